@@ -16,6 +16,9 @@
 
 #include "commands/explain.h"
 #include "executor/instrument.h"
+#ifdef PGXC
+#include "pgxc/pgxc.h"
+#endif
 #include "utils/guc.h"
 
 PG_MODULE_MAGIC;
@@ -29,6 +32,10 @@ static bool auto_explain_log_triggers = false;
 static bool auto_explain_log_timing = true;
 static int	auto_explain_log_format = EXPLAIN_FORMAT_TEXT;
 static bool auto_explain_log_nested_statements = false;
+static double auto_explain_sample_rate = 1;
+#ifdef PGXC
+static bool auto_explain_log_fragments = false;
+#endif
 
 static const struct config_enum_entry format_options[] = {
 	{"text", EXPLAIN_FORMAT_TEXT, false},
@@ -41,6 +48,9 @@ static const struct config_enum_entry format_options[] = {
 /* Current nesting depth of ExecutorRun calls */
 static int	nesting_level = 0;
 
+/* Is the current top-level query to be sampled? */
+static bool current_query_sampled = false;
+
 /* Saved hook values in case of unload */
 static ExecutorStart_hook_type prev_ExecutorStart = NULL;
 static ExecutorRun_hook_type prev_ExecutorRun = NULL;
@@ -49,7 +59,18 @@ static ExecutorEnd_hook_type prev_ExecutorEnd = NULL;
 
 #define auto_explain_enabled() \
 	(auto_explain_log_min_duration >= 0 && \
-	 (nesting_level == 0 || auto_explain_log_nested_statements))
+	 (nesting_level == 0 || auto_explain_log_nested_statements) && \
+	 current_query_sampled)
+
+#ifdef PGXC
+/*
+ * A Datanode runs the fragments of the statements of the Coordinators. The
+ * Coordinator logs them within the plan of its statement, so they are only
+ * logged on the Datanode on request.
+ */
+#define auto_explain_is_fragment() \
+	(IS_PGXC_DATANODE && IsConnFromCoord())
+#endif
 
 void		_PG_init(void);
 void		_PG_fini(void);
@@ -159,6 +180,32 @@ _PG_init(void)
 							 NULL,
 							 NULL);
 
+	DefineCustomRealVariable("auto_explain.sample_rate",
+							 "Fraction of queries to process.",
+							 NULL,
+							 &auto_explain_sample_rate,
+							 1.0,
+							 0.0,
+							 1.0,
+							 PGC_SUSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+#ifdef PGXC
+	DefineCustomBoolVariable("auto_explain.log_fragments",
+							 "Log the fragments a Datanode runs for the Coordinators.",
+							 "Only the fragments of the statements the Coordinator analyzes are logged.",
+							 &auto_explain_log_fragments,
+							 false,
+							 PGC_SUSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+#endif
+
 	EmitWarningsOnPlaceholders("auto_explain");
 
 	/* Install hooks. */
@@ -191,6 +238,24 @@ _PG_fini(void)
 static void
 explain_ExecutorStart(QueryDesc *queryDesc, int eflags)
 {
+	/*
+	 * For rate sampling, randomly choose top-level statement. Either all
+	 * nested statements will be explained or none will.
+	 */
+	if (auto_explain_log_min_duration >= 0 && nesting_level == 0)
+		current_query_sampled = (random() <= auto_explain_sample_rate *
+								 MAX_RANDOM_VALUE);
+#ifdef PGXC
+
+	/*
+	 * A fragment is sampled when the Coordinator has sampled its statement,
+	 * which makes the fragment collect instrumentation for it.
+	 */
+	if (auto_explain_is_fragment() && nesting_level == 0)
+		current_query_sampled = auto_explain_log_fragments &&
+			queryDesc->plannedstmt->instrumentOptions != 0;
+#endif
+
 	if (auto_explain_enabled())
 	{
 		/* Enable per-node instrumentation iff log_analyze is required. */
@@ -283,6 +348,7 @@ explain_ExecutorEnd(QueryDesc *queryDesc)
 	if (queryDesc->totaltime && auto_explain_enabled())
 	{
 		double		msec;
+		char		label[64];
 
 		/*
 		 * Make sure stats accumulation is done.  (Note: it's okay if several
@@ -327,9 +393,24 @@ explain_ExecutorEnd(QueryDesc *queryDesc)
 			 * reported.  This isn't ideal but trying to do it here would
 			 * often result in duplication.
 			 */
+			label[0] = '\0';
+#ifdef PGXC
+
+			/*
+			 * The queryId, if pg_stat_statements computes it, ties the
+			 * fragments logged by the Datanodes to the statement.
+			 */
+			if (auto_explain_is_fragment())
+				snprintf(label, sizeof(label), "fragment of query %u ",
+						 queryDesc->plannedstmt->queryId);
+			else if (queryDesc->plannedstmt->queryId != 0)
+				snprintf(label, sizeof(label), "query %u ",
+						 queryDesc->plannedstmt->queryId);
+#endif
+
 			ereport(LOG,
-					(errmsg("duration: %.3f ms  plan:\n%s",
-							msec, es->str->data),
+					(errmsg("duration: %.3f ms  %splan:\n%s",
+							msec, label, es->str->data),
 					 errhidestmt(true)));
 
 			pfree(es->str->data);
@@ -0,0 +1,351 @@
+/*-------------------------------------------------------------------------
+ *
+ * llvmjit.c
+ *	  JIT provider compiling expressions and tuple deforming with LLVM
+ *
+ * Each plan node gets a module holding a function for each of its quals
+ * and target list entries worth compiling, and one deforming the tuples
+ * of the relation it scans. The module is optimized and emitted by MCJIT
+ * when the node is initialized, and the functions are put in place of
+ * the interpreted ones. The code lives until the end of the execution.
+ *
+ * To use it, set jit_provider to 'llvmjit'.
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * contrib/llvmjit/llvmjit.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "llvmjit.h"
+
+#include <llvm-c/Analysis.h>
+#include <llvm-c/Target.h>
+#include <llvm-c/Transforms/InstCombine.h>
+#include <llvm-c/Transforms/Scalar.h>
+#include <llvm-c/Transforms/Utils.h>
+
+#include "fmgr.h"
+#include "utils/memutils.h"
+
+PG_MODULE_MAGIC;
+
+void		_PG_jit_provider_init(JitProviderCallbacks *callbacks);
+
+LLVMTypeRef llvmjit_datum_type;
+LLVMTypeRef llvmjit_bool_type;
+LLVMTypeRef llvmjit_int_type;
+LLVMTypeRef llvmjit_long_type;
+LLVMTypeRef llvmjit_ptr_type;
+
+static JitContext *llvmjit_create_context(EState *estate);
+static void llvmjit_compile_planstate(JitContext *context,
+						  PlanState *planstate);
+static void llvmjit_release_context(JitContext *context);
+static void llvmjit_emit_module(LLVMJitModule *jm);
+
+
+/*
+ * Entry point of the provider.
+ */
+void
+_PG_jit_provider_init(JitProviderCallbacks *callbacks)
+{
+	static bool initialized = false;
+
+	if (!initialized)
+	{
+		LLVMLinkInMCJIT();
+		if (LLVMInitializeNativeTarget() ||
+			LLVMInitializeNativeAsmPrinter())
+			elog(ERROR, "could not initialize LLVM for the native target");
+
+		llvmjit_datum_type = LLVMIntType(sizeof(Datum) * BITS_PER_BYTE);
+		llvmjit_bool_type = LLVMIntType(sizeof(bool) * BITS_PER_BYTE);
+		llvmjit_int_type = LLVMIntType(sizeof(int) * BITS_PER_BYTE);
+		llvmjit_long_type = LLVMIntType(sizeof(long) * BITS_PER_BYTE);
+		llvmjit_ptr_type = LLVMPointerType(LLVMInt8Type(), 0);
+
+		initialized = true;
+	}
+
+	callbacks->create_context = llvmjit_create_context;
+	callbacks->compile_planstate = llvmjit_compile_planstate;
+	callbacks->release_context = llvmjit_release_context;
+}
+
+static JitContext *
+llvmjit_create_context(EState *estate)
+{
+	return (JitContext *) palloc0(sizeof(LLVMJitContext));
+}
+
+/*
+ * Free the code. The execution engines own their module.
+ */
+static void
+llvmjit_release_context(JitContext *context)
+{
+	LLVMJitContext *lcontext = (LLVMJitContext *) context;
+	ListCell   *lc;
+
+	foreach(lc, lcontext->engines)
+		LLVMDisposeExecutionEngine((LLVMExecutionEngineRef) lfirst(lc));
+	lcontext->engines = NIL;
+}
+
+/*
+ * Compile the quals, the target list and the deforming of the scanned
+ * tuples of a plan node.
+ */
+static void
+llvmjit_compile_planstate(JitContext *context, PlanState *planstate)
+{
+	LLVMJitModule jm;
+	ListCell   *lc;
+
+	jm.context = (LLVMJitContext *) context;
+	jm.module = NULL;
+	jm.builder = NULL;
+	jm.functions = NIL;
+
+	foreach(lc, planstate->qual)
+		llvmjit_compile_expr(&jm, (ExprState *) lfirst(lc));
+
+	foreach(lc, planstate->targetlist)
+	{
+		GenericExprState *gstate = (GenericExprState *) lfirst(lc);
+
+		llvmjit_compile_expr(&jm, gstate->arg);
+	}
+
+	switch (nodeTag(planstate))
+	{
+		case T_NestLoopState:
+		case T_MergeJoinState:
+		case T_HashJoinState:
+			foreach(lc, ((JoinState *) planstate)->joinqual)
+				llvmjit_compile_expr(&jm, (ExprState *) lfirst(lc));
+			break;
+
+		case T_SeqScanState:
+		case T_SampleScanState:
+		case T_IndexScanState:
+		case T_BitmapHeapScanState:
+		case T_TidScanState:
+			llvmjit_compile_deform(&jm, ((ScanState *) planstate)->ss_ScanTupleSlot);
+			break;
+
+		default:
+			break;
+	}
+
+	if (jm.functions != NIL)
+		llvmjit_emit_module(&jm);
+}
+
+/*
+ * Name a new function of the module, creating the module if needed.
+ */
+char *
+llvmjit_function_name(LLVMJitModule *jm, const char *kind)
+{
+	if (jm->module == NULL)
+	{
+		char		name[NAMEDATALEN];
+
+		snprintf(name, sizeof(name), "pgjit_%d", jm->context->nmodules++);
+		jm->module = LLVMModuleCreateWithName(name);
+		jm->builder = LLVMCreateBuilder();
+	}
+
+	return psprintf("%s_%d", kind, list_length(jm->functions));
+}
+
+/*
+ * Register a function of the module, to be put in place once emitted.
+ */
+void
+llvmjit_add_function(LLVMJitModule *jm, char *name, LLVMJitTarget target,
+					 void *object)
+{
+	LLVMJitFunction *func = (LLVMJitFunction *) palloc(sizeof(LLVMJitFunction));
+
+	func->name = name;
+	func->target = target;
+	func->object = object;
+	jm->functions = lappend(jm->functions, func);
+}
+
+/*
+ * Optimize the module, emit it, and install its functions.
+ */
+static void
+llvmjit_emit_module(LLVMJitModule *jm)
+{
+	LLVMJitContext *context = jm->context;
+	struct LLVMMCJITCompilerOptions options;
+	LLVMExecutionEngineRef engine;
+	LLVMPassManagerRef fpm;
+	LLVMValueRef fn;
+	char	   *error = NULL;
+	ListCell   *lc;
+
+	LLVMDisposeBuilder(jm->builder);
+	jm->builder = NULL;
+
+#ifdef USE_ASSERT_CHECKING
+	if (LLVMVerifyModule(jm->module, LLVMReturnStatusAction, &error))
+		elog(ERROR, "generated invalid code: %s", error);
+	LLVMDisposeMessage(error);
+	error = NULL;
+#endif
+
+	fpm = LLVMCreateFunctionPassManagerForModule(jm->module);
+	LLVMAddPromoteMemoryToRegisterPass(fpm);
+	LLVMAddInstructionCombiningPass(fpm);
+	LLVMAddCFGSimplificationPass(fpm);
+	LLVMAddGVNPass(fpm);
+	LLVMAddDeadStoreEliminationPass(fpm);
+	LLVMInitializeFunctionPassManager(fpm);
+	for (fn = LLVMGetFirstFunction(jm->module); fn != NULL;
+		 fn = LLVMGetNextFunction(fn))
+	{
+		if (!LLVMIsDeclaration(fn))
+			LLVMRunFunctionPassManager(fpm, fn);
+	}
+	LLVMFinalizeFunctionPassManager(fpm);
+	LLVMDisposePassManager(fpm);
+
+	LLVMInitializeMCJITCompilerOptions(&options, sizeof(options));
+	options.OptLevel = 2;
+	if (LLVMCreateMCJITCompilerForModule(&engine, jm->module, &options,
+										 sizeof(options), &error))
+	{
+		char	   *msg = pstrdup(error);
+
+		LLVMDisposeMessage(error);
+		LLVMDisposeModule(jm->module);
+		elog(ERROR, "could not create execution engine: %s", msg);
+	}
+
+	/* From now on the engine is freed with the context */
+	context->engines = lappend(context->engines, engine);
+
+	foreach(lc, jm->functions)
+	{
+		LLVMJitFunction *func = (LLVMJitFunction *) lfirst(lc);
+		uint64		addr = LLVMGetFunctionAddress(engine, func->name);
+
+		if (addr == 0)
+			elog(ERROR, "could not find compiled function \"%s\"", func->name);
+
+		switch (func->target)
+		{
+			case LLVMJIT_EXPR:
+				((ExprState *) func->object)->evalfunc =
+					(ExprStateEvalFunc) (uintptr_t) addr;
+				break;
+			case LLVMJIT_DEFORM:
+				{
+					TupleTableSlot *slot = (TupleTableSlot *) func->object;
+
+					slot->tts_deform = (void (*) (TupleTableSlot *, int))
+						(uintptr_t) addr;
+					context->deform_descs = lappend(context->deform_descs,
+											   slot->tts_tupleDescriptor);
+					context->deform_funcs = lappend(context->deform_funcs,
+													slot->tts_deform);
+				}
+				break;
+		}
+		context->base.ncompiled++;
+	}
+
+	elog(DEBUG2, "compiled %d functions into module %d",
+		 list_length(jm->functions), context->nmodules - 1);
+
+	jm->module = NULL;
+}
+
+/*
+ * Return a pointer of the given type to the field at offset in the object
+ * pointed to by base, an i8 pointer.
+ */
+LLVMValueRef
+llvmjit_field(LLVMBuilderRef b, LLVMValueRef base, size_t offset,
+			  LLVMTypeRef type)
+{
+	LLVMValueRef idx = LLVMConstInt(LLVMInt64Type(), offset, false);
+	LLVMValueRef ptr;
+
+	ptr = LLVMBuildGEP2(b, LLVMInt8Type(), base, &idx, 1, "");
+	return LLVMBuildBitCast(b, ptr, LLVMPointerType(type, 0), "");
+}
+
+LLVMValueRef
+llvmjit_load(LLVMBuilderRef b, LLVMValueRef base, size_t offset,
+			 LLVMTypeRef type)
+{
+	return LLVMBuildLoad2(b, type, llvmjit_field(b, base, offset, type), "");
+}
+
+void
+llvmjit_store(LLVMBuilderRef b, LLVMValueRef value, LLVMValueRef base,
+			  size_t offset)
+{
+	LLVMBuildStore(b, value,
+				   llvmjit_field(b, base, offset, LLVMTypeOf(value)));
+}
+
+/*
+ * An i8 pointer constant. The code is emitted in this process, so it may
+ * point to anything living as long as the execution.
+ */
+LLVMValueRef
+llvmjit_pointer(void *ptr)
+{
+	return LLVMConstIntToPtr(LLVMConstInt(LLVMInt64Type(),
+										  (uint64) (uintptr_t) ptr, false),
+							 llvmjit_ptr_type);
+}
+
+/*
+ * Allocate a variable in the entry block of the function, where mem2reg
+ * can turn it into a register.
+ */
+LLVMValueRef
+llvmjit_entry_alloca(LLVMValueRef fn, LLVMTypeRef type, const char *name)
+{
+	LLVMBasicBlockRef entry = LLVMGetEntryBasicBlock(fn);
+	LLVMValueRef first = LLVMGetFirstInstruction(entry);
+	LLVMBuilderRef b = LLVMCreateBuilder();
+	LLVMValueRef var;
+
+	if (first != NULL)
+		LLVMPositionBuilderBefore(b, first);
+	else
+		LLVMPositionBuilderAtEnd(b, entry);
+	var = LLVMBuildAlloca(b, type, name);
+	LLVMDisposeBuilder(b);
+
+	return var;
+}
+
+/*
+ * Call a function of the server by its address.
+ */
+LLVMValueRef
+llvmjit_call(LLVMBuilderRef b, void *func, LLVMTypeRef functype,
+			 LLVMValueRef *args, int nargs)
+{
+	LLVMValueRef fn;
+
+	fn = LLVMConstIntToPtr(LLVMConstInt(LLVMInt64Type(),
+										(uint64) (uintptr_t) func, false),
+						   LLVMPointerType(functype, 0));
+	return LLVMBuildCall2(b, functype, fn, args, nargs, "");
+}
@@ -0,0 +1,83 @@
+/*-------------------------------------------------------------------------
+ *
+ * llvmjit.h
+ *	  Declarations shared by the parts of the LLVM JIT provider
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * contrib/llvmjit/llvmjit.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef LLVMJIT_H
+#define LLVMJIT_H
+
+#include "jit/jit.h"
+
+#include <llvm-c/Core.h>
+#include <llvm-c/ExecutionEngine.h>
+
+/* Compiled code of one execution */
+typedef struct LLVMJitContext
+{
+	JitContext	base;
+	List	   *engines;		/* execution engine of each emitted module */
+	List	   *deform_descs;	/* descriptors with a deform function... */
+	List	   *deform_funcs;	/* ... and the address of that function */
+	int			nmodules;		/* modules made so far, for naming */
+} LLVMJitContext;
+
+/* What to do with a function of a module once emitted */
+typedef enum LLVMJitTarget
+{
+	LLVMJIT_EXPR,				/* set the evalfunc of an ExprState */
+	LLVMJIT_DEFORM				/* set the tts_deform of a slot */
+} LLVMJitTarget;
+
+typedef struct LLVMJitFunction
+{
+	char	   *name;
+	LLVMJitTarget target;
+	void	   *object;			/* the ExprState or the slot */
+} LLVMJitFunction;
+
+/* Module being built for the expressions of one plan node */
+typedef struct LLVMJitModule
+{
+	LLVMJitContext *context;
+	LLVMModuleRef module;
+	LLVMBuilderRef builder;
+	List	   *functions;		/* LLVMJitFunction of the module */
+} LLVMJitModule;
+
+/* Types matching those of the server */
+extern LLVMTypeRef llvmjit_datum_type;
+extern LLVMTypeRef llvmjit_bool_type;
+extern LLVMTypeRef llvmjit_int_type;
+extern LLVMTypeRef llvmjit_long_type;
+extern LLVMTypeRef llvmjit_ptr_type;
+
+/* llvmjit.c */
+extern char *llvmjit_function_name(LLVMJitModule *jm, const char *kind);
+extern void llvmjit_add_function(LLVMJitModule *jm, char *name,
+					 LLVMJitTarget target, void *object);
+extern LLVMValueRef llvmjit_field(LLVMBuilderRef b, LLVMValueRef base,
+			  size_t offset, LLVMTypeRef type);
+extern LLVMValueRef llvmjit_load(LLVMBuilderRef b, LLVMValueRef base,
+			 size_t offset, LLVMTypeRef type);
+extern void llvmjit_store(LLVMBuilderRef b, LLVMValueRef value,
+			  LLVMValueRef base, size_t offset);
+extern LLVMValueRef llvmjit_pointer(void *ptr);
+extern LLVMValueRef llvmjit_entry_alloca(LLVMValueRef fn, LLVMTypeRef type,
+					 const char *name);
+extern LLVMValueRef llvmjit_call(LLVMBuilderRef b, void *func,
+			 LLVMTypeRef functype, LLVMValueRef *args, int nargs);
+
+/* llvmjit_deform.c */
+extern bool llvmjit_compile_deform(LLVMJitModule *jm, TupleTableSlot *slot);
+
+/* llvmjit_expr.c */
+extern bool llvmjit_compile_expr(LLVMJitModule *jm, ExprState *state);
+
+#endif   /* LLVMJIT_H */
@@ -0,0 +1,334 @@
+/*-------------------------------------------------------------------------
+ *
+ * llvmjit_deform.c
+ *	  Compile the deforming of the tuples of a given descriptor
+ *
+ * The generated function does what slot_deform_tuple does, with the
+ * length, alignment and nullability of every attribute known in advance,
+ * so the generic loop and its tests are gone. Attributes after a null or
+ * variable length one still have their offset computed at run time.
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * contrib/llvmjit/llvmjit_deform.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "llvmjit.h"
+
+#include "access/htup_details.h"
+#include "access/tupmacs.h"
+#include "executor/tuptable.h"
+
+static Size llvmjit_varsize_any(Pointer ptr);
+static Size llvmjit_cstring_size(Pointer ptr);
+static int	llvmjit_align(char attalign);
+
+/*
+ * Functions for the lengths the generated code does not compute itself.
+ */
+static Size
+llvmjit_varsize_any(Pointer ptr)
+{
+	return VARSIZE_ANY(ptr);
+}
+
+static Size
+llvmjit_cstring_size(Pointer ptr)
+{
+	return strlen(ptr) + 1;
+}
+
+static int
+llvmjit_align(char attalign)
+{
+	switch (attalign)
+	{
+		case 'i':
+			return ALIGNOF_INT;
+		case 'c':
+			return 1;
+		case 'd':
+			return ALIGNOF_DOUBLE;
+		case 's':
+			return ALIGNOF_SHORT;
+		default:
+			elog(ERROR, "unrecognized alignment \"%c\"", attalign);
+			return 0;			/* keep compiler quiet */
+	}
+}
+
+/*
+ * llvmjit_compile_deform
+ *		Add to the module a function deforming the tuples stored in the
+ *		slot, to be set as its tts_deform.
+ *
+ * The function has the signature of slot_deform_tuple. It deforms the
+ * tuple from its first attribute on each call.
+ */
+bool
+llvmjit_compile_deform(LLVMJitModule *jm, TupleTableSlot *slot)
+{
+	LLVMJitContext *context = jm->context;
+	TupleDesc	desc = slot->tts_tupleDescriptor;
+	LLVMBuilderRef b;
+	LLVMTypeRef params[2];
+	LLVMTypeRef sizefunc_type;
+	LLVMValueRef fn;
+	LLVMValueRef v_slot;
+	LLVMValueRef v_natts;
+	LLVMValueRef v_tuple;
+	LLVMValueRef v_tup;
+	LLVMValueRef v_values;
+	LLVMValueRef v_isnull;
+	LLVMValueRef v_hasnulls;
+	LLVMValueRef v_tp;
+	LLVMValueRef v_bits;
+	LLVMValueRef v_off;
+	LLVMBasicBlockRef done;
+	ListCell   *ld;
+	ListCell   *lf;
+	char	   *name;
+	int			attnum;
+	bool		charsigned = ((char) -1) < 0;
+
+	if (desc == NULL || desc->natts == 0)
+		return false;
+
+	/* The same descriptor may have been compiled for another node */
+	forboth(ld, context->deform_descs, lf, context->deform_funcs)
+	{
+		if (lfirst(ld) == desc)
+		{
+			slot->tts_deform = (void (*) (TupleTableSlot *, int)) lfirst(lf);
+			return true;
+		}
+	}
+
+	for (attnum = 0; attnum < desc->natts; attnum++)
+	{
+		Form_pg_attribute att = desc->attrs[attnum];
+
+		if (att->attbyval &&
+			att->attlen != 1 && att->attlen != 2 &&
+			att->attlen != 4 && att->attlen != 8)
+			return false;
+		if (!att->attbyval && att->attlen <= 0 &&
+			att->attlen != -1 && att->attlen != -2)
+			return false;
+	}
+
+	name = llvmjit_function_name(jm, "deform");
+	b = jm->builder;
+
+	params[0] = llvmjit_ptr_type;
+	params[1] = llvmjit_int_type;
+	fn = LLVMAddFunction(jm->module, name,
+						 LLVMFunctionType(LLVMVoidType(), params, 2, false));
+	params[0] = llvmjit_ptr_type;
+	sizefunc_type = LLVMFunctionType(LLVMInt64Type(), params, 1, false);
+
+	LLVMPositionBuilderAtEnd(b, LLVMAppendBasicBlock(fn, "entry"));
+	v_slot = LLVMGetParam(fn, 0);
+	v_natts = LLVMGetParam(fn, 1);
+
+	v_tuple = llvmjit_load(b, v_slot, offsetof(TupleTableSlot, tts_tuple),
+						   llvmjit_ptr_type);
+	v_tup = llvmjit_load(b, v_tuple, offsetof(HeapTupleData, t_data),
+						 llvmjit_ptr_type);
+	v_values = llvmjit_load(b, v_slot, offsetof(TupleTableSlot, tts_values),
+							LLVMPointerType(llvmjit_datum_type, 0));
+	v_isnull = llvmjit_load(b, v_slot, offsetof(TupleTableSlot, tts_isnull),
+							llvmjit_ptr_type);
+	v_hasnulls = LLVMBuildICmp(b, LLVMIntNE,
+							   LLVMBuildAnd(b,
+											llvmjit_load(b, v_tup,
+														 offsetof(HeapTupleHeaderData, t_infomask),
+														 LLVMInt16Type()),
+								   LLVMConstInt(LLVMInt16Type(), HEAP_HASNULL, false),
+											""),
+							   LLVMConstInt(LLVMInt16Type(), 0, false),
+							   "hasnulls");
+	{
+		LLVMValueRef idx = LLVMBuildZExt(b,
+										 llvmjit_load(b, v_tup,
+													  offsetof(HeapTupleHeaderData, t_hoff),
+													  LLVMInt8Type()),
+										 LLVMInt64Type(), "");
+
+		v_tp = LLVMBuildGEP2(b, LLVMInt8Type(), v_tup, &idx, 1, "tp");
+	}
+	v_bits = llvmjit_field(b, v_tup, offsetof(HeapTupleHeaderData, t_bits),
+						   LLVMInt8Type());
+	v_off = llvmjit_entry_alloca(fn, LLVMInt64Type(), "off");
+	LLVMBuildStore(b, LLVMConstInt(LLVMInt64Type(), 0, false), v_off);
+
+	done = LLVMAppendBasicBlock(fn, "done");
+
+	for (attnum = 0; attnum < desc->natts; attnum++)
+	{
+		Form_pg_attribute att = desc->attrs[attnum];
+		LLVMBasicBlockRef nullcheck = NULL;
+		LLVMBasicBlockRef fetch;
+		LLVMBasicBlockRef next;
+		LLVMValueRef v_attnum = LLVMConstInt(LLVMInt64Type(), attnum, false);
+		LLVMValueRef v_valueptr;
+		LLVMValueRef v_nullptr;
+		LLVMValueRef off;
+		LLVMValueRef attptr;
+		LLVMValueRef value;
+		int			align = llvmjit_align(att->attalign);
+
+		if (!att->attnotnull)
+			nullcheck = LLVMAppendBasicBlock(fn, "nullcheck");
+		fetch = LLVMAppendBasicBlock(fn, "fetch");
+		next = LLVMAppendBasicBlock(fn, "next");
+
+		/* Stop once natts attributes are done */
+		LLVMBuildCondBr(b,
+						LLVMBuildICmp(b, LLVMIntSGE, v_natts,
+							   LLVMConstInt(llvmjit_int_type, attnum + 1, false),
+									  ""),
+						nullcheck ? nullcheck : fetch,
+						done);
+
+		if (nullcheck)
+		{
+			LLVMBasicBlockRef isnullblock = LLVMAppendBasicBlock(fn, "isnull");
+			LLVMBasicBlockRef bitblock = LLVMAppendBasicBlock(fn, "nullbit");
+			LLVMValueRef byte;
+			LLVMValueRef idx;
+
+			LLVMPositionBuilderAtEnd(b, nullcheck);
+			LLVMBuildCondBr(b, v_hasnulls, bitblock, fetch);
+
+			LLVMPositionBuilderAtEnd(b, bitblock);
+			idx = LLVMConstInt(LLVMInt64Type(), attnum >> 3, false);
+			byte = LLVMBuildLoad2(b, LLVMInt8Type(),
+								  LLVMBuildGEP2(b, LLVMInt8Type(), v_bits,
+												&idx, 1, ""),
+								  "");
+			LLVMBuildCondBr(b,
+							LLVMBuildICmp(b, LLVMIntEQ,
+										  LLVMBuildAnd(b, byte,
+											  LLVMConstInt(LLVMInt8Type(),
+												 1 << (attnum & 0x07), false),
+													   ""),
+										  LLVMConstInt(LLVMInt8Type(), 0, false),
+										  ""),
+							isnullblock, fetch);
+
+			LLVMPositionBuilderAtEnd(b, isnullblock);
+			v_valueptr = LLVMBuildGEP2(b, llvmjit_datum_type, v_values,
+									   &v_attnum, 1, "");
+			LLVMBuildStore(b, LLVMConstInt(llvmjit_datum_type, 0, false),
+						   v_valueptr);
+			v_nullptr = LLVMBuildGEP2(b, llvmjit_bool_type, v_isnull,
+									  &v_attnum, 1, "");
+			LLVMBuildStore(b, LLVMConstInt(llvmjit_bool_type, 1, false),
+						   v_nullptr);
+			LLVMBuildBr(b, next);
+		}
+
+		LLVMPositionBuilderAtEnd(b, fetch);
+		v_nullptr = LLVMBuildGEP2(b, llvmjit_bool_type, v_isnull,
+								  &v_attnum, 1, "");
+		LLVMBuildStore(b, LLVMConstInt(llvmjit_bool_type, 0, false),
+					   v_nullptr);
+
+		/* Align the offset, as att_align_pointer does */
+		off = LLVMBuildLoad2(b, LLVMInt64Type(), v_off, "");
+		if (align > 1)
+		{
+			LLVMValueRef aligned;
+
+			aligned = LLVMBuildAnd(b,
+								   LLVMBuildAdd(b, off,
+									  LLVMConstInt(LLVMInt64Type(), align - 1,
+												   false), ""),
+								   LLVMConstInt(LLVMInt64Type(),
+												~((uint64) align - 1), false),
+								   "");
+			if (att->attlen == -1)
+			{
+				/* A short varlena header is never preceded by padding */
+				LLVMValueRef first;
+
+				first = LLVMBuildLoad2(b, LLVMInt8Type(),
+									   LLVMBuildGEP2(b, LLVMInt8Type(), v_tp,
+													 &off, 1, ""),
+									   "");
+				aligned = LLVMBuildSelect(b,
+										  LLVMBuildICmp(b, LLVMIntEQ, first,
+											   LLVMConstInt(LLVMInt8Type(), 0,
+															false), ""),
+										  aligned, off, "");
+			}
+			off = aligned;
+		}
+		attptr = LLVMBuildGEP2(b, LLVMInt8Type(), v_tp, &off, 1, "attptr");
+
+		if (att->attbyval)
+		{
+			LLVMTypeRef type = LLVMIntType(att->attlen * BITS_PER_BYTE);
+
+			value = LLVMBuildLoad2(b, type,
+								   LLVMBuildBitCast(b, attptr,
+													LLVMPointerType(type, 0),
+													""),
+								   "");
+			if (att->attlen < sizeof(Datum))
+			{
+				/* fetch_att extends the value as a signed one */
+				if (att->attlen == 1 && !charsigned)
+					value = LLVMBuildZExt(b, value, llvmjit_datum_type, "");
+				else
+					value = LLVMBuildSExt(b, value, llvmjit_datum_type, "");
+			}
+		}
+		else
+			value = LLVMBuildPtrToInt(b, attptr, llvmjit_datum_type, "");
+
+		v_valueptr = LLVMBuildGEP2(b, llvmjit_datum_type, v_values,
+								   &v_attnum, 1, "");
+		LLVMBuildStore(b, value, v_valueptr);
+
+		/* Move past the value */
+		if (att->attlen > 0)
+			off = LLVMBuildAdd(b, off,
+							   LLVMConstInt(LLVMInt64Type(), att->attlen, false),
+							   "");
+		else
+			off = LLVMBuildAdd(b, off,
+							   llvmjit_call(b,
+											att->attlen == -1 ?
+											(void *) llvmjit_varsize_any :
+											(void *) llvmjit_cstring_size,
+											sizefunc_type, &attptr, 1),
+							   "");
+		LLVMBuildStore(b, off, v_off);
+		LLVMBuildBr(b, next);
+
+		LLVMPositionBuilderAtEnd(b, next);
+	}
+	LLVMBuildBr(b, done);
+
+	/* Save the state slot_deform_tuple would leave */
+	LLVMPositionBuilderAtEnd(b, done);
+	llvmjit_store(b, v_natts, v_slot, offsetof(TupleTableSlot, tts_nvalid));
+	llvmjit_store(b,
+				  LLVMBuildIntCast2(b,
+							   LLVMBuildLoad2(b, LLVMInt64Type(), v_off, ""),
+									llvmjit_long_type, true, ""),
+				  v_slot, offsetof(TupleTableSlot, tts_off));
+	llvmjit_store(b, LLVMConstInt(llvmjit_bool_type, 1, false),
+				  v_slot, offsetof(TupleTableSlot, tts_slow));
+	LLVMBuildRetVoid(b);
+
+	llvmjit_add_function(jm, name, LLVMJIT_DEFORM, slot);
+
+	return true;
+}
@@ -0,0 +1,584 @@
+/*-------------------------------------------------------------------------
+ *
+ * llvmjit_expr.c
+ *	  Compile expression state trees
+ *
+ * An expression is compiled into a function with the signature of an
+ * ExprState evalfunc, set in place of the evalfunc of the top node. Vars,
+ * constants, strict and non-strict function and operator calls, AND, OR,
+ * NOT and scalar IS [NOT] NULL tests are compiled in line: argument values
+ * go straight into a FunctionCallInfo set up in advance, and the function
+ * is called by its address. Any other node is evaluated by calling its own
+ * evalfunc, so every tree can be compiled, the parts the compiler does not
+ * know about being interpreted as before.
+ *
+ * Only expressions returning a single value are compiled.
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * contrib/llvmjit/llvmjit_expr.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "llvmjit.h"
+
+#include "catalog/objectaccess.h"
+#include "miscadmin.h"
+#include "nodes/nodeFuncs.h"
+#include "pgstat.h"
+#include "utils/acl.h"
+
+typedef struct ExprBuild
+{
+	LLVMJitModule *jm;
+	LLVMBuilderRef b;
+	LLVMValueRef fn;
+	LLVMValueRef econtext;
+	LLVMValueRef nullbuf;		/* bool set by the functions called */
+} ExprBuild;
+
+static bool expr_native(ExprState *state);
+static LLVMValueRef build_expr(ExprBuild *eb, ExprState *state,
+		   LLVMValueRef *isnull);
+static LLVMValueRef build_fallback(ExprBuild *eb, ExprState *state,
+			   LLVMValueRef *isnull);
+static LLVMValueRef build_var(ExprBuild *eb, Var *var, LLVMValueRef *isnull);
+static LLVMValueRef build_func(ExprBuild *eb, FuncExprState *fstate,
+		   Oid funcid, Oid inputcollid, LLVMValueRef *isnull);
+static LLVMValueRef build_bool(ExprBuild *eb, BoolExprState *bstate,
+		   LLVMValueRef *isnull);
+static LLVMValueRef build_istrue(ExprBuild *eb, LLVMValueRef value);
+
+
+/*
+ * llvmjit_compile_expr
+ *		Add to the module a function evaluating the expression, to be set
+ *		as its evalfunc.
+ */
+bool
+llvmjit_compile_expr(LLVMJitModule *jm, ExprState *state)
+{
+	ExprBuild	eb;
+	LLVMTypeRef params[4];
+	LLVMValueRef value;
+	LLVMValueRef isnull;
+	LLVMValueRef isdone;
+	LLVMBasicBlockRef setdone;
+	LLVMBasicBlockRef ret;
+	char	   *name;
+
+	if (state == NULL || state->expr == NULL)
+		return false;
+
+	/* Plain Vars and constants gain nothing */
+	switch (nodeTag(state->expr))
+	{
+		case T_FuncExpr:
+		case T_OpExpr:
+		case T_BoolExpr:
+		case T_NullTest:
+			break;
+		default:
+			return false;
+	}
+
+	/* The top node has to be compiled, its evalfunc is going away */
+	if (!expr_native(state))
+		return false;
+	if (expression_returns_set((Node *) state->expr))
+		return false;
+
+	name = llvmjit_function_name(jm, "expr");
+
+	params[0] = params[1] = params[2] = params[3] = llvmjit_ptr_type;
+	eb.jm = jm;
+	eb.b = jm->builder;
+	eb.fn = LLVMAddFunction(jm->module, name,
+							LLVMFunctionType(llvmjit_datum_type, params, 4,
+											 false));
+	LLVMPositionBuilderAtEnd(eb.b, LLVMAppendBasicBlock(eb.fn, "entry"));
+	eb.econtext = LLVMGetParam(eb.fn, 1);
+	eb.nullbuf = llvmjit_entry_alloca(eb.fn, llvmjit_bool_type, "nullbuf");
+
+	value = build_expr(&eb, state, &isnull);
+
+	LLVMBuildStore(eb.b, LLVMBuildZExt(eb.b, isnull, llvmjit_bool_type, ""),
+				   LLVMGetParam(eb.fn, 2));
+
+	/* *isDone = ExprSingleResult, if asked for */
+	setdone = LLVMAppendBasicBlock(eb.fn, "setdone");
+	ret = LLVMAppendBasicBlock(eb.fn, "return");
+	isdone = LLVMGetParam(eb.fn, 3);
+	LLVMBuildCondBr(eb.b, LLVMBuildIsNotNull(eb.b, isdone, ""), setdone, ret);
+	LLVMPositionBuilderAtEnd(eb.b, setdone);
+	llvmjit_store(eb.b,
+				  LLVMConstInt(LLVMIntType(sizeof(ExprDoneCond) * BITS_PER_BYTE),
+							   ExprSingleResult, false),
+				  isdone, 0);
+	LLVMBuildBr(eb.b, ret);
+	LLVMPositionBuilderAtEnd(eb.b, ret);
+	LLVMBuildRet(eb.b, value);
+
+	llvmjit_add_function(jm, name, LLVMJIT_EXPR, state);
+
+	return true;
+}
+
+/*
+ * Can the node be compiled in line, as opposed to calling its evalfunc?
+ */
+static bool
+expr_native(ExprState *state)
+{
+	Expr	   *expr = state->expr;
+
+	switch (nodeTag(expr))
+	{
+		case T_Const:
+			return true;
+
+		case T_Var:
+			return ((Var *) expr)->varattno > 0;
+
+		case T_FuncExpr:
+		case T_OpExpr:
+			{
+				Oid			funcid;
+				FmgrInfo	flinfo;
+
+				if (IsA(expr, FuncExpr))
+				{
+					if (((FuncExpr *) expr)->funcretset)
+						return false;
+					funcid = ((FuncExpr *) expr)->funcid;
+				}
+				else
+				{
+					if (((OpExpr *) expr)->opretset)
+						return false;
+					funcid = ((OpExpr *) expr)->opfuncid;
+				}
+				if (!OidIsValid(funcid) ||
+					list_length(((FuncExprState *) state)->args) > FUNC_MAX_ARGS)
+					return false;
+
+				/* Let the interpreter report the lack of permission */
+				if (pg_proc_aclcheck(funcid, GetUserId(),
+									 ACL_EXECUTE) != ACLCHECK_OK)
+					return false;
+
+				/* Nor can the calls be counted by track_functions here */
+				fmgr_info(funcid, &flinfo);
+				if (flinfo.fn_retset ||
+					pgstat_track_functions > flinfo.fn_stats)
+					return false;
+				return true;
+			}
+
+		case T_BoolExpr:
+			return true;
+
+		case T_NullTest:
+			return !((NullTest *) expr)->argisrow;
+
+		case T_RelabelType:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+/*
+ * Generate the evaluation of the node, returning its value as a Datum and
+ * setting *isnull to an i1 telling whether it is null.
+ */
+static LLVMValueRef
+build_expr(ExprBuild *eb, ExprState *state, LLVMValueRef *isnull)
+{
+	Expr	   *expr = state->expr;
+
+	if (!expr_native(state))
+		return build_fallback(eb, state, isnull);
+
+	switch (nodeTag(expr))
+	{
+		case T_Const:
+			{
+				Const	   *con = (Const *) expr;
+
+				*isnull = LLVMConstInt(LLVMInt1Type(), con->constisnull, false);
+				return LLVMConstInt(llvmjit_datum_type,
+									con->constisnull ? 0 : con->constvalue,
+									false);
+			}
+
+		case T_Var:
+			return build_var(eb, (Var *) expr, isnull);
+
+		case T_FuncExpr:
+			{
+				FuncExpr   *func = (FuncExpr *) expr;
+
+				return build_func(eb, (FuncExprState *) state, func->funcid,
+								  func->inputcollid, isnull);
+			}
+
+		case T_OpExpr:
+			{
+				OpExpr	   *op = (OpExpr *) expr;
+
+				return build_func(eb, (FuncExprState *) state, op->opfuncid,
+								  op->inputcollid, isnull);
+			}
+
+		case T_BoolExpr:
+			return build_bool(eb, (BoolExprState *) state, isnull);
+
+		case T_NullTest:
+			{
+				NullTestState *nstate = (NullTestState *) state;
+				LLVMValueRef argnull;
+				LLVMValueRef result;
+
+				build_expr(eb, nstate->arg, &argnull);
+				result = ((NullTest *) expr)->nulltesttype == IS_NULL ?
+					argnull : LLVMBuildNot(eb->b, argnull, "");
+				*isnull = LLVMConstInt(LLVMInt1Type(), 0, false);
+				return LLVMBuildZExt(eb->b, result, llvmjit_datum_type, "");
+			}
+
+		case T_RelabelType:
+			return build_expr(eb, ((GenericExprState *) state)->arg, isnull);
+
+		default:
+			elog(ERROR, "unrecognized node type: %d", (int) nodeTag(expr));
+			return NULL;		/* keep compiler quiet */
+	}
+}
+
+/*
+ * Call the evalfunc of the node. It is read at run time, since some of
+ * them replace themselves after the first call.
+ */
+static LLVMValueRef
+build_fallback(ExprBuild *eb, ExprState *state, LLVMValueRef *isnull)
+{
+	LLVMBuilderRef b = eb->b;
+	LLVMTypeRef params[4];
+	LLVMTypeRef type;
+	LLVMValueRef func;
+	LLVMValueRef args[4];
+	LLVMValueRef value;
+
+	params[0] = params[1] = params[2] = params[3] = llvmjit_ptr_type;
+	type = LLVMFunctionType(llvmjit_datum_type, params, 4, false);
+
+	func = llvmjit_load(b, llvmjit_pointer(state),
+						offsetof(ExprState, evalfunc),
+						LLVMPointerType(type, 0));
+	args[0] = llvmjit_pointer(state);
+	args[1] = eb->econtext;
+	args[2] = eb->nullbuf;
+	args[3] = LLVMConstNull(llvmjit_ptr_type);
+	value = LLVMBuildCall2(b, type, func, args, 4, "");
+
+	*isnull = build_istrue(eb, LLVMBuildLoad2(b, llvmjit_bool_type,
+											  eb->nullbuf, ""));
+	return value;
+}
+
+/*
+ * Fetch the value of a Var, from the slot arrays if it has been deformed
+ * already, from slot_getattr otherwise.
+ */
+static LLVMValueRef
+build_var(ExprBuild *eb, Var *var, LLVMValueRef *isnull)
+{
+	LLVMBuilderRef b = eb->b;
+	size_t		slotoff;
+	LLVMValueRef slot;
+	LLVMValueRef attnum;
+	LLVMValueRef idx;
+	LLVMValueRef fastvalue;
+	LLVMValueRef fastnull;
+	LLVMValueRef slowvalue;
+	LLVMValueRef slownull;
+	LLVMValueRef value;
+	LLVMValueRef null;
+	LLVMBasicBlockRef fast;
+	LLVMBasicBlockRef slow;
+	LLVMBasicBlockRef merge;
+	LLVMTypeRef params[3];
+	LLVMValueRef args[3];
+
+	switch (var->varno)
+	{
+		case INNER_VAR:
+			slotoff = offsetof(ExprContext, ecxt_innertuple);
+			break;
+		case OUTER_VAR:
+			slotoff = offsetof(ExprContext, ecxt_outertuple);
+			break;
+		default:
+			slotoff = offsetof(ExprContext, ecxt_scantuple);
+			break;
+	}
+
+	fast = LLVMAppendBasicBlock(eb->fn, "var_fast");
+	slow = LLVMAppendBasicBlock(eb->fn, "var_slow");
+	merge = LLVMAppendBasicBlock(eb->fn, "var_merge");
+
+	slot = llvmjit_load(b, eb->econtext, slotoff, llvmjit_ptr_type);
+	attnum = LLVMConstInt(llvmjit_int_type, var->varattno, false);
+	LLVMBuildCondBr(b,
+					LLVMBuildICmp(b, LLVMIntSGE,
+								  llvmjit_load(b, slot,
+										 offsetof(TupleTableSlot, tts_nvalid),
+											   llvmjit_int_type),
+								  attnum, ""),
+					fast, slow);
+
+	LLVMPositionBuilderAtEnd(b, fast);
+	idx = LLVMConstInt(LLVMInt64Type(), var->varattno - 1, false);
+	fastvalue = LLVMBuildLoad2(b, llvmjit_datum_type,
+							   LLVMBuildGEP2(b, llvmjit_datum_type,
+											 llvmjit_load(b, slot,
+										 offsetof(TupleTableSlot, tts_values),
+									LLVMPointerType(llvmjit_datum_type, 0)),
+											 &idx, 1, ""),
+							   "");
+	fastnull = build_istrue(eb,
+							LLVMBuildLoad2(b, llvmjit_bool_type,
+										   LLVMBuildGEP2(b, llvmjit_bool_type,
+												  llvmjit_load(b, slot,
+										 offsetof(TupleTableSlot, tts_isnull),
+															llvmjit_ptr_type),
+														 &idx, 1, ""),
+										   ""));
+	LLVMBuildBr(b, merge);
+
+	LLVMPositionBuilderAtEnd(b, slow);
+	params[0] = llvmjit_ptr_type;
+	params[1] = llvmjit_int_type;
+	params[2] = llvmjit_ptr_type;
+	args[0] = slot;
+	args[1] = attnum;
+	args[2] = eb->nullbuf;
+	slowvalue = llvmjit_call(b, (void *) slot_getattr,
+							 LLVMFunctionType(llvmjit_datum_type, params, 3,
+											  false),
+							 args, 3);
+	slownull = build_istrue(eb, LLVMBuildLoad2(b, llvmjit_bool_type,
+											   eb->nullbuf, ""));
+	LLVMBuildBr(b, merge);
+
+	LLVMPositionBuilderAtEnd(b, merge);
+	value = LLVMBuildPhi(b, llvmjit_datum_type, "");
+	LLVMAddIncoming(value, &fastvalue, &fast, 1);
+	LLVMAddIncoming(value, &slowvalue, &slow, 1);
+	null = LLVMBuildPhi(b, LLVMInt1Type(), "");
+	LLVMAddIncoming(null, &fastnull, &fast, 1);
+	LLVMAddIncoming(null, &slownull, &slow, 1);
+
+	*isnull = null;
+	return value;
+}
+
+/*
+ * Call a function through a FunctionCallInfo filled in advance, skipping
+ * the call if the function is strict and an argument is null.
+ */
+static LLVMValueRef
+build_func(ExprBuild *eb, FuncExprState *fstate, Oid funcid,
+		   Oid inputcollid, LLVMValueRef *isnull)
+{
+	LLVMBuilderRef b = eb->b;
+	int			nargs = list_length(fstate->args);
+	FmgrInfo   *flinfo;
+	FunctionCallInfo fcinfo;
+	LLVMValueRef *values;
+	LLVMValueRef *nulls;
+	LLVMValueRef v_fcinfo;
+	LLVMValueRef anynull = NULL;
+	LLVMValueRef result;
+	LLVMValueRef resultnull;
+	LLVMValueRef value;
+	LLVMValueRef null;
+	LLVMBasicBlockRef callblock;
+	LLVMBasicBlockRef nullblock = NULL;
+	LLVMBasicBlockRef merge;
+	LLVMTypeRef param;
+	ListCell   *lc;
+	int			i;
+
+	/* Same as init_fcache, in the per-query context */
+	flinfo = (FmgrInfo *) palloc0(sizeof(FmgrInfo));
+	fcinfo = (FunctionCallInfo) palloc0(sizeof(FunctionCallInfoData));
+	fmgr_info(funcid, flinfo);
+	fmgr_info_set_expr((Node *) fstate->xprstate.expr, flinfo);
+	InitFunctionCallInfoData(*fcinfo, flinfo, nargs, inputcollid,
+							 NULL, NULL);
+	InvokeFunctionExecuteHook(funcid);
+
+	values = (LLVMValueRef *) palloc(nargs * sizeof(LLVMValueRef));
+	nulls = (LLVMValueRef *) palloc(nargs * sizeof(LLVMValueRef));
+	i = 0;
+	foreach(lc, fstate->args)
+	{
+		values[i] = build_expr(eb, (ExprState *) lfirst(lc), &nulls[i]);
+		anynull = anynull ? LLVMBuildOr(b, anynull, nulls[i], "") : nulls[i];
+		i++;
+	}
+
+	callblock = LLVMAppendBasicBlock(eb->fn, "call");
+	merge = LLVMAppendBasicBlock(eb->fn, "call_merge");
+	if (flinfo->fn_strict && nargs > 0)
+	{
+		nullblock = LLVMAppendBasicBlock(eb->fn, "call_null");
+		LLVMBuildCondBr(b, anynull, nullblock, callblock);
+		LLVMPositionBuilderAtEnd(b, nullblock);
+		LLVMBuildBr(b, merge);
+	}
+	else
+		LLVMBuildBr(b, callblock);
+
+	LLVMPositionBuilderAtEnd(b, callblock);
+	v_fcinfo = llvmjit_pointer(fcinfo);
+	for (i = 0; i < nargs; i++)
+	{
+		llvmjit_store(b, values[i], v_fcinfo,
+					  offsetof(FunctionCallInfoData, arg) + i * sizeof(Datum));
+		llvmjit_store(b, LLVMBuildZExt(b, nulls[i], llvmjit_bool_type, ""),
+					  v_fcinfo,
+					  offsetof(FunctionCallInfoData, argnull) + i * sizeof(bool));
+	}
+	llvmjit_store(b, LLVMConstInt(llvmjit_bool_type, 0, false), v_fcinfo,
+				  offsetof(FunctionCallInfoData, isnull));
+	param = llvmjit_ptr_type;
+	result = llvmjit_call(b, (void *) flinfo->fn_addr,
+						  LLVMFunctionType(llvmjit_datum_type, &param, 1, false),
+						  &v_fcinfo, 1);
+	resultnull = build_istrue(eb,
+							  llvmjit_load(b, v_fcinfo,
+										 offsetof(FunctionCallInfoData, isnull),
+										   llvmjit_bool_type));
+	callblock = LLVMGetInsertBlock(b);
+	LLVMBuildBr(b, merge);
+
+	LLVMPositionBuilderAtEnd(b, merge);
+	value = LLVMBuildPhi(b, llvmjit_datum_type, "");
+	LLVMAddIncoming(value, &result, &callblock, 1);
+	null = LLVMBuildPhi(b, LLVMInt1Type(), "");
+	LLVMAddIncoming(null, &resultnull, &callblock, 1);
+	if (nullblock != NULL)
+	{
+		LLVMValueRef zero = LLVMConstInt(llvmjit_datum_type, 0, false);
+		LLVMValueRef one = LLVMConstInt(LLVMInt1Type(), 1, false);
+
+		LLVMAddIncoming(value, &zero, &nullblock, 1);
+		LLVMAddIncoming(null, &one, &nullblock, 1);
+	}
+
+	pfree(values);
+	pfree(nulls);
+
+	*isnull = null;
+	return value;
+}
+
+/*
+ * AND, OR and NOT, with the short-circuit and null semantics of
+ * ExecEvalAnd, ExecEvalOr and ExecEvalNot.
+ */
+static LLVMValueRef
+build_bool(ExprBuild *eb, BoolExprState *bstate, LLVMValueRef *isnull)
+{
+	LLVMBuilderRef b = eb->b;
+	BoolExprType boolop = ((BoolExpr *) bstate->xprstate.expr)->boolop;
+	LLVMValueRef anynull;
+	LLVMValueRef value;
+	LLVMValueRef null;
+	LLVMValueRef decided;
+	LLVMValueRef lastnull;
+	LLVMValueRef incoming;
+	LLVMBasicBlockRef decidedblock;
+	LLVMBasicBlockRef lastblock;
+	LLVMBasicBlockRef merge;
+	ListCell   *lc;
+
+	if (boolop == NOT_EXPR)
+	{
+		LLVMValueRef arg;
+
+		arg = build_expr(eb, (ExprState *) linitial(bstate->args), isnull);
+		return LLVMBuildZExt(b, LLVMBuildNot(b, build_istrue(eb, arg), ""),
+							 llvmjit_datum_type, "");
+	}
+
+	/* An AND is decided by a false argument, an OR by a true one */
+	decidedblock = LLVMAppendBasicBlock(eb->fn, "bool_decided");
+	merge = LLVMAppendBasicBlock(eb->fn, "bool_merge");
+	anynull = llvmjit_entry_alloca(eb->fn, LLVMInt1Type(), "anynull");
+	LLVMBuildStore(b, LLVMConstInt(LLVMInt1Type(), 0, false), anynull);
+
+	foreach(lc, bstate->args)
+	{
+		LLVMBasicBlockRef next = LLVMAppendBasicBlock(eb->fn, "bool_next");
+		LLVMValueRef argnull;
+		LLVMValueRef arg;
+		LLVMValueRef istrue;
+
+		arg = build_expr(eb, (ExprState *) lfirst(lc), &argnull);
+		istrue = build_istrue(eb, arg);
+		if (boolop == AND_EXPR)
+			istrue = LLVMBuildNot(b, istrue, "");
+		decided = LLVMBuildAnd(b, LLVMBuildNot(b, argnull, ""), istrue, "");
+		LLVMBuildStore(b,
+					   LLVMBuildOr(b,
+								   LLVMBuildLoad2(b, LLVMInt1Type(), anynull, ""),
+								   argnull, ""),
+					   anynull);
+		LLVMBuildCondBr(b, decided, decidedblock, next);
+		LLVMPositionBuilderAtEnd(b, next);
+	}
+	lastnull = LLVMBuildLoad2(b, LLVMInt1Type(), anynull, "");
+	lastblock = LLVMGetInsertBlock(b);
+	LLVMBuildBr(b, merge);
+
+	LLVMPositionBuilderAtEnd(b, decidedblock);
+	LLVMBuildBr(b, merge);
+
+	LLVMPositionBuilderAtEnd(b, merge);
+	value = LLVMBuildPhi(b, llvmjit_datum_type, "");
+	incoming = LLVMConstInt(llvmjit_datum_type, boolop == AND_EXPR, false);
+	LLVMAddIncoming(value, &incoming, &lastblock, 1);
+	incoming = LLVMConstInt(llvmjit_datum_type, boolop != AND_EXPR, false);
+	LLVMAddIncoming(value, &incoming, &decidedblock, 1);
+	null = LLVMBuildPhi(b, LLVMInt1Type(), "");
+	LLVMAddIncoming(null, &lastnull, &lastblock, 1);
+	incoming = LLVMConstInt(LLVMInt1Type(), 0, false);
+	LLVMAddIncoming(null, &incoming, &decidedblock, 1);
+
+	*isnull = null;
+	return value;
+}
+
+/*
+ * Turn a bool, or a Datum holding one, into an i1, as DatumGetBool does.
+ */
+static LLVMValueRef
+build_istrue(ExprBuild *eb, LLVMValueRef value)
+{
+	LLVMValueRef byte;
+
+	if (LLVMTypeOf(value) == llvmjit_bool_type)
+		byte = value;
+	else
+		byte = LLVMBuildTrunc(eb->b, value, llvmjit_bool_type, "");
+	return LLVMBuildICmp(eb->b, LLVMIntNE, byte,
+						 LLVMConstInt(llvmjit_bool_type, 0, false), "");
+}
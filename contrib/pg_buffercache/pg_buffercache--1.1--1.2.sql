@@ -0,0 +1,24 @@
+/* contrib/pg_buffercache/pg_buffercache--1.1--1.2.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION pg_buffercache UPDATE TO '1.2'" to load this file. \quit
+
+CREATE FUNCTION pg_buffercache_relations(summary bool default false,
+	OUT database text, OUT relfilenode oid, OUT relation text,
+	OUT relforknumber int2, OUT buffers int8, OUT dirty int8,
+	OUT pinned int8, OUT usage_counts int8[], OUT total_buffers int8)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffercache_relations'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_buffercache_cluster(summary bool default false,
+	OUT node_name text, OUT database text, OUT relfilenode oid,
+	OUT relation text, OUT relforknumber int2, OUT buffers int8,
+	OUT dirty int8, OUT pinned int8, OUT usage_counts int8[],
+	OUT total_buffers int8)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffercache_cluster'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pg_buffercache_relations(bool) FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_buffercache_cluster(bool) FROM PUBLIC;
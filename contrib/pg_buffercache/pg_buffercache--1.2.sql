@@ -0,0 +1,42 @@
+/* contrib/pg_buffercache/pg_buffercache--1.2.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION pg_buffercache" to load this file. \quit
+
+-- Register the function.
+CREATE FUNCTION pg_buffercache_pages()
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffercache_pages'
+LANGUAGE C;
+
+-- Create a view for convenient access.
+CREATE VIEW pg_buffercache AS
+	SELECT P.* FROM pg_buffercache_pages() AS P
+	(bufferid integer, relfilenode oid, reltablespace oid, reldatabase oid,
+	 relforknumber int2, relblocknumber int8, isdirty bool, usagecount int2,
+	 pinning_backends int4);
+
+-- Don't want these to be available to public.
+REVOKE ALL ON FUNCTION pg_buffercache_pages() FROM PUBLIC;
+REVOKE ALL ON pg_buffercache FROM PUBLIC;
+
+-- Per relation sums of the local buffer cache and of all the Datanodes.
+CREATE FUNCTION pg_buffercache_relations(summary bool default false,
+	OUT database text, OUT relfilenode oid, OUT relation text,
+	OUT relforknumber int2, OUT buffers int8, OUT dirty int8,
+	OUT pinned int8, OUT usage_counts int8[], OUT total_buffers int8)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffercache_relations'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pg_buffercache_cluster(summary bool default false,
+	OUT node_name text, OUT database text, OUT relfilenode oid,
+	OUT relation text, OUT relforknumber int2, OUT buffers int8,
+	OUT dirty int8, OUT pinned int8, OUT usage_counts int8[],
+	OUT total_buffers int8)
+RETURNS SETOF RECORD
+AS 'MODULE_PATHNAME', 'pg_buffercache_cluster'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pg_buffercache_relations(bool) FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_buffercache_cluster(bool) FROM PUBLIC;
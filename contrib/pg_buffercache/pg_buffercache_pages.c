@@ -3,6 +3,10 @@
  * pg_buffercache_pages.c
  *	  display some contents of the buffer cache
  *
+ * pg_buffercache_relations() sums the buffers up per relation fork, or for
+ * the whole cache in summary mode, and pg_buffercache_cluster() collects
+ * these sums from all the Datanodes of the cluster.
+ *
  *	  contrib/pg_buffercache/pg_buffercache_pages.c
  *-------------------------------------------------------------------------
  */
@@ -10,13 +14,28 @@
 
 #include "access/htup_details.h"
 #include "catalog/pg_type.h"
+#include "commands/dbcommands.h"
+#include "executor/spi.h"
 #include "funcapi.h"
+#include "miscadmin.h"
 #include "storage/buf_internals.h"
 #include "storage/bufmgr.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/relfilenodemap.h"
+#ifdef PGXC
+#include "nodes/makefuncs.h"
+#include "pgxc/execRemote.h"
+#include "pgxc/pgxc.h"
+#include "utils/snapmgr.h"
+#endif
 
 
 #define NUM_BUFFERCACHE_PAGES_MIN_ELEM	8
 #define NUM_BUFFERCACHE_PAGES_ELEM	9
+#define NUM_BUFFERCACHE_RELATIONS_ELEM	9
 
 PG_MODULE_MAGIC;
 
@@ -249,3 +268,341 @@ pg_buffercache_pages(PG_FUNCTION_ARGS)
 	else
 		SRF_RETURN_DONE(funcctx);
 }
+
+
+/*
+ * Buffers of a relation fork, summed up by pg_buffercache_relations.
+ */
+typedef struct
+{
+	RelFileNode rnode;
+	ForkNumber	forknum;
+} BufferCacheRelKey;
+
+typedef struct
+{
+	BufferCacheRelKey key;		/* hash key, must be first */
+	int64		buffers;
+	int64		dirty;
+	int64		pinned;
+	int64		usagecounts[BM_MAX_USAGE_COUNT + 1];
+} BufferCacheRelEntry;
+
+/*
+ * Check that the function is called in a context accepting a tuplestore,
+ * and set the tuplestore up for the result.
+ */
+static Tuplestorestate *
+buffercache_init_tuplestore(FunctionCallInfo fcinfo, TupleDesc *tupdesc)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+	if (get_call_result_type(fcinfo, NULL, tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = *tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	return tupstore;
+}
+
+/*
+ * Add the sums of an entry to the result. The relation is described if
+ * key is not NULL, and its name is found if it belongs to the current
+ * database or is shared.
+ */
+static void
+buffercache_put_entry(Tuplestorestate *tupstore, TupleDesc tupdesc,
+					  BufferCacheRelKey *key, BufferCacheRelEntry *entry)
+{
+	Datum		values[NUM_BUFFERCACHE_RELATIONS_ELEM];
+	bool		nulls[NUM_BUFFERCACHE_RELATIONS_ELEM];
+	Datum		usagecounts[BM_MAX_USAGE_COUNT + 1];
+	int			i;
+
+	memset(nulls, 0, sizeof(nulls));
+	nulls[0] = nulls[1] = nulls[2] = nulls[3] = true;
+	if (key != NULL)
+	{
+		char	   *dbname = NULL;
+		Oid			relid = InvalidOid;
+
+		if (OidIsValid(key->rnode.dbNode))
+			dbname = get_database_name(key->rnode.dbNode);
+		if (dbname != NULL)
+		{
+			values[0] = CStringGetTextDatum(dbname);
+			nulls[0] = false;
+		}
+		values[1] = ObjectIdGetDatum(key->rnode.relNode);
+		nulls[1] = false;
+		if (key->rnode.dbNode == MyDatabaseId ||
+			key->rnode.dbNode == InvalidOid)
+			relid = RelidByRelfilenode(key->rnode.spcNode, key->rnode.relNode);
+		if (OidIsValid(relid))
+		{
+			char	   *relname = get_rel_name(relid);
+			char	   *nspname = get_namespace_name(get_rel_namespace(relid));
+
+			if (relname != NULL && nspname != NULL)
+			{
+				values[2] = CStringGetTextDatum(quote_qualified_identifier(nspname,
+																		   relname));
+				nulls[2] = false;
+			}
+		}
+		values[3] = Int16GetDatum(key->forknum);
+		nulls[3] = false;
+	}
+	values[4] = Int64GetDatum(entry->buffers);
+	values[5] = Int64GetDatum(entry->dirty);
+	values[6] = Int64GetDatum(entry->pinned);
+	for (i = 0; i <= BM_MAX_USAGE_COUNT; i++)
+		usagecounts[i] = Int64GetDatum(entry->usagecounts[i]);
+	values[7] = PointerGetDatum(construct_array(usagecounts,
+												BM_MAX_USAGE_COUNT + 1,
+												INT8OID, sizeof(int64),
+												FLOAT8PASSBYVAL, 'd'));
+	values[8] = Int64GetDatum((int64) NBuffers);
+
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+}
+
+/*
+ * Function returning the number of buffers of each relation fork in the
+ * shared buffer cache, with how many of them are dirty or pinned and the
+ * distribution of their usage counts. In summary mode a single row sums up
+ * all the used buffers.
+ *
+ * Unlike pg_buffercache_pages, the buffer mapping partitions are not
+ * locked, so the result is not an exact snapshot of the cache, but the
+ * function may be run on a busy server.
+ */
+PG_FUNCTION_INFO_V1(pg_buffercache_relations);
+
+Datum
+pg_buffercache_relations(PG_FUNCTION_ARGS)
+{
+	bool		summary = PG_GETARG_BOOL(0);
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	HTAB	   *relations = NULL;
+	BufferCacheRelEntry total;
+	int			i;
+
+	tupstore = buffercache_init_tuplestore(fcinfo, &tupdesc);
+	if (tupdesc->natts != NUM_BUFFERCACHE_RELATIONS_ELEM)
+		elog(ERROR, "incorrect number of output arguments");
+
+	memset(&total, 0, sizeof(total));
+	if (!summary)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(BufferCacheRelKey);
+		ctl.entrysize = sizeof(BufferCacheRelEntry);
+		ctl.hcxt = CurrentMemoryContext;
+		relations = hash_create("pg_buffercache relations", 1024, &ctl,
+								HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	for (i = 0; i < NBuffers; i++)
+	{
+		volatile BufferDesc *bufHdr;
+		BufferCacheRelKey key;
+		BufferCacheRelEntry *entry;
+		bool		used;
+		bool		dirty;
+		bool		pinned;
+		uint16		usagecount;
+
+		bufHdr = GetBufferDescriptor(i);
+		memset(&key, 0, sizeof(key));
+
+		/* Lock each buffer header before inspecting. */
+		LockBufHdr(bufHdr);
+		used = (bufHdr->flags & BM_VALID) && (bufHdr->flags & BM_TAG_VALID);
+		key.rnode = bufHdr->tag.rnode;
+		key.forknum = bufHdr->tag.forkNum;
+		dirty = (bufHdr->flags & BM_DIRTY) != 0;
+		pinned = bufHdr->refcount > 0;
+		usagecount = Min(bufHdr->usage_count, BM_MAX_USAGE_COUNT);
+		UnlockBufHdr(bufHdr);
+
+		if (!used)
+			continue;
+
+		if (summary)
+			entry = &total;
+		else
+		{
+			bool		found;
+
+			entry = (BufferCacheRelEntry *) hash_search(relations, &key,
+														HASH_ENTER, &found);
+			if (!found)
+				memset(((char *) entry) + sizeof(BufferCacheRelKey), 0,
+					   sizeof(BufferCacheRelEntry) - sizeof(BufferCacheRelKey));
+		}
+		entry->buffers++;
+		if (dirty)
+			entry->dirty++;
+		if (pinned)
+			entry->pinned++;
+		entry->usagecounts[usagecount]++;
+
+		if ((i & 0xffff) == 0)
+			CHECK_FOR_INTERRUPTS();
+	}
+
+	if (summary)
+		buffercache_put_entry(tupstore, tupdesc, NULL, &total);
+	else
+	{
+		HASH_SEQ_STATUS status;
+		BufferCacheRelEntry *entry;
+
+		hash_seq_init(&status, relations);
+		while ((entry = (BufferCacheRelEntry *) hash_seq_search(&status)) != NULL)
+			buffercache_put_entry(tupstore, tupdesc, &entry->key, entry);
+		hash_destroy(relations);
+	}
+
+	tuplestore_donestoring(tupstore);
+	return (Datum) 0;
+}
+
+#ifdef PGXC
+/*
+ * Run the query on all the Datanodes at once, and add their rows to the
+ * result as they arrive.
+ */
+static void
+buffercache_collect_datanodes(char *query, Tuplestorestate *tupstore,
+							  TupleDesc tupdesc)
+{
+	EState	   *estate;
+	MemoryContext oldcontext;
+	RemoteQuery *step;
+	RemoteQueryState *node;
+	TupleTableSlot *result;
+	int			i;
+
+	/* Build up RemoteQuery, with the types of the result columns */
+	step = makeNode(RemoteQuery);
+	step->combine_type = COMBINE_TYPE_NONE;
+	step->exec_nodes = NULL;
+	step->sql_statement = query;
+	step->force_autocommit = false;
+	step->exec_type = EXEC_ON_DATANODES;
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[i];
+		Var		   *var = makeVar(1, i + 1, attr->atttypid, attr->atttypmod,
+								  attr->attcollation, 0);
+
+		step->scan.plan.targetlist = lappend(step->scan.plan.targetlist,
+											 makeTargetEntry((Expr *) var,
+															 i + 1,
+															 NULL,
+															 false));
+	}
+
+	estate = CreateExecutorState();
+	oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+	estate->es_snapshot = GetActiveSnapshot();
+	node = ExecInitRemoteQuery(step, estate, 0);
+	MemoryContextSwitchTo(oldcontext);
+
+	result = ExecRemoteQuery(node);
+	while (result != NULL && !TupIsNull(result))
+	{
+		slot_getallattrs(result);
+		tuplestore_putvalues(tupstore, tupdesc, result->tts_values,
+							 result->tts_isnull);
+
+		CHECK_FOR_INTERRUPTS();
+		result = ExecRemoteQuery(node);
+	}
+	ExecEndRemoteQuery(node);
+	FreeExecutorState(estate);
+}
+#endif
+
+/*
+ * Function returning the result of pg_buffercache_relations on every
+ * Datanode of the cluster, after the name of the node.
+ *
+ * On a Coordinator the query is sent to all the Datanodes at once. On any
+ * other node the function returns the local buffer cache.
+ */
+PG_FUNCTION_INFO_V1(pg_buffercache_cluster);
+
+Datum
+pg_buffercache_cluster(PG_FUNCTION_ARGS)
+{
+	bool		summary = PG_GETARG_BOOL(0);
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	char	   *nspname;
+	StringInfoData query;
+	Datum		values[NUM_BUFFERCACHE_RELATIONS_ELEM + 1];
+	bool		nulls[NUM_BUFFERCACHE_RELATIONS_ELEM + 1];
+	int			ret;
+	uint32		r;
+	int			i;
+
+	tupstore = buffercache_init_tuplestore(fcinfo, &tupdesc);
+	if (tupdesc->natts != NUM_BUFFERCACHE_RELATIONS_ELEM + 1)
+		elog(ERROR, "incorrect number of output arguments");
+
+	/* The local function lives in the schema of this one */
+	nspname = get_namespace_name(get_func_namespace(fcinfo->flinfo->fn_oid));
+	initStringInfo(&query);
+	appendStringInfo(&query,
+					 "SELECT pg_catalog.pgxc_node_str()::text, * "
+					 "FROM %s.pg_buffercache_relations(%s)",
+					 quote_identifier(nspname), summary ? "true" : "false");
+
+#ifdef PGXC
+	if (IS_PGXC_LOCAL_COORDINATOR)
+	{
+		buffercache_collect_datanodes(query.data, tupstore, tupdesc);
+		tuplestore_donestoring(tupstore);
+		return (Datum) 0;
+	}
+#endif
+
+	if ((ret = SPI_connect()) < 0)
+		elog(ERROR, "SPI connect failure - returned %d", ret);
+	if (SPI_execute(query.data, true, 0) != SPI_OK_SELECT)
+		elog(ERROR, "could not read the local buffer cache");
+	for (r = 0; r < SPI_processed; r++)
+	{
+		for (i = 0; i < tupdesc->natts; i++)
+			values[i] = SPI_getbinval(SPI_tuptable->vals[r],
+									  SPI_tuptable->tupdesc, i + 1,
+									  &nulls[i]);
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+	SPI_finish();
+
+	tuplestore_donestoring(tupstore);
+	return (Datum) 0;
+}
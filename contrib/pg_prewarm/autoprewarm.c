@@ -0,0 +1,1051 @@
+/*-------------------------------------------------------------------------
+ *
+ * autoprewarm.c
+ *		  Dump the block list of the buffer cache and reload it at startup
+ *
+ * When pg_prewarm is loaded via shared_preload_libraries, a background
+ * worker writes the list of the blocks held by the buffer cache to the
+ * file autoprewarm.blocks every autoprewarm_interval, and at shutdown.
+ * When the server starts again, or a standby reaches a consistent state,
+ * the worker reads the list back into the cache, so a restarted or promoted
+ * Datanode does not slow down every distributed query until its cache is
+ * warm again.
+ *
+ * The list is made of ranges of consecutive blocks of a relation fork,
+ * along with the sum of the usage counts of the blocks. The relations of
+ * each database are loaded by autoprewarm_workers workers in parallel,
+ * connected to the database, the relations whose blocks are used the most
+ * first, so the relations of the hottest queries are warm first.
+ *
+ * The list of the blocks can also be taken from a server and loaded into
+ * another one holding the same files, such as a standby before it is
+ * promoted; pgxc_prewarm_standby() does this from a Coordinator.
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * IDENTIFICATION
+ *		  contrib/pg_prewarm/autoprewarm.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <unistd.h>
+
+#include "access/heapam.h"
+#include "access/xact.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "storage/buf_internals.h"
+#include "storage/bufmgr.h"
+#include "storage/fd.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "storage/smgr.h"
+#include "storage/spin.h"
+#include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/relfilenodemap.h"
+#ifdef PGXC
+#include "catalog/pg_collation.h"
+#include "catalog/pg_type.h"
+#include "catalog/pgxc_node.h"
+#include "executor/executor.h"
+#include "nodes/makefuncs.h"
+#include "pgxc/execRemote.h"
+#include "pgxc/nodemgr.h"
+#include "pgxc/pgxc.h"
+#include "pgxc/pgxcnode.h"
+#include "utils/snapmgr.h"
+#endif
+
+#define AUTOPREWARM_FILE		"autoprewarm.blocks"
+#define AUTOPREWARM_MAX_WORKERS	32
+
+void		_PG_init(void);
+void		autoprewarm_main(Datum main_arg) pg_attribute_noreturn();
+void		autoprewarm_database_main(Datum main_arg) pg_attribute_noreturn();
+
+PG_FUNCTION_INFO_V1(autoprewarm_dump_now);
+PG_FUNCTION_INFO_V1(autoprewarm_block_list);
+PG_FUNCTION_INFO_V1(autoprewarm_load_block_list);
+#ifdef PGXC
+PG_FUNCTION_INFO_V1(pgxc_prewarm_standby);
+#endif
+
+/*
+ * Consecutive blocks of a relation fork held by the buffer cache
+ */
+typedef struct BlockRange
+{
+	Oid			database;
+	Oid			tablespace;
+	Oid			filenode;
+	ForkNumber	forknum;
+	BlockNumber first;
+	uint32		count;
+	uint32		usage;			/* sum of the usage counts of the blocks */
+} BlockRange;
+
+/*
+ * Relation to load, with its ranges and how much they are used
+ */
+typedef struct RelationRanges
+{
+	BlockRange *ranges;
+	int			nranges;
+	uint64		usage;
+} RelationRanges;
+
+typedef struct AutoPrewarmState
+{
+	slock_t		mutex;
+	pid_t		master_pid;		/* 0 if the worker is not running */
+	Latch	   *master_latch;
+	bool		load_requested; /* the list changed, load it again */
+	/* What the workers loading the current database do */
+	Oid			database;
+	int			nworkers;
+} AutoPrewarmState;
+
+/* GUC variables */
+static bool autoprewarm = true;
+static int	autoprewarm_interval = 300;
+static int	autoprewarm_workers = 4;
+
+static AutoPrewarmState *apw_state = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* flags set by signal handlers */
+static volatile sig_atomic_t got_sighup = false;
+static volatile sig_atomic_t got_sigterm = false;
+
+static void
+autoprewarm_sigterm(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_sigterm = true;
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+static void
+autoprewarm_sighup(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_sighup = true;
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+static void
+autoprewarm_shmem_startup(void)
+{
+	bool		found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	apw_state = ShmemInitStruct("autoprewarm", sizeof(AutoPrewarmState),
+								&found);
+	if (!found)
+	{
+		SpinLockInit(&apw_state->mutex);
+		apw_state->master_pid = 0;
+		apw_state->master_latch = NULL;
+		apw_state->load_requested = false;
+		apw_state->database = InvalidOid;
+		apw_state->nworkers = 0;
+	}
+	LWLockRelease(AddinShmemInitLock);
+}
+
+static int
+block_range_cmp(const void *a, const void *b)
+{
+	const BlockRange *ra = (const BlockRange *) a;
+	const BlockRange *rb = (const BlockRange *) b;
+
+	if (ra->database != rb->database)
+		return ra->database < rb->database ? -1 : 1;
+	if (ra->tablespace != rb->tablespace)
+		return ra->tablespace < rb->tablespace ? -1 : 1;
+	if (ra->filenode != rb->filenode)
+		return ra->filenode < rb->filenode ? -1 : 1;
+	if (ra->forknum != rb->forknum)
+		return ra->forknum < rb->forknum ? -1 : 1;
+	if (ra->first != rb->first)
+		return ra->first < rb->first ? -1 : 1;
+	return 0;
+}
+
+static int
+relation_ranges_cmp(const void *a, const void *b)
+{
+	const RelationRanges *ra = (const RelationRanges *) a;
+	const RelationRanges *rb = (const RelationRanges *) b;
+
+	/* Most used first */
+	if (ra->usage != rb->usage)
+		return ra->usage > rb->usage ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Get the blocks held by the buffer cache, as ranges of consecutive blocks
+ * sorted by relation fork and block number. The buffers are looked at one
+ * by one, so it is not an exact snapshot of the cache.
+ */
+static BlockRange *
+apw_collect_blocks(int *nranges)
+{
+	BlockRange *blocks;
+	int			nblocks = 0;
+	int			n = 0;
+	int			i;
+
+	blocks = (BlockRange *) palloc(NBuffers * sizeof(BlockRange));
+	for (i = 0; i < NBuffers; i++)
+	{
+		volatile BufferDesc *bufHdr = GetBufferDescriptor(i);
+		BlockRange *block = &blocks[nblocks];
+
+		LockBufHdr(bufHdr);
+		if ((bufHdr->flags & BM_VALID) && (bufHdr->flags & BM_TAG_VALID))
+		{
+			block->database = bufHdr->tag.rnode.dbNode;
+			block->tablespace = bufHdr->tag.rnode.spcNode;
+			block->filenode = bufHdr->tag.rnode.relNode;
+			block->forknum = bufHdr->tag.forkNum;
+			block->first = bufHdr->tag.blockNum;
+			block->count = 1;
+			block->usage = bufHdr->usage_count;
+			nblocks++;
+		}
+		UnlockBufHdr(bufHdr);
+	}
+
+	/* Merge consecutive blocks into ranges, in place */
+	qsort(blocks, nblocks, sizeof(BlockRange), block_range_cmp);
+	for (i = 0; i < nblocks; i++)
+	{
+		BlockRange *last = n > 0 ? &blocks[n - 1] : NULL;
+
+		if (last != NULL &&
+			last->database == blocks[i].database &&
+			last->tablespace == blocks[i].tablespace &&
+			last->filenode == blocks[i].filenode &&
+			last->forknum == blocks[i].forknum &&
+			last->first + last->count == blocks[i].first)
+		{
+			last->count++;
+			last->usage += blocks[i].usage;
+		}
+		else
+			blocks[n++] = blocks[i];
+	}
+
+	*nranges = n;
+	return blocks;
+}
+
+/*
+ * Text form of the block list, one range per line, which is also the
+ * format of the file.
+ */
+static void
+apw_format_blocks(StringInfo buf, BlockRange *ranges, int nranges)
+{
+	int			i;
+
+	for (i = 0; i < nranges; i++)
+		appendStringInfo(buf, "%u %u %u %d %u %u %u\n",
+						 ranges[i].database, ranges[i].tablespace,
+						 ranges[i].filenode, (int) ranges[i].forknum,
+						 ranges[i].first, ranges[i].count, ranges[i].usage);
+}
+
+static BlockRange *
+apw_parse_blocks(const char *data, int *nranges)
+{
+	BlockRange *ranges;
+	const char *line;
+	int			size = 1024;
+	int			n = 0;
+
+	ranges = (BlockRange *) palloc(size * sizeof(BlockRange));
+	for (line = data; *line != '\0';)
+	{
+		const char *next = strchr(line, '\n');
+		BlockRange *range;
+		int			forknum;
+
+		if (n == size)
+		{
+			size *= 2;
+			ranges = (BlockRange *) repalloc(ranges, size * sizeof(BlockRange));
+		}
+		range = &ranges[n];
+		if (sscanf(line, "%u %u %u %d %u %u %u",
+				   &range->database, &range->tablespace, &range->filenode,
+				   &forknum, &range->first, &range->count,
+				   &range->usage) != 7 ||
+			forknum < 0 || forknum > MAX_FORKNUM || range->count == 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("invalid block list at line %d", n + 1)));
+		range->forknum = (ForkNumber) forknum;
+		n++;
+
+		if (next == NULL)
+			break;
+		line = next + 1;
+	}
+
+	*nranges = n;
+	return ranges;
+}
+
+/*
+ * Read the block list file, returns NULL if there is none.
+ */
+static char *
+apw_read_file(void)
+{
+	FILE	   *file;
+	StringInfoData buf;
+	char		chunk[8192];
+	size_t		len;
+
+	file = AllocateFile(AUTOPREWARM_FILE, "r");
+	if (file == NULL)
+	{
+		if (errno != ENOENT)
+			ereport(LOG,
+					(errcode_for_file_access(),
+					 errmsg("could not read file \"%s\": %m",
+							AUTOPREWARM_FILE)));
+		return NULL;
+	}
+
+	initStringInfo(&buf);
+	while ((len = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		appendBinaryStringInfo(&buf, chunk, len);
+	if (ferror(file))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read file \"%s\": %m", AUTOPREWARM_FILE)));
+	FreeFile(file);
+
+	return buf.data;
+}
+
+/*
+ * Replace the block list file, through a temporary file so that a crash
+ * leaves either list.
+ */
+static void
+apw_write_file(const char *data, int len)
+{
+	FILE	   *file;
+
+	file = AllocateFile(AUTOPREWARM_FILE ".tmp", "w");
+	if (file == NULL)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not create file \"%s\": %m",
+						AUTOPREWARM_FILE ".tmp")));
+	if (fwrite(data, 1, len, file) != len ||
+		fflush(file) != 0 ||
+		pg_fsync(fileno(file)) != 0)
+	{
+		int			save_errno = errno;
+
+		FreeFile(file);
+		unlink(AUTOPREWARM_FILE ".tmp");
+		errno = save_errno;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write file \"%s\": %m",
+						AUTOPREWARM_FILE ".tmp")));
+	}
+	FreeFile(file);
+
+	if (rename(AUTOPREWARM_FILE ".tmp", AUTOPREWARM_FILE) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not rename file \"%s\" to \"%s\": %m",
+						AUTOPREWARM_FILE ".tmp", AUTOPREWARM_FILE)));
+}
+
+/*
+ * Dump the blocks of the buffer cache to the file, returns their number.
+ */
+static int64
+apw_dump(void)
+{
+	BlockRange *ranges;
+	StringInfoData buf;
+	int			nranges;
+	int64		nblocks = 0;
+	int			i;
+
+	ranges = apw_collect_blocks(&nranges);
+	initStringInfo(&buf);
+	apw_format_blocks(&buf, ranges, nranges);
+	apw_write_file(buf.data, buf.len);
+
+	for (i = 0; i < nranges; i++)
+		nblocks += ranges[i].count;
+	pfree(ranges);
+	pfree(buf.data);
+
+	elog(DEBUG1, "autoprewarm: dumped " INT64_FORMAT " blocks", nblocks);
+	return nblocks;
+}
+
+/*
+ * Group the ranges of a database by relation, and sort the relations so
+ * the most used come first. The ranges must be sorted.
+ */
+static RelationRanges *
+apw_group_relations(BlockRange *ranges, int nranges, Oid database,
+					int *nrelations)
+{
+	RelationRanges *relations;
+	int			n = 0;
+	int			i;
+
+	relations = (RelationRanges *) palloc(Max(nranges, 1) *
+										  sizeof(RelationRanges));
+	for (i = 0; i < nranges; i++)
+	{
+		RelationRanges *last = n > 0 ? &relations[n - 1] : NULL;
+
+		if (ranges[i].database != database)
+			continue;
+		if (last == NULL ||
+			last->ranges[0].tablespace != ranges[i].tablespace ||
+			last->ranges[0].filenode != ranges[i].filenode)
+		{
+			last = &relations[n++];
+			last->ranges = &ranges[i];
+			last->nranges = 0;
+			last->usage = 0;
+		}
+		last->nranges++;
+		last->usage += ranges[i].usage;
+	}
+	qsort(relations, n, sizeof(RelationRanges), relation_ranges_cmp);
+
+	*nrelations = n;
+	return relations;
+}
+
+/*
+ * Start the workers loading the blocks of a database and wait for them to
+ * finish. Returns false if the postmaster died.
+ */
+static bool
+apw_load_database(Oid database, int nrelations)
+{
+	BackgroundWorkerHandle *handles[AUTOPREWARM_MAX_WORKERS];
+	int			nworkers = Min(autoprewarm_workers, nrelations);
+	int			started = 0;
+	int			i;
+
+	SpinLockAcquire(&apw_state->mutex);
+	apw_state->database = database;
+	apw_state->nworkers = nworkers;
+	SpinLockRelease(&apw_state->mutex);
+
+	for (i = 0; i < nworkers; i++)
+	{
+		BackgroundWorker worker;
+
+		MemSet(&worker, 0, sizeof(worker));
+		worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+			BGWORKER_BACKEND_DATABASE_CONNECTION;
+		worker.bgw_start_time = BgWorkerStart_ConsistentState;
+		worker.bgw_restart_time = BGW_NEVER_RESTART;
+		worker.bgw_main = NULL;
+		snprintf(worker.bgw_library_name, BGW_MAXLEN, "pg_prewarm");
+		snprintf(worker.bgw_function_name, BGW_MAXLEN,
+				 "autoprewarm_database_main");
+		snprintf(worker.bgw_name, BGW_MAXLEN, "autoprewarm loader %u/%d",
+				 database, i);
+		worker.bgw_main_arg = Int32GetDatum(i);
+		worker.bgw_notify_pid = MyProcPid;
+
+		if (!RegisterDynamicBackgroundWorker(&worker, &handles[started]))
+		{
+			ereport(WARNING,
+					(errmsg("could not start autoprewarm loader for database %u",
+							database),
+					 errhint("You may need to increase max_worker_processes.")));
+			break;
+		}
+		started++;
+	}
+
+	/* The share of the loaders not started is left cold */
+
+	for (i = 0; i < started; i++)
+	{
+		if (WaitForBackgroundWorkerShutdown(handles[i]) == BGWH_POSTMASTER_DIED)
+			return false;
+		pfree(handles[i]);
+	}
+	return true;
+}
+
+/*
+ * Load the block list file into the buffer cache, one database after the
+ * other, the most used first.
+ */
+static void
+apw_load(void)
+{
+	char	   *data;
+	BlockRange *ranges;
+	RelationRanges *databases;
+	int			nranges;
+	int			ndatabases = 0;
+	int			i;
+
+	data = apw_read_file();
+	if (data == NULL)
+		return;
+	ranges = apw_parse_blocks(data, &nranges);
+	pfree(data);
+	qsort(ranges, nranges, sizeof(BlockRange), block_range_cmp);
+
+	/*
+	 * Order the databases like the relations. The blocks of the shared
+	 * catalogs are not loaded, they are read by every session anyway.
+	 */
+	databases = (RelationRanges *) palloc(Max(nranges, 1) *
+										  sizeof(RelationRanges));
+	for (i = 0; i < nranges; i++)
+	{
+		RelationRanges *last = ndatabases > 0 ?
+			&databases[ndatabases - 1] : NULL;
+
+		if (ranges[i].database == InvalidOid)
+			continue;
+		if (last == NULL || last->ranges[0].database != ranges[i].database)
+		{
+			last = &databases[ndatabases++];
+			last->ranges = &ranges[i];
+			last->nranges = 0;
+			last->usage = 0;
+		}
+		/* Count the relations of the database in nranges */
+		if (last->nranges == 0 ||
+			ranges[i - 1].tablespace != ranges[i].tablespace ||
+			ranges[i - 1].filenode != ranges[i].filenode)
+			last->nranges++;
+		last->usage += ranges[i].usage;
+	}
+	qsort(databases, ndatabases, sizeof(RelationRanges), relation_ranges_cmp);
+
+	ereport(LOG,
+			(errmsg("autoprewarm: loading %d block ranges of %d databases",
+					nranges, ndatabases)));
+	for (i = 0; i < ndatabases && !got_sigterm; i++)
+	{
+		if (!apw_load_database(databases[i].ranges[0].database,
+							   databases[i].nranges))
+			proc_exit(1);
+	}
+
+	pfree(databases);
+	pfree(ranges);
+}
+
+static void
+apw_detach_shmem(int code, Datum arg)
+{
+	SpinLockAcquire(&apw_state->mutex);
+	if (apw_state->master_pid == MyProcPid)
+	{
+		apw_state->master_pid = 0;
+		apw_state->master_latch = NULL;
+	}
+	SpinLockRelease(&apw_state->mutex);
+}
+
+/*
+ * Main of the worker dumping and loading the block list
+ */
+void
+autoprewarm_main(Datum main_arg)
+{
+	bool		loaded = false;
+
+	pqsignal(SIGHUP, autoprewarm_sighup);
+	pqsignal(SIGTERM, autoprewarm_sigterm);
+	BackgroundWorkerUnblockSignals();
+
+	SpinLockAcquire(&apw_state->mutex);
+	if (apw_state->master_pid != 0)
+	{
+		SpinLockRelease(&apw_state->mutex);
+		ereport(LOG,
+				(errmsg("autoprewarm worker is already running under PID %d",
+						(int) apw_state->master_pid)));
+		proc_exit(0);
+	}
+	apw_state->master_pid = MyProcPid;
+	apw_state->master_latch = MyLatch;
+	apw_state->load_requested = false;
+	SpinLockRelease(&apw_state->mutex);
+	on_shmem_exit(apw_detach_shmem, 0);
+
+	/* Not dumped before it is loaded, not to replace the list by a cold one */
+	apw_load();
+	loaded = !got_sigterm;
+
+	while (!got_sigterm)
+	{
+		bool		load_requested;
+		int			rc;
+
+		rc = WaitLatch(MyLatch,
+					   WL_LATCH_SET | WL_POSTMASTER_DEATH |
+					   (autoprewarm_interval > 0 ? WL_TIMEOUT : 0),
+					   autoprewarm_interval * 1000L);
+		ResetLatch(MyLatch);
+
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+
+		if (got_sighup)
+		{
+			got_sighup = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		SpinLockAcquire(&apw_state->mutex);
+		load_requested = apw_state->load_requested;
+		apw_state->load_requested = false;
+		SpinLockRelease(&apw_state->mutex);
+
+		if (load_requested)
+			apw_load();
+		else if (rc & WL_TIMEOUT)
+			apw_dump();
+	}
+
+	if (loaded)
+		apw_dump();
+	proc_exit(0);
+}
+
+/*
+ * Main of a worker loading its share of the relations of a database
+ */
+void
+autoprewarm_database_main(Datum main_arg)
+{
+	int			index = DatumGetInt32(main_arg);
+	Oid			database;
+	int			nworkers;
+	char	   *data;
+	BlockRange *ranges;
+	RelationRanges *relations;
+	int			nranges;
+	int			nrelations;
+	int64		budget;
+	int64		nblocks = 0;
+	int			i;
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	SpinLockAcquire(&apw_state->mutex);
+	database = apw_state->database;
+	nworkers = apw_state->nworkers;
+	SpinLockRelease(&apw_state->mutex);
+
+	BackgroundWorkerInitializeConnectionByOid(database, InvalidOid);
+
+	data = apw_read_file();
+	if (data == NULL)
+		proc_exit(0);
+	ranges = apw_parse_blocks(data, &nranges);
+	qsort(ranges, nranges, sizeof(BlockRange), block_range_cmp);
+	relations = apw_group_relations(ranges, nranges, database, &nrelations);
+
+	/* Don't evict the hottest blocks of the others for colder ones */
+	budget = NBuffers / nworkers;
+
+	/* The workers take the relations in turn, from the most used one */
+	for (i = index; i < nrelations && nblocks < budget; i += nworkers)
+	{
+		RelationRanges *relation = &relations[i];
+		Oid			relid;
+		Relation	rel;
+		int			r;
+
+		SetCurrentStatementStartTimestamp();
+		StartTransactionCommand();
+
+		relid = RelidByRelfilenode(relation->ranges[0].tablespace,
+								   relation->ranges[0].filenode);
+		rel = OidIsValid(relid) ? try_relation_open(relid, AccessShareLock) :
+			NULL;
+		if (rel == NULL)
+		{
+			/* Dropped or rewritten since the list was made */
+			CommitTransactionCommand();
+			continue;
+		}
+
+		RelationOpenSmgr(rel);
+		for (r = 0; r < relation->nranges && nblocks < budget; r++)
+		{
+			BlockRange *range = &relation->ranges[r];
+			BlockNumber last;
+			BlockNumber block;
+
+			if (!smgrexists(rel->rd_smgr, range->forknum))
+				continue;
+			last = Min(range->first + range->count,
+					   RelationGetNumberOfBlocksInFork(rel, range->forknum));
+			for (block = range->first; block < last && nblocks < budget; block++)
+			{
+				Buffer		buf;
+
+				CHECK_FOR_INTERRUPTS();
+				buf = ReadBufferExtended(rel, range->forknum, block,
+										 RBM_NORMAL, NULL);
+				ReleaseBuffer(buf);
+				nblocks++;
+			}
+		}
+
+		relation_close(rel, AccessShareLock);
+		CommitTransactionCommand();
+	}
+
+	elog(DEBUG1, "autoprewarm: loaded " INT64_FORMAT " blocks of database %u",
+		 nblocks, database);
+	proc_exit(0);
+}
+
+static void
+apw_check_running(void)
+{
+	if (apw_state == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("pg_prewarm must be loaded via shared_preload_libraries")));
+}
+
+/*
+ * autoprewarm_dump_now()
+ *
+ * Dump the block list of the buffer cache to the file right now, returns
+ * the number of blocks.
+ */
+Datum
+autoprewarm_dump_now(PG_FUNCTION_ARGS)
+{
+	apw_check_running();
+	PG_RETURN_INT64(apw_dump());
+}
+
+/*
+ * autoprewarm_block_list()
+ *
+ * The block list of the buffer cache, in the format of the file.
+ */
+Datum
+autoprewarm_block_list(PG_FUNCTION_ARGS)
+{
+	BlockRange *ranges;
+	StringInfoData buf;
+	int			nranges;
+
+	ranges = apw_collect_blocks(&nranges);
+	initStringInfo(&buf);
+	apw_format_blocks(&buf, ranges, nranges);
+
+	PG_RETURN_TEXT_P(cstring_to_text_with_len(buf.data, buf.len));
+}
+
+/*
+ * autoprewarm_load_block_list(list text)
+ *
+ * Replace the block list file with the given list, such as one returned by
+ * autoprewarm_block_list() on the server this one replicates, and have the
+ * autoprewarm worker load it. Returns the number of blocks of the list;
+ * they are loaded in the background.
+ */
+Datum
+autoprewarm_load_block_list(PG_FUNCTION_ARGS)
+{
+	text	   *list = PG_GETARG_TEXT_PP(0);
+	BlockRange *ranges;
+	int			nranges;
+	int64		nblocks = 0;
+	Latch	   *latch;
+	int			i;
+
+	if (!superuser())
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 errmsg("must be superuser to load a block list")));
+	apw_check_running();
+
+	/* Check the list before it replaces the file */
+	ranges = apw_parse_blocks(text_to_cstring(list), &nranges);
+	for (i = 0; i < nranges; i++)
+		nblocks += ranges[i].count;
+	apw_write_file(VARDATA_ANY(list), VARSIZE_ANY_EXHDR(list));
+
+	SpinLockAcquire(&apw_state->mutex);
+	latch = apw_state->master_latch;
+	if (latch != NULL)
+		apw_state->load_requested = true;
+	SpinLockRelease(&apw_state->mutex);
+
+	if (latch == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("autoprewarm worker is not running"),
+				 errhint("The list will be loaded at the next start.")));
+	SetLatch(latch);
+
+	PG_RETURN_INT64(nblocks);
+}
+
+#ifdef PGXC
+/*
+ * pgxc_prewarm_standby(standby name)
+ *
+ * Warm the buffer cache of a standby of a Datanode with the blocks held by
+ * the cache of the Datanode, typically before the standby is promoted.
+ * The list is taken from the Datanode and handed to the standby, which
+ * loads it in the background. Returns the number of blocks.
+ */
+Datum
+pgxc_prewarm_standby(PG_FUNCTION_ARGS)
+{
+	char	   *standby = NameStr(*PG_GETARG_NAME(0));
+	Oid			standbyoid = get_pgxc_nodeoid(standby);
+	const char *nspname;
+	int			node;
+	int			datanode = -1;
+	StringInfoData query;
+	RemoteQuery *step;
+	RemoteQueryState *state;
+	EState	   *estate;
+	MemoryContext oldcontext;
+	TupleTableSlot *result;
+	char	   *list = NULL;
+	PGXCNodeHandle *handle;
+	ResponseCombiner combiner;
+	BlockRange *ranges;
+	int			nranges;
+	int64		nblocks = 0;
+	int			i;
+
+	if (!superuser())
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 errmsg("must be superuser to prewarm a standby")));
+	if (!IS_PGXC_LOCAL_COORDINATOR)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("standbys can only be prewarmed from a Coordinator")));
+
+	for (node = NumDataNodes; node < NumDataNodes + NumStandbyNodes; node++)
+	{
+		if (PGXCNodeGetNodeOid(node, PGXC_NODE_DATANODE) == standbyoid)
+		{
+			datanode = PGXCNodeStandbyOf(node);
+			break;
+		}
+	}
+	if (!OidIsValid(standbyoid) || datanode < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_OBJECT),
+				 errmsg("\"%s\" is not a standby of a Datanode", standby)));
+
+	/* The functions live in the schema of this one on all the nodes */
+	nspname = get_namespace_name(get_func_namespace(fcinfo->flinfo->fn_oid));
+	nspname = quote_identifier(nspname);
+
+	/* Get the block list of the Datanode */
+	initStringInfo(&query);
+	appendStringInfo(&query, "SELECT %s.autoprewarm_block_list()", nspname);
+
+	step = makeNode(RemoteQuery);
+	step->combine_type = COMBINE_TYPE_NONE;
+	step->exec_nodes = makeNode(ExecNodes);
+	step->exec_nodes->nodeList = list_make1_int(datanode);
+	step->exec_type = EXEC_ON_DATANODES;
+	step->sql_statement = query.data;
+	step->force_autocommit = false;
+	step->scan.plan.targetlist =
+		list_make1(makeTargetEntry((Expr *) makeVar(1, 1, TEXTOID, -1,
+													DEFAULT_COLLATION_OID, 0),
+								   1, NULL, false));
+
+	estate = CreateExecutorState();
+	oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+	estate->es_snapshot = GetActiveSnapshot();
+	state = ExecInitRemoteQuery(step, estate, 0);
+	MemoryContextSwitchTo(oldcontext);
+
+	result = ExecRemoteQuery(state);
+	if (result != NULL && !TupIsNull(result))
+	{
+		bool		isnull;
+		Datum		value = slot_getattr(result, 1, &isnull);
+
+		if (!isnull)
+			list = TextDatumGetCString(value);
+	}
+	ExecEndRemoteQuery(state);
+	FreeExecutorState(estate);
+
+	if (list == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("could not get the block list of the Datanode of \"%s\"",
+						standby)));
+
+	/* Hand it to the standby, which only runs read-only statements */
+	resetStringInfo(&query);
+	appendStringInfo(&query, "SELECT %s.autoprewarm_load_block_list(%s)",
+					 nspname, quote_literal_cstr(list));
+
+	handle = get_standby_handle(node);
+	if (handle == NULL ||
+		handle->state != DN_CONNECTION_STATE_IDLE ||
+		pgxc_node_send_snapshot(handle, NULL) ||
+		pgxc_node_send_query(handle, query.data))
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("could not send the block list to standby \"%s\"",
+						standby)));
+
+	InitResponseCombiner(&combiner, 1, COMBINE_TYPE_NONE);
+	for (;;)
+	{
+		int			res;
+
+		if (pgxc_node_receive(1, &handle, NULL))
+			ereport(ERROR,
+					(errcode(ERRCODE_CONNECTION_FAILURE),
+					 errmsg("lost the connection to standby \"%s\"",
+							standby)));
+		res = handle_response(handle, &combiner);
+		if (res == RESPONSE_DATAROW)
+		{
+			/* The count of blocks, which is known already */
+			pfree(combiner.currentRow);
+			combiner.currentRow = NULL;
+		}
+		else if (res == RESPONSE_READY)
+			break;
+	}
+	if (combiner.errorMessage)
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("could not prewarm standby \"%s\": %s",
+						standby, combiner.errorMessage)));
+	CloseCombiner(&combiner);
+
+	ranges = apw_parse_blocks(list, &nranges);
+	for (i = 0; i < nranges; i++)
+		nblocks += ranges[i].count;
+
+	PG_RETURN_INT64(nblocks);
+}
+#endif
+
+/*
+ * Module load callback
+ */
+void
+_PG_init(void)
+{
+	BackgroundWorker worker;
+
+	DefineCustomIntVariable("pg_prewarm.autoprewarm_interval",
+							"Time between dumps of the block list of the buffer cache.",
+							"0 dumps it only at shutdown.",
+							&autoprewarm_interval,
+							300,
+							0,
+							INT_MAX / 1000,
+							PGC_SIGHUP,
+							GUC_UNIT_S,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pg_prewarm.autoprewarm_workers",
+							"Number of workers loading the blocks of a database in parallel.",
+							NULL,
+							&autoprewarm_workers,
+							4,
+							1,
+							AUTOPREWARM_MAX_WORKERS,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	DefineCustomBoolVariable("pg_prewarm.autoprewarm",
+							 "Dumps the buffer cache and reloads it at startup.",
+							 NULL,
+							 &autoprewarm,
+							 true,
+							 PGC_POSTMASTER,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	EmitWarningsOnPlaceholders("pg_prewarm");
+
+	RequestAddinShmemSpace(MAXALIGN(sizeof(AutoPrewarmState)));
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = autoprewarm_shmem_startup;
+
+	if (!autoprewarm)
+		return;
+
+	MemSet(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+	worker.bgw_restart_time = 60;
+	worker.bgw_main = autoprewarm_main;
+	worker.bgw_notify_pid = 0;
+	snprintf(worker.bgw_name, BGW_MAXLEN, "autoprewarm");
+
+	RegisterBackgroundWorker(&worker);
+}
@@ -0,0 +1,30 @@
+/* contrib/pg_prewarm/pg_prewarm--1.0--1.1.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION pg_prewarm UPDATE TO '1.1'" to load this file. \quit
+
+-- Block lists of the buffer cache, see autoprewarm.c
+CREATE FUNCTION autoprewarm_dump_now()
+RETURNS int8
+AS 'MODULE_PATHNAME', 'autoprewarm_dump_now'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION autoprewarm_block_list()
+RETURNS text
+AS 'MODULE_PATHNAME', 'autoprewarm_block_list'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION autoprewarm_load_block_list(list text)
+RETURNS int8
+AS 'MODULE_PATHNAME', 'autoprewarm_load_block_list'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgxc_prewarm_standby(standby name)
+RETURNS int8
+AS 'MODULE_PATHNAME', 'pgxc_prewarm_standby'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION autoprewarm_dump_now() FROM PUBLIC;
+REVOKE ALL ON FUNCTION autoprewarm_block_list() FROM PUBLIC;
+REVOKE ALL ON FUNCTION autoprewarm_load_block_list(text) FROM PUBLIC;
+REVOKE ALL ON FUNCTION pgxc_prewarm_standby(name) FROM PUBLIC;
@@ -0,0 +1,40 @@
+/* contrib/pg_prewarm/pg_prewarm--1.1.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION pg_prewarm" to load this file. \quit
+
+-- Register the function.
+CREATE FUNCTION pg_prewarm(regclass,
+						   mode text default 'buffer',
+						   fork text default 'main',
+						   first_block int8 default null,
+						   last_block int8 default null)
+RETURNS int8
+AS 'MODULE_PATHNAME', 'pg_prewarm'
+LANGUAGE C;
+
+-- Block lists of the buffer cache, see autoprewarm.c
+CREATE FUNCTION autoprewarm_dump_now()
+RETURNS int8
+AS 'MODULE_PATHNAME', 'autoprewarm_dump_now'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION autoprewarm_block_list()
+RETURNS text
+AS 'MODULE_PATHNAME', 'autoprewarm_block_list'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION autoprewarm_load_block_list(list text)
+RETURNS int8
+AS 'MODULE_PATHNAME', 'autoprewarm_load_block_list'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgxc_prewarm_standby(standby name)
+RETURNS int8
+AS 'MODULE_PATHNAME', 'pgxc_prewarm_standby'
+LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION autoprewarm_dump_now() FROM PUBLIC;
+REVOKE ALL ON FUNCTION autoprewarm_block_list() FROM PUBLIC;
+REVOKE ALL ON FUNCTION autoprewarm_load_block_list(text) FROM PUBLIC;
+REVOKE ALL ON FUNCTION pgxc_prewarm_standby(name) FROM PUBLIC;
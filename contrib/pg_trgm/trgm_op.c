@@ -4,6 +4,7 @@
 #include "postgres.h"
 
 #include <ctype.h>
+#include <limits.h>
 
 #include "trgm.h"
 
@@ -12,6 +13,15 @@
 #include "utils/memutils.h"
 #include "utils/pg_crc.h"
 
+/*
+ * SSE2 is part of the x86-64 baseline, so it is used without a runtime check
+ * wherever the compiler targets it.
+ */
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define USE_SSE2_TRGM
+#endif
+
 PG_MODULE_MAGIC;
 
 float4		trgm_limit = 0.3f;
@@ -67,6 +77,108 @@ unique_array(trgm *a, int len)
 	return curend + 1 - a;
 }
 
+/*
+ * Trigrams are compared as plain chars by CMPTRGM, so whether they sort by
+ * signed or unsigned byte values depends on the platform.  TRGM_KEY maps a
+ * trigram to an integer that sorts the same way, flipping the sign bits of
+ * the bytes where char is signed; TRGM_FROM_KEY maps it back.
+ */
+#if CHAR_MIN < 0
+#define TRGM_SIGN_FLIP	0x80
+#else
+#define TRGM_SIGN_FLIP	0
+#endif
+
+#define TRGM_BYTE_KEY(t, i) \
+	((uint32) (((unsigned char) ((const char *) (t))[i]) ^ TRGM_SIGN_FLIP))
+#define TRGM_KEY(t) \
+	((TRGM_BYTE_KEY(t, 0) << 16) | (TRGM_BYTE_KEY(t, 1) << 8) | \
+	 TRGM_BYTE_KEY(t, 2))
+#define TRGM_FROM_KEY(t, key) do { \
+	((char *) (t))[0] = (char) ((((key) >> 16) & 0xff) ^ TRGM_SIGN_FLIP); \
+	((char *) (t))[1] = (char) ((((key) >> 8) & 0xff) ^ TRGM_SIGN_FLIP); \
+	((char *) (t))[2] = (char) (((key) & 0xff) ^ TRGM_SIGN_FLIP); \
+} while (0)
+
+/* Arrays shorter than this are sorted with qsort() */
+#define TRGM_RADIX_SORT_THRESHOLD	64
+
+/*
+ * Sort an array of trigrams and remove duplicates, returning the new length.
+ *
+ * Long arrays are sorted as integer keys with a radix sort, one pass per
+ * trigram byte, which avoids the comparator calls of qsort() that dominate
+ * trigram extraction from long documents.
+ */
+static int
+sort_unique_trgms(trgm *a, int len)
+{
+	uint32	   *keys;
+	uint32	   *src;
+	uint32	   *dst;
+	int			count[3][256];
+	int			pass;
+	int			i;
+	int			n;
+
+	if (len < TRGM_RADIX_SORT_THRESHOLD)
+	{
+		qsort((void *) a, len, sizeof(trgm), comp_trgm);
+		return unique_array(a, len);
+	}
+
+	keys = (uint32 *) palloc(sizeof(uint32) * len * 2);
+	src = keys;
+	dst = keys + len;
+
+	/* Build the keys and the histograms of all three passes at once */
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < len; i++)
+	{
+		uint32		key = TRGM_KEY(a[i]);
+
+		src[i] = key;
+		count[0][key & 0xff]++;
+		count[1][(key >> 8) & 0xff]++;
+		count[2][key >> 16]++;
+	}
+
+	for (pass = 0; pass < 3; pass++)
+	{
+		int			shift = pass * 8;
+		int			sum = 0;
+		uint32	   *tmp;
+
+		for (i = 0; i < 256; i++)
+		{
+			int			c = count[pass][i];
+
+			count[pass][i] = sum;
+			sum += c;
+		}
+		for (i = 0; i < len; i++)
+			dst[count[pass][(src[i] >> shift) & 0xff]++] = src[i];
+
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	n = 0;
+	for (i = 0; i < len; i++)
+	{
+		if (i == 0 || src[i] != src[i - 1])
+		{
+			TRGM_FROM_KEY(a[n], src[i]);
+			n++;
+		}
+	}
+
+	pfree(keys);
+
+	return n;
+}
+
 /*
  * Finds first word in string, returns pointer to the word,
  * endword points to the character after word
@@ -244,10 +356,7 @@ generate_trgm(char *str, int slen)
 	 * Make trigrams unique.
 	 */
 	if (len > 1)
-	{
-		qsort((void *) GETARR(trg), len, sizeof(trgm), comp_trgm);
-		len = unique_array(GETARR(trg), len);
-	}
+		len = sort_unique_trgms(GETARR(trg), len);
 
 	SET_VARSIZE(trg, CALCGTSIZE(ARRKEY, len));
 
@@ -556,6 +665,70 @@ show_trgm(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(a);
 }
 
+/*
+ * Count the common elements of two sorted arrays of distinct keys.
+ *
+ * With SSE2, blocks of four keys of each array are compared all against all
+ * with four vector compares, and the block with the smaller last key is
+ * advanced.  Each pair of blocks is compared at most once, and the keys are
+ * distinct, so every match is counted once.  The rest is merged one by one.
+ */
+static int
+count_common_keys(const uint32 *a, int na, const uint32 *b, int nb)
+{
+	int			i = 0;
+	int			j = 0;
+	int			count = 0;
+
+#ifdef USE_SSE2_TRGM
+	static const uint8 nmatches[16] = {
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+	};
+
+	while (i + 4 <= na && j + 4 <= nb)
+	{
+		__m128i		va = _mm_loadu_si128((const __m128i *) (a + i));
+		__m128i		vb = _mm_loadu_si128((const __m128i *) (b + j));
+		__m128i		match;
+		uint32		amax = a[i + 3];
+		uint32		bmax = b[j + 3];
+
+		match = _mm_cmpeq_epi32(va, vb);
+		match = _mm_or_si128(match, _mm_cmpeq_epi32(va,
+								_mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+		match = _mm_or_si128(match, _mm_cmpeq_epi32(va,
+								_mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+		match = _mm_or_si128(match, _mm_cmpeq_epi32(va,
+								_mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+		count += nmatches[_mm_movemask_ps(_mm_castsi128_ps(match))];
+
+		if (amax <= bmax)
+			i += 4;
+		if (bmax <= amax)
+			j += 4;
+	}
+#endif
+
+	while (i < na && j < nb)
+	{
+		if (a[i] < b[j])
+			i++;
+		else if (a[i] > b[j])
+			j++;
+		else
+		{
+			i++;
+			j++;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/* Arrays up to this length are converted to keys on the stack */
+#define TRGM_LOCAL_KEYS		256
+
 float4
 cnt_sml(TRGM *trg1, TRGM *trg2)
 {
@@ -564,6 +737,10 @@ cnt_sml(TRGM *trg1, TRGM *trg2)
 	int			count = 0;
 	int			len1,
 				len2;
+	uint32		local_keys[TRGM_LOCAL_KEYS];
+	uint32	   *keys1,
+			   *keys2;
+	int			i;
 
 	ptr1 = GETARR(trg1);
 	ptr2 = GETARR(trg2);
@@ -575,21 +752,24 @@ cnt_sml(TRGM *trg1, TRGM *trg2)
 	if (len1 <= 0 || len2 <= 0)
 		return (float4) 0.0;
 
-	while (ptr1 - GETARR(trg1) < len1 && ptr2 - GETARR(trg2) < len2)
-	{
-		int			res = CMPTRGM(ptr1, ptr2);
+	/*
+	 * Convert the trigrams to integer keys, which are compared in one step
+	 * instead of up to three.
+	 */
+	if (len1 + len2 <= TRGM_LOCAL_KEYS)
+		keys1 = local_keys;
+	else
+		keys1 = (uint32 *) palloc(sizeof(uint32) * (len1 + len2));
+	keys2 = keys1 + len1;
+	for (i = 0; i < len1; i++)
+		keys1[i] = TRGM_KEY(ptr1[i]);
+	for (i = 0; i < len2; i++)
+		keys2[i] = TRGM_KEY(ptr2[i]);
 
-		if (res < 0)
-			ptr1++;
-		else if (res > 0)
-			ptr2++;
-		else
-		{
-			ptr1++;
-			ptr2++;
-			count++;
-		}
-	}
+	count = count_common_keys(keys1, len1, keys2, len2);
+
+	if (keys1 != local_keys)
+		pfree(keys1);
 
 #ifdef DIVUNION
 	return ((float4) count) / ((float4) (len1 + len2 - count));
@@ -1106,6 +1106,20 @@ NodeType getNodeType(char *nodeName)
 
 }
 
+/*
+ * Number of connections pg_basebackup uses to copy a master to its slave.
+ */
+int getBaseBackupJobs(void)
+{
+	int jobs;
+
+	if (!find_var(VAR_baseBackupJobs) || !sval(VAR_baseBackupJobs) ||
+		is_none(sval(VAR_baseBackupJobs)))
+		return 1;
+	jobs = atoi(sval(VAR_baseBackupJobs));
+	return (jobs > 1) ? jobs : 1;
+}
+
 int getDefaultWalSender(int isCoord)
 {
 	int ii;
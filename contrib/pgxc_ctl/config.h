@@ -34,6 +34,7 @@ int checkNameConflict(char *name, int is_gtm);
 int checkPortConflict(char *host, int port);
 int checkDirConflict(char *host, char *dir);
 void makeServerList(void);
+int getBaseBackupJobs(void);
 int getDefaultWalSender(int isCoord);
 
 #define DEBUG() (strcasecmp(sval(VAR_debug), "y") == 0)
@@ -281,8 +281,9 @@ cmd_t *prepare_initCoordinatorSlave(char *nodeName)
 	 */
 	appendCmdEl(cmdBuildDir, (cmdBaseBkup = initCmd(aval(VAR_coordSlaveServers)[idx])));
 	snprintf(newCommand(cmdBaseBkup), MAXLINE,
-			 "pg_basebackup -p %s -h %s -D %s -x",
-			 aval(VAR_coordPorts)[idx], aval(VAR_coordMasterServers)[idx], aval(VAR_coordSlaveDirs)[idx]);
+			 "pg_basebackup -p %s -h %s -D %s -x -j %d",
+			 aval(VAR_coordPorts)[idx], aval(VAR_coordMasterServers)[idx], aval(VAR_coordSlaveDirs)[idx],
+			 getBaseBackupJobs());
 
 	/* Configure recovery.conf file at the slave */
 	appendCmdEl(cmdBuildDir, (cmdRecoveryConf = initCmd(aval(VAR_coordSlaveServers)[idx])));
@@ -953,6 +954,8 @@ int add_coordinatorMaster(char *name, char *host, int port, int pooler,
 	int ii, jj;
 	char **confFiles = NULL;
 	char **pgHbaConfFiles = NULL;
+	cmdList_t *cmdList;
+	cmd_t *cmd;
 
 	/* Check if all the coordinator masters are running */
 	if (!check_AllCoordRunning())
@@ -1169,41 +1172,60 @@ int add_coordinatorMaster(char *name, char *host, int port, int pooler,
 	start_coordinator_master(nodelist);
 	CleanArray(nodelist);
 
-	/* Issue CREATE NODE on coordinators */
+	/*
+	 * Issue CREATE NODE on coordinators and datanodes. Each node is
+	 * configured by its own psql session, all of them at once.
+	 */
+	cmdList = initCmdList();
 	for (ii = 0; aval(VAR_coordNames)[ii]; ii++)
 	{
 		if (!is_none(aval(VAR_coordNames)[ii]) && strcmp(aval(VAR_coordNames)[ii], name) != 0)
 		{
-			if ((f = pgxc_popen_wRaw("psql -h %s -p %d %s", aval(VAR_coordMasterServers)[ii], atoi(aval(VAR_coordPorts)[ii]), sval(VAR_defaultDatabase))) == NULL)
+			cmd = initCmd(NULL);
+			snprintf(newCommand(cmd), MAXLINE,
+					 "psql -h %s -p %d %s",
+					 aval(VAR_coordMasterServers)[ii],
+					 atoi(aval(VAR_coordPorts)[ii]),
+					 sval(VAR_defaultDatabase));
+			if ((f = prepareLocalStdin(newFilename(cmd->localStdin), MAXPATH, NULL)) == NULL)
 			{
-				elog(ERROR, "ERROR: cannot connect to the coordinator master %s.\n", aval(VAR_coordNames)[ii]);
+				elog(ERROR, "ERROR: cannot configure the coordinator master %s.\n", aval(VAR_coordNames)[ii]);
+				cleanCmd(cmd);
 				continue;
 			}
 			fprintf(f, "CREATE NODE %s WITH (TYPE = 'coordinator', host='%s', PORT=%d);\n", name, host, port);
 			fprintf(f, "SELECT pgxc_pool_reload();\n");
 			fprintf(f, "\\q\n");
-			pclose(f);
+			fclose(f);
+			addCmd(cmdList, cmd);
 		}
 	}
-	/* Issue CREATE NODE on datanodes */
 	for (ii = 0; aval(VAR_datanodeNames)[ii]; ii++)
 	{
 		if (!is_none(aval(VAR_datanodeNames)[ii]))
 		{
-			if ((f = pgxc_popen_wRaw("psql -h %s -p %d %s",
-							aval(VAR_coordMasterServers)[connCordIndx],
-							atoi(aval(VAR_coordPorts)[connCordIndx]),
-							sval(VAR_defaultDatabase))) == NULL)
+			cmd = initCmd(NULL);
+			snprintf(newCommand(cmd), MAXLINE,
+					 "psql -h %s -p %d %s",
+					 aval(VAR_coordMasterServers)[connCordIndx],
+					 atoi(aval(VAR_coordPorts)[connCordIndx]),
+					 sval(VAR_defaultDatabase));
+			if ((f = prepareLocalStdin(newFilename(cmd->localStdin), MAXPATH, NULL)) == NULL)
 			{
-				elog(ERROR, "ERROR: cannot connect to the coordinator master %s.\n", aval(VAR_coordNames)[ii]);
+				elog(ERROR, "ERROR: cannot configure the datanode master %s.\n", aval(VAR_datanodeNames)[ii]);
+				cleanCmd(cmd);
 				continue;
 			}
 			fprintf(f, "EXECUTE DIRECT ON (%s) 'CREATE NODE %s WITH (TYPE = ''coordinator'', host=''%s'', PORT=%d)';\n", aval(VAR_datanodeNames)[ii], name, host, port);
 			fprintf(f, "EXECUTE DIRECT ON (%s) 'SELECT pgxc_pool_reload()';\n", aval(VAR_datanodeNames)[ii]);
 			fprintf(f, "\\q\n");
-			pclose(f);
+			fclose(f);
+			addCmd(cmdList, cmd);
 		}
 	}
+	doCmdList(cmdList);
+	cleanCmdList(cmdList);
+
 	/* Quit DDL lokkup session */
 	fprintf(lockf, "\\q\n");
 	pclose(lockf);
@@ -1372,8 +1394,9 @@ int add_coordinatorSlave(char *name, char *host, int port, int pooler_port, char
 	doImmediate(aval(VAR_coordMasterServers)[idx], NULL, 
 				"pg_ctl start -Z coordinator -D %s", aval(VAR_coordMasterDirs)[idx]);
 	/* pg_basebackup */
-	doImmediate(host, NULL, "pg_basebackup -p %s -h %s -D %s -x",
-				aval(VAR_coordPorts)[idx], aval(VAR_coordMasterServers)[idx], dir);
+	doImmediate(host, NULL, "pg_basebackup -p %s -h %s -D %s -x -j %d",
+				aval(VAR_coordPorts)[idx], aval(VAR_coordMasterServers)[idx], dir,
+				getBaseBackupJobs());
 	/* Update the slave configuration with hot standby and port */
 	if ((f = pgxc_popen_w(host, "cat >> %s/postgresql.conf", dir)) == NULL)
 	{
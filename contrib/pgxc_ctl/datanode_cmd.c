@@ -279,9 +279,9 @@ cmd_t *prepare_initDatanodeSlave(char *nodeName)
 	/* Obtain base backup of the master */
 	appendCmdEl(cmdBuildDir, (cmdBaseBkup = initCmd(aval(VAR_datanodeSlaveServers)[idx])));
 	snprintf(newCommand(cmdBaseBkup), MAXLINE, 
-			 "pg_basebackup -p %s -h %s -D %s -x",
+			 "pg_basebackup -p %s -h %s -D %s -x -j %d",
 			 aval(VAR_datanodePorts)[idx], aval(VAR_datanodeMasterServers)[idx],
-			 aval(VAR_datanodeSlaveDirs)[idx]);
+			 aval(VAR_datanodeSlaveDirs)[idx], getBaseBackupJobs());
 
 	/* Configure recovery.conf of the slave */
 	appendCmdEl(cmdBuildDir, (cmdRecovConf = initCmd(aval(VAR_datanodeSlaveServers)[idx])));
@@ -926,6 +926,8 @@ int add_datanodeMaster(char *name, char *host, int port, int pooler, char *dir,
 	char **confFiles = NULL;
 	char **pgHbaConfFiles = NULL;
 	char *only_globals = "-g";
+	cmdList_t *cmdList;
+	cmd_t *cmd;
 
 	/* Check if all the datanodes are running */
 	if (!check_AllDatanodeRunning())
@@ -1159,39 +1161,51 @@ int add_datanodeMaster(char *name, char *host, int port, int pooler, char *dir,
 	start_datanode_master(nodelist);
 	CleanArray(nodelist);
 
-	/* Issue CREATE NODE  on coordinators */
+	/* find any available coordinator */
+	connCordIdx = get_any_available_coord(-1);
+
+	/*
+	 * Issue CREATE NODE on coordinators and datanodes. Each node is
+	 * configured by its own psql session, all of them at once.
+	 */
+	cmdList = initCmdList();
 	for (ii = 0; aval(VAR_coordNames)[ii]; ii++)
 	{
 		if (!is_none(aval(VAR_coordNames)[ii]))
 		{
-			if ((f = pgxc_popen_wRaw("psql -h %s -p %s %s", aval(VAR_coordMasterServers)[ii], aval(VAR_coordPorts)[ii], sval(VAR_defaultDatabase))) == NULL)
+			cmd = initCmd(NULL);
+			snprintf(newCommand(cmd), MAXLINE,
+					 "psql -h %s -p %s %s",
+					 aval(VAR_coordMasterServers)[ii],
+					 aval(VAR_coordPorts)[ii],
+					 sval(VAR_defaultDatabase));
+			if ((f = prepareLocalStdin(newFilename(cmd->localStdin), MAXPATH, NULL)) == NULL)
 			{
-				elog(ERROR, "ERROR: cannot connect to the datanode master %s.\n", aval(VAR_coordNames)[ii]);
+				elog(ERROR, "ERROR: cannot configure the coordinator master %s.\n", aval(VAR_coordNames)[ii]);
+				cleanCmd(cmd);
 				continue;
 			}
 			fprintf(f, "CREATE NODE %s WITH (TYPE = 'datanode', host='%s', PORT=%d);\n", name, host, port);
 			fprintf(f, "SELECT pgxc_pool_reload();\n");
 			fprintf(f, "\\q\n");
-			pclose(f);
+			fclose(f);
+			addCmd(cmdList, cmd);
 		}
 	}
-
-	/* find any available coordinator */
-	connCordIdx = get_any_available_coord(-1);
-	if (connCordIdx == -1)
-		return 1;
-
-	/* Issue CREATE NODE  on datanodes */
-	for (ii = 0; aval(VAR_datanodeNames)[ii]; ii++)
+	for (ii = 0; connCordIdx != -1 && aval(VAR_datanodeNames)[ii]; ii++)
 	{
 		if (!is_none(aval(VAR_datanodeNames)[ii]))
 		{
-			if ((f = pgxc_popen_wRaw("psql -h %s -p %s %s",
-							aval(VAR_coordMasterServers)[connCordIdx],
-							aval(VAR_coordPorts)[connCordIdx],
-							sval(VAR_defaultDatabase))) == NULL)
+			cmd = initCmd(NULL);
+			snprintf(newCommand(cmd), MAXLINE,
+					 "psql -h %s -p %s %s",
+					 aval(VAR_coordMasterServers)[connCordIdx],
+					 aval(VAR_coordPorts)[connCordIdx],
+					 sval(VAR_defaultDatabase));
+			if ((f = prepareLocalStdin(newFilename(cmd->localStdin), MAXPATH, NULL)) == NULL)
 			{
-				elog(ERROR, "ERROR: cannot connect to the coordinator %s.\n", aval(VAR_coordNames)[0]);
+				elog(ERROR, "ERROR: cannot configure the datanode master %s.\n", aval(VAR_datanodeNames)[ii]);
+				cleanCmd(cmd);
 				continue;
 			}
 			if (strcmp(aval(VAR_datanodeNames)[ii], name) != 0)
@@ -1200,9 +1214,14 @@ int add_datanodeMaster(char *name, char *host, int port, int pooler, char *dir,
 				fprintf(f, "EXECUTE DIRECT ON (%s) 'ALTER NODE %s WITH (TYPE = ''datanode'', host=''%s'', PORT=%d)';\n", aval(VAR_datanodeNames)[ii], name, host, port);
 			fprintf(f, "EXECUTE DIRECT ON (%s) 'SELECT pgxc_pool_reload();'\n", aval(VAR_datanodeNames)[ii]);
 			fprintf(f, "\\q\n");
-			pclose(f);
+			fclose(f);
+			addCmd(cmdList, cmd);
 		}
 	}
+	doCmdList(cmdList);
+	cleanCmdList(cmdList);
+	if (connCordIdx == -1)
+		return 1;
 
 	/* Quit DDL lokkup session */
 	fprintf(lockf, "\\q\n");
@@ -1368,8 +1387,9 @@ int add_datanodeSlave(char *name, char *host, int port, int pooler, char *dir, c
 	doImmediate(aval(VAR_datanodeMasterServers)[idx], NULL, 
 				"pg_ctl start -Z datanode -D %s", aval(VAR_datanodeMasterDirs)[idx]);
 	/* pg_basebackup */
-	doImmediate(host, NULL, "pg_basebackup -p %s -h %s -D %s -x",
-				aval(VAR_datanodePorts)[idx], aval(VAR_datanodeMasterServers)[idx], dir);
+	doImmediate(host, NULL, "pg_basebackup -p %s -h %s -D %s -x -j %d",
+				aval(VAR_datanodePorts)[idx], aval(VAR_datanodeMasterServers)[idx], dir,
+				getBaseBackupJobs());
 	/* Update the slave configuration with hot standby and port */
 	if ((f = pgxc_popen_w(host, "cat >> %s/postgresql.conf", dir)) == NULL)
 	{
@@ -27,6 +27,7 @@
 #define VAR_configBackupHost	"configBackupHost"
 #define VAR_configBackupDir	"configBackupDir"
 #define VAR_configBackupFile	"configBackupFile"
+#define VAR_baseBackupJobs	"baseBackupJobs"
 #define VAR_allServers		"allServers"
 
 
@@ -0,0 +1,187 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgxc_deadlock.c
+ *	  Background worker running the global deadlock check periodically
+ *
+ * The worker runs on every Coordinator loading the module, but only the
+ * Coordinator whose name comes first in pgxc_node does the checks, so the
+ * Datanodes are not queried by all of them.  The Coordinators are expected
+ * to have the same configuration; if the first one doesn't load the module,
+ * no check is done.
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * contrib/pgxc_deadlock/pgxc_deadlock.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "executor/spi.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "pgxc/pgxc.h"
+#include "postmaster/bgworker.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "utils/guc.h"
+#include "utils/snapmgr.h"
+
+PG_MODULE_MAGIC;
+
+void		_PG_init(void);
+void		pgxc_deadlock_main(Datum main_arg) pg_attribute_noreturn();
+
+/* flags set by signal handlers */
+static volatile sig_atomic_t got_sighup = false;
+static volatile sig_atomic_t got_sigterm = false;
+
+/* GUC variables */
+static int	pgxc_deadlock_naptime = 10;
+static char *pgxc_deadlock_database = NULL;
+
+#define ELECTION_QUERY \
+	"SELECT node_name = pg_catalog.pgxc_node_str() FROM pg_catalog.pgxc_node " \
+	"WHERE node_type = 'C' ORDER BY node_name LIMIT 1"
+#define CHECK_QUERY \
+	"SELECT * FROM pg_catalog.pgxc_global_deadlock_check()"
+
+static void
+pgxc_deadlock_sigterm(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_sigterm = true;
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+static void
+pgxc_deadlock_sighup(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_sighup = true;
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+/*
+ * Is this Coordinator the one doing the checks?
+ */
+static bool
+pgxc_deadlock_elected(void)
+{
+	bool		isnull;
+
+	if (SPI_execute(ELECTION_QUERY, true, 1) != SPI_OK_SELECT)
+		elog(ERROR, "could not query pgxc_node");
+	if (SPI_processed != 1)
+		return false;
+
+	return DatumGetBool(SPI_getbinval(SPI_tuptable->vals[0],
+									  SPI_tuptable->tupdesc, 1, &isnull));
+}
+
+void
+pgxc_deadlock_main(Datum main_arg)
+{
+	pqsignal(SIGHUP, pgxc_deadlock_sighup);
+	pqsignal(SIGTERM, pgxc_deadlock_sigterm);
+	BackgroundWorkerUnblockSignals();
+
+	BackgroundWorkerInitializeConnection(pgxc_deadlock_database, NULL);
+
+	while (!got_sigterm)
+	{
+		int			rc;
+
+		rc = WaitLatch(MyLatch,
+					   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   pgxc_deadlock_naptime * 1000L);
+		ResetLatch(MyLatch);
+
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+
+		if (got_sighup)
+		{
+			got_sighup = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		/* Datanodes don't see the other nodes */
+		if (!IS_PGXC_COORDINATOR || got_sigterm)
+			continue;
+
+		SetCurrentStatementStartTimestamp();
+		StartTransactionCommand();
+		SPI_connect();
+		PushActiveSnapshot(GetTransactionSnapshot());
+		pgstat_report_activity(STATE_RUNNING, CHECK_QUERY);
+
+		/* The victims are reported in the log by the check itself */
+		if (pgxc_deadlock_elected() &&
+			SPI_execute(CHECK_QUERY, false, 0) != SPI_OK_SELECT)
+			elog(ERROR, "could not check for global deadlocks");
+
+		SPI_finish();
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		pgstat_report_activity(STATE_IDLE, NULL);
+	}
+
+	proc_exit(1);
+}
+
+/*
+ * Module load callback
+ */
+void
+_PG_init(void)
+{
+	BackgroundWorker worker;
+
+	DefineCustomIntVariable("pgxc_deadlock.naptime",
+							"Time between checks for global deadlocks.",
+							NULL,
+							&pgxc_deadlock_naptime,
+							10,
+							1,
+							INT_MAX / 1000,
+							PGC_SIGHUP,
+							GUC_UNIT_S,
+							NULL,
+							NULL,
+							NULL);
+
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	DefineCustomStringVariable("pgxc_deadlock.database",
+							   "Database the worker connects to.",
+							   NULL,
+							   &pgxc_deadlock_database,
+							   "postgres",
+							   PGC_POSTMASTER,
+							   0,
+							   NULL,
+							   NULL,
+							   NULL);
+
+	MemSet(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+		BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = 60;
+	worker.bgw_main = pgxc_deadlock_main;
+	worker.bgw_notify_pid = 0;
+	snprintf(worker.bgw_name, BGW_MAXLEN, "global deadlock detector");
+
+	RegisterBackgroundWorker(&worker);
+}
@@ -0,0 +1,810 @@
+/*
+ * ------------------------------------------------------------------------
+ *
+ * pgxc_loadbench utility
+ *
+ *	Benchmarks loading data into a Postgres-XL cluster.
+ *
+ *	For each distribution and each loading mode requested, the utility
+ *	creates a table distributed that way, then several clients load rows
+ *	into it concurrently, spread over one or more Coordinators. The rows are
+ *	generated by the clients, as CSV or binary COPY data or as INSERT
+ *	statements. The clients connect first and start loading together.
+ *
+ *	At the end of each run the utility reports the elapsed time and the
+ *	overall throughput, the rows, throughput, size and skew of every
+ *	Datanode from pgxc_get_distribution(), and the CPU time used by the
+ *	Coordinator backends of the clients. The CPU time is read from /proc, so
+ *	it is only known for Coordinators running on the local host.
+ *
+ * Command syntax
+ *
+ * pgxc_loadbench [option ... ]
+ *
+ * Options are:
+ *
+ *  -h, --hosts=HOST[:PORT],...	Coordinators the clients connect to, in
+ *							turn. Default is the libpq default.
+ *  -d, --dbname=DBNAME		database name.
+ *  -U, --username=USER		user name.
+ *  -c, --clients=NUM		number of clients, default 4.
+ *  -r, --rows=NUM			rows loaded by each client, default 100000.
+ *  -D, --distributions=LIST	comma-separated list of the distributions
+ *							of the tables among hash, modulo, roundrobin and
+ *							replication, default all of them.
+ *  -m, --modes=LIST		comma-separated list of the loading modes among
+ *							copy (COPY in CSV format), binary (COPY in binary
+ *							format), values (multi-row INSERT) and insert
+ *							(prepared single-row INSERT in transactions),
+ *							default copy.
+ *  -b, --batch=NUM			rows per COPY data message, per INSERT statement
+ *							in values mode, or per transaction in insert mode,
+ *							default 1000.
+ *  -w, --width=NUM			length of the text column, default 100.
+ *  -?, --help				print help and exit.
+ *
+ * The tables are named pgxc_loadbench_<distribution>. They are dropped and
+ * created again before each run, and left in place at the end.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#include "postgres_fe.h"
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "getopt_long.h"
+#include "libpq-fe.h"
+#include "portability/instr_time.h"
+
+typedef enum
+{
+	MODE_COPY,
+	MODE_BINARY,
+	MODE_VALUES,
+	MODE_INSERT
+} LoadMode;
+
+static const char *const mode_names[] = {"copy", "binary", "values", "insert"};
+
+static const char *const distributions[] = {"hash", "modulo", "roundrobin",
+											"replication"};
+static const char *const distribute_by[] = {"HASH (id)", "MODULO (id)",
+											"ROUNDROBIN", "REPLICATION"};
+#define NUM_DISTRIBUTIONS lengthof(distributions)
+
+typedef struct
+{
+	char	   *host;			/* NULL for the libpq default */
+	char	   *port;
+	bool		local;			/* can its backends be seen in /proc */
+} Coordinator;
+
+/* What a client sends back to the parent */
+typedef struct
+{
+	int			client;
+	int64		rows;
+	double		cpu;			/* seconds used by the backend, -1 if unknown */
+} ClientResult;
+
+static const char *progname;
+static Coordinator *coords = NULL;
+static int	ncoords = 0;
+static const char *dbname = NULL;
+static const char *username = NULL;
+static int	nclients = 4;
+static int64 nrows = 100000;
+static bool use_distribution[NUM_DISTRIBUTIONS];
+static bool use_mode[lengthof(mode_names)];
+static int	batch_size = 1000;
+static int	width = 100;
+
+static char *payload;
+
+static void usage(void);
+static void parse_hosts(const char *arg);
+static bool parse_list(const char *arg, const char *const *names, int count,
+		   bool *result);
+static PGconn *connect_coordinator(int index);
+static void exec_command(PGconn *conn, const char *query);
+static double backend_cpu(PGconn *conn, int coord);
+static void put_int16(char *buf, int *pos, int value);
+static void put_int32(char *buf, int *pos, int value);
+static void load_copy(PGconn *conn, const char *table, int64 first, bool binary);
+static void load_values(PGconn *conn, const char *table, int64 first);
+static void load_insert(PGconn *conn, const char *table, int64 first);
+static void run_client(int client, const char *table, LoadMode mode,
+		   int ready_fd, int go_fd, int result_fd);
+static void run_benchmark(int distribution, LoadMode mode);
+static void report_distribution(const char *table, double elapsed);
+
+
+static void
+usage(void)
+{
+	printf("%s benchmarks loading data into a Postgres-XL cluster.\n\n", progname);
+	printf("Usage:\n");
+	printf("  %s [OPTION]...\n", progname);
+	printf("\nOptions:\n");
+	printf("  -h, --hosts=HOST[:PORT],...  Coordinators the clients connect to\n");
+	printf("  -d, --dbname=DBNAME          database name\n");
+	printf("  -U, --username=USER          user name\n");
+	printf("  -c, --clients=NUM            number of clients (default 4)\n");
+	printf("  -r, --rows=NUM               rows loaded by each client (default 100000)\n");
+	printf("  -D, --distributions=LIST     distributions among hash, modulo, roundrobin\n"
+		   "                               and replication (default all)\n");
+	printf("  -m, --modes=LIST             loading modes among copy, binary, values\n"
+		   "                               and insert (default copy)\n");
+	printf("  -b, --batch=NUM              rows per COPY message, INSERT statement or\n"
+		   "                               transaction (default 1000)\n");
+	printf("  -w, --width=NUM              length of the text column (default 100)\n");
+	printf("  -?, --help                   show this help, then exit\n");
+}
+
+
+/*
+ * Parse the comma-separated list of Coordinators
+ */
+static void
+parse_hosts(const char *arg)
+{
+	char	   *list = pg_strdup(arg);
+	char	   *item;
+
+	for (item = strtok(list, ","); item != NULL; item = strtok(NULL, ","))
+	{
+		Coordinator *coord;
+		char	   *sep = strrchr(item, ':');
+
+		coords = pg_realloc(coords, (ncoords + 1) * sizeof(Coordinator));
+		coord = &coords[ncoords++];
+		coord->port = NULL;
+		if (sep != NULL)
+		{
+			*sep = '\0';
+			if (sep[1] != '\0')
+				coord->port = pg_strdup(sep + 1);
+		}
+		coord->host = *item ? pg_strdup(item) : NULL;
+	}
+	free(list);
+}
+
+
+/*
+ * Parse a comma-separated list of names, setting the matching entries of
+ * result. Returns false if a name is unknown.
+ */
+static bool
+parse_list(const char *arg, const char *const *names, int count, bool *result)
+{
+	char	   *list = pg_strdup(arg);
+	char	   *item;
+	int			i;
+
+	memset(result, 0, count * sizeof(bool));
+	for (item = strtok(list, ","); item != NULL; item = strtok(NULL, ","))
+	{
+		for (i = 0; i < count; i++)
+			if (pg_strcasecmp(item, names[i]) == 0)
+				break;
+		if (i == count)
+		{
+			fprintf(stderr, "%s: unknown value \"%s\"\n", progname, item);
+			free(list);
+			return false;
+		}
+		result[i] = true;
+	}
+	free(list);
+	return true;
+}
+
+
+static PGconn *
+connect_coordinator(int index)
+{
+	const char *keywords[6];
+	const char *values[6];
+	PGconn	   *conn;
+	Coordinator *coord = &coords[index];
+
+	keywords[0] = "host";
+	values[0] = coord->host;
+	keywords[1] = "port";
+	values[1] = coord->port;
+	keywords[2] = "dbname";
+	values[2] = dbname;
+	keywords[3] = "user";
+	values[3] = username;
+	keywords[4] = "fallback_application_name";
+	values[4] = progname;
+	keywords[5] = NULL;
+	values[5] = NULL;
+
+	conn = PQconnectdbParams(keywords, values, true);
+	if (PQstatus(conn) != CONNECTION_OK)
+	{
+		fprintf(stderr, "%s: could not connect to %s:%s: %s",
+				progname, coord->host ? coord->host : "(default)",
+				coord->port ? coord->port : "(default)",
+				PQerrorMessage(conn));
+		exit(1);
+	}
+	return conn;
+}
+
+
+static void
+exec_command(PGconn *conn, const char *query)
+{
+	PGresult   *res = PQexec(conn, query);
+
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+	{
+		fprintf(stderr, "%s: query failed: %s", progname, PQerrorMessage(conn));
+		exit(1);
+	}
+	PQclear(res);
+}
+
+
+/*
+ * CPU time used so far by the backend of the connection, -1 if the backend
+ * runs on another host or /proc can not be read
+ */
+static double
+backend_cpu(PGconn *conn, int coord)
+{
+	char		path[MAXPGPATH];
+	char		buf[1024];
+	FILE	   *file;
+	char	   *p;
+	unsigned long utime;
+	unsigned long stime;
+	size_t		len;
+
+	if (!coords[coord].local)
+		return -1;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", PQbackendPID(conn));
+	file = fopen(path, "r");
+	if (file == NULL)
+		return -1;
+	len = fread(buf, 1, sizeof(buf) - 1, file);
+	fclose(file);
+	buf[len] = '\0';
+
+	/* utime and stime are the 12th and 13th fields after the command name */
+	p = strrchr(buf, ')');
+	if (p == NULL ||
+			sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+				   &utime, &stime) != 2)
+		return -1;
+	return (double) (utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+
+static void
+put_int16(char *buf, int *pos, int value)
+{
+	uint16		n16 = htons((uint16) value);
+
+	memcpy(buf + *pos, &n16, 2);
+	*pos += 2;
+}
+
+
+static void
+put_int32(char *buf, int *pos, int value)
+{
+	uint32		n32 = htonl((uint32) value);
+
+	memcpy(buf + *pos, &n32, 4);
+	*pos += 4;
+}
+
+
+/*
+ * Load the rows with COPY, batch_size rows per CopyData message
+ */
+static void
+load_copy(PGconn *conn, const char *table, int64 first, bool binary)
+{
+	char		query[256];
+	PGresult   *res;
+	char	   *buf;
+	int			pos = 0;
+	int			rowlen = width + 64;
+	int64		i;
+
+	snprintf(query, sizeof(query), "COPY %s FROM STDIN WITH (FORMAT %s)",
+			 table, binary ? "binary" : "csv");
+	res = PQexec(conn, query);
+	if (PQresultStatus(res) != PGRES_COPY_IN)
+	{
+		fprintf(stderr, "%s: COPY failed: %s", progname, PQerrorMessage(conn));
+		exit(1);
+	}
+	PQclear(res);
+
+	buf = pg_malloc(rowlen * batch_size + 32);
+	if (binary)
+	{
+		/* signature, flags and header extension length */
+		memcpy(buf, "PGCOPY\n\377\r\n\0", 11);
+		pos = 11;
+		put_int32(buf, &pos, 0);
+		put_int32(buf, &pos, 0);
+	}
+
+	for (i = 0; i < nrows; i++)
+	{
+		int64		id = first + i;
+
+		if (binary)
+		{
+			put_int16(buf, &pos, 3);
+			put_int32(buf, &pos, 8);
+			put_int32(buf, &pos, (int32) (id >> 32));
+			put_int32(buf, &pos, (int32) id);
+			put_int32(buf, &pos, 4);
+			put_int32(buf, &pos, (int32) (id % 1000));
+			put_int32(buf, &pos, width);
+			memcpy(buf + pos, payload, width);
+			pos += width;
+		}
+		else
+			pos += sprintf(buf + pos, INT64_FORMAT ",%d,%s\n",
+						   id, (int) (id % 1000), payload);
+
+		if ((i + 1) % batch_size == 0 || i + 1 == nrows)
+		{
+			if (binary && i + 1 == nrows)
+				put_int16(buf, &pos, -1);
+			if (PQputCopyData(conn, buf, pos) != 1)
+			{
+				fprintf(stderr, "%s: could not send COPY data: %s",
+						progname, PQerrorMessage(conn));
+				exit(1);
+			}
+			pos = 0;
+		}
+	}
+	free(buf);
+
+	if (PQputCopyEnd(conn, NULL) != 1)
+	{
+		fprintf(stderr, "%s: could not end COPY: %s",
+				progname, PQerrorMessage(conn));
+		exit(1);
+	}
+	res = PQgetResult(conn);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+	{
+		fprintf(stderr, "%s: COPY failed: %s", progname, PQerrorMessage(conn));
+		exit(1);
+	}
+	PQclear(res);
+}
+
+
+/*
+ * Load the rows with INSERT statements of batch_size rows each
+ */
+static void
+load_values(PGconn *conn, const char *table, int64 first)
+{
+	char	   *query;
+	int			pos = 0;
+	int64		i;
+
+	query = pg_malloc((width + 64) * batch_size + 256);
+	for (i = 0; i < nrows; i++)
+	{
+		int64		id = first + i;
+
+		if (pos == 0)
+			pos = sprintf(query, "INSERT INTO %s VALUES ", table);
+		else
+			query[pos++] = ',';
+		pos += sprintf(query + pos, "(" INT64_FORMAT ",%d,'%s')",
+					   id, (int) (id % 1000), payload);
+
+		if ((i + 1) % batch_size == 0 || i + 1 == nrows)
+		{
+			exec_command(conn, query);
+			pos = 0;
+		}
+	}
+	free(query);
+}
+
+
+/*
+ * Load the rows with a prepared single-row INSERT, committing every
+ * batch_size rows
+ */
+static void
+load_insert(PGconn *conn, const char *table, int64 first)
+{
+	char		query[256];
+	char		idbuf[32];
+	char		kbuf[16];
+	const char *values[3];
+	PGresult   *res;
+	int64		i;
+
+	snprintf(query, sizeof(query), "INSERT INTO %s VALUES ($1, $2, $3)", table);
+	res = PQprepare(conn, "load", query, 3, NULL);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK)
+	{
+		fprintf(stderr, "%s: PREPARE failed: %s", progname, PQerrorMessage(conn));
+		exit(1);
+	}
+	PQclear(res);
+
+	values[0] = idbuf;
+	values[1] = kbuf;
+	values[2] = payload;
+	for (i = 0; i < nrows; i++)
+	{
+		int64		id = first + i;
+
+		if (i % batch_size == 0)
+			exec_command(conn, "BEGIN");
+
+		snprintf(idbuf, sizeof(idbuf), INT64_FORMAT, id);
+		snprintf(kbuf, sizeof(kbuf), "%d", (int) (id % 1000));
+		res = PQexecPrepared(conn, "load", 3, values, NULL, NULL, 0);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		{
+			fprintf(stderr, "%s: INSERT failed: %s",
+					progname, PQerrorMessage(conn));
+			exit(1);
+		}
+		PQclear(res);
+
+		if ((i + 1) % batch_size == 0 || i + 1 == nrows)
+			exec_command(conn, "COMMIT");
+	}
+}
+
+
+/*
+ * Body of a client process. It connects, tells the parent it is ready,
+ * waits for the go pipe to be closed, loads its rows and sends back the
+ * result.
+ */
+static void
+run_client(int client, const char *table, LoadMode mode,
+		   int ready_fd, int go_fd, int result_fd)
+{
+	int			coord = client % ncoords;
+	PGconn	   *conn = connect_coordinator(coord);
+	ClientResult result;
+	double		cpu_start;
+	char		c = 'r';
+
+	cpu_start = backend_cpu(conn, coord);
+
+	if (write(ready_fd, &c, 1) != 1)
+		exit(1);
+	while (read(go_fd, &c, 1) > 0)
+		;
+
+	switch (mode)
+	{
+		case MODE_COPY:
+			load_copy(conn, table, client * nrows + 1, false);
+			break;
+		case MODE_BINARY:
+			load_copy(conn, table, client * nrows + 1, true);
+			break;
+		case MODE_VALUES:
+			load_values(conn, table, client * nrows + 1);
+			break;
+		case MODE_INSERT:
+			load_insert(conn, table, client * nrows + 1);
+			break;
+	}
+
+	result.client = client;
+	result.rows = nrows;
+	result.cpu = backend_cpu(conn, coord);
+	if (result.cpu >= 0 && cpu_start >= 0)
+		result.cpu -= cpu_start;
+	else
+		result.cpu = -1;
+	PQfinish(conn);
+
+	if (write(result_fd, &result, sizeof(result)) != sizeof(result))
+		exit(1);
+	exit(0);
+}
+
+
+static void
+run_benchmark(int distribution, LoadMode mode)
+{
+	char		table[64];
+	char		query[256];
+	PGconn	   *conn;
+	int			ready_pipe[2];
+	int			go_pipe[2];
+	int			result_pipe[2];
+	pid_t	   *pids;
+	double	   *cpu;
+	int		   *coord_clients;
+	int64		rows = 0;
+	int			failed = 0;
+	int			i;
+	char		c;
+	ClientResult result;
+	instr_time	start_time;
+	instr_time	end_time;
+	double		elapsed;
+
+	snprintf(table, sizeof(table), "pgxc_loadbench_%s",
+			 distributions[distribution]);
+
+	conn = connect_coordinator(0);
+	snprintf(query, sizeof(query), "DROP TABLE IF EXISTS %s", table);
+	exec_command(conn, query);
+	snprintf(query, sizeof(query),
+			 "CREATE TABLE %s (id bigint, k int, payload text) DISTRIBUTE BY %s",
+			 table, distribute_by[distribution]);
+	exec_command(conn, query);
+
+	if (pipe(ready_pipe) < 0 || pipe(go_pipe) < 0 || pipe(result_pipe) < 0)
+	{
+		fprintf(stderr, "%s: could not create pipe: %s\n",
+				progname, strerror(errno));
+		exit(1);
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	pids = pg_malloc(nclients * sizeof(pid_t));
+	for (i = 0; i < nclients; i++)
+	{
+		pids[i] = fork();
+		if (pids[i] < 0)
+		{
+			fprintf(stderr, "%s: could not fork: %s\n",
+					progname, strerror(errno));
+			exit(1);
+		}
+		if (pids[i] == 0)
+		{
+			close(ready_pipe[0]);
+			close(go_pipe[1]);
+			close(result_pipe[0]);
+			run_client(i, table, mode, ready_pipe[1], go_pipe[0],
+					   result_pipe[1]);
+		}
+	}
+	close(ready_pipe[1]);
+	close(go_pipe[0]);
+	close(result_pipe[1]);
+
+	/* Start the clock once all the clients are connected */
+	for (i = 0; i < nclients; i++)
+		if (read(ready_pipe[0], &c, 1) != 1)
+			break;
+	INSTR_TIME_SET_CURRENT(start_time);
+	close(go_pipe[1]);
+
+	cpu = pg_malloc0(ncoords * sizeof(double));
+	coord_clients = pg_malloc0(ncoords * sizeof(int));
+	while (read(result_pipe[0], &result, sizeof(result)) == sizeof(result))
+	{
+		int			coord = result.client % ncoords;
+
+		rows += result.rows;
+		coord_clients[coord]++;
+		if (result.cpu < 0 || cpu[coord] < 0)
+			cpu[coord] = -1;
+		else
+			cpu[coord] += result.cpu;
+	}
+	INSTR_TIME_SET_CURRENT(end_time);
+	INSTR_TIME_SUBTRACT(end_time, start_time);
+	elapsed = INSTR_TIME_GET_DOUBLE(end_time);
+
+	for (i = 0; i < nclients; i++)
+	{
+		int			status;
+
+		if (waitpid(pids[i], &status, 0) < 0 ||
+				!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed++;
+	}
+	close(ready_pipe[0]);
+	close(result_pipe[0]);
+
+	printf("\ndistribution: %s, mode: %s, clients: %d, batch: %d\n",
+		   distributions[distribution], mode_names[mode], nclients, batch_size);
+	if (failed > 0)
+		printf("%d of %d clients failed\n", failed, nclients);
+	printf("rows loaded: " INT64_FORMAT ", elapsed: %.3f s, %.0f rows/s\n",
+		   rows, elapsed, elapsed > 0 ? rows / elapsed : 0);
+
+	printf("%-30s %8s %10s %8s\n", "coordinator", "clients", "cpu (s)", "cpu (%)");
+	for (i = 0; i < ncoords; i++)
+	{
+		char		name[128];
+
+		snprintf(name, sizeof(name), "%s:%s",
+				 coords[i].host ? coords[i].host : "(default)",
+				 coords[i].port ? coords[i].port : "(default)");
+		if (cpu[i] < 0 || coord_clients[i] == 0)
+			printf("%-30s %8d %10s %8s\n", name, coord_clients[i], "n/a", "n/a");
+		else
+			printf("%-30s %8d %10.2f %8.1f\n", name, coord_clients[i], cpu[i],
+				   elapsed > 0 ? 100.0 * cpu[i] / elapsed : 0);
+	}
+
+	report_distribution(table, elapsed);
+
+	free(pids);
+	free(cpu);
+	free(coord_clients);
+	PQfinish(conn);
+}
+
+
+/*
+ * Report the rows of every Datanode, the throughput they got and the skew
+ */
+static void
+report_distribution(const char *table, double elapsed)
+{
+	PGconn	   *conn = connect_coordinator(0);
+	char		query[256];
+	PGresult   *res;
+	int			i;
+
+	snprintf(query, sizeof(query),
+			 "SELECT node_name, rows, pg_size_pretty(size), skew "
+			 "FROM pgxc_get_distribution('%s') ORDER BY node_name",
+			 table);
+	res = PQexec(conn, query);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK)
+	{
+		fprintf(stderr, "%s: could not get the distribution: %s",
+				progname, PQerrorMessage(conn));
+		PQclear(res);
+		PQfinish(conn);
+		return;
+	}
+
+	printf("%-30s %12s %12s %10s %8s\n",
+		   "datanode", "rows", "rows/s", "size", "skew");
+	for (i = 0; i < PQntuples(res); i++)
+	{
+		double		node_rows = atof(PQgetvalue(res, i, 1));
+
+		printf("%-30s %12s %12.0f %10s %8s\n",
+			   PQgetvalue(res, i, 0), PQgetvalue(res, i, 1),
+			   elapsed > 0 ? node_rows / elapsed : 0,
+			   PQgetvalue(res, i, 2), PQgetvalue(res, i, 3));
+	}
+	PQclear(res);
+	PQfinish(conn);
+}
+
+
+int
+main(int argc, char **argv)
+{
+	static struct option long_options[] = {
+		{"hosts", required_argument, NULL, 'h'},
+		{"dbname", required_argument, NULL, 'd'},
+		{"username", required_argument, NULL, 'U'},
+		{"clients", required_argument, NULL, 'c'},
+		{"rows", required_argument, NULL, 'r'},
+		{"distributions", required_argument, NULL, 'D'},
+		{"modes", required_argument, NULL, 'm'},
+		{"batch", required_argument, NULL, 'b'},
+		{"width", required_argument, NULL, 'w'},
+		{"help", no_argument, NULL, '?'},
+		{NULL, 0, NULL, 0}
+	};
+	int			c;
+	int			optindex;
+	int			i;
+	int			j;
+
+	progname = get_progname(argv[0]);
+
+	if (argc > 1 &&
+			(strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-?") == 0))
+	{
+		usage();
+		exit(0);
+	}
+
+	for (i = 0; i < NUM_DISTRIBUTIONS; i++)
+		use_distribution[i] = true;
+	use_mode[MODE_COPY] = true;
+
+	while ((c = getopt_long(argc, argv, "h:d:U:c:r:D:m:b:w:?",
+							long_options, &optindex)) != -1)
+	{
+		switch (c)
+		{
+			case 'h':
+				parse_hosts(optarg);
+				break;
+			case 'd':
+				dbname = pg_strdup(optarg);
+				break;
+			case 'U':
+				username = pg_strdup(optarg);
+				break;
+			case 'c':
+				nclients = atoi(optarg);
+				break;
+			case 'r':
+				nrows = atol(optarg);
+				break;
+			case 'D':
+				if (!parse_list(optarg, distributions, NUM_DISTRIBUTIONS,
+								use_distribution))
+					exit(1);
+				break;
+			case 'm':
+				if (!parse_list(optarg, mode_names, lengthof(mode_names),
+								use_mode))
+					exit(1);
+				break;
+			case 'b':
+				batch_size = atoi(optarg);
+				break;
+			case 'w':
+				width = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Try \"%s --help\" for more information.\n", progname);
+				exit(1);
+		}
+	}
+
+	if (nclients <= 0 || nrows <= 0 || batch_size <= 0 || width < 0)
+	{
+		fprintf(stderr, "%s: invalid option value\n", progname);
+		exit(1);
+	}
+
+	if (ncoords == 0)
+		parse_hosts(":");
+	for (i = 0; i < ncoords; i++)
+	{
+		const char *host = coords[i].host ? coords[i].host : getenv("PGHOST");
+
+		coords[i].local = (host == NULL || host[0] == '\0' || host[0] == '/' ||
+						   strcmp(host, "localhost") == 0 ||
+						   strcmp(host, "127.0.0.1") == 0);
+	}
+
+	/* The same text in every row, it only needs to take space */
+	payload = pg_malloc(width + 1);
+	for (i = 0; i < width; i++)
+		payload[i] = 'a' + i % 26;
+	payload[width] = '\0';
+
+	for (i = 0; i < NUM_DISTRIBUTIONS; i++)
+	{
+		if (!use_distribution[i])
+			continue;
+		for (j = 0; j < lengthof(mode_names); j++)
+			if (use_mode[j])
+				run_benchmark(i, (LoadMode) j);
+	}
+	return 0;
+}
@@ -0,0 +1,36 @@
+/* contrib/pgxc_microbench/pgxc_microbench--1.0.sql */
+
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION pgxc_microbench" to load this file. \quit
+
+CREATE FUNCTION pgxc_microbench_locator(distribution text default 'hash',
+										nodes int default 4,
+										rows int default 1000000,
+										key_width int default 0,
+										batch bool default false)
+RETURNS float8
+AS 'MODULE_PATHNAME', 'pgxc_microbench_locator'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgxc_microbench_squeue(rows int default 1000000,
+									   width int default 32,
+									   consumers int default 1,
+									   batch int default 64,
+									   OUT write_ns float8,
+									   OUT read_ns float8)
+AS 'MODULE_PATHNAME', 'pgxc_microbench_squeue'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgxc_microbench_combiner(rows int default 1000000,
+										 width int default 32,
+										 nodes int default 4)
+RETURNS float8
+AS 'MODULE_PATHNAME', 'pgxc_microbench_combiner'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION pgxc_microbench_params(rows int default 1000000,
+									   nparams int default 4,
+									   width int default 32)
+RETURNS float8
+AS 'MODULE_PATHNAME', 'pgxc_microbench_params'
+LANGUAGE C STRICT;
@@ -0,0 +1,562 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgxc_microbench.c
+ *	  Microbenchmarks of the per-row code paths of distributed execution
+ *
+ * Each function runs one of the tight loops of distributed execution in
+ * isolation, in the calling backend and without any remote node, and
+ * returns the time spent per row in nanoseconds:
+ *
+ *	pgxc_microbench_locator		choosing the target node of inserted rows
+ *	pgxc_microbench_squeue		writing rows to and reading them from a
+ *								shared queue
+ *	pgxc_microbench_combiner	fetching DataRows of the Datanodes through
+ *								a response combiner
+ *	pgxc_microbench_params		encoding the parameters of a remote query
+ *
+ * The shared queue and the combiner are fed by the backend itself: it is
+ * both the producer and the consumer of the queue, and the Datanode
+ * connections of the combiner are fake handles with the messages already
+ * in their input buffer. So only the CPU cost of the code is measured, not
+ * the waits for other processes or the network.
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * contrib/pgxc_microbench/pgxc_microbench.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <arpa/inet.h>
+
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "executor/tuptable.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "nodes/params.h"
+#include "pgxc/execRemote.h"
+#include "pgxc/locator.h"
+#include "pgxc/pgxc.h"
+#include "pgxc/pgxcnode.h"
+#include "pgxc/squeue.h"
+#include "portability/instr_time.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+
+PG_MODULE_MAGIC;
+
+PG_FUNCTION_INFO_V1(pgxc_microbench_locator);
+PG_FUNCTION_INFO_V1(pgxc_microbench_squeue);
+PG_FUNCTION_INFO_V1(pgxc_microbench_combiner);
+PG_FUNCTION_INFO_V1(pgxc_microbench_params);
+
+/* Distinct values cycled through, and size of the batches */
+#define BENCH_VALUES		1024
+
+/* Upper limit of the node counts, to catch typos */
+#define BENCH_MAX_NODES		1024
+
+
+static void
+check_args(int32 rows, int32 width, int32 nodes)
+{
+	if (rows <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of rows must be positive")));
+	if (width < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("row width must not be negative")));
+	if (nodes <= 0 || nodes > BENCH_MAX_NODES)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of nodes must be between 1 and %d",
+						BENCH_MAX_NODES)));
+}
+
+static double
+ns_per_row(instr_time elapsed, int64 rows)
+{
+	return INSTR_TIME_GET_DOUBLE(elapsed) * 1000000000.0 / rows;
+}
+
+/*
+ * A text value of width bytes, different for each seed.
+ */
+static Datum
+bench_text(int width, int seed)
+{
+	char	   *str = palloc(width + 1);
+	int			i;
+
+	for (i = 0; i < width; i++)
+		str[i] = 'a' + (seed + i * 7) % 26;
+	str[width] = '\0';
+	return CStringGetTextDatum(str);
+}
+
+/*
+ * The rows of the benchmarks: an integer key and a text payload of the
+ * requested width.
+ */
+static TupleDesc
+bench_tupdesc(void)
+{
+	TupleDesc	desc = CreateTemplateTupleDesc(2, false);
+
+	TupleDescInitEntry(desc, (AttrNumber) 1, "id", INT4OID, -1, 0);
+	TupleDescInitEntry(desc, (AttrNumber) 2, "payload", TEXTOID, -1, 0);
+	return desc;
+}
+
+
+/*
+ * pgxc_microbench_locator
+ *		Time GET_NODES, or GET_NODES_BATCH, of a locator inserting rows into
+ *		a table distributed by hash, modulo or round robin over the given
+ *		number of nodes. The key is an integer, or a text of key_width bytes
+ *		if it is not zero.
+ */
+Datum
+pgxc_microbench_locator(PG_FUNCTION_ARGS)
+{
+	char	   *distribution = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	int32		nodes = PG_GETARG_INT32(1);
+	int32		rows = PG_GETARG_INT32(2);
+	int32		key_width = PG_GETARG_INT32(3);
+	bool		batch = PG_GETARG_BOOL(4);
+	char		locatorType;
+	Locator    *locator;
+	int		   *nodeMap;
+	Datum		values[BENCH_VALUES];
+	bool		nulls[BENCH_VALUES];
+	int			indexes[BENCH_VALUES];
+	instr_time	start;
+	instr_time	elapsed;
+	int32		done;
+	int			i;
+
+	check_args(rows, key_width, nodes);
+
+	if (strcmp(distribution, "hash") == 0)
+		locatorType = LOCATOR_TYPE_HASH;
+	else if (strcmp(distribution, "modulo") == 0)
+		locatorType = LOCATOR_TYPE_MODULO;
+	else if (strcmp(distribution, "roundrobin") == 0)
+		locatorType = LOCATOR_TYPE_RROBIN;
+	else
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("unrecognized distribution \"%s\"", distribution),
+				 errhint("Valid distributions are \"hash\", \"modulo\" and \"roundrobin\".")));
+
+	nodeMap = (int *) palloc(nodes * sizeof(int));
+	for (i = 0; i < nodes; i++)
+		nodeMap[i] = i;
+	locator = createLocator(locatorType, RELATION_ACCESS_INSERT,
+							key_width > 0 ? TEXTOID : INT4OID,
+							LOCATOR_LIST_INT, nodes, nodeMap, NULL, false);
+
+	for (i = 0; i < BENCH_VALUES; i++)
+	{
+		values[i] = key_width > 0 ? bench_text(key_width, i) :
+			Int32GetDatum(i * 7919);
+		nulls[i] = false;
+	}
+
+	INSTR_TIME_SET_CURRENT(start);
+	for (done = 0; done < rows; done += BENCH_VALUES)
+	{
+		int			n = Min(rows - done, BENCH_VALUES);
+
+		if (batch)
+		{
+			if (!GET_NODES_BATCH(locator, n, values, nulls, indexes))
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("locator of distribution \"%s\" does not locate rows in batches",
+								distribution)));
+		}
+		else
+		{
+			for (i = 0; i < n; i++)
+				(void) GET_NODES(locator, values[i], nulls[i], NULL);
+		}
+		CHECK_FOR_INTERRUPTS();
+	}
+	INSTR_TIME_SET_CURRENT(elapsed);
+	INSTR_TIME_SUBTRACT(elapsed, start);
+
+	freeLocator(locator);
+	PG_RETURN_FLOAT8(ns_per_row(elapsed, rows));
+}
+
+
+/*
+ * pgxc_microbench_squeue
+ *		Time SharedQueueWriteBatch and SharedQueueRead of rows of the given
+ *		width, going through a shared queue to the given number of consumers
+ *		in batches of the given size.
+ *
+ * The backend binds to the queue as the producer, and reads the consumer
+ * queues directly without binding to them, which a consumer running in the
+ * producer process could not do. At the end it releases the consumers as
+ * they would, so the producer can unbind.
+ */
+Datum
+pgxc_microbench_squeue(PG_FUNCTION_ARGS)
+{
+	int32		rows = PG_GETARG_INT32(0);
+	int32		width = PG_GETARG_INT32(1);
+	int32		consumers = PG_GETARG_INT32(2);
+	int32		batch = PG_GETARG_INT32(3);
+	char		sqname[SQUEUE_KEYSIZE];
+	TupleDesc	resultdesc;
+	TupleDesc	desc;
+	TupleTableSlot **slots;
+	TupleTableSlot *readslot;
+	Tuplestorestate *tuplestore = NULL;
+	MemoryContext tmpcxt;
+	SharedQueue squeue;
+	List	   *nodes = NIL;
+	int		   *consMap;
+	int			myindex;
+	int			myid;
+	char	   *save_parent = parentPGXCNode;
+	int			save_parent_id = parentPGXCNodeId;
+	int			save_conn_type = remoteConnType;
+	instr_time	start;
+	instr_time	now;
+	instr_time	write_time;
+	instr_time	read_time;
+	int32		done;
+	int			c;
+	int			i;
+	Datum		result[2];
+	bool		resultnulls[2] = {false, false};
+
+	check_args(rows, width, consumers);
+	if (batch <= 0 || batch > BENCH_VALUES)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("batch size must be between 1 and %d", BENCH_VALUES)));
+	if (get_call_result_type(fcinfo, NULL, &resultdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+	if (PGXCNodeName == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("shared queue benchmark must run on a cluster node")));
+
+	desc = bench_tupdesc();
+	slots = (TupleTableSlot **) palloc(batch * sizeof(TupleTableSlot *));
+	for (i = 0; i < batch; i++)
+	{
+		slots[i] = MakeSingleTupleTableSlot(desc);
+		slots[i]->tts_values[1] = bench_text(width, i);
+		slots[i]->tts_isnull[0] = false;
+		slots[i]->tts_isnull[1] = false;
+	}
+	readslot = MakeSingleTupleTableSlot(desc);
+	tmpcxt = AllocSetContextCreate(CurrentMemoryContext,
+								   "microbench squeue",
+								   ALLOCSET_DEFAULT_MINSIZE,
+								   ALLOCSET_DEFAULT_INITSIZE,
+								   ALLOCSET_DEFAULT_MAXSIZE);
+
+	/*
+	 * The queue is acquired and bound as on a Datanode serving a subplan for
+	 * another node. The consumers are given made up node ids following that
+	 * of this node, they are only used to tell them apart.
+	 */
+	snprintf(sqname, sizeof(sqname), "microbench_%d", MyProcPid);
+	remoteConnType = REMOTE_CONN_DATANODE;
+	parentPGXCNode = PGXCNodeName;
+	myid = PGXCNodeGetNodeIdFromName(PGXCNodeName, NULL);
+	for (c = 0; c <= consumers; c++)
+		nodes = lappend_int(nodes, myid + c);
+	consMap = (int *) palloc((consumers + 1) * sizeof(int));
+
+	SharedQueueAcquire(sqname, consumers);
+	squeue = SharedQueueBind(sqname, nodes, nodes, &myindex, consMap, false);
+	remoteConnType = save_conn_type;
+
+	INSTR_TIME_SET_ZERO(write_time);
+	INSTR_TIME_SET_ZERO(read_time);
+	PG_TRY();
+	{
+		c = 0;
+		for (done = 0; done < rows; done += batch)
+		{
+			int			n = Min(rows - done, batch);
+			int			consumerIdx = consMap[1 + c];
+
+			for (i = 0; i < n; i++)
+			{
+				ExecClearTuple(slots[i]);
+				slots[i]->tts_values[0] = Int32GetDatum(done + i);
+				ExecStoreVirtualTuple(slots[i]);
+			}
+
+			INSTR_TIME_SET_CURRENT(start);
+			SharedQueueWriteBatch(squeue, consumerIdx, slots, n, &tuplestore,
+								  tmpcxt);
+			INSTR_TIME_SET_CURRENT(now);
+			INSTR_TIME_ACCUM_DIFF(write_time, now, start);
+
+			/* The batch fits in the queue unless it is tiny */
+			if (tuplestore != NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("batch of %d rows of width %d does not fit in the shared queue",
+								batch, width),
+						 errhint("Decrease the batch size or increase shared_queue_size.")));
+
+			INSTR_TIME_SET_CURRENT(start);
+			for (i = 0; i < n; i++)
+			{
+				(void) SharedQueueRead(squeue, consumerIdx, readslot, false);
+				if (TupIsNull(readslot))
+					elog(ERROR, "row %d not found in the shared queue",
+						 done + i);
+			}
+			INSTR_TIME_SET_CURRENT(now);
+			INSTR_TIME_ACCUM_DIFF(read_time, now, start);
+
+			MemoryContextReset(tmpcxt);
+			ExecClearTuple(readslot);
+			c = (c + 1) % consumers;
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+	PG_CATCH();
+	{
+		/* Release the consumers, so the queue can be unbound */
+		for (c = 1; c <= consumers; c++)
+		{
+			parentPGXCNodeId = myid + c;
+			SharedQueueRelease(sqname);
+		}
+		parentPGXCNodeId = save_parent_id;
+		parentPGXCNode = save_parent;
+		SharedQueueUnBind(squeue);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	for (c = 1; c <= consumers; c++)
+	{
+		parentPGXCNodeId = myid + c;
+		SharedQueueRelease(sqname);
+	}
+	parentPGXCNodeId = save_parent_id;
+	parentPGXCNode = save_parent;
+	SharedQueueUnBind(squeue);
+
+	for (i = 0; i < batch; i++)
+		ExecDropSingleTupleTableSlot(slots[i]);
+	ExecDropSingleTupleTableSlot(readslot);
+	MemoryContextDelete(tmpcxt);
+
+	result[0] = Float8GetDatum(ns_per_row(write_time, rows));
+	result[1] = Float8GetDatum(ns_per_row(read_time, rows));
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(resultdesc),
+													  result, resultnulls)));
+}
+
+
+/*
+ * Append a message of the protocol to the buffer.
+ */
+static void
+append_message(StringInfo buf, char msgtype, const char *body, int len)
+{
+	uint32		n32 = htonl(len + 4);
+
+	appendStringInfoChar(buf, msgtype);
+	appendBinaryStringInfo(buf, (char *) &n32, 4);
+	appendBinaryStringInfo(buf, body, len);
+}
+
+/*
+ * The responses of a Datanode to a query returning the given rows: a
+ * DataRow for each of them, in text format, then CommandComplete and
+ * ReadyForQuery.
+ */
+static void
+append_responses(StringInfo buf, int first, int count, const char *payload,
+				 int width)
+{
+	StringInfoData row;
+	char		tag[32];
+	int			i;
+
+	initStringInfo(&row);
+	for (i = first; i < first + count; i++)
+	{
+		char		id[12];
+		uint16		n16 = htons(2);
+		uint32		n32;
+
+		resetStringInfo(&row);
+		snprintf(id, sizeof(id), "%d", i);
+		appendBinaryStringInfo(&row, (char *) &n16, 2);
+		n32 = htonl(strlen(id));
+		appendBinaryStringInfo(&row, (char *) &n32, 4);
+		appendBinaryStringInfo(&row, id, strlen(id));
+		n32 = htonl(width);
+		appendBinaryStringInfo(&row, (char *) &n32, 4);
+		appendBinaryStringInfo(&row, payload, width);
+		append_message(buf, 'D', row.data, row.len);
+	}
+	pfree(row.data);
+
+	snprintf(tag, sizeof(tag), "SELECT %d", count);
+	append_message(buf, 'C', tag, strlen(tag) + 1);
+	append_message(buf, 'Z', "I", 1);
+}
+
+/*
+ * pgxc_microbench_combiner
+ *		Time FetchTuple, and HandleDataRow under it, reading the rows of the
+ *		given width that the given number of Datanodes sent.
+ *
+ * The Datanode connections are handles without a socket, their input
+ * buffers already hold all the responses, so the combiner never waits.
+ */
+Datum
+pgxc_microbench_combiner(PG_FUNCTION_ARGS)
+{
+	int32		rows = PG_GETARG_INT32(0);
+	int32		width = PG_GETARG_INT32(1);
+	int32		nodes = PG_GETARG_INT32(2);
+	ResponseCombiner *combiner;
+	PGXCNodeHandle **connections;
+	TupleTableSlot *slot;
+	char	   *payload;
+	instr_time	start;
+	instr_time	elapsed;
+	int32		fetched = 0;
+	int			first = 0;
+	int			i;
+
+	check_args(rows, width, nodes);
+
+	payload = palloc(width + 1);
+	memset(payload, 'x', width);
+
+	connections = (PGXCNodeHandle **) palloc(nodes * sizeof(PGXCNodeHandle *));
+	combiner = (ResponseCombiner *) palloc0(sizeof(ResponseCombiner));
+	InitResponseCombiner(combiner, nodes, COMBINE_TYPE_NONE);
+	combiner->ss.ps.ps_ResultTupleSlot = MakeSingleTupleTableSlot(bench_tupdesc());
+	combiner->request_type = REQUEST_TYPE_QUERY;
+
+	for (i = 0; i < nodes; i++)
+	{
+		PGXCNodeHandle *conn = (PGXCNodeHandle *) palloc0(sizeof(PGXCNodeHandle));
+		int			count = rows / nodes + (i < rows % nodes ? 1 : 0);
+		StringInfoData buf;
+
+		initStringInfo(&buf);
+		append_responses(&buf, first, count, payload, width);
+		first += count;
+
+		conn->sock = NO_SOCKET;
+		conn->epoll_sock = NO_SOCKET;
+		conn->state = DN_CONNECTION_STATE_QUERY;
+		conn->combiner = combiner;
+		conn->inBuffer = buf.data;
+		conn->inSize = buf.maxlen;
+		conn->inEnd = buf.len;
+		connections[i] = conn;
+	}
+	combiner->connections = connections;
+	combiner->conn_count = nodes;
+	combiner->current_conn = 0;
+
+	INSTR_TIME_SET_CURRENT(start);
+	while ((slot = FetchTuple(combiner)) != NULL && !TupIsNull(slot))
+	{
+		if ((++fetched & (BENCH_VALUES - 1)) == 0)
+			CHECK_FOR_INTERRUPTS();
+	}
+	INSTR_TIME_SET_CURRENT(elapsed);
+	INSTR_TIME_SUBTRACT(elapsed, start);
+
+	if (fetched != rows)
+		elog(ERROR, "fetched %d rows instead of %d", fetched, rows);
+
+	ExecDropSingleTupleTableSlot(combiner->ss.ps.ps_ResultTupleSlot);
+	PG_RETURN_FLOAT8(ns_per_row(elapsed, rows));
+}
+
+
+/*
+ * pgxc_microbench_params
+ *		Time ParamListToDataRow encoding the given number of parameters,
+ *		integers and texts of the given width in turn, once per row.
+ */
+Datum
+pgxc_microbench_params(PG_FUNCTION_ARGS)
+{
+	int32		rows = PG_GETARG_INT32(0);
+	int32		nparams = PG_GETARG_INT32(1);
+	int32		width = PG_GETARG_INT32(2);
+	ParamListInfo params;
+	MemoryContext tmpcxt;
+	MemoryContext oldcxt;
+	instr_time	start;
+	instr_time	elapsed;
+	int32		done;
+	int			i;
+
+	check_args(rows, width, 1);
+	if (nparams <= 0 || nparams > FUNC_MAX_ARGS)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("number of parameters must be between 1 and %d",
+						FUNC_MAX_ARGS)));
+
+	params = (ParamListInfo) palloc0(offsetof(ParamListInfoData, params) +
+									 nparams * sizeof(ParamExternData));
+	params->numParams = nparams;
+	for (i = 0; i < nparams; i++)
+	{
+		ParamExternData *prm = &params->params[i];
+
+		prm->ptype = (i % 2 == 0) ? INT4OID : TEXTOID;
+		prm->value = (i % 2 == 0) ? Int32GetDatum(i * 7919) :
+			bench_text(width, i);
+		prm->isnull = false;
+		prm->pflags = PARAM_FLAG_CONST;
+	}
+
+	tmpcxt = AllocSetContextCreate(CurrentMemoryContext,
+								   "microbench params",
+								   ALLOCSET_DEFAULT_MINSIZE,
+								   ALLOCSET_DEFAULT_INITSIZE,
+								   ALLOCSET_DEFAULT_MAXSIZE);
+	oldcxt = MemoryContextSwitchTo(tmpcxt);
+
+	INSTR_TIME_SET_CURRENT(start);
+	for (done = 0; done < rows; done++)
+	{
+		char	   *result;
+
+		(void) ParamListToDataRow(params, &result);
+		if ((done & (BENCH_VALUES - 1)) == 0)
+		{
+			MemoryContextReset(tmpcxt);
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+	INSTR_TIME_SET_CURRENT(elapsed);
+	INSTR_TIME_SUBTRACT(elapsed, start);
+
+	MemoryContextSwitchTo(oldcxt);
+	MemoryContextDelete(tmpcxt);
+	PG_RETURN_FLOAT8(ns_per_row(elapsed, rows));
+}
@@ -3,16 +3,19 @@
  *
  * pgxc_monitor utility
  *
- *  Monitors if a given node is running or not.
+ *  Monitors if a given node is running or not, or continuously probes the
+ *  latency of the paths of a cluster.
  *
  * Command syntax:
  *
  * pgxc_monitor [ options ]
  *
  * Options are:
- * -Z nodetype		What node type to monitor, gtm or node.
+ * -Z nodetype		What node type to monitor, gtm, node or probe.
  *					gtm tests gtm, gtm_standby or gtm_proxy.
  *					node tests Coordinator or Datanode.
+ *					probe measures the latency of the cluster through a
+ *					Coordinator until interrupted, see probe.c.
  * -p port			Port number of the monitored node.
  * -h host			Host name or IP address of the monitored node.
  * -n nodename      Specifies pgxc_monitor node name. Default is "pgxc_monitor"
@@ -20,6 +23,12 @@
  * -v				Run in verbose mode.
  * -d database		Database name to connect to.
  * -U username		Connect as specified database user.
+ * -i interval		Seconds between two probes, only for -Z probe. Default is 1.
+ * -c count			Number of probes, only for -Z probe. Default is 0, which
+ *					probes until interrupted.
+ * -o format		Output of -Z probe, csv for a time series of the samples
+ *					or histogram for their distribution when the probe
+ *					stops. Default is csv.
  * --help			Prints the help message and exits with 0.
  *
  * When monitoring Coordinator or Datanode, -p and -h options can be
@@ -50,15 +59,18 @@
 #include <stdlib.h>
 #include <getopt.h>
 
+#include "probe.h"
+
 /* Define all the node types */
 typedef enum
 {
 	NONE = 0,
 	GTM,	/* GTM or GTM-proxy */
-	NODE	/* Coordinator or Datanode */
+	NODE,	/* Coordinator or Datanode */
+	PROBE	/* Latency of the cluster, through a Coordinator */
 } nodetype_t;
 
-static char 	*progname;
+char	   *progname;
 
 #define Free(x) do{if((x)) free((x)); x = NULL;} while(0)
 
@@ -77,6 +89,9 @@ main(int ac, char *av[])
 	bool		verbose = false;
 	char	   *username = NULL;
 	char	   *database = NULL;
+	int			interval = 1;
+	int			count = 0;
+	bool		histogram = false;
 
 	progname = strdup(av[0]);
 
@@ -91,7 +106,7 @@ main(int ac, char *av[])
 	}
 
 	/* Scan options */
-	while ((opt = getopt(ac, av, "Z:U:d:h:n:p:qv")) != -1)
+	while ((opt = getopt(ac, av, "Z:U:c:d:h:i:n:o:p:qv")) != -1)
 	{
 		switch(opt)
 		{
@@ -100,6 +115,8 @@ main(int ac, char *av[])
 					nodetype = GTM;
 				else if (strcmp(optarg, "node") == 0)
 					nodetype = NODE;
+				else if (strcmp(optarg, "probe") == 0)
+					nodetype = PROBE;
 				else
 				{
 					fprintf(stderr, "%s: invalid -Z option value.\n", progname);
@@ -130,6 +147,33 @@ main(int ac, char *av[])
 			case 'd':
 				database = strdup(optarg);
 				break;
+			case 'i':
+				interval = atoi(optarg);
+				if (interval <= 0)
+				{
+					fprintf(stderr, "%s: invalid -i option value.\n", progname);
+					exit(3);
+				}
+				break;
+			case 'c':
+				count = atoi(optarg);
+				if (count < 0)
+				{
+					fprintf(stderr, "%s: invalid -c option value.\n", progname);
+					exit(3);
+				}
+				break;
+			case 'o':
+				if (strcmp(optarg, "csv") == 0)
+					histogram = false;
+				else if (strcmp(optarg, "histogram") == 0)
+					histogram = true;
+				else
+				{
+					fprintf(stderr, "%s: invalid -o option value.\n", progname);
+					exit(3);
+				}
+				break;
 			default:
 				fprintf(stderr, "%s: unknow option %c.\n", progname, opt);
 				exit(3);
@@ -150,6 +194,9 @@ main(int ac, char *av[])
 			exit(do_gtm_ping(host, port, nodetype, nodename, verbose));
 		case NODE:
 			exit(do_node_ping(host, port, username, database, verbose));
+		case PROBE:
+			exit(do_probe(host, port, username, database, interval, count,
+						  histogram, verbose));
 		case NONE:
 		default:
 			break;
@@ -260,11 +307,14 @@ do_node_ping(char *host, char *port, char *username, char *database, bool verbos
 static void
 usage(void)
 {
-	printf("pgxc_monitor -Z nodetype -p port -h host\n\n");
+	printf("pgxc_monitor -Z nodetype -p port -h host\n");
+	printf("pgxc_monitor -Z probe [ -i interval ] [ -c count ] [ -o format ] -p port -h host\n\n");
 	printf("Options are:\n");
 	printf("    -Z nodetype	    What node type to monitor, GTM, GTM-Proxy,\n");
 	printf("                    Coordinator, or Datanode.\n");
 	printf("                    Use \"gtm\" for GTM and GTM-proxy, \"node\" for Coordinator and Datanode.\n");
+	printf("                    Use \"probe\" to measure the latency of the cluster through\n");
+	printf("                    a Coordinator until interrupted.\n");
 	printf("    -h host         Host name or IP address of the monitored node.\n");
 	printf("                    Mandatory for -Z gtm\n");
 	printf("    -n nodename     Nodename of this pgxc_monitor.\n");
@@ -273,6 +323,10 @@ usage(void)
 	printf("    -p port         Port number of the monitored node. Mandatory for -Z gtm\n");
 	printf("    -d database     Database name to connect to. Default is \"postgres\".  \n");
 	printf("    -U username     Connect as specified database user. \n");
+	printf("    -i interval     Seconds between two probes. Default is 1.\n");
+	printf("    -c count        Number of probes. Default is 0, until interrupted.\n");
+	printf("    -o format       \"csv\" for a time series of the samples, \"histogram\"\n");
+	printf("                    for their distribution when the probe stops. Default is csv.\n");
 	printf("    -q              Quiet mode.\n");
 	printf("    -v              Verbose mode.\n");
 	printf("    --help          Prints the help message and exits with 0.\n");
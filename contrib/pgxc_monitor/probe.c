@@ -0,0 +1,528 @@
+/*-------------------------------------------------------------------------
+ *
+ * probe.c
+ *	  Continuous latency probe of a Postgres-XL cluster
+ *
+ * Connected to a Coordinator, the probe measures at each interval:
+ *
+ * - the round trip from pgxc_monitor to the Coordinator (SELECT 1);
+ * - for each Datanode, the round trip from the Coordinator, and the time
+ *	 the Coordinator takes to obtain a connection to it. Two EXECUTE DIRECT
+ *	 statements run in one transaction block: the first one obtains the
+ *	 connection from the pooler, the second reuses it, so the difference
+ *	 between them is the acquisition time, and the second one less the
+ *	 client round trip is the Coordinator to Datanode round trip;
+ * - for each node, the mean time its sessions waited for GTM during the
+ *	 interval, from pg_stat_wait_histogram, which is dominated by snapshot
+ *	 and transaction ID requests;
+ * - for each Datanode, the mean time the sessions of the Coordinator waited
+ *	 for the pooler during the interval, from pg_stat_pooler.
+ *
+ * The first two are active measurements of idle paths, the last two are
+ * what the workload actually saw. Samples are written as a CSV time series,
+ * or accumulated in latency histograms printed when the probe stops.
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * contrib/pgxc_monitor/probe.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres_fe.h"
+
+#include <signal.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "libpq-fe.h"
+#include "portability/instr_time.h"
+
+#include "probe.h"
+
+/* Upper bounds of the histogram buckets in msec, the last one is unbounded */
+#define PROBE_BUCKETS	10
+static const double probe_bounds[PROBE_BUCKETS - 1] = {
+	0.1, 0.25, 0.5, 1, 2.5, 5, 10, 50, 100
+};
+
+/* Samples of one metric of one path */
+typedef struct ProbeSeries
+{
+	const char *metric;
+	int64		samples;
+	int64		failures;
+	double		total;
+	double		max;
+	int64		counts[PROBE_BUCKETS];
+} ProbeSeries;
+
+/* Cumulative counters of a node, to compute their increase over an interval */
+typedef struct ProbeCounters
+{
+	bool		valid;
+	double		waits;
+	double		wait_time;
+} ProbeCounters;
+
+typedef struct ProbeNode
+{
+	char	   *name;
+	char	   *ident;			/* name quoted for EXECUTE DIRECT */
+	char	   *literal;		/* name quoted as a string */
+	bool		coordinator;	/* the Coordinator we are connected to */
+	ProbeSeries rtt;
+	ProbeSeries acquire;
+	ProbeSeries gtm_wait;
+	ProbeSeries pool_wait;
+	ProbeCounters gtm;
+	ProbeCounters pool;
+} ProbeNode;
+
+static ProbeNode *nodes;
+static int	num_nodes;
+static bool print_histogram;
+static bool print_verbose;
+static volatile sig_atomic_t probe_stop = false;
+
+static void probe_signal(int signo);
+static void *probe_malloc(size_t size);
+static char *probe_strdup(const char *str);
+static bool probe_get_nodes(PGconn *conn);
+static void probe_free_nodes(void);
+static bool probe_exec(PGconn *conn, const char *query, double *elapsed,
+		   PGresult **result);
+static void probe_interval(PGconn *conn);
+static void probe_counters(ProbeNode *node, ProbeSeries *series,
+			   ProbeCounters *counters, PGresult *res);
+static void probe_sample(ProbeNode *node, ProbeSeries *series, double value);
+static void probe_failure(ProbeNode *node, ProbeSeries *series);
+static void probe_print_histogram(void);
+static void probe_print_series(ProbeNode *node, ProbeSeries *series);
+
+static void
+probe_signal(int signo)
+{
+	probe_stop = true;
+}
+
+static void *
+probe_malloc(size_t size)
+{
+	void	   *result = calloc(1, size);
+
+	if (result == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", progname);
+		exit(3);
+	}
+	return result;
+}
+
+static char *
+probe_strdup(const char *str)
+{
+	char	   *result = strdup(str);
+
+	if (result == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", progname);
+		exit(3);
+	}
+	return result;
+}
+
+/*
+ * Probe the cluster through the given Coordinator every interval seconds,
+ * count times or until interrupted if count is 0. Returns the exit code of
+ * pgxc_monitor: 0 if the Coordinator could be probed until the end, 1 if
+ * not.
+ */
+int
+do_probe(char *host, char *port, char *username, char *database,
+		 int interval, int count, int histogram, int verbose)
+{
+	const char *keywords[6];
+	const char *values[6];
+	PGconn	   *conn;
+	int			n = 0;
+	int			i;
+	int			result = 0;
+
+	print_histogram = histogram;
+	print_verbose = verbose;
+
+	keywords[0] = "host";
+	values[0] = host;
+	keywords[1] = "port";
+	values[1] = port;
+	keywords[2] = "user";
+	values[2] = username;
+	keywords[3] = "dbname";
+	values[3] = database ? database : "postgres";
+	keywords[4] = "fallback_application_name";
+	values[4] = "pgxc_monitor";
+	keywords[5] = NULL;
+	values[5] = NULL;
+
+	conn = PQconnectdbParams(keywords, values, true);
+	if (PQstatus(conn) != CONNECTION_OK)
+	{
+		if (verbose)
+			fprintf(stderr, "%s: could not connect to the Coordinator: %s",
+					progname, PQerrorMessage(conn));
+		PQfinish(conn);
+		return 1;
+	}
+
+	if (!probe_get_nodes(conn))
+	{
+		PQfinish(conn);
+		return 1;
+	}
+
+	pqsignal(SIGINT, probe_signal);
+	pqsignal(SIGTERM, probe_signal);
+
+	if (!print_histogram)
+	{
+		printf("time,node,metric,msec\n");
+		fflush(stdout);
+	}
+
+	while (!probe_stop && (count == 0 || n < count))
+	{
+		if (PQstatus(conn) != CONNECTION_OK)
+		{
+			/* Report the whole interval as failed and try to reconnect */
+			for (i = 0; i < num_nodes; i++)
+				probe_failure(&nodes[i], &nodes[i].rtt);
+			PQreset(conn);
+			result = 1;
+		}
+		else
+			probe_interval(conn);
+
+		if (++n == count)
+			break;
+		for (i = 0; i < interval * 10 && !probe_stop; i++)
+			pg_usleep(100000L);
+	}
+
+	if (print_histogram)
+		probe_print_histogram();
+
+	probe_free_nodes();
+	PQfinish(conn);
+	return result;
+}
+
+/*
+ * Build the list of the probed nodes: the Coordinator we are connected to,
+ * then the Datanodes.
+ */
+static bool
+probe_get_nodes(PGconn *conn)
+{
+	PGresult   *res;
+	int			i;
+
+	res = PQexec(conn,
+				 "SELECT node_name, node_name = pgxc_node_str() FROM pgxc_node "
+				 "WHERE node_type = 'D' OR node_name = pgxc_node_str() "
+				 "ORDER BY node_type, node_name");
+	if (PQresultStatus(res) != PGRES_TUPLES_OK)
+	{
+		fprintf(stderr, "%s: could not get the list of nodes: %s",
+				progname, PQerrorMessage(conn));
+		PQclear(res);
+		return false;
+	}
+
+	num_nodes = PQntuples(res);
+	nodes = (ProbeNode *) probe_malloc(num_nodes * sizeof(ProbeNode));
+	for (i = 0; i < num_nodes; i++)
+	{
+		ProbeNode  *node = &nodes[i];
+		char	   *quoted;
+
+		node->name = probe_strdup(PQgetvalue(res, i, 0));
+		node->coordinator = (strcmp(PQgetvalue(res, i, 1), "t") == 0);
+		quoted = PQescapeIdentifier(conn, node->name, strlen(node->name));
+		node->ident = probe_strdup(quoted);
+		PQfreemem(quoted);
+		quoted = PQescapeLiteral(conn, node->name, strlen(node->name));
+		node->literal = probe_strdup(quoted);
+		PQfreemem(quoted);
+
+		node->rtt.metric = "rtt";
+		node->acquire.metric = "acquire";
+		node->gtm_wait.metric = "gtm_wait";
+		node->pool_wait.metric = "pool_wait";
+	}
+	PQclear(res);
+	return true;
+}
+
+static void
+probe_free_nodes(void)
+{
+	int			i;
+
+	for (i = 0; i < num_nodes; i++)
+	{
+		free(nodes[i].name);
+		free(nodes[i].ident);
+		free(nodes[i].literal);
+	}
+	free(nodes);
+	nodes = NULL;
+	num_nodes = 0;
+}
+
+/*
+ * Run a query and measure its elapsed time in msec. If result is not NULL,
+ * the result of a successful query is returned there.
+ */
+static bool
+probe_exec(PGconn *conn, const char *query, double *elapsed,
+		   PGresult **result)
+{
+	PGresult   *res;
+	instr_time	start;
+	instr_time	duration;
+	bool		ok;
+
+	INSTR_TIME_SET_CURRENT(start);
+	res = PQexec(conn, query);
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+	if (elapsed)
+		*elapsed = INSTR_TIME_GET_MILLISEC(duration);
+
+	ok = (PQresultStatus(res) == PGRES_TUPLES_OK ||
+		  PQresultStatus(res) == PGRES_COMMAND_OK);
+	if (!ok && print_verbose)
+		fprintf(stderr, "%s: probe \"%s\" failed: %s",
+				progname, query, PQerrorMessage(conn));
+
+	if (ok && result)
+		*result = res;
+	else
+		PQclear(res);
+	return ok;
+}
+
+/*
+ * Take one set of samples of every node.
+ */
+static void
+probe_interval(PGconn *conn)
+{
+	char		query[NAMEDATALEN * 2 + 256];
+	double		base = 0;
+	double		first;
+	double		second;
+	PGresult   *res;
+	int			i;
+
+	for (i = 0; i < num_nodes; i++)
+	{
+		ProbeNode  *node = &nodes[i];
+
+		if (node->coordinator)
+		{
+			/* The round trip to the Coordinator is the base of the others */
+			if (probe_exec(conn, "SELECT 1", &base, NULL))
+				probe_sample(node, &node->rtt, base);
+			else
+				probe_failure(node, &node->rtt);
+
+			res = NULL;
+			probe_exec(conn,
+					   "SELECT waits, total_time FROM pg_stat_wait_histogram "
+					   "WHERE wait_event_type = 'GTM'",
+					   NULL, &res);
+			probe_counters(node, &node->gtm_wait, &node->gtm, res);
+			continue;
+		}
+
+		if (!probe_exec(conn, "BEGIN", NULL, NULL))
+		{
+			probe_failure(node, &node->rtt);
+			continue;
+		}
+
+		snprintf(query, sizeof(query),
+				 "EXECUTE DIRECT ON (%s) 'SELECT 1'", node->ident);
+		if (probe_exec(conn, query, &first, NULL) &&
+			probe_exec(conn, query, &second, NULL))
+		{
+			probe_sample(node, &node->acquire, Max(first - second, 0));
+			probe_sample(node, &node->rtt, Max(second - base, 0));
+
+			res = NULL;
+			snprintf(query, sizeof(query),
+					 "EXECUTE DIRECT ON (%s) 'SELECT waits, total_time "
+					 "FROM pg_stat_wait_histogram "
+					 "WHERE wait_event_type = ''GTM'''", node->ident);
+			probe_exec(conn, query, NULL, &res);
+			probe_counters(node, &node->gtm_wait, &node->gtm, res);
+		}
+		else
+		{
+			probe_failure(node, &node->rtt);
+			node->gtm.valid = false;
+		}
+		probe_exec(conn, "ROLLBACK", NULL, NULL);
+
+		/* Pooler waits of the sessions of the Coordinator for this node */
+		res = NULL;
+		snprintf(query, sizeof(query),
+				 "SELECT sum(acquisitions), sum(wait_time) FROM pg_stat_pooler "
+				 "WHERE node_name = %s", node->literal);
+		probe_exec(conn, query, NULL, &res);
+		probe_counters(node, &node->pool_wait, &node->pool, res);
+	}
+
+	fflush(stdout);
+}
+
+/*
+ * Sample the mean wait over the interval from the cumulative counters of a
+ * node, res giving the number of waits and their total time. Nothing is
+ * sampled at the first interval, or if there was no wait.
+ */
+static void
+probe_counters(ProbeNode *node, ProbeSeries *series, ProbeCounters *counters,
+			   PGresult *res)
+{
+	double		waits;
+	double		wait_time;
+
+	if (res == NULL || PQntuples(res) != 1 || PQgetisnull(res, 0, 0))
+	{
+		counters->valid = false;
+		if (res)
+			PQclear(res);
+		return;
+	}
+
+	waits = atof(PQgetvalue(res, 0, 0));
+	wait_time = atof(PQgetvalue(res, 0, 1));
+	PQclear(res);
+
+	/* Counters going backwards mean the node was restarted */
+	if (counters->valid && waits > counters->waits &&
+		wait_time >= counters->wait_time)
+		probe_sample(node, series,
+					 (wait_time - counters->wait_time) /
+					 (waits - counters->waits));
+
+	counters->valid = true;
+	counters->waits = waits;
+	counters->wait_time = wait_time;
+}
+
+static void
+probe_sample(ProbeNode *node, ProbeSeries *series, double value)
+{
+	int			bucket;
+
+	series->samples++;
+	series->total += value;
+	if (value > series->max)
+		series->max = value;
+	for (bucket = 0; bucket < PROBE_BUCKETS - 1; bucket++)
+		if (value < probe_bounds[bucket])
+			break;
+	series->counts[bucket]++;
+
+	if (!print_histogram)
+	{
+		struct timeval tv;
+		char		timestamp[64];
+
+		gettimeofday(&tv, NULL);
+		strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S",
+				 localtime(&tv.tv_sec));
+		printf("%s.%03d,%s,%s,%.3f\n", timestamp, (int) (tv.tv_usec / 1000),
+			   node->name, series->metric, value);
+	}
+}
+
+/*
+ * Record a failed probe. In the time series it shows as a sample with no
+ * value, so that an unreachable node does not merely vanish from the graph.
+ */
+static void
+probe_failure(ProbeNode *node, ProbeSeries *series)
+{
+	series->failures++;
+
+	if (!print_histogram)
+	{
+		struct timeval tv;
+		char		timestamp[64];
+
+		gettimeofday(&tv, NULL);
+		strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S",
+				 localtime(&tv.tv_sec));
+		printf("%s.%03d,%s,%s,\n", timestamp, (int) (tv.tv_usec / 1000),
+			   node->name, series->metric);
+	}
+}
+
+/*
+ * Print one line per node and metric, with the number of samples in each
+ * latency bucket.
+ */
+static void
+probe_print_histogram(void)
+{
+	int			i;
+
+	printf("%-20s %-10s %8s %8s %9s %9s", "node", "metric", "samples",
+		   "failures", "mean", "max");
+	for (i = 0; i < PROBE_BUCKETS - 1; i++)
+	{
+		char		label[16];
+
+		snprintf(label, sizeof(label), "<%g", probe_bounds[i]);
+		printf(" %7s", label);
+	}
+	printf(" %7s\n", "more");
+
+	for (i = 0; i < num_nodes; i++)
+	{
+		probe_print_series(&nodes[i], &nodes[i].rtt);
+		probe_print_series(&nodes[i], &nodes[i].acquire);
+		probe_print_series(&nodes[i], &nodes[i].pool_wait);
+		probe_print_series(&nodes[i], &nodes[i].gtm_wait);
+	}
+}
+
+static void
+probe_print_series(ProbeNode *node, ProbeSeries *series)
+{
+	char		samples[32];
+	char		failures[32];
+	int			i;
+
+	if (series->samples == 0 && series->failures == 0)
+		return;
+
+	snprintf(samples, sizeof(samples), INT64_FORMAT, series->samples);
+	snprintf(failures, sizeof(failures), INT64_FORMAT, series->failures);
+	printf("%-20s %-10s %8s %8s %9.3f %9.3f",
+		   node->name, series->metric, samples, failures,
+		   series->samples ? series->total / series->samples : 0,
+		   series->max);
+	for (i = 0; i < PROBE_BUCKETS; i++)
+	{
+		char		count[32];
+
+		snprintf(count, sizeof(count), INT64_FORMAT, series->counts[i]);
+		printf(" %7s", count);
+	}
+	printf("\n");
+}
@@ -0,0 +1,23 @@
+/*-------------------------------------------------------------------------
+ *
+ * probe.h
+ *	  Continuous latency probe of pgxc_monitor
+ *
+ * The probe uses libpq, whose header cannot be included together with the
+ * GTM client headers used by pgxc_monitor.c, so it lives in its own file.
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * contrib/pgxc_monitor/probe.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PGXC_MONITOR_PROBE_H
+#define PGXC_MONITOR_PROBE_H
+
+extern char *progname;
+
+extern int do_probe(char *host, char *port, char *username, char *database,
+		 int interval, int count, int histogram, int verbose);
+
+#endif   /* PGXC_MONITOR_PROBE_H */
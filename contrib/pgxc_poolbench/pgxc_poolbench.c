@@ -0,0 +1,960 @@
+/*
+ * ------------------------------------------------------------------------
+ *
+ * pgxc_poolbench utility
+ *
+ *	Benchmarks the connection pooler of a Coordinator or a Datanode.
+ *
+ *	The utility opens many sessions to the pooler socket, the same way the
+ *	backends do, and each of them repeatedly gets connections from the
+ *	pooler, holds them for a while and releases them. Optionally some cycles
+ *	destroy the connections, like the backends do after an error, and the
+ *	sessions disconnect and reconnect to the pooler. At the end the latency
+ *	of getting the connections from the pooler and the throughput are
+ *	reported.
+ *
+ *	The utility can also run mock node endpoints, which accept connections,
+ *	answer the startup packet and simple queries and nothing else, so the
+ *	pooler can be measured without the cost of real node sessions. The pooler
+ *	connects to the nodes defined in the pgxc_node catalog, so to use the mock
+ *	endpoints define the Datanodes of a test cluster with their ports and run
+ *	pgxc_pool_reload() before starting the benchmark.
+ *
+ * Command syntax
+ *
+ * pgxc_poolbench [option ... ]
+ *
+ * Options are:
+ *
+ *  -h, --host=DIR			directory of the pooler Unix-domain socket,
+ *							default /tmp.
+ *  -p, --port=PORT			pooler port, default 6667.
+ *  -d, --dbname=DBNAME		database name the sessions use.
+ *  -U, --username=USER		user name the sessions use.
+ *  -O, --options=OPTIONS	connection options the sessions use.
+ *  -c, --clients=NUM		number of sessions, default 100. Zero only runs
+ *							the mock endpoints until interrupted.
+ *  -T, --time=SECONDS		duration of the benchmark, default 10.
+ *  -n, --nodes=NUM			number of Datanodes in the cluster, default 1.
+ *  -N, --request=NUM		number of Datanodes per request, default 1.
+ *  -H, --hold=USEC			time a session holds the connections,
+ *							default 0.
+ *  -a, --abort=NUM			destroy the connections every NUM cycles of
+ *							a session, default never.
+ *  -r, --reconnect=NUM		reconnect to the pooler every NUM cycles of a
+ *							session, default never.
+ *  -m, --mock-port=PORT	run mock node endpoints from this port on.
+ *  -M, --mock-nodes=NUM	number of mock node endpoints, default 0.
+ *  -?, --help				print help and exit.
+ *
+ * The pooler serves at most max_connections sessions, set it higher than
+ * the number of the clients.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+#include "postgres_fe.h"
+
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "getopt_long.h"
+#include "portability/instr_time.h"
+
+/* Protocol codes of the startup packets, see pqcomm.h */
+#define MOCK_CANCEL_REQUEST_CODE	80877102
+#define MOCK_SSL_REQUEST_CODE		80877103
+
+/* Size of the header of the pooler message carrying descriptors */
+#define FDS_HEADER_SIZE 9
+
+typedef enum
+{
+	AGENT_IDLE,					/* waiting to send the next request */
+	AGENT_ACQUIRING,			/* waiting for the pooler to respond */
+	AGENT_HOLDING				/* holding the connections */
+} AgentState;
+
+typedef struct
+{
+	int			sock;			/* connection to the pooler */
+	AgentState	state;
+	int			cycles;			/* completed acquire/release cycles */
+	int64		started;		/* when the request was sent */
+	int64		next;			/* when to move to the next state */
+	int			nfds;			/* descriptors held */
+	int		   *fds;
+} Agent;
+
+typedef struct
+{
+	int			sock;
+	bool		started;		/* has the startup packet been processed */
+	int			len;			/* bytes in the buffer */
+	char		buf[8192];
+} MockClient;
+
+static const char *progname;
+static const char *sockdir = "/tmp";
+static int	pooler_port = 6667;
+static const char *dbname = NULL;
+static const char *username = NULL;
+static const char *pgoptions = "";
+static int	nclients = 100;
+static int	duration = 10;
+static int	nnodes = 1;
+static int	nrequest = 1;
+static int	hold_time = 0;
+static int	abort_every = 0;
+static int	reconnect_every = 0;
+static int	mock_port = 0;
+static int	mock_nodes = 0;
+
+static instr_time start_time;
+static volatile bool interrupted = false;
+
+/* Results */
+static int64 *latencies = NULL;
+static int64 nlatencies = 0;
+static int64 maxlatencies = 0;
+static int64 failures = 0;
+static int64 aborts = 0;
+static int64 reconnects = 0;
+
+static void usage(void);
+static void handle_sigint(SIGNAL_ARGS);
+static int64 now_us(void);
+static void write_all(int sock, const char *buf, int len);
+static void put_int32(char *buf, int *pos, int value);
+static int	pooler_connect(void);
+static void agent_send_connect(Agent *agent);
+static void agent_send_get(Agent *agent, int index);
+static bool agent_recv_fds(Agent *agent);
+static void agent_send_release(Agent *agent, bool destroy);
+static void agent_send_disconnect(Agent *agent);
+static void add_latency(int64 latency);
+static int	compare_int64(const void *a, const void *b);
+static void run_benchmark(void);
+static void report(int64 elapsed);
+static pid_t start_mock_nodes(void);
+static void run_mock_nodes(void);
+static bool mock_handle_input(MockClient *client);
+
+
+static void
+usage(void)
+{
+	printf("%s benchmarks the connection pooler of a Postgres-XL node.\n\n", progname);
+	printf("Usage:\n");
+	printf("  %s [OPTION]...\n", progname);
+	printf("\nOptions:\n");
+	printf("  -h, --host=DIR          directory of the pooler socket (default /tmp)\n");
+	printf("  -p, --port=PORT         pooler port (default 6667)\n");
+	printf("  -d, --dbname=DBNAME     database name of the sessions\n");
+	printf("  -U, --username=USER     user name of the sessions\n");
+	printf("  -O, --options=OPTIONS   connection options of the sessions\n");
+	printf("  -c, --clients=NUM       number of sessions (default 100)\n");
+	printf("  -T, --time=SECONDS      duration of the benchmark (default 10)\n");
+	printf("  -n, --nodes=NUM         number of Datanodes in the cluster (default 1)\n");
+	printf("  -N, --request=NUM       number of Datanodes per request (default 1)\n");
+	printf("  -H, --hold=USEC         time the connections are held (default 0)\n");
+	printf("  -a, --abort=NUM         destroy the connections every NUM cycles\n");
+	printf("  -r, --reconnect=NUM     reconnect to the pooler every NUM cycles\n");
+	printf("  -m, --mock-port=PORT    run mock node endpoints from this port on\n");
+	printf("  -M, --mock-nodes=NUM    number of mock node endpoints (default 0)\n");
+	printf("  -?, --help              show this help, then exit\n");
+}
+
+
+static void
+handle_sigint(SIGNAL_ARGS)
+{
+	interrupted = true;
+}
+
+
+/*
+ * Microseconds since the start of the benchmark
+ */
+static int64
+now_us(void)
+{
+	instr_time	now;
+
+	INSTR_TIME_SET_CURRENT(now);
+	INSTR_TIME_SUBTRACT(now, start_time);
+	return INSTR_TIME_GET_MICROSEC(now);
+}
+
+
+static void
+write_all(int sock, const char *buf, int len)
+{
+	while (len > 0)
+	{
+		int			n = send(sock, buf, len, 0);
+
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "%s: could not send data: %s\n",
+					progname, strerror(errno));
+			exit(1);
+		}
+		buf += n;
+		len -= n;
+	}
+}
+
+
+static void
+put_int32(char *buf, int *pos, int value)
+{
+	uint32		n32 = htonl((uint32) value);
+
+	memcpy(buf + *pos, &n32, 4);
+	*pos += 4;
+}
+
+
+static int
+pooler_connect(void)
+{
+	struct sockaddr_un addr;
+	int			sock;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/.s.PGPOOL.%d",
+			 sockdir, pooler_port);
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0 ||
+			connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+	{
+		fprintf(stderr, "%s: could not connect to the pooler at \"%s\": %s\n",
+				progname, addr.sun_path, strerror(errno));
+		exit(1);
+	}
+	return sock;
+}
+
+
+/*
+ * Open the pooler session, see PoolManagerConnect()
+ */
+static void
+agent_send_connect(Agent *agent)
+{
+	int			dblen = strlen(dbname) + 1;
+	int			userlen = strlen(username) + 1;
+	int			optlen = strlen(pgoptions) + 1;
+	char	   *buf = pg_malloc(dblen + userlen + optlen + 24);
+	int			pos = 1;
+
+	agent->sock = pooler_connect();
+
+	buf[0] = 'c';
+	put_int32(buf, &pos, dblen + userlen + optlen + 20);
+	put_int32(buf, &pos, getpid());
+	put_int32(buf, &pos, dblen);
+	memcpy(buf + pos, dbname, dblen);
+	pos += dblen;
+	put_int32(buf, &pos, userlen);
+	memcpy(buf + pos, username, userlen);
+	pos += userlen;
+	put_int32(buf, &pos, optlen);
+	memcpy(buf + pos, pgoptions, optlen);
+	pos += optlen;
+	write_all(agent->sock, buf, pos);
+	free(buf);
+}
+
+
+/*
+ * Ask for connections to nrequest Datanodes, see PoolManagerGetConnections()
+ * The sessions start at different Datanodes to spread the load.
+ */
+static void
+agent_send_get(Agent *agent, int index)
+{
+	char	   *buf = pg_malloc(5 + 4 * (nrequest + 4));
+	int			pos = 1;
+	int			i;
+
+	buf[0] = 'g';
+	put_int32(buf, &pos, 4 + 4 * (nrequest + 4));
+	put_int32(buf, &pos, nrequest);
+	for (i = 0; i < nrequest; i++)
+		put_int32(buf, &pos, (index + agent->cycles + i) % nnodes);
+	put_int32(buf, &pos, 0);	/* no Coordinators */
+	put_int32(buf, &pos, 0);	/* default session parameters */
+	put_int32(buf, &pos, 0);	/* nothing to prefetch */
+	write_all(agent->sock, buf, pos);
+	free(buf);
+
+	agent->started = now_us();
+	agent->state = AGENT_ACQUIRING;
+}
+
+
+/*
+ * Receive the descriptors, see pool_recvfds(). Return false if the pooler
+ * could not provide the connections.
+ */
+static bool
+agent_recv_fds(Agent *agent)
+{
+	char		header[FDS_HEADER_SIZE];
+	struct iovec iov[1];
+	struct msghdr msg;
+	char	   *control;
+	int			controllen = CMSG_SPACE(nrequest * sizeof(int));
+	uint32		n32;
+	int			count;
+	int			r;
+
+	control = pg_malloc(controllen);
+	iov[0].iov_base = header;
+	iov[0].iov_len = FDS_HEADER_SIZE;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = controllen;
+
+	do
+		r = recvmsg(agent->sock, &msg, 0);
+	while (r < 0 && errno == EINTR);
+	if (r != FDS_HEADER_SIZE || header[0] != 'f')
+	{
+		fprintf(stderr, "%s: unexpected response from the pooler\n", progname);
+		exit(1);
+	}
+
+	memcpy(&n32, header + 5, 4);
+	count = ntohl(n32);
+	if (count == 0)
+	{
+		free(control);
+		return false;
+	}
+	if (count > nrequest || CMSG_FIRSTHDR(&msg) == NULL)
+	{
+		fprintf(stderr, "%s: unexpected connection count %d\n", progname, count);
+		exit(1);
+	}
+	memcpy(agent->fds, CMSG_DATA(CMSG_FIRSTHDR(&msg)), count * sizeof(int));
+	agent->nfds = count;
+	free(control);
+
+	/* Skip the tags of the connections */
+	r = 0;
+	while (r < count * 4)
+	{
+		char		tags[4 * 64];
+		int			want = Min((int) sizeof(tags), count * 4 - r);
+		int			n = recv(agent->sock, tags, want, 0);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			fprintf(stderr, "%s: incomplete response from the pooler\n", progname);
+			exit(1);
+		}
+		r += n;
+	}
+	return true;
+}
+
+
+/*
+ * Close the connections and give them back, see PoolManagerReleaseConnections()
+ */
+static void
+agent_send_release(Agent *agent, bool destroy)
+{
+	char		buf[17];
+	int			pos = 1;
+	int			i;
+
+	for (i = 0; i < agent->nfds; i++)
+		close(agent->fds[i]);
+	agent->nfds = 0;
+
+	buf[0] = 'r';
+	put_int32(buf, &pos, 16);
+	put_int32(buf, &pos, destroy ? 1 : 0);
+	put_int32(buf, &pos, 0);	/* no session parameters on Datanodes */
+	put_int32(buf, &pos, 0);	/* and on Coordinators */
+	write_all(agent->sock, buf, pos);
+}
+
+
+static void
+agent_send_disconnect(Agent *agent)
+{
+	char		buf[5];
+	int			pos = 1;
+
+	buf[0] = 'd';
+	put_int32(buf, &pos, 4);
+	write_all(agent->sock, buf, pos);
+	close(agent->sock);
+	agent->sock = -1;
+}
+
+
+static void
+add_latency(int64 latency)
+{
+	if (nlatencies == maxlatencies)
+	{
+		maxlatencies = maxlatencies ? maxlatencies * 2 : 65536;
+		latencies = pg_realloc(latencies, maxlatencies * sizeof(int64));
+	}
+	latencies[nlatencies++] = latency;
+}
+
+
+static int
+compare_int64(const void *a, const void *b)
+{
+	int64		x = *(const int64 *) a;
+	int64		y = *(const int64 *) b;
+
+	return (x > y) - (x < y);
+}
+
+
+/*
+ * Run the sessions until the time is up. A single process drives all the
+ * sessions, each of them waits for the pooler response or for its next step.
+ */
+static void
+run_benchmark(void)
+{
+	Agent	   *agents = pg_malloc0(nclients * sizeof(Agent));
+	struct pollfd *pfds = pg_malloc(nclients * sizeof(struct pollfd));
+	int		   *pidx = pg_malloc(nclients * sizeof(int));
+	int64		end = (int64) duration * 1000000;
+	int64		now;
+	int			i;
+
+	for (i = 0; i < nclients; i++)
+	{
+		agents[i].fds = pg_malloc(nrequest * sizeof(int));
+		agents[i].state = AGENT_IDLE;
+		agents[i].next = 0;
+		agent_send_connect(&agents[i]);
+	}
+
+	while (!interrupted && (now = now_us()) < end)
+	{
+		int64		wakeup = end;
+		int			npfds = 0;
+		int			timeout;
+		int			res;
+
+		/* Move the sessions whose time has come */
+		for (i = 0; i < nclients; i++)
+		{
+			Agent	   *agent = &agents[i];
+
+			if (agent->state == AGENT_HOLDING && agent->next <= now)
+			{
+				bool		destroy = abort_every > 0 &&
+					(agent->cycles + 1) % abort_every == 0;
+
+				agent_send_release(agent, destroy);
+				if (destroy)
+					aborts++;
+				agent->cycles++;
+				if (reconnect_every > 0 && agent->cycles % reconnect_every == 0)
+				{
+					agent_send_disconnect(agent);
+					agent_send_connect(agent);
+					reconnects++;
+				}
+				agent->state = AGENT_IDLE;
+				agent->next = now;
+			}
+			if (agent->state == AGENT_IDLE && agent->next <= now)
+				agent_send_get(agent, i);
+
+			if (agent->state == AGENT_ACQUIRING)
+			{
+				pfds[npfds].fd = agent->sock;
+				pfds[npfds].events = POLLIN;
+				pfds[npfds].revents = 0;
+				pidx[npfds++] = i;
+			}
+			else if (agent->next < wakeup)
+				wakeup = agent->next;
+		}
+
+		timeout = (int) ((wakeup - now + 999) / 1000);
+		res = poll(pfds, npfds, Max(timeout, 0));
+		if (res < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "%s: poll failed: %s\n", progname, strerror(errno));
+			exit(1);
+		}
+
+		for (i = 0; i < npfds && res > 0; i++)
+		{
+			Agent	   *agent = &agents[pidx[i]];
+
+			if (pfds[i].revents == 0)
+				continue;
+			res--;
+			now = now_us();
+			if (agent_recv_fds(agent))
+			{
+				add_latency(now - agent->started);
+				agent->state = AGENT_HOLDING;
+				agent->next = now + hold_time;
+			}
+			else
+			{
+				/* Pooler could not serve, retry a bit later */
+				failures++;
+				agent->state = AGENT_IDLE;
+				agent->next = now + 1000;
+			}
+		}
+	}
+
+	/* Sessions do not wait for the remaining responses */
+	for (i = 0; i < nclients; i++)
+	{
+		if (agents[i].state == AGENT_HOLDING)
+			agent_send_release(&agents[i], false);
+		close(agents[i].sock);
+		free(agents[i].fds);
+	}
+	free(agents);
+	free(pfds);
+	free(pidx);
+}
+
+
+static void
+report(int64 elapsed)
+{
+	int64		sum = 0;
+	int64		i;
+	double		secs = elapsed / 1000000.0;
+
+	printf("clients: %d\n", nclients);
+	printf("Datanodes per request: %d of %d\n", nrequest, nnodes);
+	printf("duration: %.3f s\n", secs);
+	printf("acquisitions: " INT64_FORMAT "\n", nlatencies);
+	printf("failed requests: " INT64_FORMAT "\n", failures);
+	printf("destroyed releases: " INT64_FORMAT "\n", aborts);
+	printf("reconnects: " INT64_FORMAT "\n", reconnects);
+	printf("throughput: %.1f acquisitions/s\n", secs > 0 ? nlatencies / secs : 0.0);
+
+	if (nlatencies == 0)
+		return;
+
+	qsort(latencies, nlatencies, sizeof(int64), compare_int64);
+	for (i = 0; i < nlatencies; i++)
+		sum += latencies[i];
+
+	printf("latency average: %.3f ms\n", sum / 1000.0 / nlatencies);
+	printf("latency p50: %.3f ms\n", latencies[nlatencies / 2] / 1000.0);
+	printf("latency p90: %.3f ms\n", latencies[nlatencies * 90 / 100] / 1000.0);
+	printf("latency p99: %.3f ms\n", latencies[nlatencies * 99 / 100] / 1000.0);
+	printf("latency p99.9: %.3f ms\n", latencies[nlatencies * 999 / 1000] / 1000.0);
+	printf("latency max: %.3f ms\n", latencies[nlatencies - 1] / 1000.0);
+}
+
+
+static pid_t
+start_mock_nodes(void)
+{
+	pid_t		pid;
+
+	fflush(stdout);
+	fflush(stderr);
+	pid = fork();
+	if (pid < 0)
+	{
+		fprintf(stderr, "%s: could not fork: %s\n", progname, strerror(errno));
+		exit(1);
+	}
+	if (pid == 0)
+	{
+		run_mock_nodes();
+		exit(0);
+	}
+	return pid;
+}
+
+
+/*
+ * Serve the mock node endpoints until terminated
+ */
+static void
+run_mock_nodes(void)
+{
+	MockClient **clients = NULL;
+	int			nmock = 0;
+	int			maxmock = 0;
+	struct pollfd *pfds = NULL;
+	int		   *listeners = pg_malloc(mock_nodes * sizeof(int));
+	int			i;
+
+	pqsignal(SIGINT, SIG_DFL);
+	for (i = 0; i < mock_nodes; i++)
+	{
+		struct sockaddr_in addr;
+		int			on = 1;
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_port = htons(mock_port + i);
+
+		listeners[i] = socket(AF_INET, SOCK_STREAM, 0);
+		if (listeners[i] < 0 ||
+				setsockopt(listeners[i], SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+				bind(listeners[i], (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+				listen(listeners[i], 1024) < 0)
+		{
+			fprintf(stderr, "%s: could not listen on port %d: %s\n",
+					progname, mock_port + i, strerror(errno));
+			exit(1);
+		}
+	}
+
+	for (;;)
+	{
+		int			npfds = mock_nodes + nmock;
+
+		pfds = pg_realloc(pfds, npfds * sizeof(struct pollfd));
+		for (i = 0; i < mock_nodes; i++)
+		{
+			pfds[i].fd = listeners[i];
+			pfds[i].events = POLLIN;
+			pfds[i].revents = 0;
+		}
+		for (i = 0; i < nmock; i++)
+		{
+			pfds[mock_nodes + i].fd = clients[i]->sock;
+			pfds[mock_nodes + i].events = POLLIN;
+			pfds[mock_nodes + i].revents = 0;
+		}
+
+		if (poll(pfds, npfds, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "%s: poll failed: %s\n", progname, strerror(errno));
+			exit(1);
+		}
+
+		/* Served clients are removed, go downward */
+		for (i = nmock - 1; i >= 0; i--)
+		{
+			if (pfds[mock_nodes + i].revents == 0)
+				continue;
+			if (!mock_handle_input(clients[i]))
+			{
+				close(clients[i]->sock);
+				free(clients[i]);
+				clients[i] = clients[--nmock];
+			}
+		}
+
+		for (i = 0; i < mock_nodes; i++)
+		{
+			int			sock;
+
+			if (!(pfds[i].revents & POLLIN))
+				continue;
+			sock = accept(listeners[i], NULL, NULL);
+			if (sock < 0)
+				continue;
+			if (nmock == maxmock)
+			{
+				maxmock = maxmock ? maxmock * 2 : 256;
+				clients = pg_realloc(clients, maxmock * sizeof(MockClient *));
+			}
+			clients[nmock] = pg_malloc0(sizeof(MockClient));
+			clients[nmock]->sock = sock;
+			nmock++;
+		}
+	}
+}
+
+
+/*
+ * Read from the client of a mock endpoint and respond to the complete
+ * messages. Return false if the connection is to be closed.
+ */
+static bool
+mock_handle_input(MockClient *client)
+{
+	int			n;
+	int			pos = 0;
+
+	n = recv(client->sock, client->buf + client->len,
+			 sizeof(client->buf) - client->len, 0);
+	if (n <= 0)
+		return n < 0 && errno == EINTR;
+	client->len += n;
+
+	for (;;)
+	{
+		char		reply[256];
+		int			rlen = 0;
+		uint32		n32;
+		int			msglen;
+		char		msgtype = 0;
+		int			hdr = client->started ? 5 : 4;
+
+		if (client->len - pos < hdr)
+			break;
+		if (client->started)
+			msgtype = client->buf[pos];
+		memcpy(&n32, client->buf + pos + hdr - 4, 4);
+		msglen = ntohl(n32) + hdr - 4;
+		if (msglen < hdr || msglen > (int) sizeof(client->buf))
+			return false;
+		if (client->len - pos < msglen)
+			break;
+
+		if (!client->started)
+		{
+			int			code = 0;
+
+			if (msglen >= 8)
+			{
+				memcpy(&n32, client->buf + pos + 4, 4);
+				code = ntohl(n32);
+			}
+			if (code == MOCK_CANCEL_REQUEST_CODE)
+				return false;
+			if (code == MOCK_SSL_REQUEST_CODE)
+				reply[rlen++] = 'N';
+			else
+			{
+				static const char *params[] = {
+					"server_version", "9.5.0",
+					"server_encoding", "UTF8",
+					"client_encoding", "UTF8",
+					"integer_datetimes", "on",
+					"standard_conforming_strings", "on",
+					NULL
+				};
+				int			i;
+
+				/* AuthenticationOk */
+				reply[rlen++] = 'R';
+				put_int32(reply, &rlen, 8);
+				put_int32(reply, &rlen, 0);
+				for (i = 0; params[i]; i += 2)
+				{
+					int			l1 = strlen(params[i]) + 1;
+					int			l2 = strlen(params[i + 1]) + 1;
+
+					reply[rlen++] = 'S';
+					put_int32(reply, &rlen, 4 + l1 + l2);
+					memcpy(reply + rlen, params[i], l1);
+					rlen += l1;
+					memcpy(reply + rlen, params[i + 1], l2);
+					rlen += l2;
+				}
+				/* BackendKeyData */
+				reply[rlen++] = 'K';
+				put_int32(reply, &rlen, 12);
+				put_int32(reply, &rlen, getpid());
+				put_int32(reply, &rlen, client->sock);
+				/* ReadyForQuery */
+				reply[rlen++] = 'Z';
+				put_int32(reply, &rlen, 5);
+				reply[rlen++] = 'I';
+				client->started = true;
+			}
+		}
+		else if (msgtype == 'X')
+			return false;
+		else if (msgtype == 'Q' || msgtype == 'S')
+		{
+			/* Nothing to execute, just be ready for the next query */
+			if (msgtype == 'Q')
+			{
+				reply[rlen++] = 'I';
+				put_int32(reply, &rlen, 4);
+			}
+			reply[rlen++] = 'Z';
+			put_int32(reply, &rlen, 5);
+			reply[rlen++] = 'I';
+		}
+
+		if (rlen > 0)
+			write_all(client->sock, reply, rlen);
+		pos += msglen;
+	}
+
+	/* Keep the incomplete message */
+	memmove(client->buf, client->buf + pos, client->len - pos);
+	client->len -= pos;
+	return true;
+}
+
+
+int
+main(int argc, char **argv)
+{
+	static struct option long_options[] = {
+		{"host", required_argument, NULL, 'h'},
+		{"port", required_argument, NULL, 'p'},
+		{"dbname", required_argument, NULL, 'd'},
+		{"username", required_argument, NULL, 'U'},
+		{"options", required_argument, NULL, 'O'},
+		{"clients", required_argument, NULL, 'c'},
+		{"time", required_argument, NULL, 'T'},
+		{"nodes", required_argument, NULL, 'n'},
+		{"request", required_argument, NULL, 'N'},
+		{"hold", required_argument, NULL, 'H'},
+		{"abort", required_argument, NULL, 'a'},
+		{"reconnect", required_argument, NULL, 'r'},
+		{"mock-port", required_argument, NULL, 'm'},
+		{"mock-nodes", required_argument, NULL, 'M'},
+		{"help", no_argument, NULL, '?'},
+		{NULL, 0, NULL, 0}
+	};
+	int			c;
+	int			optindex;
+	pid_t		mock_pid = 0;
+
+	progname = get_progname(argv[0]);
+
+	if (argc > 1 &&
+			(strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-?") == 0))
+	{
+		usage();
+		exit(0);
+	}
+
+	while ((c = getopt_long(argc, argv, "h:p:d:U:O:c:T:n:N:H:a:r:m:M:?",
+							long_options, &optindex)) != -1)
+	{
+		switch (c)
+		{
+			case 'h':
+				sockdir = pg_strdup(optarg);
+				break;
+			case 'p':
+				pooler_port = atoi(optarg);
+				break;
+			case 'd':
+				dbname = pg_strdup(optarg);
+				break;
+			case 'U':
+				username = pg_strdup(optarg);
+				break;
+			case 'O':
+				pgoptions = pg_strdup(optarg);
+				break;
+			case 'c':
+				nclients = atoi(optarg);
+				break;
+			case 'T':
+				duration = atoi(optarg);
+				break;
+			case 'n':
+				nnodes = atoi(optarg);
+				break;
+			case 'N':
+				nrequest = atoi(optarg);
+				break;
+			case 'H':
+				hold_time = atoi(optarg);
+				break;
+			case 'a':
+				abort_every = atoi(optarg);
+				break;
+			case 'r':
+				reconnect_every = atoi(optarg);
+				break;
+			case 'm':
+				mock_port = atoi(optarg);
+				break;
+			case 'M':
+				mock_nodes = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Try \"%s --help\" for more information.\n", progname);
+				exit(1);
+		}
+	}
+
+	if (nclients < 0 || duration <= 0 || nnodes <= 0 || nrequest <= 0 ||
+			nrequest > nnodes || hold_time < 0 || abort_every < 0 ||
+			reconnect_every < 0 || mock_nodes < 0 ||
+			(mock_nodes > 0 && mock_port <= 0))
+	{
+		fprintf(stderr, "%s: invalid option value\n", progname);
+		exit(1);
+	}
+	if (nclients == 0 && mock_nodes == 0)
+	{
+		fprintf(stderr, "%s: nothing to do\n", progname);
+		exit(1);
+	}
+
+	if (username == NULL)
+		username = getenv("PGUSER");
+	if (username == NULL)
+		username = getenv("USER");
+	if (username == NULL && nclients > 0)
+	{
+		fprintf(stderr, "%s: no user name specified\n", progname);
+		exit(1);
+	}
+	if (dbname == NULL)
+		dbname = getenv("PGDATABASE");
+	if (dbname == NULL)
+		dbname = username;
+
+	pqsignal(SIGINT, handle_sigint);
+	pqsignal(SIGPIPE, SIG_IGN);
+
+	if (mock_nodes > 0)
+		mock_pid = start_mock_nodes();
+
+	INSTR_TIME_SET_CURRENT(start_time);
+
+	if (nclients == 0)
+	{
+		/* Only serve the mock endpoints until interrupted */
+		while (!interrupted)
+			pause();
+	}
+	else
+	{
+		run_benchmark();
+		report(now_us());
+	}
+
+	if (mock_pid > 0)
+	{
+		kill(mock_pid, SIGTERM);
+		waitpid(mock_pid, NULL, 0);
+	}
+	return 0;
+}
@@ -0,0 +1,306 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgxc_resolve.c
+ *	  Background worker finishing the in-doubt prepared transactions
+ *
+ * The worker runs on every Coordinator loading the module.  Right after
+ * the Coordinator starts, which may be the recovery from a crash, it
+ * resolves the transactions prepared in all the databases at once, without
+ * waiting to be elected: the transactions this Coordinator was committing
+ * when it failed are holding their locks on the nodes.  From then on only
+ * the Coordinator whose name comes first in pgxc_node does it, every
+ * naptime, to pick up the transactions left behind by the other
+ * Coordinators.  Each database is handled by a worker of its own connected
+ * to it, which calls pgxc_resolve_prepared().
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * contrib/pgxc_resolve/pgxc_resolve.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "executor/spi.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "pgxc/pgxc.h"
+#include "postmaster/bgworker.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "tcop/tcopprot.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+
+PG_MODULE_MAGIC;
+
+void		_PG_init(void);
+void		pgxc_resolve_main(Datum main_arg) pg_attribute_noreturn();
+void		pgxc_resolve_database_main(Datum main_arg) pg_attribute_noreturn();
+
+/* flags set by signal handlers */
+static volatile sig_atomic_t got_sighup = false;
+static volatile sig_atomic_t got_sigterm = false;
+
+/* GUC variables */
+static int	pgxc_resolve_naptime = 60;
+static int	pgxc_resolve_min_age = 60;
+static char *pgxc_resolve_database = NULL;
+
+#define ELECTION_QUERY \
+	"SELECT node_name = pg_catalog.pgxc_node_str() FROM pg_catalog.pgxc_node " \
+	"WHERE node_type = 'C' ORDER BY node_name LIMIT 1"
+#define DATABASE_QUERY \
+	"SELECT oid FROM pg_catalog.pg_database WHERE datallowconn"
+#define RESOLVE_QUERY \
+	"SELECT * FROM pg_catalog.pgxc_resolve_prepared(%d)"
+
+static void
+pgxc_resolve_sigterm(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_sigterm = true;
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+static void
+pgxc_resolve_sighup(SIGNAL_ARGS)
+{
+	int			save_errno = errno;
+
+	got_sighup = true;
+	SetLatch(MyLatch);
+
+	errno = save_errno;
+}
+
+/*
+ * Find the databases to look at, returns their number.  On the first pass
+ * all Coordinators do it, later only the elected one.
+ */
+static int
+pgxc_resolve_get_databases(bool first, Oid **databases)
+{
+	bool		isnull;
+	int			count = 0;
+	int			i;
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	if (!first)
+	{
+		if (SPI_execute(ELECTION_QUERY, true, 1) != SPI_OK_SELECT)
+			elog(ERROR, "could not query pgxc_node");
+		if (SPI_processed != 1 ||
+			!DatumGetBool(SPI_getbinval(SPI_tuptable->vals[0],
+										SPI_tuptable->tupdesc, 1, &isnull)))
+			goto done;
+	}
+
+	if (SPI_execute(DATABASE_QUERY, true, 0) != SPI_OK_SELECT)
+		elog(ERROR, "could not query pg_database");
+
+	*databases = (Oid *) MemoryContextAlloc(TopMemoryContext,
+											Max(SPI_processed, 1) * sizeof(Oid));
+	for (i = 0; i < SPI_processed; i++)
+		(*databases)[count++] =
+			DatumGetObjectId(SPI_getbinval(SPI_tuptable->vals[i],
+										   SPI_tuptable->tupdesc, 1, &isnull));
+
+done:
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	return count;
+}
+
+/*
+ * Start the worker resolving the transactions of the database and wait
+ * for it to finish.  The databases are done one after the other, each of
+ * them talks to all the nodes at once anyway.
+ */
+static void
+pgxc_resolve_one_database(Oid dboid)
+{
+	BackgroundWorker worker;
+	BackgroundWorkerHandle *handle;
+
+	MemSet(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+		BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	worker.bgw_main = NULL;
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "pgxc_resolve");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN, "pgxc_resolve_database_main");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "in-doubt transaction resolver %u",
+			 dboid);
+	worker.bgw_main_arg = ObjectIdGetDatum(dboid);
+	worker.bgw_notify_pid = MyProcPid;
+
+	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+	{
+		ereport(WARNING,
+				(errmsg("could not start in-doubt transaction resolver for database %u",
+						dboid),
+				 errhint("You may need to increase max_worker_processes.")));
+		return;
+	}
+
+	if (WaitForBackgroundWorkerShutdown(handle) == BGWH_POSTMASTER_DIED)
+		proc_exit(1);
+	pfree(handle);
+}
+
+void
+pgxc_resolve_main(Datum main_arg)
+{
+	bool		first = true;
+
+	pqsignal(SIGHUP, pgxc_resolve_sighup);
+	pqsignal(SIGTERM, pgxc_resolve_sigterm);
+	BackgroundWorkerUnblockSignals();
+
+	BackgroundWorkerInitializeConnection(pgxc_resolve_database, NULL);
+
+	while (!got_sigterm)
+	{
+		int			rc;
+
+		/* Datanodes don't see the other nodes */
+		if (IS_PGXC_COORDINATOR)
+		{
+			Oid		   *databases = NULL;
+			int			count;
+			int			i;
+
+			count = pgxc_resolve_get_databases(first, &databases);
+			for (i = 0; i < count && !got_sigterm; i++)
+				pgxc_resolve_one_database(databases[i]);
+			if (databases)
+				pfree(databases);
+			first = false;
+		}
+
+		rc = WaitLatch(MyLatch,
+					   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   pgxc_resolve_naptime * 1000L);
+		ResetLatch(MyLatch);
+
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+
+		if (got_sighup)
+		{
+			got_sighup = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+	}
+
+	proc_exit(1);
+}
+
+/*
+ * Main of the worker doing a database
+ */
+void
+pgxc_resolve_database_main(Datum main_arg)
+{
+	char		query[64];
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	BackgroundWorkerInitializeConnectionByOid(DatumGetObjectId(main_arg),
+											  InvalidOid);
+
+	snprintf(query, sizeof(query), RESOLVE_QUERY, pgxc_resolve_min_age);
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
+	pgstat_report_activity(STATE_RUNNING, query);
+
+	/* The transactions finished are reported in the log by the function */
+	if (SPI_execute(query, false, 0) != SPI_OK_SELECT)
+		elog(ERROR, "could not resolve prepared transactions");
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+	pgstat_report_activity(STATE_IDLE, NULL);
+
+	proc_exit(0);
+}
+
+/*
+ * Module load callback
+ */
+void
+_PG_init(void)
+{
+	BackgroundWorker worker;
+
+	DefineCustomIntVariable("pgxc_resolve.naptime",
+							"Time between resolutions of in-doubt transactions.",
+							NULL,
+							&pgxc_resolve_naptime,
+							60,
+							1,
+							INT_MAX / 1000,
+							PGC_SIGHUP,
+							GUC_UNIT_S,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgxc_resolve.min_age",
+							"Age of the prepared transactions considered in doubt.",
+							NULL,
+							&pgxc_resolve_min_age,
+							60,
+							0,
+							INT_MAX,
+							PGC_SIGHUP,
+							GUC_UNIT_S,
+							NULL,
+							NULL,
+							NULL);
+
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	DefineCustomStringVariable("pgxc_resolve.database",
+							   "Database the worker connects to.",
+							   NULL,
+							   &pgxc_resolve_database,
+							   "postgres",
+							   PGC_POSTMASTER,
+							   0,
+							   NULL,
+							   NULL,
+							   NULL);
+
+	MemSet(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+		BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = 60;
+	worker.bgw_main = pgxc_resolve_main;
+	worker.bgw_notify_pid = 0;
+	snprintf(worker.bgw_name, BGW_MAXLEN, "in-doubt transaction resolver");
+
+	RegisterBackgroundWorker(&worker);
+}
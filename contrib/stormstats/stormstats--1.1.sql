@@ -0,0 +1,37 @@
+CREATE FUNCTION storm_database_stats(
+    OUT datname text,
+    OUT conn_cnt int8,
+    OUT select_cnt int8,
+    OUT insert_cnt int8,
+    OUT update_cnt int8,
+    OUT delete_cnt int8,
+    OUT ddl_cnt int8
+)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
+-- Register a view on the function for ease of use.
+CREATE VIEW storm_database_stats AS
+  SELECT * FROM storm_database_stats();
+
+
+CREATE FUNCTION storm_statement_stats(
+    OUT node_name text,
+    OUT rolname text,
+    OUT datname text,
+    OUT queryid int8,
+    OUT calls int8,
+    OUT total_time float8,
+    OUT rows int8,
+    OUT shared_blks_hit int8,
+    OUT shared_blks_read int8,
+    OUT temp_blks_written int8
+)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C;
+
+-- Register a view on the function for ease of use.
+CREATE VIEW storm_statement_stats AS
+  SELECT * FROM storm_statement_stats();
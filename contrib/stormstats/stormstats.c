@@ -36,6 +36,21 @@ static const uint32 STORM_FILE_HEADER = 0x20120229;
 
 #define STORM_STATS_COLS 7
 
+/*
+ * Statement statistics of a node. Fragments of a distributed query executed
+ * on the Datanodes are accounted by pg_stat_statements to the query id of
+ * the Coordinator statement, so rows of the same queryid show the load the
+ * statement put on each node. Roles and databases are reported by name since
+ * their OIDs may differ between the nodes.
+ */
+#define STORM_STATEMENT_QUERY \
+	"SELECT current_setting('pgxc_node_name'), r.rolname::text, " \
+	"d.datname::text, s.queryid, s.calls, s.total_time, s.rows, " \
+	"s.shared_blks_hit, s.shared_blks_read, s.temp_blks_written " \
+	"FROM pg_stat_statements s " \
+	"JOIN pg_roles r ON r.oid = s.userid " \
+	"JOIN pg_database d ON d.oid = s.dbid"
+
 typedef struct ssHashKey
 {
 	int dbname_len;
@@ -91,8 +106,10 @@ static StormStatsEntry *alloc_event_entry(ssHashKey *key);
 
 /* Functions */
 Datum storm_database_stats(PG_FUNCTION_ARGS);
+Datum storm_statement_stats(PG_FUNCTION_ARGS);
 
 PG_FUNCTION_INFO_V1(storm_database_stats);
+PG_FUNCTION_INFO_V1(storm_statement_stats);
 
 /* Shared Memory Objects */
 static HTAB *StatsEntryHash = NULL;
@@ -600,30 +617,17 @@ stats_store(const char *dbname, CmdType c, bool isConnEvent, bool isUtilEvent)
 }
 
 /*
- * Gather statistics from remote coordinators
+ * Build up a RemoteQuery running the query on the remote nodes, the query
+ * returns the columns of the function funcid.
  */
-static HTAB *
-storm_gather_remote_coord_info(Oid funcid)
+static RemoteQuery *
+storm_remote_query(Oid funcid, char *query, RemoteQueryExecType exec_type)
 {
-	bool		found;
-	EState 	   *estate;
-	TupleTableSlot *result;
 	RemoteQuery *step;
-	RemoteQueryState *node;
 	int			i, ncolumns;
 	HeapTuple	tp;
 	TupleDesc	tupdesc;
-	MemoryContext oldcontext;
-	HTAB		*LocalStatsHash;
-	HASHCTL		event_ctl;
 
-	/*
-	 * We will sort output by database name, should make adding up info from
-	 * multiple remote coordinators easier
-	 */
-	char *query = "SELECT * FROM storm_database_stats() ORDER BY datname";
-
-	/* Build up RemoteQuery */
 	step = makeNode(RemoteQuery);
 
 	step->combine_type = COMBINE_TYPE_NONE;
@@ -631,21 +635,7 @@ storm_gather_remote_coord_info(Oid funcid)
 	step->sql_statement = query;
 	step->force_autocommit = false;
 	step->read_only = true;
-	step->exec_type = EXEC_ON_COORDS;
-
-	/* Build a local hash table to contain info from remote nodes */
-	memset(&event_ctl, 0, sizeof(event_ctl));
-
-	event_ctl.keysize = sizeof(ssHashKey);
-	event_ctl.entrysize = sizeof(LocalStatsEntry);
-	event_ctl.hash = ss_hash_fn;
-	event_ctl.match = ss_match_fn;
-
-	LocalStatsHash = hash_create("storm_stats local hash", max_tracked_dbs,
-								   &event_ctl,
-								   HASH_ELEM | HASH_FUNCTION | HASH_COMPARE);
-	if (!LocalStatsHash)
-		elog(ERROR, "out of memory");
+	step->exec_type = exec_type;
 
 	/*
 	 * Add targetlist entries. We use the proc oid to get the tupledesc for
@@ -675,6 +665,47 @@ storm_gather_remote_coord_info(Oid funcid)
 	}
 	ReleaseSysCache(tp);
 
+	return step;
+}
+
+/*
+ * Gather statistics from remote coordinators
+ */
+static HTAB *
+storm_gather_remote_coord_info(Oid funcid)
+{
+	bool		found;
+	EState 	   *estate;
+	TupleTableSlot *result;
+	RemoteQuery *step;
+	RemoteQueryState *node;
+	MemoryContext oldcontext;
+	HTAB		*LocalStatsHash;
+	HASHCTL		event_ctl;
+
+	/*
+	 * We will sort output by database name, should make adding up info from
+	 * multiple remote coordinators easier
+	 */
+	char *query = "SELECT * FROM storm_database_stats() ORDER BY datname";
+
+	/* Build up RemoteQuery */
+	step = storm_remote_query(funcid, query, EXEC_ON_COORDS);
+
+	/* Build a local hash table to contain info from remote nodes */
+	memset(&event_ctl, 0, sizeof(event_ctl));
+
+	event_ctl.keysize = sizeof(ssHashKey);
+	event_ctl.entrysize = sizeof(LocalStatsEntry);
+	event_ctl.hash = ss_hash_fn;
+	event_ctl.match = ss_match_fn;
+
+	LocalStatsHash = hash_create("storm_stats local hash", max_tracked_dbs,
+								   &event_ctl,
+								   HASH_ELEM | HASH_FUNCTION | HASH_COMPARE);
+	if (!LocalStatsHash)
+		elog(ERROR, "out of memory");
+
 	/* Execute query on the data nodes */
 	estate = CreateExecutorState();
 
@@ -896,3 +927,83 @@ Datum storm_database_stats(PG_FUNCTION_ARGS)
 
 	return (Datum) 0;
 }
+
+/*
+ * Statement statistics of all the nodes of the cluster, as collected by
+ * pg_stat_statements on each of them. The local node is queried through SPI,
+ * then all the other nodes at once.
+ */
+Datum storm_statement_stats(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo       *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc           tupdesc;
+	Tuplestorestate     *tupstore;
+	MemoryContext       per_query_ctx;
+	MemoryContext       oldcontext;
+	EState				*estate;
+	RemoteQuery			*step;
+	RemoteQueryState	*node;
+	TupleTableSlot		*result;
+	uint64				i;
+
+	if (IS_PGXC_DATANODE)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("invalid invocation on data node")));
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupdesc = CreateTupleDescCopy(tupdesc);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+	if (SPI_execute(STORM_STATEMENT_QUERY, true, 0) != SPI_OK_SELECT)
+		elog(ERROR, "could not read the local statement statistics");
+	for (i = 0; i < SPI_processed; i++)
+		tuplestore_puttuple(tupstore, SPI_tuptable->vals[i]);
+	SPI_finish();
+
+	/* Send the query to all the other nodes */
+	step = storm_remote_query(fcinfo->flinfo->fn_oid, STORM_STATEMENT_QUERY,
+							  EXEC_ON_ALL_NODES);
+
+	estate = CreateExecutorState();
+	oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+	estate->es_snapshot = GetActiveSnapshot();
+	node = ExecInitRemoteQuery(step, estate, 0);
+	MemoryContextSwitchTo(oldcontext);
+
+	result = ExecRemoteQuery(node);
+	while (result != NULL && !TupIsNull(result))
+	{
+		tuplestore_puttupleslot(tupstore, result);
+		result = ExecRemoteQuery(node);
+	}
+	ExecEndRemoteQuery(node);
+	FreeExecutorState(estate);
+
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
@@ -25,10 +25,12 @@
 #include "access/xact.h"
 #include "access/xloginsert.h"
 #include "catalog/index.h"
+#include "executor/executor.h"
 #include "miscadmin.h"
 #include "pgstat.h"
 #include "storage/bufmgr.h"
 #include "storage/freespace.h"
+#include "storage/lmgr.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/snapmgr.h"
@@ -63,6 +65,14 @@ typedef struct BrinOpaque
 static BrinBuildState *initialize_brin_buildstate(Relation idxRel,
 						   BrinRevmap *revmap, BlockNumber pagesPerRange);
 static void terminate_brin_buildstate(BrinBuildState *state);
+static void summarize_range(IndexInfo *indexInfo, BrinBuildState *state,
+				Relation heapRel, BlockNumber heapBlk, bool allTuples);
+static void summarize_range_tuples(IndexInfo *indexInfo,
+					   BrinBuildState *state, Relation heapRel,
+					   BlockNumber heapBlk);
+static void brin_autosummarize(Relation index, Relation heapRel,
+				   BrinRevmap *revmap, BlockNumber pagesPerRange,
+				   BlockNumber heapBlk);
 static void brinsummarize(Relation index, Relation heapRel,
 			  double *numSummarized, double *numExisting);
 static void form_and_insert_tuple(BrinBuildState *state);
@@ -78,6 +88,9 @@ static void union_tuples(BrinDesc *bdesc, BrinMemTuple *a,
  *
  * If the range is not currently summarized (i.e. the revmap returns NULL for
  * it), there's nothing to do.
+ *
+ * With autosummarize, the first insertion into a page range also summarizes
+ * the range before it, which the heap has just filled up.
  */
 Datum
 brininsert(PG_FUNCTION_ARGS)
@@ -86,9 +99,11 @@ brininsert(PG_FUNCTION_ARGS)
 	Datum	   *values = (Datum *) PG_GETARG_POINTER(1);
 	bool	   *nulls = (bool *) PG_GETARG_POINTER(2);
 	ItemPointer heaptid = (ItemPointer) PG_GETARG_POINTER(3);
+	Relation	heapRel = (Relation) PG_GETARG_POINTER(4);
 
 	/* we ignore the rest of our arguments */
 	BlockNumber pagesPerRange;
+	BlockNumber origHeapBlk;
 	BrinDesc   *bdesc = NULL;
 	BrinRevmap *revmap;
 	Buffer		buf = InvalidBuffer;
@@ -96,6 +111,7 @@ brininsert(PG_FUNCTION_ARGS)
 	MemoryContext oldcxt = NULL;
 
 	revmap = brinRevmapInitialize(idxRel, &pagesPerRange);
+	origHeapBlk = ItemPointerGetBlockNumber(heaptid);
 
 	for (;;)
 	{
@@ -215,9 +231,16 @@ brininsert(PG_FUNCTION_ARGS)
 		break;
 	}
 
-	brinRevmapTerminate(revmap);
 	if (BufferIsValid(buf))
 		ReleaseBuffer(buf);
+
+	if (BrinGetAutoSummarize(idxRel) &&
+		origHeapBlk >= pagesPerRange &&
+		origHeapBlk % pagesPerRange == 0)
+		brin_autosummarize(idxRel, heapRel, revmap, pagesPerRange,
+						   origHeapBlk - pagesPerRange);
+
+	brinRevmapTerminate(revmap);
 	if (bdesc != NULL)
 	{
 		brin_free_desc(bdesc);
@@ -748,7 +771,8 @@ brinoptions(PG_FUNCTION_ARGS)
 	BrinOptions *rdopts;
 	int			numoptions;
 	static const relopt_parse_elt tab[] = {
-		{"pages_per_range", RELOPT_TYPE_INT, offsetof(BrinOptions, pagesPerRange)}
+		{"pages_per_range", RELOPT_TYPE_INT, offsetof(BrinOptions, pagesPerRange)},
+		{"autosummarize", RELOPT_TYPE_BOOL, offsetof(BrinOptions, autosummarize)}
 	};
 
 	options = parseRelOptions(reloptions, validate, RELOPT_KIND_BRIN,
@@ -909,6 +933,93 @@ terminate_brin_buildstate(BrinBuildState *state)
 	pfree(state);
 }
 
+/*
+ * Feed every tuple stored in the given page range to brinbuildCallback,
+ * without any visibility check.
+ */
+static void
+summarize_range_tuples(IndexInfo *indexInfo, BrinBuildState *state,
+					   Relation heapRel, BlockNumber heapBlk)
+{
+	EState	   *estate;
+	ExprContext *econtext;
+	TupleTableSlot *slot;
+	List	   *predicate;
+	HeapTuple  *tuples;
+	BlockNumber endBlk;
+	BlockNumber blk;
+	Datum		values[INDEX_MAX_KEYS];
+	bool		isnull[INDEX_MAX_KEYS];
+
+	estate = CreateExecutorState();
+	econtext = GetPerTupleExprContext(estate);
+	slot = MakeSingleTupleTableSlot(RelationGetDescr(heapRel));
+	econtext->ecxt_scantuple = slot;
+	predicate = (List *) ExecPrepareExpr((Expr *) indexInfo->ii_Predicate,
+										 estate);
+	tuples = palloc(sizeof(HeapTuple) * MaxHeapTuplesPerPage);
+
+	endBlk = Min(heapBlk + state->bs_pagesPerRange,
+				 RelationGetNumberOfBlocks(heapRel));
+	for (blk = heapBlk; blk < endBlk; blk++)
+	{
+		Buffer		buf;
+		Page		page;
+		OffsetNumber off;
+		OffsetNumber maxoff;
+		MemoryContext oldcxt;
+		int			ntuples = 0;
+		int			i;
+
+		CHECK_FOR_INTERRUPTS();
+
+		/*
+		 * Copy the tuples out of the page, so that index expressions aren't
+		 * evaluated while holding the buffer lock.
+		 */
+		buf = ReadBuffer(heapRel, blk);
+		LockBuffer(buf, BUFFER_LOCK_SHARE);
+		page = BufferGetPage(buf);
+		maxoff = PageGetMaxOffsetNumber(page);
+		oldcxt = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+		for (off = FirstOffsetNumber; off <= maxoff; off = OffsetNumberNext(off))
+		{
+			ItemId		lp = PageGetItemId(page, off);
+			HeapTupleData tuple;
+
+			if (!ItemIdIsNormal(lp))
+				continue;
+
+			tuple.t_data = (HeapTupleHeader) PageGetItem(page, lp);
+			tuple.t_len = ItemIdGetLength(lp);
+			tuple.t_tableOid = RelationGetRelid(heapRel);
+			ItemPointerSet(&tuple.t_self, blk, off);
+			tuples[ntuples++] = heap_copytuple(&tuple);
+		}
+		MemoryContextSwitchTo(oldcxt);
+		UnlockReleaseBuffer(buf);
+
+		for (i = 0; i < ntuples; i++)
+		{
+			ExecStoreTuple(tuples[i], slot, InvalidBuffer, false);
+
+			if (predicate == NIL || ExecQual(predicate, econtext, false))
+			{
+				FormIndexDatum(indexInfo, slot, estate, values, isnull);
+				brinbuildCallback(state->bs_irel, tuples[i], values, isnull,
+								  true, (void *) state);
+			}
+		}
+
+		ExecClearTuple(slot);
+		ResetExprContext(econtext);
+	}
+
+	pfree(tuples);
+	ExecDropSingleTupleTableSlot(slot);
+	FreeExecutorState(estate);
+}
+
 /*
  * Summarize the given page range of the given index.
  *
@@ -920,10 +1031,15 @@ terminate_brin_buildstate(BrinBuildState *state)
  * update of the index value happens in a loop, so that if somebody updates
  * the placeholder tuple after we read it, we detect the case and try again.
  * This ensures that the concurrently inserted tuples are not lost.
+ *
+ * If allTuples is true, every tuple stored in the range is summarized,
+ * regardless of its visibility.  That gives a wider summary than necessary
+ * if there are dead tuples, but it is what an inserting backend must do, as
+ * the tuples it inserted aren't visible to itself yet.
  */
 static void
 summarize_range(IndexInfo *indexInfo, BrinBuildState *state, Relation heapRel,
-				BlockNumber heapBlk)
+				BlockNumber heapBlk, bool allTuples)
 {
 	Buffer		phbuf;
 	BrinTuple  *phtup;
@@ -945,9 +1061,12 @@ summarize_range(IndexInfo *indexInfo, BrinBuildState *state, Relation heapRel,
 	 * short of brinbuildCallback creating the new index entry.
 	 */
 	state->bs_currRangeStart = heapBlk;
-	IndexBuildHeapRangeScan(heapRel, state->bs_irel, indexInfo, false,
-							heapBlk, state->bs_pagesPerRange,
-							brinbuildCallback, (void *) state);
+	if (allTuples)
+		summarize_range_tuples(indexInfo, state, heapRel, heapBlk);
+	else
+		IndexBuildHeapRangeScan(heapRel, state->bs_irel, indexInfo, false,
+								heapBlk, state->bs_pagesPerRange,
+								brinbuildCallback, (void *) state);
 
 	/*
 	 * Now we update the values obtained by the scan with the placeholder
@@ -1003,6 +1122,61 @@ summarize_range(IndexInfo *indexInfo, BrinBuildState *state, Relation heapRel,
 	ReleaseBuffer(phbuf);
 }
 
+/*
+ * Summarize the page range starting at heapBlk from brininsert, unless it
+ * is summarized already.
+ *
+ * We take ShareUpdateExclusiveLock on the heap for this, as VACUUM and
+ * brin_summarize_new_values do, so that no two processes summarize the same
+ * range.  Inserters must not wait for each other or for a VACUUM, so if the
+ * lock is not free the range is left for whoever holds it, or for a later
+ * VACUUM.  The lock is released once done; the summary isn't transactional.
+ */
+static void
+brin_autosummarize(Relation index, Relation heapRel, BrinRevmap *revmap,
+				   BlockNumber pagesPerRange, BlockNumber heapBlk)
+{
+	BrinBuildState *state;
+	IndexInfo  *indexInfo;
+	BrinTuple  *tup;
+	Buffer		buf = InvalidBuffer;
+	OffsetNumber off;
+
+	/* cheap check first, without the lock */
+	tup = brinGetTupleForHeapBlock(revmap, heapBlk, &buf, &off, NULL,
+								   BUFFER_LOCK_SHARE);
+	if (tup != NULL)
+	{
+		UnlockReleaseBuffer(buf);
+		return;
+	}
+
+	if (!ConditionalLockRelation(heapRel, ShareUpdateExclusiveLock))
+	{
+		if (BufferIsValid(buf))
+			ReleaseBuffer(buf);
+		return;
+	}
+
+	/* somebody might have summarized it before we got the lock */
+	tup = brinGetTupleForHeapBlock(revmap, heapBlk, &buf, &off, NULL,
+								   BUFFER_LOCK_SHARE);
+	if (tup != NULL)
+		LockBuffer(buf, BUFFER_LOCK_UNLOCK);
+	if (BufferIsValid(buf))
+		ReleaseBuffer(buf);
+
+	if (tup == NULL)
+	{
+		state = initialize_brin_buildstate(index, revmap, pagesPerRange);
+		indexInfo = BuildIndexInfo(index);
+		summarize_range(indexInfo, state, heapRel, heapBlk, true);
+		terminate_brin_buildstate(state);
+	}
+
+	UnlockRelation(heapRel, ShareUpdateExclusiveLock);
+}
+
 /*
  * Scan a complete BRIN index, and summarize each page range that's not already
  * summarized.  The index and heap must have been locked by caller in at
@@ -1081,7 +1255,7 @@ brinsummarize(Relation index, Relation heapRel, double *numSummarized,
 							(errcode(ERRCODE_INVALID_TRANSACTION_STATE),
 							 errmsg("brin_summarize_new_values() cannot run in a transaction that has already obtained a snapshot")));
 			}
-			summarize_range(indexInfo, state, heapRel, heapBlk);
+			summarize_range(indexInfo, state, heapRel, heapBlk, false);
 
 			/* and re-initialize state for the next range */
 			brin_memtuple_initialize(state->bs_dtuple, state->bs_bdesc);
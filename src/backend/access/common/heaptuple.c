@@ -69,7 +69,9 @@
 #include "access/tuptoaster.h"
 #include "executor/tuptable.h"
 #ifdef XCP
+#include "common/pg_lzcompress.h"
 #include "lib/stringinfo.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #endif
 #include "utils/expandeddatum.h"
@@ -949,6 +951,64 @@ heap_modifytuple(HeapTuple tuple,
 	return result;
 }
 
+/*
+ * heap_fixed_prefix
+ *		Return the number of leading attributes of fixed width of the
+ *		descriptor.  As long as none of them is null, they are found at the
+ *		same offset in every tuple; that offset is cached in attcacheoff, as
+ *		the deforming loops would do.
+ */
+static int
+heap_fixed_prefix(TupleDesc tupleDesc)
+{
+	Form_pg_attribute *att = tupleDesc->attrs;
+	long		off = 0;
+	int			attnum;
+
+	if (tupleDesc->tdnfixed >= 0)
+		return tupleDesc->tdnfixed;
+
+	for (attnum = 0; attnum < tupleDesc->natts; attnum++)
+	{
+		Form_pg_attribute thisatt = att[attnum];
+
+		if (thisatt->attlen <= 0)
+			break;
+
+		off = att_align_nominal(off, thisatt->attalign);
+		thisatt->attcacheoff = off;
+		off += thisatt->attlen;
+	}
+
+	tupleDesc->tdnfixed = attnum;
+
+	return attnum;
+}
+
+/*
+ * Are none of the first natts attributes null in the null bitmap?
+ * The bitmap is checked a byte at a time.
+ */
+static inline bool
+heap_prefix_notnull(bits8 *bp, int natts)
+{
+	int			i;
+
+	for (i = 0; i < (natts >> 3); i++)
+	{
+		if (bp[i] != 0xFF)
+			return false;
+	}
+	if ((natts & 0x07) != 0)
+	{
+		int			mask = (1 << (natts & 0x07)) - 1;
+
+		return (bp[i] & mask) == mask;
+	}
+
+	return true;
+}
+
 /*
  * heap_deform_tuple
  *		Given a tuple, extract data into values/isnull arrays; this is
@@ -975,6 +1035,7 @@ heap_deform_tuple(HeapTuple tuple, TupleDesc tupleDesc,
 	Form_pg_attribute *att = tupleDesc->attrs;
 	int			tdesc_natts = tupleDesc->natts;
 	int			natts;			/* number of atts to extract */
+	int			nfixed;			/* atts at a fixed offset */
 	int			attnum;
 	char	   *tp;				/* ptr to tuple data */
 	long		off;			/* offset in tuple data */
@@ -993,8 +1054,25 @@ heap_deform_tuple(HeapTuple tuple, TupleDesc tupleDesc,
 	tp = (char *) tup + tup->t_hoff;
 
 	off = 0;
+	attnum = 0;
 
-	for (attnum = 0; attnum < natts; attnum++)
+	/*
+	 * Fetch the attributes of the fixed-width prefix at their cached offset,
+	 * if none of them is null.
+	 */
+	nfixed = Min(heap_fixed_prefix(tupleDesc), natts);
+	if (nfixed > 0 && (!hasnulls || heap_prefix_notnull(bp, nfixed)))
+	{
+		for (; attnum < nfixed; attnum++)
+		{
+			values[attnum] = fetchatt(att[attnum],
+									  tp + att[attnum]->attcacheoff);
+			isnull[attnum] = false;
+		}
+		off = att[nfixed - 1]->attcacheoff + att[nfixed - 1]->attlen;
+	}
+
+	for (; attnum < natts; attnum++)
 	{
 		Form_pg_attribute thisatt = att[attnum];
 
@@ -1056,6 +1134,50 @@ heap_deform_tuple(HeapTuple tuple, TupleDesc tupleDesc,
 	}
 }
 
+/*
+ * heap_getattr_batch
+ *		Extract one attribute of each tuple of an array into values and
+ *		isnull, like heap_getattr does.
+ *
+ *		An attribute of the fixed-width prefix of the descriptor is fetched
+ *		at its cached offset from the tuples having no null in the prefix,
+ *		without walking the preceding attributes.
+ */
+void
+heap_getattr_batch(HeapTuple tuples, int ntuples, int attnum,
+				   TupleDesc tupleDesc, Datum *values, bool *isnull)
+{
+	Form_pg_attribute thisatt;
+	int			i;
+
+	Assert(attnum > 0 && attnum <= tupleDesc->natts);
+
+	if (attnum > heap_fixed_prefix(tupleDesc))
+	{
+		for (i = 0; i < ntuples; i++)
+			values[i] = heap_getattr(&tuples[i], attnum, tupleDesc, &isnull[i]);
+		return;
+	}
+
+	thisatt = tupleDesc->attrs[attnum - 1];
+	for (i = 0; i < ntuples; i++)
+	{
+		HeapTupleHeader tup = tuples[i].t_data;
+
+		if (attnum > HeapTupleHeaderGetNatts(tup) ||
+			(HeapTupleHasNulls(&tuples[i]) &&
+			 !heap_prefix_notnull(tup->t_bits, attnum)))
+		{
+			values[i] = heap_getattr(&tuples[i], attnum, tupleDesc, &isnull[i]);
+			continue;
+		}
+
+		values[i] = fetchatt(thisatt,
+							 (char *) tup + tup->t_hoff + thisatt->attcacheoff);
+		isnull[i] = false;
+	}
+}
+
 /*
  *		heap_deformtuple
  *
@@ -1118,11 +1240,19 @@ slot_deform_tuple(TupleTableSlot *slot, int natts)
 	bool		hasnulls = HeapTupleHasNulls(tuple);
 	Form_pg_attribute *att = tupleDesc->attrs;
 	int			attnum;
+	int			nfixed;			/* atts at a fixed offset */
 	char	   *tp;				/* ptr to tuple data */
 	long		off;			/* offset in tuple data */
 	bits8	   *bp = tup->t_bits;		/* ptr to null bitmap in tuple */
 	bool		slow;			/* can we use/set attcacheoff? */
 
+	/* Use the code compiled for the descriptor, if any */
+	if (slot->tts_deform != NULL)
+	{
+		slot->tts_deform(slot, natts);
+		return;
+	}
+
 	/*
 	 * Check whether the first call for this tuple, and initialize or restore
 	 * loop state.
@@ -1143,6 +1273,24 @@ slot_deform_tuple(TupleTableSlot *slot, int natts)
 
 	tp = (char *) tup + tup->t_hoff;
 
+	/*
+	 * Fetch the attributes of the fixed-width prefix at their cached offset,
+	 * if none of them is null.  The offsets of the attributes extracted by a
+	 * previous call are still valid if slow is not set.
+	 */
+	nfixed = Min(heap_fixed_prefix(tupleDesc), natts);
+	if (!slow && attnum < nfixed &&
+		(!hasnulls || heap_prefix_notnull(bp, nfixed)))
+	{
+		for (; attnum < nfixed; attnum++)
+		{
+			values[attnum] = fetchatt(att[attnum],
+									  tp + att[attnum]->attcacheoff);
+			isnull[attnum] = false;
+		}
+		off = att[nfixed - 1]->attcacheoff + att[nfixed - 1]->attlen;
+	}
+
 	for (; attnum < natts; attnum++)
 	{
 		Form_pg_attribute thisatt = att[attnum];
@@ -1203,11 +1351,47 @@ slot_deform_tuple(TupleTableSlot *slot, int natts)
 }
 
 #ifdef PGXC
+/*
+ * Build metadata needed to extract attribute values from binary DataRows,
+ * like TupleDescGetAttInMetadata does for text ones.
+ */
+static AttInMetadata *
+datarow_recv_metadata(TupleDesc tupdesc)
+{
+	int			natts = tupdesc->natts;
+	int			i;
+	AttInMetadata *attinmeta;
+
+	attinmeta = (AttInMetadata *) palloc(sizeof(AttInMetadata));
+	attinmeta->tupdesc = tupdesc;
+	attinmeta->attinfuncs = (FmgrInfo *) palloc0(natts * sizeof(FmgrInfo));
+	attinmeta->attioparams = (Oid *) palloc0(natts * sizeof(Oid));
+	attinmeta->atttypmods = (int32 *) palloc0(natts * sizeof(int32));
+
+	for (i = 0; i < natts; i++)
+	{
+		/* Ignore dropped attributes */
+		if (!tupdesc->attrs[i]->attisdropped)
+		{
+			Oid			atttypeid = tupdesc->attrs[i]->atttypid;
+			Oid			attrecvfuncid;
+
+			getTypeBinaryInputInfo(atttypeid, &attrecvfuncid,
+								   &attinmeta->attioparams[i]);
+			fmgr_info(attrecvfuncid, &attinmeta->attinfuncs[i]);
+			attinmeta->atttypmods[i] = tupdesc->attrs[i]->atttypmod;
+		}
+	}
+	return attinmeta;
+}
+
 /*
  * slot_deform_datarow
  * 		Extract data from the DataRow message into Datum/isnull arrays.
  * 		We always extract all atributes, as specified in tts_tupleDescriptor,
  * 		because there is no easy way to find random attribute in the DataRow.
+ * 		Values are converted with the input or the receive functions, according
+ * 		to the format of the DataRow, see DATAROW_FLAGS.
  */
 static void
 slot_deform_datarow(TupleTableSlot *slot)
@@ -1216,8 +1400,10 @@ slot_deform_datarow(TupleTableSlot *slot)
 	int i;
 	int 		col_count;
 	char	   *cur = slot->tts_datarow->msg;
+	char	   *rawdata = NULL;
 	StringInfo  buffer;
 	uint16		n16;
+	uint16		flags;
 	uint32		n32;
 	MemoryContext oldcontext;
 
@@ -1233,13 +1419,44 @@ slot_deform_datarow(TupleTableSlot *slot)
 	memcpy(&n16, cur, 2);
 	cur += 2;
 	col_count = ntohs(n16);
+	flags = col_count & DATAROW_FLAGS;
+	col_count &= ~DATAROW_FLAGS;
 
 	if (col_count != attnum)
 		ereport(ERROR,
 				(errcode(ERRCODE_DATA_CORRUPTED),
 				 errmsg("Tuple does not match the descriptor")));
 
-	if (slot->tts_attinmeta == NULL)
+	if (flags & DATAROW_COMPRESSED)
+	{
+		int32		rawlen;
+
+		memcpy(&n32, cur, 4);
+		cur += 4;
+		rawlen = ntohl(n32);
+		rawdata = palloc(rawlen);
+		if (pglz_decompress(cur, slot->tts_datarow->msglen - 6, rawdata,
+							rawlen) != rawlen)
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_CORRUPTED),
+					 errmsg("compressed data row is corrupted")));
+		cur = rawdata;
+	}
+
+	if (flags & DATAROW_BINARY)
+	{
+		if (slot->tts_attrecvmeta == NULL)
+		{
+			/*
+			 * Ensure info about receive functions is available as long as
+			 * slot lives
+			 */
+			oldcontext = MemoryContextSwitchTo(slot->tts_mcxt);
+			slot->tts_attrecvmeta = datarow_recv_metadata(slot->tts_tupleDescriptor);
+			MemoryContextSwitchTo(oldcontext);
+		}
+	}
+	else if (slot->tts_attinmeta == NULL)
 	{
 		/*
 		 * Ensure info about input functions is available as long as slot lives
@@ -1284,10 +1501,24 @@ slot_deform_datarow(TupleTableSlot *slot)
 			appendBinaryStringInfo(buffer, cur, len);
 			cur += len;
 
-			slot->tts_values[i] = InputFunctionCall(slot->tts_attinmeta->attinfuncs + i,
-													buffer->data,
-													slot->tts_attinmeta->attioparams[i],
-													slot->tts_attinmeta->atttypmods[i]);
+			if (flags & DATAROW_BINARY)
+			{
+				slot->tts_values[i] = ReceiveFunctionCall(slot->tts_attrecvmeta->attinfuncs + i,
+														  buffer,
+														  slot->tts_attrecvmeta->attioparams[i],
+														  slot->tts_attrecvmeta->atttypmods[i]);
+				/* Trouble if it didn't eat the whole buffer */
+				if (buffer->cursor != buffer->len)
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							 errmsg("incorrect binary data format in data row column %d",
+									i + 1)));
+			}
+			else
+				slot->tts_values[i] = InputFunctionCall(slot->tts_attinmeta->attinfuncs + i,
+														buffer->data,
+														slot->tts_attinmeta->attioparams[i],
+														slot->tts_attinmeta->atttypmods[i]);
 			slot->tts_isnull[i] = false;
 
 			resetStringInfo(buffer);
@@ -1335,6 +1566,8 @@ slot_deform_datarow(TupleTableSlot *slot)
 	}
 	pfree(buffer->data);
 	pfree(buffer);
+	if (rawdata)
+		pfree(rawdata);
 
 	slot->tts_nvalid = attnum;
 
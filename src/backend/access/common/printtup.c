@@ -70,6 +70,9 @@ typedef struct
 	TupleDesc	attrinfo;		/* The attr info we are set up for */
 	int			nattrs;
 	PrinttupAttrInfo *myinfo;	/* Cached info about each attr */
+#ifdef PGXC
+	bool		allbinary;		/* all attrs are in binary format */
+#endif
 	MemoryContext tmpcontext;	/* Memory context for per-row workspace */
 } DR_printtup;
 
@@ -97,6 +100,9 @@ printtup_create_DR(CommandDest dest)
 	self->attrinfo = NULL;
 	self->nattrs = 0;
 	self->myinfo = NULL;
+#ifdef PGXC
+	self->allbinary = false;
+#endif
 	self->tmpcontext = NULL;
 
 	return (DestReceiver *) self;
@@ -284,8 +290,14 @@ printtup_prepare_info(DR_printtup *myState, TupleDesc typeinfo, int numAttrs)
 
 	myState->attrinfo = typeinfo;
 	myState->nattrs = numAttrs;
+#ifdef PGXC
+	myState->allbinary = false;
+#endif
 	if (numAttrs <= 0)
 		return;
+#ifdef PGXC
+	myState->allbinary = true;
+#endif
 
 	myState->myinfo = (PrinttupAttrInfo *)
 		palloc0(numAttrs * sizeof(PrinttupAttrInfo));
@@ -296,6 +308,10 @@ printtup_prepare_info(DR_printtup *myState, TupleDesc typeinfo, int numAttrs)
 		int16		format = (formats ? formats[i] : 0);
 
 		thisState->format = format;
+#ifdef PGXC
+		if (format != 1)
+			myState->allbinary = false;
+#endif
 		if (format == 0)
 		{
 			getTypeOutputInfo(typeinfo->attrs[i]->atttypid,
@@ -335,9 +351,12 @@ printtup(TupleTableSlot *slot, DestReceiver *self)
 	/*
 	 * If we are having DataRow-based tuple we do not have to encode attribute
 	 * values, just send over the DataRow message as we received it from the
-	 * Datanode
+	 * Datanode. Binary or compressed DataRows are understood only by cluster
+	 * nodes, for other clients the values are encoded as usual.
 	 */
-	if (slot->tts_datarow)
+	if (slot->tts_datarow &&
+			(DataRowIsPlain(slot->tts_datarow) ||
+			 IsConnFromCoord() || IsConnFromDatanode()))
 	{
 		pq_putmessage('D', slot->tts_datarow->msg, slot->tts_datarow->msglen);
 		return;
@@ -359,6 +378,16 @@ printtup(TupleTableSlot *slot, DestReceiver *self)
 	 */
 	pq_beginmessage(&buf, 'D');
 
+#ifdef PGXC
+	/*
+	 * Cluster nodes request all the values in binary format if they can
+	 * decode them, mark such rows as binary DataRows, since they may get
+	 * text rows forwarded as is, see above.
+	 */
+	if (myState->allbinary && (IsConnFromCoord() || IsConnFromDatanode()))
+		pq_sendint(&buf, natts | DATAROW_BINARY, 2);
+	else
+#endif
 	pq_sendint(&buf, natts, 2);
 
 	/*
@@ -69,6 +69,16 @@ static relopt_bool boolRelOpts[] =
 		},
 		false
 	},
+#ifdef XCP
+	{
+		{
+			"result_cache",
+			"Keep the results of the queries reading the table in the result cache of the Coordinators",
+			RELOPT_KIND_HEAP
+		},
+		false
+	},
+#endif
 	{
 		{
 			"fastupdate",
@@ -77,6 +87,14 @@ static relopt_bool boolRelOpts[] =
 		},
 		true
 	},
+	{
+		{
+			"autosummarize",
+			"Enables automatic summarization on this BRIN index",
+			RELOPT_KIND_BRIN
+		},
+		false
+	},
 	{
 		{
 			"security_barrier",
@@ -1225,7 +1243,11 @@ default_reloptions(Datum reloptions, bool validate, relopt_kind kind)
 		{"autovacuum_analyze_scale_factor", RELOPT_TYPE_REAL,
 		offsetof(StdRdOptions, autovacuum) +offsetof(AutoVacOpts, analyze_scale_factor)},
 		{"user_catalog_table", RELOPT_TYPE_BOOL,
-		offsetof(StdRdOptions, user_catalog_table)}
+		offsetof(StdRdOptions, user_catalog_table)},
+#ifdef XCP
+		{"result_cache", RELOPT_TYPE_BOOL,
+		offsetof(StdRdOptions, result_cache)}
+#endif
 	};
 
 	options = parseRelOptions(reloptions, validate, kind, &numoptions);
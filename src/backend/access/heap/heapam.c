@@ -85,7 +85,9 @@ static HeapScanDesc heap_beginscan_internal(Relation relation,
 						int nkeys, ScanKey key,
 					  bool allow_strat, bool allow_sync, bool allow_pagemode,
 						bool is_bitmapscan, bool is_samplescan,
-						bool temp_snap);
+						bool temp_snap,
+						ParallelHeapScanDesc parallel_scan);
+static BlockNumber heap_parallelscan_nextpage(HeapScanDesc scan);
 static HeapTuple heap_prepare_insert(Relation relation, HeapTuple tup,
 					TransactionId xid, CommandId cid, int options);
 static XLogRecPtr log_heap_update(Relation reln, Buffer oldbuf,
@@ -226,7 +228,10 @@ initscan(HeapScanDesc scan, ScanKey key, bool is_rescan)
 	 * results for a non-MVCC snapshot, the caller must hold some higher-level
 	 * lock that ensures the interesting tuple(s) won't change.)
 	 */
-	scan->rs_nblocks = RelationGetNumberOfBlocks(scan->rs_rd);
+	if (scan->rs_parallel != NULL)
+		scan->rs_nblocks = scan->rs_parallel->phs_nblocks;
+	else
+		scan->rs_nblocks = RelationGetNumberOfBlocks(scan->rs_rd);
 
 	/*
 	 * If the table is large relative to NBuffers, use a bulk-read access
@@ -248,6 +253,10 @@ initscan(HeapScanDesc scan, ScanKey key, bool is_rescan)
 	else
 		allow_strat = allow_sync = false;
 
+	/* The participants of a parallel scan take the pages in order */
+	if (scan->rs_parallel != NULL)
+		allow_sync = false;
+
 	if (allow_strat)
 	{
 		if (scan->rs_strategy == NULL)
@@ -282,6 +291,8 @@ initscan(HeapScanDesc scan, ScanKey key, bool is_rescan)
 
 	scan->rs_initblock = 0;
 	scan->rs_numblocks = InvalidBlockNumber;
+	scan->rs_prefetch_pos = 0;
+	scan->rs_prefetch_distance = 0;
 	scan->rs_inited = false;
 	scan->rs_ctup.t_data = NULL;
 	ItemPointerSetInvalid(&scan->rs_ctup.t_self);
@@ -313,6 +324,45 @@ heap_setscanlimits(HeapScanDesc scan, BlockNumber startBlk, BlockNumber numBlks)
 	scan->rs_numblocks = numBlks;
 }
 
+/*
+ * heap_readahead - prefetch the pages a sequential scan reads next
+ *
+ * The kernel's own read-ahead only sees one read at a time, so the scan
+ * keeps up to target_prefetch_pages of the following pages requested.  The
+ * positions are counted from rs_startblock, since a synchronized scan wraps
+ * around the end of the relation.  Sample and parallel scans do not read
+ * the pages in order, so they are left alone.
+ */
+static void
+heap_readahead(HeapScanDesc scan, BlockNumber page)
+{
+	BlockNumber pos;
+	BlockNumber end;
+
+	if (target_prefetch_pages <= 0 || scan->rs_samplescan ||
+		scan->rs_parallel != NULL)
+		return;
+
+	end = scan->rs_nblocks;
+	if (scan->rs_numblocks != InvalidBlockNumber)
+		end = Min(end, scan->rs_numblocks);
+
+	pos = (page + scan->rs_nblocks - scan->rs_startblock) % scan->rs_nblocks;
+	if (scan->rs_prefetch_pos <= pos)
+		scan->rs_prefetch_pos = pos + 1;
+
+	scan->rs_prefetch_distance = PrefetchDistance(scan->rs_prefetch_distance);
+	end = Min(end, pos + 1 + scan->rs_prefetch_distance);
+
+	while (scan->rs_prefetch_pos < end)
+	{
+		PrefetchBuffer(scan->rs_rd, MAIN_FORKNUM,
+					   (scan->rs_startblock + scan->rs_prefetch_pos) %
+					   scan->rs_nblocks);
+		scan->rs_prefetch_pos++;
+	}
+}
+
 /*
  * heapgetpage - subroutine for heapgettup()
  *
@@ -348,6 +398,9 @@ heapgetpage(HeapScanDesc scan, BlockNumber page)
 	 */
 	CHECK_FOR_INTERRUPTS();
 
+	/* get the following pages on their way */
+	heap_readahead(scan, page);
+
 	/* read page using selected strategy */
 	scan->rs_cbuf = ReadBufferExtended(scan->rs_rd, MAIN_FORKNUM, page,
 									   RBM_NORMAL, scan->rs_strategy);
@@ -486,7 +539,17 @@ heapgettup(HeapScanDesc scan,
 				tuple->t_data = NULL;
 				return;
 			}
-			page = scan->rs_startblock; /* first page */
+			if (scan->rs_parallel != NULL)
+			{
+				page = heap_parallelscan_nextpage(scan);
+				if (page == InvalidBlockNumber)
+				{
+					tuple->t_data = NULL;
+					return;
+				}
+			}
+			else
+				page = scan->rs_startblock; /* first page */
 			heapgetpage(scan, page);
 			lineoff = FirstOffsetNumber;		/* first offnum */
 			scan->rs_inited = true;
@@ -521,6 +584,9 @@ heapgettup(HeapScanDesc scan,
 				return;
 			}
 
+			/* A parallel scan only moves forward */
+			Assert(scan->rs_parallel == NULL);
+
 			/*
 			 * Disable reporting to syncscan logic in a backwards scan; it's
 			 * not very likely anyone else is doing the same thing at the same
@@ -659,6 +725,11 @@ heapgettup(HeapScanDesc scan,
 				page = scan->rs_nblocks;
 			page--;
 		}
+		else if (scan->rs_parallel != NULL)
+		{
+			page = heap_parallelscan_nextpage(scan);
+			finished = (page == InvalidBlockNumber);
+		}
 		else
 		{
 			page++;
@@ -763,7 +834,17 @@ heapgettup_pagemode(HeapScanDesc scan,
 				tuple->t_data = NULL;
 				return;
 			}
-			page = scan->rs_startblock; /* first page */
+			if (scan->rs_parallel != NULL)
+			{
+				page = heap_parallelscan_nextpage(scan);
+				if (page == InvalidBlockNumber)
+				{
+					tuple->t_data = NULL;
+					return;
+				}
+			}
+			else
+				page = scan->rs_startblock; /* first page */
 			heapgetpage(scan, page);
 			lineindex = 0;
 			scan->rs_inited = true;
@@ -795,6 +876,9 @@ heapgettup_pagemode(HeapScanDesc scan,
 				return;
 			}
 
+			/* A parallel scan only moves forward */
+			Assert(scan->rs_parallel == NULL);
+
 			/*
 			 * Disable reporting to syncscan logic in a backwards scan; it's
 			 * not very likely anyone else is doing the same thing at the same
@@ -922,6 +1006,11 @@ heapgettup_pagemode(HeapScanDesc scan,
 				page = scan->rs_nblocks;
 			page--;
 		}
+		else if (scan->rs_parallel != NULL)
+		{
+			page = heap_parallelscan_nextpage(scan);
+			finished = (page == InvalidBlockNumber);
+		}
 		else
 		{
 			page++;
@@ -1325,7 +1414,7 @@ heap_beginscan(Relation relation, Snapshot snapshot,
 			   int nkeys, ScanKey key)
 {
 	return heap_beginscan_internal(relation, snapshot, nkeys, key,
-								   true, true, true, false, false, false);
+								   true, true, true, false, false, false, NULL);
 }
 
 HeapScanDesc
@@ -1335,7 +1424,7 @@ heap_beginscan_catalog(Relation relation, int nkeys, ScanKey key)
 	Snapshot	snapshot = RegisterSnapshot(GetCatalogSnapshot(relid));
 
 	return heap_beginscan_internal(relation, snapshot, nkeys, key,
-								   true, true, true, false, false, true);
+								   true, true, true, false, false, true, NULL);
 }
 
 HeapScanDesc
@@ -1345,7 +1434,7 @@ heap_beginscan_strat(Relation relation, Snapshot snapshot,
 {
 	return heap_beginscan_internal(relation, snapshot, nkeys, key,
 								   allow_strat, allow_sync, true,
-								   false, false, false);
+								   false, false, false, NULL);
 }
 
 HeapScanDesc
@@ -1353,7 +1442,7 @@ heap_beginscan_bm(Relation relation, Snapshot snapshot,
 				  int nkeys, ScanKey key)
 {
 	return heap_beginscan_internal(relation, snapshot, nkeys, key,
-								   false, false, true, true, false, false);
+								   false, false, true, true, false, false, NULL);
 }
 
 HeapScanDesc
@@ -1363,14 +1452,15 @@ heap_beginscan_sampling(Relation relation, Snapshot snapshot,
 {
 	return heap_beginscan_internal(relation, snapshot, nkeys, key,
 								   allow_strat, false, allow_pagemode,
-								   false, true, false);
+								   false, true, false, NULL);
 }
 
 static HeapScanDesc
 heap_beginscan_internal(Relation relation, Snapshot snapshot,
 						int nkeys, ScanKey key,
 					  bool allow_strat, bool allow_sync, bool allow_pagemode,
-					  bool is_bitmapscan, bool is_samplescan, bool temp_snap)
+					  bool is_bitmapscan, bool is_samplescan, bool temp_snap,
+						ParallelHeapScanDesc parallel_scan)
 {
 	HeapScanDesc scan;
 
@@ -1397,6 +1487,7 @@ heap_beginscan_internal(Relation relation, Snapshot snapshot,
 	scan->rs_allow_strat = allow_strat;
 	scan->rs_allow_sync = allow_sync;
 	scan->rs_temp_snap = temp_snap;
+	scan->rs_parallel = parallel_scan;
 
 	/*
 	 * we can use page-at-a-time mode if it's an MVCC-safe snapshot
@@ -1493,6 +1584,74 @@ heap_endscan(HeapScanDesc scan)
 	pfree(scan);
 }
 
+/* ----------------
+ *		heap_parallelscan_estimate - size of the shared state of a parallel
+ *		scan
+ * ----------------
+ */
+Size
+heap_parallelscan_estimate(void)
+{
+	return sizeof(ParallelHeapScanDescData);
+}
+
+/* ----------------
+ *		heap_parallelscan_initialize - set up the shared state of a parallel
+ *		scan
+ *
+ * The number of blocks is fixed here, so all the participants of the scan
+ * agree on it.  The caller must set up the shared state before any of them
+ * starts.
+ * ----------------
+ */
+void
+heap_parallelscan_initialize(ParallelHeapScanDesc target, Relation relation)
+{
+	target->phs_relid = RelationGetRelid(relation);
+	target->phs_nblocks = RelationGetNumberOfBlocks(relation);
+	SpinLockInit(&target->phs_mutex);
+	target->phs_cblock = 0;
+}
+
+/* ----------------
+ *		heap_beginscan_parallel - join a parallel scan
+ *
+ * Every participant returns the tuples of the pages it took, so together
+ * they return every tuple of the relation once.  The scan only moves
+ * forward, and a rescan does not return the pages handed out before.
+ * ----------------
+ */
+HeapScanDesc
+heap_beginscan_parallel(Relation relation, Snapshot snapshot,
+						ParallelHeapScanDesc parallel_scan)
+{
+	Assert(RelationGetRelid(relation) == parallel_scan->phs_relid);
+
+	return heap_beginscan_internal(relation, snapshot, 0, NULL,
+								   true, false, true, false, false, false,
+								   parallel_scan);
+}
+
+/* ----------------
+ *		heap_parallelscan_nextpage - take the next page of a parallel scan
+ *
+ * Returns InvalidBlockNumber once all the pages are handed out.
+ * ----------------
+ */
+static BlockNumber
+heap_parallelscan_nextpage(HeapScanDesc scan)
+{
+	ParallelHeapScanDesc parallel_scan = scan->rs_parallel;
+	BlockNumber page = InvalidBlockNumber;
+
+	SpinLockAcquire(&parallel_scan->phs_mutex);
+	if (parallel_scan->phs_cblock < parallel_scan->phs_nblocks)
+		page = parallel_scan->phs_cblock++;
+	SpinLockRelease(&parallel_scan->phs_mutex);
+
+	return page;
+}
+
 /* ----------------
  *		heap_getnext	- retrieve next tuple in scan
  *
@@ -1547,6 +1706,59 @@ heap_getnext(HeapScanDesc scan, ScanDirection direction)
 	return &(scan->rs_ctup);
 }
 
+/* ----------------
+ *		heap_getnext_batch	- retrieve the next tuples of a scan
+ *
+ *		Fills tuples[] with up to maxtuples tuples following the current
+ *		one, all of them from the same page, and returns their number.
+ *		Zero means the end of the scan. Like the result of heap_getnext,
+ *		the tuples point into the buffer rs_cbuf, and are valid until the
+ *		scan is advanced again.
+ *
+ *		Only forward scans without keys in page-at-a-time mode are
+ *		supported; the visible tuples of the page are known already.
+ * ----------------
+ */
+int
+heap_getnext_batch(HeapScanDesc scan, HeapTuple tuples, int maxtuples)
+{
+	Page		dp;
+	int			ntuples;
+
+	Assert(scan->rs_pageatatime && scan->rs_nkeys == 0);
+	Assert(maxtuples > 0);
+
+	/* This moves on to the next page when the current one is done */
+	if (heap_getnext(scan, ForwardScanDirection) == NULL)
+		return 0;
+	tuples[0] = scan->rs_ctup;
+	ntuples = 1;
+
+	dp = (Page) BufferGetPage(scan->rs_cbuf);
+	while (ntuples < maxtuples && scan->rs_cindex + 1 < scan->rs_ntuples)
+	{
+		HeapTuple	tuple = &tuples[ntuples++];
+		OffsetNumber lineoff;
+		ItemId		lpp;
+
+		lineoff = scan->rs_vistuples[++scan->rs_cindex];
+		lpp = PageGetItemId(dp, lineoff);
+		Assert(ItemIdIsNormal(lpp));
+
+		tuple->t_data = (HeapTupleHeader) PageGetItem(dp, lpp);
+		tuple->t_len = ItemIdGetLength(lpp);
+		tuple->t_tableOid = scan->rs_ctup.t_tableOid;
+		ItemPointerSet(&(tuple->t_self), scan->rs_cblock, lineoff);
+
+		pgstat_count_heap_getnext(scan->rs_rd);
+	}
+
+	/* Keep the current tuple in line with rs_cindex */
+	scan->rs_ctup = tuples[ntuples - 1];
+
+	return ntuples;
+}
+
 /*
  *	heap_fetch		- retrieve tuple with given tid
  *
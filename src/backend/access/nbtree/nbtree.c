@@ -73,6 +73,7 @@ static void btvacuumscan(IndexVacuumInfo *info, IndexBulkDeleteResult *stats,
 			 BTCycleId cycleid);
 static void btvacuumpage(BTVacState *vstate, BlockNumber blkno,
 			 BlockNumber orig_blkno);
+static void _bt_prefetch_heap(IndexScanDesc scan, ScanDirection dir);
 
 
 /*
@@ -108,36 +109,42 @@ btbuild(PG_FUNCTION_ARGS)
 		elog(ERROR, "index \"%s\" already contains data",
 			 RelationGetRelationName(index));
 
-	buildstate.spool = _bt_spoolinit(heap, index, indexInfo->ii_Unique, false);
+	/* Share the scan and the sort with parallel workers, if worth it */
+	if (!_bt_parallel_build(heap, index, indexInfo,
+							&reltuples, &buildstate.indtuples))
+	{
+		buildstate.spool = _bt_spoolinit(heap, index, indexInfo->ii_Unique,
+										 false);
 
-	/*
-	 * If building a unique index, put dead tuples in a second spool to keep
-	 * them out of the uniqueness check.
-	 */
-	if (indexInfo->ii_Unique)
-		buildstate.spool2 = _bt_spoolinit(heap, index, false, true);
+		/*
+		 * If building a unique index, put dead tuples in a second spool to
+		 * keep them out of the uniqueness check.
+		 */
+		if (indexInfo->ii_Unique)
+			buildstate.spool2 = _bt_spoolinit(heap, index, false, true);
 
-	/* do the heap scan */
-	reltuples = IndexBuildHeapScan(heap, index, indexInfo, true,
-								   btbuildCallback, (void *) &buildstate);
+		/* do the heap scan */
+		reltuples = IndexBuildHeapScan(heap, index, indexInfo, true,
+									   btbuildCallback, (void *) &buildstate);
 
-	/* okay, all heap tuples are indexed */
-	if (buildstate.spool2 && !buildstate.haveDead)
-	{
-		/* spool2 turns out to be unnecessary */
-		_bt_spooldestroy(buildstate.spool2);
-		buildstate.spool2 = NULL;
-	}
+		/* okay, all heap tuples are indexed */
+		if (buildstate.spool2 && !buildstate.haveDead)
+		{
+			/* spool2 turns out to be unnecessary */
+			_bt_spooldestroy(buildstate.spool2);
+			buildstate.spool2 = NULL;
+		}
 
-	/*
-	 * Finish the build by (1) completing the sort of the spool file, (2)
-	 * inserting the sorted tuples into btree pages and (3) building the upper
-	 * levels.
-	 */
-	_bt_leafbuild(buildstate.spool, buildstate.spool2);
-	_bt_spooldestroy(buildstate.spool);
-	if (buildstate.spool2)
-		_bt_spooldestroy(buildstate.spool2);
+		/*
+		 * Finish the build by (1) completing the sort of the spool file, (2)
+		 * inserting the sorted tuples into btree pages and (3) building the
+		 * upper levels.
+		 */
+		_bt_leafbuild(buildstate.spool, buildstate.spool2);
+		_bt_spooldestroy(buildstate.spool);
+		if (buildstate.spool2)
+			_bt_spooldestroy(buildstate.spool2);
+	}
 
 #ifdef BTREE_BUILD_STATS
 	if (log_btree_build_stats)
@@ -320,9 +327,65 @@ btgettuple(PG_FUNCTION_ARGS)
 		/* ... otherwise see if we have more array keys to deal with */
 	} while (so->numArrayKeys && _bt_advance_array_keys(scan, dir));
 
+	if (res)
+		_bt_prefetch_heap(scan, dir);
+
 	PG_RETURN_BOOL(res);
 }
 
+/*
+ * _bt_prefetch_heap() -- prefetch the heap pages of the next items
+ *
+ * A plain index scan reads the heap page of each tuple it returns as it
+ * goes, waiting for every read.  The matching items of the current leaf
+ * page are all known already, so the heap pages of the ones coming next are
+ * prefetched, keeping up to target_prefetch_pages reads in flight.  Index-
+ * only scans mostly do not visit the heap, and are left alone.
+ */
+static void
+_bt_prefetch_heap(IndexScanDesc scan, ScanDirection dir)
+{
+	BTScanOpaque so = (BTScanOpaque) scan->opaque;
+	BTScanPos	pos = &so->currPos;
+	int			item;
+	int			stop;
+
+	if (target_prefetch_pages <= 0 || scan->heapRelation == NULL ||
+		scan->xs_want_itup)
+		return;
+
+	so->prefetchDistance = PrefetchDistance(so->prefetchDistance);
+
+	if (ScanDirectionIsForward(dir))
+	{
+		item = pos->itemIndex + 1;
+		if (so->prefetchItem >= item)
+			item = so->prefetchItem + 1;
+		stop = Min(pos->lastItem, pos->itemIndex + so->prefetchDistance);
+	}
+	else
+	{
+		item = pos->itemIndex - 1;
+		if (so->prefetchItem >= 0 && so->prefetchItem <= item)
+			item = so->prefetchItem - 1;
+		stop = Max(pos->firstItem, pos->itemIndex - so->prefetchDistance);
+	}
+
+	while (ScanDirectionIsForward(dir) ? item <= stop : item >= stop)
+	{
+		BlockNumber blkno = ItemPointerGetBlockNumber(&pos->items[item].heapTid);
+
+		/* Consecutive items often point into the same heap page */
+		if (blkno != so->prefetchBlock)
+		{
+			PrefetchBuffer(scan->heapRelation, MAIN_FORKNUM, blkno);
+			so->prefetchBlock = blkno;
+		}
+		so->prefetchItem = item;
+		item += ScanDirectionIsForward(dir) ? 1 : -1;
+	}
+}
+
 /*
  * btgetbitmap() -- gets all matching tuples, and adds them to a bitmap
  */
@@ -418,6 +481,10 @@ btbeginscan(PG_FUNCTION_ARGS)
 	so->killedItems = NULL;		/* until needed */
 	so->numKilled = 0;
 
+	so->prefetchDistance = 0;
+	so->prefetchItem = -1;
+	so->prefetchBlock = InvalidBlockNumber;
+
 	/*
 	 * We don't know yet whether the scan will be index-only, so we do not
 	 * allocate the tuple workspace arrays until btrescan.  However, we set up
@@ -458,6 +525,10 @@ btrescan(PG_FUNCTION_ARGS)
 	BTScanPosUnpinIfPinned(so->markPos);
 	BTScanPosInvalidate(so->markPos);
 
+	so->prefetchDistance = 0;
+	so->prefetchItem = -1;
+	so->prefetchBlock = InvalidBlockNumber;
+
 	/*
 	 * Allocate tuple workspace arrays, if needed for an index-only scan and
 	 * not already done in a previous rescan call.  To save on palloc
@@ -1196,6 +1196,9 @@ _bt_readpage(IndexScanDesc scan, ScanDirection dir, OffsetNumber offnum)
 	/* initialize tuple workspace to empty */
 	so->currPos.nextTupleOffset = 0;
 
+	/* none of the heap tuples of the new items is prefetched yet */
+	so->prefetchItem = -1;
+
 	/*
 	 * Now that the current page has been made consistent, the macro should be
 	 * good.
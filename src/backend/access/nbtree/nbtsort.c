@@ -55,6 +55,13 @@
  * This code isn't concerned about the FSM at all. The caller is responsible
  * for initializing that.
  *
+ * A large table may be indexed with the help of parallel workers (see
+ * _bt_parallel_build).  Each process sorts the tuples of its share of the
+ * heap with its own tuplesort, and the workers stream their sorted tuples
+ * to the leader through shared memory queues.  The leader merges them with
+ * its own as it loads the leaf pages, so the merge costs no extra pass over
+ * the data.
+ *
  * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
  *
@@ -67,15 +74,35 @@
 #include "postgres.h"
 
 #include "access/nbtree.h"
+#include "access/parallel.h"
+#include "access/relscan.h"
+#include "access/xact.h"
 #include "access/xlog.h"
 #include "access/xloginsert.h"
+#include "catalog/catalog.h"
+#include "catalog/index.h"
+#include "executor/nodeGather.h"
+#include "lib/binaryheap.h"
 #include "miscadmin.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
 #include "storage/smgr.h"
+#include "storage/spin.h"
 #include "tcop/tcopprot.h"
 #include "utils/rel.h"
+#include "utils/snapmgr.h"
 #include "utils/sortsupport.h"
 #include "utils/tuplesort.h"
 
+/* Keys of the parallel state, see parallel.c */
+#define BT_KEY_SHARED				UINT64CONST(1)
+#define BT_KEY_TUPLE_QUEUE			UINT64CONST(2)
+
+#define BT_TUPLE_QUEUE_SIZE			65536
+
+/* Header of a tuple sent by a worker, keeping the tuple aligned */
+#define BT_QUEUE_HEADER_SIZE		MAXIMUM_ALIGNOF
+
 
 /*
  * Status record for spooling/sorting phase.  (Note we may have two of
@@ -90,6 +117,63 @@ struct BTSpool
 	bool		isunique;
 };
 
+/*
+ * State of a parallel build shared by the leader and the workers.
+ */
+typedef struct BTShared
+{
+	Oid			heaprelid;
+	Oid			indexrelid;
+	bool		isunique;
+	int			sortmem;		/* kB of memory of the spool of a process */
+
+	/* Counts of all the processes, protected by mutex */
+	slock_t		mutex;
+	double		reltuples;
+	double		indtuples;
+	bool		brokenhotchain;
+
+	ParallelHeapScanDescData heapdesc;	/* the shared heap scan */
+} BTShared;
+
+/*
+ * Spools of a process taking part in a parallel build.
+ */
+typedef struct BTParticipantState
+{
+	BTSpool    *spool;
+	BTSpool    *spool2;			/* dead tuples of a unique index */
+	bool		haveDead;
+	double		indtuples;
+} BTParticipantState;
+
+/*
+ * Sorted tuples to load into the btree: those of a spool of this process,
+ * or those a worker sends through its queue.
+ */
+typedef struct BTSortSource
+{
+	BTSpool    *spool;
+	shm_mq_handle *queue;
+	bool		isdead;			/* is the current tuple dead? */
+	IndexTuple	itup;			/* current tuple, NULL once exhausted */
+	bool		should_free;	/* must itup be freed? */
+} BTSortSource;
+
+/*
+ * Status record for the merge of several sources.
+ */
+typedef struct BTMergeState
+{
+	TupleDesc	tupdesc;
+	int			keysz;
+	SortSupport sortKeys;
+	BTSortSource *sources;
+	int			nsources;
+	binaryheap *heap;			/* sources not exhausted, by current tuple */
+	int			current;		/* source of the tuple returned last */
+} BTMergeState;
+
 /*
  * Status record for a btree page being built.  We have one of these
  * for each active tree level.
@@ -136,8 +220,28 @@ static void _bt_sortaddtup(Page page, Size itemsize,
 static void _bt_buildadd(BTWriteState *wstate, BTPageState *state,
 			 IndexTuple itup);
 static void _bt_uppershutdown(BTWriteState *wstate, BTPageState *state);
-static void _bt_load(BTWriteState *wstate,
-		 BTSpool *btspool, BTSpool *btspool2);
+static void _bt_load(BTWriteState *wstate, BTSortSource *sources,
+		 int nsources, bool checkunique);
+static BTSpool *_bt_spoolcreate(Relation heap, Relation index,
+				bool isunique, int sortmem);
+static void _bt_writeindex(Relation heap, Relation index,
+			   BTSortSource *sources, int nsources, bool checkunique);
+static void _bt_merge_begin(BTMergeState *merge, Relation index,
+				BTSortSource *sources, int nsources);
+static IndexTuple _bt_merge_next(BTMergeState *merge, bool *isdead);
+static void _bt_merge_end(BTMergeState *merge);
+static int _bt_merge_keycmp(BTMergeState *merge, IndexTuple itup1,
+				 IndexTuple itup2, bool *hasnull);
+static int	_bt_merge_compare(Datum a, Datum b, void *arg);
+static bool _bt_source_next(BTSortSource *source);
+static int	_bt_parallel_workers(Relation heap, IndexInfo *indexInfo);
+static void _bt_parallel_scan_and_sort(BTShared *btshared, Relation heap,
+						   Relation index, IndexInfo *indexInfo,
+						   BTParticipantState *pstate);
+static void _bt_parallel_callback(Relation index, HeapTuple htup,
+					  Datum *values, bool *isnull,
+					  bool tupleIsAlive, void *state);
+static void _bt_parallel_main(dsm_segment *seg, shm_toc *toc);
 
 
 /*
@@ -151,13 +255,6 @@ static void _bt_load(BTWriteState *wstate,
 BTSpool *
 _bt_spoolinit(Relation heap, Relation index, bool isunique, bool isdead)
 {
-	BTSpool    *btspool = (BTSpool *) palloc0(sizeof(BTSpool));
-	int			btKbytes;
-
-	btspool->heap = heap;
-	btspool->index = index;
-	btspool->isunique = isunique;
-
 	/*
 	 * We size the sort area as maintenance_work_mem rather than work_mem to
 	 * speed index creation.  This should be OK since a single backend can't
@@ -166,9 +263,23 @@ _bt_spoolinit(Relation heap, Relation index, bool isunique, bool isdead)
 	 * second one (for dead tuples) won't get very full, so we give it only
 	 * work_mem.
 	 */
-	btKbytes = isdead ? work_mem : maintenance_work_mem;
+	return _bt_spoolcreate(heap, index, isunique,
+						   isdead ? work_mem : maintenance_work_mem);
+}
+
+/*
+ * create a spool sorting in the given kB of memory
+ */
+static BTSpool *
+_bt_spoolcreate(Relation heap, Relation index, bool isunique, int sortmem)
+{
+	BTSpool    *btspool = (BTSpool *) palloc0(sizeof(BTSpool));
+
+	btspool->heap = heap;
+	btspool->index = index;
+	btspool->isunique = isunique;
 	btspool->sortstate = tuplesort_begin_index_btree(heap, index, isunique,
-													 btKbytes, false);
+													 sortmem, false);
 
 	return btspool;
 }
@@ -200,7 +311,8 @@ _bt_spool(BTSpool *btspool, ItemPointer self, Datum *values, bool *isnull)
 void
 _bt_leafbuild(BTSpool *btspool, BTSpool *btspool2)
 {
-	BTWriteState wstate;
+	BTSortSource sources[2];
+	int			nsources = 0;
 
 #ifdef BTREE_BUILD_STATS
 	if (log_btree_build_stats)
@@ -214,8 +326,28 @@ _bt_leafbuild(BTSpool *btspool, BTSpool *btspool2)
 	if (btspool2)
 		tuplesort_performsort(btspool2->sortstate);
 
-	wstate.heap = btspool->heap;
-	wstate.index = btspool->index;
+	memset(sources, 0, sizeof(sources));
+	sources[nsources++].spool = btspool;
+	if (btspool2)
+	{
+		sources[nsources].spool = btspool2;
+		sources[nsources++].isdead = true;
+	}
+
+	_bt_writeindex(btspool->heap, btspool->index, sources, nsources, false);
+}
+
+/*
+ * load the sorted tuples of the sources into a new btree
+ */
+static void
+_bt_writeindex(Relation heap, Relation index,
+			   BTSortSource *sources, int nsources, bool checkunique)
+{
+	BTWriteState wstate;
+
+	wstate.heap = heap;
+	wstate.index = index;
 
 	/*
 	 * We need to log index creation in WAL iff WAL archiving/streaming is
@@ -228,7 +360,7 @@ _bt_leafbuild(BTSpool *btspool, BTSpool *btspool2)
 	wstate.btws_pages_written = 0;
 	wstate.btws_zeropage = NULL;	/* until needed */
 
-	_bt_load(&wstate, btspool, btspool2);
+	_bt_load(&wstate, sources, nsources, checkunique);
 }
 
 
@@ -670,131 +802,83 @@ _bt_uppershutdown(BTWriteState *wstate, BTPageState *state)
 }
 
 /*
- * Read tuples in correct sort order from tuplesort, and load them into
+ * Read tuples in correct sort order from the sources, and load them into
  * btree leaves.
+ *
+ * If checkunique is set, the tuples of different sources were not compared
+ * with each other by any sort, so the live tuples are checked for duplicates
+ * here.
  */
 static void
-_bt_load(BTWriteState *wstate, BTSpool *btspool, BTSpool *btspool2)
+_bt_load(BTWriteState *wstate, BTSortSource *sources, int nsources,
+		 bool checkunique)
 {
 	BTPageState *state = NULL;
-	bool		merge = (btspool2 != NULL);
-	IndexTuple	itup,
-				itup2 = NULL;
-	bool		should_free,
-				should_free2,
-				load1;
-	TupleDesc	tupdes = RelationGetDescr(wstate->index);
-	int			i,
-				keysz = RelationGetNumberOfAttributes(wstate->index);
-	ScanKey		indexScanKey = NULL;
-	SortSupport sortKeys;
+	IndexTuple	itup;
+	bool		should_free;
 
-	if (merge)
+	if (nsources > 1)
 	{
+		BTMergeState merge;
+		IndexTuple	lastlive = NULL;
+		bool		isdead;
+
 		/*
-		 * Another BTSpool for dead tuples exists. Now we have to merge
-		 * btspool and btspool2.
+		 * Another BTSpool for dead tuples, or the sorted tuples of parallel
+		 * workers, exist. Now we have to merge them.
 		 */
+		_bt_merge_begin(&merge, wstate->index, sources, nsources);
 
-		/* the preparation of merge */
-		itup = tuplesort_getindextuple(btspool->sortstate,
-									   true, &should_free);
-		itup2 = tuplesort_getindextuple(btspool2->sortstate,
-										true, &should_free2);
-		indexScanKey = _bt_mkscankey_nodata(wstate->index);
-
-		/* Prepare SortSupport data for each column */
-		sortKeys = (SortSupport) palloc0(keysz * sizeof(SortSupportData));
-
-		for (i = 0; i < keysz; i++)
-		{
-			SortSupport sortKey = sortKeys + i;
-			ScanKey		scanKey = indexScanKey + i;
-			int16		strategy;
-
-			sortKey->ssup_cxt = CurrentMemoryContext;
-			sortKey->ssup_collation = scanKey->sk_collation;
-			sortKey->ssup_nulls_first =
-				(scanKey->sk_flags & SK_BT_NULLS_FIRST) != 0;
-			sortKey->ssup_attno = scanKey->sk_attno;
-			/* Abbreviation is not supported here */
-			sortKey->abbreviate = false;
-
-			AssertState(sortKey->ssup_attno != 0);
-
-			strategy = (scanKey->sk_flags & SK_BT_DESC) != 0 ?
-				BTGreaterStrategyNumber : BTLessStrategyNumber;
-
-			PrepareSortSupportFromIndexRel(wstate->index, strategy, sortKey);
-		}
-
-		_bt_freeskey(indexScanKey);
-
-		for (;;)
+		while ((itup = _bt_merge_next(&merge, &isdead)) != NULL)
 		{
-			load1 = true;		/* load BTSpool next ? */
-			if (itup2 == NULL)
-			{
-				if (itup == NULL)
-					break;
-			}
-			else if (itup != NULL)
+			if (checkunique && !isdead)
 			{
-				for (i = 1; i <= keysz; i++)
+				bool		hasnull;
+
+				if (lastlive != NULL &&
+					_bt_merge_keycmp(&merge, lastlive, itup, &hasnull) == 0 &&
+					!hasnull)
 				{
-					SortSupport entry;
-					Datum		attrDatum1,
-								attrDatum2;
-					bool		isNull1,
-								isNull2;
-					int32		compare;
-
-					entry = sortKeys + i - 1;
-					attrDatum1 = index_getattr(itup, i, tupdes, &isNull1);
-					attrDatum2 = index_getattr(itup2, i, tupdes, &isNull2);
-
-					compare = ApplySortComparator(attrDatum1, isNull1,
-												  attrDatum2, isNull2,
-												  entry);
-					if (compare > 0)
-					{
-						load1 = false;
-						break;
-					}
-					else if (compare < 0)
-						break;
+					Datum		values[INDEX_MAX_KEYS];
+					bool		isnull[INDEX_MAX_KEYS];
+					char	   *key_desc;
+
+					index_deform_tuple(itup, merge.tupdesc, values, isnull);
+					key_desc = BuildIndexValueDescription(wstate->index,
+														  values, isnull);
+
+					ereport(ERROR,
+							(errcode(ERRCODE_UNIQUE_VIOLATION),
+							 errmsg("could not create unique index \"%s\"",
+									RelationGetRelationName(wstate->index)),
+							 key_desc ? errdetail("Key %s is duplicated.", key_desc) :
+							 errdetail("Duplicate keys exist."),
+							 errtableconstraint(wstate->heap,
+								 RelationGetRelationName(wstate->index))));
 				}
+
+				if (lastlive != NULL)
+					pfree(lastlive);
+				lastlive = CopyIndexTuple(itup);
 			}
-			else
-				load1 = false;
 
 			/* When we see first tuple, create first index page */
 			if (state == NULL)
 				state = _bt_pagestate(wstate, 0);
 
-			if (load1)
-			{
-				_bt_buildadd(wstate, state, itup);
-				if (should_free)
-					pfree(itup);
-				itup = tuplesort_getindextuple(btspool->sortstate,
-											   true, &should_free);
-			}
-			else
-			{
-				_bt_buildadd(wstate, state, itup2);
-				if (should_free2)
-					pfree(itup2);
-				itup2 = tuplesort_getindextuple(btspool2->sortstate,
-												true, &should_free2);
-			}
+			_bt_buildadd(wstate, state, itup);
 		}
-		pfree(sortKeys);
+
+		if (lastlive != NULL)
+			pfree(lastlive);
+		_bt_merge_end(&merge);
 	}
 	else
 	{
+		Assert(nsources == 1 && sources[0].spool != NULL);
+
 		/* merge is unnecessary */
-		while ((itup = tuplesort_getindextuple(btspool->sortstate,
+		while ((itup = tuplesort_getindextuple(sources[0].spool->sortstate,
 											   true, &should_free)) != NULL)
 		{
 			/* When we see first tuple, create first index page */
@@ -831,3 +915,515 @@ _bt_load(BTWriteState *wstate, BTSpool *btspool, BTSpool *btspool2)
 		smgrimmedsync(wstate->index->rd_smgr, MAIN_FORKNUM);
 	}
 }
+
+/*
+ * Set up the merge of sorted sources.  The tuples of each source are in
+ * index order, and equal keys are ordered by heap TID, like tuplesort does.
+ */
+static void
+_bt_merge_begin(BTMergeState *merge, Relation index,
+				BTSortSource *sources, int nsources)
+{
+	ScanKey		indexScanKey;
+	int			i;
+
+	merge->tupdesc = RelationGetDescr(index);
+	merge->keysz = RelationGetNumberOfAttributes(index);
+	merge->sources = sources;
+	merge->nsources = nsources;
+	merge->current = -1;
+
+	indexScanKey = _bt_mkscankey_nodata(index);
+
+	/* Prepare SortSupport data for each column */
+	merge->sortKeys = (SortSupport) palloc0(merge->keysz *
+											sizeof(SortSupportData));
+
+	for (i = 0; i < merge->keysz; i++)
+	{
+		SortSupport sortKey = merge->sortKeys + i;
+		ScanKey		scanKey = indexScanKey + i;
+		int16		strategy;
+
+		sortKey->ssup_cxt = CurrentMemoryContext;
+		sortKey->ssup_collation = scanKey->sk_collation;
+		sortKey->ssup_nulls_first =
+			(scanKey->sk_flags & SK_BT_NULLS_FIRST) != 0;
+		sortKey->ssup_attno = scanKey->sk_attno;
+		/* Abbreviation is not supported here */
+		sortKey->abbreviate = false;
+
+		AssertState(sortKey->ssup_attno != 0);
+
+		strategy = (scanKey->sk_flags & SK_BT_DESC) != 0 ?
+			BTGreaterStrategyNumber : BTLessStrategyNumber;
+
+		PrepareSortSupportFromIndexRel(index, strategy, sortKey);
+	}
+
+	_bt_freeskey(indexScanKey);
+
+	/* Read the first tuple of each source, and order the sources by it */
+	merge->heap = binaryheap_allocate(nsources, _bt_merge_compare, merge);
+	for (i = 0; i < nsources; i++)
+	{
+		if (_bt_source_next(&sources[i]))
+			binaryheap_add_unordered(merge->heap, Int32GetDatum(i));
+	}
+	binaryheap_build(merge->heap);
+}
+
+/*
+ * Return the next tuple of the merge, or NULL once all the sources are
+ * exhausted.  The tuple is valid until the next call.
+ */
+static IndexTuple
+_bt_merge_next(BTMergeState *merge, bool *isdead)
+{
+	BTSortSource *source;
+
+	/* Move past the tuple returned last */
+	if (merge->current >= 0)
+	{
+		if (_bt_source_next(&merge->sources[merge->current]))
+			binaryheap_replace_first(merge->heap,
+									 Int32GetDatum(merge->current));
+		else
+			(void) binaryheap_remove_first(merge->heap);
+	}
+
+	if (binaryheap_empty(merge->heap))
+	{
+		merge->current = -1;
+		return NULL;
+	}
+
+	merge->current = DatumGetInt32(binaryheap_first(merge->heap));
+	source = &merge->sources[merge->current];
+	*isdead = source->isdead;
+
+	return source->itup;
+}
+
+static void
+_bt_merge_end(BTMergeState *merge)
+{
+	binaryheap_free(merge->heap);
+	pfree(merge->sortKeys);
+}
+
+/*
+ * Compare the keys of two index tuples.  *hasnull is set if they are equal
+ * and any of the keys is NULL.
+ */
+static int
+_bt_merge_keycmp(BTMergeState *merge, IndexTuple itup1, IndexTuple itup2,
+				 bool *hasnull)
+{
+	int			i;
+
+	*hasnull = false;
+	for (i = 1; i <= merge->keysz; i++)
+	{
+		SortSupport entry = merge->sortKeys + i - 1;
+		Datum		attrDatum1,
+					attrDatum2;
+		bool		isNull1,
+					isNull2;
+		int32		compare;
+
+		attrDatum1 = index_getattr(itup1, i, merge->tupdesc, &isNull1);
+		attrDatum2 = index_getattr(itup2, i, merge->tupdesc, &isNull2);
+
+		compare = ApplySortComparator(attrDatum1, isNull1,
+									  attrDatum2, isNull2,
+									  entry);
+		if (compare != 0)
+			return compare;
+		if (isNull1)
+			*hasnull = true;
+	}
+
+	return 0;
+}
+
+/*
+ * binaryheap comparator of the sources, by their current tuple.  The
+ * binaryheap keeps the greatest element first, so the order is reversed.
+ */
+static int
+_bt_merge_compare(Datum a, Datum b, void *arg)
+{
+	BTMergeState *merge = (BTMergeState *) arg;
+	IndexTuple	itup1 = merge->sources[DatumGetInt32(a)].itup;
+	IndexTuple	itup2 = merge->sources[DatumGetInt32(b)].itup;
+	bool		hasnull;
+	int			compare;
+
+	compare = _bt_merge_keycmp(merge, itup1, itup2, &hasnull);
+	if (compare == 0)
+		compare = ItemPointerCompare(&itup1->t_tid, &itup2->t_tid);
+
+	return -compare;
+}
+
+/*
+ * Read the next tuple of a source into source->itup.  Returns false once
+ * the source is exhausted.
+ */
+static bool
+_bt_source_next(BTSortSource *source)
+{
+	if (source->itup != NULL && source->should_free)
+		pfree(source->itup);
+	source->itup = NULL;
+	source->should_free = false;
+
+	if (source->spool != NULL)
+	{
+		source->itup = tuplesort_getindextuple(source->spool->sortstate,
+											   true, &source->should_free);
+	}
+	else
+	{
+		Size		nbytes;
+		void	   *data;
+
+		/*
+		 * The message stays in the queue until the next one is read.  The
+		 * queue is detached once the worker sent all its tuples, or failed;
+		 * the leader learns which when it waits for the workers.
+		 */
+		if (shm_mq_receive(source->queue, &nbytes, &data, false) ==
+			SHM_MQ_SUCCESS)
+		{
+			Assert(nbytes > BT_QUEUE_HEADER_SIZE);
+			source->isdead = ((char *) data)[0] != 0;
+			source->itup = (IndexTuple) ((char *) data + BT_QUEUE_HEADER_SIZE);
+		}
+	}
+
+	return source->itup != NULL;
+}
+
+
+/*
+ * Parallel build.
+ */
+
+/*
+ * Number of workers to build the index with, 0 if it is not built in
+ * parallel.  It grows with the size of the table like the number of workers
+ * running a plan fragment, see ExecParallelFragment.
+ */
+static int
+_bt_parallel_workers(Relation heap, IndexInfo *indexInfo)
+{
+	BlockNumber nblocks;
+	double		threshold;
+	int			nworkers;
+
+	/*
+	 * The processes must all see the same tuples, so a concurrent build,
+	 * which takes its own MVCC snapshot, is done alone.  The catalogs and the
+	 * temporary tables can not be scanned by the workers.
+	 */
+	if (max_parallel_degree <= 0 || !IsUnderPostmaster ||
+		IsBootstrapProcessingMode() || IsInParallelMode() ||
+		IsolationIsSerializable() || indexInfo->ii_Concurrent ||
+		IsSystemRelation(heap) || RelationUsesLocalBuffers(heap))
+		return 0;
+
+	nblocks = RelationGetNumberOfBlocks(heap);
+	threshold = Max(min_parallel_relation_size, 1);
+	if (nblocks < threshold)
+		return 0;
+	nworkers = 1;
+	while (nworkers < max_parallel_degree && nblocks >= threshold * 3)
+	{
+		threshold *= 3;
+		nworkers++;
+	}
+
+	return nworkers;
+}
+
+/*
+ * Build the index with the help of parallel workers, if worth it.  Returns
+ * false, doing nothing, otherwise.
+ *
+ * The processes share the scan of the heap, each sorting the index tuples of
+ * the pages it takes in its own spools.  The workers then send their sorted
+ * tuples to the leader, which merges them with its own while loading the
+ * btree, and checks the uniqueness across processes.
+ */
+bool
+_bt_parallel_build(Relation heap, Relation index, IndexInfo *indexInfo,
+				   double *reltuples, double *indtuples)
+{
+	int			nworkers;
+	ParallelContext *pcxt;
+	BTShared   *btshared;
+	BTParticipantState pstate;
+	BTSortSource *sources;
+	int			nsources = 0;
+	char	   *queue_space;
+	bool		snapshot_pushed = false;
+	int			i;
+
+	nworkers = _bt_parallel_workers(heap, indexInfo);
+	if (nworkers == 0)
+		return false;
+
+	/*
+	 * The heap is scanned with SnapshotAny, but the workers take the
+	 * snapshots of the leader, so there must be one.
+	 */
+	if (!ActiveSnapshotSet())
+	{
+		PushActiveSnapshot(GetTransactionSnapshot());
+		snapshot_pushed = true;
+	}
+
+	EnterParallelMode();
+	pcxt = CreateParallelContext(_bt_parallel_main, nworkers);
+
+	shm_toc_estimate_chunk(&pcxt->estimator, sizeof(BTShared));
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   mul_size(BT_TUPLE_QUEUE_SIZE, pcxt->nworkers));
+	shm_toc_estimate_keys(&pcxt->estimator, 2);
+
+	InitializeParallelDSM(pcxt);
+	if (snapshot_pushed)
+		PopActiveSnapshot();
+
+	/* The processes share maintenance_work_mem */
+	btshared = (BTShared *) shm_toc_allocate(pcxt->toc, sizeof(BTShared));
+	btshared->heaprelid = RelationGetRelid(heap);
+	btshared->indexrelid = RelationGetRelid(index);
+	btshared->isunique = indexInfo->ii_Unique;
+	btshared->sortmem = Max(maintenance_work_mem / (nworkers + 1), 64);
+	SpinLockInit(&btshared->mutex);
+	btshared->reltuples = 0;
+	btshared->indtuples = 0;
+	btshared->brokenhotchain = false;
+	heap_parallelscan_initialize(&btshared->heapdesc, heap);
+	shm_toc_insert(pcxt->toc, BT_KEY_SHARED, btshared);
+
+	sources = (BTSortSource *)
+		palloc0((pcxt->nworkers + 2) * sizeof(BTSortSource));
+
+	/* There are no workers if the shared memory could not be allocated */
+	if (pcxt->nworkers > 0)
+	{
+		shm_mq_handle **queues;
+
+		queue_space = shm_toc_allocate(pcxt->toc,
+									   mul_size(BT_TUPLE_QUEUE_SIZE,
+												pcxt->nworkers));
+		shm_toc_insert(pcxt->toc, BT_KEY_TUPLE_QUEUE, queue_space);
+
+		queues = (shm_mq_handle **)
+			palloc(pcxt->nworkers * sizeof(shm_mq_handle *));
+		for (i = 0; i < pcxt->nworkers; i++)
+		{
+			shm_mq	   *mq;
+
+			mq = shm_mq_create(queue_space + i * BT_TUPLE_QUEUE_SIZE,
+							   BT_TUPLE_QUEUE_SIZE);
+			shm_mq_set_receiver(mq, MyProc);
+			queues[i] = shm_mq_attach(mq, pcxt->seg, NULL);
+		}
+
+		LaunchParallelWorkers(pcxt);
+
+		/*
+		 * Only read the queues of the workers registered. The others take no
+		 * page of the heap.
+		 */
+		for (i = 0; i < pcxt->nworkers; i++)
+		{
+			if (pcxt->worker[i].bgwhandle == NULL)
+				continue;
+			shm_mq_set_handle(queues[i], pcxt->worker[i].bgwhandle);
+			sources[nsources++].queue = queues[i];
+		}
+	}
+
+	elog(DEBUG1, "building index \"%s\" with %d parallel workers",
+		 RelationGetRelationName(index), nsources);
+
+	/* Take our share of the heap meanwhile */
+	_bt_parallel_scan_and_sort(btshared, heap, index, indexInfo, &pstate);
+
+	sources[nsources++].spool = pstate.spool;
+	if (pstate.spool2 != NULL)
+	{
+		sources[nsources].spool = pstate.spool2;
+		sources[nsources++].isdead = true;
+	}
+
+	_bt_writeindex(heap, index, sources, nsources,
+				   indexInfo->ii_Unique && nsources > 1);
+
+	/* Report the errors of the workers, if any, before trusting the counts */
+	WaitForParallelWorkersToFinish(pcxt);
+
+	*reltuples = btshared->reltuples;
+	*indtuples = btshared->indtuples;
+	if (btshared->brokenhotchain)
+		indexInfo->ii_BrokenHotChain = true;
+
+	_bt_spooldestroy(pstate.spool);
+	if (pstate.spool2 != NULL)
+		_bt_spooldestroy(pstate.spool2);
+
+	DestroyParallelContext(pcxt);
+	ExitParallelMode();
+
+	return true;
+}
+
+/*
+ * Scan the share of the heap of this process, and sort the index tuples
+ * into its spools.  The counts go to the shared state.
+ */
+static void
+_bt_parallel_scan_and_sort(BTShared *btshared, Relation heap, Relation index,
+						   IndexInfo *indexInfo, BTParticipantState *pstate)
+{
+	double		reltuples;
+
+	pstate->spool = _bt_spoolcreate(heap, index, btshared->isunique,
+									btshared->sortmem);
+	pstate->spool2 = NULL;
+	pstate->haveDead = false;
+	pstate->indtuples = 0;
+
+	/*
+	 * As in a serial build, dead tuples of a unique index go to a second
+	 * spool to keep them out of the uniqueness check.
+	 */
+	if (btshared->isunique)
+		pstate->spool2 = _bt_spoolcreate(heap, index, false, work_mem);
+
+	reltuples = IndexBuildHeapParallelScan(heap, index, indexInfo,
+										   &btshared->heapdesc,
+										   _bt_parallel_callback,
+										   (void *) pstate);
+
+	if (pstate->spool2 != NULL && !pstate->haveDead)
+	{
+		/* spool2 turns out to be unnecessary */
+		_bt_spooldestroy(pstate->spool2);
+		pstate->spool2 = NULL;
+	}
+
+	tuplesort_performsort(pstate->spool->sortstate);
+	if (pstate->spool2 != NULL)
+		tuplesort_performsort(pstate->spool2->sortstate);
+
+	SpinLockAcquire(&btshared->mutex);
+	btshared->reltuples += reltuples;
+	btshared->indtuples += pstate->indtuples;
+	if (indexInfo->ii_BrokenHotChain)
+		btshared->brokenhotchain = true;
+	SpinLockRelease(&btshared->mutex);
+}
+
+/*
+ * Per-tuple callback from IndexBuildHeapParallelScan, see btbuildCallback
+ */
+static void
+_bt_parallel_callback(Relation index,
+					  HeapTuple htup,
+					  Datum *values,
+					  bool *isnull,
+					  bool tupleIsAlive,
+					  void *state)
+{
+	BTParticipantState *pstate = (BTParticipantState *) state;
+
+	if (tupleIsAlive || pstate->spool2 == NULL)
+		_bt_spool(pstate->spool, &htup->t_self, values, isnull);
+	else
+	{
+		/* dead tuples are put into spool2 */
+		pstate->haveDead = true;
+		_bt_spool(pstate->spool2, &htup->t_self, values, isnull);
+	}
+
+	pstate->indtuples += 1;
+}
+
+/*
+ * Main entry point of a worker.  It sorts its share of the index tuples,
+ * then sends them in order to the leader through its queue, each following
+ * a header telling whether it is dead.
+ */
+static void
+_bt_parallel_main(dsm_segment *seg, shm_toc *toc)
+{
+	BTShared   *btshared;
+	char	   *queue_space;
+	shm_mq	   *mq;
+	shm_mq_handle *queue;
+	Relation	heap;
+	Relation	index;
+	IndexInfo  *indexInfo;
+	BTParticipantState pstate;
+	BTSortSource sources[2];
+	int			nsources = 0;
+	BTMergeState merge;
+	IndexTuple	itup;
+	bool		isdead;
+	char		header[BT_QUEUE_HEADER_SIZE];
+	shm_mq_iovec iov[2];
+
+	btshared = (BTShared *) shm_toc_lookup(toc, BT_KEY_SHARED);
+	queue_space = shm_toc_lookup(toc, BT_KEY_TUPLE_QUEUE);
+	mq = (shm_mq *) (queue_space + ParallelWorkerNumber * BT_TUPLE_QUEUE_SIZE);
+	shm_mq_set_sender(mq, MyProc);
+	queue = shm_mq_attach(mq, seg, NULL);
+
+	/* The leader holds the locks until the workers are done */
+	heap = heap_open(btshared->heaprelid, NoLock);
+	index = index_open(btshared->indexrelid, NoLock);
+	indexInfo = BuildIndexInfo(index);
+
+	_bt_parallel_scan_and_sort(btshared, heap, index, indexInfo, &pstate);
+
+	memset(sources, 0, sizeof(sources));
+	sources[nsources++].spool = pstate.spool;
+	if (pstate.spool2 != NULL)
+	{
+		sources[nsources].spool = pstate.spool2;
+		sources[nsources++].isdead = true;
+	}
+
+	memset(header, 0, sizeof(header));
+	iov[0].data = header;
+	iov[0].len = BT_QUEUE_HEADER_SIZE;
+
+	_bt_merge_begin(&merge, index, sources, nsources);
+	while ((itup = _bt_merge_next(&merge, &isdead)) != NULL)
+	{
+		header[0] = isdead ? 1 : 0;
+		iov[1].data = (char *) itup;
+		iov[1].len = IndexTupleSize(itup);
+
+		/* The leader went away, it will not need the rest */
+		if (shm_mq_sendv(queue, iov, 2, false) == SHM_MQ_DETACHED)
+			break;
+	}
+	_bt_merge_end(&merge);
+
+	_bt_spooldestroy(pstate.spool);
+	if (pstate.spool2 != NULL)
+		_bt_spooldestroy(pstate.spool2);
+
+	index_close(index, NoLock);
+	heap_close(heap, NoLock);
+
+	shm_mq_detach(mq);
+}
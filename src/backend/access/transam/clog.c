@@ -46,6 +46,8 @@
 #include "access/xlogutils.h"
 #include "miscadmin.h"
 #include "pg_trace.h"
+#include "port/atomics.h"
+#include "storage/shmem.h"
 
 /*
  * Defines for CLOG page sizes.  A page is the same BLCKSZ as is used
@@ -90,6 +92,30 @@ static SlruCtlData ClogCtlData;
 
 #define ClogCtl (&ClogCtlData)
 
+/*
+ * Cache of final transaction statuses in front of the CLOG buffers.
+ *
+ * Right after a bulk load, every tuple a scan looks at needs a CLOG lookup
+ * until its hint bits are set, and concurrent scans over many transactions
+ * keep the few CLOG buffers busy and CLogControlLock contended.  The cache
+ * is a direct-mapped array of entries each holding a transaction id in the
+ * high half and its status in the low half, read and written atomically
+ * without any lock.  Only committed and aborted statuses are cached, as they
+ * never change; zero is the empty entry.  Commits are cached only once their
+ * WAL is flushed, so that callers can set hint bits without knowing the
+ * commit LSN.  Entries of truncated CLOG segments are cleared along with
+ * them, so that they do not apply to the same xids after a wraparound.
+ */
+int			xact_status_cache_size = 1024;	/* kB */
+
+#ifdef PG_HAVE_ATOMIC_U64_SUPPORT
+static pg_atomic_uint64 *XactStatusCache = NULL;
+static uint32 XactStatusCacheMask;
+
+static uint32 XactStatusCacheEntries(void);
+static void XactStatusCacheTruncate(int cutoffPage);
+#endif
+
 
 static int	ZeroCLOGPage(int pageno, bool writeXlog);
 static bool CLOGPagePrecedes(int page1, int page2);
@@ -419,6 +445,23 @@ TransactionIdGetStatus(TransactionId xid, XLogRecPtr *lsn)
 	char	   *byteptr;
 	XidStatus	status;
 
+#ifdef PG_HAVE_ATOMIC_U64_SUPPORT
+	pg_atomic_uint64 *entry = NULL;
+
+	if (XactStatusCache != NULL)
+	{
+		uint64		cached;
+
+		entry = &XactStatusCache[xid & XactStatusCacheMask];
+		cached = pg_atomic_read_u64(entry);
+		if (cached != 0 && (TransactionId) (cached >> 32) == xid)
+		{
+			*lsn = InvalidXLogRecPtr;
+			return (XidStatus) (cached & CLOG_XACT_BITMASK);
+		}
+	}
+#endif
+
 	/* lock is acquired by SimpleLruReadPage_ReadOnly */
 
 	slotno = SimpleLruReadPage_ReadOnly(ClogCtl, pageno, xid);
@@ -431,9 +474,61 @@ TransactionIdGetStatus(TransactionId xid, XLogRecPtr *lsn)
 
 	LWLockRelease(CLogControlLock);
 
+#ifdef PG_HAVE_ATOMIC_U64_SUPPORT
+	if (entry != NULL &&
+		(status == TRANSACTION_STATUS_ABORTED ||
+		 (status == TRANSACTION_STATUS_COMMITTED &&
+		  (XLogRecPtrIsInvalid(*lsn) ||
+		   (!RecoveryInProgress() && *lsn <= GetFlushRecPtr())))))
+		pg_atomic_write_u64(entry, ((uint64) xid << 32) | (uint64) status);
+#endif
+
 	return status;
 }
 
+#ifdef PG_HAVE_ATOMIC_U64_SUPPORT
+/*
+ * Number of entries of the transaction status cache: the largest power of
+ * two fitting in xact_status_cache_size, or zero.
+ */
+static uint32
+XactStatusCacheEntries(void)
+{
+	uint64		entries;
+	uint32		result = 1;
+
+	entries = (uint64) xact_status_cache_size * 1024 / sizeof(pg_atomic_uint64);
+	if (entries == 0)
+		return 0;
+	while ((uint64) result * 2 <= entries)
+		result *= 2;
+	return result;
+}
+
+/*
+ * Forget the cached statuses of transactions on CLOG pages preceding
+ * cutoffPage.
+ */
+static void
+XactStatusCacheTruncate(int cutoffPage)
+{
+	uint32		i;
+
+	if (XactStatusCache == NULL)
+		return;
+
+	for (i = 0; i <= XactStatusCacheMask; i++)
+	{
+		uint64		cached = pg_atomic_read_u64(&XactStatusCache[i]);
+
+		if (cached != 0 &&
+			CLOGPagePrecedes(TransactionIdToPage((TransactionId) (cached >> 32)),
+							 cutoffPage))
+			pg_atomic_write_u64(&XactStatusCache[i], 0);
+	}
+}
+#endif
+
 /*
  * Number of shared CLOG buffers.
  *
@@ -469,7 +564,14 @@ CLOGShmemBuffers(void)
 Size
 CLOGShmemSize(void)
 {
-	return SimpleLruShmemSize(CLOGShmemBuffers(), CLOG_LSNS_PER_PAGE);
+	Size		size;
+
+	size = SimpleLruShmemSize(CLOGShmemBuffers(), CLOG_LSNS_PER_PAGE);
+#ifdef PG_HAVE_ATOMIC_U64_SUPPORT
+	size = add_size(size, mul_size(XactStatusCacheEntries(),
+								   sizeof(pg_atomic_uint64)));
+#endif
+	return size;
 }
 
 void
@@ -478,6 +580,26 @@ CLOGShmemInit(void)
 	ClogCtl->PagePrecedes = CLOGPagePrecedes;
 	SimpleLruInit(ClogCtl, "CLOG Ctl", CLOGShmemBuffers(), CLOG_LSNS_PER_PAGE,
 				  CLogControlLock, "pg_clog");
+
+#ifdef PG_HAVE_ATOMIC_U64_SUPPORT
+	if (XactStatusCacheEntries() > 0)
+	{
+		uint32		nentries = XactStatusCacheEntries();
+		bool		found;
+
+		XactStatusCache = (pg_atomic_uint64 *)
+			ShmemInitStruct("CLOG Status Cache",
+							nentries * sizeof(pg_atomic_uint64), &found);
+		XactStatusCacheMask = nentries - 1;
+		if (!found)
+		{
+			uint32		i;
+
+			for (i = 0; i < nentries; i++)
+				pg_atomic_init_u64(&XactStatusCache[i], 0);
+		}
+	}
+#endif
 }
 
 /*
@@ -722,6 +844,9 @@ TruncateCLOG(TransactionId oldestXact)
 
 	/* Now we can remove the old CLOG segment(s) */
 	SimpleLruTruncate(ClogCtl, cutoffPage);
+#ifdef PG_HAVE_ATOMIC_U64_SUPPORT
+	XactStatusCacheTruncate(cutoffPage);
+#endif
 }
 
 
@@ -816,6 +941,9 @@ clog_redo(XLogReaderState *record)
 		ClogCtl->shared->latest_page_number = pageno;
 
 		SimpleLruTruncate(ClogCtl, pageno);
+#ifdef PG_HAVE_ATOMIC_U64_SUPPORT
+		XactStatusCacheTruncate(pageno);
+#endif
 	}
 	else
 		elog(PANIC, "clog_redo: unknown op code %u", info);
@@ -0,0 +1,231 @@
+/*-------------------------------------------------------------------------
+ *
+ * csnlog.c
+ *
+ *	  Commit sequence number snapshots obtained from GTM
+ *
+ * GTM numbers the completions of global transactions with commit sequence
+ * numbers (CSN) and publishes a CSN snapshot on every completion, so it can
+ * hand out a snapshot without scanning its open transactions. The snapshot
+ * is just the CSN of the next completion plus the xmin and xmax horizons:
+ * a transaction between xmin and xmax is running for the snapshot unless it
+ * completed with a lower CSN.
+ *
+ * The node keeps the recent completions fetched from GTM in shared memory,
+ * indexed by XID, and turns the CSN snapshot into the usual list of running
+ * XIDs. Completions are fetched incrementally by the first backend that
+ * needs them, so the cost is shared by all backends of the node.
+ *
+ * When the completions needed to resolve a snapshot are not available,
+ * because the log was reset after GTM restarted or we lagged behind too far,
+ * GetCSNSnapshotData returns NULL and the caller requests a regular snapshot
+ * from GTM instead.
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * src/backend/access/transam/csnlog.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/csnlog.h"
+#include "access/gtm.h"
+#include "access/transam.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+
+/*
+ * Completed transaction as recorded in the log. The entry of a XID is at
+ * the slot XID modulo the log size, csn is InvalidCSN if the slot is unused.
+ */
+typedef struct CSNLogEntry
+{
+	TransactionId	xid;
+	GTM_CSN			csn;
+} CSNLogEntry;
+
+/*
+ * Shared state, protected by CSNLogControlLock. Completions with CSN below
+ * "upto" are all in the log, except those of XIDs preceding "horizon": they
+ * were missed while the log was reset.
+ */
+typedef struct CSNLogControl
+{
+	bool			valid;
+	uint32			epoch;
+	GTM_CSN			upto;
+	TransactionId	horizon;
+	CSNLogEntry		entries[GTM_CSNLOG_SIZE];
+} CSNLogControl;
+
+static CSNLogControl *CSNLog = NULL;
+
+static void CSNLogReset(GTM_CSNSnapshot csn_snapshot);
+static bool CSNLogCatchUp(GTM_CSNSnapshot csn_snapshot);
+
+Size
+CSNLogShmemSize(void)
+{
+	return sizeof(CSNLogControl);
+}
+
+void
+CSNLogShmemInit(void)
+{
+	bool		found;
+
+	CSNLog = (CSNLogControl *)
+		ShmemInitStruct("CSN log", CSNLogShmemSize(), &found);
+	if (!found)
+		MemSet(CSNLog, 0, CSNLogShmemSize());
+}
+
+/*
+ * Forget about all the recorded completions and start recording them from
+ * the given snapshot on. Any XID completed before the snapshot was taken
+ * precedes its xmax, that becomes the horizon.
+ */
+static void
+CSNLogReset(GTM_CSNSnapshot csn_snapshot)
+{
+	MemSet(CSNLog->entries, 0, sizeof(CSNLog->entries));
+	CSNLog->epoch = csn_snapshot->cs_epoch;
+	CSNLog->upto = csn_snapshot->cs_csn;
+	CSNLog->horizon = csn_snapshot->cs_xmax;
+	CSNLog->valid = true;
+
+	elog(DEBUG1, "CSN log reset at CSN " UINT64_FORMAT ", horizon %u",
+		 CSNLog->upto, CSNLog->horizon);
+}
+
+/*
+ * Make sure all the completions preceding the snapshot are recorded.
+ * The caller holds CSNLogControlLock in exclusive mode.
+ * Returns false if GTM failed to send them.
+ */
+static bool
+CSNLogCatchUp(GTM_CSNSnapshot csn_snapshot)
+{
+	if (!CSNLog->valid || CSNLog->epoch != csn_snapshot->cs_epoch)
+		CSNLogReset(csn_snapshot);
+
+	while (CSNLog->upto < csn_snapshot->cs_csn)
+	{
+		uint32		epoch;
+		GTM_CSN		first;
+		int			count;
+		GlobalTransactionId *gxids;
+		int			i;
+
+		if (GetCSNLogGTM(CSNLog->upto, &epoch, &first, &count, &gxids) != 0)
+			return false;
+
+		/* GTM restarted, or its log was overwritten past what we have */
+		if (epoch != csn_snapshot->cs_epoch || first != CSNLog->upto)
+		{
+			CSNLogReset(csn_snapshot);
+			break;
+		}
+		if (count == 0)
+			break;
+
+		for (i = 0; i < count; i++)
+		{
+			CSNLogEntry *entry = &CSNLog->entries[gxids[i] % GTM_CSNLOG_SIZE];
+
+			entry->xid = gxids[i];
+			entry->csn = first + i;
+		}
+		CSNLog->upto = first + count;
+	}
+	return true;
+}
+
+/*
+ * Get the snapshot for the transaction gxid from GTM as a CSN snapshot and
+ * resolve it into a regular one. The first snapshot of the transaction sets
+ * its xmin on GTM.
+ *
+ * Returns NULL if the snapshot can not be resolved, the caller should fall
+ * back to GetSnapshotGTM. The result is valid until the next call.
+ */
+GTM_Snapshot
+GetCSNSnapshotData(GlobalTransactionId gxid, bool first)
+{
+	static GTM_SnapshotData snapshot;
+	static GlobalTransactionId *xip = NULL;
+	GTM_CSNSnapshotData csn_snapshot;
+	TransactionId xid;
+	bool		caught_up;
+
+	if (xip == NULL)
+	{
+		xip = (GlobalTransactionId *)
+			malloc(GTM_CSNLOG_SIZE * sizeof(GlobalTransactionId));
+		if (xip == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_OUT_OF_MEMORY),
+					 errmsg("out of memory")));
+	}
+
+	if (GetCSNSnapshotGTM(gxid, first, &csn_snapshot) != 0)
+		return NULL;
+
+	/* Not enough room to resolve the snapshot */
+	if (!TransactionIdIsNormal(csn_snapshot.cs_xmin) ||
+		csn_snapshot.cs_xmax - csn_snapshot.cs_xmin > GTM_CSNLOG_SIZE)
+		return NULL;
+
+	LWLockAcquire(CSNLogControlLock, LW_SHARED);
+	caught_up = CSNLog->valid && CSNLog->epoch == csn_snapshot.cs_epoch &&
+		CSNLog->upto >= csn_snapshot.cs_csn;
+	if (!caught_up)
+	{
+		LWLockRelease(CSNLogControlLock);
+		LWLockAcquire(CSNLogControlLock, LW_EXCLUSIVE);
+		if (!CSNLogCatchUp(&csn_snapshot))
+		{
+			LWLockRelease(CSNLogControlLock);
+			return NULL;
+		}
+	}
+
+	if (TransactionIdPrecedes(csn_snapshot.cs_xmin, CSNLog->horizon))
+	{
+		LWLockRelease(CSNLogControlLock);
+		return NULL;
+	}
+
+	snapshot.sn_xcnt = 0;
+	xid = csn_snapshot.cs_xmin;
+	while (TransactionIdPrecedes(xid, csn_snapshot.cs_xmax))
+	{
+		CSNLogEntry *entry = &CSNLog->entries[xid % GTM_CSNLOG_SIZE];
+
+		if (entry->csn == InvalidCSN || entry->xid != xid)
+		{
+			/* Overwritten by a later completion, can't tell */
+			if (entry->csn != InvalidCSN &&
+				TransactionIdFollows(entry->xid, xid))
+			{
+				LWLockRelease(CSNLogControlLock);
+				return NULL;
+			}
+			xip[snapshot.sn_xcnt++] = xid;
+		}
+		else if (entry->csn >= csn_snapshot.cs_csn)
+			xip[snapshot.sn_xcnt++] = xid;
+
+		TransactionIdAdvance(xid);
+	}
+	LWLockRelease(CSNLogControlLock);
+
+	snapshot.sn_xmin = csn_snapshot.cs_xmin;
+	snapshot.sn_xmax = csn_snapshot.cs_xmax;
+	snapshot.sn_recent_global_xmin = csn_snapshot.cs_recent_global_xmin;
+	snapshot.sn_xip = xip;
+
+	return &snapshot;
+}
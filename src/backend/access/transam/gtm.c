@@ -16,16 +16,32 @@
 #include "gtm/gtm_client.h"
 #include "access/gtm.h"
 #include "access/transam.h"
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "catalog/pgxc_node.h"
+#include "executor/executor.h"
+#include "funcapi.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
 #include "utils/elog.h"
 #include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#include "pgstat.h"
+#include "pgxc/execRemote.h"
+#include "pgxc/nodemgr.h"
 #include "pgxc/pgxc.h"
 #include "gtm/gtm_c.h"
+#include "gtm/gtm_utils.h"
 #include "postmaster/autovacuum.h"
 #include "storage/backendid.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
 #include "tcop/tcopprot.h"
 #include "utils/guc.h"
 #include "utils/lsyscache.h"
 #include "utils/pg_rusage.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
 
 /* To access sequences */
 #define MyCoordName \
@@ -36,13 +52,48 @@ int GtmPort = 6666;
 static int GtmConnectTimeout = 60;
 bool IsXidFromGTM = false;
 bool gtm_backup_barrier = false;
+bool gtm_csn_snapshots = false;
+bool gtm_standby_snapshots = false;
+int gtm_clock_sync_interval = 0;
+int gtm_global_xmin_interval = 1000;
 extern bool FirstSnapshotSet;
 
 static GTM_Conn *conn;
 
+/* Commit sent to GTM by StartCommitTranGTM, whose reply is not read yet */
+static GlobalTransactionId pendingCommitGxid = InvalidGlobalTransactionId;
+
+/* Read-only transaction which got a snapshot from the GTM primary */
+static GlobalTransactionId primarySnapshotGxid = InvalidGlobalTransactionId;
+
+/* Transaction started by BeginTranSnapshotGTM, not handed out yet */
+static GlobalTransactionId startedGxid = InvalidGlobalTransactionId;
+static GTM_Timestamp startedTimestamp;
+
 /* Used to check if needed to commit/abort at datanodes */
 GlobalTransactionId currentGxid = InvalidGlobalTransactionId;
 
+/* Report the waits on the GTM socket, see GTMPQwait_hook */
+static void
+ReportGTMWait(int waiting)
+{
+	if (waiting)
+		pgstat_report_wait_start(WAIT_EVENT_GTM_RESPONSE, InvalidOid);
+	else
+		pgstat_report_wait_end(WAIT_EVENT_GTM_RESPONSE);
+}
+
+/*
+ * Isolation level of the current transaction for GTM, which only knows
+ * whether the transaction uses a single snapshot or one per statement.
+ */
+static GTM_IsolationLevel
+GetGTMIsolationLevel(void)
+{
+	return IsolationUsesXactSnapshot() ? GTM_ISOLATION_SERIALIZABLE :
+		GTM_ISOLATION_RC;
+}
+
 bool
 IsGTMConnected()
 {
@@ -52,6 +103,10 @@ IsGTMConnected()
 static void
 CheckConnection(void)
 {
+	/* The reply to a pending commit comes first on the connection */
+	if (GlobalTransactionIdIsValid(pendingCommitGxid))
+		FinishCommitTranGTM();
+
 	/* Be sure that a backend does not use a postmaster connection */
 	if (IsUnderPostmaster && GTMPQispostmaster(conn) == 1)
 	{
@@ -69,6 +124,8 @@ InitGTM(void)
 	/* 256 bytes should be enough */
 	char conn_str[256];
 
+	GTMPQwait_hook = ReportGTMWait;
+
 	/* If this thread is postmaster itself, it contacts gtm identifying itself */
 	if (!IsUnderPostmaster)
 	{
@@ -123,6 +180,10 @@ InitGTM(void)
 void
 CloseGTM(void)
 {
+	/* GTM would abort a transaction whose commit is still pending */
+	if (GlobalTransactionIdIsValid(pendingCommitGxid))
+		FinishCommitTranGTM();
+
 	GTMPQfinish(conn);
 	conn = NULL;
 
@@ -144,13 +205,24 @@ BeginTranGTM(GTM_Timestamp *timestamp)
 	struct rusage start_r;
 	struct timeval start_t;
 
+	/* Already started on GTM along with its first snapshot */
+	if (GlobalTransactionIdIsValid(startedGxid))
+	{
+		xid = startedGxid;
+		if (timestamp)
+			*timestamp = startedTimestamp;
+		startedGxid = InvalidGlobalTransactionId;
+		IsXidFromGTM = true;
+		currentGxid = xid;
+		return xid;
+	}
+
 	if (log_gtm_stats)
 		ResetUsageCommon(&start_r, &start_t);
 
 	CheckConnection();
-	// TODO Isolation level
 	if (conn)
-		xid =  begin_transaction(conn, GTM_ISOLATION_RC, timestamp);
+		xid =  begin_transaction(conn, GetGTMIsolationLevel(), timestamp);
 
 	/* If something went wrong (timeout), try and reset GTM connection
 	 * and retry. This is safe at the beginning of a transaction.
@@ -160,7 +232,7 @@ BeginTranGTM(GTM_Timestamp *timestamp)
 		CloseGTM();
 		InitGTM();
 		if (conn)
-			xid = begin_transaction(conn, GTM_ISOLATION_RC, timestamp);
+			xid = begin_transaction(conn, GetGTMIsolationLevel(), timestamp);
 	}
 	if (xid)
 		IsXidFromGTM = true;
@@ -177,7 +249,7 @@ BeginTranAutovacuumGTM(void)
 	GlobalTransactionId  xid = InvalidGlobalTransactionId;
 
 	CheckConnection();
-	// TODO Isolation level
+	/* Autovacuum takes a snapshot per table, like read committed */
 	if (conn)
 		xid =  begin_transaction_autovacuum(conn, GTM_ISOLATION_RC);
 
@@ -239,6 +311,78 @@ CommitTranGTM(GlobalTransactionId gxid, int waited_xid_count,
 	return ret;
 }
 
+/*
+ * Send the commit of gxid to GTM without waiting for the reply, so the
+ * caller can do other work while GTM processes it. The commit must be
+ * completed by FinishCommitTranGTM before it is reported to the client;
+ * any other call to GTM completes it first anyway.
+ *
+ * A transaction which waited for others is committed synchronously, GTM
+ * may ask to retry its commit.
+ */
+void
+StartCommitTranGTM(GlobalTransactionId gxid, int waited_xid_count,
+		GlobalTransactionId *waited_xids)
+{
+	if (!GlobalTransactionIdIsValid(gxid))
+		return;
+
+	if (waited_xid_count == 0)
+	{
+		CheckConnection();
+		if (conn && send_commit_transaction(conn, gxid) == 0)
+		{
+			pendingCommitGxid = gxid;
+			return;
+		}
+	}
+
+	CommitTranGTM(gxid, waited_xid_count, waited_xids);
+}
+
+/*
+ * Wait for the reply to the commit sent by StartCommitTranGTM, if any.
+ */
+int
+FinishCommitTranGTM(void)
+{
+	GlobalTransactionId gxid = pendingCommitGxid;
+	int ret;
+	struct rusage start_r;
+	struct timeval start_t;
+
+	if (!GlobalTransactionIdIsValid(gxid))
+		return 0;
+	pendingCommitGxid = InvalidGlobalTransactionId;
+
+	if (log_gtm_stats)
+		ResetUsageCommon(&start_r, &start_t);
+
+	ret = receive_commit_transaction(conn);
+
+	/*
+	 * If something went wrong (timeout), the reply may still arrive later,
+	 * so reset the GTM connection before committing again.
+	 */
+	if (ret < 0)
+	{
+		CloseGTM();
+		InitGTM();
+		if (conn)
+			ret = commit_transaction(conn, gxid, 0, NULL);
+	}
+
+	/* Close connection in case commit is done by autovacuum worker or launcher */
+	if (IsAutoVacuumWorkerProcess() || IsAutoVacuumLauncherProcess())
+		CloseGTM();
+
+	currentGxid = InvalidGlobalTransactionId;
+
+	if (log_gtm_stats)
+		ShowUsageCommon("FinishCommitTranGTM", &start_r, &start_t);
+	return ret;
+}
+
 /*
  * For a prepared transaction, commit the gxid used for PREPARE TRANSACTION
  * and for COMMIT PREPARED.
@@ -444,6 +588,654 @@ GetSnapshotGTM(GlobalTransactionId gxid, bool canbe_grouped)
 	return ret_snapshot;
 }
 
+/*
+ * Get a snapshot for the read-only transaction gxid, which the GTM proxy may
+ * get from the GTM standby. The snapshots of the standby lag behind the ones
+ * of GTM, so once the transaction got one from GTM it keeps asking GTM:
+ * its snapshots never go back in time.
+ */
+GTM_Snapshot
+GetSnapshotGTMReadOnly(GlobalTransactionId gxid)
+{
+	GTM_Snapshot ret_snapshot = NULL;
+	bool from_standby = false;
+	struct rusage start_r;
+	struct timeval start_t;
+
+	if (gxid == primarySnapshotGxid)
+		return GetSnapshotGTM(gxid, true);
+
+	CheckConnection();
+
+	if (log_gtm_stats)
+		ResetUsageCommon(&start_r, &start_t);
+
+	if (conn)
+		ret_snapshot = get_snapshot_readonly(conn, 1, &gxid, &from_standby);
+	if (ret_snapshot == NULL)
+	{
+		CloseGTM();
+		InitGTM();
+		if (conn)
+			ret_snapshot = get_snapshot_readonly(conn, 1, &gxid, &from_standby);
+	}
+
+	if (ret_snapshot && !from_standby)
+		primarySnapshotGxid = gxid;
+
+	if (log_gtm_stats)
+		ShowUsageCommon("GetSnapshotGTMReadOnly", &start_r, &start_t);
+
+	return ret_snapshot;
+}
+
+/*
+ * Start a transaction on GTM and get its first snapshot in a single round
+ * trip. The GXID is not returned: the next BeginTranGTM call hands it out
+ * without contacting GTM, so the caller should assign the transaction ID
+ * right away. The snapshot is only valid until the next call to GTM.
+ */
+GTM_Snapshot
+BeginTranSnapshotGTM(void)
+{
+	GTM_Snapshot ret_snapshot = NULL;
+	GlobalTransactionId gxid = InvalidGlobalTransactionId;
+	GTM_Timestamp timestamp = 0;
+	struct rusage start_r;
+	struct timeval start_t;
+
+	CheckConnection();
+
+	if (log_gtm_stats)
+		ResetUsageCommon(&start_r, &start_t);
+
+	if (conn)
+		ret_snapshot = begin_transaction_snapshot(conn, GetGTMIsolationLevel(),
+												  &gxid, &timestamp);
+
+	/*
+	 * If something went wrong (timeout), try and reset GTM connection
+	 * and retry. This is safe at the beginning of a transaction.
+	 */
+	if (ret_snapshot == NULL)
+	{
+		CloseGTM();
+		InitGTM();
+		if (conn)
+			ret_snapshot = begin_transaction_snapshot(conn,
+													  GetGTMIsolationLevel(),
+													  &gxid, &timestamp);
+	}
+
+	if (ret_snapshot)
+	{
+		startedGxid = gxid;
+		startedTimestamp = timestamp;
+	}
+
+	if (log_gtm_stats)
+		ShowUsageCommon("BeginTranSnapshotGTM", &start_r, &start_t);
+
+	return ret_snapshot;
+}
+
+/*
+ * Get the commit sequence number snapshot from GTM. The first snapshot of
+ * the transaction also advertises its xmin on GTM.
+ */
+int
+GetCSNSnapshotGTM(GlobalTransactionId gxid, bool first,
+				  GTM_CSNSnapshot csn_snapshot)
+{
+	int ret = -1;
+
+	CheckConnection();
+	if (conn)
+		ret = get_snapshot_csn(conn, gxid, first, csn_snapshot);
+	if (ret < 0)
+	{
+		CloseGTM();
+		InitGTM();
+		if (conn)
+			ret = get_snapshot_csn(conn, gxid, first, csn_snapshot);
+	}
+	return ret;
+}
+
+/*
+ * Fetch the gxids completed on GTM starting at the CSN "from".
+ */
+int
+GetCSNLogGTM(GTM_CSN from, uint32 *epoch, GTM_CSN *first, int *count,
+			 GlobalTransactionId **gxids)
+{
+	int ret = -1;
+
+	CheckConnection();
+	if (conn)
+		ret = get_csnlog(conn, from, epoch, first, count, gxids);
+	if (ret < 0)
+	{
+		CloseGTM();
+		InitGTM();
+		if (conn)
+			ret = get_csnlog(conn, from, epoch, first, count, gxids);
+	}
+	return ret;
+}
+
+
+/*
+ * Get the latency counters of the messages served by GTM. The result is
+ * valid until the next call.
+ */
+int
+GetStatsGTM(GTM_MessageStats **stats, int *count)
+{
+	int ret = -1;
+
+	CheckConnection();
+	if (conn)
+		ret = get_gtm_stats(conn, stats, count);
+	if (ret < 0)
+	{
+		CloseGTM();
+		InitGTM();
+		if (conn)
+			ret = get_gtm_stats(conn, stats, count);
+	}
+	return ret;
+}
+
+/*
+ * Get the current GTM timestamp
+ */
+int
+GetTimestampGTM(GTM_Timestamp *timestamp)
+{
+	int ret = -1;
+
+	CheckConnection();
+	if (conn)
+		ret = get_timestamp(conn, timestamp);
+	if (ret < 0)
+	{
+		CloseGTM();
+		InitGTM();
+		if (conn)
+			ret = get_timestamp(conn, timestamp);
+	}
+	return ret;
+}
+
+/*
+ * Hybrid logical clock
+ *
+ * When gtm_clock_sync_interval is set, the coordinator derives transaction
+ * timestamps from its local clock corrected by the offset of the GTM clock,
+ * instead of taking them from GTM along with the GXIDs. The offset is
+ * refreshed from every timestamp GTM sends with a GXID anyway, and a single
+ * backend of the node asks GTM for the time when none came within the
+ * interval, so timestamps normally cost no GTM round trip. The timestamps
+ * are only as close to the GTM timeline as the drift of the local clock over
+ * the interval, but the node never hands out the same timestamp twice, nor
+ * one preceding a timestamp it already handed out or received from GTM.
+ */
+typedef struct GTMClockData
+{
+	slock_t		mutex;
+	GTM_Timestamp offset;		/* GTM clock minus local clock */
+	TimestampTz synced;			/* local time of the last sync, 0 if none */
+	GTM_Timestamp last;			/* last timestamp handed out or received */
+} GTMClockData;
+
+static GTMClockData *GTMClock = NULL;
+
+Size
+GTMClockShmemSize(void)
+{
+	return sizeof(GTMClockData);
+}
+
+void
+GTMClockShmemInit(void)
+{
+	bool		found;
+
+	GTMClock = (GTMClockData *)
+		ShmemInitStruct("GTM clock", GTMClockShmemSize(), &found);
+	if (!found)
+	{
+		SpinLockInit(&GTMClock->mutex);
+		GTMClock->offset = 0;
+		GTMClock->synced = 0;
+		GTMClock->last = 0;
+	}
+}
+
+/*
+ * Adjust the offset of the clock to a timestamp just received from GTM
+ */
+void
+GTMClockSync(GTM_Timestamp timestamp)
+{
+	TimestampTz now = GetCurrentTimestamp();
+
+	SpinLockAcquire(&GTMClock->mutex);
+	GTMClock->offset = timestamp - (GTM_Timestamp) now;
+	GTMClock->synced = now;
+	if (timestamp > GTMClock->last)
+		GTMClock->last = timestamp;
+	SpinLockRelease(&GTMClock->mutex);
+}
+
+/*
+ * Turn the local time into a timestamp of the GTM timeline, synchronizing
+ * the clock with GTM first if it was not lately.
+ */
+GTM_Timestamp
+GTMClockTimestamp(GTM_Timestamp local)
+{
+	GTM_Timestamp timestamp;
+	bool		refresh = false;
+
+	/*
+	 * Claim the refresh by moving the sync time, the other backends go on
+	 * with the current offset meanwhile.
+	 */
+	SpinLockAcquire(&GTMClock->mutex);
+	if (GTMClock->synced == 0 ||
+		TimestampDifferenceExceeds(GTMClock->synced, (TimestampTz) local,
+								   gtm_clock_sync_interval))
+	{
+		GTMClock->synced = (TimestampTz) local;
+		refresh = true;
+	}
+	SpinLockRelease(&GTMClock->mutex);
+
+	if (refresh)
+	{
+		if (GetTimestampGTM(&timestamp) == 0)
+			GTMClockSync(timestamp);
+		else
+			elog(LOG, "could not synchronize the clock with GTM");
+	}
+
+	SpinLockAcquire(&GTMClock->mutex);
+	timestamp = local + GTMClock->offset;
+	if (timestamp <= GTMClock->last)
+	{
+#ifdef HAVE_INT64_TIMESTAMP
+		timestamp = GTMClock->last + 1;
+#else
+		timestamp = GTMClock->last + 0.000001;
+#endif
+	}
+	GTMClock->last = timestamp;
+	SpinLockRelease(&GTMClock->mutex);
+
+	return timestamp;
+}
+
+/*
+ * Get the current global xmin from GTM
+ */
+int
+GetGlobalXminGTM(GlobalTransactionId *globalxmin)
+{
+	int ret = -1;
+
+	CheckConnection();
+	if (conn)
+		ret = get_global_xmin(conn, globalxmin);
+	if (ret < 0)
+	{
+		CloseGTM();
+		InitGTM();
+		if (conn)
+			ret = get_global_xmin(conn, globalxmin);
+	}
+	return ret;
+}
+
+/*
+ * Global xmin of the node
+ *
+ * A backend learns the global xmin along with the snapshots it gets from GTM
+ * or from a Coordinator, and a pooled connection which did not get one for a
+ * while prunes and vacuums with an old horizon. The newest global xmin any
+ * backend of the node heard of is kept in shared memory, and the backends
+ * take it when it is newer than the one of their snapshot: GTM computed it
+ * from the xmins of all the open transactions. When gtm_global_xmin_interval
+ * is set and the global xmin did not advance within the interval, a single
+ * backend of the node asks GTM for it, so it keeps up even when the
+ * snapshots come from an idle Coordinator.
+ */
+typedef struct GlobalXminData
+{
+	slock_t		mutex;
+	TransactionId xmin;			/* newest global xmin heard of */
+	TimestampTz updated;		/* when it last advanced */
+	TimestampTz refreshed;		/* last time GTM was asked for it */
+} GlobalXminData;
+
+static GlobalXminData *GlobalXmin = NULL;
+
+Size
+GlobalXminShmemSize(void)
+{
+	return sizeof(GlobalXminData);
+}
+
+void
+GlobalXminShmemInit(void)
+{
+	bool		found;
+
+	GlobalXmin = (GlobalXminData *)
+		ShmemInitStruct("Global xmin", GlobalXminShmemSize(), &found);
+	if (!found)
+	{
+		SpinLockInit(&GlobalXmin->mutex);
+		GlobalXmin->xmin = InvalidTransactionId;
+		GlobalXmin->updated = 0;
+		GlobalXmin->refreshed = 0;
+	}
+}
+
+/*
+ * Publish a global xmin received from GTM or a Coordinator, and return the
+ * newest global xmin of the node instead if it is newer. The result does not
+ * go past limit, the xmin of the snapshot of the caller, which GTM may not
+ * know about.
+ */
+TransactionId
+GlobalXminAdvance(TransactionId globalxmin, TransactionId limit)
+{
+	TimestampTz now = GetCurrentStatementStartTimestamp();
+	TransactionId newest;
+	bool		refresh = false;
+
+	if (!TransactionIdIsNormal(globalxmin))
+		return globalxmin;
+
+	SpinLockAcquire(&GlobalXmin->mutex);
+	if (!TransactionIdIsValid(GlobalXmin->xmin) ||
+		TransactionIdPrecedes(GlobalXmin->xmin, globalxmin))
+	{
+		GlobalXmin->xmin = globalxmin;
+		GlobalXmin->updated = now;
+	}
+	else if (gtm_global_xmin_interval > 0 &&
+			 TimestampDifferenceExceeds(GlobalXmin->updated, now,
+										gtm_global_xmin_interval) &&
+			 TimestampDifferenceExceeds(GlobalXmin->refreshed, now,
+										gtm_global_xmin_interval))
+	{
+		/* Claim the refresh, the other backends go on meanwhile */
+		GlobalXmin->refreshed = now;
+		refresh = true;
+	}
+	newest = GlobalXmin->xmin;
+	SpinLockRelease(&GlobalXmin->mutex);
+
+	if (refresh)
+	{
+		GlobalTransactionId gxmin;
+
+		if (GetGlobalXminGTM(&gxmin) == 0 && TransactionIdIsNormal(gxmin))
+		{
+			SpinLockAcquire(&GlobalXmin->mutex);
+			if (TransactionIdPrecedes(GlobalXmin->xmin, gxmin))
+			{
+				GlobalXmin->xmin = gxmin;
+				GlobalXmin->updated = now;
+			}
+			newest = GlobalXmin->xmin;
+			SpinLockRelease(&GlobalXmin->mutex);
+		}
+		else
+			elog(LOG, "could not get the global xmin from GTM");
+	}
+
+	if (TransactionIdIsNormal(limit) && TransactionIdPrecedes(limit, newest))
+		newest = limit;
+	if (TransactionIdPrecedes(globalxmin, newest))
+		return newest;
+	return globalxmin;
+}
+
+/*
+ * Newest global xmin of the node, invalid if none was received yet
+ */
+TransactionId
+GlobalXminGet(void)
+{
+	TransactionId xmin;
+
+	SpinLockAcquire(&GlobalXmin->mutex);
+	xmin = GlobalXmin->xmin;
+	SpinLockRelease(&GlobalXmin->mutex);
+
+	return xmin;
+}
+
+/*
+ * pg_stat_get_global_xmin
+ *
+ * SQL SRF showing the global xmin known to the node, and how far it lags
+ * behind the next transaction ID. On the Coordinator the client is connected
+ * to, the Datanodes are shown too.
+ */
+Datum
+pg_stat_get_global_xmin(PG_FUNCTION_ARGS)
+{
+#define PG_STAT_GET_GLOBAL_XMIN_COLS 4
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+	Datum		values[PG_STAT_GET_GLOBAL_XMIN_COLS];
+	bool		nulls[PG_STAT_GET_GLOBAL_XMIN_COLS];
+	TransactionId xmin;
+	TimestampTz updated;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	SpinLockAcquire(&GlobalXmin->mutex);
+	xmin = GlobalXmin->xmin;
+	updated = GlobalXmin->updated;
+	SpinLockRelease(&GlobalXmin->mutex);
+
+	MemSet(nulls, 0, sizeof(nulls));
+	values[0] = DirectFunctionCall1(namein, CStringGetDatum(PGXCNodeName));
+	if (TransactionIdIsValid(xmin))
+	{
+		values[1] = TransactionIdGetDatum(xmin);
+		values[2] = Int32GetDatum((int32) (ReadNewTransactionId() - xmin));
+		values[3] = TimestampTzGetDatum(updated);
+	}
+	else
+		nulls[1] = nulls[2] = nulls[3] = true;
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+
+	if (IS_PGXC_LOCAL_COORDINATOR)
+	{
+		Oid		   *dnOids;
+		int			numdnodes;
+		RemoteQuery *plan;
+		RemoteQueryState *pstate;
+		EState	   *estate;
+		TupleTableSlot *result;
+		int			i;
+
+		PgxcNodeGetOids(NULL, &dnOids, NULL, &numdnodes, false);
+
+		plan = makeNode(RemoteQuery);
+		plan->combine_type = COMBINE_TYPE_NONE;
+		plan->exec_nodes = makeNode(ExecNodes);
+		plan->exec_type = EXEC_ON_DATANODES;
+		for (i = 0; i < numdnodes; i++)
+		{
+			char		ntype = PGXC_NODE_DATANODE;
+
+			plan->exec_nodes->nodeList = lappend_int(plan->exec_nodes->nodeList,
+									PGXCNodeGetNodeId(dnOids[i], &ntype));
+		}
+		plan->sql_statement = "SELECT * FROM pg_catalog.pg_stat_get_global_xmin()";
+		plan->force_autocommit = false;
+		/* The target list only determines the types of the result */
+		plan->scan.plan.targetlist = list_make4(
+				makeTargetEntry((Expr *) makeVar(1, 1, NAMEOID, -1, InvalidOid, 0),
+								1, NULL, false),
+				makeTargetEntry((Expr *) makeVar(1, 2, XIDOID, -1, InvalidOid, 0),
+								2, NULL, false),
+				makeTargetEntry((Expr *) makeVar(1, 3, INT4OID, -1, InvalidOid, 0),
+								3, NULL, false),
+				makeTargetEntry((Expr *) makeVar(1, 4, TIMESTAMPTZOID, -1, InvalidOid, 0),
+								4, NULL, false));
+
+		estate = CreateExecutorState();
+		oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+		estate->es_snapshot = GetActiveSnapshot();
+		pstate = ExecInitRemoteQuery(plan, estate, 0);
+		MemoryContextSwitchTo(oldcontext);
+
+		result = ExecRemoteQuery(pstate);
+		while (!TupIsNull(result))
+		{
+			for (i = 0; i < PG_STAT_GET_GLOBAL_XMIN_COLS; i++)
+				values[i] = slot_getattr(result, i + 1, &nulls[i]);
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+			result = ExecRemoteQuery(pstate);
+		}
+		ExecEndRemoteQuery(pstate);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * pg_stat_get_gtm
+ *
+ * SQL SRF showing the messages served by GTM, one row per message type,
+ * type of client and phase of the processing.
+ */
+Datum
+pg_stat_get_gtm(PG_FUNCTION_ARGS)
+{
+#define PG_STAT_GET_GTM_COLS 6
+	/* Indexed by GTM_PGXCNodeType */
+	static const char *client_type_names[GTM_STAT_CLIENT_TYPES] =
+	{
+		"unknown", "gtm_proxy", "gtm_proxy_postmaster", "coordinator",
+		"datanode", "gtm", "other"
+	};
+	static const char *phase_names[GTM_STAT_PHASE_COUNT] =
+	{
+		"queue_wait", "lock_wait", "processing"
+	};
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+	GTM_MessageStats *stats;
+	int			count;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	if (GetStatsGTM(&stats, &count) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("could not obtain statistics from GTM")));
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	for (i = 0; i < count; i++)
+	{
+		GTM_MessageStats *entry = &stats[i];
+		int			phase;
+
+		if (entry->ms_client_type < 0 ||
+			entry->ms_client_type >= GTM_STAT_CLIENT_TYPES)
+			continue;
+
+		for (phase = 0; phase < GTM_STAT_PHASE_COUNT; phase++)
+		{
+			Datum		values[PG_STAT_GET_GTM_COLS];
+			bool		nulls[PG_STAT_GET_GTM_COLS];
+			Datum		latency[GTM_STAT_LATENCY_BUCKETS];
+			int			j;
+
+			MemSet(nulls, 0, sizeof(nulls));
+			values[0] = CStringGetTextDatum(gtm_util_message_name(entry->ms_mtype));
+			values[1] = CStringGetTextDatum(client_type_names[entry->ms_client_type]);
+			values[2] = CStringGetTextDatum(phase_names[phase]);
+			values[3] = Int64GetDatum(entry->ms_count);
+			values[4] = Float8GetDatum(entry->ms_usecs[phase] / 1000.0);
+			for (j = 0; j < GTM_STAT_LATENCY_BUCKETS; j++)
+				latency[j] = Int64GetDatum(entry->ms_latency[phase][j]);
+			values[5] = PointerGetDatum(construct_array(latency,
+														GTM_STAT_LATENCY_BUCKETS,
+														INT8OID, sizeof(int64),
+														FLOAT8PASSBYVAL, 'd'));
+
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
 
 /*
  * Create a sequence on the GTM.
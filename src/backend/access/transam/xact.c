@@ -317,6 +317,13 @@ static TimestampTz xactStopTimestamp;
 #ifdef PGXC
 static TimestampTz GTMxactStartTimestamp = 0;
 static TimestampTz GTMdeltaTimestamp = 0;
+
+/*
+ * Set when GTMxactStartTimestamp was derived from the clock of the node, see
+ * gtm_clock_sync_interval. The timestamp received with the GXID then only
+ * synchronizes the clock.
+ */
+static bool GTMclockTimestamp = false;
 #endif
 
 /*
@@ -674,7 +681,9 @@ AssignTransactionId(TransactionState s)
 		bool			received_tp;
 
 		s->transactionId = GetNewTransactionId(isSubXact, &received_tp, &gtm_timestamp);
-		if (received_tp)
+		if (received_tp && GTMclockTimestamp)
+			GTMClockSync(gtm_timestamp);
+		else if (received_tp)
 		{
 			GTMxactStartTimestamp = (TimestampTz) gtm_timestamp;
 			GTMdeltaTimestamp = GTMxactStartTimestamp - stmtStartTimestamp;
@@ -800,6 +809,23 @@ SetAuxilliaryTransactionId(GlobalTransactionId gxid)
 	s->auxilliaryTransactionId = gxid;
 }
 
+/*
+ * A hot standby Coordinator can not assign transaction IDs. Its read-only
+ * transactions get a GXID from GTM instead, to anchor their snapshots on GTM
+ * and to be sent down to the remote nodes. It is kept as the auxilliary
+ * transaction of the top transaction, so it is closed on GTM along with it.
+ */
+GlobalTransactionId
+GetStandbyGlobalTransactionId(void)
+{
+	TransactionState s = &TopTransactionStateData;
+
+	Assert(RecoveryInProgress());
+	if (!GlobalTransactionIdIsValid(s->auxilliaryTransactionId))
+		s->auxilliaryTransactionId = BeginTranGTM(NULL);
+	return s->auxilliaryTransactionId;
+}
+
 /*
  *	GetCurrentSubTransactionId
  */
@@ -2061,6 +2087,16 @@ StartTransaction(void)
 
 	Assert(XactTopTransactionId == InvalidTransactionId);
 
+#ifdef XCP
+	/*
+	 * Commands may be sent before the commit of the previous transaction is
+	 * reported with ReadyForQuery, complete it before using the remote nodes
+	 * again.
+	 */
+	if (IsAsyncCommitPending())
+		FinishAsyncCommit();
+#endif
+
 	/*
 	 * check the current transaction state
 	 */
@@ -2171,6 +2207,19 @@ StartTransaction(void)
 	xactStartTimestamp = stmtStartTimestamp;
 	xactStopTimestamp = 0;
 #ifdef PGXC
+	/*
+	 * The coordinator can derive the transaction timestamp from its own clock
+	 * right away, the one coming with the GXID would be the same give or take
+	 * the drift since the last synchronization with GTM.
+	 */
+	GTMclockTimestamp = IS_PGXC_LOCAL_COORDINATOR && IsUnderPostmaster &&
+		gtm_clock_sync_interval > 0;
+	if (GTMclockTimestamp)
+	{
+		GTMxactStartTimestamp = (TimestampTz)
+			GTMClockTimestamp((GTM_Timestamp) xactStartTimestamp);
+		GTMdeltaTimestamp = GTMxactStartTimestamp - xactStartTimestamp;
+	}
 	/* For Postgres-XC, transaction start timestamp has to follow the GTM timeline */
 	pgstat_report_xact_timestamp(GTMxactStartTimestamp);
 #else
@@ -2612,9 +2661,14 @@ CommitTransaction(void)
 	 * GTM. We do this after resuming interrupts to ensure that we don't end
 	 * blocking forever on the communication channel. But we need to see if
 	 * this is safe in all cases (TODO)
+	 *
+	 * The commit is only sent to GTM there, the remote nodes are cleaned up
+	 * while GTM processes it. The reply must be in before the commit is
+	 * reported to the client.
 	 */
 	AtEOXact_GlobalTxn(true);
 	AtEOXact_Remote();
+	FinishCommitTranGTM();
 }
 
 /*
@@ -2640,7 +2694,7 @@ AtEOXact_GlobalTxn(bool commit)
 						s->waitedForXidsCount,
 						s->waitedForXids);
 			else if (GlobalTransactionIdIsValid(s->topGlobalTransansactionId))
-				CommitTranGTM(s->topGlobalTransansactionId,
+				StartCommitTranGTM(s->topGlobalTransansactionId,
 						s->waitedForXidsCount,
 						s->waitedForXids);
 			else if (GlobalTransactionIdIsValid(s->auxilliaryTransactionId))
@@ -3066,6 +3120,11 @@ AbortTransaction(void)
 	TransactionId latestXid;
 	bool		is_parallel_worker;
 
+#ifdef XCP
+	/* An error may have interrupted a distributed wait */
+	pgstat_clear_wait();
+#endif
+
 #ifdef PGXC
 	/*
 	 * Cleanup the files created during database/tablespace operations.
@@ -5341,6 +5400,9 @@ AbortSubTransaction(void)
 	 * if we try to wait for another lock before doing this.
 	 */
 	LockErrorCleanup();
+#ifdef XCP
+	pgstat_clear_wait();
+#endif
 
 	/*
 	 * If any timeout events are still active, make sure the timeout interrupt
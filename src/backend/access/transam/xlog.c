@@ -101,6 +101,7 @@ int			sync_method = DEFAULT_SYNC_METHOD;
 int			wal_level = WAL_LEVEL_MINIMAL;
 int			CommitDelay = 0;	/* precommit delay in microseconds */
 int			CommitSiblings = 5; /* # concurrent xacts needed to sleep */
+bool		AdaptiveCommitDelay = false;	/* derive the delay from the load */
 int			wal_retrieve_retry_interval = 5000;
 
 #ifdef WAL_DEBUG
@@ -114,6 +115,15 @@ bool		XLOG_DEBUG = false;
  */
 #define NUM_XLOGINSERT_LOCKS  8
 
+/*
+ * Weight of the newest sample in the moving averages kept for
+ * adaptive_commit_delay is 1/GROUP_COMMIT_SMOOTHING.  Intervals between flush
+ * requests are clamped to MAX_FLUSH_REQUEST_INTERVAL microseconds, so that
+ * an idle period doesn't hide a burst of commits for long.
+ */
+#define GROUP_COMMIT_SMOOTHING		8
+#define MAX_FLUSH_REQUEST_INTERVAL	100000.0
+
 /*
  * Max distance from last checkpoint, before triggering a new xlog-based
  * checkpoint.
@@ -325,7 +335,7 @@ static TimeLineID curFileTLI;
  * stored here.  The parallel leader advances its own copy, when necessary,
  * in WaitForParallelWorkersToFinish.
  */
-static XLogRecPtr ProcLastRecPtr = InvalidXLogRecPtr;
+XLogRecPtr	ProcLastRecPtr = InvalidXLogRecPtr;
 
 XLogRecPtr	XactLastRecEnd = InvalidXLogRecPtr;
 XLogRecPtr	XactLastCommitEnd = InvalidXLogRecPtr;
@@ -650,6 +660,15 @@ typedef struct XLogCtlData
 	 */
 	XLogRecPtr	lastFpwDisableRecPtr;
 
+	/*
+	 * Recent load of XLogFlush, for adaptive_commit_delay: when the last
+	 * flush request arrived, and moving averages of the interval between
+	 * requests and of the time a flush takes, in microseconds.
+	 */
+	TimestampTz lastFlushRequest;
+	double		flushRequestInterval;
+	double		flushDuration;
+
 	slock_t		info_lck;		/* locks shared variables shown above */
 } XLogCtlData;
 
@@ -810,6 +829,8 @@ static XLogRecPtr XLogGetReplicationSlotMinimumLSN(void);
 static void AdvanceXLInsertBuffer(XLogRecPtr upto, bool opportunistic);
 static bool XLogCheckpointNeeded(XLogSegNo new_segno);
 static void XLogWrite(XLogwrtRqst WriteRqst, bool flexible);
+static int	GroupCommitDelay(void);
+static void NoteFlushDuration(TimestampTz start);
 static bool InstallXLogFileSegment(XLogSegNo *segno, char *tmppath,
 					   bool find_free, XLogSegNo max_segno,
 					   bool use_lock, int elevel);
@@ -2549,6 +2570,9 @@ XLogFlush(XLogRecPtr record)
 {
 	XLogRecPtr	WriteRqstPtr;
 	XLogwrtRqst WriteRqst;
+	TimestampTz now = 0;
+	TimestampTz start = 0;
+	int			delay;
 
 	/*
 	 * During REDO, we are reading not writing WAL.  Therefore, instead of
@@ -2588,6 +2612,10 @@ XLogFlush(XLogRecPtr record)
 	/* initialize to given target; may increase below */
 	WriteRqstPtr = record;
 
+	/* note the arrival of this request, to estimate the rate of flushes */
+	if (AdaptiveCommitDelay)
+		now = GetCurrentTimestamp();
+
 	/*
 	 * Now wait until we get the write lock, or someone else does the flush
 	 * for us.
@@ -2601,6 +2629,25 @@ XLogFlush(XLogRecPtr record)
 		if (WriteRqstPtr < XLogCtl->LogwrtRqst.Write)
 			WriteRqstPtr = XLogCtl->LogwrtRqst.Write;
 		LogwrtResult = XLogCtl->LogwrtResult;
+		if (now != 0)
+		{
+			if (XLogCtl->lastFlushRequest != 0)
+			{
+				long		secs;
+				int			usecs;
+				double		interval;
+
+				TimestampDifference(XLogCtl->lastFlushRequest, now,
+									&secs, &usecs);
+				interval = Min(secs * 1000000.0 + usecs,
+							   MAX_FLUSH_REQUEST_INTERVAL);
+				XLogCtl->flushRequestInterval +=
+					(interval - XLogCtl->flushRequestInterval) /
+					GROUP_COMMIT_SMOOTHING;
+			}
+			XLogCtl->lastFlushRequest = Max(now, XLogCtl->lastFlushRequest);
+			now = 0;
+		}
 		SpinLockRelease(&XLogCtl->info_lck);
 
 		/* done already? */
@@ -2642,15 +2689,18 @@ XLogFlush(XLogRecPtr record)
 		 * Sleep before flush! By adding a delay here, we may give further
 		 * backends the opportunity to join the backlog of group commit
 		 * followers; this can significantly improve transaction throughput,
-		 * at the risk of increasing transaction latency.
+		 * at the risk of increasing transaction latency.  With
+		 * adaptive_commit_delay the delay follows the recent rate of flush
+		 * requests instead of being fixed; see GroupCommitDelay().
 		 *
 		 * We do not sleep if enableFsync is not turned on, nor if there are
 		 * fewer than CommitSiblings other backends with active transactions.
 		 */
-		if (CommitDelay > 0 && enableFsync &&
+		delay = AdaptiveCommitDelay ? GroupCommitDelay() : CommitDelay;
+		if (delay > 0 && enableFsync &&
 			MinimumActiveBackends(CommitSiblings))
 		{
-			pg_usleep(CommitDelay);
+			pg_usleep(delay);
 
 			/*
 			 * Re-check how far we can now flush the WAL. It's generally not
@@ -2669,8 +2719,14 @@ XLogFlush(XLogRecPtr record)
 		WriteRqst.Write = insertpos;
 		WriteRqst.Flush = insertpos;
 
+		if (AdaptiveCommitDelay)
+			start = GetCurrentTimestamp();
+
 		XLogWrite(WriteRqst, false);
 
+		if (AdaptiveCommitDelay)
+			NoteFlushDuration(start);
+
 		LWLockRelease(WALWriteLock);
 		/* done */
 		break;
@@ -2709,6 +2765,58 @@ XLogFlush(XLogRecPtr record)
 		   (uint32) (LogwrtResult.Flush >> 32), (uint32) LogwrtResult.Flush);
 }
 
+/*
+ * How long the leader of a group commit should wait before flushing, with
+ * adaptive_commit_delay.
+ *
+ * Waiting is only worthwhile if other flush requests are expected to arrive
+ * meanwhile, so there is no delay unless requests have recently come more
+ * often than the wait would last.  The wait is half of the recent flush
+ * time: a request arriving during it joins this flush instead of waiting
+ * for the whole of the next one, while the leader's own latency grows by at
+ * most half a flush.  commit_delay, if set, caps the wait.
+ */
+static int
+GroupCommitDelay(void)
+{
+	double		interval;
+	double		duration;
+	double		delay;
+
+	SpinLockAcquire(&XLogCtl->info_lck);
+	interval = XLogCtl->flushRequestInterval;
+	duration = XLogCtl->flushDuration;
+	SpinLockRelease(&XLogCtl->info_lck);
+
+	delay = duration / 2;
+	if (CommitDelay > 0)
+		delay = Min(delay, CommitDelay);
+	if (interval <= 0 || interval >= delay)
+		return 0;
+
+	return (int) delay;
+}
+
+/*
+ * Account for a flush started at the given time in the moving average of
+ * the flush time.
+ */
+static void
+NoteFlushDuration(TimestampTz start)
+{
+	long		secs;
+	int			usecs;
+	double		duration;
+
+	TimestampDifference(start, GetCurrentTimestamp(), &secs, &usecs);
+	duration = secs * 1000000.0 + usecs;
+
+	SpinLockAcquire(&XLogCtl->info_lck);
+	XLogCtl->flushDuration +=
+		(duration - XLogCtl->flushDuration) / GROUP_COMMIT_SMOOTHING;
+	SpinLockRelease(&XLogCtl->info_lck);
+}
+
 /*
  * Flush xlog, but without specifying exactly where to flush to.
  *
@@ -75,6 +75,7 @@
 #include "utils/snapmgr.h"
 #include "utils/syscache.h"
 #include "utils/tqual.h"
+#include "utils/typcache.h"
 
 #ifdef PGXC
 #include "catalog/pgxc_class.h"
@@ -1000,6 +1001,8 @@ AddRelationDistribution(Oid relid,
 	ObjectAddress myself, referenced;
 	int	numnodes;
 	Oid	*nodeoids;
+	List *ranges = NIL;
+	List *attnums;
 
 	/* Obtain details of distribution information */
 	GetRelationDistributionItems(relid,
@@ -1009,13 +1012,23 @@ AddRelationDistribution(Oid relid,
 								 &hashalgorithm,
 								 &hashbuckets,
 								 &attnum);
+	attnums = BuildRelationDistributionKeys(relid, distributeby, descriptor);
 
 	/* Obtain details of nodes and classify them */
 	nodeoids = GetRelationDistributionNodes(subcluster, &numnodes);
 
+	/* Each node stores one range of values */
+	if (locatortype == LOCATOR_TYPE_RANGE)
+	{
+		ranges = BuildRelationDistributionRanges(
+								descriptor->attrs[attnum - 1]->atttypid,
+								distributeby->rangevalues);
+		CheckRelationDistributionRanges(ranges, numnodes);
+	}
+
 	/* Now OK to insert data in catalog */
 	PgxcClassCreate(relid, locatortype, attnum, hashalgorithm,
-					hashbuckets, numnodes, nodeoids);
+					hashbuckets, numnodes, nodeoids, ranges, attnums);
 
 	/* Make dependency entries */
 	myself.classId = PgxcClassRelationId;
@@ -1129,6 +1142,52 @@ GetRelationDistributionItems(Oid relid,
 				local_locatortype = LOCATOR_TYPE_MODULO;
 				break;
 
+			case DISTTYPE_BUCKET:
+				/*
+				 * Validate user-specified bucket column, it is hashed the
+				 * same way as a hash distribution column.
+				 */
+				local_attnum = get_attnum(relid, distributeby->colname);
+				if (local_attnum <= 0 && local_attnum >= -(int) lengthof(SysAtt))
+				{
+					ereport(ERROR,
+						(errcode(ERRCODE_INVALID_TABLE_DEFINITION),
+						 errmsg("Invalid distribution column specified")));
+				}
+
+				if (!IsTypeHashDistributable(descriptor->attrs[local_attnum - 1]->atttypid))
+				{
+					ereport(ERROR,
+						(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+						 errmsg("Column %s is not a hash distributable data type",
+							distributeby->colname)));
+				}
+				local_locatortype = LOCATOR_TYPE_BUCKET;
+				break;
+
+			case DISTTYPE_RANGE:
+				/*
+				 * Validate user-specified range column, its values have to
+				 * be sorted.
+				 */
+				local_attnum = get_attnum(relid, distributeby->colname);
+				if (local_attnum <= 0 && local_attnum >= -(int) lengthof(SysAtt))
+				{
+					ereport(ERROR,
+						(errcode(ERRCODE_INVALID_TABLE_DEFINITION),
+						 errmsg("Invalid distribution column specified")));
+				}
+
+				if (!IsTypeRangeDistributable(descriptor->attrs[local_attnum - 1]->atttypid))
+				{
+					ereport(ERROR,
+						(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+						 errmsg("Column %s is not a range distributable data type",
+							distributeby->colname)));
+				}
+				local_locatortype = LOCATOR_TYPE_RANGE;
+				break;
+
 			case DISTTYPE_REPLICATION:
 				local_locatortype = LOCATOR_TYPE_REPLICATED;
 				break;
@@ -1150,6 +1209,11 @@ GetRelationDistributionItems(Oid relid,
 		local_hashalgorithm = 1;
 		local_hashbuckets = HASH_SIZE;
 	}
+	else if (local_locatortype == LOCATOR_TYPE_BUCKET)
+	{
+		local_hashalgorithm = 1;
+		local_hashbuckets = BUCKET_MAP_SIZE;
+	}
 
 	/* Save results */
 	if (attnum)
@@ -1163,6 +1227,111 @@ GetRelationDistributionItems(Oid relid,
 }
 
 
+/*
+ * BuildRelationDistributionKeys
+ * Validate the columns of a multi-column hash distribution and return their
+ * attribute numbers, in the order of the clause. NIL is returned if the
+ * distribution is not on more than one column.
+ */
+List *
+BuildRelationDistributionKeys(Oid relid,
+							  DistributeBy *distributeby,
+							  TupleDesc descriptor)
+{
+	List	   *attnums = NIL;
+	ListCell   *lc;
+
+	if (distributeby == NULL || list_length(distributeby->colnames) < 2)
+		return NIL;
+
+	Assert(distributeby->disttype == DISTTYPE_HASH);
+
+	foreach(lc, distributeby->colnames)
+	{
+		char	   *colname = strVal(lfirst(lc));
+		AttrNumber	attnum = get_attnum(relid, colname);
+
+		if (attnum <= 0 && attnum >= -(int) lengthof(SysAtt))
+			ereport(ERROR,
+				(errcode(ERRCODE_INVALID_TABLE_DEFINITION),
+				 errmsg("Invalid distribution column specified")));
+
+		if (!IsTypeHashDistributable(descriptor->attrs[attnum - 1]->atttypid))
+			ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("Column %s is not a hash distributable data type",
+					colname)));
+
+		if (list_member_int(attnums, attnum))
+			ereport(ERROR,
+				(errcode(ERRCODE_DUPLICATE_COLUMN),
+				 errmsg("Column %s appears twice in the distribution",
+					colname)));
+
+		attnums = lappend_int(attnums, attnum);
+	}
+
+	return attnums;
+}
+
+/*
+ * BuildRelationDistributionRanges
+ * Build the split points of a range distribution of a column of the given
+ * type, as canonical strings. They have to be in strictly ascending order.
+ */
+List *
+BuildRelationDistributionRanges(Oid typid, List *rangevalues)
+{
+	TypeCacheEntry *typentry;
+	Oid			typinput;
+	Oid			typioparam;
+	Oid			typoutput;
+	bool		typisvarlena;
+	Datum		prev = (Datum) 0;
+	List	   *result = NIL;
+	ListCell   *item;
+
+	typentry = lookup_type_cache(typid, TYPECACHE_CMP_PROC_FINFO);
+	getTypeInputInfo(typid, &typinput, &typioparam);
+	getTypeOutputInfo(typid, &typoutput, &typisvarlena);
+
+	foreach(item, rangevalues)
+	{
+		Datum		value;
+
+		value = OidInputFunctionCall(typinput, strVal(lfirst(item)),
+									 typioparam, -1);
+		if (result != NIL &&
+			DatumGetInt32(FunctionCall2Coll(&typentry->cmp_proc_finfo,
+											get_typcollation(typid),
+											prev, value)) >= 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_TABLE_DEFINITION),
+					 errmsg("split points of range distribution must be in strictly ascending order")));
+
+		result = lappend(result,
+						 makeString(OidOutputFunctionCall(typoutput, value)));
+		prev = value;
+	}
+
+	return result;
+}
+
+/*
+ * CheckRelationDistributionRanges
+ * Each node of a range distributed table stores one range of values.
+ */
+void
+CheckRelationDistributionRanges(List *ranges, int numnodes)
+{
+	if (list_length(ranges) != numnodes - 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_TABLE_DEFINITION),
+				 errmsg("range distribution on %d nodes requires %d split points, %d given",
+						numnodes, numnodes - 1, list_length(ranges))));
+}
+
+
 /*
  * BuildRelationDistributionNodes
  * Build an unsorted node Oid array based on a node name list.
@@ -109,6 +109,15 @@ static void index_update_stats(Relation rel,
 static void IndexCheckExclusion(Relation heapRelation,
 					Relation indexRelation,
 					IndexInfo *indexInfo);
+static double IndexBuildHeapScanInternal(Relation heapRelation,
+						   Relation indexRelation,
+						   IndexInfo *indexInfo,
+						   bool allow_sync,
+						   BlockNumber start_blockno,
+						   BlockNumber numblocks,
+						   ParallelHeapScanDesc parallel_scan,
+						   IndexBuildCallback callback,
+						   void *callback_state);
 static bool validate_index_callback(ItemPointer itemptr, void *opaque);
 static void validate_index_heapscan(Relation heapRelation,
 						Relation indexRelation,
@@ -2179,6 +2188,46 @@ IndexBuildHeapRangeScan(Relation heapRelation,
 						BlockNumber numblocks,
 						IndexBuildCallback callback,
 						void *callback_state)
+{
+	return IndexBuildHeapScanInternal(heapRelation, indexRelation,
+									  indexInfo, allow_sync,
+									  start_blockno, numblocks, NULL,
+									  callback, callback_state);
+}
+
+/*
+ * As IndexBuildHeapScan, except that the heap is scanned together with other
+ * processes sharing the given parallel scan, so only the tuples of the pages
+ * this process takes are passed to the callback.  The count returned covers
+ * these tuples only.
+ */
+double
+IndexBuildHeapParallelScan(Relation heapRelation,
+						   Relation indexRelation,
+						   IndexInfo *indexInfo,
+						   ParallelHeapScanDesc parallel_scan,
+						   IndexBuildCallback callback,
+						   void *callback_state)
+{
+	/* Every process must see the same tuples */
+	Assert(!indexInfo->ii_Concurrent && !IsBootstrapProcessingMode());
+
+	return IndexBuildHeapScanInternal(heapRelation, indexRelation,
+									  indexInfo, false,
+									  0, InvalidBlockNumber, parallel_scan,
+									  callback, callback_state);
+}
+
+static double
+IndexBuildHeapScanInternal(Relation heapRelation,
+						   Relation indexRelation,
+						   IndexInfo *indexInfo,
+						   bool allow_sync,
+						   BlockNumber start_blockno,
+						   BlockNumber numblocks,
+						   ParallelHeapScanDesc parallel_scan,
+						   IndexBuildCallback callback,
+						   void *callback_state)
 {
 	bool		is_system_catalog;
 	bool		checking_uniqueness;
@@ -2243,15 +2292,20 @@ IndexBuildHeapRangeScan(Relation heapRelation,
 		OldestXmin = GetOldestXmin(heapRelation, true);
 	}
 
-	scan = heap_beginscan_strat(heapRelation,	/* relation */
-								snapshot,		/* snapshot */
-								0,		/* number of keys */
-								NULL,	/* scan key */
-								true,	/* buffer access strategy OK */
-								allow_sync);	/* syncscan OK? */
-
-	/* set our scan endpoints */
-	heap_setscanlimits(scan, start_blockno, numblocks);
+	if (parallel_scan != NULL)
+		scan = heap_beginscan_parallel(heapRelation, snapshot, parallel_scan);
+	else
+	{
+		scan = heap_beginscan_strat(heapRelation,	/* relation */
+									snapshot,	/* snapshot */
+									0,	/* number of keys */
+									NULL,		/* scan key */
+									true,		/* buffer access strategy OK */
+									allow_sync);	/* syncscan OK? */
+
+		/* set our scan endpoints */
+		heap_setscanlimits(scan, start_blockno, numblocks);
+	}
 
 	reltuples = 0;
 
@@ -22,8 +22,49 @@
 #include "utils/rel.h"
 #include "utils/syscache.h"
 #include "pgxc/locator.h"
+#include "pgxc/redistrib.h"
 #include "utils/array.h"
 
+static Datum BuildRangesArray(List *ranges);
+static Datum BuildAttnumsVector(List *attnums);
+
+/*
+ * BuildRangesArray
+ *		Build the text array of split points of a range distribution
+ */
+static Datum
+BuildRangesArray(List *ranges)
+{
+	Datum	   *splits;
+	ListCell   *lc;
+	int			i = 0;
+
+	splits = (Datum *) palloc(list_length(ranges) * sizeof(Datum));
+	foreach(lc, ranges)
+		splits[i++] = CStringGetTextDatum(strVal(lfirst(lc)));
+
+	return PointerGetDatum(construct_array(splits, list_length(ranges),
+										   TEXTOID, -1, false, 'i'));
+}
+
+/*
+ * BuildAttnumsVector
+ *		Build the vector of columns of a multi-column distribution
+ */
+static Datum
+BuildAttnumsVector(List *attnums)
+{
+	int16	   *cols;
+	ListCell   *lc;
+	int			i = 0;
+
+	cols = (int16 *) palloc(list_length(attnums) * sizeof(int16));
+	foreach(lc, attnums)
+		cols[i++] = (int16) lfirst_int(lc);
+
+	return PointerGetDatum(buildint2vector(cols, list_length(attnums)));
+}
+
 /*
  * PgxcClassCreate
  *		Create a pgxc_class entry
@@ -35,7 +76,9 @@ PgxcClassCreate(Oid pcrelid,
 				int pchashalgorithm,
 				int pchashbuckets,
 				int numnodes,
-				Oid *nodes)
+				Oid *nodes,
+				List *ranges,
+				List *attnums)
 {
 	Relation	pgxcclassrel;
 	HeapTuple	htup;
@@ -43,10 +86,19 @@ PgxcClassCreate(Oid pcrelid,
 	Datum		values[Natts_pgxc_class];
 	int		i;
 	oidvector	*nodes_array;
+	int2vector	*bucketmap;
 
 	/* Build array of Oids to be inserted */
 	nodes_array = buildoidvector(nodes, numnodes);
 
+	/* Spread the buckets evenly over the nodes */
+	if (pclocatortype == LOCATOR_TYPE_BUCKET)
+		bucketmap = buildint2vector(BuildBucketMap(pchashbuckets, NULL, 0, NULL,
+												   nodes, numnodes, 0),
+									pchashbuckets);
+	else
+		bucketmap = buildint2vector(NULL, 0);
+
 	/* Iterate through attributes initializing nulls and values */
 	for (i = 0; i < Natts_pgxc_class; i++)
 	{
@@ -64,7 +116,10 @@ PgxcClassCreate(Oid pcrelid,
 	values[Anum_pgxc_class_pcrelid - 1]   = ObjectIdGetDatum(pcrelid);
 	values[Anum_pgxc_class_pclocatortype - 1] = CharGetDatum(pclocatortype);
 
-	if (pclocatortype == LOCATOR_TYPE_HASH || pclocatortype == LOCATOR_TYPE_MODULO)
+	if (pclocatortype == LOCATOR_TYPE_HASH ||
+		pclocatortype == LOCATOR_TYPE_MODULO ||
+		pclocatortype == LOCATOR_TYPE_BUCKET ||
+		pclocatortype == LOCATOR_TYPE_RANGE)
 	{
 		values[Anum_pgxc_class_pcattnum - 1] = UInt16GetDatum(pcattnum);
 		values[Anum_pgxc_class_pchashalgorithm - 1] = UInt16GetDatum(pchashalgorithm);
@@ -73,6 +128,19 @@ PgxcClassCreate(Oid pcrelid,
 
 	/* Node information */
 	values[Anum_pgxc_class_nodes - 1] = PointerGetDatum(nodes_array);
+	values[Anum_pgxc_class_pcbucketmap - 1] = PointerGetDatum(bucketmap);
+
+	/* Split points, only for range distribution */
+	if (pclocatortype == LOCATOR_TYPE_RANGE && ranges != NIL)
+		values[Anum_pgxc_class_pcranges - 1] = BuildRangesArray(ranges);
+	else
+		nulls[Anum_pgxc_class_pcranges - 1] = true;
+
+	/* Distribution columns, only if there are more than one */
+	if (pclocatortype == LOCATOR_TYPE_HASH && list_length(attnums) > 1)
+		values[Anum_pgxc_class_pcattnums - 1] = BuildAttnumsVector(attnums);
+	else
+		nulls[Anum_pgxc_class_pcattnums - 1] = true;
 
 	/* Open the relation for insertion */
 	pgxcclassrel = heap_open(PgxcClassRelationId, RowExclusiveLock);
@@ -99,11 +167,15 @@ PgxcClassAlter(Oid pcrelid,
 			   int pchashbuckets,
 			   int numnodes,
 			   Oid *nodes,
+			   List *ranges,
+			   List *attnums,
 			   PgxcClassAlterType type)
 {
 	Relation	rel;
 	HeapTuple	oldtup, newtup;
+	Form_pgxc_class oldform;
 	oidvector  *nodes_array;
+	int2vector *bucketmap;
 	Datum		new_record[Natts_pgxc_class];
 	bool		new_record_nulls[Natts_pgxc_class];
 	bool		new_record_repl[Natts_pgxc_class];
@@ -147,6 +219,50 @@ PgxcClassAlter(Oid pcrelid,
 			new_record_repl[Anum_pgxc_class_nodes - 1] = true;
 	}
 
+	/*
+	 * The bucket map follows the changes of the distribution and of the node
+	 * list. Buckets are kept on their nodes as much as possible, so that only
+	 * the reassigned ones have to be moved, and the number of buckets moved
+	 * between the remaining nodes may be limited.
+	 */
+	oldform = (Form_pgxc_class) GETSTRUCT(oldtup);
+	if (!new_record_repl[Anum_pgxc_class_pclocatortype - 1])
+		pclocatortype = oldform->pclocatortype;
+	if (!new_record_repl[Anum_pgxc_class_pchashbuckets - 1])
+		pchashbuckets = oldform->pchashbuckets;
+	if (!new_record_repl[Anum_pgxc_class_nodes - 1])
+	{
+		numnodes = oldform->nodeoids.dim1;
+		nodes = oldform->nodeoids.values;
+	}
+	if (pclocatortype == LOCATOR_TYPE_BUCKET)
+	{
+		int16	   *oldmap = NULL;
+
+		if (oldform->pclocatortype == LOCATOR_TYPE_BUCKET &&
+				oldform->pchashbuckets == pchashbuckets)
+		{
+			Datum		datum;
+			bool		isnull;
+
+			datum = heap_getattr(oldtup, Anum_pgxc_class_pcbucketmap,
+								 RelationGetDescr(rel), &isnull);
+			if (!isnull &&
+					((int2vector *) DatumGetPointer(datum))->dim1 == pchashbuckets)
+				oldmap = ((int2vector *) DatumGetPointer(datum))->values;
+		}
+		bucketmap = buildint2vector(BuildBucketMap(pchashbuckets,
+												   oldform->nodeoids.values,
+												   oldform->nodeoids.dim1,
+												   oldmap, nodes, numnodes,
+												   RedistribMaxBuckets),
+									pchashbuckets);
+	}
+	else
+		bucketmap = buildint2vector(NULL, 0);
+	new_record_repl[Anum_pgxc_class_pcbucketmap - 1] = true;
+	new_record[Anum_pgxc_class_pcbucketmap - 1] = PointerGetDatum(bucketmap);
+
 	/* Set up new fields */
 	/* Relation Oid */
 	if (new_record_repl[Anum_pgxc_class_pcrelid - 1])
@@ -172,6 +288,22 @@ PgxcClassAlter(Oid pcrelid,
 	if (new_record_repl[Anum_pgxc_class_nodes - 1])
 		new_record[Anum_pgxc_class_nodes - 1] = PointerGetDatum(nodes_array);
 
+	/* Split points and columns are replaced along with the distribution */
+	if (new_record_repl[Anum_pgxc_class_pclocatortype - 1])
+	{
+		new_record_repl[Anum_pgxc_class_pcranges - 1] = true;
+		if (pclocatortype == LOCATOR_TYPE_RANGE && ranges != NIL)
+			new_record[Anum_pgxc_class_pcranges - 1] = BuildRangesArray(ranges);
+		else
+			new_record_nulls[Anum_pgxc_class_pcranges - 1] = true;
+
+		new_record_repl[Anum_pgxc_class_pcattnums - 1] = true;
+		if (pclocatortype == LOCATOR_TYPE_HASH && list_length(attnums) > 1)
+			new_record[Anum_pgxc_class_pcattnums - 1] = BuildAttnumsVector(attnums);
+		else
+			new_record_nulls[Anum_pgxc_class_pcattnums - 1] = true;
+	}
+
 	/* Update relation */
 	newtup = heap_modify_tuple(oldtup, RelationGetDescr(rel),
 							   new_record,
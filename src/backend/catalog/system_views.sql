@@ -221,6 +221,48 @@ CREATE VIEW pg_locks AS
 CREATE VIEW pg_cursors AS
     SELECT * FROM pg_cursor() AS C;
 
+CREATE VIEW pg_stat_shared_queues AS
+    SELECT * FROM pg_stat_get_shared_queues() AS Q;
+
+CREATE VIEW pg_stat_pooler AS
+    SELECT * FROM pg_stat_get_pooler() AS P;
+
+CREATE VIEW pg_stat_remote_nodes AS
+    SELECT * FROM pg_stat_get_remote_nodes() AS R;
+
+CREATE VIEW pg_stat_session_remote_nodes AS
+    SELECT * FROM pg_stat_get_session_remote_nodes() AS R;
+
+CREATE VIEW pg_stat_gtm AS
+    SELECT * FROM pg_stat_get_gtm() AS G;
+
+CREATE VIEW pg_stat_global_xmin AS
+    SELECT * FROM pg_stat_get_global_xmin() AS G;
+
+CREATE VIEW pg_stat_wait_histogram AS
+    SELECT * FROM pg_stat_get_wait_histogram() AS W;
+
+CREATE VIEW pgxc_distribution AS
+    SELECT N.nspname AS schemaname, C.relname AS tablename, D.*
+    FROM pgxc_class X
+         JOIN pg_class C ON C.oid = X.pcrelid
+         LEFT JOIN pg_namespace N ON N.oid = C.relnamespace,
+         LATERAL pgxc_get_distribution(C.oid) AS D
+    WHERE X.pclocatortype <> 'R';
+
+CREATE VIEW pgxc_distribution_hot_values AS
+    SELECT S.schemaname, S.tablename, S.attname,
+           S.null_frac, S.n_distinct, S.most_common_vals, S.most_common_freqs
+    FROM pgxc_class X
+         JOIN pg_class C ON C.oid = X.pcrelid
+         JOIN pg_namespace N ON N.oid = C.relnamespace
+         JOIN pg_attribute A ON A.attrelid = X.pcrelid
+              AND (A.attnum = X.pcattnum OR A.attnum = ANY (X.pcattnums))
+         JOIN pg_stats S ON S.schemaname = N.nspname
+              AND S.tablename = C.relname AND S.attname = A.attname
+              AND NOT S.inherited
+    WHERE X.pcattnum > 0;
+
 CREATE VIEW pg_available_extensions AS
     SELECT E.name, E.default_version, X.extversion AS installed_version,
            E.comment
@@ -621,6 +663,9 @@ CREATE VIEW pg_stat_activity AS
             S.query_start,
             S.state_change,
             S.waiting,
+            S.wait_event_type,
+            S.wait_event,
+            S.wait_node,
             S.state,
             S.backend_xid,
             s.backend_xmin,
@@ -914,6 +959,31 @@ LANGUAGE INTERNAL
 VOLATILE ROWS 1000 COST 1000
 AS 'pg_logical_slot_peek_binary_changes';
 
+CREATE OR REPLACE FUNCTION pgxc_logical_slot_peek_changes(
+    IN slot_name name, IN upto_lsn pg_lsn, IN upto_nchanges int, VARIADIC options text[] DEFAULT '{}',
+    OUT location pg_lsn, OUT xid xid, OUT commit_location pg_lsn,
+    OUT commit_time timestamptz, OUT data text)
+RETURNS SETOF RECORD
+LANGUAGE INTERNAL
+VOLATILE ROWS 1000 COST 1000
+AS 'pgxc_logical_slot_peek_changes';
+
+CREATE OR REPLACE FUNCTION pgxc_logical_slot_get_changes(
+    IN slot_name name, IN upto_nchanges int, VARIADIC options text[] DEFAULT '{}',
+    OUT node_name name, OUT location pg_lsn, OUT xid xid,
+    OUT commit_time timestamptz, OUT data text)
+RETURNS SETOF RECORD
+LANGUAGE INTERNAL
+VOLATILE ROWS 1000 COST 1000
+AS 'pgxc_logical_slot_get_changes';
+
+CREATE OR REPLACE FUNCTION pgxc_result_cache_invalidate(
+    relation regclass, writer xid DEFAULT NULL)
+RETURNS void
+LANGUAGE INTERNAL
+VOLATILE
+AS 'pgxc_result_cache_invalidate';
+
 CREATE OR REPLACE FUNCTION
   make_interval(years int4 DEFAULT 0, months int4 DEFAULT 0, weeks int4 DEFAULT 0,
                 days int4 DEFAULT 0, hours int4 DEFAULT 0, mins int4 DEFAULT 0,
@@ -2725,6 +2725,452 @@ compare_mcvs(const void *a, const void *b)
 
 
 #ifdef XCP
+/*
+ * Statistics of an attribute received from a datanode
+ */
+typedef struct RemoteAttStats
+{
+	double		reltuples;		/* rows of the relation on the node */
+	float4		nullfrac;
+	int32		width;
+	float4		distinct;
+	int16		kind[STATISTIC_NUM_SLOTS];
+	Oid			op[STATISTIC_NUM_SLOTS];
+	int			nnumbers[STATISTIC_NUM_SLOTS];
+	float4	   *numbers[STATISTIC_NUM_SLOTS];
+	int			nvalues[STATISTIC_NUM_SLOTS];
+	Datum	   *values[STATISTIC_NUM_SLOTS];
+	Oid			valtypid[STATISTIC_NUM_SLOTS];
+	int16		valtyplen[STATISTIC_NUM_SLOTS];
+	bool		valtypbyval[STATISTIC_NUM_SLOTS];
+	char		valtypalign[STATISTIC_NUM_SLOTS];
+} RemoteAttStats;
+
+/* A value with its share of the rows, when merging MCVs and histograms */
+typedef struct MergeStatItem
+{
+	Datum		value;
+	double		weight;
+} MergeStatItem;
+
+/*
+ * Find the slot of the given kind in the statistics of a datanode, with the
+ * given operator unless it is InvalidOid. Returns -1 if there is none.
+ */
+static int
+remote_stat_slot(RemoteAttStats *remote, int16 kind, Oid op)
+{
+	int			k;
+
+	for (k = 0; k < STATISTIC_NUM_SLOTS; k++)
+		if (remote->kind[k] == kind &&
+			(!OidIsValid(op) || remote->op[k] == op))
+			return k;
+	return -1;
+}
+
+/*
+ * Take the slot k of the datanode statistics as is
+ */
+static void
+copy_remote_stat_slot(VacAttrStats *stats, int slot,
+					  RemoteAttStats *remote, int k)
+{
+	stats->numnumbers[slot] = remote->nnumbers[k];
+	stats->stanumbers[slot] = remote->numbers[k];
+	stats->numvalues[slot] = remote->nvalues[k];
+	stats->stavalues[slot] = remote->values[k];
+	if (remote->nvalues[k] > 0)
+	{
+		stats->statypid[slot] = remote->valtypid[k];
+		stats->statyplen[slot] = remote->valtyplen[k];
+		stats->statypbyval[slot] = remote->valtypbyval[k];
+		stats->statypalign[slot] = remote->valtypalign[k];
+	}
+}
+
+static int
+compare_mcv_weights(const void *a, const void *b)
+{
+	double		wa = ((const MergeStatItem *) a)->weight;
+	double		wb = ((const MergeStatItem *) b)->weight;
+
+	if (wa > wb)
+		return -1;
+	if (wa < wb)
+		return 1;
+	return 0;
+}
+
+static int
+compare_histogram_values(const void *a, const void *b, void *arg)
+{
+	return ApplySortComparator(((const MergeStatItem *) a)->value, false,
+							   ((const MergeStatItem *) b)->value, false,
+							   (SortSupport) arg);
+}
+
+static int
+compare_float4_desc(const void *a, const void *b)
+{
+	float4		fa = *(const float4 *) a;
+	float4		fb = *(const float4 *) b;
+
+	if (fa > fb)
+		return -1;
+	if (fa < fb)
+		return 1;
+	return 0;
+}
+
+/*
+ * Merge the most common values of the datanodes. The frequency of a value
+ * in the relation is the sum of its frequencies on the nodes, weighted by
+ * the share of the rows the nodes hold. A value missing from the list of a
+ * node is counted as not present there. As many values are kept as the
+ * longest list of the nodes has.
+ */
+static void
+merge_remote_mcv(VacAttrStats *stats, int slot, List *nodestats,
+				 double *weights)
+{
+	FmgrInfo	eqproc;
+	MergeStatItem *items = NULL;
+	int			nitems = 0;
+	int			num_mcv = 0;
+	ListCell   *lc;
+	int			n = 0;
+	int			i;
+
+	fmgr_info(get_opcode(stats->staop[slot]), &eqproc);
+
+	foreach(lc, nodestats)
+	{
+		RemoteAttStats *remote = (RemoteAttStats *) lfirst(lc);
+		int			k = remote_stat_slot(remote, STATISTIC_KIND_MCV,
+										 stats->staop[slot]);
+
+		if (k < 0 || remote->nvalues[k] == 0 ||
+			remote->nnumbers[k] != remote->nvalues[k])
+		{
+			n++;
+			continue;
+		}
+
+		if (items == NULL)
+		{
+			copy_remote_stat_slot(stats, slot, remote, k);
+			items = (MergeStatItem *)
+				palloc(remote->nvalues[k] * sizeof(MergeStatItem));
+		}
+		else
+			items = (MergeStatItem *)
+				repalloc(items, (nitems + remote->nvalues[k]) *
+						 sizeof(MergeStatItem));
+		num_mcv = Max(num_mcv, remote->nvalues[k]);
+
+		for (i = 0; i < remote->nvalues[k]; i++)
+		{
+			int			j;
+
+			for (j = 0; j < nitems; j++)
+				if (DatumGetBool(FunctionCall2Coll(&eqproc,
+												   DEFAULT_COLLATION_OID,
+												   items[j].value,
+												   remote->values[k][i])))
+					break;
+			if (j == nitems)
+			{
+				items[nitems].value = remote->values[k][i];
+				items[nitems].weight = 0.0;
+				nitems++;
+			}
+			items[j].weight += weights[n] * remote->numbers[k][i];
+		}
+		n++;
+	}
+
+	if (items == NULL)
+		return;
+
+	qsort(items, nitems, sizeof(MergeStatItem), compare_mcv_weights);
+	num_mcv = Min(num_mcv, nitems);
+
+	stats->numvalues[slot] = stats->numnumbers[slot] = num_mcv;
+	stats->stavalues[slot] = (Datum *) palloc(num_mcv * sizeof(Datum));
+	stats->stanumbers[slot] = (float4 *) palloc(num_mcv * sizeof(float4));
+	for (i = 0; i < num_mcv; i++)
+	{
+		stats->stavalues[slot][i] = items[i].value;
+		stats->stanumbers[slot][i] = (float4) items[i].weight;
+	}
+}
+
+/*
+ * Merge the histograms of the datanodes. The bounds of a node histogram
+ * split its rows, other than the NULLs and the most common values, into
+ * bins of equal population, so each bound but the first stands for a bin
+ * worth of the rows of the relation. Put the bounds of all the nodes in
+ * order and pick new bounds at equal distances of the accumulated rows, as
+ * many as the longest histogram of the nodes has.
+ */
+static void
+merge_remote_histogram(VacAttrStats *stats, int slot, List *nodestats,
+					   double *weights)
+{
+	SortSupportData ssup;
+	MergeStatItem *items = NULL;
+	int			nitems = 0;
+	int			num_hist = 0;
+	double		total = 0.0;
+	double		cumulative;
+	ListCell   *lc;
+	int			n = 0;
+	int			i,
+				b;
+
+	foreach(lc, nodestats)
+	{
+		RemoteAttStats *remote = (RemoteAttStats *) lfirst(lc);
+		int			k = remote_stat_slot(remote, STATISTIC_KIND_HISTOGRAM,
+										 stats->staop[slot]);
+		int			mcv = remote_stat_slot(remote, STATISTIC_KIND_MCV,
+										   InvalidOid);
+		double		binweight;
+
+		if (k < 0 || remote->nvalues[k] < 2)
+		{
+			n++;
+			continue;
+		}
+
+		/* Share of the relation rows in a bin of the node histogram */
+		binweight = 1.0 - remote->nullfrac;
+		if (mcv >= 0)
+			for (i = 0; i < remote->nnumbers[mcv]; i++)
+				binweight -= remote->numbers[mcv][i];
+		binweight = weights[n] * Max(binweight, 0.0) /
+			(remote->nvalues[k] - 1);
+
+		if (items == NULL)
+		{
+			copy_remote_stat_slot(stats, slot, remote, k);
+			items = (MergeStatItem *)
+				palloc(remote->nvalues[k] * sizeof(MergeStatItem));
+		}
+		else
+			items = (MergeStatItem *)
+				repalloc(items, (nitems + remote->nvalues[k]) *
+						 sizeof(MergeStatItem));
+		num_hist = Max(num_hist, remote->nvalues[k]);
+
+		for (i = 0; i < remote->nvalues[k]; i++)
+		{
+			items[nitems].value = remote->values[k][i];
+			items[nitems].weight = (i == 0) ? 0.0 : binweight;
+			total += items[nitems].weight;
+			nitems++;
+		}
+		n++;
+	}
+
+	/* Nothing to merge, keep the histogram of the first node */
+	if (items == NULL || total <= 0.0 || !OidIsValid(stats->staop[slot]))
+		return;
+
+	memset(&ssup, 0, sizeof(ssup));
+	ssup.ssup_cxt = CurrentMemoryContext;
+	/* We always use the default collation for statistics */
+	ssup.ssup_collation = DEFAULT_COLLATION_OID;
+	ssup.ssup_nulls_first = false;
+	ssup.abbreviate = false;
+	PrepareSortSupportFromOrderingOp(stats->staop[slot], &ssup);
+
+	qsort_arg(items, nitems, sizeof(MergeStatItem),
+			  compare_histogram_values, &ssup);
+
+	stats->numvalues[slot] = num_hist;
+	stats->stavalues[slot] = (Datum *) palloc(num_hist * sizeof(Datum));
+	stats->stavalues[slot][0] = items[0].value;
+	stats->stavalues[slot][num_hist - 1] = items[nitems - 1].value;
+	i = 0;
+	cumulative = items[0].weight;
+	for (b = 1; b < num_hist - 1; b++)
+	{
+		double		target = total * b / (num_hist - 1);
+
+		while (i < nitems - 1 && cumulative < target)
+			cumulative += items[++i].weight;
+		stats->stavalues[slot][b] = items[i].value;
+	}
+}
+
+/*
+ * Average the correlations of the datanodes, weighted by their rows
+ */
+static void
+merge_remote_correlation(VacAttrStats *stats, int slot, List *nodestats,
+						 double *weights)
+{
+	double		correlation = 0.0;
+	double		total = 0.0;
+	ListCell   *lc;
+	int			n = 0;
+
+	foreach(lc, nodestats)
+	{
+		RemoteAttStats *remote = (RemoteAttStats *) lfirst(lc);
+		int			k = remote_stat_slot(remote, STATISTIC_KIND_CORRELATION,
+										 stats->staop[slot]);
+
+		if (k >= 0 && remote->nnumbers[k] > 0)
+		{
+			correlation += weights[n] * remote->numbers[k][0];
+			total += weights[n];
+		}
+		n++;
+	}
+
+	stats->numnumbers[slot] = 1;
+	stats->stanumbers[slot] = (float4 *) palloc(sizeof(float4));
+	stats->stanumbers[slot][0] = total > 0.0 ? correlation / total : 0.0;
+}
+
+/*
+ * Combine the statistics of an attribute received from the datanodes into
+ * the statistics of the relation. The nodes are weighted by the share of
+ * the relation rows they hold. The values of the distribution column are
+ * not shared between the nodes, so the numbers of distinct values of the
+ * nodes add up; for other columns the largest one is taken, assuming the
+ * values are common to the nodes. Statistic kinds we do not know how to
+ * merge are taken from the first node reporting them.
+ *
+ * For the distribution column the share of the rows of each node is kept
+ * in a STATISTIC_KIND_DATANODE_ROWS slot, for the planner to cost the skew.
+ */
+static void
+merge_remote_stats(VacAttrStats *stats, List *nodestats, bool distcol)
+{
+	int			nnodes = list_length(nodestats);
+	double	   *weights = (double *) palloc(nnodes * sizeof(double));
+	double		totalrows = 0.0;
+	double		nullfrac = 0.0;
+	double		width = 0.0;
+	double		avgdistinct = 0.0;
+	double		ndistinct = 0.0;
+	bool		all_negative = true;
+	int			slot = 0;
+	ListCell   *lc;
+	int			n;
+
+	foreach(lc, nodestats)
+		totalrows += Max(((RemoteAttStats *) lfirst(lc))->reltuples, 0.0);
+
+	n = 0;
+	foreach(lc, nodestats)
+	{
+		RemoteAttStats *remote = (RemoteAttStats *) lfirst(lc);
+		double		nodedistinct;
+
+		if (totalrows > 0.0)
+			weights[n] = Max(remote->reltuples, 0.0) / totalrows;
+		else
+			weights[n] = 1.0 / nnodes;
+
+		nullfrac += weights[n] * remote->nullfrac;
+		width += weights[n] * remote->width;
+		avgdistinct += weights[n] * remote->distinct;
+
+		if (remote->distinct < 0)
+			nodedistinct = -remote->distinct * Max(remote->reltuples, 0.0);
+		else
+		{
+			nodedistinct = remote->distinct;
+			all_negative = false;
+		}
+		if (distcol)
+			ndistinct += nodedistinct;
+		else
+			ndistinct = Max(ndistinct, nodedistinct);
+		n++;
+	}
+
+	stats->stats_valid = true;
+	stats->stanullfrac = (float4) nullfrac;
+	stats->stawidth = (int32) rint(width);
+	/* Same rule as in compute_scalar_stats() */
+	if (all_negative || totalrows <= 0.0)
+		stats->stadistinct = (float4) avgdistinct;
+	else if (ndistinct > 0.1 * totalrows)
+		stats->stadistinct = (float4) -Min(ndistinct / totalrows, 1.0);
+	else
+		stats->stadistinct = (float4) ndistinct;
+
+	foreach(lc, nodestats)
+	{
+		RemoteAttStats *remote = (RemoteAttStats *) lfirst(lc);
+		int			k;
+
+		for (k = 0; k < STATISTIC_NUM_SLOTS && slot < STATISTIC_NUM_SLOTS; k++)
+		{
+			int			j;
+
+			if (remote->kind[k] == 0)
+				continue;
+
+			/* Already merged */
+			for (j = 0; j < slot; j++)
+				if (stats->stakind[j] == remote->kind[k] &&
+					stats->staop[j] == remote->op[k])
+					break;
+			if (j < slot)
+				continue;
+
+			stats->stakind[slot] = remote->kind[k];
+			stats->staop[slot] = remote->op[k];
+			switch (remote->kind[k])
+			{
+				case STATISTIC_KIND_MCV:
+					merge_remote_mcv(stats, slot, nodestats, weights);
+					break;
+				case STATISTIC_KIND_HISTOGRAM:
+					merge_remote_histogram(stats, slot, nodestats, weights);
+					break;
+				case STATISTIC_KIND_CORRELATION:
+					merge_remote_correlation(stats, slot, nodestats, weights);
+					break;
+				default:
+					copy_remote_stat_slot(stats, slot, remote, k);
+					break;
+			}
+			slot++;
+		}
+	}
+
+	if (distcol && totalrows > 0.0 && slot < STATISTIC_NUM_SLOTS)
+	{
+		float4	   *numbers = (float4 *) palloc(nnodes * sizeof(float4));
+
+		for (n = 0; n < nnodes; n++)
+			numbers[n] = (float4) weights[n];
+		qsort(numbers, nnodes, sizeof(float4), compare_float4_desc);
+
+		stats->stakind[slot] = STATISTIC_KIND_DATANODE_ROWS;
+		stats->staop[slot] = InvalidOid;
+		stats->numnumbers[slot] = nnodes;
+		stats->stanumbers[slot] = numbers;
+		stats->numvalues[slot] = 0;
+		stats->stavalues[slot] = NULL;
+	}
+
+	pfree(weights);
+}
+
+/*
+ * Fetch the statistics of the relation attributes from the datanodes, where
+ * the ANALYZE command has just run, and merge them into the statistics of
+ * the relation.
+ */
 static void
 analyze_rel_coordinator(Relation onerel, bool inh, int attr_cnt,
 						VacAttrStats **vacattrstats)
@@ -2739,8 +3185,9 @@ analyze_rel_coordinator(Relation onerel, bool inh, int attr_cnt,
 	RemoteQueryState *node;
 	TupleTableSlot *result;
 	int 			i;
-	/* Number of data nodes from which attribute statistics are received. */
-	int			   *numnodes;
+	/* Statistics received from the data nodes, per attribute */
+	List		  **nodestats;
+	AttrNumber		distattnum = InvalidAttrNumber;
 
 	/* Get the relation identifier */
 	relname = RelationGetRelationName(onerel);
@@ -2752,9 +3199,7 @@ analyze_rel_coordinator(Relation onerel, bool inh, int attr_cnt,
 	initStringInfo(&query);
 	/* Generic statistic fields */
 	appendStringInfoString(&query, "SELECT s.staattnum, "
-// assume the number of tuples approximately the same on all nodes
-// to build more precise statistics get this number
-//										  "c.reltuples, "
+										  "c.reltuples, "
 										  "s.stanullfrac, "
 										  "s.stawidth, "
 										  "s.stadistinct");
@@ -2809,10 +3254,10 @@ analyze_rel_coordinator(Relation onerel, bool inh, int attr_cnt,
 										 make_relation_tle(StatisticRelationId,
 														   "pg_statistic",
 														   "staattnum"));
-//	step->scan.plan.targetlist = lappend(step->scan.plan.targetlist,
-//										 make_relation_tle(RelationRelationId,
-//														   "pg_class",
-//														   "reltuples"));
+	step->scan.plan.targetlist = lappend(step->scan.plan.targetlist,
+										 make_relation_tle(RelationRelationId,
+														   "pg_class",
+														   "reltuples"));
 	step->scan.plan.targetlist = lappend(step->scan.plan.targetlist,
 										 make_relation_tle(StatisticRelationId,
 														   "pg_statistic",
@@ -2890,9 +3335,11 @@ analyze_rel_coordinator(Relation onerel, bool inh, int attr_cnt,
 	MemoryContextSwitchTo(oldcontext);
 
 	/* get ready to combine results */
-	numnodes = (int *) palloc(attr_cnt * sizeof(int));
-	for (i = 0; i < attr_cnt; i++)
-		numnodes[i] = 0;
+	nodestats = (List **) palloc0(attr_cnt * sizeof(List *));
+	/* Values of one of several distribution columns are not disjoint */
+	if (IsLocatorDistributedByValue(onerel->rd_locator_info->locatorType) &&
+			onerel->rd_locator_info->partAttrNums == NIL)
+		distattnum = onerel->rd_locator_info->partAttrNum;
 
 	result = ExecRemoteQuery(node);
 	PopActiveSnapshot();
@@ -2902,234 +3349,172 @@ analyze_rel_coordinator(Relation onerel, bool inh, int attr_cnt,
 		bool			isnull;
 		int 			colnum = 1;
 		int16			attnum;
-//		float4			reltuples;
-		float4			nullfrac;
-		int32 			width;
-		float4			distinct;
-		VacAttrStats   *stats = NULL;
-
+		RemoteAttStats *remote;
+		int				k;
 
 		/* Process statistics from the data node */
 		value = slot_getattr(result, colnum++, &isnull); /* staattnum */
 		attnum = DatumGetInt16(value);
 		for (i = 0; i < attr_cnt; i++)
 			if (vacattrstats[i]->attr->attnum == attnum)
-			{
-				stats = vacattrstats[i];
-				stats->stats_valid = true;
-				numnodes[i]++;
 				break;
-			}
-
-//		value = slot_getattr(result, colnum++, &isnull); /* reltuples */
-//		reltuples = DatumGetFloat4(value);
 
-		if (stats)
+		if (i >= attr_cnt)
 		{
-			value = slot_getattr(result, colnum++, &isnull); /* stanullfrac */
-			nullfrac = DatumGetFloat4(value);
-			stats->stanullfrac += nullfrac;
-
-			value = slot_getattr(result, colnum++, &isnull); /* stawidth */
-			width = DatumGetInt32(value);
-			stats->stawidth += width;
+			/* fetch next */
+			result = ExecRemoteQuery(node);
+			continue;
+		}
 
-			value = slot_getattr(result, colnum++, &isnull); /* stadistinct */
-			distinct = DatumGetFloat4(value);
-			stats->stadistinct += distinct;
+		remote = (RemoteAttStats *) palloc0(sizeof(RemoteAttStats));
 
-			/* Detailed statistics */
-			for (i = 1; i <= STATISTIC_NUM_SLOTS; i++)
-			{
-				int16 		kind;
-				float4	   *numbers;
-				Datum	   *values;
-				int			nnumbers, nvalues;
-				int 		k;
+		value = slot_getattr(result, colnum++, &isnull); /* reltuples */
+		remote->reltuples = isnull ? 0.0 : DatumGetFloat4(value);
 
-				value = slot_getattr(result, colnum++, &isnull); /* kind */
-				kind = DatumGetInt16(value);
+		value = slot_getattr(result, colnum++, &isnull); /* stanullfrac */
+		remote->nullfrac = DatumGetFloat4(value);
 
-				if (kind == 0)
-				{
-					/*
-					 * Empty slot - skip next 8 fields: 6 fields of the
-					 * operation identifier and two data fields (numbers and
-					 * values)
-					 */
-					colnum += 8;
-					continue;
-				}
-				else
-				{
-					Oid			oprid;
-
-					/* Get operator */
-					value = slot_getattr(result, colnum++, &isnull); /* oprname */
-					if (isnull)
-					{
-						/*
-						 * Operator is not specified for that kind, skip remaining
-						 * fields to lookup the operator
-						 */
-						oprid = InvalidOid;
-						colnum += 5; /* skip operation nsp and types */
-					}
-					else
-					{
-						char	   *oprname;
-						char	   *oprnspname;
-						Oid			ltypid, rtypid;
-						char	   *ltypname,
-								   *rtypname;
-						char	   *ltypnspname,
-								   *rtypnspname;
-						oprname = DatumGetCString(value);
-						value = slot_getattr(result, colnum++, &isnull); /* oprnspname */
-						oprnspname = DatumGetCString(value);
-						/* Get left operand data type */
-						value = slot_getattr(result, colnum++, &isnull); /* typname */
-						ltypname = DatumGetCString(value);
-						value = slot_getattr(result, colnum++, &isnull); /* typnspname */
-						ltypnspname = DatumGetCString(value);
-						ltypid = get_typname_typid(ltypname,
-											   get_namespaceid(ltypnspname));
-						/* Get right operand data type */
-						value = slot_getattr(result, colnum++, &isnull); /* typname */
-						rtypname = DatumGetCString(value);
-						value = slot_getattr(result, colnum++, &isnull); /* typnspname */
-						rtypnspname = DatumGetCString(value);
-						rtypid = get_typname_typid(rtypname,
-											   get_namespaceid(rtypnspname));
-						/* lookup operator */
-						oprid = get_operid(oprname, ltypid, rtypid,
-										   get_namespaceid(oprnspname));
-					}
-					/*
-					 * Look up a statistics slot. If there is an entry of the
-					 * same kind already, leave it, assuming the statistics
-					 * is approximately the same on all nodes, so values from
-					 * one node are representing entire relation well.
-					 * If empty slot is found store values here. If no more
-					 * slots skip remaining values.
-					 */
-					for (k = 0; k < STATISTIC_NUM_SLOTS; k++)
-					{
-						if (stats->stakind[k] == 0 ||
-								(stats->stakind[k] == kind && stats->staop[k] == oprid))
-							break;
-					}
+		value = slot_getattr(result, colnum++, &isnull); /* stawidth */
+		remote->width = DatumGetInt32(value);
 
-					if (k >= STATISTIC_NUM_SLOTS)
-					{
-						/* No empty slots */
-						break;
-					}
+		value = slot_getattr(result, colnum++, &isnull); /* stadistinct */
+		remote->distinct = DatumGetFloat4(value);
 
-					/*
-					 * If it is an existing slot which has numbers or values
-					 * continue to the next set. If slot exists but without
-					 * numbers and values, try to acquire them now
-					 */
-					if (stats->stakind[k] != 0 && (stats->numnumbers[k] > 0 ||
-							stats->numvalues[k] > 0))
-					{
-						colnum += 2; /* skip numbers and values */
-						continue;
-					}
+		/* Detailed statistics */
+		for (k = 0; k < STATISTIC_NUM_SLOTS; k++)
+		{
+			value = slot_getattr(result, colnum++, &isnull); /* kind */
+			remote->kind[k] = DatumGetInt16(value);
 
-					/*
-					 * Initialize slot
-					 */
-					stats->stakind[k] = kind;
-					stats->staop[k] = oprid;
-					stats->numnumbers[k] = 0;
-					stats->stanumbers[k] = NULL;
-					stats->numvalues[k] = 0;
-					stats->stavalues[k] = NULL;
-					stats->statypid[k] = InvalidOid;
-					stats->statyplen[k] = -1;
-					stats->statypalign[k] = 'i';
-					stats->statypbyval[k] = true;
-				}
+			if (remote->kind[k] == 0)
+			{
+				/*
+				 * Empty slot - skip next 8 fields: 6 fields of the
+				 * operation identifier and two data fields (numbers and
+				 * values)
+				 */
+				colnum += 8;
+				continue;
+			}
 
+			/* Get operator */
+			value = slot_getattr(result, colnum++, &isnull); /* oprname */
+			if (isnull)
+			{
+				/*
+				 * Operator is not specified for that kind, skip remaining
+				 * fields to lookup the operator
+				 */
+				remote->op[k] = InvalidOid;
+				colnum += 5; /* skip operation nsp and types */
+			}
+			else
+			{
+				char	   *oprname;
+				char	   *oprnspname;
+				Oid			ltypid, rtypid;
+				char	   *ltypname,
+						   *rtypname;
+				char	   *ltypnspname,
+						   *rtypnspname;
+				oprname = DatumGetCString(value);
+				value = slot_getattr(result, colnum++, &isnull); /* oprnspname */
+				oprnspname = DatumGetCString(value);
+				/* Get left operand data type */
+				value = slot_getattr(result, colnum++, &isnull); /* typname */
+				ltypname = DatumGetCString(value);
+				value = slot_getattr(result, colnum++, &isnull); /* typnspname */
+				ltypnspname = DatumGetCString(value);
+				ltypid = get_typname_typid(ltypname,
+									   get_namespaceid(ltypnspname));
+				/* Get right operand data type */
+				value = slot_getattr(result, colnum++, &isnull); /* typname */
+				rtypname = DatumGetCString(value);
+				value = slot_getattr(result, colnum++, &isnull); /* typnspname */
+				rtypnspname = DatumGetCString(value);
+				rtypid = get_typname_typid(rtypname,
+									   get_namespaceid(rtypnspname));
+				/* lookup operator */
+				remote->op[k] = get_operid(oprname, ltypid, rtypid,
+										   get_namespaceid(oprnspname));
+			}
 
-				/* get numbers */
-				value = slot_getattr(result, colnum++, &isnull); /* numbers */
-				if (!isnull)
-				{
-					ArrayType  *arry = DatumGetArrayTypeP(value);
+			/* get numbers */
+			value = slot_getattr(result, colnum++, &isnull); /* numbers */
+			if (!isnull)
+			{
+				ArrayType  *arry = DatumGetArrayTypeP(value);
+				int			nnumbers;
 
-					/*
-					 * We expect the array to be a 1-D float4 array; verify that. We don't
-					 * need to use deconstruct_array() since the array data is just going
-					 * to look like a C array of float4 values.
-					 */
-					nnumbers = ARR_DIMS(arry)[0];
-					if (ARR_NDIM(arry) != 1 || nnumbers <= 0 ||
-						ARR_HASNULL(arry) ||
-						ARR_ELEMTYPE(arry) != FLOAT4OID)
-						elog(ERROR, "stanumbers is not a 1-D float4 array");
-					numbers = (float4 *) palloc(nnumbers * sizeof(float4));
-					memcpy(numbers, ARR_DATA_PTR(arry),
-						   nnumbers * sizeof(float4));
+				/*
+				 * We expect the array to be a 1-D float4 array; verify that. We don't
+				 * need to use deconstruct_array() since the array data is just going
+				 * to look like a C array of float4 values.
+				 */
+				nnumbers = ARR_DIMS(arry)[0];
+				if (ARR_NDIM(arry) != 1 || nnumbers <= 0 ||
+					ARR_HASNULL(arry) ||
+					ARR_ELEMTYPE(arry) != FLOAT4OID)
+					elog(ERROR, "stanumbers is not a 1-D float4 array");
+				remote->numbers[k] = (float4 *) palloc(nnumbers * sizeof(float4));
+				memcpy(remote->numbers[k], ARR_DATA_PTR(arry),
+					   nnumbers * sizeof(float4));
+				remote->nnumbers[k] = nnumbers;
 
-					/*
-					 * Free arry if it's a detoasted copy.
-					 */
-					if ((Pointer) arry != DatumGetPointer(value))
-						pfree(arry);
+				/*
+				 * Free arry if it's a detoasted copy.
+				 */
+				if ((Pointer) arry != DatumGetPointer(value))
+					pfree(arry);
+			}
+			/* get values */
+			value = slot_getattr(result, colnum++, &isnull); /* values */
+			if (!isnull)
+			{
+				int 		j;
+				ArrayType  *arry;
+				Oid			elmtype;
+				int16		elmlen;
+				bool		elmbyval;
+				char		elmalign;
+				arry = DatumGetArrayTypeP(value);
+				elmtype = ARR_ELEMTYPE(arry);
+				/* We could cache this data, but not clear it's worth it */
+				get_typlenbyvalalign(elmtype, &elmlen, &elmbyval, &elmalign);
+				/* Deconstruct array into Datum elements; NULLs not expected */
+				deconstruct_array(arry, elmtype,
+								  elmlen, elmbyval, elmalign,
+								  &remote->values[k], NULL,
+								  &remote->nvalues[k]);
 
-					stats->numnumbers[k] = nnumbers;
-					stats->stanumbers[k] = numbers;
-				}
-				/* get values */
-				value = slot_getattr(result, colnum++, &isnull); /* values */
-				if (!isnull)
+				/*
+				 * If the element type is pass-by-reference, we now have a bunch of
+				 * Datums that are pointers into the syscache value.  Copy them to
+				 * avoid problems if syscache decides to drop the entry.
+				 */
+				if (!elmbyval)
 				{
-					int 		j;
-					ArrayType  *arry;
-					int16		elmlen;
-					bool		elmbyval;
-					char		elmalign;
-					arry = DatumGetArrayTypeP(value);
-					/* We could cache this data, but not clear it's worth it */
-					get_typlenbyvalalign(ARR_ELEMTYPE(arry),
-										 &elmlen, &elmbyval, &elmalign);
-					/* Deconstruct array into Datum elements; NULLs not expected */
-					deconstruct_array(arry,
-									  ARR_ELEMTYPE(arry),
-									  elmlen, elmbyval, elmalign,
-									  &values, NULL, &nvalues);
-
-					/*
-					 * If the element type is pass-by-reference, we now have a bunch of
-					 * Datums that are pointers into the syscache value.  Copy them to
-					 * avoid problems if syscache decides to drop the entry.
-					 */
-					if (!elmbyval)
-					{
-						for (j = 0; j < nvalues; j++)
-							values[j] = datumCopy(values[j], elmbyval, elmlen);
-					}
-
-					/*
-					 * Free statarray if it's a detoasted copy.
-					 */
-					if ((Pointer) arry != DatumGetPointer(value))
-						pfree(arry);
-
-					stats->numvalues[k] = nvalues;
-					stats->stavalues[k] = values;
-					/* store details about values data type */
-					stats->statypid[k] = ARR_ELEMTYPE(arry);
-					stats->statyplen[k] = elmlen;
-					stats->statypalign[k] = elmalign;
-					stats->statypbyval[k] = elmbyval;
+					for (j = 0; j < remote->nvalues[k]; j++)
+						remote->values[k][j] = datumCopy(remote->values[k][j],
+														 elmbyval, elmlen);
 				}
+
+				/*
+				 * Free statarray if it's a detoasted copy.
+				 */
+				if ((Pointer) arry != DatumGetPointer(value))
+					pfree(arry);
+
+				/* store details about values data type */
+				remote->valtypid[k] = elmtype;
+				remote->valtyplen[k] = elmlen;
+				remote->valtypalign[k] = elmalign;
+				remote->valtypbyval[k] = elmbyval;
 			}
 		}
 
+		nodestats[i] = lappend(nodestats[i], remote);
+
 		/* fetch next */
 		result = ExecRemoteQuery(node);
 	}
@@ -3139,12 +3524,9 @@ analyze_rel_coordinator(Relation onerel, bool inh, int attr_cnt,
 	{
 		VacAttrStats *stats = vacattrstats[i];
 
-		if (numnodes[i] > 0)
-		{
-			stats->stanullfrac /= numnodes[i];
-			stats->stawidth /= numnodes[i];
-			stats->stadistinct /= numnodes[i];
-		}
+		if (nodestats[i] != NIL)
+			merge_remote_stats(stats, nodestats[i],
+							   stats->attr->attnum == distattnum);
 	}
 	update_attstats(RelationGetRelid(onerel), inh, attr_cnt, vacattrstats);
 }
@@ -42,6 +42,9 @@
 #endif
 #include "commands/copy.h"
 #include "commands/defrem.h"
+#ifdef XCP
+#include "commands/matview.h"
+#endif
 #include "commands/trigger.h"
 #include "executor/executor.h"
 #include "libpq/libpq.h"
@@ -54,8 +57,10 @@
 #ifdef PGXC
 #include "pgxc/pgxc.h"
 #include "pgxc/execRemote.h"
+#include "pgxc/globalindex.h"
 #include "pgxc/locator.h"
 #include "pgxc/remotecopy.h"
+#include "pgxc/resultcache.h"
 #include "nodes/nodes.h"
 #include "pgxc/poolmgr.h"
 #include "pgxc/postgresql_fdw.h"
@@ -231,6 +236,8 @@ typedef struct CopyStateData
 #ifdef PGXC
 	/* Remote COPY state data */
 	RemoteCopyData *remoteCopyState;
+	bool		node_files;		/* COPY TO a file on each Datanode? */
+	char	   *node_filename;	/* prefix of the Datanode file names */
 #endif
 } CopyStateData;
 
@@ -340,6 +347,9 @@ static Datum CopyReadBinaryAttribute(CopyState cstate,
 						int column_no, FmgrInfo *flinfo,
 						Oid typioparam, int32 typmod,
 						bool *isnull);
+#ifdef PGXC
+static void CopyForwardBinaryAttribute(CopyState cstate);
+#endif
 static void CopyAttributeOutText(CopyState cstate, char *string);
 static void CopyAttributeOutCSV(CopyState cstate, char *string,
 					bool use_quote, bool single_attr);
@@ -686,6 +696,22 @@ CopyGetData(CopyState cstate, void *databuf, int minread, int maxread)
 							 * sent was COPY.
 							 */
 							goto readmessage;
+#ifdef PGXC
+						case PQ_PACKED_MSG_TYPE:
+
+							/*
+							 * The Coordinator compresses the rows it sends at
+							 * once, see remote_compression_threshold. Go on
+							 * with the unpacked messages.
+							 */
+							if ((IsConnFromCoord() || IsConnFromDatanode()) &&
+								pq_inflatemessage(cstate->fe_msgbuf) == 0)
+								goto readmessage;
+							ereport(ERROR,
+									(errcode(ERRCODE_PROTOCOL_VIOLATION),
+									 errmsg("invalid compressed message during COPY from stdin")));
+							break;
+#endif
 						default:
 							ereport(ERROR,
 									(errcode(ERRCODE_PROTOCOL_VIOLATION),
@@ -1219,6 +1245,16 @@ ProcessCopyOptions(CopyState cstate,
 						 errmsg("argument to option \"%s\" must be a list of column names",
 								defel->defname)));
 		}
+#ifdef PGXC
+		else if (strcmp(defel->defname, "node_files") == 0)
+		{
+			if (cstate->node_files)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("conflicting or redundant options")));
+			cstate->node_files = defGetBoolean(defel);
+		}
+#endif
 		else if (strcmp(defel->defname, "encoding") == 0)
 		{
 			if (cstate->file_encoding >= 0)
@@ -1369,6 +1405,14 @@ ProcessCopyOptions(CopyState cstate,
 				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 				 errmsg("COPY force null only available using COPY FROM")));
 
+#ifdef PGXC
+	/* Check node_files */
+	if (cstate->node_files && is_from)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("COPY node_files only available using COPY TO")));
+#endif
+
 	/* Don't allow the delimiter to appear in the null string. */
 	if (strchr(cstate->null_print, cstate->delim[0]) != NULL)
 		ereport(ERROR,
@@ -1712,7 +1756,7 @@ BeginCopy(bool is_from,
 		 * In the case of CopyOut, it is just necessary to pick up one node randomly.
 		 * This is done when rel_loc is found.
 		 */
-		if (remoteCopyState && remoteCopyState->rel_loc)
+		if (remoteCopyState && remoteCopyState->rel_loc && !cstate->node_files)
 		{
 			DataNodeCopyBegin(remoteCopyState);
 			if (!remoteCopyState->locator)
@@ -1720,6 +1764,29 @@ BeginCopy(bool is_from,
 						(errcode(ERRCODE_CONNECTION_EXCEPTION),
 						 errmsg("Failed to initialize Datanodes for COPY")));
 		}
+
+		/*
+		 * The Datanodes parse the rows they receive anyway, only the
+		 * distribution columns have to be converted here to route the rows.
+		 * Skipping the input functions of the other columns is what keeps
+		 * the Coordinator from being the bottleneck of the load. The binary
+		 * fields of the other columns are forwarded as they are.
+		 */
+		if (is_from && remoteCopyState &&
+				remoteCopyState->rel_loc && !cstate->convert_selectively)
+		{
+			RelationLocInfo *rel_loc = remoteCopyState->rel_loc;
+			ListCell   *cur;
+
+			cstate->convert_select_flags = (bool *) palloc0(num_phys_attrs * sizeof(bool));
+			if (rel_loc->partAttrNums)
+			{
+				foreach(cur, rel_loc->partAttrNums)
+					cstate->convert_select_flags[lfirst_int(cur) - 1] = true;
+			}
+			else if (AttributeNumberIsValid(rel_loc->partAttrNum))
+				cstate->convert_select_flags[rel_loc->partAttrNum - 1] = true;
+		}
 	}
 #endif
 
@@ -1825,6 +1892,31 @@ BeginCopyTo(Relation rel,
 					   options);
 	oldcontext = MemoryContextSwitchTo(cstate->copycontext);
 
+#ifdef PGXC
+	/*
+	 * The Datanodes write the files themselves, nothing is opened here.
+	 */
+	if (cstate->node_files)
+	{
+		if (pipe || is_program)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("COPY node_files only available using COPY TO a file")));
+		if (!is_absolute_path(filename))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_NAME),
+					 errmsg("relative path not allowed for COPY to file")));
+		if (!IS_PGXC_COORDINATOR || cstate->remoteCopyState == NULL ||
+			cstate->remoteCopyState->rel_loc == NULL)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("COPY node_files only available for tables stored on Datanodes")));
+		cstate->node_filename = pstrdup(filename);
+		MemoryContextSwitchTo(oldcontext);
+		return cstate;
+	}
+#endif
+
 	if (pipe)
 	{
 		Assert(!is_program);	/* the grammar does not allow this */
@@ -1893,6 +1985,13 @@ DoCopyTo(CopyState cstate)
 	bool		fe_copy = (pipe && whereToSendOutput == DestRemote);
 	uint64		processed;
 
+#ifdef PGXC
+	if (cstate->node_files)
+		return DataNodeCopyToFiles(cstate->remoteCopyState,
+								   cstate->node_filename,
+								   cstate->header_line);
+#endif
+
 	PG_TRY();
 	{
 		if (fe_copy)
@@ -2388,6 +2487,24 @@ CopyFrom(CopyState cstate)
 							RelationGetRelationName(cstate->rel))));
 	}
 
+#ifdef XCP
+	/* The rules maintaining global indexes do not apply to COPY */
+	if (IS_PGXC_COORDINATOR && RelationHasGlobalIndex(cstate->rel))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot copy to table \"%s\" because it has a global index",
+						RelationGetRelationName(cstate->rel)),
+				 errhint("Use INSERT, or drop the global index and create it again after loading.")));
+	if (IS_PGXC_COORDINATOR && RelationHasMatViewLog(cstate->rel))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot copy to table \"%s\" because it has a materialized view log",
+						RelationGetRelationName(cstate->rel)),
+				 errhint("Use INSERT, or drop the log and create it again after loading.")));
+	if (IS_PGXC_LOCAL_COORDINATOR)
+		ResultCacheRelationModified(cstate->rel);
+#endif
+
 	tupDesc = RelationGetDescr(cstate->rel);
 
 	/*----------
@@ -2563,7 +2680,13 @@ CopyFrom(CopyState cstate)
 			RemoteCopyData 	   *rcstate = cstate->remoteCopyState;
 			AttrNumber			dist_col = rcstate->rel_loc->partAttrNum;
 
-			if (AttributeNumberIsValid(dist_col))
+			if (rcstate->rel_loc->partAttrNums)
+			{
+				value = ComputeDistributionKey(rcstate->rel_loc, tupDesc,
+											   values, nulls);
+				isnull = false;
+			}
+			else if (AttributeNumberIsValid(dist_col))
 			{
 				value = values[dist_col-1];
 				isnull = nulls[dist_col-1];
@@ -3441,6 +3564,16 @@ NextCopyFrom(CopyState cstate, ExprContext *econtext,
 
 			cstate->cur_attname = NameStr(attr[m]->attname);
 			i++;
+#ifdef PGXC
+			if (IS_PGXC_COORDINATOR && cstate->convert_select_flags &&
+				!cstate->convert_select_flags[m])
+			{
+				/* not needed to route the row, leave it NULL */
+				CopyForwardBinaryAttribute(cstate);
+				cstate->cur_attname = NULL;
+				continue;
+			}
+#endif
 			values[m] = CopyReadBinaryAttribute(cstate,
 												i,
 												&in_functions[m],
@@ -4532,6 +4665,42 @@ CopyReadBinaryAttribute(CopyState cstate,
 	return result;
 }
 
+#ifdef PGXC
+/*
+ * Append a binary attribute to the data row sent to the Datanodes without
+ * converting it, the bytes are read straight into the row.
+ */
+static void
+CopyForwardBinaryAttribute(CopyState cstate)
+{
+	int32		fld_size;
+	int32		nSize;
+
+	if (!CopyGetInt32(cstate, &fld_size))
+		ereport(ERROR,
+				(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+				 errmsg("unexpected EOF in COPY data")));
+	if (fld_size < -1)
+		ereport(ERROR,
+				(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+				 errmsg("invalid field size")));
+
+	nSize = htonl(fld_size);
+	appendBinaryStringInfo(&cstate->line_buf, (char *) &nSize, sizeof(int32));
+	if (fld_size <= 0)
+		return;
+
+	enlargeStringInfo(&cstate->line_buf, fld_size);
+	if (CopyGetData(cstate, cstate->line_buf.data + cstate->line_buf.len,
+					fld_size, fld_size) != fld_size)
+		ereport(ERROR,
+				(errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+				 errmsg("unexpected EOF in COPY data")));
+	cstate->line_buf.len += fld_size;
+	cstate->line_buf.data[cstate->line_buf.len] = '\0';
+}
+#endif
+
 /*
  * Send text representation of one attribute, with conversion and escaping
  */
@@ -4941,6 +5110,7 @@ GetRemoteCopyOptions(CopyState cstate)
 		res->rco_force_quote = list_copy(cstate->force_quote);
 	if (cstate->force_notnull)
 		res->rco_force_notnull = list_copy(cstate->force_notnull);
+	res->rco_freeze = cstate->freeze;
 
 	return res;
 }
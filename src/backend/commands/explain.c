@@ -45,6 +45,9 @@
 #include "pgxc/pgxcnode.h"
 #include "pgxc/planner.h"
 #endif
+#ifdef XCP
+#include "pgxc/execRemote.h"
+#endif
 
 /* Hook for plugins to get control in ExplainOneQuery() */
 ExplainOneQuery_hook_type ExplainOneQuery_hook = NULL;
@@ -107,6 +110,9 @@ static void show_sortorder_options(StringInfo buf, Node *sortexpr,
 					   Oid sortOperator, Oid collation, bool nullsFirst);
 static void show_sort_info(SortState *sortstate, ExplainState *es);
 static void show_hash_info(HashState *hashstate, ExplainState *es);
+static void show_resultcache_info(ResultCacheState *rcstate, List *ancestors,
+					  ExplainState *es);
+static void show_hashagg_info(AggState *aggstate, ExplainState *es);
 static void show_tidbitmap_info(BitmapHeapScanState *planstate,
 					ExplainState *es);
 static void show_instrumentation_count(const char *qlabel, int which,
@@ -139,6 +145,10 @@ static void ExplainExecNodes(ExecNodes *en, ExplainState *es);
 static void ExplainRemoteQuery(RemoteQuery *plan, PlanState *planstate,
 								List *ancestors, ExplainState *es);
 #endif
+#ifdef XCP
+static void show_remote_instrumentation(ResponseCombiner *combiner,
+							ExplainState *es);
+#endif
 static void ExplainXMLTag(const char *tagname, int flags, ExplainState *es);
 static void ExplainJSONLineEnding(ExplainState *es);
 static void ExplainYAMLLineStarting(ExplainState *es);
@@ -1029,8 +1039,14 @@ ExplainNode(PlanState *planstate, List *ancestors,
 		case T_Material:
 			pname = sname = "Materialize";
 			break;
+		case T_ResultCache:
+			pname = sname = "Result Cache";
+			break;
 		case T_Sort:
-			pname = sname = "Sort";
+			if (((Sort *) plan)->numPresorted > 0)
+				pname = sname = "Incremental Sort";
+			else
+				pname = sname = "Sort";
 			break;
 		case T_Group:
 			pname = sname = "Group";
@@ -1102,6 +1118,9 @@ ExplainNode(PlanState *planstate, List *ancestors,
 		case T_Limit:
 			pname = sname = "Limit";
 			break;
+		case T_Gather:
+			pname = sname = "Gather";
+			break;
 		case T_Hash:
 			pname = sname = "Hash";
 			break;
@@ -1482,7 +1501,7 @@ ExplainNode(PlanState *planstate, List *ancestors,
 				{
 					if (list_length(rsubplan->distributionNodes) > 0)
 					{
-						char 		label[24];
+						char 		label[32];
 						AttrNumber 	dkey = rsubplan->distributionKey;
 						sprintf(label, "Distribute results by %c",
 								rsubplan->distributionType);
@@ -1502,8 +1521,26 @@ ExplainNode(PlanState *planstate, List *ancestors,
 												planstate, ancestors,
 												false, es);
 						}
+						if (rsubplan->adaptiveKey != InvalidAttrNumber &&
+								plan->targetlist)
+						{
+							TargetEntry *tle;
+
+							tle = (TargetEntry *) list_nth(plan->targetlist,
+												rsubplan->adaptiveKey - 1);
+							snprintf(label, sizeof(label),
+									 "After %d rows by %c",
+									 rsubplan->adaptiveRows,
+									 rsubplan->adaptiveType);
+							show_expression((Node *) tle->expr, label,
+											planstate, ancestors,
+											false, es);
+						}
 					}
 				}
+				if (es->analyze)
+					show_remote_instrumentation((ResponseCombiner *) planstate,
+												es);
 			}
 			break;
 #endif
@@ -1632,6 +1669,8 @@ ExplainNode(PlanState *planstate, List *ancestors,
 			if (plan->qual)
 				show_instrumentation_count("Rows Removed by Filter", 1,
 										   planstate, es);
+			if (es->analyze)
+				show_hashagg_info((AggState *) planstate, es);
 			break;
 		case T_Group:
 			show_group_keys((GroupState *) planstate, ancestors, es);
@@ -1663,6 +1702,10 @@ ExplainNode(PlanState *planstate, List *ancestors,
 		case T_Hash:
 			show_hash_info((HashState *) planstate, es);
 			break;
+		case T_ResultCache:
+			show_resultcache_info((ResultCacheState *) planstate, ancestors,
+								  es);
+			break;
 		default:
 			break;
 	}
@@ -1996,6 +2039,11 @@ show_sort_keys(SortState *sortstate, List *ancestors, ExplainState *es)
 						 plan->sortOperators, plan->collations,
 						 plan->nullsFirst,
 						 ancestors, es);
+	show_sort_group_keys((PlanState *) sortstate, "Presorted Key",
+						 plan->numPresorted, plan->sortColIdx,
+						 plan->sortOperators, plan->collations,
+						 plan->nullsFirst,
+						 ancestors, es);
 }
 
 /*
@@ -2273,8 +2321,29 @@ static void
 show_sort_info(SortState *sortstate, ExplainState *es)
 {
 	Assert(IsA(sortstate, SortState));
-	if (es->analyze && sortstate->sort_Done &&
-		sortstate->tuplesortstate != NULL)
+	if (es->analyze && sortstate->presorted > 0 && sortstate->sort_Done)
+	{
+		if (es->format == EXPLAIN_FORMAT_TEXT)
+		{
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			appendStringInfo(es->str,
+							 "Sort Method: %s  Batches: %ld  Peak %s: %ldkB\n",
+							 sortstate->incr_method, sortstate->incr_batches,
+							 sortstate->incr_spaceType,
+							 sortstate->incr_spaceUsed);
+		}
+		else
+		{
+			ExplainPropertyText("Sort Method", sortstate->incr_method, es);
+			ExplainPropertyLong("Sort Batches", sortstate->incr_batches, es);
+			ExplainPropertyLong("Peak Sort Space Used",
+								sortstate->incr_spaceUsed, es);
+			ExplainPropertyText("Sort Space Type",
+								sortstate->incr_spaceType, es);
+		}
+	}
+	else if (es->analyze && sortstate->sort_Done &&
+			 sortstate->tuplesortstate != NULL)
 	{
 		Tuplesortstate *state = (Tuplesortstate *) sortstate->tuplesortstate;
 		const char *sortMethod;
@@ -2346,6 +2415,81 @@ show_hash_info(HashState *hashstate, ExplainState *es)
 	}
 }
 
+/*
+ * Show the key of a result cache and, if it's EXPLAIN ANALYZE, how well
+ * the cache did.
+ */
+static void
+show_resultcache_info(ResultCacheState *rcstate, List *ancestors,
+					  ExplainState *es)
+{
+	ResultCache *plan = (ResultCache *) rcstate->ps.plan;
+	List	   *context;
+	List	   *result = NIL;
+	bool		useprefix;
+	ListCell   *lc;
+
+	/* Set up deparsing context */
+	context = set_deparse_context_planstate(es->deparse_cxt,
+											(Node *) rcstate,
+											ancestors);
+	useprefix = (list_length(es->rtable) > 1 || es->verbose);
+
+	foreach(lc, plan->param_exprs)
+		result = lappend(result,
+						 deparse_expression((Node *) lfirst(lc), context,
+											useprefix, false));
+
+	ExplainPropertyList("Cache Key", result, es);
+
+	if (!es->analyze)
+		return;
+
+	if (es->format != EXPLAIN_FORMAT_TEXT)
+	{
+		ExplainPropertyLong("Cache Hits", rcstate->hits, es);
+		ExplainPropertyLong("Cache Misses", rcstate->misses, es);
+		ExplainPropertyLong("Cache Evictions", rcstate->evictions, es);
+		ExplainPropertyLong("Cache Overflows", rcstate->overflows, es);
+		ExplainPropertyLong("Peak Memory Usage",
+							(rcstate->mem_peak + 1023) / 1024, es);
+	}
+	else
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str,
+						 "Hits: %ld  Misses: %ld  Evictions: %ld  Overflows: %ld  Memory Usage: %ldkB\n",
+						 rcstate->hits, rcstate->misses, rcstate->evictions,
+						 rcstate->overflows,
+						 (long) ((rcstate->mem_peak + 1023) / 1024));
+	}
+}
+
+/*
+ * Show the batches and memory used by a hashed aggregation
+ */
+static void
+show_hashagg_info(AggState *aggstate, ExplainState *es)
+{
+	Agg		   *agg = (Agg *) aggstate->ss.ps.plan;
+	long		memPeakKb = (aggstate->hash_mem_peak + 1023) / 1024;
+
+	if (agg->aggstrategy != AGG_HASHED || aggstate->hash_nbatches == 0)
+		return;
+
+	if (es->format != EXPLAIN_FORMAT_TEXT)
+	{
+		ExplainPropertyLong("Hash Batches", aggstate->hash_nbatches, es);
+		ExplainPropertyLong("Peak Memory Usage", memPeakKb, es);
+	}
+	else
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str, "Batches: %d  Memory Usage: %ldkB\n",
+						 aggstate->hash_nbatches, memPeakKb);
+	}
+}
+
 /*
  * If it's EXPLAIN ANALYZE, show exact/lossy pages for a BitmapHeapScan node
  */
@@ -2372,6 +2516,112 @@ show_tidbitmap_info(BitmapHeapScanState *planstate, ExplainState *es)
 	}
 }
 
+#ifdef XCP
+/*
+ * If it's EXPLAIN ANALYZE, show how the fragment under a RemoteSubplan went
+ * on the remote nodes: the least, average and most rows and time of a node,
+ * and the buffers of all the nodes together. Nodes which did not run the
+ * fragment to the end have not reported anything.
+ */
+static void
+show_remote_instrumentation(ResponseCombiner *combiner, ExplainState *es)
+{
+	RemoteInstrumentation *slowest = NULL;
+	ListCell   *lc;
+	int			nnodes = list_length(combiner->remote_instr);
+	double		min_rows = 0;
+	double		max_rows = 0;
+	double		sum_rows = 0;
+	double		min_time = 0;
+	double		sum_time = 0;
+	long		shared_blks_hit = 0;
+	long		shared_blks_read = 0;
+	long		temp_blks_written = 0;
+
+	if (nnodes == 0)
+		return;
+
+	foreach(lc, combiner->remote_instr)
+	{
+		RemoteInstrumentation *instr = (RemoteInstrumentation *) lfirst(lc);
+
+		if (slowest == NULL || instr->ntuples < min_rows)
+			min_rows = instr->ntuples;
+		if (slowest == NULL || instr->ntuples > max_rows)
+			max_rows = instr->ntuples;
+		if (slowest == NULL || instr->total < min_time)
+			min_time = instr->total;
+		if (slowest == NULL || instr->total > slowest->total)
+			slowest = instr;
+		sum_rows += instr->ntuples;
+		sum_time += instr->total;
+		shared_blks_hit += instr->shared_blks_hit;
+		shared_blks_read += instr->shared_blks_read;
+		temp_blks_written += instr->temp_blks_written;
+	}
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str,
+						 "Remote Rows: min=%.0f avg=%.0f max=%.0f nodes=%d\n",
+						 min_rows, sum_rows / nnodes, max_rows, nnodes);
+		if (es->timing)
+		{
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			appendStringInfo(es->str,
+							 "Remote Time: min=%.3f avg=%.3f max=%.3f slowest=%s\n",
+							 1000.0 * min_time, 1000.0 * sum_time / nnodes,
+							 1000.0 * slowest->total,
+							 get_pgxc_nodename(slowest->nodeoid));
+		}
+		if (es->buffers &&
+			(shared_blks_hit > 0 || shared_blks_read > 0 ||
+			 temp_blks_written > 0))
+		{
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			appendStringInfoString(es->str, "Remote Buffers:");
+			if (shared_blks_hit > 0 || shared_blks_read > 0)
+			{
+				appendStringInfoString(es->str, " shared");
+				if (shared_blks_hit > 0)
+					appendStringInfo(es->str, " hit=%ld", shared_blks_hit);
+				if (shared_blks_read > 0)
+					appendStringInfo(es->str, " read=%ld", shared_blks_read);
+			}
+			if (temp_blks_written > 0)
+				appendStringInfo(es->str, " temp written=%ld",
+								 temp_blks_written);
+			appendStringInfoChar(es->str, '\n');
+		}
+	}
+	else
+	{
+		ExplainPropertyInteger("Remote Nodes", nnodes, es);
+		ExplainPropertyFloat("Remote Rows Min", min_rows, 0, es);
+		ExplainPropertyFloat("Remote Rows Avg", sum_rows / nnodes, 0, es);
+		ExplainPropertyFloat("Remote Rows Max", max_rows, 0, es);
+		if (es->timing)
+		{
+			ExplainPropertyFloat("Remote Time Min", 1000.0 * min_time, 3, es);
+			ExplainPropertyFloat("Remote Time Avg",
+								 1000.0 * sum_time / nnodes, 3, es);
+			ExplainPropertyFloat("Remote Time Max",
+								 1000.0 * slowest->total, 3, es);
+			ExplainPropertyText("Slowest Node",
+								get_pgxc_nodename(slowest->nodeoid), es);
+		}
+		if (es->buffers)
+		{
+			ExplainPropertyLong("Remote Shared Hit Blocks", shared_blks_hit, es);
+			ExplainPropertyLong("Remote Shared Read Blocks", shared_blks_read, es);
+			ExplainPropertyLong("Remote Temp Written Blocks", temp_blks_written,
+								es);
+		}
+	}
+}
+#endif
+
 /*
  * If it's EXPLAIN ANALYZE, show instrumentation information for a plan node
  *
@@ -557,6 +557,10 @@ DefineIndex(Oid relationId,
 				break;
 			}
 
+			/* All the columns of a multi-column distribution are checked below */
+			if (rel->rd_locator_info->partAttrNums)
+				break;
+
 			if (CheckLocalIndexColumn(rel->rd_locator_info->locatorType, 
 				rel->rd_locator_info->partAttrName, key->name))
 			{
@@ -564,6 +568,31 @@ DefineIndex(Oid relationId,
 				break;
 			}
 		}
+		if (rel->rd_locator_info && rel->rd_locator_info->partAttrNums)
+		{
+			ListCell   *lc;
+
+			isSafe = true;
+			foreach(lc, rel->rd_locator_info->partAttrNums)
+			{
+				char	   *attname = get_attname(RelationGetRelid(rel),
+												  lfirst_int(lc));
+				bool		found = false;
+
+				foreach(elem, stmt->indexParams)
+				{
+					IndexElem  *key = (IndexElem *) lfirst(elem);
+
+					if (key->name && strcmp(key->name, attname) == 0)
+					{
+						found = true;
+						break;
+					}
+				}
+				if (!found)
+					isSafe = false;
+			}
+		}
 		if (!isSafe)
 		{
 			if (loose_constraints)
@@ -14,6 +14,9 @@
  */
 #include "postgres.h"
 
+#ifdef XCP
+#include "access/genam.h"
+#endif
 #include "access/htup_details.h"
 #include "access/multixact.h"
 #include "access/xact.h"
@@ -22,6 +25,12 @@
 #include "catalog/indexing.h"
 #include "catalog/namespace.h"
 #include "catalog/pg_operator.h"
+#ifdef XCP
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_namespace.h"
+#include "catalog/pg_rewrite.h"
+#include "commands/defrem.h"
+#endif
 #include "commands/cluster.h"
 #include "commands/matview.h"
 #include "commands/tablecmds.h"
@@ -31,16 +40,34 @@
 #endif
 #include "executor/executor.h"
 #include "executor/spi.h"
+#ifdef XCP
+#include "mb/pg_wchar.h"
+#endif
 #include "miscadmin.h"
 #ifdef PGXC
 #include "nodes/makefuncs.h"
 #endif
+#ifdef XCP
+#include "optimizer/tlist.h"
+#include "parser/parse_oper.h"
+#include "parser/parsetree.h"
+#endif
 #include "parser/parse_relation.h"
+#ifdef XCP
+#include "pgxc/pgxc.h"
+#include "pgxc/redistrib.h"
+#include "rewrite/prs2lock.h"
+#include "rewrite/rewriteDefine.h"
+#endif
 #include "rewrite/rewriteHandler.h"
 #include "storage/lmgr.h"
 #include "storage/smgr.h"
 #include "tcop/tcopprot.h"
+#include "utils/acl.h"
 #include "utils/builtins.h"
+#ifdef XCP
+#include "utils/fmgroids.h"
+#endif
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/snapmgr.h"
@@ -78,6 +105,18 @@ static void refresh_by_heap_swap(Oid matviewOid, Oid OIDNewHeap, char relpersist
 static void OpenMatViewIncrementalMaintenance(void);
 static void CloseMatViewIncrementalMaintenance(void);
 
+#ifdef XCP
+static bool matview_get_log(Relation matviewRel, Query *dataQuery, Oid *relid,
+				Oid *inslogid, Oid *dellogid);
+static const char *matview_log_check_query(Query *query, Oid relid,
+						bool *iskey, AttrNumber *countattno);
+static void matview_lock_log(Oid inslogid, Oid dellogid);
+static void refresh_by_matview_log(Oid matviewOid, Query *dataQuery,
+					   Oid relid, Oid inslogid, Oid dellogid, bool *iskey,
+					   AttrNumber countattno, Oid relowner,
+					   int save_sec_context);
+#endif
+
 /*
  * SetMatViewPopulatedState
  *		Mark a materialized view as populated, or not.
@@ -160,6 +199,13 @@ ExecRefreshMatView(RefreshMatViewStmt *stmt, const char *queryString,
 	int			save_sec_context;
 	int			save_nestlevel;
 	ObjectAddress address;
+#ifdef XCP
+	bool		populated;
+	bool		haslog;
+	Oid			logrelid = InvalidOid;
+	Oid			inslogid = InvalidOid;
+	Oid			dellogid = InvalidOid;
+#endif
 
 	/* Determine strength of lock needed. */
 	concurrent = stmt->concurrent;
@@ -238,6 +284,12 @@ ExecRefreshMatView(RefreshMatViewStmt *stmt, const char *queryString,
 	 */
 	CheckTableNotInUse(matviewRel, "REFRESH MATERIALIZED VIEW");
 
+#ifdef XCP
+	populated = RelationIsPopulated(matviewRel);
+	haslog = matview_get_log(matviewRel, dataQuery, &logrelid, &inslogid,
+							 &dellogid);
+#endif
+
 	/*
 	 * Tentatively mark the matview as populated or not (this will roll back
 	 * if we fail later).
@@ -257,6 +309,52 @@ ExecRefreshMatView(RefreshMatViewStmt *stmt, const char *queryString,
 						   save_sec_context | SECURITY_LOCAL_USERID_CHANGE);
 	save_nestlevel = NewGUCNestLevel();
 
+#ifdef XCP
+	if (haslog)
+	{
+		bool	   *iskey;
+		AttrNumber	countattno;
+
+		/* The other Coordinators run under the lock of this one */
+		if (IS_PGXC_LOCAL_COORDINATOR)
+			matview_lock_log(inslogid, dellogid);
+
+		/*
+		 * Apply the changes logged if the view has its contents of the last
+		 * refresh. CONCURRENTLY recomputes it entirely.
+		 */
+		iskey = (bool *) palloc0(sizeof(bool) * RelationGetNumberOfAttributes(matviewRel));
+		if (populated && !concurrent && !stmt->skipData &&
+			matview_log_check_query(dataQuery, logrelid, iskey,
+									&countattno) == NULL)
+		{
+			int			old_depth = matview_maintenance_depth;
+
+			heap_close(matviewRel, NoLock);
+
+			PG_TRY();
+			{
+				refresh_by_matview_log(matviewOid, dataQuery, logrelid,
+									   inslogid, dellogid, iskey, countattno,
+									   relowner, save_sec_context);
+			}
+			PG_CATCH();
+			{
+				matview_maintenance_depth = old_depth;
+				PG_RE_THROW();
+			}
+			PG_END_TRY();
+			Assert(matview_maintenance_depth == old_depth);
+
+			AtEOXact_GUC(false, save_nestlevel);
+			SetUserIdAndSecContext(save_userid, save_sec_context);
+			ObjectAddressSet(address, RelationRelationId, matviewOid);
+			return address;
+		}
+		pfree(iskey);
+	}
+#endif
+
 	/* Concurrent refresh builds new data in temp tablespace, and does diff. */
 	if (concurrent)
 	{
@@ -847,3 +945,708 @@ CloseMatViewIncrementalMaintenance(void)
 	matview_maintenance_depth--;
 	Assert(matview_maintenance_depth >= 0);
 }
+
+#ifdef XCP
+/*
+ * Incremental refresh of materialized views
+ *
+ * Refreshing a view aggregating a large distributed table recomputes it all,
+ * even when few rows changed.  A materialized view log records the rows
+ * inserted and deleted in one table of the query since the last refresh, in
+ * two tables distributed like it.  The rules of the logged table maintaining
+ * them run in the transactions changing it.
+ *
+ * REFRESH then runs the query of the view over the logs instead of the
+ * table: the Datanodes aggregate the changes they store, in parallel, and
+ * the Coordinator merges the groups changed with those of the view.  This
+ * works for grouped queries whose columns are grouping columns, count() or
+ * sum(), and having a count(*), whose groups are then the sums of those of
+ * the rows logged.  The other tables joined are assumed unchanged.
+ *
+ * The logs are recognized by the names of the rules, made of the name of
+ * the view, which exist on all the Coordinators.  The Coordinator running
+ * REFRESH locks the logs, and empties them once the view is refreshed on
+ * all the Coordinators.
+ */
+#define MATVIEW_LOG_INSERT_RULE		"_MVLOG_INS_"
+#define MATVIEW_LOG_UPDATE_RULE		"_MVLOG_UPD_"
+#define MATVIEW_LOG_DELETE_RULE		"_MVLOG_DEL_"
+
+/*
+ * matview_log_rulename
+ *	Name of a rule maintaining the log of a materialized view.
+ */
+static void
+matview_log_rulename(char *rulename, const char *prefix,
+					 const char *matviewname)
+{
+	char	   *name = psprintf("%s%s", prefix, matviewname);
+	int			len = pg_mbcliplen(name, strlen(name), NAMEDATALEN - 1);
+
+	memcpy(rulename, name, len);
+	rulename[len] = '\0';
+	pfree(name);
+}
+
+/*
+ * matview_log_rule_target
+ *	Table into which an action of a log rule of a relation inserts the rows,
+ *	InvalidOid if the rule is missing or not applied any more.
+ */
+static Oid
+matview_log_rule_target(Relation rel, const char *rulename, int nactions,
+						int action)
+{
+	HeapTuple	tuple;
+	Oid			ruleid;
+	int			i;
+
+	if (rel->rd_rules == NULL)
+		return InvalidOid;
+
+	tuple = SearchSysCache2(RULERELNAME,
+							ObjectIdGetDatum(RelationGetRelid(rel)),
+							CStringGetDatum(rulename));
+	if (!HeapTupleIsValid(tuple))
+		return InvalidOid;
+	ruleid = HeapTupleGetOid(tuple);
+	ReleaseSysCache(tuple);
+
+	for (i = 0; i < rel->rd_rules->numLocks; i++)
+	{
+		RewriteRule *rule = rel->rd_rules->rules[i];
+		Query	   *query;
+
+		if (rule->ruleId != ruleid)
+			continue;
+
+		if (rule->enabled == RULE_DISABLED || rule->isInstead ||
+			rule->qual != NULL || list_length(rule->actions) != nactions)
+			return InvalidOid;
+		query = (Query *) list_nth(rule->actions, action);
+		if (query->commandType != CMD_INSERT || query->resultRelation == 0)
+			return InvalidOid;
+		return rt_fetch(query->resultRelation, query->rtable)->relid;
+	}
+	return InvalidOid;
+}
+
+/*
+ * matview_log_columns_valid
+ *	Do the columns of a log still have the numbers of those of the logged
+ *	relation? The query of the view is run on the log as is.
+ */
+static bool
+matview_log_columns_valid(Relation rel, Oid logid)
+{
+	Relation	logrel = heap_open(logid, AccessShareLock);
+	TupleDesc	tupdesc = RelationGetDescr(rel);
+	TupleDesc	logtupdesc = RelationGetDescr(logrel);
+	bool		valid = logtupdesc->natts <= tupdesc->natts;
+	int			i;
+
+	for (i = 0; valid && i < logtupdesc->natts; i++)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[i];
+		Form_pg_attribute logattr = logtupdesc->attrs[i];
+
+		valid = !attr->attisdropped && !logattr->attisdropped &&
+			attr->atttypid == logattr->atttypid &&
+			strcmp(NameStr(attr->attname), NameStr(logattr->attname)) == 0;
+	}
+
+	heap_close(logrel, NoLock);
+	return valid;
+}
+
+/*
+ * matview_get_log
+ *	Find the relation logged for a materialized view, and its logs. Return
+ *	false if the view has no log, or if it is not maintained any more.
+ */
+static bool
+matview_get_log(Relation matviewRel, Query *dataQuery, Oid *relid,
+				Oid *inslogid, Oid *dellogid)
+{
+	char		insrule[NAMEDATALEN];
+	char		updrule[NAMEDATALEN];
+	char		delrule[NAMEDATALEN];
+	ListCell   *lc;
+
+	matview_log_rulename(insrule, MATVIEW_LOG_INSERT_RULE,
+						 RelationGetRelationName(matviewRel));
+	matview_log_rulename(updrule, MATVIEW_LOG_UPDATE_RULE,
+						 RelationGetRelationName(matviewRel));
+	matview_log_rulename(delrule, MATVIEW_LOG_DELETE_RULE,
+						 RelationGetRelationName(matviewRel));
+
+	foreach(lc, dataQuery->rtable)
+	{
+		RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+		Relation	rel;
+		Oid			insid;
+		Oid			delid;
+		bool		valid;
+
+		if (rte->rtekind != RTE_RELATION ||
+			rte->relid == RelationGetRelid(matviewRel))
+			continue;
+
+		rel = relation_open(rte->relid, AccessShareLock);
+		insid = matview_log_rule_target(rel, insrule, 1, 0);
+		if (!OidIsValid(insid))
+		{
+			relation_close(rel, AccessShareLock);
+			continue;
+		}
+
+		delid = matview_log_rule_target(rel, delrule, 1, 0);
+		valid = OidIsValid(delid) &&
+			matview_log_rule_target(rel, updrule, 2, 0) == delid &&
+			matview_log_rule_target(rel, updrule, 2, 1) == insid &&
+			matview_log_columns_valid(rel, insid) &&
+			matview_log_columns_valid(rel, delid);
+		relation_close(rel, NoLock);
+
+		if (!valid)
+			return false;
+		*relid = rte->relid;
+		*inslogid = insid;
+		*dellogid = delid;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * matview_log_check_query
+ *	Can the query of a materialized view be run over the logs of a relation
+ *	to maintain the view? Return NULL if so, setting which columns are the
+ *	grouping columns and which one has the count of rows of the groups, and
+ *	the reason otherwise.
+ */
+static const char *
+matview_log_check_query(Query *query, Oid relid, bool *iskey,
+						AttrNumber *countattno)
+{
+	ListCell   *lc;
+	int			nlogged = 0;
+
+	*countattno = InvalidAttrNumber;
+
+	if (query->commandType != CMD_SELECT || !query->hasAggs ||
+		query->groupClause == NIL || query->groupingSets != NIL)
+		return gettext_noop("The query has no GROUP BY clause.");
+	if (query->havingQual != NULL || query->distinctClause != NIL ||
+		query->hasWindowFuncs || query->setOperations != NULL ||
+		query->cteList != NIL || query->hasSubLinks ||
+		query->limitCount != NULL || query->limitOffset != NULL ||
+		query->hasForUpdate)
+		return gettext_noop("The query has a HAVING, DISTINCT, WITH, LIMIT or FOR UPDATE clause, a subquery, a window function or a set operation.");
+
+	foreach(lc, query->rtable)
+	{
+		RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+
+		if (rte->rtekind == RTE_RELATION && rte->relid == relid)
+			nlogged++;
+		else if (rte->rtekind == RTE_SUBQUERY || rte->rtekind == RTE_CTE)
+			return gettext_noop("The query has a subquery.");
+		else if (rte->rtekind == RTE_JOIN && rte->jointype != JOIN_INNER)
+			return gettext_noop("The query has an outer join.");
+	}
+	if (nlogged != 1)
+		return gettext_noop("The relation is not scanned exactly once by the query.");
+
+	foreach(lc, query->groupClause)
+	{
+		SortGroupClause *sgc = (SortGroupClause *) lfirst(lc);
+		TargetEntry *tle = get_sortgroupclause_tle(sgc, query->targetList);
+
+		if (tle->resjunk)
+			return gettext_noop("A grouping expression is not a column of the view.");
+		iskey[tle->resno - 1] = true;
+	}
+
+	foreach(lc, query->targetList)
+	{
+		TargetEntry *tle = (TargetEntry *) lfirst(lc);
+		Aggref	   *aggref = (Aggref *) tle->expr;
+		char	   *aggname;
+
+		if (tle->resjunk || iskey[tle->resno - 1])
+			continue;
+
+		if (!IsA(aggref, Aggref) || aggref->aggkind != AGGKIND_NORMAL ||
+			aggref->aggdistinct != NIL || aggref->aggorder != NIL ||
+			aggref->aggfilter != NULL ||
+			get_func_namespace(aggref->aggfnoid) != PG_CATALOG_NAMESPACE)
+			return gettext_noop("A column of the view is neither a grouping column nor count() or sum().");
+
+		aggname = get_func_name(aggref->aggfnoid);
+		if (strcmp(aggname, "count") == 0)
+		{
+			if (aggref->aggstar && *countattno == InvalidAttrNumber)
+				*countattno = tle->resno;
+		}
+		else if (strcmp(aggname, "sum") != 0)
+			return gettext_noop("A column of the view is neither a grouping column nor count() or sum().");
+
+		/* The deleted rows are added negated */
+		if (!OidIsValid(LookupOperName(NULL, list_make1(makeString("-")),
+									   InvalidOid, aggref->aggtype,
+									   true, -1)))
+			return gettext_noop("The result of an aggregate of the view can not be negated.");
+	}
+
+	if (*countattno == InvalidAttrNumber)
+		return gettext_noop("The view has no count(*) column.");
+	return NULL;
+}
+
+/*
+ * matview_log_delta_query
+ *	Text of the query of the view, run over a log of the relation.
+ */
+static char *
+matview_log_delta_query(Query *dataQuery, Oid relid, Oid logid)
+{
+	Query	   *query = copyObject(dataQuery);
+	StringInfoData buf;
+	ListCell   *lc;
+
+	foreach(lc, query->rtable)
+	{
+		RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+
+		if (rte->rtekind == RTE_RELATION && rte->relid == relid)
+			rte->relid = logid;
+	}
+
+	initStringInfo(&buf);
+	deparse_query(query, &buf, NIL);
+	return buf.data;
+}
+
+/*
+ * matview_log_execute
+ *	Run a command maintaining a materialized view from its logs.
+ */
+static void
+matview_log_execute(const char *sql, int expected)
+{
+	if (SPI_exec(sql, 0) != expected)
+		elog(ERROR, "SPI_exec failed: %s", sql);
+}
+
+/*
+ * matview_lock_log
+ *	Stop the changes of the logged relation until the end of the refresh, on
+ *	all the nodes, so none is lost when the logs are emptied.
+ */
+static void
+matview_lock_log(Oid inslogid, Oid dellogid)
+{
+	char	   *sql;
+
+	sql = psprintf("LOCK TABLE %s, %s IN EXCLUSIVE MODE",
+				   quote_qualified_identifier(
+						get_namespace_name(get_rel_namespace(inslogid)),
+						get_rel_name(inslogid)),
+				   quote_qualified_identifier(
+						get_namespace_name(get_rel_namespace(dellogid)),
+						get_rel_name(dellogid)));
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+	matview_log_execute(sql, SPI_OK_UTILITY);
+	if (SPI_finish() != SPI_OK_FINISH)
+		elog(ERROR, "SPI_finish failed");
+	pfree(sql);
+}
+
+/*
+ * refresh_by_matview_log
+ *	Apply the changes logged to the groups of the materialized view.
+ *
+ * The changes of the groups are collected in a temporary table, the rows
+ * inserted counting positively and the rows deleted negatively. Every group
+ * changed is then replaced by its sum with the old one, unless no row is
+ * left in it.
+ */
+static void
+refresh_by_matview_log(Oid matviewOid, Query *dataQuery, Oid relid,
+					   Oid inslogid, Oid dellogid, bool *iskey,
+					   AttrNumber countattno, Oid relowner,
+					   int save_sec_context)
+{
+	StringInfoData querybuf;
+	StringInfoData collist;
+	StringInfoData deltalist;
+	StringInfoData mergelist;
+	StringInfoData keylist;
+	StringInfoData keyqual;
+	Relation	matviewRel;
+	TupleDesc	tupdesc;
+	char	   *matviewname;
+	char	   *deltaname;
+	char	   *newname;
+	char	   *insquery;
+	char	   *delquery;
+	int			i;
+
+	matviewRel = heap_open(matviewOid, NoLock);
+	matviewname = quote_qualified_identifier(get_namespace_name(RelationGetNamespace(matviewRel)),
+										RelationGetRelationName(matviewRel));
+	deltaname = psprintf("pg_temp.pg_mvlog_delta_%u", matviewOid);
+	newname = psprintf("pg_temp.pg_mvlog_new_%u", matviewOid);
+	tupdesc = RelationGetDescr(matviewRel);
+
+	initStringInfo(&collist);
+	initStringInfo(&deltalist);
+	initStringInfo(&mergelist);
+	initStringInfo(&keylist);
+	initStringInfo(&keyqual);
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		const char *colname = quote_identifier(NameStr(tupdesc->attrs[i]->attname));
+		const char *sep = (i > 0) ? ", " : "";
+
+		appendStringInfo(&collist, "%s%s", sep, colname);
+		if (iskey[i])
+		{
+			appendStringInfo(&deltalist, "%s%s", sep, colname);
+			appendStringInfo(&mergelist, "%s%s", sep, colname);
+			appendStringInfo(&keylist, "%s%s", keylist.len > 0 ? ", " : "",
+							 colname);
+			appendStringInfo(&keyqual,
+							 "%sdelta.%s IS NOT DISTINCT FROM mv.%s",
+							 keyqual.len > 0 ? " AND " : "",
+							 colname, colname);
+		}
+		else
+		{
+			appendStringInfo(&deltalist, "%s- %s", sep, colname);
+			appendStringInfo(&mergelist, "%spg_catalog.sum(%s)", sep, colname);
+		}
+	}
+
+	insquery = matview_log_delta_query(dataQuery, relid, inslogid);
+	delquery = matview_log_delta_query(dataQuery, relid, dellogid);
+
+	initStringInfo(&querybuf);
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	SetUserIdAndSecContext(relowner,
+						   save_sec_context | SECURITY_LOCAL_USERID_CHANGE);
+
+	/* The tables exist on this Coordinator only */
+	appendStringInfo(&querybuf, "CREATE LOCAL TEMP TABLE %s (LIKE %s)",
+					 deltaname, matviewname);
+	matview_log_execute(querybuf.data, SPI_OK_UTILITY);
+
+	resetStringInfo(&querybuf);
+	appendStringInfo(&querybuf, "CREATE LOCAL TEMP TABLE %s (LIKE %s)",
+					 newname, matviewname);
+	matview_log_execute(querybuf.data, SPI_OK_UTILITY);
+
+	SetUserIdAndSecContext(relowner,
+						   save_sec_context | SECURITY_RESTRICTED_OPERATION);
+
+	/* The Datanodes aggregate the rows logged they store */
+	resetStringInfo(&querybuf);
+	appendStringInfo(&querybuf, "INSERT INTO %s SELECT * FROM (%s) ins",
+					 deltaname, insquery);
+	matview_log_execute(querybuf.data, SPI_OK_INSERT);
+
+	resetStringInfo(&querybuf);
+	appendStringInfo(&querybuf, "INSERT INTO %s SELECT %s FROM (%s) del (%s)",
+					 deltaname, deltalist.data, delquery, collist.data);
+	matview_log_execute(querybuf.data, SPI_OK_INSERT);
+
+	resetStringInfo(&querybuf);
+	appendStringInfo(&querybuf,
+					 "INSERT INTO %s SELECT %s FROM "
+					 "(SELECT * FROM %s UNION ALL SELECT mv.* FROM %s mv "
+					 "WHERE EXISTS (SELECT 1 FROM %s delta WHERE %s)) groups "
+					 "GROUP BY %s",
+					 newname, mergelist.data, deltaname, matviewname,
+					 deltaname, keyqual.data, keylist.data);
+	matview_log_execute(querybuf.data, SPI_OK_INSERT);
+
+	OpenMatViewIncrementalMaintenance();
+
+	resetStringInfo(&querybuf);
+	appendStringInfo(&querybuf,
+					 "DELETE FROM %s mv WHERE EXISTS "
+					 "(SELECT 1 FROM %s delta WHERE %s)",
+					 matviewname, deltaname, keyqual.data);
+	matview_log_execute(querybuf.data, SPI_OK_DELETE);
+
+	resetStringInfo(&querybuf);
+	appendStringInfo(&querybuf, "INSERT INTO %s SELECT * FROM %s WHERE %s > 0",
+					 matviewname, newname,
+					 quote_identifier(NameStr(tupdesc->attrs[countattno - 1]->attname)));
+	matview_log_execute(querybuf.data, SPI_OK_INSERT);
+
+	CloseMatViewIncrementalMaintenance();
+	heap_close(matviewRel, NoLock);
+
+	resetStringInfo(&querybuf);
+	appendStringInfo(&querybuf, "DROP TABLE %s, %s", deltaname, newname);
+	matview_log_execute(querybuf.data, SPI_OK_UTILITY);
+
+	if (SPI_finish() != SPI_OK_FINISH)
+		elog(ERROR, "SPI_finish failed");
+}
+
+/*
+ * PurgeMatViewLog
+ *	Empty the logs of a materialized view, once it is refreshed on all the
+ *	Coordinators.
+ */
+void
+PurgeMatViewLog(Oid matviewOid)
+{
+	Relation	matviewRel;
+	Query	   *dataQuery;
+	Oid			relid;
+	Oid			inslogid;
+	Oid			dellogid;
+	Oid			save_userid;
+	int			save_sec_context;
+	char	   *sql;
+
+	matviewRel = heap_open(matviewOid, NoLock);
+	dataQuery = (Query *) linitial(matviewRel->rd_rules->rules[0]->actions);
+	if (!matview_get_log(matviewRel, dataQuery, &relid, &inslogid, &dellogid))
+	{
+		heap_close(matviewRel, NoLock);
+		return;
+	}
+
+	sql = psprintf("TRUNCATE %s, %s",
+				   quote_qualified_identifier(
+						get_namespace_name(get_rel_namespace(inslogid)),
+						get_rel_name(inslogid)),
+				   quote_qualified_identifier(
+						get_namespace_name(get_rel_namespace(dellogid)),
+						get_rel_name(dellogid)));
+
+	GetUserIdAndSecContext(&save_userid, &save_sec_context);
+	SetUserIdAndSecContext(matviewRel->rd_rel->relowner,
+						   save_sec_context | SECURITY_LOCAL_USERID_CHANGE);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+	matview_log_execute(sql, SPI_OK_UTILITY);
+	if (SPI_finish() != SPI_OK_FINISH)
+		elog(ERROR, "SPI_finish failed");
+
+	SetUserIdAndSecContext(save_userid, save_sec_context);
+	heap_close(matviewRel, NoLock);
+	pfree(sql);
+}
+
+/*
+ * RelationHasMatViewLog
+ *	Is the relation logged for a materialized view?
+ */
+bool
+RelationHasMatViewLog(Relation rel)
+{
+	Relation	rewriteRel;
+	SysScanDesc scan;
+	ScanKeyData key;
+	HeapTuple	tuple;
+	bool		found = false;
+
+	if (rel->rd_rules == NULL)
+		return false;
+
+	rewriteRel = heap_open(RewriteRelationId, AccessShareLock);
+	ScanKeyInit(&key,
+				Anum_pg_rewrite_ev_class,
+				BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(RelationGetRelid(rel)));
+	scan = systable_beginscan(rewriteRel, RewriteRelRulenameIndexId, true,
+							  NULL, 1, &key);
+	while (!found && HeapTupleIsValid(tuple = systable_getnext(scan)))
+	{
+		Form_pg_rewrite rule = (Form_pg_rewrite) GETSTRUCT(tuple);
+
+		found = strncmp(NameStr(rule->rulename), MATVIEW_LOG_INSERT_RULE,
+						strlen(MATVIEW_LOG_INSERT_RULE)) == 0;
+	}
+	systable_endscan(scan);
+	heap_close(rewriteRel, AccessShareLock);
+
+	return found;
+}
+
+/*
+ * pgxc_create_matview_log
+ *	Log the changes of a relation scanned by a materialized view, so that
+ *	REFRESH applies them instead of recomputing the view. The view is
+ *	refreshed entirely first.
+ */
+Datum
+pgxc_create_matview_log(PG_FUNCTION_ARGS)
+{
+	Oid			matviewOid = PG_GETARG_OID(0);
+	Oid			relid = PG_GETARG_OID(1);
+	Relation	matviewRel;
+	Relation	rel;
+	Query	   *dataQuery;
+	const char *reason;
+	bool	   *iskey;
+	AttrNumber	countattno;
+	Oid			logrelid;
+	Oid			inslogid;
+	Oid			dellogid;
+	char	   *distribution = NULL;
+	char	   *nspname;
+	char	   *matviewname;
+	char	   *matview;
+	char	   *table;
+	char	   *inslog;
+	char	   *dellog;
+	char		rulename[NAMEDATALEN];
+	StringInfoData buf;
+	int			i;
+
+	if (!IS_PGXC_LOCAL_COORDINATOR)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialized view logs can only be created on a Coordinator")));
+
+	matviewRel = heap_open(matviewOid, AccessExclusiveLock);
+	if (matviewRel->rd_rel->relkind != RELKIND_MATVIEW)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a materialized view",
+						RelationGetRelationName(matviewRel))));
+	if (!pg_class_ownercheck(matviewOid, GetUserId()))
+		aclcheck_error(ACLCHECK_NOT_OWNER, ACL_KIND_CLASS,
+					   RelationGetRelationName(matviewRel));
+
+	/* Rows changed from this Coordinator must wait for the rules */
+	rel = relation_open(relid, ShareLock);
+	if (!pg_class_ownercheck(relid, GetUserId()))
+		aclcheck_error(ACLCHECK_NOT_OWNER, ACL_KIND_CLASS,
+					   RelationGetRelationName(rel));
+	if (rel->rd_rel->relkind != RELKIND_RELATION)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("\"%s\" is not a table",
+						RelationGetRelationName(rel))));
+	if (RelationUsesLocalBuffers(rel) ||
+		matviewRel->rd_rel->relpersistence == RELPERSISTENCE_TEMP)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot create a materialized view log on a temporary relation")));
+	for (i = 0; i < RelationGetNumberOfAttributes(rel); i++)
+	{
+		if (RelationGetDescr(rel)->attrs[i]->attisdropped)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("cannot create a materialized view log on relation \"%s\" having dropped columns",
+							RelationGetRelationName(rel))));
+	}
+
+	dataQuery = (Query *) linitial(matviewRel->rd_rules->rules[0]->actions);
+	iskey = (bool *) palloc0(sizeof(bool) * RelationGetNumberOfAttributes(matviewRel));
+	reason = matview_log_check_query(dataQuery, relid, iskey, &countattno);
+	if (reason != NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialized view \"%s\" cannot be refreshed from a log of relation \"%s\"",
+						RelationGetRelationName(matviewRel),
+						RelationGetRelationName(rel)),
+				 errdetail("%s", _(reason))));
+	if (matview_get_log(matviewRel, dataQuery, &logrelid, &inslogid, &dellogid))
+		ereport(ERROR,
+				(errcode(ERRCODE_DUPLICATE_OBJECT),
+				 errmsg("materialized view \"%s\" already has a log",
+						RelationGetRelationName(matviewRel))));
+
+	/* The logs are stored next to the rows of the relation */
+	if (rel->rd_locator_info)
+		distribution = RelationLocInfoDistribution(relid,
+												   rel->rd_locator_info);
+
+	nspname = get_namespace_name(RelationGetNamespace(rel));
+	matviewname = pstrdup(RelationGetRelationName(matviewRel));
+	matview = quote_qualified_identifier(
+						get_namespace_name(RelationGetNamespace(matviewRel)),
+						matviewname);
+	table = quote_qualified_identifier(nspname, RelationGetRelationName(rel));
+	inslog = quote_qualified_identifier(nspname,
+						ChooseRelationName(matviewname,
+										   RelationGetRelationName(rel),
+										   "mvins", RelationGetNamespace(rel)));
+	dellog = quote_qualified_identifier(nspname,
+						ChooseRelationName(matviewname,
+										   RelationGetRelationName(rel),
+										   "mvdel", RelationGetNamespace(rel)));
+
+	/* REFRESH requires the view not to be open, it stays locked */
+	heap_close(matviewRel, NoLock);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "CREATE TABLE %s (LIKE %s)%s",
+					 inslog, table, distribution ? distribution : "");
+	matview_log_execute(buf.data, SPI_OK_UTILITY);
+
+	resetStringInfo(&buf);
+	appendStringInfo(&buf, "CREATE TABLE %s (LIKE %s)%s",
+					 dellog, table, distribution ? distribution : "");
+	matview_log_execute(buf.data, SPI_OK_UTILITY);
+
+	matview_log_rulename(rulename, MATVIEW_LOG_INSERT_RULE, matviewname);
+	resetStringInfo(&buf);
+	appendStringInfo(&buf, "CREATE RULE %s AS ON INSERT TO %s "
+					 "DO ALSO INSERT INTO %s SELECT new.*",
+					 quote_identifier(rulename), table, inslog);
+	matview_log_execute(buf.data, SPI_OK_UTILITY);
+
+	/* The old row is logged as deleted first, as in the actions checked */
+	matview_log_rulename(rulename, MATVIEW_LOG_UPDATE_RULE, matviewname);
+	resetStringInfo(&buf);
+	appendStringInfo(&buf, "CREATE RULE %s AS ON UPDATE TO %s "
+					 "DO ALSO (INSERT INTO %s SELECT old.*; "
+					 "INSERT INTO %s SELECT new.*)",
+					 quote_identifier(rulename), table, dellog, inslog);
+	matview_log_execute(buf.data, SPI_OK_UTILITY);
+
+	matview_log_rulename(rulename, MATVIEW_LOG_DELETE_RULE, matviewname);
+	resetStringInfo(&buf);
+	appendStringInfo(&buf, "CREATE RULE %s AS ON DELETE TO %s "
+					 "DO ALSO INSERT INTO %s SELECT old.*",
+					 quote_identifier(rulename), table, dellog);
+	matview_log_execute(buf.data, SPI_OK_UTILITY);
+
+	/*
+	 * The rows changed before the rules are missing from the view and from
+	 * the logs: refresh it entirely, which is done if it is not populated.
+	 */
+	resetStringInfo(&buf);
+	appendStringInfo(&buf, "REFRESH MATERIALIZED VIEW %s WITH NO DATA",
+					 matview);
+	matview_log_execute(buf.data, SPI_OK_UTILITY);
+
+	resetStringInfo(&buf);
+	appendStringInfo(&buf, "REFRESH MATERIALIZED VIEW %s", matview);
+	matview_log_execute(buf.data, SPI_OK_UTILITY);
+
+	SPI_finish();
+
+	relation_close(rel, NoLock);
+
+	PG_RETURN_VOID();
+}
+#endif
@@ -39,6 +39,7 @@
 #include "nodes/makefuncs.h"
 #include "storage/lmgr.h"
 #include "storage/proc.h"
+#include "storage/shmem.h"
 #include "storage/smgr.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
@@ -72,7 +73,7 @@
 /* Configuration options */
 #ifdef XCP
 
-int			SequenceRangeVal = 1;
+int			SequenceRangeVal = 1000;
 #endif
 
 typedef struct sequence_magic
@@ -97,10 +98,6 @@ typedef struct SeqTableData
 	/* if last != cached, we have not used up all the cached values */
 	int64		increment;		/* copy of sequence's increment field */
 	/* note that increment is zero until we first do read_seq_tuple() */
-#ifdef XCP
-	TimestampTz last_call_time; /* the time when the last call as made */
-	int64		range_multiplier; /* multiply this value with 2 next time */
-#endif
 } SeqTableData;
 
 typedef SeqTableData *SeqTable;
@@ -150,6 +147,13 @@ static void init_params(List *options, bool isInit,
 #endif
 static void do_setval(Oid relid, int64 next, bool iscalled);
 static void process_owned_by(Relation seqrel, List *owned_by);
+#ifdef XCP
+static bool seqcache_next(Relation seqrel, int64 *result);
+static int64 seqcache_range(Relation seqrel);
+static bool seqcache_store(Relation seqrel, int64 increment, int64 first,
+			   int64 last, int64 range);
+static void seqcache_forget(Relation seqrel);
+#endif
 
 
 /*
@@ -566,6 +570,9 @@ AlterSequence(AlterSeqStmt *stmt)
 	/* Clear local cache so that we don't think we have cached numbers */
 	/* Note that we do not change the currval() state */
 	elm->cached = elm->last;
+#ifdef XCP
+	seqcache_forget(seqrel);
+#endif
 
 	/* check the comment above nextval_internal()'s equivalent call. */
 	if (RelationNeedsWAL(seqrel))
@@ -742,6 +749,18 @@ nextval_internal(Oid relid)
 		return elm->last;
 	}
 
+#ifdef XCP
+	/* Try the block of values shared by the backends of the node */
+	if (!is_temp && seqcache_next(seqrel, &result))
+	{
+		elm->last = elm->cached = result;
+		elm->last_valid = true;
+		relation_close(seqrel, NoLock);
+		last_used_seq = elm;
+		return result;
+	}
+#endif
+
 	/* lock page' buffer and read tuple */
 	seq = read_seq_tuple(elm, seqrel, &buf, &seqtuple);
 	page = BufferGetPage(buf);
@@ -752,68 +771,34 @@ nextval_internal(Oid relid)
 	{
 		int64 range = seq->cache_value; /* how many values to ask from GTM? */
 		int64 rangemax; /* the max value returned from the GTM for our request */
-		char *seqname = GetGlobalSeqName(seqrel, NULL, NULL);
+		bool shared = false;
+		char *seqname;
 
 		/*
 		 * Above, we still use the page as a locking mechanism to handle
 		 * concurrency
 		 *
-		 * If the user has set a CACHE parameter, we use that. Else we pass in
-		 * the SequenceRangeVal value
+		 * If the user has set a CACHE parameter, we use that. Else the values
+		 * are fetched in blocks shared by the backends of the node, sized
+		 * after the rate the sequence is used at, up to SequenceRangeVal.
 		 */
 		if (range == DEFAULT_CACHEVAL && SequenceRangeVal > range)
 		{
-			TimestampTz curtime = GetCurrentTimestamp();
-
-			if (!TimestampDifferenceExceeds(elm->last_call_time,
-													curtime, 1000))
-			{
-				/*
-				 * The previous GetNextValGTM call was made just a while back.
-				 * Request double the range of what was requested in the
-				 * earlier call. Honor the SequenceRangeVal boundary
-				 * value to limit very large range requests!
-				 */
-				elm->range_multiplier *= 2;
-				if (elm->range_multiplier < SequenceRangeVal)
-					range = elm->range_multiplier;
-				else
-					elm->range_multiplier = range = SequenceRangeVal;
-
-				elog(DEBUG1, "increase sequence range %ld", range);
-			}
-			else if (TimestampDifferenceExceeds(elm->last_call_time,
-												curtime, 5000))
-			{
-				/* The previous GetNextValGTM call was pretty old */
-				range = elm->range_multiplier = DEFAULT_CACHEVAL;
-				elog(DEBUG1, "reset sequence range %ld", range);
-			}
-			else if (TimestampDifferenceExceeds(elm->last_call_time,
-												curtime, 3000))
-			{
-				/*
-				 * The previous GetNextValGTM call was made quite some time
-				 * ago. Try to reduce the range request to reduce the gap
-				 */
-				if (elm->range_multiplier != DEFAULT_CACHEVAL)
-				{
-					range = elm->range_multiplier =
-								rint(elm->range_multiplier/2);
-					elog(DEBUG1, "decrease sequence range %ld", range);
-				}
-			}
-			else
+			/* Another backend may have fetched a block while we waited */
+			if (seqcache_next(seqrel, &result))
 			{
-				/*
-				 * Current range_multiplier alllows to cache sequence values
-				 * for 1-3 seconds of work. Keep that rate.
-				 */
-				range = elm->range_multiplier;
+				UnlockReleaseBuffer(buf);
+				elm->last = elm->cached = result;
+				elm->last_valid = true;
+				relation_close(seqrel, NoLock);
+				last_used_seq = elm;
+				return result;
 			}
-			elm->last_call_time = curtime;
+			range = seqcache_range(seqrel);
+			shared = true;
 		}
 
+		seqname = GetGlobalSeqName(seqrel, NULL, NULL);
 		result = (int64) GetNextValGTM(seqname, range, &rangemax);
 		pfree(seqname);
 
@@ -826,6 +811,11 @@ nextval_internal(Oid relid)
 		elm->cached = rangemax;		/* last fetched range max limit */
 		elm->last_valid = true;
 
+		/* The rest of the block goes to the shared cache if there is room */
+		if (shared &&
+			seqcache_store(seqrel, elm->increment, result, rangemax, range))
+			elm->cached = result;
+
 		last_used_seq = elm;
 	}
 	else
@@ -1204,6 +1194,10 @@ do_setval(Oid relid, int64 next, bool iscalled)
 					(errcode(ERRCODE_CONNECTION_FAILURE),
 					 errmsg("GTM error, could not obtain sequence value")));
 		pfree(seqname);
+#ifdef XCP
+		/* Values fetched before are not to be handed out any more */
+		seqcache_forget(seqrel);
+#endif
 		/* Update the on-disk data */
 		seq->last_value = next; /* last fetched number */
 		seq->is_called = iscalled;
@@ -1395,10 +1389,6 @@ init_sequence(Oid relid, SeqTable *p_elm, Relation *p_rel)
 		elm->lxid = InvalidLocalTransactionId;
 		elm->last_valid = false;
 		elm->last = elm->cached = elm->increment = 0;
-#ifdef XCP
-		elm->last_call_time = 0;
-		elm->range_multiplier = DEFAULT_CACHEVAL;
-#endif
 	}
 
 	/*
@@ -2053,6 +2043,209 @@ ResetSequenceCaches(void)
 	last_used_seq = NULL;
 }
 
+#ifdef XCP
+/*
+ * Shared sequence cache
+ *
+ * Sequences using the default cache size get their values from GTM in
+ * blocks shared by all the backends of the node, so a busy sequence costs a
+ * GTM round trip per block rather than per value. The size of the next
+ * block follows the rate the sequence is used at on the node: it doubles
+ * while blocks are used up within a second, up to SequenceRangeVal values,
+ * and shrinks back once the sequence slows down.
+ *
+ * Blocks are not shared with other nodes, their unused values are lost for
+ * good when the block is dropped. The cache is protected by
+ * SequenceCacheLock.
+ */
+#define SEQ_CACHE_SIZE		1024
+
+typedef struct SeqCacheKey
+{
+	Oid			dbid;
+	Oid			relid;
+} SeqCacheKey;
+
+typedef struct SeqCacheEntry
+{
+	SeqCacheKey	key;			/* hash key */
+	Oid			filenode;		/* relfilenode the block was fetched for */
+	int64		last;			/* value last handed out */
+	int64		cached;			/* last value of the block */
+	int64		increment;		/* copy of sequence's increment field */
+	int64		range;			/* number of values in the block */
+	TimestampTz	fetch_time;		/* when the block was fetched */
+} SeqCacheEntry;
+
+static HTAB *SeqCacheHash = NULL;
+
+Size
+SequenceCacheShmemSize(void)
+{
+	return hash_estimate_size(SEQ_CACHE_SIZE, sizeof(SeqCacheEntry));
+}
+
+void
+SequenceCacheShmemInit(void)
+{
+	HASHCTL		info;
+
+	MemSet(&info, 0, sizeof(info));
+	info.keysize = sizeof(SeqCacheKey);
+	info.entrysize = sizeof(SeqCacheEntry);
+
+	SeqCacheHash = ShmemInitHash("Sequence cache",
+								 SEQ_CACHE_SIZE, SEQ_CACHE_SIZE,
+								 &info, HASH_ELEM | HASH_BLOBS);
+}
+
+static void
+seqcache_key(Relation seqrel, SeqCacheKey *key)
+{
+	MemSet(key, 0, sizeof(SeqCacheKey));
+	key->dbid = MyDatabaseId;
+	key->relid = RelationGetRelid(seqrel);
+}
+
+/*
+ * Hand out the next value of the shared block of the sequence, if any is
+ * left.
+ */
+static bool
+seqcache_next(Relation seqrel, int64 *result)
+{
+	SeqCacheKey key;
+	SeqCacheEntry *entry;
+	bool		found = false;
+
+	seqcache_key(seqrel, &key);
+
+	LWLockAcquire(SequenceCacheLock, LW_EXCLUSIVE);
+	entry = (SeqCacheEntry *) hash_search(SeqCacheHash, &key, HASH_FIND, NULL);
+	if (entry && entry->filenode == seqrel->rd_rel->relfilenode &&
+		entry->last != entry->cached)
+	{
+		entry->last += entry->increment;
+		*result = entry->last;
+		found = true;
+	}
+	LWLockRelease(SequenceCacheLock);
+
+	return found;
+}
+
+/*
+ * Number of values to ask GTM for the next block of the sequence, based on
+ * how long the previous block lasted.
+ */
+static int64
+seqcache_range(Relation seqrel)
+{
+	SeqCacheKey key;
+	SeqCacheEntry *entry;
+	int64		range = DEFAULT_CACHEVAL;
+
+	seqcache_key(seqrel, &key);
+
+	LWLockAcquire(SequenceCacheLock, LW_SHARED);
+	entry = (SeqCacheEntry *) hash_search(SeqCacheHash, &key, HASH_FIND, NULL);
+	if (entry && entry->filenode == seqrel->rd_rel->relfilenode)
+	{
+		TimestampTz curtime = GetCurrentTimestamp();
+
+		range = entry->range;
+		if (!TimestampDifferenceExceeds(entry->fetch_time, curtime, 1000))
+		{
+			/* Used up within a second, ask for twice as many values */
+			range *= 2;
+		}
+		else if (TimestampDifferenceExceeds(entry->fetch_time, curtime, 5000))
+		{
+			/* The sequence is hardly used any more */
+			range = DEFAULT_CACHEVAL;
+		}
+		else if (TimestampDifferenceExceeds(entry->fetch_time, curtime, 3000))
+		{
+			/* Reduce the values lost when the block is dropped */
+			range = Max(range / 2, DEFAULT_CACHEVAL);
+		}
+	}
+	LWLockRelease(SequenceCacheLock);
+
+	range = Min(range, SequenceRangeVal);
+	elog(DEBUG1, "sequence range " INT64_FORMAT, range);
+
+	return range;
+}
+
+/*
+ * Share the block of values from first to last just fetched from GTM, the
+ * caller hands out first. Returns false if there is no room left in the
+ * cache, the caller then keeps the block for itself.
+ */
+static bool
+seqcache_store(Relation seqrel, int64 increment, int64 first, int64 last,
+			   int64 range)
+{
+	SeqCacheKey key;
+	SeqCacheEntry *entry;
+	bool		found;
+
+	seqcache_key(seqrel, &key);
+
+	LWLockAcquire(SequenceCacheLock, LW_EXCLUSIVE);
+
+	/* Make room by dropping the blocks which are used up */
+	if (hash_get_num_entries(SeqCacheHash) >= SEQ_CACHE_SIZE &&
+		hash_search(SeqCacheHash, &key, HASH_FIND, NULL) == NULL)
+	{
+		HASH_SEQ_STATUS status;
+
+		hash_seq_init(&status, SeqCacheHash);
+		while ((entry = (SeqCacheEntry *) hash_seq_search(&status)) != NULL)
+		{
+			if (entry->last == entry->cached)
+				hash_search(SeqCacheHash, &entry->key, HASH_REMOVE, NULL);
+		}
+		if (hash_get_num_entries(SeqCacheHash) >= SEQ_CACHE_SIZE)
+		{
+			LWLockRelease(SequenceCacheLock);
+			return false;
+		}
+	}
+
+	entry = (SeqCacheEntry *) hash_search(SeqCacheHash, &key, HASH_ENTER_NULL,
+										  &found);
+	if (entry)
+	{
+		entry->filenode = seqrel->rd_rel->relfilenode;
+		entry->last = first;
+		entry->cached = last;
+		entry->increment = increment;
+		entry->range = range;
+		entry->fetch_time = GetCurrentTimestamp();
+	}
+	LWLockRelease(SequenceCacheLock);
+
+	return entry != NULL;
+}
+
+/*
+ * Drop the shared block of the sequence, after its state changed on GTM.
+ */
+static void
+seqcache_forget(Relation seqrel)
+{
+	SeqCacheKey key;
+
+	seqcache_key(seqrel, &key);
+
+	LWLockAcquire(SequenceCacheLock, LW_EXCLUSIVE);
+	hash_search(SeqCacheHash, &key, HASH_REMOVE, NULL);
+	LWLockRelease(SequenceCacheLock);
+}
+#endif
+
 #ifdef PGXC
 /*
  * Register a callback for a sequence rename drop on GTM
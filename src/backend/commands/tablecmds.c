@@ -107,6 +107,7 @@
 #include "commands/sequence.h"
 #include "pgxc/execRemote.h"
 #include "pgxc/redistrib.h"
+#include "pgxc/resultcache.h"
 #endif
 
 /*
@@ -1159,6 +1160,15 @@ ExecuteTruncate(TruncateStmt *stmt)
 		heap_truncate_check_FKs(rels, false);
 #endif
 
+#ifdef XCP
+	/* The cached results of the tables are about to be stale */
+	if (IS_PGXC_LOCAL_COORDINATOR)
+	{
+		foreach(cell, rels)
+			ResultCacheRelationModified((Relation) lfirst(cell));
+	}
+#endif
+
 	/*
 	 * If we are asked to restart sequences, find all the sequences, lock them
 	 * (we need AccessExclusiveLock for ResetSequence), and check permissions.
@@ -11326,6 +11336,7 @@ AtExecDistributeBy(Relation rel, DistributeBy *options)
 	char locatortype;
 	int hashalgorithm, hashbuckets;
 	AttrNumber attnum;
+	List *ranges = NIL;
 
 	/* Nothing to do on Datanodes */
 	if (IS_PGXC_DATANODE || options == NULL)
@@ -11347,6 +11358,12 @@ AtExecDistributeBy(Relation rel, DistributeBy *options)
 	 * user might define a different sub-cluster at the same time.
 	 */
 
+	/* The number of split points is checked once the node list is known */
+	if (locatortype == LOCATOR_TYPE_RANGE)
+		ranges = BuildRelationDistributionRanges(
+						RelationGetDescr(rel)->attrs[attnum - 1]->atttypid,
+						options->rangevalues);
+
 	/* Update pgxc_class entry */
 	PgxcClassAlter(relid,
 				   locatortype,
@@ -11355,6 +11372,9 @@ AtExecDistributeBy(Relation rel, DistributeBy *options)
 				   hashbuckets,
 				   0,
 				   NULL,
+				   ranges,
+				   BuildRelationDistributionKeys(relid, options,
+												 RelationGetDescr(rel)),
 				   PGXC_CLASS_ALTER_DISTRIBUTION);
 
 	/* Make the additional catalog changes visible */
@@ -11391,6 +11411,8 @@ AtExecSubCluster(Relation rel, PGXCSubCluster *options)
 				   0,
 				   numnodes,
 				   nodeoids,
+				   NIL,
+				   NIL,
 				   PGXC_CLASS_ALTER_NODES);
 
 	/* Make the additional catalog changes visible */
@@ -11437,6 +11459,8 @@ AtExecAddNode(Relation rel, List *options)
 				   0,
 				   old_num,
 				   old_oids,
+				   NIL,
+				   NIL,
 				   PGXC_CLASS_ALTER_NODES);
 
 	/* Make the additional catalog changes visible */
@@ -11480,6 +11504,8 @@ AtExecDeleteNode(Relation rel, List *options)
 				   0,
 				   old_num,
 				   old_oids,
+				   NIL,
+				   NIL,
 				   PGXC_CLASS_ALTER_NODES);
 
 	/* Make the additional catalog changes visible */
@@ -11528,6 +11554,8 @@ BuildRedistribCommands(Oid relid, List *subCmds)
 	Relation	rel;
 	Oid		   *new_oid_array;	/* Modified list of Oids */
 	int			new_num, i;	/* Modified number of Oids */
+	int16	   *bucket_map;		/* Position in Oid list of each bucket */
+	int			nbuckets;		/* Number of buckets */
 	ListCell   *item;
 #ifdef XCP
 	char		node_type = PGXC_NODE_DATANODE;
@@ -11549,10 +11577,20 @@ BuildRedistribCommands(Oid relid, List *subCmds)
 
 	/* Get the list to be modified */
 	new_num = get_pgxc_classnodes(RelationGetRelid(rel), &new_oid_array);
+	nbuckets = get_pgxc_classbuckets(RelationGetRelid(rel), &bucket_map);
 
 	foreach(item, subCmds)
 	{
 		AlterTableCmd *cmd = (AlterTableCmd *) lfirst(item);
+		Oid		   *prev_oid_array;
+		int			prev_num = new_num;
+		char		prev_type = newLocInfo->locatorType;
+		int			prev_nbuckets = nbuckets;
+
+		/* The commands below may modify the array in place */
+		prev_oid_array = (Oid *) palloc(prev_num * sizeof(Oid));
+		memcpy(prev_oid_array, new_oid_array, prev_num * sizeof(Oid));
+
 		switch (cmd->subtype)
 		{
 			case AT_DistributeBy:
@@ -11565,8 +11603,21 @@ BuildRedistribCommands(Oid relid, List *subCmds)
 											 RelationGetDescr(rel),
 											 &(newLocInfo->locatorType),
 											 NULL,
-											 NULL,
+											 &nbuckets,
 											 (AttrNumber *)&(newLocInfo->partAttrNum));
+				/* So do the columns of a multi-column distribution */
+				list_free(newLocInfo->partAttrNums);
+				newLocInfo->partAttrNums =
+					BuildRelationDistributionKeys(redistribState->relid,
+												  (DistributeBy *) cmd->def,
+												  RelationGetDescr(rel));
+				/* Split points come along with the range distribution */
+				list_free(newLocInfo->ranges);
+				newLocInfo->ranges = NIL;
+				if (newLocInfo->locatorType == LOCATOR_TYPE_RANGE)
+					newLocInfo->ranges = BuildRelationDistributionRanges(
+							RelationGetDescr(rel)->attrs[newLocInfo->partAttrNum - 1]->atttypid,
+							((DistributeBy *) cmd->def)->rangevalues);
 				break;
 			case AT_SubCluster:
 				/* Update new list of nodes */
@@ -11593,6 +11644,31 @@ BuildRedistribCommands(Oid relid, List *subCmds)
 			default:
 				Assert(0); /* Should not happen */
 		}
+
+		/*
+		 * Follow the bucket map the same way PgxcClassAlter does when the
+		 * command is applied to the catalog.
+		 */
+		if (newLocInfo->locatorType == LOCATOR_TYPE_BUCKET)
+		{
+			int16	   *new_map;
+
+			new_map = BuildBucketMap(nbuckets, prev_oid_array, prev_num,
+									 (prev_type == LOCATOR_TYPE_BUCKET &&
+									  prev_nbuckets == nbuckets) ?
+									 bucket_map : NULL,
+									 new_oid_array, new_num,
+									 RedistribMaxBuckets);
+			if (bucket_map)
+				pfree(bucket_map);
+			bucket_map = new_map;
+		}
+		else if (bucket_map)
+		{
+			pfree(bucket_map);
+			bucket_map = NULL;
+		}
+		pfree(prev_oid_array);
 	}
 
 	/* Build relation node list for new locator info */
@@ -11600,6 +11676,45 @@ BuildRedistribCommands(Oid relid, List *subCmds)
 		newLocInfo->nodeList = lappend_int(newLocInfo->nodeList,
 										   PGXCNodeGetNodeId(new_oid_array[i],
 															 &node_type));
+
+	/* Build the bucket map of new locator info */
+	list_free(newLocInfo->buckets);
+	newLocInfo->buckets = NIL;
+	if (bucket_map)
+	{
+		/* Tell how much is left when the moves are limited */
+		if (RedistribMaxBuckets > 0)
+		{
+			int16	   *full_map;
+			int			remaining = 0;
+
+			full_map = BuildBucketMap(nbuckets, new_oid_array, new_num,
+									  bucket_map, new_oid_array, new_num, 0);
+			for (i = 0; i < nbuckets; i++)
+			{
+				if (full_map[i] != bucket_map[i])
+					remaining++;
+			}
+			pfree(full_map);
+			if (remaining > 0)
+				ereport(NOTICE,
+						(errmsg("%d buckets of relation \"%s\" remain to be moved",
+								remaining, RelationGetRelationName(rel)),
+						 errhint("Repeat the command to move more of them.")));
+		}
+
+		for (i = 0; i < nbuckets; i++)
+			newLocInfo->buckets = lappend_int(newLocInfo->buckets,
+					list_nth_int(newLocInfo->nodeList, bucket_map[i]));
+		pfree(bucket_map);
+	}
+	else if (newLocInfo->locatorType == LOCATOR_TYPE_RANGE)
+	{
+		/* Range i is stored on node i, the split points have to match */
+		CheckRelationDistributionRanges(newLocInfo->ranges, new_num);
+		newLocInfo->buckets = list_copy(newLocInfo->nodeList);
+	}
+
 	/* Build the command tree for table redistribution */
 	PGXCRedistribCreateCommandList(redistribState, newLocInfo);
 
@@ -0,0 +1,554 @@
+/*-------------------------------------------------------------------------
+ *
+ * execBatch.c
+ *	  Evaluation of simple scan quals over a batch of tuples at a time
+ *
+ * ExecQual evaluates the quals of a scan one tuple at a time, calling the
+ * operator function of each clause through the function manager. Clauses
+ * comparing a column of an integer, date or float type with a constant or
+ * with another integer column are very common, and much cheaper to check
+ * the other way round: a batch of tuples, typically all the visible tuples
+ * of a page, is deformed into column arrays first, then each clause is
+ * applied to the whole arrays by a loop free of branches and calls, which
+ * the compiler can vectorize. The result is a selection vector holding the
+ * positions of the tuples passing all these clauses; the scan evaluates
+ * the remaining clauses on those tuples only.
+ *
+ * Only built-in comparison operators whose result is known to be that of
+ * comparing the values of their arguments are handled, so the outcome is
+ * the same as that of ExecQual. All of them are strict.
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * src/backend/executor/execBatch.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <math.h>
+
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "executor/execBatch.h"
+#include "nodes/primnodes.h"
+#include "utils/fmgroids.h"
+#include "utils/lsyscache.h"
+
+typedef enum BatchCmp
+{
+	BATCH_EQ,
+	BATCH_NE,
+	BATCH_LT,
+	BATCH_LE,
+	BATCH_GT,
+	BATCH_GE
+} BatchCmp;
+
+#define BATCH_OPERATORS(prefix) \
+	{F_##prefix##EQ, BATCH_EQ}, \
+	{F_##prefix##NE, BATCH_NE}, \
+	{F_##prefix##LT, BATCH_LT}, \
+	{F_##prefix##LE, BATCH_LE}, \
+	{F_##prefix##GT, BATCH_GT}, \
+	{F_##prefix##GE, BATCH_GE}
+
+/* Operator functions comparing the values of their arguments */
+static const struct
+{
+	Oid			funcid;
+	BatchCmp	cmp;
+}	batch_operators[] =
+{
+	BATCH_OPERATORS(INT2),
+	BATCH_OPERATORS(INT4),
+	BATCH_OPERATORS(INT8),
+	BATCH_OPERATORS(INT24),
+	BATCH_OPERATORS(INT42),
+	BATCH_OPERATORS(INT28),
+	BATCH_OPERATORS(INT82),
+	BATCH_OPERATORS(INT48),
+	BATCH_OPERATORS(INT84),
+	BATCH_OPERATORS(DATE_),
+	BATCH_OPERATORS(FLOAT4),
+	BATCH_OPERATORS(FLOAT8),
+	BATCH_OPERATORS(FLOAT48),
+	BATCH_OPERATORS(FLOAT84)
+};
+
+/*
+ * A column of the batch. Integer and date values are widened to int64,
+ * float values to double, which does not change the result of comparing
+ * them.
+ */
+typedef struct BatchColumn
+{
+	AttrNumber	attnum;
+	Oid			typid;
+	bool		isfloat;
+	int64	   *ivalues;		/* values, if !isfloat */
+	double	   *fvalues;		/* values, if isfloat */
+	bool	   *isnull;
+	bool		hasnulls;		/* any null value in the current batch? */
+} BatchColumn;
+
+/* A clause "column cmp constant" or "column cmp column" */
+typedef struct BatchClause
+{
+	BatchCmp	cmp;
+	int			lcol;			/* index of the left column */
+	int			rcol;			/* index of the right column, or -1 */
+	int64		iconst;			/* right constant, if integer */
+	double		fconst;			/* right constant, if float */
+} BatchClause;
+
+struct BatchQual
+{
+	TupleDesc	tupdesc;
+	int			maxtuples;
+	int			ncolumns;
+	BatchColumn *columns;
+	int			nclauses;
+	BatchClause *clauses;
+	bool	   *match;			/* does the tuple pass the clauses so far? */
+	Datum	   *datums;			/* workspace of batch_deform */
+};
+
+static bool batch_clause(BatchQual *bqual, Expr *clause, Index varno,
+			 BatchClause *bclause);
+static int batch_column(BatchQual *bqual, Var *var);
+static bool batch_var(Node *node, Index varno);
+static void batch_deform(BatchQual *bqual, HeapTuple tuples, int ntuples);
+static void batch_compare_int(bool *match, const int64 *values, int64 value,
+				  BatchCmp cmp, int n);
+static void batch_compare_float(bool *match, const double *values,
+					double value, BatchCmp cmp, int n);
+static void batch_compare_columns(bool *match, const int64 *lvalues,
+					  const int64 *rvalues, BatchCmp cmp, int n);
+
+
+/*
+ * ExecInitBatchQual
+ *		Set up the evaluation of the clauses of an implicitly-ANDed scan qual
+ *		over batches of up to maxtuples tuples of the relation scanned as
+ *		varno, described by tupdesc.
+ *
+ * Returns NULL if no clause of the qual can be evaluated this way. The
+ * clauses which can not are returned in *residual, to be initialized by the
+ * caller as usual.
+ */
+BatchQual *
+ExecInitBatchQual(List *qual, Index varno, TupleDesc tupdesc, int maxtuples,
+				  List **residual)
+{
+	BatchQual  *bqual;
+	ListCell   *lc;
+	int			c;
+
+	*residual = NIL;
+
+	bqual = (BatchQual *) palloc0(sizeof(BatchQual));
+	bqual->tupdesc = tupdesc;
+	bqual->maxtuples = maxtuples;
+	bqual->columns = (BatchColumn *)
+		palloc(2 * list_length(qual) * sizeof(BatchColumn));
+	bqual->clauses = (BatchClause *)
+		palloc(list_length(qual) * sizeof(BatchClause));
+
+	foreach(lc, qual)
+	{
+		Expr	   *clause = (Expr *) lfirst(lc);
+
+		if (batch_clause(bqual, clause, varno,
+						 &bqual->clauses[bqual->nclauses]))
+			bqual->nclauses++;
+		else
+			*residual = lappend(*residual, clause);
+	}
+
+	if (bqual->nclauses == 0)
+	{
+		pfree(bqual->columns);
+		pfree(bqual->clauses);
+		pfree(bqual);
+		list_free(*residual);
+		*residual = qual;
+		return NULL;
+	}
+
+	for (c = 0; c < bqual->ncolumns; c++)
+	{
+		BatchColumn *col = &bqual->columns[c];
+
+		if (col->isfloat)
+			col->fvalues = (double *) palloc(maxtuples * sizeof(double));
+		else
+			col->ivalues = (int64 *) palloc(maxtuples * sizeof(int64));
+		col->isnull = (bool *) palloc(maxtuples * sizeof(bool));
+	}
+	bqual->match = (bool *) palloc(maxtuples * sizeof(bool));
+	bqual->datums = (Datum *) palloc(maxtuples * sizeof(Datum));
+
+	return bqual;
+}
+
+/*
+ * ExecBatchQual
+ *		Evaluate the clauses over a batch of tuples.
+ *
+ * The positions in the batch of the tuples passing all the clauses are
+ * stored into selection, in ascending order. Returns their number.
+ */
+int
+ExecBatchQual(BatchQual *bqual, HeapTuple tuples, int ntuples,
+			  uint16 *selection)
+{
+	bool	   *match = bqual->match;
+	int			nselected = 0;
+	int			c;
+	int			i;
+
+	Assert(ntuples <= bqual->maxtuples);
+
+	batch_deform(bqual, tuples, ntuples);
+
+	for (i = 0; i < ntuples; i++)
+		match[i] = true;
+	for (c = 0; c < bqual->nclauses; c++)
+	{
+		BatchClause *bclause = &bqual->clauses[c];
+		BatchColumn *lcol = &bqual->columns[bclause->lcol];
+
+		/* The operators are strict, so null values never pass */
+		if (lcol->hasnulls)
+			for (i = 0; i < ntuples; i++)
+				match[i] &= !lcol->isnull[i];
+
+		if (bclause->rcol >= 0)
+		{
+			BatchColumn *rcol = &bqual->columns[bclause->rcol];
+
+			if (rcol->hasnulls)
+				for (i = 0; i < ntuples; i++)
+					match[i] &= !rcol->isnull[i];
+			batch_compare_columns(match, lcol->ivalues, rcol->ivalues,
+								  bclause->cmp, ntuples);
+		}
+		else if (lcol->isfloat)
+			batch_compare_float(match, lcol->fvalues, bclause->fconst,
+								bclause->cmp, ntuples);
+		else
+			batch_compare_int(match, lcol->ivalues, bclause->iconst,
+							  bclause->cmp, ntuples);
+	}
+
+	for (i = 0; i < ntuples; i++)
+	{
+		selection[nselected] = i;
+		nselected += match[i];
+	}
+
+	return nselected;
+}
+
+/*
+ * Check whether the clause can be evaluated over batches, and if so set up
+ * *bclause, adding the columns it references to the batch.
+ */
+static bool
+batch_clause(BatchQual *bqual, Expr *clause, Index varno,
+			 BatchClause *bclause)
+{
+	OpExpr	   *opexpr;
+	Oid			funcid;
+	Node	   *left;
+	Node	   *right;
+	int			i;
+
+	if (!IsA(clause, OpExpr))
+		return false;
+	opexpr = (OpExpr *) clause;
+	if (list_length(opexpr->args) != 2)
+		return false;
+
+	funcid = OidIsValid(opexpr->opfuncid) ?
+		opexpr->opfuncid : get_opcode(opexpr->opno);
+	for (i = 0; i < lengthof(batch_operators); i++)
+		if (batch_operators[i].funcid == funcid)
+			break;
+	if (i == lengthof(batch_operators))
+		return false;
+	bclause->cmp = batch_operators[i].cmp;
+
+	left = (Node *) linitial(opexpr->args);
+	right = (Node *) lsecond(opexpr->args);
+
+	/* Keep the column on the left */
+	if (IsA(left, Const) && batch_var(right, varno))
+	{
+		Node	   *tmp = left;
+
+		left = right;
+		right = tmp;
+		switch (bclause->cmp)
+		{
+			case BATCH_LT:
+				bclause->cmp = BATCH_GT;
+				break;
+			case BATCH_LE:
+				bclause->cmp = BATCH_GE;
+				break;
+			case BATCH_GT:
+				bclause->cmp = BATCH_LT;
+				break;
+			case BATCH_GE:
+				bclause->cmp = BATCH_LE;
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (!batch_var(left, varno))
+		return false;
+
+	if (IsA(right, Const))
+	{
+		Const	   *con = (Const *) right;
+
+		if (con->constisnull)
+			return false;
+		switch (con->consttype)
+		{
+			case INT2OID:
+				bclause->iconst = DatumGetInt16(con->constvalue);
+				break;
+			case INT4OID:
+			case DATEOID:
+				bclause->iconst = DatumGetInt32(con->constvalue);
+				break;
+			case INT8OID:
+				bclause->iconst = DatumGetInt64(con->constvalue);
+				break;
+			case FLOAT4OID:
+				bclause->fconst = DatumGetFloat4(con->constvalue);
+				break;
+			case FLOAT8OID:
+				bclause->fconst = DatumGetFloat8(con->constvalue);
+				break;
+			default:
+				return false;
+		}
+
+		/* NaN sorts above all other values, leave that to the operator */
+		if ((con->consttype == FLOAT4OID || con->consttype == FLOAT8OID) &&
+			isnan(bclause->fconst))
+			return false;
+
+		bclause->lcol = batch_column(bqual, (Var *) left);
+		bclause->rcol = -1;
+		return true;
+	}
+
+	/* Comparisons of two float columns have to take care of NaN too */
+	if (batch_var(right, varno) &&
+		((Var *) left)->vartype != FLOAT4OID &&
+		((Var *) left)->vartype != FLOAT8OID)
+	{
+		bclause->lcol = batch_column(bqual, (Var *) left);
+		bclause->rcol = batch_column(bqual, (Var *) right);
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Check whether the node is a user column of a type handled here, of the
+ * scanned relation.
+ */
+static bool
+batch_var(Node *node, Index varno)
+{
+	Var		   *var = (Var *) node;
+
+	if (!IsA(node, Var) ||
+		var->varno != varno ||
+		var->varlevelsup != 0 ||
+		var->varattno <= 0)
+		return false;
+
+	switch (var->vartype)
+	{
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case DATEOID:
+		case FLOAT4OID:
+		case FLOAT8OID:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*
+ * Return the index of the column of the batch holding the values of the
+ * Var, adding it if needed.
+ */
+static int
+batch_column(BatchQual *bqual, Var *var)
+{
+	BatchColumn *col;
+	int			c;
+
+	for (c = 0; c < bqual->ncolumns; c++)
+		if (bqual->columns[c].attnum == var->varattno)
+			return c;
+
+	col = &bqual->columns[bqual->ncolumns];
+	memset(col, 0, sizeof(BatchColumn));
+	col->attnum = var->varattno;
+	col->typid = var->vartype;
+	col->isfloat = (var->vartype == FLOAT4OID || var->vartype == FLOAT8OID);
+
+	return bqual->ncolumns++;
+}
+
+/*
+ * Extract the values of the columns of the batch from the tuples.
+ */
+static void
+batch_deform(BatchQual *bqual, HeapTuple tuples, int ntuples)
+{
+	Datum	   *datums = bqual->datums;
+	int			c;
+	int			i;
+
+	for (c = 0; c < bqual->ncolumns; c++)
+	{
+		BatchColumn *col = &bqual->columns[c];
+
+		heap_getattr_batch(tuples, ntuples, col->attnum, bqual->tupdesc,
+						   datums, col->isnull);
+
+		/* The values of the nulls are ignored, but must be set */
+		col->hasnulls = false;
+		for (i = 0; i < ntuples; i++)
+		{
+			if (col->isnull[i])
+			{
+				col->hasnulls = true;
+				datums[i] = (Datum) 0;
+			}
+		}
+
+		switch (col->typid)
+		{
+			case INT2OID:
+				for (i = 0; i < ntuples; i++)
+					col->ivalues[i] = DatumGetInt16(datums[i]);
+				break;
+			case INT4OID:
+			case DATEOID:
+				for (i = 0; i < ntuples; i++)
+					col->ivalues[i] = DatumGetInt32(datums[i]);
+				break;
+			case INT8OID:
+				for (i = 0; i < ntuples; i++)
+					col->ivalues[i] = col->isnull[i] ? 0 :
+						DatumGetInt64(datums[i]);
+				break;
+			case FLOAT4OID:
+				for (i = 0; i < ntuples; i++)
+					col->fvalues[i] = col->isnull[i] ? 0 :
+						DatumGetFloat4(datums[i]);
+				break;
+			case FLOAT8OID:
+				for (i = 0; i < ntuples; i++)
+					col->fvalues[i] = col->isnull[i] ? 0 :
+						DatumGetFloat8(datums[i]);
+				break;
+			default:
+				elog(ERROR, "unexpected type %u in batch qual", col->typid);
+		}
+	}
+}
+
+/*
+ * The comparison loops below must not branch, so that they get vectorized.
+ * They clear the match flag of the tuples failing the comparison.
+ */
+#define BATCH_COMPARE(cmp, n, lhs, rhs) \
+	do { \
+		int			i; \
+		switch (cmp) \
+		{ \
+			case BATCH_EQ: \
+				for (i = 0; i < (n); i++) \
+					match[i] &= ((lhs) == (rhs)); \
+				break; \
+			case BATCH_NE: \
+				for (i = 0; i < (n); i++) \
+					match[i] &= ((lhs) != (rhs)); \
+				break; \
+			case BATCH_LT: \
+				for (i = 0; i < (n); i++) \
+					match[i] &= ((lhs) < (rhs)); \
+				break; \
+			case BATCH_LE: \
+				for (i = 0; i < (n); i++) \
+					match[i] &= ((lhs) <= (rhs)); \
+				break; \
+			case BATCH_GT: \
+				for (i = 0; i < (n); i++) \
+					match[i] &= ((lhs) > (rhs)); \
+				break; \
+			case BATCH_GE: \
+				for (i = 0; i < (n); i++) \
+					match[i] &= ((lhs) >= (rhs)); \
+				break; \
+		} \
+	} while (0)
+
+static void
+batch_compare_int(bool *match, const int64 *values, int64 value,
+				  BatchCmp cmp, int n)
+{
+	BATCH_COMPARE(cmp, n, values[i], value);
+}
+
+static void
+batch_compare_columns(bool *match, const int64 *lvalues,
+					  const int64 *rvalues, BatchCmp cmp, int n)
+{
+	BATCH_COMPARE(cmp, n, lvalues[i], rvalues[i]);
+}
+
+/*
+ * NaN is equal to itself and greater than any other value, whereas any
+ * comparison involving NaN is false in C. The constant is not NaN, so only
+ * the results of > and >= have to be fixed up.
+ */
+static void
+batch_compare_float(bool *match, const double *values, double value,
+					BatchCmp cmp, int n)
+{
+	int			i;
+
+	switch (cmp)
+	{
+		case BATCH_GT:
+			for (i = 0; i < n; i++)
+				match[i] &= ((values[i] > value) | (values[i] != values[i]));
+			break;
+		case BATCH_GE:
+			for (i = 0; i < n; i++)
+				match[i] &= ((values[i] >= value) | (values[i] != values[i]));
+			break;
+		default:
+			BATCH_COMPARE(cmp, n, values[i], value);
+			break;
+	}
+}
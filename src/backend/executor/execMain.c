@@ -51,16 +51,21 @@
 #include "commands/trigger.h"
 #include "executor/execdebug.h"
 #include "foreign/fdwapi.h"
+#include "jit/jit.h"
+#include "libpq/pqformat.h"
 #include "mb/pg_wchar.h"
 #include "miscadmin.h"
 #include "optimizer/clauses.h"
 #include "parser/parsetree.h"
 #include "storage/bufmgr.h"
 #include "storage/lmgr.h"
+#include "tcop/tcopprot.h"
 #include "tcop/utility.h"
 #include "utils/acl.h"
+#include "utils/guc.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/portal.h"
 #include "utils/rls.h"
 #include "utils/snapmgr.h"
 #include "utils/tqual.h"
@@ -72,6 +77,7 @@
 #include "access/gtm.h"
 #include "pgxc/execRemote.h"
 #include "pgxc/poolmgr.h"
+#include "pgxc/resultcache.h"
 #endif
 
 /* Hooks for plugins to get control in ExecutorStart/Run/Finish/End */
@@ -106,6 +112,10 @@ static char *ExecBuildSlotValueDescription(Oid reloid,
 							  int maxfieldlen);
 static void EvalPlanQualStart(EPQState *epqstate, EState *parentestate,
 				  Plan *planTree);
+#ifdef XCP
+static int	ExecSetFragmentWorkMem(PlannedStmt *plannedstmt);
+static void ExecReportFragmentInstrumentation(QueryDesc *queryDesc);
+#endif
 
 /*
  * Note that GetUpdatedColumns() also exists in commands/trigger.c.  There does
@@ -146,10 +156,19 @@ static void EvalPlanQualStart(EPQState *epqstate, EState *parentestate,
 void
 ExecutorStart(QueryDesc *queryDesc, int eflags)
 {
+#ifdef XCP
+	int			save_nestlevel = ExecSetFragmentWorkMem(queryDesc->plannedstmt);
+#endif
+
 	if (ExecutorStart_hook)
 		(*ExecutorStart_hook) (queryDesc, eflags);
 	else
 		standard_ExecutorStart(queryDesc, eflags);
+
+#ifdef XCP
+	if (save_nestlevel > 0)
+		AtEOXact_GUC(true, save_nestlevel);
+#endif
 }
 
 void
@@ -274,6 +293,15 @@ standard_ExecutorStart(QueryDesc *queryDesc, int eflags)
 	estate->es_crosscheck_snapshot = RegisterSnapshot(queryDesc->crosscheck_snapshot);
 	estate->es_top_eflags = eflags;
 	estate->es_instrument = queryDesc->instrument_options;
+#ifdef XCP
+	/* Measure the fragment if the Coordinator runs EXPLAIN ANALYZE */
+	if (queryDesc->plannedstmt->instrumentOptions && !queryDesc->totaltime)
+		queryDesc->totaltime =
+			InstrAlloc(1, queryDesc->plannedstmt->instrumentOptions);
+#endif
+
+	/* Compile the plan as it gets initialized, if it is expensive enough */
+	jit_start_execution(estate, queryDesc->plannedstmt, eflags);
 
 	/*
 	 * Initialize the plan state tree
@@ -323,10 +351,19 @@ void
 ExecutorRun(QueryDesc *queryDesc,
 			ScanDirection direction, long count)
 {
+#ifdef XCP
+	int			save_nestlevel = ExecSetFragmentWorkMem(queryDesc->plannedstmt);
+#endif
+
 	if (ExecutorRun_hook)
 		(*ExecutorRun_hook) (queryDesc, direction, count);
 	else
 		standard_ExecutorRun(queryDesc, direction, count);
+
+#ifdef XCP
+	if (save_nestlevel > 0)
+		AtEOXact_GUC(true, save_nestlevel);
+#endif
 }
 
 void
@@ -395,6 +432,13 @@ standard_ExecutorRun(QueryDesc *queryDesc,
 	if (queryDesc->totaltime)
 		InstrStopNode(queryDesc->totaltime, estate->es_processed);
 
+#ifdef XCP
+	/* Report the fragment once it has run out of rows */
+	if (queryDesc->plannedstmt->instrumentOptions &&
+		(count == 0 || estate->es_processed < count))
+		ExecReportFragmentInstrumentation(queryDesc);
+#endif
+
 	MemoryContextSwitchTo(oldcontext);
 }
 
@@ -809,6 +853,60 @@ ExecCheckXactReadOnly(PlannedStmt *plannedstmt)
 }
 
 
+#ifdef XCP
+/*
+ * A fragment of a distributed query runs with the work_mem the Coordinator
+ * gave it out of query_work_mem, so its sorts and hashes spill to disk
+ * rather than exceed the memory of the query. The setting is saved at a new
+ * GUC nest level, the caller restores it with AtEOXact_GUC, and the abort
+ * does if the execution fails. Returns 0 if work_mem is left as is.
+ */
+static int
+ExecSetFragmentWorkMem(PlannedStmt *plannedstmt)
+{
+	int			save_nestlevel;
+	char		value[32];
+
+	if (plannedstmt->workMem <= 0 || plannedstmt->workMem == work_mem)
+		return 0;
+
+	save_nestlevel = NewGUCNestLevel();
+	snprintf(value, sizeof(value), "%d", plannedstmt->workMem);
+	(void) set_config_option("work_mem", value, PGC_SUSET, PGC_S_SESSION,
+							 GUC_ACTION_SAVE, true, 0, false);
+	return save_nestlevel;
+}
+
+/*
+ * Tell the Coordinator running EXPLAIN ANALYZE how the fragment of the query
+ * executed by the active portal went ('i' message): the portal name, then the
+ * rows produced, the execution time in microseconds, and the shared blocks
+ * hit and read and the temporary blocks written, as 64-bit integers.
+ */
+static void
+ExecReportFragmentInstrumentation(QueryDesc *queryDesc)
+{
+	Instrumentation *instr = queryDesc->totaltime;
+	StringInfoData buf;
+
+	if (!IS_PGXC_DATANODE || whereToSendOutput != DestRemote ||
+		ActivePortal == NULL || instr == NULL)
+		return;
+
+	InstrEndLoop(instr);
+
+	pq_beginmessage(&buf, 'i');
+	pq_sendstring(&buf, ActivePortal->name);
+	pq_sendint64(&buf, (int64) instr->ntuples);
+	pq_sendint64(&buf, (int64) (instr->total * 1000000.0));
+	pq_sendint64(&buf, instr->bufusage.shared_blks_hit);
+	pq_sendint64(&buf, instr->bufusage.shared_blks_read);
+	pq_sendint64(&buf, instr->bufusage.temp_blks_written);
+	pq_endmessage(&buf);
+}
+#endif
+
+
 /* ----------------------------------------------------------------
  *		InitPlan
  *
@@ -864,6 +962,12 @@ InitPlan(QueryDesc *queryDesc, int eflags)
 
 			resultRelationOid = getrelid(resultRelationIndex, rangeTable);
 			resultRelation = heap_open(resultRelationOid, RowExclusiveLock);
+#ifdef XCP
+			/* The cached results of the table are about to be stale */
+			if (IS_PGXC_LOCAL_COORDINATOR &&
+					!(eflags & EXEC_FLAG_EXPLAIN_ONLY))
+				ResultCacheRelationModified(resultRelation);
+#endif
 			InitResultRelInfo(resultRelInfo,
 							  resultRelation,
 							  resultRelationIndex,
@@ -93,6 +93,7 @@
 #include "executor/nodeCustom.h"
 #include "executor/nodeForeignscan.h"
 #include "executor/nodeFunctionscan.h"
+#include "executor/nodeGather.h"
 #include "executor/nodeGroup.h"
 #include "executor/nodeHash.h"
 #include "executor/nodeHashjoin.h"
@@ -107,6 +108,7 @@
 #include "executor/nodeNestloop.h"
 #include "executor/nodeRecursiveunion.h"
 #include "executor/nodeResult.h"
+#include "executor/nodeResultCache.h"
 #include "executor/nodeSamplescan.h"
 #include "executor/nodeSeqscan.h"
 #include "executor/nodeSetOp.h"
@@ -118,6 +120,7 @@
 #include "executor/nodeValuesscan.h"
 #include "executor/nodeWindowAgg.h"
 #include "executor/nodeWorktablescan.h"
+#include "jit/jit.h"
 #include "miscadmin.h"
 #ifdef PGXC
 #include "pgxc/execRemote.h"
@@ -334,6 +337,16 @@ ExecInitNode(Plan *node, EState *estate, int eflags)
 												 estate, eflags);
 			break;
 
+		case T_Gather:
+			result = (PlanState *) ExecInitGather((Gather *) node,
+												  estate, eflags);
+			break;
+
+		case T_ResultCache:
+			result = (PlanState *) ExecInitResultCache((ResultCache *) node,
+													   estate, eflags);
+			break;
+
 #ifdef PGXC
 		case T_RemoteQuery:
 			result = (PlanState *) ExecInitRemoteQuery((RemoteQuery *) node,
@@ -381,6 +394,9 @@ ExecInitNode(Plan *node, EState *estate, int eflags)
 #endif
 	result->initPlan = subps;
 
+	/* Compile the expressions of the node if that is worth it */
+	jit_compile_planstate(estate, result);
+
 	/* Set up instrumentation for this node if requested */
 	if (estate->es_instrument)
 		result->instrument = InstrAlloc(1, estate->es_instrument);
@@ -624,6 +640,14 @@ ExecProcNode(PlanState *node)
 			result = ExecLimit((LimitState *) node);
 			break;
 
+		case T_GatherState:
+			result = ExecGather((GatherState *) node);
+			break;
+
+		case T_ResultCacheState:
+			result = ExecResultCache((ResultCacheState *) node);
+			break;
+
 #ifdef PGXC
 		case T_RemoteQueryState:
 			result = ExecRemoteQuery((RemoteQueryState *) node);
@@ -879,6 +903,14 @@ ExecEndNode(PlanState *node)
 			ExecEndLimit((LimitState *) node);
 			break;
 
+		case T_GatherState:
+			ExecEndGather((GatherState *) node);
+			break;
+
+		case T_ResultCacheState:
+			ExecEndResultCache((ResultCacheState *) node);
+			break;
+
 #ifdef PGXC
 		case T_RemoteQueryState:
 			ExecEndRemoteQuery((RemoteQueryState *) node);
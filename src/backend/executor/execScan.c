@@ -19,6 +19,9 @@
 #include "postgres.h"
 
 #include "executor/executor.h"
+#ifdef XCP
+#include "executor/joinFilter.h"
+#endif
 #include "miscadmin.h"
 #include "utils/memutils.h"
 
@@ -126,7 +129,11 @@ ExecScan(ScanState *node,
 	 * If we have neither a qual to check nor a projection to do, just skip
 	 * all the overhead and return the raw scan tuple.
 	 */
-	if (!qual && !projInfo)
+	if (!qual && !projInfo
+#ifdef XCP
+		&& node->ss_JoinFilter == NULL
+#endif
+		)
 	{
 		ResetExprContext(econtext);
 		return ExecScanFetch(node, accessMtd, recheckMtd);
@@ -185,6 +192,18 @@ ExecScan(ScanState *node,
 		 */
 		econtext->ecxt_scantuple = slot;
 
+#ifdef XCP
+		/*
+		 * Drop the tuple if the hash join above can not find a match for it
+		 */
+		if (node->ss_JoinFilter && !ExecScanJoinFilter(node, slot))
+		{
+			InstrCountFiltered1(node, 1);
+			ResetExprContext(econtext);
+			continue;
+		}
+#endif
+
 		/*
 		 * check that the current tuple satisfies the qual-clause
 		 *
@@ -352,3 +371,33 @@ ExecScanReScan(ScanState *node)
 		estate->es_epqScanDone[scanrelid - 1] = false;
 	}
 }
+
+#ifdef XCP
+/*
+ * ExecScanJoinFilter
+ *
+ *		Test the scan tuple against the filter of the keys of the hash join
+ *		above, see joinFilter.c. Stops testing for good if the filter does
+ *		not reject enough tuples to pay for itself.
+ */
+bool
+ExecScanJoinFilter(ScanState *node, TupleTableSlot *slot)
+{
+	JoinFilter *filter = node->ss_JoinFilter;
+	MemoryContext oldcontext;
+	bool		result;
+
+	if (!JoinFilterWorthwhile(filter))
+	{
+		node->ss_JoinFilter = NULL;
+		return true;
+	}
+
+	/* the hash functions may leak */
+	oldcontext = MemoryContextSwitchTo(node->ps.ps_ExprContext->ecxt_per_tuple_memory);
+	result = JoinFilterTestSlot(filter, slot);
+	MemoryContextSwitchTo(oldcontext);
+
+	return result;
+}
+#endif
@@ -97,8 +97,10 @@
 #include "utils/lsyscache.h"
 #include "utils/typcache.h"
 #ifdef XCP
+#include "common/pg_lzcompress.h"
 #include "pgxc/pgxc.h"
 #include "utils/memutils.h"
+#include "utils/syscache.h"
 #endif
 
 static TupleDesc ExecTypeFromTLInternal(List *targetList,
@@ -131,6 +133,7 @@ MakeTupleTableSlot(void)
 	slot->tts_datarow = NULL;
 	slot->tts_drowcxt = NULL;
 	slot->tts_attinmeta = NULL;
+	slot->tts_attrecvmeta = NULL;
 #endif
 	slot->tts_mcxt = CurrentMemoryContext;
 	slot->tts_buffer = InvalidBuffer;
@@ -138,6 +141,7 @@ MakeTupleTableSlot(void)
 	slot->tts_values = NULL;
 	slot->tts_isnull = NULL;
 	slot->tts_mintuple = NULL;
+	slot->tts_deform = NULL;
 
 	return slot;
 }
@@ -279,6 +283,8 @@ ExecSetSlotDescriptor(TupleTableSlot *slot,		/* slot to change */
 	/* XXX there in no routine to release AttInMetadata instance */
 	if (slot->tts_attinmeta)
 		slot->tts_attinmeta = NULL;
+	if (slot->tts_attrecvmeta)
+		slot->tts_attrecvmeta = NULL;
 #endif
 
 	if (slot->tts_values)
@@ -286,6 +292,9 @@ ExecSetSlotDescriptor(TupleTableSlot *slot,		/* slot to change */
 	if (slot->tts_isnull)
 		pfree(slot->tts_isnull);
 
+	/* Deforming code compiled for the old descriptor is no use */
+	slot->tts_deform = NULL;
+
 	/*
 	 * Install the new descriptor; if it's refcounted, bump its refcount.
 	 */
@@ -665,11 +674,76 @@ ExecCopySlotMinimalTuple(TupleTableSlot *slot)
 }
 
 #ifdef PGXC
+/*
+ * Encode attribute values of data rows built by ExecCopySlotDatarow in binary
+ * format, and compress attribute data of the rows.
+ */
+bool		DatarowBinaryFormat = false;
+bool		DatarowCompression = false;
+
+/*
+ * Do not try to compress data rows shorter than that, even if compression is
+ * enabled. Compression of short rows does not pay off.
+ */
+#define DATAROW_COMPRESS_MIN	256
+
+/*
+ * Look up the binary output function of the type, returns false if it is not
+ * possible to pass values of the type in binary format.
+ */
+bool
+ExecDatarowBinaryOutput(Oid typid, Oid *typSend, bool *typIsVarlena)
+{
+	HeapTuple	typeTuple;
+	Form_pg_type pt;
+	bool		result;
+
+	typeTuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typid));
+	if (!HeapTupleIsValid(typeTuple))
+		elog(ERROR, "cache lookup failed for type %u", typid);
+	pt = (Form_pg_type) GETSTRUCT(typeTuple);
+
+	/* Receiving side needs the receive function */
+	result = OidIsValid(pt->typsend) && OidIsValid(pt->typreceive) &&
+		pt->typisdefined;
+	*typSend = pt->typsend;
+	*typIsVarlena = (!pt->typbyval) && (pt->typlen == -1);
+
+	ReleaseSysCache(typeTuple);
+	return result;
+}
+
+/*
+ * Can values of all the attributes of the descriptor be passed in binary
+ * format? It is so if all the types have binary output and input functions.
+ */
+bool
+ExecDatarowBinaryPossible(TupleDesc tdesc)
+{
+	int			i;
+
+	for (i = 0; i < tdesc->natts; i++)
+	{
+		Oid			typSend;
+		bool		typIsVarlena;
+
+		if (!ExecDatarowBinaryOutput(tdesc->attrs[i]->atttypid, &typSend,
+								   &typIsVarlena))
+			return false;
+	}
+	return true;
+}
+
 /* --------------------------------
  *		ExecCopySlotDatarow
  *			Obtain a copy of a slot's data row.  The copy is
  *			palloc'd in the current memory context.
  *			The slot itself is undisturbed
+ *
+ *			If datarow_binary_format is on and all the attribute types
+ *			have binary I/O functions values are encoded with the send
+ *			functions, if datarow_compression is on the attribute data
+ *			are compressed, see DATAROW_FLAGS.
  * --------------------------------
  */
 RemoteDataRow
@@ -692,6 +766,11 @@ ExecCopySlotDatarow(TupleTableSlot *slot, MemoryContext tmpcxt)
 		MemoryContext	savecxt = NULL;
 		StringInfoData	buf;
 		uint16 			n16;
+		uint16			flags = 0;
+		Oid			   *typOutput;
+		bool		   *typIsVarlena;
+		char		   *cdata = NULL;
+		int32			clen = -1;
 		int 			i;
 
 		/* ensure we have all values */
@@ -704,11 +783,34 @@ ExecCopySlotDatarow(TupleTableSlot *slot, MemoryContext tmpcxt)
 			savecxt = MemoryContextSwitchTo(tmpcxt);
 		}
 
-		initStringInfo(&buf);
-		/* Number of parameter values */
-		n16 = htons(tdesc->natts);
-		appendBinaryStringInfo(&buf, (char *) &n16, 2);
+		/*
+		 * Get info needed to output the values. Binary format is used only if
+		 * it is possible for all the attributes, so the receiving side does
+		 * not need to know about the format of each value.
+		 */
+		typOutput = (Oid *) palloc(tdesc->natts * sizeof(Oid));
+		typIsVarlena = (bool *) palloc(tdesc->natts * sizeof(bool));
+		if (DatarowBinaryFormat)
+		{
+			flags = DATAROW_BINARY;
+			for (i = 0; i < tdesc->natts; i++)
+			{
+				if (!ExecDatarowBinaryOutput(tdesc->attrs[i]->atttypid,
+										   &typOutput[i], &typIsVarlena[i]))
+				{
+					flags = 0;
+					break;
+				}
+			}
+		}
+		if (flags == 0)
+		{
+			for (i = 0; i < tdesc->natts; i++)
+				getTypeOutputInfo(tdesc->attrs[i]->atttypid, &typOutput[i],
+								  &typIsVarlena[i]);
+		}
 
+		initStringInfo(&buf);
 		for (i = 0; i < tdesc->natts; i++)
 		{
 			uint32 n32;
@@ -720,47 +822,90 @@ ExecCopySlotDatarow(TupleTableSlot *slot, MemoryContext tmpcxt)
 			}
 			else
 			{
-				Form_pg_attribute attr = tdesc->attrs[i];
-				Oid		typOutput;
-				bool	typIsVarlena;
 				Datum	pval;
-				char   *pstring;
 				int		len;
 
-				/* Get info needed to output the value */
-				getTypeOutputInfo(attr->atttypid, &typOutput, &typIsVarlena);
 				/*
 				 * If we have a toasted datum, forcibly detoast it here to avoid
 				 * memory leakage inside the type's output routine.
 				 */
-				if (typIsVarlena)
+				if (typIsVarlena[i])
 					pval = PointerGetDatum(PG_DETOAST_DATUM(slot->tts_values[i]));
 				else
 					pval = slot->tts_values[i];
 
-				/* Convert Datum to string */
-				pstring = OidOutputFunctionCall(typOutput, pval);
-
-				/* copy data to the buffer */
-				len = strlen(pstring);
-				n32 = htonl(len);
-				appendBinaryStringInfo(&buf, (char *) &n32, 4);
-				appendBinaryStringInfo(&buf, pstring, len);
+				if (flags & DATAROW_BINARY)
+				{
+					/* Convert Datum to binary */
+					bytea  *outputbytes = OidSendFunctionCall(typOutput[i],
+															  pval);
+
+					/* copy data to the buffer */
+					len = VARSIZE(outputbytes) - VARHDRSZ;
+					n32 = htonl(len);
+					appendBinaryStringInfo(&buf, (char *) &n32, 4);
+					appendBinaryStringInfo(&buf, VARDATA(outputbytes), len);
+				}
+				else
+				{
+					/* Convert Datum to string */
+					char   *pstring = OidOutputFunctionCall(typOutput[i], pval);
+
+					/* copy data to the buffer */
+					len = strlen(pstring);
+					n32 = htonl(len);
+					appendBinaryStringInfo(&buf, (char *) &n32, 4);
+					appendBinaryStringInfo(&buf, pstring, len);
+				}
 			}
 		}
 
+		/*
+		 * Try to compress attribute data, and use compressed data if they are
+		 * actually shorter.
+		 */
+		if (DatarowCompression && buf.len >= DATAROW_COMPRESS_MIN)
+		{
+			cdata = palloc(PGLZ_MAX_OUTPUT(buf.len));
+			clen = pglz_compress(buf.data, buf.len, cdata,
+								 PGLZ_strategy_default);
+			if (clen >= 0 && clen + 4 < buf.len)
+				flags |= DATAROW_COMPRESSED;
+		}
+
 		/* restore memory context to allocate result */
 		if (savecxt)
 		{
 			MemoryContextSwitchTo(savecxt);
 		}
 
-		/* copy data to the buffer */
-		datarow = (RemoteDataRow) palloc(sizeof(RemoteDataRowData) + buf.len);
+		/* Number of parameter values, and the flags */
+		n16 = htons(tdesc->natts | flags);
+		if (flags & DATAROW_COMPRESSED)
+		{
+			uint32	n32 = htonl(buf.len);
+
+			datarow = (RemoteDataRow) palloc(sizeof(RemoteDataRowData) + 6 +
+											 clen);
+			datarow->msglen = 6 + clen;
+			memcpy(datarow->msg, &n16, 2);
+			memcpy(datarow->msg + 2, &n32, 4);
+			memcpy(datarow->msg + 6, cdata, clen);
+		}
+		else
+		{
+			datarow = (RemoteDataRow) palloc(sizeof(RemoteDataRowData) + 2 +
+											 buf.len);
+			datarow->msglen = 2 + buf.len;
+			memcpy(datarow->msg, &n16, 2);
+			memcpy(datarow->msg + 2, buf.data, buf.len);
+		}
 		datarow->msgnode = InvalidOid;
-		datarow->msglen = buf.len;
-		memcpy(datarow->msg, buf.data, buf.len);
+		if (cdata)
+			pfree(cdata);
 		pfree(buf.data);
+		pfree(typOutput);
+		pfree(typIsVarlena);
 		return datarow;
 	}
 }
@@ -0,0 +1,299 @@
+/*-------------------------------------------------------------------------
+ *
+ * joinFilter.c
+ *	  Bloom filters of hash join keys, applied by the nodes producing the
+ *	  outer rows of the join
+ *
+ * When the outer side of a hash join is a remote subplan, every outer row
+ * is shipped to the joining node, even those which can not match any inner
+ * row. Once the hash table is built the joining node sends a Bloom filter
+ * of the hash values of the inner keys to the nodes executing the subplan,
+ * along with the request to bind it. The session serving the joining node
+ * there drops the rows whose keys are not in the filter instead of sending
+ * them over the network.
+ *
+ * The outer keys are hashed the same way the hash join does, so a filter
+ * is only built if the outer keys are plain columns of the subplan and the
+ * hash functions are built-in, hence the same on all the nodes.
+ *
+ * The filter is also of use when the outer rows are produced locally. If
+ * they come from a scan of a relation, the scan drops the rows which can
+ * not match before evaluating its quals and projecting them. Otherwise the
+ * hash join itself tests the hash value of each outer row before looking
+ * at the buckets, which saves walking a hash table much bigger than the
+ * filter, or writing the row to a batch file. Either way the filter stops
+ * being tested if it turns out to reject few rows.
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * src/backend/executor/joinFilter.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include <math.h>
+
+#include "access/hash.h"
+#include "executor/joinFilter.h"
+#include "libpq/pqformat.h"
+#include "utils/memutils.h"
+
+/* GUC parameter */
+bool		RuntimeJoinFilters = true;
+
+/* Do not bother with filters passing more rows than that */
+#define JOIN_FILTER_MAX_FALSE_POSITIVES 0.25
+
+/* Stop testing rows locally if fewer than that are rejected... */
+#define JOIN_FILTER_MIN_REJECTED 0.05
+/* ... among that many rows tested */
+#define JOIN_FILTER_SAMPLE_ROWS 10000
+
+static JoinFilter *JoinFilterAlloc(int nkeys, uint32 nbits);
+
+
+/*
+ * Allocate an empty filter in its own memory context
+ */
+static JoinFilter *
+JoinFilterAlloc(int nkeys, uint32 nbits)
+{
+	MemoryContext context;
+	JoinFilter *filter;
+
+	context = AllocSetContextCreate(CurrentMemoryContext,
+									"Join filter",
+									ALLOCSET_SMALL_MINSIZE,
+									ALLOCSET_SMALL_INITSIZE,
+									ALLOCSET_DEFAULT_MAXSIZE);
+	filter = (JoinFilter *) MemoryContextAllocZero(context, sizeof(JoinFilter));
+	filter->jf_context = context;
+	filter->jf_nkeys = nkeys;
+	filter->jf_attnos = (AttrNumber *)
+		MemoryContextAlloc(context, nkeys * sizeof(AttrNumber));
+	filter->jf_hashfuncs = (Oid *)
+		MemoryContextAlloc(context, nkeys * sizeof(Oid));
+	filter->jf_nbits = nbits;
+	filter->jf_bits = (uint64 *)
+		MemoryContextAllocZero(context, nbits / 8);
+	return filter;
+}
+
+/*
+ * Create an empty filter for the given outer keys, sized for the expected
+ * number of inner rows.
+ */
+JoinFilter *
+JoinFilterCreate(int nkeys, AttrNumber *attnos, Oid *hashfuncs, double rows)
+{
+	JoinFilter *filter;
+	uint32		nbits = JOIN_FILTER_MIN_BITS;
+
+	/* About 8 bits per value keep false positives at a few percent */
+	while (nbits < JOIN_FILTER_MAX_BITS && nbits < rows * 8)
+		nbits <<= 1;
+
+	filter = JoinFilterAlloc(nkeys, nbits);
+	memcpy(filter->jf_attnos, attnos, nkeys * sizeof(AttrNumber));
+	memcpy(filter->jf_hashfuncs, hashfuncs, nkeys * sizeof(Oid));
+	return filter;
+}
+
+void
+JoinFilterFree(JoinFilter *filter)
+{
+	if (filter->jf_tested > 0)
+		elog(DEBUG1, "Join filter of %u bits rejected %ld of %ld rows",
+			 filter->jf_nbits, filter->jf_rejected, filter->jf_tested);
+	MemoryContextDelete(filter->jf_context);
+}
+
+/*
+ * Set the bits of the hash value. The positions are derived from two hash
+ * values, the second one made from the first.
+ */
+#define JOIN_FILTER_POSITION(filter, hashvalue, hash2, i) \
+	(((hashvalue) + (i) * (hash2)) & ((filter)->jf_nbits - 1))
+
+void
+JoinFilterAdd(JoinFilter *filter, uint32 hashvalue)
+{
+	uint32		hash2 = DatumGetUInt32(hash_uint32(hashvalue)) | 1;
+	int			i;
+
+	for (i = 0; i < JOIN_FILTER_HASHES; i++)
+	{
+		uint32		pos = JOIN_FILTER_POSITION(filter, hashvalue, hash2, i);
+
+		filter->jf_bits[pos / 64] |= UINT64CONST(1) << (pos % 64);
+	}
+	filter->jf_nadded += 1;
+}
+
+/*
+ * Is the filter worth sending? Too many values added make it pass nearly
+ * everything.
+ */
+bool
+JoinFilterUseful(JoinFilter *filter)
+{
+	double		fill;
+
+	fill = 1.0 - exp(-(double) JOIN_FILTER_HASHES * filter->jf_nadded /
+					 filter->jf_nbits);
+	return pow(fill, JOIN_FILTER_HASHES) <= JOIN_FILTER_MAX_FALSE_POSITIVES;
+}
+
+/*
+ * Might the outer row match any inner row? The keys are hashed like in
+ * ExecHashGetHashValue. A NULL key can not match.
+ */
+bool
+JoinFilterTestSlot(JoinFilter *filter, TupleTableSlot *slot)
+{
+	uint32		hashvalue = 0;
+	int			i;
+
+	if (filter->jf_hashinfo == NULL)
+	{
+		filter->jf_hashinfo = (FmgrInfo *)
+			MemoryContextAlloc(filter->jf_context,
+							   filter->jf_nkeys * sizeof(FmgrInfo));
+		for (i = 0; i < filter->jf_nkeys; i++)
+			fmgr_info_cxt(filter->jf_hashfuncs[i], &filter->jf_hashinfo[i],
+						  filter->jf_context);
+	}
+
+	for (i = 0; i < filter->jf_nkeys; i++)
+	{
+		Datum		value;
+		bool		isnull;
+
+		/* Not a column we know about, let it go */
+		if (filter->jf_attnos[i] > slot->tts_tupleDescriptor->natts)
+			return true;
+
+		/* rotate hashvalue left 1 bit at each step */
+		hashvalue = (hashvalue << 1) | ((hashvalue & 0x80000000) ? 1 : 0);
+
+		value = slot_getattr(slot, filter->jf_attnos[i], &isnull);
+		if (isnull)
+		{
+			filter->jf_tested++;
+			filter->jf_rejected++;
+			return false;
+		}
+		hashvalue ^= DatumGetUInt32(FunctionCall1(&filter->jf_hashinfo[i],
+												  value));
+	}
+
+	return JoinFilterTestHash(filter, hashvalue);
+}
+
+/*
+ * Might a row with this hash value of its keys match any inner row?
+ */
+bool
+JoinFilterTestHash(JoinFilter *filter, uint32 hashvalue)
+{
+	uint32		hash2;
+	int			i;
+
+	filter->jf_tested++;
+	hash2 = DatumGetUInt32(hash_uint32(hashvalue)) | 1;
+	for (i = 0; i < JOIN_FILTER_HASHES; i++)
+	{
+		uint32		pos = JOIN_FILTER_POSITION(filter, hashvalue, hash2, i);
+
+		if ((filter->jf_bits[pos / 64] & (UINT64CONST(1) << (pos % 64))) == 0)
+		{
+			filter->jf_rejected++;
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Is the filter still worth testing? Once enough rows are tested, give up
+ * if it hardly rejects any: most outer rows have a match, and testing them
+ * is wasted.
+ */
+bool
+JoinFilterWorthwhile(JoinFilter *filter)
+{
+	if (filter->jf_tested < JOIN_FILTER_SAMPLE_ROWS)
+		return true;
+	return filter->jf_rejected >= filter->jf_tested * JOIN_FILTER_MIN_REJECTED;
+}
+
+/*
+ * Append the filter to the message. NULL is sent as a filter without keys,
+ * which drops the filter sent before.
+ */
+void
+JoinFilterSerialize(JoinFilter *filter, StringInfo buf)
+{
+	int			i;
+
+	if (filter == NULL)
+	{
+		pq_sendint(buf, 0, 2);
+		return;
+	}
+
+	pq_sendint(buf, filter->jf_nkeys, 2);
+	for (i = 0; i < filter->jf_nkeys; i++)
+	{
+		pq_sendint(buf, filter->jf_attnos[i], 2);
+		pq_sendint(buf, filter->jf_hashfuncs[i], 4);
+	}
+	pq_sendint(buf, filter->jf_nbits, 4);
+	for (i = 0; i < filter->jf_nbits / 64; i++)
+		pq_sendint64(buf, filter->jf_bits[i]);
+}
+
+/*
+ * Read a filter sent by JoinFilterSerialize. The result is allocated in its
+ * own memory context under the current one, NULL if there is no filter.
+ */
+JoinFilter *
+JoinFilterDeserialize(StringInfo msg)
+{
+	JoinFilter *filter;
+	int			nkeys;
+	uint32		nbits;
+	AttrNumber *attnos;
+	Oid		   *hashfuncs;
+	int			i;
+
+	nkeys = pq_getmsgint(msg, 2);
+	if (nkeys == 0)
+		return NULL;
+
+	attnos = (AttrNumber *) palloc(nkeys * sizeof(AttrNumber));
+	hashfuncs = (Oid *) palloc(nkeys * sizeof(Oid));
+	for (i = 0; i < nkeys; i++)
+	{
+		attnos[i] = pq_getmsgint(msg, 2);
+		hashfuncs[i] = pq_getmsgint(msg, 4);
+	}
+	nbits = pq_getmsgint(msg, 4);
+	if (nbits < JOIN_FILTER_MIN_BITS || nbits > JOIN_FILTER_MAX_BITS ||
+		(nbits & (nbits - 1)) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("invalid join filter size %u", nbits)));
+
+	filter = JoinFilterAlloc(nkeys, nbits);
+	memcpy(filter->jf_attnos, attnos, nkeys * sizeof(AttrNumber));
+	memcpy(filter->jf_hashfuncs, hashfuncs, nkeys * sizeof(Oid));
+	for (i = 0; i < nbits / 64; i++)
+		filter->jf_bits[i] = pq_getmsgint64(msg);
+
+	pfree(attnos);
+	pfree(hashfuncs);
+	return filter;
+}
@@ -123,6 +123,19 @@
  *
  *	  TODO: AGG_HASHED doesn't support multiple grouping sets yet.
  *
+ *	  Spilling hashed aggregation:
+ *
+ *	  The planner estimates the size of the hash table, but the estimate may
+ *	  be far off.  So when the table grows past work_mem, no new groups are
+ *	  added to it: input tuples of groups already in the table keep being
+ *	  aggregated in memory, the others are written to temporary files, one
+ *	  of several partitions chosen by their hash value.  Once the input is
+ *	  exhausted and the groups of the table returned, each partition is
+ *	  aggregated in turn as a new batch, starting from an empty table, and
+ *	  may spill in turn.  Every level of spilling partitions on different
+ *	  bits of the hash value; when they are all used up, the table grows
+ *	  as it used to.
+ *
  * Portions Copyright (c) 2012-2014, TransLattice, Inc.
  * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
  * Portions Copyright (c) 1994, Regents of the University of California
@@ -148,6 +161,7 @@
 #include "parser/parse_agg.h"
 #include "parser/parse_coerce.h"
 #include "pgxc/pgxc.h"
+#include "storage/buffile.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
@@ -391,6 +405,29 @@ typedef struct AggHashEntryData
 	AggStatePerGroupData pergroup[FLEXIBLE_ARRAY_MEMBER];
 }	AggHashEntryData;
 
+/*
+ * Spilled tuples are split into HASHAGG_PARTITIONS files, using the next
+ * HASHAGG_PARTITION_BITS of the hash value at each level, highest bits
+ * first since the hash table uses the lowest ones to pick buckets.
+ */
+#define HASHAGG_PARTITION_BITS	4
+#define HASHAGG_PARTITIONS		(1 << HASHAGG_PARTITION_BITS)
+#define HASHAGG_MAX_LEVEL		(32 / HASHAGG_PARTITION_BITS)
+
+/* Partition files being written while aggregating a batch */
+typedef struct AggHashSpillData
+{
+	int			level;			/* level of the batches being written */
+	BufFile    *files[HASHAGG_PARTITIONS];
+}	AggHashSpillData;
+
+/* A partition waiting to be aggregated */
+typedef struct AggHashBatchData
+{
+	int			level;			/* number of times its tuples were spilled */
+	BufFile    *file;
+}	AggHashBatchData;
+
 
 static void initialize_phase(AggState *aggstate, int newphase);
 static TupleTableSlot *fetch_input_tuple(AggState *aggstate);
@@ -425,6 +462,15 @@ static bool find_unaggregated_cols_walker(Node *node, Bitmapset **colnos);
 static void build_hash_table(AggState *aggstate);
 static AggHashEntry lookup_hash_entry(AggState *aggstate,
 				  TupleTableSlot *inputslot);
+static void hash_agg_check_memory(AggState *aggstate);
+static uint32 hash_agg_hash_value(AggState *aggstate, TupleTableSlot *slot);
+static void hash_agg_spill_tuple(AggState *aggstate, TupleTableSlot *slot,
+					 uint32 hashvalue);
+static TupleTableSlot *hash_agg_read_spilled(AggState *aggstate,
+					  uint32 *hashvalue);
+static void hash_agg_finish_spill(AggState *aggstate);
+static bool hash_agg_next_batch(AggState *aggstate);
+static void hash_agg_reset_spill(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_direct(AggState *aggstate);
 static void agg_fill_hash_table(AggState *aggstate);
 static TupleTableSlot *agg_retrieve_hash_table(AggState *aggstate);
@@ -1423,6 +1469,7 @@ build_hash_table(AggState *aggstate)
 	Agg		   *node = (Agg *) aggstate->ss.ps.plan;
 	MemoryContext tmpmem = aggstate->tmpcontext->ecxt_per_tuple_memory;
 	Size		entrysize;
+	long		nbuckets;
 
 	Assert(node->aggstrategy == AGG_HASHED);
 	Assert(node->numGroups > 0);
@@ -1430,11 +1477,17 @@ build_hash_table(AggState *aggstate)
 	entrysize = offsetof(AggHashEntryData, pergroup) +
 		aggstate->numaggs * sizeof(AggStatePerGroupData);
 
+	/* No point sizing the table beyond what fits, the rest spills */
+	nbuckets = Min(node->numGroups,
+				   aggstate->hash_mem_limit /
+				   hash_agg_entry_size(aggstate->numaggs));
+	nbuckets = Max(nbuckets, 1);
+
 	aggstate->hashtable = BuildTupleHashTable(node->numCols,
 											  node->grpColIdx,
 											  aggstate->phase->eqfunctions,
 											  aggstate->hashfunctions,
-											  node->numGroups,
+											  nbuckets,
 											  entrysize,
 							 aggstate->aggcontexts[0]->ecxt_per_tuple_memory,
 											  tmpmem);
@@ -1511,6 +1564,9 @@ hash_agg_entry_size(int numAggs)
  * Find or create a hashtable entry for the tuple group containing the
  * given tuple.
  *
+ * Returns NULL if the table is full and the group is not in it, in which
+ * case the caller has to spill the tuple.
+ *
  * When called, CurrentMemoryContext should be the per-query context.
  */
 static AggHashEntry
@@ -1539,6 +1595,12 @@ lookup_hash_entry(AggState *aggstate, TupleTableSlot *inputslot)
 		hashslot->tts_isnull[varNumber] = inputslot->tts_isnull[varNumber];
 	}
 
+	/* once the table is full, only look for existing groups */
+	if (aggstate->hash_spill_mode)
+		return (AggHashEntry) LookupTupleHashEntry(aggstate->hashtable,
+												   hashslot,
+												   NULL);
+
 	/* find or create the hashtable entry using the filtered tuple */
 	entry = (AggHashEntry) LookupTupleHashEntry(aggstate->hashtable,
 												hashslot,
@@ -1548,11 +1610,259 @@ lookup_hash_entry(AggState *aggstate, TupleTableSlot *inputslot)
 	{
 		/* initialize aggregates for new tuple group */
 		initialize_aggregates(aggstate, aggstate->peragg, entry->pergroup, 0);
+
+		hash_agg_check_memory(aggstate);
 	}
 
 	return entry;
 }
 
+/*
+ * Start spilling new groups if the hash table, with the transition values
+ * and first tuples of its groups, has outgrown its memory.
+ *
+ * Only batches that can still be partitioned further spill.
+ */
+static void
+hash_agg_check_memory(AggState *aggstate)
+{
+	Size		used;
+	int			level;
+
+	used = MemoryContextMemAllocated(aggstate->aggcontexts[0]->ecxt_per_tuple_memory,
+									 true);
+	if (used > aggstate->hash_mem_peak)
+		aggstate->hash_mem_peak = used;
+
+	level = aggstate->hash_batch ? aggstate->hash_batch->level : 0;
+	if (used > aggstate->hash_mem_limit && level < HASHAGG_MAX_LEVEL)
+		aggstate->hash_spill_mode = true;
+}
+
+/*
+ * Compute the hash value of the grouping columns of a tuple, the same way
+ * the hash table does.
+ */
+static uint32
+hash_agg_hash_value(AggState *aggstate, TupleTableSlot *slot)
+{
+	Agg		   *node = (Agg *) aggstate->ss.ps.plan;
+	MemoryContext oldcontext;
+	uint32		hashkey = 0;
+	int			i;
+
+	oldcontext = MemoryContextSwitchTo(aggstate->tmpcontext->ecxt_per_tuple_memory);
+
+	for (i = 0; i < node->numCols; i++)
+	{
+		Datum		attr;
+		bool		isNull;
+
+		/* rotate hashkey left 1 bit at each step */
+		hashkey = (hashkey << 1) | ((hashkey & 0x80000000) ? 1 : 0);
+
+		attr = slot_getattr(slot, node->grpColIdx[i], &isNull);
+
+		if (!isNull)			/* treat nulls as having hash key 0 */
+			hashkey ^= DatumGetUInt32(FunctionCall1(&aggstate->hashfunctions[i],
+													attr));
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return hashkey;
+}
+
+/*
+ * Write an input tuple whose group is not in the hash table to the file of
+ * its partition.
+ *
+ * As in ExecHashJoinSaveTuple, the hash value is written, then the tuple
+ * in MinimalTuple format. This has to be called in the per-query context.
+ */
+static void
+hash_agg_spill_tuple(AggState *aggstate, TupleTableSlot *slot,
+					 uint32 hashvalue)
+{
+	AggHashSpill spill = aggstate->hash_spill;
+	MinimalTuple tuple;
+	BufFile   **file;
+	int			partition;
+	size_t		written;
+
+	if (spill == NULL)
+	{
+		spill = (AggHashSpill) palloc0(sizeof(AggHashSpillData));
+		spill->level = (aggstate->hash_batch ? aggstate->hash_batch->level : 0) + 1;
+		aggstate->hash_spill = spill;
+	}
+
+	partition = (hashvalue >> (32 - spill->level * HASHAGG_PARTITION_BITS)) &
+		(HASHAGG_PARTITIONS - 1);
+	file = &spill->files[partition];
+	if (*file == NULL)
+		*file = BufFileCreateTemp(false);
+
+	tuple = ExecFetchSlotMinimalTuple(slot);
+
+	written = BufFileWrite(*file, (void *) &hashvalue, sizeof(uint32));
+	if (written != sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+			errmsg("could not write to hash-aggregate temporary file: %m")));
+
+	written = BufFileWrite(*file, (void *) tuple, tuple->t_len);
+	if (written != tuple->t_len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+			errmsg("could not write to hash-aggregate temporary file: %m")));
+}
+
+/*
+ * Read the next tuple of the batch being aggregated, or return NULL at the
+ * end of it.
+ */
+static TupleTableSlot *
+hash_agg_read_spilled(AggState *aggstate, uint32 *hashvalue)
+{
+	BufFile    *file = aggstate->hash_batch->file;
+	TupleTableSlot *slot = aggstate->hash_spill_slot;
+	uint32		header[2];
+	size_t		nread;
+	MinimalTuple tuple;
+
+	/* The hash value and the length word of the tuple come together */
+	nread = BufFileRead(file, (void *) header, sizeof(header));
+	if (nread == 0)				/* end of file */
+		return ExecClearTuple(slot);
+	if (nread != sizeof(header))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+			 errmsg("could not read from hash-aggregate temporary file: %m")));
+	*hashvalue = header[0];
+	tuple = (MinimalTuple) palloc(header[1]);
+	tuple->t_len = header[1];
+	nread = BufFileRead(file,
+						(void *) ((char *) tuple + sizeof(uint32)),
+						header[1] - sizeof(uint32));
+	if (nread != header[1] - sizeof(uint32))
+		ereport(ERROR,
+				(errcode_for_file_access(),
+			 errmsg("could not read from hash-aggregate temporary file: %m")));
+	return ExecStoreMinimalTuple(tuple, slot, true);
+}
+
+/*
+ * Queue the partitions written while aggregating the current batch, to be
+ * aggregated once its groups have been returned.
+ */
+static void
+hash_agg_finish_spill(AggState *aggstate)
+{
+	AggHashSpill spill = aggstate->hash_spill;
+	int			i;
+
+	for (i = 0; i < HASHAGG_PARTITIONS; i++)
+	{
+		AggHashBatch batch;
+
+		if (spill->files[i] == NULL)
+			continue;
+
+		if (BufFileSeek(spill->files[i], 0, 0L, SEEK_SET))
+			ereport(ERROR,
+					(errcode_for_file_access(),
+			   errmsg("could not rewind hash-aggregate temporary file: %m")));
+
+		batch = (AggHashBatch) palloc(sizeof(AggHashBatchData));
+		batch->level = spill->level;
+		batch->file = spill->files[i];
+		aggstate->hash_batches = lappend(aggstate->hash_batches, batch);
+	}
+
+	pfree(spill);
+	aggstate->hash_spill = NULL;
+}
+
+/*
+ * Once the groups of the hash table have all been returned, fill it again
+ * from the next spilled batch. Returns false if there is none left.
+ */
+static bool
+hash_agg_next_batch(AggState *aggstate)
+{
+	AggHashBatch batch;
+
+	/* We are done with the batch just returned */
+	if (aggstate->hash_batch != NULL)
+	{
+		BufFileClose(aggstate->hash_batch->file);
+		pfree(aggstate->hash_batch);
+		aggstate->hash_batch = NULL;
+	}
+
+	if (aggstate->hash_batches == NIL)
+		return false;
+
+	batch = (AggHashBatch) linitial(aggstate->hash_batches);
+	aggstate->hash_batches = list_delete_first(aggstate->hash_batches);
+	aggstate->hash_batch = batch;
+
+	/*
+	 * Forget the groups of the previous batch. As in ExecReScanAgg, rescan
+	 * rather than reset the context so that shutdown callbacks are run.
+	 */
+	ExecClearTuple(aggstate->ss.ss_ScanTupleSlot);
+	ReScanExprContext(aggstate->aggcontexts[0]);
+	build_hash_table(aggstate);
+	aggstate->hash_spill_mode = false;
+
+	agg_fill_hash_table(aggstate);
+
+	return true;
+}
+
+/*
+ * Close the temporary files of an unfinished hashed aggregation.
+ */
+static void
+hash_agg_reset_spill(AggState *aggstate)
+{
+	ListCell   *lc;
+	int			i;
+
+	if (aggstate->hash_spill != NULL)
+	{
+		for (i = 0; i < HASHAGG_PARTITIONS; i++)
+		{
+			if (aggstate->hash_spill->files[i] != NULL)
+				BufFileClose(aggstate->hash_spill->files[i]);
+		}
+		pfree(aggstate->hash_spill);
+		aggstate->hash_spill = NULL;
+	}
+
+	if (aggstate->hash_batch != NULL)
+	{
+		BufFileClose(aggstate->hash_batch->file);
+		pfree(aggstate->hash_batch);
+		aggstate->hash_batch = NULL;
+	}
+
+	foreach(lc, aggstate->hash_batches)
+	{
+		AggHashBatch batch = (AggHashBatch) lfirst(lc);
+
+		BufFileClose(batch->file);
+		pfree(batch);
+	}
+	list_free(aggstate->hash_batches);
+	aggstate->hash_batches = NIL;
+
+	aggstate->hash_spill_mode = false;
+	aggstate->hash_nbatches = 0;
+}
+
 /*
  * ExecAgg -
  *
@@ -1958,7 +2268,13 @@ agg_fill_hash_table(AggState *aggstate)
 	 */
 	for (;;)
 	{
-		outerslot = fetch_input_tuple(aggstate);
+		uint32		hashvalue = 0;
+
+		/* Read the outer plan, or the spilled batch being aggregated */
+		if (aggstate->hash_batch != NULL)
+			outerslot = hash_agg_read_spilled(aggstate, &hashvalue);
+		else
+			outerslot = fetch_input_tuple(aggstate);
 		if (TupIsNull(outerslot))
 			break;
 		/* set up for advance_aggregates call */
@@ -1967,13 +2283,29 @@ agg_fill_hash_table(AggState *aggstate)
 		/* Find or build hashtable entry for this tuple's group */
 		entry = lookup_hash_entry(aggstate, outerslot);
 
-		/* Advance the aggregates */
-		advance_aggregates(aggstate, entry->pergroup);
+		if (entry != NULL)
+		{
+			/* Advance the aggregates */
+			advance_aggregates(aggstate, entry->pergroup);
+		}
+		else
+		{
+			/* No room for the group, aggregate the tuple later */
+			if (aggstate->hash_batch == NULL)
+				hashvalue = hash_agg_hash_value(aggstate, outerslot);
+			hash_agg_spill_tuple(aggstate, outerslot, hashvalue);
+		}
 
 		/* Reset per-input-tuple context after each tuple */
 		ResetExprContext(tmpcontext);
 	}
 
+	/* Queue what was spilled, and account for the memory used */
+	if (aggstate->hash_spill != NULL)
+		hash_agg_finish_spill(aggstate);
+	hash_agg_check_memory(aggstate);
+	aggstate->hash_nbatches++;
+
 	aggstate->table_filled = true;
 	/* Initialize to walk the hash table */
 	ResetTupleHashIterator(aggstate->hashtable, &aggstate->hashiter);
@@ -2012,7 +2344,11 @@ agg_retrieve_hash_table(AggState *aggstate)
 		entry = (AggHashEntry) ScanTupleHashTable(&aggstate->hashiter);
 		if (entry == NULL)
 		{
-			/* No more entries in hashtable, so done */
+			/* No more entries in hashtable, go on with any spilled batch */
+			if (hash_agg_next_batch(aggstate))
+				continue;
+
+			/* No more batches either, so done */
 			aggstate->agg_done = TRUE;
 			return NULL;
 		}
@@ -2102,6 +2438,13 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	aggstate->pergroup = NULL;
 	aggstate->grp_firstTuple = NULL;
 	aggstate->hashtable = NULL;
+	aggstate->hash_mem_limit = work_mem * 1024L;
+	aggstate->hash_mem_peak = 0;
+	aggstate->hash_spill_mode = false;
+	aggstate->hash_spill = NULL;
+	aggstate->hash_batch = NULL;
+	aggstate->hash_batches = NIL;
+	aggstate->hash_nbatches = 0;
 	aggstate->sort_in = NULL;
 	aggstate->sort_out = NULL;
 
@@ -2161,6 +2504,7 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	ExecInitResultTupleSlot(estate, &aggstate->ss.ps);
 	aggstate->hashslot = ExecInitExtraTupleSlot(estate);
 	aggstate->sort_slot = ExecInitExtraTupleSlot(estate);
+	aggstate->hash_spill_slot = ExecInitExtraTupleSlot(estate);
 
 	/*
 	 * initialize child expressions
@@ -2196,6 +2540,9 @@ ExecInitAgg(Agg *node, EState *estate, int eflags)
 	if (node->chain)
 		ExecSetSlotDescriptor(aggstate->sort_slot,
 						 aggstate->ss.ss_ScanTupleSlot->tts_tupleDescriptor);
+	if (node->aggstrategy == AGG_HASHED)
+		ExecSetSlotDescriptor(aggstate->hash_spill_slot,
+						 aggstate->ss.ss_ScanTupleSlot->tts_tupleDescriptor);
 
 	/*
 	 * Initialize result tuple type and projection info.
@@ -2857,6 +3204,9 @@ ExecEndAgg(AggState *node)
 	if (node->sort_out)
 		tuplesort_end(node->sort_out);
 
+	/* And any spill files */
+	hash_agg_reset_spill(node);
+
 	for (aggno = 0; aggno < node->numaggs; aggno++)
 	{
 		AggStatePerAgg peraggstate = &node->peragg[aggno];
@@ -2914,9 +3264,10 @@ ExecReScanAgg(AggState *node)
 		/*
 		 * If we do have the hash table and the subplan does not have any
 		 * parameter changes, then we can just rescan the existing hash table;
-		 * no need to build it again.
+		 * no need to build it again.  Not so if it spilled, since the table
+		 * only holds the groups of the last batch.
 		 */
-		if (outerPlan->chgParam == NULL)
+		if (outerPlan->chgParam == NULL && node->hash_nbatches == 1)
 		{
 			ResetTupleHashIterator(node->hashtable, &node->hashiter);
 			return;
@@ -2970,6 +3321,7 @@ ExecReScanAgg(AggState *node)
 	if (aggnode->aggstrategy == AGG_HASHED)
 	{
 		/* Rebuild an empty hash table */
+		hash_agg_reset_spill(node);
 		build_hash_table(node);
 		node->table_filled = false;
 	}
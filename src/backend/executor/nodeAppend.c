@@ -59,8 +59,15 @@
 
 #include "executor/execdebug.h"
 #include "executor/nodeAppend.h"
+#ifdef XCP
+#include "pgxc/execRemote.h"
+#include "pgxc/pgxc.h"
+#endif
 
 static bool exec_append_initialize_next(AppendState *appendstate);
+#ifdef XCP
+static TupleTableSlot *exec_append_async(AppendState *node);
+#endif
 
 
 /* ----------------------------------------------------------------
@@ -169,6 +176,29 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 		i++;
 	}
 
+#ifdef XCP
+	/*
+	 * On the Coordinator, if all the subplans are remote, start them all at
+	 * once and return rows from those having them ready, so the nodes of
+	 * every subplan work in parallel. The order of the rows is not defined
+	 * anyway, except when scanning backward.
+	 */
+	appendstate->as_async = IS_PGXC_COORDINATOR && nplans > 1 &&
+		!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_EXPLAIN_ONLY));
+	for (i = 0; appendstate->as_async && i < nplans; i++)
+	{
+		if (!IsA(appendplanstates[i], RemoteSubplanState))
+			appendstate->as_async = false;
+	}
+	if (appendstate->as_async)
+	{
+		appendstate->as_started = false;
+		appendstate->as_finished = (bool *) palloc0(nplans * sizeof(bool));
+		appendstate->as_waitconns = (PGXCNodeHandle **)
+			palloc(nplans * sizeof(PGXCNodeHandle *));
+	}
+#endif
+
 	/*
 	 * initialize output tuple type
 	 */
@@ -193,6 +223,11 @@ ExecInitAppend(Append *node, EState *estate, int eflags)
 TupleTableSlot *
 ExecAppend(AppendState *node)
 {
+#ifdef XCP
+	if (node->as_async)
+		return exec_append_async(node);
+#endif
+
 	for (;;)
 	{
 		PlanState  *subnode;
@@ -234,6 +269,104 @@ ExecAppend(AppendState *node)
 	}
 }
 
+#ifdef XCP
+/* ----------------------------------------------------------------
+ *		exec_append_async
+ *
+ *		Returns a tuple of whichever remote subplan has one ready,
+ *		waiting on the connections of all of them if none has.
+ *		The subplan which returned the previous tuple is tried first,
+ *		to read its rows in batches.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+exec_append_async(AppendState *node)
+{
+	int			nplans = node->as_nplans;
+	int			i;
+
+	if (!node->as_started)
+	{
+		for (i = 0; i < nplans; i++)
+			(void) ExecStartRemoteSubplan(
+						(RemoteSubplanState *) node->appendplans[i]);
+		node->as_started = true;
+	}
+
+	for (;;)
+	{
+		int			nactive = 0;
+		int			nwait = 0;
+		int			n;
+
+		for (n = 0; n < nplans; n++)
+		{
+			RemoteSubplanState *subnode;
+			PGXCNodeHandle *waitconn;
+			TupleTableSlot *result;
+
+			i = (node->as_whichplan + n) % nplans;
+			if (node->as_finished[i])
+				continue;
+			nactive++;
+
+			/*
+			 * Subplan which could not start because its connections were
+			 * busy may be able to start now.
+			 */
+			subnode = (RemoteSubplanState *) node->appendplans[i];
+			if (!ExecStartRemoteSubplan(subnode))
+				continue;
+
+			if (!ExecRemoteSubplanReady(subnode, &waitconn))
+			{
+				node->as_waitconns[nwait++] = waitconn;
+				continue;
+			}
+
+			result = ExecProcNode((PlanState *) subnode);
+			if (!TupIsNull(result))
+			{
+				node->as_whichplan = i;
+				return result;
+			}
+			node->as_finished[i] = true;
+			nactive--;
+		}
+
+		if (nactive == 0)
+			return ExecClearTuple(node->ps.ps_ResultTupleSlot);
+
+		if (nwait > 0)
+		{
+			/* Sleep until any of the nodes sends something */
+			if (pgxc_node_receive(nwait, node->as_waitconns, NULL))
+				ereport(ERROR,
+						(errcode(ERRCODE_INTERNAL_ERROR),
+						 errmsg("Failed to receive data from data nodes")));
+		}
+		else
+		{
+			TupleTableSlot *result;
+
+			/*
+			 * No subplan is running, those left can not start ahead, run the
+			 * first one as usual.
+			 */
+			for (i = 0; node->as_finished[i]; i++)
+				;
+			result = ExecProcNode(node->appendplans[i]);
+			if (!TupIsNull(result))
+			{
+				node->as_whichplan = i;
+				return result;
+			}
+			node->as_finished[i] = true;
+		}
+	}
+}
+#endif
+
 /* ----------------------------------------------------------------
  *		ExecEndAppend
  *
@@ -287,4 +420,11 @@ ExecReScanAppend(AppendState *node)
 	}
 	node->as_whichplan = 0;
 	exec_append_initialize_next(node);
+#ifdef XCP
+	if (node->as_async)
+	{
+		node->as_started = false;
+		memset(node->as_finished, 0, node->as_nplans * sizeof(bool));
+	}
+#endif
 }
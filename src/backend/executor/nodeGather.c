@@ -0,0 +1,732 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeGather.c
+ *	  Routines to run a plan fragment in parallel workers
+ *
+ * A Datanode runs the fragment of a RemoteSubplan in a single process. If
+ * the fragment scans a large table, ExecParallelFragment puts a Gather node
+ * on top of it. The Gather node launches parallel workers which run the
+ * fragment too, sharing the first sequential scan down its outer side so
+ * that every page is scanned by one process only. The rows of each worker
+ * come back through a shared memory queue, and the process running the
+ * Gather node runs the fragment itself whenever no row is ready.
+ *
+ * A fragment is only run that way if splitting the scan does not change
+ * its result: the outer side of the joins is split, while every process
+ * runs the inner side in full, and an aggregate is only allowed on top if it
+ * is the first phase of a distributed aggregate, whose second phase combines
+ * the partial results of the processes like those of the Datanodes.
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/nodeGather.c
+ *
+ *-------------------------------------------------------------------------
+ */
+/*
+ * INTERFACE ROUTINES
+ *		ExecParallelFragment	- put a Gather node on top of a fragment
+ *		ExecInitGather			- initialize the node and the subplan
+ *		ExecGather				- return the next row of any process
+ *		ExecEndGather			- stop the workers and shut down the subplan
+ *		ExecReScanGather		- rescan the subplan
+ */
+#include "postgres.h"
+
+#include "access/parallel.h"
+#include "access/relscan.h"
+#include "access/xact.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "executor/nodeGather.h"
+#include "executor/nodeSeqscan.h"
+#include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "parser/parsetree.h"
+#include "pgxc/pgxc.h"
+#include "storage/bufmgr.h"
+#include "storage/lmgr.h"
+#include "storage/proc.h"
+#include "tcop/tcopprot.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+/* GUC parameters */
+int			max_parallel_degree = 0;
+int			min_parallel_relation_size = 1024;
+
+/* Keys of the parallel state, see parallel.c */
+#define GATHER_KEY_PLAN				UINT64CONST(1)
+#define GATHER_KEY_RANGE_TABLE		UINT64CONST(2)
+#define GATHER_KEY_SCAN				UINT64CONST(3)
+#define GATHER_KEY_TUPLE_QUEUE		UINT64CONST(4)
+
+#define GATHER_TUPLE_QUEUE_SIZE		65536
+
+/* Receiver of a worker sending the rows to its queue */
+typedef struct
+{
+	DestReceiver pub;
+	shm_mq_handle *queue;
+} GatherDestReceiver;
+
+static SeqScan *parallel_driving_scan(Plan *plan, List *rtable, bool top);
+static bool parallel_inner_safe(Plan *plan, List *rtable);
+static bool parallel_node_safe(Plan *plan);
+static bool parallel_expr_unsafe(Node *node);
+static bool parallel_expr_unsafe_walker(Node *node, void *context);
+static BlockNumber parallel_scan_blocks(Index scanrelid, List *rtable);
+static SeqScanState *parallel_scan_state(PlanState *planstate);
+static void ExecGatherBegin(GatherState *node);
+static HeapTuple gather_readnext(GatherState *node, bool nowait);
+static void ExecShutdownGather(GatherState *node, bool wait);
+static void ParallelFragmentMain(dsm_segment *seg, shm_toc *toc);
+static void gather_receive(TupleTableSlot *slot, DestReceiver *self);
+static void gather_startup(DestReceiver *self, int operation,
+			   TupleDesc typeinfo);
+static void gather_shutdown(DestReceiver *self);
+
+
+/* ----------------------------------------------------------------
+ *		ExecParallelFragment
+ *
+ *		Returns a Gather node running the plan fragment in parallel
+ *		workers, or the fragment itself if that is not possible or not
+ *		worth it. The number of workers grows with the size of the table
+ *		scanned, by one each time the size is tripled.
+ * ----------------------------------------------------------------
+ */
+Plan *
+ExecParallelFragment(Plan *plan, EState *estate, int eflags)
+{
+	PlannedStmt *pstmt = estate->es_plannedstmt;
+	SeqScan    *scan;
+	BlockNumber nblocks;
+	double		threshold;
+	int			nworkers;
+	Gather	   *gather;
+	List	   *tlist = NIL;
+	ListCell   *lc;
+
+	if (max_parallel_degree <= 0 || !IS_PGXC_DATANODE ||
+		IsInParallelMode() || IsolationIsSerializable() ||
+		(eflags & (EXEC_FLAG_EXPLAIN_ONLY | EXEC_FLAG_BACKWARD |
+				   EXEC_FLAG_MARK)) ||
+		pstmt == NULL || pstmt->commandType != CMD_SELECT ||
+		pstmt->rowMarks != NIL || pstmt->hasModifyingCTE)
+		return plan;
+
+	scan = parallel_driving_scan(plan, estate->es_range_table, true);
+	if (scan == NULL)
+		return plan;
+
+	/* The rows are copied to the queues as they are */
+	foreach(lc, plan->targetlist)
+	{
+		TargetEntry *tle = (TargetEntry *) lfirst(lc);
+		Oid			type = exprType((Node *) tle->expr);
+
+		if (type == RECORDOID || type == INTERNALOID)
+			return plan;
+	}
+
+	nblocks = parallel_scan_blocks(scan->scanrelid, estate->es_range_table);
+	threshold = Max(min_parallel_relation_size, 1);
+	if (nblocks == InvalidBlockNumber || nblocks < threshold)
+		return plan;
+	nworkers = 1;
+	while (nworkers < max_parallel_degree && nblocks >= threshold * 3)
+	{
+		threshold *= 3;
+		nworkers++;
+	}
+
+	gather = makeNode(Gather);
+	gather->num_workers = nworkers;
+	gather->plan.startup_cost = plan->startup_cost;
+	gather->plan.total_cost = plan->total_cost;
+	gather->plan.plan_rows = plan->plan_rows;
+	gather->plan.plan_width = plan->plan_width;
+	foreach(lc, plan->targetlist)
+	{
+		TargetEntry *tle = (TargetEntry *) lfirst(lc);
+
+		tlist = lappend(tlist,
+						makeTargetEntry((Expr *) makeVarFromTargetEntry(OUTER_VAR, tle),
+										tle->resno,
+										tle->resname,
+										tle->resjunk));
+	}
+	gather->plan.targetlist = tlist;
+	gather->plan.lefttree = plan;
+
+	elog(DEBUG1, "running plan fragment in %d parallel workers", nworkers);
+
+	return (Plan *) gather;
+}
+
+/*
+ * Find the sequential scan the processes share, following the outer side of
+ * the plan, or NULL if the plan can not be split that way.
+ */
+static SeqScan *
+parallel_driving_scan(Plan *plan, List *rtable, bool top)
+{
+	if (plan == NULL || !parallel_node_safe(plan))
+		return NULL;
+
+	switch (nodeTag(plan))
+	{
+		case T_SeqScan:
+			return (SeqScan *) plan;
+
+		case T_Agg:
+			/* The second phase combines the rows of all the processes */
+			if (!top || ((Agg *) plan)->aggdistribution != AGG_SLAVE)
+				return NULL;
+			break;
+
+		case T_Sort:
+		case T_Material:
+			break;
+
+		case T_Result:
+			if (outerPlan(plan) == NULL)
+				return NULL;
+			break;
+
+		case T_NestLoop:
+		case T_MergeJoin:
+		case T_HashJoin:
+			switch (((Join *) plan)->jointype)
+			{
+				case JOIN_INNER:
+				case JOIN_LEFT:
+				case JOIN_SEMI:
+				case JOIN_ANTI:
+					break;
+				default:
+					/* Every process would return the unmatched inner rows */
+					return NULL;
+			}
+			if (!parallel_inner_safe(innerPlan(plan), rtable))
+				return NULL;
+			break;
+
+		default:
+			return NULL;
+	}
+
+	return parallel_driving_scan(outerPlan(plan), rtable, false);
+}
+
+/*
+ * Can every process run the plan in full?
+ */
+static bool
+parallel_inner_safe(Plan *plan, List *rtable)
+{
+	if (plan == NULL)
+		return true;
+
+	if (!parallel_node_safe(plan))
+		return false;
+
+	switch (nodeTag(plan))
+	{
+		case T_SeqScan:
+			if (parallel_scan_blocks(((Scan *) plan)->scanrelid, rtable) ==
+				InvalidBlockNumber)
+				return false;
+			break;
+
+		case T_Agg:
+			if (((Agg *) plan)->aggdistribution != AGG_ONENODE)
+				return false;
+			break;
+
+		case T_Hash:
+		case T_Sort:
+		case T_Material:
+		case T_Result:
+		case T_NestLoop:
+		case T_MergeJoin:
+		case T_HashJoin:
+			break;
+
+		default:
+			return false;
+	}
+
+	return parallel_inner_safe(outerPlan(plan), rtable) &&
+		parallel_inner_safe(innerPlan(plan), rtable);
+}
+
+/*
+ * The workers get neither the parameters nor the subplans, and should not
+ * run functions with side effects.
+ */
+static bool
+parallel_node_safe(Plan *plan)
+{
+	if (plan->initPlan != NIL ||
+		parallel_expr_unsafe((Node *) plan->targetlist) ||
+		parallel_expr_unsafe((Node *) plan->qual))
+		return false;
+
+	switch (nodeTag(plan))
+	{
+		case T_Result:
+			return !parallel_expr_unsafe(((Result *) plan)->resconstantqual);
+		case T_NestLoop:
+			return ((NestLoop *) plan)->nestParams == NIL &&
+				!parallel_expr_unsafe((Node *) ((Join *) plan)->joinqual);
+		case T_MergeJoin:
+			return !parallel_expr_unsafe((Node *) ((Join *) plan)->joinqual) &&
+				!parallel_expr_unsafe((Node *) ((MergeJoin *) plan)->mergeclauses);
+		case T_HashJoin:
+			return !parallel_expr_unsafe((Node *) ((Join *) plan)->joinqual) &&
+				!parallel_expr_unsafe((Node *) ((HashJoin *) plan)->hashclauses);
+		default:
+			return true;
+	}
+}
+
+static bool
+parallel_expr_unsafe(Node *node)
+{
+	return parallel_expr_unsafe_walker(node, NULL) ||
+		contain_volatile_functions(node);
+}
+
+static bool
+parallel_expr_unsafe_walker(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Param) || IsA(node, SubPlan) ||
+		IsA(node, AlternativeSubPlan))
+		return true;
+	return expression_tree_walker(node, parallel_expr_unsafe_walker, context);
+}
+
+/*
+ * Number of blocks of the table, or InvalidBlockNumber if the workers can
+ * not scan it.
+ */
+static BlockNumber
+parallel_scan_blocks(Index scanrelid, List *rtable)
+{
+	Relation	rel;
+	BlockNumber nblocks = InvalidBlockNumber;
+
+	rel = heap_open(getrelid(scanrelid, rtable), AccessShareLock);
+	if ((rel->rd_rel->relkind == RELKIND_RELATION ||
+		 rel->rd_rel->relkind == RELKIND_MATVIEW) &&
+		!RelationUsesLocalBuffers(rel))
+		nblocks = RelationGetNumberOfBlocks(rel);
+	heap_close(rel, NoLock);
+
+	return nblocks;
+}
+
+/*
+ * The state of the shared scan, down the outer side of the plan
+ */
+static SeqScanState *
+parallel_scan_state(PlanState *planstate)
+{
+	while (planstate != NULL && !IsA(planstate, SeqScanState))
+		planstate = outerPlanState(planstate);
+	return (SeqScanState *) planstate;
+}
+
+
+/* ----------------------------------------------------------------
+ *		ExecInitGather
+ * ----------------------------------------------------------------
+ */
+GatherState *
+ExecInitGather(Gather *node, EState *estate, int eflags)
+{
+	GatherState *gatherstate;
+
+	/* The shared scan only moves forward */
+	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK)));
+
+	gatherstate = makeNode(GatherState);
+	gatherstate->ps.plan = (Plan *) node;
+	gatherstate->ps.state = estate;
+	gatherstate->need_to_scan_locally = true;
+
+	/*
+	 * Gather nodes don't project, the rows of the subplan are returned as
+	 * they are.
+	 */
+	ExecInitResultTupleSlot(estate, &gatherstate->ps);
+
+	outerPlanState(gatherstate) = ExecInitNode(outerPlan(node), estate, eflags);
+
+	ExecAssignResultTypeFromTL(&gatherstate->ps);
+	gatherstate->ps.ps_ProjInfo = NULL;
+
+	return gatherstate;
+}
+
+/*
+ * Launch the workers and make the subplan of this process join the shared
+ * scan.
+ */
+static void
+ExecGatherBegin(GatherState *node)
+{
+	Gather	   *plan = (Gather *) node->ps.plan;
+	EState	   *estate = node->ps.state;
+	SeqScanState *scanstate = parallel_scan_state(outerPlanState(node));
+	ParallelContext *pcxt;
+	char	   *plan_string;
+	char	   *rtable_string;
+	char	   *space;
+	ParallelHeapScanDesc pscan;
+	shm_mq_handle **queues = NULL;
+	int			i;
+
+	Assert(scanstate != NULL);
+
+	plan_string = nodeToString(outerPlan(plan));
+	rtable_string = nodeToString(estate->es_range_table);
+
+	EnterParallelMode();
+	pcxt = CreateParallelContext(ParallelFragmentMain, plan->num_workers);
+
+	shm_toc_estimate_chunk(&pcxt->estimator, strlen(plan_string) + 1);
+	shm_toc_estimate_chunk(&pcxt->estimator, strlen(rtable_string) + 1);
+	shm_toc_estimate_chunk(&pcxt->estimator, heap_parallelscan_estimate());
+	shm_toc_estimate_chunk(&pcxt->estimator,
+						   mul_size(GATHER_TUPLE_QUEUE_SIZE, pcxt->nworkers));
+	shm_toc_estimate_keys(&pcxt->estimator, 4);
+
+	/* The workers see the rows the subplan of this process sees */
+	PushActiveSnapshot(estate->es_snapshot);
+	InitializeParallelDSM(pcxt);
+	PopActiveSnapshot();
+
+	space = shm_toc_allocate(pcxt->toc, strlen(plan_string) + 1);
+	strcpy(space, plan_string);
+	shm_toc_insert(pcxt->toc, GATHER_KEY_PLAN, space);
+
+	space = shm_toc_allocate(pcxt->toc, strlen(rtable_string) + 1);
+	strcpy(space, rtable_string);
+	shm_toc_insert(pcxt->toc, GATHER_KEY_RANGE_TABLE, space);
+
+	pscan = shm_toc_allocate(pcxt->toc, heap_parallelscan_estimate());
+	heap_parallelscan_initialize(pscan, scanstate->ss.ss_currentRelation);
+	shm_toc_insert(pcxt->toc, GATHER_KEY_SCAN, pscan);
+	ExecSeqScanInitializeParallel(scanstate, pscan);
+
+	/* There are no workers if the shared memory could not be allocated */
+	node->nreaders = 0;
+	node->nextreader = 0;
+	if (pcxt->nworkers > 0)
+	{
+		space = shm_toc_allocate(pcxt->toc,
+								 mul_size(GATHER_TUPLE_QUEUE_SIZE,
+										  pcxt->nworkers));
+		shm_toc_insert(pcxt->toc, GATHER_KEY_TUPLE_QUEUE, space);
+
+		queues = (shm_mq_handle **)
+			palloc(pcxt->nworkers * sizeof(shm_mq_handle *));
+		for (i = 0; i < pcxt->nworkers; i++)
+		{
+			shm_mq	   *mq;
+
+			mq = shm_mq_create(space + i * GATHER_TUPLE_QUEUE_SIZE,
+							   GATHER_TUPLE_QUEUE_SIZE);
+			shm_mq_set_receiver(mq, MyProc);
+			queues[i] = shm_mq_attach(mq, pcxt->seg, NULL);
+		}
+
+		LaunchParallelWorkers(pcxt);
+
+		/*
+		 * Only read the queues of the workers registered. If a worker dies
+		 * before attaching to its queue, reading it reports the queue is
+		 * detached.
+		 */
+		for (i = 0; i < pcxt->nworkers; i++)
+		{
+			if (pcxt->worker[i].bgwhandle == NULL)
+				continue;
+			shm_mq_set_handle(queues[i], pcxt->worker[i].bgwhandle);
+			queues[node->nreaders++] = queues[i];
+		}
+	}
+	node->reader = queues;
+	node->pcxt = pcxt;
+	node->initialized = true;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecGather
+ *
+ *		Returns the rows of the workers as soon as they are ready, so they
+ *		do not wait for room in their queues, otherwise a row of the
+ *		subplan of this process.
+ * ----------------------------------------------------------------
+ */
+TupleTableSlot *
+ExecGather(GatherState *node)
+{
+	TupleTableSlot *slot;
+	HeapTuple	tuple;
+
+	if (!node->initialized)
+		ExecGatherBegin(node);
+
+	for (;;)
+	{
+		if (node->nreaders > 0)
+		{
+			tuple = gather_readnext(node, node->need_to_scan_locally);
+			if (tuple != NULL)
+				return ExecStoreTuple(tuple, node->ps.ps_ResultTupleSlot,
+									  InvalidBuffer, true);
+		}
+
+		if (node->need_to_scan_locally)
+		{
+			slot = ExecProcNode(outerPlanState(node));
+			if (!TupIsNull(slot))
+				return slot;
+			node->need_to_scan_locally = false;
+		}
+		else if (node->nreaders == 0)
+		{
+			/* Report the errors of the workers, if any */
+			ExecShutdownGather(node, true);
+			return ExecClearTuple(node->ps.ps_ResultTupleSlot);
+		}
+	}
+}
+
+/*
+ * Read a row from the queues of the workers, in turn. Unless nowait is set
+ * wait until a row is ready, return NULL once all the workers are done.
+ */
+static HeapTuple
+gather_readnext(GatherState *node, bool nowait)
+{
+	int			nvisited = 0;
+
+	for (;;)
+	{
+		shm_mq_result result;
+		Size		nbytes;
+		void	   *data;
+
+		/* Errors of the workers are thrown from here */
+		CHECK_FOR_INTERRUPTS();
+
+		if (node->nreaders == 0)
+			return NULL;
+		if (node->nextreader >= node->nreaders)
+			node->nextreader = 0;
+
+		result = shm_mq_receive(node->reader[node->nextreader],
+								&nbytes, &data, true);
+		if (result == SHM_MQ_SUCCESS)
+		{
+			HeapTuple	tuple;
+
+			tuple = (HeapTuple) palloc(HEAPTUPLESIZE + nbytes);
+			memset(tuple, 0, HEAPTUPLESIZE);
+			tuple->t_len = nbytes;
+			ItemPointerSetInvalid(&tuple->t_self);
+			tuple->t_tableOid = InvalidOid;
+			tuple->t_data = (HeapTupleHeader) ((char *) tuple + HEAPTUPLESIZE);
+			memcpy(tuple->t_data, data, nbytes);
+			node->nextreader++;
+			return tuple;
+		}
+
+		if (result == SHM_MQ_DETACHED)
+		{
+			/* The worker is done, forget its queue */
+			node->nreaders--;
+			memmove(&node->reader[node->nextreader],
+					&node->reader[node->nextreader + 1],
+					(node->nreaders - node->nextreader) *
+					sizeof(shm_mq_handle *));
+			continue;
+		}
+
+		node->nextreader++;
+		if (++nvisited >= node->nreaders)
+		{
+			if (nowait)
+				return NULL;
+			WaitLatch(&MyProc->procLatch, WL_LATCH_SET, 0);
+			ResetLatch(&MyProc->procLatch);
+			nvisited = 0;
+		}
+	}
+}
+
+/*
+ * Stop the workers, after waiting for them to finish if wait is set. The
+ * subplan of this process is given back a scan of its own, as the shared
+ * state of the scan goes away.
+ */
+static void
+ExecShutdownGather(GatherState *node, bool wait)
+{
+	if (node->pcxt == NULL)
+		return;
+
+	ExecSeqScanInitializeParallel(parallel_scan_state(outerPlanState(node)),
+								  NULL);
+	if (wait)
+		WaitForParallelWorkersToFinish(node->pcxt);
+	DestroyParallelContext(node->pcxt);
+	node->pcxt = NULL;
+	ExitParallelMode();
+
+	node->nreaders = 0;
+	if (node->reader)
+	{
+		pfree(node->reader);
+		node->reader = NULL;
+	}
+}
+
+/* ----------------------------------------------------------------
+ *		ExecEndGather
+ * ----------------------------------------------------------------
+ */
+void
+ExecEndGather(GatherState *node)
+{
+	ExecShutdownGather(node, false);
+	ExecClearTuple(node->ps.ps_ResultTupleSlot);
+	ExecEndNode(outerPlanState(node));
+}
+
+/* ----------------------------------------------------------------
+ *		ExecReScanGather
+ *
+ *		The workers are stopped and launched again on the next call.
+ * ----------------------------------------------------------------
+ */
+void
+ExecReScanGather(GatherState *node)
+{
+	ExecShutdownGather(node, false);
+	node->initialized = false;
+	node->need_to_scan_locally = true;
+
+	if (node->ps.lefttree->chgParam == NULL)
+		ExecReScan(node->ps.lefttree);
+}
+
+
+/*
+ * Main function of the parallel workers: run the plan fragment, with the
+ * scan shared, sending the rows to the queue of the worker.
+ */
+static void
+ParallelFragmentMain(dsm_segment *seg, shm_toc *toc)
+{
+	char	   *queue_space;
+	shm_mq	   *mq;
+	GatherDestReceiver *receiver;
+	Plan	   *plan;
+	List	   *rtable;
+	ListCell   *lc;
+	PlannedStmt *pstmt;
+	QueryDesc  *queryDesc;
+
+	queue_space = shm_toc_lookup(toc, GATHER_KEY_TUPLE_QUEUE);
+	mq = (shm_mq *) (queue_space +
+					 ParallelWorkerNumber * GATHER_TUPLE_QUEUE_SIZE);
+	shm_mq_set_sender(mq, MyProc);
+
+	receiver = (GatherDestReceiver *) palloc0(sizeof(GatherDestReceiver));
+	receiver->pub.receiveSlot = gather_receive;
+	receiver->pub.rStartup = gather_startup;
+	receiver->pub.rShutdown = gather_shutdown;
+	receiver->pub.rDestroy = gather_shutdown;
+	receiver->pub.mydest = DestNone;
+	receiver->queue = shm_mq_attach(mq, seg, NULL);
+
+	plan = (Plan *) stringToNode(shm_toc_lookup(toc, GATHER_KEY_PLAN));
+	rtable = (List *) stringToNode(shm_toc_lookup(toc, GATHER_KEY_RANGE_TABLE));
+
+	/*
+	 * The relations are locked by the process running the Gather node. If
+	 * a worker waited for a lock behind a conflicting request, that request
+	 * would wait for the process, which would wait for the worker, and the
+	 * deadlock detector would not know. Give up instead, the other processes
+	 * scan the pages this worker would have scanned.
+	 */
+	foreach(lc, rtable)
+	{
+		RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+
+		if (rte->rtekind == RTE_RELATION &&
+			!ConditionalLockRelationOid(rte->relid, AccessShareLock))
+		{
+			shm_mq_detach(mq);
+			return;
+		}
+	}
+
+	pstmt = makeNode(PlannedStmt);
+	pstmt->commandType = CMD_SELECT;
+	pstmt->canSetTag = true;
+	pstmt->planTree = plan;
+	pstmt->rtable = rtable;
+
+	queryDesc = CreateQueryDesc(pstmt, debug_query_string,
+								GetActiveSnapshot(), InvalidSnapshot,
+								(DestReceiver *) receiver, NULL, 0);
+	ExecutorStart(queryDesc, 0);
+	ExecSeqScanInitializeParallel(parallel_scan_state(queryDesc->planstate),
+								  shm_toc_lookup(toc, GATHER_KEY_SCAN));
+	ExecutorRun(queryDesc, ForwardScanDirection, 0L);
+	ExecutorFinish(queryDesc);
+	ExecutorEnd(queryDesc);
+	FreeQueryDesc(queryDesc);
+
+	shm_mq_detach(mq);
+}
+
+static void
+gather_receive(TupleTableSlot *slot, DestReceiver *self)
+{
+	GatherDestReceiver *receiver = (GatherDestReceiver *) self;
+	HeapTuple	tuple = ExecFetchSlotTuple(slot);
+
+	/* The queue is detached if the Gather node stopped reading */
+	if (shm_mq_send(receiver->queue, tuple->t_len, tuple->t_data,
+					false) != SHM_MQ_SUCCESS)
+		ereport(ERROR,
+				(errcode(ERRCODE_QUERY_CANCELED),
+				 errmsg("parallel worker is no longer needed")));
+}
+
+static void
+gather_startup(DestReceiver *self, int operation, TupleDesc typeinfo)
+{
+	/* nothing to do */
+}
+
+static void
+gather_shutdown(DestReceiver *self)
+{
+	/* nothing to do */
+}
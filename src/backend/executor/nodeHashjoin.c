@@ -22,6 +22,13 @@
 #include "executor/nodeHashjoin.h"
 #include "miscadmin.h"
 #include "utils/memutils.h"
+#ifdef XCP
+#include "access/transam.h"
+#include "executor/joinFilter.h"
+#include "pgxc/execRemote.h"
+#include "pgxc/pgxc.h"
+#include "utils/lsyscache.h"
+#endif
 
 
 /*
@@ -39,6 +46,14 @@
 /* Returns true if doing null-fill on inner relation */
 #define HJ_FILL_INNER(hjstate)	((hjstate)->hj_NullOuterTupleSlot != NULL)
 
+#ifdef XCP
+/*
+ * Test the outer tuples against the join filter before probing a single
+ * batch hash table only if it takes that many times the memory of the filter
+ */
+#define JOIN_FILTER_PROBE_RATIO	16
+#endif
+
 static TupleTableSlot *ExecHashJoinOuterGetTuple(PlanState *outerNode,
 						  HashJoinState *hjstate,
 						  uint32 *hashvalue);
@@ -47,6 +62,11 @@ static TupleTableSlot *ExecHashJoinGetSavedTuple(HashJoinState *hjstate,
 						  uint32 *hashvalue,
 						  TupleTableSlot *tupleSlot);
 static bool ExecHashJoinNewBatch(HashJoinState *hjstate);
+#ifdef XCP
+static JoinFilter *ExecHashJoinCreateFilter(HashJoinState *hjstate);
+static AttrNumber ExecHashJoinScanAttno(ScanState *scan, AttrNumber attno);
+static void ExecHashJoinDropFilter(HashJoinState *hjstate);
+#endif
 
 
 /* ----------------------------------------------------------------
@@ -119,6 +139,17 @@ ExecHashJoin(HashJoinState *node)
 				 */
 				Assert(hashtable == NULL);
 
+#ifdef XCP
+				/*
+				 * Build a filter of the inner keys along with the hash table,
+				 * so the outer rows which can not match are dropped early:
+				 * by the nodes executing the outer subplan if it is remote,
+				 * by the outer scan, or before probing the hash table.
+				 */
+				ExecHashJoinDropFilter(node);
+				node->hj_JoinFilter = ExecHashJoinCreateFilter(node);
+#endif
+
 				/*
 				 * If the outer relation is completely empty, and it's not
 				 * right/full join, we can quit without building the hash
@@ -149,7 +180,12 @@ ExecHashJoin(HashJoinState *node)
 				}
 				else if (HJ_FILL_OUTER(node) ||
 						 (outerNode->plan->startup_cost < hashNode->ps.plan->total_cost &&
-						  !node->hj_OuterNotEmpty))
+						  !node->hj_OuterNotEmpty
+#ifdef XCP
+						  /* the subplan must not start before the filter is ready */
+						  && !node->hj_FilterRemote
+#endif
+						  ))
 				{
 					node->hj_FirstOuterTupleSlot = ExecProcNode(outerNode);
 					if (TupIsNull(node->hj_FirstOuterTupleSlot))
@@ -175,7 +211,30 @@ ExecHashJoin(HashJoinState *node)
 				 * execute the Hash node, to build the hash table
 				 */
 				hashNode->hashtable = hashtable;
+#ifdef XCP
+				hashNode->joinfilter = node->hj_JoinFilter;
+#endif
 				(void) MultiExecProcNode((PlanState *) hashNode);
+#ifdef XCP
+				hashNode->joinfilter = NULL;
+				if (node->hj_JoinFilter)
+				{
+					if (!JoinFilterUseful(node->hj_JoinFilter))
+						ExecHashJoinDropFilter(node);
+					else if (node->hj_FilterRemote)
+						ExecRemoteSubplanSetJoinFilter(
+								(RemoteSubplanState *) outerNode,
+								node->hj_JoinFilter);
+					else if (node->hj_FilterScan)
+						node->hj_FilterScan->ss_JoinFilter = node->hj_JoinFilter;
+					else if (hashtable->nbatch > 1 ||
+							 hashtable->spaceUsed >
+							 JOIN_FILTER_PROBE_RATIO * (node->hj_JoinFilter->jf_nbits / 8))
+						node->hj_FilterProbe = true;
+					else
+						ExecHashJoinDropFilter(node);
+				}
+#endif
 
 				/*
 				 * If the inner relation is completely empty, and we're not
@@ -224,6 +283,20 @@ ExecHashJoin(HashJoinState *node)
 					continue;
 				}
 
+#ifdef XCP
+				/*
+				 * Skip the tuple if it can not match. The tuples of later
+				 * batches were tested before being saved.
+				 */
+				if (node->hj_FilterProbe && hashtable->curbatch == 0)
+				{
+					if (!JoinFilterWorthwhile(node->hj_JoinFilter))
+						node->hj_FilterProbe = false;
+					else if (!JoinFilterTestHash(node->hj_JoinFilter, hashvalue))
+						continue;
+				}
+#endif
+
 				econtext->ecxt_outertuple = outerTupleSlot;
 				node->hj_MatchedOuter = false;
 
@@ -590,6 +663,12 @@ ExecInitHashJoin(HashJoin *node, EState *estate, int eflags)
 	hjstate->hj_JoinState = HJ_BUILD_HASHTABLE;
 	hjstate->hj_MatchedOuter = false;
 	hjstate->hj_OuterNotEmpty = false;
+#ifdef XCP
+	hjstate->hj_JoinFilter = NULL;
+	hjstate->hj_FilterRemote = false;
+	hjstate->hj_FilterScan = NULL;
+	hjstate->hj_FilterProbe = false;
+#endif
 
 	return hjstate;
 }
@@ -631,6 +710,145 @@ ExecEndHashJoin(HashJoinState *node)
 	ExecEndNode(innerPlanState(node));
 }
 
+#ifdef XCP
+/*
+ * Set up an empty filter of the inner keys, see joinFilter.c, and decide
+ * where it is applied. Returns NULL if it can not be used: the outer rows
+ * without a match must be returned.
+ *
+ * It is sent to the nodes executing the outer subplan if that is remote,
+ * the outer keys are plain columns of the subplan and they are hashed by
+ * built-in functions, which are the same on the remote nodes. It is pushed
+ * down to the outer node if that is a scan of a relation and the outer
+ * keys are plain columns of the relation. Otherwise the hash join tests
+ * the outer tuples itself.
+ */
+static JoinFilter *
+ExecHashJoinCreateFilter(HashJoinState *hjstate)
+{
+	PlanState  *outerNode = outerPlanState(hjstate);
+	PlanState  *hashNode = innerPlanState(hjstate);
+	int			nkeys = list_length(hjstate->hj_OuterHashKeys);
+	AttrNumber *attnos;
+	Oid		   *hashfuncs;
+	JoinFilter *filter;
+	bool		remote;
+	bool		scan;
+	ListCell   *lk;
+	ListCell   *lo;
+	int			i = 0;
+
+	if (!RuntimeJoinFilters ||
+		HJ_FILL_OUTER(hjstate) || hjstate->js.jointype == JOIN_ANTI)
+		return NULL;
+
+	remote = IS_PGXC_DATANODE &&
+		IsA(outerNode, RemoteSubplanState) &&
+		!((RemoteSubplanState *) outerNode)->local_exec;
+	switch (nodeTag(outerNode))
+	{
+		case T_SeqScanState:
+		case T_SampleScanState:
+		case T_IndexScanState:
+		case T_BitmapHeapScanState:
+		case T_TidScanState:
+			scan = true;
+			break;
+		default:
+			scan = false;
+			break;
+	}
+
+	attnos = (AttrNumber *) palloc(nkeys * sizeof(AttrNumber));
+	hashfuncs = (Oid *) palloc(nkeys * sizeof(Oid));
+	forboth(lk, hjstate->hj_OuterHashKeys, lo, hjstate->hj_HashOperators)
+	{
+		Expr	   *expr = ((ExprState *) lfirst(lk))->expr;
+		Oid			left_hashfn;
+		Oid			right_hashfn;
+
+		if (!get_op_hash_functions(lfirst_oid(lo), &left_hashfn, &right_hashfn))
+			elog(ERROR, "could not find hash function for hash operator %u",
+				 lfirst_oid(lo));
+		hashfuncs[i] = left_hashfn;
+		if (left_hashfn >= FirstBootstrapObjectId)
+			remote = false;
+
+		while (IsA(expr, RelabelType))
+			expr = ((RelabelType *) expr)->arg;
+		if (IsA(expr, Var) && ((Var *) expr)->varno == OUTER_VAR)
+		{
+			attnos[i] = ((Var *) expr)->varattno;
+			if (scan)
+				attnos[i] = ExecHashJoinScanAttno((ScanState *) outerNode,
+												  attnos[i]);
+		}
+		else
+			attnos[i] = InvalidAttrNumber;
+		if (attnos[i] == InvalidAttrNumber)
+			remote = scan = false;
+		i++;
+	}
+
+	filter = JoinFilterCreate(nkeys, attnos, hashfuncs,
+							  hashNode->plan->plan_rows);
+	hjstate->hj_FilterRemote = remote;
+	hjstate->hj_FilterScan = scan ? (ScanState *) outerNode : NULL;
+	pfree(attnos);
+	pfree(hashfuncs);
+	return filter;
+}
+
+/*
+ * Column of the relation scanned by the outer scan node holding its output
+ * column attno, or InvalidAttrNumber if that is computed.
+ */
+static AttrNumber
+ExecHashJoinScanAttno(ScanState *scan, AttrNumber attno)
+{
+	Plan	   *plan = scan->ps.plan;
+	Expr	   *expr;
+	Var		   *var;
+
+	if (attno < 1 || attno > list_length(plan->targetlist))
+		return InvalidAttrNumber;
+
+	expr = ((TargetEntry *) list_nth(plan->targetlist, attno - 1))->expr;
+	while (IsA(expr, RelabelType))
+		expr = ((RelabelType *) expr)->arg;
+	if (!IsA(expr, Var))
+		return InvalidAttrNumber;
+
+	var = (Var *) expr;
+	if (var->varno != ((Scan *) plan)->scanrelid || var->varlevelsup != 0 ||
+		var->varattno < 1)
+		return InvalidAttrNumber;
+
+	return var->varattno;
+}
+
+/*
+ * Release the filter, after taking it back from whoever applies it
+ */
+static void
+ExecHashJoinDropFilter(HashJoinState *hjstate)
+{
+	if (hjstate->hj_JoinFilter == NULL)
+		return;
+
+	if (hjstate->hj_FilterRemote)
+		ExecRemoteSubplanSetJoinFilter((RemoteSubplanState *) outerPlanState(hjstate),
+									   NULL);
+	if (hjstate->hj_FilterScan)
+		hjstate->hj_FilterScan->ss_JoinFilter = NULL;
+	JoinFilterFree(hjstate->hj_JoinFilter);
+	hjstate->hj_JoinFilter = NULL;
+	hjstate->hj_FilterRemote = false;
+	hjstate->hj_FilterScan = NULL;
+	hjstate->hj_FilterProbe = false;
+}
+#endif
+
 /*
  * ExecHashJoinOuterGetTuple
  *
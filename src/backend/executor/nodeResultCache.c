@@ -0,0 +1,602 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeResultCache.c
+ *	  Routines to cache the rows of a parameterized subplan
+ *
+ * A nested loop rescans its inner side once for every outer row, setting
+ * the Params the inner side is parameterized by. When the outer side has
+ * many rows with the same values, the inner side is run again and again to
+ * return the same rows; this is costly for an index scan, and much more so
+ * for a RemoteSubplan, which sends the new Params to the Datanodes and
+ * waits for their rows on every rescan.
+ *
+ * A ResultCache node between the nested loop and its inner side keeps the
+ * rows returned for each value of the Params in a hash table. When it is
+ * rescanned with a value it has seen, it returns the saved rows without
+ * touching the subplan. The entries are kept in work_mem: when it is full,
+ * the least recently used entries are thrown away, and the rows of a value
+ * which do not fit even alone are returned without being saved.
+ *
+ * An entry is only used once the subplan returned all of its rows. If the
+ * node is rescanned before that, say by a semi join satisfied by the first
+ * row, the partial entry is dropped.
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * IDENTIFICATION
+ *	  src/backend/executor/nodeResultCache.c
+ *
+ *-------------------------------------------------------------------------
+ */
+/*
+ * INTERFACE ROUTINES
+ *		ExecInitResultCache		- initialize the node and the subplan
+ *		ExecResultCache			- return the next row for the current key
+ *		ExecEndResultCache		- free the cache and shut down the subplan
+ *		ExecReScanResultCache	- start over with new values of the key
+ */
+#include "postgres.h"
+
+#include "executor/executor.h"
+#include "executor/nodeResultCache.h"
+#include "miscadmin.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/typcache.h"
+
+/* A row saved for a key */
+typedef struct ResultCacheTuple
+{
+	struct ResultCacheTuple *next;
+	MinimalTuple mintuple;
+} ResultCacheTuple;
+
+/* The rows saved for a key */
+typedef struct ResultCacheEntry
+{
+	struct ResultCacheEntry *next;	/* next entry of the hash bucket */
+	dlist_node	lru_node;		/* position in the LRU list */
+	uint32		hash;
+	Datum	   *keyvalues;
+	bool	   *keynulls;
+	ResultCacheTuple *tuples;	/* rows in the order returned */
+	ResultCacheTuple *last;
+	Size		mem;			/* memory taken by the entry */
+	bool		complete;		/* all the rows of the subplan saved? */
+} ResultCacheEntry;
+
+#define RESULTCACHE_INITIAL_BUCKETS 256
+
+static uint32 rc_hash_key(ResultCacheState *node);
+static ResultCacheEntry *rc_lookup(ResultCacheState *node, uint32 hash);
+static ResultCacheEntry *rc_create_entry(ResultCacheState *node, uint32 hash);
+static void rc_remove_entry(ResultCacheState *node, ResultCacheEntry *entry);
+static void rc_grow_buckets(ResultCacheState *node);
+static bool rc_save_tuple(ResultCacheState *node, TupleTableSlot *slot);
+static void rc_purge(ResultCacheState *node);
+
+
+/*
+ * Hash the key of the current rescan, combining the hashes of the columns
+ * the way execGrouping.c does.
+ */
+static uint32
+rc_hash_key(ResultCacheState *node)
+{
+	uint32		hashkey = 0;
+	int			i;
+
+	for (i = 0; i < node->nkeys; i++)
+	{
+		/* rotate hashkey left 1 bit at each step */
+		hashkey = (hashkey << 1) | ((hashkey & 0x80000000) ? 1 : 0);
+
+		if (!node->keynulls[i])
+		{
+			uint32		hkey;
+
+			hkey = DatumGetUInt32(FunctionCall1Coll(&node->hashfunctions[i],
+													node->keycollations[i],
+													node->keyvalues[i]));
+			hashkey ^= hkey;
+		}
+	}
+
+	return hashkey;
+}
+
+/*
+ * Find the entry of the current key, or NULL. A NULL column only matches
+ * a NULL column, as in grouping.
+ */
+static ResultCacheEntry *
+rc_lookup(ResultCacheState *node, uint32 hash)
+{
+	ResultCacheEntry *entry;
+
+	for (entry = node->buckets[hash % node->nbuckets];
+		 entry != NULL;
+		 entry = entry->next)
+	{
+		int			i;
+
+		if (entry->hash != hash)
+			continue;
+
+		for (i = 0; i < node->nkeys; i++)
+		{
+			if (entry->keynulls[i] != node->keynulls[i])
+				break;
+			if (entry->keynulls[i])
+				continue;
+			if (!DatumGetBool(FunctionCall2Coll(&node->eqfunctions[i],
+												node->keycollations[i],
+												entry->keyvalues[i],
+												node->keyvalues[i])))
+				break;
+		}
+		if (i == node->nkeys)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/*
+ * Make an empty entry for the current key, as the most recently used.
+ */
+static ResultCacheEntry *
+rc_create_entry(ResultCacheState *node, uint32 hash)
+{
+	MemoryContext oldcontext;
+	ResultCacheEntry *entry;
+	int			bucket;
+	int			i;
+
+	if (node->nentries >= node->nbuckets)
+		rc_grow_buckets(node);
+
+	oldcontext = MemoryContextSwitchTo(node->cachecontext);
+
+	entry = (ResultCacheEntry *) palloc(sizeof(ResultCacheEntry));
+	entry->hash = hash;
+	entry->keyvalues = (Datum *) palloc(node->nkeys * sizeof(Datum));
+	entry->keynulls = (bool *) palloc(node->nkeys * sizeof(bool));
+	entry->tuples = NULL;
+	entry->last = NULL;
+	entry->complete = false;
+	entry->mem = GetMemoryChunkSpace(entry) +
+		GetMemoryChunkSpace(entry->keyvalues) +
+		GetMemoryChunkSpace(entry->keynulls);
+
+	for (i = 0; i < node->nkeys; i++)
+	{
+		entry->keynulls[i] = node->keynulls[i];
+		if (node->keynulls[i] || node->keybyval[i])
+			entry->keyvalues[i] = node->keyvalues[i];
+		else
+		{
+			entry->keyvalues[i] = datumCopy(node->keyvalues[i], false,
+											node->keylen[i]);
+			entry->mem += GetMemoryChunkSpace(DatumGetPointer(entry->keyvalues[i]));
+		}
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	bucket = hash % node->nbuckets;
+	entry->next = node->buckets[bucket];
+	node->buckets[bucket] = entry;
+	dlist_push_tail(&node->lru, &entry->lru_node);
+	node->nentries++;
+	node->mem_used += entry->mem;
+
+	return entry;
+}
+
+/*
+ * Free an entry and its rows.
+ */
+static void
+rc_remove_entry(ResultCacheState *node, ResultCacheEntry *entry)
+{
+	ResultCacheEntry **prev;
+	ResultCacheTuple *tuple;
+	int			i;
+
+	prev = &node->buckets[entry->hash % node->nbuckets];
+	while (*prev != entry)
+		prev = &(*prev)->next;
+	*prev = entry->next;
+	dlist_delete(&entry->lru_node);
+	node->nentries--;
+	node->mem_used -= entry->mem;
+
+	tuple = entry->tuples;
+	while (tuple != NULL)
+	{
+		ResultCacheTuple *next = tuple->next;
+
+		pfree(tuple->mintuple);
+		pfree(tuple);
+		tuple = next;
+	}
+	for (i = 0; i < node->nkeys; i++)
+	{
+		if (!entry->keynulls[i] && !node->keybyval[i])
+			pfree(DatumGetPointer(entry->keyvalues[i]));
+	}
+	pfree(entry->keyvalues);
+	pfree(entry->keynulls);
+	pfree(entry);
+
+	if (node->entry == entry)
+		node->entry = NULL;
+}
+
+/*
+ * Double the number of buckets of the hash table.
+ */
+static void
+rc_grow_buckets(ResultCacheState *node)
+{
+	int			nbuckets = node->nbuckets * 2;
+	ResultCacheEntry **buckets;
+	int			i;
+
+	buckets = (ResultCacheEntry **)
+		MemoryContextAllocZero(node->ps.state->es_query_cxt,
+							   nbuckets * sizeof(ResultCacheEntry *));
+
+	for (i = 0; i < node->nbuckets; i++)
+	{
+		ResultCacheEntry *entry = node->buckets[i];
+
+		while (entry != NULL)
+		{
+			ResultCacheEntry *next = entry->next;
+			int			bucket = entry->hash % nbuckets;
+
+			entry->next = buckets[bucket];
+			buckets[bucket] = entry;
+			entry = next;
+		}
+	}
+
+	pfree(node->buckets);
+	node->buckets = buckets;
+	node->nbuckets = nbuckets;
+}
+
+/*
+ * Add a row to the entry being filled, evicting the least recently used
+ * entries if the cache gets too big. Returns false, dropping the entry, if
+ * it does not fit even alone.
+ */
+static bool
+rc_save_tuple(ResultCacheState *node, TupleTableSlot *slot)
+{
+	ResultCacheEntry *entry = node->entry;
+	MemoryContext oldcontext;
+	ResultCacheTuple *tuple;
+	Size		mem;
+
+	oldcontext = MemoryContextSwitchTo(node->cachecontext);
+	tuple = (ResultCacheTuple *) palloc(sizeof(ResultCacheTuple));
+	tuple->mintuple = ExecCopySlotMinimalTuple(slot);
+	tuple->next = NULL;
+	MemoryContextSwitchTo(oldcontext);
+
+	if (entry->last)
+		entry->last->next = tuple;
+	else
+		entry->tuples = tuple;
+	entry->last = tuple;
+
+	mem = GetMemoryChunkSpace(tuple) + GetMemoryChunkSpace(tuple->mintuple);
+	entry->mem += mem;
+	node->mem_used += mem;
+
+	if (node->mem_used > node->mem_limit)
+	{
+		dlist_mutable_iter iter;
+
+		dlist_foreach_modify(iter, &node->lru)
+		{
+			ResultCacheEntry *victim;
+
+			victim = dlist_container(ResultCacheEntry, lru_node, iter.cur);
+			if (victim == entry)
+				continue;
+			rc_remove_entry(node, victim);
+			node->evictions++;
+			if (node->mem_used <= node->mem_limit)
+				break;
+		}
+	}
+
+	if (node->mem_used > node->mem_peak)
+		node->mem_peak = node->mem_used;
+
+	if (node->mem_used > node->mem_limit)
+	{
+		rc_remove_entry(node, entry);
+		node->overflows++;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Forget all the entries.
+ */
+static void
+rc_purge(ResultCacheState *node)
+{
+	MemoryContextReset(node->cachecontext);
+	memset(node->buckets, 0, node->nbuckets * sizeof(ResultCacheEntry *));
+	dlist_init(&node->lru);
+	node->nentries = 0;
+	node->mem_used = 0;
+	node->entry = NULL;
+	node->next = NULL;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecResultCache
+ *
+ *		On the first call after a rescan, look up the key. If its rows are
+ *		cached, return them; else run the subplan, saving its rows as they
+ *		are returned.
+ * ----------------------------------------------------------------
+ */
+TupleTableSlot *
+ExecResultCache(ResultCacheState *node)
+{
+	PlanState  *outerNode = outerPlanState(node);
+	TupleTableSlot *slot;
+
+	for (;;)
+	{
+		switch (node->status)
+		{
+			case RC_LOOKUP:
+				{
+					ExprContext *econtext = node->ps.ps_ExprContext;
+					ResultCacheEntry *entry;
+					ListCell   *lc;
+					uint32		hash;
+					int			i = 0;
+
+					ResetExprContext(econtext);
+					foreach(lc, node->param_exprs)
+					{
+						ExprState  *keyexpr = (ExprState *) lfirst(lc);
+
+						node->keyvalues[i] = ExecEvalExpr(keyexpr, econtext,
+														  &node->keynulls[i],
+														  NULL);
+						i++;
+					}
+
+					hash = rc_hash_key(node);
+					entry = rc_lookup(node, hash);
+					if (entry != NULL)
+					{
+						Assert(entry->complete);
+						node->hits++;
+						dlist_delete(&entry->lru_node);
+						dlist_push_tail(&node->lru, &entry->lru_node);
+						node->entry = entry;
+						node->next = entry->tuples;
+						node->status = RC_FETCH;
+						break;
+					}
+
+					node->misses++;
+
+					/*
+					 * If the subplan has Params changed, ExecProcNode rescans
+					 * it; else rescan it here unless it is still fresh.
+					 */
+					if (node->subplan_used && outerNode->chgParam == NULL)
+						ExecReScan(outerNode);
+					node->subplan_used = true;
+
+					node->entry = rc_create_entry(node, hash);
+					node->status = RC_FILLING;
+					break;
+				}
+
+			case RC_FETCH:
+				{
+					ResultCacheTuple *tuple = node->next;
+
+					if (tuple == NULL)
+					{
+						node->status = RC_END;
+						break;
+					}
+					node->next = tuple->next;
+					return ExecStoreMinimalTuple(tuple->mintuple,
+												 node->ps.ps_ResultTupleSlot,
+												 false);
+				}
+
+			case RC_FILLING:
+				slot = ExecProcNode(outerNode);
+				if (TupIsNull(slot))
+				{
+					node->entry->complete = true;
+					node->status = RC_END;
+					return NULL;
+				}
+				if (!rc_save_tuple(node, slot))
+					node->status = RC_BYPASS;
+				return slot;
+
+			case RC_BYPASS:
+				slot = ExecProcNode(outerNode);
+				if (TupIsNull(slot))
+					node->status = RC_END;
+				return slot;
+
+			case RC_END:
+				return NULL;
+		}
+	}
+}
+
+/* ----------------------------------------------------------------
+ *		ExecInitResultCache
+ * ----------------------------------------------------------------
+ */
+ResultCacheState *
+ExecInitResultCache(ResultCache *node, EState *estate, int eflags)
+{
+	ResultCacheState *rcstate;
+	ListCell   *lc;
+	int			i;
+
+	/* check for unsupported flags */
+	Assert(!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_MARK)));
+
+	/*
+	 * create state structure
+	 */
+	rcstate = makeNode(ResultCacheState);
+	rcstate->ps.plan = (Plan *) node;
+	rcstate->ps.state = estate;
+	rcstate->status = RC_LOOKUP;
+
+	/*
+	 * Miscellaneous initialization
+	 *
+	 * The expression context is used to compute the key.
+	 */
+	ExecAssignExprContext(estate, &rcstate->ps);
+
+	/*
+	 * tuple table initialization
+	 */
+	ExecInitResultTupleSlot(estate, &rcstate->ps);
+
+	/*
+	 * initialize the key
+	 */
+	rcstate->nkeys = list_length(node->param_exprs);
+	rcstate->param_exprs = (List *) ExecInitExpr((Expr *) node->param_exprs,
+												 &rcstate->ps);
+	rcstate->hashfunctions = (FmgrInfo *) palloc(rcstate->nkeys * sizeof(FmgrInfo));
+	rcstate->eqfunctions = (FmgrInfo *) palloc(rcstate->nkeys * sizeof(FmgrInfo));
+	rcstate->keycollations = (Oid *) palloc(rcstate->nkeys * sizeof(Oid));
+	rcstate->keybyval = (bool *) palloc(rcstate->nkeys * sizeof(bool));
+	rcstate->keylen = (int16 *) palloc(rcstate->nkeys * sizeof(int16));
+	rcstate->keyvalues = (Datum *) palloc(rcstate->nkeys * sizeof(Datum));
+	rcstate->keynulls = (bool *) palloc(rcstate->nkeys * sizeof(bool));
+
+	i = 0;
+	foreach(lc, node->param_exprs)
+	{
+		Param	   *param = (Param *) lfirst(lc);
+		TypeCacheEntry *typentry;
+
+		Assert(IsA(param, Param) && param->paramkind == PARAM_EXEC);
+		rcstate->keyparams = bms_add_member(rcstate->keyparams,
+											param->paramid);
+
+		typentry = lookup_type_cache(param->paramtype,
+									 TYPECACHE_HASH_PROC_FINFO |
+									 TYPECACHE_EQ_OPR_FINFO);
+		if (!OidIsValid(typentry->hash_proc_finfo.fn_oid))
+			elog(ERROR, "could not find hash function for type %s",
+				 format_type_be(param->paramtype));
+		if (!OidIsValid(typentry->eq_opr_finfo.fn_oid))
+			elog(ERROR, "could not identify an equality operator for type %s",
+				 format_type_be(param->paramtype));
+		fmgr_info_copy(&rcstate->hashfunctions[i], &typentry->hash_proc_finfo,
+					   CurrentMemoryContext);
+		fmgr_info_copy(&rcstate->eqfunctions[i], &typentry->eq_opr_finfo,
+					   CurrentMemoryContext);
+		rcstate->keycollations[i] = param->paramcollid;
+		get_typlenbyval(param->paramtype, &rcstate->keylen[i],
+						&rcstate->keybyval[i]);
+		i++;
+	}
+
+	/*
+	 * initialize the cache
+	 */
+	rcstate->nbuckets = RESULTCACHE_INITIAL_BUCKETS;
+	rcstate->buckets = (struct ResultCacheEntry **)
+		palloc0(rcstate->nbuckets * sizeof(ResultCacheEntry *));
+	dlist_init(&rcstate->lru);
+	rcstate->mem_limit = work_mem * 1024L;
+	rcstate->cachecontext = AllocSetContextCreate(CurrentMemoryContext,
+												  "ResultCache",
+												  ALLOCSET_DEFAULT_MINSIZE,
+												  ALLOCSET_DEFAULT_INITSIZE,
+												  ALLOCSET_DEFAULT_MAXSIZE);
+
+	/*
+	 * initialize child nodes
+	 *
+	 * The rows of the subplan are cached here, so it does not need to
+	 * support rewinding.
+	 */
+	eflags &= ~EXEC_FLAG_REWIND;
+	outerPlanState(rcstate) = ExecInitNode(outerPlan(node), estate, eflags);
+
+	/*
+	 * initialize tuple type.  no need to initialize projection info because
+	 * this node doesn't do projections.
+	 */
+	ExecAssignResultTypeFromTL(&rcstate->ps);
+	rcstate->ps.ps_ProjInfo = NULL;
+
+	return rcstate;
+}
+
+/* ----------------------------------------------------------------
+ *		ExecEndResultCache
+ * ----------------------------------------------------------------
+ */
+void
+ExecEndResultCache(ResultCacheState *node)
+{
+	ExecFreeExprContext(&node->ps);
+	ExecClearTuple(node->ps.ps_ResultTupleSlot);
+
+	MemoryContextDelete(node->cachecontext);
+
+	ExecEndNode(outerPlanState(node));
+}
+
+/* ----------------------------------------------------------------
+ *		ExecReScanResultCache
+ *
+ *		The cached rows only stay valid if no Param other than those of
+ *		the key changed.
+ * ----------------------------------------------------------------
+ */
+void
+ExecReScanResultCache(ResultCacheState *node)
+{
+	ExecClearTuple(node->ps.ps_ResultTupleSlot);
+
+	/* Drop the rows of a key not read to the end */
+	if (node->status == RC_FILLING)
+		rc_remove_entry(node, node->entry);
+
+	if (node->ps.chgParam != NULL &&
+		!bms_is_subset(node->ps.chgParam, node->keyparams))
+		rc_purge(node);
+
+	node->entry = NULL;
+	node->next = NULL;
+	node->status = RC_LOOKUP;
+}
@@ -19,16 +19,21 @@
  *		ExecInitSeqScan			creates and initializes a seqscan node.
  *		ExecEndSeqScan			releases any storage allocated.
  *		ExecReScanSeqScan		rescans the relation
+ *		ExecSeqScanInitializeParallel	joins a parallel scan
  */
 #include "postgres.h"
 
 #include "access/relscan.h"
+#include "executor/execBatch.h"
 #include "executor/execdebug.h"
 #include "executor/nodeSeqscan.h"
+#include "miscadmin.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
 
 static void InitScanRelation(SeqScanState *node, EState *estate, int eflags);
 static TupleTableSlot *SeqNext(SeqScanState *node);
+static TupleTableSlot *SeqNextBatch(SeqScanState *node);
 
 /* ----------------------------------------------------------------
  *						Scan Support
@@ -53,10 +58,10 @@ SeqNext(SeqScanState *node)
 	/*
 	 * get information from the estate and scan state
 	 */
-	scandesc = node->ss_currentScanDesc;
-	estate = node->ps.state;
+	scandesc = node->ss.ss_currentScanDesc;
+	estate = node->ss.ps.state;
 	direction = estate->es_direction;
-	slot = node->ss_ScanTupleSlot;
+	slot = node->ss.ss_ScanTupleSlot;
 
 	/*
 	 * get the next tuple from the table
@@ -108,11 +113,129 @@ SeqRecheck(SeqScanState *node, TupleTableSlot *slot)
 TupleTableSlot *
 ExecSeqScan(SeqScanState *node)
 {
+	HeapScanDesc scandesc = node->ss.ss_currentScanDesc;
+
+	/*
+	 * Batches are only read going forward, and EvalPlanQual rechecks work
+	 * on a single test tuple.
+	 */
+	if (node->batchqual != NULL &&
+		scandesc->rs_pageatatime && scandesc->rs_nkeys == 0 &&
+		ScanDirectionIsForward(node->ss.ps.state->es_direction) &&
+		node->ss.ps.state->es_epqTuple == NULL)
+		return SeqNextBatch(node);
+
 	return ExecScan((ScanState *) node,
 					(ExecScanAccessMtd) SeqNext,
 					(ExecScanRecheckMtd) SeqRecheck);
 }
 
+/* ----------------------------------------------------------------
+ *		SeqNextBatch
+ *
+ *		Returns the next qualifying tuple, like ExecScan does, but
+ *		reads a page of tuples at a time and checks the batch quals
+ *		over the whole page at once. The residual quals and the
+ *		projection are then applied to the selected tuples one by one.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+SeqNextBatch(SeqScanState *node)
+{
+	HeapScanDesc scandesc = node->ss.ss_currentScanDesc;
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+	List	   *qual = node->residualqual;
+	ProjectionInfo *projInfo = node->ss.ps.ps_ProjInfo;
+	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+	ExprDoneCond isDone;
+	TupleTableSlot *resultSlot;
+
+	/*
+	 * Check to see if we're still projecting out tuples from a previous scan
+	 * tuple (because there is a function-returning-set in the projection
+	 * expressions).  If so, try to project another one.
+	 */
+	if (node->ss.ps.ps_TupFromTlist)
+	{
+		Assert(projInfo);		/* can't get here if not projecting */
+		resultSlot = ExecProject(projInfo, &isDone);
+		if (isDone == ExprMultipleResult)
+			return resultSlot;
+		/* Done with that source tuple... */
+		node->ss.ps.ps_TupFromTlist = false;
+	}
+
+	/*
+	 * Reset per-tuple memory context to free any expression evaluation
+	 * storage allocated in the previous tuple cycle.
+	 */
+	ResetExprContext(econtext);
+
+	for (;;)
+	{
+		HeapTuple	tuple;
+
+		CHECK_FOR_INTERRUPTS();
+
+		/* Read pages until some tuple passes the batch quals */
+		while (node->batchnext >= node->batchnsel)
+		{
+			int			ntuples;
+
+			ntuples = heap_getnext_batch(scandesc, node->batch,
+										 MaxHeapTuplesPerPage);
+			if (ntuples == 0)
+			{
+				ExecClearTuple(slot);
+				if (projInfo)
+					return ExecClearTuple(projInfo->pi_slot);
+				else
+					return slot;
+			}
+
+			node->batchnsel = ExecBatchQual(node->batchqual, node->batch,
+											ntuples, node->batchsel);
+			node->batchnext = 0;
+			InstrCountFiltered1(node, ntuples - node->batchnsel);
+		}
+
+		tuple = &node->batch[node->batchsel[node->batchnext++]];
+		ExecStoreTuple(tuple, slot, scandesc->rs_cbuf, false);
+
+		/* place the current tuple into the expr context */
+		econtext->ecxt_scantuple = slot;
+
+#ifdef XCP
+		if (node->ss.ss_JoinFilter && !ExecScanJoinFilter(&node->ss, slot))
+		{
+			InstrCountFiltered1(node, 1);
+			ResetExprContext(econtext);
+			continue;
+		}
+#endif
+
+		if (qual == NIL || ExecQual(qual, econtext, false))
+		{
+			if (projInfo == NULL)
+				return slot;
+
+			resultSlot = ExecProject(projInfo, &isDone);
+			if (isDone != ExprEndResult)
+			{
+				node->ss.ps.ps_TupFromTlist = (isDone == ExprMultipleResult);
+				return resultSlot;
+			}
+		}
+		else
+			InstrCountFiltered1(node, 1);
+
+		/*
+		 * Tuple fails qual, so free per-tuple memory and try again.
+		 */
+		ResetExprContext(econtext);
+	}
+}
+
 /* ----------------------------------------------------------------
  *		InitScanRelation
  *
@@ -130,7 +253,7 @@ InitScanRelation(SeqScanState *node, EState *estate, int eflags)
 	 * open that relation and acquire appropriate lock on it.
 	 */
 	currentRelation = ExecOpenScanRelation(estate,
-									  ((SeqScan *) node->ps.plan)->scanrelid,
+								   ((SeqScan *) node->ss.ps.plan)->scanrelid,
 										   eflags);
 
 	/* initialize a heapscan */
@@ -139,11 +262,11 @@ InitScanRelation(SeqScanState *node, EState *estate, int eflags)
 									 0,
 									 NULL);
 
-	node->ss_currentRelation = currentRelation;
-	node->ss_currentScanDesc = currentScanDesc;
+	node->ss.ss_currentRelation = currentRelation;
+	node->ss.ss_currentScanDesc = currentScanDesc;
 
 	/* and report the scan tuple slot's rowtype */
-	ExecAssignScanType(node, RelationGetDescr(currentRelation));
+	ExecAssignScanType(&node->ss, RelationGetDescr(currentRelation));
 }
 
 
@@ -167,44 +290,70 @@ ExecInitSeqScan(SeqScan *node, EState *estate, int eflags)
 	 * create state structure
 	 */
 	scanstate = makeNode(SeqScanState);
-	scanstate->ps.plan = (Plan *) node;
-	scanstate->ps.state = estate;
+	scanstate->ss.ps.plan = (Plan *) node;
+	scanstate->ss.ps.state = estate;
 
 	/*
 	 * Miscellaneous initialization
 	 *
 	 * create expression context for node
 	 */
-	ExecAssignExprContext(estate, &scanstate->ps);
+	ExecAssignExprContext(estate, &scanstate->ss.ps);
 
 	/*
 	 * initialize child expressions
 	 */
-	scanstate->ps.targetlist = (List *)
+	scanstate->ss.ps.targetlist = (List *)
 		ExecInitExpr((Expr *) node->plan.targetlist,
 					 (PlanState *) scanstate);
-	scanstate->ps.qual = (List *)
+	scanstate->ss.ps.qual = (List *)
 		ExecInitExpr((Expr *) node->plan.qual,
 					 (PlanState *) scanstate);
 
 	/*
 	 * tuple table initialization
 	 */
-	ExecInitResultTupleSlot(estate, &scanstate->ps);
-	ExecInitScanTupleSlot(estate, scanstate);
+	ExecInitResultTupleSlot(estate, &scanstate->ss.ps);
+	ExecInitScanTupleSlot(estate, &scanstate->ss);
 
 	/*
 	 * initialize scan relation
 	 */
 	InitScanRelation(scanstate, estate, eflags);
 
-	scanstate->ps.ps_TupFromTlist = false;
+	/*
+	 * Clauses comparing simple columns with constants are checked a page
+	 * of tuples at a time if possible.  The full qual is still needed for
+	 * EvalPlanQual rechecks.  Batches read ahead of the current tuple, so
+	 * not if the scan may have to move backward.
+	 */
+	if (node->plan.qual != NIL &&
+		!(eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_EXPLAIN_ONLY)))
+	{
+		List	   *residual;
+
+		scanstate->batchqual =
+			ExecInitBatchQual(node->plan.qual, node->scanrelid,
+							  RelationGetDescr(scanstate->ss.ss_currentRelation),
+							  MaxHeapTuplesPerPage, &residual);
+		if (scanstate->batchqual != NULL)
+		{
+			scanstate->residualqual = (List *)
+				ExecInitExpr((Expr *) residual, (PlanState *) scanstate);
+			scanstate->batch = (HeapTupleData *)
+				palloc(MaxHeapTuplesPerPage * sizeof(HeapTupleData));
+			scanstate->batchsel = (uint16 *)
+				palloc(MaxHeapTuplesPerPage * sizeof(uint16));
+		}
+	}
+
+	scanstate->ss.ps.ps_TupFromTlist = false;
 
 	/*
 	 * Initialize result tuple type and projection info.
 	 */
-	ExecAssignResultTypeFromTL(&scanstate->ps);
-	ExecAssignScanProjectionInfo(scanstate);
+	ExecAssignResultTypeFromTL(&scanstate->ss.ps);
+	ExecAssignScanProjectionInfo(&scanstate->ss);
 
 	return scanstate;
 }
@@ -224,19 +373,19 @@ ExecEndSeqScan(SeqScanState *node)
 	/*
 	 * get information from node
 	 */
-	relation = node->ss_currentRelation;
-	scanDesc = node->ss_currentScanDesc;
+	relation = node->ss.ss_currentRelation;
+	scanDesc = node->ss.ss_currentScanDesc;
 
 	/*
 	 * Free the exprcontext
 	 */
-	ExecFreeExprContext(&node->ps);
+	ExecFreeExprContext(&node->ss.ps);
 
 	/*
 	 * clean out the tuple table
 	 */
-	ExecClearTuple(node->ps.ps_ResultTupleSlot);
-	ExecClearTuple(node->ss_ScanTupleSlot);
+	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	ExecClearTuple(node->ss.ss_ScanTupleSlot);
 
 	/*
 	 * close heap scan
@@ -265,10 +414,47 @@ ExecReScanSeqScan(SeqScanState *node)
 {
 	HeapScanDesc scan;
 
-	scan = node->ss_currentScanDesc;
+	scan = node->ss.ss_currentScanDesc;
 
 	heap_rescan(scan,			/* scan desc */
 				NULL);			/* new scan keys */
 
+	/* forget the rest of the current batch */
+	node->batchnsel = node->batchnext = 0;
+
 	ExecScanReScan((ScanState *) node);
 }
+
+/* ----------------------------------------------------------------
+ *						Parallel Scan Support
+ * ----------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------
+ *		ExecSeqScanInitializeParallel
+ *
+ *		Replaces the scan of the node by a share of the parallel scan,
+ *		or by a scan of its own if parallel_scan is NULL. Called by the
+ *		Gather node and its workers before the first tuple is fetched,
+ *		and by the Gather node once the parallel scan is over.
+ * ----------------------------------------------------------------
+ */
+void
+ExecSeqScanInitializeParallel(SeqScanState *node,
+							  ParallelHeapScanDesc parallel_scan)
+{
+	EState	   *estate = node->ss.ps.state;
+
+	heap_endscan(node->ss.ss_currentScanDesc);
+	if (parallel_scan != NULL)
+		node->ss.ss_currentScanDesc =
+			heap_beginscan_parallel(node->ss.ss_currentRelation,
+									estate->es_snapshot,
+									parallel_scan);
+	else
+		node->ss.ss_currentScanDesc =
+			heap_beginscan(node->ss.ss_currentRelation,
+						   estate->es_snapshot,
+						   0, NULL);
+	node->batchnsel = node->batchnext = 0;
+}
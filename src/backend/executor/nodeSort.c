@@ -18,9 +18,15 @@
 #include "executor/execdebug.h"
 #include "executor/nodeSort.h"
 #include "miscadmin.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/tuplesort.h"
 
 
+static TupleTableSlot *ExecSortIncremental(SortState *node);
+static void ExecSortNextBatch(SortState *node);
+
+
 /* ----------------------------------------------------------------
  *		ExecSort
  *
@@ -49,6 +55,9 @@ ExecSort(SortState *node)
 	SO1_printf("ExecSort: %s\n",
 			   "entering routine");
 
+	if (node->presorted > 0)
+		return ExecSortIncremental(node);
+
 	estate = node->ss.ps.state;
 	dir = estate->es_direction;
 	tuplesortstate = (Tuplesortstate *) node->tuplesortstate;
@@ -141,6 +150,143 @@ ExecSort(SortState *node)
 	return slot;
 }
 
+/* ----------------------------------------------------------------
+ *		ExecSortIncremental
+ *
+ *		Sorts tuples from an outer subtree already sorted by the leading
+ *		sort columns. The tuples are read and sorted in batches holding
+ *		whole groups of tuples equal on those columns, each batch being
+ *		returned before the next is read. This uses memory for a batch
+ *		only, and returns the first tuples without reading all the input.
+ *		The output can only be read forward once.
+ * ----------------------------------------------------------------
+ */
+static TupleTableSlot *
+ExecSortIncremental(SortState *node)
+{
+	TupleTableSlot *slot = node->ss.ps.ps_ResultTupleSlot;
+
+	for (;;)
+	{
+		if (node->tuplesortstate != NULL &&
+			tuplesort_gettupleslot((Tuplesortstate *) node->tuplesortstate,
+								   true, slot))
+		{
+			node->returned++;
+			return slot;
+		}
+
+		/* the batch is done, read the next one if needed */
+		if (node->outerDone ||
+			(node->bounded && node->returned >= node->bound))
+			return ExecClearTuple(slot);
+
+		ExecSortNextBatch(node);
+	}
+}
+
+/* ----------------------------------------------------------------
+ *		ExecSortNextBatch
+ *
+ *		Reads and sorts the next batch of an incremental sort. A batch
+ *		holds at least SORT_MIN_BATCH_TUPLES tuples, then the tuples
+ *		equal to the last of those on the presorted columns. The first
+ *		tuple that differs is kept for the next batch.
+ * ----------------------------------------------------------------
+ */
+static void
+ExecSortNextBatch(SortState *node)
+{
+	Sort	   *plannode = (Sort *) node->ss.ps.plan;
+	EState	   *estate = node->ss.ps.state;
+	ScanDirection dir = estate->es_direction;
+	PlanState  *outerNode = outerPlanState(node);
+	ExprContext *econtext = node->ss.ps.ps_ExprContext;
+	Tuplesortstate *tuplesortstate;
+	long		ntuples = 0;
+	const char *sortMethod;
+	const char *spaceType;
+	long		spaceUsed;
+
+	SO1_printf("ExecSortNextBatch: %s\n",
+			   "sorting next batch");
+
+	if (node->tuplesortstate != NULL)
+		tuplesort_end((Tuplesortstate *) node->tuplesortstate);
+	node->tuplesortstate = NULL;
+
+	estate->es_direction = ForwardScanDirection;
+
+	tuplesortstate = tuplesort_begin_heap(ExecGetResultType(outerNode),
+										  plannode->numCols,
+										  plannode->sortColIdx,
+										  plannode->sortOperators,
+										  plannode->collations,
+										  plannode->nullsFirst,
+										  work_mem,
+										  false);
+	if (node->bounded)
+		tuplesort_set_bound(tuplesortstate, node->bound - node->returned);
+	node->tuplesortstate = (void *) tuplesortstate;
+
+	if (node->pivotPending)
+	{
+		tuplesort_puttupleslot(tuplesortstate, node->pivotSlot);
+		node->pivotPending = false;
+		ntuples++;
+	}
+
+	for (;;)
+	{
+		TupleTableSlot *slot = ExecProcNode(outerNode);
+
+		if (TupIsNull(slot))
+		{
+			node->outerDone = true;
+			break;
+		}
+
+		if (ntuples >= SORT_MIN_BATCH_TUPLES)
+		{
+			bool		same;
+
+			ResetExprContext(econtext);
+			same = execTuplesMatch(node->pivotSlot, slot,
+								   node->presorted, plannode->sortColIdx,
+								   node->presortedEq,
+								   econtext->ecxt_per_tuple_memory);
+			if (!same)
+			{
+				ExecCopySlot(node->pivotSlot, slot);
+				node->pivotPending = true;
+				break;
+			}
+		}
+
+		tuplesort_puttupleslot(tuplesortstate, slot);
+		if (++ntuples == SORT_MIN_BATCH_TUPLES)
+			ExecCopySlot(node->pivotSlot, slot);
+	}
+
+	tuplesort_performsort(tuplesortstate);
+
+	estate->es_direction = dir;
+
+	/* remember the stats of the biggest batch */
+	tuplesort_get_stats(tuplesortstate, &sortMethod, &spaceType, &spaceUsed);
+	if (node->incr_batches == 0 || spaceUsed > node->incr_spaceUsed)
+	{
+		node->incr_method = sortMethod;
+		node->incr_spaceType = spaceType;
+		node->incr_spaceUsed = spaceUsed;
+	}
+	node->incr_batches++;
+
+	node->sort_Done = true;
+	node->bounded_Done = node->bounded;
+	node->bound_Done = node->bound;
+}
+
 /* ----------------------------------------------------------------
  *		ExecInitSort
  *
@@ -176,12 +322,40 @@ ExecInitSort(Sort *node, EState *estate, int eflags)
 	sortstate->sort_Done = false;
 	sortstate->tuplesortstate = NULL;
 
+	/*
+	 * Sort incrementally if the input is already sorted by the leading
+	 * columns, unless the sorted output must be kept around.
+	 */
+	if (node->numPresorted > 0 && !sortstate->randomAccess)
+		sortstate->presorted = node->numPresorted;
+
 	/*
 	 * Miscellaneous initialization
 	 *
 	 * Sort nodes don't initialize their ExprContexts because they never call
-	 * ExecQual or ExecProject.
+	 * ExecQual or ExecProject, except for an incremental sort comparing the
+	 * presorted columns.
 	 */
+	if (sortstate->presorted > 0)
+	{
+		Oid		   *eqOperators;
+		int			i;
+
+		ExecAssignExprContext(estate, &sortstate->ss.ps);
+
+		eqOperators = (Oid *) palloc(node->numPresorted * sizeof(Oid));
+		for (i = 0; i < node->numPresorted; i++)
+		{
+			eqOperators[i] = get_equality_op_for_ordering_op(node->sortOperators[i],
+															 NULL);
+			if (!OidIsValid(eqOperators[i]))
+				elog(ERROR, "could not find equality operator for ordering operator %u",
+					 node->sortOperators[i]);
+		}
+		sortstate->presortedEq = execTuplesMatchPrepare(node->numPresorted,
+														eqOperators);
+		pfree(eqOperators);
+	}
 
 	/*
 	 * tuple table initialization
@@ -209,6 +383,13 @@ ExecInitSort(Sort *node, EState *estate, int eflags)
 	ExecAssignScanTypeFromOuterPlan(&sortstate->ss);
 	sortstate->ss.ps.ps_ProjInfo = NULL;
 
+	if (sortstate->presorted > 0)
+	{
+		sortstate->pivotSlot = ExecInitExtraTupleSlot(estate);
+		ExecSetSlotDescriptor(sortstate->pivotSlot,
+							  ExecGetResultType(outerPlanState(sortstate)));
+	}
+
 	SO1_printf("ExecInitSort: %s\n",
 			   "sort node initialized");
 
@@ -231,6 +412,10 @@ ExecEndSort(SortState *node)
 	ExecClearTuple(node->ss.ss_ScanTupleSlot);
 	/* must drop pointer to sort result tuple */
 	ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	if (node->pivotSlot)
+		ExecClearTuple(node->pivotSlot);
+	if (node->presorted > 0)
+		ExecFreeExprContext(&node->ss.ps);
 
 	/*
 	 * Release tuplesort resources
@@ -319,6 +504,15 @@ ExecReScanSort(SortState *node)
 		tuplesort_end((Tuplesortstate *) node->tuplesortstate);
 		node->tuplesortstate = NULL;
 
+		/* an incremental sort reads the outer plan from the start again */
+		if (node->presorted > 0)
+		{
+			ExecClearTuple(node->pivotSlot);
+			node->pivotPending = false;
+			node->outerDone = false;
+			node->returned = 0;
+		}
+
 		/*
 		 * if chgParam of subnode is not null then plan will be re-scanned by
 		 * first ExecProcNode.
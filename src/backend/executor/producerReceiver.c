@@ -25,15 +25,23 @@ typedef struct
 	DestReceiver pub;
 	/* parameters: */
 	DestReceiver *consumer;		/* where to put the tuples for self */
+	JoinFilter *selffilter;		/* tuples for self must pass it */
 	AttrNumber distKey;			/* distribution key attribute in the tuple */
 	Locator *locator;			/* locator is determining destination nodes */
 	int *distNodes;				/* array where to get locator results */
 	int *consMap;				/* map of consumers: consMap[node-1] indicates
 								 * the target consumer */
+	AttrNumber adaptiveKey;		/* distribution key to switch to */
+	Locator *adaptiveLocator;	/* locator to switch to */
+	long adaptiveRows;			/* switch after that many tuples */
 	SharedQueue squeue;			/* a SharedQueue for result distribution */
 	MemoryContext tmpcxt;       /* holds temporary data */
 	Tuplestorestate **tstores;	/* storage to buffer data if destination queue
 								 * is full */
+	TupleTableSlot **batches;	/* tuples accumulated to be written to the
+								 * squeue, SQUEUE_BATCH_SIZE per consumer */
+	int *nbatched;				/* number of accumulated tuples per consumer */
+	MemoryContext batchcxt;		/* context of the accumulated tuples */
 	TupleDesc typeinfo;			/* description of received tuples */
 	long tcount;
 	long selfcount;
@@ -67,6 +75,71 @@ producerStartupReceiver(DestReceiver *self, int operation, TupleDesc typeinfo)
 		(*myState->consumer->rStartup) (myState->consumer, operation, typeinfo);
 }
 
+/*
+ * Write out tuples accumulated for the consumer to the shared queue.
+ */
+static void
+producerFlushBatch(ProducerState *myState, int consumerIdx)
+{
+	TupleTableSlot **slots;
+	int			nslots = myState->nbatched[consumerIdx];
+	MemoryContext savecontext;
+	int			i;
+
+	if (nslots == 0)
+		return;
+
+	slots = &myState->batches[consumerIdx * SQUEUE_BATCH_SIZE];
+	/*
+	 * The tuplestore should be in the same long living context as the
+	 * accumulated tuples, see producerReceiveSlot.
+	 */
+	savecontext = MemoryContextSwitchTo(myState->batchcxt);
+	SharedQueueWriteBatch(myState->squeue, consumerIdx, slots, nslots,
+						  &myState->tstores[consumerIdx], myState->tmpcxt);
+	MemoryContextSwitchTo(savecontext);
+
+	/* data are copied, release memory */
+	for (i = 0; i < nslots; i++)
+		ExecClearTuple(slots[i]);
+	myState->nbatched[consumerIdx] = 0;
+}
+
+
+/*
+ * Write out tuples accumulated for all the consumers to the shared queue.
+ */
+static void
+producerFlushBatches(ProducerState *myState)
+{
+	int			i;
+
+	if (myState->squeue == NULL || myState->nbatched == NULL)
+		return;
+
+	for (i = 0; i < NumDataNodes; i++)
+		producerFlushBatch(myState, i);
+}
+
+
+/*
+ * Stop broadcasting and distribute the following tuples by the key, see
+ * SetProducerAdaptiveParams.
+ */
+static void
+producerSwitchLocator(ProducerState *myState)
+{
+	elog(DEBUG1, "Producer switches from broadcast to distribution by key "
+		 "after %ld tuples", myState->tcount);
+
+	freeLocator(myState->locator);
+	myState->locator = myState->adaptiveLocator;
+	myState->distKey = myState->adaptiveKey;
+	myState->distNodes = (int *) getLocatorResults(myState->locator);
+	myState->adaptiveLocator = NULL;
+}
+
+
 /*
  * Receive a tuple from the executor and dispatch it to the proper consumer
  */
@@ -76,8 +149,13 @@ producerReceiveSlot(TupleTableSlot *slot, DestReceiver *self)
 	ProducerState *myState = (ProducerState *) self;
 	Datum		value;
 	bool		isnull;
+	bool		queued = false;
 	int 		ncount, i;
 
+	if (myState->adaptiveLocator &&
+			myState->tcount >= myState->adaptiveRows)
+		producerSwitchLocator(myState);
+
 	if (myState->distKey == InvalidAttrNumber)
 	{
 		value = (Datum) 0;
@@ -100,23 +178,48 @@ producerReceiveSlot(TupleTableSlot *slot, DestReceiver *self)
 		else if (consumerIdx == SQ_CONS_SELF)
 		{
 			Assert(myState->consumer);
+			if (myState->selffilter &&
+					!JoinFilterTestSlot(myState->selffilter, slot))
+				continue;
 			(*myState->consumer->receiveSlot) (slot, myState->consumer);
 			myState->selfcount++;
 		}
-		else if (myState->squeue)
+		else if (myState->squeue && !queued)
 		{
 			/*
-			 * If the tuple will not fit to the consumer queue it will be stored
-			 * in the local tuplestore. The tuplestore should be in the portal
-			 * context, because ExecutorContext may be destroyed when tuples
-			 * are not yet pushed to the consumer queue.
+			 * Accumulate tuples for the consumer and write them to the queue
+			 * at once, so the queue is checked and the consumer is woken up
+			 * once per batch. If tuples will not fit to the consumer queue
+			 * they will be stored in the local tuplestore. Both should be in
+			 * the portal context, because ExecutorContext may be destroyed
+			 * when tuples are not yet pushed to the consumer queue.
 			 */
 			MemoryContext savecontext;
+			TupleTableSlot **batchslot;
+
+			/*
+			 * Consumers of a broadcast queue read the same data, so the tuple
+			 * is written once, through the first batch.
+			 */
+			if (SharedQueueIsBroadcast(myState->squeue))
+			{
+				consumerIdx = 0;
+				queued = true;
+			}
+
 			Assert(ActivePortal);
-			savecontext = MemoryContextSwitchTo(PortalGetHeapMemory(ActivePortal));
-			SharedQueueWrite(myState->squeue, consumerIdx, slot,
-							 &myState->tstores[consumerIdx], myState->tmpcxt);
+			myState->batchcxt = PortalGetHeapMemory(ActivePortal);
+			savecontext = MemoryContextSwitchTo(myState->batchcxt);
+			batchslot = &myState->batches[consumerIdx * SQUEUE_BATCH_SIZE +
+										  myState->nbatched[consumerIdx]];
+			if (*batchslot == NULL)
+				*batchslot = MakeSingleTupleTableSlot(myState->typeinfo);
+			ExecStoreDataRowTuple(ExecCopySlotDatarow(slot, myState->tmpcxt),
+								  *batchslot, true);
 			MemoryContextSwitchTo(savecontext);
+
+			if (++myState->nbatched[consumerIdx] == SQUEUE_BATCH_SIZE)
+				producerFlushBatch(myState, consumerIdx);
 			myState->othercount++;
 		}
 	}
@@ -131,6 +234,12 @@ producerShutdownReceiver(DestReceiver *self)
 {
 	ProducerState *myState = (ProducerState *) self;
 
+	/*
+	 * Do not keep tuples while executor is not running, consumers may be
+	 * waiting for them.
+	 */
+	producerFlushBatches(myState);
+
 	if (myState->consumer)
 		(*myState->consumer->rShutdown) (myState->consumer);
 }
@@ -151,6 +260,7 @@ producerDestroyReceiver(DestReceiver *self)
 		(*myState->consumer->rDestroy) (myState->consumer);
 
 	/* Make sure all data are in the squeue */
+	producerFlushBatches(myState);
 	while (myState->tstores)
 	{
 		if (SharedQueueFinish(myState->squeue, myState->typeinfo,
@@ -159,12 +269,11 @@ producerDestroyReceiver(DestReceiver *self)
 			pfree(myState->tstores);
 			myState->tstores = NULL;
 		}
-		else
+		else if (!SharedQueueWaitCredit(myState->squeue, 10000L))
 		{
-			pg_usleep(10*1000*1000l);
 			/*
 			 * Do not wait for consumers that was not even connected after 10
-			 * seconds after start waiting for their disconnection.
+			 * seconds without progress of any consumer.
 			 * That should help to break the loop which would otherwise endless.
 			 * The error will be emitted later in SharedQueueUnBind
 			 */
@@ -178,8 +287,20 @@ producerDestroyReceiver(DestReceiver *self)
 	myState->squeue = NULL;
 
 	/* Release workspace if any */
+	if (myState->batches)
+	{
+		int			i;
+
+		for (i = 0; i < NumDataNodes * SQUEUE_BATCH_SIZE; i++)
+			if (myState->batches[i])
+				ExecDropSingleTupleTableSlot(myState->batches[i]);
+		pfree(myState->batches);
+		pfree(myState->nbatched);
+	}
 	if (myState->locator)
 		freeLocator(myState->locator);
+	if (myState->adaptiveLocator)
+		freeLocator(myState->adaptiveLocator);
 	pfree(myState);
 }
 
@@ -227,8 +348,13 @@ SetProducerDestReceiverParams(DestReceiver *self,
 	/* Create workspace */
 	myState->distNodes = (int *) getLocatorResults(locator);
 	if (squeue)
+	{
 		myState->tstores = (Tuplestorestate **)
 			palloc0(NumDataNodes * sizeof(Tuplestorestate *));
+		myState->batches = (TupleTableSlot **)
+			palloc0(NumDataNodes * SQUEUE_BATCH_SIZE * sizeof(TupleTableSlot *));
+		myState->nbatched = (int *) palloc0(NumDataNodes * sizeof(int));
+	}
 }
 
 
@@ -274,6 +400,7 @@ ProducerReceiverPushBuffers(DestReceiver *self)
 	ProducerState *myState = (ProducerState *) self;
 
 	Assert(myState->pub.mydest == DestProducer);
+	producerFlushBatches(myState);
 	if (myState->tstores)
 	{
 		if (SharedQueueFinish(myState->squeue, myState->typeinfo,
@@ -287,3 +414,42 @@ ProducerReceiverPushBuffers(DestReceiver *self)
 	}
 	return true;
 }
+
+
+/*
+ * Set the join filter the tuples for self must pass, see joinFilter.c.
+ * NULL lets all of them pass.
+ */
+void
+SetProducerJoinFilter(DestReceiver *self, JoinFilter *filter)
+{
+	ProducerState *myState = (ProducerState *) self;
+
+	Assert(myState->pub.mydest == DestProducer);
+	myState->selffilter = filter;
+}
+
+
+/*
+ * Broadcasting producer switches to the locator after the specified number
+ * of tuples, and sends the rest of the tuples only to the nodes determined
+ * by the value of the distKey attribute. That is only correct if the
+ * consumers do not need the tuples which do not belong to them, like the
+ * inner side of a join where the outer side is distributed by the join key.
+ * The squeue must not be a broadcast one.
+ */
+void
+SetProducerAdaptiveParams(DestReceiver *self,
+						  AttrNumber distKey,
+						  Locator *locator,
+						  long rows)
+{
+	ProducerState *myState = (ProducerState *) self;
+
+	Assert(myState->pub.mydest == DestProducer);
+	Assert(myState->squeue == NULL ||
+		   !SharedQueueIsBroadcast(myState->squeue));
+	myState->adaptiveKey = distKey;
+	myState->adaptiveLocator = locator;
+	myState->adaptiveRows = rows;
+}
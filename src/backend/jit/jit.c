@@ -0,0 +1,128 @@
+/*-------------------------------------------------------------------------
+ *
+ * jit.c
+ *	  Interface to the loadable provider compiling expressions and tuple
+ *	  deforming code at execution time
+ *
+ * The executor evaluates expressions by walking trees of ExprState nodes,
+ * and deforms tuples by a generic loop over the attributes. Both pay for
+ * dispatch and for decisions which are the same for every tuple. A JIT
+ * provider may replace them by code compiled for the expressions and the
+ * tuple descriptors at hand, when the plan is initialized.
+ *
+ * The provider is a shared library named by jit_provider, so the server
+ * does not depend on the compiler infrastructure it needs. Compiling
+ * takes time, so it is only done for plans expected to run long enough:
+ * those costing jit_above_cost or more. On a Datanode that is the cost of
+ * the plan fragment it runs.
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * src/backend/jit/jit.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "executor/executor.h"
+#include "fmgr.h"
+#include "jit/jit.h"
+#include "utils/memutils.h"
+
+/* GUC parameters */
+char	   *jit_provider = NULL;
+double		jit_above_cost = 100000;
+
+/* Callbacks of the loaded provider, and the library they came from */
+static JitProviderCallbacks provider;
+static char *provider_loaded = NULL;
+
+static bool jit_load_provider(void);
+static void jit_release_context(void *arg);
+
+
+/*
+ * Load the provider named by jit_provider, unless it is loaded already.
+ * Returns false if there is none.
+ */
+static bool
+jit_load_provider(void)
+{
+	JitProviderInit init;
+
+	if (jit_provider == NULL || jit_provider[0] == '\0')
+		return false;
+
+	if (provider_loaded != NULL && strcmp(provider_loaded, jit_provider) == 0)
+		return true;
+
+	init = (JitProviderInit)
+		load_external_function(jit_provider, JIT_PROVIDER_INIT_FUNCTION,
+							   true, NULL);
+	memset(&provider, 0, sizeof(provider));
+	init(&provider);
+
+	if (provider_loaded)
+		pfree(provider_loaded);
+	provider_loaded = MemoryContextStrdup(TopMemoryContext, jit_provider);
+
+	return true;
+}
+
+/*
+ * Release the compiled code when the per-query memory goes away, whether
+ * the execution ended normally or not.
+ */
+static void
+jit_release_context(void *arg)
+{
+	JitContext *context = (JitContext *) arg;
+
+	provider.release_context(context);
+}
+
+/*
+ * jit_start_execution
+ *		Decide whether to compile the plan about to be initialized.
+ *
+ * Called by ExecutorStart in the per-query memory context.
+ */
+void
+jit_start_execution(EState *estate, PlannedStmt *plannedstmt, int eflags)
+{
+	MemoryContextCallback *callback;
+
+	estate->es_jit = NULL;
+
+	if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
+		return;
+	if (plannedstmt->planTree == NULL ||
+		plannedstmt->planTree->total_cost < jit_above_cost)
+		return;
+	if (!jit_load_provider())
+		return;
+
+	estate->es_jit = provider.create_context(estate);
+	estate->es_jit->estate = estate;
+
+	callback = (MemoryContextCallback *)
+		palloc(sizeof(MemoryContextCallback));
+	callback->func = jit_release_context;
+	callback->arg = estate->es_jit;
+	MemoryContextRegisterResetCallback(estate->es_query_cxt, callback);
+}
+
+/*
+ * jit_compile_planstate
+ *		Let the provider compile the expressions of a newly initialized plan
+ *		node, if the execution is compiled.
+ */
+void
+jit_compile_planstate(EState *estate, PlanState *planstate)
+{
+	if (estate->es_jit == NULL || planstate == NULL)
+		return;
+
+	provider.compile_planstate(estate->es_jit, planstate);
+}
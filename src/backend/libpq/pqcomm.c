@@ -89,6 +89,9 @@
 #include <mstcpip.h>
 #endif
 
+#ifdef XCP
+#include "common/pg_lzcompress.h"
+#endif
 #include "libpq/ip.h"
 #include "libpq/libpq.h"
 #include "miscadmin.h"
@@ -120,10 +123,32 @@ static int	PqSendBufferSize;	/* Size send buffer */
 static int	PqSendPointer;		/* Next index to store a byte in PqSendBuffer */
 static int	PqSendStart;		/* Next index to send a byte in PqSendBuffer */
 
+#ifdef XCP
+/*
+ * While the messages unpacked from a compressed message are read PqRecvBuffer
+ * points to them, and the position in the socket data is saved.
+ */
+static char PqRecvBufferData[PQ_RECV_BUFFER_SIZE];
+static char *PqRecvBuffer = PqRecvBufferData;
+static int	PqRecvSavedPointer;
+static int	PqRecvSavedLength;
+#else
 static char PqRecvBuffer[PQ_RECV_BUFFER_SIZE];
+#endif
 static int	PqRecvPointer;		/* Next index to read a byte from PqRecvBuffer */
 static int	PqRecvLength;		/* End of data available in PqRecvBuffer */
 
+#ifdef XCP
+/*
+ * Output compression, see pq_setcompression(). Data in PqSendBuffer up to
+ * PqSendPacked are final and are not compressed again.
+ */
+static int	PqSendCompressThreshold = -1;
+static int	PqSendPacked;
+static char *PqCompressBuffer;
+static int	PqCompressBufferSize;
+#endif
+
 /*
  * Message status
  */
@@ -146,6 +171,10 @@ static void socket_endcopyout(bool errorAbort);
 static int	internal_putbytes(const char *s, size_t len);
 static int	internal_flush(void);
 static void socket_set_nonblocking(bool nonblocking);
+#ifdef XCP
+static void socket_pack_output(void);
+static void socket_resume_recvbuf(void);
+#endif
 
 #ifdef HAVE_UNIX_SOCKETS
 static int	Lock_AF_UNIX(char *unixSocketDir, char *unixSocketPath);
@@ -862,6 +891,15 @@ socket_set_nonblocking(bool nonblocking)
 static int
 pq_recvbuf(void)
 {
+#ifdef XCP
+	if (PqRecvBuffer != PqRecvBufferData)
+	{
+		socket_resume_recvbuf();
+		if (PqRecvPointer < PqRecvLength)
+			return 0;
+	}
+#endif
+
 	if (PqRecvPointer > 0)
 	{
 		if (PqRecvLength > PqRecvPointer)
@@ -967,6 +1005,11 @@ pq_getbyte_if_available(unsigned char *c)
 
 	Assert(PqCommReadingMsg);
 
+#ifdef XCP
+	if (PqRecvBuffer != PqRecvBufferData && PqRecvPointer >= PqRecvLength)
+		socket_resume_recvbuf();
+#endif
+
 	if (PqRecvPointer < PqRecvLength)
 	{
 		*c = PqRecvBuffer[PqRecvPointer++];
@@ -1330,6 +1373,10 @@ socket_flush(void)
 		return 0;
 	PqCommBusy = true;
 	socket_set_nonblocking(false);
+#ifdef XCP
+	if (PqSendCompressThreshold >= 0)
+		socket_pack_output();
+#endif
 	res = internal_flush();
 	PqCommBusy = false;
 	return res;
@@ -1395,6 +1442,9 @@ internal_flush(void)
 			 * the connection.
 			 */
 			PqSendStart = PqSendPointer = 0;
+#ifdef XCP
+			PqSendPacked = 0;
+#endif
 			ClientConnectionLost = 1;
 			InterruptPending = 1;
 			return EOF;
@@ -1406,6 +1456,9 @@ internal_flush(void)
 	}
 
 	PqSendStart = PqSendPointer = 0;
+#ifdef XCP
+	PqSendPacked = 0;
+#endif
 	return 0;
 }
 
@@ -1432,6 +1485,10 @@ socket_flush_if_writable(void)
 	socket_set_nonblocking(true);
 
 	PqCommBusy = true;
+#ifdef XCP
+	if (PqSendCompressThreshold >= 0)
+		socket_pack_output();
+#endif
 	res = internal_flush();
 	PqCommBusy = false;
 	return res;
@@ -1483,9 +1540,32 @@ socket_is_send_pending(void)
 static int
 socket_putmessage(char msgtype, const char *s, size_t len)
 {
+#ifdef XCP
+	bool		oversized = false;
+#endif
+
 	if (DoingCopyOut || PqCommBusy)
 		return 0;
 	PqCommBusy = true;
+#ifdef XCP
+	/*
+	 * Compressed data must end on a message boundary, so if the message does
+	 * not fit into the buffer send out the buffered messages first. The
+	 * message which does not fit even into the empty buffer is sent as is.
+	 */
+	if (PqSendCompressThreshold >= 0 &&
+		PqSendPointer + 1 + 4 + len > PqSendBufferSize)
+	{
+		if (PqSendPointer > PqSendStart)
+		{
+			socket_pack_output();
+			socket_set_nonblocking(false);
+			if (internal_flush())
+				goto fail;
+		}
+		oversized = (1 + 4 + len > PqSendBufferSize);
+	}
+#endif
 	if (msgtype)
 		if (internal_putbytes(&msgtype, 1))
 			goto fail;
@@ -1499,6 +1579,10 @@ socket_putmessage(char msgtype, const char *s, size_t len)
 	}
 	if (internal_putbytes(s, len))
 		goto fail;
+#ifdef XCP
+	if (oversized)
+		PqSendPacked = PqSendPointer;
+#endif
 	PqCommBusy = false;
 	return 0;
 
@@ -1535,6 +1619,140 @@ socket_putmessage_noblock(char msgtype, const char *s, size_t len)
 }
 
 
+#ifdef XCP
+/* --------------------------------
+ *		pq_setcompression - compress output sent to another node
+ *
+ *		If threshold is not negative, buffered messages amounting to more
+ *		than threshold bytes are compressed into a single message of type
+ *		PQ_PACKED_MSG_TYPE when they are flushed. The other node unpacks them
+ *		with pq_inflatemessage() or its equivalent.
+ * --------------------------------
+ */
+void
+pq_setcompression(int threshold)
+{
+	if (threshold == PqSendCompressThreshold)
+		return;
+
+	if (threshold >= 0 && PqCompressBuffer == NULL)
+	{
+		PqCompressBufferSize = PGLZ_MAX_OUTPUT(PqSendBufferSize);
+		PqCompressBuffer = MemoryContextAlloc(TopMemoryContext,
+											  PqCompressBufferSize);
+	}
+	/* Do not touch messages which are already buffered */
+	PqSendPacked = PqSendPointer;
+	PqSendCompressThreshold = threshold;
+}
+
+/* --------------------------------
+ *		socket_pack_output - compress buffered messages before they are sent
+ *
+ *		Data which are not worth compressing are left as they are.
+ * --------------------------------
+ */
+static void
+socket_pack_output(void)
+{
+	int			start = Max(PqSendStart, PqSendPacked);
+	int32		rawlen = PqSendPointer - start;
+
+	if (rawlen > PqSendCompressThreshold &&
+		rawlen > PQ_PACKED_HDR_SIZE &&
+		PGLZ_MAX_OUTPUT(rawlen) <= PqCompressBufferSize)
+	{
+		int32		clen;
+
+		clen = pglz_compress(PqSendBuffer + start, rawlen, PqCompressBuffer,
+							 PGLZ_strategy_default);
+		if (clen >= 0 && clen + PQ_PACKED_HDR_SIZE < rawlen)
+		{
+			uint32		n32;
+
+			PqSendBuffer[start] = PQ_PACKED_MSG_TYPE;
+			n32 = htonl((uint32) (clen + 8));
+			memcpy(PqSendBuffer + start + 1, &n32, 4);
+			n32 = htonl((uint32) rawlen);
+			memcpy(PqSendBuffer + start + 5, &n32, 4);
+			memcpy(PqSendBuffer + start + PQ_PACKED_HDR_SIZE, PqCompressBuffer,
+				   clen);
+			PqSendPointer = start + PQ_PACKED_HDR_SIZE + clen;
+		}
+	}
+	PqSendPacked = PqSendPointer;
+}
+
+/* --------------------------------
+ *		pq_inflatemessage - unpack messages compressed by another node
+ *
+ *		s holds the body of a message of type PQ_PACKED_MSG_TYPE. The
+ *		messages packed into it are read before the rest of the socket data.
+ *
+ *		returns 0 if OK, EOF if trouble
+ * --------------------------------
+ */
+int
+pq_inflatemessage(StringInfo s)
+{
+	uint32		n32;
+	int32		rawlen;
+	char	   *buf;
+
+	if (PqRecvBuffer != PqRecvBufferData || s->len < 4)
+	{
+		ereport(COMMERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("invalid compressed message")));
+		return EOF;
+	}
+
+	memcpy(&n32, s->data, 4);
+	rawlen = (int32) ntohl(n32);
+	if (rawlen <= 0 || !AllocSizeIsValid(rawlen))
+	{
+		ereport(COMMERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("invalid compressed message length")));
+		return EOF;
+	}
+
+	buf = MemoryContextAlloc(TopMemoryContext, rawlen);
+	if (pglz_decompress(s->data + 4, s->len - 4, buf, rawlen) != rawlen)
+	{
+		pfree(buf);
+		ereport(COMMERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("compressed message is corrupted")));
+		return EOF;
+	}
+
+	PqRecvSavedPointer = PqRecvPointer;
+	PqRecvSavedLength = PqRecvLength;
+	PqRecvBuffer = buf;
+	PqRecvPointer = 0;
+	PqRecvLength = rawlen;
+	return 0;
+}
+
+/* --------------------------------
+ *		socket_resume_recvbuf - go on reading the socket data after the
+ *			unpacked messages are consumed
+ * --------------------------------
+ */
+static void
+socket_resume_recvbuf(void)
+{
+	Assert(PqRecvPointer >= PqRecvLength);
+
+	pfree(PqRecvBuffer);
+	PqRecvBuffer = PqRecvBufferData;
+	PqRecvPointer = PqRecvSavedPointer;
+	PqRecvLength = PqRecvSavedLength;
+}
+#endif
+
+
 /* --------------------------------
  *		socket_startcopyout - inform libpq that an old-style COPY OUT transfer
  *			is beginning
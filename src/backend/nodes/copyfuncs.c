@@ -115,6 +115,13 @@ _copyPlannedStmt(const PlannedStmt *from)
 	COPY_SCALAR_FIELD(distributionKey);
 	COPY_NODE_FIELD(distributionNodes);
 	COPY_NODE_FIELD(distributionRestrict);
+	COPY_NODE_FIELD(distributionBuckets);
+	COPY_NODE_FIELD(distributionRanges);
+	COPY_SCALAR_FIELD(adaptiveType);
+	COPY_SCALAR_FIELD(adaptiveKey);
+	COPY_SCALAR_FIELD(adaptiveRows);
+	COPY_SCALAR_FIELD(workMem);
+	COPY_SCALAR_FIELD(instrumentOptions);
 #endif
 	COPY_SCALAR_FIELD(hasRowSecurity);
 
@@ -822,6 +829,7 @@ _copySort(const Sort *from)
 	COPY_POINTER_FIELD(sortOperators, from->numCols * sizeof(Oid));
 	COPY_POINTER_FIELD(collations, from->numCols * sizeof(Oid));
 	COPY_POINTER_FIELD(nullsFirst, from->numCols * sizeof(bool));
+	COPY_SCALAR_FIELD(numPresorted);
 
 	return newnode;
 }
@@ -1021,6 +1029,48 @@ _copyLimit(const Limit *from)
 	return newnode;
 }
 
+/*
+ * _copyGather
+ */
+static Gather *
+_copyGather(const Gather *from)
+{
+	Gather	   *newnode = makeNode(Gather);
+
+	/*
+	 * copy node superclass fields
+	 */
+	CopyPlanFields((const Plan *) from, (Plan *) newnode);
+
+	/*
+	 * copy remainder of node
+	 */
+	COPY_SCALAR_FIELD(num_workers);
+
+	return newnode;
+}
+
+/*
+ * _copyResultCache
+ */
+static ResultCache *
+_copyResultCache(const ResultCache *from)
+{
+	ResultCache *newnode = makeNode(ResultCache);
+
+	/*
+	 * copy node superclass fields
+	 */
+	CopyPlanFields((const Plan *) from, (Plan *) newnode);
+
+	/*
+	 * copy remainder of node
+	 */
+	COPY_NODE_FIELD(param_exprs);
+
+	return newnode;
+}
+
 /*
  * _copyNestLoopParam
  */
@@ -1192,11 +1242,21 @@ _copyRemoteSubplan(const RemoteSubplan *from)
 	COPY_SCALAR_FIELD(distributionKey);
 	COPY_NODE_FIELD(distributionNodes);
 	COPY_NODE_FIELD(distributionRestrict);
+	COPY_NODE_FIELD(distributionBuckets);
+	COPY_NODE_FIELD(distributionRanges);
 	COPY_NODE_FIELD(nodeList);
 	COPY_SCALAR_FIELD(execOnAll);
 	COPY_NODE_FIELD(sort);
 	COPY_STRING_FIELD(cursor);
 	COPY_SCALAR_FIELD(unique);
+	COPY_SCALAR_FIELD(persistent);
+	COPY_SCALAR_FIELD(adaptiveType);
+	COPY_SCALAR_FIELD(adaptiveKey);
+	COPY_SCALAR_FIELD(adaptiveRows);
+	COPY_STRING_FIELD(resultCacheKey);
+	COPY_SCALAR_FIELD(globalIndex);
+	COPY_SCALAR_FIELD(globalIndexRel);
+	COPY_NODE_FIELD(globalIndexValue);
 
 	return newnode;
 }
@@ -1213,6 +1273,8 @@ _copyDistribution(const Distribution *from)
 	COPY_NODE_FIELD(distributionExpr);
 	COPY_BITMAPSET_FIELD(nodes);
 	COPY_BITMAPSET_FIELD(restrictNodes);
+	COPY_NODE_FIELD(buckets);
+	COPY_NODE_FIELD(ranges);
 
 	return newnode;
 }
@@ -3155,6 +3217,8 @@ _copyDistributeBy(const DistributeBy *from)
 
 	COPY_SCALAR_FIELD(disttype);
 	COPY_STRING_FIELD(colname);
+	COPY_NODE_FIELD(colnames);
+	COPY_NODE_FIELD(rangevalues);
 
 	return newnode;
 }
@@ -4625,6 +4689,12 @@ copyObject(const void *from)
 		case T_Limit:
 			retval = _copyLimit(from);
 			break;
+		case T_Gather:
+			retval = _copyGather(from);
+			break;
+		case T_ResultCache:
+			retval = _copyResultCache(from);
+			break;
 		case T_NestLoopParam:
 			retval = _copyNestLoopParam(from);
 			break;
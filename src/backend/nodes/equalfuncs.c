@@ -2590,6 +2590,8 @@ _equalDistribution(const Distribution *a, const Distribution *b)
 	COMPARE_SCALAR_FIELD(distributionType);
 	COMPARE_NODE_FIELD(distributionExpr);
 	COMPARE_BITMAPSET_FIELD(nodes);
+	COMPARE_NODE_FIELD(buckets);
+	COMPARE_NODE_FIELD(ranges);
 
 	return true;
 }
@@ -1276,6 +1276,8 @@ _outSort(StringInfo str, const Sort *node)
 	appendStringInfoString(str, " :nullsFirst");
 	for (i = 0; i < node->numCols; i++)
 		appendStringInfo(str, " %s", booltostr(node->nullsFirst[i]));
+
+	WRITE_INT_FIELD(numPresorted);
 }
 
 static void
@@ -1422,6 +1424,26 @@ _outLimit(StringInfo str, const Limit *node)
 	WRITE_NODE_FIELD(limitCount);
 }
 
+static void
+_outGather(StringInfo str, const Gather *node)
+{
+	WRITE_NODE_TYPE("GATHER");
+
+	_outPlanInfo(str, (const Plan *) node);
+
+	WRITE_INT_FIELD(num_workers);
+}
+
+static void
+_outResultCache(StringInfo str, const ResultCache *node)
+{
+	WRITE_NODE_TYPE("RESULTCACHE");
+
+	_outPlanInfo(str, (const Plan *) node);
+
+	WRITE_NODE_FIELD(param_exprs);
+}
+
 #ifdef XCP
 static void
 _outRemoteSubplan(StringInfo str, const RemoteSubplan *node)
@@ -1434,11 +1456,21 @@ _outRemoteSubplan(StringInfo str, const RemoteSubplan *node)
 	WRITE_INT_FIELD(distributionKey);
 	WRITE_NODE_FIELD(distributionNodes);
 	WRITE_NODE_FIELD(distributionRestrict);
+	WRITE_NODE_FIELD(distributionBuckets);
+	WRITE_NODE_FIELD(distributionRanges);
 	WRITE_NODE_FIELD(nodeList);
 	WRITE_BOOL_FIELD(execOnAll);
 	WRITE_NODE_FIELD(sort);
 	WRITE_STRING_FIELD(cursor);
 	WRITE_INT_FIELD(unique);
+	WRITE_BOOL_FIELD(persistent);
+	WRITE_CHAR_FIELD(adaptiveType);
+	WRITE_INT_FIELD(adaptiveKey);
+	WRITE_INT_FIELD(adaptiveRows);
+	WRITE_STRING_FIELD(resultCacheKey);
+	WRITE_RELID_FIELD(globalIndex);
+	WRITE_RELID_FIELD(globalIndexRel);
+	WRITE_NODE_FIELD(globalIndexValue);
 }
 
 static void
@@ -1484,6 +1516,14 @@ _outRemoteStmt(StringInfo str, const RemoteStmt *node)
 	WRITE_INT_FIELD(distributionKey);
 	WRITE_NODE_FIELD(distributionNodes);
 	WRITE_NODE_FIELD(distributionRestrict);
+	WRITE_NODE_FIELD(distributionBuckets);
+	WRITE_NODE_FIELD(distributionRanges);
+	WRITE_CHAR_FIELD(adaptiveType);
+	WRITE_INT_FIELD(adaptiveKey);
+	WRITE_INT_FIELD(adaptiveRows);
+	WRITE_INT_FIELD(workMem);
+	WRITE_INT_FIELD(instrumentOptions);
+	WRITE_UINT_FIELD(queryId);
 }
 
 static void
@@ -2785,6 +2825,21 @@ _outMaterialPath(StringInfo str, const MaterialPath *node)
 	WRITE_NODE_FIELD(subpath);
 }
 
+static void
+_outResultCachePath(StringInfo str, const ResultCachePath *node)
+{
+	WRITE_NODE_TYPE("RESULTCACHEPATH");
+
+	_outPathInfo(str, (const Path *) node);
+
+	WRITE_NODE_FIELD(subpath);
+	WRITE_NODE_FIELD(param_exprs);
+	WRITE_FLOAT_FIELD(calls, "%.0f");
+	WRITE_FLOAT_FIELD(ndistinct, "%.0f");
+	WRITE_FLOAT_FIELD(est_entries, "%.0f");
+	WRITE_FLOAT_FIELD(hit_ratio, "%.4f");
+}
+
 static void
 _outUniquePath(StringInfo str, const UniquePath *node)
 {
@@ -4221,6 +4276,12 @@ _outNode(StringInfo str, const void *obj)
 			case T_Limit:
 				_outLimit(str, obj);
 				break;
+			case T_Gather:
+				_outGather(str, obj);
+				break;
+			case T_ResultCache:
+				_outResultCache(str, obj);
+				break;
 			case T_NestLoopParam:
 				_outNestLoopParam(str, obj);
 				break;
@@ -4421,6 +4482,9 @@ _outNode(StringInfo str, const void *obj)
 			case T_MaterialPath:
 				_outMaterialPath(str, obj);
 				break;
+			case T_ResultCachePath:
+				_outResultCachePath(str, obj);
+				break;
 			case T_UniquePath:
 				_outUniquePath(str, obj);
 				break;
@@ -2768,6 +2768,8 @@ _readSort(void)
 		local_node->nullsFirst[i] = strtobool(token);
 	}
 
+	READ_INT_FIELD(numPresorted);
+
 	READ_DONE();
 }
 
@@ -3192,6 +3194,34 @@ _readLimit(void)
 }
 
 
+/*
+ * _readGather
+ */
+static Gather *
+_readGather(void)
+{
+	READ_PLAN_FIELDS(Gather);
+
+	READ_INT_FIELD(num_workers);
+
+	READ_DONE();
+}
+
+
+/*
+ * _readResultCache
+ */
+static ResultCache *
+_readResultCache(void)
+{
+	READ_PLAN_FIELDS(ResultCache);
+
+	READ_NODE_FIELD(param_exprs);
+
+	READ_DONE();
+}
+
+
 /*
  * _readRemoteSubplan
  */
@@ -3204,11 +3234,21 @@ _readRemoteSubplan(void)
 	READ_INT_FIELD(distributionKey);
 	READ_NODE_FIELD(distributionNodes);
 	READ_NODE_FIELD(distributionRestrict);
+	READ_NODE_FIELD(distributionBuckets);
+	READ_NODE_FIELD(distributionRanges);
 	READ_NODE_FIELD(nodeList);
 	READ_BOOL_FIELD(execOnAll);
 	READ_NODE_FIELD(sort);
 	READ_STRING_FIELD(cursor);
 	READ_INT_FIELD(unique);
+	READ_BOOL_FIELD(persistent);
+	READ_CHAR_FIELD(adaptiveType);
+	READ_INT_FIELD(adaptiveKey);
+	READ_INT_FIELD(adaptiveRows);
+	READ_STRING_FIELD(resultCacheKey);
+	READ_RELID_FIELD(globalIndex);
+	READ_RELID_FIELD(globalIndexRel);
+	READ_NODE_FIELD(globalIndexValue);
 
 	READ_DONE();
 }
@@ -3276,6 +3316,14 @@ _readRemoteStmt(void)
 	READ_INT_FIELD(distributionKey);
 	READ_NODE_FIELD(distributionNodes);
 	READ_NODE_FIELD(distributionRestrict);
+	READ_NODE_FIELD(distributionBuckets);
+	READ_NODE_FIELD(distributionRanges);
+	READ_CHAR_FIELD(adaptiveType);
+	READ_INT_FIELD(adaptiveKey);
+	READ_INT_FIELD(adaptiveRows);
+	READ_INT_FIELD(workMem);
+	READ_INT_FIELD(instrumentOptions);
+	READ_UINT_FIELD(queryId);
 
 	READ_DONE();
 }
@@ -3650,6 +3698,10 @@ parseNodeString(void)
 		return_value = _readSetOp();
 	else if (MATCH("LIMIT", 5))
 		return_value = _readLimit();
+	else if (MATCH("GATHER", 6))
+		return_value = _readGather();
+	else if (MATCH("RESULTCACHE", 11))
+		return_value = _readResultCache();
 	else if (MATCH("REMOTESUBPLAN", 13))
 		return_value = _readRemoteSubplan();
 	else if (MATCH("REMOTESTMT", 10))
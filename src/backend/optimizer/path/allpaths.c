@@ -1404,6 +1404,8 @@ set_subquery_pathlist(PlannerInfo *root, RelOptInfo *rel,
 		distribution->distributionType = subroot->distribution->distributionType;
 		distribution->nodes = bms_copy(subroot->distribution->nodes);
 		distribution->restrictNodes = bms_copy(subroot->distribution->restrictNodes);
+		distribution->buckets = list_copy(subroot->distribution->buckets);
+		distribution->ranges = list_copy(subroot->distribution->ranges);
 		foreach(lc, rel->subplan->targetlist)
 		{
 			TargetEntry *tle = (TargetEntry *) lfirst(lc);
@@ -2504,6 +2506,10 @@ print_path(PlannerInfo *root, Path *path, int indent)
 			ptype = "Material";
 			subpath = ((MaterialPath *) path)->subpath;
 			break;
+		case T_ResultCachePath:
+			ptype = "ResultCache";
+			subpath = ((ResultCachePath *) path)->subpath;
+			break;
 		case T_UniquePath:
 			ptype = "Unique";
 			subpath = ((UniquePath *) path)->subpath;
@@ -79,8 +79,10 @@
 #include <math.h>
 
 #include "access/htup_details.h"
+#include "catalog/pg_statistic.h"
 #include "executor/executor.h"
 #include "executor/nodeHash.h"
+#include "executor/nodeSort.h"
 #include "miscadmin.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/clauses.h"
@@ -92,7 +94,15 @@
 #include "optimizer/planmain.h"
 #include "optimizer/restrictinfo.h"
 #include "parser/parsetree.h"
+#ifdef XCP
+#include "pgxc/locator.h"
+#include "pgxc/nodemgr.h"
+#include "pgxc/pgxc.h"
+#endif
+#include "utils/builtins.h"
+#include "utils/guc.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/selfuncs.h"
 #include "utils/spccache.h"
 #include "utils/tuplesort.h"
@@ -109,6 +119,7 @@ double		cpu_operator_cost = DEFAULT_CPU_OPERATOR_COST;
 #ifdef XCP
 double		network_byte_cost = DEFAULT_NETWORK_BYTE_COST;
 double		remote_query_cost = DEFAULT_REMOTE_QUERY_COST;
+int			adaptive_broadcast_rows = 100000;
 #endif
 
 int			effective_cache_size = DEFAULT_EFFECTIVE_CACHE_SIZE;
@@ -121,9 +132,11 @@ bool		enable_indexonlyscan = true;
 bool		enable_bitmapscan = true;
 bool		enable_tidscan = true;
 bool		enable_sort = true;
+bool		enable_incremental_sort = true;
 bool		enable_hashagg = true;
 bool		enable_nestloop = true;
 bool		enable_material = true;
+bool		enable_resultcache = true;
 bool		enable_mergejoin = true;
 bool		enable_hashjoin = true;
 #ifdef PGXC
@@ -1451,6 +1464,73 @@ cost_sort(Path *path, PlannerInfo *root,
 	path->total_cost = startup_cost + run_cost;
 }
 
+/*
+ * cost_incremental_sort
+ *	  Determines and returns the cost of sorting input already sorted by the
+ *	  first presorted_keys of the pathkeys, including the cost of reading it.
+ *
+ * The input is read and sorted a batch of groups of tuples equal on the
+ * presorted keys at a time, each batch holding at least
+ * SORT_MIN_BATCH_TUPLES. The first tuples come out once the first batch is
+ * read and sorted, which makes the startup cost much lower than that of a
+ * full sort. Each batch costs about what cost_sort says for its size; we
+ * also charge an operator eval per input tuple for detecting the group
+ * boundaries. As for cost_sort, a LIMIT above pro-rates the run cost.
+ *
+ * The arguments are those of cost_sort, except for the startup and total
+ * costs of the input.
+ */
+void
+cost_incremental_sort(Path *path, PlannerInfo *root,
+					  List *pathkeys, int presorted_keys,
+					  Cost input_startup_cost, Cost input_total_cost,
+					  double input_tuples, int width, Cost comparison_cost,
+					  int sort_mem, double limit_tuples)
+{
+	Path		batch_path;		/* dummy for result of cost_sort */
+	List	   *presorted_exprs = NIL;
+	double		input_groups;
+	double		batch_tuples;
+	double		nbatches;
+	Cost		input_run_cost = input_total_cost - input_startup_cost;
+	ListCell   *lc;
+	int			i = 0;
+
+	Assert(presorted_keys > 0 && presorted_keys < list_length(pathkeys));
+
+	/* Estimate the number of groups of the presorted keys */
+	foreach(lc, pathkeys)
+	{
+		PathKey    *key = (PathKey *) lfirst(lc);
+		EquivalenceMember *member = (EquivalenceMember *)
+		linitial(key->pk_eclass->ec_members);
+
+		if (i++ >= presorted_keys)
+			break;
+		presorted_exprs = lappend(presorted_exprs, member->em_expr);
+	}
+	input_tuples = clamp_row_est(input_tuples);
+	input_groups = estimate_num_groups(root, presorted_exprs, input_tuples,
+									   NULL);
+	list_free(presorted_exprs);
+
+	batch_tuples = Max(input_tuples / input_groups,
+					   Min(SORT_MIN_BATCH_TUPLES, input_tuples));
+	nbatches = clamp_row_est(input_tuples / batch_tuples);
+
+	cost_sort(&batch_path, root, NIL, 0.0, batch_tuples, width,
+			  comparison_cost, sort_mem, limit_tuples);
+
+	if (!enable_incremental_sort)
+		input_startup_cost += disable_cost;
+
+	path->rows = input_tuples;
+	path->startup_cost = input_startup_cost + input_run_cost / nbatches +
+		batch_path.startup_cost;
+	path->total_cost = input_total_cost + nbatches * batch_path.total_cost +
+		cpu_operator_cost * input_tuples;
+}
+
 /*
  * cost_merge_append
  *	  Determines and returns the cost of a MergeAppend node.
@@ -1570,6 +1650,54 @@ cost_material(Path *path,
 	path->total_cost = startup_cost + run_cost;
 }
 
+/*
+ * cost_resultcache
+ *	  Determines and returns the cost of the first scan of a ResultCache
+ *	  path, and estimates how well the cache will do on the rescans.
+ *
+ * The path is expected to be rescanned calls times, with ndistinct distinct
+ * keys.  Every distinct key misses once; the other rescans hit, provided the
+ * entry of their key is still cached, which we take to be as likely as all
+ * the keys fitting in work_mem.
+ *
+ * Returns false if the rows of a single key are not expected to fit in
+ * work_mem, in which case the cache is useless.
+ */
+bool
+cost_resultcache(ResultCachePath *rcpath, PlannerInfo *root)
+{
+	Path	   *subpath = rcpath->subpath;
+	double		calls = Max(rcpath->calls, 1.0);
+	double		ndistinct = Max(rcpath->ndistinct, 1.0);
+	int			nkeys = list_length(rcpath->param_exprs);
+	double		entry_bytes;
+	long		work_mem_bytes = work_mem * 1024L;
+
+	/* Rows, key and the overhead of the entry */
+	entry_bytes = relation_byte_size(subpath->rows, subpath->parent->width) +
+		nkeys * sizeof(Datum) + 64;
+	if (entry_bytes > work_mem_bytes)
+		return false;
+
+	ndistinct = Min(ndistinct, calls);
+	rcpath->ndistinct = ndistinct;
+	rcpath->est_entries = Min(ndistinct, floor(work_mem_bytes / entry_bytes));
+	rcpath->hit_ratio = ((calls - ndistinct) / calls) *
+		Min(1.0, rcpath->est_entries / ndistinct);
+
+	/*
+	 * The first scan runs the subpath, computing the key and saving every
+	 * row on the way.
+	 */
+	rcpath->path.rows = subpath->rows;
+	rcpath->path.startup_cost = subpath->startup_cost +
+		cpu_operator_cost * nkeys;
+	rcpath->path.total_cost = subpath->total_cost +
+		cpu_operator_cost * nkeys + cpu_tuple_cost * subpath->rows;
+
+	return true;
+}
+
 /*
  * cost_agg
  *		Determines and returns the cost of performing an Agg plan node,
@@ -1664,6 +1792,42 @@ cost_agg(Path *path, PlannerInfo *root,
 	path->total_cost = total_cost;
 }
 
+/*
+ * cost_hashagg_spill
+ *		Adds to an AGG_HASHED path the cost of spilling to disk the input
+ *		tuples of the groups that don't fit in work_mem.
+ *
+ * 'hashentrysize' is the estimated space needed by each group.
+ *
+ * The spilled tuples are written and read back once for each level of
+ * partitioning needed for every partition to fit; the executor splits
+ * them 16 ways at each level.  This all happens before the first group
+ * is returned.
+ */
+void
+cost_hashagg_spill(Path *path, double numGroups, Size hashentrysize,
+				   double input_tuples, int input_width)
+{
+	double		tablebytes = numGroups * hashentrysize;
+	double		membytes = work_mem * 1024.0;
+	double		spillpages;
+	double		levels;
+	Cost		spill_cost;
+
+	if (tablebytes <= membytes)
+		return;
+
+	spillpages = page_size(input_tuples * (1.0 - membytes / tablebytes),
+						   input_width);
+	levels = ceil(log(tablebytes / membytes) / log(16.0));
+	if (levels < 1.0)
+		levels = 1.0;
+
+	spill_cost = 2.0 * seq_page_cost * spillpages * levels;
+	path->startup_cost += spill_cost;
+	path->total_cost += spill_cost;
+}
+
 /*
  * cost_windowagg
  *		Determines and returns the cost of performing a WindowAgg plan node,
@@ -3042,6 +3206,31 @@ cost_rescan(PlannerInfo *root, Path *path,
 				*rescan_total_cost = run_cost;
 			}
 			break;
+		case T_ResultCache:
+			{
+				/*
+				 * A hit returns the saved rows at cpu_tuple_cost each, a miss
+				 * rescans the subpath and saves its rows.
+				 */
+				ResultCachePath *rcpath = (ResultCachePath *) path;
+				double		hit_ratio = rcpath->hit_ratio;
+				Cost		key_cost;
+				Cost		sub_startup_cost;
+				Cost		sub_total_cost;
+
+				cost_rescan(root, rcpath->subpath,
+							&sub_startup_cost, &sub_total_cost);
+				key_cost = cpu_operator_cost *
+					list_length(rcpath->param_exprs);
+
+				*rescan_startup_cost = key_cost +
+					(1.0 - hit_ratio) * sub_startup_cost;
+				*rescan_total_cost = key_cost +
+					hit_ratio * cpu_tuple_cost * path->rows +
+					(1.0 - hit_ratio) * (sub_total_cost +
+										 cpu_tuple_cost * path->rows);
+			}
+			break;
 		default:
 			*rescan_startup_cost = path->startup_cost;
 			*rescan_total_cost = path->total_cost;
@@ -4257,16 +4446,361 @@ page_size(double tuples, int width)
 
 
 #ifdef XCP
+/*
+ * Link cost factors
+ *
+ * network_link_costs lists the cost of shipping data between nodes relative
+ * to network_byte_cost, as "from:to=factor" entries separated by commas.
+ * "from" and "to" are node names or host names, an entry applies to both
+ * directions, and the last matching entry wins. Other links cost 1, and
+ * tuples sent to the node they come from cost nothing.
+ */
+typedef struct NetworkLinkCost
+{
+	NameData	from;
+	NameData	to;
+	double		factor;
+} NetworkLinkCost;
+
+typedef struct NetworkLinkCostsExtra
+{
+	int			count;
+	NetworkLinkCost entries[FLEXIBLE_ARRAY_MEMBER];
+} NetworkLinkCostsExtra;
+
+char	   *network_link_costs = NULL;
+
+static NetworkLinkCostsExtra *link_costs_entries = NULL;
+static bool link_costs_valid = false;
+
+/*
+ * Factors by pair of node indexes, datanodes first and this coordinator at
+ * index NumDataNodes. Built on first use after the setting or the number of
+ * datanodes changes.
+ */
+static double *link_costs = NULL;
+static int	link_costs_nodes = -1;
+
+bool
+check_network_link_costs(char **newval, void **extra, GucSource source)
+{
+	NetworkLinkCostsExtra *myextra;
+	char	   *rawstring;
+	char	   *item;
+	char	   *next;
+	int			count = 0;
+
+	rawstring = pstrdup(*newval);
+	for (item = rawstring; *item; item++)
+		if (*item == ',')
+			count++;
+
+	myextra = (NetworkLinkCostsExtra *)
+		malloc(offsetof(NetworkLinkCostsExtra, entries) +
+			   (count + 1) * sizeof(NetworkLinkCost));
+	if (!myextra)
+	{
+		pfree(rawstring);
+		return false;
+	}
+	myextra->count = 0;
+
+	for (item = rawstring; item != NULL; item = next)
+	{
+		NetworkLinkCost *entry = &myextra->entries[myextra->count];
+		char	   *colon;
+		char	   *equals;
+		char	   *endptr;
+
+		next = strchr(item, ',');
+		if (next)
+			*next++ = '\0';
+
+		/* Skip empty entries, the default value is an empty list */
+		while (isspace((unsigned char) *item))
+			item++;
+		if (*item == '\0')
+			continue;
+
+		colon = strchr(item, ':');
+		equals = colon ? strchr(colon, '=') : NULL;
+		if (equals == NULL || colon == item || equals == colon + 1 ||
+			colon - item >= NAMEDATALEN || equals - colon - 1 >= NAMEDATALEN)
+		{
+			GUC_check_errdetail("Link \"%s\" is not of the form from:to=factor.",
+								item);
+			free(myextra);
+			pfree(rawstring);
+			return false;
+		}
+		*colon = '\0';
+		*equals = '\0';
+		entry->factor = strtod(equals + 1, &endptr);
+		while (isspace((unsigned char) *endptr))
+			endptr++;
+		if (endptr == equals + 1 || *endptr != '\0' || entry->factor < 0)
+		{
+			GUC_check_errdetail("Cost factor of link \"%s:%s\" is invalid.",
+								item, colon + 1);
+			free(myextra);
+			pfree(rawstring);
+			return false;
+		}
+		namestrcpy(&entry->from, item);
+		namestrcpy(&entry->to, colon + 1);
+		myextra->count++;
+	}
+
+	pfree(rawstring);
+	*extra = (void *) myextra;
+	return true;
+}
+
 void
-cost_remote_subplan(Path *path,
+assign_network_link_costs(const char *newval, void *extra)
+{
+	link_costs_entries = (NetworkLinkCostsExtra *) extra;
+	link_costs_valid = false;
+}
+
+/*
+ * Does the name of a link entry designate the node?
+ */
+static bool
+link_matches(Name name, NodeDefinition *node)
+{
+	return node != NULL &&
+		(strcmp(NameStr(*name), NameStr(node->nodename)) == 0 ||
+		 strcmp(NameStr(*name), NameStr(node->nodehost)) == 0);
+}
+
+/*
+ * Build the table of link cost factors between the nodes
+ */
+static void
+build_link_costs(void)
+{
+	NodeDefinition **nodes;
+	int			nnodes = NumDataNodes + 1;
+	int			i;
+	int			j;
+	int			k;
+
+	if (link_costs)
+		pfree(link_costs);
+	link_costs = (double *) MemoryContextAlloc(TopMemoryContext,
+											   nnodes * nnodes * sizeof(double));
+
+	nodes = (NodeDefinition **) palloc0(nnodes * sizeof(NodeDefinition *));
+	if (link_costs_entries && link_costs_entries->count > 0)
+	{
+		Oid		   *dnOids;
+		int			numdn;
+
+		/* Datanodes are indexed in the order of the node table */
+		PgxcNodeGetOids(NULL, &dnOids, NULL, &numdn, false);
+		for (i = 0; i < NumDataNodes && i < numdn; i++)
+			nodes[i] = PgxcNodeGetDefinition(dnOids[i]);
+		pfree(dnOids);
+		if (PGXCNodeName)
+			nodes[NumDataNodes] = PgxcNodeGetDefinition(get_pgxc_nodeoid(PGXCNodeName));
+	}
+
+	for (i = 0; i < nnodes; i++)
+	{
+		for (j = 0; j < nnodes; j++)
+		{
+			double		factor = (i == j) ? 0.0 : 1.0;
+
+			for (k = 0; link_costs_entries && k < link_costs_entries->count; k++)
+			{
+				NetworkLinkCost *entry = &link_costs_entries->entries[k];
+
+				if ((link_matches(&entry->from, nodes[i]) &&
+					 link_matches(&entry->to, nodes[j])) ||
+					(link_matches(&entry->from, nodes[j]) &&
+					 link_matches(&entry->to, nodes[i])))
+					factor = entry->factor;
+			}
+			link_costs[i * nnodes + j] = factor;
+		}
+	}
+
+	for (i = 0; i < nnodes; i++)
+		if (nodes[i])
+			pfree(nodes[i]);
+	pfree(nodes);
+
+	link_costs_nodes = NumDataNodes;
+	link_costs_valid = true;
+}
+
+/*
+ * Average cost factor of the links from the source nodes to the target
+ * nodes, a NULL set standing for this coordinator. A replicated source is
+ * read from one of its nodes, which could be any.
+ */
+static double
+average_link_cost(Bitmapset *from, Bitmapset *to)
+{
+	int			nnodes;
+	int			nfrom;
+	int			nto;
+	int			i;
+	int			j;
+	double		total = 0.0;
+
+	if (!link_costs_valid || link_costs_nodes != NumDataNodes)
+		build_link_costs();
+	nnodes = NumDataNodes + 1;
+
+	nfrom = from ? bms_num_members(from) : 1;
+	nto = to ? bms_num_members(to) : 1;
+	if (nfrom == 0 || nto == 0)
+		return 1.0;
+
+	for (i = 0; i < nnodes; i++)
+	{
+		if (from ? (i == NumDataNodes || !bms_is_member(i, from)) :
+			i != NumDataNodes)
+			continue;
+		for (j = 0; j < nnodes; j++)
+		{
+			if (to ? (j == NumDataNodes || !bms_is_member(j, to)) :
+				j != NumDataNodes)
+				continue;
+			total += link_costs[i * nnodes + j];
+		}
+	}
+	return total / (nfrom * nto);
+}
+
+/*
+ * Estimate how unevenly the rows are spread over the target nodes when they
+ * are redistributed by the distribution expression, as the ratio of the rows
+ * the busiest node gets to the average. The most common value of the
+ * expression, or the NULLs, all go to a single node.
+ */
+static double
+redistribution_skew(PlannerInfo *root, Node *expr, int nnodes)
+{
+	VariableStatData vardata;
+	double		maxfreq = 0.0;
+
+	if (root == NULL || expr == NULL || nnodes <= 1)
+		return 1.0;
+
+	examine_variable(root, expr, 0, &vardata);
+	if (HeapTupleIsValid(vardata.statsTuple))
+	{
+		Form_pg_statistic stats;
+		float4	   *numbers;
+		int			nnumbers;
+
+		stats = (Form_pg_statistic) GETSTRUCT(vardata.statsTuple);
+		maxfreq = stats->stanullfrac;
+		if (get_attstatsslot(vardata.statsTuple,
+							 vardata.atttype, vardata.atttypmod,
+							 STATISTIC_KIND_MCV, InvalidOid,
+							 NULL,
+							 NULL, NULL,
+							 &numbers, &nnumbers))
+		{
+			/* The frequencies are in decreasing order */
+			if (nnumbers > 0 && numbers[0] > maxfreq)
+				maxfreq = numbers[0];
+			free_attstatsslot(vardata.atttype, NULL, 0, numbers, nnumbers);
+		}
+	}
+	ReleaseVariableStats(vardata);
+
+	/* The busiest node gets its share of the rest too */
+	return (maxfreq + (1.0 - maxfreq) / nnodes) * nnodes;
+}
+
+/*
+ * Estimate how unevenly the rows of a table distributed by the expression
+ * are spread over its nodes, as the ratio of the rows of the busiest node
+ * to the average. The shares of the nodes are recorded by ANALYZE on the
+ * coordinator with the statistics of the distribution column.
+ */
+static double
+distribution_skew(PlannerInfo *root, Node *expr, int nnodes)
+{
+	VariableStatData vardata;
+	double		skew = 1.0;
+
+	if (root == NULL || expr == NULL || nnodes <= 1)
+		return 1.0;
+
+	examine_variable(root, expr, 0, &vardata);
+	if (HeapTupleIsValid(vardata.statsTuple))
+	{
+		float4	   *numbers;
+		int			nnumbers;
+
+		if (get_attstatsslot(vardata.statsTuple,
+							 vardata.atttype, vardata.atttypmod,
+							 STATISTIC_KIND_DATANODE_ROWS, InvalidOid,
+							 NULL,
+							 NULL, NULL,
+							 &numbers, &nnumbers))
+		{
+			/* The shares are in decreasing order */
+			if (nnumbers > 0)
+				skew = Max(numbers[0] * nnodes, 1.0);
+			free_attstatsslot(vardata.atttype, NULL, 0, numbers, nnumbers);
+		}
+	}
+	ReleaseVariableStats(vardata);
+
+	return skew;
+}
+
+/*
+ * cost_remote_subplan
+ *	  Determines and returns the cost of shipping the rows of a subplan from
+ *	  the nodes of the source distribution to the nodes of the path
+ *	  distribution, or to this coordinator if the path is not distributed.
+ *
+ * Each target node of a replicated distribution gets all the rows, else the
+ * rows are split between them. Shipping a row costs network_byte_cost per
+ * byte times the average cost factor of the links between the source and
+ * target nodes, see network_link_costs. As the step takes as long as the
+ * busiest node, redistribution by an expression is charged by the skew of
+ * its values, and rows coming from a table distributed by value by the skew
+ * of the table over its nodes, whichever is larger.
+ */
+void
+cost_remote_subplan(PlannerInfo *root, Path *path,
 			  Cost input_startup_cost, Cost input_total_cost,
-			  double tuples, int width, int replication)
+			  double tuples, int width, Distribution *source)
 {
+	Distribution *target = path->distribution;
+	Bitmapset  *from = NULL;
+	Bitmapset  *to = NULL;
+	int			replication = 1;
+	double		skew = 1.0;
 	Cost		startup_cost = input_startup_cost + remote_query_cost;
 	Cost		run_cost = input_total_cost - input_startup_cost;
 
 	path->rows = tuples;
 
+	if (source)
+		from = source->restrictNodes ? source->restrictNodes : source->nodes;
+	if (target)
+	{
+		to = target->nodes;
+		if (IsLocatorReplicated(target->distributionType))
+			replication = bms_num_members(target->nodes);
+		else
+			skew = redistribution_skew(root, target->distributionExpr,
+									   bms_num_members(to));
+	}
+	if (source && IsLocatorDistributedByValue(source->distributionType))
+		skew = Max(skew, distribution_skew(root, source->distributionExpr,
+										   bms_num_members(from)));
+
 	/*
 	 * Charge 2x cpu_operator_cost per tuple to reflect bookkeeping overhead.
 	 */
@@ -4275,7 +4809,8 @@ cost_remote_subplan(Path *path,
 	/*
 	 * Estimate cost of sending data over network
 	 */
-	run_cost += network_byte_cost * tuples * width * replication;
+	run_cost += network_byte_cost * tuples * width * replication *
+		average_link_cost(from, to) * skew;
 
 	path->startup_cost = startup_cost;
 	path->total_cost = startup_cost + run_cost;
@@ -46,18 +46,22 @@
 #include "optimizer/tlist.h"
 #include "optimizer/var.h"
 #include "parser/parse_clause.h"
+#include "parser/parse_oper.h"
 #include "parser/parsetree.h"
 #ifdef PGXC
 #include "access/htup_details.h"
 #include "access/gtm.h"
 #include "parser/parse_coerce.h"
+#include "pgxc/globalindex.h"
 #include "pgxc/pgxc.h"
 #include "pgxc/planner.h"
 #include "pgxc/postgresql_fdw.h"
 #include "access/sysattr.h"
 #include "utils/builtins.h"
+#include "utils/fmgroids.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
+#include "utils/typcache.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
 #include "executor/executor.h"
@@ -81,6 +85,8 @@ static Plan *create_append_plan(PlannerInfo *root, AppendPath *best_path);
 static Plan *create_merge_append_plan(PlannerInfo *root, MergeAppendPath *best_path);
 static Result *create_result_plan(PlannerInfo *root, ResultPath *best_path);
 static Material *create_material_plan(PlannerInfo *root, MaterialPath *best_path);
+static Plan *create_resultcache_plan(PlannerInfo *root,
+						ResultCachePath *best_path);
 static Plan *create_unique_plan(PlannerInfo *root, UniquePath *best_path);
 #ifdef XCP
 static void adjustSubplanDistribution(PlannerInfo *root, Distribution *pathd,
@@ -208,11 +214,18 @@ static EquivalenceMember *find_ec_member_for_tle(EquivalenceClass *ec,
 					   TargetEntry *tle,
 					   Relids relids);
 static Material *make_material(Plan *lefttree);
+static ResultCache *make_resultcache(Plan *lefttree, List *param_exprs);
 
 #ifdef XCP
 static int add_sort_column(AttrNumber colIdx, Oid sortOp, Oid coll,
 				bool nulls_first,int numCols, AttrNumber *sortColIdx,
 				Oid *sortOperators, Oid *collations, bool *nullsFirst);
+static bool limit_push_down_expr(Node *expr);
+static RemoteSubplan *find_limit_push_down_plan(Plan *plan, Sort **sort);
+static Plan *make_remote_distinct(PlannerInfo *root, Plan *subplan,
+					 double numGroups);
+static void set_remotesubplan_global_index(PlannerInfo *root,
+							   RemoteSubplan *plan);
 #endif
 
 /*
@@ -317,6 +330,10 @@ create_plan_recurse(PlannerInfo *root, Path *best_path)
 			plan = (Plan *) create_material_plan(root,
 												 (MaterialPath *) best_path);
 			break;
+		case T_ResultCache:
+			plan = create_resultcache_plan(root,
+										   (ResultCachePath *) best_path);
+			break;
 		case T_Unique:
 			plan = create_unique_plan(root,
 									  (UniquePath *) best_path);
@@ -946,6 +963,67 @@ create_material_plan(PlannerInfo *root, MaterialPath *best_path)
 	return plan;
 }
 
+/*
+ * create_resultcache_plan
+ *	  Create a ResultCache plan for 'best_path' and (recursively) plans
+ *	  for its subpaths.
+ *
+ *	  The key of the cache is made of the nestloop params the subplan uses,
+ *	  which are the ones in root->curOuterParams referring to the rels the
+ *	  subpath is parameterized by once the subplan is made.  If there are
+ *	  none, or one of them cannot be hashed, the subplan is returned alone.
+ *
+ *	  Returns a Plan node.
+ */
+static Plan *
+create_resultcache_plan(PlannerInfo *root, ResultCachePath *best_path)
+{
+	ResultCache *plan;
+	Plan	   *subplan;
+	Relids		req_outer = PATH_REQ_OUTER(best_path->subpath);
+	List	   *param_exprs = NIL;
+	ListCell   *lc;
+
+	subplan = create_plan_recurse(root, best_path->subpath);
+
+	foreach(lc, root->curOuterParams)
+	{
+		NestLoopParam *nlp = (NestLoopParam *) lfirst(lc);
+		Expr	   *paramval = (Expr *) nlp->paramval;
+		TypeCacheEntry *typentry;
+		Param	   *param;
+
+		if (!bms_is_subset(pull_varnos((Node *) paramval), req_outer))
+			continue;
+
+		typentry = lookup_type_cache(exprType((Node *) paramval),
+									 TYPECACHE_HASH_PROC | TYPECACHE_EQ_OPR);
+		if (!OidIsValid(typentry->hash_proc) || !OidIsValid(typentry->eq_opr))
+			return subplan;
+
+		param = makeNode(Param);
+		param->paramkind = PARAM_EXEC;
+		param->paramid = nlp->paramno;
+		param->paramtype = exprType((Node *) paramval);
+		param->paramtypmod = exprTypmod((Node *) paramval);
+		param->paramcollid = exprCollation((Node *) paramval);
+		param->location = -1;
+		param_exprs = lappend(param_exprs, param);
+	}
+
+	if (param_exprs == NIL)
+		return subplan;
+
+	/* We don't want any excess columns in the cached tuples */
+	disuse_physical_tlist(root, subplan, best_path->subpath);
+
+	plan = make_resultcache(subplan, param_exprs);
+
+	copy_path_costsize(&plan->plan, (Path *) best_path);
+
+	return (Plan *) plan;
+}
+
 /*
  * create_unique_plan
  *	  Create a Unique plan for 'best_path' and (recursively) plans
@@ -1260,11 +1338,35 @@ create_remotescan_plan(PlannerInfo *root,
 	/* We don't want any excess columns in the remote tuples */
 	disuse_physical_tlist(root, subplan, best_path->subpath);
 
+	/* Duplicates are not needed, do not send them */
+	if (best_path->distinct)
+		subplan = make_remote_distinct(root, subplan, best_path->path.rows);
+
 	plan = make_remotesubplan(root, subplan,
 							  best_path->path.distribution,
 							  best_path->subpath->distribution,
 							  best_path->path.pathkeys);
 
+	/*
+	 * Broadcast may switch to distribution by the join key, if the key is
+	 * among the columns sent.
+	 */
+	if (best_path->adaptiveExpr)
+	{
+		TargetEntry *tle;
+
+		tle = tlist_member_ignore_relabel(best_path->adaptiveExpr,
+										  plan->scan.plan.lefttree->targetlist);
+		if (tle)
+		{
+			plan->adaptiveType = best_path->adaptiveType;
+			plan->adaptiveKey = tle->resno;
+			plan->adaptiveRows = adaptive_broadcast_rows;
+		}
+	}
+
+	set_remotesubplan_global_index(root, plan);
+
 	copy_path_costsize(&plan->scan.plan, (Path *) best_path);
 
 	/* restore current restrict */
@@ -1275,6 +1377,162 @@ create_remotescan_plan(PlannerInfo *root,
 }
 
 
+/*
+ * set_remotesubplan_global_index
+ *	  If the subplan returning rows to the caller scans a single relation
+ *	  comparing a column having a global index with a constant or a
+ *	  parameter, let the executor probe the index and run the subplan only on
+ *	  the nodes storing the matching rows. The index is probed when the plan
+ *	  is executed, as its contents change. Only the equality operator of the
+ *	  type of the column is recognized, the index is distributed with the
+ *	  hash function matching it.
+ */
+static void
+set_remotesubplan_global_index(PlannerInfo *root, RemoteSubplan *plan)
+{
+	Plan	   *subplan = plan->scan.plan.lefttree;
+	List	   *quals;
+	RangeTblEntry *rte;
+	Relation	rel;
+	ListCell   *lc;
+
+	if (plan->distributionType != LOCATOR_TYPE_NONE || !plan->execOnAll ||
+		list_length(plan->nodeList) < 2)
+		return;
+
+	/* Nodes not having matching rows return nothing from these either */
+	while (subplan && subplan->righttree == NULL &&
+		   subplan->initPlan == NIL &&
+		   (IsA(subplan, Agg) || IsA(subplan, Sort) || IsA(subplan, Limit) ||
+			IsA(subplan, Unique) || IsA(subplan, Material) ||
+			IsA(subplan, Result)))
+		subplan = subplan->lefttree;
+	if (subplan == NULL || subplan->initPlan != NIL)
+		return;
+
+	switch (nodeTag(subplan))
+	{
+		case T_SeqScan:
+			quals = subplan->qual;
+			break;
+		case T_IndexScan:
+			quals = list_concat(list_copy(((IndexScan *) subplan)->indexqualorig),
+								subplan->qual);
+			break;
+		case T_BitmapHeapScan:
+			quals = list_concat(list_copy(((BitmapHeapScan *) subplan)->bitmapqualorig),
+								subplan->qual);
+			break;
+		default:
+			return;
+	}
+
+	rte = planner_rt_fetch(((Scan *) subplan)->scanrelid, root);
+	if (quals == NIL || rte->rtekind != RTE_RELATION)
+		return;
+
+	rel = heap_open(rte->relid, NoLock);
+	if (rel->rd_rules == NULL)
+	{
+		heap_close(rel, NoLock);
+		return;
+	}
+
+	foreach(lc, quals)
+	{
+		OpExpr	   *op = (OpExpr *) lfirst(lc);
+		Var		   *var;
+		Expr	   *value;
+		Oid			gindexid;
+
+		if (!IsA(op, OpExpr) || list_length(op->args) != 2)
+			continue;
+
+		var = (Var *) linitial(op->args);
+		value = (Expr *) lsecond(op->args);
+		if (!IsA(var, Var))
+		{
+			var = (Var *) lsecond(op->args);
+			value = (Expr *) linitial(op->args);
+		}
+		if (!IsA(var, Var) || var->varno != ((Scan *) subplan)->scanrelid ||
+			var->varlevelsup != 0 || var->varattno <= 0)
+			continue;
+		if (!IsA(value, Const) &&
+			!(IsA(value, Param) && ((Param *) value)->paramkind == PARAM_EXTERN))
+			continue;
+		if (exprType((Node *) value) != var->vartype ||
+			op->opno != lookup_type_cache(var->vartype,
+										  TYPECACHE_EQ_OPR)->eq_opr)
+			continue;
+
+		gindexid = RelationGetGlobalIndex(rel, var->varattno);
+		if (OidIsValid(gindexid))
+		{
+			plan->globalIndex = gindexid;
+			plan->globalIndexRel = rte->relid;
+			plan->globalIndexValue = (Expr *) copyObject(value);
+			break;
+		}
+	}
+
+	heap_close(rel, NoLock);
+}
+
+
+/*
+ * Put hashed aggregate removing duplicate rows on top of the subplan, if all
+ * the columns can be hashed, see distinct_semijoin_inner.
+ */
+static Plan *
+make_remote_distinct(PlannerInfo *root, Plan *subplan, double numGroups)
+{
+	int			numCols = list_length(subplan->targetlist);
+	AttrNumber *grpColIdx;
+	Oid		   *grpOperators;
+	ListCell   *lc;
+	int			i;
+
+	if (numCols == 0)
+		return subplan;
+
+	grpColIdx = (AttrNumber *) palloc(sizeof(AttrNumber) * numCols);
+	grpOperators = (Oid *) palloc(sizeof(Oid) * numCols);
+	i = 0;
+	foreach(lc, subplan->targetlist)
+	{
+		TargetEntry *tle = (TargetEntry *) lfirst(lc);
+		Oid			eqop;
+		bool		hashable;
+
+		get_sort_group_operators(exprType((Node *) tle->expr),
+								 false, false, false,
+								 NULL, &eqop, NULL, &hashable);
+		if (!OidIsValid(eqop) || !hashable)
+		{
+			pfree(grpColIdx);
+			pfree(grpOperators);
+			return subplan;
+		}
+		grpColIdx[i] = tle->resno;
+		grpOperators[i] = eqop;
+		i++;
+	}
+
+	return (Plan *) make_agg(root,
+							 subplan->targetlist,
+							 NIL,
+							 AGG_HASHED,
+							 NULL,
+							 numCols,
+							 grpColIdx,
+							 grpOperators,
+							 NIL,
+							 (long) Min(numGroups, (double) LONG_MAX),
+							 subplan);
+}
+
+
 static RemoteSubplan *
 find_push_down_plan_int(PlannerInfo *root, Plan *plan, bool force, Plan **parent)
 {
@@ -4048,12 +4306,17 @@ make_remotesubplan(PlannerInfo *root,
 		}
 		else
 			node->distributionRestrict = list_copy(node->distributionNodes);
+		/* Bucket map or ranges of the result, if distributed by those */
+		node->distributionBuckets = list_copy(resultDistribution->buckets);
+		node->distributionRanges = list_copy(resultDistribution->ranges);
 	}
 	else
 	{
 		node->distributionType = LOCATOR_TYPE_NONE;
 		node->distributionKey = InvalidAttrNumber;
 		node->distributionNodes = NIL;
+		node->distributionBuckets = NIL;
+		node->distributionRanges = NIL;
 	}
 
 	/* determine where subplan will be executed */
@@ -4293,6 +4556,9 @@ make_remotesubplan(PlannerInfo *root,
 
 	node->cursor = get_internal_cursor();
 	node->unique = 0;
+	node->adaptiveType = LOCATOR_TYPE_NONE;
+	node->adaptiveKey = InvalidAttrNumber;
+	node->adaptiveRows = 0;
 	return node;
 }
 #endif /* XCP */
@@ -5144,6 +5410,54 @@ make_sort_from_pathkeys(PlannerInfo *root, Plan *lefttree, List *pathkeys,
 					 nullsFirst, limit_tuples);
 }
 
+/*
+ * make_incremental_sort_from_pathkeys
+ *	  Create sort plan to sort according to given pathkeys, the input being
+ *	  already sorted by the first presortedKeys of them
+ *
+ *	  The Sort node is made incremental, unless it can not be found because
+ *	  it was pushed down into a remote subplan below other nodes. Returns
+ *	  the top node of the result, like make_sort does.
+ */
+Plan *
+make_incremental_sort_from_pathkeys(PlannerInfo *root, Plan *lefttree,
+									List *pathkeys, int presortedKeys,
+									double limit_tuples)
+{
+	Plan	   *result;
+	Plan	   *input;
+	Sort	   *sort;
+	Path		sort_path;		/* dummy for result of cost_incremental_sort */
+
+	Assert(presortedKeys > 0 && presortedKeys < list_length(pathkeys));
+
+	result = (Plan *) make_sort_from_pathkeys(root, lefttree, pathkeys,
+											  limit_tuples);
+#ifdef XCP
+	/* The sort may go below the remote subplan producing the input */
+	if (IsA(result, RemoteSubplan))
+		sort = (Sort *) result->lefttree;
+	else
+#endif
+		sort = (Sort *) result;
+
+	/* Columns of equal sort keys are merged, do not bother then */
+	if (!IsA(sort, Sort) || sort->numCols != list_length(pathkeys))
+		return result;
+
+	sort->numPresorted = presortedKeys;
+
+	input = sort->plan.lefttree;
+	cost_incremental_sort(&sort_path, root, pathkeys, presortedKeys,
+						  input->startup_cost, input->total_cost,
+						  input->plan_rows, input->plan_width,
+						  0.0, work_mem, limit_tuples);
+	sort->plan.startup_cost = sort_path.startup_cost;
+	sort->plan.total_cost = sort_path.total_cost;
+
+	return result;
+}
+
 /*
  * make_sort_from_sortclauses
  *	  Create sort plan to sort according to given sortclauses
@@ -5257,6 +5571,22 @@ make_material(Plan *lefttree)
 	return node;
 }
 
+static ResultCache *
+make_resultcache(Plan *lefttree, List *param_exprs)
+{
+	ResultCache *node = makeNode(ResultCache);
+	Plan	   *plan = &node->plan;
+
+	/* cost should be inserted by caller */
+	plan->targetlist = lefttree->targetlist;
+	plan->qual = NIL;
+	plan->lefttree = lefttree;
+	plan->righttree = NULL;
+	node->param_exprs = param_exprs;
+
+	return node;
+}
+
 /*
  * materialize_finished_plan: stick a Material node atop a completed plan
  *
@@ -5421,6 +5751,36 @@ find_referenced_cols_walker(Node *node, find_referenced_cols_context *context)
 	return expression_tree_walker(node, find_referenced_cols_walker,
 								  (void *) context);
 }
+
+
+/*
+ * If the rows are redistributed check the distribution key is one of the
+ * grouping columns, otherwise the first aggregation phase can not be done
+ * before the redistribution.
+ */
+static bool
+distribution_key_grouped(RemoteSubplan *pushdown, int numGroupCols,
+						 AttrNumber *grpColIdx)
+{
+	TargetEntry *keytle;
+	int			i;
+
+	if (pushdown->distributionKey == InvalidAttrNumber)
+		return true;
+
+	keytle = (TargetEntry *) list_nth(pushdown->scan.plan.targetlist,
+									  pushdown->distributionKey - 1);
+	for (i = 0; i < numGroupCols; i++)
+	{
+		TargetEntry *tle;
+
+		tle = (TargetEntry *) list_nth(pushdown->scan.plan.targetlist,
+									   grpColIdx[i] - 1);
+		if (equal(tle->expr, keytle->expr))
+			return true;
+	}
+	return false;
+}
 #endif
 
 
@@ -5512,7 +5872,8 @@ make_agg(PlannerInfo *root, List *tlist, List *qual,
 		context.subtlist = pushdown->scan.plan.targetlist;
 		context.newtlist = NIL;
 		if (find_referenced_cols_walker((Node *) tlist, &context) ||
-				find_referenced_cols_walker((Node *) qual, &context))
+				find_referenced_cols_walker((Node *) qual, &context) ||
+				!distribution_key_grouped(pushdown, numGroupCols, grpColIdx))
 		{
 			/*
 			 * We found we can not push down this aggregate, clean up and
@@ -5591,6 +5952,22 @@ make_agg(PlannerInfo *root, List *tlist, List *qual,
 				}
 			}
 
+			/*
+			 * If the pushdown plan redistributes the rows by a grouping
+			 * column update the distribution key index
+			 */
+			if (pushdown->distributionKey != InvalidAttrNumber)
+			{
+				TargetEntry *tle;
+				TargetEntry *newtle;
+
+				tle = (TargetEntry *) list_nth(context.subtlist,
+											   pushdown->distributionKey - 1);
+				newtle = tlist_member((Node *) tle->expr, context.newtlist);
+				Assert(newtle);
+				pushdown->distributionKey = newtle->resno;
+			}
+
 			copy_plan_costsize(plan1, (Plan *) pushdown); // ???
 
 			/*
@@ -5916,6 +6293,55 @@ make_lockrows(Plan *lefttree, List *rowMarks, int epqParam)
 	return node;
 }
 
+#ifdef XCP
+/*
+ * Can the LIMIT or OFFSET expression be evaluated on the remote nodes?
+ */
+static bool
+limit_push_down_expr(Node *expr)
+{
+	if (IsA(expr, Const))
+		return true;
+	return IsA(expr, Param) && ((Param *) expr)->paramkind == PARAM_EXTERN;
+}
+
+/*
+ * Find the RemoteSubplan whose rows can be limited on the remote side.
+ * The nodes between it and the Limit must not change the number or the order
+ * of the rows, except the Sort, which is returned in *sort so the caller can
+ * push a copy of it down along with the limit.
+ */
+static RemoteSubplan *
+find_limit_push_down_plan(Plan *plan, Sort **sort)
+{
+	*sort = NULL;
+	while (IsA(plan, Material))
+		plan = plan->lefttree;
+
+	if (IsA(plan, Sort))
+	{
+		RemoteSubplan *pushdown;
+
+		pushdown = find_limit_push_down_plan(plan->lefttree, sort);
+		/* Sort columns must refer to the same columns below */
+		if (pushdown == NULL || *sort != NULL ||
+				!tlist_same_exprs(pushdown->scan.plan.targetlist,
+								  pushdown->scan.plan.lefttree->targetlist))
+		{
+			*sort = NULL;
+			return NULL;
+		}
+		*sort = (Sort *) plan;
+		return pushdown;
+	}
+
+	if (IsA(plan, RemoteSubplan))
+		return (RemoteSubplan *) plan;
+
+	return NULL;
+}
+#endif
+
 /*
  * Note: offset_est and count_est are passed in to save having to repeat
  * work already done to estimate the values of the limitOffset and limitCount
@@ -5992,32 +6418,49 @@ make_limit(Plan *lefttree, Node *limitOffset, Node *limitCount,
 
 #ifdef XCP
 	/*
-	 * We want to push down LIMTI clause to the remote side in order to limit
+	 * We want to push down LIMIT clause to the remote side in order to limit
 	 * the number of rows that get shipped from the remote side. This can be
 	 * done even if there is an ORDER BY clause, as long as we fetch minimum
 	 * number of rows from all the nodes and then do a local sort and apply the
-	 * final limit.
+	 * final limit. If the sort is done locally, because it was not pushed
+	 * down, push down a copy of it along with the limit, so every node sends
+	 * its top rows only.
 	 *
-	 * We can't push down limit clause unless its a constant. Similarly, if the
-	 * OFFSET is specified then it must be a constant too.
+	 * We can't push down limit clause unless its a constant or an external
+	 * parameter, which is sent to the remote nodes. Similarly for the
+	 * OFFSET, the remote nodes are limited to OFFSET + LIMIT rows.
 	 *
 	 * Simple expressions get folded into constants by the time we come here.
 	 * So this works well in case of constant expressions such as
 	 * 	SELECT .. LIMIT (1024 * 1024);
 	 */
-	if (limitCount && IsA(limitCount, Const) &&
-		((limitOffset == NULL) || IsA(limitOffset, Const)))
+	if (limit_push_down_expr(limitCount) &&
+		!(IsA(limitCount, Const) && ((Const *) limitCount)->constisnull) &&
+		(limitOffset == NULL || limit_push_down_expr(limitOffset)))
 	{
+		Sort	   *sort = NULL;
+
 		/*
 		 * We may reduce amount of rows sent over the network and do not send more
 		 * rows then necessary
 		 */
-		pushdown = find_push_down_plan(lefttree, true);
+		pushdown = find_limit_push_down_plan(lefttree, &sort);
 		if (pushdown)
 		{
 			Limit	   *node1 = makeNode(Limit);
 			Plan	   *plan1 = &node1->plan;
 
+			if (sort)
+			{
+				Sort	   *sort1 = makeNode(Sort);
+
+				memcpy(sort1, sort, sizeof(Sort));
+				sort1->plan.targetlist = pushdown->scan.plan.lefttree->targetlist;
+				sort1->plan.lefttree = pushdown->scan.plan.lefttree;
+				sort1->plan.initPlan = NIL;
+				pushdown->scan.plan.lefttree = (Plan *) sort1;
+			}
+
 			copy_plan_costsize(plan1, pushdown->scan.plan.lefttree);
 			plan1->targetlist = pushdown->scan.plan.lefttree->targetlist;
 			plan1->qual = NIL;
@@ -6026,11 +6469,22 @@ make_limit(Plan *lefttree, Node *limitOffset, Node *limitCount,
 			plan1->righttree = NULL;
 
 			node1->limitOffset = NULL;
-			node1->limitCount = (Node *) makeConst(INT8OID, -1,
-												   InvalidOid,
-												   sizeof(int64),
+			if (IsA(limitCount, Const) &&
+				(limitOffset == NULL || IsA(limitOffset, Const)))
+				node1->limitCount = (Node *) makeConst(INT8OID, -1,
+													   InvalidOid,
+													   sizeof(int64),
 									   Int64GetDatum(offset_est + count_est),
-												   false, FLOAT8PASSBYVAL);
+													   false, FLOAT8PASSBYVAL);
+			else if (limitOffset == NULL)
+				node1->limitCount = copyObject(limitCount);
+			else
+				node1->limitCount = (Node *)
+					makeFuncExpr(F_INT8PL, INT8OID,
+								 list_make2(copyObject(limitOffset),
+											copyObject(limitCount)),
+								 InvalidOid, InvalidOid,
+								 COERCE_EXPLICIT_CALL);
 		}
 	}
 #endif
@@ -6310,6 +6764,7 @@ is_projection_capable_plan(Plan *plan)
 	{
 		case T_Hash:
 		case T_Material:
+		case T_ResultCache:
 		case T_Sort:
 		case T_Unique:
 		case T_SetOp:
@@ -50,9 +50,14 @@
 #include "rewrite/rewriteManip.h"
 #include "utils/rel.h"
 #ifdef PGXC
+#include "catalog/pg_aggregate.h"
 #include "commands/prepare.h"
+#include "parser/parse_oper.h"
+#include "pgxc/locator.h"
 #include "pgxc/pgxc.h"
 #include "pgxc/planner.h"
+#include "pgxc/resultcache.h"
+#include "utils/syscache.h"
 #endif
 #include "utils/selfuncs.h"
 
@@ -133,9 +138,21 @@ static void get_column_info_for_window(PlannerInfo *root, WindowClause *wc,
 						   AttrNumber **ordColIdx,
 						   Oid **ordOperators);
 #ifdef XCP
+static bool grouping_preserves_distribution(Plan *plan,
+								int numGroupCols, AttrNumber *groupColIdx,
+								Distribution *distribution);
 static Plan *grouping_distribution(PlannerInfo *root, Plan *plan,
 					  int numGroupCols, AttrNumber *groupColIdx,
 					  List *current_pathkeys, Distribution **distribution);
+static Distribution *grouping_key_distribution(Plan *plan,
+						  int numGroupCols, AttrNumber *groupColIdx,
+						  Distribution *distribution);
+static bool aggs_need_one_phase_walker(Node *node, void *context);
+static bool aggs_distinct_only_walker(Node *node, void *context);
+static Plan *grouping_redistribution(PlannerInfo *root, Plan *plan,
+						List *tlist, Node *havingQual,
+						int numGroupCols, AttrNumber *groupColIdx,
+						List *pathkeys, Distribution **distribution);
 static bool equal_distributions(PlannerInfo *root, Distribution *dst1,
 					Distribution *dst2);
 #endif
@@ -185,11 +202,15 @@ standard_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 	Plan	   *top_plan;
 	ListCell   *lp,
 			   *lr;
-
 #ifdef XCP
+	char	   *resultCacheKey;
+
 	if (IS_PGXC_LOCAL_COORDINATOR && parse->utilityStmt &&
 			IsA(parse->utilityStmt, RemoteQuery))
 		return pgxc_direct_planner(parse, cursorOptions, boundParams);
+
+	/* Must be taken before the query is modified by the planner */
+	resultCacheKey = ResultCacheQueryKey(parse);
 #endif
 
 	/* Cursor options may come from caller or from DECLARE CURSOR stmt */
@@ -285,6 +306,17 @@ standard_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 		lfirst(lp) = set_plan_references(subroot, subplan);
 	}
 
+#ifdef XCP
+	/*
+	 * The result of the query may be taken from the result cache if it is
+	 * entirely computed by the Datanodes, without values from the
+	 * Coordinator.
+	 */
+	if (resultCacheKey && IsA(top_plan, RemoteSubplan) &&
+			bms_is_empty(top_plan->allParam) && !glob->hasRowSecurity)
+		((RemoteSubplan *) top_plan)->resultCacheKey = resultCacheKey;
+#endif
+
 	/* build the PlannedStmt result */
 	result = makeNode(PlannedStmt);
 
@@ -1502,6 +1534,7 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 		Path	   *cheapest_path;
 		Path	   *sorted_path;
 		Path	   *best_path;
+		bool		incremental_sort;
 
 		MemSet(&agg_costs, 0, sizeof(AggClauseCosts));
 
@@ -1839,7 +1872,19 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 		 * not grouping/aggregating, so use root->limit_tuples in the
 		 * cost_sort call.
 		 */
-		if (sorted_path)
+		/*
+		 * If the only ordering needed is that of the final ORDER BY, the
+		 * explicit sort is made incremental when the path is sorted by a
+		 * prefix of the pathkeys, so such paths are worth considering too.
+		 */
+		incremental_sort = enable_incremental_sort &&
+			root->query_pathkeys != NIL &&
+			root->query_pathkeys == root->sort_pathkeys &&
+			!parse->groupClause && !parse->groupingSets &&
+			!parse->hasAggs && !root->hasHavingQual &&
+			!parse->hasWindowFuncs && !parse->distinctClause;
+
+		if (sorted_path || incremental_sort)
 		{
 			Path		sort_path;		/* dummy for result of cost_sort */
 
@@ -1860,12 +1905,56 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 						  0.0, work_mem, root->limit_tuples);
 			}
 
-			if (compare_fractional_path_costs(sorted_path, &sort_path,
+			if (sorted_path &&
+				compare_fractional_path_costs(sorted_path, &sort_path,
 											  tuple_fraction) > 0)
 			{
 				/* Presorted path is a loser */
 				sorted_path = NULL;
 			}
+
+			if (incremental_sort)
+			{
+				ListCell   *lc;
+
+				/* Beat the best of the above, if any path can */
+				if (sorted_path)
+				{
+					sort_path.startup_cost = sorted_path->startup_cost;
+					sort_path.total_cost = sorted_path->total_cost;
+				}
+
+				foreach(lc, final_rel->pathlist)
+				{
+					Path	   *path = (Path *) lfirst(lc);
+					Path		incr_path;	/* dummy for the incremental sort */
+					int			presorted;
+
+					if (path->param_info != NULL ||
+						pathkeys_count_contained_in(root->query_pathkeys,
+													path->pathkeys,
+													&presorted) ||
+						presorted == 0)
+						continue;
+
+					cost_incremental_sort(&incr_path, root,
+										  root->query_pathkeys, presorted,
+										  path->startup_cost,
+										  path->total_cost,
+										  path_rows, path_width,
+										  0.0, work_mem, root->limit_tuples);
+					if (compare_fractional_path_costs(&incr_path, &sort_path,
+													  tuple_fraction) < 0)
+					{
+						sorted_path = path;
+						sort_path.startup_cost = incr_path.startup_cost;
+						sort_path.total_cost = incr_path.total_cost;
+					}
+				}
+
+				if (sorted_path == cheapest_path)
+					sorted_path = NULL;
+			}
 		}
 
 		/*
@@ -2059,6 +2148,13 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 			if (use_hashed_grouping)
 			{
 #ifdef XCP
+				result_plan = grouping_redistribution(root, result_plan,
+													  tlist,
+													  parse->havingQual,
+													  numGroupCols,
+													  groupColIdx,
+													  NIL,
+													  &distribution);
 				result_plan = grouping_distribution(root, result_plan,
 													numGroupCols, groupColIdx,
 													current_pathkeys,
@@ -2081,6 +2177,17 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 			}
 			else if (parse->hasAggs || (parse->groupingSets && parse->groupClause))
 			{
+#ifdef XCP
+				if (parse->groupingSets == NIL)
+					result_plan = grouping_redistribution(root, result_plan,
+														  tlist,
+														  parse->havingQual,
+														  numGroupCols,
+														  groupColIdx,
+											need_sort_for_grouping ? NIL :
+														  current_pathkeys,
+														  &distribution);
+#endif
 				/*
 				 * Output is in sorted order by group_pathkeys if, and only
 				 * if, there is a single rollup operation on a non-empty list
@@ -2515,12 +2622,23 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 	 */
 	if (parse->sortClause)
 	{
-		if (!pathkeys_contained_in(root->sort_pathkeys, current_pathkeys))
+		int			presorted;
+
+		if (!pathkeys_count_contained_in(root->sort_pathkeys,
+										 current_pathkeys, &presorted))
 		{
-			result_plan = (Plan *) make_sort_from_pathkeys(root,
-														   result_plan,
+			/* Only sort groups of rows if sorted by a prefix already */
+			if (enable_incremental_sort && presorted > 0)
+				result_plan = make_incremental_sort_from_pathkeys(root,
+																  result_plan,
+														 root->sort_pathkeys,
+																  presorted,
+																limit_tuples);
+			else
+				result_plan = (Plan *) make_sort_from_pathkeys(root,
+															   result_plan,
 														 root->sort_pathkeys,
-														   limit_tuples);
+															   limit_tuples);
 			current_pathkeys = root->sort_pathkeys;
 		}
 	}
@@ -2610,9 +2728,10 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 			 * RemoteSubquery node supplies RemoteTuples, without such field.
 			 * Therefore we can not execute such plan.
 			 * Most common case is when UPDATE statement modifies the
-			 * distribution column. Also incorrect distributed plan is possible
-			 * if planning a complex UPDATE or DELETE statement involving table
-			 * join.
+			 * distribution column. Joins keep the rows of the target table
+			 * on their nodes if they can, see set_joinpath_distribution, but
+			 * incorrect distributed plan is still possible if planning a
+			 * complex UPDATE or DELETE statement involving table join.
 			 * We output different error messages in UPDATE and DELETE cases
 			 * mostly for compatibility with PostgresXC. It is hard to determine
 			 * here, if such plan is because updated partitioning key or poorly
@@ -2703,6 +2822,10 @@ grouping_planner(PlannerInfo *root, double tuple_fraction)
 					distributePlan->distributionNodes = lappend_int(
 							distributePlan->distributionNodes, nodenum);
 				bms_free(tmpset);
+				distributePlan->distributionBuckets =
+						list_copy(root->distribution->buckets);
+				distributePlan->distributionRanges =
+						list_copy(root->distribution->ranges);
 			}
 			else
 				result_plan = (Plan *) make_remotesubplan(root,
@@ -3981,8 +4104,8 @@ choose_hashed_grouping(PlannerInfo *root,
 		return false;
 
 	/*
-	 * Don't do it if it doesn't look like the hashtable will fit into
-	 * work_mem.
+	 * Estimate the size of the hashtable; the part of it that doesn't fit
+	 * into work_mem spills to disk, which is costed below.
 	 */
 
 	/* Estimate per-hash-entry space at tuple width... */
@@ -3992,9 +4115,6 @@ choose_hashed_grouping(PlannerInfo *root,
 	/* plus the per-hash-entry overhead */
 	hashentrysize += hash_agg_entry_size(agg_costs->numAggs);
 
-	if (hashentrysize * dNumGroups > work_mem * 1024L)
-		return false;
-
 	/*
 	 * When we have both GROUP BY and DISTINCT, use the more-rigorous of
 	 * DISTINCT and ORDER BY as the assumed required output sort order. This
@@ -4028,6 +4148,8 @@ choose_hashed_grouping(PlannerInfo *root,
 			 numGroupCols, dNumGroups,
 			 cheapest_path->startup_cost, cheapest_path->total_cost,
 			 path_rows);
+	cost_hashagg_spill(&hashed_p, dNumGroups, hashentrysize,
+					   path_rows, path_width);
 	/* Result of hashed agg is always unsorted */
 	if (target_pathkeys)
 		cost_sort(&hashed_p, root, target_pathkeys, hashed_p.total_cost,
@@ -4149,8 +4271,8 @@ choose_hashed_distinct(PlannerInfo *root,
 		return false;
 
 	/*
-	 * Don't do it if it doesn't look like the hashtable will fit into
-	 * work_mem.
+	 * Estimate the size of the hashtable; the part of it that doesn't fit
+	 * into work_mem spills to disk, which is costed below.
 	 */
 
 	/* Estimate per-hash-entry space at tuple width... */
@@ -4158,9 +4280,6 @@ choose_hashed_distinct(PlannerInfo *root,
 	/* plus the per-hash-entry overhead */
 	hashentrysize += hash_agg_entry_size(0);
 
-	if (hashentrysize * dNumDistinctRows > work_mem * 1024L)
-		return false;
-
 	/*
 	 * See if the estimated cost is no more than doing it the other way. While
 	 * avoiding the need for sorted input is usually a win, the fact that the
@@ -4178,6 +4297,8 @@ choose_hashed_distinct(PlannerInfo *root,
 			 numDistinctCols, dNumDistinctRows,
 			 cheapest_startup_cost, cheapest_total_cost,
 			 path_rows);
+	cost_hashagg_spill(&hashed_p, dNumDistinctRows, hashentrysize,
+					   path_rows, path_width);
 
 	/*
 	 * Result of hashed agg is always unsorted, so if ORDER BY is present we
@@ -5024,37 +5145,286 @@ plan_cluster_use_sort(Oid tableOid, Oid indexOid)
 
 #ifdef XCP
 /*
- * Grouping preserves distribution if distribution key is the
- * first grouping key or if distribution is replicated.
- * In these cases aggregation is fully pushed down to nodes.
- * Otherwise we need 2-phase aggregation so put remote subplan
+ * Grouping preserves distribution if distribution key is one of the
+ * grouping keys or if distribution is replicated.
+ */
+static bool
+grouping_preserves_distribution(Plan *plan,
+								int numGroupCols, AttrNumber *groupColIdx,
+								Distribution *distribution)
+{
+	int			i;
+
+	if (distribution == NULL ||
+			IsLocatorReplicated(distribution->distributionType))
+		return true;
+
+	if (distribution->distributionExpr == NULL)
+		return false;
+
+	for (i = 0; i < numGroupCols; i++)
+	{
+		TargetEntry *tle = (TargetEntry *) list_nth(plan->targetlist,
+													groupColIdx[i] - 1);
+
+		if (equal(tle->expr, distribution->distributionExpr))
+			return true;
+	}
+	return false;
+}
+
+
+/*
+ * If grouping preserves distribution aggregation is fully pushed down to
+ * nodes. Otherwise we need 2-phase aggregation so put remote subplan
  * on top of the result_plan. When adding result agg on top of
  * RemoteSubplan first aggregation phase will be pushed down
  * automatically.
+ * The rows of the subquery of INSERT ... SELECT are going to be sent to the
+ * Datanodes anyway, so rather than bringing them here they are redistributed
+ * by a grouping column, and the grouping is completed on all the nodes.
  */
 static Plan *
 grouping_distribution(PlannerInfo *root, Plan *plan,
 					  int numGroupCols, AttrNumber *groupColIdx,
 					  List *current_pathkeys, Distribution **distribution)
 {
-	if (*distribution &&
-			!IsLocatorReplicated((*distribution)->distributionType) &&
-			(numGroupCols == 0 ||
-					(*distribution)->distributionExpr == NULL ||
-					!equal(((TargetEntry *)list_nth(plan->targetlist, groupColIdx[0]-1))->expr,
-						   (*distribution)->distributionExpr)))
+	if (!grouping_preserves_distribution(plan, numGroupCols, groupColIdx,
+										 *distribution))
 	{
 		Plan *result_plan;
-		result_plan = (Plan *) make_remotesubplan(root, plan, NULL,
+		Distribution *newdist = NULL;
+
+		if (numGroupCols > 0 && root->parse->groupingSets == NIL &&
+				root->parent_root &&
+				root->parent_root->parse->commandType == CMD_INSERT &&
+				root->parent_root->distribution)
+			newdist = grouping_key_distribution(plan, numGroupCols,
+												groupColIdx, *distribution);
+		result_plan = (Plan *) make_remotesubplan(root, plan, newdist,
 												  *distribution,
 												  current_pathkeys);
-		*distribution = NULL;
+		*distribution = newdist;
 		return result_plan;
 	}
 	return plan;
 }
 
 
+/*
+ * Hash distribution of the rows by a grouping column over the nodes of the
+ * current distribution, NULL if no grouping column can be hashed.
+ */
+static Distribution *
+grouping_key_distribution(Plan *plan,
+						  int numGroupCols, AttrNumber *groupColIdx,
+						  Distribution *distribution)
+{
+	Distribution *newdist;
+	int			i;
+
+	for (i = 0; i < numGroupCols; i++)
+	{
+		TargetEntry *tle = (TargetEntry *) list_nth(plan->targetlist,
+													groupColIdx[i] - 1);
+
+		if (IsTypeHashDistributable(exprType((Node *) tle->expr)) &&
+				!contain_volatile_functions((Node *) tle->expr))
+		{
+			newdist = makeNode(Distribution);
+			newdist->distributionType = LOCATOR_TYPE_HASH;
+			newdist->nodes = bms_copy(distribution->nodes);
+			newdist->restrictNodes = NULL;
+			newdist->distributionExpr = (Node *) tle->expr;
+			return newdist;
+		}
+	}
+	return NULL;
+}
+
+
+/*
+ * Find an aggregate which can not be split into the transition phase on the
+ * nodes and the final phase on top of them: aggregates with DISTINCT or
+ * ORDER BY, ordered-set aggregates and aggregates without collection
+ * function.
+ */
+static bool
+aggs_need_one_phase_walker(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Aggref))
+	{
+		Aggref	   *aggref = (Aggref *) node;
+		HeapTuple	aggTuple;
+		Form_pg_aggregate aggform;
+		bool		result;
+
+		if (aggref->aggdistinct || aggref->aggorder ||
+				aggref->aggkind != AGGKIND_NORMAL)
+			return true;
+
+		aggTuple = SearchSysCache1(AGGFNOID,
+								   ObjectIdGetDatum(aggref->aggfnoid));
+		if (!HeapTupleIsValid(aggTuple))
+			elog(ERROR, "cache lookup failed for aggregate %u",
+				 aggref->aggfnoid);
+		aggform = (Form_pg_aggregate) GETSTRUCT(aggTuple);
+		result = !OidIsValid(aggform->aggcollectfn);
+		ReleaseSysCache(aggTuple);
+		return result;
+	}
+	return expression_tree_walker(node, aggs_need_one_phase_walker, context);
+}
+
+
+/*
+ * Find an aggregate which is not a plain aggregate with DISTINCT.
+ */
+static bool
+aggs_distinct_only_walker(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Aggref))
+	{
+		Aggref	   *aggref = (Aggref *) node;
+
+		return aggref->aggdistinct == NIL ||
+				aggref->aggkind != AGGKIND_NORMAL;
+	}
+	return expression_tree_walker(node, aggs_distinct_only_walker, context);
+}
+
+
+/*
+ * If some aggregates can not be computed in two phases grouping_distribution
+ * brings all the rows to a single node. Avoid that when we can:
+ * - if there are grouping columns redistribute the rows by one of them, so
+ * every group is on a single node, and the aggregation can be completed on
+ * all the nodes in parallel;
+ * - if there are no grouping columns and all the aggregates are DISTINCT,
+ * duplicate rows do not make any difference for them. Redistribute the rows
+ * so the duplicates are on the same node and remove them there. Only the
+ * distinct rows are sent to the final aggregation.
+ * The pathkeys are the sort order of the plan to be preserved by
+ * redistribution. Returns the plan unchanged if none of that applies,
+ * otherwise the distribution is updated.
+ */
+static Plan *
+grouping_redistribution(PlannerInfo *root, Plan *plan,
+						List *tlist, Node *havingQual,
+						int numGroupCols, AttrNumber *groupColIdx,
+						List *pathkeys, Distribution **distribution)
+{
+	Distribution *newdist;
+	Expr	   *distexpr = NULL;
+	ListCell   *lc;
+	int			i;
+
+	/* Nothing to do if the rows are not on multiple nodes */
+	if (grouping_preserves_distribution(plan, numGroupCols, groupColIdx,
+										*distribution) ||
+			bms_num_members((*distribution)->nodes) < 2)
+		return plan;
+
+	/* Two-phase aggregation is fine */
+	if (!aggs_need_one_phase_walker((Node *) tlist, NULL) &&
+			!aggs_need_one_phase_walker(havingQual, NULL))
+		return plan;
+
+	newdist = makeNode(Distribution);
+	newdist->distributionType = LOCATOR_TYPE_HASH;
+	newdist->nodes = bms_copy((*distribution)->nodes);
+	newdist->restrictNodes = NULL;
+
+	if (numGroupCols > 0)
+	{
+		for (i = 0; i < numGroupCols; i++)
+		{
+			TargetEntry *tle = (TargetEntry *) list_nth(plan->targetlist,
+														groupColIdx[i] - 1);
+
+			if (IsTypeHashDistributable(exprType((Node *) tle->expr)) &&
+					!contain_volatile_functions((Node *) tle->expr))
+			{
+				distexpr = tle->expr;
+				break;
+			}
+		}
+		if (distexpr == NULL)
+			return plan;
+
+		newdist->distributionExpr = (Node *) distexpr;
+		plan = (Plan *) make_remotesubplan(root, plan, newdist, *distribution,
+										   pathkeys);
+	}
+	else
+	{
+		int			numCols = list_length(plan->targetlist);
+		AttrNumber *grpColIdx;
+		Oid		   *grpOperators;
+		List	   *groupExprs = NIL;
+		double		numGroups;
+
+		if (aggs_distinct_only_walker((Node *) tlist, NULL) ||
+				aggs_distinct_only_walker(havingQual, NULL))
+			return plan;
+
+		grpColIdx = (AttrNumber *) palloc(sizeof(AttrNumber) * numCols);
+		grpOperators = (Oid *) palloc(sizeof(Oid) * numCols);
+		i = 0;
+		foreach(lc, plan->targetlist)
+		{
+			TargetEntry *tle = (TargetEntry *) lfirst(lc);
+			Oid			restype = exprType((Node *) tle->expr);
+			Oid			eqop;
+			bool		hashable;
+
+			get_sort_group_operators(restype, false, false, false,
+									 NULL, &eqop, NULL, &hashable);
+			if (!OidIsValid(eqop) || !hashable)
+				return plan;
+
+			if (distexpr == NULL && IsTypeHashDistributable(restype))
+				distexpr = tle->expr;
+
+			grpColIdx[i] = tle->resno;
+			grpOperators[i] = eqop;
+			groupExprs = lappend(groupExprs, tle->expr);
+			i++;
+		}
+		if (distexpr == NULL)
+			return plan;
+
+		/* Not worth it if duplicates are rare */
+		numGroups = estimate_num_groups(root, groupExprs, plan->plan_rows,
+										NULL);
+		if (numGroups > plan->plan_rows / 2)
+			return plan;
+
+		newdist->distributionExpr = (Node *) distexpr;
+		plan = (Plan *) make_remotesubplan(root, plan, newdist, *distribution,
+										   NIL);
+		plan = (Plan *) make_agg(root,
+								 plan->targetlist,
+								 NIL,
+								 AGG_HASHED,
+								 NULL,
+								 numCols,
+								 grpColIdx,
+								 grpOperators,
+								 NIL,
+								 (long) Min(numGroups, (double) LONG_MAX),
+								 plan);
+	}
+
+	*distribution = newdist;
+	return plan;
+}
+
+
 /*
  * Check if two distributions are equal.
  * Distributions are considered equal if they are of the same type, on the same
@@ -5079,6 +5449,12 @@ equal_distributions(PlannerInfo *root, Distribution *dst1,
 	if (!bms_equal(dst1->nodes, dst2->nodes))
 		return false;
 
+	if (!equal(dst1->buckets, dst2->buckets))
+		return false;
+
+	if (!equal(dst1->ranges, dst2->ranges))
+		return false;
+
 	if (equal(dst1->distributionExpr, dst2->distributionExpr))
 		return true;
 
@@ -5098,7 +5474,24 @@ equal_distributions(PlannerInfo *root, Distribution *dst1,
 	if (exprs_known_equal(root, dst1->distributionExpr, dst2->distributionExpr))
 		return true;
 
-	/* The restrictNodes field does not matter for distribution equality */
-	return false;
+	/* Keys combining several columns are equal if all the columns are */
+	{
+		List	   *cols1 = GetDistributionKeyColumns(dst1->distributionExpr);
+		List	   *cols2 = GetDistributionKeyColumns(dst2->distributionExpr);
+		ListCell   *lc1;
+		ListCell   *lc2;
+
+		if (cols1 == NIL || list_length(cols1) != list_length(cols2))
+			return false;
+		forboth(lc1, cols1, lc2, cols2)
+		{
+			if (exprType((Node *) lfirst(lc1)) != exprType((Node *) lfirst(lc2)) ||
+					(!equal(lfirst(lc1), lfirst(lc2)) &&
+					 !exprs_known_equal(root, (Node *) lfirst(lc1),
+										(Node *) lfirst(lc2))))
+				return false;
+		}
+		return true;
+	}
 }
 #endif
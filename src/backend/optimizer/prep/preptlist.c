@@ -106,6 +106,8 @@ preprocess_targetlist(PlannerInfo *root, List *tlist)
 				distribution->nodes = bms_add_member(distribution->nodes,
 													 lfirst_int(lc));
 			distribution->restrictNodes = NULL;
+			distribution->buckets = list_copy(rel_loc_info->buckets);
+			distribution->ranges = list_copy(rel_loc_info->ranges);
 			if (rel_loc_info->partAttrNum)
 			{
 				/*
@@ -115,10 +117,28 @@ preprocess_targetlist(PlannerInfo *root, List *tlist)
 				if (command_type == CMD_INSERT || command_type == CMD_UPDATE)
 				{
 					TargetEntry *keyTle;
-					keyTle = (TargetEntry *) list_nth(tlist,
-											  rel_loc_info->partAttrNum - 1);
 
-					distribution->distributionExpr = (Node *) keyTle->expr;
+					if (rel_loc_info->partAttrNums)
+					{
+						List	   *keyexprs = NIL;
+
+						/* The key combines the values of the columns */
+						foreach(lc, rel_loc_info->partAttrNums)
+						{
+							keyTle = (TargetEntry *) list_nth(tlist,
+													  lfirst_int(lc) - 1);
+							keyexprs = lappend(keyexprs, keyTle->expr);
+						}
+						distribution->distributionExpr =
+								MakeDistributionKeyExpr(keyexprs);
+					}
+					else
+					{
+						keyTle = (TargetEntry *) list_nth(tlist,
+												  rel_loc_info->partAttrNum - 1);
+
+						distribution->distributionExpr = (Node *) keyTle->expr;
+					}
 
 					/*
 					 * We can restrict the distribution if the expression
@@ -135,33 +155,23 @@ preprocess_targetlist(PlannerInfo *root, List *tlist)
 						if (IsA(constExpr, Const) &&
 								constExpr->consttype == keytype)
 						{
-							List 	   *nodeList = NIL;
-							Bitmapset  *tmpset = bms_copy(distribution->nodes);
 							Bitmapset  *restrictinfo = NULL;
 							Locator    *locator;
 							int		   *nodenums;
 							int 		i, count;
 
-							while((i = bms_first_member(tmpset)) >= 0)
-								nodeList = lappend_int(nodeList, i);
-							bms_free(tmpset);
-
-							locator = createLocator(distribution->distributionType,
-													RELATION_ACCESS_INSERT,
-													keytype,
-													LOCATOR_LIST_LIST,
-													0,
-													(void *) nodeList,
-													(void **) &nodenums,
-													false);
+							/*
+							 * The distribution is the one of the relation,
+							 * so is its cached locator
+							 */
+							locator = GetRelationInsertLocator(rel, keytype);
 							count = GET_NODES(locator, constExpr->constvalue,
 											  constExpr->constisnull, NULL);
+							nodenums = (int *) getLocatorResults(locator);
 
 							for (i = 0; i < count; i++)
 								restrictinfo = bms_add_member(restrictinfo, nodenums[i]);
 							distribution->restrictNodes = restrictinfo;
-							list_free(nodeList);
-							freeLocator(locator);
 						}
 					}
 				}
@@ -173,21 +183,34 @@ preprocess_targetlist(PlannerInfo *root, List *tlist)
 				 */
 				if (command_type == CMD_DELETE)
 				{
-					Form_pg_attribute att_tup;
-					TargetEntry *tle;
-					Var		   *var;
-
-					att_tup = rel->rd_att->attrs[rel_loc_info->partAttrNum - 1];
-					var = makeVar(result_relation, rel_loc_info->partAttrNum,
-								  att_tup->atttypid, att_tup->atttypmod,
-								  att_tup->attcollation, 0);
-
-					tle = makeTargetEntry((Expr *) var,
-										  list_length(tlist) + 1,
-										  pstrdup(NameStr(att_tup->attname)),
-										  true);
-					tlist = lappend(tlist, tle);
-					distribution->distributionExpr = (Node *) var;
+					List	   *keycols = rel_loc_info->partAttrNums;
+					List	   *vars = NIL;
+
+					if (keycols == NIL)
+						keycols = list_make1_int(rel_loc_info->partAttrNum);
+					foreach(lc, keycols)
+					{
+						Form_pg_attribute att_tup;
+						TargetEntry *tle;
+						Var		   *var;
+
+						att_tup = rel->rd_att->attrs[lfirst_int(lc) - 1];
+						var = makeVar(result_relation, lfirst_int(lc),
+									  att_tup->atttypid, att_tup->atttypmod,
+									  att_tup->attcollation, 0);
+
+						tle = makeTargetEntry((Expr *) var,
+											  list_length(tlist) + 1,
+											  pstrdup(NameStr(att_tup->attname)),
+											  true);
+						tlist = lappend(tlist, tle);
+						vars = lappend(vars, var);
+					}
+					if (list_length(vars) > 1)
+						distribution->distributionExpr =
+								MakeDistributionKeyExpr(vars);
+					else
+						distribution->distributionExpr = (Node *) linitial(vars);
 				}
 			}
 			else
@@ -35,11 +35,16 @@
 #include "utils/selfuncs.h"
 #ifdef XCP
 #include "access/heapam.h"
+#include "access/stratnum.h"
+#include "catalog/pg_type.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
+#include "parser/parse_coerce.h"
+#include "parser/parse_oper.h"
 #include "pgxc/locator.h"
 #include "pgxc/nodemgr.h"
 #include "utils/rel.h"
+#include "utils/typcache.h"
 #endif
 
 
@@ -59,14 +64,55 @@ typedef enum
 #define STD_FUZZ_FACTOR 1.01
 
 static List *translate_sub_tlist(List *tlist, int relid);
+static NestPath *cache_nestloop_inner(PlannerInfo *root, NestPath *pathnode,
+					 SpecialJoinInfo *sjinfo,
+					 SemiAntiJoinFactors *semifactors);
 #ifdef XCP
+/*
+ * Nodes storing rows with the given value of the distribution key, see
+ * distribution_value_nodes
+ */
+typedef struct DistributionValueNodes
+{
+	char		distributionType;
+	Oid			keytype;
+	Bitmapset  *nodes;			/* nodes of the distribution */
+	List	   *buckets;		/* bucket map of the distribution */
+	List	   *ranges;			/* split points of the distribution */
+	Const	   *value;			/* value of the key */
+	Bitmapset  *result;			/* nodes where the value may be found */
+} DistributionValueNodes;
+
 static void restrict_distribution(PlannerInfo *root, RestrictInfo *ri,
-								  Path *pathnode);
-static Path *redistribute_path(Path *subpath, char distributionType,
+					  Distribution *distribution);
+static bool restrict_range_distribution(PlannerInfo *root, RestrictInfo *ri,
+							Distribution *distribution);
+static void restrict_key_distribution(PlannerInfo *root, List *restrictinfo,
+						  Distribution *distribution);
+static void restrict_tenant_distribution(PlannerInfo *root, RelOptInfo *rel,
+							 Distribution *distribution);
+static Const *restriction_key_value(PlannerInfo *root, RestrictInfo *ri,
+					  Node *column);
+static Bitmapset *distribution_value_nodes(PlannerInfo *root,
+						 Distribution *distribution,
+						 Oid keytype, Const *value);
+static Path *redistribute_path(PlannerInfo *root, Path *subpath,
+				  char distributionType,
 				  Bitmapset *nodes, Bitmapset *restrictNodes,
 				  Node* distributionExpr);
-static void set_scanpath_distribution(PlannerInfo *root, RelOptInfo *rel, Path *pathnode);
+static void set_scanpath_distribution(PlannerInfo *root, RelOptInfo *rel,
+						  Path *pathnode, bool restricted);
+static Distribution *make_scan_distribution(PlannerInfo *root,
+					   RelOptInfo *rel);
 static List *set_joinpath_distribution(PlannerInfo *root, JoinPath *pathnode);
+static bool distribution_keys_equivalent(PlannerInfo *root, Node *key1,
+							 Node *key2);
+static Expr *equijoin_partner(RestrictInfo *ri, Node *expr,
+				 Relids other_rels);
+static bool distribution_keys_joined(PlannerInfo *root, JoinPath *pathnode,
+						 List *restrictClauses);
+static List *distribution_key_join_exprs(Node *key, List *restrictClauses,
+							Relids other_rels);
 #endif
 
 /*****************************************************************************
@@ -718,9 +764,8 @@ add_path_precheck(RelOptInfo *parent_rel,
  */
 static void
 restrict_distribution(PlannerInfo *root, RestrictInfo *ri,
-								  Path *pathnode)
+					  Distribution *distribution)
 {
-	Distribution   *distribution = pathnode->distribution;
 	Oid				keytype;
 	Const		   *constExpr = NULL;
 	bool			found_key = false;
@@ -738,6 +783,11 @@ restrict_distribution(PlannerInfo *root, RestrictInfo *ri,
 	if (ri->orclause)
 		return;
 
+	/* Ranges of values are stored on known nodes */
+	if (distribution->distributionType == LOCATOR_TYPE_RANGE &&
+			restrict_range_distribution(root, ri, distribution))
+		return;
+
 	/*
 	 * Check if the operator is hash joinable. Currently we only support hash
 	 * joinable operator for arriving at restricted nodes. This allows us
@@ -829,99 +879,456 @@ restrict_distribution(PlannerInfo *root, RestrictInfo *ri,
 	}
 	if (found_key && constExpr)
 	{
-		List 	   *nodeList = NIL;
-		Bitmapset  *tmpset = bms_copy(distribution->nodes);
-		Bitmapset  *restrictinfo = NULL;
-		Locator    *locator;
-		int		   *nodenums;
-		int 		i, count;
-
-		while((i = bms_first_member(tmpset)) >= 0)
-			nodeList = lappend_int(nodeList, i);
-		bms_free(tmpset);
-
-		locator = createLocator(distribution->distributionType,
-								RELATION_ACCESS_READ,
-								keytype,
-								LOCATOR_LIST_LIST,
-								0,
-								(void *) nodeList,
-								(void **) &nodenums,
-								false);
-		count = GET_NODES(locator, constExpr->constvalue,
-						  constExpr->constisnull, NULL);
-
-		for (i = 0; i < count; i++)
-			restrictinfo = bms_add_member(restrictinfo, nodenums[i]);
+		Bitmapset  *restrictinfo;
+
+		restrictinfo = distribution_value_nodes(root, distribution, keytype,
+												constExpr);
 		if (distribution->restrictNodes)
 			distribution->restrictNodes = bms_intersect(distribution->restrictNodes,
 														restrictinfo);
 		else
-			distribution->restrictNodes = restrictinfo;
-		list_free(nodeList);
-		freeLocator(locator);
+			distribution->restrictNodes = bms_copy(restrictinfo);
+	}
+}
+
+
+/*
+ * restriction_key_value
+ *    If the restriction equates the column to a constant return the constant,
+ *    coerced to the type of the column.
+ */
+static Const *
+restriction_key_value(PlannerInfo *root, RestrictInfo *ri, Node *column)
+{
+	OpExpr	   *opexpr = (OpExpr *) ri->clause;
+	Node	   *other;
+	Oid			coltype = exprType(column);
+
+	if (ri->pseudoconstant || ri->orclause || !is_opclause(opexpr) ||
+			list_length(opexpr->args) != 2 ||
+			!op_hashjoinable(opexpr->opno,
+							 exprType(linitial(opexpr->args))) ||
+			contain_volatile_functions((Node *) opexpr))
+		return NULL;
+
+	if (equal(linitial(opexpr->args), column))
+		other = (Node *) lsecond(opexpr->args);
+	else if (equal(lsecond(opexpr->args), column))
+		other = (Node *) linitial(opexpr->args);
+	else
+		return NULL;
+
+	if (exprType(other) != coltype)
+		other = coerce_to_target_type(NULL, other, exprType(other),
+									  coltype, -1, COERCION_IMPLICIT,
+									  COERCE_IMPLICIT_CAST, -1);
+	if (other == NULL)
+		return NULL;
+	other = eval_const_expressions(root, other);
+	if (!IsA(other, Const) || ((Const *) other)->constisnull)
+		return NULL;
+	return (Const *) other;
+}
+
+
+/*
+ * restrict_key_distribution
+ *    Restrict the nodes of a distribution by a key combining several columns
+ *    to those storing the rows where every column of the key is equal to a
+ *    constant. The key value is computed from the constants the same way it
+ *    is computed from the columns.
+ */
+static void
+restrict_key_distribution(PlannerInfo *root, List *restrictinfo,
+						  Distribution *distribution)
+{
+	List	   *columns;
+	List	   *values = NIL;
+	ListCell   *lc;
+	Node	   *key;
+	Bitmapset  *nodes;
+
+	if (distribution == NULL)
+		return;
+	columns = GetDistributionKeyColumns(distribution->distributionExpr);
+	if (columns == NIL)
+		return;
+
+	foreach(lc, columns)
+	{
+		Const	   *value = NULL;
+		ListCell   *rlc;
+
+		foreach(rlc, restrictinfo)
+		{
+			value = restriction_key_value(root, (RestrictInfo *) lfirst(rlc),
+										  (Node *) lfirst(lc));
+			if (value)
+				break;
+		}
+		/* All the columns have to be known */
+		if (value == NULL)
+			return;
+		values = lappend(values, value);
+	}
+
+	key = eval_const_expressions(root, MakeDistributionKeyExpr(values));
+	if (!IsA(key, Const))
+		return;
+
+	nodes = distribution_value_nodes(root, distribution, INT4OID,
+									 (Const *) key);
+	if (distribution->restrictNodes)
+		distribution->restrictNodes = bms_intersect(distribution->restrictNodes,
+													nodes);
+	else
+		distribution->restrictNodes = bms_copy(nodes);
+}
+
+
+/*
+ * restrict_tenant_distribution
+ *    If the session works for a tenant, restrict the nodes of a relation
+ *    distributed by the tenant column to those storing the rows of the
+ *    tenant, as if the query compared the column to the tenant key. The
+ *    session is trusted to only look at the rows of its tenant, a query on
+ *    other rows of the relation does not see them.
+ */
+static void
+restrict_tenant_distribution(PlannerInfo *root, RelOptInfo *rel,
+							 Distribution *distribution)
+{
+	Var		   *var;
+	RangeTblEntry *rte;
+	char	   *attname;
+	Oid			typinput;
+	Oid			typioparam;
+	int16		typlen;
+	bool		typbyval;
+	Datum		value;
+	Const	   *key;
+	Bitmapset  *nodes;
+
+	if (TenantId == NULL || TenantId[0] == '\0' ||
+			TenantColumn == NULL || TenantColumn[0] == '\0' ||
+			distribution == NULL ||
+			!IsLocatorDistributedByValue(distribution->distributionType) ||
+			distribution->distributionExpr == NULL ||
+			!IsA(distribution->distributionExpr, Var))
+		return;
+	var = (Var *) distribution->distributionExpr;
+
+	rte = planner_rt_fetch(rel->relid, root);
+	attname = get_attname(rte->relid, var->varattno);
+	if (attname == NULL || strcmp(attname, TenantColumn) != 0)
+		return;
+
+	getTypeInputInfo(var->vartype, &typinput, &typioparam);
+	get_typlenbyval(var->vartype, &typlen, &typbyval);
+	value = OidInputFunctionCall(typinput, TenantId, typioparam,
+								 var->vartypmod);
+	key = makeConst(var->vartype, var->vartypmod, var->varcollid, typlen,
+					value, false, typbyval);
+
+	nodes = distribution_value_nodes(root, distribution, var->vartype, key);
+	if (distribution->restrictNodes)
+		distribution->restrictNodes = bms_intersect(distribution->restrictNodes,
+													nodes);
+	else
+		distribution->restrictNodes = bms_copy(nodes);
+}
+
+
+/*
+ * restrict_range_distribution
+ *    Restrict the nodes of range distribution to those storing the values
+ *    satisfying an inequality of the distribution key and a constant, like
+ *    key < const or const <= key. Returns false if the clause is not such an
+ *    inequality, equalities are handled like for the other distributions.
+ */
+static bool
+restrict_range_distribution(PlannerInfo *root, RestrictInfo *ri,
+							Distribution *distribution)
+{
+	OpExpr	   *opexpr = (OpExpr *) ri->clause;
+	Oid			keytype = exprType(distribution->distributionExpr);
+	TypeCacheEntry *typentry;
+	Oid			opno;
+	Expr	   *other;
+	int			strategy;
+	Oid			lefttype;
+	Oid			righttype;
+	Const	   *constExpr;
+	Bitmapset  *restrictinfo = NULL;
+	int			index;
+	int			first;
+	int			last;
+	int			i;
+
+	if (ri->pseudoconstant || !is_opclause(opexpr) ||
+			list_length(opexpr->args) != 2 ||
+			list_length(distribution->buckets) !=
+				list_length(distribution->ranges) + 1)
+		return false;
+
+	/* Make the key the left operand */
+	if (equal(linitial(opexpr->args), distribution->distributionExpr))
+	{
+		opno = opexpr->opno;
+		other = (Expr *) lsecond(opexpr->args);
 	}
+	else if (equal(lsecond(opexpr->args), distribution->distributionExpr))
+	{
+		opno = get_commutator(opexpr->opno);
+		other = (Expr *) linitial(opexpr->args);
+	}
+	else
+		return false;
+
+	/*
+	 * The operator has to order the values of the key type the way the split
+	 * points are ordered.
+	 */
+	typentry = lookup_type_cache(keytype, TYPECACHE_BTREE_OPFAMILY);
+	if (!OidIsValid(opno) || !OidIsValid(typentry->btree_opf) ||
+			!op_in_opfamily(opno, typentry->btree_opf))
+		return false;
+	get_op_opfamily_properties(opno, typentry->btree_opf, false,
+							   &strategy, &lefttype, &righttype);
+	if (strategy == BTEqualStrategyNumber ||
+			lefttype != keytype || righttype != keytype ||
+			opexpr->inputcollid != get_typcollation(keytype) ||
+			contain_volatile_functions((Node *) other))
+		return false;
+
+	other = (Expr *) eval_const_expressions(root, (Node *) other);
+	if (!IsA(other, Const) || ((Const *) other)->constisnull)
+		return false;
+	constExpr = (Const *) other;
+
+	/* Values lower than the constant are in its range or below */
+	index = GetRangeIndex(keytype, distribution->ranges, constExpr->constvalue);
+	if (strategy == BTLessStrategyNumber ||
+			strategy == BTLessEqualStrategyNumber)
+	{
+		first = 0;
+		last = index;
+	}
+	else
+	{
+		first = index;
+		last = list_length(distribution->ranges);
+	}
+	for (i = first; i <= last; i++)
+		restrictinfo = bms_add_member(restrictinfo,
+									  list_nth_int(distribution->buckets, i));
+
+	if (distribution->restrictNodes)
+		distribution->restrictNodes = bms_intersect(distribution->restrictNodes,
+													restrictinfo);
+	else
+		distribution->restrictNodes = restrictinfo;
+	return true;
+}
+
+
+/*
+ * distribution_value_nodes
+ *    Determine the nodes where rows with the specified value of the
+ *    distribution key are stored. Children of a partitioned table usually
+ *    are distributed the same way and restricted by the same constants, so
+ *    the results are remembered in the PlannerInfo and shared between them.
+ *    The returned set must not be modified.
+ */
+static Bitmapset *
+distribution_value_nodes(PlannerInfo *root, Distribution *distribution,
+						 Oid keytype, Const *value)
+{
+	DistributionValueNodes *entry;
+	ListCell   *lc;
+	List 	   *nodeList = NIL;
+	Bitmapset  *tmpset;
+	Locator    *locator;
+	int		   *nodenums;
+	int 		i, count;
+
+	foreach(lc, root->distribution_value_nodes)
+	{
+		entry = (DistributionValueNodes *) lfirst(lc);
+		if (entry->distributionType == distribution->distributionType &&
+				entry->keytype == keytype &&
+				bms_equal(entry->nodes, distribution->nodes) &&
+				equal(entry->buckets, distribution->buckets) &&
+				equal(entry->ranges, distribution->ranges) &&
+				equal(entry->value, value))
+			return entry->result;
+	}
+
+	entry = (DistributionValueNodes *) palloc(sizeof(DistributionValueNodes));
+	entry->distributionType = distribution->distributionType;
+	entry->keytype = keytype;
+	entry->nodes = bms_copy(distribution->nodes);
+	entry->buckets = list_copy(distribution->buckets);
+	entry->ranges = list_copy(distribution->ranges);
+	entry->value = (Const *) copyObject(value);
+	entry->result = NULL;
+
+	tmpset = bms_copy(distribution->nodes);
+	while((i = bms_first_member(tmpset)) >= 0)
+		nodeList = lappend_int(nodeList, i);
+	bms_free(tmpset);
+
+	locator = createLocator(distribution->distributionType,
+							RELATION_ACCESS_READ,
+							keytype,
+							LOCATOR_LIST_LIST,
+							0,
+							(void *) nodeList,
+							(void **) &nodenums,
+							false);
+	setLocatorBuckets(locator, distribution->buckets, nodeList);
+	setLocatorRanges(locator, distribution->ranges);
+	count = GET_NODES(locator, value->constvalue, value->constisnull, NULL);
+
+	for (i = 0; i < count; i++)
+		entry->result = bms_add_member(entry->result, nodenums[i]);
+	list_free(nodeList);
+	freeLocator(locator);
+
+	root->distribution_value_nodes = lappend(root->distribution_value_nodes,
+											 entry);
+
+	return entry->result;
 }
 
 /*
  * set_scanpath_distribution
  *	  Assign distribution to the path which is a base relation scan.
+ *	  If restricted is true the distribution is restricted to the nodes where
+ *	  the rows satisfying the relation restrictions may be found.
+ *
+ * All the scan paths of the relation have the same distribution, so it is
+ * determined once and remembered in the RelOptInfo. That matters for
+ * partitioned tables with many children, each of them gets a few paths.
+ * Paths get their own copies, since createplan.c adjusts them in place.
  */
 static void
-set_scanpath_distribution(PlannerInfo *root, RelOptInfo *rel, Path *pathnode)
+set_scanpath_distribution(PlannerInfo *root, RelOptInfo *rel, Path *pathnode,
+						  bool restricted)
+{
+	Distribution *distribution;
+
+	if (!rel->scan_distribution_set)
+	{
+		rel->scan_distribution = make_scan_distribution(root, rel);
+		rel->restricted_distribution = NULL;
+		if (rel->scan_distribution)
+		{
+			ListCell   *lc;
+
+			distribution = (Distribution *) copyObject(rel->scan_distribution);
+			foreach (lc, rel->baserestrictinfo)
+			{
+				RestrictInfo *ri = (RestrictInfo *) lfirst(lc);
+				restrict_distribution(root, ri, distribution);
+			}
+			restrict_key_distribution(root, rel->baserestrictinfo,
+									  distribution);
+			restrict_tenant_distribution(root, rel, distribution);
+			rel->restricted_distribution = distribution;
+		}
+		rel->scan_distribution_set = true;
+	}
+
+	distribution = restricted ? rel->restricted_distribution :
+								rel->scan_distribution;
+	pathnode->distribution = (Distribution *) copyObject(distribution);
+}
+
+
+/*
+ * scan_distribution_var
+ *	  Var of the distribution column of the base relation, the one from the
+ *	  target list if it is there.
+ */
+static Var *
+scan_distribution_var(RelOptInfo *rel, RangeTblEntry *rte, AttrNumber attnum)
+{
+	Var 	   *var = NULL;
+	ListCell   *lc;
+
+	/* Look if the Var is already in the target list */
+	foreach (lc, rel->reltargetlist)
+	{
+		var = (Var *) lfirst(lc);
+		if (IsA(var, Var) && var->varno == rel->relid &&
+				var->varattno == attnum)
+			break;
+	}
+	/* If not found we should look up the attribute and make the Var */
+	if (!lc)
+	{
+		Relation 	relation = heap_open(rte->relid, NoLock);
+		TupleDesc	tdesc = RelationGetDescr(relation);
+		Form_pg_attribute att_tup;
+
+		att_tup = tdesc->attrs[attnum - 1];
+		var = makeVar(rel->relid, attnum,
+					  att_tup->atttypid, att_tup->atttypmod,
+					  att_tup->attcollation, 0);
+
+
+		heap_close(relation, NoLock);
+	}
+	return var;
+}
+
+
+/*
+ * make_scan_distribution
+ *	  Build the distribution of the base relation from its locator info.
+ */
+static Distribution *
+make_scan_distribution(PlannerInfo *root, RelOptInfo *rel)
 {
 	RangeTblEntry   *rte;
 	RelationLocInfo *rel_loc_info;
+	Distribution	*distribution = NULL;
 
 	rte = planner_rt_fetch(rel->relid, root);
 	rel_loc_info = GetRelationLocInfo(rte->relid);
 	if (rel_loc_info)
 	{
 		ListCell *lc;
-		Distribution *distribution = makeNode(Distribution);
+		distribution = makeNode(Distribution);
 		distribution->distributionType = rel_loc_info->locatorType;
 		foreach(lc, rel_loc_info->nodeList)
 			distribution->nodes = bms_add_member(distribution->nodes,
 												 lfirst_int(lc));
 		distribution->restrictNodes = NULL;
+		distribution->buckets = list_copy(rel_loc_info->buckets);
+		distribution->ranges = list_copy(rel_loc_info->ranges);
 		/*
 		 * Distribution expression of the base relation is Var representing
-		 * respective attribute.
+		 * respective attribute, or the key expression combining the Vars if
+		 * the relation is distributed by more than one column.
 		 */
 		distribution->distributionExpr = NULL;
-		if (rel_loc_info->partAttrNum)
+		if (rel_loc_info->partAttrNums)
 		{
-			Var 	   *var = NULL;
-			ListCell   *lc;
-
-			/* Look if the Var is already in the target list */
-			foreach (lc, rel->reltargetlist)
-			{
-				var = (Var *) lfirst(lc);
-				if (IsA(var, Var) && var->varno == rel->relid &&
-						var->varattno == rel_loc_info->partAttrNum)
-					break;
-			}
-			/* If not found we should look up the attribute and make the Var */
-			if (!lc)
-			{
-				Relation 	relation = heap_open(rte->relid, NoLock);
-				TupleDesc	tdesc = RelationGetDescr(relation);
-				Form_pg_attribute att_tup;
+			List	   *vars = NIL;
 
-				att_tup = tdesc->attrs[rel_loc_info->partAttrNum - 1];
-				var = makeVar(rel->relid, rel_loc_info->partAttrNum,
-							  att_tup->atttypid, att_tup->atttypmod,
-							  att_tup->attcollation, 0);
-
-
-				heap_close(relation, NoLock);
-			}
-
-			distribution->distributionExpr = (Node *) var;
+			foreach(lc, rel_loc_info->partAttrNums)
+				vars = lappend(vars, scan_distribution_var(rel, rte,
+														   lfirst_int(lc)));
+			distribution->distributionExpr = MakeDistributionKeyExpr(vars);
 		}
-		pathnode->distribution = distribution;
+		else if (rel_loc_info->partAttrNum)
+			distribution->distributionExpr = (Node *)
+				scan_distribution_var(rel, rte, rel_loc_info->partAttrNum);
+		FreeRelationLocInfo(rel_loc_info);
 	}
+	return distribution;
 }
 
 
@@ -930,7 +1337,7 @@ set_scanpath_distribution(PlannerInfo *root, RelOptInfo *rel, Path *pathnode)
  * distribution to it
  */
 static Path *
-redistribute_path(Path *subpath, char distributionType,
+redistribute_path(PlannerInfo *root, Path *subpath, char distributionType,
 				  Bitmapset *nodes, Bitmapset *restrictNodes,
 				  Node* distributionExpr)
 {
@@ -973,10 +1380,9 @@ redistribute_path(Path *subpath, char distributionType,
 		pathnode->path.distribution = distribution;
 		mpath->path.distribution = (Distribution *) copyObject(distribution);
 		/* (re)calculate costs */
-		cost_remote_subplan((Path *) pathnode, subpath->startup_cost,
+		cost_remote_subplan(root, (Path *) pathnode, subpath->startup_cost,
 							subpath->total_cost, subpath->rows, rel->width,
-							IsLocatorReplicated(distributionType) ?
-									bms_num_members(nodes) : 1);
+							subpath->distribution);
 		mpath->subpath = (Path *) pathnode;
 		cost_material(&mpath->path,
 					  pathnode->path.startup_cost,
@@ -994,10 +1400,9 @@ redistribute_path(Path *subpath, char distributionType,
 		pathnode->path.pathkeys = subpath->pathkeys;
 		pathnode->subpath = subpath;
 		pathnode->path.distribution = distribution;
-		cost_remote_subplan((Path *) pathnode, subpath->startup_cost,
+		cost_remote_subplan(root, (Path *) pathnode, subpath->startup_cost,
 							subpath->total_cost, subpath->rows, rel->width,
-							IsLocatorReplicated(distributionType) ?
-									bms_num_members(nodes) : 1);
+							subpath->distribution);
 		return (Path *) pathnode;
 	}
 }
@@ -1029,6 +1434,299 @@ flatCopyJoinPath(JoinPath *pathnode)
 }
 
 
+/*
+ * Check if the distribution keys are members of the same equivalence class,
+ * so they are known to be equal in the joined rows.
+ */
+static bool
+distribution_keys_equivalent(PlannerInfo *root, Node *key1, Node *key2)
+{
+	ListCell   *lc;
+
+	if (IsA(key1, RelabelType))
+		key1 = (Node *) ((RelabelType *) key1)->arg;
+	if (IsA(key2, RelabelType))
+		key2 = (Node *) ((RelabelType *) key2)->arg;
+
+	foreach(lc, root->eq_classes)
+	{
+		EquivalenceClass *ec = (EquivalenceClass *) lfirst(lc);
+		bool		found1 = false;
+		bool		found2 = false;
+		ListCell   *emc;
+
+		/* Never match to a volatile EC */
+		if (ec->ec_has_volatile)
+			continue;
+
+		foreach(emc, ec->ec_members)
+		{
+			EquivalenceMember *em = (EquivalenceMember *) lfirst(emc);
+			Node	   *emexpr = (Node *) em->em_expr;
+
+			if (IsA(emexpr, RelabelType))
+				emexpr = (Node *) ((RelabelType *) emexpr)->arg;
+			if (!found1)
+				found1 = equal(emexpr, key1);
+			if (!found2)
+				found2 = equal(emexpr, key2);
+		}
+		if (found1 && found2)
+			return true;
+	}
+	return false;
+}
+
+
+/*
+ * If the restriction is a hash joinable equality of the expression and an
+ * expression of the same type referring only the other relations, return
+ * the latter.
+ */
+static Expr *
+equijoin_partner(RestrictInfo *ri, Node *expr, Relids other_rels)
+{
+	OpExpr	   *opexpr = (OpExpr *) ri->clause;
+	Expr	   *left;
+	Expr	   *right;
+
+	if (ri->orclause || !IsA(opexpr, OpExpr) ||
+			list_length(opexpr->args) != 2)
+		return NULL;
+
+	left = (Expr *) linitial(opexpr->args);
+	right = (Expr *) lsecond(opexpr->args);
+	if (exprType((Node *) left) != exprType((Node *) right) ||
+			!op_hashjoinable(opexpr->opno, exprType((Node *) left)))
+		return NULL;
+
+	if (equal(left, expr) && bms_is_subset(ri->right_relids, other_rels) &&
+			!contain_volatile_functions((Node *) right))
+		return right;
+	if (equal(right, expr) && bms_is_subset(ri->left_relids, other_rels) &&
+			!contain_volatile_functions((Node *) left))
+		return left;
+	return NULL;
+}
+
+
+/*
+ * Check if the outer and inner distribution keys combine several columns and
+ * each outer column is joined to the inner column at the same position, by
+ * a join clause or by being in the same equivalence class. The joined rows
+ * have equal keys then, hence are on the same node.
+ */
+static bool
+distribution_keys_joined(PlannerInfo *root, JoinPath *pathnode,
+						 List *restrictClauses)
+{
+	List	   *outercols;
+	List	   *innercols;
+	ListCell   *olc;
+	ListCell   *ilc;
+	Relids		inner_rels = pathnode->innerjoinpath->parent->relids;
+
+	outercols = GetDistributionKeyColumns(
+							pathnode->outerjoinpath->distribution->distributionExpr);
+	innercols = GetDistributionKeyColumns(
+							pathnode->innerjoinpath->distribution->distributionExpr);
+	if (outercols == NIL || list_length(outercols) != list_length(innercols))
+		return false;
+
+	forboth(olc, outercols, ilc, innercols)
+	{
+		Node	   *outercol = (Node *) lfirst(olc);
+		Node	   *innercol = (Node *) lfirst(ilc);
+		ListCell   *lc;
+		bool		joined = false;
+
+		/* Equal values have to be hashed the same way */
+		if (exprType(outercol) != exprType(innercol))
+			return false;
+
+		/* As for single column keys, no side of the join may be nullable */
+		if ((pathnode->jointype == JOIN_INNER ||
+			 pathnode->jointype == JOIN_SEMI) &&
+				distribution_keys_equivalent(root, outercol, innercol))
+			continue;
+
+		foreach(lc, restrictClauses)
+		{
+			RestrictInfo *ri = (RestrictInfo *) lfirst(lc);
+
+			if (equal(equijoin_partner(ri, outercol, inner_rels), innercol))
+			{
+				joined = true;
+				break;
+			}
+		}
+		if (!joined)
+			return false;
+	}
+	return true;
+}
+
+
+/*
+ * If the join clauses equate each column of a distribution key combining
+ * several columns to an expression of the other relations, return these
+ * expressions in the order of the key columns, NIL otherwise. The other side
+ * redistributed by the key made of them is joined on the nodes where the
+ * key is.
+ */
+static List *
+distribution_key_join_exprs(Node *key, List *restrictClauses,
+							Relids other_rels)
+{
+	List	   *columns = GetDistributionKeyColumns(key);
+	List	   *result = NIL;
+	ListCell   *lc;
+
+	foreach(lc, columns)
+	{
+		Expr	   *partner = NULL;
+		ListCell   *rlc;
+
+		foreach(rlc, restrictClauses)
+		{
+			partner = equijoin_partner((RestrictInfo *) lfirst(rlc),
+									   (Node *) lfirst(lc), other_rels);
+			if (partner)
+				break;
+		}
+		if (partner == NULL)
+			return NIL;
+		result = lappend(result, partner);
+	}
+	return result;
+}
+
+
+/*
+ * If the join clauses equate the distribution key of the outer relation to
+ * an expression of the inner relation, the inner rows broadcast to the outer
+ * nodes are only joined on the node where the key has the same value.
+ * Return that expression, so if more rows than expected are broadcast the
+ * executor could send the rest of them to that node only.
+ */
+static Node *
+adaptive_broadcast_key(JoinPath *pathnode)
+{
+	Distribution   *outerd = pathnode->outerjoinpath->distribution;
+	Relids			inner_rels = pathnode->innerjoinpath->parent->relids;
+	List		   *restrictClauses;
+	ListCell	   *lc;
+
+	restrictClauses = list_concat(list_copy(pathnode->joinrestrictinfo),
+								  list_copy(pathnode->movedrestrictinfo));
+	foreach(lc, restrictClauses)
+	{
+		RestrictInfo   *ri = (RestrictInfo *) lfirst(lc);
+		OpExpr		   *expr = (OpExpr *) ri->clause;
+		Expr		   *left;
+		Expr		   *right;
+
+		if (ri->orclause || !IsA(expr, OpExpr) ||
+				list_length(expr->args) != 2)
+			continue;
+
+		left = (Expr *) linitial(expr->args);
+		right = (Expr *) lsecond(expr->args);
+
+		/* Values must be hashed the same way as the outer key */
+		if (exprType((Node *) left) != exprType((Node *) right) ||
+				!op_hashjoinable(expr->opno, exprType((Node *) left)))
+			continue;
+
+		if (equal(outerd->distributionExpr, left) &&
+				bms_is_subset(ri->right_relids, inner_rels) &&
+				!contain_volatile_functions((Node *) right))
+			return (Node *) right;
+		if (equal(outerd->distributionExpr, right) &&
+				bms_is_subset(ri->left_relids, inner_rels) &&
+				!contain_volatile_functions((Node *) left))
+			return (Node *) left;
+	}
+	return NULL;
+}
+
+
+/*
+ * Semi and anti joins only check if a matching inner row exists, so the
+ * duplicate inner rows can be removed before they are sent to the nodes
+ * joining them. That is common for IN and EXISTS subqueries, which often
+ * return a few distinct keys repeated many times. If removing the duplicates
+ * on the source nodes reduces the number of shipped rows enough, mark the
+ * RemoteSubPath just put on top of the inner path to do that, and charge
+ * for the hashing.
+ */
+static void
+distinct_semijoin_inner(PlannerInfo *root, JoinPath *pathnode)
+{
+	RemoteSubPath  *rpath;
+	Path		   *subpath;
+	RelOptInfo	   *rel;
+	Distribution   *source;
+	List		   *exprs = NIL;
+	ListCell	   *lc;
+	int				nsources = 1;
+	double			numGroups;
+	Path			aggpath;
+
+	if (pathnode->jointype != JOIN_SEMI && pathnode->jointype != JOIN_ANTI)
+		return;
+	if (!IsA(pathnode->innerjoinpath, RemoteSubPath))
+		return;
+
+	rpath = (RemoteSubPath *) pathnode->innerjoinpath;
+	subpath = rpath->subpath;
+	rel = subpath->parent;
+	source = subpath->distribution;
+
+	/* The rows are hashed as a whole */
+	foreach(lc, rel->reltargetlist)
+	{
+		Node	   *expr = (Node *) lfirst(lc);
+		Oid			eqop;
+		bool		hashable;
+
+		get_sort_group_operators(exprType(expr), false, false, false,
+								 NULL, &eqop, NULL, &hashable);
+		if (!OidIsValid(eqop) || !hashable)
+			return;
+		exprs = lappend(exprs, expr);
+	}
+	if (exprs == NIL)
+		return;
+
+	/* Every source node removes duplicates of its own rows */
+	if (source && !IsLocatorReplicated(source->distributionType))
+		nsources = bms_num_members(source->restrictNodes ?
+								   source->restrictNodes : source->nodes);
+	if (nsources < 1)
+		nsources = 1;
+	numGroups = estimate_num_groups(root, exprs, subpath->rows, NULL);
+	numGroups = Min(numGroups, subpath->rows / nsources);
+
+	/* Not worth it if duplicates are rare */
+	if (numGroups * nsources > subpath->rows / 2)
+		return;
+
+	/* Hash table must fit in memory, see create_unique_path */
+	if ((rel->width + 64) * numGroups > work_mem * 1024L)
+		return;
+
+	cost_agg(&aggpath, root, AGG_HASHED, NULL,
+			 list_length(exprs), numGroups,
+			 subpath->startup_cost, subpath->total_cost,
+			 subpath->rows / nsources);
+	rpath->distinct = true;
+	cost_remote_subplan(root, (Path *) rpath, aggpath.startup_cost,
+						aggpath.total_cost, numGroups * nsources, rel->width,
+						source);
+}
+
+
 /*
  * Analyze join parameters and set distribution of the join node.
  * If there are possible alternate distributions the respective pathes are
@@ -1043,6 +1741,8 @@ set_joinpath_distribution(PlannerInfo *root, JoinPath *pathnode)
 	Distribution   *targetd;
 	List		   *alternate = NIL;
 	List		   *restrictClauses = NIL;
+	bool			inner_target = false;
+	bool			outer_target = false;
 
 	/* Catalog join */
 	if (innerd == NULL && outerd == NULL)
@@ -1098,6 +1798,8 @@ set_joinpath_distribution(PlannerInfo *root, JoinPath *pathnode)
 		targetd->distributionType = outerd->distributionType;
 		targetd->nodes = bms_copy(outerd->nodes);
 		targetd->restrictNodes = bms_copy(outerd->restrictNodes);
+		targetd->buckets = list_copy(outerd->buckets);
+		targetd->ranges = list_copy(outerd->ranges);
 		targetd->distributionExpr = outerd->distributionExpr;
 		pathnode->path.distribution = targetd;
 		return alternate;
@@ -1124,6 +1826,8 @@ set_joinpath_distribution(PlannerInfo *root, JoinPath *pathnode)
 		targetd->distributionType = innerd->distributionType;
 		targetd->nodes = bms_copy(innerd->nodes);
 		targetd->restrictNodes = bms_copy(innerd->restrictNodes);
+		targetd->buckets = list_copy(innerd->buckets);
+		targetd->ranges = list_copy(innerd->ranges);
 		targetd->distributionExpr = innerd->distributionExpr;
 		pathnode->path.distribution = targetd;
 		return alternate;
@@ -1142,7 +1846,9 @@ set_joinpath_distribution(PlannerInfo *root, JoinPath *pathnode)
 			innerd->distributionType == outerd->distributionType &&
 			innerd->distributionExpr &&
 			outerd->distributionExpr &&
-			bms_equal(innerd->nodes, outerd->nodes))
+			bms_equal(innerd->nodes, outerd->nodes) &&
+			equal(innerd->buckets, outerd->buckets) &&
+			equal(innerd->ranges, outerd->ranges))
 	{
 		ListCell   *lc;
 
@@ -1151,6 +1857,55 @@ set_joinpath_distribution(PlannerInfo *root, JoinPath *pathnode)
 		 * on data type
 		 */
 
+		/*
+		 * If distribution keys are in the same equivalence class the join
+		 * condition does not have to refer the keys directly. That is common
+		 * in multi-way joins, where the distribution key of a joinrel is taken
+		 * from one of the joined relations, while the join clause may be
+		 * built from another member of the class. Keys equal to the same
+		 * constant are in the same class too. Equality is guaranteed for the
+		 * joined rows only if no side of the join is nullable.
+		 */
+		if ((pathnode->jointype == JOIN_INNER ||
+			 pathnode->jointype == JOIN_SEMI) &&
+				distribution_keys_equivalent(root, outerd->distributionExpr,
+											 innerd->distributionExpr))
+		{
+			targetd = makeNode(Distribution);
+			targetd->distributionType = innerd->distributionType;
+			targetd->nodes = bms_copy(innerd->nodes);
+			targetd->restrictNodes = bms_copy(innerd->restrictNodes);
+			targetd->buckets = list_copy(innerd->buckets);
+			targetd->ranges = list_copy(innerd->ranges);
+			targetd->distributionExpr = outerd->distributionExpr;
+			pathnode->path.distribution = targetd;
+			return alternate;
+		}
+
+		/*
+		 * Keys combining several columns are compared column by column, the
+		 * clauses do not refer the key expressions themselves.
+		 */
+		if (distribution_keys_joined(root, pathnode, restrictClauses))
+		{
+			targetd = makeNode(Distribution);
+			targetd->distributionType = innerd->distributionType;
+			targetd->nodes = bms_copy(innerd->nodes);
+			targetd->restrictNodes = bms_copy(innerd->restrictNodes);
+			targetd->buckets = list_copy(innerd->buckets);
+			targetd->ranges = list_copy(innerd->ranges);
+			pathnode->path.distribution = targetd;
+
+			/* The key of a nullable part can not be referred, as below */
+			if (pathnode->jointype == JOIN_FULL)
+				targetd->distributionExpr = NULL;
+			else if (pathnode->jointype == JOIN_RIGHT)
+				targetd->distributionExpr = innerd->distributionExpr;
+			else
+				targetd->distributionExpr = outerd->distributionExpr;
+			return alternate;
+		}
+
 		/*
 		 * Planner already did necessary work and if there is a join
 		 * condition like left.key=right.key the key expressions
@@ -1213,6 +1968,8 @@ set_joinpath_distribution(PlannerInfo *root, JoinPath *pathnode)
 					targetd->distributionType = innerd->distributionType;
 					targetd->nodes = bms_copy(innerd->nodes);
 					targetd->restrictNodes = bms_copy(innerd->restrictNodes);
+					targetd->buckets = list_copy(innerd->buckets);
+					targetd->ranges = list_copy(innerd->ranges);
 					targetd->distributionExpr = NULL;
 					pathnode->path.distribution = targetd;
 
@@ -1271,6 +2028,8 @@ set_joinpath_distribution(PlannerInfo *root, JoinPath *pathnode)
 					targetd->distributionType = innerd->distributionType;
 					targetd->nodes = bms_copy(innerd->nodes);
 					targetd->restrictNodes = bms_copy(innerd->restrictNodes);
+					targetd->buckets = list_copy(innerd->buckets);
+					targetd->ranges = list_copy(innerd->ranges);
 					pathnode->path.distribution = targetd;
 
 					/*
@@ -1295,16 +2054,37 @@ set_joinpath_distribution(PlannerInfo *root, JoinPath *pathnode)
 	 * If we could not determine the distribution redistribute the subpathes.
 	 */
 not_allowed_join:
+	/*
+	 * Rows of the target relation of UPDATE or DELETE have to stay on their
+	 * nodes, where ModifyTable finds them by ctid. Move the other side to
+	 * them instead, by their distribution key if they are joined along it,
+	 * broadcast otherwise, so the whole statement runs on the Datanodes.
+	 */
+	if ((root->parse->commandType == CMD_UPDATE ||
+		 root->parse->commandType == CMD_DELETE) &&
+			root->parse->resultRelation > 0)
+	{
+		inner_target = bms_is_member(root->parse->resultRelation,
+									 pathnode->innerjoinpath->parent->relids);
+		outer_target = bms_is_member(root->parse->resultRelation,
+									 pathnode->outerjoinpath->parent->relids);
+	}
+
 	/*
 	 * If redistribution is required, sometimes the cheapest path would be if
 	 * one of the subplan is replicated. If replication of any or all subplans
 	 * is possible, return resulting plans as alternates. Try to distribute all
-	 * by has as main variant.
+	 * by has as main variant. cost_remote_subplan() weighs broadcasting one
+	 * side against redistributing by the number of target nodes, the links
+	 * between them and the skew of the distribution key.
+	 *
+	 * A MaterialPath is redistributed in place, so it can not be shared
+	 * between the alternates.
 	 */
 
-#ifdef NOT_USED	
 	/* These join types allow replicated inner */
-	if (outerd &&
+	if (innerd && outerd && !inner_target &&
+			!IsA(pathnode->innerjoinpath, MaterialPath) &&
 			(pathnode->jointype == JOIN_INNER ||
 			 pathnode->jointype == JOIN_LEFT ||
 			 pathnode->jointype == JOIN_SEMI ||
@@ -1316,23 +2096,46 @@ not_allowed_join:
 		 */
 		JoinPath *altpath = flatCopyJoinPath(pathnode);
 		/* Redistribute inner subquery */
-		altpath->innerjoinpath = redistribute_path(
+		altpath->innerjoinpath = redistribute_path(root,
 				altpath->innerjoinpath,
 				LOCATOR_TYPE_REPLICATED,
 				bms_copy(outerd->nodes),
 				bms_copy(outerd->restrictNodes),
 				NULL);
+		/*
+		 * If the outer relation is distributed by the join key let executor
+		 * switch to redistribution if broadcast turns out to be too large.
+		 * The inner rows are not needed on other nodes, so it is correct
+		 * to switch at any time.
+		 */
+		if (adaptive_broadcast_rows > 0 &&
+				IsA(altpath->innerjoinpath, RemoteSubPath) &&
+				outerd->distributionExpr &&
+				IsLocatorDistributedByValue(outerd->distributionType) &&
+				outerd->distributionType != LOCATOR_TYPE_BUCKET &&
+				outerd->distributionType != LOCATOR_TYPE_RANGE)
+		{
+			RemoteSubPath *rpath = (RemoteSubPath *) altpath->innerjoinpath;
+
+			rpath->adaptiveExpr = adaptive_broadcast_key(altpath);
+			if (rpath->adaptiveExpr)
+				rpath->adaptiveType = outerd->distributionType;
+		}
+		distinct_semijoin_inner(root, altpath);
 		targetd = makeNode(Distribution);
 		targetd->distributionType = outerd->distributionType;
 		targetd->nodes = bms_copy(outerd->nodes);
 		targetd->restrictNodes = bms_copy(outerd->restrictNodes);
+		targetd->buckets = list_copy(outerd->buckets);
+		targetd->ranges = list_copy(outerd->ranges);
 		targetd->distributionExpr = outerd->distributionExpr;
 		altpath->path.distribution = targetd;
 		alternate = lappend(alternate, altpath);
 	}
 
 	/* These join types allow replicated outer */
-	if (innerd &&
+	if (innerd && outerd && !outer_target &&
+			!IsA(pathnode->outerjoinpath, MaterialPath) &&
 			(pathnode->jointype == JOIN_INNER ||
 			 pathnode->jointype == JOIN_RIGHT))
 	{
@@ -1342,7 +2145,7 @@ not_allowed_join:
 		 */
 		JoinPath *altpath = flatCopyJoinPath(pathnode);
 		/* Redistribute inner subquery */
-		altpath->outerjoinpath = redistribute_path(
+		altpath->outerjoinpath = redistribute_path(root,
 				altpath->outerjoinpath,
 				LOCATOR_TYPE_REPLICATED,
 				bms_copy(innerd->nodes),
@@ -1352,11 +2155,12 @@ not_allowed_join:
 		targetd->distributionType = innerd->distributionType;
 		targetd->nodes = bms_copy(innerd->nodes);
 		targetd->restrictNodes = bms_copy(innerd->restrictNodes);
+		targetd->buckets = list_copy(innerd->buckets);
+		targetd->ranges = list_copy(innerd->ranges);
 		targetd->distributionExpr = innerd->distributionExpr;
 		altpath->path.distribution = targetd;
 		alternate = lappend(alternate, altpath);
 	}
-#endif
 
 	/*
 	 * Redistribute subplans to make them compatible.
@@ -1369,6 +2173,8 @@ not_allowed_join:
 		Expr		   *new_inner_key = NULL;
 		Expr		   *new_outer_key = NULL;
 		char			distType = LOCATOR_TYPE_NONE;
+		List		   *distBuckets = NIL;
+		List		   *distRanges = NIL;
 		ListCell 	   *lc;
 
 		/*
@@ -1421,7 +2227,8 @@ not_allowed_join:
 						 * If left side is distribution key of outer subquery
 						 * and right expression refers only inner subquery
 						 */
-						if (equal(outerd->distributionExpr, left) &&
+						if (!inner_target &&
+								equal(outerd->distributionExpr, left) &&
 								bms_is_subset(ri->right_relids, inner_rels))
 						{
 							if (!preferred || /* no preferred restriction yet found */
@@ -1433,6 +2240,8 @@ not_allowed_join:
 								new_inner_key = right;
 								new_outer_key = NULL; /* no need to change */
 								distType = outerd->distributionType;
+								distBuckets = outerd->buckets;
+								distRanges = outerd->ranges;
 							}
 							continue;
 						}
@@ -1440,7 +2249,8 @@ not_allowed_join:
 						 * If right side is distribution key of outer subquery
 						 * and left expression refers only inner subquery
 						 */
-						if (equal(outerd->distributionExpr, right) &&
+						if (!inner_target &&
+								equal(outerd->distributionExpr, right) &&
 								bms_is_subset(ri->left_relids, inner_rels))
 						{
 							if (!preferred || /* no preferred restriction yet found */
@@ -1452,6 +2262,8 @@ not_allowed_join:
 								new_inner_key = left;
 								new_outer_key = NULL; /* no need to change */
 								distType = outerd->distributionType;
+								distBuckets = outerd->buckets;
+								distRanges = outerd->ranges;
 							}
 							continue;
 						}
@@ -1462,7 +2274,8 @@ not_allowed_join:
 						 * If left side is distribution key of inner subquery
 						 * and right expression refers only outer subquery
 						 */
-						if (equal(innerd->distributionExpr, left) &&
+						if (!outer_target &&
+								equal(innerd->distributionExpr, left) &&
 								bms_is_subset(ri->right_relids, outer_rels))
 						{
 							if (!preferred || /* no preferred restriction yet found */
@@ -1474,6 +2287,8 @@ not_allowed_join:
 								new_inner_key = NULL; /* no need to change */
 								new_outer_key = right;
 								distType = innerd->distributionType;
+								distBuckets = innerd->buckets;
+								distRanges = innerd->ranges;
 							}
 							continue;
 						}
@@ -1481,7 +2296,8 @@ not_allowed_join:
 						 * If right side is distribution key of inner subquery
 						 * and left expression refers only outer subquery
 						 */
-						if (equal(innerd->distributionExpr, right) &&
+						if (!outer_target &&
+								equal(innerd->distributionExpr, right) &&
 								bms_is_subset(ri->left_relids, outer_rels))
 						{
 							if (!preferred || /* no preferred restriction yet found */
@@ -1493,6 +2309,8 @@ not_allowed_join:
 								new_inner_key = NULL; /* no need to change */
 								new_outer_key = left;
 								distType = innerd->distributionType;
+								distBuckets = innerd->buckets;
+								distRanges = innerd->ranges;
 							}
 							continue;
 						}
@@ -1506,6 +2324,10 @@ not_allowed_join:
 							(new_inner_key == NULL || new_outer_key == NULL))
 						continue;
 
+					/* Rows of the target relation can not be moved */
+					if (inner_target || outer_target)
+						continue;
+
 					/*
 					 * Skip this condition if the data type of the expressions
 					 * does not allow either HASH or MODULO distribution.
@@ -1517,6 +2339,8 @@ not_allowed_join:
 						distType = LOCATOR_TYPE_MODULO;
 					else
 						continue;
+					distBuckets = NIL;
+					distRanges = NIL;
 					/*
 					 * If this restriction the first or easier to calculate
 					 * then preferred, try to store it as new preferred
@@ -1557,6 +2381,42 @@ not_allowed_join:
 				}
 			}
 		}
+		/*
+		 * A key combining several columns is not referred by the clauses, but
+		 * if they equate each of its columns to an expression of the other
+		 * side, redistributing the other side only by the key made of these
+		 * expressions is better than redistributing both.
+		 */
+		if (preferred == NULL || (new_inner_key && new_outer_key))
+		{
+			List	   *keyexprs;
+
+			if (!inner_target &&
+					(keyexprs = distribution_key_join_exprs(outerd->distributionExpr,
+							restrictClauses,
+							pathnode->innerjoinpath->parent->relids)) != NIL)
+			{
+				preferred = (RestrictInfo *) linitial(restrictClauses);
+				new_inner_key = (Expr *) MakeDistributionKeyExpr(keyexprs);
+				new_outer_key = NULL;
+				distType = outerd->distributionType;
+				distBuckets = outerd->buckets;
+				distRanges = outerd->ranges;
+			}
+			else if (!outer_target &&
+					(keyexprs = distribution_key_join_exprs(innerd->distributionExpr,
+							restrictClauses,
+							pathnode->outerjoinpath->parent->relids)) != NIL)
+			{
+				preferred = (RestrictInfo *) linitial(restrictClauses);
+				new_inner_key = NULL;
+				new_outer_key = (Expr *) MakeDistributionKeyExpr(keyexprs);
+				distType = innerd->distributionType;
+				distBuckets = innerd->buckets;
+				distRanges = innerd->ranges;
+			}
+		}
+
 		/* If we have suitable restriction we can repartition accordingly */
 		if (preferred)
 		{
@@ -1592,12 +2452,20 @@ not_allowed_join:
 			if (new_inner_key)
 			{
 				/* Redistribute inner subquery */
-				pathnode->innerjoinpath = redistribute_path(
+				pathnode->innerjoinpath = redistribute_path(root,
 						pathnode->innerjoinpath,
 						distType,
 						nodes,
 						restrictNodes,
 						(Node *) new_inner_key);
+				/* Follow the bucket map or the ranges of the other side */
+				if (distBuckets)
+					pathnode->innerjoinpath->distribution->buckets =
+							list_copy(distBuckets);
+				if (distRanges)
+					pathnode->innerjoinpath->distribution->ranges =
+							list_copy(distRanges);
+				distinct_semijoin_inner(root, pathnode);
 			}
 			/*
 			 * Redistribute join by hash, and, if jointype allows, create
@@ -1606,17 +2474,25 @@ not_allowed_join:
 			if (new_outer_key)
 			{
 				/* Redistribute outer subquery */
-				pathnode->outerjoinpath = redistribute_path(
+				pathnode->outerjoinpath = redistribute_path(root,
 						pathnode->outerjoinpath,
 						distType,
 						nodes,
 						restrictNodes,
 						(Node *) new_outer_key);
+				if (distBuckets)
+					pathnode->outerjoinpath->distribution->buckets =
+							list_copy(distBuckets);
+				if (distRanges)
+					pathnode->outerjoinpath->distribution->ranges =
+							list_copy(distRanges);
 			}
 			targetd = makeNode(Distribution);
 			targetd->distributionType = distType;
 			targetd->nodes = nodes;
 			targetd->restrictNodes = NULL;
+			targetd->buckets = list_copy(distBuckets);
+			targetd->ranges = list_copy(distRanges);
 			pathnode->path.distribution = targetd;
 			/*
 			 * In case of outer join distribution key should not refer
@@ -1638,6 +2514,20 @@ not_allowed_join:
 		}
 	}
 
+	/*
+	 * Joining on the Coordinator would move the rows of the target relation,
+	 * broadcast the other side to them instead.
+	 */
+	if ((inner_target || outer_target) && alternate != NIL)
+	{
+		JoinPath   *altpath = (JoinPath *) linitial(alternate);
+
+		pathnode->innerjoinpath = altpath->innerjoinpath;
+		pathnode->outerjoinpath = altpath->outerjoinpath;
+		pathnode->path.distribution = altpath->path.distribution;
+		return NIL;
+	}
+
 	/*
 	 * Build cartesian product, if no hasheable restrictions is found.
 	 * Perform coordinator join in such cases. If this join would be a part of
@@ -1649,13 +2539,13 @@ not_allowed_join:
 	 * relations.
 	 */
 	if (innerd)
-		pathnode->innerjoinpath = redistribute_path(pathnode->innerjoinpath,
+		pathnode->innerjoinpath = redistribute_path(root, pathnode->innerjoinpath,
 													LOCATOR_TYPE_NONE,
 													NULL,
 													NULL,
 													NULL);
 	if (outerd)
-		pathnode->outerjoinpath = redistribute_path(pathnode->outerjoinpath,
+		pathnode->outerjoinpath = redistribute_path(root, pathnode->outerjoinpath,
 													LOCATOR_TYPE_NONE,
 													NULL,
 													NULL,
@@ -1682,16 +2572,7 @@ create_seqscan_path(PlannerInfo *root, RelOptInfo *rel, Relids required_outer)
 	pathnode->pathkeys = NIL;	/* seqscan has unordered result */
 
 #ifdef XCP
-	set_scanpath_distribution(root, rel, pathnode);
-	if (rel->baserestrictinfo)
-	{
-		ListCell *lc;
-		foreach (lc, rel->baserestrictinfo)
-		{
-			RestrictInfo *ri = (RestrictInfo *) lfirst(lc);
-			restrict_distribution(root, ri, pathnode);
-		}
-	}
+	set_scanpath_distribution(root, rel, pathnode, true);
 #endif
 
 	cost_seqscan(pathnode, root, rel, pathnode->param_info);
@@ -1715,16 +2596,7 @@ create_samplescan_path(PlannerInfo *root, RelOptInfo *rel, Relids required_outer
 	pathnode->pathkeys = NIL;	/* samplescan has unordered result */
 
 #ifdef XCP
-	set_scanpath_distribution(root, rel, pathnode);
-	if (rel->baserestrictinfo)
-	{
-		ListCell *lc;
-		foreach (lc, rel->baserestrictinfo)
-		{
-			RestrictInfo *ri = (RestrictInfo *) lfirst(lc);
-			restrict_distribution(root, ri, pathnode);
-		}
-	}
+	set_scanpath_distribution(root, rel, pathnode, true);
 #endif
 
 	cost_samplescan(pathnode, root, rel);
@@ -1794,14 +2666,14 @@ create_index_path(PlannerInfo *root,
 	pathnode->indexscandir = indexscandir;
 
 #ifdef XCP
-	set_scanpath_distribution(root, rel, (Path *) pathnode);
+	set_scanpath_distribution(root, rel, (Path *) pathnode, false);
 	if (indexclauses)
 	{
 		ListCell *lc;
 		foreach (lc, indexclauses)
 		{
 			RestrictInfo *ri = (RestrictInfo *) lfirst(lc);
-			restrict_distribution(root, ri, (Path *) pathnode);
+			restrict_distribution(root, ri, pathnode->path.distribution);
 		}
 	}
 #endif
@@ -1840,16 +2712,7 @@ create_bitmap_heap_path(PlannerInfo *root,
 	pathnode->bitmapqual = bitmapqual;
 
 #ifdef XCP
-	set_scanpath_distribution(root, rel, (Path *) pathnode);
-	if (rel->baserestrictinfo)
-	{
-		ListCell *lc;
-		foreach (lc, rel->baserestrictinfo)
-		{
-			RestrictInfo *ri = (RestrictInfo *) lfirst(lc);
-			restrict_distribution(root, ri, (Path *) pathnode);
-		}
-	}
+	set_scanpath_distribution(root, rel, (Path *) pathnode, true);
 #endif
 
 	cost_bitmap_heap_scan(&pathnode->path, root, rel,
@@ -1878,7 +2741,7 @@ create_bitmap_and_path(PlannerInfo *root,
 	pathnode->bitmapquals = bitmapquals;
 
 #ifdef XCP
-	set_scanpath_distribution(root, rel, (Path *) pathnode);
+	set_scanpath_distribution(root, rel, (Path *) pathnode, false);
 #endif
 
 	/* this sets bitmapselectivity as well as the regular cost fields: */
@@ -1906,7 +2769,7 @@ create_bitmap_or_path(PlannerInfo *root,
 	pathnode->bitmapquals = bitmapquals;
 
 #ifdef XCP
-	set_scanpath_distribution(root, rel, (Path *) pathnode);
+	set_scanpath_distribution(root, rel, (Path *) pathnode, false);
 #endif
 
 	/* this sets bitmapselectivity as well as the regular cost fields: */
@@ -1934,7 +2797,7 @@ create_tidscan_path(PlannerInfo *root, RelOptInfo *rel, List *tidquals,
 	pathnode->tidquals = tidquals;
 
 #ifdef XCP
-	set_scanpath_distribution(root, rel, (Path *) pathnode);
+	set_scanpath_distribution(root, rel, (Path *) pathnode, false);
 	/* We may need to pass info about target node to support */
 	if (pathnode->path.distribution)
 		elog(ERROR, "could not perform TID scan on remote relation");
@@ -2017,7 +2880,7 @@ create_append_path(RelOptInfo *rel, List *subpaths, Relids required_outer)
 			{
 				subpath = (Path *) lfirst(l);
 				if (subpath->distribution)
-					subpath = redistribute_path(subpath, LOCATOR_TYPE_NONE,
+					subpath = redistribute_path(NULL, subpath, LOCATOR_TYPE_NONE,
 												NULL, NULL, NULL);
 				newsubpaths = lappend(newsubpaths, subpath);
 			}
@@ -2127,7 +2990,7 @@ create_merge_append_path(PlannerInfo *root,
 		{
 			subpath = (Path *) lfirst(l);
 			if (subpath->distribution)
-				subpath = redistribute_path(subpath, LOCATOR_TYPE_NONE,
+				subpath = redistribute_path(NULL, subpath, LOCATOR_TYPE_NONE,
 											NULL, NULL, NULL);
 			newsubpaths = lappend(newsubpaths, subpath);
 		}
@@ -2264,6 +3127,83 @@ create_material_path(RelOptInfo *rel, Path *subpath)
 	return pathnode;
 }
 
+/*
+ * create_resultcache_path
+ *	  Creates a path caching the rows of a parameterized subpath for each
+ *	  value of the outer expressions it is parameterized by, returning the
+ *	  pathnode.
+ *
+ * 'calls' is the number of times the path is expected to be rescanned.
+ * Returns NULL if the subpath is not parameterized by hashable expressions,
+ * or if its rows are not expected to fit in the cache.
+ */
+ResultCachePath *
+create_resultcache_path(PlannerInfo *root, RelOptInfo *rel, Path *subpath,
+						double calls)
+{
+	ResultCachePath *pathnode;
+	List	   *param_exprs = NIL;
+	ListCell   *lc;
+
+	Assert(subpath->parent == rel);
+
+	if (subpath->param_info == NULL)
+		return NULL;
+
+	/* The key is made of the outer Vars the pushed down clauses refer to */
+	foreach(lc, subpath->param_info->ppi_clauses)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+		List	   *vars;
+		ListCell   *lc2;
+
+		vars = pull_var_clause((Node *) rinfo->clause,
+							   PVC_RECURSE_AGGREGATES,
+							   PVC_INCLUDE_PLACEHOLDERS);
+		foreach(lc2, vars)
+		{
+			Node	   *expr = (Node *) lfirst(lc2);
+			TypeCacheEntry *typentry;
+
+			if (bms_is_subset(pull_varnos(expr), rel->relids))
+				continue;
+
+			typentry = lookup_type_cache(exprType(expr),
+										 TYPECACHE_HASH_PROC |
+										 TYPECACHE_EQ_OPR);
+			if (!OidIsValid(typentry->hash_proc) ||
+				!OidIsValid(typentry->eq_opr))
+				return NULL;
+
+			param_exprs = list_append_unique(param_exprs, expr);
+		}
+	}
+
+	if (param_exprs == NIL)
+		return NULL;
+
+	pathnode = makeNode(ResultCachePath);
+
+	pathnode->path.pathtype = T_ResultCache;
+	pathnode->path.parent = rel;
+	pathnode->path.param_info = subpath->param_info;
+	pathnode->path.pathkeys = subpath->pathkeys;
+
+	pathnode->subpath = subpath;
+	pathnode->param_exprs = param_exprs;
+	pathnode->calls = calls;
+	pathnode->ndistinct = estimate_num_groups(root, param_exprs, calls, NULL);
+
+#ifdef XCP
+	pathnode->path.distribution = (Distribution *) copyObject(subpath->distribution);
+#endif
+
+	if (!cost_resultcache(pathnode, root))
+		return NULL;
+
+	return pathnode;
+}
+
 /*
  * create_unique_path
  *	  Creates a path representing elimination of distinct rows from the
@@ -2822,6 +3762,60 @@ create_nestloop_path(PlannerInfo *root,
 	}
 #endif
 
+	/*
+	 * Consider caching the rows of the inner side.  This is done once the
+	 * distribution is settled, so that the cache also saves the round trips
+	 * to the Datanodes when the inner side is a RemoteSubPath.
+	 */
+	pathnode = cache_nestloop_inner(root, pathnode, sjinfo, semifactors);
+
+	return pathnode;
+}
+
+/*
+ * cache_nestloop_inner
+ *	  Return a copy of the nestloop path with a ResultCachePath on top of
+ *	  its inner side if that is cheaper, else the path itself.
+ *
+ * The inner side must be parameterized by the outer side, else every rescan
+ * has the same key.  Semi and anti joins stop reading the inner side at the
+ * first match, which would leave most entries incomplete, so they are not
+ * considered.
+ */
+static NestPath *
+cache_nestloop_inner(PlannerInfo *root, NestPath *pathnode,
+					 SpecialJoinInfo *sjinfo,
+					 SemiAntiJoinFactors *semifactors)
+{
+	Path	   *outer_path = pathnode->outerjoinpath;
+	Path	   *inner_path = pathnode->innerjoinpath;
+	ResultCachePath *rcpath;
+	NestPath   *cachedpath;
+	JoinCostWorkspace workspace;
+
+	if (!enable_resultcache)
+		return pathnode;
+	if (pathnode->jointype != JOIN_INNER && pathnode->jointype != JOIN_LEFT)
+		return pathnode;
+	if (!bms_overlap(PATH_REQ_OUTER(inner_path), outer_path->parent->relids))
+		return pathnode;
+
+	rcpath = create_resultcache_path(root, inner_path->parent, inner_path,
+									 outer_path->rows);
+	if (rcpath == NULL)
+		return pathnode;
+
+	cachedpath = makeNode(NestPath);
+	memcpy(cachedpath, pathnode, sizeof(NestPath));
+	cachedpath->innerjoinpath = (Path *) rcpath;
+
+	initial_cost_nestloop(root, &workspace, cachedpath->jointype,
+						  outer_path, (Path *) rcpath, sjinfo, semifactors);
+	final_cost_nestloop(root, cachedpath, &workspace, sjinfo, semifactors);
+
+	if (cachedpath->path.total_cost < pathnode->path.total_cost)
+		return cachedpath;
+
 	return pathnode;
 }
 
@@ -133,6 +133,11 @@ build_simple_rel(PlannerInfo *root, int relid, RelOptKind reloptkind)
 	rel->baserestrictcost.per_tuple = 0;
 	rel->joininfo = NIL;
 	rel->has_eclass_joins = false;
+#ifdef XCP
+	rel->scan_distribution_set = false;
+	rel->scan_distribution = NULL;
+	rel->restricted_distribution = NULL;
+#endif
 
 	/* Check type of rtable entry */
 	switch (rte->rtekind)
@@ -554,6 +554,8 @@ static Node *makeRecursiveViewSelect(char *relname, List *aliases, Node *query);
 /* PGXC_BEGIN */
 %type <str>		opt_barrier_id OptDistributeType
 %type <distby>	OptDistributeBy OptDistributeByInternal
+%type <list>	distribute_range_list
+%type <value>	distribute_range_value
 %type <subclus> OptSubCluster OptSubClusterInternal
 /* PGXC_END */
 %type <boolean> opt_if_not_exists
@@ -3563,6 +3565,13 @@ OptDistributeByInternal:  DISTRIBUTE BY OptDistributeType '(' name ')'
 						n->disttype = DISTTYPE_MODULO;
 					else if (strcmp($3, "hash") == 0)
 						n->disttype = DISTTYPE_HASH;
+					else if (strcmp($3, "bucket") == 0)
+						n->disttype = DISTTYPE_BUCKET;
+					else if (strcmp($3, "range") == 0)
+						ereport(ERROR,
+								(errcode(ERRCODE_SYNTAX_ERROR),
+								 errmsg("distribution by range requires split point values"),
+								 parser_errposition(@3)));
 					else
                         ereport(ERROR,
                                 (errcode(ERRCODE_SYNTAX_ERROR),
@@ -3570,6 +3579,34 @@ OptDistributeByInternal:  DISTRIBUTE BY OptDistributeType '(' name ')'
 					n->colname = $5;
 					$$ = n;
 				}
+			| DISTRIBUTE BY OptDistributeType '(' name ',' name_list ')'
+				{
+					DistributeBy *n = makeNode(DistributeBy);
+					if (strcmp($3, "hash") == 0)
+						n->disttype = DISTTYPE_HASH;
+					else
+						ereport(ERROR,
+								(errcode(ERRCODE_SYNTAX_ERROR),
+								 errmsg("only distribution by hash allows more than one column"),
+								 parser_errposition(@3)));
+					n->colname = $5;
+					n->colnames = lcons(makeString($5), $7);
+					$$ = n;
+				}
+			| DISTRIBUTE BY OptDistributeType '(' name ')' VALUES '(' distribute_range_list ')'
+				{
+					DistributeBy *n = makeNode(DistributeBy);
+					if (strcmp($3, "range") == 0)
+						n->disttype = DISTTYPE_RANGE;
+					else
+						ereport(ERROR,
+								(errcode(ERRCODE_SYNTAX_ERROR),
+								 errmsg("split point values are only allowed with distribution by range"),
+								 parser_errposition(@7)));
+					n->colname = $5;
+					n->rangevalues = $9;
+					$$ = n;
+				}
 			| DISTRIBUTE BY OptDistributeType
 				{
 					DistributeBy *n = makeNode(DistributeBy);
@@ -3586,6 +3623,24 @@ OptDistributeByInternal:  DISTRIBUTE BY OptDistributeType '(' name ')'
 				}
 		;
 
+/* Split points of a range distribution, kept as strings */
+distribute_range_list:
+			distribute_range_value					{ $$ = list_make1($1); }
+			| distribute_range_list ',' distribute_range_value
+													{ $$ = lappend($1, $3); }
+		;
+
+distribute_range_value:
+			Sconst									{ $$ = makeString($1); }
+			| NumericOnly
+				{
+					if (IsA($1, Integer))
+						$$ = makeString(psprintf("%ld", intVal($1)));
+					else
+						$$ = makeString(strVal($1));
+				}
+		;
+
 OptSubCluster: OptSubClusterInternal				{ $$ = $1; }
 			| /* EMPTY */							{ $$ = NULL; }
 		;
@@ -162,6 +162,7 @@ static void transformColumnType(CreateStmtContext *cxt, ColumnDef *column);
 static void setSchemaName(char *context_schema, char **stmt_schema_name);
 #ifdef PGXC
 static void checkLocalFKConstraints(CreateStmtContext *cxt);
+static bool CheckLocalIndexColumns(List *partcolnames, List *indexparams);
 #endif
 #ifdef XCP
 static List *transformSubclusterNodes(PGXCSubCluster *subcluster);
@@ -383,6 +384,7 @@ transformCreateStmt(CreateStmt *stmt, const char *queryString)
 		{
 			RangeVar   *inh = (RangeVar *) linitial(stmt->inhRelations);
 			Relation	rel;
+			ListCell   *lc;
 
 			Assert(IsA(inh, RangeVar));
 			rel = heap_openrv(inh, AccessShareLock);
@@ -400,12 +402,29 @@ transformCreateStmt(CreateStmt *stmt, const char *queryString)
 						stmt->distributeby->disttype = DISTTYPE_HASH;
 						stmt->distributeby->colname =
 								pstrdup(rel->rd_locator_info->partAttrName);
+						foreach(lc, rel->rd_locator_info->partAttrNums)
+							stmt->distributeby->colnames =
+								lappend(stmt->distributeby->colnames,
+										makeString(get_attname(RelationGetRelid(rel),
+															   lfirst_int(lc))));
 						break;
 					case LOCATOR_TYPE_MODULO:
 						stmt->distributeby->disttype = DISTTYPE_MODULO;
 						stmt->distributeby->colname =
 								pstrdup(rel->rd_locator_info->partAttrName);
 						break;
+					case LOCATOR_TYPE_BUCKET:
+						stmt->distributeby->disttype = DISTTYPE_BUCKET;
+						stmt->distributeby->colname =
+								pstrdup(rel->rd_locator_info->partAttrName);
+						break;
+					case LOCATOR_TYPE_RANGE:
+						stmt->distributeby->disttype = DISTTYPE_RANGE;
+						stmt->distributeby->colname =
+								pstrdup(rel->rd_locator_info->partAttrName);
+						stmt->distributeby->rangevalues = (List *)
+								copyObject(rel->rd_locator_info->ranges);
+						break;
 					case LOCATOR_TYPE_REPLICATED:
 						stmt->distributeby->disttype = DISTTYPE_REPLICATION;
 						break;
@@ -1693,12 +1712,26 @@ transformIndexConstraint(Constraint *constraint, CreateStmtContext *cxt)
 	IndexStmt  *index;
 #ifdef PGXC
 	bool		isLocalSafe = false;
+	List	   *keycols = NIL;
 #endif
 #ifdef XCP
 	List	   *fallback_cols = NIL;
 #endif
 	ListCell   *lc;
 
+#ifdef PGXC
+	/* Columns of a distribution by more than one column */
+	if (cxt->distributeby)
+		keycols = cxt->distributeby->colnames;
+	else if (cxt->isalter && cxt->rel->rd_locator_info)
+	{
+		foreach(lc, cxt->rel->rd_locator_info->partAttrNums)
+			keycols = lappend(keycols,
+							  makeString(get_attname(RelationGetRelid(cxt->rel),
+													 lfirst_int(lc))));
+	}
+#endif
+
 	index = makeNode(IndexStmt);
 
 	index->unique = (constraint->contype != CONSTR_EXCLUSION);
@@ -2086,7 +2119,7 @@ transformIndexConstraint(Constraint *constraint, CreateStmtContext *cxt)
 				 * If distribution is defined check current column against
 				 * the distribution.
 				 */
-				if (cxt->distributeby)
+				if (cxt->distributeby && keycols == NIL)
 					isLocalSafe = CheckLocalIndexColumn (
 							ConvertToLocatorType(cxt->distributeby->disttype),
 							cxt->distributeby->colname, key);
@@ -2094,7 +2127,7 @@ transformIndexConstraint(Constraint *constraint, CreateStmtContext *cxt)
 				 * Similar, if altering existing table check against target
 				 * table distribution
 				 */
-				if (cxt->isalter)
+				if (cxt->isalter && keycols == NIL)
 					isLocalSafe = cxt->rel->rd_locator_info == NULL ||
 							CheckLocalIndexColumn (
 									cxt->rel->rd_locator_info->locatorType,
@@ -2131,6 +2164,10 @@ transformIndexConstraint(Constraint *constraint, CreateStmtContext *cxt)
 		index->indexParams = lappend(index->indexParams, iparam);
 	}
 #ifdef PGXC
+	/* All the columns of a multi-column distribution have to be indexed */
+	if (IS_PGXC_COORDINATOR && !isLocalSafe && keycols != NIL)
+		isLocalSafe = CheckLocalIndexColumns(keycols, index->indexParams);
+
 	if (IS_PGXC_COORDINATOR && !isLocalSafe)
 	{
 		if (cxt->distributeby || cxt->isalter)
@@ -3252,7 +3289,8 @@ CheckLocalIndexColumn (char loctype, char *partcolname, char *indexcolname)
 			ereport(ERROR,
 					(errcode(ERRCODE_INVALID_COLUMN_REFERENCE),
 					errmsg("Cannot locally enforce a unique index on round robin distributed table.")));
-	else if (loctype == LOCATOR_TYPE_HASH || loctype == LOCATOR_TYPE_MODULO)
+	else if (loctype == LOCATOR_TYPE_HASH || loctype == LOCATOR_TYPE_MODULO ||
+			 loctype == LOCATOR_TYPE_BUCKET || loctype == LOCATOR_TYPE_RANGE)
 	{
 		if (partcolname && indexcolname && strcmp(partcolname, indexcolname) == 0)
 			return true;
@@ -3260,6 +3298,39 @@ CheckLocalIndexColumn (char loctype, char *partcolname, char *indexcolname)
 	return false;
 }
 
+/*
+ * CheckLocalIndexColumns
+ *
+ * Checks whether the index columns, a list of IndexElem, contain all the
+ * columns of a distribution by several columns, given as a list of String
+ * values
+ */
+static bool
+CheckLocalIndexColumns(List *partcolnames, List *indexparams)
+{
+	ListCell   *lc;
+
+	foreach(lc, partcolnames)
+	{
+		ListCell   *ilc;
+		bool		found = false;
+
+		foreach(ilc, indexparams)
+		{
+			IndexElem  *elem = (IndexElem *) lfirst(ilc);
+
+			if (elem->name && strcmp(elem->name, strVal(lfirst(lc))) == 0)
+			{
+				found = true;
+				break;
+			}
+		}
+		if (!found)
+			return false;
+	}
+	return true;
+}
+
 /*
  * Given relation, find the index of the attribute in the primary key,
  * which is the distribution key. Returns -1 if table is not a Hash/Modulo
@@ -3440,6 +3511,36 @@ checkLocalFKConstraints(CreateStmtContext *cxt)
 					(errcode(ERRCODE_SYNTAX_ERROR),
 					 errmsg("Cannot reference a round robin table in a foreign key constraint")));
 		}
+		else if (rel_loc_info->locatorType == LOCATOR_TYPE_BUCKET)
+		{
+			/*
+			 * Bucket maps of different tables are rebalanced independently,
+			 * so the referencing rows can not be kept on the same nodes.
+			 */
+			ereport(ERROR,
+					(errcode(ERRCODE_SYNTAX_ERROR),
+					 errmsg("Cannot reference a bucket distributed table in a foreign key constraint")));
+		}
+		else if (rel_loc_info->locatorType == LOCATOR_TYPE_RANGE)
+		{
+			/*
+			 * Split points of different tables are independent, the
+			 * referencing rows may belong to other nodes.
+			 */
+			ereport(ERROR,
+					(errcode(ERRCODE_SYNTAX_ERROR),
+					 errmsg("Cannot reference a range distributed table in a foreign key constraint")));
+		}
+		else if (rel_loc_info->partAttrNums)
+		{
+			/*
+			 * The referencing rows would have to be located by the same
+			 * combination of columns.
+			 */
+			ereport(ERROR,
+					(errcode(ERRCODE_SYNTAX_ERROR),
+					 errmsg("Cannot reference a table distributed by more than one column in a foreign key constraint")));
+		}
 		else if (IsLocatorDistributedByValue(rel_loc_info->locatorType))
 		{
 			ListCell   *fklc;
@@ -3449,6 +3550,13 @@ checkLocalFKConstraints(CreateStmtContext *cxt)
 			bool		found = false;
 			List 	   *common;
 
+			if ((cxt->distributeby && cxt->distributeby->colnames) ||
+					(cxt->isalter && cxt->rel->rd_locator_info &&
+					 cxt->rel->rd_locator_info->partAttrNums))
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("Table distributed by more than one column can only reference a replicated table in a foreign key constraint")));
+
 			/*
 			 * First check nodes, they must be the same as in
 			 * the referenced relation
@@ -25,13 +25,23 @@
 #include "pgxc/pgxc.h"
 #include "nodes/nodes.h"
 #include "pgxc/pgxcnode.h"
+#include "pgstat.h"
 #include "storage/lwlock.h"
 #include "tcop/dest.h"
 
+/* GUC: flush the BARRIER records once the commits resumed */
+bool barrier_deferred_flush = true;
+
+/* BARRIER record inserted by the last CREATE BARRIER EXECUTE */
+static XLogRecPtr barrierRecPtr = InvalidXLogRecPtr;
+
 static const char *generate_barrier_id(const char *id);
+static XLogRecPtr InsertBarrierRecord(const char *id);
 static PGXCNodeAllHandles *PrepareBarrier(const char *id);
-static void ExecuteBarrier(const char *id);
+static PGXCNodeAllHandles *ExecuteBarrier(const char *id, XLogRecPtr *recptr);
 static void EndBarrier(PGXCNodeAllHandles *handles, const char *id);
+static void FlushBarrier(PGXCNodeAllHandles *handles, const char *id,
+			 XLogRecPtr recptr);
 
 /*
  * Prepare ourselves for an incoming BARRIER. We must disable all new 2PC
@@ -103,11 +113,13 @@ ProcessCreateBarrierEnd(const char *id)
 
 /*
  * Execute the CREATE BARRIER command. Write a BARRIER WAL record and flush the
- * WAL buffers to disk before returning to the caller. Writing the WAL record
- * does not guarantee successful completion of the barrier command.
+ * WAL buffers to disk before returning to the caller, unless the driving
+ * Coordinator asks for the flush later on with CREATE BARRIER FLUSH. Writing
+ * the WAL record does not guarantee successful completion of the barrier
+ * command.
  */
 void
-ProcessCreateBarrierExecute(const char *id)
+ProcessCreateBarrierExecute(const char *id, bool flush)
 {
 	StringInfoData buf;
 
@@ -116,14 +128,39 @@ ProcessCreateBarrierExecute(const char *id)
 				(errcode(ERRCODE_INTERNAL_ERROR),
 				 errmsg("The CREATE BARRIER EXECUTE message is expected to "
 						"arrive from a Coordinator")));
-	{
-		XLogRecPtr recptr;
 
-		XLogBeginInsert();
-		XLogRegisterData((char *) &id, strlen(id) + 1);
-		recptr = XLogInsert(RM_BARRIER_ID, XLOG_BARRIER_CREATE);
-		XLogFlush(recptr);
-	}
+	barrierRecPtr = InsertBarrierRecord(id);
+	if (flush)
+		XLogFlush(barrierRecPtr);
+
+	pq_beginmessage(&buf, 'b');
+	pq_sendstring(&buf, id);
+	pq_endmessage(&buf);
+	pq_flush();
+}
+
+/*
+ * Flush the BARRIER WAL record written by CREATE BARRIER EXECUTE
+ */
+void
+ProcessCreateBarrierFlush(const char *id)
+{
+	StringInfoData buf;
+
+	if (!IsConnFromCoord())
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("The CREATE BARRIER FLUSH message is expected to "
+						"arrive from a Coordinator")));
+
+	if (XLogRecPtrIsInvalid(barrierRecPtr))
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("Received CREATE BARRIER FLUSH without CREATE BARRIER "
+						"EXECUTE")));
+
+	XLogFlush(barrierRecPtr);
+	barrierRecPtr = InvalidXLogRecPtr;
 
 	pq_beginmessage(&buf, 'b');
 	pq_sendstring(&buf, id);
@@ -155,29 +192,38 @@ generate_barrier_id(const char *id)
 	return pstrdup(genid);
 }
 
-static PGXCNodeAllHandles *
-SendBarrierPrepareRequest(List *coords, const char *id)
+/*
+ * Send a barrier command to all the nodes of the handles at once, the
+ * responses are collected later by CheckBarrierCommandStatus.
+ */
+static void
+SendBarrierRequest(PGXCNodeAllHandles *conn_handles, char command,
+				   const char *id)
 {
-	PGXCNodeAllHandles *coord_handles;
 	int conn;
-	int msglen;
-	int barrier_idlen;
+	int count = conn_handles->co_conn_count + conn_handles->dn_conn_count;
+	int barrier_idlen = strlen(id) + 1;
 
-	coord_handles = get_handles(NIL, coords, true, true);
+	elog(DEBUG2, "Sending CREATE BARRIER <%s> %c command to %d nodes",
+		 id, command, count);
 
-	for (conn = 0; conn < coord_handles->co_conn_count; conn++)
+	for (conn = 0; conn < count; conn++)
 	{
-		PGXCNodeHandle *handle = coord_handles->coord_handles[conn];
+		PGXCNodeHandle *handle;
+		int msglen;
+
+		if (conn < conn_handles->co_conn_count)
+			handle = conn_handles->coord_handles[conn];
+		else
+			handle = conn_handles->datanode_handles[conn - conn_handles->co_conn_count];
 
 		/* Invalid connection state, return error */
 		if (handle->state != DN_CONNECTION_STATE_IDLE)
 			ereport(ERROR,
 					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("Failed to send CREATE BARRIER PREPARE request "
+					 errmsg("Failed to send CREATE BARRIER request "
 						 	"to the node")));
 
-		barrier_idlen = strlen(id) + 1;
-
 		msglen = 4; /* for the length itself */
 		msglen += barrier_idlen;
 		msglen += 1; /* for barrier command itself */
@@ -195,7 +241,7 @@ SendBarrierPrepareRequest(List *coords, const char *id)
 		memcpy(handle->outBuffer + handle->outEnd, &msglen, 4);
 		handle->outEnd += 4;
 
-		handle->outBuffer[handle->outEnd++] = CREATE_BARRIER_PREPARE;
+		handle->outBuffer[handle->outEnd++] = command;
 
 		memcpy(handle->outBuffer + handle->outEnd, id, barrier_idlen);
 		handle->outEnd += barrier_idlen;
@@ -204,92 +250,88 @@ SendBarrierPrepareRequest(List *coords, const char *id)
 
 		pgxc_node_flush(handle);
 	}
-
-	return coord_handles;
 }
 
+/*
+ * Wait for all the nodes to acknowledge a barrier command. The responses
+ * are read as they arrive, whatever node sends them first, so the wait
+ * lasts as long as the slowest node and not the sum of them all.
+ */
 static void
 CheckBarrierCommandStatus(PGXCNodeAllHandles *conn_handles, const char *id,
 						  const char *command)
 {
 	int conn;
 	int count = conn_handles->co_conn_count + conn_handles->dn_conn_count;
+	int pending = 0;
+	PGXCNodeHandle **handles;
 
 	elog(DEBUG2, "Check CREATE BARRIER <%s> %s command status", id, command);
 
+	if (count == 0)
+		return;
+
+	handles = (PGXCNodeHandle **) palloc(count * sizeof(PGXCNodeHandle *));
 	for (conn = 0; conn < count; conn++)
 	{
-		PGXCNodeHandle *handle;
-
 		if (conn < conn_handles->co_conn_count)
-			handle = conn_handles->coord_handles[conn];
+			handles[pending++] = conn_handles->coord_handles[conn];
 		else
-			handle = conn_handles->datanode_handles[conn - conn_handles->co_conn_count];
-
-		if (pgxc_node_receive(1, &handle, NULL))
-			ereport(ERROR,
-					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("Failed to receive response from the remote side")));
-
-		if (handle_response(handle, NULL) != RESPONSE_BARRIER_OK)
-			ereport(ERROR,
-					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("CREATE BARRIER PREPARE command failed "
-						 	"with error %s", handle->error)));
+			handles[pending++] = conn_handles->datanode_handles[conn - conn_handles->co_conn_count];
 	}
 
-	elog(DEBUG2, "Successfully completed CREATE BARRIER <%s> %s command on "
-				 "all nodes", id, command);
-}
-
-static void
-SendBarrierEndRequest(PGXCNodeAllHandles *coord_handles, const char *id)
-{
-	int conn;
-	int msglen;
-	int barrier_idlen;
-
-	elog(DEBUG2, "Sending CREATE BARRIER <%s> END command to all Coordinators", id);
-
-	for (conn = 0; conn < coord_handles->co_conn_count; conn++)
+	while (pending > 0)
 	{
-		PGXCNodeHandle *handle = coord_handles->coord_handles[conn];
+		bool		failed;
 
-		/* Invalid connection state, return error */
-		if (handle->state != DN_CONNECTION_STATE_IDLE)
+		pgstat_report_wait_start(WAIT_EVENT_BARRIER, handles[0]->nodeoid);
+		failed = pgxc_node_receive(pending, handles, NULL);
+		pgstat_report_wait_end(WAIT_EVENT_BARRIER);
+		if (failed)
 			ereport(ERROR,
 					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("Failed to send CREATE BARRIER PREPARE request "
-						 	"to the node")));
-
-		barrier_idlen = strlen(id) + 1;
-
-		msglen = 4; /* for the length itself */
-		msglen += barrier_idlen;
-		msglen += 1; /* for barrier command itself */
+					 errmsg("Failed to receive response from the remote side")));
 
-		/* msgType + msgLen */
-		if (ensure_out_buffer_capacity(handle->outEnd + 1 + msglen, handle) != 0)
+		conn = 0;
+		while (conn < pending)
 		{
-			ereport(ERROR,
-					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("Out of memory")));
+			PGXCNodeHandle *handle = handles[conn];
+			int res = handle_response(handle, NULL);
+
+			if (res == RESPONSE_EOF)
+			{
+				/* not complete yet, wait for more */
+				conn++;
+				continue;
+			}
+
+			if (res != RESPONSE_BARRIER_OK)
+				ereport(ERROR,
+						(errcode(ERRCODE_INTERNAL_ERROR),
+						 errmsg("CREATE BARRIER %s command failed "
+							 	"with error %s", command, handle->error)));
+
+			/* done with this one */
+			handles[conn] = handles[--pending];
 		}
+	}
 
-		handle->outBuffer[handle->outEnd++] = 'b';
-		msglen = htonl(msglen);
-		memcpy(handle->outBuffer + handle->outEnd, &msglen, 4);
-		handle->outEnd += 4;
-
-		handle->outBuffer[handle->outEnd++] = CREATE_BARRIER_END;
+	pfree(handles);
 
-		memcpy(handle->outBuffer + handle->outEnd, id, barrier_idlen);
-		handle->outEnd += barrier_idlen;
+	elog(DEBUG2, "Successfully completed CREATE BARRIER <%s> %s command on "
+				 "all nodes", id, command);
+}
 
-		handle->state = DN_CONNECTION_STATE_QUERY;
-		pgxc_node_flush(handle);
-	}
+/*
+ * Write the BARRIER WAL record locally
+ */
+static XLogRecPtr
+InsertBarrierRecord(const char *id)
+{
+	XLogBeginInsert();
+	XLogRegisterData((char *) id, strlen(id) + 1);
 
+	return XLogInsert(RM_BARRIER_ID, XLOG_BARRIER_CREATE);
 }
 
 /*
@@ -315,7 +357,8 @@ PrepareBarrier(const char *id)
 	 * send an asynchronous request so that we can disable local commits and
 	 * then wait for the remote Coordinators to finish the work
 	 */
-	coord_handles = SendBarrierPrepareRequest(GetAllCoordNodes(), id);
+	coord_handles = get_handles(NIL, GetAllCoordNodes(), true, true);
+	SendBarrierRequest(coord_handles, CREATE_BARRIER_PREPARE, id);
 
 	/*
 	 * Disable local commits
@@ -339,85 +382,40 @@ PrepareBarrier(const char *id)
 
 /*
  * Execute the barrier command on all the components, including Datanodes and
- * Coordinators.
+ * Coordinators. With barrier_deferred_flush the nodes only insert the
+ * record, the handles are returned to flush it once the commits resumed.
  */
-static void
-ExecuteBarrier(const char *id)
+static PGXCNodeAllHandles *
+ExecuteBarrier(const char *id, XLogRecPtr *recptr)
 {
 	List *barrierDataNodeList = GetAllDataNodes();
 	List *barrierCoordList = GetAllCoordNodes();
 	PGXCNodeAllHandles *conn_handles;
-	int conn;
-	int msglen;
-	int barrier_idlen;
 
 	conn_handles = get_handles(barrierDataNodeList, barrierCoordList, false, true);
 
-	elog(DEBUG2, "Sending CREATE BARRIER <%s> EXECUTE message to "
-				 "Datanodes and Coordinator", id);
 	/*
 	 * Send a CREATE BARRIER request to all the Datanodes and the Coordinators
 	 */
-	for (conn = 0; conn < conn_handles->co_conn_count + conn_handles->dn_conn_count; conn++)
-	{
-		PGXCNodeHandle *handle;
-
-		if (conn < conn_handles->co_conn_count)
-			handle = conn_handles->coord_handles[conn];
-		else
-			handle = conn_handles->datanode_handles[conn - conn_handles->co_conn_count];
-
-		/* Invalid connection state, return error */
-		if (handle->state != DN_CONNECTION_STATE_IDLE)
-			ereport(ERROR,
-					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("Failed to send CREATE BARRIER EXECUTE request "
-						 	"to the node")));
-
-		barrier_idlen = strlen(id) + 1;
-
-		msglen = 4; /* for the length itself */
-		msglen += barrier_idlen;
-		msglen += 1; /* for barrier command itself */
-
-		/* msgType + msgLen */
-		if (ensure_out_buffer_capacity(handle->outEnd + 1 + msglen, handle) != 0)
-		{
-			ereport(ERROR,
-					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("Out of memory")));
-		}
-
-		handle->outBuffer[handle->outEnd++] = 'b';
-		msglen = htonl(msglen);
-		memcpy(handle->outBuffer + handle->outEnd, &msglen, 4);
-		handle->outEnd += 4;
-
-		handle->outBuffer[handle->outEnd++] = CREATE_BARRIER_EXECUTE;
-
-		memcpy(handle->outBuffer + handle->outEnd, id, barrier_idlen);
-		handle->outEnd += barrier_idlen;
-
-		handle->state = DN_CONNECTION_STATE_QUERY;
-		pgxc_node_flush(handle);
-	}
-
-	CheckBarrierCommandStatus(conn_handles, id, "EXECUTE");
-
-	pfree_pgxc_all_handles(conn_handles);
+	SendBarrierRequest(conn_handles,
+					   barrier_deferred_flush ? CREATE_BARRIER_INSERT :
+					   CREATE_BARRIER_EXECUTE, id);
 
 	/*
-	 * Also WAL log the BARRIER locally and flush the WAL buffers to disk
+	 * Also WAL log the BARRIER locally while the other nodes do the same
 	 */
-	{
-		XLogRecPtr recptr;
+	*recptr = InsertBarrierRecord(id);
+	if (!barrier_deferred_flush)
+		XLogFlush(*recptr);
 
-		XLogBeginInsert();
-		XLogRegisterData((char *) &id, strlen(id) + 1);
+	CheckBarrierCommandStatus(conn_handles, id, "EXECUTE");
 
-		recptr = XLogInsert(RM_BARRIER_ID, XLOG_BARRIER_CREATE);
-		XLogFlush(recptr);
+	if (!barrier_deferred_flush)
+	{
+		pfree_pgxc_all_handles(conn_handles);
+		return NULL;
 	}
+	return conn_handles;
 }
 
 /*
@@ -429,16 +427,35 @@ EndBarrier(PGXCNodeAllHandles *prepared_handles, const char *id)
 	/* Resume 2PC locally */
 	LWLockRelease(BarrierLock);
 
-	SendBarrierEndRequest(prepared_handles, id);
+	SendBarrierRequest(prepared_handles, CREATE_BARRIER_END, id);
 
 	CheckBarrierCommandStatus(prepared_handles, id, "END");
 }
 
+/*
+ * Make the BARRIER records durable on all the nodes, once the commits
+ * resumed.
+ */
+static void
+FlushBarrier(PGXCNodeAllHandles *conn_handles, const char *id,
+			 XLogRecPtr recptr)
+{
+	SendBarrierRequest(conn_handles, CREATE_BARRIER_FLUSH, id);
+
+	XLogFlush(recptr);
+
+	CheckBarrierCommandStatus(conn_handles, id, "FLUSH");
+
+	pfree_pgxc_all_handles(conn_handles);
+}
+
 void
 RequestBarrier(const char *id, char *completionTag)
 {
 	PGXCNodeAllHandles *prepared_handles;
+	PGXCNodeAllHandles *executed_handles;
 	const char *barrier_id;
+	XLogRecPtr	recptr;
 
 	elog(DEBUG2, "CREATE BARRIER request received");
 	/*
@@ -471,12 +488,20 @@ RequestBarrier(const char *id, char *completionTag)
 	 * Step two. Issue BARRIER command to all involved components, including
 	 * Coordinators and Datanodes
 	 */
-	ExecuteBarrier(barrier_id);
+	executed_handles = ExecuteBarrier(barrier_id, &recptr);
 
 	/*
 	 * Step three. Inform Coordinators about a successfully completed barrier
 	 */
 	EndBarrier(prepared_handles, barrier_id);
+
+	/*
+	 * Step four, with a deferred flush. The commits are not held while the
+	 * nodes write the records to disk
+	 */
+	if (executed_handles)
+		FlushBarrier(executed_handles, barrier_id, recptr);
+
 	/* Finally report the barrier to GTM to backup its restart point */
 	ReportBarrierGTM(barrier_id);
 
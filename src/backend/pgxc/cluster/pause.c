@@ -15,6 +15,8 @@
 #include "pgxc/execRemote.h"
 #include "pgxc/pause.h"
 #include "pgxc/pgxc.h"
+#include "storage/backendid.h"
+#include "storage/barrier.h"
 #include "storage/spin.h"
 #include "miscadmin.h"
 
@@ -164,33 +166,48 @@ HandleClusterPause(bool pause, bool initiator)
 	PG_TRY();
 	{
 		ResponseCombiner combiner;
+		PGXCNodeHandle **pending_handles;
+		int			pending = coord_handles->co_conn_count;
 
 		InitResponseCombiner(&combiner, coord_handles->co_conn_count, COMBINE_TYPE_NONE);
-		for (conn = 0; conn < coord_handles->co_conn_count; conn++)
-		{
-			PGXCNodeHandle *handle;
 
-			handle = coord_handles->coord_handles[conn];
+		/*
+		 * Read the responses as they arrive, from whatever coordinator sends
+		 * them first
+		 */
+		pending_handles = (PGXCNodeHandle **)
+			palloc((pending + 1) * sizeof(PGXCNodeHandle *));
+		memcpy(pending_handles, coord_handles->coord_handles,
+			   pending * sizeof(PGXCNodeHandle *));
+
+		while (pending > 0)
+		{
+			if (pgxc_node_receive(pending, pending_handles, NULL))
+				ereport(ERROR,
+						(errcode(ERRCODE_INTERNAL_ERROR),
+						 errmsg("Failed to receive a response from the remote coordinator node")));
 
-			while (true)
+			conn = 0;
+			while (conn < pending)
 			{
-				if (pgxc_node_receive(1, &handle, NULL))
-					ereport(ERROR,
-							(errcode(ERRCODE_INTERNAL_ERROR),
-							 errmsg("Failed to receive a response from the remote coordinator node")));
+				PGXCNodeHandle *handle = pending_handles[conn];
 
 				response = handle_response(handle, &combiner);
 				if (response == RESPONSE_EOF)
+				{
+					conn++;
 					continue;
-				else if (response == RESPONSE_COMPLETE)
-					break;
-				else
+				}
+				else if (response != RESPONSE_COMPLETE)
 					ereport(ERROR,
 							(errcode(ERRCODE_INTERNAL_ERROR),
 							 errmsg("%s CLUSTER command failed "
 									"with error %s", action, handle->error)));
+
+				pending_handles[conn] = pending_handles[--pending];
 			}
 		}
+		pfree(pending_handles);
 
 		if (combiner.errorMessage)
 		{
@@ -329,7 +346,8 @@ ClusterLockShmemSize(void)
 {
 	Size		size = 0;
 
-	size = add_size(size, sizeof(ClusterLockInfo));
+	size = add_size(size, offsetof(ClusterLockInfo, cl_holding));
+	size = add_size(size, mul_size(MaxBackends, sizeof(bool)));
 
 	return size;
 }
@@ -360,41 +378,57 @@ ClusterLockShmemInit(void)
  *  occur that frequently so most of the calls will come out immediately here
  *  without any sleeps at all
  *
+ *  The lock is taken in shared mode by every statement run on a
+ *  Coordinator, DDL included, so the shared mode only sets the flag of the
+ *  backend and checks that no PAUSE is going on, without taking a spinlock
+ *  every backend would contend for. The exclusive mode announces itself
+ *  first and then checks that no flag is set, so that one of the two sides
+ *  always sees the other. If it cannot go on it backs off, so that a PAUSE
+ *  interrupted while waiting does not leave the cluster stalled.
+ *
  *  We could have used a semaphore to allow the processes to sleep while the
  *  cluster lock is held. But again we are really not worried about performance
  *  and immediate wakeups around PAUSE CLUSTER functionality. Using the sleep
- *  in an infinite loop keeps things simple yet correct
+ *  in an infinite loop keeps things simple yet correct. The sleep starts
+ *  short and grows, so that a PAUSE waiting for a few short queries to
+ *  finish does not keep the cluster stalled longer than they run.
  */
 void
 AcquireClusterLock(bool exclusive)
 {
 	volatile ClusterLockInfo *clinfo = ClustLinfo;
+	long		delay = 1000L;
 
 	if (exclusive && cluster_ex_lock_held)
 	{
 		return;
 	}
 
+	Assert(MyBackendId != InvalidBackendId && MyBackendId <= MaxBackends);
+
 	/*
 	 * In the normal case, none of the backends will ask for exclusive lock, so
-	 * they will just update the cl_process_count value and exit immediately
-	 * from the below loop
+	 * they will just set their flag and exit immediately from the below loop
 	 */
 	for (;;)
 	{
 		bool wait = false;
 
-		SpinLockAcquire(&clinfo->cl_mutex);
-
 		if (!exclusive)
 		{
-			if (clinfo->cl_holder_pid == 0)
-				clinfo->cl_process_count++;
-			else
+			clinfo->cl_holding[MyBackendId - 1] = true;
+			pg_memory_barrier();
+			if (clinfo->cl_holder_pid != 0)
+			{
+				clinfo->cl_holding[MyBackendId - 1] = false;
 				wait = true;
+			}
 		}
 		else /* PAUSE CLUSTER handling */
 		{
+			int			i;
+
+			SpinLockAcquire(&clinfo->cl_mutex);
 			if (clinfo->cl_holder_pid != 0)
 			{
 				SpinLockRelease(&clinfo->cl_mutex);
@@ -402,17 +436,29 @@ AcquireClusterLock(bool exclusive)
 						(errcode(ERRCODE_INTERNAL_ERROR),
 						 errmsg("PAUSE CLUSTER already in progress")));
 			}
+			clinfo->cl_holder_pid = MyProcPid;
+			SpinLockRelease(&clinfo->cl_mutex);
+			pg_memory_barrier();
 
 			/*
 			 * There should be no other process
 			 * holding the lock including ourself
 			 */
-			if (clinfo->cl_process_count  > 0)
-				wait = true;
-			else
-				clinfo->cl_holder_pid = MyProcPid;
+			for (i = 0; i < MaxBackends; i++)
+			{
+				if (clinfo->cl_holding[i])
+				{
+					wait = true;
+					break;
+				}
+			}
+			if (wait)
+			{
+				SpinLockAcquire(&clinfo->cl_mutex);
+				clinfo->cl_holder_pid = 0;
+				SpinLockRelease(&clinfo->cl_mutex);
+			}
 		}
-		SpinLockRelease(&clinfo->cl_mutex);
 
 		/*
 		 * We use a simple sleep mechanism. If PAUSE CLUSTER has been invoked,
@@ -421,7 +467,8 @@ AcquireClusterLock(bool exclusive)
 		if (wait)
 		{
 			CHECK_FOR_INTERRUPTS();
-			pg_usleep(100000L);
+			pg_usleep(delay);
+			delay = Min(delay * 2, 100000L);
 		}
 		else /* Got the proper semantic read/write lock.. */
 			break;
@@ -440,11 +487,10 @@ ReleaseClusterLock(bool exclusive)
 {
 	volatile ClusterLockInfo *clinfo = ClustLinfo;
 
-	SpinLockAcquire(&clinfo->cl_mutex);
 	if (exclusive)
 	{
-		if (clinfo->cl_process_count > 1 ||
-				clinfo->cl_holder_pid == 0)
+		SpinLockAcquire(&clinfo->cl_mutex);
+		if (clinfo->cl_holder_pid != MyProcPid)
 		{
 			SpinLockRelease(&clinfo->cl_mutex);
 			ereport(ERROR,
@@ -458,23 +504,16 @@ ReleaseClusterLock(bool exclusive)
 		 * move ahead
 		 */
 		clinfo->cl_holder_pid = 0;
+		SpinLockRelease(&clinfo->cl_mutex);
 	}
 	else
 	{
-		if (clinfo->cl_holder_pid != 0)
-		{
-			SpinLockRelease(&clinfo->cl_mutex);
-			ereport(ERROR,
-				(errcode(ERRCODE_INTERNAL_ERROR),
-				 errmsg("Inconsistent state while releasing CLUSTER lock")));
-		}
 		/*
-		 * Decrement our count. If a PAUSE is waiting inside AcquireClusterLock
+		 * Clear our flag. If a PAUSE is waiting inside AcquireClusterLock
 		 * elsewhere, it will wake out of sleep and do the needful
 		 */
-		if (clinfo->cl_process_count > 0)
-			clinfo->cl_process_count--;
+		pg_memory_barrier();
+		clinfo->cl_holding[MyBackendId - 1] = false;
 	}
-	SpinLockRelease(&clinfo->cl_mutex);
 }
 #endif
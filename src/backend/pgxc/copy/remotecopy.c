@@ -20,6 +20,7 @@
 
 #include "postgres.h"
 #include "miscadmin.h"
+#include "catalog/pg_type.h"
 #include "lib/stringinfo.h"
 #include "nodes/pg_list.h"
 #include "optimizer/planner.h"
@@ -53,7 +54,10 @@ RemoteCopy_GetRelationLoc(RemoteCopyData *state,
 	 */
 	state->rel_loc = GetRelationLocInfo(RelationGetRelid(rel));
 
-	if (state->rel_loc &&
+	/* The rows are located by the key combining several columns */
+	if (state->rel_loc && state->rel_loc->partAttrNums)
+		state->dist_type = INT4OID;
+	else if (state->rel_loc &&
 			AttributeNumberIsValid(state->rel_loc->partAttrNum))
 	{
 		TupleDesc tdesc;
@@ -148,6 +152,7 @@ RemoteCopy_BuildStatement(RemoteCopyData *state,
 		appendStringInfoChar(&state->query_buf, ')');
 	}
 
+	state->target_pos = state->query_buf.len;
 	if (state->is_from)
 		appendStringInfoString(&state->query_buf, " FROM STDIN");
 	else
@@ -182,6 +187,13 @@ RemoteCopy_BuildStatement(RemoteCopyData *state,
 	if (options->rco_csv_mode)
 		appendStringInfoString(&state->query_buf, " CSV");
 
+	/*
+	 * The table created or truncated in the transaction is new on the
+	 * Datanodes as well, so they can load the rows frozen
+	 */
+	if (options->rco_freeze && state->is_from)
+		appendStringInfoString(&state->query_buf, " FREEZE");
+
 	/*
 	 * It is not necessary to send the HEADER part to Datanodes.
 	 * Sending data is sufficient.
@@ -230,6 +242,33 @@ RemoteCopy_BuildStatement(RemoteCopyData *state,
 }
 
 
+/*
+ * RemoteCopy_FileStatement
+ * Build a COPY TO query making the Datanode write the data to the specified
+ * file on its own file system instead of sending them to the Coordinator.
+ * The header line is written to each file, if requested.
+ */
+char *
+RemoteCopy_FileStatement(RemoteCopyData *state, const char *filename,
+						 bool header)
+{
+	StringInfoData buf;
+
+	Assert(!state->is_from);
+
+	initStringInfo(&buf);
+	appendBinaryStringInfo(&buf, state->query_buf.data, state->target_pos);
+	appendStringInfoString(&buf, " TO ");
+	RemoteCopy_QuoteStr(&buf, (char *) filename);
+	appendStringInfoString(&buf, state->query_buf.data + state->target_pos +
+						   strlen(" TO STDOUT"));
+	if (header)
+		appendStringInfoString(&buf, " HEADER");
+
+	return buf.data;
+}
+
+
 /*
  * Build a default set for RemoteCopyOptions
  */
@@ -246,6 +285,7 @@ makeRemoteCopyOptions(void)
 	res->rco_escape = NULL;
 	res->rco_force_quote = NIL;
 	res->rco_force_notnull = NIL;
+	res->rco_freeze = false;
 	return res;
 }
 
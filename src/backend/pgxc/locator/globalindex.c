@@ -0,0 +1,374 @@
+/*-------------------------------------------------------------------------
+ *
+ * globalindex.c
+ *	  Global secondary indexes of tables distributed by value
+ *
+ * A lookup on a column other than the distribution column of a table has to
+ * be sent to all its Datanodes. A global index of such a column is a hidden
+ * table distributed by the indexed column, mapping its values to the values
+ * of the distribution column. A lookup probes the index on the only node
+ * storing the value, and then runs on the nodes storing the rows found.
+ *
+ * The index is kept up to date by two rules of the indexed table, so it is
+ * maintained in the transaction changing the table. It may keep the entries
+ * of rows since deleted or updated: those only send a lookup to a node
+ * having nothing to return. The rules are recognized by their names, which
+ * give the number of the indexed column.
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/pgxc/locator/globalindex.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/pg_class.h"
+#include "commands/defrem.h"
+#include "executor/spi.h"
+#include "nodes/parsenodes.h"
+#include "parser/parsetree.h"
+#include "pgxc/globalindex.h"
+#include "pgxc/locator.h"
+#include "pgxc/pgxc.h"
+#include "rewrite/prs2lock.h"
+#include "rewrite/rewriteDefine.h"
+#include "rewrite/rewriteManip.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+
+#define GLOBAL_INDEX_INSERT_RULE	"_GIDX_INSERT_%d"
+#define GLOBAL_INDEX_UPDATE_RULE	"_GIDX_UPDATE_%d"
+
+static bool global_index_action_valid(Query *action, AttrNumber attnum,
+						  AttrNumber distattnum);
+static void global_index_execute(const char *sql, int expected);
+
+
+/*
+ * RelationGetGlobalIndex
+ *	Oid of the global index of the given column of a relation, InvalidOid if
+ *	it has none.
+ */
+Oid
+RelationGetGlobalIndex(Relation rel, AttrNumber attnum)
+{
+	RelationLocInfo *rel_loc_info = rel->rd_locator_info;
+	char		rulename[NAMEDATALEN];
+	HeapTuple	tuple;
+	Oid			ruleid;
+	int			i;
+
+	if (rel->rd_rules == NULL || rel_loc_info == NULL ||
+		!IsLocatorDistributedByValue(rel_loc_info->locatorType) ||
+		rel_loc_info->partAttrNums != NIL)
+		return InvalidOid;
+
+	snprintf(rulename, NAMEDATALEN, GLOBAL_INDEX_INSERT_RULE, attnum);
+	tuple = SearchSysCache2(RULERELNAME,
+							ObjectIdGetDatum(RelationGetRelid(rel)),
+							CStringGetDatum(rulename));
+	if (!HeapTupleIsValid(tuple))
+		return InvalidOid;
+	ruleid = HeapTupleGetOid(tuple);
+	ReleaseSysCache(tuple);
+
+	for (i = 0; i < rel->rd_rules->numLocks; i++)
+	{
+		RewriteRule *rule = rel->rd_rules->rules[i];
+		Query	   *action;
+
+		if (rule->ruleId != ruleid)
+			continue;
+
+		/* An index not maintained any more can not be used */
+		if (rule->enabled == RULE_DISABLED || rule->isInstead ||
+			list_length(rule->actions) != 1)
+			return InvalidOid;
+		action = (Query *) linitial(rule->actions);
+		if (!global_index_action_valid(action, attnum,
+									   rel_loc_info->partAttrNum))
+			return InvalidOid;
+		return rt_fetch(action->resultRelation, action->rtable)->relid;
+	}
+	return InvalidOid;
+}
+
+
+/*
+ * RelationHasGlobalIndex
+ *	Does any column of the relation have a global index?
+ */
+bool
+RelationHasGlobalIndex(Relation rel)
+{
+	AttrNumber	attnum;
+
+	if (rel->rd_rules == NULL)
+		return false;
+
+	for (attnum = 1; attnum <= RelationGetNumberOfAttributes(rel); attnum++)
+	{
+		if (OidIsValid(RelationGetGlobalIndex(rel, attnum)))
+			return true;
+	}
+	return false;
+}
+
+
+/*
+ * global_index_action_valid
+ *	Does the action of the insert rule of a global index still store the
+ *	indexed column with the distribution column? The latter is changed when
+ *	the table is redistributed, and the entries are then useless.
+ */
+static bool
+global_index_action_valid(Query *action, AttrNumber attnum,
+						  AttrNumber distattnum)
+{
+	Query	   *select;
+	TargetEntry *tle;
+	Var		   *var;
+
+	if (action->commandType != CMD_INSERT || action->resultRelation == 0)
+		return false;
+
+	select = getInsertSelectQuery(action, NULL);
+	if (select == action || list_length(select->targetList) != 2)
+		return false;
+
+	tle = (TargetEntry *) linitial(select->targetList);
+	var = (Var *) tle->expr;
+	if (!IsA(var, Var) || var->varno != PRS2_NEW_VARNO ||
+		var->varattno != attnum)
+		return false;
+
+	tle = (TargetEntry *) lsecond(select->targetList);
+	var = (Var *) tle->expr;
+	if (!IsA(var, Var) || var->varno != PRS2_NEW_VARNO ||
+		var->varattno != distattnum)
+		return false;
+
+	return true;
+}
+
+
+/*
+ * GlobalIndexLookup
+ *	Probe the global index of a relation for a value of the indexed column,
+ *	and return the list of the Datanodes storing the matching rows.
+ */
+List *
+GlobalIndexLookup(Oid relid, Oid gindexid, Datum value, Oid valuetype)
+{
+	MemoryContext oldcontext = CurrentMemoryContext;
+	MemoryContext spicontext;
+	List	   *nodes = NIL;
+	Relation	rel;
+	Locator    *locator;
+	Oid			disttype;
+	char	   *sql;
+	int			res;
+	uint32		i;
+
+	rel = relation_open(relid, AccessShareLock);
+	disttype = RelationGetDescr(rel)->attrs[
+						rel->rd_locator_info->partAttrNum - 1]->atttypid;
+	locator = GetRelationInsertLocator(rel, disttype);
+
+	sql = psprintf("SELECT DISTINCT dkey FROM %s WHERE val = $1",
+				   quote_qualified_identifier(
+						get_namespace_name(get_rel_namespace(gindexid)),
+						get_rel_name(gindexid)));
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+	spicontext = CurrentMemoryContext;
+
+	res = SPI_execute_with_args(sql, 1, &valuetype, &value, NULL, true, 0);
+	if (res != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute_with_args failed: %s", sql);
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		Datum		dkey;
+		bool		isnull;
+		int			count;
+
+		dkey = SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc,
+							 1, &isnull);
+		count = GET_NODES(locator, dkey, isnull, NULL);
+		Assert(count == 1);
+
+		MemoryContextSwitchTo(oldcontext);
+		nodes = list_append_unique_int(nodes,
+								((int *) getLocatorResults(locator))[0]);
+		MemoryContextSwitchTo(spicontext);
+	}
+
+	SPI_finish();
+	relation_close(rel, AccessShareLock);
+	pfree(sql);
+
+	return nodes;
+}
+
+
+/*
+ * global_index_execute
+ *	Run a command building a global index.
+ */
+static void
+global_index_execute(const char *sql, int expected)
+{
+	if (SPI_exec(sql, 0) != expected)
+		elog(ERROR, "SPI_exec failed: %s", sql);
+}
+
+
+/*
+ * pgxc_create_global_index
+ *	Create a global index of a column of a table distributed by value, and
+ *	return the hidden table storing it. The index is dropped with that table.
+ */
+Datum
+pgxc_create_global_index(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	Name		colname = PG_GETARG_NAME(1);
+	Relation	rel;
+	RelationLocInfo *rel_loc_info;
+	AttrNumber	attnum;
+	Form_pg_attribute attr;
+	Form_pg_attribute distattr;
+	char	   *nspname;
+	char	   *gindexname;
+	char	   *gindex;
+	char	   *table;
+	char	   *col;
+	char	   *distcol;
+	char	   *maintain;
+	StringInfoData buf;
+	Oid			gindexid;
+
+	if (!IS_PGXC_LOCAL_COORDINATOR)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("global indexes can only be created on a Coordinator")));
+
+	/* Rows inserted from this Coordinator must wait for the rules */
+	rel = relation_open(relid, ShareLock);
+	if (!pg_class_ownercheck(relid, GetUserId()))
+		aclcheck_error(ACLCHECK_NOT_OWNER, ACL_KIND_CLASS,
+					   RelationGetRelationName(rel));
+
+	rel_loc_info = rel->rd_locator_info;
+	if (rel->rd_rel->relkind != RELKIND_RELATION || rel_loc_info == NULL ||
+		!IsLocatorDistributedByValue(rel_loc_info->locatorType) ||
+		rel_loc_info->partAttrNums != NIL)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("relation \"%s\" is not distributed by the value of one column",
+						RelationGetRelationName(rel))));
+	if (RelationUsesLocalBuffers(rel))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot create a global index on a temporary table")));
+
+	attnum = get_attnum(relid, NameStr(*colname));
+	if (attnum == InvalidAttrNumber)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_COLUMN),
+				 errmsg("column \"%s\" of relation \"%s\" does not exist",
+						NameStr(*colname), RelationGetRelationName(rel))));
+	if (attnum < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot create a global index on system column \"%s\"",
+						NameStr(*colname))));
+	if (attnum == rel_loc_info->partAttrNum)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("column \"%s\" is the distribution column of relation \"%s\"",
+						NameStr(*colname), RelationGetRelationName(rel))));
+	if (OidIsValid(RelationGetGlobalIndex(rel, attnum)))
+		ereport(ERROR,
+				(errcode(ERRCODE_DUPLICATE_OBJECT),
+				 errmsg("column \"%s\" of relation \"%s\" already has a global index",
+						NameStr(*colname), RelationGetRelationName(rel))));
+
+	attr = RelationGetDescr(rel)->attrs[attnum - 1];
+	distattr = RelationGetDescr(rel)->attrs[rel_loc_info->partAttrNum - 1];
+	if (!IsTypeHashDistributable(attr->atttypid))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("column \"%s\" of type %s can not be indexed globally",
+						NameStr(*colname), format_type_be(attr->atttypid))));
+
+	nspname = get_namespace_name(RelationGetNamespace(rel));
+	gindexname = ChooseRelationName(RelationGetRelationName(rel),
+									NameStr(*colname), "gidx",
+									RelationGetNamespace(rel));
+	gindex = quote_qualified_identifier(nspname, gindexname);
+	table = quote_qualified_identifier(nspname, RelationGetRelationName(rel));
+	col = pstrdup(quote_identifier(NameStr(*colname)));
+	distcol = pstrdup(quote_identifier(NameStr(distattr->attname)));
+
+	/* Action of the rules, adding the entry of a new row if missing */
+	maintain = psprintf("INSERT INTO %s SELECT new.%s, new.%s "
+						"WHERE new.%s IS NOT NULL AND NOT EXISTS "
+						"(SELECT 1 FROM %s WHERE val = new.%s AND dkey = new.%s)",
+						gindex, col, distcol, col, gindex, col, distcol);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf,
+					 "CREATE TABLE %s (val %s, dkey %s) DISTRIBUTE BY HASH (val)",
+					 gindex,
+					 format_type_with_typemod(attr->atttypid, attr->atttypmod),
+					 format_type_with_typemod(distattr->atttypid,
+											  distattr->atttypmod));
+	global_index_execute(buf.data, SPI_OK_UTILITY);
+
+	/*
+	 * Create the rules before filling the index: they lock the table on all
+	 * the Coordinators, so no row can be missed.
+	 */
+	resetStringInfo(&buf);
+	appendStringInfo(&buf, "CREATE RULE \"" GLOBAL_INDEX_INSERT_RULE "\" AS "
+					 "ON INSERT TO %s DO ALSO %s",
+					 attnum, table, maintain);
+	global_index_execute(buf.data, SPI_OK_UTILITY);
+
+	resetStringInfo(&buf);
+	appendStringInfo(&buf, "CREATE RULE \"" GLOBAL_INDEX_UPDATE_RULE "\" AS "
+					 "ON UPDATE TO %s WHERE new.%s IS DISTINCT FROM old.%s "
+					 "DO ALSO %s",
+					 attnum, table, col, col, maintain);
+	global_index_execute(buf.data, SPI_OK_UTILITY);
+
+	resetStringInfo(&buf);
+	appendStringInfo(&buf, "INSERT INTO %s SELECT DISTINCT %s, %s FROM %s "
+					 "WHERE %s IS NOT NULL",
+					 gindex, col, distcol, table, col);
+	global_index_execute(buf.data, SPI_OK_INSERT);
+
+	SPI_finish();
+
+	CommandCounterIncrement();
+	gindexid = get_relname_relid(gindexname, RelationGetNamespace(rel));
+	relation_close(rel, NoLock);
+
+	PG_RETURN_OID(gindexid);
+}
@@ -32,8 +32,12 @@
 #include "access/relscan.h"
 #include "catalog/indexing.h"
 #include "catalog/pg_type.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "nodes/makefuncs.h"
 #include "nodes/pg_list.h"
 #include "nodes/nodeFuncs.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/catcache.h"
 #include "utils/fmgroids.h"
@@ -42,6 +46,8 @@
 #include "utils/relcache.h"
 #include "utils/tqual.h"
 #include "utils/syscache.h"
+#include "utils/typcache.h"
+#include "utils/uuid.h"
 #include "nodes/nodes.h"
 #include "optimizer/clauses.h"
 #include "parser/parse_coerce.h"
@@ -56,8 +62,24 @@
 #include "access/hash.h"
 #ifdef XCP
 #include "utils/date.h"
+#include "utils/inval.h"
 #include "utils/memutils.h"
 
+/*
+ * Hash functions of the most common distribution key types are computed
+ * inline, without going through the function manager. Others are called via
+ * the hashfunc pointer.
+ */
+typedef enum
+{
+	LOCATOR_HASH_GENERIC,		/* call hashfunc */
+	LOCATOR_HASH_INT2,			/* same as hashint2 */
+	LOCATOR_HASH_INT4,			/* same as hashint4 */
+	LOCATOR_HASH_INT8,			/* same as hashint8 */
+	LOCATOR_HASH_TEXT,			/* same as hashtext */
+	LOCATOR_HASH_UUID			/* same as uuid_hash */
+} LocatorHashKind;
+
 /*
  * Locator details are private
  */
@@ -70,6 +92,12 @@ struct _Locator
 	 */
 	int			(*locatefunc) (Locator *self, Datum value, bool isnull,
 								bool *hasprimary);
+	/*
+	 * Determine target node indexes for array of values, if the locator
+	 * always returns exactly one node. NULL otherwise.
+	 */
+	void		(*batchfunc) (Locator *self, int nvalues, Datum *values,
+							  bool *nulls, int *indexes);
 	Oid			dataType; 		/* values of that type are passed to locateNodes function */
 	LocatorListType listType;
 	bool		primary;
@@ -77,7 +105,14 @@ struct _Locator
 	/* XXX: move them into union ? */
 	int			roundRobinNode; /* for LOCATOR_TYPE_RROBIN */
 	LocatorHashFunc	hashfunc; /* for LOCATOR_TYPE_HASH */
+	LocatorHashKind	hashkind; /* hashfunc computed inline, see LocatorHashKind */
 	int 		valuelen; /* 1, 2 or 4 for LOCATOR_TYPE_MODULO */
+	int			nbuckets; /* for LOCATOR_TYPE_BUCKET and LOCATOR_TYPE_RANGE */
+	int		   *bucketMap; /* node map index of each bucket or range */
+	TypeCacheEntry *rangetype; /* comparison function for LOCATOR_TYPE_RANGE */
+	Oid			rangecollation; /* collation of the comparisons */
+	int			nsplits; /* number of split points between the ranges */
+	Datum	   *splits; /* split points in ascending order */
 
 	int			nodeCount; /* How many nodes are in the map */
 	void	   *nodeMap; /* map index to node reference according to listType */
@@ -87,11 +122,29 @@ struct _Locator
 
 Oid		primary_data_node = InvalidOid;
 int		num_preferred_data_nodes = 0;
+int		replicated_read_policy = REPLICATED_READ_LATENCY;
+
+/*
+ * Name of the column holding the tenant key of the multi-tenant tables and
+ * the key of the tenant the session works for, see
+ * restrict_tenant_distribution
+ */
+char	   *TenantColumn = NULL;
+char	   *TenantId = NULL;
+
+/*
+ * Nodes answering up to that many times slower than the fastest one are
+ * still chosen for replicated reads, to spread the load
+ */
+#define REPLICATED_READ_LATENCY_FACTOR 2
 Oid		preferred_data_node[MAX_PREFERRED_NODES];
 
 #ifdef XCP
 static int modulo_value_len(Oid dataType);
 static LocatorHashFunc hash_func_ptr(Oid dataType);
+static Oid hash_func_oid(Oid dataType);
+static bool distribution_key_columns(Node *expr, List **columns);
+static LocatorHashKind hash_func_kind(Oid dataType);
 static int locate_static(Locator *self, Datum value, bool isnull,
 			  bool *hasprimary);
 static int locate_roundrobin(Locator *self, Datum value, bool isnull,
@@ -100,10 +153,31 @@ static int locate_hash_insert(Locator *self, Datum value, bool isnull,
 			  bool *hasprimary);
 static int locate_hash_select(Locator *self, Datum value, bool isnull,
 			  bool *hasprimary);
+static int locate_bucket_insert(Locator *self, Datum value, bool isnull,
+			  bool *hasprimary);
+static int locate_bucket_select(Locator *self, Datum value, bool isnull,
+			  bool *hasprimary);
+static int locate_range_insert(Locator *self, Datum value, bool isnull,
+			  bool *hasprimary);
+static int locate_range_select(Locator *self, Datum value, bool isnull,
+			  bool *hasprimary);
 static int locate_modulo_insert(Locator *self, Datum value, bool isnull,
 			  bool *hasprimary);
 static int locate_modulo_select(Locator *self, Datum value, bool isnull,
 			  bool *hasprimary);
+static void locate_roundrobin_batch(Locator *self, int nvalues, Datum *values,
+						bool *nulls, int *indexes);
+static void locate_hash_batch(Locator *self, int nvalues, Datum *values,
+				  bool *nulls, int *indexes);
+static void locate_bucket_batch(Locator *self, int nvalues, Datum *values,
+					bool *nulls, int *indexes);
+static void locate_range_batch(Locator *self, int nvalues, Datum *values,
+				   bool *nulls, int *indexes);
+static Datum *range_split_values(TypeCacheEntry *typentry, List *ranges);
+static int range_index(TypeCacheEntry *typentry, Oid collation, int nsplits,
+			Datum *splits, Datum value);
+static void locate_modulo_batch(Locator *self, int nvalues, Datum *values,
+					bool *nulls, int *indexes);
 #endif
 
 static const unsigned int xc_mod_m[] =
@@ -171,7 +245,9 @@ static const unsigned int xc_mod_r[][6] =
 
 /*
  * GetAnyDataNode
- * Pick any data node from given set, but try a preferred node
+ * Pick any data node from given set, but try a preferred node.
+ * Depending on replicated_read_policy, among them prefer the nodes the
+ * session is already connected to, then the nodes answering faster.
  */
 int
 GetAnyDataNode(Bitmapset *nodes)
@@ -207,6 +283,51 @@ GetAnyDataNode(Bitmapset *nodes)
 	bms_free(preferred);
 
 	/* If there is a single member nothing to balance */
+	if (nmembers == 1)
+		return members[0];
+
+	/*
+	 * Reading from a node the session is already connected to saves a
+	 * connection and the start of a remote transaction.
+	 */
+	if (replicated_read_policy != REPLICATED_READ_RANDOM)
+	{
+		int			nconnected = 0;
+
+		for (i = 0; i < nmembers; i++)
+			if (PGXCNodeIsConnected(members[i]))
+				members[nconnected++] = members[i];
+		if (nconnected > 0)
+			nmembers = nconnected;
+	}
+
+	/*
+	 * Leave out the nodes much slower than the fastest one, according to the
+	 * round trips counted so far. A loaded or distant node answers slower.
+	 * Nodes without round trips are kept, so they are measured.
+	 */
+	if (replicated_read_policy == REPLICATED_READ_LATENCY && nmembers > 1)
+	{
+		int64		latency[nmembers];
+		int64		best = -1;
+		int			nfast = 0;
+
+		for (i = 0; i < nmembers; i++)
+		{
+			latency[i] = PGXCNodeGetLatency(members[i]);
+			if (latency[i] >= 0 && (best < 0 || latency[i] < best))
+				best = latency[i];
+		}
+		if (best >= 0)
+		{
+			for (i = 0; i < nmembers; i++)
+				if (latency[i] < 0 ||
+					latency[i] <= best * REPLICATED_READ_LATENCY_FACTOR)
+					members[nfast++] = members[i];
+			nmembers = nfast;
+		}
+	}
+
 	if (nmembers == 1)
 		return members[0];
 
@@ -229,7 +350,7 @@ GetAnyDataNode(Bitmapset *nodes)
  * The optimized algos have been taken from
  * http://www-graphics.stanford.edu/~seander/bithacks.html
  */
-static int
+static inline int
 compute_modulo(unsigned int numerator, unsigned int denominator)
 {
 	unsigned int d;
@@ -288,6 +409,9 @@ char *pColName;
 	pColName = GetRelationHashColumn(rel_loc_info);
 	if (pColName == NULL)
 		pColName = GetRelationModuloColumn(rel_loc_info);
+	if (pColName == NULL && rel_loc_info &&
+			rel_loc_info->locatorType == LOCATOR_TYPE_RANGE)
+		pColName = pstrdup(rel_loc_info->partAttrName);
 
 	return pColName;
 }
@@ -314,7 +438,8 @@ GetRelationHashColumn(RelationLocInfo * rel_loc_info)
 
 	if (rel_loc_info == NULL)
 		column_str = NULL;
-	else if (rel_loc_info->locatorType != LOCATOR_TYPE_HASH)
+	else if (rel_loc_info->locatorType != LOCATOR_TYPE_HASH &&
+			 rel_loc_info->locatorType != LOCATOR_TYPE_BUCKET)
 		column_str = NULL;
 	else
 	{
@@ -338,8 +463,23 @@ IsHashColumn(RelationLocInfo *rel_loc_info, char *part_col_name)
 
 	if (!rel_loc_info || !part_col_name)
 		ret_value = false;
-	else if (rel_loc_info->locatorType != LOCATOR_TYPE_HASH)
+	else if (rel_loc_info->locatorType != LOCATOR_TYPE_HASH &&
+			 rel_loc_info->locatorType != LOCATOR_TYPE_BUCKET)
 		ret_value = false;
+	else if (rel_loc_info->partAttrNums != NIL)
+	{
+		/* Any of the columns of a multi-column distribution */
+		ListCell   *lc;
+
+		foreach(lc, rel_loc_info->partAttrNums)
+		{
+			char	   *attname = get_attname(rel_loc_info->relid,
+											  lfirst_int(lc));
+
+			if (attname && strcmp(part_col_name, attname) == 0)
+				ret_value = true;
+		}
+	}
 	else
 		ret_value = !strcmp(part_col_name, rel_loc_info->partAttrName);
 
@@ -375,6 +515,9 @@ IsDistColumnForRelId(Oid relid, char *part_col_name)
 	bRet = IsHashColumn(rel_loc_info, part_col_name);
 	if (bRet == false)
 		IsModuloColumn(rel_loc_info, part_col_name);
+	if (bRet == false && rel_loc_info &&
+			rel_loc_info->locatorType == LOCATOR_TYPE_RANGE)
+		bRet = !strcmp(part_col_name, rel_loc_info->partAttrName);
 	return bRet;
 }
 
@@ -524,11 +667,23 @@ IsLocatorInfoEqual(RelationLocInfo *rel_loc_info1, RelationLocInfo *rel_loc_info
 	if (rel_loc_info1->partAttrNum != rel_loc_info2->partAttrNum)
 		return false;
 
+	/* Same columns of a multi-column distribution? */
+	if (!equal(rel_loc_info1->partAttrNums, rel_loc_info2->partAttrNums))
+		return false;
+
 	/* Same node list? */
 	if (list_difference_int(nodeList1, nodeList2) != NIL ||
 		list_difference_int(nodeList2, nodeList1) != NIL)
 		return false;
 
+	/* Same buckets on the same nodes? */
+	if (!equal(rel_loc_info1->buckets, rel_loc_info2->buckets))
+		return false;
+
+	/* Same split points? */
+	if (!equal(rel_loc_info1->ranges, rel_loc_info2->ranges))
+		return false;
+
 	/* Everything is equal */
 	return true;
 }
@@ -557,6 +712,12 @@ ConvertToLocatorType(int disttype)
 		case DISTTYPE_MODULO:
 			loctype = LOCATOR_TYPE_MODULO;
 			break;
+		case DISTTYPE_BUCKET:
+			loctype = LOCATOR_TYPE_BUCKET;
+			break;
+		case DISTTYPE_RANGE:
+			loctype = LOCATOR_TYPE_RANGE;
+			break;
 		default:
 			ereport(ERROR,
 					(errcode(ERRCODE_WRONG_OBJECT_TYPE),
@@ -576,11 +737,13 @@ char
 GetLocatorType(Oid relid)
 {
 	char		ret = '\0';
+	Relation	rel = relation_open(relid, AccessShareLock);
 
-	RelationLocInfo *ret_loc_info = GetRelationLocInfo(relid);
+	/* Read the relcache entry, no need to copy it for one field */
+	if (rel->rd_locator_info != NULL)
+		ret = rel->rd_locator_info->locatorType;
 
-	if (ret_loc_info != NULL)
-		ret = ret_loc_info->locatorType;
+	relation_close(rel, AccessShareLock);
 
 	return ret;
 }
@@ -629,6 +792,184 @@ GetAllCoordNodes(void)
 }
 
 
+/*
+ * Shared locator cache
+ *
+ * Every backend of a Coordinator reads the pgxc_class tuple of each
+ * distributed relation it uses when it builds the relcache entry.  With many
+ * relations and short sessions these lookups are a large part of the backend
+ * warm-up, so the tuples are kept in shared memory for the other backends of
+ * the node.  Tuples too big for an entry, like those of large bucket maps,
+ * are always read from the catalog.
+ *
+ * Entries are dropped by the pgxc_class syscache invalidations, which the
+ * backend changing the catalog executes at the end of its command.  A
+ * backend that read the catalog before such a change must not store what it
+ * read afterwards, so each invalidation advances a generation counter and a
+ * tuple is only stored if the counter did not move while it was read.
+ * Tuples that are being updated or deleted are not stored either.  The cache
+ * is protected by LocatorCacheLock.
+ */
+#define LOCATOR_CACHE_SIZE			4096
+#define LOCATOR_CACHE_TUPLE_SIZE	256
+
+typedef struct LocatorCacheKey
+{
+	Oid			dbid;
+	Oid			relid;
+} LocatorCacheKey;
+
+typedef struct LocatorCacheEntry
+{
+	LocatorCacheKey key;		/* hash key */
+	uint32		hashvalue;		/* syscache hash value of the tuple */
+	uint32		t_len;			/* length of the tuple */
+	char		t_data[LOCATOR_CACHE_TUPLE_SIZE];	/* the tuple */
+} LocatorCacheEntry;
+
+static HTAB *LocatorCacheHash = NULL;
+static uint64 *LocatorCacheGeneration = NULL;
+static bool LocatorCacheCallbackRegistered = false;
+
+Size
+LocatorCacheShmemSize(void)
+{
+	return add_size(MAXALIGN(sizeof(uint64)),
+					hash_estimate_size(LOCATOR_CACHE_SIZE,
+									   sizeof(LocatorCacheEntry)));
+}
+
+void
+LocatorCacheShmemInit(void)
+{
+	HASHCTL		info;
+	bool		found;
+
+	LocatorCacheGeneration = (uint64 *)
+		ShmemInitStruct("Locator cache generation", sizeof(uint64), &found);
+	if (!found)
+		*LocatorCacheGeneration = 0;
+
+	MemSet(&info, 0, sizeof(info));
+	info.keysize = sizeof(LocatorCacheKey);
+	info.entrysize = sizeof(LocatorCacheEntry);
+
+	LocatorCacheHash = ShmemInitHash("Locator cache",
+									 LOCATOR_CACHE_SIZE, LOCATOR_CACHE_SIZE,
+									 &info, HASH_ELEM | HASH_BLOBS);
+}
+
+/*
+ * Drop the entries of pgxc_class tuples with the given syscache hash value,
+ * or all entries if it is zero.
+ */
+static void
+locator_cache_invalidate(Datum arg, int cacheid, uint32 hashvalue)
+{
+	HASH_SEQ_STATUS status;
+	LocatorCacheEntry *entry;
+
+	LWLockAcquire(LocatorCacheLock, LW_EXCLUSIVE);
+	(*LocatorCacheGeneration)++;
+	hash_seq_init(&status, LocatorCacheHash);
+	while ((entry = (LocatorCacheEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (hashvalue == 0 || entry->hashvalue == hashvalue)
+			hash_search(LocatorCacheHash, &entry->key, HASH_REMOVE, NULL);
+	}
+	LWLockRelease(LocatorCacheLock);
+}
+
+/*
+ * Look up the pgxc_class tuple of the relation in the shared cache.  Returns
+ * a palloc'd copy of the tuple, or NULL, and the current generation of the
+ * cache, to be passed to locator_cache_store() if the tuple was not found.
+ */
+static HeapTuple
+locator_cache_lookup(Oid relid, uint64 *generation)
+{
+	LocatorCacheKey key;
+	LocatorCacheEntry *entry;
+	HeapTuple	htup = NULL;
+
+	if (!LocatorCacheCallbackRegistered)
+	{
+		CacheRegisterSyscacheCallback(PGXCCLASSRELID,
+									  locator_cache_invalidate,
+									  (Datum) 0);
+		LocatorCacheCallbackRegistered = true;
+	}
+
+	MemSet(&key, 0, sizeof(key));
+	key.dbid = MyDatabaseId;
+	key.relid = relid;
+
+	LWLockAcquire(LocatorCacheLock, LW_SHARED);
+	*generation = *LocatorCacheGeneration;
+	entry = (LocatorCacheEntry *) hash_search(LocatorCacheHash, &key,
+											  HASH_FIND, NULL);
+	if (entry)
+	{
+		htup = (HeapTuple) palloc(HEAPTUPLESIZE + entry->t_len);
+		htup->t_len = entry->t_len;
+		ItemPointerSetInvalid(&htup->t_self);
+		htup->t_tableOid = PgxcClassRelationId;
+		htup->t_data = (HeapTupleHeader) ((char *) htup + HEAPTUPLESIZE);
+		memcpy(htup->t_data, entry->t_data, entry->t_len);
+	}
+	LWLockRelease(LocatorCacheLock);
+
+	return htup;
+}
+
+/*
+ * Store the pgxc_class tuple of the relation read from the catalog, unless
+ * the cache was invalidated since the given generation.
+ */
+static void
+locator_cache_store(Oid relid, HeapTuple htup, uint64 generation)
+{
+	LocatorCacheKey key;
+	LocatorCacheEntry *entry;
+
+	if (htup->t_len > LOCATOR_CACHE_TUPLE_SIZE)
+		return;
+
+	/* The tuple is being updated or deleted, don't keep it */
+	if (!(htup->t_data->t_infomask & HEAP_XMAX_INVALID) &&
+		TransactionIdIsValid(HeapTupleHeaderGetRawXmax(htup->t_data)))
+		return;
+
+	MemSet(&key, 0, sizeof(key));
+	key.dbid = MyDatabaseId;
+	key.relid = relid;
+
+	LWLockAcquire(LocatorCacheLock, LW_EXCLUSIVE);
+	if (*LocatorCacheGeneration == generation)
+	{
+		/* Start over when full, entries of dropped databases pile up */
+		if (hash_get_num_entries(LocatorCacheHash) >= LOCATOR_CACHE_SIZE)
+		{
+			HASH_SEQ_STATUS status;
+
+			hash_seq_init(&status, LocatorCacheHash);
+			while ((entry = (LocatorCacheEntry *) hash_seq_search(&status)) != NULL)
+				hash_search(LocatorCacheHash, &entry->key, HASH_REMOVE, NULL);
+		}
+
+		entry = (LocatorCacheEntry *) hash_search(LocatorCacheHash, &key,
+												  HASH_ENTER_NULL, NULL);
+		if (entry)
+		{
+			entry->hashvalue = GetSysCacheHashValue1(PGXCCLASSRELID,
+													 ObjectIdGetDatum(relid));
+			entry->t_len = htup->t_len;
+			memcpy(entry->t_data, htup->t_data, htup->t_len);
+		}
+	}
+	LWLockRelease(LocatorCacheLock);
+}
+
 /*
  * Build locator information associated with the specified relation.
  */
@@ -637,30 +978,38 @@ RelationBuildLocator(Relation rel)
 {
 	Relation	pcrel;
 	ScanKeyData	skey;
-	SysScanDesc	pcscan;
+	SysScanDesc	pcscan = NULL;
 	HeapTuple	htup;
 	MemoryContext	oldContext;
 	RelationLocInfo	*relationLocInfo;
 	int		j;
 	Form_pgxc_class	pgxc_class;
-
-	ScanKeyInit(&skey,
-				Anum_pgxc_class_pcrelid,
-				BTEqualStrategyNumber, F_OIDEQ,
-				ObjectIdGetDatum(RelationGetRelid(rel)));
+	uint64		generation;
 
 	pcrel = heap_open(PgxcClassRelationId, AccessShareLock);
-	pcscan = systable_beginscan(pcrel, PgxcClassPgxcRelIdIndexId, true,
-								SnapshotSelf, 1, &skey);
-	htup = systable_getnext(pcscan);
 
-	if (!HeapTupleIsValid(htup))
+	htup = locator_cache_lookup(RelationGetRelid(rel), &generation);
+	if (htup == NULL)
 	{
-		/* Assume local relation only */
-		rel->rd_locator_info = NULL;
-		systable_endscan(pcscan);
-		heap_close(pcrel, AccessShareLock);
-		return;
+		ScanKeyInit(&skey,
+					Anum_pgxc_class_pcrelid,
+					BTEqualStrategyNumber, F_OIDEQ,
+					ObjectIdGetDatum(RelationGetRelid(rel)));
+
+		pcscan = systable_beginscan(pcrel, PgxcClassPgxcRelIdIndexId, true,
+									SnapshotSelf, 1, &skey);
+		htup = systable_getnext(pcscan);
+
+		if (!HeapTupleIsValid(htup))
+		{
+			/* Assume local relation only */
+			rel->rd_locator_info = NULL;
+			systable_endscan(pcscan);
+			heap_close(pcrel, AccessShareLock);
+			return;
+		}
+
+		locator_cache_store(RelationGetRelid(rel), htup, generation);
 	}
 
 	pgxc_class = (Form_pgxc_class) GETSTRUCT(htup);
@@ -672,11 +1021,33 @@ RelationBuildLocator(Relation rel)
 
 	relationLocInfo->relid = RelationGetRelid(rel);
 	relationLocInfo->locatorType = pgxc_class->pclocatortype;
+	relationLocInfo->insertLocator = NULL;
+	relationLocInfo->locatorcxt = NULL;
 
 	relationLocInfo->partAttrNum = pgxc_class->pcattnum;
 
 	relationLocInfo->partAttrName = get_attname(relationLocInfo->relid, pgxc_class->pcattnum);
 
+	/* All the columns of a multi-column distribution, the first is above */
+	relationLocInfo->partAttrNums = NIL;
+	if (relationLocInfo->locatorType == LOCATOR_TYPE_HASH)
+	{
+		Datum		datum;
+		bool		isnull;
+
+		datum = heap_getattr(htup, Anum_pgxc_class_pcattnums,
+							 RelationGetDescr(pcrel), &isnull);
+		if (!isnull)
+		{
+			int2vector *attnums = (int2vector *) DatumGetPointer(datum);
+
+			for (j = 0; j < attnums->dim1; j++)
+				relationLocInfo->partAttrNums =
+					lappend_int(relationLocInfo->partAttrNums,
+								attnums->values[j]);
+		}
+	}
+
 	relationLocInfo->nodeList = NIL;
 
 	for (j = 0; j < pgxc_class->nodeoids.dim1; j++)
@@ -686,6 +1057,56 @@ RelationBuildLocator(Relation rel)
 		relationLocInfo->nodeList = lappend_int(relationLocInfo->nodeList, nid);
 	}
 
+	/*
+	 * The bucket map refers to the nodes by position in the node list,
+	 * remember the node indexes instead.
+	 */
+	relationLocInfo->buckets = NIL;
+	if (relationLocInfo->locatorType == LOCATOR_TYPE_BUCKET)
+	{
+		Datum		datum;
+		bool		isnull;
+
+		datum = heap_getattr(htup, Anum_pgxc_class_pcbucketmap,
+							 RelationGetDescr(pcrel), &isnull);
+		if (!isnull)
+		{
+			int2vector *bucketmap = (int2vector *) DatumGetPointer(datum);
+
+			for (j = 0; j < bucketmap->dim1; j++)
+				relationLocInfo->buckets = lappend_int(relationLocInfo->buckets,
+						list_nth_int(relationLocInfo->nodeList,
+									 bucketmap->values[j]));
+		}
+	}
+
+	/*
+	 * Range i of a range distribution is stored on node i of the node list,
+	 * the ranges are delimited by the split points.
+	 */
+	relationLocInfo->ranges = NIL;
+	if (relationLocInfo->locatorType == LOCATOR_TYPE_RANGE)
+	{
+		Datum		datum;
+		bool		isnull;
+
+		relationLocInfo->buckets = list_copy(relationLocInfo->nodeList);
+		datum = heap_getattr(htup, Anum_pgxc_class_pcranges,
+							 RelationGetDescr(pcrel), &isnull);
+		if (!isnull)
+		{
+			Datum	   *splits;
+			int			nsplits;
+
+			deconstruct_array(DatumGetArrayTypeP(datum),
+							  TEXTOID, -1, false, 'i',
+							  &splits, NULL, &nsplits);
+			for (j = 0; j < nsplits; j++)
+				relationLocInfo->ranges = lappend(relationLocInfo->ranges,
+						makeString(TextDatumGetCString(splits[j])));
+		}
+	}
+
 	/*
 	 * If the locator type is round robin, we set a node to
 	 * use next time. In addition, if it is replicated,
@@ -707,10 +1128,13 @@ RelationBuildLocator(Relation rel)
 			relationLocInfo->roundRobinNode = relationLocInfo->roundRobinNode->next;
 	}
 
-	systable_endscan(pcscan);
-	heap_close(pcrel, AccessShareLock);
-
 	MemoryContextSwitchTo(oldContext);
+
+	if (pcscan)
+		systable_endscan(pcscan);
+	else
+		heap_freetuple(htup);
+	heap_close(pcrel, AccessShareLock);
 }
 
 /*
@@ -740,11 +1164,12 @@ GetRelationLocInfo(Oid relid)
 char
 GetRelationLocType(Oid relid)
 {
-	RelationLocInfo *locinfo = GetRelationLocInfo(relid);
-	if (!locinfo)
+	char		ret = GetLocatorType(relid);
+
+	if (ret == '\0')
 		return LOCATOR_TYPE_NONE;
 
-	return locinfo->locatorType;
+	return ret;
 }
 
 /*
@@ -764,10 +1189,16 @@ CopyRelationLocInfo(RelationLocInfo * src_info)
 	dest_info->partAttrNum = src_info->partAttrNum;
 	if (src_info->partAttrName)
 		dest_info->partAttrName = pstrdup(src_info->partAttrName);
+	if (src_info->partAttrNums)
+		dest_info->partAttrNums = list_copy(src_info->partAttrNums);
 
 	if (src_info->nodeList)
 		dest_info->nodeList = list_copy(src_info->nodeList);
 	/* Note, for round robin, we use the relcache entry */
+	if (src_info->buckets)
+		dest_info->buckets = list_copy(src_info->buckets);
+	if (src_info->ranges)
+		dest_info->ranges = (List *) copyObject(src_info->ranges);
 
 	return dest_info;
 }
@@ -783,11 +1214,137 @@ FreeRelationLocInfo(RelationLocInfo *relationLocInfo)
 	{
 		if (relationLocInfo->partAttrName)
 			pfree(relationLocInfo->partAttrName);
+		list_free(relationLocInfo->partAttrNums);
+		list_free(relationLocInfo->buckets);
+		list_free(relationLocInfo->ranges);
+		FreeRelationInsertLocator(relationLocInfo);
 		pfree(relationLocInfo);
 	}
 }
 
 
+/*
+ * Position in the new node list of the old node of the bucket, -1 if the
+ * node is removed.
+ */
+static int
+bucket_new_position(int16 oldpos, Oid *oldnodes, int oldcount,
+					Oid *newnodes, int newcount)
+{
+	int			j;
+
+	if (oldpos < 0 || oldpos >= oldcount)
+		return -1;
+	for (j = 0; j < newcount; j++)
+	{
+		if (newnodes[j] == oldnodes[oldpos])
+			return j;
+	}
+	return -1;
+}
+
+
+/*
+ * Assign the buckets of a bucket distributed table to the nodes of the new
+ * node list. The maps hold the position of the node of each bucket in the
+ * respective node list, oldmap is NULL if the table was not distributed by
+ * buckets before.
+ *
+ * Every node gets an even share of the buckets. A bucket stays where it is
+ * if its node is still in the list and has not yet got its share, so only
+ * the buckets of the removed nodes and the surplus of the remaining nodes
+ * are moved. The result does not depend on the order of the node lists,
+ * the nodes with lower Oids get the remainder and are filled up first.
+ *
+ * If maxmoves is positive at most that many buckets of the surplus are
+ * moved, the others stay on their nodes until the map is built again from
+ * the result. The buckets of the removed nodes are always moved.
+ */
+int16 *
+BuildBucketMap(int nbuckets, Oid *oldnodes, int oldcount, int16 *oldmap,
+			   Oid *newnodes, int newcount, int maxmoves)
+{
+	int16	   *map = (int16 *) palloc(nbuckets * sizeof(int16));
+	int		   *order = (int *) palloc(newcount * sizeof(int));
+	int		   *share = (int *) palloc(newcount * sizeof(int));
+	int		   *count = (int *) palloc0(newcount * sizeof(int));
+	int			i, j;
+
+	Assert(newcount > 0);
+
+	/* Sort node positions by Oid */
+	for (i = 0; i < newcount; i++)
+	{
+		for (j = i; j > 0 && newnodes[order[j - 1]] > newnodes[i]; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+	for (i = 0; i < newcount; i++)
+		share[order[i]] = nbuckets / newcount +
+				(i < nbuckets % newcount ? 1 : 0);
+
+	/* Keep the buckets that may stay on their nodes */
+	for (i = 0; i < nbuckets; i++)
+	{
+		map[i] = -1;
+		if (oldmap)
+		{
+			j = bucket_new_position(oldmap[i], oldnodes, oldcount,
+									newnodes, newcount);
+			if (j >= 0 && count[j] < share[j])
+			{
+				map[i] = j;
+				count[j]++;
+			}
+		}
+	}
+
+	/* Leave the surplus beyond the allowed moves where it is */
+	if (oldmap && maxmoves > 0)
+	{
+		int			surplus = 0;
+
+		for (i = 0; i < nbuckets; i++)
+		{
+			if (map[i] < 0 &&
+					bucket_new_position(oldmap[i], oldnodes, oldcount,
+										newnodes, newcount) >= 0)
+				surplus++;
+		}
+		for (i = nbuckets - 1; i >= 0 && surplus > maxmoves; i--)
+		{
+			if (map[i] >= 0)
+				continue;
+			j = bucket_new_position(oldmap[i], oldnodes, oldcount,
+									newnodes, newcount);
+			if (j >= 0)
+			{
+				map[i] = j;
+				count[j]++;
+				surplus--;
+			}
+		}
+	}
+
+	/* Move the others to the nodes having less than their share */
+	j = 0;
+	for (i = 0; i < nbuckets; i++)
+	{
+		if (map[i] >= 0)
+			continue;
+		while (count[order[j]] >= share[order[j]])
+			j++;
+		map[i] = order[j];
+		count[order[j]]++;
+	}
+
+	pfree(order);
+	pfree(share);
+	pfree(count);
+	return map;
+}
+
+
 /*
  * Free the contents of the ExecNodes expression */
 void
@@ -883,34 +1440,323 @@ hash_func_ptr(Oid dataType)
 }
 
 
-Locator *
-createLocator(char locatorType, RelationAccessType accessType,
-			  Oid dataType, LocatorListType listType, int nodeCount,
-			  void *nodeList, void **result, bool primary)
+/*
+ * Oid of the function hash_func_ptr returns for the type
+ */
+static Oid
+hash_func_oid(Oid dataType)
 {
-	Locator    *locator;
+	switch (dataType)
+	{
+		case INT8OID:
+		case CASHOID:
+			return F_HASHINT8;
+		case INT2OID:
+			return F_HASHINT2;
+		case OIDOID:
+			return F_HASHOID;
+		case INT4OID:
+		case ABSTIMEOID:
+		case RELTIMEOID:
+		case DATEOID:
+			return F_HASHINT4;
+		case BOOLOID:
+		case CHAROID:
+			return F_HASHCHAR;
+		case NAMEOID:
+			return F_HASHNAME;
+		case INT2VECTOROID:
+			return F_HASHINT2VECTOR;
+		case VARCHAROID:
+		case TEXTOID:
+			return F_HASHTEXT;
+		case OIDVECTOROID:
+			return F_HASHOIDVECTOR;
+		case BPCHAROID:
+			return F_HASHBPCHAR;
+		case BYTEAOID:
+			return F_HASHVARLENA;
+		case TIMEOID:
+			return F_TIME_HASH;
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			return F_TIMESTAMP_HASH;
+		case INTERVALOID:
+			return F_INTERVAL_HASH;
+		case TIMETZOID:
+			return F_TIMETZ_HASH;
+		case NUMERICOID:
+			return F_HASH_NUMERIC;
+		case UUIDOID:
+			return F_UUID_HASH;
+		default:
+			return InvalidOid;
+	}
+}
+
+
+/*
+ * A table hash distributed by more than one column is located by an int4
+ * key combining the hashes of the columns:
+ *
+ *		key = COALESCE(hash(c1), 0)
+ *		key = hashint4(key) # COALESCE(hash(cN), 0), for each next column
+ *
+ * The key is then hashed like a single int4 distribution column. Being an
+ * ordinary expression it can be computed wherever the tuples are, and
+ * compared, folded and evaluated by the planner as any other distribution
+ * expression.
+ *
+ * MakeDistributionKeyExpr builds the key expression of the given column
+ * expressions, in the order of the distribution.
+ */
+Node *
+MakeDistributionKeyExpr(List *keyexprs)
+{
+	Node	   *result = NULL;
 	ListCell   *lc;
-	void 	   *nodeMap = NULL;
-	int 		i;
 
-	locator = (Locator *) palloc(sizeof(Locator));
-	locator->dataType = dataType;
-	locator->listType = listType;
-	locator->nodeCount = nodeCount;
-	/* Create node map */
-	switch (listType)
+	foreach(lc, keyexprs)
 	{
-		case LOCATOR_LIST_NONE:
-			/* No map, return indexes */
-			break;
-		case LOCATOR_LIST_INT:
-			/* Copy integer array */
-			nodeMap = palloc(nodeCount * sizeof(int));
-			memcpy(nodeMap, nodeList, nodeCount * sizeof(int));
-			break;
-		case LOCATOR_LIST_OID:
-			/* Copy array of Oids */
-			nodeMap = palloc(nodeCount * sizeof(Oid));
+		Node	   *expr = (Node *) lfirst(lc);
+		CoalesceExpr *hash = makeNode(CoalesceExpr);
+
+		hash->coalescetype = INT4OID;
+		hash->coalescecollid = InvalidOid;
+		hash->args = list_make2(makeFuncExpr(hash_func_oid(exprType(expr)),
+											 INT4OID, list_make1(expr),
+											 InvalidOid, InvalidOid,
+											 COERCE_EXPLICIT_CALL),
+								makeConst(INT4OID, -1, InvalidOid,
+										  sizeof(int32), Int32GetDatum(0),
+										  false, true));
+		hash->location = -1;
+
+		if (result == NULL)
+			result = (Node *) hash;
+		else
+			result = (Node *) makeFuncExpr(F_INT4XOR, INT4OID,
+							list_make2(makeFuncExpr(F_HASHINT4, INT4OID,
+													list_make1(result),
+													InvalidOid, InvalidOid,
+													COERCE_EXPLICIT_CALL),
+									   hash),
+							InvalidOid, InvalidOid, COERCE_EXPLICIT_CALL);
+	}
+	return result;
+}
+
+
+/*
+ * Append to the list the column expressions of a key expression built by
+ * MakeDistributionKeyExpr, return false if it is not one.
+ */
+static bool
+distribution_key_columns(Node *expr, List **columns)
+{
+	CoalesceExpr *hash;
+	FuncExpr   *func;
+	Node	   *arg;
+
+	if (IsA(expr, FuncExpr) && ((FuncExpr *) expr)->funcid == F_INT4XOR)
+	{
+		FuncExpr   *rehash;
+
+		func = (FuncExpr *) expr;
+		if (list_length(func->args) != 2)
+			return false;
+		rehash = (FuncExpr *) linitial(func->args);
+		if (!IsA(rehash, FuncExpr) || rehash->funcid != F_HASHINT4 ||
+				!distribution_key_columns((Node *) linitial(rehash->args),
+										  columns))
+			return false;
+		expr = (Node *) lsecond(func->args);
+	}
+
+	if (!IsA(expr, CoalesceExpr))
+		return false;
+	hash = (CoalesceExpr *) expr;
+	if (list_length(hash->args) != 2 || !IsA(linitial(hash->args), FuncExpr))
+		return false;
+	func = (FuncExpr *) linitial(hash->args);
+	if (list_length(func->args) != 1)
+		return false;
+	arg = (Node *) linitial(func->args);
+	if (func->funcid != hash_func_oid(exprType(arg)))
+		return false;
+
+	*columns = lappend(*columns, arg);
+	return true;
+}
+
+
+/*
+ * GetDistributionKeyColumns
+ *	The column expressions of a key expression built by
+ *	MakeDistributionKeyExpr, NIL if the expression is not such a key.
+ */
+List *
+GetDistributionKeyColumns(Node *expr)
+{
+	List	   *columns = NIL;
+
+	if (expr == NULL || !distribution_key_columns(expr, &columns) ||
+			list_length(columns) < 2)
+	{
+		list_free(columns);
+		return NIL;
+	}
+	return columns;
+}
+
+
+/*
+ * ComputeDistributionKey
+ *	Value of the key expression of a table distributed by more than one
+ *	column, computed from the column values of a tuple.
+ */
+Datum
+ComputeDistributionKey(RelationLocInfo *rel_loc_info, TupleDesc tupdesc,
+					   Datum *values, bool *nulls)
+{
+	uint32		key = 0;
+	ListCell   *lc;
+
+	foreach(lc, rel_loc_info->partAttrNums)
+	{
+		int			attidx = lfirst_int(lc) - 1;
+		uint32		hash = 0;
+
+		if (!nulls[attidx])
+			hash = DatumGetUInt32(DirectFunctionCall1(
+						hash_func_ptr(tupdesc->attrs[attidx]->atttypid),
+						values[attidx]));
+
+		if (lc == list_head(rel_loc_info->partAttrNums))
+			key = hash;
+		else
+			key = DatumGetUInt32(hash_uint32(key)) ^ hash;
+	}
+	return Int32GetDatum((int32) key);
+}
+
+
+/*
+ * Determine if the hash function of the type can be computed inline
+ */
+static LocatorHashKind
+hash_func_kind(Oid dataType)
+{
+	switch (dataType)
+	{
+		case INT8OID:
+		case CASHOID:
+			return LOCATOR_HASH_INT8;
+#ifdef HAVE_INT64_TIMESTAMP
+		/* time_hash and timestamp_hash are hashint8 then */
+		case TIMEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			return LOCATOR_HASH_INT8;
+#endif
+		case INT2OID:
+			return LOCATOR_HASH_INT2;
+		case INT4OID:
+		case OIDOID:
+		case ABSTIMEOID:
+		case RELTIMEOID:
+		case DATEOID:
+			return LOCATOR_HASH_INT4;
+		case VARCHAROID:
+		case TEXTOID:
+			return LOCATOR_HASH_TEXT;
+		case UUIDOID:
+			return LOCATOR_HASH_UUID;
+		default:
+			return LOCATOR_HASH_GENERIC;
+	}
+}
+
+
+/*
+ * Compute hash of the non-NULL value, the result is the same as of the
+ * hashfunc of the locator.
+ */
+static inline uint32
+locator_hash(Locator *self, Datum value)
+{
+	switch (self->hashkind)
+	{
+		case LOCATOR_HASH_INT2:
+			return DatumGetUInt32(hash_uint32((int32) DatumGetInt16(value)));
+		case LOCATOR_HASH_INT4:
+			return DatumGetUInt32(hash_uint32(DatumGetInt32(value)));
+		case LOCATOR_HASH_INT8:
+		{
+			int64		val = DatumGetInt64(value);
+			uint32		lohalf = (uint32) val;
+			uint32		hihalf = (uint32) (val >> 32);
+
+			lohalf ^= (val >= 0) ? hihalf : ~hihalf;
+			return DatumGetUInt32(hash_uint32(lohalf));
+		}
+		case LOCATOR_HASH_TEXT:
+		{
+			text	   *key = DatumGetTextPP(value);
+			uint32		result;
+
+			result = DatumGetUInt32(hash_any((unsigned char *) VARDATA_ANY(key),
+											 VARSIZE_ANY_EXHDR(key)));
+			if ((Pointer) key != DatumGetPointer(value))
+				pfree(key);
+			return result;
+		}
+		case LOCATOR_HASH_UUID:
+			/* pg_uuid_t is opaque, it is just the bytes of the value */
+			return DatumGetUInt32(hash_any((unsigned char *) DatumGetPointer(value),
+										   UUID_LEN));
+		default:
+			return (uint32) DatumGetInt32(DirectFunctionCall1(self->hashfunc,
+															  value));
+	}
+}
+
+
+Locator *
+createLocator(char locatorType, RelationAccessType accessType,
+			  Oid dataType, LocatorListType listType, int nodeCount,
+			  void *nodeList, void **result, bool primary)
+{
+	Locator    *locator;
+	ListCell   *lc;
+	void 	   *nodeMap = NULL;
+	int 		i;
+
+	locator = (Locator *) palloc(sizeof(Locator));
+	locator->batchfunc = NULL;
+	locator->nbuckets = 0;
+	locator->bucketMap = NULL;
+	locator->rangetype = NULL;
+	locator->rangecollation = InvalidOid;
+	locator->nsplits = 0;
+	locator->splits = NULL;
+	locator->dataType = dataType;
+	locator->listType = listType;
+	locator->nodeCount = nodeCount;
+	/* Create node map */
+	switch (listType)
+	{
+		case LOCATOR_LIST_NONE:
+			/* No map, return indexes */
+			break;
+		case LOCATOR_LIST_INT:
+			/* Copy integer array */
+			nodeMap = palloc(nodeCount * sizeof(int));
+			memcpy(nodeMap, nodeList, nodeCount * sizeof(int));
+			break;
+		case LOCATOR_LIST_OID:
+			/* Copy array of Oids */
+			nodeMap = palloc(nodeCount * sizeof(Oid));
 			memcpy(nodeMap, nodeList, nodeCount * sizeof(Oid));
 			break;
 		case LOCATOR_LIST_POINTER:
@@ -984,6 +1830,7 @@ createLocator(char locatorType, RelationAccessType accessType,
 			else
 			{
 				locator->locatefunc = locate_roundrobin;
+				locator->batchfunc = locate_roundrobin_batch;
 				locator->nodeMap = nodeMap;
 				switch (locator->listType)
 				{
@@ -1009,6 +1856,7 @@ createLocator(char locatorType, RelationAccessType accessType,
 			if (accessType == RELATION_ACCESS_INSERT)
 			{
 				locator->locatefunc = locate_roundrobin;
+				locator->batchfunc = locate_roundrobin_batch;
 				locator->nodeMap = nodeMap;
 				switch (locator->listType)
 				{
@@ -1049,6 +1897,7 @@ createLocator(char locatorType, RelationAccessType accessType,
 			if (accessType == RELATION_ACCESS_INSERT)
 			{
 				locator->locatefunc = locate_hash_insert;
+				locator->batchfunc = locate_hash_batch;
 				locator->nodeMap = nodeMap;
 				switch (locator->listType)
 				{
@@ -1095,11 +1944,13 @@ createLocator(char locatorType, RelationAccessType accessType,
 			if (locator->hashfunc == NULL)
 				ereport(ERROR, (errmsg("Error: unsupported data type for HASH locator: %d\n",
 								   dataType)));
+			locator->hashkind = hash_func_kind(dataType);
 			break;
 		case LOCATOR_TYPE_MODULO:
 			if (accessType == RELATION_ACCESS_INSERT)
 			{
 				locator->locatefunc = locate_modulo_insert;
+				locator->batchfunc = locate_modulo_batch;
 				locator->nodeMap = nodeMap;
 				switch (locator->listType)
 				{
@@ -1147,6 +1998,131 @@ createLocator(char locatorType, RelationAccessType accessType,
 				ereport(ERROR, (errmsg("Error: unsupported data type for MODULO locator: %d\n",
 								   dataType)));
 			break;
+		case LOCATOR_TYPE_BUCKET:
+			if (accessType == RELATION_ACCESS_INSERT)
+			{
+				locator->locatefunc = locate_bucket_insert;
+				locator->batchfunc = locate_bucket_batch;
+				locator->nodeMap = nodeMap;
+				switch (locator->listType)
+				{
+					case LOCATOR_LIST_NONE:
+					case LOCATOR_LIST_INT:
+						locator->results = palloc(sizeof(int));
+						break;
+					case LOCATOR_LIST_OID:
+						locator->results = palloc(sizeof(Oid));
+						break;
+					case LOCATOR_LIST_POINTER:
+						locator->results = palloc(sizeof(void *));
+						break;
+					case LOCATOR_LIST_LIST:
+						/* Should never happen */
+						Assert(false);
+						break;
+				}
+			}
+			else
+			{
+				locator->locatefunc = locate_bucket_select;
+				locator->nodeMap = nodeMap;
+				switch (locator->listType)
+				{
+					case LOCATOR_LIST_NONE:
+					case LOCATOR_LIST_INT:
+						locator->results = palloc(locator->nodeCount * sizeof(int));
+						break;
+					case LOCATOR_LIST_OID:
+						locator->results = palloc(locator->nodeCount * sizeof(Oid));
+						break;
+					case LOCATOR_LIST_POINTER:
+						locator->results = palloc(locator->nodeCount * sizeof(void *));
+						break;
+					case LOCATOR_LIST_LIST:
+						/* Should never happen */
+						Assert(false);
+						break;
+				}
+			}
+
+			locator->hashfunc = hash_func_ptr(dataType);
+			if (locator->hashfunc == NULL)
+				ereport(ERROR, (errmsg("Error: unsupported data type for BUCKET locator: %d\n",
+								   dataType)));
+			locator->hashkind = hash_func_kind(dataType);
+
+			/*
+			 * Until the caller sets the actual bucket map the buckets are
+			 * assigned to the nodes in turn.
+			 */
+			locator->nbuckets = BUCKET_MAP_SIZE;
+			locator->bucketMap = (int *) palloc(BUCKET_MAP_SIZE * sizeof(int));
+			for (i = 0; i < BUCKET_MAP_SIZE; i++)
+				locator->bucketMap[i] = i % locator->nodeCount;
+			break;
+		case LOCATOR_TYPE_RANGE:
+			if (accessType == RELATION_ACCESS_INSERT)
+			{
+				locator->locatefunc = locate_range_insert;
+				locator->batchfunc = locate_range_batch;
+				locator->nodeMap = nodeMap;
+				switch (locator->listType)
+				{
+					case LOCATOR_LIST_NONE:
+					case LOCATOR_LIST_INT:
+						locator->results = palloc(sizeof(int));
+						break;
+					case LOCATOR_LIST_OID:
+						locator->results = palloc(sizeof(Oid));
+						break;
+					case LOCATOR_LIST_POINTER:
+						locator->results = palloc(sizeof(void *));
+						break;
+					case LOCATOR_LIST_LIST:
+						/* Should never happen */
+						Assert(false);
+						break;
+				}
+			}
+			else
+			{
+				locator->locatefunc = locate_range_select;
+				locator->nodeMap = nodeMap;
+				switch (locator->listType)
+				{
+					case LOCATOR_LIST_NONE:
+					case LOCATOR_LIST_INT:
+						locator->results = palloc(locator->nodeCount * sizeof(int));
+						break;
+					case LOCATOR_LIST_OID:
+						locator->results = palloc(locator->nodeCount * sizeof(Oid));
+						break;
+					case LOCATOR_LIST_POINTER:
+						locator->results = palloc(locator->nodeCount * sizeof(void *));
+						break;
+					case LOCATOR_LIST_LIST:
+						/* Should never happen */
+						Assert(false);
+						break;
+				}
+			}
+
+			locator->rangetype = lookup_type_cache(dataType,
+												   TYPECACHE_CMP_PROC_FINFO);
+			locator->rangecollation = get_typcollation(dataType);
+			if (!OidIsValid(locator->rangetype->cmp_proc))
+				ereport(ERROR, (errmsg("Error: unsupported data type for RANGE locator: %d\n",
+								   dataType)));
+
+			/*
+			 * Range i is on node i. Until the caller sets the split points
+			 * the locator refuses to work, unless there is a single range.
+			 */
+			locator->nbuckets = locator->nodeCount;
+			locator->bucketMap = (int *) palloc(locator->nodeCount * sizeof(int));
+			for (i = 0; i < locator->nodeCount; i++)
+				locator->bucketMap[i] = i;
+			break;
 		default:
 			ereport(ERROR, (errmsg("Error: no such supported locator type: %c\n",
 								   locatorType)));
@@ -1159,9 +2135,161 @@ createLocator(char locatorType, RelationAccessType accessType,
 }
 
 
+/*
+ * Set the bucket map of the LOCATOR_TYPE_BUCKET locator, or the node of each
+ * range of the LOCATOR_TYPE_RANGE locator. The buckets list holds the node
+ * index of each bucket, nodeList the node indexes of the nodes the locator
+ * was created with, in the same order.
+ */
+void
+setLocatorBuckets(Locator *locator, List *buckets, List *nodeList)
+{
+	ListCell   *lc;
+	int			nbuckets = list_length(buckets);
+	int			i;
+
+	if (locator->bucketMap == NULL || nbuckets == 0)
+		return;
+
+	if (nbuckets != locator->nbuckets)
+	{
+		pfree(locator->bucketMap);
+		locator->bucketMap = (int *) palloc(nbuckets * sizeof(int));
+		locator->nbuckets = nbuckets;
+	}
+
+	i = 0;
+	foreach(lc, buckets)
+	{
+		int			nodenum = lfirst_int(lc);
+		int			index = 0;
+		ListCell   *lc2;
+
+		foreach(lc2, nodeList)
+		{
+			if (lfirst_int(lc2) == nodenum)
+				break;
+			index++;
+		}
+		if (lc2 == NULL)
+			elog(ERROR, "node %d of bucket %d is not a distribution node",
+				 nodenum, i);
+		locator->bucketMap[i++] = index;
+	}
+}
+
+
+/*
+ * Set the split points of the LOCATOR_TYPE_RANGE locator, the ranges list
+ * holds them as strings in ascending order. The node of each range is set
+ * by setLocatorBuckets.
+ */
+void
+setLocatorRanges(Locator *locator, List *ranges)
+{
+	if (locator->rangetype == NULL || ranges == NIL)
+		return;
+
+	if (locator->splits)
+		pfree(locator->splits);
+	locator->splits = range_split_values(locator->rangetype, ranges);
+	locator->nsplits = list_length(ranges);
+}
+
+
+/*
+ * Position of the range holding the value of the given type, the ranges are
+ * delimited by the split points given as strings in ascending order.
+ */
+int
+GetRangeIndex(Oid dataType, List *ranges, Datum value)
+{
+	TypeCacheEntry *typentry;
+	Datum	   *splits;
+	int			index;
+
+	typentry = lookup_type_cache(dataType, TYPECACHE_CMP_PROC_FINFO);
+	if (!OidIsValid(typentry->cmp_proc))
+		ereport(ERROR, (errmsg("Error: unsupported data type for RANGE locator: %d\n",
+							   dataType)));
+	splits = range_split_values(typentry, ranges);
+	index = range_index(typentry, get_typcollation(dataType),
+						list_length(ranges), splits, value);
+	pfree(splits);
+	return index;
+}
+
+
+/*
+ * Returns whether or not the data type is range distributable, that is if
+ * the values can be sorted.
+ */
+bool
+IsTypeRangeDistributable(Oid col_type)
+{
+	TypeCacheEntry *typentry;
+
+	typentry = lookup_type_cache(col_type, TYPECACHE_CMP_PROC);
+	return OidIsValid(typentry->cmp_proc);
+}
+
+
+/*
+ * Convert the split points from strings to values of the type
+ */
+static Datum *
+range_split_values(TypeCacheEntry *typentry, List *ranges)
+{
+	Datum	   *splits;
+	Oid			typinput;
+	Oid			typioparam;
+	ListCell   *lc;
+	int			i = 0;
+
+	getTypeInputInfo(typentry->type_id, &typinput, &typioparam);
+	splits = (Datum *) palloc(list_length(ranges) * sizeof(Datum));
+	foreach(lc, ranges)
+		splits[i++] = OidInputFunctionCall(typinput, strVal(lfirst(lc)),
+										   typioparam, -1);
+	return splits;
+}
+
+
+/*
+ * Binary search of the range holding the non-NULL value, that is the number
+ * of split points lower than or equal to the value.
+ */
+static int
+range_index(TypeCacheEntry *typentry, Oid collation, int nsplits,
+			Datum *splits, Datum value)
+{
+	int			low = 0;
+	int			high = nsplits;
+
+	while (low < high)
+	{
+		int			mid = (low + high) / 2;
+		int32		cmp;
+
+		cmp = DatumGetInt32(FunctionCall2Coll(&typentry->cmp_proc_finfo,
+											  collation,
+											  value, splits[mid]));
+		if (cmp < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+	return low;
+}
+
+
 void
 freeLocator(Locator *locator)
 {
+	if (locator->bucketMap)
+		pfree(locator->bucketMap);
+	if (locator->splits)
+		pfree(locator->splits);
 	pfree(locator->nodeMap);
 	/*
 	 * locator->nodeMap and locator->results may point to the same memory,
@@ -1173,6 +2301,88 @@ freeLocator(Locator *locator)
 }
 
 
+/*
+ * GetRelationInsertLocator
+ *	Locator routing the rows inserted into the relation, for values of the
+ *	given type. It is built once and kept in the relcache entry until the
+ *	entry is invalidated, so single row inserts do not set up a new locator
+ *	each time. The node map is the node list of the relation in ascending
+ *	order, like the distribution of plans modifying the relation.
+ *
+ *	The locator is shared by the whole session, the results must be read
+ *	before it is used again and the caller must not free it.
+ */
+Locator *
+GetRelationInsertLocator(Relation rel, Oid dataType)
+{
+	RelationLocInfo *rel_loc_info = rel->rd_locator_info;
+	MemoryContext oldcontext;
+	Bitmapset  *nodes = NULL;
+	List	   *nodeList = NIL;
+	ListCell   *lc;
+	int			i;
+
+	Assert(rel_loc_info);
+
+	if (rel_loc_info->insertLocator &&
+			rel_loc_info->insertLocator->dataType == dataType)
+		return rel_loc_info->insertLocator;
+
+	FreeRelationInsertLocator(rel_loc_info);
+
+	foreach(lc, rel_loc_info->nodeList)
+		nodes = bms_add_member(nodes, lfirst_int(lc));
+	while ((i = bms_first_member(nodes)) >= 0)
+		nodeList = lappend_int(nodeList, i);
+	bms_free(nodes);
+
+	rel_loc_info->locatorcxt = AllocSetContextCreate(CacheMemoryContext,
+													 RelationGetRelationName(rel),
+													 ALLOCSET_SMALL_MINSIZE,
+													 ALLOCSET_SMALL_INITSIZE,
+													 ALLOCSET_SMALL_MAXSIZE);
+	oldcontext = MemoryContextSwitchTo(rel_loc_info->locatorcxt);
+	PG_TRY();
+	{
+		rel_loc_info->insertLocator = createLocator(rel_loc_info->locatorType,
+													RELATION_ACCESS_INSERT,
+													dataType,
+													LOCATOR_LIST_LIST,
+													0,
+													(void *) nodeList,
+													NULL,
+													false);
+		setLocatorBuckets(rel_loc_info->insertLocator, rel_loc_info->buckets,
+						  nodeList);
+		setLocatorRanges(rel_loc_info->insertLocator, rel_loc_info->ranges);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(oldcontext);
+		FreeRelationInsertLocator(rel_loc_info);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	MemoryContextSwitchTo(oldcontext);
+	list_free(nodeList);
+
+	return rel_loc_info->insertLocator;
+}
+
+
+/*
+ * Release the insert locator of the relcache entry, if it has been built
+ */
+void
+FreeRelationInsertLocator(RelationLocInfo *rel_loc_info)
+{
+	if (rel_loc_info->locatorcxt)
+		MemoryContextDelete(rel_loc_info->locatorcxt);
+	rel_loc_info->locatorcxt = NULL;
+	rel_loc_info->insertLocator = NULL;
+}
+
+
 /*
  * Each time return the same predefined results
  */
@@ -1241,7 +2451,7 @@ locate_hash_insert(Locator *self, Datum value, bool isnull,
 	{
 		unsigned int hash32;
 
-		hash32 = (unsigned int) DatumGetInt32(DirectFunctionCall1(self->hashfunc, value));
+		hash32 = locator_hash(self, value);
 
 		index = compute_modulo(hash32, self->nodeCount);
 	}
@@ -1311,7 +2521,7 @@ locate_hash_select(Locator *self, Datum value, bool isnull,
 		unsigned int hash32;
 		int 		 index;
 
-		hash32 = (unsigned int) DatumGetInt32(DirectFunctionCall1(self->hashfunc, value));
+		hash32 = locator_hash(self, value);
 
 		index = compute_modulo(hash32, self->nodeCount);
 		switch (self->listType)
@@ -1338,6 +2548,130 @@ locate_hash_select(Locator *self, Datum value, bool isnull,
 }
 
 
+/*
+ * Node map index of the value's bucket. NULLs are in the first bucket.
+ */
+static inline int
+locator_bucket_index(Locator *self, Datum value, bool isnull)
+{
+	if (isnull)
+		return self->bucketMap[0];
+	return self->bucketMap[compute_modulo(locator_hash(self, value),
+										  self->nbuckets)];
+}
+
+
+/*
+ * Calculate hash from supplied value and use the node of its bucket
+ */
+static int
+locate_bucket_insert(Locator *self, Datum value, bool isnull,
+					 bool *hasprimary)
+{
+	int index;
+	if (hasprimary)
+		*hasprimary = false;
+	index = locator_bucket_index(self, value, isnull);
+	switch (self->listType)
+	{
+		case LOCATOR_LIST_NONE:
+			((int *) self->results)[0] = index;
+			break;
+		case LOCATOR_LIST_INT:
+			((int *) self->results)[0] = ((int *) self->nodeMap)[index];
+			break;
+		case LOCATOR_LIST_OID:
+			((Oid *) self->results)[0] = ((Oid *) self->nodeMap)[index];
+			break;
+		case LOCATOR_LIST_POINTER:
+			((void **) self->results)[0] = ((void **) self->nodeMap)[index];
+			break;
+		case LOCATOR_LIST_LIST:
+			/* Should never happen */
+			Assert(false);
+			break;
+	}
+	return 1;
+}
+
+
+/*
+ * Calculate hash from supplied value and use the node of its bucket,
+ * if value is NULL assume no hint and return all the nodes.
+ */
+static int
+locate_bucket_select(Locator *self, Datum value, bool isnull,
+					 bool *hasprimary)
+{
+	if (isnull)
+		return locate_hash_select(self, value, isnull, hasprimary);
+	return locate_bucket_insert(self, value, isnull, hasprimary);
+}
+
+
+/*
+ * Node map index of the value's range. NULLs are in the first range.
+ */
+static inline int
+locator_range_index(Locator *self, Datum value, bool isnull)
+{
+	if (self->nsplits + 1 != self->nbuckets)
+		elog(ERROR, "split points of range distribution are not set");
+	if (isnull)
+		return self->bucketMap[0];
+	return self->bucketMap[range_index(self->rangetype, self->rangecollation,
+									   self->nsplits, self->splits, value)];
+}
+
+
+/*
+ * Find the range of supplied value and use the node of the range
+ */
+static int
+locate_range_insert(Locator *self, Datum value, bool isnull,
+					bool *hasprimary)
+{
+	int index;
+	if (hasprimary)
+		*hasprimary = false;
+	index = locator_range_index(self, value, isnull);
+	switch (self->listType)
+	{
+		case LOCATOR_LIST_NONE:
+			((int *) self->results)[0] = index;
+			break;
+		case LOCATOR_LIST_INT:
+			((int *) self->results)[0] = ((int *) self->nodeMap)[index];
+			break;
+		case LOCATOR_LIST_OID:
+			((Oid *) self->results)[0] = ((Oid *) self->nodeMap)[index];
+			break;
+		case LOCATOR_LIST_POINTER:
+			((void **) self->results)[0] = ((void **) self->nodeMap)[index];
+			break;
+		case LOCATOR_LIST_LIST:
+			/* Should never happen */
+			Assert(false);
+			break;
+	}
+	return 1;
+}
+
+
+/*
+ * Find the range of supplied value and use the node of the range,
+ * if value is NULL assume no hint and return all the nodes.
+ */
+static int
+locate_range_select(Locator *self, Datum value, bool isnull,
+					bool *hasprimary)
+{
+	if (isnull)
+		return locate_hash_select(self, value, isnull, hasprimary);
+	return locate_range_insert(self, value, isnull, hasprimary);
+}
+
+
 /*
  * Use modulo of supplied value by nodeCount as an index
  */
@@ -1473,6 +2807,141 @@ GET_NODES(Locator *self, Datum value, bool isnull, bool *hasprimary)
 }
 
 
+/*
+ * Round robin locator assigns nodes one by one, values do not matter
+ */
+static void
+locate_roundrobin_batch(Locator *self, int nvalues, Datum *values,
+						bool *nulls, int *indexes)
+{
+	int			node = self->roundRobinNode;
+	int			i;
+
+	for (i = 0; i < nvalues; i++)
+	{
+		if (++node >= self->nodeCount)
+			node = 0;
+		indexes[i] = node;
+	}
+	self->roundRobinNode = node;
+}
+
+
+/*
+ * Same as locate_hash_insert for each of the values. The loop is repeated for
+ * each of the inline hash functions, so in the loop there are no calls other
+ * than to the hash function itself.
+ */
+static void
+locate_hash_batch(Locator *self, int nvalues, Datum *values,
+				  bool *nulls, int *indexes)
+{
+	unsigned int nodeCount = self->nodeCount;
+	int			i;
+
+	switch (self->hashkind)
+	{
+		case LOCATOR_HASH_INT4:
+			for (i = 0; i < nvalues; i++)
+				indexes[i] = nulls[i] ? 0 :
+					compute_modulo(hash_uint32(DatumGetInt32(values[i])),
+								   nodeCount);
+			break;
+		case LOCATOR_HASH_INT8:
+			for (i = 0; i < nvalues; i++)
+			{
+				int64		val = DatumGetInt64(values[i]);
+				uint32		lohalf = (uint32) val;
+				uint32		hihalf = (uint32) (val >> 32);
+
+				lohalf ^= (val >= 0) ? hihalf : ~hihalf;
+				indexes[i] = nulls[i] ? 0 :
+					compute_modulo(hash_uint32(lohalf), nodeCount);
+			}
+			break;
+		default:
+			for (i = 0; i < nvalues; i++)
+				indexes[i] = nulls[i] ? 0 :
+					compute_modulo(locator_hash(self, values[i]), nodeCount);
+			break;
+	}
+}
+
+
+/*
+ * Same as locate_bucket_insert for each of the values
+ */
+static void
+locate_bucket_batch(Locator *self, int nvalues, Datum *values,
+					bool *nulls, int *indexes)
+{
+	int			i;
+
+	for (i = 0; i < nvalues; i++)
+		indexes[i] = locator_bucket_index(self, values[i], nulls[i]);
+}
+
+
+/*
+ * Same as locate_range_insert for each of the values
+ */
+static void
+locate_range_batch(Locator *self, int nvalues, Datum *values,
+				   bool *nulls, int *indexes)
+{
+	int			i;
+
+	for (i = 0; i < nvalues; i++)
+		indexes[i] = locator_range_index(self, values[i], nulls[i]);
+}
+
+
+/*
+ * Same as locate_modulo_insert for each of the values
+ */
+static void
+locate_modulo_batch(Locator *self, int nvalues, Datum *values,
+					bool *nulls, int *indexes)
+{
+	unsigned int nodeCount = self->nodeCount;
+	Datum		mask;
+	int			i;
+
+	if (self->valuelen == 4)
+		mask = (Datum) 0xffffffff;
+	else if (self->valuelen == 2)
+		mask = (Datum) 0x0000ffff;
+	else if (self->valuelen == 1)
+		mask = (Datum) 0x000000ff;
+	else
+		mask = (Datum) 0;
+
+	for (i = 0; i < nvalues; i++)
+		indexes[i] = nulls[i] ? 0 :
+			compute_modulo((unsigned int) (values[i] & mask), nodeCount);
+}
+
+
+/*
+ * Determine target nodes for number of values at once. It is possible only
+ * if the locator determines exactly one node for each value, that is for
+ * locators of hash, modulo and round robin distributed tables used to insert
+ * data, and for locators reading from replicated tables. Node indexes, that
+ * is positions in the node map of the locator, are returned in the indexes
+ * array. If the locator may return more than one node for a value, false is
+ * returned and the caller should call GET_NODES for each value.
+ */
+bool
+GET_NODES_BATCH(Locator *self, int nvalues, Datum *values, bool *nulls,
+				int *indexes)
+{
+	if (self->batchfunc == NULL)
+		return false;
+	(*self->batchfunc) (self, nvalues, values, nulls, indexes);
+	return true;
+}
+
+
 void *
 getLocatorResults(Locator *self)
 {
@@ -1492,4 +2961,213 @@ getLocatorNodeCount(Locator *self)
 {
 	return self->nodeCount;
 }
+
+
+/*
+ * pgxc_get_distribution_map
+ *	SQL SRF describing where the rows of a table distributed by value are
+ *	stored, so a loader can split its data by Datanode and load every part
+ *	directly into its Datanode. One row per node, in the order of the map
+ *	the distribution hash is reduced to: the position in the map, the name,
+ *	host and port of the node and, for bucket and range distributions, the
+ *	buckets or ranges the node stores.
+ */
+Datum
+pgxc_get_distribution_map(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+	Relation	rel;
+	RelationLocInfo *rel_loc_info;
+	Bitmapset  *nodes = NULL;
+	ListCell   *lc;
+	int			nodeid;
+	int			position = 0;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	rel = relation_open(relid, AccessShareLock);
+	rel_loc_info = rel->rd_locator_info;
+	if (rel_loc_info == NULL ||
+			!IsLocatorDistributedByValue(rel_loc_info->locatorType))
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("relation \"%s\" is not distributed by value",
+						RelationGetRelationName(rel))));
+
+	/* The locators map the hash to the nodes in ascending order */
+	foreach(lc, rel_loc_info->nodeList)
+		nodes = bms_add_member(nodes, lfirst_int(lc));
+
+	while ((nodeid = bms_first_member(nodes)) >= 0)
+	{
+		Datum		values[5];
+		bool		nulls[5];
+		HeapTuple	tuple;
+		Form_pgxc_node nodeForm;
+		Oid			nodeoid = PGXCNodeGetNodeOid(nodeid, PGXC_NODE_DATANODE);
+
+		MemSet(nulls, 0, sizeof(nulls));
+		tuple = SearchSysCache1(PGXCNODEOID, ObjectIdGetDatum(nodeoid));
+		if (!HeapTupleIsValid(tuple))
+			elog(ERROR, "cache lookup failed for node %u", nodeoid);
+		nodeForm = (Form_pgxc_node) GETSTRUCT(tuple);
+
+		values[0] = Int32GetDatum(position++);
+		values[1] = NameGetDatum(&nodeForm->node_name);
+		values[2] = NameGetDatum(&nodeForm->node_host);
+		values[3] = Int32GetDatum(nodeForm->node_port);
+		if (rel_loc_info->buckets)
+		{
+			Datum	   *buckets;
+			int			nbuckets = 0;
+			int			bucket = 0;
+
+			buckets = (Datum *) palloc(list_length(rel_loc_info->buckets) *
+									   sizeof(Datum));
+			foreach(lc, rel_loc_info->buckets)
+			{
+				if (lfirst_int(lc) == nodeid)
+					buckets[nbuckets++] = Int32GetDatum(bucket);
+				bucket++;
+			}
+			values[4] = PointerGetDatum(construct_array(buckets, nbuckets,
+														INT4OID, sizeof(int32),
+														true, 'i'));
+		}
+		else
+			nulls[4] = true;
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		ReleaseSysCache(tuple);
+	}
+
+	relation_close(rel, AccessShareLock);
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * pgxc_node_for_value
+ *	Name of the Datanode storing the rows of a table distributed by value
+ *	with the given values of the distribution columns, given as text in the
+ *	order of the columns. A loader can use it to split its data by node.
+ */
+Datum
+pgxc_node_for_value(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	ArrayType  *keys = PG_GETARG_ARRAYTYPE_P(1);
+	Relation	rel;
+	RelationLocInfo *rel_loc_info;
+	TupleDesc	tupdesc;
+	List	   *keycols;
+	Datum	   *keyvalues;
+	bool	   *keynulls;
+	int			nkeys;
+	Datum	   *values;
+	bool	   *nulls;
+	Datum		value;
+	bool		isnull;
+	Oid			keytype;
+	Locator    *locator;
+	int			count;
+	int			nodeid;
+	ListCell   *lc;
+	int			i;
+
+	rel = relation_open(relid, AccessShareLock);
+	rel_loc_info = rel->rd_locator_info;
+	if (rel_loc_info == NULL ||
+			!IsLocatorDistributedByValue(rel_loc_info->locatorType))
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("relation \"%s\" is not distributed by value",
+						RelationGetRelationName(rel))));
+	tupdesc = RelationGetDescr(rel);
+
+	keycols = rel_loc_info->partAttrNums;
+	if (keycols == NIL)
+		keycols = list_make1_int(rel_loc_info->partAttrNum);
+
+	deconstruct_array(keys, TEXTOID, -1, false, 'i',
+					  &keyvalues, &keynulls, &nkeys);
+	if (nkeys != list_length(keycols))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("relation \"%s\" is distributed by %d columns, %d values given",
+						RelationGetRelationName(rel),
+						list_length(keycols), nkeys)));
+
+	/* Convert the values to the types of the columns */
+	values = (Datum *) palloc0(tupdesc->natts * sizeof(Datum));
+	nulls = (bool *) palloc(tupdesc->natts * sizeof(bool));
+	memset(nulls, true, tupdesc->natts * sizeof(bool));
+	i = 0;
+	foreach(lc, keycols)
+	{
+		Form_pg_attribute attr = tupdesc->attrs[lfirst_int(lc) - 1];
+		Oid			typinput;
+		Oid			typioparam;
+
+		if (!keynulls[i])
+		{
+			getTypeInputInfo(attr->atttypid, &typinput, &typioparam);
+			values[attr->attnum - 1] =
+				OidInputFunctionCall(typinput,
+									 TextDatumGetCString(keyvalues[i]),
+									 typioparam, attr->atttypmod);
+			nulls[attr->attnum - 1] = false;
+		}
+		i++;
+	}
+
+	if (rel_loc_info->partAttrNums)
+	{
+		value = ComputeDistributionKey(rel_loc_info, tupdesc, values, nulls);
+		isnull = false;
+		keytype = INT4OID;
+	}
+	else
+	{
+		value = values[rel_loc_info->partAttrNum - 1];
+		isnull = nulls[rel_loc_info->partAttrNum - 1];
+		keytype = tupdesc->attrs[rel_loc_info->partAttrNum - 1]->atttypid;
+	}
+
+	locator = GetRelationInsertLocator(rel, keytype);
+	count = GET_NODES(locator, value, isnull, NULL);
+	Assert(count == 1);
+	nodeid = ((int *) getLocatorResults(locator))[0];
+
+	relation_close(rel, AccessShareLock);
+
+	PG_RETURN_DATUM(DirectFunctionCall1(namein,
+				CStringGetDatum(get_pgxc_nodename(PGXCNodeGetNodeOid(nodeid,
+												PGXC_NODE_DATANODE)))));
+}
 #endif
@@ -21,15 +21,22 @@
 #include "catalog/pg_type.h"
 #include "catalog/pgxc_node.h"
 #include "commands/tablecmds.h"
+#include "executor/spi.h"
 #include "pgxc/copyops.h"
 #include "pgxc/execRemote.h"
 #include "pgxc/pgxc.h"
+#include "pgxc/pgxcnode.h"
 #include "pgxc/redistrib.h"
 #include "pgxc/remotecopy.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/snapmgr.h"
 
+/* Maximum number of buckets moved between the remaining nodes at once */
+int			RedistribMaxBuckets = 0;
+
 #define IsCommandTypePreUpdate(x) (x == CATALOG_UPDATE_BEFORE || \
 								   x == CATALOG_UPDATE_BOTH)
 #define IsCommandTypePostUpdate(x) (x == CATALOG_UPDATE_AFTER || \
@@ -38,11 +45,17 @@
 /* Functions used for the execution of redistribution commands */
 static void distrib_execute_query(char *sql, bool is_temp, ExecNodes *exec_nodes);
 static void distrib_execute_command(RedistribState *distribState, RedistribCommand *command);
-static void distrib_copy_to(RedistribState *distribState);
+static void distrib_copy_to(RedistribState *distribState, List *buckets);
 static void distrib_copy_from(RedistribState *distribState, ExecNodes *exec_nodes);
+static void distrib_stage_to(RedistribState *distribState);
+static void distrib_stage_from(RedistribState *distribState);
+static void distrib_execute_spi(char *sql, int expected);
 static void distrib_truncate(RedistribState *distribState, ExecNodes *exec_nodes);
 static void distrib_reindex(RedistribState *distribState, ExecNodes *exec_nodes);
 static void distrib_delete_hash(RedistribState *distribState, ExecNodes *exec_nodes);
+static void distrib_delete_buckets(RedistribState *distribState, ExecNodes *exec_nodes,
+								List *buckets);
+static void distrib_bucket_condition(StringInfo buf, Relation rel, List *buckets);
 
 /* Functions used to build the command list */
 static void pgxc_redist_build_entry(RedistribState *distribState,
@@ -54,8 +67,19 @@ static void pgxc_redist_build_replicate(RedistribState *distribState,
 static void pgxc_redist_build_replicate_to_distrib(RedistribState *distribState,
 								RelationLocInfo *oldLocInfo,
 								RelationLocInfo *newLocInfo);
-
-static void pgxc_redist_build_default(RedistribState *distribState);
+static void pgxc_redist_build_buckets(RedistribState *distribState,
+								RelationLocInfo *oldLocInfo,
+								RelationLocInfo *newLocInfo);
+static void pgxc_redist_add_delete_buckets(RedistribState *distribState,
+								RelationLocInfo *oldLocInfo,
+								RelationLocInfo *newLocInfo,
+								List *nodeList,
+								RedistribCatalog updateState);
+
+static void pgxc_redist_build_default(RedistribState *distribState,
+									  RelationLocInfo *newLocInfo);
+static char *pgxc_redist_stage_distribution(RedistribState *distribState,
+											RelationLocInfo *newLocInfo);
 static void pgxc_redist_add_reindex(RedistribState *distribState);
 
 
@@ -134,10 +158,13 @@ pgxc_redist_build_entry(RedistribState *distribState,
 	/* Evaluate cases for replicated to distributed tables */
 	pgxc_redist_build_replicate_to_distrib(distribState, oldLocInfo, newLocInfo);
 
+	/* Evaluate cases for tables distributed by bucket */
+	pgxc_redist_build_buckets(distribState, oldLocInfo, newLocInfo);
+
 	/* PGXCTODO: perform more complex builds of command list */
 
 	/* Fallback to default */
-	pgxc_redist_build_default(distribState);
+	pgxc_redist_build_default(distribState, newLocInfo);
 }
 
 
@@ -163,6 +190,14 @@ pgxc_redist_build_replicate_to_distrib(RedistribState *distribState,
 		!IsLocatorDistributedByValue(newLocInfo->locatorType))
 		return;
 
+	/*
+	 * Rows of range distribution and of distribution by several columns are
+	 * moved by the default operations
+	 */
+	if (newLocInfo->locatorType == LOCATOR_TYPE_RANGE ||
+		newLocInfo->partAttrNums != NIL)
+		return;
+
 	/* Get the list of nodes that are added to the relation */
 	removedNodes = list_difference_int(oldLocInfo->nodeList, newLocInfo->nodeList);
 
@@ -216,6 +251,13 @@ pgxc_redist_build_replicate_to_distrib(RedistribState *distribState,
 		distribState->commands = lappend(distribState->commands,
 					 makeRedistribCommand(DISTRIB_DELETE_MODULO, CATALOG_UPDATE_AFTER, execNodes));
 	}
+	else if (newLocInfo->locatorType == LOCATOR_TYPE_BUCKET)
+	{
+		/* Each node keeps only the buckets it is assigned */
+		pgxc_redist_add_delete_buckets(distribState, NULL, newLocInfo,
+									   newLocInfo->nodeList,
+									   CATALOG_UPDATE_AFTER);
+	}
 	else
 		ereport(ERROR,
 				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
@@ -226,6 +268,134 @@ pgxc_redist_build_replicate_to_distrib(RedistribState *distribState,
 }
 
 
+/*
+ * pgxc_redist_build_buckets
+ * Build redistribution command list for a table distributed by bucket whose
+ * bucket map is changed. Only the tuples of the buckets reassigned to other
+ * nodes are moved:
+ * COPY TO of moved buckets -> TRUNCATE of removed nodes ->
+ * DELETE of moved buckets on remaining nodes -> COPY FROM ( -> REINDEX )
+ */
+static void
+pgxc_redist_build_buckets(RedistribState *distribState,
+						  RelationLocInfo *oldLocInfo,
+						  RelationLocInfo *newLocInfo)
+{
+	List	   *removedNodes;
+	List	   *keptNodes;
+	List	   *movedBuckets = NIL;
+	ListCell   *oldItem, *newItem;
+	int			bucket;
+
+	/* If a command list has already been built, nothing to do */
+	if (list_length(distribState->commands) != 0)
+		return;
+
+	/* Only the bucket map may change, on the same distribution column */
+	if (oldLocInfo->locatorType != LOCATOR_TYPE_BUCKET ||
+		newLocInfo->locatorType != LOCATOR_TYPE_BUCKET ||
+		oldLocInfo->partAttrNum != newLocInfo->partAttrNum ||
+		list_length(oldLocInfo->buckets) != list_length(newLocInfo->buckets))
+		return;
+
+	/* Get the list of buckets assigned to another node */
+	bucket = 0;
+	forboth(oldItem, oldLocInfo->buckets, newItem, newLocInfo->buckets)
+	{
+		if (lfirst_int(oldItem) != lfirst_int(newItem))
+			movedBuckets = lappend_int(movedBuckets, bucket);
+		bucket++;
+	}
+
+	/* Get the list of nodes that are removed from relation */
+	removedNodes = list_difference_int(oldLocInfo->nodeList, newLocInfo->nodeList);
+
+	/* Get the list of nodes that remain in relation */
+	keptNodes = list_intersection_int(oldLocInfo->nodeList, newLocInfo->nodeList);
+
+	/* Fetch the tuples of the moved buckets */
+	if (movedBuckets != NIL)
+	{
+		RedistribCommand *command;
+
+		command = makeRedistribCommand(DISTRIB_COPY_TO, CATALOG_UPDATE_BEFORE, NULL);
+		command->buckets = movedBuckets;
+		distribState->commands = lappend(distribState->commands, command);
+	}
+
+	/* Nodes removed have to be truncated, so add a TRUNCATE commands to removed nodes */
+	if (removedNodes != NIL)
+	{
+		ExecNodes *execNodes = makeNode(ExecNodes);
+		execNodes->nodeList = removedNodes;
+		/* Add TRUNCATE command */
+		distribState->commands = lappend(distribState->commands,
+					 makeRedistribCommand(DISTRIB_TRUNCATE, CATALOG_UPDATE_BEFORE, execNodes));
+	}
+
+	/* Remaining nodes delete the tuples of the buckets they lose */
+	pgxc_redist_add_delete_buckets(distribState, oldLocInfo, newLocInfo,
+								   keptNodes, CATALOG_UPDATE_BEFORE);
+	list_free(keptNodes);
+
+	/* Send the fetched tuples to their new nodes */
+	if (movedBuckets != NIL)
+		distribState->commands = lappend(distribState->commands,
+					 makeRedistribCommand(DISTRIB_COPY_FROM, CATALOG_UPDATE_AFTER, NULL));
+
+	/* Add REINDEX command if necessary */
+	pgxc_redist_add_reindex(distribState);
+}
+
+
+/*
+ * pgxc_redist_add_delete_buckets
+ * Add a DELETE command for each node of the list, removing the tuples of the
+ * buckets the node held in old bucket map, or all the buckets if oldLocInfo is
+ * NULL, and that are assigned to another node in new bucket map.
+ */
+static void
+pgxc_redist_add_delete_buckets(RedistribState *distribState,
+							   RelationLocInfo *oldLocInfo,
+							   RelationLocInfo *newLocInfo,
+							   List *nodeList,
+							   RedistribCatalog updateState)
+{
+	ListCell   *item;
+
+	foreach(item, nodeList)
+	{
+		int			nodenum = lfirst_int(item);
+		List	   *buckets = NIL;
+		ListCell   *oldItem = oldLocInfo ? list_head(oldLocInfo->buckets) : NULL;
+		ListCell   *newItem;
+		int			bucket = 0;
+
+		foreach(newItem, newLocInfo->buckets)
+		{
+			if (lfirst_int(newItem) != nodenum &&
+				(oldItem == NULL || lfirst_int(oldItem) == nodenum))
+				buckets = lappend_int(buckets, bucket);
+			if (oldItem)
+				oldItem = lnext(oldItem);
+			bucket++;
+		}
+
+		if (buckets != NIL)
+		{
+			ExecNodes  *execNodes = makeNode(ExecNodes);
+			RedistribCommand *command;
+
+			execNodes->nodeList = lappend_int(NIL, nodenum);
+			command = makeRedistribCommand(DISTRIB_DELETE_BUCKETS, updateState,
+										   execNodes);
+			command->buckets = buckets;
+			distribState->commands = lappend(distribState->commands, command);
+		}
+	}
+}
+
+
 /*
  * pgxc_redist_build_replicate
  * Build redistribution command list for replicated tables
@@ -292,30 +462,176 @@ pgxc_redist_build_replicate(RedistribState *distribState,
 /*
  * pgxc_redist_build_default
  * Build a default list consisting of
+ * STAGE TO -> TRUNCATE -> STAGE FROM ( -> REINDEX )
+ * The rows are moved by the Datanodes themselves to a staging table having
+ * the new distribution, then inserted back locally once the catalogs are
+ * updated. If no staging table can be used the list consists of
  * COPY TO -> TRUNCATE -> COPY FROM ( -> REINDEX )
  */
 static void
-pgxc_redist_build_default(RedistribState *distribState)
+pgxc_redist_build_default(RedistribState *distribState,
+						  RelationLocInfo *newLocInfo)
 {
 	/* If a command list has already been built, nothing to do */
 	if (list_length(distribState->commands) != 0)
 		return;
 
-	/* COPY TO command */
+	distribState->stageDistribution =
+		pgxc_redist_stage_distribution(distribState, newLocInfo);
+
+	/* COPY TO or STAGE TO command */
 	distribState->commands = lappend(distribState->commands,
-					 makeRedistribCommand(DISTRIB_COPY_TO, CATALOG_UPDATE_BEFORE, NULL));
+					 makeRedistribCommand(distribState->stageDistribution ?
+										  DISTRIB_STAGE_TO : DISTRIB_COPY_TO,
+										  CATALOG_UPDATE_BEFORE, NULL));
 	/* TRUNCATE command */
 	distribState->commands = lappend(distribState->commands,
 					 makeRedistribCommand(DISTRIB_TRUNCATE, CATALOG_UPDATE_BEFORE, NULL));
-	/* COPY FROM command */
+	/* COPY FROM or STAGE FROM command */
 	distribState->commands = lappend(distribState->commands,
-					 makeRedistribCommand(DISTRIB_COPY_FROM, CATALOG_UPDATE_AFTER, NULL));
+					 makeRedistribCommand(distribState->stageDistribution ?
+										  DISTRIB_STAGE_FROM : DISTRIB_COPY_FROM,
+										  CATALOG_UPDATE_AFTER, NULL));
 
 	/* REINDEX command */
 	pgxc_redist_add_reindex(distribState);
 }
 
 
+/*
+ * pgxc_redist_stage_distribution
+ * Build the DISTRIBUTE BY and TO NODE clauses of the staging table used to
+ * move data to its new distribution, and set the staging table name.
+ * Return NULL if the staging table cannot be used for the relation, in which
+ * case data goes through the Coordinator.
+ */
+static char *
+pgxc_redist_stage_distribution(RedistribState *distribState,
+							   RelationLocInfo *newLocInfo)
+{
+	Relation	rel;
+	Oid			nspid;
+	char	   *clause;
+	bool		usable;
+
+	rel = relation_open(distribState->relid, NoLock);
+	nspid = RelationGetNamespace(rel);
+
+	/*
+	 * Temporary tables and tables with OIDs are not supported, and the
+	 * staging table is created in the schema of the relation.
+	 */
+	usable = !IsTempTable(distribState->relid) &&
+		!rel->rd_rel->relhasoids &&
+		pg_namespace_aclcheck(nspid, GetUserId(), ACL_CREATE) == ACLCHECK_OK;
+
+	if (usable)
+	{
+		char		relname[NAMEDATALEN];
+
+		snprintf(relname, NAMEDATALEN, "pgxc_redistrib_%u",
+				 distribState->relid);
+		distribState->stageName =
+			quote_qualified_identifier(get_namespace_name(nspid), relname);
+	}
+
+	relation_close(rel, NoLock);
+
+	if (!usable)
+		return NULL;
+
+	clause = RelationLocInfoDistribution(distribState->relid, newLocInfo);
+	if (clause == NULL)
+	{
+		/* Let the Coordinator deal with other types */
+		pfree(distribState->stageName);
+		distribState->stageName = NULL;
+	}
+
+	return clause;
+}
+
+
+/*
+ * RelationLocInfoDistribution
+ * Build the DISTRIBUTE BY and TO NODE clauses of a table distributed like
+ * the given locator information of a relation. Return NULL if the type of
+ * distribution has no such clause.
+ */
+char *
+RelationLocInfoDistribution(Oid relid, RelationLocInfo *locInfo)
+{
+	StringInfoData buf;
+	ListCell   *lc;
+
+	initStringInfo(&buf);
+	switch (locInfo->locatorType)
+	{
+		case LOCATOR_TYPE_REPLICATED:
+			appendStringInfoString(&buf, " DISTRIBUTE BY REPLICATION");
+			break;
+		case LOCATOR_TYPE_RROBIN:
+			appendStringInfoString(&buf, " DISTRIBUTE BY ROUNDROBIN");
+			break;
+		case LOCATOR_TYPE_HASH:
+		case LOCATOR_TYPE_MODULO:
+		case LOCATOR_TYPE_BUCKET:
+		case LOCATOR_TYPE_RANGE:
+			appendStringInfo(&buf, " DISTRIBUTE BY %s(",
+							 locInfo->locatorType == LOCATOR_TYPE_HASH ? "HASH" :
+							 locInfo->locatorType == LOCATOR_TYPE_MODULO ? "MODULO" :
+							 locInfo->locatorType == LOCATOR_TYPE_BUCKET ? "BUCKET" :
+							 "RANGE");
+			if (locInfo->partAttrNums)
+			{
+				foreach(lc, locInfo->partAttrNums)
+				{
+					if (lc != list_head(locInfo->partAttrNums))
+						appendStringInfoString(&buf, ", ");
+					appendStringInfoString(&buf,
+										   quote_identifier(get_attname(relid,
+																		lfirst_int(lc))));
+				}
+			}
+			else
+				appendStringInfoString(&buf,
+									   quote_identifier(get_attname(relid,
+																	locInfo->partAttrNum)));
+			appendStringInfoChar(&buf, ')');
+			if (locInfo->locatorType == LOCATOR_TYPE_RANGE)
+			{
+				appendStringInfoString(&buf, " VALUES (");
+				foreach(lc, locInfo->ranges)
+				{
+					if (lc != list_head(locInfo->ranges))
+						appendStringInfoString(&buf, ", ");
+					appendStringInfoString(&buf,
+										   quote_literal_cstr(strVal(lfirst(lc))));
+				}
+				appendStringInfoChar(&buf, ')');
+			}
+			break;
+		default:
+			pfree(buf.data);
+			return NULL;
+	}
+
+	appendStringInfoString(&buf, " TO NODE (");
+	foreach(lc, locInfo->nodeList)
+	{
+		Oid			nodeoid = PGXCNodeGetNodeOid(lfirst_int(lc),
+												 PGXC_NODE_DATANODE);
+
+		if (lc != list_head(locInfo->nodeList))
+			appendStringInfoString(&buf, ", ");
+		appendStringInfoString(&buf, quote_identifier(get_pgxc_nodename(nodeoid)));
+	}
+	appendStringInfoChar(&buf, ')');
+
+	return buf.data;
+}
+
+
 /*
  * pgxc_redist_build_reindex
  * Add a reindex command if necessary
@@ -349,11 +665,17 @@ distrib_execute_command(RedistribState *distribState, RedistribCommand *command)
 	switch (command->type)
 	{
 		case DISTRIB_COPY_TO:
-			distrib_copy_to(distribState);
+			distrib_copy_to(distribState, command->buckets);
 			break;
 		case DISTRIB_COPY_FROM:
 			distrib_copy_from(distribState, command->execNodes);
 			break;
+		case DISTRIB_STAGE_TO:
+			distrib_stage_to(distribState);
+			break;
+		case DISTRIB_STAGE_FROM:
+			distrib_stage_from(distribState);
+			break;
 		case DISTRIB_TRUNCATE:
 			distrib_truncate(distribState, command->execNodes);
 			break;
@@ -364,6 +686,10 @@ distrib_execute_command(RedistribState *distribState, RedistribCommand *command)
 		case DISTRIB_DELETE_MODULO:
 			distrib_delete_hash(distribState, command->execNodes);
 			break;
+		case DISTRIB_DELETE_BUCKETS:
+			distrib_delete_buckets(distribState, command->execNodes,
+								   command->buckets);
+			break;
 		case DISTRIB_NONE:
 		default:
 			Assert(0); /* Should not happen */
@@ -378,9 +704,10 @@ distrib_execute_command(RedistribState *distribState, RedistribCommand *command)
  * a COPY FROM operation is always done on nodes determined by the locator data
  * in catalogs, explaining why this cannot be done on a subset of nodes. It also
  * insures that no read operations are done on nodes where data is not yet located.
+ * If a list of buckets is given only the tuples of these buckets are copied.
  */
 static void
-distrib_copy_to(RedistribState *distribState)
+distrib_copy_to(RedistribState *distribState, List *buckets)
 {
 	Oid			relOid = distribState->relid;
 	Relation	rel;
@@ -404,6 +731,18 @@ distrib_copy_to(RedistribState *distribState)
 	RemoteCopy_GetRelationLoc(copyState, rel, NIL);
 	RemoteCopy_BuildStatement(copyState, rel, options, NIL, NIL);
 
+	/* Copy only the tuples of given buckets */
+	if (buckets != NIL)
+	{
+		resetStringInfo(&copyState->query_buf);
+		appendStringInfo(&copyState->query_buf,
+						 "COPY (SELECT * FROM %s.%s WHERE ",
+						 get_namespace_name(RelationGetNamespace(rel)),
+						 RelationGetRelationName(rel));
+		distrib_bucket_condition(&copyState->query_buf, rel, buckets);
+		appendStringInfoString(&copyState->query_buf, ") TO STDOUT");
+	}
+
 	/* Inform client of operation being done */
 	ereport(DEBUG1,
 			(errmsg("Copying data for relation \"%s.%s\"",
@@ -451,6 +790,13 @@ distrib_copy_from(RedistribState *distribState, ExecNodes *exec_nodes)
 	FmgrInfo 	in_function;
 	Oid 		typioparam;
 	int 		typmod = 0;
+	/* Same for each column of a key combining several columns */
+	int			nkeys = 0;
+	int		   *keyIdx = NULL;
+	FmgrInfo   *keyInFunctions = NULL;
+	Oid		   *keyIoParams = NULL;
+	Datum	   *keyValues = NULL;
+	bool	   *keyNulls = NULL;
 
 	/* Nothing to do if on remote node */
 	if (IS_PGXC_DATANODE || IsConnFromCoord())
@@ -479,7 +825,41 @@ distrib_copy_from(RedistribState *distribState, ExecNodes *exec_nodes)
 	}
 
 	tupdesc = RelationGetDescr(rel);
-	if (AttributeNumberIsValid(copyState->rel_loc->partAttrNum))
+	if (copyState->rel_loc->partAttrNums)
+	{
+		ListCell   *lc;
+		int			i;
+
+		nkeys = list_length(copyState->rel_loc->partAttrNums);
+		keyIdx = (int *) palloc(nkeys * sizeof(int));
+		keyInFunctions = (FmgrInfo *) palloc(nkeys * sizeof(FmgrInfo));
+		keyIoParams = (Oid *) palloc(nkeys * sizeof(Oid));
+		keyValues = (Datum *) palloc0(tupdesc->natts * sizeof(Datum));
+		keyNulls = (bool *) palloc(tupdesc->natts * sizeof(bool));
+		memset(keyNulls, true, tupdesc->natts * sizeof(bool));
+
+		i = 0;
+		foreach(lc, copyState->rel_loc->partAttrNums)
+		{
+			int			attidx = lfirst_int(lc) - 1;
+			Oid			in_func_oid;
+			int			j;
+
+			getTypeInputInfo(tupdesc->attrs[attidx]->atttypid,
+							 &in_func_oid, &keyIoParams[i]);
+			fmgr_info(in_func_oid, &keyInFunctions[i]);
+
+			/* The data row does not contain data of dropped attributes */
+			keyIdx[i] = attidx;
+			for (j = 0; j < attidx; j++)
+			{
+				if (tupdesc->attrs[j]->attisdropped)
+					keyIdx[i]--;
+			}
+			i++;
+		}
+	}
+	else if (AttributeNumberIsValid(copyState->rel_loc->partAttrNum))
 	{
 		Oid in_func_oid;
 		int dropped = 0;
@@ -532,7 +912,31 @@ distrib_copy_from(RedistribState *distribState, ExecNodes *exec_nodes)
 			break;
 
 		/* Find value of distribution column if necessary */
-		if (AttributeNumberIsValid(copyState->rel_loc->partAttrNum))
+		if (nkeys > 0)
+		{
+			char	  **fields;
+			ListCell   *lc;
+			int			i = 0;
+
+			/* Combine the values of the key columns */
+			fields = CopyOps_RawDataToArrayField(tupdesc, data, len);
+			foreach(lc, copyState->rel_loc->partAttrNums)
+			{
+				int			attidx = lfirst_int(lc) - 1;
+
+				keyNulls[attidx] = (fields[keyIdx[i]] == NULL);
+				if (fields[keyIdx[i]])
+					keyValues[attidx] = InputFunctionCall(&keyInFunctions[i],
+														  fields[keyIdx[i]],
+														  keyIoParams[i],
+														  tupdesc->attrs[attidx]->atttypmod);
+				i++;
+			}
+			value = ComputeDistributionKey(copyState->rel_loc, tupdesc,
+										   keyValues, keyNulls);
+			is_null = false;
+		}
+		else if (AttributeNumberIsValid(copyState->rel_loc->partAttrNum))
 		{
 			char 	  **fields;
 
@@ -569,6 +973,114 @@ distrib_copy_from(RedistribState *distribState, ExecNodes *exec_nodes)
 }
 
 
+/*
+ * distrib_stage_to
+ * Move all the data of table to be distributed to a staging table having the
+ * new distribution. This is a distributed INSERT SELECT, so each Datanode
+ * reads its local rows and sends them directly to the Datanodes where they
+ * belong, without going through the Coordinator.
+ */
+static void
+distrib_stage_to(RedistribState *distribState)
+{
+	Relation	rel;
+	char	   *relname;
+	StringInfoData buf;
+
+	/* A sufficient lock level needs to be taken at a higher level */
+	rel = relation_open(distribState->relid, NoLock);
+	relname = quote_qualified_identifier(
+							get_namespace_name(RelationGetNamespace(rel)),
+							RelationGetRelationName(rel));
+
+	/* Inform client of operation being done */
+	ereport(DEBUG1,
+			(errmsg("Moving data of relation \"%s.%s\" to staging table",
+					get_namespace_name(RelationGetNamespace(rel)),
+					RelationGetRelationName(rel))));
+
+	/* Lock is maintained until transaction commits */
+	relation_close(rel, NoLock);
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "CREATE TABLE %s (LIKE %s)%s",
+					 distribState->stageName, relname,
+					 distribState->stageDistribution);
+	distrib_execute_spi(buf.data, SPI_OK_UTILITY);
+
+	resetStringInfo(&buf);
+	appendStringInfo(&buf, "INSERT INTO %s SELECT * FROM %s",
+					 distribState->stageName, relname);
+	distrib_execute_spi(buf.data, SPI_OK_INSERT);
+
+	pfree(buf.data);
+	pfree(relname);
+}
+
+
+/*
+ * distrib_stage_from
+ * Move the data back from the staging table to the table redistributed,
+ * once catalogs have been updated. Both tables have the same distribution so
+ * each Datanode inserts its local rows, then the staging table is dropped.
+ */
+static void
+distrib_stage_from(RedistribState *distribState)
+{
+	Relation	rel;
+	char	   *relname;
+	StringInfoData buf;
+
+	/* A sufficient lock level needs to be taken at a higher level */
+	rel = relation_open(distribState->relid, NoLock);
+	relname = quote_qualified_identifier(
+							get_namespace_name(RelationGetNamespace(rel)),
+							RelationGetRelationName(rel));
+
+	/* Inform client of operation being done */
+	ereport(DEBUG1,
+			(errmsg("Redistributing data for relation \"%s.%s\"",
+					get_namespace_name(RelationGetNamespace(rel)),
+					RelationGetRelationName(rel))));
+
+	/* Lock is maintained until transaction commits */
+	relation_close(rel, NoLock);
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "INSERT INTO %s SELECT * FROM %s",
+					 relname, distribState->stageName);
+	distrib_execute_spi(buf.data, SPI_OK_INSERT);
+
+	resetStringInfo(&buf);
+	appendStringInfo(&buf, "DROP TABLE %s", distribState->stageName);
+	distrib_execute_spi(buf.data, SPI_OK_UTILITY);
+
+	pfree(buf.data);
+	pfree(relname);
+}
+
+
+/*
+ * distrib_execute_spi
+ * Run a query planned on the Coordinator, checking its result
+ */
+static void
+distrib_execute_spi(char *sql, int expected)
+{
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	if (SPI_exec(sql, 0) != expected)
+		elog(ERROR, "SPI_exec failed: %s", sql);
+
+	if (SPI_finish() != SPI_OK_FINISH)
+		elog(ERROR, "SPI_finish failed");
+
+	/* Be sure to advance the command counter after the last command */
+	CommandCounterIncrement();
+}
+
+
 /*
  * distrib_truncate
  * Truncate all the data of specified table.
@@ -780,6 +1292,95 @@ distrib_delete_hash(RedistribState *distribState, ExecNodes *exec_nodes)
 }
 
 
+/*
+ * distrib_delete_buckets
+ * Delete the tuples of the given buckets on the given nodes, they have been
+ * moved to other nodes.
+ */
+static void
+distrib_delete_buckets(RedistribState *distribState, ExecNodes *exec_nodes,
+					   List *buckets)
+{
+	Relation	rel;
+	StringInfo	buf;
+	Oid			relOid = distribState->relid;
+
+	/* Nothing to do if on remote node */
+	if (IS_PGXC_DATANODE || IsConnFromCoord())
+		return;
+
+	/* A sufficient lock level needs to be taken at a higher level */
+	rel = relation_open(relOid, NoLock);
+
+	/* Inform client of operation being done */
+	ereport(DEBUG1,
+			(errmsg("Deleting moved buckets \"%s.%s\"",
+					get_namespace_name(RelationGetNamespace(rel)),
+					RelationGetRelationName(rel))));
+
+	/* Initialize buffer */
+	buf = makeStringInfo();
+
+	/* Build query to delete the tuples of the buckets */
+	appendStringInfo(buf, "DELETE FROM %s.%s WHERE ",
+					 get_namespace_name(RelationGetNamespace(rel)),
+					 RelationGetRelationName(rel));
+	distrib_bucket_condition(buf, rel, buckets);
+
+	/*
+	 * Lock is maintained until transaction commits,
+	 * relation needs also to be closed before effectively launching the query.
+	 */
+	relation_close(rel, NoLock);
+
+	/* Execute the query */
+	distrib_execute_query(buf->data, IsTempTable(relOid), exec_nodes);
+
+	/* Clean buffers */
+	pfree(buf->data);
+	pfree(buf);
+}
+
+
+/*
+ * distrib_bucket_condition
+ * Append the condition matching the tuples of the given buckets of relation
+ * distributed by bucket. The bucket is computed like in the locator, that is
+ * the low bits of the hash value of the distribution column, NULLs are in
+ * the first bucket.
+ */
+static void
+distrib_bucket_condition(StringInfo buf, Relation rel, List *buckets)
+{
+	RelationLocInfo *locinfo = RelationGetLocInfo(rel);
+	TupleDesc	tupDesc = RelationGetDescr(rel);
+	Oid			hashtype;
+	char	   *hashfuncname;
+	ListCell   *item;
+
+	if (locinfo->locatorType != LOCATOR_TYPE_BUCKET)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("Incorrect redistribution operation")));
+
+	/* Get function hash name */
+	hashtype = tupDesc->attrs[locinfo->partAttrNum - 1]->atttypid;
+	hashfuncname = get_compute_hash_function(hashtype, LOCATOR_TYPE_HASH);
+
+	appendStringInfo(buf, "COALESCE(%s(%s) & %d, 0) IN (",
+					 hashfuncname,
+					 quote_identifier(GetRelationHashColumn(locinfo)),
+					 list_length(locinfo->buckets) - 1);
+	foreach(item, buckets)
+	{
+		if (item != list_head(buckets))
+			appendStringInfoString(buf, ", ");
+		appendStringInfo(buf, "%d", lfirst_int(item));
+	}
+	appendStringInfoChar(buf, ')');
+}
+
+
 /*
  * makeRedistribState
  * Build a distribution state operator
@@ -791,6 +1392,8 @@ makeRedistribState(Oid relOid)
 	res->relid = relOid;
 	res->commands = NIL;
 	res->store = NULL;
+	res->stageName = NULL;
+	res->stageDistribution = NULL;
 	return res;
 }
 
@@ -814,6 +1417,10 @@ FreeRedistribState(RedistribState *state)
 		list_free(state->commands);
 	if (state->store)
 		tuplestore_clear(state->store);
+	if (state->stageName)
+		pfree(state->stageName);
+	if (state->stageDistribution)
+		pfree(state->stageDistribution);
 }
 
 /*
@@ -845,6 +1452,7 @@ FreeRedistribCommand(RedistribCommand *command)
 
 	if (nodes)
 		FreeExecNodes(&nodes);
+	list_free(command->buckets);
 	pfree(command);
 }
 
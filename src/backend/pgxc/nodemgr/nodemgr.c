@@ -37,6 +37,7 @@
 #define MAX_TRIES_FOR_NID	200
 
 static Datum generate_node_id(const char *node_name);
+static void check_node_standbys(Oid nodeoid, const char *node_name);
 
 /*
  * GUC parameters.
@@ -52,10 +53,12 @@ int				MaxDataNodes = 16;
 /* Global number of nodes. Point to a shared memory block */
 static int	   *shmemNumCoords;
 static int	   *shmemNumDataNodes;
+static int	   *shmemNumStandbys;
 
 /* Shared memory tables of node definitions */
 NodeDefinition *coDefs;
 NodeDefinition *dnDefs;
+NodeDefinition *sbDefs;
 
 /*
  * NodeTablesInit
@@ -97,6 +100,17 @@ NodeTablesShmemInit(void)
 	/* Mark it empty upon creation */
 	if (!found)
 		*shmemNumDataNodes = 0;
+
+	/* Same for Datanode standbys, up to one for each Datanode in total */
+	shmemNumStandbys = ShmemInitStruct("Standby Table",
+								   sizeof(int) +
+									   sizeof(NodeDefinition) * MaxDataNodes,
+								   &found);
+
+	sbDefs = (NodeDefinition *) (shmemNumStandbys + 1);
+
+	if (!found)
+		*shmemNumStandbys = 0;
 }
 
 
@@ -109,13 +123,16 @@ NodeTablesShmemSize(void)
 {
 	Size co_size;
 	Size dn_size;
+	Size sb_size;
 
 	co_size = mul_size(sizeof(NodeDefinition), MaxCoords);
 	co_size = add_size(co_size, sizeof(int));
 	dn_size = mul_size(sizeof(NodeDefinition), MaxDataNodes);
 	dn_size = add_size(dn_size, sizeof(int));
+	sb_size = mul_size(sizeof(NodeDefinition), MaxDataNodes);
+	sb_size = add_size(sb_size, sizeof(int));
 
-	return add_size(co_size, dn_size);
+	return add_size(add_size(co_size, dn_size), sb_size);
 }
 
 /*
@@ -125,9 +142,10 @@ NodeTablesShmemSize(void)
 static void
 check_node_options(const char *node_name, List *options, char **node_host,
 			int *node_port, char *node_type,
-			bool *is_primary, bool *is_preferred)
+			bool *is_primary, bool *is_preferred, Oid *standby_of)
 {
 	ListCell   *option;
+	bool		standby_of_set = false;
 
 	if (!options)
 		ereport(ERROR,
@@ -159,16 +177,32 @@ check_node_options(const char *node_name, List *options, char **node_host,
 			type_loc = defGetString(defel);
 
 			if (strcmp(type_loc, "coordinator") != 0 &&
-				strcmp(type_loc, "datanode") != 0)
+				strcmp(type_loc, "datanode") != 0 &&
+				strcmp(type_loc, "standby") != 0)
 				ereport(ERROR,
 						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-						 errmsg("type value is incorrect, specify 'coordinator or 'datanode'")));
+						 errmsg("type value is incorrect, specify 'coordinator', 'datanode' or 'standby'")));
 
 			if (strcmp(type_loc, "coordinator") == 0)
 				*node_type = PGXC_NODE_COORDINATOR;
+			else if (strcmp(type_loc, "standby") == 0)
+				*node_type = PGXC_NODE_DATANODE_STANDBY;
 			else
 				*node_type = PGXC_NODE_DATANODE;
 		}
+		else if (strcmp(defel->defname, "standby_of") == 0)
+		{
+			char	   *primary_name = defGetString(defel);
+
+			*standby_of = get_pgxc_nodeoid(primary_name);
+			if (!OidIsValid(*standby_of) ||
+				get_pgxc_nodetype(*standby_of) != PGXC_NODE_DATANODE)
+				ereport(ERROR,
+						(errcode(ERRCODE_UNDEFINED_OBJECT),
+						 errmsg("PGXC node %s: standby_of must name a Datanode",
+								node_name)));
+			standby_of_set = true;
+		}
 		else if (strcmp(defel->defname, "primary") == 0)
 		{
 			*is_primary = defGetBoolean(defel);
@@ -206,6 +240,23 @@ check_node_options(const char *node_name, List *options, char **node_host,
 				 errmsg("PGXC node %s: Node type not specified",
 						node_name)));
 
+	/* A standby replicates a Datanode, and only a standby does */
+	if (*node_type == PGXC_NODE_DATANODE_STANDBY)
+	{
+		if (!OidIsValid(*standby_of))
+			ereport(ERROR,
+					(errcode(ERRCODE_SYNTAX_ERROR),
+					 errmsg("PGXC node %s: standby_of not specified",
+							node_name)));
+	}
+	else if (standby_of_set)
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("PGXC node %s: only a standby node can have standby_of",
+						node_name)));
+	else
+		*standby_of = InvalidOid;
+
 #ifdef XCP
 	if (*node_type == PGXC_NODE_DATANODE && NumDataNodes >= MaxDataNodes)
 		ereport(ERROR,
@@ -213,6 +264,12 @@ check_node_options(const char *node_name, List *options, char **node_host,
 				 errmsg("Too many datanodes, current value of max_data_nodes is %d",
 						MaxDataNodes)));
 
+	if (*node_type == PGXC_NODE_DATANODE_STANDBY &&
+		NumStandbyNodes >= MaxDataNodes)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("Too many standby nodes, current value of max_data_nodes is %d",
+						MaxDataNodes)));
 #endif
 }
 
@@ -280,6 +337,35 @@ generate_node_id(const char *node_name)
 	return node_id;
 }
 
+/*
+ * check_node_standbys
+ *
+ * Error out if standby nodes replicate the given node
+ */
+static void
+check_node_standbys(Oid nodeoid, const char *node_name)
+{
+	Relation	rel;
+	HeapScanDesc scan;
+	HeapTuple	tuple;
+
+	rel = heap_open(PgxcNodeRelationId, AccessShareLock);
+	scan = heap_beginscan_catalog(rel, 0, NULL);
+	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
+	{
+		Form_pgxc_node nodeForm = (Form_pgxc_node) GETSTRUCT(tuple);
+
+		if (nodeForm->node_type == PGXC_NODE_DATANODE_STANDBY &&
+			nodeForm->node_standby_of == nodeoid)
+			ereport(ERROR,
+					(errcode(ERRCODE_DEPENDENT_OBJECTS_STILL_EXIST),
+					 errmsg("PGXC node %s: standby node %s depends on it",
+							node_name, NameStr(nodeForm->node_name))));
+	}
+	heap_endscan(scan);
+	heap_close(rel, AccessShareLock);
+}
+
 /* --------------------------------
  *  cmp_nodes
  *
@@ -319,6 +405,7 @@ PgxcNodeListAndCount(void)
 
 	*shmemNumCoords = 0;
 	*shmemNumDataNodes = 0;
+	*shmemNumStandbys = 0;
 
 	/*
 	 * Node information initialization is made in one scan:
@@ -340,6 +427,12 @@ PgxcNodeListAndCount(void)
 			case PGXC_NODE_COORDINATOR:
 				node = &coDefs[(*shmemNumCoords)++];
 				break;
+			case PGXC_NODE_DATANODE_STANDBY:
+				/* should not happen, the number is checked when created */
+				if (*shmemNumStandbys >= MaxDataNodes)
+					continue;
+				node = &sbDefs[(*shmemNumStandbys)++];
+				break;
 			case PGXC_NODE_DATANODE:
 			default:
 				node = &dnDefs[(*shmemNumDataNodes)++];
@@ -353,18 +446,21 @@ PgxcNodeListAndCount(void)
 		node->nodeport = nodeForm->node_port;
 		node->nodeisprimary = nodeForm->nodeis_primary;
 		node->nodeispreferred = nodeForm->nodeis_preferred;
+		node->nodestandbyof = nodeForm->node_standby_of;
 	}
 	heap_endscan(scan);
 	heap_close(rel, AccessShareLock);
 
-	elog(DEBUG1, "Done pgxc_nodes scan: %d coordinators and %d datanodes",
-			*shmemNumCoords, *shmemNumDataNodes);
+	elog(DEBUG1, "Done pgxc_nodes scan: %d coordinators, %d datanodes and %d standbys",
+			*shmemNumCoords, *shmemNumDataNodes, *shmemNumStandbys);
 
 	/* Finally sort the lists */
 	if (*shmemNumCoords > 1)
 		qsort(coDefs, *shmemNumCoords, sizeof(NodeDefinition), cmp_nodes);
 	if (*shmemNumDataNodes > 1)
 		qsort(dnDefs, *shmemNumDataNodes, sizeof(NodeDefinition), cmp_nodes);
+	if (*shmemNumStandbys > 1)
+		qsort(sbDefs, *shmemNumStandbys, sizeof(NodeDefinition), cmp_nodes);
 
 	LWLockRelease(NodeTableLock);
 }
@@ -437,6 +533,34 @@ PgxcNodeGetOids(Oid **coOids, Oid **dnOids,
 }
 
 
+/*
+ * PgxcNodeGetStandbyOids
+ *
+ * List into palloc'ed arrays the Oids of the Datanode standbys currently
+ * presented in the node table and the Oids of the Datanodes they replicate.
+ */
+void
+PgxcNodeGetStandbyOids(Oid **sbOids, Oid **primaryOids, int *num_standbys)
+{
+	int			i;
+
+	LWLockAcquire(NodeTableLock, LW_SHARED);
+
+	*num_standbys = *shmemNumStandbys;
+	*sbOids = (Oid *) palloc((*shmemNumStandbys + 1) * sizeof(Oid));
+	if (primaryOids)
+		*primaryOids = (Oid *) palloc((*shmemNumStandbys + 1) * sizeof(Oid));
+	for (i = 0; i < *shmemNumStandbys; i++)
+	{
+		(*sbOids)[i] = sbDefs[i].nodeoid;
+		if (primaryOids)
+			(*primaryOids)[i] = sbDefs[i].nodestandbyof;
+	}
+
+	LWLockRelease(NodeTableLock);
+}
+
+
 /*
  * Find node definition in the shared memory node table.
  * The structure is a copy palloc'ed in current memory context.
@@ -479,6 +603,21 @@ PgxcNodeGetDefinition(Oid node)
 		}
 	}
 
+	/* then through the standbys */
+	for (i = 0; i < *shmemNumStandbys; i++)
+	{
+		if (sbDefs[i].nodeoid == node)
+		{
+			result = (NodeDefinition *) palloc(sizeof(NodeDefinition));
+
+			memcpy(result, sbDefs + i, sizeof(NodeDefinition));
+
+			LWLockRelease(NodeTableLock);
+
+			return result;
+		}
+	}
+
 	/* not found, return NULL */
 	LWLockRelease(NodeTableLock);
 	return NULL;
@@ -505,6 +644,7 @@ PgxcNodeCreate(CreateNodeStmt *stmt)
 	int			node_port = 0;
 	bool		is_primary = false;
 	bool		is_preferred = false;
+	Oid			standby_of = InvalidOid;
 	Datum		node_id;
 
 	/* Only a DB administrator can add nodes */
@@ -530,7 +670,7 @@ PgxcNodeCreate(CreateNodeStmt *stmt)
 	/* Filter options */
 	check_node_options(node_name, stmt->options, &node_host,
 				&node_port, &node_type,
-				&is_primary, &is_preferred);
+				&is_primary, &is_preferred, &standby_of);
 
 	/* Compute node identifier */
 	node_id = generate_node_id(node_name);
@@ -587,6 +727,7 @@ PgxcNodeCreate(CreateNodeStmt *stmt)
 	values[Anum_pgxc_node_is_primary - 1] = BoolGetDatum(is_primary);
 	values[Anum_pgxc_node_is_preferred - 1] = BoolGetDatum(is_preferred);
 	values[Anum_pgxc_node_id - 1] = node_id;
+	values[Anum_pgxc_node_standby_of - 1] = ObjectIdGetDatum(standby_of);
 
 	htup = heap_form_tuple(pgxcnodesrel->rd_att, values, nulls);
 
@@ -612,6 +753,7 @@ PgxcNodeAlter(AlterNodeStmt *stmt)
 	int			node_port;
 	bool		is_preferred;
 	bool		is_primary;
+	Oid			standby_of;
 	HeapTuple	oldtup, newtup;
 	Oid			nodeOid = get_pgxc_nodeoid(node_name);
 	Relation	rel;
@@ -651,11 +793,23 @@ PgxcNodeAlter(AlterNodeStmt *stmt)
 	is_primary = is_pgxc_nodeprimary(nodeOid);
 	node_type = get_pgxc_nodetype(nodeOid);
 	node_id = get_pgxc_node_id(nodeOid);
+	standby_of = ((Form_pgxc_node) GETSTRUCT(oldtup))->node_standby_of;
 
 	/* Filter options */
 	check_node_options(node_name, stmt->options, &node_host,
 				&node_port, &node_type,
-				&is_primary, &is_preferred);
+				&is_primary, &is_preferred, &standby_of);
+
+	if (standby_of == nodeOid)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("PGXC node %s: node can not be a standby of itself",
+						node_name)));
+
+	/* A Datanode keeps being one while it has standbys */
+	if (get_pgxc_nodetype(nodeOid) == PGXC_NODE_DATANODE &&
+		node_type != PGXC_NODE_DATANODE)
+		check_node_standbys(nodeOid, node_name);
 
 	/*
 	 * Two nodes cannot be primary at the same time. If the primary
@@ -687,6 +841,8 @@ PgxcNodeAlter(AlterNodeStmt *stmt)
 	new_record_repl[Anum_pgxc_node_is_preferred - 1] = true;
 	new_record[Anum_pgxc_node_id - 1] = UInt32GetDatum(node_id);
 	new_record_repl[Anum_pgxc_node_id - 1] = true;
+	new_record[Anum_pgxc_node_standby_of - 1] = ObjectIdGetDatum(standby_of);
+	new_record_repl[Anum_pgxc_node_standby_of - 1] = true;
 
 	/* Update relation */
 	newtup = heap_modify_tuple(oldtup, RelationGetDescr(rel),
@@ -743,6 +899,9 @@ PgxcNodeRemove(DropNodeStmt *stmt)
 	 * However, we have to be sure that there are no pooler agents in the cluster pointing to it.
 	 */
 
+	/* Standbys of a Datanode are dropped first */
+	check_node_standbys(noid, node_name);
+
 	/* Delete the pgxc_node tuple */
 	relation = heap_open(PgxcNodeRelationId, RowExclusiveLock);
 	tup = SearchSysCache1(PGXCNODEOID, ObjectIdGetDatum(noid));
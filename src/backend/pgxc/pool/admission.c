@@ -0,0 +1,286 @@
+/*-------------------------------------------------------------------------
+ *
+ * admission.c
+ *	  Admission control of the distributed statements of a Coordinator
+ *
+ * When too many distributed statements run at once, their remote subplans
+ * exhaust the shared queues, the pooled connections and the memory of the
+ * Datanodes together, and most of them fail. A Coordinator can limit how
+ * many of its statements are running on the Datanodes: the others wait
+ * before dispatching anything, and go on as the running ones finish, so the
+ * throughput stays at its peak.
+ *
+ * Statements are of the small or the large class, chosen by the cost of
+ * their plan, or set for a role with statement_class. The large ones have a
+ * limit of their own, so they can not take all the slots, and the small
+ * ones do not queue for too long behind them.
+ *
+ * A statement is admitted when its first remote subplan is initialized, and
+ * holds its slot until the executor that admitted it ends, or the
+ * transaction ends. The waiting backends are woken up through their latches
+ * when a slot is released.
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/pgxc/pool/admission.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "pgxc/admission.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "storage/sinvaladt.h"
+#include "storage/spin.h"
+#include "utils/timestamp.h"
+
+/* Configuration options */
+int			MaxActiveStatements = 0;
+int			MaxActiveLargeStatements = 0;
+double		LargeStatementCost = 100000.0;
+int			StatementClassSetting = STATEMENT_CLASS_AUTO;
+int			AdmissionTimeout = 0;
+
+typedef struct
+{
+	slock_t		mutex;
+	int			active;			/* statements admitted */
+	int			active_large;	/* of them, those of the large class */
+	int			nwaiting;		/* backends waiting for admission */
+	bool		waiting[FLEXIBLE_ARRAY_MEMBER];	/* by backend id */
+} AdmissionControlData;
+
+static AdmissionControlData *AdmissionCtl = NULL;
+
+/* Admission of the statement of this backend */
+static bool admitted = false;
+static bool admitted_large = false;
+static EState *admitted_estate = NULL;
+static bool waiting = false;
+
+static bool admission_try(bool large);
+static void admission_stop_waiting(void);
+static void admission_release(void);
+
+
+/* Report shared memory space needed by AdmissionShmemInit */
+Size
+AdmissionShmemSize(void)
+{
+	Size		size = 0;
+
+	size = add_size(size, offsetof(AdmissionControlData, waiting));
+	size = add_size(size, mul_size(MaxBackends, sizeof(bool)));
+
+	return size;
+}
+
+/* Allocate and initialize admission control shared memory */
+void
+AdmissionShmemInit(void)
+{
+	bool		found;
+
+	AdmissionCtl = (AdmissionControlData *)
+		ShmemInitStruct("Admission Control", AdmissionShmemSize(), &found);
+
+	if (!found)
+	{
+		MemSet(AdmissionCtl, 0, AdmissionShmemSize());
+		SpinLockInit(&AdmissionCtl->mutex);
+	}
+}
+
+
+/*
+ * Take a slot for the statement if the limits allow it. Otherwise register
+ * the backend as waiting, in the same critical section, so a slot released
+ * afterwards always sets its latch.
+ */
+static bool
+admission_try(bool large)
+{
+	volatile AdmissionControlData *ctl = AdmissionCtl;
+	bool		ok;
+
+	SpinLockAcquire(&ctl->mutex);
+	ok = (MaxActiveStatements <= 0 ||
+		  ctl->active < MaxActiveStatements) &&
+		(!large || MaxActiveLargeStatements <= 0 ||
+		 ctl->active_large < MaxActiveLargeStatements);
+	if (ok)
+	{
+		ctl->active++;
+		if (large)
+			ctl->active_large++;
+		if (waiting)
+		{
+			ctl->waiting[MyBackendId - 1] = false;
+			ctl->nwaiting--;
+			waiting = false;
+		}
+	}
+	else if (!waiting)
+	{
+		ctl->waiting[MyBackendId - 1] = true;
+		ctl->nwaiting++;
+		waiting = true;
+	}
+	SpinLockRelease(&ctl->mutex);
+
+	return ok;
+}
+
+static void
+admission_stop_waiting(void)
+{
+	volatile AdmissionControlData *ctl = AdmissionCtl;
+
+	SpinLockAcquire(&ctl->mutex);
+	ctl->waiting[MyBackendId - 1] = false;
+	ctl->nwaiting--;
+	SpinLockRelease(&ctl->mutex);
+	waiting = false;
+}
+
+/*
+ * Give back the slot of the statement, and wake up the waiting backends.
+ * They race for the slot, the losers register again.
+ */
+static void
+admission_release(void)
+{
+	volatile AdmissionControlData *ctl = AdmissionCtl;
+	int			nwaiting;
+	int			i;
+
+	SpinLockAcquire(&ctl->mutex);
+	ctl->active--;
+	if (admitted_large)
+		ctl->active_large--;
+	nwaiting = ctl->nwaiting;
+	SpinLockRelease(&ctl->mutex);
+
+	admitted = false;
+	admitted_large = false;
+	admitted_estate = NULL;
+
+	for (i = 0; nwaiting > 0 && i < MaxBackends; i++)
+	{
+		if (ctl->waiting[i])
+		{
+			PGPROC	   *proc = BackendIdGetProc(i + 1);
+
+			if (proc)
+				SetLatch(&proc->procLatch);
+			nwaiting--;
+		}
+	}
+}
+
+
+/*
+ * AdmitStatement
+ *	Wait until the statement being started by the executor may run on the
+ *	Datanodes. Nothing is done if the statement of the backend is admitted
+ *	already, like when a function called by it runs a statement.
+ */
+void
+AdmitStatement(EState *estate)
+{
+	TimestampTz start = 0;
+	bool		large;
+
+	if (admitted || AdmissionCtl == NULL ||
+		(MaxActiveStatements <= 0 && MaxActiveLargeStatements <= 0))
+		return;
+
+	switch (StatementClassSetting)
+	{
+		case STATEMENT_CLASS_SMALL:
+			large = false;
+			break;
+		case STATEMENT_CLASS_LARGE:
+			large = true;
+			break;
+		default:
+			large = estate->es_plannedstmt != NULL &&
+				estate->es_plannedstmt->planTree != NULL &&
+				estate->es_plannedstmt->planTree->total_cost >=
+				LargeStatementCost;
+			break;
+	}
+
+	for (;;)
+	{
+		int			rc;
+		long		timeout = -1;
+
+		ResetLatch(MyLatch);
+		if (admission_try(large))
+			break;
+
+		if (AdmissionTimeout > 0)
+		{
+			long		secs;
+			int			usecs;
+
+			if (start == 0)
+				start = GetCurrentTimestamp();
+			TimestampDifference(start, GetCurrentTimestamp(), &secs, &usecs);
+			timeout = AdmissionTimeout - (secs * 1000 + usecs / 1000);
+			if (timeout <= 0)
+			{
+				admission_stop_waiting();
+				ereport(ERROR,
+						(errcode(ERRCODE_QUERY_CANCELED),
+						 errmsg("canceling statement waiting for admission"),
+						 errdetail("Too many distributed statements are running on this Coordinator.")));
+			}
+		}
+
+		rc = WaitLatch(MyLatch,
+					   WL_LATCH_SET | WL_POSTMASTER_DEATH |
+					   (timeout > 0 ? WL_TIMEOUT : 0),
+					   timeout);
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	admitted = true;
+	admitted_large = large;
+	admitted_estate = estate;
+}
+
+/*
+ * ReleaseStatement
+ *	The executor is ending, give back the slot if it took it.
+ */
+void
+ReleaseStatement(EState *estate)
+{
+	if (admitted && estate == admitted_estate)
+		admission_release();
+}
+
+/*
+ * AtEOXact_Admission
+ *	The executor may have not ended because of an error, give back the slot
+ *	if held, and stop waiting for one.
+ */
+void
+AtEOXact_Admission(void)
+{
+	if (waiting)
+		admission_stop_waiting();
+	if (admitted)
+		admission_release();
+}
@@ -27,30 +27,44 @@
 #include "access/sysattr.h"
 #include "access/transam.h"
 #include "access/xact.h"
+#include "access/xlog.h"
 #include "access/relscan.h"
 #include "catalog/pg_type.h"
 #include "catalog/pgxc_node.h"
 #include "commands/prepare.h"
+#include "funcapi.h"
 #include "executor/executor.h"
+#include "executor/nodeGather.h"
+#include "executor/spi.h"
 #include "gtm/gtm_c.h"
 #include "libpq/libpq.h"
+#include "libpq/pqformat.h"
 #include "miscadmin.h"
+#include "pgxc/admission.h"
 #include "pgxc/execRemote.h"
+#include "pgxc/resultcache.h"
 #include "tcop/tcopprot.h"
 #include "executor/nodeSubplan.h"
 #include "nodes/nodeFuncs.h"
 #include "pgstat.h"
 #include "nodes/nodes.h"
+#include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/var.h"
 #include "pgxc/copyops.h"
+#include "pgxc/globalindex.h"
 #include "pgxc/nodemgr.h"
 #include "pgxc/poolmgr.h"
 #include "storage/ipc.h"
+#include "storage/lmgr.h"
+#include "storage/proc.h"
+#include "storage/procarray.h"
 #include "utils/datum.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/pg_rusage.h"
+#include "utils/resowner.h"
+#include "utils/tuplestore.h"
 #include "utils/tuplesort.h"
 #include "utils/snapmgr.h"
 #include "utils/builtins.h"
@@ -62,6 +76,72 @@
 
 /* Enforce the use of two-phase commit when temporary objects are used */
 bool EnforceTwoPhaseCommit = true;
+/*
+ * Max amount of data, in kilobytes, read in advance from a Datanode
+ * connection while rows received from other connections are processed
+ */
+int RemotePrefetchSize = 256;
+/*
+ * Number of rows a Datanode portal is asked for at once when a remote subplan
+ * reads it as a cursor. Requests of a portal that keeps being resumed grow up
+ * to REMOTE_FETCH_GROWTH times that.
+ */
+int RemoteFetchSize = 1000;
+#define REMOTE_FETCH_GROWTH 64
+/*
+ * Keep remote subplans of prepared statements stored on the Datanodes, so
+ * they are not sent down and restored at every execution
+ */
+bool CacheRemoteSubplans = true;
+/*
+ * Do not wait for the BEGIN responses, send the command right after BEGIN and
+ * skip the BEGIN responses when the command responses are received
+ */
+bool RemotePipelineBegin = true;
+/*
+ * Number of simple INSERTs in a transaction block sent to a Datanode without
+ * waiting for the results, zero to wait for every INSERT
+ */
+int InsertBatchSize = 0;
+/*
+ * Number of utility statements in a transaction block sent to the remote nodes
+ * without waiting for the results, zero to wait for every statement
+ */
+int DDLBatchSize = 0;
+/*
+ * Release node connections at the end of transaction even if remote subplans
+ * are stored on the nodes, the subplans are dropped and sent again if needed
+ */
+bool TransactionPooling = false;
+/*
+ * Datanode sessions keep their connections to the other Datanodes at the end
+ * of transaction, the next transactions of the session reuse them
+ */
+bool KeepPeerConnections = false;
+/*
+ * Run the read-only statements shipped to Datanodes outside of transaction
+ * blocks on standbys of the Datanodes lagging at most that many milliseconds
+ * behind, -1 to always run them on the Datanodes
+ */
+int StandbyReadMaxLag = -1;
+/*
+ * Report implicit two-phase commits to the client before COMMIT PREPARED
+ * completes on the remote nodes, see FinishAsyncCommit
+ */
+bool AsyncCommitPrepared = false;
+/*
+ * Memory in kilobytes shared by the fragments of a distributed query running
+ * on remote nodes, zero to let each of them use work_mem
+ */
+int QueryWorkMem = 0;
+/*
+ * Commit transactions which have written to replicated tables only without
+ * two-phase commit, on the primary node first
+ */
+bool ReplicatedOnePhaseCommit = false;
+
+/* Try to prefetch once per that many rows fetched from connections */
+#define PREFETCH_INTERVAL 64
 /*
  * We do not want it too long, when query is terminating abnormally we just
  * want to read in already available data, if datanode connection will reach a
@@ -80,18 +160,30 @@ typedef struct
 } abort_callback_type;
 
 /*
- * Buffer size does not affect performance significantly, just do not allow
- * connection buffer grows infinitely
+ * COPY data are sent to a node without waiting each time the buffer grows by
+ * COPY_BUFFER_SIZE. Whatever the socket does not accept stays in the buffer,
+ * so a slow node does not hold up the rows routed to the other nodes, until
+ * its backlog reaches COPY_BACKLOG_SIZE.
  */
 #define COPY_BUFFER_SIZE 8192
+#define COPY_BACKLOG_SIZE (1024 * 1024)
 #define PRIMARY_NODE_WRITEAHEAD 1024 * 1024
 
 /*
  * Flag to track if a temporary object is accessed by the current transaction
  */
 static bool temp_object_included = false;
+/*
+ * Flag to track if the current transaction has written to the nodes anything
+ * else than rows of replicated tables, see ReplicatedOnePhaseCommit
+ */
+static bool xact_nonreplicated_write = false;
+/* The next pgxc_node_begin is for a write to replicated tables only */
+static bool begin_replicated_write = false;
 static abort_callback_type dbcleanup_info = { NULL, NULL };
 
+static bool release_connections_at_end(void);
+
 static int	pgxc_node_begin(int conn_count, PGXCNodeHandle ** connections,
 				GlobalTransactionId gxid, bool need_tran_block,
 				bool readOnly, char node_type);
@@ -105,15 +197,48 @@ static PGXCNodeAllHandles *get_exec_connections(RemoteQueryState *planstate,
 static bool pgxc_start_command_on_connection(PGXCNodeHandle *connection,
 					RemoteQueryState *remotestate, Snapshot snapshot);
 
-static char *pgxc_node_remote_prepare(char *prepareGID, bool localNode);
+/*
+ * Implicit two-phase commit reported to the client before the COMMIT
+ * PREPARED commands sent to the nodes complete
+ */
+typedef struct AsyncCommit
+{
+	bool		pending;
+	char	   *gid;
+	PGXCNodeHandle **connections;	/* running COMMIT PREPARED */
+	int			conn_count;
+} AsyncCommit;
+
+static AsyncCommit asyncCommit;
+
+static char *pgxc_node_remote_prepare(char *prepareGID, bool localNode,
+									  bool implicit);
 static bool pgxc_node_remote_finish(char *prepareGID, bool commit,
 						char *nodestring, GlobalTransactionId gxid,
-						GlobalTransactionId prepare_gxid);
+						GlobalTransactionId prepare_gxid, bool wait);
+static GlobalTransactionId pgxc_get_remote_gxid(void);
+static void pgxc_node_defer_finish(char *prepareGID, int conn_count,
+					   PGXCNodeHandle **connections);
+static void pgxc_node_forget_async_commit(void);
+static void pgxc_node_add_diverged(StringInfo diverged, PGXCNodeHandle *conn);
 static void pgxc_node_remote_commit(void);
 static void pgxc_node_remote_abort(void);
+static void pgxc_node_finish_deferred(int conn_count,
+									 PGXCNodeHandle **connections);
 static void pgxc_connections_cleanup(ResponseCombiner *combiner);
+static void buffer_data_row(ResponseCombiner *combiner, RemoteDataRow datarow);
+static RemoteDataRow get_buffered_row(ResponseCombiner *combiner, Oid nodeoid);
+static void free_row_buffers(ResponseCombiner *combiner);
+static int	remote_fetch_size(ResponseCombiner *combiner, PGXCNodeHandle *conn);
+static void reset_fetch_sizes(ResponseCombiner *combiner);
+static MemoryContext combiner_row_context(ResponseCombiner *combiner);
 
 static void pgxc_node_report_error(ResponseCombiner *combiner);
+static int16 append_param_data(StringInfo buf, Oid ptype, Datum value,
+							   bool isnull);
+static int finish_param_data(StringInfo values, int nparams, int16 *formats,
+							 char **result);
+static int simple_insert_rows(RemoteSubplan *node, EState *estate);
 
 #define REMOVE_CURR_CONN(combiner) \
 	if ((combiner)->current_conn < --((combiner)->conn_count)) \
@@ -234,17 +359,25 @@ InitResponseCombiner(ResponseCombiner *combiner, int node_count,
 	combiner->probing_primary = false;
 	combiner->returning_node = InvalidOid;
 	combiner->currentRow = NULL;
-	combiner->rowBuffer = NIL;
+	combiner->prefetch_counter = 0;
+	combiner->rowBufferCount = 0;
+	combiner->rowBufferNodes = NULL;
+	combiner->rowBuffers = NULL;
+	combiner->rowBufferRows = NULL;
+	combiner->fetchSizeCount = 0;
+	combiner->fetchSizeNodes = NULL;
+	combiner->fetchSizes = NULL;
 	combiner->tapenodes = NULL;
 	combiner->merge_sort = false;
 	combiner->extended_query = false;
-	combiner->tapemarks = NULL;
 	combiner->tuplesortstate = NULL;
 	combiner->cursor = NULL;
 	combiner->update_cursor = NULL;
 	combiner->cursor_count = 0;
 	combiner->cursor_connections = NULL;
 	combiner->remoteCopyType = REMOTE_COPY_NONE;
+	combiner->collect_instr = false;
+	combiner->remote_instr = NIL;
 }
 
 
@@ -625,9 +758,13 @@ HandleDataRow(ResponseCombiner *combiner, char *msg_body, size_t len, Oid node)
 
 	/*
 	 * We are copying message because it points into connection buffer, and
-	 * will be overwritten on next socket read
+	 * will be overwritten on next socket read. The copy is made in the memory
+	 * context of the result slot, so it can be handed over to the slot as is,
+	 * see StoreDataRowTupleInSlot.
 	 */
-	combiner->currentRow = (RemoteDataRow) palloc(sizeof(RemoteDataRowData) + len);
+	combiner->currentRow = (RemoteDataRow)
+			MemoryContextAlloc(combiner_row_context(combiner),
+							   sizeof(RemoteDataRowData) + len);
 	memcpy(combiner->currentRow->msg, msg_body, len);
 	combiner->currentRow->msglen = len;
 	combiner->currentRow->msgnode = node;
@@ -829,6 +966,44 @@ HandleDatanodeCommandId(ResponseCombiner *combiner, char *msg_body, size_t len)
 		SetReceivedCommandId(cid);
 }
 
+/*
+ * Keep the statistics of a fragment executed on a remote node ('i' message)
+ * for EXPLAIN ANALYZE. They belong to the RemoteSubplan whose cursor the
+ * node reports, late reports of other portals are dropped.
+ */
+static void
+HandleRemoteInstrumentation(ResponseCombiner *combiner, char *msg_body,
+							size_t len, Oid nodeoid)
+{
+	StringInfoData buf;
+	const char *portal;
+	RemoteInstrumentation *instr;
+
+	if (combiner == NULL || !combiner->collect_instr)
+		return;
+
+	buf.data = msg_body;
+	buf.len = len;
+	buf.maxlen = len;
+	buf.cursor = 0;
+
+	portal = pq_getmsgstring(&buf);
+	if (strcmp(portal, combiner->cursor ? combiner->cursor : "") != 0)
+		return;
+
+	instr = (RemoteInstrumentation *)
+		MemoryContextAlloc(combiner->ss.ps.state->es_query_cxt,
+						   sizeof(RemoteInstrumentation));
+	instr->nodeoid = nodeoid;
+	instr->ntuples = (double) pq_getmsgint64(&buf);
+	instr->total = (double) pq_getmsgint64(&buf) / 1000000.0;
+	instr->shared_blks_hit = (long) pq_getmsgint64(&buf);
+	instr->shared_blks_read = (long) pq_getmsgint64(&buf);
+	instr->temp_blks_written = (long) pq_getmsgint64(&buf);
+
+	combiner->remote_instr = lappend(combiner->remote_instr, instr);
+}
+
 /*
  * Record waited-for XIDs received from the remote nodes into the transaction
  * state
@@ -915,8 +1090,8 @@ CloseCombiner(ResponseCombiner *combiner)
 		pfree(combiner->cursor_connections);
 	if (combiner->tapenodes)
 		pfree(combiner->tapenodes);
-	if (combiner->tapemarks)
-		pfree(combiner->tapemarks);
+	free_row_buffers(combiner);
+	reset_fetch_sizes(combiner);
 }
 
 /*
@@ -976,23 +1151,6 @@ BufferConnection(PGXCNodeHandle *conn)
 	}
 	Assert(combiner->current_conn < combiner->conn_count);
 
-	if (combiner->tapemarks == NULL)
-		combiner->tapemarks = (ListCell**) palloc0(combiner->conn_count * sizeof(ListCell*));
-
-	/*
-	 * If current bookmark for the current tape is not set it means either
-	 * first row in the buffer is from the current tape or no rows from
-	 * the tape in the buffer, so if first row is not from current
-	 * connection bookmark the last cell in the list.
-	 */
-	if (combiner->tapemarks[combiner->current_conn] == NULL &&
-			list_length(combiner->rowBuffer) > 0)
-	{
-		RemoteDataRow dataRow = (RemoteDataRow) linitial(combiner->rowBuffer);
-		if (dataRow->msgnode != conn->nodeoid)
-			combiner->tapemarks[combiner->current_conn] = list_tail(combiner->rowBuffer);
-	}
-
 	/*
 	 * Buffer data rows until data node return number of rows specified by the
 	 * fetch_size parameter of last Execute message (PortalSuspended message)
@@ -1005,8 +1163,7 @@ BufferConnection(PGXCNodeHandle *conn)
 		/* Move to buffer currentRow (received from the data node) */
 		if (combiner->currentRow)
 		{
-			combiner->rowBuffer = lappend(combiner->rowBuffer,
-										  combiner->currentRow);
+			buffer_data_row(combiner, combiner->currentRow);
 			combiner->currentRow = NULL;
 		}
 
@@ -1115,23 +1272,210 @@ BufferConnection(PGXCNodeHandle *conn)
 }
 
 /*
- * copy the datarow from combiner to the given slot, in the slot's memory
- * context
+ * Put the data row into the row buffer of the node it came from, the
+ * function takes ownership of the row. The buffer is created if needed.
+ * Buffers are divided work_mem between the participating nodes and spill
+ * rows to temporary files when they do not fit.
+ */
+static void
+buffer_data_row(ResponseCombiner *combiner, RemoteDataRow datarow)
+{
+	ResourceOwner oldowner;
+	int			i;
+
+	for (i = 0; i < combiner->rowBufferCount; i++)
+		if (combiner->rowBufferNodes[i] == datarow->msgnode)
+			break;
+
+	if (i == combiner->rowBufferCount)
+	{
+		int			maxKBytes;
+
+		if (combiner->rowBufferCount == 0)
+		{
+			combiner->rowBufferNodes = (Oid *) palloc(sizeof(Oid));
+			combiner->rowBuffers = (Tuplestorestate **)
+					palloc(sizeof(Tuplestorestate *));
+			combiner->rowBufferRows = (long *) palloc(sizeof(long));
+		}
+		else
+		{
+			combiner->rowBufferNodes = (Oid *)
+					repalloc(combiner->rowBufferNodes, (i + 1) * sizeof(Oid));
+			combiner->rowBuffers = (Tuplestorestate **)
+					repalloc(combiner->rowBuffers,
+							 (i + 1) * sizeof(Tuplestorestate *));
+			combiner->rowBufferRows = (long *)
+					repalloc(combiner->rowBufferRows, (i + 1) * sizeof(long));
+		}
+		maxKBytes = Max(work_mem / Max(combiner->node_count, 1), 64);
+		combiner->rowBufferNodes[i] = datarow->msgnode;
+		combiner->rowBuffers[i] = tuplestore_begin_datarow(false, maxKBytes,
+														   NULL);
+		combiner->rowBufferRows[i] = 0;
+		combiner->rowBufferCount++;
+	}
+
+	/*
+	 * The connection may be buffered on behalf of another portal, so its
+	 * resource owner may be released before we read the rows back. Create
+	 * temporary files of the buffer on the transaction level.
+	 */
+	oldowner = CurrentResourceOwner;
+	if (TopTransactionResourceOwner)
+		CurrentResourceOwner = TopTransactionResourceOwner;
+	tuplestore_putdatarow(combiner->rowBuffers[i], datarow);
+	CurrentResourceOwner = oldowner;
+	combiner->rowBufferRows[i]++;
+}
+
+
+/*
+ * Get next buffered row of the specified node, or of any node if nodeoid is
+ * invalid. Returns NULL if no such row is buffered. Like rows received from
+ * the connection the row is allocated in the combiner_row_context.
+ */
+static RemoteDataRow
+get_buffered_row(ResponseCombiner *combiner, Oid nodeoid)
+{
+	MemoryContext oldcontext;
+	int			i;
+
+	for (i = 0; i < combiner->rowBufferCount; i++)
+	{
+		RemoteDataRow datarow;
+
+		if (combiner->rowBufferRows[i] == 0)
+			continue;
+		if (OidIsValid(nodeoid) && combiner->rowBufferNodes[i] != nodeoid)
+			continue;
+
+		oldcontext = MemoryContextSwitchTo(combiner_row_context(combiner));
+		datarow = tuplestore_getdatarow(combiner->rowBuffers[i]);
+		MemoryContextSwitchTo(oldcontext);
+		Assert(datarow);
+		/*
+		 * Empty the buffer when everything is read to release memory and
+		 * files. That also keeps the read pointer from reaching EOF, which
+		 * would not be reset when more rows are buffered.
+		 */
+		if (--combiner->rowBufferRows[i] == 0)
+			tuplestore_clear(combiner->rowBuffers[i]);
+		return datarow;
+	}
+	return NULL;
+}
+
+
+/*
+ * Discard all buffered rows and release the buffers.
+ */
+static void
+free_row_buffers(ResponseCombiner *combiner)
+{
+	int			i;
+
+	for (i = 0; i < combiner->rowBufferCount; i++)
+		tuplestore_end(combiner->rowBuffers[i]);
+	if (combiner->rowBufferCount > 0)
+	{
+		pfree(combiner->rowBufferNodes);
+		pfree(combiner->rowBuffers);
+		pfree(combiner->rowBufferRows);
+	}
+	combiner->rowBufferCount = 0;
+	combiner->rowBufferNodes = NULL;
+	combiner->rowBuffers = NULL;
+	combiner->rowBufferRows = NULL;
+}
+
+
+/*
+ * Number of rows to request when the portal on the node of the connection is
+ * resumed. The first requests are of remote_fetch_size rows, so a query
+ * reading a few rows does not make the nodes produce more. Each time the
+ * portal is resumed the next request is doubled, so large results are
+ * transferred in few round trips, up to REMOTE_FETCH_GROWTH times
+ * remote_fetch_size.
+ */
+static int
+remote_fetch_size(ResponseCombiner *combiner, PGXCNodeHandle *conn)
+{
+	int64		maxsize = (int64) RemoteFetchSize * REMOTE_FETCH_GROWTH;
+	int			size;
+	int			i;
+
+	for (i = 0; i < combiner->fetchSizeCount; i++)
+		if (combiner->fetchSizeNodes[i] == conn->nodeoid)
+			break;
+
+	if (i == combiner->fetchSizeCount)
+	{
+		if (combiner->fetchSizeCount == 0)
+		{
+			combiner->fetchSizeNodes = (Oid *) palloc(sizeof(Oid));
+			combiner->fetchSizes = (int *) palloc(sizeof(int));
+		}
+		else
+		{
+			combiner->fetchSizeNodes = (Oid *)
+					repalloc(combiner->fetchSizeNodes, (i + 1) * sizeof(Oid));
+			combiner->fetchSizes = (int *)
+					repalloc(combiner->fetchSizes, (i + 1) * sizeof(int));
+		}
+		combiner->fetchSizeNodes[i] = conn->nodeoid;
+		combiner->fetchSizes[i] = RemoteFetchSize;
+		combiner->fetchSizeCount++;
+	}
+
+	size = combiner->fetchSizes[i];
+	combiner->fetchSizes[i] = (int) Min((int64) size * 2, maxsize);
+	return size;
+}
+
+
+/*
+ * Forget the request sizes, the portals are started over.
+ */
+static void
+reset_fetch_sizes(ResponseCombiner *combiner)
+{
+	if (combiner->fetchSizeCount > 0)
+	{
+		pfree(combiner->fetchSizeNodes);
+		pfree(combiner->fetchSizes);
+	}
+	combiner->fetchSizeCount = 0;
+	combiner->fetchSizeNodes = NULL;
+	combiner->fetchSizes = NULL;
+}
+
+
+/*
+ * Memory context where data rows received by the combiner are allocated.
+ * That is the context of the result slot, if the combiner has one, so rows
+ * can be passed to the slot without copying.
+ */
+static MemoryContext
+combiner_row_context(ResponseCombiner *combiner)
+{
+	TupleTableSlot *slot = combiner->ss.ps.ps_ResultTupleSlot;
+
+	return slot ? slot->tts_mcxt : CurrentMemoryContext;
+}
+
+
+/*
+ * Pass the datarow from combiner to the given slot. The row is allocated in
+ * the slot's memory context, see HandleDataRow and get_buffered_row, so the
+ * slot just takes ownership of it.
  */
 static void
-CopyDataRowTupleToSlot(ResponseCombiner *combiner, TupleTableSlot *slot)
+StoreDataRowTupleInSlot(ResponseCombiner *combiner, TupleTableSlot *slot)
 {
-	RemoteDataRow 	datarow;
-	MemoryContext	oldcontext;
-	oldcontext = MemoryContextSwitchTo(slot->tts_mcxt);
-	datarow = (RemoteDataRow) palloc(sizeof(RemoteDataRowData) + combiner->currentRow->msglen);
-	datarow->msgnode = combiner->currentRow->msgnode;
-	datarow->msglen = combiner->currentRow->msglen;
-	memcpy(datarow->msg, combiner->currentRow->msg, datarow->msglen);
-	ExecStoreDataRowTuple(datarow, slot, true);
-	pfree(combiner->currentRow);
+	Assert(GetMemoryChunkContext(combiner->currentRow) == slot->tts_mcxt);
+	ExecStoreDataRowTuple(combiner->currentRow, slot, true);
 	combiner->currentRow = NULL;
-	MemoryContextSwitchTo(oldcontext);
 }
 
 
@@ -1145,7 +1489,7 @@ CopyDataRowTupleToSlot(ResponseCombiner *combiner, TupleTableSlot *slot)
  * connection defined by combiner->current_conn, or NULL slot if no more tuple
  * are available from the connection. Otherwise it returns tuple from any
  * connection or NULL slot if no more available connections.
- * 		Function looks into combiner->rowBuffer before accessing connection
+ * 		Function looks into combiner->rowBuffers before accessing connection
  * and return a tuple from there if found.
  * 		Function may wait while more data arrive from the data nodes. If there
  * is a locally executed subplan function advance it and buffer resulting rows
@@ -1222,84 +1566,15 @@ FetchTuple(ResponseCombiner *combiner)
 	}
 
 	/*
-	 * First look into the row buffer.
+	 * First look into the row buffers.
 	 * When we are performing merge sort we need to get from the buffer record
-	 * from the connection marked as "current". Otherwise get first.
+	 * from the connection marked as "current". Otherwise get any.
 	 */
-	if (list_length(combiner->rowBuffer) > 0)
+	if (combiner->rowBufferCount > 0)
 	{
-		RemoteDataRow dataRow;
-
 		Assert(combiner->currentRow == NULL);
-
-		if (combiner->merge_sort)
-		{
-			ListCell *lc;
-			ListCell *prev;
-
-			elog(DEBUG1, "Getting buffered tuple from node %x", nodeOid);
-
-			prev = combiner->tapemarks[combiner->current_conn];
-			if (prev)
-			{
-				/*
-				 * Start looking through the list from the bookmark.
-				 * Probably the first cell we check contains row from the needed
-				 * node. Otherwise continue scanning until we encounter one,
-				 * advancing prev pointer as well.
-				 */
-				while((lc = lnext(prev)) != NULL)
-				{
-					dataRow = (RemoteDataRow) lfirst(lc);
-					if (dataRow->msgnode == nodeOid)
-					{
-						combiner->currentRow = dataRow;
-						break;
-					}
-					prev = lc;
-				}
-			}
-			else
-			{
-				/*
-				 * Either needed row is the first in the buffer or no such row
-				 */
-				lc = list_head(combiner->rowBuffer);
-				dataRow = (RemoteDataRow) lfirst(lc);
-				if (dataRow->msgnode == nodeOid)
-					combiner->currentRow = dataRow;
-				else
-					lc = NULL;
-			}
-			if (lc)
-			{
-				/*
-				 * Delete cell from the buffer. Before we delete we must check
-				 * the bookmarks, if the cell is a bookmark for any tape.
-				 * If it is the case we are deleting last row of the current
-				 * block from the current tape. That tape should have bookmark
-				 * like current, and current bookmark will be advanced when we
-				 * read the tape once again.
-				 */
-				int i;
-				for (i = 0; i < combiner->conn_count; i++)
-				{
-					if (combiner->tapemarks[i] == lc)
-						combiner->tapemarks[i] = prev;
-				}
-				elog(DEBUG1, "Found buffered tuple from node %x", nodeOid);
-				combiner->rowBuffer = list_delete_cell(combiner->rowBuffer,
-													   lc, prev);
-			}
-			elog(DEBUG1, "Update tapemark");
-			combiner->tapemarks[combiner->current_conn] = prev;
-		}
-		else
-		{
-			dataRow = (RemoteDataRow) linitial(combiner->rowBuffer);
-			combiner->currentRow = dataRow;
-			combiner->rowBuffer = list_delete_first(combiner->rowBuffer);
-		}
+		combiner->currentRow = get_buffered_row(combiner,
+								combiner->merge_sort ? nodeOid : InvalidOid);
 	}
 
 	/* If we have node message in the currentRow slot, and it is from a proper
@@ -1309,7 +1584,7 @@ FetchTuple(ResponseCombiner *combiner)
 		Assert(!combiner->merge_sort ||
 			   combiner->currentRow->msgnode == nodeOid);
 		slot = combiner->ss.ps.ps_ResultTupleSlot;
-		CopyDataRowTupleToSlot(combiner, slot);
+		StoreDataRowTupleInSlot(combiner, slot);
 		return slot;
 	}
 
@@ -1337,7 +1612,8 @@ FetchTuple(ResponseCombiner *combiner)
 				return NULL;
 			}
 
-			if (pgxc_node_send_execute(conn, combiner->cursor, 1000) != 0)
+			if (pgxc_node_send_execute(conn, combiner->cursor,
+									   remote_fetch_size(combiner, conn)) != 0)
 			{
 				ereport(ERROR,
 						(errcode(ERRCODE_INTERNAL_ERROR),
@@ -1363,8 +1639,19 @@ FetchTuple(ResponseCombiner *combiner)
 		res = handle_response(conn, combiner);
 		if (res == RESPONSE_DATAROW)
 		{
+			/*
+			 * While the upper plan nodes are busy with the row keep other
+			 * nodes sending, read in what they have sent so far.
+			 */
+			if (RemotePrefetchSize > 0 && combiner->conn_count > 1 &&
+					++combiner->prefetch_counter >= PREFETCH_INTERVAL)
+			{
+				combiner->prefetch_counter = 0;
+				pgxc_node_prefetch(combiner->conn_count, combiner->connections,
+								   (size_t) RemotePrefetchSize * 1024);
+			}
 			slot = combiner->ss.ps.ps_ResultTupleSlot;
-			CopyDataRowTupleToSlot(combiner, slot);
+			StoreDataRowTupleInSlot(combiner, slot);
 			return slot;
 		}
 		else if (res == RESPONSE_EOF)
@@ -1385,7 +1672,8 @@ FetchTuple(ResponseCombiner *combiner)
 			 */
 			if (combiner->merge_sort || combiner->probing_primary)
 			{
-				if (pgxc_node_send_execute(conn, combiner->cursor, 1000) != 0)
+				if (pgxc_node_send_execute(conn, combiner->cursor,
+										   remote_fetch_size(combiner, conn)) != 0)
 					ereport(ERROR,
 							(errcode(ERRCODE_INTERNAL_ERROR),
 							 errmsg("Failed to send execute cursor '%s' to node %u", combiner->cursor, conn->nodeoid)));
@@ -1404,7 +1692,8 @@ FetchTuple(ResponseCombiner *combiner)
 			 * Tell the node to fetch data in background, next loop when we 
 			 * pgxc_node_receive, data is already there, so we can run faster
 			 * */
-			if (pgxc_node_send_execute(conn, combiner->cursor, 1000) != 0)
+			if (pgxc_node_send_execute(conn, combiner->cursor,
+									   remote_fetch_size(combiner, conn)) != 0)
 			{
 				ereport(ERROR,
 						(errcode(ERRCODE_INTERNAL_ERROR),
@@ -1683,6 +1972,11 @@ handle_response(PGXCNodeHandle *conn, ResponseCombiner *combiner)
 			case 'E':			/* ErrorResponse */
 				HandleError(combiner, msg, msg_len, conn);
 				add_error_message(conn, combiner->errorMessage);
+				/*
+				 * The error may be caused by the snapshot message, send
+				 * the full snapshot next time
+				 */
+				conn->last_xcnt = -1;
 				return RESPONSE_ERROR;
 			case 'A':			/* NotificationResponse */
 			case 'N':			/* NoticeResponse */
@@ -1719,6 +2013,18 @@ handle_response(PGXCNodeHandle *conn, ResponseCombiner *combiner)
 			case 'W':
 				HandleWaitXids(msg, msg_len);	
 				return RESPONSE_WAITXIDS;
+			case 'i':			/* Fragment instrumentation */
+				HandleRemoteInstrumentation(combiner, msg, msg_len,
+											conn->nodeoid);
+				break;
+			case 'L':			/* Standby lag */
+			{
+				uint32		n32;
+
+				memcpy(&n32, msg, sizeof(uint32));
+				PGXCNodeStandbyReport(conn->nodeoid, (int) ntohl(n32));
+				break;
+			}
 			default:
 				/* sync lost? */
 				elog(WARNING, "Received unsupported message type: %c", msg_type);
@@ -1781,6 +2087,19 @@ is_data_node_ready(PGXCNodeHandle * conn)
 }
 
 
+/*
+ * GXID of the transaction to send down to the remote nodes. A hot standby
+ * Coordinator can not assign transaction IDs, its read-only transactions use
+ * a GXID taken from GTM, see GetStandbyGlobalTransactionId.
+ */
+static GlobalTransactionId
+pgxc_get_remote_gxid(void)
+{
+	if (RecoveryInProgress())
+		return GetStandbyGlobalTransactionId();
+	return GetCurrentTransactionId();
+}
+
 /*
  * Send BEGIN command to the Datanodes or Coordinators and receive responses.
  * Also send the GXID for the transaction.
@@ -1796,7 +2115,12 @@ pgxc_node_begin(int conn_count, PGXCNodeHandle **connections,
 	TimestampTz timestamp = GetCurrentGTMStartTimestamp();
 	PGXCNodeHandle *new_connections[conn_count];
 	int new_count = 0;
-	char 		   *init_str;
+	char 		   *init_str = NULL;
+	char		   *begin_str = NULL;
+	StringInfoData	prefix;
+	bool			replicated_write = begin_replicated_write;
+
+	begin_replicated_write = false;
 
 	/*
 	 * If no remote connections, we don't have anything to do
@@ -1804,10 +2128,31 @@ pgxc_node_begin(int conn_count, PGXCNodeHandle **connections,
 	if (conn_count == 0)
 		return 0;
 
+	/*
+	 * When pipelining the transaction local parameters are set by the same
+	 * query that starts the transaction
+	 */
+	if (RemotePipelineBegin)
+	{
+		init_str = PGXCNodeGetTransactionParamStr();
+		begin_str = init_str ? psprintf("BEGIN;%s", init_str) : "BEGIN";
+	}
+
+	/* GXID and timestamp are the same for all the nodes, serialize them once */
+	initStringInfo(&prefix);
+	if (GlobalTransactionIdIsValid(gxid))
+		pgxc_node_prefix_gxid(&prefix, gxid);
+	if (GlobalTimestampIsValid(timestamp))
+		pgxc_node_prefix_timestamp(&prefix, timestamp);
+
 	for (i = 0; i < conn_count; i++)
 	{
 		if (!readOnly && !IsConnFromDatanode())
+		{
 			connections[i]->read_only = false;
+			if (!replicated_write)
+				xact_nonreplicated_write = true;
+		}
 		/*
 		 * PGXC TODO - A connection should not be in DN_CONNECTION_STATE_QUERY
 		 * state when we are about to send a BEGIN TRANSACTION command to the
@@ -1817,13 +2162,12 @@ pgxc_node_begin(int conn_count, PGXCNodeHandle **connections,
 		if (connections[i]->state == DN_CONNECTION_STATE_QUERY)
 			BufferConnection(connections[i]);
 
-		/* Send GXID and check for errors */
-		if (GlobalTransactionIdIsValid(gxid) && pgxc_node_send_gxid(connections[i], gxid))
-			return EOF;
-
-		/* Send timestamp and check for errors */
-		if (GlobalTimestampIsValid(timestamp) && pgxc_node_send_timestamp(connections[i], timestamp))
+		/* Send GXID and timestamp and check for errors */
+		if (pgxc_node_send_prefix(connections[i], &prefix))
+		{
+			pfree(prefix.data);
 			return EOF;
+		}
 
 		if (IS_PGXC_DATANODE && GlobalTransactionIdIsValid(gxid))
 			need_tran_block = true;
@@ -1832,13 +2176,33 @@ pgxc_node_begin(int conn_count, PGXCNodeHandle **connections,
 		/* Send BEGIN if not already in transaction */
 		if (need_tran_block && connections[i]->transaction_status == 'I')
 		{
+			/*
+			 * Queue up BEGIN and go on, it is sent along with the command
+			 * and its responses are skipped, see pgxc_node_send_begin()
+			 */
+			if (begin_str)
+			{
+				if (pgxc_node_send_begin(connections[i], begin_str))
+				{
+					pfree(prefix.data);
+					return EOF;
+				}
+				continue;
+			}
+
 			/* Send the BEGIN TRANSACTION command and check for errors */
 			if (pgxc_node_send_query(connections[i], "BEGIN"))
+			{
+				pfree(prefix.data);
 				return EOF;
+			}
 
 			new_connections[new_count++] = connections[i];
 		}
 	}
+	pfree(prefix.data);
+	if (begin_str && init_str)
+		pfree(begin_str);
 
 	/*
 	 * If we did not send a BEGIN command to any node, we are done. Otherwise,
@@ -1876,6 +2240,24 @@ pgxc_node_begin(int conn_count, PGXCNodeHandle **connections,
 }
 
 
+/*
+ * Should the node connections be released once the transaction is finished?
+ * Sessions having used temporary objects keep them. So do the Datanode
+ * sessions if keep_peer_connections is on: their connections go to the other
+ * Datanodes, and the next fragments of the same Coordinator session reuse
+ * them instead of getting them through the pooler. The connections are
+ * released when the Datanode session is assigned to another Coordinator
+ * session, or if the transaction is aborted.
+ */
+static bool
+release_connections_at_end(void)
+{
+	if (temp_object_included || PersistentConnections)
+		return false;
+	return !(IS_PGXC_DATANODE && KeepPeerConnections);
+}
+
+
 /*
  * Execute DISCARD ALL command on all allocated nodes to remove all session
  * specific stuff before releasing them to pool for reuse by other sessions.
@@ -1887,8 +2269,8 @@ pgxc_node_remote_cleanup_all(void)
 	PGXCNodeHandle *new_connections[handles->co_conn_count + handles->dn_conn_count];
 	int				new_conn_count = 0;
 	int				i;
-	char		   *resetcmd = "RESET ALL;RESET SESSION AUTHORIZATION;"
-							   "RESET transaction_isolation;";
+	char		   *resetcmd = PGXC_NODE_RESET_SESSION_CMD;
+	char		   *deallocatecmd = PGXC_NODE_RESET_SESSION_CMD "DEALLOCATE ALL;";
 
 	/*
 	 * We must handle reader and writer connections both since even a read-only
@@ -1897,6 +2279,22 @@ pgxc_node_remote_cleanup_all(void)
 	if (handles->co_conn_count + handles->dn_conn_count == 0)
 		return;
 
+	/*
+	 * Connections holding remote subplans are not released, so keep the
+	 * remote sessions intact. In the transaction pooling mode forget the
+	 * subplans instead, the nodes holding them are marked to deallocate them
+	 * below.
+	 */
+	if (HavePreparedSubplans())
+	{
+		if (!TransactionPooling)
+		{
+			pfree_pgxc_all_handles(handles);
+			return;
+		}
+		pgxc_node_forget_all_subplans();
+	}
+
 	/*
 	 * Send down snapshot followed by DISCARD ALL command.
 	 */
@@ -1911,6 +2309,13 @@ pgxc_node_remote_cleanup_all(void)
 			continue;
 		}
 
+		/*
+		 * Session with current parameters is kept set up, the pooler knows
+		 * the parameters and resets it if needed, see release_handles
+		 */
+		if (handle->param_hash != 0)
+			continue;
+
 		/*
 		 * We must go ahead and release connections anyway, so do not throw
 		 * an error if we have a problem here.
@@ -1936,11 +2341,20 @@ pgxc_node_remote_cleanup_all(void)
 			continue;
 		}
 
+		/*
+		 * Session with current parameters is kept set up, the pooler knows
+		 * the parameters and resets it if needed, see release_handles
+		 */
+		if (handle->param_hash != 0 && !handle->deallocate_subplans)
+			continue;
+
 		/*
 		 * We must go ahead and release connections anyway, so do not throw
 		 * an error if we have a problem here.
+		 * Drop persistent statements that might be left on the node.
 		 */
-		if (pgxc_node_send_query(handle, resetcmd))
+		if (pgxc_node_send_query(handle, handle->deallocate_subplans ?
+								 deallocatecmd : resetcmd))
 		{
 			ereport(WARNING,
 					(errcode(ERRCODE_INTERNAL_ERROR),
@@ -1948,6 +2362,8 @@ pgxc_node_remote_cleanup_all(void)
 			handle->state = DN_CONNECTION_STATE_ERROR_FATAL;
 			continue;
 		}
+		handle->deallocate_subplans = false;
+		handle->param_hash = 0;
 		new_connections[new_conn_count++] = handle;
 	}
 
@@ -1964,30 +2380,117 @@ pgxc_node_remote_cleanup_all(void)
 
 
 /*
- * Prepare nodes which ran write operations during the transaction.
- * Read only remote transactions are committed and connections are released
- * back to the pool.
- * Function returns the list of nodes where transaction is prepared, including
- * local node, if requested, in format expected by the GTM server.
- * If something went wrong the function tries to abort prepared transactions on
- * the nodes where it succeeded and throws error. A warning is emitted if abort
- * prepared fails.
- * After completion remote connection handles are released.
+ * Receive the results of the INSERTs and utility statements sent to the
+ * nodes without waiting, see ExecEndRemoteSubplan and ExecRemoteUtility, and
+ * report the first error of them. The transaction can not be committed
+ * before it is known they succeeded.
  */
-static char *
-pgxc_node_remote_prepare(char *prepareGID, bool localNode)
+static void
+pgxc_node_finish_deferred(int conn_count, PGXCNodeHandle **connections)
 {
-	bool 			isOK = true;
-	StringInfoData 	nodestr;
-	char			prepare_cmd[256];
-	char			abort_cmd[256];
-	GlobalTransactionId auxXid;
-	char		   *commit_cmd = "COMMIT TRANSACTION";
-	int				i;
+	PGXCNodeHandle *pending[MaxDataNodes + MaxCoords];
 	ResponseCombiner combiner;
-	PGXCNodeHandle *connections[MaxDataNodes + MaxCoords];
-	int				conn_count = 0;
-	PGXCNodeAllHandles *handles = get_current_handles();
+	int			count = 0;
+	bool		lost = false;
+	int			i;
+
+	for (i = 0; i < conn_count; i++)
+	{
+		PGXCNodeHandle *conn = connections[i];
+
+		if (conn->sock != NO_SOCKET &&
+				(conn->deferred_pending > 0 || conn->deferred_error))
+			pending[count++] = conn;
+	}
+	if (count == 0)
+		return;
+
+	if (pgxc_node_flush_all(count, pending))
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("Failed to send command to remote nodes")));
+
+	InitResponseCombiner(&combiner, count, COMBINE_TYPE_NONE);
+	for (;;)
+	{
+		/* The responses are consumed by get_message, just read them in */
+		i = 0;
+		while (i < count)
+		{
+			PGXCNodeHandle *conn = pending[i];
+
+			if (conn->deferred_pending > 0)
+				(void) handle_response(conn, &combiner);
+			if (conn->state == DN_CONNECTION_STATE_ERROR_FATAL)
+				lost = true;
+			else if (conn->deferred_pending > 0)
+			{
+				i++;
+				continue;
+			}
+			pending[i] = pending[--count];
+		}
+		if (count == 0)
+			break;
+		if (pgxc_node_receive(count, pending, NULL))
+			ereport(ERROR,
+					(errcode(ERRCODE_INTERNAL_ERROR),
+					 errmsg("Failed to receive results of deferred commands from remote nodes")));
+	}
+
+	for (i = 0; i < conn_count; i++)
+	{
+		PGXCNodeHandle *conn = connections[i];
+
+		if (conn->deferred_error)
+		{
+			HandleError(&combiner, conn->deferred_error, conn->deferred_error_len,
+						conn);
+			pfree(conn->deferred_error);
+			conn->deferred_error = NULL;
+		}
+	}
+	pgxc_node_report_error(&combiner);
+	CloseCombiner(&combiner);
+	if (lost)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("Failed to receive results of deferred commands from remote nodes")));
+}
+
+
+/*
+ * Prepare nodes which ran write operations during the transaction.
+ * Read only remote transactions are committed and connections are released
+ * back to the pool.
+ * Function returns the list of nodes where transaction is prepared, including
+ * local node, if requested, in format expected by the GTM server.
+ * If something went wrong the function tries to abort prepared transactions on
+ * the nodes where it succeeded and throws error. A warning is emitted if abort
+ * prepared fails.
+ * The GTM work needed to complete the transaction is done while the nodes
+ * are processing the PREPARE: for explicit PREPARE the GID and the node list
+ * are saved on GTM, for implicit one the GXID for COMMIT PREPARED is obtained.
+ * After completion remote connection handles are released.
+ */
+static char *
+pgxc_node_remote_prepare(char *prepareGID, bool localNode, bool implicit)
+{
+	bool 			isOK = true;
+	bool			prepared = false;
+	StringInfoData 	nodestr;
+	char			prepare_cmd[256];
+	char			abort_cmd[256];
+	GlobalTransactionId auxXid;
+	char		   *commit_cmd = "COMMIT TRANSACTION";
+	int				i;
+	ResponseCombiner combiner;
+	PGXCNodeHandle *connections[MaxDataNodes + MaxCoords];
+	int				conn_count = 0;
+	PGXCNodeAllHandles *handles = get_current_handles();
+
+	pgxc_node_finish_deferred(handles->dn_conn_count, handles->datanode_handles);
+	pgxc_node_finish_deferred(handles->co_conn_count, handles->coord_handles);
 
 	initStringInfo(&nodestr);
 	if (localNode)
@@ -2063,6 +2566,7 @@ pgxc_node_remote_prepare(char *prepareGID, bool localNode)
 					appendStringInfoString(&nodestr, nodename);
 					/* Read responses from these */
 					connections[conn_count++] = conn;
+					prepared = true;
 					/*
 					 * If it fails on remote node it would just return ROLLBACK.
 					 * Set the flag for the message handler so the response is
@@ -2150,6 +2654,7 @@ pgxc_node_remote_prepare(char *prepareGID, bool localNode)
 					appendStringInfoString(&nodestr, nodename);
 					/* Read responses from these */
 					connections[conn_count++] = conn;
+					prepared = true;
 					/*
 					 * If it fails on remote node it would just return ROLLBACK.
 					 * Set the flag for the message handler so the response is
@@ -2178,6 +2683,23 @@ pgxc_node_remote_prepare(char *prepareGID, bool localNode)
 	if (!isOK)
 		goto prepare_err;
 
+	/*
+	 * The commands are on their way, talk to GTM while the remote nodes are
+	 * preparing instead of adding another round trip after they respond.
+	 * If the remote PREPARE fails the transaction is aborted, and GTM forgets
+	 * about both the GID and the auxilliary GXID along with it.
+	 */
+	if (!implicit)
+	{
+		if (IS_PGXC_LOCAL_COORDINATOR)
+			/* Save the node list and gid on GTM. */
+			StartPreparedTranGTM(GetTopGlobalTransactionId(), prepareGID,
+								 nodestr.data);
+	}
+	else if (prepared)
+		/* Will be needed to run COMMIT PREPARED on the remote nodes */
+		(void) GetAuxilliaryTransactionId();
+
 	/* exit if nothing has been prepared */
 	if (conn_count > 0)
 	{
@@ -2208,7 +2730,7 @@ pgxc_node_remote_prepare(char *prepareGID, bool localNode)
 			connections[i]->ck_resp_rollback = false;
 
 		pfree_pgxc_all_handles(handles);
-		if (!temp_object_included && !PersistentConnections)
+		if (release_connections_at_end())
 		{
 			/* Clean up remote sessions */
 			pgxc_node_remote_cleanup_all();
@@ -2335,6 +2857,19 @@ prepare_err:
 }
 
 
+/*
+ * Add the node of the connection to the comma separated list of the nodes
+ * which failed to commit a transaction already committed on the primary
+ * node, see ReplicatedOnePhaseCommit.
+ */
+static void
+pgxc_node_add_diverged(StringInfo diverged, PGXCNodeHandle *conn)
+{
+	if (diverged->len > 0)
+		appendStringInfoString(diverged, ", ");
+	appendStringInfoString(diverged, get_pgxc_nodename(conn->nodeoid));
+}
+
 /*
  * Commit transactions on remote nodes.
  * If barrier lock is set wait while it is released.
@@ -2350,9 +2885,14 @@ pgxc_node_remote_commit(void)
 	PGXCNodeHandle *connections[MaxDataNodes + MaxCoords];
 	int				conn_count = 0;
 	PGXCNodeAllHandles *handles = get_current_handles();
+	bool			primary_committed = false;
+	StringInfoData	diverged;
 
 	SetSendCommandId(false);
 
+	pgxc_node_finish_deferred(handles->dn_conn_count, handles->datanode_handles);
+	pgxc_node_finish_deferred(handles->co_conn_count, handles->coord_handles);
+
 	/*
 	 * Barrier:
 	 *
@@ -2363,6 +2903,56 @@ pgxc_node_remote_commit(void)
 	 */
 	LWLockAcquire(BarrierLock, LW_SHARED);
 
+	initStringInfo(&diverged);
+
+	/*
+	 * A transaction which has written to replicated tables only commits on
+	 * the primary node first, like its statements have run there first. If
+	 * the commit fails there, because of a deferred constraint for example,
+	 * the other nodes are rolled back and the copies of the tables stay the
+	 * same. The readers do not see the transaction committed on some nodes
+	 * only, it is running for their snapshots until GTM knows it committed.
+	 * Once committed on the primary node the transaction is committed, a
+	 * node failing to commit afterwards is only reported, see
+	 * pgxc_node_add_diverged.
+	 */
+	if (ReplicatedOnePhaseCommit && !xact_nonreplicated_write &&
+			OidIsValid(primary_data_node))
+	{
+		for (i = 0; i < handles->dn_conn_count; i++)
+		{
+			PGXCNodeHandle *conn = handles->datanode_handles[i];
+
+			if (conn->sock == NO_SOCKET || conn->nodeoid != primary_data_node ||
+					conn->transaction_status == 'I' || conn->read_only)
+				continue;
+
+			if (conn->state != DN_CONNECTION_STATE_IDLE)
+				BufferConnection(conn);
+
+			if (pgxc_node_send_query(conn, commitCmd))
+				ereport(ERROR,
+						(errcode(ERRCODE_INTERNAL_ERROR),
+						 errmsg("failed to send COMMIT command to the node %u",
+								conn->nodeoid)));
+
+			InitResponseCombiner(&combiner, 1, COMBINE_TYPE_NONE);
+			if (pgxc_node_receive_responses(1, &conn, NULL, &combiner) ||
+					!validate_combiner(&combiner))
+			{
+				if (combiner.errorMessage)
+					pgxc_node_report_error(&combiner);
+				else
+					ereport(ERROR,
+							(errcode(ERRCODE_INTERNAL_ERROR),
+							 errmsg("Failed to COMMIT the transaction on the primary node")));
+			}
+			CloseCombiner(&combiner);
+			primary_committed = true;
+			break;
+		}
+	}
+
 	for (i = 0; i < handles->dn_conn_count; i++)
 	{
 		PGXCNodeHandle *conn = handles->datanode_handles[i];
@@ -2384,6 +2974,11 @@ pgxc_node_remote_commit(void)
 
 			if (pgxc_node_send_query(conn, commitCmd))
 			{
+				if (primary_committed)
+				{
+					pgxc_node_add_diverged(&diverged, conn);
+					continue;
+				}
 				/*
 				 * Do not bother with clean up, just bomb out. The error handler
 				 * will invoke RollbackTransaction which will do the work.
@@ -2418,6 +3013,11 @@ pgxc_node_remote_commit(void)
 		{
 			if (pgxc_node_send_query(conn, commitCmd))
 			{
+				if (primary_committed)
+				{
+					pgxc_node_add_diverged(&diverged, conn);
+					continue;
+				}
 				/*
 				 * Do not bother with clean up, just bomb out. The error handler
 				 * will invoke RollbackTransaction which will do the work.
@@ -2440,7 +3040,23 @@ pgxc_node_remote_commit(void)
 	 */
 	LWLockRelease(BarrierLock);
 
-	if (conn_count)
+	if (conn_count && primary_committed)
+	{
+		/*
+		 * The commands run concurrently, the responses are read one node at
+		 * a time to know which nodes failed.
+		 */
+		for (i = 0; i < conn_count; i++)
+		{
+			InitResponseCombiner(&combiner, 1, COMBINE_TYPE_NONE);
+			if (pgxc_node_receive_responses(1, &connections[i], NULL,
+											&combiner) ||
+				!validate_combiner(&combiner))
+				pgxc_node_add_diverged(&diverged, connections[i]);
+			CloseCombiner(&combiner);
+		}
+	}
+	else if (conn_count)
 	{
 		InitResponseCombiner(&combiner, conn_count, COMBINE_TYPE_NONE);
 		/* Receive responses */
@@ -2453,6 +3069,15 @@ pgxc_node_remote_commit(void)
 
 	stat_transaction(conn_count);
 
+	if (diverged.len > 0)
+		ereport(WARNING,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("could not commit the transaction on nodes %s after committing it on the primary node",
+						diverged.data),
+				 errdetail("The replicated tables written by the transaction differ on these nodes from the primary node."),
+				 errhint("Copy the tables from the primary node to repair them.")));
+	pfree(diverged.data);
+
 	if (result)
 	{
 		if (combiner.errorMessage)
@@ -2463,7 +3088,7 @@ pgxc_node_remote_commit(void)
 					 errmsg("Failed to COMMIT the transaction on one or more nodes")));
 	}
 
-	if (!temp_object_included && !PersistentConnections)
+	if (release_connections_at_end())
 	{
 		/* Clean up remote sessions */
 		pgxc_node_remote_cleanup_all();
@@ -2499,6 +3124,13 @@ pgxc_node_remote_abort(void)
 		if (conn->sock == NO_SOCKET)
 			continue;
 
+		/* Failure of the commands not waited for does not matter any more */
+		if (conn->deferred_error)
+		{
+			pfree(conn->deferred_error);
+			conn->deferred_error = NULL;
+		}
+
 		if (conn->transaction_status != 'I')
 		{
 			/* Read in any pending input */
@@ -2530,8 +3162,19 @@ pgxc_node_remote_abort(void)
 		if (conn->sock == NO_SOCKET)
 			continue;
 
+		/* Failure of the commands not waited for does not matter any more */
+		if (conn->deferred_error)
+		{
+			pfree(conn->deferred_error);
+			conn->deferred_error = NULL;
+		}
+
 		if (conn->transaction_status != 'I')
 		{
+			/* Read in any pending input */
+			if (conn->state != DN_CONNECTION_STATE_IDLE)
+				BufferConnection(conn);
+
 			/*
 			 * Do not matter, is there committed or failed transaction,
 			 * just send down rollback to finish it.
@@ -2621,7 +3264,7 @@ DataNodeCopyBegin(RemoteCopyData *rcstate)
 	stat_statement();
 	stat_transaction(conn_count);
 
-	gxid = GetCurrentTransactionId();
+	gxid = pgxc_get_remote_gxid();
 
 	/* Start transaction on connections where it is not started */
 	if (pgxc_node_begin(conn_count, connections, gxid, need_tran_block, false, PGXC_NODE_DATANODE))
@@ -2651,6 +3294,12 @@ DataNodeCopyBegin(RemoteCopyData *rcstate)
 			(void *) connections,
 			NULL,
 			false);
+	if (rcstate->is_from)
+	{
+		setLocatorBuckets(rcstate->locator, rcstate->rel_loc->buckets,
+						  nodelist);
+		setLocatorRanges(rcstate->locator, rcstate->rel_loc->ranges);
+	}
 
 	/* Send query to nodes */
 	for (i = 0; i < conn_count; i++)
@@ -2699,6 +3348,111 @@ DataNodeCopyBegin(RemoteCopyData *rcstate)
 }
 
 
+/*
+ * Run COPY TO on the Datanodes, each of them writing its part of the table to
+ * a file of its own, named after the specified file name followed by a dot
+ * and the node name. Nothing is sent through the Coordinator, so the nodes
+ * export their data in parallel. Returns total number of rows copied.
+ */
+uint64
+DataNodeCopyToFiles(RemoteCopyData *rcstate, const char *filename, bool header)
+{
+	int			i;
+	List	   *nodelist = rcstate->rel_loc->nodeList;
+	PGXCNodeHandle **connections;
+	bool		need_tran_block;
+	GlobalTransactionId gxid;
+	ResponseCombiner combiner;
+	EState	   *estate;
+	Snapshot	snapshot = GetActiveSnapshot();
+	int			conn_count = list_length(nodelist);
+	uint64		processed;
+	bool		error = false;
+
+	Assert(!rcstate->is_from);
+
+	/* Any node has all the rows of a replicated table */
+	if (IsLocatorReplicated(rcstate->rel_loc->locatorType))
+	{
+		connections = (PGXCNodeHandle **) palloc(sizeof(PGXCNodeHandle *));
+		connections[0] = get_any_handle(nodelist);
+		conn_count = 1;
+	}
+	else
+	{
+		PGXCNodeAllHandles *pgxc_handles;
+		pgxc_handles = get_handles(nodelist, NULL, false, true);
+		connections = pgxc_handles->datanode_handles;
+		Assert(pgxc_handles->dn_conn_count == conn_count);
+		pfree(pgxc_handles);
+	}
+
+	need_tran_block = (conn_count > 1) || (TransactionBlockStatusCode() == 'T');
+
+	/* Gather statistics */
+	stat_statement();
+	stat_transaction(conn_count);
+
+	gxid = pgxc_get_remote_gxid();
+
+	if (pgxc_node_begin(conn_count, connections, gxid, need_tran_block, false, PGXC_NODE_DATANODE))
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("Could not begin transaction on data nodes.")));
+
+	for (i = 0; i < conn_count; i++)
+	{
+		char	   *nodefile;
+		char	   *query;
+
+		CHECK_OWNERSHIP(connections[i], NULL);
+
+		nodefile = psprintf("%s.%s", filename,
+							get_pgxc_nodename(connections[i]->nodeoid));
+		query = RemoteCopy_FileStatement(rcstate, nodefile, header);
+
+		if ((snapshot && pgxc_node_send_snapshot(connections[i], snapshot)) ||
+			pgxc_node_send_query(connections[i], query) != 0)
+		{
+			add_error_message(connections[i], "Can not send request");
+			error = true;
+			conn_count = i;
+			break;
+		}
+		pfree(query);
+		pfree(nodefile);
+	}
+
+	/* The row counts of the command tags are summed up in the executor state */
+	estate = CreateExecutorState();
+	InitResponseCombiner(&combiner, conn_count, COMBINE_TYPE_SUM);
+	/*
+	 * Make sure there are zeroes in unused fields
+	 */
+	memset(&combiner, 0, sizeof(ScanState));
+	combiner.ss.ps.state = estate;
+
+	error = (pgxc_node_receive_responses(conn_count, connections, NULL, &combiner) != 0) || error;
+	processed = estate->es_processed;
+	FreeExecutorState(estate);
+
+	if (!validate_combiner(&combiner) || error)
+	{
+		if (combiner.errorMessage)
+			pgxc_node_report_error(&combiner);
+		else
+			ereport(ERROR,
+					(errcode(ERRCODE_INTERNAL_ERROR),
+					 errmsg("Error while running COPY")));
+	}
+	else
+		CloseCombiner(&combiner);
+
+	pfree(connections);
+	return processed;
+}
+
+
 /*
  * Send a data row to the specified nodes
  */
@@ -2718,11 +3472,9 @@ DataNodeCopyIn(char *data_row, int len, int conn_count, PGXCNodeHandle** copy_co
 			/* precalculate to speed up access */
 			int bytes_needed = handle->outEnd + 1 + msgLen;
 
-			/* flush buffer if it is almost full */
-			if (bytes_needed > COPY_BUFFER_SIZE)
+			/* try to send out the buffer each time it grows by a chunk */
+			if (bytes_needed / COPY_BUFFER_SIZE != handle->outEnd / COPY_BUFFER_SIZE)
 			{
-				int to_send = handle->outEnd;
-
 				/* First look if data node has sent a error message */
 				int read_status = pgxc_node_read_data(handle, true);
 				if (read_status == EOF || read_status < 0)
@@ -2747,14 +3499,25 @@ DataNodeCopyIn(char *data_row, int len, int conn_count, PGXCNodeHandle** copy_co
 				if (DN_CONNECTION_STATE_ERROR(handle))
 					return EOF;
 
+				if (pgxc_node_flush_nowait(handle) < 0)
+				{
+					add_error_message(handle, "failed to send data to data node");
+					return EOF;
+				}
+
 				/*
-				 * Try to send down buffered data if we have
+				 * The node does not keep up, wait until enough of its backlog
+				 * is sent to make room for the row.
 				 */
-				if (to_send && send_some(handle, to_send) < 0)
+				bytes_needed = handle->outEnd + 1 + msgLen;
+				if (bytes_needed > COPY_BACKLOG_SIZE &&
+					send_some(handle, Min(bytes_needed - COPY_BACKLOG_SIZE,
+										  handle->outEnd)) < 0)
 				{
 					add_error_message(handle, "failed to send data to data node");
 					return EOF;
 				}
+				bytes_needed = handle->outEnd + 1 + msgLen;
 			}
 
 			if (ensure_out_buffer_capacity(bytes_needed, handle) != 0)
@@ -2861,6 +3624,13 @@ DataNodeCopyFinish(int conn_count, PGXCNodeHandle** connections)
 	int		i;
 	ResponseCombiner combiner;
 	bool 		error = false;
+
+	/*
+	 * Send out the backlogs of all the nodes at once, failures show up when
+	 * the copy is ended below.
+	 */
+	(void) pgxc_node_flush_all(conn_count, connections);
+
 	for (i = 0; i < conn_count; i++)
 	{
 		PGXCNodeHandle *handle = connections[i];
@@ -3031,39 +3801,263 @@ get_exec_connections(RemoteQueryState *planstate,
 }
 
 
-static bool
-pgxc_start_command_on_connection(PGXCNodeHandle *connection,
-									RemoteQueryState *remotestate,
-									Snapshot snapshot)
+/*
+ * Ask a standby for its lag, with an empty query. The lag is recorded when
+ * the response is handled. A standby that can not be reached is recorded as
+ * not knowing its lag, so it is not tried again for a while.
+ */
+static void
+probe_standby(int node)
 {
-	CommandId	cid;
-	ResponseCombiner *combiner = (ResponseCombiner *) remotestate;
-	RemoteQuery	*step = (RemoteQuery *) combiner->ss.ps.plan;
-	CHECK_OWNERSHIP(connection, combiner);
-
-	/*
-	 * Scan descriptor would be valid and would contain a valid snapshot
-	 * in cases when we need to send out of order command id to data node
-	 * e.g. in case of a fetch
-	 */
-	cid = GetCurrentCommandId(false);
+	PGXCNodeHandle *handle = get_standby_handle(node);
+	ResponseCombiner combiner;
 
-	if (pgxc_node_send_cmd_id(connection, cid) < 0 )
-		return false;
+	if (handle == NULL ||
+		handle->state != DN_CONNECTION_STATE_IDLE ||
+		pgxc_node_send_snapshot(handle, NULL) ||
+		pgxc_node_send_query(handle, ""))
+	{
+		PGXCNodeStandbyReport(PGXCNodeGetNodeOid(node, PGXC_NODE_DATANODE), -1);
+		return;
+	}
 
-	if (snapshot && pgxc_node_send_snapshot(connection, snapshot))
-		return false;
-	if (step->statement || step->cursor || step->remote_param_types)
+	InitResponseCombiner(&combiner, 1, COMBINE_TYPE_NONE);
+	memset(&combiner, 0, sizeof(ScanState));
+	for (;;)
 	{
-		/* need to use Extended Query Protocol */
-		int	fetch = 0;
-		bool	prepared = false;
+		int			res;
 
-		/*
-		 * execute and fetch rows only if they will be consumed
-		 * immediately by the sorter
-		 */
-		if (step->cursor)
+		if (pgxc_node_receive(1, &handle, NULL))
+			break;
+		res = handle_response(handle, &combiner);
+		if (res == RESPONSE_READY)
+			break;
+		if (res != RESPONSE_EOF && res != RESPONSE_COMPLETE &&
+			res != RESPONSE_ERROR)
+			break;
+	}
+	CloseCombiner(&combiner);
+}
+
+/*
+ * Choose the standby of the Datanode to run a statement on: of those lagging
+ * at most max_lag milliseconds, the one with the shortest round trip.
+ * Returns -1 if there is none.
+ */
+static int
+choose_standby(int datanode, int max_lag)
+{
+	int			best = -1;
+	int64		best_latency = 0;
+	int			node;
+
+	for (node = NumDataNodes; node < NumDataNodes + NumStandbyNodes; node++)
+	{
+		int			lag;
+		int64		latency;
+
+		if (PGXCNodeStandbyOf(node) != datanode)
+			continue;
+
+		if (!PGXCNodeGetStandbyLag(node, &lag))
+		{
+			probe_standby(node);
+			if (!PGXCNodeGetStandbyLag(node, &lag))
+				continue;
+		}
+		if (lag < 0 || lag > max_lag)
+			continue;
+
+		/* unknown round trip is assumed fast, so the standby gets measured */
+		latency = Max(PGXCNodeGetLatency(node), 0);
+		if (best < 0 || latency < best_latency)
+		{
+			best = node;
+			best_latency = latency;
+		}
+	}
+
+	return best;
+}
+
+/*
+ * Standbys to run a read-only statement on instead of the given Datanodes,
+ * NIL if it runs on the Datanodes. Statements in transaction blocks or of
+ * transactions which have written something have to see their own changes,
+ * so they stay on the Datanodes. If any is true, one of the Datanodes is
+ * enough, otherwise either all of them are replaced or none.
+ */
+static List *
+get_standby_nodes(List *datanodes, bool any)
+{
+	List	   *standbys = NIL;
+	ListCell   *lc;
+
+	if (StandbyReadMaxLag < 0 || NumStandbyNodes == 0 ||
+		IsTransactionBlock() || TransactionIdIsValid(GetTopTransactionIdIfAny()))
+		return NIL;
+
+	foreach(lc, datanodes)
+	{
+		int			node = choose_standby(lfirst_int(lc), StandbyReadMaxLag);
+
+		if (node >= 0 && any)
+			return list_make1_int(node);
+		if (node < 0 && !any)
+		{
+			list_free(standbys);
+			return NIL;
+		}
+		if (node >= 0)
+			standbys = lappend_int(standbys, node);
+	}
+
+	return standbys;
+}
+
+/*
+ * Nodes to run the remote query on if it can run on standbys, NULL if it
+ * runs on the Datanodes. EXECUTE DIRECT names the node it runs on.
+ */
+static ExecNodes *
+get_standby_exec_nodes(RemoteQuery *step, ExecNodes *exec_nodes)
+{
+	ExecNodes  *result;
+	List	   *datanodes = NIL;
+	List	   *standbys;
+
+	if (step->exec_type != EXEC_ON_DATANODES ||
+		step->exec_direct_type != EXEC_DIRECT_NONE ||
+		!step->read_only || step->has_row_marks || step->cursor)
+		return NULL;
+
+	if (exec_nodes && exec_nodes->primarynodelist)
+		return NULL;
+
+	if (exec_nodes && exec_nodes->nodeList)
+		datanodes = exec_nodes->nodeList;
+	else
+	{
+		int			i;
+
+		for (i = 0; i < NumDataNodes; i++)
+			datanodes = lappend_int(datanodes, i);
+	}
+
+	standbys = get_standby_nodes(datanodes, false);
+	if (standbys == NIL)
+		return NULL;
+
+	result = makeNode(ExecNodes);
+	if (exec_nodes)
+		memcpy(result, exec_nodes, sizeof(ExecNodes));
+	result->nodeList = standbys;
+	return result;
+}
+
+/*
+ * Nodes to run the remote subplan on if it can run on standbys, NIL if it
+ * runs on the Datanodes. Only the subplans of the Coordinator reading rows
+ * qualify, if they do not contain remote subplans themselves.
+ */
+static List *
+get_standby_subplan_nodes(RemoteSubplanState *node)
+{
+	RemoteSubplan *plan = (RemoteSubplan *) node->combiner.ss.ps.plan;
+	PlannedStmt *stmt = node->combiner.ss.ps.state->es_plannedstmt;
+
+	if (!IS_PGXC_LOCAL_COORDINATOR || stmt == NULL ||
+		stmt->commandType != CMD_SELECT || stmt->hasModifyingCTE ||
+		stmt->rowMarks != NIL || IsA(outerPlan(plan), ModifyTable) ||
+		plan_has_remote_nodes(outerPlan(plan)))
+		return NIL;
+
+	return get_standby_nodes(node->execNodes, !node->execOnAll);
+}
+
+/*
+ * plan_has_remote_nodes
+ *
+ * Whether a plan tree contains remote subplans or queries. Running on a
+ * Datanode, those would send the snapshot of that Datanode to the others,
+ * and their producers exchange rows with the other Datanodes through shared
+ * queues.
+ */
+bool
+plan_has_remote_nodes(Plan *plan)
+{
+	List	   *children = NIL;
+	ListCell   *lc;
+
+	if (plan == NULL)
+		return false;
+
+	switch (nodeTag(plan))
+	{
+		case T_RemoteSubplan:
+		case T_RemoteQuery:
+			return true;
+		case T_Append:
+			children = ((Append *) plan)->appendplans;
+			break;
+		case T_MergeAppend:
+			children = ((MergeAppend *) plan)->mergeplans;
+			break;
+		case T_BitmapAnd:
+			children = ((BitmapAnd *) plan)->bitmapplans;
+			break;
+		case T_BitmapOr:
+			children = ((BitmapOr *) plan)->bitmapplans;
+			break;
+		case T_SubqueryScan:
+			children = list_make1(((SubqueryScan *) plan)->subplan);
+			break;
+		default:
+			break;
+	}
+
+	foreach(lc, children)
+	{
+		if (plan_has_remote_nodes((Plan *) lfirst(lc)))
+			return true;
+	}
+	return plan_has_remote_nodes(plan->lefttree) ||
+		plan_has_remote_nodes(plan->righttree);
+}
+
+static bool
+pgxc_start_command_on_connection(PGXCNodeHandle *connection,
+									RemoteQueryState *remotestate,
+									Snapshot snapshot)
+{
+	CommandId	cid;
+	ResponseCombiner *combiner = (ResponseCombiner *) remotestate;
+	RemoteQuery	*step = (RemoteQuery *) combiner->ss.ps.plan;
+	CHECK_OWNERSHIP(connection, combiner);
+
+	/*
+	 * Scan descriptor would be valid and would contain a valid snapshot
+	 * in cases when we need to send out of order command id to data node
+	 * e.g. in case of a fetch
+	 */
+	cid = GetCurrentCommandId(false);
+
+	if (pgxc_node_send_cmd_id(connection, cid) < 0 )
+		return false;
+
+	if (snapshot && pgxc_node_send_snapshot(connection, snapshot))
+		return false;
+	if (step->statement || step->cursor || step->remote_param_types)
+	{
+		/* need to use Extended Query Protocol */
+		int	fetch = 0;
+		bool	prepared = false;
+
+		/*
+		 * execute and fetch rows only if they will be consumed
+		 * immediately by the sorter
+		 */
+		if (step->cursor)
 			fetch = 1;
 
 		combiner->extended_query = true;
@@ -3089,8 +4083,9 @@ pgxc_start_command_on_connection(PGXCNodeHandle *connection,
 }
 
 /*
- * Encode parameter values to format of DataRow message (the same format is
- * used in Bind) to prepare for sending down to Datanodes.
+ * Encode parameter values to format of the Bind message to prepare for
+ * sending down to Datanodes: array of parameter format codes followed by
+ * array of parameter values. See append_param_data for the format codes.
  * The buffer to store encoded value is palloc'ed and returned as the result
  * parameter. Function returns size of the result
  */
@@ -3098,8 +4093,10 @@ int
 ParamListToDataRow(ParamListInfo params, char** result)
 {
 	StringInfoData buf;
+	int16	   *formats;
 	uint16 n16;
 	int i;
+	int len;
 	int real_num_params = 0;
 
 	/*
@@ -3137,6 +4134,7 @@ ParamListToDataRow(ParamListInfo params, char** result)
 	}
 
 	initStringInfo(&buf);
+	formats = (int16 *) palloc(real_num_params * sizeof(int16));
 
 	/* Number of parameter values */
 	n16 = htons(real_num_params);
@@ -3146,53 +4144,20 @@ ParamListToDataRow(ParamListInfo params, char** result)
 	for (i = 0; i < real_num_params; i++)
 	{
 		ParamExternData *param = &params->params[i];
-		uint32 n32;
 
 		/*
 		 * Parameters with no types are considered as NULL and treated as integer
 		 * The same trick is used for dropped columns for remote DML generation.
 		 */
-		if (param->isnull || !OidIsValid(param->ptype))
-		{
-			n32 = htonl(-1);
-			appendBinaryStringInfo(&buf, (char *) &n32, 4);
-		}
-		else
-		{
-			Oid		typOutput;
-			bool	typIsVarlena;
-			Datum	pval;
-			char   *pstring;
-			int		len;
-
-			/* Get info needed to output the value */
-			getTypeOutputInfo(param->ptype, &typOutput, &typIsVarlena);
-
-			/*
-			 * If we have a toasted datum, forcibly detoast it here to avoid
-			 * memory leakage inside the type's output routine.
-			 */
-			if (typIsVarlena)
-				pval = PointerGetDatum(PG_DETOAST_DATUM(param->value));
-			else
-				pval = param->value;
-
-			/* Convert Datum to string */
-			pstring = OidOutputFunctionCall(typOutput, pval);
-
-			/* copy data to the buffer */
-			len = strlen(pstring);
-			n32 = htonl(len);
-			appendBinaryStringInfo(&buf, (char *) &n32, 4);
-			appendBinaryStringInfo(&buf, pstring, len);
-		}
+		formats[i] = append_param_data(&buf, param->ptype, param->value,
+									   param->isnull ||
+									   !OidIsValid(param->ptype));
 	}
 
-	/* Take data from the buffer */
-	*result = palloc(buf.len);
-	memcpy(*result, buf.data, buf.len);
+	len = finish_param_data(&buf, real_num_params, formats, result);
+	pfree(formats);
 	pfree(buf.data);
-	return buf.len;
+	return len;
 }
 
 /*
@@ -3222,6 +4187,9 @@ ExecRemoteUtility(RemoteQuery *node)
 	ExecDirectType		exec_direct_type = node->exec_direct_type;
 	int			i;
 	CommandId	cid = GetCurrentCommandId(true);	
+	StringInfoData prefix;
+	PGXCNodeHandle **connections;
+	int			conn_count;
 
 	if (!force_autocommit)
 		RegisterTransactionLocalNode(true);
@@ -3271,172 +4239,126 @@ ExecRemoteUtility(RemoteQuery *node)
 				(errcode(ERRCODE_INTERNAL_ERROR),
 				 errmsg("Failed to get next transaction ID")));
 
-	{
-		if (pgxc_node_begin(dn_conn_count, pgxc_connections->datanode_handles,
-					gxid, need_tran_block, false, PGXC_NODE_DATANODE))
-			ereport(ERROR,
-					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("Could not begin transaction on Datanodes")));
-		for (i = 0; i < dn_conn_count; i++)
-		{
-			PGXCNodeHandle *conn = pgxc_connections->datanode_handles[i];
+	/*
+	 * Start the transaction on all the nodes before sending the command to
+	 * any of them, so that it runs on all of them at once.
+	 */
+	if (pgxc_node_begin(dn_conn_count, pgxc_connections->datanode_handles,
+				gxid, need_tran_block, false, PGXC_NODE_DATANODE))
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("Could not begin transaction on Datanodes")));
+	if (pgxc_node_begin(co_conn_count, pgxc_connections->coord_handles,
+				gxid, need_tran_block, false, PGXC_NODE_COORDINATOR))
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("Could not begin transaction on coordinators")));
 
-			if (conn->state == DN_CONNECTION_STATE_QUERY)
-				BufferConnection(conn);
-			if (snapshot && pgxc_node_send_snapshot(conn, snapshot))
-			{
-				ereport(ERROR,
-						(errcode(ERRCODE_INTERNAL_ERROR),
-						 errmsg("Failed to send snapshot to Datanodes")));
-			}
-			if (pgxc_node_send_cmd_id(conn, cid) < 0)
-			{
-				ereport(ERROR,
-						(errcode(ERRCODE_INTERNAL_ERROR),
-						 errmsg("Failed to send command ID to Datanodes")));
-			}
+	conn_count = dn_conn_count + co_conn_count;
+	connections = (PGXCNodeHandle **) palloc(conn_count * sizeof(PGXCNodeHandle *));
+	memcpy(connections, pgxc_connections->datanode_handles,
+		   dn_conn_count * sizeof(PGXCNodeHandle *));
+	memcpy(connections + dn_conn_count, pgxc_connections->coord_handles,
+		   co_conn_count * sizeof(PGXCNodeHandle *));
 
-			if (pgxc_node_send_query(conn, node->sql_statement) != 0)
-			{
-				ereport(ERROR,
-						(errcode(ERRCODE_INTERNAL_ERROR),
-						 errmsg("Failed to send command to Datanodes")));
-			}
-		}
-	}
+	/* Command ID is the same for all the nodes */
+	initStringInfo(&prefix);
+	pgxc_node_prefix_cmd_id(&prefix, cid);
 
+	for (i = 0; i < conn_count; i++)
 	{
-		if (pgxc_node_begin(co_conn_count, pgxc_connections->coord_handles,
-					gxid, need_tran_block, false, PGXC_NODE_COORDINATOR))
+		PGXCNodeHandle *conn = connections[i];
+
+		if (conn->state == DN_CONNECTION_STATE_QUERY)
+			BufferConnection(conn);
+		if (snapshot && pgxc_node_send_snapshot(conn, snapshot))
 			ereport(ERROR,
 					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("Could not begin transaction on coordinators")));
-		/* Now send it to Coordinators if necessary */
-		for (i = 0; i < co_conn_count; i++)
-		{
-			if (snapshot && pgxc_node_send_snapshot(pgxc_connections->coord_handles[i], snapshot))
-			{
-				ereport(ERROR,
-						(errcode(ERRCODE_INTERNAL_ERROR),
-						 errmsg("Failed to send command to coordinators")));
-			}
-			if (pgxc_node_send_cmd_id(pgxc_connections->coord_handles[i], cid) < 0)
-			{
-				ereport(ERROR,
-						(errcode(ERRCODE_INTERNAL_ERROR),
-						 errmsg("Failed to send command ID to Datanodes")));
-			}
-
-			if (pgxc_node_send_query(pgxc_connections->coord_handles[i], node->sql_statement) != 0)
-			{
-				ereport(ERROR,
-						(errcode(ERRCODE_INTERNAL_ERROR),
-						 errmsg("Failed to send command to coordinators")));
-			}
-		}
+					 errmsg("Failed to send snapshot to remote nodes")));
+		if (pgxc_node_send_prefix(conn, &prefix))
+			ereport(ERROR,
+					(errcode(ERRCODE_INTERNAL_ERROR),
+					 errmsg("Failed to send command ID to remote nodes")));
+		if (pgxc_node_send_query(conn, node->sql_statement) != 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INTERNAL_ERROR),
+					 errmsg("Failed to send command to remote nodes")));
 	}
+	pfree(prefix.data);
 
 	/*
-	 * Stop if all commands are completed or we got a data row and
-	 * initialized state node for subsequent invocations
+	 * Inside a transaction block the results of the statement are received
+	 * later, along with those of the following ones, see
+	 * pgxc_node_finish_deferred. A failure is reported then, or at commit at
+	 * the latest, that aborts the transaction anyway.
 	 */
+	if (DDLBatchSize > 0 && need_tran_block &&
+			exec_direct_type == EXEC_DIRECT_NONE &&
+			IsTransactionBlock() && !IsSubTransaction())
 	{
-		while (dn_conn_count > 0)
+		bool		finish = false;
+
+		for (i = 0; i < conn_count; i++)
 		{
-			int i = 0;
+			PGXCNodeHandle *conn = connections[i];
 
-			if (pgxc_node_receive(dn_conn_count, pgxc_connections->datanode_handles, NULL))
-				break;
-			/*
-			 * Handle input from the Datanodes.
-			 * We do not expect Datanodes returning tuples when running utility
-			 * command.
-			 * If we got EOF, move to the next connection, will receive more
-			 * data on the next iteration.
-			 */
-			while (i < dn_conn_count)
-			{
-				PGXCNodeHandle *conn = pgxc_connections->datanode_handles[i];
-				int res = handle_response(conn, combiner);
-				if (res == RESPONSE_EOF)
-				{
-					i++;
-				}
-				else if (res == RESPONSE_COMPLETE)
-				{
-					/* Ignore, wait for ReadyForQuery */
-				}
-				else if (res == RESPONSE_ERROR)
-				{
-					/* Ignore, wait for ReadyForQuery */
-				}
-				else if (res == RESPONSE_READY)
-				{
-					if (i < --dn_conn_count)
-						pgxc_connections->datanode_handles[i] =
-							pgxc_connections->datanode_handles[dn_conn_count];
-				}
-				else if (res == RESPONSE_TUPDESC)
-				{
-					ereport(ERROR,
-							(errcode(ERRCODE_INTERNAL_ERROR),
-							 errmsg("Unexpected response from Datanode")));
-				}
-				else if (res == RESPONSE_DATAROW)
-				{
-					ereport(ERROR,
-							(errcode(ERRCODE_INTERNAL_ERROR),
-							 errmsg("Unexpected response from Datanode")));
-				}
-			}
+			conn->deferred_pending++;
+			conn->state = DN_CONNECTION_STATE_IDLE;
+			conn->combiner = NULL;
+			if (conn->deferred_pending >= DDLBatchSize)
+				finish = true;
 		}
+		if (finish)
+			pgxc_node_finish_deferred(conn_count, connections);
+
+		pfree(connections);
+		pfree_pgxc_all_handles(pgxc_connections);
+		return;
 	}
 
-	/* Make the same for Coordinators */
+	/*
+	 * Wait for the Datanodes and Coordinators together, in the order they
+	 * respond. We do not expect them returning tuples when running utility
+	 * command. If we got EOF, move to the next connection, will receive more
+	 * data on the next iteration.
+	 */
+	while (conn_count > 0)
 	{
-		while (co_conn_count > 0)
-		{
-			int i = 0;
+		i = 0;
 
-			if (pgxc_node_receive(co_conn_count, pgxc_connections->coord_handles, NULL))
-				break;
+		if (pgxc_node_receive(conn_count, connections, NULL))
+			break;
+
+		while (i < conn_count)
+		{
+			int			res = handle_response(connections[i], combiner);
 
-			while (i < co_conn_count)
+			if (res == RESPONSE_EOF)
 			{
-				int res = handle_response(pgxc_connections->coord_handles[i], combiner);
-				if (res == RESPONSE_EOF)
-				{
-					i++;
-				}
-				else if (res == RESPONSE_COMPLETE)
-				{
-					/* Ignore, wait for ReadyForQuery */
-				}
-				else if (res == RESPONSE_ERROR)
-				{
-					/* Ignore, wait for ReadyForQuery */
-				}
-				else if (res == RESPONSE_READY)
-				{
-					if (i < --co_conn_count)
-						pgxc_connections->coord_handles[i] =
-							 pgxc_connections->coord_handles[co_conn_count];
-				}
-				else if (res == RESPONSE_TUPDESC)
-				{
-					ereport(ERROR,
-							(errcode(ERRCODE_INTERNAL_ERROR),
-							 errmsg("Unexpected response from coordinator")));
-				}
-				else if (res == RESPONSE_DATAROW)
-				{
-					ereport(ERROR,
-							(errcode(ERRCODE_INTERNAL_ERROR),
-							 errmsg("Unexpected response from coordinator")));
-				}
+				i++;
+			}
+			else if (res == RESPONSE_COMPLETE)
+			{
+				/* Ignore, wait for ReadyForQuery */
+			}
+			else if (res == RESPONSE_ERROR)
+			{
+				/* Ignore, wait for ReadyForQuery */
+			}
+			else if (res == RESPONSE_READY)
+			{
+				if (i < --conn_count)
+					connections[i] = connections[conn_count];
+			}
+			else if (res == RESPONSE_TUPDESC || res == RESPONSE_DATAROW)
+			{
+				ereport(ERROR,
+						(errcode(ERRCODE_INTERNAL_ERROR),
+						 errmsg("Unexpected response from remote node")));
 			}
 		}
 	}
+	pfree(connections);
 
 	/*
 	 * We have processed all responses from nodes and if we have
@@ -3596,6 +4518,9 @@ void
 AtEOXact_Remote(void)
 {
 	PGXCNodeResetParams(true);
+	PGXCNodeReportStats();
+	AtEOXact_Admission();
+	xact_nonreplicated_write = false;
 }
 
 /*
@@ -3638,7 +4563,7 @@ PreCommit_Remote(char *prepareGID, char *nodestring, bool preparedLocalNode)
 		Assert(preparedLocalNode);
 		pgxc_node_remote_finish(prepareGID, true, nodestring,
 								GetAuxilliaryTransactionId(),
-								GetTopGlobalTransactionId());
+								GetTopGlobalTransactionId(), true);
 
 	}
 	else
@@ -3689,6 +4614,22 @@ PreAbort_Remote(void)
 	if (log_gtm_stats)
 		ResetUsageCommon(&start_r, &start_t);
 
+	/*
+	 * COMMIT PREPARED left running by pgxc_node_defer_finish must not be
+	 * cancelled, the transaction may already be committed on some nodes.
+	 */
+	if (asyncCommit.pending)
+	{
+		ResponseCombiner combiner;
+
+		InitResponseCombiner(&combiner, asyncCommit.conn_count,
+							 COMBINE_TYPE_NONE);
+		pgxc_node_receive_responses(asyncCommit.conn_count,
+									asyncCommit.connections, NULL, &combiner);
+		CloseCombiner(&combiner);
+		pgxc_node_forget_async_commit();
+	}
+
 	all_handles = get_current_handles();
 	/*
 	 * Find "dirty" coordinator connections.
@@ -3774,6 +4715,13 @@ PreAbort_Remote(void)
 
 	pgxc_node_remote_abort();
 
+	/*
+	 * We can not be sure the remote subplans stored on the nodes survived the
+	 * error, so send them down again on next execution. The leftovers are
+	 * deallocated when connections are cleaned up.
+	 */
+	pgxc_node_forget_all_subplans();
+
 	if (!temp_object_included && !PersistentConnections)
 	{
 		/* Clean up remote sessions */
@@ -3823,22 +4771,21 @@ PrePrepare_Remote(char *prepareGID, bool localNode, bool implicit)
 	}
 
 	nodestring = pgxc_node_remote_prepare(prepareGID,
-												!implicit || localNode);
-
-	if (!implicit && IS_PGXC_LOCAL_COORDINATOR)
-		/* Save the node list and gid on GTM. */
-		StartPreparedTranGTM(GetTopGlobalTransactionId(), prepareGID,
-							 nodestring);
+										  !implicit || localNode, implicit);
 
 	/*
 	 * If no need to commit on local node go ahead and commit prepared
-	 * transaction right away.
+	 * transaction right away. With async_commit_prepared the client is
+	 * not kept waiting for it, the responses are read by FinishAsyncCommit
+	 * once the commit is reported.
 	 */
 	if (implicit && !localNode && nodestring)
 	{
 		pgxc_node_remote_finish(prepareGID, true, nodestring,
 								GetAuxilliaryTransactionId(),
-								GetTopGlobalTransactionId());
+								GetTopGlobalTransactionId(),
+								!AsyncCommitPrepared ||
+								whereToSendOutput != DestRemote);
 		pfree(nodestring);
 		nodestring = NULL;
 	}
@@ -3892,6 +4839,17 @@ IsTwoPhaseCommitRequired(bool localWrite)
 		return false;
 	}
 
+	/*
+	 * Writes to replicated tables only commit in one phase, on the primary
+	 * node first, see pgxc_node_remote_commit
+	 */
+	if (ReplicatedOnePhaseCommit && !localWrite && !xact_nonreplicated_write)
+	{
+		elog(DEBUG1, "Transaction wrote to replicated tables only - "
+				"2PC will not be used");
+		return false;
+	}
+
 	handles = get_current_handles();
 	for (i = 0; i < handles->dn_conn_count; i++)
 	{
@@ -3972,7 +4930,7 @@ FinishRemotePreparedTransaction(char *prepareGID, bool commit)
 				 errmsg("prepared transaction with identifier \"%s\" does not exist",
 						prepareGID)));
 	prepared_local = pgxc_node_remote_finish(prepareGID, commit, nodestring,
-											 gxid, prepare_gxid);
+											 gxid, prepare_gxid, true);
 
 	if (commit)
 	{
@@ -3996,11 +4954,13 @@ FinishRemotePreparedTransaction(char *prepareGID, bool commit)
 /*
  * Complete previously prepared transactions on remote nodes.
  * Release remote connection after completion.
+ * If wait is false the commands are sent but not completed, see
+ * pgxc_node_defer_finish.
  */
 static bool
 pgxc_node_remote_finish(char *prepareGID, bool commit,
 						char *nodestring, GlobalTransactionId gxid,
-						GlobalTransactionId prepare_gxid)
+						GlobalTransactionId prepare_gxid, bool wait)
 {
 	char				finish_cmd[256];
 	PGXCNodeHandle	   *connections[MaxCoords + MaxDataNodes];
@@ -4055,96 +5015,736 @@ pgxc_node_remote_finish(char *prepareGID, bool commit,
 	else
 		sprintf(finish_cmd, "ROLLBACK PREPARED '%s'", prepareGID);
 
-	for (i = 0; i < pgxc_handles->dn_conn_count; i++)
-	{
-		PGXCNodeHandle *conn = pgxc_handles->datanode_handles[i];
+	for (i = 0; i < pgxc_handles->dn_conn_count; i++)
+	{
+		PGXCNodeHandle *conn = pgxc_handles->datanode_handles[i];
+
+		if (pgxc_node_send_gxid(conn, gxid))
+		{
+			ereport(ERROR,
+					(errcode(ERRCODE_INTERNAL_ERROR),
+					 errmsg("failed to send GXID for %s PREPARED command",
+							commit ? "COMMIT" : "ROLLBACK")));
+		}
+
+		if (pgxc_node_send_query(conn, finish_cmd))
+		{
+			/*
+			 * Do not bother with clean up, just bomb out. The error handler
+			 * will invoke RollbackTransaction which will do the work.
+			 */
+			ereport(ERROR,
+					(errcode(ERRCODE_INTERNAL_ERROR),
+					 errmsg("failed to send %s PREPARED command to the node %u",
+							commit ? "COMMIT" : "ROLLBACK", conn->nodeoid)));
+		}
+		else
+		{
+			/* Read responses from these */
+			connections[conn_count++] = conn;
+		}
+	}
+
+	for (i = 0; i < pgxc_handles->co_conn_count; i++)
+	{
+		PGXCNodeHandle *conn = pgxc_handles->coord_handles[i];
+
+		if (pgxc_node_send_gxid(conn, gxid))
+		{
+			ereport(ERROR,
+					(errcode(ERRCODE_INTERNAL_ERROR),
+					 errmsg("failed to send GXID for %s PREPARED command",
+							commit ? "COMMIT" : "ROLLBACK")));
+		}
+
+		if (pgxc_node_send_query(conn, finish_cmd))
+		{
+			/*
+			 * Do not bother with clean up, just bomb out. The error handler
+			 * will invoke RollbackTransaction which will do the work.
+			 */
+			ereport(ERROR,
+					(errcode(ERRCODE_INTERNAL_ERROR),
+					 errmsg("failed to send %s PREPARED command to the node %u",
+							commit ? "COMMIT" : "ROLLBACK", conn->nodeoid)));
+		}
+		else
+		{
+			/* Read responses from these */
+			connections[conn_count++] = conn;
+		}
+	}
+
+	if (conn_count && !wait)
+	{
+		Assert(commit);
+		pgxc_node_defer_finish(prepareGID, conn_count, connections);
+		pfree_pgxc_all_handles(pgxc_handles);
+		return prepared_local;
+	}
+
+	if (conn_count)
+	{
+		InitResponseCombiner(&combiner, conn_count, COMBINE_TYPE_NONE);
+		/* Receive responses */
+		if (pgxc_node_receive_responses(conn_count, connections, NULL, &combiner) ||
+				!validate_combiner(&combiner))
+		{
+			if (combiner.errorMessage)
+				pgxc_node_report_error(&combiner);
+			else
+				ereport(ERROR,
+						(errcode(ERRCODE_INTERNAL_ERROR),
+						 errmsg("Failed to COMMIT the transaction on one or more nodes")));
+		}
+		else
+			CloseCombiner(&combiner);
+	}
+
+	if (release_connections_at_end())
+	{
+		/* Clean up remote sessions */
+		pgxc_node_remote_cleanup_all();
+		release_handles();
+	}
+
+	pfree_pgxc_all_handles(pgxc_handles);
+
+	return prepared_local;
+}
+
+/*
+ * Leave the COMMIT PREPARED commands sent to the connections running, their
+ * responses are read by FinishAsyncCommit once the commit is reported to the
+ * client. The transaction is committed on GTM as usual before that, so the
+ * snapshots taken meanwhile see it committed, and the statements of the
+ * Datanodes wait for the commands to complete, see WaitForPreparedCommits.
+ */
+static void
+pgxc_node_defer_finish(char *prepareGID, int conn_count,
+					   PGXCNodeHandle **connections)
+{
+	asyncCommit.connections = (PGXCNodeHandle **)
+		MemoryContextAlloc(TopMemoryContext,
+						   conn_count * sizeof(PGXCNodeHandle *));
+	memcpy(asyncCommit.connections, connections,
+		   conn_count * sizeof(PGXCNodeHandle *));
+	asyncCommit.conn_count = conn_count;
+	asyncCommit.gid = MemoryContextStrdup(TopMemoryContext, prepareGID);
+	asyncCommit.pending = true;
+}
+
+/*
+ * Is there a commit to complete by FinishAsyncCommit?
+ */
+bool
+IsAsyncCommitPending(void)
+{
+	return asyncCommit.pending;
+}
+
+/*
+ * Read the responses to the COMMIT PREPARED commands left running by
+ * pgxc_node_defer_finish. Called right after the commit is reported to the
+ * client, and before a new transaction starts. A node failing to commit does
+ * not make the transaction abort, it is committed on GTM and the other
+ * nodes, so only a warning is issued and the transaction stays prepared on
+ * the node until resolved.
+ */
+void
+FinishAsyncCommit(void)
+{
+	ResponseCombiner combiner;
+
+	if (!asyncCommit.pending)
+		return;
+
+	PG_TRY();
+	{
+		InitResponseCombiner(&combiner, asyncCommit.conn_count,
+							 COMBINE_TYPE_NONE);
+		if (pgxc_node_receive_responses(asyncCommit.conn_count,
+										asyncCommit.connections, NULL,
+										&combiner) ||
+			!validate_combiner(&combiner))
+			ereport(WARNING,
+					(errcode(ERRCODE_INTERNAL_ERROR),
+					 errmsg("could not complete COMMIT PREPARED of transaction \"%s\" on one or more nodes",
+							asyncCommit.gid),
+					 combiner.errorMessage ?
+					 errdetail("%s", combiner.errorMessage) : 0,
+					 errhint("The transaction is committed, use pgxc_resolve_prepared() to finish it on the nodes.")));
+		CloseCombiner(&combiner);
+
+		if (release_connections_at_end())
+		{
+			/* Clean up remote sessions */
+			pgxc_node_remote_cleanup_all();
+			release_handles();
+		}
+	}
+	PG_CATCH();
+	{
+		pgxc_node_forget_async_commit();
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	pgxc_node_forget_async_commit();
+}
+
+/*
+ * Drop the pending commit. The connections are cleaned up by the caller.
+ */
+static void
+pgxc_node_forget_async_commit(void)
+{
+	if (!asyncCommit.pending)
+		return;
+	asyncCommit.pending = false;
+
+	pfree(asyncCommit.connections);
+	asyncCommit.connections = NULL;
+	asyncCommit.conn_count = 0;
+	pfree(asyncCommit.gid);
+	asyncCommit.gid = NULL;
+}
+
+/*
+ * Resolution of in-doubt prepared transactions
+ *
+ * A Coordinator failing between PREPARE TRANSACTION and COMMIT PREPARED
+ * leaves the transaction prepared on the nodes, where it holds its locks
+ * until somebody finishes it.  pgxc_resolve_prepared finishes such
+ * transactions of the current database the way pgxc_clean does, without a
+ * round trip per node and transaction: the prepared transactions and then
+ * their status are fetched from all the nodes at once, and the COMMIT or
+ * ROLLBACK PREPARED commands for a node are sent in a single batch, all the
+ * nodes working through their batches concurrently.  A transaction
+ * committed on some node is committed on the others, one aborted on some
+ * node is rolled back, and one still prepared on all its nodes is committed
+ * if it was prepared implicitly; an explicitly prepared transaction is left
+ * to its owner.  Only the transactions prepared at least min_age seconds ago
+ * on all their nodes are considered, so that the Coordinators still
+ * finishing their transactions are not interfered with.
+ */
+typedef struct InDoubtXact
+{
+	TransactionId xid;			/* hash key */
+	char	   *gid;
+	bool	   *prepared;		/* prepared on the node, by node index */
+	bool		recent;			/* prepared less than min_age ago somewhere */
+	bool		conflict;		/* prepared with different GIDs */
+	bool		committed;		/* committed on some node */
+	bool		aborted;		/* aborted on some node */
+	bool		failed;			/* could not be finished on some node */
+} InDoubtXact;
+
+/* Commands sent to a remote node, in the order of their responses */
+typedef struct ResolveBatch
+{
+	PGXCNodeHandle *conn;
+	List	   *xacts;			/* InDoubtXact of the pending commands */
+	ResponseCombiner combiner;
+} ResolveBatch;
+
+/*
+ * Index of the node in the prepared[] arrays: the Datanodes come first,
+ * then the Coordinators.
+ */
+static int
+pgxc_resolve_node_index(char *nodename)
+{
+	char		ntype = PGXC_NODE_NONE;
+	int			nodeid = PGXCNodeGetNodeIdFromName(nodename, &ntype);
+
+	if (ntype == PGXC_NODE_DATANODE)
+		return nodeid;
+	if (ntype == PGXC_NODE_COORDINATOR)
+		return NumDataNodes + nodeid;
+	return -1;
+}
+
+/*
+ * Record a row fetched from a node: the transaction if it is prepared
+ * there, that is gid is not NULL, otherwise its status on the node.
+ */
+static void
+pgxc_resolve_record(HTAB *xacts, char *nodename, TransactionId xid,
+					char *gid, bool flag, bool flagnull)
+{
+	InDoubtXact *xact;
+	bool		found;
+	int			node = pgxc_resolve_node_index(nodename);
+
+	if (node < 0)
+		return;
+
+	if (gid == NULL)
+	{
+		xact = (InDoubtXact *) hash_search(xacts, &xid, HASH_FIND, NULL);
+		if (xact && !flagnull)
+		{
+			if (flag)
+				xact->committed = true;
+			else
+				xact->aborted = true;
+		}
+		return;
+	}
+
+	xact = (InDoubtXact *) hash_search(xacts, &xid, HASH_ENTER, &found);
+	if (!found)
+	{
+		xact->gid = pstrdup(gid);
+		xact->prepared = (bool *) palloc0((NumDataNodes + NumCoords) *
+										  sizeof(bool));
+		xact->recent = false;
+		xact->conflict = false;
+		xact->committed = false;
+		xact->aborted = false;
+		xact->failed = false;
+	}
+	else if (strcmp(xact->gid, gid) != 0)
+		xact->conflict = true;
+	xact->prepared[node] = true;
+	/* The flag tells whether it was prepared long enough ago */
+	if (flagnull || !flag)
+		xact->recent = true;
+}
+
+/*
+ * Run the query on the remote nodes of the given type at once. The query
+ * returns the node name, a transaction id, a GID and a boolean.
+ */
+static void
+pgxc_resolve_fetch_remote(RemoteQueryExecType exec_type, List *nodelist,
+						  const char *query, HTAB *xacts)
+{
+	RemoteQuery *plan;
+	RemoteQueryState *pstate;
+	EState	   *estate;
+	MemoryContext oldcontext;
+	TupleTableSlot *result;
+
+	plan = makeNode(RemoteQuery);
+	plan->combine_type = COMBINE_TYPE_NONE;
+	plan->exec_nodes = makeNode(ExecNodes);
+	plan->exec_nodes->nodeList = nodelist;
+	plan->exec_type = exec_type;
+	plan->sql_statement = (char *) query;
+	/*
+	 * Leave no transaction block open on the nodes, the COMMIT PREPARED
+	 * commands sent over the same connections can not run inside one
+	 */
+	plan->force_autocommit = true;
+	/* The target list only determines the types of the result */
+	plan->scan.plan.targetlist = list_make4(
+			makeTargetEntry((Expr *) makeVar(1, 1, NAMEOID, -1, InvalidOid, 0),
+							1, NULL, false),
+			makeTargetEntry((Expr *) makeVar(1, 2, XIDOID, -1, InvalidOid, 0),
+							2, NULL, false),
+			makeTargetEntry((Expr *) makeVar(1, 3, TEXTOID, -1, InvalidOid, 0),
+							3, NULL, false),
+			makeTargetEntry((Expr *) makeVar(1, 4, BOOLOID, -1, InvalidOid, 0),
+							4, NULL, false));
+
+	estate = CreateExecutorState();
+	oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+	estate->es_snapshot = GetActiveSnapshot();
+	pstate = ExecInitRemoteQuery(plan, estate, 0);
+	MemoryContextSwitchTo(oldcontext);
+
+	result = ExecRemoteQuery(pstate);
+	while (!TupIsNull(result))
+	{
+		bool		isnull;
+		bool		gidnull;
+		bool		flagnull;
+		char	   *nodename;
+		TransactionId xid;
+		Datum		gid;
+		Datum		flag;
+
+		nodename = NameStr(*DatumGetName(slot_getattr(result, 1, &isnull)));
+		xid = DatumGetTransactionId(slot_getattr(result, 2, &isnull));
+		gid = slot_getattr(result, 3, &gidnull);
+		flag = slot_getattr(result, 4, &flagnull);
+		pgxc_resolve_record(xacts, nodename, xid,
+							gidnull ? NULL : TextDatumGetCString(gid),
+							DatumGetBool(flag), flagnull);
+
+		result = ExecRemoteQuery(pstate);
+	}
+	ExecEndRemoteQuery(pstate);
+	FreeExecutorState(estate);
+}
+
+/*
+ * Run the query on all the nodes, this Coordinator included, and record
+ * the results. SPI must be connected.
+ */
+static void
+pgxc_resolve_fetch(const char *query, HTAB *xacts)
+{
+	List	   *nodelist = NIL;
+	int			i;
+
+	for (i = 0; i < NumDataNodes; i++)
+		nodelist = lappend_int(nodelist, i);
+	pgxc_resolve_fetch_remote(EXEC_ON_DATANODES, nodelist, query, xacts);
+
+	nodelist = GetAllCoordNodes();
+	if (nodelist != NIL)
+		pgxc_resolve_fetch_remote(EXEC_ON_COORDS, nodelist, query, xacts);
+
+	if (SPI_execute(query, true, 0) != SPI_OK_SELECT)
+		elog(ERROR, "could not query prepared transactions");
+	for (i = 0; i < SPI_processed; i++)
+	{
+		HeapTuple	tuple = SPI_tuptable->vals[i];
+		TupleDesc	tupdesc = SPI_tuptable->tupdesc;
+		bool		isnull;
+		bool		gidnull;
+		bool		flagnull;
+		Datum		gid;
+		Datum		flag;
+
+		gid = SPI_getbinval(tuple, tupdesc, 3, &gidnull);
+		flag = SPI_getbinval(tuple, tupdesc, 4, &flagnull);
+		pgxc_resolve_record(xacts,
+							NameStr(*DatumGetName(SPI_getbinval(tuple, tupdesc,
+																1, &isnull))),
+							DatumGetTransactionId(SPI_getbinval(tuple, tupdesc,
+																2, &isnull)),
+							gidnull ? NULL : TextDatumGetCString(gid),
+							DatumGetBool(flag), flagnull);
+	}
+}
+
+/*
+ * Finish the transactions on all the nodes they are prepared on.  Each
+ * remote node gets its commands in one batch, and the responses of all the
+ * nodes are read as they come.  A command failing on a node is reported as
+ * a warning and the transaction is marked failed, the others go on.
+ */
+static void
+pgxc_resolve_finish(List *xacts)
+{
+	int			local = NumDataNodes + PGXCNodeId - 1;
+	List	   *nodelist = NIL;
+	List	   *coordlist = NIL;
+	PGXCNodeAllHandles *handles;
+	PGXCNodeHandle **conns;
+	ResolveBatch *batches;
+	int		   *nodes;
+	int			count = 0;
+	int			node;
+	int			i;
+	ListCell   *lc;
+
+	nodes = (int *) palloc((NumDataNodes + NumCoords) * sizeof(int));
+	for (node = 0; node < NumDataNodes + NumCoords; node++)
+	{
+		if (node == local)
+			continue;
+		foreach(lc, xacts)
+			if (((InDoubtXact *) lfirst(lc))->prepared[node])
+				break;
+		if (lc == NULL)
+			continue;
+		if (node < NumDataNodes)
+			nodelist = lappend_int(nodelist, node);
+		else
+			coordlist = lappend_int(coordlist, node - NumDataNodes);
+		nodes[count++] = node;
+	}
+
+	conns = (PGXCNodeHandle **) palloc(Max(count, 1) * sizeof(PGXCNodeHandle *));
+	batches = (ResolveBatch *) palloc(Max(count, 1) * sizeof(ResolveBatch));
+
+	if (count > 0)
+	{
+		/* The handles come in the order of the nodes */
+		handles = get_handles(nodelist, coordlist, nodelist == NIL, true);
+		for (i = 0; i < count; i++)
+		{
+			ResolveBatch *batch = &batches[i];
+
+			if (i < handles->dn_conn_count)
+				batch->conn = handles->datanode_handles[i];
+			else
+				batch->conn = handles->coord_handles[i - handles->dn_conn_count];
+			batch->xacts = NIL;
+
+			foreach(lc, xacts)
+			{
+				InDoubtXact *xact = (InDoubtXact *) lfirst(lc);
+				char	   *cmd;
+
+				if (!xact->prepared[nodes[i]])
+					continue;
+				cmd = psprintf("%s PREPARED %s",
+							   xact->aborted ? "ROLLBACK" : "COMMIT",
+							   quote_literal_cstr(xact->gid));
+				if (batch->conn->state != DN_CONNECTION_STATE_IDLE ||
+					pgxc_node_queue_query(batch->conn, cmd))
+					ereport(ERROR,
+							(errcode(ERRCODE_INTERNAL_ERROR),
+							 errmsg("failed to send %s PREPARED command to the node %u",
+									xact->aborted ? "ROLLBACK" : "COMMIT",
+									batch->conn->nodeoid)));
+				batch->xacts = lappend(batch->xacts, xact);
+			}
+			batch->conn->state = DN_CONNECTION_STATE_QUERY;
+			InitResponseCombiner(&batch->combiner, 1, COMBINE_TYPE_NONE);
+			conns[i] = batch->conn;
+		}
+		pfree_pgxc_all_handles(handles);
 
-		if (pgxc_node_send_gxid(conn, gxid))
-		{
+		if (pgxc_node_flush_all(count, conns))
 			ereport(ERROR,
 					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("failed to send GXID for %s PREPARED command",
-							commit ? "COMMIT" : "ROLLBACK")));
-		}
+					 errmsg("failed to send COMMIT or ROLLBACK PREPARED commands")));
+	}
 
-		if (pgxc_node_send_query(conn, finish_cmd))
-		{
-			/*
-			 * Do not bother with clean up, just bomb out. The error handler
-			 * will invoke RollbackTransaction which will do the work.
-			 */
+	while (count > 0)
+	{
+		if (pgxc_node_receive(count, conns, NULL))
 			ereport(ERROR,
 					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("failed to send %s PREPARED command to the node %u",
-							commit ? "COMMIT" : "ROLLBACK", conn->nodeoid)));
-		}
-		else
+					 errmsg("failed to receive responses to COMMIT or ROLLBACK PREPARED")));
+
+		i = 0;
+		while (i < count)
 		{
-			/* Read responses from these */
-			connections[conn_count++] = conn;
+			ResolveBatch *batch = &batches[i];
+			PGXCNodeHandle *conn = batch->conn;
+			InDoubtXact *xact;
+
+			switch (handle_response(conn, &batch->combiner))
+			{
+				case RESPONSE_EOF:
+					i++;
+					continue;
+
+				case RESPONSE_READY:
+					/* Done with the first pending command */
+					xact = (InDoubtXact *) linitial(batch->xacts);
+					if (batch->combiner.errorMessage)
+					{
+						ereport(WARNING,
+								(errmsg("could not finish prepared transaction \"%s\" on node \"%s\": %s",
+										xact->gid,
+										get_pgxc_nodename(conn->nodeoid),
+										batch->combiner.errorMessage)));
+						xact->failed = true;
+					}
+					CloseCombiner(&batch->combiner);
+					InitResponseCombiner(&batch->combiner, 1, COMBINE_TYPE_NONE);
+					batch->xacts = list_delete_first(batch->xacts);
+					if (batch->xacts == NIL)
+						break;
+					conn->state = DN_CONNECTION_STATE_QUERY;
+					continue;
+
+				default:
+					if (conn->state != DN_CONNECTION_STATE_ERROR_FATAL)
+					{
+						/* Keep reading up to ReadyForQuery */
+						conn->state = DN_CONNECTION_STATE_QUERY;
+						continue;
+					}
+					ereport(WARNING,
+							(errcode(ERRCODE_CONNECTION_FAILURE),
+							 errmsg("lost connection to node \"%s\" while finishing prepared transactions",
+									get_pgxc_nodename(conn->nodeoid))));
+					foreach(lc, batch->xacts)
+						((InDoubtXact *) lfirst(lc))->failed = true;
+					break;
+			}
+
+			/* Nothing more to read from the node */
+			count--;
+			batches[i] = batches[count];
+			conns[i] = conns[count];
 		}
 	}
 
-	for (i = 0; i < pgxc_handles->co_conn_count; i++)
+	/* The transactions prepared on this Coordinator */
+	foreach(lc, xacts)
 	{
-		PGXCNodeHandle *conn = pgxc_handles->coord_handles[i];
+		InDoubtXact *xact = (InDoubtXact *) lfirst(lc);
 
-		if (pgxc_node_send_gxid(conn, gxid))
-		{
-			ereport(ERROR,
-					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("failed to send GXID for %s PREPARED command",
-							commit ? "COMMIT" : "ROLLBACK")));
-		}
+		if (xact->prepared[local])
+			FinishPreparedTransaction(xact->gid, !xact->aborted);
+	}
+}
 
-		if (pgxc_node_send_query(conn, finish_cmd))
+/*
+ * pgxc_resolve_prepared - finish the prepared transactions left behind
+ *
+ * Returns a row for each transaction finished on all the nodes it was
+ * prepared on, with the action taken.
+ */
+Datum
+pgxc_resolve_prepared(PG_FUNCTION_ARGS)
+{
+	int32		min_age = PG_GETARG_INT32(0);
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+	HASHCTL		ctl;
+	HTAB	   *xacts;
+	HASH_SEQ_STATUS status;
+	InDoubtXact *xact;
+	StringInfoData query;
+	List	   *resolved = NIL;
+	ListCell   *lc;
+	int			count;
+
+	if (!superuser())
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 (errmsg("must be superuser to resolve prepared transactions"))));
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Only a Coordinator the client is connected to sees all the nodes */
+	if (!IS_PGXC_LOCAL_COORDINATOR)
+		return (Datum) 0;
+
+	/* Everything below lives in the SPI procedure context */
+	SPI_connect();
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(TransactionId);
+	ctl.entrysize = sizeof(InDoubtXact);
+	ctl.hcxt = CurrentMemoryContext;
+	xacts = hash_create("In-doubt transactions", 256, &ctl,
+						HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	/* The transactions prepared in this database on all the nodes */
+	initStringInfo(&query);
+	appendStringInfo(&query,
+					 "SELECT pg_catalog.pgxc_node_str(), transaction, gid, "
+					 "prepared < pg_catalog.now() - interval '%d seconds' "
+					 "FROM pg_catalog.pg_prepared_xacts "
+					 "WHERE database = pg_catalog.current_database()",
+					 min_age);
+	pgxc_resolve_fetch(query.data, xacts);
+
+	/* The status of the old enough ones on the other nodes */
+	resetStringInfo(&query);
+	appendStringInfoString(&query,
+						   "SELECT pg_catalog.pgxc_node_str(), x, NULL::text, "
+						   "pg_catalog.pgxc_is_committed(x) "
+						   "FROM pg_catalog.unnest('{");
+	count = 0;
+	hash_seq_init(&status, xacts);
+	while ((xact = (InDoubtXact *) hash_seq_search(&status)) != NULL)
+	{
+		if (xact->recent)
+			continue;
+		if (xact->conflict)
 		{
-			/*
-			 * Do not bother with clean up, just bomb out. The error handler
-			 * will invoke RollbackTransaction which will do the work.
-			 */
-			ereport(ERROR,
-					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("failed to send %s PREPARED command to the node %u",
-							commit ? "COMMIT" : "ROLLBACK", conn->nodeoid)));
+			ereport(WARNING,
+					(errmsg("transaction %u is prepared with different identifiers on the nodes",
+							xact->xid)));
+			continue;
 		}
-		else
+		appendStringInfo(&query, count++ ? ",%u" : "%u", xact->xid);
+	}
+	appendStringInfoString(&query,
+						   "}'::pg_catalog.xid[]) x "
+						   "WHERE pg_catalog.pgxc_is_committed(x) IS NOT NULL");
+	if (count > 0)
+		pgxc_resolve_fetch(query.data, xacts);
+
+	/* Decide what to do with each of them */
+	hash_seq_init(&status, xacts);
+	while ((xact = (InDoubtXact *) hash_seq_search(&status)) != NULL)
+	{
+		if (xact->recent || xact->conflict)
+			continue;
+		if (xact->committed && xact->aborted)
 		{
-			/* Read responses from these */
-			connections[conn_count++] = conn;
+			ereport(WARNING,
+					(errmsg("prepared transaction \"%s\" is committed on some nodes and aborted on others",
+							xact->gid)));
+			continue;
 		}
+		if (xact->committed || xact->aborted || IsXidImplicit(xact->gid))
+			resolved = lappend(resolved, xact);
 	}
 
-	if (conn_count)
+	pgxc_resolve_finish(resolved);
+
+	foreach(lc, resolved)
 	{
-		InitResponseCombiner(&combiner, conn_count, COMBINE_TYPE_NONE);
-		/* Receive responses */
-		if (pgxc_node_receive_responses(conn_count, connections, NULL, &combiner) ||
-				!validate_combiner(&combiner))
+		Datum		values[3];
+		bool		nulls[3];
+		char	   *nodestring;
+		GlobalTransactionId gxid;
+		GlobalTransactionId prepare_gxid;
+
+		xact = (InDoubtXact *) lfirst(lc);
+		if (xact->failed)
+			continue;
+
+		/* GTM keeps track of the explicitly prepared transactions */
+		if (!IsXidImplicit(xact->gid) &&
+			GetGIDDataGTM(xact->gid, &gxid, &prepare_gxid, &nodestring) >= 0)
 		{
-			if (combiner.errorMessage)
-				pgxc_node_report_error(&combiner);
+			if (xact->aborted)
+			{
+				RollbackTranGTM(prepare_gxid);
+				RollbackTranGTM(gxid);
+			}
 			else
-				ereport(ERROR,
-						(errcode(ERRCODE_INTERNAL_ERROR),
-						 errmsg("Failed to COMMIT the transaction on one or more nodes")));
+				CommitPreparedTranGTM(prepare_gxid, gxid, 0, NULL);
 		}
-		else
-			CloseCombiner(&combiner);
-	}
 
-	if (!temp_object_included && !PersistentConnections)
-	{
-		/* Clean up remote sessions */
-		pgxc_node_remote_cleanup_all();
-		release_handles();
+		ereport(LOG,
+				(errmsg("%s prepared transaction \"%s\"",
+						xact->aborted ? "rolled back" : "committed",
+						xact->gid)));
+
+		MemSet(nulls, 0, sizeof(nulls));
+		values[0] = TransactionIdGetDatum(xact->xid);
+		values[1] = CStringGetTextDatum(xact->gid);
+		values[2] = CStringGetTextDatum(xact->aborted ? "rollback" : "commit");
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
 	}
 
-	pfree_pgxc_all_handles(pgxc_handles);
+	SPI_finish();
 
-	return prepared_local;
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
 }
 
+
 /*****************************************************************************
  *
  * Simplified versions of ExecInitRemoteQuery, ExecRemoteQuery and
@@ -4230,12 +5830,16 @@ ExecRemoteQuery(RemoteQueryState *node)
 		int				total_conn_count = 0;
 		bool			need_tran_block;
 		PGXCNodeAllHandles *pgxc_connections;
+		ExecNodes	   *standby_nodes = get_standby_exec_nodes(step,
+															   step->exec_nodes);
 
 		/*
 		 * Get connections for Datanodes only, utilities and DDLs
 		 * are launched in ExecRemoteUtility
 		 */
-		pgxc_connections = get_exec_connections(node, step->exec_nodes,
+		pgxc_connections = get_exec_connections(node,
+												standby_nodes ? standby_nodes :
+												step->exec_nodes,
 												step->exec_type,
 												true);
 
@@ -4279,9 +5883,17 @@ ExecRemoteQuery(RemoteQueryState *node)
 		stat_statement();
 		stat_transaction(total_conn_count);
 
-		gxid = GetCurrentTransactionId();
+		/*
+		 * A read-only statement running with a local snapshot does not need
+		 * the cluster to know about it, neither does one running on standbys
+		 */
+		if (StatementLocalSnapshots() || standby_nodes)
+			gxid = InvalidGlobalTransactionId;
+		else
+			gxid = pgxc_get_remote_gxid();
 
-		if (!GlobalTransactionIdIsValid(gxid))
+		if (!GlobalTransactionIdIsValid(gxid) &&
+			!StatementLocalSnapshots() && !standby_nodes)
 		{
 			pfree_pgxc_all_handles(pgxc_connections);
 			ereport(ERROR,
@@ -4416,6 +6028,53 @@ ExecRemoteQuery(RemoteQueryState *node)
 }
 
 
+/*
+ * FetchTupleReady
+ *		Can FetchTuple return the next row of the specified tape (connection
+ * of a merge sorting combiner) without waiting for the network? That is true
+ * if a row from the node is buffered or is already received in full, or if
+ * the tape is at the end.
+ */
+bool
+FetchTupleReady(ResponseCombiner *combiner, int tapenum)
+{
+	PGXCNodeHandle *conn;
+	Oid			nodeoid;
+	int			i;
+
+	Assert(combiner->merge_sort);
+	Assert(tapenum < combiner->conn_count);
+
+	conn = combiner->connections[tapenum];
+	nodeoid = conn ? conn->nodeoid : combiner->tapenodes[tapenum];
+	for (i = 0; i < combiner->rowBufferCount; i++)
+	{
+		if (combiner->rowBufferNodes[i] == nodeoid)
+		{
+			if (combiner->rowBufferRows[i] > 0)
+				return true;
+			break;
+		}
+	}
+
+	/* End of the tape */
+	if (conn == NULL)
+		return true;
+
+	/*
+	 * Connection used by other step needs to be buffered, and idle connection
+	 * means FetchTuple would request more rows and wait for them.
+	 */
+	if (conn->combiner != combiner || conn->state != DN_CONNECTION_STATE_QUERY)
+		return false;
+
+	/* Compressed batch of messages is most likely full of rows as well */
+	return HAS_MESSAGE_BUFFERED(conn) &&
+		(conn->inBuffer[conn->inCursor] == 'D' ||
+		 conn->inBuffer[conn->inCursor] == PQ_PACKED_MSG_TYPE);
+}
+
+
 /*
  * Clean up and discard any data on the data node connections that might not
  * handled yet, including pending on the remote connection.
@@ -4424,8 +6083,7 @@ static void
 pgxc_connections_cleanup(ResponseCombiner *combiner)
 {
 	/* clean up the buffer */
-	list_free_deep(combiner->rowBuffer);
-	combiner->rowBuffer = NIL;
+	free_row_buffers(combiner);
 
 	/*
 	 * Read in and discard remaining data from the connections, if any
@@ -4501,11 +6159,6 @@ pgxc_connections_cleanup(ResponseCombiner *combiner)
 			pfree(combiner->tapenodes);
 			combiner->tapenodes = NULL;
 		}
-		if (combiner->tapemarks)
-		{
-			pfree(combiner->tapemarks);
-			combiner->tapemarks = NULL;
-		}
 		/*
 		 * tuplesort_end invalidates minimal tuple if it is in the slot because
 		 * deletes the TupleSort memory context, causing seg fault later when
@@ -4540,27 +6193,165 @@ ExecEndRemoteQuery(RemoteQueryState *node)
 		node->paramval_data = NULL;
 		node->paramval_len = 0;
 	}
-
-	CloseCombiner(combiner);
-	pfree(node);
+
+	CloseCombiner(combiner);
+	pfree(node);
+}
+
+
+/**********************************************
+ *
+ * Routines to support RemoteSubplan plan node
+ *
+ **********************************************/
+
+
+/*
+ * The routine walks recursively over the plan tree and changes cursor names of
+ * RemoteSubplan nodes to make them different from launched from the other
+ * datanodes. The routine changes cursor names in place, so caller should
+ * take writable copy of the plan tree.
+ */
+void
+RemoteSubplanMakeUnique(Node *plan, int unique)
+{
+	if (plan == NULL)
+		return;
+
+	if (IsA(plan, List))
+	{
+		ListCell *lc;
+		foreach(lc, (List *) plan)
+		{
+			RemoteSubplanMakeUnique(lfirst(lc), unique);
+		}
+		return;
+	}
+
+	/*
+	 * Transform SharedQueue name
+	 */
+	if (IsA(plan, RemoteSubplan))
+	{
+		((RemoteSubplan *)plan)->unique = unique;
+	}
+	/* Otherwise it is a Plan descendant */
+	RemoteSubplanMakeUnique((Node *) ((Plan *) plan)->lefttree, unique);
+	RemoteSubplanMakeUnique((Node *) ((Plan *) plan)->righttree, unique);
+	/* Tranform special cases */
+	switch (nodeTag(plan))
+	{
+		case T_Append:
+			RemoteSubplanMakeUnique((Node *) ((Append *) plan)->appendplans,
+									unique);
+			break;
+		case T_MergeAppend:
+			RemoteSubplanMakeUnique((Node *) ((MergeAppend *) plan)->mergeplans,
+									unique);
+			break;
+		case T_BitmapAnd:
+			RemoteSubplanMakeUnique((Node *) ((BitmapAnd *) plan)->bitmapplans,
+									unique);
+			break;
+		case T_BitmapOr:
+			RemoteSubplanMakeUnique((Node *) ((BitmapOr *) plan)->bitmapplans,
+									unique);
+			break;
+		case T_SubqueryScan:
+			RemoteSubplanMakeUnique((Node *) ((SubqueryScan *) plan)->subplan,
+									unique);
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Count the RemoteSubplan nodes of the plan tree, including the nested ones.
+ */
+static int
+RemoteSubplanCount(Node *plan)
+{
+	int			count = 0;
+
+	if (plan == NULL)
+		return 0;
+
+	if (IsA(plan, List))
+	{
+		ListCell *lc;
+		foreach(lc, (List *) plan)
+		{
+			count += RemoteSubplanCount(lfirst(lc));
+		}
+		return count;
+	}
+
+	if (IsA(plan, RemoteSubplan))
+		count++;
+	/* Otherwise it is a Plan descendant */
+	count += RemoteSubplanCount((Node *) ((Plan *) plan)->lefttree);
+	count += RemoteSubplanCount((Node *) ((Plan *) plan)->righttree);
+	/* Special cases */
+	switch (nodeTag(plan))
+	{
+		case T_Append:
+			count += RemoteSubplanCount((Node *) ((Append *) plan)->appendplans);
+			break;
+		case T_MergeAppend:
+			count += RemoteSubplanCount((Node *) ((MergeAppend *) plan)->mergeplans);
+			break;
+		case T_BitmapAnd:
+			count += RemoteSubplanCount((Node *) ((BitmapAnd *) plan)->bitmapplans);
+			break;
+		case T_BitmapOr:
+			count += RemoteSubplanCount((Node *) ((BitmapOr *) plan)->bitmapplans);
+			break;
+		case T_SubqueryScan:
+			count += RemoteSubplanCount((Node *) ((SubqueryScan *) plan)->subplan);
+			break;
+		default:
+			break;
+	}
+	return count;
 }
 
+/*
+ * Memory the fragments of the query may use on the remote nodes, in
+ * kilobytes, zero for work_mem. The local Coordinator splits query_work_mem
+ * evenly between all the fragments, since they may all run on the same node
+ * at the same time, and never gives a fragment more than work_mem. The
+ * Datanodes pass their share down to the nested fragments they dispatch.
+ */
+static int
+RemoteSubplanWorkMem(EState *estate)
+{
+	PlannedStmt *stmt = estate->es_plannedstmt;
+	int			count;
+
+	if (!IS_PGXC_LOCAL_COORDINATOR)
+		return stmt->workMem;
 
-/**********************************************
- *
- * Routines to support RemoteSubplan plan node
- *
- **********************************************/
+	if (QueryWorkMem <= 0)
+		return 0;
 
+	count = RemoteSubplanCount((Node *) stmt->planTree) +
+		RemoteSubplanCount((Node *) stmt->subplans);
+	return Min(work_mem, Max(QueryWorkMem / Max(count, 1), 64));
+}
 
 /*
- * The routine walks recursively over the plan tree and changes cursor names of
- * RemoteSubplan nodes to make them different from launched from the other
- * datanodes. The routine changes cursor names in place, so caller should
- * take writable copy of the plan tree.
+ * The routine walks recursively over the plan tree and marks RemoteSubplan
+ * nodes executed by the local node as persistent, so their statements are
+ * kept on the remote nodes and reused by subsequent executions. The subplans
+ * are not looked into, nested RemoteSubplan nodes are executed remotely.
+ * When plan is being released the routine is invoked with persistent = false
+ * to make connections to forget about the stored statements.
+ * The cursor name is unique for the plan, so if the plan is rebuilt new
+ * statements are stored under new names.
  */
 void
-RemoteSubplanMakeUnique(Node *plan, int unique)
+RemoteSubplanSetPersistent(Node *plan, bool persistent)
 {
 	if (plan == NULL)
 		return;
@@ -4570,43 +6361,50 @@ RemoteSubplanMakeUnique(Node *plan, int unique)
 		ListCell *lc;
 		foreach(lc, (List *) plan)
 		{
-			RemoteSubplanMakeUnique(lfirst(lc), unique);
+			RemoteSubplanSetPersistent(lfirst(lc), persistent);
 		}
 		return;
 	}
 
-	/*
-	 * Transform SharedQueue name
-	 */
 	if (IsA(plan, RemoteSubplan))
 	{
-		((RemoteSubplan *)plan)->unique = unique;
+		RemoteSubplan *rsplan = (RemoteSubplan *) plan;
+
+		if (!persistent && rsplan->persistent)
+			pgxc_node_forget_subplan(rsplan->cursor);
+		else if (persistent && rsplan->cursor && rsplan->unique == 0)
+			rsplan->persistent = true;
+		return;
 	}
 	/* Otherwise it is a Plan descendant */
-	RemoteSubplanMakeUnique((Node *) ((Plan *) plan)->lefttree, unique);
-	RemoteSubplanMakeUnique((Node *) ((Plan *) plan)->righttree, unique);
+	RemoteSubplanSetPersistent((Node *) ((Plan *) plan)->lefttree, persistent);
+	RemoteSubplanSetPersistent((Node *) ((Plan *) plan)->righttree, persistent);
 	/* Tranform special cases */
 	switch (nodeTag(plan))
 	{
 		case T_Append:
-			RemoteSubplanMakeUnique((Node *) ((Append *) plan)->appendplans,
-									unique);
+			RemoteSubplanSetPersistent((Node *) ((Append *) plan)->appendplans,
+									   persistent);
 			break;
 		case T_MergeAppend:
-			RemoteSubplanMakeUnique((Node *) ((MergeAppend *) plan)->mergeplans,
-									unique);
+			RemoteSubplanSetPersistent((Node *) ((MergeAppend *) plan)->mergeplans,
+									   persistent);
 			break;
 		case T_BitmapAnd:
-			RemoteSubplanMakeUnique((Node *) ((BitmapAnd *) plan)->bitmapplans,
-									unique);
+			RemoteSubplanSetPersistent((Node *) ((BitmapAnd *) plan)->bitmapplans,
+									   persistent);
 			break;
 		case T_BitmapOr:
-			RemoteSubplanMakeUnique((Node *) ((BitmapOr *) plan)->bitmapplans,
-									unique);
+			RemoteSubplanSetPersistent((Node *) ((BitmapOr *) plan)->bitmapplans,
+									   persistent);
 			break;
 		case T_SubqueryScan:
-			RemoteSubplanMakeUnique((Node *) ((SubqueryScan *) plan)->subplan,
-									unique);
+			RemoteSubplanSetPersistent((Node *) ((SubqueryScan *) plan)->subplan,
+									   persistent);
+			break;
+		case T_ModifyTable:
+			RemoteSubplanSetPersistent((Node *) ((ModifyTable *) plan)->plans,
+									   persistent);
 			break;
 		default:
 			break;
@@ -4843,6 +6641,13 @@ determine_param_types(Plan *plan,  struct find_params_context *context)
 		case T_LockRows:
 			break;
 
+		case T_ResultCache:
+			if (expression_tree_walker((Node *) ((ResultCache *) plan)->param_exprs,
+									   determine_param_types_walker,
+									   (void *) context))
+				return true;
+			break;
+
 		case T_WindowAgg:
 			if (expression_tree_walker((Node *) ((WindowAgg *) plan)->startOffset,
 									   determine_param_types_walker,
@@ -4873,6 +6678,37 @@ determine_param_types(Plan *plan,  struct find_params_context *context)
 }
 
 
+/*
+ * Nodes to run the remote subplan on, once the global index it looks up has
+ * been probed. Only the nodes storing rows with the value looked up are
+ * kept. If there is none, one node is enough to return nothing.
+ */
+static List *
+get_global_index_nodes(RemoteSubplan *plan, EState *estate, List *nodes)
+{
+	ExprState  *exprstate;
+	Datum		value;
+	bool		isnull;
+	List	   *found;
+	List	   *result;
+
+	exprstate = ExecInitExpr(plan->globalIndexValue, NULL);
+	value = ExecEvalExprSwitchContext(exprstate, GetPerTupleExprContext(estate),
+									  &isnull, NULL);
+	if (isnull)
+		return nodes;
+
+	found = GlobalIndexLookup(plan->globalIndexRel, plan->globalIndex, value,
+							  exprType((Node *) plan->globalIndexValue));
+	result = list_intersection_int(nodes, found);
+	if (result == NIL)
+		result = list_make1_int(linitial_int(nodes));
+	list_free(found);
+	list_free(nodes);
+	return result;
+}
+
+
 RemoteSubplanState *
 ExecInitRemoteSubplan(RemoteSubplan *node, EState *estate, int eflags)
 {
@@ -4880,12 +6716,29 @@ ExecInitRemoteSubplan(RemoteSubplan *node, EState *estate, int eflags)
 	RemoteSubplanState *remotestate;
 	ResponseCombiner   *combiner;
 	CombineType			combineType;
+	ResultCacheScan	   *resultcache = NULL;
 	struct rusage		start_r;
 	struct timeval		start_t;
 
 	if (log_remotesubplan_stats)
 		ResetUsageCommon(&start_r, &start_t);
 
+	/*
+	 * The result of the query may be in the result cache, nothing is sent to
+	 * the Datanodes then.
+	 */
+	if (node->resultCacheKey && IS_PGXC_LOCAL_COORDINATOR &&
+			!(eflags & EXEC_FLAG_EXPLAIN_ONLY))
+		resultcache = ResultCacheBeginScan(node->resultCacheKey, estate);
+
+	/*
+	 * Wait until the statement may run on the Datanodes, before anything is
+	 * sent to them.
+	 */
+	if (IS_PGXC_LOCAL_COORDINATOR && !(eflags & EXEC_FLAG_EXPLAIN_ONLY) &&
+			!(resultcache && ResultCacheHit(resultcache)))
+		AdmitStatement(estate);
+
 	remotestate = makeNode(RemoteSubplanState);
 	combiner = (ResponseCombiner *) remotestate;
 	/*
@@ -4921,6 +6774,19 @@ ExecInitRemoteSubplan(RemoteSubplan *node, EState *estate, int eflags)
 	ExecInitResultTupleSlot(estate, &combiner->ss.ps);
 	ExecAssignResultTypeFromTL((PlanState *) remotestate);
 
+	remotestate->resultcache = resultcache;
+	if (resultcache && ResultCacheHit(resultcache))
+	{
+		/* Consider the subplan done, the tuples come from the cache */
+		remotestate->bound = true;
+		return remotestate;
+	}
+
+	if (IS_PGXC_LOCAL_COORDINATOR && OidIsValid(node->globalIndex) &&
+			!(eflags & EXEC_FLAG_EXPLAIN_ONLY))
+		remotestate->execNodes = get_global_index_nodes(node, estate,
+													remotestate->execNodes);
+
 	/*
 	 * We optimize execution if we going to send down query to next level
 	 */
@@ -4984,8 +6850,17 @@ ExecInitRemoteSubplan(RemoteSubplan *node, EState *estate, int eflags)
 	 */
 	if (remotestate->local_exec || (eflags & EXEC_FLAG_EXPLAIN_ONLY))
 	{
-		outerPlanState(remotestate) = ExecInitNode(outerPlan(node), estate,
-												   eflags);
+		Plan	   *subplan = outerPlan(node);
+
+		/*
+		 * On a Datanode the fragment may be split across parallel workers,
+		 * if it is large enough. Sorted output has to come from a single
+		 * process, so leave it alone in that case.
+		 */
+		if (IS_PGXC_DATANODE && remotestate->local_exec && node->sort == NULL)
+			subplan = ExecParallelFragment(subplan, estate, eflags);
+
+		outerPlanState(remotestate) = ExecInitNode(subplan, estate, eflags);
 		if (node->distributionNodes)
 		{
 			Oid 		distributionType = InvalidOid;
@@ -5007,6 +6882,9 @@ ExecInitRemoteSubplan(RemoteSubplan *node, EState *estate, int eflags)
 												 (void *) node->distributionNodes,
 												 (void **) &remotestate->dest_nodes,
 												 false);
+			setLocatorBuckets(remotestate->locator, node->distributionBuckets,
+							  node->distributionNodes);
+			setLocatorRanges(remotestate->locator, node->distributionRanges);
 		}
 		else
 			remotestate->locator = NULL;
@@ -5155,6 +7033,15 @@ ExecInitRemoteSubplan(RemoteSubplan *node, EState *estate, int eflags)
 			}
 			remotestate->nParamRemote = rstmt.nParamRemote;
 			remotestate->remoteparams = rstmt.remoteparams;
+			/*
+			 * If the subplan is a SELECT depending on values evaluated here,
+			 * like inner side of a parameterized nested loop, remote portals
+			 * can be restarted with new values on rescan, no need to close
+			 * and bind them again. Exec params are at the end of the list.
+			 */
+			remotestate->rescan = rstmt.commandType == CMD_SELECT &&
+					rstmt.nParamRemote > 0 &&
+					rstmt.remoteparams[rstmt.nParamRemote - 1].paramkind == PARAM_EXEC;
 		}
 		else
 			rstmt.remoteparams = NULL;
@@ -5163,10 +7050,34 @@ ExecInitRemoteSubplan(RemoteSubplan *node, EState *estate, int eflags)
 		rstmt.distributionType = node->distributionType;
 		rstmt.distributionNodes = node->distributionNodes;
 		rstmt.distributionRestrict = node->distributionRestrict;
+		rstmt.distributionBuckets = node->distributionBuckets;
+		rstmt.distributionRanges = node->distributionRanges;
+		rstmt.adaptiveType = node->adaptiveType;
+		rstmt.adaptiveKey = node->adaptiveKey;
+		rstmt.adaptiveRows = node->adaptiveRows;
+		rstmt.workMem = RemoteSubplanWorkMem(estate);
+		/* Datanodes report the execution of the fragments to EXPLAIN ANALYZE */
+		if (IS_PGXC_LOCAL_COORDINATOR && estate->es_instrument)
+		{
+			rstmt.instrumentOptions = estate->es_instrument;
+			combiner->collect_instr = true;
+		}
+		else
+			rstmt.instrumentOptions = 0;
+		rstmt.queryId = estate->es_plannedstmt->queryId;
 
-		set_portable_output(true);
-		remotestate->subplanstr = nodeToString(&rstmt);
-		set_portable_output(false);
+		/*
+		 * Persistent subplan does not need to be encoded if it is already
+		 * stored on all the nodes where it may be executed.
+		 */
+		remotestate->persistent = node->persistent && IS_PGXC_LOCAL_COORDINATOR;
+		if (!remotestate->persistent ||
+				!pgxc_node_subplan_prepared(remotestate->execNodes, node->cursor))
+		{
+			set_portable_output(true);
+			remotestate->subplanstr = nodeToString(&rstmt);
+			set_portable_output(false);
+		}
 
 		/*
 		 * Connect to remote nodes and send down subplan
@@ -5175,6 +7086,9 @@ ExecInitRemoteSubplan(RemoteSubplan *node, EState *estate, int eflags)
 			ExecFinishInitRemoteSubplan(remotestate);
 	}
 	remotestate->bound = false;
+	if (IS_PGXC_LOCAL_COORDINATOR && !remotestate->local_exec &&
+			!(eflags & EXEC_FLAG_EXPLAIN_ONLY))
+		remotestate->insert_rows = simple_insert_rows(node, estate);
 	/*
 	 * It does not makes sense to merge sort if there is only one tuple source.
 	 * By the contract it is already sorted
@@ -5190,6 +7104,78 @@ ExecInitRemoteSubplan(RemoteSubplan *node, EState *estate, int eflags)
 }
 
 
+/*
+ * Does the ModifyTable change replicated tables only?
+ */
+static bool
+modify_replicated_only(ModifyTable *mt, EState *estate)
+{
+	ListCell   *lc;
+
+	foreach(lc, mt->resultRelations)
+	{
+		RangeTblEntry *rte = rt_fetch(lfirst_int(lc), estate->es_range_table);
+
+		if (!IsLocatorReplicated(GetRelationLocType(rte->relid)))
+			return false;
+	}
+	return true;
+}
+
+
+/*
+ * If the remote subplan is a plain INSERT of the VALUES rows, without
+ * triggers, RETURNING or ON CONFLICT, return the number of inserted rows,
+ * otherwise 0. The results of such an INSERT are known in advance unless it
+ * fails, so it may be sent without waiting for them, see ExecRemoteSubplan.
+ */
+static int
+simple_insert_rows(RemoteSubplan *node, EState *estate)
+{
+	PlannedStmt *stmt = estate->es_plannedstmt;
+	ModifyTable *mt;
+	Plan	   *subplan;
+
+	if (stmt->commandType != CMD_INSERT || stmt->hasReturning ||
+			stmt->planTree != (Plan *) node ||
+			!IsA(outerPlan(node), ModifyTable))
+		return 0;
+
+	mt = (ModifyTable *) outerPlan(node);
+	if (mt->operation != CMD_INSERT || mt->returningLists != NIL ||
+			mt->onConflictAction != ONCONFLICT_NONE ||
+			list_length(mt->plans) != 1 ||
+			list_length(mt->resultRelations) != 1)
+		return 0;
+
+	/* Triggers, including the foreign key checks, may change the outcome */
+	if (estate->es_num_result_relations != 1 ||
+			estate->es_result_relations[0].ri_TrigDesc != NULL)
+		return 0;
+
+	subplan = (Plan *) linitial(mt->plans);
+	if (expression_returns_set((Node *) subplan->targetlist))
+		return 0;
+
+	if (IsA(subplan, Result))
+	{
+		Result	   *result = (Result *) subplan;
+
+		if (outerPlan(result) == NULL && result->resconstantqual == NULL &&
+				result->plan.qual == NIL)
+			return 1;
+	}
+	else if (IsA(subplan, ValuesScan))
+	{
+		ValuesScan *values = (ValuesScan *) subplan;
+
+		if (values->scan.plan.qual == NIL)
+			return list_length(values->values_lists);
+	}
+	return 0;
+}
+
+
 void
 ExecFinishInitRemoteSubplan(RemoteSubplanState *node)
 {
@@ -5203,6 +7189,8 @@ ExecFinishInitRemoteSubplan(RemoteSubplanState *node)
 	int 				i;
 	bool				is_read_only;
 	char				cursor[NAMEDATALEN];
+	StringInfoData		prefix;
+	List			   *standby_nodes;
 
 	/*
 	 * Name is required to store plan as a statement
@@ -5219,7 +7207,7 @@ ExecFinishInitRemoteSubplan(RemoteSubplanState *node)
 		return;
 
 	/* local only or explain only execution */
-	if (node->subplanstr == NULL)
+	if (node->subplanstr == NULL && !node->persistent)
 		return;
 
 	/* 
@@ -5236,10 +7224,12 @@ ExecFinishInitRemoteSubplan(RemoteSubplanState *node)
 	 * That does not require transaction id or snapshot, so does not send them
 	 * here, postpone till bind.
 	 */
-	if (node->execOnAll)
+	standby_nodes = get_standby_subplan_nodes(node);
+	if (node->execOnAll || standby_nodes)
 	{
 		PGXCNodeAllHandles *pgxc_connections;
-		pgxc_connections = get_handles(node->execNodes, NIL, false, true);
+		pgxc_connections = get_handles(standby_nodes ? standby_nodes :
+									   node->execNodes, NIL, false, true);
 		combiner->conn_count = pgxc_connections->dn_conn_count;
 		combiner->connections = pgxc_connections->datanode_handles;
 		combiner->current_conn = 0;
@@ -5253,8 +7243,16 @@ ExecFinishInitRemoteSubplan(RemoteSubplanState *node)
 		combiner->current_conn = 0;
 	}
 
-	gxid = GetCurrentTransactionId();
-	if (!GlobalTransactionIdIsValid(gxid))
+	/*
+	 * A read-only statement running with a local snapshot or on standbys
+	 * does not need the cluster to know about it
+	 */
+	if (StatementLocalSnapshots() || standby_nodes)
+		gxid = InvalidGlobalTransactionId;
+	else
+		gxid = pgxc_get_remote_gxid();
+	if (!GlobalTransactionIdIsValid(gxid) &&
+		!StatementLocalSnapshots() && standby_nodes == NIL)
 	{
 		combiner->conn_count = 0;
 		pfree(combiner->connections);
@@ -5282,17 +7280,30 @@ ExecFinishInitRemoteSubplan(RemoteSubplanState *node)
 	is_read_only = IS_PGXC_DATANODE ||
 			!IsA(outerPlan(plan), ModifyTable);
 
+	if (!is_read_only)
+		begin_replicated_write =
+			modify_replicated_only((ModifyTable *) outerPlan(plan), estate);
+
+	/*
+	 * Start transaction on all the nodes at once, so the BEGIN round trips
+	 * overlap
+	 */
+	if (pgxc_node_begin(combiner->conn_count, combiner->connections, gxid, true,
+						is_read_only, PGXC_NODE_DATANODE))
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("Could not begin transaction on data node.")));
+
+	/* Timestamp and command ID are the same for all the nodes */
+	initStringInfo(&prefix);
+	pgxc_node_prefix_timestamp(&prefix, timestamp);
+	pgxc_node_prefix_cmd_id(&prefix, estate->es_snapshot->curcid);
+
 	for (i = 0; i < combiner->conn_count; i++)
 	{
 		PGXCNodeHandle *connection = combiner->connections[i];
 
-		if (pgxc_node_begin(1, &connection, gxid, true,
-							is_read_only, PGXC_NODE_DATANODE))
-			ereport(ERROR,
-					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("Could not begin transaction on data node.")));
-
-		if (pgxc_node_send_timestamp(connection, timestamp))
+		if (pgxc_node_send_prefix(connection, &prefix))
 		{
 			combiner->conn_count = 0;
 			pfree(combiner->connections);
@@ -5308,32 +7319,47 @@ ExecFinishInitRemoteSubplan(RemoteSubplanState *node)
 					(errcode(ERRCODE_INTERNAL_ERROR),
 					 errmsg("Failed to send snapshot to data nodes")));
 		}
-		if (pgxc_node_send_cmd_id(connection, estate->es_snapshot->curcid) < 0 )
-		{
-			combiner->conn_count = 0;
-			pfree(combiner->connections);
-			ereport(ERROR,
-					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("Failed to send command ID to data nodes")));
-		}
-		pgxc_node_send_plan(connection, cursor, "Remote Subplan",
-							node->subplanstr, node->nParamRemote, paramtypes);
-		if (pgxc_node_flush(connection))
+		/*
+		 * Persistent subplan may already be stored on the node, then just
+		 * bind it
+		 */
+		if (!node->persistent || !pgxc_node_has_subplan(connection, cursor))
 		{
-			combiner->conn_count = 0;
-			pfree(combiner->connections);
-			ereport(ERROR,
-					(errcode(ERRCODE_INTERNAL_ERROR),
-					 errmsg("Failed to send subplan to data nodes")));
+			if (node->subplanstr == NULL)
+				elog(ERROR, "remote subplan is not stored on node %u",
+					 connection->nodeoid);
+			pgxc_node_send_plan(connection, cursor, "Remote Subplan",
+								node->subplanstr, node->nParamRemote, paramtypes,
+								node->persistent);
+			if (node->persistent)
+				pgxc_node_add_subplan(connection, cursor);
 		}
 	}
+	pfree(prefix.data);
+
+	/* Send out the subplan to all the nodes in parallel */
+	if (pgxc_node_flush_all(combiner->conn_count, combiner->connections))
+	{
+		combiner->conn_count = 0;
+		pfree(combiner->connections);
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("Failed to send subplan to data nodes")));
+	}
 }
 
 
-static void
+/*
+ * Append the parameter value to the buffer in the format of the Bind message.
+ * If datarow_binary_format is on and the type has binary I/O functions the
+ * value is encoded with the send function, otherwise with the output function.
+ * Returns the format code of the value: 0 for text, 1 for binary.
+ */
+static int16
 append_param_data(StringInfo buf, Oid ptype, Datum value, bool isnull)
 {
 	uint32 n32;
+	int16	format = 0;
 
 	if (isnull)
 	{
@@ -5345,11 +7371,13 @@ append_param_data(StringInfo buf, Oid ptype, Datum value, bool isnull)
 		Oid		typOutput;
 		bool	typIsVarlena;
 		Datum	pval;
-		char   *pstring;
-		int		len;
 
 		/* Get info needed to output the value */
-		getTypeOutputInfo(ptype, &typOutput, &typIsVarlena);
+		if (DatarowBinaryFormat &&
+				ExecDatarowBinaryOutput(ptype, &typOutput, &typIsVarlena))
+			format = 1;
+		else
+			getTypeOutputInfo(ptype, &typOutput, &typIsVarlena);
 
 		/*
 		 * If we have a toasted datum, forcibly detoast it here to avoid
@@ -5360,15 +7388,79 @@ append_param_data(StringInfo buf, Oid ptype, Datum value, bool isnull)
 		else
 			pval = value;
 
-		/* Convert Datum to string */
-		pstring = OidOutputFunctionCall(typOutput, pval);
+		if (format == 1)
+		{
+			bytea  *outputbytes;
+			int		len;
 
-		/* copy data to the buffer */
-		len = strlen(pstring);
-		n32 = htonl(len);
-		appendBinaryStringInfo(buf, (char *) &n32, 4);
-		appendBinaryStringInfo(buf, pstring, len);
+			outputbytes = OidSendFunctionCall(typOutput, pval);
+			len = VARSIZE(outputbytes) - VARHDRSZ;
+			n32 = htonl(len);
+			appendBinaryStringInfo(buf, (char *) &n32, 4);
+			appendBinaryStringInfo(buf, VARDATA(outputbytes), len);
+		}
+		else
+		{
+			char   *pstring;
+			int		len;
+
+			/* Convert Datum to string */
+			pstring = OidOutputFunctionCall(typOutput, pval);
+
+			/* copy data to the buffer */
+			len = strlen(pstring);
+			n32 = htonl(len);
+			appendBinaryStringInfo(buf, (char *) &n32, 4);
+			appendBinaryStringInfo(buf, pstring, len);
+		}
+	}
+	return format;
+}
+
+
+/*
+ * Build parameter data to be sent with the Bind message from the encoded
+ * values and their format codes. If all the values are text the format codes
+ * array is empty, otherwise there is a code for each value.
+ * The buffer to store the data is palloc'ed in the current memory context and
+ * returned as the result parameter. Function returns size of the result.
+ */
+static int
+finish_param_data(StringInfo values, int nparams, int16 *formats,
+				  char **result)
+{
+	StringInfoData buf;
+	uint16		n16;
+	bool		binary = false;
+	int			i;
+
+	for (i = 0; i < nparams; i++)
+	{
+		if (formats[i] != 0)
+		{
+			binary = true;
+			break;
+		}
+	}
+
+	initStringInfo(&buf);
+	/* Number of parameter format codes */
+	n16 = htons(binary ? nparams : 0);
+	appendBinaryStringInfo(&buf, (char *) &n16, 2);
+	/* Parameter format codes */
+	if (binary)
+	{
+		for (i = 0; i < nparams; i++)
+		{
+			n16 = htons(formats[i]);
+			appendBinaryStringInfo(&buf, (char *) &n16, 2);
+		}
 	}
+	/* Parameter values */
+	appendBinaryStringInfo(&buf, values->data, values->len);
+
+	*result = buf.data;
+	return buf.len;
 }
 
 
@@ -5379,6 +7471,8 @@ static int encode_parameters(int nparams, RemoteParam *remoteparams,
 	StringInfoData	buf;
 	uint16 			n16;
 	int 			i;
+	int				len;
+	int16		   *formats;
 	ExprContext	   *econtext;
 	MemoryContext 	oldcontext;
 
@@ -5390,6 +7484,7 @@ static int encode_parameters(int nparams, RemoteParam *remoteparams,
 	MemoryContextReset(econtext->ecxt_per_tuple_memory);
 
 	initStringInfo(&buf);
+	formats = (int16 *) palloc(nparams * sizeof(int16));
 
 	/* Number of parameter values */
 	n16 = htons(nparams);
@@ -5404,7 +7499,8 @@ static int encode_parameters(int nparams, RemoteParam *remoteparams,
 		{
 			ParamExternData *param;
 			param = &(estate->es_param_list_info->params[rparam->paramid - 1]);
-			append_param_data(&buf, ptype, param->value, param->isnull);
+			formats[i] = append_param_data(&buf, ptype, param->value,
+										   param->isnull);
 		}
 		else
 		{
@@ -5418,248 +7514,296 @@ static int encode_parameters(int nparams, RemoteParam *remoteparams,
 				/* ExecSetParamPlan should have processed this param... */
 				Assert(param->execPlan == NULL);
 			}
-			append_param_data(&buf, ptype, param->value, param->isnull);
+			formats[i] = append_param_data(&buf, ptype, param->value,
+										   param->isnull);
 		}
 	}
 
 	/* Take data from the buffer */
-	*result = palloc(buf.len);
-	memcpy(*result, buf.data, buf.len);
+	len = finish_param_data(&buf, nparams, formats, result);
 	MemoryContextSwitchTo(oldcontext);
-	return buf.len;
+	return len;
 }
 
 
-TupleTableSlot *
-ExecRemoteSubplan(RemoteSubplanState *node)
+/*
+ * Send the subplan to the nodes, binding its portals and executing them
+ */
+static void
+remote_subplan_bind(RemoteSubplanState *node)
 {
 	ResponseCombiner *combiner = (ResponseCombiner *) node;
 	RemoteSubplan  *plan = (RemoteSubplan *) combiner->ss.ps.plan;
 	EState		   *estate = combiner->ss.ps.state;
 	TupleTableSlot *resultslot = combiner->ss.ps.ps_ResultTupleSlot;
-	struct rusage	start_r;
-	struct timeval		start_t;
+	int fetch = 0;
+	int paramlen = 0;
+	char *paramdata = NULL;
+	/*
+	 * Conditions when we want to execute query on the primary node first:
+	 * Coordinator running replicated ModifyTable on multiple nodes
+	 */
+	bool primary_mode = combiner->probing_primary ||
+			(IS_PGXC_COORDINATOR &&
+			 combiner->combine_type == COMBINE_TYPE_SAME &&
+			 OidIsValid(primary_data_node) &&
+			 combiner->conn_count > 1);
+	/*
+	 * Request results in binary format if it is enabled and possible for
+	 * all the columns, the combiner decodes rows with the receive
+	 * functions then, see slot_deform_datarow.
+	 */
+	bool binary = DatarowBinaryFormat &&
+			ExecDatarowBinaryPossible(resultslot->tts_tupleDescriptor);
+	char cursor[NAMEDATALEN];
+	/*
+	 * Join filter to send before the portals are bound. Once a filter
+	 * is sent it has to be sent every time, possibly empty, so the
+	 * nodes do not apply a stale one.
+	 */
+	StringInfoData filterdata;
+	bool sendfilter = node->joinfilter != NULL || node->joinfilter_sent;
 
-	/* 
-	 * We allow combiner->conn_count == 0 after node initialization
-	 * if we figured out that current node won't receive any result
-	 * because of distributionRestrict is set by planner.
-	 * But we should distinguish this case from others, when conn_count is 0.
-	 * That is possible if local execution is chosen or data are buffered 
-	 * at the coordinator or data are exhausted and node was reset.
-	 * in last two cases connections are saved to cursor_connections and we
-	 * can check their presence.  
+	if (plan->cursor)
+	{
+		fetch = RemoteFetchSize;
+		if (plan->unique)
+			snprintf(cursor, NAMEDATALEN, "%s_%d", plan->cursor, plan->unique);
+		else
+			strncpy(cursor, plan->cursor, NAMEDATALEN);
+	}
+	else
+		cursor[0] = '\0';
+
+	/*
+	 * Send down all available parameters, if any is used by the plan
 	 */
-	if (!node->local_exec && combiner->conn_count == 0 && 
-			combiner->cursor_count == 0)
-		return NULL;
+	if (estate->es_param_list_info ||
+			!bms_is_empty(plan->scan.plan.allParam))
+		paramlen = encode_parameters(node->nParamRemote,
+									 node->remoteparams,
+									 &combiner->ss.ps,
+									 &paramdata);
 
-	if (log_remotesubplan_stats)
-		ResetUsageCommon(&start_r, &start_t);
+	if (sendfilter)
+	{
+		initStringInfo(&filterdata);
+		JoinFilterSerialize(node->joinfilter, &filterdata);
+		if (node->joinfilter)
+			node->joinfilter_sent = true;
+	}
 
-primary_mode_phase_two:
-	if (!node->bound)
+	/*
+	 * The subplan being rescanned, need to restore connections and
+	 * re-bind the portal
+	 */
+	if (combiner->cursor)
 	{
-		int fetch = 0;
-		int paramlen = 0;
-		char *paramdata = NULL;
-		/*
-		 * Conditions when we want to execute query on the primary node first:
-		 * Coordinator running replicated ModifyTable on multiple nodes
-		 */
-		bool primary_mode = combiner->probing_primary ||
-				(IS_PGXC_COORDINATOR &&
-				 combiner->combine_type == COMBINE_TYPE_SAME &&
-				 OidIsValid(primary_data_node) &&
-				 combiner->conn_count > 1);
-		char cursor[NAMEDATALEN];
+		int i;
 
-		if (plan->cursor)
-		{
-			fetch = 1000;
-			if (plan->unique)
-				snprintf(cursor, NAMEDATALEN, "%s_%d", plan->cursor, plan->unique);
-			else
-				strncpy(cursor, plan->cursor, NAMEDATALEN);
-		}
-		else
-			cursor[0] = '\0';
+		reset_fetch_sizes(combiner);
 
 		/*
-		 * Send down all available parameters, if any is used by the plan
+		 * On second phase of primary mode connections are properly set,
+		 * so do not copy.
 		 */
-		if (estate->es_param_list_info ||
-				!bms_is_empty(plan->scan.plan.allParam))
-			paramlen = encode_parameters(node->nParamRemote,
-										 node->remoteparams,
-										 &combiner->ss.ps,
-										 &paramdata);
+		if (!combiner->probing_primary)
+		{
+			combiner->conn_count = combiner->cursor_count;
+			memcpy(combiner->connections, combiner->cursor_connections,
+						combiner->cursor_count * sizeof(PGXCNodeHandle *));
+		}
 
-		/*
-		 * The subplan being rescanned, need to restore connections and
-		 * re-bind the portal
-		 */
-		if (combiner->cursor)
+		for (i = 0; i < combiner->conn_count; i++)
 		{
-			int i;
+			PGXCNodeHandle *conn = combiner->connections[i];
 
-			/*
-			 * On second phase of primary mode connections are properly set,
-			 * so do not copy.
-			 */
-			if (!combiner->probing_primary)
+			CHECK_OWNERSHIP(conn, combiner);
+
+			if (node->rescan && !primary_mode)
 			{
-				combiner->conn_count = combiner->cursor_count;
-				memcpy(combiner->connections, combiner->cursor_connections,
-							combiner->cursor_count * sizeof(PGXCNodeHandle *));
+				/* restart the portal with new parameter values */
+				if (sendfilter)
+					pgxc_node_send_join_filter(conn, combiner->cursor,
+											   filterdata.data,
+											   filterdata.len);
+				pgxc_node_send_rescan(conn, combiner->cursor,
+									  paramlen, paramdata);
 			}
-
-			for (i = 0; i < combiner->conn_count; i++)
+			else
 			{
-				PGXCNodeHandle *conn = combiner->connections[i];
-
-				CHECK_OWNERSHIP(conn, combiner);
-
 				/* close previous cursor only on phase 1 */
 				if (!primary_mode || !combiner->probing_primary)
 					pgxc_node_send_close(conn, false, combiner->cursor);
 
 				/*
-				 * If we now should probe primary, skip execution on non-primary
-				 * nodes
+				 * If we now should probe primary, skip execution on
+				 * non-primary nodes
 				 */
 				if (primary_mode && !combiner->probing_primary &&
 						conn->nodeoid != primary_data_node)
 					continue;
 
 				/* rebind */
+				if (sendfilter)
+					pgxc_node_send_join_filter(conn, combiner->cursor,
+											   filterdata.data,
+											   filterdata.len);
 				pgxc_node_send_bind(conn, combiner->cursor, combiner->cursor,
-									paramlen, paramdata);
-				/* execute */
-				pgxc_node_send_execute(conn, combiner->cursor, fetch);
-				/* submit */
-				if (pgxc_node_send_flush(conn))
-				{
-					combiner->conn_count = 0;
-					pfree(combiner->connections);
-					ereport(ERROR,
-							(errcode(ERRCODE_INTERNAL_ERROR),
-							 errmsg("Failed to send command to data nodes")));
-				}
+									paramlen, paramdata, binary);
+			}
+			/* execute */
+			pgxc_node_send_execute(conn, combiner->cursor, fetch);
+			/* submit */
+			if (pgxc_node_queue_flush(conn))
+			{
+				combiner->conn_count = 0;
+				pfree(combiner->connections);
+				ereport(ERROR,
+						(errcode(ERRCODE_INTERNAL_ERROR),
+						 errmsg("Failed to send command to data nodes")));
+			}
 
-				/*
-				 * There could be only one primary node, but can not leave the
-				 * loop now, because we need to close cursors.
-				 */
-				if (primary_mode && !combiner->probing_primary)
-				{
-					combiner->current_conn = i;
-				}
+			/*
+			 * There could be only one primary node, but can not leave the
+			 * loop now, because we need to close cursors.
+			 */
+			if (primary_mode && !combiner->probing_primary)
+			{
+				combiner->current_conn = i;
 			}
 		}
-		else if (node->execNodes)
+
+		if (pgxc_node_flush_all(combiner->conn_count, combiner->connections))
 		{
-			CommandId		cid;
-			int 			i;
+			combiner->conn_count = 0;
+			pfree(combiner->connections);
+			ereport(ERROR,
+					(errcode(ERRCODE_INTERNAL_ERROR),
+					 errmsg("Failed to send command to data nodes")));
+		}
+	}
+	else if (node->execNodes)
+	{
+		CommandId		cid;
+		int 			i;
+		StringInfoData	prefix;
 
-			/*
-			 * There are prepared statement, connections should be already here
-			 */
-			Assert(combiner->conn_count > 0);
+		/*
+		 * There are prepared statement, connections should be already here
+		 */
+		Assert(combiner->conn_count > 0);
 
-			combiner->extended_query = true;
-			cid = estate->es_snapshot->curcid;
+		/*
+		 * Inside a transaction block a simple INSERT does not need to wait
+		 * for the results, they are received later in a batch, see
+		 * ExecEndRemoteSubplan. A failure is reported then, or at commit
+		 * at the latest, that aborts the transaction anyway.
+		 */
+		node->insert_deferred = node->insert_rows > 0 &&
+				InsertBatchSize > 0 && !primary_mode &&
+				IsTransactionBlock() && !IsSubTransaction();
 
-			for (i = 0; i < combiner->conn_count; i++)
-			{
-				PGXCNodeHandle *conn = combiner->connections[i];
+		combiner->extended_query = true;
+		cid = estate->es_snapshot->curcid;
 
-				CHECK_OWNERSHIP(conn, combiner);
+		/*
+		 * Update Command Id. Other command may be executed after we
+		 * prepare and advanced Command Id. We should use one that
+		 * was active at the moment when command started.
+		 * Resend the snapshot as well since the connection may have
+		 * been buffered and use by other commands, with different
+		 * snapshot. Set the snapshot back to what it was.
+		 * Command ID is the same for all the nodes, so serialize it once.
+		 */
+		initStringInfo(&prefix);
+		pgxc_node_prefix_cmd_id(&prefix, cid);
 
-				/*
-				 * If we now should probe primary, skip execution on non-primary
-				 * nodes
-				 */
-				if (primary_mode && !combiner->probing_primary &&
-						conn->nodeoid != primary_data_node)
-					continue;
+		for (i = 0; i < combiner->conn_count; i++)
+		{
+			PGXCNodeHandle *conn = combiner->connections[i];
 
-				/*
-				 * Update Command Id. Other command may be executed after we
-				 * prepare and advanced Command Id. We should use one that
-				 * was active at the moment when command started.
-				 */
-				if (pgxc_node_send_cmd_id(conn, cid))
-				{
-					combiner->conn_count = 0;
-					pfree(combiner->connections);
-					ereport(ERROR,
-							(errcode(ERRCODE_INTERNAL_ERROR),
-							 errmsg("Failed to send command ID to data nodes")));
-				}
+			CHECK_OWNERSHIP(conn, combiner);
 
-				/*
-				 * Resend the snapshot as well since the connection may have
-				 * been buffered and use by other commands, with different
-				 * snapshot. Set the snapshot back to what it was
-				 */
-				if (pgxc_node_send_snapshot(conn, estate->es_snapshot))
-				{
-					combiner->conn_count = 0;
-					pfree(combiner->connections);
-					ereport(ERROR,
-							(errcode(ERRCODE_INTERNAL_ERROR),
-							 errmsg("Failed to send snapshot to data nodes")));
-				}
+			/*
+			 * If we now should probe primary, skip execution on non-primary
+			 * nodes
+			 */
+			if (primary_mode && !combiner->probing_primary &&
+					conn->nodeoid != primary_data_node)
+				continue;
 
-				/* bind */
-				pgxc_node_send_bind(conn, cursor, cursor, paramlen, paramdata);
-				/* execute */
-				pgxc_node_send_execute(conn, cursor, fetch);
-				/* submit */
-				if (pgxc_node_send_flush(conn))
-				{
-					combiner->conn_count = 0;
-					pfree(combiner->connections);
-					ereport(ERROR,
-							(errcode(ERRCODE_INTERNAL_ERROR),
-							 errmsg("Failed to send command to data nodes")));
-				}
+			if (pgxc_node_send_prefix(conn, &prefix))
+			{
+				combiner->conn_count = 0;
+				pfree(combiner->connections);
+				ereport(ERROR,
+						(errcode(ERRCODE_INTERNAL_ERROR),
+						 errmsg("Failed to send command ID to data nodes")));
+			}
+			if (pgxc_node_send_snapshot(conn, estate->es_snapshot))
+			{
+				combiner->conn_count = 0;
+				pfree(combiner->connections);
+				ereport(ERROR,
+						(errcode(ERRCODE_INTERNAL_ERROR),
+						 errmsg("Failed to send snapshot to data nodes")));
+			}
 
-				/*
-				 * There could be only one primary node, so if we executed
-				 * subquery on the phase one of primary mode we can leave the
-				 * loop now.
-				 */
-				if (primary_mode && !combiner->probing_primary)
-				{
-					combiner->current_conn = i;
-					break;
-				}
+			/* bind */
+			if (sendfilter)
+				pgxc_node_send_join_filter(conn, cursor, filterdata.data,
+										   filterdata.len);
+			pgxc_node_send_bind(conn, cursor, cursor, paramlen, paramdata,
+								binary);
+			/* execute */
+			pgxc_node_send_execute(conn, cursor, fetch);
+			/* submit */
+			if (pgxc_node_queue_flush(conn))
+			{
+				combiner->conn_count = 0;
+				pfree(combiner->connections);
+				ereport(ERROR,
+						(errcode(ERRCODE_INTERNAL_ERROR),
+						 errmsg("Failed to send command to data nodes")));
 			}
 
 			/*
-			 * On second phase of primary mode connections are backed up
-			 * already, so do not copy.
+			 * There could be only one primary node, so if we executed
+			 * subquery on the phase one of primary mode we can leave the
+			 * loop now.
 			 */
-			if (primary_mode)
+			if (primary_mode && !combiner->probing_primary)
 			{
-				if (combiner->probing_primary)
-				{
-					combiner->cursor = pstrdup(cursor);
-				}
-				else
-				{
-					combiner->cursor_count = combiner->conn_count;
-					combiner->cursor_connections = (PGXCNodeHandle **) palloc(
-								combiner->conn_count * sizeof(PGXCNodeHandle *));
-					memcpy(combiner->cursor_connections, combiner->connections,
-								combiner->conn_count * sizeof(PGXCNodeHandle *));
-				}
+				combiner->current_conn = i;
+				break;
 			}
-			else
+		}
+		pfree(prefix.data);
+
+		/* Send out the requests to all the nodes in parallel */
+		if (!node->insert_deferred &&
+			pgxc_node_flush_all(combiner->conn_count, combiner->connections))
+		{
+			combiner->conn_count = 0;
+			pfree(combiner->connections);
+			ereport(ERROR,
+					(errcode(ERRCODE_INTERNAL_ERROR),
+					 errmsg("Failed to send command to data nodes")));
+		}
+
+		/*
+		 * On second phase of primary mode connections are backed up
+		 * already, so do not copy.
+		 */
+		if (primary_mode)
+		{
+			if (combiner->probing_primary)
 			{
 				combiner->cursor = pstrdup(cursor);
+			}
+			else
+			{
 				combiner->cursor_count = combiner->conn_count;
 				combiner->cursor_connections = (PGXCNodeHandle **) palloc(
 							combiner->conn_count * sizeof(PGXCNodeHandle *));
@@ -5667,35 +7811,89 @@ primary_mode_phase_two:
 							combiner->conn_count * sizeof(PGXCNodeHandle *));
 			}
 		}
-
-		if (combiner->merge_sort)
+		else
 		{
-			/*
-			 * Requests are already made and sorter can fetch tuples to populate
-			 * sort buffer.
-			 */
-			combiner->tuplesortstate = tuplesort_begin_merge(
-									   resultslot->tts_tupleDescriptor,
-									   plan->sort->numCols,
-									   plan->sort->sortColIdx,
-									   plan->sort->sortOperators,
-									   plan->sort->sortCollations,
-									   plan->sort->nullsFirst,
-									   combiner,
-									   work_mem);
+			combiner->cursor = pstrdup(cursor);
+			combiner->cursor_count = combiner->conn_count;
+			combiner->cursor_connections = (PGXCNodeHandle **) palloc(
+						combiner->conn_count * sizeof(PGXCNodeHandle *));
+			memcpy(combiner->cursor_connections, combiner->connections,
+						combiner->conn_count * sizeof(PGXCNodeHandle *));
 		}
-		if (primary_mode)
+	}
+
+	if (sendfilter)
+		pfree(filterdata.data);
+
+	if (combiner->merge_sort)
+	{
+		/*
+		 * Requests are already made and sorter can fetch tuples to populate
+		 * sort buffer.
+		 */
+		combiner->tuplesortstate = tuplesort_begin_merge(
+								   resultslot->tts_tupleDescriptor,
+								   plan->sort->numCols,
+								   plan->sort->sortColIdx,
+								   plan->sort->sortOperators,
+								   plan->sort->sortCollations,
+								   plan->sort->nullsFirst,
+								   combiner,
+								   work_mem);
+	}
+	if (primary_mode)
+	{
+		if (combiner->probing_primary)
 		{
-			if (combiner->probing_primary)
-			{
-				combiner->probing_primary = false;
-				node->bound = true;
-			}
-			else
-				combiner->probing_primary = true;
+			combiner->probing_primary = false;
+			node->bound = true;
 		}
 		else
-			node->bound = true;
+			combiner->probing_primary = true;
+	}
+	else
+		node->bound = true;
+}
+
+
+static TupleTableSlot *
+remote_subplan_fetch(RemoteSubplanState *node)
+{
+	ResponseCombiner *combiner = (ResponseCombiner *) node;
+	EState		   *estate = combiner->ss.ps.state;
+	TupleTableSlot *resultslot = combiner->ss.ps.ps_ResultTupleSlot;
+	struct rusage	start_r;
+	struct timeval		start_t;
+
+	/* 
+	 * We allow combiner->conn_count == 0 after node initialization
+	 * if we figured out that current node won't receive any result
+	 * because of distributionRestrict is set by planner.
+	 * But we should distinguish this case from others, when conn_count is 0.
+	 * That is possible if local execution is chosen or data are buffered 
+	 * at the coordinator or data are exhausted and node was reset.
+	 * in last two cases connections are saved to cursor_connections and we
+	 * can check their presence.  
+	 */
+	if (!node->local_exec && combiner->conn_count == 0 && 
+			combiner->cursor_count == 0)
+		return NULL;
+
+	if (log_remotesubplan_stats)
+		ResetUsageCommon(&start_r, &start_t);
+
+primary_mode_phase_two:
+	if (!node->bound)
+		remote_subplan_bind(node);
+
+	/* Assume all the rows are inserted, a failure aborts the transaction */
+	if (node->insert_deferred)
+	{
+		estate->es_processed += node->insert_rows;
+		node->insert_rows = 0;
+		if (log_remotesubplan_stats)
+			ShowUsageCommon("ExecRemoteSubplan", &start_r, &start_t);
+		return NULL;
 	}
 
 	if (combiner->tuplesortstate)
@@ -5731,11 +7929,121 @@ primary_mode_phase_two:
 }
 
 
+TupleTableSlot *
+ExecRemoteSubplan(RemoteSubplanState *node)
+{
+	TupleTableSlot *slot;
+
+	if (node->resultcache == NULL)
+		return remote_subplan_fetch(node);
+
+	if (ResultCacheHit(node->resultcache))
+		return ResultCacheGetTuple(node->resultcache,
+								   node->combiner.ss.ps.ps_ResultTupleSlot);
+
+	/* Collect the result, and store it once complete */
+	slot = remote_subplan_fetch(node);
+	if (TupIsNull(slot))
+		ResultCacheStore(node->resultcache);
+	else
+		ResultCachePutTuple(node->resultcache, slot);
+	return slot;
+}
+
+
+/*
+ * ExecStartRemoteSubplan
+ *		Send the subplan to the nodes ahead of its first execution, so they
+ * work on it while the caller is busy with other steps. Returns false if the
+ * subplan can not be started now, it is then started as usual when executed.
+ * That is the case for subplans executed locally, modifying data, waiting
+ * for a rescan, or using connections another step is still reading from,
+ * since all the pending results of that step would have to be buffered.
+ */
+bool
+ExecStartRemoteSubplan(RemoteSubplanState *node)
+{
+	ResponseCombiner *combiner = (ResponseCombiner *) node;
+	int			i;
+
+	if (combiner->ss.ps.chgParam != NULL)
+		return false;
+
+	if (node->bound)
+		return true;
+
+	if (node->local_exec || combiner->conn_count == 0 ||
+			combiner->combine_type != COMBINE_TYPE_NONE)
+		return false;
+
+	for (i = 0; i < combiner->conn_count; i++)
+	{
+		PGXCNodeHandle *conn = combiner->connections[i];
+
+		if (conn->state == DN_CONNECTION_STATE_QUERY &&
+				conn->combiner && conn->combiner != combiner)
+			return false;
+	}
+
+	remote_subplan_bind(node);
+	return true;
+}
+
+
+/*
+ * ExecRemoteSubplanReady
+ *		Can ExecRemoteSubplan make progress without waiting for the network?
+ * If not, *waitconn is set to the connection the subplan would wait on,
+ * otherwise to NULL. Subplans not started yet, executed locally or merge
+ * sorting the results are considered ready, they run as usual.
+ */
+bool
+ExecRemoteSubplanReady(RemoteSubplanState *node, PGXCNodeHandle **waitconn)
+{
+	ResponseCombiner *combiner = (ResponseCombiner *) node;
+	PGXCNodeHandle *conn;
+	int			i;
+
+	*waitconn = NULL;
+
+	if (!node->bound || node->local_exec || combiner->merge_sort ||
+			combiner->currentRow ||
+			combiner->current_conn >= combiner->conn_count)
+		return true;
+
+	for (i = 0; i < combiner->rowBufferCount; i++)
+	{
+		if (combiner->rowBufferRows[i] > 0)
+			return true;
+	}
+
+	/*
+	 * Connection used by other step needs to be buffered, and idle connection
+	 * means the portal is suspended, FetchTuple requests more rows then.
+	 */
+	conn = combiner->connections[combiner->current_conn];
+	if (conn->combiner != combiner ||
+			conn->state != DN_CONNECTION_STATE_QUERY ||
+			HAS_MESSAGE_BUFFERED(conn))
+		return true;
+
+	*waitconn = conn;
+	return false;
+}
+
+
 void
 ExecReScanRemoteSubplan(RemoteSubplanState *node)
 {
 	ResponseCombiner *combiner = (ResponseCombiner *)node;
 
+	if (node->resultcache)
+	{
+		ResultCacheRescan(node->resultcache);
+		if (ResultCacheHit(node->resultcache))
+			return;
+	}
+
 	/*
 	 * If we haven't queried remote nodes yet, just return. If outerplan'
 	 * chgParam is not NULL then it will be re-scanned by ExecProcNode,
@@ -5766,6 +8074,19 @@ ExecReScanRemoteSubplan(RemoteSubplanState *node)
 }
 
 
+/*
+ * Set the filter the nodes executing the subplan apply to the rows before
+ * sending them, see joinFilter.c. It is sent when the subplan is bound, so
+ * it should be set before the subplan is executed or rescanned. The caller
+ * keeps the filter valid while it is set.
+ */
+void
+ExecRemoteSubplanSetJoinFilter(RemoteSubplanState *node, JoinFilter *filter)
+{
+	node->joinfilter = filter;
+}
+
+
 void
 ExecEndRemoteSubplan(RemoteSubplanState *node)
 {
@@ -5786,7 +8107,7 @@ ExecEndRemoteSubplan(RemoteSubplanState *node)
 	/*
 	 * Consume any possible pending input
 	 */
-	if (node->bound)
+	if (node->bound && !node->insert_deferred)
 		pgxc_connections_cleanup(combiner);
 
 	/*
@@ -5891,10 +8212,28 @@ ExecEndRemoteSubplan(RemoteSubplanState *node)
 
 		CHECK_OWNERSHIP(conn, combiner);
 
-		if (pgxc_node_send_close(conn, true, cursor) != 0)
+		/* Persistent statements are kept for the next execution */
+		if (!node->persistent &&
+				pgxc_node_send_close(conn, true, cursor) != 0)
 			ereport(ERROR,
 					(errcode(ERRCODE_INTERNAL_ERROR),
 					 errmsg("Failed to close data node statement")));
+		/*
+		 * Results of the deferred INSERT are skipped when the responses to
+		 * the next command are received, so just queue SYNC and release the
+		 * connection.
+		 */
+		if (node->insert_deferred)
+		{
+			if (pgxc_node_queue_sync(conn) != 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_INTERNAL_ERROR),
+						 errmsg("Failed to synchronize data node")));
+			conn->deferred_pending++;
+			conn->state = DN_CONNECTION_STATE_IDLE;
+			conn->combiner = NULL;
+			continue;
+		}
 		/* Send SYNC and wait for ReadyForQuery */
 		if (pgxc_node_send_sync(conn) != 0)
 			ereport(ERROR,
@@ -5909,6 +8248,18 @@ ExecEndRemoteSubplan(RemoteSubplanState *node)
 		conn->state = DN_CONNECTION_STATE_CLOSE;
 	}
 
+	/* Receive the results once enough INSERTs are sent to a node */
+	if (node->insert_deferred)
+	{
+		for (i = 0; i < combiner->conn_count; i++)
+			if (combiner->connections[i]->deferred_pending >= InsertBatchSize)
+				break;
+		if (i < combiner->conn_count)
+			pgxc_node_finish_deferred(combiner->conn_count,
+									 combiner->connections);
+		combiner->conn_count = 0;
+	}
+
 	while (combiner->conn_count > 0)
 	{
 		if (pgxc_node_receive(combiner->conn_count,
@@ -5949,6 +8300,9 @@ ExecEndRemoteSubplan(RemoteSubplanState *node)
 		}
 	}
 
+	if (IS_PGXC_LOCAL_COORDINATOR)
+		ReleaseStatement(combiner->ss.ps.state);
+
 	ValidateAndCloseCombiner(combiner);
 	pfree(node);
 
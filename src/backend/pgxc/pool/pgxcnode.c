@@ -23,6 +23,9 @@
 
 #include "postgres.h"
 #include <poll.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 
 #include <sys/time.h>
 #include <sys/types.h>
@@ -32,11 +35,16 @@
 #include <unistd.h>
 #include <errno.h>
 #include "access/gtm.h"
+#include "access/hash.h"
+#include "access/htup_details.h"
 #include "access/transam.h"
 #include "access/xact.h"
 #include "catalog/pg_type.h"
 #include "commands/prepare.h"
+#include "common/pg_lzcompress.h"
+#include "funcapi.h"
 #include "gtm/gtm_c.h"
+#include "libpq/libpq.h"
 #include "nodes/nodes.h"
 #include "pgxc/pgxcnode.h"
 #include "pgxc/execRemote.h"
@@ -46,6 +54,7 @@
 #include "pgxc/nodemgr.h"
 #include "pgxc/pgxc.h"
 #include "pgxc/poolmgr.h"
+#include "pgstat.h"
 #include "tcop/dest.h"
 #include "utils/builtins.h"
 #include "utils/elog.h"
@@ -59,11 +68,17 @@
 #ifdef XCP
 #include "miscadmin.h"
 #include "storage/ipc.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
 #include "pgxc/pause.h"
+#include "storage/procarray.h"
+#include "utils/array.h"
 #include "utils/snapmgr.h"
 #endif
 
 #define CMD_ID_MSG_LEN 8
+/* Initial size of the handle buffers, they shrink back when released */
+#define PGXC_NODE_BUFFER_SIZE (16 * 1024)
 
 /* Number of connections held */
 static int	datanode_count = 0;
@@ -87,10 +102,81 @@ static PGXCNodeHandle *co_handles = NULL;
 int			NumDataNodes;
 int 		NumCoords;
 
+/*
+ * Handles of the Datanode standbys follow the Datanode handles in
+ * dn_handles, standby_of has the index of the Datanode of each of them.
+ */
+int			NumStandbyNodes;
+static int *standby_of = NULL;
+
 
 #ifdef XCP
 volatile bool HandlesInvalidatePending = false;
 
+/*
+ * Batches of messages sent to other nodes larger than this are compressed,
+ * negative value disables compression. The value is passed to the remote
+ * sessions the pooler establishes, so they compress the results they send.
+ */
+int			RemoteCompressionThreshold = -1;
+
+/*
+ * When the session gets connections from the pooler, it asks in addition for
+ * the connections to the Datanodes it has used in recent transactions, so a
+ * query touching more nodes later in the transaction does not need another
+ * round trip to the pooler.
+ */
+bool		PrefetchRemoteConnections = true;
+
+/*
+ * Datanodes used by the recent transactions of the session. Bit 0 of the
+ * element of a Datanode is set if the current transaction has requested it,
+ * the higher bits keep the same for the previous ones. A Datanode is
+ * prefetched if it was used by PGXC_NODE_PREFETCH_MIN of the transactions
+ * selected by PGXC_NODE_PREFETCH_MASK.
+ */
+static uint8 *dn_usage = NULL;
+#define PGXC_NODE_PREFETCH_MASK 0x1E
+#define PGXC_NODE_PREFETCH_MIN 2
+
+/* Work area for compression of the outgoing data */
+static char *compress_buffer = NULL;
+static int	compress_buffer_size = 0;
+
+/*
+ * Network activity counters of all the sessions of the server by remote
+ * node, the sessions add their counters at the end of each transaction.
+ * An entry is assigned to a node under the mutex of the array, then it is
+ * updated under the mutex of the entry.
+ */
+typedef struct
+{
+	Oid			nodeoid;		/* InvalidOid if the entry is free */
+	slock_t		mutex;
+	PGXCNodeStats stats;
+	/* Last lag reported by a standby, see PGXCNodeStandbyReport */
+	int			standby_lag;
+	TimestampTz standby_lag_time;
+} PGXCNodeStatsEntry;
+
+typedef struct
+{
+	slock_t		mutex;
+	int			nentries;
+	PGXCNodeStatsEntry entries[FLEXIBLE_ARRAY_MEMBER];
+} PGXCNodeStatsArray;
+
+static PGXCNodeStatsArray *NodeStats = NULL;
+
+/* Lag reported by a standby is trusted for that long, in milliseconds */
+#define STANDBY_LAG_VALIDITY 1000
+
+/* Upper bounds of the latency buckets, in microseconds */
+static const int64 latency_bounds[PGXC_NODE_LATENCY_BUCKETS - 1] =
+{
+	100, 300, 1000, 3000, 10000, 30000, 100000, 300000, 1000000
+};
+
 /*
  * Session and transaction parameters need to to be set on newly connected
  * remote nodes.
@@ -111,14 +197,25 @@ static bool DoInvalidateRemoteHandles(void);
 #endif
 
 #ifdef XCP
-static void pgxc_node_init(PGXCNodeHandle *handle, int sock, bool global_session);
+static void pgxc_node_init(PGXCNodeHandle *handle, int sock, bool global_session,
+			   uint32 param_hash);
 #else
 static void pgxc_node_init(PGXCNodeHandle *handle, int sock);
 #endif
 static void pgxc_node_free(PGXCNodeHandle *handle);
+static void pgxc_node_shrink_buffers(PGXCNodeHandle *handle);
 static void pgxc_node_all_free(void);
+static void pgxc_node_unwatch(PGXCNodeHandle *handle);
+static void pgxc_node_discard_output(PGXCNodeHandle *handle);
+static void pgxc_node_pack_output(PGXCNodeHandle *handle);
+static void pgxc_node_add_latency(PGXCNodeHandle *handle);
+static void pgxc_node_add_wait_time(int conn_count,
+						PGXCNodeHandle **connections, instr_time start);
+static Oid pgxc_node_awaited(int conn_count, PGXCNodeHandle **connections);
+static bool pgxc_node_inflate_message(PGXCNodeHandle *conn, int len);
 
 static int	get_int(PGXCNodeHandle * conn, size_t len, int *out);
+static List *get_prefetch_list(List *allocate);
 static int	get_char(PGXCNodeHandle * conn, char *out);
 
 
@@ -133,12 +230,15 @@ init_pgxc_handle(PGXCNodeHandle *pgxc_handle)
 	 * Indicate the handle is not initialized yet
 	 */
 	pgxc_handle->sock = NO_SOCKET;
+	pgxc_handle->epoll_sock = NO_SOCKET;
+	pgxc_handle->readable = false;
+	pgxc_handle->standby = false;
 
 	/* Initialise buffers */
 	pgxc_handle->error = NULL;
-	pgxc_handle->outSize = 16 * 1024;
+	pgxc_handle->outSize = PGXC_NODE_BUFFER_SIZE;
 	pgxc_handle->outBuffer = (char *) palloc(pgxc_handle->outSize);
-	pgxc_handle->inSize = 16 * 1024;
+	pgxc_handle->inSize = PGXC_NODE_BUFFER_SIZE;
 
 	pgxc_handle->inBuffer = (char *) palloc(pgxc_handle->inSize);
 	pgxc_handle->combiner = NULL;
@@ -146,6 +246,19 @@ init_pgxc_handle(PGXCNodeHandle *pgxc_handle)
 	pgxc_handle->inEnd = 0;
 	pgxc_handle->inCursor = 0;
 	pgxc_handle->outEnd = 0;
+	pgxc_handle->outPacked = 0;
+	pgxc_handle->prepared_subplans = NIL;
+	pgxc_handle->deallocate_subplans = false;
+	pgxc_handle->last_xip = NULL;
+	pgxc_handle->last_xcnt = -1;
+	pgxc_handle->last_xip_size = 0;
+	pgxc_handle->param_hash = 0;
+	pgxc_handle->begin_pending = false;
+	pgxc_handle->deferred_pending = 0;
+	pgxc_handle->deferred_error = NULL;
+	memset(&pgxc_handle->stats, 0, sizeof(PGXCNodeStats));
+	memset(&pgxc_handle->stats_reported, 0, sizeof(PGXCNodeStats));
+	INSTR_TIME_SET_ZERO(pgxc_handle->request_sent);
 
 	if (pgxc_handle->outBuffer == NULL || pgxc_handle->inBuffer == NULL)
 	{
@@ -164,14 +277,18 @@ InitMultinodeExecutor(bool is_force)
 {
 	int				count;
 	Oid				*coOids, *dnOids;
+	Oid				*sbOids, *primaryOids;
 #ifdef XCP
 	MemoryContext	oldcontext;
 #endif
 
 
-	/* Free all the existing information first */
+	/* Free all the existing information first, keep the counters */
 	if (is_force)
+	{
+		PGXCNodeReportStats();
 		pgxc_node_all_free();
+	}
 
 	/* This function could get called multiple times because of sigjmp */
 	if (dn_handles != NULL &&
@@ -183,6 +300,7 @@ InitMultinodeExecutor(bool is_force)
 
 	/* Get classified list of node Oids */
 	PgxcNodeGetOids(&coOids, &dnOids, &NumCoords, &NumDataNodes, true);
+	PgxcNodeGetStandbyOids(&sbOids, &primaryOids, &NumStandbyNodes);
 
 #ifdef XCP
 	/*
@@ -194,8 +312,13 @@ InitMultinodeExecutor(bool is_force)
 
 	/* Do proper initialization of handles */
 	if (NumDataNodes > 0)
+	{
 		dn_handles = (PGXCNodeHandle *)
-			palloc(NumDataNodes * sizeof(PGXCNodeHandle));
+			palloc((NumDataNodes + NumStandbyNodes) * sizeof(PGXCNodeHandle));
+		dn_usage = (uint8 *)
+			palloc0((NumDataNodes + NumStandbyNodes) * sizeof(uint8));
+		standby_of = (int *) palloc((NumStandbyNodes + 1) * sizeof(int));
+	}
 	if (NumCoords > 0)
 		co_handles = (PGXCNodeHandle *)
 			palloc(NumCoords * sizeof(PGXCNodeHandle));
@@ -212,6 +335,19 @@ InitMultinodeExecutor(bool is_force)
 		init_pgxc_handle(&dn_handles[count]);
 		dn_handles[count].nodeoid = dnOids[count];
 	}
+	for (count = 0; count < NumStandbyNodes && dn_handles; count++)
+	{
+		PGXCNodeHandle *handle = &dn_handles[NumDataNodes + count];
+		int			i;
+
+		init_pgxc_handle(handle);
+		handle->nodeoid = sbOids[count];
+		handle->standby = true;
+		standby_of[count] = -1;
+		for (i = 0; i < NumDataNodes; i++)
+			if (dnOids[i] == primaryOids[count])
+				standby_of[count] = i;
+	}
 	for (count = 0; count < NumCoords; count++)
 	{
 		init_pgxc_handle(&co_handles[count]);
@@ -260,9 +396,9 @@ PGXCNodeConnStr(char *host, int port, char *dbname,
 	 * remote type can be Coordinator, Datanode or application.
 	 */
 	num = snprintf(connstr, sizeof(connstr),
-				   "host=%s port=%d dbname=%s user=%s application_name=pgxc sslmode=disable options='-c remotetype=%s -c parentnode=%s %s'",
+				   "host=%s port=%d dbname=%s user=%s application_name=pgxc sslmode=disable options='-c remotetype=%s -c parentnode=%s -c remote_compression_threshold=%d %s'",
 				   host, port, dbname, user, remote_type, parent_node,
-				   pgoptions);
+				   RemoteCompressionThreshold, pgoptions);
 
 	/* Check for overflow */
 	if (num > 0 && num < sizeof(connstr))
@@ -292,6 +428,85 @@ PGXCNodeConnect(char *connstr)
 }
 
 
+/*
+ * Establish connections using the specified connection strings at the same
+ * time, so it takes as long as connecting to the slowest node rather than
+ * to all of them in turn. Check the connections with PGXCNodeConnected().
+ */
+void
+PGXCNodeConnectAll(int count, char **connstrs, NODE_CONNECTION **conns)
+{
+	PostgresPollingStatusType *status;
+	struct pollfd *fds;
+	int		   *fdconn;
+	int			pending = 0;
+	int			i;
+
+	status = (PostgresPollingStatusType *)
+		palloc(count * sizeof(PostgresPollingStatusType));
+	fds = (struct pollfd *) palloc(count * sizeof(struct pollfd));
+	fdconn = (int *) palloc(count * sizeof(int));
+
+	for (i = 0; i < count; i++)
+	{
+		PGconn	   *conn = PQconnectStart(connstrs[i]);
+
+		conns[i] = (NODE_CONNECTION *) conn;
+		/* Start as if PQconnectPoll() asked to wait for writing */
+		if (conn == NULL || PQstatus(conn) == CONNECTION_BAD)
+			status[i] = PGRES_POLLING_FAILED;
+		else
+		{
+			status[i] = PGRES_POLLING_WRITING;
+			pending++;
+		}
+	}
+
+	while (pending > 0)
+	{
+		int			nfds = 0;
+
+		for (i = 0; i < count; i++)
+		{
+			if (status[i] == PGRES_POLLING_READING ||
+					status[i] == PGRES_POLLING_WRITING)
+			{
+				fds[nfds].fd = PQsocket((PGconn *) conns[i]);
+				fds[nfds].events = status[i] == PGRES_POLLING_READING ?
+						POLLIN : POLLOUT;
+				fds[nfds].revents = 0;
+				fdconn[nfds++] = i;
+			}
+		}
+
+		if (poll(fds, nfds, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			/* Connections not completed are reported as failed */
+			elog(LOG, "poll() failed while connecting to nodes: %m");
+			break;
+		}
+
+		for (i = 0; i < nfds; i++)
+		{
+			int			n = fdconn[i];
+
+			if (fds[i].revents == 0)
+				continue;
+			status[n] = PQconnectPoll((PGconn *) conns[n]);
+			if (status[n] == PGRES_POLLING_OK ||
+					status[n] == PGRES_POLLING_FAILED)
+				pending--;
+		}
+	}
+
+	pfree(status);
+	pfree(fds);
+	pfree(fdconn);
+}
+
+
 /*
  * Close specified connection
  */
@@ -329,8 +544,49 @@ PGXCNodeConnected(NODE_CONNECTION *conn)
 static void
 pgxc_node_free(PGXCNodeHandle *handle)
 {
+	pgxc_node_unwatch(handle);
 	close(handle->sock);
 	handle->sock = NO_SOCKET;
+	/* Statements prepared on the node are gone along with the session */
+	list_free_deep(handle->prepared_subplans);
+	handle->prepared_subplans = NIL;
+	if (handle->last_xip)
+		pfree(handle->last_xip);
+	handle->last_xip = NULL;
+	handle->last_xcnt = -1;
+	handle->last_xip_size = 0;
+	handle->param_hash = 0;
+	handle->begin_pending = false;
+	handle->deferred_pending = 0;
+	if (handle->deferred_error)
+	{
+		pfree(handle->deferred_error);
+		handle->deferred_error = NULL;
+	}
+	pgxc_node_shrink_buffers(handle);
+}
+
+/*
+ * Buffers of the handle grow to hold the largest message sent or received
+ * over the connection. When the connection is released they are empty, so
+ * return the memory taken by big messages instead of keeping it for the
+ * life of the backend in every handle.
+ */
+static void
+pgxc_node_shrink_buffers(PGXCNodeHandle *handle)
+{
+	if (handle->inSize > PGXC_NODE_BUFFER_SIZE)
+	{
+		pfree(handle->inBuffer);
+		handle->inSize = PGXC_NODE_BUFFER_SIZE;
+		handle->inBuffer = (char *) palloc(handle->inSize);
+	}
+	if (handle->outSize > PGXC_NODE_BUFFER_SIZE)
+	{
+		pfree(handle->outBuffer);
+		handle->outSize = PGXC_NODE_BUFFER_SIZE;
+		handle->outBuffer = (char *) palloc(handle->outSize);
+	}
 }
 
 /*
@@ -353,7 +609,7 @@ pgxc_node_all_free(void)
 				array_handles = co_handles;
 				break;
 			case 1:
-				num_nodes = NumDataNodes;
+				num_nodes = dn_handles ? NumDataNodes + NumStandbyNodes : 0;
 				array_handles = dn_handles;
 				break;
 			default:
@@ -371,19 +627,29 @@ pgxc_node_all_free(void)
 
 	co_handles = NULL;
 	dn_handles = NULL;
+	if (dn_usage)
+		pfree(dn_usage);
+	dn_usage = NULL;
+	if (standby_of)
+		pfree(standby_of);
+	standby_of = NULL;
 	HandlesInvalidatePending = false;
 }
 
 /*
  * Create and initialise internal structure to communicate to
  * Datanode via supplied socket descriptor.
- * Structure stores state info and I/O buffers
+ * Structure stores state info and I/O buffers.
+ * The param_hash is the hash of session parameters set on the pooled
+ * connection by its previous user, zero if it has default parameters.
  */
 static void
-pgxc_node_init(PGXCNodeHandle *handle, int sock, bool global_session)
+pgxc_node_init(PGXCNodeHandle *handle, int sock, bool global_session,
+			   uint32 param_hash)
 {
 	char *init_str;
 
+	pgxc_node_unwatch(handle);
 	handle->sock = sock;
 	handle->transaction_status = 'I';
 	handle->state = DN_CONNECTION_STATE_IDLE;
@@ -395,23 +661,219 @@ pgxc_node_init(PGXCNodeHandle *handle, int sock, bool global_session)
 #endif
 	handle->error = NULL;
 	handle->outEnd = 0;
+	handle->outPacked = 0;
+	INSTR_TIME_SET_ZERO(handle->request_sent);
 	handle->inStart = 0;
 	handle->inEnd = 0;
 	handle->inCursor = 0;
+	handle->deallocate_subplans = false;
+	handle->param_hash = 0;
+	handle->begin_pending = false;
+	handle->deferred_pending = 0;
+	handle->deferred_error = NULL;
+	/* The new session has not received any snapshot */
+	handle->last_xcnt = -1;
 	/*
 	 * We got a new connection, set on the remote node the session parameters
-	 * if defined. The transaction parameter should be sent after BEGIN
+	 * if defined. The transaction parameter should be sent after BEGIN.
+	 * If the connection already has the same parameters nothing is needed,
+	 * if it has parameters of another session reset them first.
 	 */
 	if (global_session)
 	{
+		uint32		my_hash = PGXCNodeGetSessionParamHash();
+
 		init_str = PGXCNodeGetSessionParamStr();
-		if (init_str)
+		if (param_hash != 0 && param_hash == my_hash)
+			handle->param_hash = my_hash;
+		else if (param_hash != 0)
+		{
+			StringInfoData cmd;
+
+			initStringInfo(&cmd);
+			appendStringInfoString(&cmd, PGXC_NODE_RESET_SESSION_CMD);
+			if (init_str)
+				appendStringInfoString(&cmd, init_str);
+			pgxc_node_set_query(handle, cmd.data);
+			pfree(cmd.data);
+			handle->param_hash = my_hash;
+		}
+		else if (init_str)
 		{
 			pgxc_node_set_query(handle, init_str);
+			handle->param_hash = my_hash;
+		}
+	}
+	else if (param_hash != 0)
+		pgxc_node_set_query(handle, PGXC_NODE_RESET_SESSION_CMD);
+}
+
+
+#ifdef HAVE_SYS_EPOLL_H
+/*
+ * Sockets of the node connections pgxc_node_receive waits on are registered
+ * in the epoll set of the backend once, and stay there while the socket
+ * belongs to the handle, so waiting does not cost O(number of connections)
+ * in the kernel. Sockets are registered edge-triggered: handle->readable
+ * remembers there was an event for the connection, even if that happened
+ * while waiting on other connections, and is cleared when read attempt finds
+ * no data. Level-triggered events would not let us block while other
+ * registered connections have unread data.
+ */
+static int	epoll_fd = -1;
+static struct epoll_event *epoll_events = NULL;
+static int	epoll_events_size = 0;
+#endif
+
+/*
+ * Remove the socket of the handle from the epoll set. That must be done
+ * before the socket is closed or handed off, the pooler keeps its own
+ * descriptor of the same socket, and closing ours would not remove it.
+ */
+static void
+pgxc_node_unwatch(PGXCNodeHandle *handle)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	if (handle->epoll_sock != NO_SOCKET && epoll_fd >= 0)
+		(void) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, handle->epoll_sock, NULL);
+#endif
+	handle->epoll_sock = NO_SOCKET;
+	handle->readable = false;
+}
+
+/*
+ * Abandon the data pending in the output buffer of the handle. The node may
+ * have missed the snapshot, so do not send it a snapshot difference anymore.
+ */
+static void
+pgxc_node_discard_output(PGXCNodeHandle *handle)
+{
+	handle->outEnd = 0;
+	handle->outPacked = 0;
+	handle->last_xcnt = -1;
+}
+
+/*
+ * Compress the messages appended to the output buffer since it was packed
+ * last time into a single message, if they are larger than
+ * RemoteCompressionThreshold and compress well. The remote node unpacks
+ * them, see pq_inflatemessage.
+ */
+static void
+pgxc_node_pack_output(PGXCNodeHandle *handle)
+{
+	int32		rawlen = handle->outEnd - handle->outPacked;
+	size_t		pos;
+
+	/* Count the messages, only whole messages are there */
+	for (pos = handle->outPacked; pos + 5 <= handle->outEnd;)
+	{
+		uint32		n32;
+
+		memcpy(&n32, handle->outBuffer + pos + 1, 4);
+		pos += 1 + ntohl(n32);
+		handle->stats.messages_sent++;
+	}
+
+	if (RemoteCompressionThreshold >= 0 &&
+		rawlen > RemoteCompressionThreshold &&
+		rawlen > PQ_PACKED_HDR_SIZE)
+	{
+		char	   *start = handle->outBuffer + handle->outPacked;
+		int32		clen;
+
+		if (compress_buffer_size < PGLZ_MAX_OUTPUT(rawlen))
+		{
+			if (compress_buffer)
+				pfree(compress_buffer);
+			compress_buffer_size = PGLZ_MAX_OUTPUT(rawlen);
+			compress_buffer = MemoryContextAlloc(TopMemoryContext,
+												 compress_buffer_size);
 		}
+
+		clen = pglz_compress(start, rawlen, compress_buffer,
+							 PGLZ_strategy_default);
+		if (clen >= 0 && clen + PQ_PACKED_HDR_SIZE < rawlen)
+		{
+			uint32		n32;
+
+			start[0] = PQ_PACKED_MSG_TYPE;
+			n32 = htonl((uint32) (clen + 8));
+			memcpy(start + 1, &n32, 4);
+			n32 = htonl((uint32) rawlen);
+			memcpy(start + 5, &n32, 4);
+			memcpy(start + PQ_PACKED_HDR_SIZE, compress_buffer, clen);
+			handle->outEnd = handle->outPacked + PQ_PACKED_HDR_SIZE + clen;
+		}
+	}
+	handle->outPacked = handle->outEnd;
+}
+
+/*
+ * Response from the node is received, count the round trip if a request
+ * was waiting for it
+ */
+static void
+pgxc_node_add_latency(PGXCNodeHandle *handle)
+{
+	instr_time	now;
+	int64		latency;
+	int			i;
+
+	INSTR_TIME_SET_CURRENT(now);
+	INSTR_TIME_SUBTRACT(now, handle->request_sent);
+	latency = INSTR_TIME_GET_MICROSEC(now);
+	for (i = 0; i < PGXC_NODE_LATENCY_BUCKETS - 1; i++)
+		if (latency < latency_bounds[i])
+			break;
+	handle->stats.latency[i]++;
+	INSTR_TIME_SET_ZERO(handle->request_sent);
+}
+
+/*
+ * Add the time waited since start to the connections which had to provide
+ * data, see pgxc_node_receive
+ */
+static void
+pgxc_node_add_wait_time(int conn_count, PGXCNodeHandle **connections,
+						instr_time start)
+{
+	instr_time	wait_time;
+	int64		usec;
+	int			i;
+
+	INSTR_TIME_SET_CURRENT(wait_time);
+	INSTR_TIME_SUBTRACT(wait_time, start);
+	usec = INSTR_TIME_GET_MICROSEC(wait_time);
+	for (i = 0; i < conn_count; i++)
+	{
+		PGXCNodeHandle *conn = connections[i];
+
+		if (conn->state != DN_CONNECTION_STATE_IDLE &&
+			!HAS_MESSAGE_BUFFERED(conn))
+			conn->stats.wait_time += usec;
 	}
 }
 
+/*
+ * The first of the connections which have to provide data, the node reported
+ * as waited on
+ */
+static Oid
+pgxc_node_awaited(int conn_count, PGXCNodeHandle **connections)
+{
+	int			i;
+
+	for (i = 0; i < conn_count; i++)
+	{
+		PGXCNodeHandle *conn = connections[i];
+
+		if (conn->state != DN_CONNECTION_STATE_IDLE &&
+			!HAS_MESSAGE_BUFFERED(conn))
+			return conn->nodeoid;
+	}
+	return InvalidOid;
+}
 
 /*
  * Wait while at least one of specified connections has data available and read
@@ -420,6 +882,186 @@ pgxc_node_init(PGXCNodeHandle *handle, int sock, bool global_session)
 bool
 pgxc_node_receive(const int conn_count,
 				  PGXCNodeHandle ** connections, struct timeval * timeout)
+#ifdef HAVE_SYS_EPOLL_H
+{
+#define ERROR_OCCURED		true
+#define NO_ERROR_OCCURED	false
+	int		i,
+			sockets_to_poll,
+			poll_val;
+	bool	is_msg_buffered;
+	bool	have_readable;
+	int 	timeout_ms;
+	instr_time wait_start;
+
+	if (epoll_fd < 0)
+	{
+		epoll_fd = epoll_create(64);
+		if (epoll_fd < 0)
+			ereport(ERROR,
+					(errcode_for_socket_access(),
+					 errmsg("could not create epoll set: %m")));
+	}
+
+	if (conn_count > epoll_events_size)
+	{
+		epoll_events_size = Max(conn_count, 16);
+		if (epoll_events)
+			pfree(epoll_events);
+		epoll_events = (struct epoll_event *)
+			MemoryContextAlloc(TopMemoryContext,
+							   epoll_events_size * sizeof(struct epoll_event));
+	}
+
+	/* sockets to be polled count */
+	sockets_to_poll = 0;
+	have_readable = false;
+
+	is_msg_buffered = false;
+	for (i = 0; i < conn_count; i++)
+	{
+		PGXCNodeHandle *conn = connections[i];
+
+		/* If connection has a buffered message */
+		if (HAS_MESSAGE_BUFFERED(conn))
+		{
+			is_msg_buffered = true;
+			continue;
+		}
+
+		/* If connection finished sending do not wait input from it */
+		if (conn->state == DN_CONNECTION_STATE_IDLE)
+			continue;
+
+		if (conn->sock > 0)
+		{
+			/* Register the socket if not yet */
+			if (conn->epoll_sock != conn->sock)
+			{
+				struct epoll_event ev;
+
+				pgxc_node_unwatch(conn);
+				ev.events = EPOLLIN | EPOLLPRI | EPOLLRDHUP | EPOLLET;
+				ev.data.ptr = conn;
+				if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->sock, &ev) < 0)
+				{
+					elog(WARNING, "epoll_ctl() error: %d", errno);
+					return ERROR_OCCURED;
+				}
+				conn->epoll_sock = conn->sock;
+				/* there may be data already, we missed the edge */
+				conn->readable = true;
+			}
+			if (conn->readable)
+				have_readable = true;
+			sockets_to_poll++;
+		}
+		else
+		{
+			/* flag as bad, it will be removed from the list */
+			conn->state = DN_CONNECTION_STATE_ERROR_FATAL;
+		}
+	}
+
+	/*
+	 * Return if we do not have connections to receive input
+	 */
+	if (sockets_to_poll == 0)
+	{
+		if (is_msg_buffered)
+			return NO_ERROR_OCCURED;
+		return ERROR_OCCURED;
+	}
+
+	/* do conversion from the select behaviour */
+	if ( timeout == NULL )
+		timeout_ms = -1;
+	else
+		timeout_ms = (timeout->tv_sec * (uint64_t) 1000) + (timeout->tv_usec / 1000);
+
+retry:
+	CHECK_FOR_INTERRUPTS();
+	/*
+	 * No need to wait if some connection may have data, collect events
+	 * only if there is nothing to read.
+	 */
+	if (!have_readable)
+	{
+		INSTR_TIME_SET_CURRENT(wait_start);
+		pgstat_report_wait_start(WAIT_EVENT_REMOTE_RESPONSE,
+								 pgxc_node_awaited(conn_count, connections));
+		poll_val = epoll_wait(epoll_fd, epoll_events, epoll_events_size,
+							  timeout_ms);
+		pgstat_report_wait_end(WAIT_EVENT_REMOTE_RESPONSE);
+		pgxc_node_add_wait_time(conn_count, connections, wait_start);
+		if (poll_val < 0)
+		{
+			/* error - retry if EINTR */
+			if (errno == EINTR  || errno == EAGAIN)
+				goto retry;
+
+			elog(WARNING, "epoll_wait() error: %d", errno);
+			if (errno)
+				return ERROR_OCCURED;
+			return NO_ERROR_OCCURED;
+		}
+
+		if (poll_val == 0)
+		{
+			/* Handle timeout */
+			elog(DEBUG1, "timeout %d while waiting for any response from %d connections", timeout_ms,conn_count);
+			for (i = 0; i < conn_count; i++)
+				connections[i]->state = DN_CONNECTION_STATE_ERROR_FATAL;
+			return NO_ERROR_OCCURED;
+		}
+
+		/*
+		 * Remember the events, including these on connections we are not
+		 * waiting on now. Errors and hang ups are discovered by the read.
+		 */
+		for (i = 0; i < poll_val; i++)
+			((PGXCNodeHandle *) epoll_events[i].data.ptr)->readable = true;
+	}
+
+	/* read data */
+	have_readable = false;
+	for (i = 0; i < conn_count; i++)
+	{
+		PGXCNodeHandle *conn = connections[i];
+		int		read_status;
+
+		if (!conn->readable || conn->epoll_sock != conn->sock ||
+				conn->state == DN_CONNECTION_STATE_IDLE ||
+				HAS_MESSAGE_BUFFERED(conn))
+			continue;
+
+		read_status = pgxc_node_read_data(conn, true);
+		if ( read_status == EOF || read_status < 0 )
+		{
+			/* Can not read - no more actions, just discard connection */
+			conn->state = DN_CONNECTION_STATE_ERROR_FATAL;
+			add_error_message(conn, "unexpected EOF on datanode connection.");
+			elog(WARNING, "unexpected EOF on datanode oid connection: %d", conn->nodeoid);
+			/* Should we read from the other connections before returning? */
+			return ERROR_OCCURED;
+		}
+		if (read_status == 0)
+			/* no data, wait for the next event */
+			conn->readable = false;
+		else
+			have_readable = true;
+	}
+
+	/*
+	 * If the connections claimed readable did not have data keep waiting,
+	 * the caller expects something can be read when we return
+	 */
+	if (!have_readable && !is_msg_buffered)
+		goto retry;
+
+	return NO_ERROR_OCCURED;
+}
+#else
 {
 #define ERROR_OCCURED		true
 #define NO_ERROR_OCCURED	false
@@ -429,6 +1071,7 @@ pgxc_node_receive(const int conn_count,
 	bool	is_msg_buffered;
 	long 	timeout_ms;
 	struct	pollfd pool_fd[conn_count];
+	instr_time wait_start;
 
 	/* sockets to be polled index */
 	sockets_to_poll = 0;
@@ -488,7 +1131,12 @@ pgxc_node_receive(const int conn_count,
 
 retry:
 	CHECK_FOR_INTERRUPTS();
+	INSTR_TIME_SET_CURRENT(wait_start);
+	pgstat_report_wait_start(WAIT_EVENT_REMOTE_RESPONSE,
+							 pgxc_node_awaited(conn_count, connections));
 	poll_val  = poll(pool_fd, conn_count, timeout_ms);
+	pgstat_report_wait_end(WAIT_EVENT_REMOTE_RESPONSE);
+	pgxc_node_add_wait_time(conn_count, connections, wait_start);
 	if (poll_val < 0)
 	{
 		/* error - retry if EINTR */
@@ -550,6 +1198,7 @@ retry:
 	}
 	return NO_ERROR_OCCURED;
 }
+#endif
 
 /*
  * Is there any data enqueued in the TCP input buffer waiting
@@ -572,10 +1221,44 @@ pgxc_node_is_data_enqueued(PGXCNodeHandle *conn)
 }
 
 /*
- * Read up incoming messages from the PGXC node connection
+ * Read in data which are already available on the connections without
+ * waiting, while the caller is busy with the data it has. That allows nodes
+ * sending results to proceed instead of being blocked when kernel socket
+ * buffers are full. Connections having at least maxbuffered bytes unread in
+ * the input buffer are skipped, to keep the memory use bounded.
+ * Returns the number of connections data were read from.
  */
 int
-pgxc_node_read_data(PGXCNodeHandle *conn, bool close_if_error)
+pgxc_node_prefetch(int conn_count, PGXCNodeHandle **connections,
+				   size_t maxbuffered)
+{
+	int			i;
+	int			result = 0;
+
+	for (i = 0; i < conn_count; i++)
+	{
+		PGXCNodeHandle *conn = connections[i];
+
+		/* Merge sort leaves finished tapes in the array as NULLs */
+		if (conn == NULL || conn->state != DN_CONNECTION_STATE_QUERY)
+			continue;
+		if (conn->inEnd - conn->inStart >= maxbuffered)
+			continue;
+		if (pgxc_node_is_data_enqueued(conn) <= 0)
+			continue;
+		/* Errors are reported when the connection is read normally */
+		if (pgxc_node_read_data(conn, true) > 0)
+			result++;
+	}
+	return result;
+}
+
+
+/*
+ * Read up incoming messages from the PGXC node connection
+ */
+int
+pgxc_node_read_data(PGXCNodeHandle *conn, bool close_if_error)
 {
 	int			someread = 0;
 	int			nread;
@@ -662,6 +1345,7 @@ retry:
 								"\tbefore or while processing the request.\n");
 				conn->state = DN_CONNECTION_STATE_ERROR_FATAL;	/* No more connection to
 															* backend */
+				pgxc_node_unwatch(conn);
 				closesocket(conn->sock);
 				conn->sock = NO_SOCKET;
 			}
@@ -677,6 +1361,9 @@ retry:
 	if (nread > 0)
 	{
 		conn->inEnd += nread;
+		conn->stats.bytes_received += nread;
+		if (!INSTR_TIME_IS_ZERO(conn->request_sent))
+			pgxc_node_add_latency(conn);
 
 		/*
 		 * Hack to deal with the fact that some kernels will only give us back
@@ -805,13 +1492,260 @@ get_message(PGXCNodeHandle *conn, int *len, char **msg)
 		return '\0';
 	}
 
+	/*
+	 * Replace the compressed messages with the raw ones and go on with the
+	 * first of them
+	 */
+	if (msgtype == PQ_PACKED_MSG_TYPE)
+	{
+		if (!pgxc_node_inflate_message(conn, *len))
+		{
+			conn->state = DN_CONNECTION_STATE_ERROR_FATAL;
+			conn->inStart = conn->inCursor = conn->inEnd = 0;
+			return '\0';
+		}
+		return get_message(conn, len, msg);
+	}
+
 	*msg = conn->inBuffer + conn->inCursor;
 	conn->inCursor += *len;
 	conn->inStart = conn->inCursor;
+	conn->stats.messages_received++;
+
+	/*
+	 * Skip the completion of the pipelined BEGIN, the caller is waiting for
+	 * the responses of the command sent after it. Errors are passed through,
+	 * so the caller fails the command.
+	 */
+	if (conn->begin_pending)
+	{
+		if (msgtype == 'Z')
+		{
+			conn->transaction_status = (*msg)[0];
+			conn->begin_pending = false;
+			return get_message(conn, len, msg);
+		}
+		if (msgtype == 'C')
+			return get_message(conn, len, msg);
+	}
+
+	/*
+	 * Likewise skip the results of the INSERTs and utility statements sent
+	 * without waiting, see ExecEndRemoteSubplan and ExecRemoteUtility. They
+	 * come before the responses of the commands sent later. The first error
+	 * is kept to be reported when they are finished, the following commands
+	 * fail on the node anyway.
+	 */
+	if (conn->deferred_pending > 0)
+	{
+		switch (msgtype)
+		{
+			case 'Z':
+				conn->transaction_status = (*msg)[0];
+				conn->deferred_pending--;
+				return get_message(conn, len, msg);
+			case 'E':
+				if (conn->deferred_error == NULL)
+				{
+					conn->deferred_error = MemoryContextAlloc(TopMemoryContext,
+															*len);
+					memcpy(conn->deferred_error, *msg, *len);
+					conn->deferred_error_len = *len;
+				}
+				return get_message(conn, len, msg);
+			case '1':
+			case '2':
+			case '3':
+			case 'n':
+			case 'C':
+			case 'N':
+				return get_message(conn, len, msg);
+			default:
+				break;
+		}
+	}
 	return msgtype;
 }
 
 
+/*
+ * Unpack the compressed message at conn->inStart, the cursor points to its
+ * body of len bytes. The raw messages replace it in the input buffer.
+ */
+static bool
+pgxc_node_inflate_message(PGXCNodeHandle *conn, int len)
+{
+	int			rawlen;
+	size_t		msgend = conn->inCursor + len;
+	size_t		tail = conn->inEnd - msgend;
+	char	   *raw;
+
+	if (len < 4 || get_int(conn, 4, &rawlen) || rawlen <= 0 ||
+		!AllocSizeIsValid(rawlen))
+	{
+		add_error_message(conn, "invalid compressed message length");
+		return false;
+	}
+
+	raw = (char *) palloc(rawlen);
+	if (pglz_decompress(conn->inBuffer + conn->inCursor, len - 4, raw,
+						rawlen) != rawlen)
+	{
+		pfree(raw);
+		add_error_message(conn, "compressed message is corrupted");
+		return false;
+	}
+
+	if (ensure_in_buffer_capacity(conn->inStart + rawlen + tail, conn) != 0)
+	{
+		pfree(raw);
+		add_error_message(conn, "can not allocate buffer");
+		return false;
+	}
+
+	memmove(conn->inBuffer + conn->inStart + rawlen, conn->inBuffer + msgend,
+			tail);
+	memcpy(conn->inBuffer + conn->inStart, raw, rawlen);
+	conn->inEnd = conn->inStart + rawlen + tail;
+	conn->inCursor = conn->inStart;
+	pfree(raw);
+	return true;
+}
+
+
+/*
+ * Check if remote subplan is stored as a persistent statement on the node
+ */
+bool
+pgxc_node_has_subplan(PGXCNodeHandle *handle, const char *name)
+{
+	ListCell   *lc;
+
+	foreach(lc, handle->prepared_subplans)
+	{
+		if (strcmp((char *) lfirst(lc), name) == 0)
+			return true;
+	}
+	return false;
+}
+
+
+/*
+ * Check if remote subplan is stored as a persistent statement on all the
+ * Datanodes from the list, so there is no need to send it down again.
+ */
+bool
+pgxc_node_subplan_prepared(List *nodelist, const char *name)
+{
+	ListCell   *lc;
+
+	if (dn_handles == NULL)
+		return false;
+
+	foreach(lc, nodelist)
+	{
+		PGXCNodeHandle *handle = &dn_handles[lfirst_int(lc)];
+
+		if (handle->sock == NO_SOCKET || !pgxc_node_has_subplan(handle, name))
+			return false;
+	}
+	return true;
+}
+
+
+/*
+ * Remember the remote subplan is stored on the node as a persistent statement
+ */
+void
+pgxc_node_add_subplan(PGXCNodeHandle *handle, const char *name)
+{
+	MemoryContext oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+
+	handle->prepared_subplans = lappend(handle->prepared_subplans,
+										pstrdup(name));
+	handle->deallocate_subplans = true;
+	MemoryContextSwitchTo(oldcontext);
+}
+
+
+/*
+ * Forget the remote subplan on all the nodes, because its plan is being
+ * released. The statement is left on the nodes, it is deallocated when the
+ * connection is cleaned up.
+ */
+void
+pgxc_node_forget_subplan(const char *name)
+{
+	int			i;
+
+	if (dn_handles == NULL)
+		return;
+
+	for (i = 0; i < NumDataNodes; i++)
+	{
+		PGXCNodeHandle *handle = &dn_handles[i];
+		ListCell   *lc;
+
+		foreach(lc, handle->prepared_subplans)
+		{
+			char	   *stmt = (char *) lfirst(lc);
+
+			if (strcmp(stmt, name) == 0)
+			{
+				handle->prepared_subplans =
+						list_delete_ptr(handle->prepared_subplans, stmt);
+				pfree(stmt);
+				break;
+			}
+		}
+	}
+}
+
+
+/*
+ * Forget all the remote subplans. Invoked on transaction abort, when we can
+ * not be sure which statements were actually stored on the nodes. If a
+ * subplan is sent down again the node replaces the existing statement.
+ */
+void
+pgxc_node_forget_all_subplans(void)
+{
+	int			i;
+
+	if (dn_handles == NULL)
+		return;
+
+	for (i = 0; i < NumDataNodes; i++)
+	{
+		PGXCNodeHandle *handle = &dn_handles[i];
+
+		list_free_deep(handle->prepared_subplans);
+		handle->prepared_subplans = NIL;
+	}
+}
+
+
+/*
+ * Return true if there is at least one remote subplan stored on the nodes,
+ * so acquired Datanode connections should not be released
+ */
+bool
+HavePreparedSubplans(void)
+{
+	int			i;
+
+	if (dn_handles == NULL)
+		return false;
+
+	for (i = 0; i < NumDataNodes; i++)
+	{
+		if (dn_handles[i].prepared_subplans != NIL)
+			return true;
+	}
+	return false;
+}
+
+
 /*
  * Release all Datanode and Coordinator connections
  * back to pool and release occupied memory
@@ -821,6 +1755,9 @@ release_handles(void)
 {
 	bool		destroy = false;
 	int			i;
+	uint32		my_hash;
+	uint32		dn_hashes[NumDataNodes + NumStandbyNodes];
+	uint32		co_hashes[NumCoords];
 
 	if (HandlesInvalidatePending)
 	{
@@ -836,16 +1773,27 @@ release_handles(void)
 		return;
 
 	/* Do not release connections if we have prepared statements on nodes */
-	if (HaveActiveDatanodeStatements())
+	if (HaveActiveDatanodeStatements() || HavePreparedSubplans())
 		return;
 
-	/* Free Datanodes handles */
-	for (i = 0; i < NumDataNodes; i++)
+	/*
+	 * Remote sessions initialized with session parameters have received all
+	 * the later changes, so they have current parameters of the session.
+	 * Let the pooler know, so the connections are not reset if reused by
+	 * this session or another one with the same parameters.
+	 */
+	my_hash = PGXCNodeGetSessionParamHash();
+
+	/* Free Datanodes handles, the standby ones as well */
+	for (i = 0; i < NumDataNodes + NumStandbyNodes; i++)
 	{
 		PGXCNodeHandle *handle = &dn_handles[i];
 
+		dn_hashes[i] = 0;
 		if (handle->sock != NO_SOCKET)
 		{
+			if (handle->param_hash != 0)
+				dn_hashes[i] = my_hash;
 			/*
 			 * Connections at this point should be completely inactive,
 			 * otherwise abaandon them. We can not allow not cleaned up
@@ -858,6 +1806,16 @@ release_handles(void)
 				elog(DEBUG1, "Connection to Datanode %d has unexpected state %d and will be dropped",
 					 handle->nodeoid, handle->state);
 			}
+			/*
+			 * Persistent statements are not deallocated if the connection
+			 * has not been cleaned up, do not return it to pool.
+			 */
+			if (handle->deallocate_subplans)
+			{
+				destroy = true;
+				elog(DEBUG1, "Connection to Datanode %d has persistent statements and will be dropped",
+					 handle->nodeoid);
+			}
 			pgxc_node_free(handle);
 		}
 	}
@@ -869,8 +1827,11 @@ release_handles(void)
 		{
 			PGXCNodeHandle *handle = &co_handles[i];
 
+			co_hashes[i] = 0;
 			if (handle->sock != NO_SOCKET)
 			{
+				if (handle->param_hash != 0)
+					co_hashes[i] = my_hash;
 				/*
 				 * Connections at this point should be completely inactive,
 				 * otherwise abaandon them. We can not allow not cleaned up
@@ -887,12 +1848,43 @@ release_handles(void)
 			}
 		}
 	}
+	else
+	{
+		for (i = 0; i < NumCoords; i++)
+			co_hashes[i] = 0;
+	}
 
 	/* And finally release all the connections on pooler */
-	PoolManagerReleaseConnections(destroy);
+	PoolManagerReleaseConnections(destroy, NumDataNodes + NumStandbyNodes,
+								  dn_hashes, NumCoords, co_hashes);
 
 	datanode_count = 0;
 	coord_count = 0;
+
+	/* Next transaction starts */
+	for (i = 0; i < NumDataNodes + NumStandbyNodes; i++)
+		dn_usage[i] <<= 1;
+}
+
+/*
+ * Size of the buffer large enough for the specified amount of data.
+ * Buffers grow in powers of two starting from the default size, so the
+ * memory freed by one handle fits the buffer of another handle and the
+ * allocator can reuse it. Returns 0 if the amount is too large.
+ */
+static size_t
+buffer_size_class(size_t bytes_needed)
+{
+	size_t		newsize = PGXC_NODE_BUFFER_SIZE;
+
+	while (newsize < bytes_needed)
+	{
+		/* Last class is the largest allocation possible */
+		if (newsize > MaxAllocSize / 2)
+			return bytes_needed <= MaxAllocSize ? MaxAllocSize : 0;
+		newsize *= 2;
+	}
+	return newsize;
 }
 
 /*
@@ -902,48 +1894,18 @@ release_handles(void)
 int
 ensure_in_buffer_capacity(size_t bytes_needed, PGXCNodeHandle *handle)
 {
-	int			newsize = handle->inSize;
-	char	   *newbuf;
+	size_t		newsize;
 
-	if (bytes_needed <= (size_t) newsize)
+	if (bytes_needed <= handle->inSize)
 		return 0;
 
-	do
-	{
-		newsize *= 2;
-	} while (newsize > 0 && bytes_needed > (size_t) newsize);
-
-	if (newsize > 0 && bytes_needed <= (size_t) newsize)
-	{
-		newbuf = repalloc(handle->inBuffer, newsize);
-		if (newbuf)
-		{
-			/* repalloc succeeded */
-			handle->inBuffer = newbuf;
-			handle->inSize = newsize;
-			return 0;
-		}
-	}
-
-	newsize = handle->inSize;
-	do
-	{
-		newsize += 8192;
-	} while (newsize > 0 && bytes_needed > (size_t) newsize);
-
-	if (newsize > 0 && bytes_needed <= (size_t) newsize)
-	{
-		newbuf = repalloc(handle->inBuffer, newsize);
-		if (newbuf)
-		{
-			/* repalloc succeeded */
-			handle->inBuffer = newbuf;
-			handle->inSize = newsize;
-			return 0;
-		}
-	}
+	newsize = buffer_size_class(bytes_needed);
+	if (newsize == 0)
+		return EOF;
 
-	return EOF;
+	handle->inBuffer = repalloc(handle->inBuffer, newsize);
+	handle->inSize = newsize;
+	return 0;
 }
 
 
@@ -954,48 +1916,18 @@ ensure_in_buffer_capacity(size_t bytes_needed, PGXCNodeHandle *handle)
 int
 ensure_out_buffer_capacity(size_t bytes_needed, PGXCNodeHandle *handle)
 {
-	int			newsize = handle->outSize;
-	char	   *newbuf;
+	size_t		newsize;
 
-	if (bytes_needed <= (size_t) newsize)
+	if (bytes_needed <= handle->outSize)
 		return 0;
 
-	do
-	{
-		newsize *= 2;
-	} while (newsize > 0 && bytes_needed > (size_t) newsize);
-
-	if (newsize > 0 && bytes_needed <= (size_t) newsize)
-	{
-		newbuf = repalloc(handle->outBuffer, newsize);
-		if (newbuf)
-		{
-			/* repalloc succeeded */
-			handle->outBuffer = newbuf;
-			handle->outSize = newsize;
-			return 0;
-		}
-	}
-
-	newsize = handle->outSize;
-	do
-	{
-		newsize += 8192;
-	} while (newsize > 0 && bytes_needed > (size_t) newsize);
-
-	if (newsize > 0 && bytes_needed <= (size_t) newsize)
-	{
-		newbuf = repalloc(handle->outBuffer, newsize);
-		if (newbuf)
-		{
-			/* repalloc succeeded */
-			handle->outBuffer = newbuf;
-			handle->outSize = newsize;
-			return 0;
-		}
-	}
+	newsize = buffer_size_class(bytes_needed);
+	if (newsize == 0)
+		return EOF;
 
-	return EOF;
+	handle->outBuffer = repalloc(handle->outBuffer, newsize);
+	handle->outSize = newsize;
+	return 0;
 }
 
 
@@ -1005,9 +1937,22 @@ ensure_out_buffer_capacity(size_t bytes_needed, PGXCNodeHandle *handle)
 int
 send_some(PGXCNodeHandle *handle, int len)
 {
-	char	   *ptr = handle->outBuffer;
-	int			remaining = handle->outEnd;
+	char	   *ptr;
+	int			remaining;
 	int			result = 0;
+	instr_time	start;
+	instr_time	send_time;
+
+	INSTR_TIME_SET_CURRENT(start);
+	/*
+	 * Compress the messages not sent yet even if only a part of the buffer is
+	 * to be sent, a packed message can not start in the middle of a message
+	 * already sent
+	 */
+	pgxc_node_pack_output(handle);
+	len = Min(len, handle->outEnd);
+	ptr = handle->outBuffer;
+	remaining = handle->outEnd;
 
 	/* while there's still data to send */
 	while (len > 0)
@@ -1061,13 +2006,13 @@ send_some(PGXCNodeHandle *handle, int len)
 					 * pqReadData finds no more data can be read.  But abandon
 					 * attempt to send data.
 					 */
-					handle->outEnd = 0;
+					pgxc_node_discard_output(handle);
 					return -1;
 
 				default:
 					add_error_message(handle, "could not send data to server");
 					/* We don't assume it's a fatal error... */
-					handle->outEnd = 0;
+					pgxc_node_discard_output(handle);
 					return -1;
 			}
 		}
@@ -1076,6 +2021,7 @@ send_some(PGXCNodeHandle *handle, int len)
 			ptr += sent;
 			len -= sent;
 			remaining -= sent;
+			handle->stats.bytes_sent += sent;
 		}
 
 		if (len > 0)
@@ -1103,7 +2049,7 @@ send_some(PGXCNodeHandle *handle, int len)
 				else
 				{
 					add_error_message(handle, "poll failed ");
-					handle->outEnd = 0;
+					pgxc_node_discard_output(handle);
 					return -1;
 				}
 			}
@@ -1112,7 +2058,7 @@ send_some(PGXCNodeHandle *handle, int len)
 				if (pool_fd.revents & POLLHUP)
 				{
 					add_error_message(handle, "remote end disconnected");
-					handle->outEnd = 0;
+					pgxc_node_discard_output(handle);
 					return -1;
 				}
 			}
@@ -1123,6 +2069,15 @@ send_some(PGXCNodeHandle *handle, int len)
 	if (remaining > 0)
 		memmove(handle->outBuffer, ptr, remaining);
 	handle->outEnd = remaining;
+	handle->outPacked -= Min(handle->outPacked, ptr - handle->outBuffer);
+
+	INSTR_TIME_SET_CURRENT(send_time);
+	/* Request is on the wire, wait for the response, unless it is COPY */
+	if (remaining == 0 && INSTR_TIME_IS_ZERO(handle->request_sent) &&
+		handle->state != DN_CONNECTION_STATE_COPY_IN)
+		handle->request_sent = send_time;
+	INSTR_TIME_SUBTRACT(send_time, start);
+	handle->stats.send_time += INSTR_TIME_GET_MICROSEC(send_time);
 
 	return result;
 }
@@ -1219,7 +2174,7 @@ pgxc_node_send_parse(PGXCNodeHandle * handle, const char* statement,
 int
 pgxc_node_send_plan(PGXCNodeHandle * handle, const char *statement,
 					const char *query, const char *planstr,
-					short num_params, Oid *param_types)
+					short num_params, Oid *param_types, bool persistent)
 {
 	int			stmtLen;
 	int			queryLen;
@@ -1248,8 +2203,8 @@ pgxc_node_send_plan(PGXCNodeHandle * handle, const char *statement,
 		paramTypes[i] = format_type_be(param_types[i]);
 		paramTypeLen += strlen(paramTypes[i]) + 1;
 	}
-	/* size + pnameLen + queryLen + parameters */
-	msgLen = 4 + queryLen + stmtLen + planLen + paramTypeLen;
+	/* size + pnameLen + queryLen + parameters + persistent flag */
+	msgLen = 4 + queryLen + stmtLen + planLen + paramTypeLen + 1;
 
 	/* msgType + msgLen */
 	if (ensure_out_buffer_capacity(handle->outEnd + 1 + msgLen, handle) != 0)
@@ -1289,6 +2244,8 @@ pgxc_node_send_plan(PGXCNodeHandle * handle, const char *statement,
 		pfree(paramTypes[i]);
 	}
 	pfree(paramTypes);
+	/* keep the statement after the end of transaction? */
+	handle->outBuffer[handle->outEnd++] = persistent ? 1 : 0;
 
  	return 0;
 }
@@ -1298,7 +2255,8 @@ pgxc_node_send_plan(PGXCNodeHandle * handle, const char *statement,
  */
 int
 pgxc_node_send_bind(PGXCNodeHandle * handle, const char *portal,
-					const char *statement, int paramlen, char *params)
+					const char *statement, int paramlen, char *params,
+					bool binary)
 {
 	int			pnameLen;
 	int			stmtLen;
@@ -1315,12 +2273,15 @@ pgxc_node_send_bind(PGXCNodeHandle * handle, const char *portal,
 	pnameLen = portal ? strlen(portal) + 1 : 1;
 	/* statement name size (allow NULL) */
 	stmtLen = statement ? strlen(statement) + 1 : 1;
-	/* size of parameter codes array (always empty for now) */
-	paramCodeLen = 2;
-	/* size of parameter values array, 2 if no params */
+	/*
+	 * Parameter data start with the parameter format codes array, so if
+	 * there are parameters we only need room for them, otherwise for empty
+	 * codes and values arrays.
+	 */
+	paramCodeLen = paramlen ? 0 : 2;
 	paramValueLen = paramlen ? paramlen : 2;
-	/* size of output parameter codes array (always empty for now) */
-	paramOutLen = 2;
+	/* size of output parameter codes array, one code for all if binary */
+	paramOutLen = binary ? 4 : 2;
 	/* size + pnameLen + stmtLen + parameters */
 	msgLen = 4 + pnameLen + stmtLen + paramCodeLen + paramValueLen + paramOutLen;
 
@@ -1352,47 +2313,61 @@ pgxc_node_send_bind(PGXCNodeHandle * handle, const char *portal,
 	}
 	else
 		handle->outBuffer[handle->outEnd++] = '\0';
-	/* parameter codes (none) */
-	handle->outBuffer[handle->outEnd++] = 0;
-	handle->outBuffer[handle->outEnd++] = 0;
-	/* parameter values */
+	/* parameter codes and values */
 	if (paramlen)
 	{
 		memcpy(handle->outBuffer + handle->outEnd, params, paramlen);
 		handle->outEnd += paramlen;
 	}
 	else
+	{
+		/* no codes */
+		handle->outBuffer[handle->outEnd++] = 0;
+		handle->outBuffer[handle->outEnd++] = 0;
+		/* no values */
+		handle->outBuffer[handle->outEnd++] = 0;
+		handle->outBuffer[handle->outEnd++] = 0;
+	}
+	/* output parameter codes, binary for all or none meaning text */
+	if (binary)
+	{
+		handle->outBuffer[handle->outEnd++] = 0;
+		handle->outBuffer[handle->outEnd++] = 1;
+		handle->outBuffer[handle->outEnd++] = 0;
+		handle->outBuffer[handle->outEnd++] = 1;
+	}
+	else
 	{
 		handle->outBuffer[handle->outEnd++] = 0;
 		handle->outBuffer[handle->outEnd++] = 0;
 	}
-	/* output parameter codes (none) */
-	handle->outBuffer[handle->outEnd++] = 0;
-	handle->outBuffer[handle->outEnd++] = 0;
 
  	return 0;
 }
 
 
 /*
- * Send DESCRIBE message (portal or statement) down to the Datanode
+ * Send RESCAN message down to the Datanode, to restart the portal with new
+ * parameter values. Parameter data are encoded like for pgxc_node_send_bind.
  */
 int
-pgxc_node_send_describe(PGXCNodeHandle * handle, bool is_statement,
-						const char *name)
+pgxc_node_send_rescan(PGXCNodeHandle * handle, const char *portal,
+					  int paramlen, char *params)
 {
-	int			nameLen;
+	int			pnameLen;
+	int			paramLen;
 	int			msgLen;
 
 	/* Invalid connection state, return error */
 	if (handle->state != DN_CONNECTION_STATE_IDLE)
 		return EOF;
 
-	/* statement or portal name size (allow NULL) */
-	nameLen = name ? strlen(name) + 1 : 1;
-
-	/* size + statement/portal + name */
-	msgLen = 4 + 1 + nameLen;
+	/* portal name size (allow NULL) */
+	pnameLen = portal ? strlen(portal) + 1 : 1;
+	/* size of parameter codes and values arrays, 4 if no params */
+	paramLen = paramlen ? paramlen : 4;
+	/* size + pnameLen + parameters */
+	msgLen = 4 + pnameLen + paramLen;
 
 	/* msgType + msgLen */
 	if (ensure_out_buffer_capacity(handle->outEnd + 1 + msgLen, handle) != 0)
@@ -1401,36 +2376,139 @@ pgxc_node_send_describe(PGXCNodeHandle * handle, bool is_statement,
 		return EOF;
 	}
 
-	handle->outBuffer[handle->outEnd++] = 'D';
+	handle->outBuffer[handle->outEnd++] = 'r';
 	/* size */
 	msgLen = htonl(msgLen);
 	memcpy(handle->outBuffer + handle->outEnd, &msgLen, 4);
 	handle->outEnd += 4;
-	/* statement/portal flag */
-	handle->outBuffer[handle->outEnd++] = is_statement ? 'S' : 'P';
-	/* object name */
-	if (name)
+	/* portal name */
+	if (portal)
 	{
-		memcpy(handle->outBuffer + handle->outEnd, name, nameLen);
-		handle->outEnd += nameLen;
+		memcpy(handle->outBuffer + handle->outEnd, portal, pnameLen);
+		handle->outEnd += pnameLen;
 	}
 	else
 		handle->outBuffer[handle->outEnd++] = '\0';
+	/* parameter codes and values */
+	if (paramlen)
+	{
+		memcpy(handle->outBuffer + handle->outEnd, params, paramlen);
+		handle->outEnd += paramlen;
+	}
+	else
+	{
+		memset(handle->outBuffer + handle->outEnd, 0, 4);
+		handle->outEnd += 4;
+	}
 
  	return 0;
 }
 
 
 /*
- * Send CLOSE message (portal or statement) down to the Datanode
+ * Send the join filter for the portal, see joinFilter.c. The node applies it
+ * to the rows of the portal bound or restarted next with that name.
  */
 int
-pgxc_node_send_close(PGXCNodeHandle * handle, bool is_statement,
-					 const char *name)
+pgxc_node_send_join_filter(PGXCNodeHandle * handle, const char *portal,
+						   const char *data, int len)
 {
-	/* statement or portal name size (allow NULL) */
-	int			nameLen = name ? strlen(name) + 1 : 1;
-
+	int			pnameLen;
+	int			msgLen;
+
+	/* Invalid connection state, return error */
+	if (handle->state != DN_CONNECTION_STATE_IDLE)
+		return EOF;
+
+	/* portal name size (allow NULL) */
+	pnameLen = portal ? strlen(portal) + 1 : 1;
+	/* size + pnameLen + filter */
+	msgLen = 4 + pnameLen + len;
+
+	/* msgType + msgLen */
+	if (ensure_out_buffer_capacity(handle->outEnd + 1 + msgLen, handle) != 0)
+	{
+		add_error_message(handle, "out of memory");
+		return EOF;
+	}
+
+	handle->outBuffer[handle->outEnd++] = 'J';
+	/* size */
+	msgLen = htonl(msgLen);
+	memcpy(handle->outBuffer + handle->outEnd, &msgLen, 4);
+	handle->outEnd += 4;
+	/* portal name */
+	if (portal)
+	{
+		memcpy(handle->outBuffer + handle->outEnd, portal, pnameLen);
+		handle->outEnd += pnameLen;
+	}
+	else
+		handle->outBuffer[handle->outEnd++] = '\0';
+	/* filter */
+	memcpy(handle->outBuffer + handle->outEnd, data, len);
+	handle->outEnd += len;
+
+	return 0;
+}
+
+/*
+ * Send DESCRIBE message (portal or statement) down to the Datanode
+ */
+int
+pgxc_node_send_describe(PGXCNodeHandle * handle, bool is_statement,
+						const char *name)
+{
+	int			nameLen;
+	int			msgLen;
+
+	/* Invalid connection state, return error */
+	if (handle->state != DN_CONNECTION_STATE_IDLE)
+		return EOF;
+
+	/* statement or portal name size (allow NULL) */
+	nameLen = name ? strlen(name) + 1 : 1;
+
+	/* size + statement/portal + name */
+	msgLen = 4 + 1 + nameLen;
+
+	/* msgType + msgLen */
+	if (ensure_out_buffer_capacity(handle->outEnd + 1 + msgLen, handle) != 0)
+	{
+		add_error_message(handle, "out of memory");
+		return EOF;
+	}
+
+	handle->outBuffer[handle->outEnd++] = 'D';
+	/* size */
+	msgLen = htonl(msgLen);
+	memcpy(handle->outBuffer + handle->outEnd, &msgLen, 4);
+	handle->outEnd += 4;
+	/* statement/portal flag */
+	handle->outBuffer[handle->outEnd++] = is_statement ? 'S' : 'P';
+	/* object name */
+	if (name)
+	{
+		memcpy(handle->outBuffer + handle->outEnd, name, nameLen);
+		handle->outEnd += nameLen;
+	}
+	else
+		handle->outBuffer[handle->outEnd++] = '\0';
+
+ 	return 0;
+}
+
+
+/*
+ * Send CLOSE message (portal or statement) down to the Datanode
+ */
+int
+pgxc_node_send_close(PGXCNodeHandle * handle, bool is_statement,
+					 const char *name)
+{
+	/* statement or portal name size (allow NULL) */
+	int			nameLen = name ? strlen(name) + 1 : 1;
+
 	/* size + statement/portal + name */
 	int			msgLen = 4 + 1 + nameLen;
 
@@ -1509,6 +2587,21 @@ pgxc_node_send_execute(PGXCNodeHandle * handle, const char *portal, int fetch)
  */
 int
 pgxc_node_send_flush(PGXCNodeHandle * handle)
+{
+	if (pgxc_node_queue_flush(handle))
+		return EOF;
+
+	return pgxc_node_flush(handle);
+}
+
+
+/*
+ * Put FLUSH message into the output buffer of the Datanode connection.
+ * The caller is responsible to send the buffer out, that allows to flush
+ * multiple connections at once with pgxc_node_flush_all().
+ */
+int
+pgxc_node_queue_flush(PGXCNodeHandle *handle)
 {
 	/* size */
 	int			msgLen = 4;
@@ -1526,7 +2619,7 @@ pgxc_node_send_flush(PGXCNodeHandle * handle)
 	memcpy(handle->outBuffer + handle->outEnd, &msgLen, 4);
 	handle->outEnd += 4;
 
-	return pgxc_node_flush(handle);
+	return 0;
 }
 
 
@@ -1535,6 +2628,20 @@ pgxc_node_send_flush(PGXCNodeHandle * handle)
  */
 int
 pgxc_node_send_sync(PGXCNodeHandle * handle)
+{
+	if (pgxc_node_queue_sync(handle))
+		return EOF;
+
+	return pgxc_node_flush(handle);
+}
+
+
+/*
+ * Put SYNC message into the output buffer of the Datanode connection, it is
+ * sent out along with the messages queued after it.
+ */
+int
+pgxc_node_queue_sync(PGXCNodeHandle *handle)
 {
 	/* size */
 	int			msgLen = 4;
@@ -1552,7 +2659,7 @@ pgxc_node_send_sync(PGXCNodeHandle * handle)
 	memcpy(handle->outBuffer + handle->outEnd, &msgLen, 4);
 	handle->outEnd += 4;
 
-	return pgxc_node_flush(handle);
+	return 0;
 }
 
 
@@ -1570,7 +2677,8 @@ pgxc_node_send_query_extended(PGXCNodeHandle *handle, const char *query,
 	if (query)
 		if (pgxc_node_send_parse(handle, statement, query, num_params, param_types))
 			return EOF;
-	if (pgxc_node_send_bind(handle, portal, statement, paramlen, params))
+	if (pgxc_node_send_bind(handle, portal, statement, paramlen, params,
+							false))
 		return EOF;
 	if (send_describe)
 		if (pgxc_node_send_describe(handle, false, portal))
@@ -1603,6 +2711,162 @@ pgxc_node_flush(PGXCNodeHandle *handle)
 	return 0;
 }
 
+/*
+ * Send as much of the buffered data as the socket accepts without waiting.
+ * Returns number of bytes left in the buffer or -1 in case of error.
+ */
+static int
+send_nowait(PGXCNodeHandle *handle)
+{
+	char	   *ptr;
+	int			remaining;
+
+	pgxc_node_pack_output(handle);
+	ptr = handle->outBuffer;
+	remaining = handle->outEnd;
+
+	while (remaining > 0)
+	{
+		int			sent;
+
+#ifndef WIN32
+		sent = send(handle->sock, ptr, remaining, 0);
+#else
+		/* See send_some */
+		sent = send(handle->sock, ptr, Min(remaining, 65536), 0);
+#endif
+
+		if (sent < 0)
+		{
+			if (errno == EINTR)
+				continue;
+#ifdef EAGAIN
+			if (errno == EAGAIN)
+				break;
+#endif
+#if defined(EWOULDBLOCK) && (!defined(EAGAIN) || (EWOULDBLOCK != EAGAIN))
+			if (errno == EWOULDBLOCK)
+				break;
+#endif
+			if (errno == EPIPE
+#ifdef ECONNRESET
+				|| errno == ECONNRESET
+#endif
+				)
+				add_error_message(handle, "server closed the connection unexpectedly\n"
+					"\tThis probably means the server terminated abnormally\n"
+							  "\tbefore or while processing the request.\n");
+			else
+				add_error_message(handle, "could not send data to server");
+			/* Abandon attempt to send data, see send_some */
+			pgxc_node_discard_output(handle);
+			return -1;
+		}
+		ptr += sent;
+		remaining -= sent;
+		handle->stats.bytes_sent += sent;
+	}
+
+	/* shift the remaining contents of the buffer */
+	if (remaining > 0 && ptr != handle->outBuffer)
+		memmove(handle->outBuffer, ptr, remaining);
+	handle->outEnd = remaining;
+	handle->outPacked = remaining;
+
+	/* Request is on the wire, see send_some */
+	if (remaining == 0 && INSTR_TIME_IS_ZERO(handle->request_sent) &&
+		handle->state != DN_CONNECTION_STATE_COPY_IN)
+		INSTR_TIME_SET_CURRENT(handle->request_sent);
+
+	return remaining;
+}
+
+/*
+ * Send as much of the buffered data as the socket accepts without waiting.
+ * Returns number of bytes left in the buffer or -1 in case of error.
+ */
+int
+pgxc_node_flush_nowait(PGXCNodeHandle *handle)
+{
+	if (handle->outEnd == 0)
+		return 0;
+	return send_nowait(handle);
+}
+
+/*
+ * Send out the buffered data of all the specified handles and return when
+ * all the buffers are empty. Unlike pgxc_node_flush() for each handle in
+ * turn, if a socket can not accept all the data do not wait for it, but go
+ * on sending to the other sockets, and then wait until any of the pending
+ * sockets accepts more. Returns EOF if sending failed for some handle.
+ */
+int
+pgxc_node_flush_all(int count, PGXCNodeHandle **handles)
+{
+	struct pollfd pool_fd[count];
+	int			result = 0;
+	int			i;
+	instr_time	start;
+	instr_time	send_time;
+
+	for (;;)
+	{
+		int			npending = 0;
+		int			poll_ret;
+
+		for (i = 0; i < count; i++)
+		{
+			PGXCNodeHandle *handle = handles[i];
+
+			if (handle->outEnd == 0)
+				continue;
+
+			if (send_nowait(handle) < 0)
+			{
+				add_error_message(handle, "failed to send data to datanode");
+				result = EOF;
+			}
+			else if (handle->outEnd > 0)
+			{
+				pool_fd[npending].fd = handle->sock;
+				pool_fd[npending].events = POLLOUT;
+				npending++;
+			}
+		}
+
+		if (npending == 0)
+			break;
+
+		/*
+		 * Wait for some socket to become ready again to accept more data, a
+		 * small timeout avoids infinite wait, as in send_some
+		 */
+		INSTR_TIME_SET_CURRENT(start);
+		poll_ret = poll(pool_fd, npending, 1000);
+		INSTR_TIME_SET_CURRENT(send_time);
+		INSTR_TIME_SUBTRACT(send_time, start);
+		for (i = 0; i < count; i++)
+		{
+			if (handles[i]->outEnd > 0)
+				handles[i]->stats.send_time +=
+					INSTR_TIME_GET_MICROSEC(send_time);
+		}
+		if (poll_ret < 0 && errno != EAGAIN && errno != EINTR)
+		{
+			for (i = 0; i < count; i++)
+			{
+				if (handles[i]->outEnd > 0)
+				{
+					add_error_message(handles[i], "poll failed ");
+					pgxc_node_discard_output(handles[i]);
+				}
+			}
+			return EOF;
+		}
+	}
+	return result;
+}
+
 /*
  * This method won't return until network buffer is empty or error occurs
  * To ensure all data in network buffers is read and wasted
@@ -1639,12 +2903,68 @@ pgxc_node_flush_read(PGXCNodeHandle *handle)
  */
 int
 pgxc_node_send_query(PGXCNodeHandle * handle, const char *query)
+{
+	/* Invalid connection state, return error */
+	if (handle->state != DN_CONNECTION_STATE_IDLE)
+		return EOF;
+
+	if (pgxc_node_queue_query(handle, query))
+		return EOF;
+
+	handle->state = DN_CONNECTION_STATE_QUERY;
+
+ 	return pgxc_node_flush(handle);
+}
+
+
+/*
+ * Put the statement into the output buffer of the connection without
+ * changing its state. Several statements may be queued this way and sent
+ * out at once, the caller is responsible to flush the buffer and to read
+ * a ReadyForQuery for each of them.
+ */
+int
+pgxc_node_queue_query(PGXCNodeHandle *handle, const char *query)
+{
+	int			strLen;
+	int			msgLen;
+
+	strLen = strlen(query) + 1;
+	/* size + strlen */
+	msgLen = 4 + strLen;
+
+	/* msgType + msgLen */
+	if (ensure_out_buffer_capacity(handle->outEnd + 1 + msgLen, handle) != 0)
+	{
+		add_error_message(handle, "out of memory");
+		return EOF;
+	}
+
+	handle->outBuffer[handle->outEnd++] = 'Q';
+	msgLen = htonl(msgLen);
+	memcpy(handle->outBuffer + handle->outEnd, &msgLen, 4);
+	handle->outEnd += 4;
+	memcpy(handle->outBuffer + handle->outEnd, query, strLen);
+	handle->outEnd += strLen;
+
+	return 0;
+}
+
+
+/*
+ * Queue up the query starting a transaction on the node, and leave the
+ * connection ready for the next command without waiting for the response.
+ * The query is sent when the command is flushed. The transaction is assumed
+ * started, and get_message() skips the responses to the query.
+ */
+int
+pgxc_node_send_begin(PGXCNodeHandle *handle, const char *query)
 {
 	int			strLen;
 	int			msgLen;
 
 	/* Invalid connection state, return error */
-	if (handle->state != DN_CONNECTION_STATE_IDLE)
+	if (handle->state != DN_CONNECTION_STATE_IDLE || handle->begin_pending)
 		return EOF;
 
 	strLen = strlen(query) + 1;
@@ -1665,38 +2985,139 @@ pgxc_node_send_query(PGXCNodeHandle * handle, const char *query)
 	memcpy(handle->outBuffer + handle->outEnd, query, strLen);
 	handle->outEnd += strLen;
 
-	handle->state = DN_CONNECTION_STATE_QUERY;
+	handle->transaction_status = 'T';
+	handle->begin_pending = true;
 
- 	return pgxc_node_flush(handle);
+	return 0;
 }
 
 
+/*
+ * Messages sent ahead of a command: GXID, Command ID, snapshot and timestamp.
+ * Each of them is written by a single routine, either to the output buffer of
+ * one handle by pgxc_node_send_*(), or to a prefix buffer by
+ * pgxc_node_prefix_*(). The snapshot is not put into the prefix, because it
+ * is sent to each node as a difference to its previous snapshot. The prefix is serialized once for a command going
+ * to multiple nodes and copied to the handles with pgxc_node_send_prefix().
+ * The routines return the length of the written message, the size of the
+ * message should be reserved in advance, see *_msg_len().
+ */
+#define GXID_MSG_LEN		(1 + 8)
+#define TIMESTAMP_MSG_LEN	(1 + 12)	/* 4 bytes for msglen and 8 bytes for
+										 * timestamp (int64) */
+#define SNAPSHOT_MSG_LEN(snapshot) \
+	(1 + 20 + ((snapshot)->xcnt > 0 ? (snapshot)->xcnt * 4 : 0))
+
+static int
+write_gxid_msg(char *buf, GlobalTransactionId gxid)
+{
+	int			msglen = 8;
+
+	buf[0] = 'g';
+	msglen = htonl(msglen);
+	memcpy(buf + 1, &msglen, 4);
+	memcpy(buf + 5, &gxid, sizeof (TransactionId));
+
+	return GXID_MSG_LEN;
+}
+
+static int
+write_cmd_id_msg(char *buf, CommandId cid)
+{
+	int			msglen = CMD_ID_MSG_LEN;
+	int			i32;
+
+	buf[0] = 'M';
+	msglen = htonl(msglen);
+	memcpy(buf + 1, &msglen, 4);
+	i32 = htonl(cid);
+	memcpy(buf + 5, &i32, 4);
+
+	return 1 + CMD_ID_MSG_LEN;
+}
+
+static int
+write_snapshot_msg(char *buf, Snapshot snapshot)
+{
+	int			msglen = SNAPSHOT_MSG_LEN(snapshot) - 1;
+	int			nval;
+	int			pos = 0;
+
+	buf[pos++] = 's';
+	msglen = htonl(msglen);
+	memcpy(buf + pos, &msglen, 4);
+	pos += 4;
+
+	memcpy(buf + pos, &snapshot->xmin, sizeof (TransactionId));
+	pos += sizeof (TransactionId);
+
+	memcpy(buf + pos, &snapshot->xmax, sizeof (TransactionId));
+	pos += sizeof (TransactionId);
+
+	memcpy(buf + pos, &RecentGlobalXmin, sizeof (TransactionId));
+	pos += sizeof (TransactionId);
+
+	nval = htonl(snapshot->xcnt);
+	memcpy(buf + pos, &nval, 4);
+	pos += 4;
+
+	if (snapshot->xcnt > 0)
+	{
+		memcpy(buf + pos, snapshot->xip,
+			   snapshot->xcnt * sizeof (TransactionId));
+		pos += snapshot->xcnt * sizeof (TransactionId);
+	}
+
+	return pos;
+}
+
+static int
+write_timestamp_msg(char *buf, TimestampTz timestamp)
+{
+	int			msglen = TIMESTAMP_MSG_LEN - 1;
+	uint32		n32;
+	int64		i = (int64) timestamp;
+
+	buf[0] = 't';
+	msglen = htonl(msglen);
+	memcpy(buf + 1, &msglen, 4);
+
+	/* High order half first */
+#ifdef INT64_IS_BUSTED
+	/* don't try a right shift of 32 on a 32-bit word */
+	n32 = (i < 0) ? -1 : 0;
+#else
+	n32 = (uint32) (i >> 32);
+#endif
+	n32 = htonl(n32);
+	memcpy(buf + 5, &n32, 4);
+
+	/* Now the low order half */
+	n32 = (uint32) i;
+	n32 = htonl(n32);
+	memcpy(buf + 9, &n32, 4);
+
+	return TIMESTAMP_MSG_LEN;
+}
+
 /*
  * Send the GXID down to the PGXC node
  */
 int
 pgxc_node_send_gxid(PGXCNodeHandle *handle, GlobalTransactionId gxid)
 {
-	int			msglen = 8;
-
 	/* Invalid connection state, return error */
 	if (handle->state != DN_CONNECTION_STATE_IDLE)
 		return EOF;
 
 	/* msgType + msgLen */
-	if (ensure_out_buffer_capacity(handle->outEnd + 1 + msglen, handle) != 0)
+	if (ensure_out_buffer_capacity(handle->outEnd + GXID_MSG_LEN, handle) != 0)
 	{
 		add_error_message(handle, "out of memory");
 		return EOF;
 	}
 
-	handle->outBuffer[handle->outEnd++] = 'g';
-	msglen = htonl(msglen);
-	memcpy(handle->outBuffer + handle->outEnd, &msglen, 4);
-	handle->outEnd += 4;
-	memcpy(handle->outBuffer + handle->outEnd, &gxid, sizeof
-			(TransactionId));
-	handle->outEnd += sizeof (TransactionId);
+	handle->outEnd += write_gxid_msg(handle->outBuffer + handle->outEnd, gxid);
 
 	return 0;
 }
@@ -1707,9 +3128,6 @@ pgxc_node_send_gxid(PGXCNodeHandle *handle, GlobalTransactionId gxid)
 int
 pgxc_node_send_cmd_id(PGXCNodeHandle *handle, CommandId cid)
 {
-	int			msglen = CMD_ID_MSG_LEN;
-	int			i32;
-
 	/* No need to send command ID if its sending flag is not enabled */
 	if (!IsSendCommandId())
 		return 0;
@@ -1719,118 +3137,302 @@ pgxc_node_send_cmd_id(PGXCNodeHandle *handle, CommandId cid)
 		return EOF;
 
 	/* msgType + msgLen */
-	if (ensure_out_buffer_capacity(handle->outEnd + 1 + msglen, handle) != 0)
+	if (ensure_out_buffer_capacity(handle->outEnd + 1 + CMD_ID_MSG_LEN,
+								   handle) != 0)
 	{
 		add_error_message(handle, "out of memory");
 		return EOF;
 	}
 
-	handle->outBuffer[handle->outEnd++] = 'M';
-	msglen = htonl(msglen);
-	memcpy(handle->outBuffer + handle->outEnd, &msglen, 4);
-	handle->outEnd += 4;
-	i32 = htonl(cid);
-	memcpy(handle->outBuffer + handle->outEnd, &i32, 4);
-	handle->outEnd += 4;
+	handle->outEnd += write_cmd_id_msg(handle->outBuffer + handle->outEnd, cid);
 
 	return 0;
 }
 
 /*
- * Send the snapshot down to the PGXC node
+ * Return xids of the snapshot sorted, the result is cached, so the sort is
+ * done once if the same snapshot is sent to multiple nodes.
+ */
+static TransactionId *
+get_sorted_xip(Snapshot snapshot)
+{
+	static TransactionId *cached_xip = NULL;
+	static TransactionId *sorted_xip = NULL;
+	static int	cached_xcnt = -1;
+	static int	cached_size = 0;
+	int			size = snapshot->xcnt * sizeof(TransactionId);
+
+	if (snapshot->xcnt == 0)
+		return NULL;
+
+	if (cached_xcnt == snapshot->xcnt &&
+			memcmp(cached_xip, snapshot->xip, size) == 0)
+		return sorted_xip;
+
+	if (cached_size < snapshot->xcnt)
+	{
+		int			newsize = Max(snapshot->xcnt, 64);
+
+		if (cached_xip)
+		{
+			pfree(cached_xip);
+			pfree(sorted_xip);
+		}
+		cached_xip = (TransactionId *)
+			MemoryContextAlloc(TopMemoryContext,
+							   newsize * sizeof(TransactionId));
+		sorted_xip = (TransactionId *)
+			MemoryContextAlloc(TopMemoryContext,
+							   newsize * sizeof(TransactionId));
+		cached_size = newsize;
+	}
+	memcpy(cached_xip, snapshot->xip, size);
+	memcpy(sorted_xip, snapshot->xip, size);
+	qsort(sorted_xip, snapshot->xcnt, sizeof(TransactionId), xidComparator);
+	cached_xcnt = snapshot->xcnt;
+
+	return sorted_xip;
+}
+
+/*
+ * Find xids of the sorted array xip missing in the sorted array other.
+ * Returns the number of them, and writes them to the buffer, if not NULL.
+ */
+static int
+xip_difference(TransactionId *xip, int xcnt, TransactionId *other, int ocnt,
+			   char *buffer)
+{
+	int			count = 0;
+	int			i,
+				j = 0;
+
+	for (i = 0; i < xcnt; i++)
+	{
+		while (j < ocnt && other[j] < xip[i])
+			j++;
+		if (j < ocnt && other[j] == xip[i])
+			continue;
+		if (buffer)
+		{
+			memcpy(buffer, &xip[i], sizeof (TransactionId));
+			buffer += sizeof (TransactionId);
+		}
+		count++;
+	}
+	return count;
+}
+
+/*
+ * Send the snapshot down to the PGXC node.
+ * If the node has received a snapshot before, and the set of running
+ * transactions is mostly the same, send xmin, xmax and the difference of the
+ * xid lists only ('z' message), otherwise send the full snapshot ('s').
  */
 int
 pgxc_node_send_snapshot(PGXCNodeHandle *handle, Snapshot snapshot)
 {
-	int			msglen;
-	int			nval;
-	int			i;
+	TransactionId *xip;
+	int			nremoved = 0;
+	int			nadded = 0;
 
 	/* Invalid connection state, return error */
 	if (handle->state != DN_CONNECTION_STATE_IDLE)
 		return EOF;
 
-	/* calculate message length */
-	msglen = 20;
+	/*
+	 * The snapshot of a statement running on a single node is taken by the
+	 * node itself, an invalid xmin tells it so. A standby always takes its
+	 * own snapshot, it does not know the transactions of the cluster.
+	 */
+	if (handle->standby || StatementLocalSnapshots())
+	{
+		SnapshotData local;
+
+		local.xmin = InvalidTransactionId;
+		local.xmax = InvalidTransactionId;
+		local.xcnt = 0;
+		local.xip = NULL;
+
+		if (ensure_out_buffer_capacity(handle->outEnd + SNAPSHOT_MSG_LEN(&local),
+									   handle) != 0)
+		{
+			add_error_message(handle, "out of memory");
+			return EOF;
+		}
+
+		handle->outEnd += write_snapshot_msg(handle->outBuffer + handle->outEnd,
+											 &local);
+		/* the next snapshot is sent in full */
+		handle->last_xcnt = -1;
+		return 0;
+	}
+
+	xip = get_sorted_xip(snapshot);
+
+	if (handle->last_xcnt >= 0)
+	{
+		nremoved = xip_difference(handle->last_xip, handle->last_xcnt,
+								  xip, snapshot->xcnt, NULL);
+		nadded = xip_difference(xip, snapshot->xcnt,
+								handle->last_xip, handle->last_xcnt, NULL);
+	}
+
+	if (handle->last_xcnt >= 0 && nremoved + nadded < snapshot->xcnt)
+	{
+		/* msgLen + xmin, xmax, RecentGlobalXmin + two counted lists */
+		int			msglen = 4 + 3 * sizeof (TransactionId) +
+							 4 + nremoved * sizeof (TransactionId) +
+							 4 + nadded * sizeof (TransactionId);
+		int			nval;
+		char	   *buf;
+
+		/* msgType + msgLen */
+		if (ensure_out_buffer_capacity(handle->outEnd + 1 + msglen,
+									   handle) != 0)
+		{
+			add_error_message(handle, "out of memory");
+			return EOF;
+		}
+
+		buf = handle->outBuffer + handle->outEnd;
+		*buf++ = 'z';
+		nval = htonl(msglen);
+		memcpy(buf, &nval, 4);
+		buf += 4;
+		memcpy(buf, &snapshot->xmin, sizeof (TransactionId));
+		buf += sizeof (TransactionId);
+		memcpy(buf, &snapshot->xmax, sizeof (TransactionId));
+		buf += sizeof (TransactionId);
+		memcpy(buf, &RecentGlobalXmin, sizeof (TransactionId));
+		buf += sizeof (TransactionId);
+
+		/* xids not running anymore */
+		nval = htonl(nremoved);
+		memcpy(buf, &nval, 4);
+		buf += 4;
+		buf += xip_difference(handle->last_xip, handle->last_xcnt,
+							  xip, snapshot->xcnt, buf) * sizeof (TransactionId);
+
+		/* newly started xids */
+		nval = htonl(nadded);
+		memcpy(buf, &nval, 4);
+		buf += 4;
+		(void) xip_difference(xip, snapshot->xcnt,
+							  handle->last_xip, handle->last_xcnt, buf);
+
+		handle->outEnd += 1 + msglen;
+	}
+	else
+	{
+		/* msgType + msgLen */
+		if (ensure_out_buffer_capacity(handle->outEnd + SNAPSHOT_MSG_LEN(snapshot),
+									   handle) != 0)
+		{
+			add_error_message(handle, "out of memory");
+			return EOF;
+		}
+
+		handle->outEnd += write_snapshot_msg(handle->outBuffer + handle->outEnd,
+											 snapshot);
+	}
+
+	/* Remember what the node has now */
+	if (handle->last_xip_size < snapshot->xcnt)
+	{
+		int			newsize = Max(snapshot->xcnt, 64);
+
+		if (handle->last_xip)
+			pfree(handle->last_xip);
+		handle->last_xip = (TransactionId *)
+			MemoryContextAlloc(TopMemoryContext,
+							   newsize * sizeof(TransactionId));
+		handle->last_xip_size = newsize;
+	}
 	if (snapshot->xcnt > 0)
-		msglen += snapshot->xcnt * 4;
+		memcpy(handle->last_xip, xip, snapshot->xcnt * sizeof(TransactionId));
+	handle->last_xcnt = snapshot->xcnt;
+
+	return 0;
+}
+
+/*
+ * Send the timestamp down to the PGXC node
+ */
+int
+pgxc_node_send_timestamp(PGXCNodeHandle *handle, TimestampTz timestamp)
+{
+	/* Invalid connection state, return error */
+	if (handle->state != DN_CONNECTION_STATE_IDLE)
+		return EOF;
 
 	/* msgType + msgLen */
-	if (ensure_out_buffer_capacity(handle->outEnd + 1 + msglen, handle) != 0)
+	if (ensure_out_buffer_capacity(handle->outEnd + TIMESTAMP_MSG_LEN,
+								   handle) != 0)
 	{
 		add_error_message(handle, "out of memory");
 		return EOF;
 	}
 
-	handle->outBuffer[handle->outEnd++] = 's';
-	msglen = htonl(msglen);
-	memcpy(handle->outBuffer + handle->outEnd, &msglen, 4);
-	handle->outEnd += 4;
-
-	memcpy(handle->outBuffer + handle->outEnd, &snapshot->xmin, sizeof (TransactionId));
-	handle->outEnd += sizeof (TransactionId);
+	handle->outEnd += write_timestamp_msg(handle->outBuffer + handle->outEnd,
+										  timestamp);
 
-	memcpy(handle->outBuffer + handle->outEnd, &snapshot->xmax, sizeof (TransactionId));
-	handle->outEnd += sizeof (TransactionId);
+	return 0;
+}
 
-	memcpy(handle->outBuffer + handle->outEnd, &RecentGlobalXmin, sizeof (TransactionId));
-	handle->outEnd += sizeof (TransactionId);
+/*
+ * Add the GXID message to the command prefix
+ */
+void
+pgxc_node_prefix_gxid(StringInfo prefix, GlobalTransactionId gxid)
+{
+	enlargeStringInfo(prefix, GXID_MSG_LEN);
+	prefix->len += write_gxid_msg(prefix->data + prefix->len, gxid);
+}
 
-	nval = htonl(snapshot->xcnt);
-	memcpy(handle->outBuffer + handle->outEnd, &nval, 4);
-	handle->outEnd += 4;
+/*
+ * Add the Command ID message to the command prefix, if command IDs are sent
+ */
+void
+pgxc_node_prefix_cmd_id(StringInfo prefix, CommandId cid)
+{
+	if (!IsSendCommandId())
+		return;
 
-	for (i = 0; i < snapshot->xcnt; i++)
-	{
-		memcpy(handle->outBuffer + handle->outEnd, &snapshot->xip[i], sizeof
-				(TransactionId));
-		handle->outEnd += sizeof (TransactionId);
-	}
+	enlargeStringInfo(prefix, 1 + CMD_ID_MSG_LEN);
+	prefix->len += write_cmd_id_msg(prefix->data + prefix->len, cid);
+}
 
-	return 0;
+/*
+ * Add the timestamp message to the command prefix
+ */
+void
+pgxc_node_prefix_timestamp(StringInfo prefix, TimestampTz timestamp)
+{
+	enlargeStringInfo(prefix, TIMESTAMP_MSG_LEN);
+	prefix->len += write_timestamp_msg(prefix->data + prefix->len, timestamp);
 }
 
 /*
- * Send the timestamp down to the PGXC node
+ * Send the messages accumulated in the command prefix down to the PGXC node
  */
 int
-pgxc_node_send_timestamp(PGXCNodeHandle *handle, TimestampTz timestamp)
+pgxc_node_send_prefix(PGXCNodeHandle *handle, StringInfo prefix)
 {
-	int		msglen = 12; /* 4 bytes for msglen and 8 bytes for timestamp (int64) */
-	uint32	n32;
-	int64	i = (int64) timestamp;
+	if (prefix->len == 0)
+		return 0;
 
 	/* Invalid connection state, return error */
 	if (handle->state != DN_CONNECTION_STATE_IDLE)
 		return EOF;
 
-	/* msgType + msgLen */
-	if (ensure_out_buffer_capacity(handle->outEnd + 1 + msglen, handle) != 0)
+	if (ensure_out_buffer_capacity(handle->outEnd + prefix->len, handle) != 0)
 	{
 		add_error_message(handle, "out of memory");
 		return EOF;
 	}
-	handle->outBuffer[handle->outEnd++] = 't';
-	msglen = htonl(msglen);
-	memcpy(handle->outBuffer + handle->outEnd, &msglen, 4);
-	handle->outEnd += 4;
-
-	/* High order half first */
-#ifdef INT64_IS_BUSTED
-	/* don't try a right shift of 32 on a 32-bit word */
-	n32 = (i < 0) ? -1 : 0;
-#else
-	n32 = (uint32) (i >> 32);
-#endif
-	n32 = htonl(n32);
-	memcpy(handle->outBuffer + handle->outEnd, &n32, 4);
-	handle->outEnd += 4;
 
-	/* Now the low order half */
-	n32 = (uint32) i;
-	n32 = htonl(n32);
-	memcpy(handle->outBuffer + handle->outEnd, &n32, 4);
-	handle->outEnd += 4;
+	memcpy(handle->outBuffer + handle->outEnd, prefix->data, prefix->len);
+	handle->outEnd += prefix->len;
 
 	return 0;
 }
@@ -1917,7 +3519,11 @@ get_any_handle(List *datanodelist)
 				{
 					/* The node is requested */
 					List   *allocate = list_make1_int(node);
-					int    *fds = PoolManagerGetConnections(allocate, NIL);
+					uint32 *param_hashes;
+					int		prefetched;
+					int    *fds = PoolManagerGetConnections(allocate, NIL, NIL,
+											PGXCNodeGetSessionParamHash(),
+											&param_hashes, &prefetched);
 
 					if (!fds)
 					{
@@ -1925,7 +3531,8 @@ get_any_handle(List *datanodelist)
 								(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
 								 errmsg("Failed to get pooled connections")));
 					}
-					pgxc_node_init(&dn_handles[node], fds[0], true);
+					pgxc_node_init(&dn_handles[node], fds[0], true,
+								   param_hashes[0]);
 					datanode_count++;
 
 					/*
@@ -1944,6 +3551,67 @@ get_any_handle(List *datanodelist)
 	return NULL;
 }
 
+/*
+ * Get the handle of a Datanode standby. Unlike get_handles, return NULL if
+ * the pooler can not connect to it, the caller may use the Datanode instead.
+ */
+PGXCNodeHandle *
+get_standby_handle(int node)
+{
+	PGXCNodeHandle *handle;
+	List	   *allocate;
+	uint32	   *param_hashes;
+	int			prefetched;
+	int		   *fds;
+
+	Assert(PGXCNodeStandbyOf(node) >= 0);
+
+	handle = &dn_handles[node];
+	dn_usage[node] |= 1;
+	if (handle->sock != NO_SOCKET)
+		return handle;
+
+	allocate = list_make1_int(node);
+	fds = PoolManagerGetConnections(allocate, NIL, NIL,
+									PGXCNodeGetSessionParamHash(),
+									&param_hashes, &prefetched);
+	list_free(allocate);
+	if (!fds)
+		return NULL;
+
+	pgxc_node_init(handle, fds[0], true, param_hashes[0]);
+	datanode_count++;
+	pfree(fds);
+	pfree(param_hashes);
+
+	return handle;
+}
+
+/*
+ * Datanodes the session is likely to use in the current transaction, which
+ * it has no connections to and has not requested in the allocate list
+ */
+static List *
+get_prefetch_list(List *allocate)
+{
+	List	   *result = NIL;
+	int			i;
+
+	for (i = 0; i < NumDataNodes; i++)
+	{
+		uint8		usage = dn_usage[i] & PGXC_NODE_PREFETCH_MASK;
+		int			used = 0;
+
+		if (dn_handles[i].sock != NO_SOCKET || list_member_int(allocate, i))
+			continue;
+		for (; usage; usage &= usage - 1)
+			used++;
+		if (used >= PGXC_NODE_PREFETCH_MIN)
+			result = lappend_int(result, i);
+	}
+	return result;
+}
+
 /*
  * for specified list return array of PGXCNodeHandles
  * acquire from pool if needed.
@@ -2011,6 +3679,7 @@ get_handles(List *datanodelist, List *coordlist, bool is_coord_only_query, bool
 			{
 				node_handle = &dn_handles[i];
 				result->datanode_handles[i] = node_handle;
+				dn_usage[i] |= 1;
 				if (node_handle->sock == NO_SOCKET)
 					dn_allocate = lappend_int(dn_allocate, i);
 			}
@@ -2036,7 +3705,7 @@ get_handles(List *datanodelist, List *coordlist, bool is_coord_only_query, bool
 			{
 				int	node = lfirst_int(node_list_item);
 
-				if (node < 0 || node >= NumDataNodes)
+				if (node < 0 || node >= NumDataNodes + NumStandbyNodes)
 				{
 					ereport(ERROR,
 							(errcode(ERRCODE_OUT_OF_MEMORY),
@@ -2045,6 +3714,7 @@ get_handles(List *datanodelist, List *coordlist, bool is_coord_only_query, bool
 
 				node_handle = &dn_handles[node];
 				result->datanode_handles[i++] = node_handle;
+				dn_usage[node] |= 1;
 				if (node_handle->sock == NO_SOCKET)
 					dn_allocate = lappend_int(dn_allocate, node);
 			}
@@ -2125,7 +3795,18 @@ get_handles(List *datanodelist, List *coordlist, bool is_coord_only_query, bool
 	if (dn_allocate || co_allocate)
 	{
 		int	j = 0;
-		int	*fds = PoolManagerGetConnections(dn_allocate, co_allocate);
+		uint32 *param_hashes;
+		List   *prefetch = NIL;
+		int		prefetched;
+		int	   *fds;
+
+		if (PrefetchRemoteConnections && dn_allocate)
+			prefetch = get_prefetch_list(dn_allocate);
+
+		fds = PoolManagerGetConnections(dn_allocate, co_allocate, prefetch,
+										is_global_session ?
+										PGXCNodeGetSessionParamHash() : 0,
+										&param_hashes, &prefetched);
 
 		if (!fds)
 		{
@@ -2141,6 +3822,7 @@ get_handles(List *datanodelist, List *coordlist, bool is_coord_only_query, bool
 				list_free(dn_allocate);
 			if (co_allocate)
 				list_free(co_allocate);
+			list_free(prefetch);
 			ereport(ERROR,
 					(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
 					 errmsg("Failed to get pooled connections")));
@@ -2151,9 +3833,10 @@ get_handles(List *datanodelist, List *coordlist, bool is_coord_only_query, bool
 			foreach(node_list_item, dn_allocate)
 			{
 				int			node = lfirst_int(node_list_item);
+				uint32		param_hash = param_hashes[j];
 				int			fdsock = fds[j++];
 
-				if (node < 0 || node >= NumDataNodes)
+				if (node < 0 || node >= NumDataNodes + NumStandbyNodes)
 				{
 					ereport(ERROR,
 							(errcode(ERRCODE_OUT_OF_MEMORY),
@@ -2161,7 +3844,8 @@ get_handles(List *datanodelist, List *coordlist, bool is_coord_only_query, bool
 				}
 
 				node_handle = &dn_handles[node];
-				pgxc_node_init(node_handle, fdsock, is_global_session);
+				pgxc_node_init(node_handle, fdsock, is_global_session,
+							   param_hash);
 				dn_handles[node] = *node_handle;
 				datanode_count++;
 			}
@@ -2172,6 +3856,7 @@ get_handles(List *datanodelist, List *coordlist, bool is_coord_only_query, bool
 			foreach(node_list_item, co_allocate)
 			{
 				int			node = lfirst_int(node_list_item);
+				uint32		param_hash = param_hashes[j];
 				int			fdsock = fds[j++];
 
 				if (node < 0 || node >= NumCoords)
@@ -2182,13 +3867,29 @@ get_handles(List *datanodelist, List *coordlist, bool is_coord_only_query, bool
 				}
 
 				node_handle = &co_handles[node];
-				pgxc_node_init(node_handle, fdsock, is_global_session);
+				pgxc_node_init(node_handle, fdsock, is_global_session,
+							   param_hash);
 				co_handles[node] = *node_handle;
 				coord_count++;
 			}
 		}
+		/* The prefetched Datanodes come last, the pooler got a prefix */
+		foreach(node_list_item, prefetch)
+		{
+			int			node = lfirst_int(node_list_item);
+
+			if (prefetched-- == 0)
+				break;
+			node_handle = &dn_handles[node];
+			pgxc_node_init(node_handle, fds[j], is_global_session,
+						   param_hashes[j]);
+			j++;
+			datanode_count++;
+		}
+		list_free(prefetch);
 
 		pfree(fds);
+		pfree(param_hashes);
 
 		if (co_allocate)
 			list_free(co_allocate);
@@ -2219,7 +3920,7 @@ get_current_handles(void)
 	result->dn_conn_count = 0;
 
 	result->datanode_handles = (PGXCNodeHandle **)
-							   palloc(NumDataNodes * sizeof(PGXCNodeHandle *));
+		palloc((NumDataNodes + NumStandbyNodes) * sizeof(PGXCNodeHandle *));
 	if (!result->datanode_handles)
 	{
 		ereport(ERROR,
@@ -2227,7 +3928,7 @@ get_current_handles(void)
 				 errmsg("out of memory")));
 	}
 
-	for (i = 0; i < NumDataNodes; i++)
+	for (i = 0; i < NumDataNodes + NumStandbyNodes; i++)
 	{
 		node_handle = &dn_handles[i];
 		if (node_handle->sock != NO_SOCKET)
@@ -2480,6 +4181,21 @@ PGXCNodeSetParam(bool local, const char *name, const char *value)
 void
 PGXCNodeResetParams(bool only_local)
 {
+	if (!only_local)
+	{
+		int			i;
+
+		/*
+		 * Remote sessions still have the parameters, but they do not match
+		 * the session anymore, so they should be reset when released.
+		 */
+		if (dn_handles)
+			for (i = 0; i < NumDataNodes; i++)
+				dn_handles[i].param_hash = 0;
+		if (co_handles)
+			for (i = 0; i < NumCoords; i++)
+				co_handles[i].param_hash = 0;
+	}
 	if (!only_local && session_param_list)
 	{
 		/* need to explicitly pfree session stuff, it is in TopMemoryContext */
@@ -2578,6 +4294,28 @@ PGXCNodeGetSessionParamStr(void)
 }
 
 
+/*
+ * Returns hash of the SET commands initializing remote session, zero if there
+ * are no session parameters. The pooler prefers to give out connections
+ * whose remote sessions already have the same parameters, so the commands
+ * need not to be sent again.
+ */
+uint32
+PGXCNodeGetSessionParamHash(void)
+{
+	char	   *paramstr = PGXCNodeGetSessionParamStr();
+	uint32		hash;
+
+	if (paramstr == NULL)
+		return 0;
+
+	hash = DatumGetUInt32(hash_any((unsigned char *) paramstr,
+								   strlen(paramstr)));
+	/* zero is reserved for remote sessions with default parameters */
+	return hash == 0 ? 1 : hash;
+}
+
+
 /*
  * Returns SET commands needed to initialize transaction on a remote session.
  * The command may already be biult and valid, return it right away if the case.
@@ -2694,21 +4432,436 @@ DoInvalidateRemoteHandles(void)
 		handle = &co_handles[i];
 		if (handle->sock != NO_SOCKET)
 			result = true;
+		pgxc_node_unwatch(handle);
 		handle->sock = NO_SOCKET;
 		handle->inStart = handle->inEnd = handle->inCursor = 0;
-		handle->outEnd = 0;
+		pgxc_node_discard_output(handle);
 	}
-	for (i = 0; i < NumDataNodes; i++)
+	for (i = 0; i < NumDataNodes + NumStandbyNodes; i++)
 	{
 		handle = &dn_handles[i];
 		if (handle->sock != NO_SOCKET)
 			result = true;
+		pgxc_node_unwatch(handle);
 		handle->sock = NO_SOCKET;
 		handle->inStart = handle->inEnd = handle->inCursor = 0;
-		handle->outEnd = 0;
+		pgxc_node_discard_output(handle);
 	}
 
 	InitMultinodeExecutor(true);
 
 	return result;
 }
+
+
+/*
+ * Size of the server-wide network activity counters
+ */
+Size
+PGXCNodeStatsShmemSize(void)
+{
+	return add_size(offsetof(PGXCNodeStatsArray, entries),
+					mul_size(MaxCoords + 2 * MaxDataNodes,
+							 sizeof(PGXCNodeStatsEntry)));
+}
+
+/*
+ * Allocate and initialize the server-wide network activity counters
+ */
+void
+PGXCNodeStatsShmemInit(void)
+{
+	bool		found;
+	int			i;
+
+	NodeStats = (PGXCNodeStatsArray *)
+		ShmemInitStruct("Remote node statistics", PGXCNodeStatsShmemSize(),
+						&found);
+	if (!found)
+	{
+		SpinLockInit(&NodeStats->mutex);
+		/* Datanodes may have a standby each */
+		NodeStats->nentries = MaxCoords + 2 * MaxDataNodes;
+		for (i = 0; i < NodeStats->nentries; i++)
+		{
+			NodeStats->entries[i].nodeoid = InvalidOid;
+			SpinLockInit(&NodeStats->entries[i].mutex);
+			memset(&NodeStats->entries[i].stats, 0, sizeof(PGXCNodeStats));
+			NodeStats->entries[i].standby_lag = -1;
+			NodeStats->entries[i].standby_lag_time = 0;
+		}
+	}
+}
+
+/*
+ * Find the server-wide counters of the node, assign an entry if the node
+ * does not have one yet. Returns NULL if all the entries are taken:
+ * entries of the dropped nodes are not reclaimed until restart.
+ */
+static PGXCNodeStatsEntry *
+get_node_stats_entry(Oid nodeoid)
+{
+	PGXCNodeStatsEntry *entry = NULL;
+	int			i;
+
+	/* Assigned entries never change, so look for it without the lock */
+	for (i = 0; i < NodeStats->nentries; i++)
+	{
+		if (NodeStats->entries[i].nodeoid == nodeoid)
+			return &NodeStats->entries[i];
+		if (!OidIsValid(NodeStats->entries[i].nodeoid))
+			break;
+	}
+
+	SpinLockAcquire(&NodeStats->mutex);
+	for (i = 0; i < NodeStats->nentries; i++)
+	{
+		if (NodeStats->entries[i].nodeoid == nodeoid)
+		{
+			entry = &NodeStats->entries[i];
+			break;
+		}
+		if (!OidIsValid(NodeStats->entries[i].nodeoid))
+		{
+			entry = &NodeStats->entries[i];
+			entry->nodeoid = nodeoid;
+			break;
+		}
+	}
+	SpinLockRelease(&NodeStats->mutex);
+
+	return entry;
+}
+
+static void
+report_handle_stats(PGXCNodeHandle *handle)
+{
+	PGXCNodeStatsEntry *entry;
+	PGXCNodeStats *stats = &handle->stats;
+	PGXCNodeStats *reported = &handle->stats_reported;
+	int			i;
+
+	/* Any activity is seen as some data sent or received */
+	if (stats->bytes_sent == reported->bytes_sent &&
+		stats->bytes_received == reported->bytes_received)
+		return;
+
+	entry = get_node_stats_entry(handle->nodeoid);
+	if (entry == NULL)
+		return;
+
+	SpinLockAcquire(&entry->mutex);
+	entry->stats.bytes_sent += stats->bytes_sent - reported->bytes_sent;
+	entry->stats.bytes_received +=
+		stats->bytes_received - reported->bytes_received;
+	entry->stats.messages_sent +=
+		stats->messages_sent - reported->messages_sent;
+	entry->stats.messages_received +=
+		stats->messages_received - reported->messages_received;
+	entry->stats.send_time += stats->send_time - reported->send_time;
+	entry->stats.wait_time += stats->wait_time - reported->wait_time;
+	for (i = 0; i < PGXC_NODE_LATENCY_BUCKETS; i++)
+		entry->stats.latency[i] += stats->latency[i] - reported->latency[i];
+	SpinLockRelease(&entry->mutex);
+
+	memcpy(reported, stats, sizeof(PGXCNodeStats));
+}
+
+/*
+ * Add the network activity of the session since the last call to the
+ * server-wide counters. Called at the end of transaction.
+ */
+void
+PGXCNodeReportStats(void)
+{
+	int			i;
+
+	if (NodeStats == NULL)
+		return;
+
+	if (dn_handles)
+		for (i = 0; i < NumDataNodes + NumStandbyNodes; i++)
+			report_handle_stats(&dn_handles[i]);
+	if (co_handles)
+		for (i = 0; i < NumCoords; i++)
+			report_handle_stats(&co_handles[i]);
+}
+
+/*
+ * Does the session hold a connection to the Datanode?
+ */
+bool
+PGXCNodeIsConnected(int nodeid)
+{
+	if (dn_handles == NULL || nodeid < 0 ||
+		nodeid >= NumDataNodes + NumStandbyNodes)
+		return false;
+	return dn_handles[nodeid].sock != NO_SOCKET;
+}
+
+/*
+ * Average round trip time to the Datanode in microseconds, estimated from
+ * the server-wide latency counters, -1 if no round trip was counted yet.
+ * The round trips of a bucket are counted at its upper bound, and twice the
+ * last bound for the last bucket.
+ */
+int64
+PGXCNodeGetLatency(int nodeid)
+{
+	Oid			nodeoid;
+	PGXCNodeStatsEntry *entry = NULL;
+	int64		count = 0;
+	int64		total = 0;
+	int			i;
+
+	if (NodeStats == NULL || dn_handles == NULL ||
+		nodeid < 0 || nodeid >= NumDataNodes + NumStandbyNodes)
+		return -1;
+
+	/* Do not assign an entry, a node without one has no counters */
+	nodeoid = dn_handles[nodeid].nodeoid;
+	for (i = 0; i < NodeStats->nentries; i++)
+	{
+		if (NodeStats->entries[i].nodeoid == nodeoid)
+		{
+			entry = &NodeStats->entries[i];
+			break;
+		}
+		if (!OidIsValid(NodeStats->entries[i].nodeoid))
+			break;
+	}
+	if (entry == NULL)
+		return -1;
+
+	SpinLockAcquire(&entry->mutex);
+	for (i = 0; i < PGXC_NODE_LATENCY_BUCKETS; i++)
+	{
+		int64		bound = i < PGXC_NODE_LATENCY_BUCKETS - 1 ?
+			latency_bounds[i] : 2 * latency_bounds[i - 1];
+
+		count += entry->stats.latency[i];
+		total += entry->stats.latency[i] * bound;
+	}
+	SpinLockRelease(&entry->mutex);
+
+	return count > 0 ? total / count : -1;
+}
+
+/*
+ * Index of the Datanode the standby replicates, -1 if the node is not a
+ * standby
+ */
+int
+PGXCNodeStandbyOf(int nodeid)
+{
+	if (dn_handles == NULL || nodeid < NumDataNodes ||
+		nodeid >= NumDataNodes + NumStandbyNodes)
+		return -1;
+	return standby_of[nodeid - NumDataNodes];
+}
+
+/*
+ * Remember the lag a standby has reported, in milliseconds, -1 if the
+ * standby can not tell
+ */
+void
+PGXCNodeStandbyReport(Oid nodeoid, int lag)
+{
+	PGXCNodeStatsEntry *entry;
+
+	if (NodeStats == NULL)
+		return;
+
+	entry = get_node_stats_entry(nodeoid);
+	if (entry == NULL)
+		return;
+
+	SpinLockAcquire(&entry->mutex);
+	entry->standby_lag = lag;
+	entry->standby_lag_time = GetCurrentTimestamp();
+	SpinLockRelease(&entry->mutex);
+}
+
+/*
+ * Get the lag last reported by the standby, if any session of the server has
+ * heard from it recently enough. Returns false if the lag is unknown.
+ */
+bool
+PGXCNodeGetStandbyLag(int nodeid, int *lag)
+{
+	PGXCNodeStatsEntry *entry;
+	TimestampTz reported;
+
+	if (NodeStats == NULL || PGXCNodeStandbyOf(nodeid) < 0)
+		return false;
+
+	entry = get_node_stats_entry(dn_handles[nodeid].nodeoid);
+	if (entry == NULL)
+		return false;
+
+	SpinLockAcquire(&entry->mutex);
+	*lag = entry->standby_lag;
+	reported = entry->standby_lag_time;
+	SpinLockRelease(&entry->mutex);
+
+	return reported != 0 &&
+		!TimestampDifferenceExceeds(reported, GetCurrentTimestamp(),
+									STANDBY_LAG_VALIDITY);
+}
+
+/*
+ * Output one row of pg_stat_get_remote_nodes or
+ * pg_stat_get_session_remote_nodes. Nodes dropped since are skipped.
+ */
+static void
+put_node_stats_row(Tuplestorestate *tupstore, TupleDesc tupdesc,
+				   Oid nodeoid, PGXCNodeStats *stats)
+{
+#define PG_STAT_GET_REMOTE_NODES_COLS 9
+	Datum		values[PG_STAT_GET_REMOTE_NODES_COLS];
+	bool		nulls[PG_STAT_GET_REMOTE_NODES_COLS];
+	Datum		latency[PGXC_NODE_LATENCY_BUCKETS];
+	HeapTuple	tuple;
+	Form_pgxc_node nodeForm;
+	int			i;
+
+	tuple = SearchSysCache1(PGXCNODEOID, ObjectIdGetDatum(nodeoid));
+	if (!HeapTupleIsValid(tuple))
+		return;
+	nodeForm = (Form_pgxc_node) GETSTRUCT(tuple);
+
+	MemSet(nulls, 0, sizeof(nulls));
+	values[0] = NameGetDatum(&nodeForm->node_name);
+	values[1] = CStringGetTextDatum(nodeForm->node_type == PGXC_NODE_COORDINATOR ?
+									"coordinator" :
+									nodeForm->node_type == PGXC_NODE_DATANODE_STANDBY ?
+									"standby" : "datanode");
+	values[2] = Int64GetDatum(stats->bytes_sent);
+	values[3] = Int64GetDatum(stats->bytes_received);
+	values[4] = Int64GetDatum(stats->messages_sent);
+	values[5] = Int64GetDatum(stats->messages_received);
+	values[6] = Float8GetDatum(stats->send_time / 1000.0);
+	values[7] = Float8GetDatum(stats->wait_time / 1000.0);
+	for (i = 0; i < PGXC_NODE_LATENCY_BUCKETS; i++)
+		latency[i] = Int64GetDatum(stats->latency[i]);
+	values[8] = PointerGetDatum(construct_array(latency,
+												PGXC_NODE_LATENCY_BUCKETS,
+												INT8OID, sizeof(int64),
+												FLOAT8PASSBYVAL, 'd'));
+
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	ReleaseSysCache(tuple);
+}
+
+/*
+ * Set up the tuplestore to return the rows of a statistics SRF
+ */
+static Tuplestorestate *
+node_stats_tuplestore(FunctionCallInfo fcinfo, TupleDesc *tupdesc)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = *tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return tupstore;
+}
+
+/*
+ * pg_stat_get_remote_nodes
+ *    SQL SRF showing the network activity counters of all the sessions of
+ *    the server, one row per remote node.
+ */
+Datum
+pg_stat_get_remote_nodes(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	Oid		   *nodeoids;
+	PGXCNodeStats *stats;
+	int			nstats = 0;
+	int			i;
+
+	tupstore = node_stats_tuplestore(fcinfo, &tupdesc);
+
+	/* Our own counters are not reported yet */
+	PGXCNodeReportStats();
+
+	/* Copy the counters first, nodes are looked up in the catalog */
+	nodeoids = (Oid *) palloc(NodeStats->nentries * sizeof(Oid));
+	stats = (PGXCNodeStats *) palloc(NodeStats->nentries * sizeof(PGXCNodeStats));
+	for (i = 0; i < NodeStats->nentries; i++)
+	{
+		PGXCNodeStatsEntry *entry = &NodeStats->entries[i];
+
+		if (!OidIsValid(entry->nodeoid))
+			break;
+		nodeoids[nstats] = entry->nodeoid;
+		SpinLockAcquire(&entry->mutex);
+		memcpy(&stats[nstats], &entry->stats, sizeof(PGXCNodeStats));
+		SpinLockRelease(&entry->mutex);
+		nstats++;
+	}
+
+	for (i = 0; i < nstats; i++)
+		put_node_stats_row(tupstore, tupdesc, nodeoids[i], &stats[i]);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * pg_stat_get_session_remote_nodes
+ *    SQL SRF showing the network activity counters of the current session,
+ *    one row per remote node the session has communicated with.
+ */
+Datum
+pg_stat_get_session_remote_nodes(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	int			i;
+
+	tupstore = node_stats_tuplestore(fcinfo, &tupdesc);
+
+	if (dn_handles)
+		for (i = 0; i < NumDataNodes + NumStandbyNodes; i++)
+			if (dn_handles[i].stats.bytes_sent > 0)
+				put_node_stats_row(tupstore, tupdesc, dn_handles[i].nodeoid,
+								   &dn_handles[i].stats);
+	if (co_handles)
+		for (i = 0; i < NumCoords; i++)
+			if (co_handles[i].stats.bytes_sent > 0)
+				put_node_stats_row(tupstore, tupdesc, co_handles[i].nodeoid,
+								   &co_handles[i].stats);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
@@ -491,7 +491,7 @@ pool_putmessage(PoolPort *port, char msgtype, const char *s, size_t len)
 	return 0;
 }
 
-/* message code('f'), size(8), node_count */
+/* message code('f'), size(8 + 4 * node_count), node_count, then the tags */
 #define SEND_MSG_BUFFER_SIZE 9
 /* message code('s'), result */
 #define SEND_RES_BUFFER_SIZE 5
@@ -499,28 +499,35 @@ pool_putmessage(PoolPort *port, char msgtype, const char *s, size_t len)
 
 /*
  * Build up a message carrying file descriptors or process numbers and send them over specified
- * connection
+ * connection. Every descriptor is accompanied with a tag, the pooler uses it
+ * to tell what session parameters are set on the connection.
  */
 int
-pool_sendfds(PoolPort *port, int *fds, int count)
+pool_sendfds(PoolPort *port, int *fds, uint32 *tags, int count)
 {
-	struct iovec iov[1];
+	struct iovec iov[2];
 	struct msghdr msg;
 	char		buf[SEND_MSG_BUFFER_SIZE];
+	uint32		ntags[count > 0 ? count : 1];
 	uint		n32;
 	int                     controllen =  CMSG_LEN(count * sizeof(int));
 	struct cmsghdr *cmptr = NULL;
+	int			i;
 
 	buf[0] = 'f';
-	n32 = htonl((uint32) 8);
+	n32 = htonl((uint32) (8 + count * 4));
 	memcpy(buf + 1, &n32, 4);
 	n32 = htonl((uint32) count);
 	memcpy(buf + 5, &n32, 4);
+	for (i = 0; i < count; i++)
+		ntags[i] = htonl(tags[i]);
 
 	iov[0].iov_base = buf;
 	iov[0].iov_len = SEND_MSG_BUFFER_SIZE;
+	iov[1].iov_base = (char *) ntags;
+	iov[1].iov_len = count * 4;
 	msg.msg_iov = iov;
-	msg.msg_iovlen = 1;
+	msg.msg_iovlen = count > 0 ? 2 : 1;
 	msg.msg_name = NULL;
 	msg.msg_namelen = 0;
 	if (count == 0)
@@ -541,7 +548,7 @@ pool_sendfds(PoolPort *port, int *fds, int count)
 		memcpy(CMSG_DATA(CMSG_FIRSTHDR(&msg)), fds, count * sizeof(int));
 	}
 
-	if (sendmsg(Socket(*port), &msg, 0) != SEND_MSG_BUFFER_SIZE)
+	if (sendmsg(Socket(*port), &msg, 0) != SEND_MSG_BUFFER_SIZE + count * 4)
 	{
 		if (cmptr)
 			free(cmptr);
@@ -557,9 +564,11 @@ pool_sendfds(PoolPort *port, int *fds, int count)
 
 /*
  * Read a message from the specified connection carrying file descriptors
+ * and their tags. At least mincount and at most count descriptors are
+ * expected, return the number of the received descriptors or EOF.
  */
 int
-pool_recvfds(PoolPort *port, int *fds, int count)
+pool_recvfds(PoolPort *port, int *fds, uint32 *tags, int mincount, int count)
 {
 	int			r;
 	uint		n32;
@@ -568,6 +577,7 @@ pool_recvfds(PoolPort *port, int *fds, int count)
 	struct msghdr msg;
 	int                     controllen = CMSG_LEN(count * sizeof(int));
 	struct cmsghdr *cmptr = malloc(CMSG_SPACE(count * sizeof(int)));
+	int			i;
 
 	if (cmptr == NULL)
 		return EOF;
@@ -613,20 +623,10 @@ pool_recvfds(PoolPort *port, int *fds, int count)
 		goto failure;
 	}
 
-	memcpy(&n32, buf + 1, 4);
-	n32 = ntohl(n32);
-	if (n32 != 8)
-	{
-		ereport(ERROR,
-				(errcode(ERRCODE_PROTOCOL_VIOLATION),
-				 errmsg("invalid message size")));
-		goto failure;
-	}
-
 	/*
 	 * If connection count is 0 it means pool does not have connections
 	 * to  fulfill request. Otherwise number of returned connections
-	 * should be equal to requested count. If it not the case consider this
+	 * should be in the requested range. If it not the case consider this
 	 * a protocol violation. (Probably connection went out of sync)
 	 */
 	memcpy(&n32, buf + 5, 4);
@@ -639,17 +639,50 @@ pool_recvfds(PoolPort *port, int *fds, int count)
 		goto failure;
 	}
 
-	if (n32 != count)
+	if (n32 < mincount || n32 > count)
 	{
 		ereport(ERROR,
 				(errcode(ERRCODE_PROTOCOL_VIOLATION),
 				 errmsg("unexpected connection count")));
 		goto failure;
 	}
+	count = n32;
+
+	memcpy(&n32, buf + 1, 4);
+	n32 = ntohl(n32);
+	if (n32 != 8 + count * 4)
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("invalid message size")));
+		goto failure;
+	}
 
 	memcpy(fds, CMSG_DATA(CMSG_FIRSTHDR(&msg)), count * sizeof(int));
+
+	/* The tags follow the header in the stream */
+	r = 0;
+	while (r < count * 4)
+	{
+		int			n = recv(Socket(*port), ((char *) tags) + r,
+							 count * 4 - r, 0);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			ereport(ERROR,
+					(errcode(ERRCODE_PROTOCOL_VIOLATION),
+					 errmsg("incomplete message from client")));
+			goto failure;
+		}
+		r += n;
+	}
+	for (i = 0; i < count; i++)
+		tags[i] = ntohl(tags[i]);
+
 	free(cmptr);
-	return 0;
+	return count;
 failure:
 	free(cmptr);
 	return EOF;
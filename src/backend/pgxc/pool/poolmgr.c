@@ -43,6 +43,7 @@
 #include <signal.h>
 #include "libpq/pqsignal.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include "access/xact.h"
 #include "catalog/pgxc_node.h"
 #include "commands/dbcommands.h"
@@ -59,9 +60,11 @@
 #include "pgxc/pgxc.h"
 #include "pgxc/nodemgr.h"
 #include "pgxc/poolutils.h"
+#include "portability/instr_time.h"
 #include "../interfaces/libpq/libpq-fe.h"
 #include "../interfaces/libpq/libpq-int.h"
 #include "postmaster/postmaster.h"		/* For UnixSocketDir */
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
@@ -69,18 +72,44 @@
 #include <poll.h>
 #include "pgxc/pause.h"
 #include "storage/procarray.h"
+#include "utils/timestamp.h"
 
 /* Configuration options */
 int			PoolConnKeepAlive = 600;
 int			PoolMaintenanceTimeout = 30;
 int			MaxPoolSize = 100;
+int			MinPoolSize = 0;
+int			PoolWaitTimeout = 0;
+int			PoolMaxWaiters = 0;
 int			PoolerPort = 6667;
 
 bool			PersistentConnections = false;
+bool		PoolUseUnixSocket = false;
 
 /* Flag to tell if we are Postgres-XC pooler process */
 static bool am_pgxc_pooler = false;
 
+/* Max number of connections a node pool is grown by at once */
+#define POOL_GROW_MAX_BATCH 16
+
+/*
+ * Sizing of the node pools of the database pools in use, see shrink_pool().
+ * The demand of a node pool is the moving average of the peak number of
+ * connections used between the maintenance rounds, the latest round having
+ * the weight of POOL_DEMAND_WEIGHT. Idle connections are not closed while
+ * the pool is below the demand plus POOL_HEADROOM of it, and at most
+ * 1/POOL_SHRINK_DIVISOR of the connections above that is closed per round.
+ */
+#define POOL_DEMAND_WEIGHT 0.25
+#define POOL_HEADROOM 0.25
+#define POOL_SHRINK_DIVISOR 2
+
+/* Interval of checking free connections for the remote end gone, seconds */
+#define POOL_HEALTH_CHECK_INTERVAL 1
+
+/* Some pools may be below min_pool_size, see warm_up_pools() */
+static bool warm_up_pending = false;
+
 /* Connection information cached */
 typedef struct
 {
@@ -107,40 +136,111 @@ static MemoryContext PoolerCoreContext = NULL;
  * Memory to store Agents
  */
 static MemoryContext PoolerAgentContext = NULL;
+/*
+ * Connection slots, created and destroyed as connections are opened and
+ * closed
+ */
+static MemoryContext PoolerSlotContext = NULL;
 
 /* Pool to all the databases (linked list) */
 static DatabasePool *databasePools = NULL;
 
+/*
+ * Database pools indexed by database, user name and connection options, so
+ * a session start does not need to scan the list
+ */
+typedef struct
+{
+	const char *database;
+	const char *user_name;
+	const char *pgoptions;
+} DatabasePoolKey;
+
+typedef struct
+{
+	DatabasePoolKey key;			/* points to the strings of the pool */
+	DatabasePool   *pool;
+} DatabasePoolEntry;
+
+static HTAB *databasePoolsHash = NULL;
+
 /* PoolAgents and the poll array*/
 static int	agentCount = 0;
 static PoolAgent **poolAgents;
 
 static PoolHandle *poolHandle = NULL;
 
+/*
+ * Session waiting for connections while the node pools it needs are at
+ * max_pool_size, see agent_enqueue()
+ */
+typedef struct
+{
+	PoolAgent  *agent;
+	List	   *datanodelist;
+	List	   *coordlist;
+	uint32		paramhash;
+	TimestampTz	deadline;
+} PoolWaiter;
+
+/* Waiting sessions, in order of arrival */
+static List *poolWaiters = NIL;
+
 static int	is_pool_locked = false;
 static int	server_fd = -1;
 
 static int	node_info_check(PoolAgent *agent);
+static void pool_get_node_oids(Oid **coOids, Oid **dnOids, int *numCo,
+				   int *numDn);
 static void agent_init(PoolAgent *agent, const char *database, const char *user_name,
 	                   const char *pgoptions);
 static void agent_destroy(PoolAgent *agent);
 static void agent_create(void);
 static void agent_handle_input(PoolAgent *agent, StringInfo s);
+static void agent_send_statistics(PoolAgent *agent);
+static bool agent_pools_exhausted(PoolAgent *agent, List *datanodelist,
+					  List *coordlist);
+static bool agent_enqueue(PoolAgent *agent, List *datanodelist,
+			  List *coordlist, uint32 paramhash);
+static void agent_dequeue(PoolAgent *agent);
+static void serve_waiters(void);
+static int	waiters_timeout(void);
 static DatabasePool *create_database_pool(const char *database, const char *user_name, const char *pgoptions);
 static void insert_database_pool(DatabasePool *pool);
 static int	destroy_database_pool(const char *database, const char *user_name);
 static void reload_database_pools(PoolAgent *agent);
 static DatabasePool *find_database_pool(const char *database, const char *user_name, const char *pgoptions);
+static uint32 database_pool_hash(const void *key, Size keysize);
+static void unindex_database_pool(DatabasePool *databasePool);
+static int database_pool_match(const void *key1, const void *key2, Size keysize);
 static DatabasePool *remove_database_pool(const char *database, const char *user_name);
-static int *agent_acquire_connections(PoolAgent *agent, List *datanodelist, List *coordlist);
+static int *agent_acquire_connections(PoolAgent *agent, List *datanodelist,
+						  List *coordlist, List *prefetchlist,
+						  uint32 paramhash, uint32 **paramhashes,
+						  int *prefetched);
 static int cancel_query_on_connections(PoolAgent *agent, List *datanodelist, List *coordlist);
-static PGXCNodePoolSlot *acquire_connection(DatabasePool *dbPool, Oid node);
-static void agent_release_connections(PoolAgent *agent, bool force_destroy);
+static PGXCNodePoolSlot *acquire_connection(DatabasePool *dbPool, Oid node,
+				   uint32 paramhash);
+static void agent_release_connections(PoolAgent *agent, bool force_destroy,
+						  int dn_count, uint32 *dn_paramhashes,
+						  int co_count, uint32 *co_paramhashes);
 static void release_connection(DatabasePool *dbPool, PGXCNodePoolSlot *slot,
 							   Oid node, bool force_destroy);
 static void destroy_slot(PGXCNodePoolSlot *slot);
 static PGXCNodePool *grow_pool(DatabasePool *dbPool, Oid node);
+static PGXCNodePool *get_node_pool(DatabasePool *dbPool, Oid node);
+static int pool_grow_batch(PGXCNodePool *nodePool);
+static bool add_pool_connection(DatabasePool *dbPool, PGXCNodePool *nodePool,
+					NODE_CONNECTION *conn);
+static int connect_pools(int count, DatabasePool **dbPools,
+			  PGXCNodePool **nodePools);
+static void agent_prepare_connections(PoolAgent *agent, List *datanodelist,
+						  List *coordlist);
+static bool warm_up_pools(void);
 static void destroy_node_pool(PGXCNodePool *node_pool);
+static int	check_node_pool(PGXCNodePool *nodePool);
+static void evict_dead_slots(Oid node);
+static void pools_health_check(void);
 static void PoolerLoop(void);
 static int clean_connection(List *node_discard,
 							const char *database,
@@ -150,13 +250,17 @@ static int *abort_pids(int *count,
 					   const char *database,
 					   const char *user_name);
 static char *build_node_conn_str(Oid node, DatabasePool *dbPool);
+static bool node_host_is_local(const char *host);
+static char *local_socket_dir(void);
 /* Signal handlers */
 static void pooler_die(SIGNAL_ARGS);
 static void pooler_quickdie(SIGNAL_ARGS);
 static void PoolManagerConnect(const char *database, const char *user_name,
 		const char *pgoptions);
 static void pooler_sighup(SIGNAL_ARGS);
+static void update_pool_demand(void);
 static bool shrink_pool(DatabasePool *pool);
+static bool pool_in_use(DatabasePool *pool);
 static void pools_maintenance(void);
 /*
  * Flags set by interrupt handlers for later service in the main loop.
@@ -202,6 +306,25 @@ PoolManagerInit()
 											   ALLOCSET_DEFAULT_MINSIZE,
 											   ALLOCSET_DEFAULT_INITSIZE,
 											   ALLOCSET_DEFAULT_MAXSIZE);
+	PoolerSlotContext = SlabContextCreate(PoolerCoreContext,
+										  "PoolerSlotContext",
+										  SLAB_DEFAULT_BLOCK_SIZE,
+										  sizeof(PGXCNodePoolSlot));
+
+	/* Index of the database pools */
+	{
+		HASHCTL			hinfo;
+
+		MemSet(&hinfo, 0, sizeof(hinfo));
+		hinfo.keysize = sizeof(DatabasePoolKey);
+		hinfo.entrysize = sizeof(DatabasePoolEntry);
+		hinfo.hash = database_pool_hash;
+		hinfo.match = database_pool_match;
+		hinfo.hcxt = PoolerCoreContext;
+		databasePoolsHash = hash_create("Database Pools", 64, &hinfo,
+										HASH_ELEM | HASH_FUNCTION |
+										HASH_COMPARE | HASH_CONTEXT);
+	}
 
 	ForgetLockFiles();	
 
@@ -242,6 +365,28 @@ PoolManagerInit()
 }
 
 
+/*
+ * Get the Oids of the remote nodes the agents connect to. The Datanode
+ * standbys are appended to the Datanodes, so the sessions refer to a
+ * standby by its position after the last Datanode.
+ */
+static void
+pool_get_node_oids(Oid **coOids, Oid **dnOids, int *numCo, int *numDn)
+{
+	Oid		   *sbOids;
+	int			numSb;
+
+	PgxcNodeGetOids(coOids, dnOids, numCo, numDn, false);
+	PgxcNodeGetStandbyOids(&sbOids, NULL, &numSb);
+	if (numSb > 0)
+	{
+		*dnOids = (Oid *) repalloc(*dnOids, (*numDn + numSb) * sizeof(Oid));
+		memcpy(*dnOids + *numDn, sbOids, numSb * sizeof(Oid));
+		*numDn += numSb;
+	}
+	pfree(sbOids);
+}
+
 /*
  * Check connection info consistency with system catalogs
  */
@@ -260,7 +405,7 @@ node_info_check(PoolAgent *agent)
 	 * First check if agent's node information matches to current content of the
 	 * shared memory table.
 	 */
-	PgxcNodeGetOids(&coOids, &dnOids, &numCo, &numDn, false);
+	pool_get_node_oids(&coOids, &dnOids, &numCo, &numDn);
 
 	if (agent->num_coord_connections != numCo ||
 			agent->num_dn_connections != numDn ||
@@ -274,9 +419,11 @@ node_info_check(PoolAgent *agent)
 
 	/*
 	 * Iterate over all dbnode pools and check if connection strings
-	 * are matching node definitions.
+	 * are matching node definitions. Every node is checked once, so stop
+	 * when all of them are checked.
 	 */
-	while (res == POOL_CHECK_SUCCESS && dbPool)
+	while (res == POOL_CHECK_SUCCESS && dbPool &&
+		   list_length(checked) < numCo + numDn)
 	{
 		HASH_SEQ_STATUS hseq_status;
 		PGXCNodePool   *nodePool;
@@ -680,13 +827,13 @@ agent_init(PoolAgent *agent, const char *database, const char *user_name,
 
 	/* disconnect if we are still connected */
 	if (agent->pool)
-		agent_release_connections(agent, false);
+		agent_release_connections(agent, false, 0, NULL, 0, NULL);
 
 	oldcontext = MemoryContextSwitchTo(agent->mcxt);
 
 	/* Get needed info and allocate memory */
-	PgxcNodeGetOids(&agent->coord_conn_oids, &agent->dn_conn_oids,
-					&agent->num_coord_connections, &agent->num_dn_connections, false);
+	pool_get_node_oids(&agent->coord_conn_oids, &agent->dn_conn_oids,
+					   &agent->num_coord_connections, &agent->num_dn_connections);
 
 	agent->coord_connections = (PGXCNodePoolSlot **)
 			palloc0(agent->num_coord_connections * sizeof(PGXCNodePoolSlot *));
@@ -716,6 +863,9 @@ agent_destroy(PoolAgent *agent)
 
 	close(Socket(agent->port));
 
+	/* Session is gone, do not wait for connections on its behalf */
+	agent_dequeue(agent);
+
 	/* Discard connections if any remaining */
 	if (agent->pool)
 	{
@@ -723,7 +873,7 @@ agent_destroy(PoolAgent *agent)
 		 * If session is disconnecting while there are active connections
 		 * we can not know if they clean or not, so force destroy them
 		 */
-		agent_release_connections(agent, true);
+		agent_release_connections(agent, true, 0, NULL, 0, NULL);
 	}
 
 	/* find agent in the list */
@@ -765,15 +915,24 @@ PoolManagerDisconnect(void)
 
 /*
  * Get pooled connections
+ * The Datanodes of the prefetchlist are not required, the pooler returns the
+ * connections to the first of them it has readily available after the
+ * required ones, their number is returned in prefetched.
  */
 int *
-PoolManagerGetConnections(List *datanodelist, List *coordlist)
+PoolManagerGetConnections(List *datanodelist, List *coordlist,
+						  List *prefetchlist, uint32 paramhash,
+						  uint32 **paramhashes, int *prefetched)
 {
 	int			i;
 	ListCell   *nodelist_item;
 	int		   *fds;
 	int			totlen = list_length(datanodelist) + list_length(coordlist);
-	int			nodes[totlen + 2];
+	int			maxlen = totlen + list_length(prefetchlist);
+	int			nodes[maxlen + 4];
+	int			count;
+
+	*prefetched = 0;
 
 	if (poolHandle == NULL)
 		PoolManagerConnect(get_database_name(MyDatabaseId),
@@ -803,23 +962,38 @@ PoolManagerGetConnections(List *datanodelist, List *coordlist)
 			nodes[i++] = htonl(lfirst_int(nodelist_item));
 		}
 	}
+	/* Pooler prefers connections with the same session parameters */
+	nodes[i++] = htonl(paramhash);
+	/* Then the Datanodes the session may need soon */
+	nodes[i++] = htonl(list_length(prefetchlist));
+	foreach(nodelist_item, prefetchlist)
+	{
+		nodes[i++] = htonl(lfirst_int(nodelist_item));
+	}
 
-	pool_putmessage(&poolHandle->port, 'g', (char *) nodes, sizeof(int) * (totlen + 2));
+	pool_putmessage(&poolHandle->port, 'g', (char *) nodes, sizeof(int) * (maxlen + 4));
 	pool_flush(&poolHandle->port);
 
 	/* Receive response */
-	fds = (int *) palloc(sizeof(int) * totlen);
+	fds = (int *) palloc(sizeof(int) * maxlen);
+	*paramhashes = (uint32 *) palloc(sizeof(uint32) * (maxlen + 1));
 	if (fds == NULL)
 	{
 		ereport(ERROR,
 				(errcode(ERRCODE_OUT_OF_MEMORY),
 				 errmsg("out of memory")));
 	}
-	if (pool_recvfds(&poolHandle->port, fds, totlen))
+	pgstat_report_wait_start(WAIT_EVENT_POOLER_CONNECTIONS, InvalidOid);
+	count = pool_recvfds(&poolHandle->port, fds, *paramhashes, totlen, maxlen);
+	pgstat_report_wait_end(WAIT_EVENT_POOLER_CONNECTIONS);
+	if (count == EOF)
 	{
 		pfree(fds);
+		pfree(*paramhashes);
+		*paramhashes = NULL;
 		return NULL;
 	}
+	*prefetched = count - totlen;
 
 	return fds;
 }
@@ -997,6 +1171,60 @@ PoolManagerReloadConnectionInfo(void)
 }
 
 
+/*
+ * Get statistics of all the node pools of the pooler
+ */
+List *
+PoolManagerGetStatistics(void)
+{
+	StringInfoData buf;
+	List	   *result = NIL;
+	int			count;
+	int			i;
+
+	if (poolHandle == NULL)
+		PoolManagerConnect(get_database_name(MyDatabaseId),
+						   GetClusterUserName(), session_options());
+
+	pool_putmessage(&poolHandle->port, 's', NULL, 0);
+	pool_flush(&poolHandle->port);
+
+	if (pool_getbyte(&poolHandle->port) != 's')
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("unexpected message code")));
+
+	initStringInfo(&buf);
+	pool_getmessage(&poolHandle->port, &buf, 0);
+
+	count = pq_getmsgint(&buf, 4);
+	for (i = 0; i < count; i++)
+	{
+		PoolNodeStatistics *stats;
+		int			len;
+
+		stats = (PoolNodeStatistics *) palloc(sizeof(PoolNodeStatistics));
+		len = pq_getmsgint(&buf, 4);
+		stats->database = pstrdup(pq_getmsgbytes(&buf, len));
+		len = pq_getmsgint(&buf, 4);
+		stats->user_name = pstrdup(pq_getmsgbytes(&buf, len));
+		stats->nodeoid = (Oid) pq_getmsgint(&buf, 4);
+		stats->size = pq_getmsgint(&buf, 4);
+		stats->freeSize = pq_getmsgint(&buf, 4);
+		stats->acquisitions = pq_getmsgint64(&buf);
+		stats->wait_time = pq_getmsgint64(&buf);
+		stats->grow_failures = pq_getmsgint64(&buf);
+		stats->destroyed = pq_getmsgint64(&buf);
+		stats->evicted = pq_getmsgint64(&buf);
+		result = lappend(result, stats);
+	}
+	pq_getmsgend(&buf);
+	pfree(buf.data);
+
+	return result;
+}
+
+
 /*
  * Handle messages to agent
  */
@@ -1019,8 +1247,12 @@ agent_handle_input(PoolAgent * agent, StringInfo s)
 		List	   *nodelist = NIL;
 		List	   *datanodelist = NIL;
 		List	   *coordlist = NIL;
+		List	   *prefetchlist = NIL;
+		int			prefetched;
 		int		   *fds;
 		int		   *pids;
+		uint32	   *paramhashes;
+		uint32		paramhash;
 		int			i, len, res;
 
 		/*
@@ -1121,10 +1353,13 @@ agent_handle_input(PoolAgent * agent, StringInfo s)
 				 * - List of Coordinators = NumPoolCoords * 4bytes (max)
 				 * - Number of Datanodes sent = 4bytes
 				 * - Number of Coordinators sent = 4bytes
+				 * - Hash of session parameters = 4bytes
+				 * - Number of Datanodes to prefetch = 4bytes
+				 * - List of Datanodes to prefetch = NumPoolDataNodes * 4bytes (max)
 				 * It is better to send in a same message the list of Co and Dn at the same
 				 * time, this permits to reduce interactions between postmaster and pooler
 				 */
-				pool_getmessage(&agent->port, s, 4 * agent->num_dn_connections + 4 * agent->num_coord_connections + 12);
+				pool_getmessage(&agent->port, s, 8 * agent->num_dn_connections + 4 * agent->num_coord_connections + 20);
 				datanodecount = pq_getmsgint(s, 4);
 				for (i = 0; i < datanodecount; i++)
 					datanodelist = lappend_int(datanodelist, pq_getmsgint(s, 4));
@@ -1132,19 +1367,48 @@ agent_handle_input(PoolAgent * agent, StringInfo s)
 				/* It is possible that no Coordinators are involved in the transaction */
 				for (i = 0; i < coordcount; i++)
 					coordlist = lappend_int(coordlist, pq_getmsgint(s, 4));
+				paramhash = (uint32) pq_getmsgint(s, 4);
+				len = pq_getmsgint(s, 4);
+				for (i = 0; i < len; i++)
+					prefetchlist = lappend_int(prefetchlist, pq_getmsgint(s, 4));
 				pq_getmsgend(s);
 
+				/*
+				 * If the pools are at their limit wait until other sessions
+				 * release connections, the response is sent by
+				 * serve_waiters(). Sessions arriving while others are
+				 * waiting line up behind them. Nothing is prefetched for
+				 * the waiting sessions.
+				 */
+				if (PoolWaitTimeout > 0 && agent->pool &&
+						(poolWaiters != NIL ||
+						 agent_pools_exhausted(agent, datanodelist, coordlist)) &&
+						agent_enqueue(agent, datanodelist, coordlist, paramhash))
+				{
+					list_free(datanodelist);
+					list_free(coordlist);
+					list_free(prefetchlist);
+					break;
+				}
+
 				/*
 				 * In case of error agent_acquire_connections will log
 				 * the error and return NULL
 				 */
-				fds = agent_acquire_connections(agent, datanodelist, coordlist);
+				fds = agent_acquire_connections(agent, datanodelist, coordlist,
+												prefetchlist, paramhash,
+												&paramhashes, &prefetched);
 				list_free(datanodelist);
 				list_free(coordlist);
+				list_free(prefetchlist);
 
-				pool_sendfds(&agent->port, fds, fds ? datanodecount + coordcount : 0);
+				pool_sendfds(&agent->port, fds, paramhashes,
+							 fds ? datanodecount + coordcount + prefetched : 0);
 				if (fds)
+				{
 					pfree(fds);
+					pfree(paramhashes);
+				}
 				break;
 
 			case 'h':			/* Cancel SQL Command in progress on specified connections */
@@ -1215,14 +1479,41 @@ agent_handle_input(PoolAgent * agent, StringInfo s)
 				/* Send result */
 				pool_sendres(&agent->port, res);
 				break;
+			case 's':			/* Statistics */
+				pool_getmessage(&agent->port, s, 4);
+				pq_getmsgend(s);
+
+				agent_send_statistics(agent);
+				break;
 			case 'r':			/* RELEASE CONNECTIONS */
 				{
 					bool destroy;
-
-					pool_getmessage(&agent->port, s, 8);
+					uint32 *dn_paramhashes;
+					uint32 *co_paramhashes;
+
+					/*
+					 * Length of message is caused by:
+					 * - Message header = 4bytes
+					 * - Destroy flag = 4bytes
+					 * - Number of Datanodes and their parameter hashes
+					 * - Number of Coordinators and their parameter hashes
+					 */
+					pool_getmessage(&agent->port, s, 4 * agent->num_dn_connections + 4 * agent->num_coord_connections + 16);
 					destroy = (bool) pq_getmsgint(s, 4);
+					datanodecount = pq_getmsgint(s, 4);
+					dn_paramhashes = (uint32 *) palloc((datanodecount + 1) * sizeof(uint32));
+					for (i = 0; i < datanodecount; i++)
+						dn_paramhashes[i] = (uint32) pq_getmsgint(s, 4);
+					coordcount = pq_getmsgint(s, 4);
+					co_paramhashes = (uint32 *) palloc((coordcount + 1) * sizeof(uint32));
+					for (i = 0; i < coordcount; i++)
+						co_paramhashes[i] = (uint32) pq_getmsgint(s, 4);
 					pq_getmsgend(s);
-					agent_release_connections(agent, destroy);
+					agent_release_connections(agent, destroy,
+											  datanodecount, dn_paramhashes,
+											  coordcount, co_paramhashes);
+					pfree(dn_paramhashes);
+					pfree(co_paramhashes);
 				}
 				break;
 			default:			/* EOF or protocol violation */
@@ -1235,19 +1526,355 @@ agent_handle_input(PoolAgent * agent, StringInfo s)
 	}
 }
 
+/*
+ * Check if any of the node pools the agent needs a connection from has no
+ * free connections and can not grow.
+ */
+static bool
+agent_pools_exhausted(PoolAgent *agent, List *datanodelist, List *coordlist)
+{
+	ListCell   *lc;
+
+	foreach(lc, datanodelist)
+	{
+		int			node = lfirst_int(lc);
+		PGXCNodePool *nodePool;
+
+		if (node < 0 || node >= agent->num_dn_connections ||
+				agent->dn_connections[node] != NULL)
+			continue;
+		nodePool = (PGXCNodePool *) hash_search(agent->pool->nodePools,
+												&agent->dn_conn_oids[node],
+												HASH_FIND, NULL);
+		if (nodePool && nodePool->freeSize == 0 &&
+				nodePool->size >= MaxPoolSize)
+			return true;
+	}
+	foreach(lc, coordlist)
+	{
+		int			node = lfirst_int(lc);
+		PGXCNodePool *nodePool;
+
+		if (node < 0 || node >= agent->num_coord_connections ||
+				agent->coord_connections[node] != NULL)
+			continue;
+		nodePool = (PGXCNodePool *) hash_search(agent->pool->nodePools,
+												&agent->coord_conn_oids[node],
+												HASH_FIND, NULL);
+		if (nodePool && nodePool->freeSize == 0 &&
+				nodePool->size >= MaxPoolSize)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Put the connection request of the agent to the wait queue. Return false
+ * if the database or the user of the agent already have pool_max_waiters
+ * sessions waiting, the request fails then as if there were no queue, so
+ * a busy tenant can not fill up the queue.
+ */
+static bool
+agent_enqueue(PoolAgent *agent, List *datanodelist, List *coordlist,
+			  uint32 paramhash)
+{
+	PoolWaiter *waiter;
+	MemoryContext oldcontext;
+
+	if (PoolMaxWaiters > 0)
+	{
+		int			same_database = 0;
+		int			same_user = 0;
+		ListCell   *lc;
+
+		foreach(lc, poolWaiters)
+		{
+			DatabasePool *pool = ((PoolWaiter *) lfirst(lc))->agent->pool;
+
+			if (strcmp(pool->database, agent->pool->database) == 0 &&
+					++same_database >= PoolMaxWaiters)
+				return false;
+			if (strcmp(pool->user_name, agent->pool->user_name) == 0 &&
+					++same_user >= PoolMaxWaiters)
+				return false;
+		}
+	}
+
+	oldcontext = MemoryContextSwitchTo(agent->mcxt);
+	waiter = (PoolWaiter *) palloc(sizeof(PoolWaiter));
+	waiter->agent = agent;
+	waiter->datanodelist = list_copy(datanodelist);
+	waiter->coordlist = list_copy(coordlist);
+	waiter->paramhash = paramhash;
+	waiter->deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+												   PoolWaitTimeout);
+	MemoryContextSwitchTo(PoolerCoreContext);
+	poolWaiters = lappend(poolWaiters, waiter);
+	MemoryContextSwitchTo(oldcontext);
+
+	elog(DEBUG1, "Pooler: session %d is waiting for connections", agent->pid);
+	return true;
+}
+
+/*
+ * Remove the request of the agent from the wait queue, if any
+ */
+static void
+agent_dequeue(PoolAgent *agent)
+{
+	ListCell   *lc;
+	ListCell   *prev = NULL;
+
+	foreach(lc, poolWaiters)
+	{
+		PoolWaiter *waiter = (PoolWaiter *) lfirst(lc);
+
+		if (waiter->agent == agent)
+		{
+			poolWaiters = list_delete_cell(poolWaiters, lc, prev);
+			list_free(waiter->datanodelist);
+			list_free(waiter->coordlist);
+			pfree(waiter);
+			return;
+		}
+		prev = lc;
+	}
+}
+
+/*
+ * Hand out connections to the waiting sessions in order of arrival, and
+ * fail the requests which have been waiting longer than pool_wait_timeout.
+ * A session is not served before the earlier sessions of the same database
+ * pool, so the connections go to the sessions which waited longest.
+ */
+static void
+serve_waiters(void)
+{
+	TimestampTz now = GetCurrentTimestamp();
+	List	   *blocked = NIL;
+	ListCell   *lc;
+	ListCell   *prev = NULL;
+	ListCell   *next;
+
+	for (lc = list_head(poolWaiters); lc; lc = next)
+	{
+		PoolWaiter *waiter = (PoolWaiter *) lfirst(lc);
+		PoolAgent  *agent = waiter->agent;
+		int		   *fds = NULL;
+		uint32	   *paramhashes = NULL;
+		int			prefetched;
+
+		next = lnext(lc);
+		if (!list_member_ptr(blocked, agent->pool) &&
+				!agent_pools_exhausted(agent, waiter->datanodelist,
+									   waiter->coordlist))
+			fds = agent_acquire_connections(agent, waiter->datanodelist,
+											waiter->coordlist, NIL,
+											waiter->paramhash, &paramhashes,
+											&prefetched);
+		else if (now < waiter->deadline)
+		{
+			/* Keep waiting */
+			blocked = lappend(blocked, agent->pool);
+			prev = lc;
+			continue;
+		}
+		else
+			elog(LOG, "Pooler: session %d timed out waiting for connections",
+				 agent->pid);
+
+		pool_sendfds(&agent->port, fds, paramhashes,
+					 fds ? list_length(waiter->datanodelist) +
+						   list_length(waiter->coordlist) : 0);
+		if (fds)
+		{
+			pfree(fds);
+			pfree(paramhashes);
+		}
+
+		poolWaiters = list_delete_cell(poolWaiters, lc, prev);
+		list_free(waiter->datanodelist);
+		list_free(waiter->coordlist);
+		pfree(waiter);
+	}
+	list_free(blocked);
+}
+
+/*
+ * Time until the first waiting session times out, in milliseconds
+ */
+static int
+waiters_timeout(void)
+{
+	TimestampTz now = GetCurrentTimestamp();
+	TimestampTz deadline = 0;
+	ListCell   *lc;
+	long		secs;
+	int			usecs;
+
+	foreach(lc, poolWaiters)
+	{
+		PoolWaiter *waiter = (PoolWaiter *) lfirst(lc);
+
+		if (deadline == 0 || waiter->deadline < deadline)
+			deadline = waiter->deadline;
+	}
+	if (deadline <= now)
+		return 0;
+
+	TimestampDifference(now, deadline, &secs, &usecs);
+	return (int) (secs * 1000 + (usecs + 999) / 1000);
+}
+
+/*
+ * Send the agent statistics of all the node pools. Strings are sent with
+ * their terminators, like the other pooler messages do.
+ */
+static void
+agent_send_statistics(PoolAgent *agent)
+{
+	StringInfoData buf;
+	DatabasePool *databasePool;
+	int			count = 0;
+
+	initStringInfo(&buf);
+	/* Placeholder for the number of node pools */
+	pq_sendint(&buf, 0, 4);
+	for (databasePool = databasePools; databasePool;
+			databasePool = databasePool->next)
+	{
+		HASH_SEQ_STATUS hseq_status;
+		PGXCNodePool   *nodePool;
+		int				dblen = strlen(databasePool->database) + 1;
+		int				userlen = strlen(databasePool->user_name) + 1;
+
+		hash_seq_init(&hseq_status, databasePool->nodePools);
+		while ((nodePool = (PGXCNodePool *) hash_seq_search(&hseq_status)))
+		{
+			pq_sendint(&buf, dblen, 4);
+			pq_sendbytes(&buf, databasePool->database, dblen);
+			pq_sendint(&buf, userlen, 4);
+			pq_sendbytes(&buf, databasePool->user_name, userlen);
+			pq_sendint(&buf, nodePool->nodeoid, 4);
+			pq_sendint(&buf, nodePool->size, 4);
+			pq_sendint(&buf, nodePool->freeSize, 4);
+			pq_sendint64(&buf, nodePool->acquisitions);
+			pq_sendint64(&buf, nodePool->wait_time);
+			pq_sendint64(&buf, nodePool->grow_failures);
+			pq_sendint64(&buf, nodePool->destroyed);
+			pq_sendint64(&buf, nodePool->evicted);
+			count++;
+		}
+	}
+	count = htonl(count);
+	memcpy(buf.data, &count, 4);
+
+	pool_putmessage(&agent->port, 's', buf.data, buf.len);
+	pool_flush(&agent->port);
+	pfree(buf.data);
+}
+
+/*
+ * If the agent needs new connections from several node pools having no free
+ * connections, grow them in parallel, so the session waits for one connect
+ * rather than for one per node. A single pool is grown when the connection
+ * is acquired.
+ */
+static void
+agent_prepare_connections(PoolAgent *agent, List *datanodelist,
+						  List *coordlist)
+{
+	DatabasePool  **dbPools;
+	PGXCNodePool  **nodePools;
+	ListCell	   *lc;
+	int				count = 0;
+	int				npools = 0;
+	int				i;
+
+	i = list_length(datanodelist) + list_length(coordlist);
+	if (i < 2)
+		return;
+	i *= POOL_GROW_MAX_BATCH;
+	dbPools = (DatabasePool **) palloc(i * sizeof(DatabasePool *));
+	nodePools = (PGXCNodePool **) palloc(i * sizeof(PGXCNodePool *));
+
+	foreach(lc, datanodelist)
+	{
+		int			node = lfirst_int(lc);
+
+		if (agent->dn_connections[node] == NULL)
+		{
+			PGXCNodePool *nodePool = get_node_pool(agent->pool,
+												   agent->dn_conn_oids[node]);
+
+			if (nodePool->freeSize == 0 && nodePool->size < MaxPoolSize)
+			{
+				int			batch = pool_grow_batch(nodePool);
+
+				while (batch-- > 0)
+				{
+					dbPools[count] = agent->pool;
+					nodePools[count++] = nodePool;
+				}
+				npools++;
+			}
+		}
+	}
+	foreach(lc, coordlist)
+	{
+		int			node = lfirst_int(lc);
+
+		if (agent->coord_connections[node] == NULL)
+		{
+			PGXCNodePool *nodePool = get_node_pool(agent->pool,
+												   agent->coord_conn_oids[node]);
+
+			if (nodePool->freeSize == 0 && nodePool->size < MaxPoolSize)
+			{
+				int			batch = pool_grow_batch(nodePool);
+
+				while (batch-- > 0)
+				{
+					dbPools[count] = agent->pool;
+					nodePools[count++] = nodePool;
+				}
+				npools++;
+			}
+		}
+	}
+
+	if (npools > 1)
+		connect_pools(count, dbPools, nodePools);
+
+	pfree(dbPools);
+	pfree(nodePools);
+}
+
 /*
  * acquire connection
  */
 static int *
-agent_acquire_connections(PoolAgent *agent, List *datanodelist, List *coordlist)
+agent_acquire_connections(PoolAgent *agent, List *datanodelist,
+						  List *coordlist, List *prefetchlist,
+						  uint32 paramhash, uint32 **paramhashes,
+						  int *prefetched)
 {
 	int			i;
 	int		   *result;
+	uint32	   *hashes;
+	Oid		   *acquired;
+	int			nacquired = 0;
+	instr_time	start;
+	instr_time	waited;
 	ListCell   *nodelist_item;
 	MemoryContext oldcontext;
 
 	Assert(agent);
 
+	*paramhashes = NULL;
+	*prefetched = 0;
+	INSTR_TIME_SET_CURRENT(start);
+
 	/* Check if pooler can accept those requests */
 	if (list_length(datanodelist) > agent->num_dn_connections ||
 			list_length(coordlist) > agent->num_coord_connections)
@@ -1258,10 +1885,12 @@ agent_acquire_connections(PoolAgent *agent, List *datanodelist, List *coordlist)
 	 * File descriptors of Datanodes and Coordinators are saved in the same array,
 	 * This array will be sent back to the postmaster.
 	 * It has a length equal to the length of the Datanode list
-	 * plus the length of the Coordinator list.
+	 * plus the length of the Coordinator list, plus the length of the list of
+	 * Datanodes to prefetch.
 	 * Datanode fds are saved first, then Coordinator fds are saved.
 	 */
-	result = (int *) palloc((list_length(datanodelist) + list_length(coordlist)) * sizeof(int));
+	result = (int *) palloc((list_length(datanodelist) + list_length(coordlist) +
+							 list_length(prefetchlist)) * sizeof(int));
 	if (result == NULL)
 	{
 		ereport(ERROR,
@@ -1269,12 +1898,27 @@ agent_acquire_connections(PoolAgent *agent, List *datanodelist, List *coordlist)
 				 errmsg("out of memory")));
 	}
 
+	/*
+	 * Along with the descriptors return hashes of session parameters set on
+	 * the connections, so the session knows if it needs to set them.
+	 * If the agent is holding the connection already its state is unknown,
+	 * zero tells the session set up the parameters as if it has defaults.
+	 */
+	hashes = (uint32 *) palloc((list_length(datanodelist) + list_length(coordlist) +
+								list_length(prefetchlist)) * sizeof(uint32));
+
+	/* Nodes the connections are taken from, to account the wait time */
+	acquired = (Oid *) palloc((list_length(datanodelist) + list_length(coordlist) +
+							   list_length(prefetchlist)) * sizeof(Oid));
+
 	/*
 	 * There are possible memory allocations in the core pooler, we want
 	 * these allocations in the contect of the database pool
 	 */
 	oldcontext = MemoryContextSwitchTo(agent->pool->mcxt);
 
+	/* Open at once the connections missing in the pools */
+	agent_prepare_connections(agent, datanodelist, coordlist);
 
 	/* Initialize result */
 	i = 0;
@@ -1283,19 +1927,25 @@ agent_acquire_connections(PoolAgent *agent, List *datanodelist, List *coordlist)
 	{
 		int			node = lfirst_int(nodelist_item);
 
+		hashes[i] = 0;
 		/* Acquire from the pool if none */
 		if (agent->dn_connections[node] == NULL)
 		{
 			PGXCNodePoolSlot *slot = acquire_connection(agent->pool,
-														agent->dn_conn_oids[node]);
+														agent->dn_conn_oids[node],
+														paramhash);
 
 			/* Handle failure */
 			if (slot == NULL)
 			{
 				pfree(result);
+				pfree(hashes);
+				pfree(acquired);
 				MemoryContextSwitchTo(oldcontext);
 				return NULL;
 			}
+			hashes[i] = slot->paramhash;
+			acquired[nacquired++] = agent->dn_conn_oids[node];
 
 			/* Store in the descriptor */
 			agent->dn_connections[node] = slot;
@@ -1315,18 +1965,25 @@ agent_acquire_connections(PoolAgent *agent, List *datanodelist, List *coordlist)
 	{
 		int			node = lfirst_int(nodelist_item);
 
+		hashes[i] = 0;
 		/* Acquire from the pool if none */
 		if (agent->coord_connections[node] == NULL)
 		{
-			PGXCNodePoolSlot *slot = acquire_connection(agent->pool, agent->coord_conn_oids[node]);
+			PGXCNodePoolSlot *slot = acquire_connection(agent->pool,
+														agent->coord_conn_oids[node],
+														paramhash);
 
 			/* Handle failure */
 			if (slot == NULL)
 			{
 				pfree(result);
+				pfree(hashes);
+				pfree(acquired);
 				MemoryContextSwitchTo(oldcontext);
 				return NULL;
 			}
+			hashes[i] = slot->paramhash;
+			acquired[nacquired++] = agent->coord_conn_oids[node];
 
 			/* Store in the descriptor */
 			agent->coord_connections[node] = slot;
@@ -1341,8 +1998,56 @@ agent_acquire_connections(PoolAgent *agent, List *datanodelist, List *coordlist)
 		result[i++] = PQsocket((PGconn *) agent->coord_connections[node]->conn);
 	}
 
+	/*
+	 * The session is likely to need the Datanodes of the prefetch list soon,
+	 * pass it the connections to them it does not have to wait for. Stop at
+	 * the first Datanode that has none, the session expects a prefix of the
+	 * list.
+	 */
+	foreach(nodelist_item, prefetchlist)
+	{
+		int			node = lfirst_int(nodelist_item);
+		PGXCNodePoolSlot *slot;
+		PGXCNodePool *nodePool;
+
+		if (node < 0 || node >= agent->num_dn_connections ||
+				agent->dn_connections[node] != NULL)
+			break;
+		nodePool = (PGXCNodePool *) hash_search(agent->pool->nodePools,
+												&agent->dn_conn_oids[node],
+												HASH_FIND, NULL);
+		if (nodePool == NULL || nodePool->freeSize == 0)
+			break;
+		slot = acquire_connection(agent->pool, agent->dn_conn_oids[node],
+								  paramhash);
+		if (slot == NULL)
+			break;
+		agent->dn_connections[node] = slot;
+		hashes[i] = slot->paramhash;
+		result[i++] = PQsocket((PGconn *) slot->conn);
+		(*prefetched)++;
+	}
+
+	/*
+	 * The session has been waiting for all the connections it got, including
+	 * the time the pools were growing in parallel, charge every pool with it.
+	 */
+	INSTR_TIME_SET_CURRENT(waited);
+	INSTR_TIME_SUBTRACT(waited, start);
+	for (i = 0; i < nacquired; i++)
+	{
+		PGXCNodePool *nodePool;
+
+		nodePool = (PGXCNodePool *) hash_search(agent->pool->nodePools,
+												&acquired[i], HASH_FIND, NULL);
+		if (nodePool)
+			nodePool->wait_time += INSTR_TIME_GET_MICROSEC(waited);
+	}
+	pfree(acquired);
+
 	MemoryContextSwitchTo(oldcontext);
 
+	*paramhashes = hashes;
 	return result;
 }
 
@@ -1411,11 +2116,14 @@ cancel_query_on_connections(PoolAgent *agent, List *datanodelist, List *coordlis
  * Return connections back to the pool
  */
 void
-PoolManagerReleaseConnections(bool force)
+PoolManagerReleaseConnections(bool force,
+							  int dn_count, uint32 *dn_paramhashes,
+							  int co_count, uint32 *co_paramhashes)
 {
 	char msgtype = 'r';
 	int n32;
-	int msglen = 8;
+	int msglen = 16 + 4 * (dn_count + co_count);
+	int i;
 
 	/* If disconnected from pooler all the connections already released */
 	if (!poolHandle)
@@ -1431,6 +2139,22 @@ PoolManagerReleaseConnections(bool force)
 	/* Lock information */
 	n32 = htonl((int) force);
 	pool_putbytes(&poolHandle->port, (char *) &n32, 4);
+
+	/* Session parameters left on the connections */
+	n32 = htonl(dn_count);
+	pool_putbytes(&poolHandle->port, (char *) &n32, 4);
+	for (i = 0; i < dn_count; i++)
+	{
+		n32 = htonl(dn_paramhashes[i]);
+		pool_putbytes(&poolHandle->port, (char *) &n32, 4);
+	}
+	n32 = htonl(co_count);
+	pool_putbytes(&poolHandle->port, (char *) &n32, 4);
+	for (i = 0; i < co_count; i++)
+	{
+		n32 = htonl(co_paramhashes[i]);
+		pool_putbytes(&poolHandle->port, (char *) &n32, 4);
+	}
 	pool_flush(&poolHandle->port);
 }
 
@@ -1494,10 +2218,15 @@ PoolManagerCancelQuery(int dn_count, int* dn_list, int co_count, int* co_list)
 }
 
 /*
- * Release connections for Datanodes and Coordinators
+ * Release connections for Datanodes and Coordinators.
+ * The session reports hashes of session parameters it left on the
+ * connections, zero if they are reset. Connections not reported are assumed
+ * to be reset.
  */
 static void
-agent_release_connections(PoolAgent *agent, bool force_destroy)
+agent_release_connections(PoolAgent *agent, bool force_destroy,
+						  int dn_count, uint32 *dn_paramhashes,
+						  int co_count, uint32 *co_paramhashes)
 {
 	MemoryContext oldcontext;
 	int			i;
@@ -1529,7 +2258,10 @@ agent_release_connections(PoolAgent *agent, bool force_destroy)
 		 * If connection has temporary objects on it, destroy connection slot.
 		 */
 		if (slot)
+		{
+			slot->paramhash = i < dn_count ? dn_paramhashes[i] : 0;
 			release_connection(agent->pool, slot, agent->dn_conn_oids[i], force_destroy);
+		}
 		agent->dn_connections[i] = NULL;
 	}
 	/* Then clean up for Coordinator connections */
@@ -1542,7 +2274,10 @@ agent_release_connections(PoolAgent *agent, bool force_destroy)
 		 * If connection has temporary objects on it, destroy connection slot.
 		 */
 		if (slot)
+		{
+			slot->paramhash = i < co_count ? co_paramhashes[i] : 0;
 			release_connection(agent->pool, slot, agent->coord_conn_oids[i], force_destroy);
+		}
 		agent->coord_connections[i] = NULL;
 	}
 
@@ -1633,6 +2368,10 @@ create_database_pool(const char *database, const char *user_name, const char *pg
 	/* Insert into the list */
 	insert_database_pool(databasePool);
 
+	/* Get connections of the new pool ready while the pooler is idle */
+	if (MinPoolSize > 0)
+		warm_up_pending = true;
+
 	return databasePool;
 }
 
@@ -1671,8 +2410,18 @@ destroy_database_pool(const char *database, const char *user_name)
 static void
 insert_database_pool(DatabasePool *databasePool)
 {
+	DatabasePoolKey		key;
+	DatabasePoolEntry  *entry;
+
 	Assert(databasePool);
 
+	key.database = databasePool->database;
+	key.user_name = databasePool->user_name;
+	key.pgoptions = databasePool->pgoptions;
+	entry = (DatabasePoolEntry *) hash_search(databasePoolsHash, &key,
+											  HASH_ENTER, NULL);
+	entry->pool = databasePool;
+
 	/* Reference existing list or null the tail */
 	if (databasePools)
 		databasePool->next = databasePools;
@@ -1695,14 +2444,14 @@ reload_database_pools(PoolAgent *agent)
 	 * Release node connections if any held. It is not guaranteed client session
 	 * does the same so don't ever try to return them to pool and reuse
 	 */
-	agent_release_connections(agent, true);
+	agent_release_connections(agent, true, 0, NULL, 0, NULL);
 
 	/* Forget previously allocated node info */
 	MemoryContextReset(agent->mcxt);
 
 	/* and allocate new */
-	PgxcNodeGetOids(&agent->coord_conn_oids, &agent->dn_conn_oids,
-					&agent->num_coord_connections, &agent->num_dn_connections, false);
+	pool_get_node_oids(&agent->coord_conn_oids, &agent->dn_conn_oids,
+					   &agent->num_coord_connections, &agent->num_dn_connections);
 
 	agent->coord_connections = (PGXCNodePoolSlot **)
 			palloc0(agent->num_coord_connections * sizeof(PGXCNodePoolSlot *));
@@ -1748,19 +2497,59 @@ reload_database_pools(PoolAgent *agent)
 static DatabasePool *
 find_database_pool(const char *database, const char *user_name, const char *pgoptions)
 {
-	DatabasePool *databasePool;
+	DatabasePoolKey		key;
+	DatabasePoolEntry  *entry;
+
+	key.database = database;
+	key.user_name = user_name;
+	key.pgoptions = pgoptions;
+	entry = (DatabasePoolEntry *) hash_search(databasePoolsHash, &key,
+											  HASH_FIND, NULL);
+	return entry ? entry->pool : NULL;
+}
 
-	/* Scan the list */
-	databasePool = databasePools;
-	while (databasePool)
-	{
-		if (strcmp(database, databasePool->database) == 0 &&
-			strcmp(user_name, databasePool->user_name) == 0 &&
-			strcmp(pgoptions, databasePool->pgoptions) == 0)
-			break;
-		databasePool = databasePool->next;
-	}
-	return databasePool;
+
+/*
+ * Hash and match functions of the database pool index
+ */
+static uint32
+database_pool_hash(const void *key, Size keysize)
+{
+	const DatabasePoolKey *k = (const DatabasePoolKey *) key;
+	uint32		result;
+
+	result = string_hash(k->database, NAMEDATALEN);
+	result ^= string_hash(k->user_name, NAMEDATALEN) * 31;
+	result ^= string_hash(k->pgoptions, strlen(k->pgoptions) + 1) * 7;
+	return result;
+}
+
+static int
+database_pool_match(const void *key1, const void *key2, Size keysize)
+{
+	const DatabasePoolKey *k1 = (const DatabasePoolKey *) key1;
+	const DatabasePoolKey *k2 = (const DatabasePoolKey *) key2;
+
+	if (strcmp(k1->database, k2->database) == 0 &&
+		strcmp(k1->user_name, k2->user_name) == 0 &&
+		strcmp(k1->pgoptions, k2->pgoptions) == 0)
+		return 0;
+	return 1;
+}
+
+
+/*
+ * Delete the pool from the index, the pool is already out of the list
+ */
+static void
+unindex_database_pool(DatabasePool *databasePool)
+{
+	DatabasePoolKey		key;
+
+	key.database = databasePool->database;
+	key.user_name = databasePool->user_name;
+	key.pgoptions = databasePool->pgoptions;
+	hash_search(databasePoolsHash, &key, HASH_REMOVE, NULL);
 }
 
 
@@ -1796,7 +2585,7 @@ remove_database_pool(const char *database, const char *user_name)
 			prev->next = databasePool->next;
 		else
 			databasePools = databasePool->next;
-
+		unindex_database_pool(databasePool);
 
 		databasePool->next = NULL;
 	}
@@ -1804,13 +2593,16 @@ remove_database_pool(const char *database, const char *user_name)
 }
 
 /*
- * Acquire connection
+ * Acquire connection.
+ * Prefer the connection which has the session parameters with specified
+ * hash already set, so the session does not need to set them up.
  */
 static PGXCNodePoolSlot *
-acquire_connection(DatabasePool *dbPool, Oid node)
+acquire_connection(DatabasePool *dbPool, Oid node, uint32 paramhash)
 {
 	PGXCNodePool	   *nodePool;
 	PGXCNodePoolSlot   *slot;
+	int					i;
 
 	Assert(dbPool);
 
@@ -1826,6 +2618,26 @@ acquire_connection(DatabasePool *dbPool, Oid node)
 	if (nodePool == NULL || nodePool->freeSize == 0)
 		nodePool = grow_pool(dbPool, node);
 
+	/*
+	 * Look for matching connection starting from the most recently released
+	 * and move it to the top, where it is taken from. Free slots are kept in
+	 * the order they were released, so shift the more recent ones down.
+	 */
+	if (nodePool && paramhash != 0)
+	{
+		for (i = nodePool->freeSize - 1; i >= 0; i--)
+		{
+			if (nodePool->slot[i]->paramhash == paramhash)
+			{
+				slot = nodePool->slot[i];
+				memmove(&nodePool->slot[i], &nodePool->slot[i + 1],
+						(nodePool->freeSize - 1 - i) * sizeof(PGXCNodePoolSlot *));
+				nodePool->slot[nodePool->freeSize - 1] = slot;
+				break;
+			}
+		}
+	}
+
 	slot = NULL;
 	/* Check available connections */
 	while (nodePool && nodePool->freeSize > 0)
@@ -1858,15 +2670,29 @@ acquire_connection(DatabasePool *dbPool, Oid node)
 
 		destroy_slot(slot);
 		slot = NULL;
+		nodePool->destroyed++;
 
 		/* Decrement current max pool size */
 		(nodePool->size)--;
+		/*
+		 * The node has probably restarted, then all the free connections to
+		 * it are broken, get rid of them at once.
+		 */
+		evict_dead_slots(node);
 		/* Ensure we are not below minimum size */
 		nodePool = grow_pool(dbPool, node);
 	}
 
 	if (slot == NULL)
 		elog(WARNING, "can not connect to node %u", node);
+	else
+	{
+		nodePool->acquisitions++;
+		if (nodePool->size - nodePool->freeSize > nodePool->peak_used)
+			nodePool->peak_used = nodePool->size - nodePool->freeSize;
+		if (nodePool->freeSize < MinPoolSize)
+			warm_up_pending = true;
+	}
 
 	return slot;
 }
@@ -1907,6 +2733,7 @@ release_connection(DatabasePool *dbPool, PGXCNodePoolSlot *slot,
 	{
 		elog(DEBUG1, "Cleaning up connection from pool %s, closing", nodePool->connstr);
 		destroy_slot(slot);
+		nodePool->destroyed++;
 		/* Decrement pool size */
 		(nodePool->size)--;
 		/* Ensure we are not below minimum size */
@@ -1924,57 +2751,25 @@ grow_pool(DatabasePool *dbPool, Oid node)
 	/* if error try to release idle connections and try again */
 	bool 			tryagain = true;
 	PGXCNodePool   *nodePool;
-	bool			found;
 
 	Assert(dbPool);
 
-	nodePool = (PGXCNodePool *) hash_search(dbPool->nodePools, &node,
-											HASH_ENTER, &found);
-	nodePool->connstr = build_node_conn_str(node, dbPool);
-	if (!nodePool->connstr)
-	{
-		ereport(ERROR,
-				(errcode(ERRCODE_INTERNAL_ERROR),
-				 errmsg("could not build connection string for node %u", node)));
-	}
-
-	if (!found)
-	{
-		nodePool->slot = (PGXCNodePoolSlot **) palloc0(MaxPoolSize * sizeof(PGXCNodePoolSlot *));
-		if (!nodePool->slot)
-		{
-			ereport(ERROR,
-					(errcode(ERRCODE_OUT_OF_MEMORY),
-					 errmsg("out of memory")));
-		}
-		nodePool->freeSize = 0;
-		nodePool->size = 0;
-	}
+	nodePool = get_node_pool(dbPool, node);
 
 	while (nodePool->freeSize == 0 && nodePool->size < MaxPoolSize)
 	{
-		PGXCNodePoolSlot *slot;
+		int			batch = pool_grow_batch(nodePool);
+		DatabasePool *dbPools[POOL_GROW_MAX_BATCH];
+		PGXCNodePool *nodePools[POOL_GROW_MAX_BATCH];
+		int			i;
 
-		/* Allocate new slot */
-		slot = (PGXCNodePoolSlot *) palloc(sizeof(PGXCNodePoolSlot));
-		if (slot == NULL)
+		for (i = 0; i < batch; i++)
 		{
-			ereport(ERROR,
-					(errcode(ERRCODE_OUT_OF_MEMORY),
-					 errmsg("out of memory")));
+			dbPools[i] = dbPool;
+			nodePools[i] = nodePool;
 		}
-
-		/* If connection fails, be sure that slot is destroyed cleanly */
-		slot->xc_cancelConn = NULL;
-
-		/* Establish connection */
-		slot->conn = PGXCNodeConnect(nodePool->connstr);
-		if (!PGXCNodeConnected(slot->conn))
+		if (connect_pools(batch, dbPools, nodePools) == 0)
 		{
-			destroy_slot(slot);
-			ereport(LOG,
-					(errcode(ERRCODE_CONNECTION_FAILURE),
-					 errmsg("failed to connect to Datanode")));
 			/*
 			 * If we failed to connect probably number of connections on the
 			 * target node reached max_connections. Try and release idle
@@ -1993,25 +2788,245 @@ grow_pool(DatabasePool *dbPool, Oid node)
 			}
 			break;
 		}
+	}
+	return nodePool;
+}
 
-		slot->xc_cancelConn = (NODE_CANCEL *) PQgetCancel((PGconn *)slot->conn);
-		slot->released = time(NULL);
-		if (dbPool->oldest_idle == (time_t) 0)
-			dbPool->oldest_idle = slot->released;
 
-		/* Insert at the end of the pool */
-		nodePool->slot[(nodePool->freeSize)++] = slot;
+/*
+ * Find the pool of the node in the database pool, create new empty one if
+ * does not exist
+ */
+static PGXCNodePool *
+get_node_pool(DatabasePool *dbPool, Oid node)
+{
+	PGXCNodePool   *nodePool;
+	bool			found;
 
-		/* Increase count of pool size */
-		(nodePool->size)++;
-		elog(DEBUG1, "Pooler: increased pool size to %d for pool %s",
-			 nodePool->size,
-			 nodePool->connstr);
+	nodePool = (PGXCNodePool *) hash_search(dbPool->nodePools, &node,
+											HASH_ENTER, &found);
+	/*
+	 * Connection information of existing pools is up to date, pools of the
+	 * changed nodes are dropped by reload_database_pools
+	 */
+	if (!found)
+	{
+		nodePool->connstr = build_node_conn_str(node, dbPool);
+		if (!nodePool->connstr)
+		{
+			hash_search(dbPool->nodePools, &node, HASH_REMOVE, NULL);
+			ereport(ERROR,
+					(errcode(ERRCODE_INTERNAL_ERROR),
+					 errmsg("could not build connection string for node %u", node)));
+		}
+
+		nodePool->slot = (PGXCNodePoolSlot **) palloc0(MaxPoolSize * sizeof(PGXCNodePoolSlot *));
+		if (!nodePool->slot)
+		{
+			ereport(ERROR,
+					(errcode(ERRCODE_OUT_OF_MEMORY),
+					 errmsg("out of memory")));
+		}
+		nodePool->freeSize = 0;
+		nodePool->size = 0;
+		nodePool->acquisitions = 0;
+		nodePool->wait_time = 0;
+		nodePool->grow_failures = 0;
+		nodePool->destroyed = 0;
+		nodePool->evicted = 0;
+		nodePool->peak_used = 0;
+		nodePool->demand = 0;
 	}
 	return nodePool;
 }
 
 
+/*
+ * Number of connections to open at once when the pool of the node has run
+ * out of free connections. A busy pool grows by a quarter of its size, so a
+ * surge of sessions is served by a few rounds of parallel connects rather
+ * than by a connect per session.
+ */
+static int
+pool_grow_batch(PGXCNodePool *nodePool)
+{
+	int			batch = nodePool->size / 4;
+
+	if (batch > POOL_GROW_MAX_BATCH)
+		batch = POOL_GROW_MAX_BATCH;
+	if (batch > MaxPoolSize - nodePool->size)
+		batch = MaxPoolSize - nodePool->size;
+	return Max(batch, 1);
+}
+
+
+/*
+ * Put the connection just opened into the pool as free. If the connection
+ * has failed it is closed and false is returned.
+ */
+static bool
+add_pool_connection(DatabasePool *dbPool, PGXCNodePool *nodePool,
+					NODE_CONNECTION *conn)
+{
+	PGXCNodePoolSlot *slot;
+
+	/* Allocate new slot */
+	slot = (PGXCNodePoolSlot *) MemoryContextAlloc(PoolerSlotContext,
+												   sizeof(PGXCNodePoolSlot));
+	if (slot == NULL)
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of memory")));
+	}
+
+	/* If connection fails, be sure that slot is destroyed cleanly */
+	slot->xc_cancelConn = NULL;
+	/* New connection has default session parameters */
+	slot->paramhash = 0;
+
+	slot->conn = conn;
+	if (!PGXCNodeConnected(slot->conn))
+	{
+		destroy_slot(slot);
+		ereport(LOG,
+				(errcode(ERRCODE_CONNECTION_FAILURE),
+				 errmsg("failed to connect to Datanode")));
+		return false;
+	}
+
+	slot->xc_cancelConn = (NODE_CANCEL *) PQgetCancel((PGconn *)slot->conn);
+	slot->released = time(NULL);
+	if (dbPool->oldest_idle == (time_t) 0)
+		dbPool->oldest_idle = slot->released;
+
+	/* Insert at the end of the pool */
+	nodePool->slot[(nodePool->freeSize)++] = slot;
+
+	/* Increase count of pool size */
+	(nodePool->size)++;
+	elog(DEBUG1, "Pooler: increased pool size to %d for pool %s",
+		 nodePool->size,
+		 nodePool->connstr);
+	return true;
+}
+
+
+/*
+ * Open one more connection to every Datanode which pool of every database
+ * has fewer than min_pool_size free connections. Connecting blocks the
+ * pooler, so it is done only when there are no requests to serve, see
+ * PoolerLoop, and at most one connection per node pool at a time. The
+ * connections are opened in parallel.
+ * Returns true if some pools are still below the minimum. If all the
+ * connections fail the pools are left as is until the next maintenance.
+ */
+static bool
+warm_up_pools(void)
+{
+	DatabasePool   *dbPool;
+	DatabasePool  **dbPools;
+	PGXCNodePool  **nodePools;
+	Oid			   *coOids;
+	Oid			   *dnOids;
+	int				numCo;
+	int				numDn;
+	int				count = 0;
+	int				maxcount = 0;
+	int				i;
+	bool			result = false;
+
+	if (MinPoolSize <= 0)
+		return false;
+
+	PgxcNodeGetOids(&coOids, &dnOids, &numCo, &numDn, false);
+	for (dbPool = databasePools; dbPool; dbPool = dbPool->next)
+		maxcount += numDn;
+	dbPools = (DatabasePool **) palloc((maxcount + 1) * sizeof(DatabasePool *));
+	nodePools = (PGXCNodePool **) palloc((maxcount + 1) * sizeof(PGXCNodePool *));
+
+	for (dbPool = databasePools; dbPool; dbPool = dbPool->next)
+	{
+		MemoryContext oldcontext;
+
+		/*
+		 * Pools no session is using are left alone, the database may be
+		 * about to be dropped
+		 */
+		if (!pool_in_use(dbPool))
+			continue;
+
+		oldcontext = MemoryContextSwitchTo(dbPool->mcxt);
+		for (i = 0; i < numDn; i++)
+		{
+			PGXCNodePool   *nodePool = get_node_pool(dbPool, dnOids[i]);
+
+			if (nodePool->freeSize < MinPoolSize &&
+					nodePool->size < MaxPoolSize)
+			{
+				dbPools[count] = dbPool;
+				nodePools[count++] = nodePool;
+			}
+		}
+		MemoryContextSwitchTo(oldcontext);
+	}
+	pfree(coOids);
+	pfree(dnOids);
+
+	/* Go on if connected and there is still room to grow */
+	if (count > 0 && connect_pools(count, dbPools, nodePools) > 0)
+	{
+		for (i = 0; i < count; i++)
+		{
+			if (nodePools[i]->freeSize < MinPoolSize &&
+					nodePools[i]->size < MaxPoolSize)
+				result = true;
+		}
+	}
+	pfree(dbPools);
+	pfree(nodePools);
+
+	return result;
+}
+
+
+/*
+ * Open a new connection for each of the listed node pools, all at the same
+ * time, and put them into the pools as free. The pools are in the matching
+ * database pools. Returns the number of connections opened.
+ */
+static int
+connect_pools(int count, DatabasePool **dbPools, PGXCNodePool **nodePools)
+{
+	char			  **connstrs;
+	NODE_CONNECTION   **conns;
+	int					i;
+	int					result = 0;
+
+	connstrs = (char **) palloc(count * sizeof(char *));
+	conns = (NODE_CONNECTION **) palloc(count * sizeof(NODE_CONNECTION *));
+	for (i = 0; i < count; i++)
+		connstrs[i] = nodePools[i]->connstr;
+
+	PGXCNodeConnectAll(count, connstrs, conns);
+
+	for (i = 0; i < count; i++)
+	{
+		MemoryContext oldcontext = MemoryContextSwitchTo(dbPools[i]->mcxt);
+
+		if (add_pool_connection(dbPools[i], nodePools[i], conns[i]))
+			result++;
+		else
+			nodePools[i]->grow_failures++;
+		MemoryContextSwitchTo(oldcontext);
+	}
+	pfree(connstrs);
+	pfree(conns);
+
+	return result;
+}
+
+
 /*
  * Destroy pool slot
  */
@@ -2057,6 +3072,115 @@ destroy_node_pool(PGXCNodePool *node_pool)
 }
 
 
+/*
+ * Close the free connections of the node pool which are unusable because the
+ * remote end has closed them or sent something unexpected, like the message
+ * of a terminated backend. All the connections are checked with one poll()
+ * call. Return the number of closed connections.
+ */
+static int
+check_node_pool(PGXCNodePool *nodePool)
+{
+	struct pollfd *fds;
+	int			i;
+	int			j;
+	int			closed = 0;
+	int			res;
+
+	if (nodePool->freeSize == 0)
+		return 0;
+
+	fds = (struct pollfd *) palloc(nodePool->freeSize * sizeof(struct pollfd));
+	for (i = 0; i < nodePool->freeSize; i++)
+	{
+		fds[i].fd = PQsocket((PGconn *) nodePool->slot[i]->conn);
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+
+	do
+		res = poll(fds, nodePool->freeSize, 0);
+	while (res < 0 && (errno == EINTR || errno == EAGAIN));
+
+	if (res < 0)
+		elog(WARNING, "Error in checking connections, errno = %d", errno);
+	else
+	{
+		/* Keep the order of the remaining slots */
+		for (i = 0, j = 0; i < nodePool->freeSize; i++)
+		{
+			if (fds[i].fd < 0 || fds[i].revents != 0)
+			{
+				destroy_slot(nodePool->slot[i]);
+				closed++;
+			}
+			else
+				nodePool->slot[j++] = nodePool->slot[i];
+		}
+		nodePool->freeSize = j;
+		nodePool->size -= closed;
+		nodePool->destroyed += closed;
+		if (closed > 0 && nodePool->freeSize < MinPoolSize)
+			warm_up_pending = true;
+	}
+	pfree(fds);
+
+	return closed;
+}
+
+
+/*
+ * Close the broken free connections to the node in all the database pools
+ */
+static void
+evict_dead_slots(Oid node)
+{
+	DatabasePool *databasePool;
+	int			closed = 0;
+
+	for (databasePool = databasePools; databasePool;
+			databasePool = databasePool->next)
+	{
+		PGXCNodePool *nodePool;
+
+		nodePool = (PGXCNodePool *) hash_search(databasePool->nodePools,
+												&node, HASH_FIND, NULL);
+		if (nodePool)
+			closed += check_node_pool(nodePool);
+	}
+
+	if (closed > 0)
+		elog(LOG, "Pooler: closed %d broken connections to node %u",
+			 closed, node);
+}
+
+
+/*
+ * Check the free connections of all the pools, so the connections broken
+ * by a node restart are replaced before sessions try to use them
+ */
+static void
+pools_health_check(void)
+{
+	DatabasePool *databasePool;
+	int			closed = 0;
+
+	for (databasePool = databasePools; databasePool;
+			databasePool = databasePool->next)
+	{
+		HASH_SEQ_STATUS hseq_status;
+		PGXCNodePool   *nodePool;
+
+		hash_seq_init(&hseq_status, databasePool->nodePools);
+		while ((nodePool = (PGXCNodePool *) hash_seq_search(&hseq_status)))
+			closed += check_node_pool(nodePool);
+	}
+
+	if (closed > 0)
+		elog(LOG, "Pooler: closed %d broken connections", closed);
+}
+
+
 /*
  * Main handling loop
  */
@@ -2065,6 +3189,7 @@ PoolerLoop(void)
 {
 	StringInfoData 	input_message;
 	time_t			last_maintenance = (time_t) 0;
+	time_t			last_health_check = (time_t) 0;
 	int				maintenance_timeout;
 	struct pollfd	*pool_fd;
 	int i;
@@ -2178,6 +3303,31 @@ PoolerLoop(void)
 		}
 		else
 			maintenance_timeout = -1;
+
+		/* Do not wait if there are connections to warm up */
+		if (warm_up_pending)
+			maintenance_timeout = 0;
+
+		/* Wake up to check the pooled connections */
+		if (databasePools)
+		{
+			double		timediff = difftime(time(NULL), last_health_check);
+			int			check_timeout = 0;
+
+			if (timediff < POOL_HEALTH_CHECK_INTERVAL)
+				check_timeout = (POOL_HEALTH_CHECK_INTERVAL - rint(timediff)) * 1000;
+			if (maintenance_timeout < 0 || check_timeout < maintenance_timeout)
+				maintenance_timeout = check_timeout;
+		}
+
+		/* Wake up to fail the requests waiting for too long */
+		if (poolWaiters != NIL)
+		{
+			int			wait_timeout = waiters_timeout();
+
+			if (maintenance_timeout < 0 || wait_timeout < maintenance_timeout)
+				maintenance_timeout = wait_timeout;
+		}
 		/*
 		 * Emergency bailout if postmaster has died.  This is to avoid the
 		 * necessity for manual cleanup of all postmaster children.
@@ -2243,9 +3393,29 @@ PoolerLoop(void)
 		else if (retval == 0)
 		{
 			/* maintenance timeout */
-			pools_maintenance();
-			last_maintenance = time(NULL);
+			if (!warm_up_pending || (PoolMaintenanceTimeout > 0 &&
+					difftime(time(NULL), last_maintenance) >= PoolMaintenanceTimeout))
+			{
+				update_pool_demand();
+				pools_maintenance();
+				last_maintenance = time(NULL);
+			}
+			/* pooler is idle, prepare connections */
+			if (warm_up_pending)
+				warm_up_pending = warm_up_pools();
+		}
+
+		/* Replace the connections broken by node restarts without delay */
+		if (databasePools &&
+				difftime(time(NULL), last_health_check) >= POOL_HEALTH_CHECK_INTERVAL)
+		{
+			pools_health_check();
+			last_health_check = time(NULL);
 		}
+
+		/* Connections may have been released or waits have timed out */
+		if (poolWaiters != NIL)
+			serve_waiters();
 	}
 }
 
@@ -2392,6 +3562,7 @@ build_node_conn_str(Oid node, DatabasePool *dbPool)
 {
 	NodeDefinition *nodeDef;
 	char 		   *connstr;
+	char		   *host = NULL;
 
 	nodeDef = PgxcNodeGetDefinition(node);
 	if (nodeDef == NULL)
@@ -2400,7 +3571,14 @@ build_node_conn_str(Oid node, DatabasePool *dbPool)
 		return NULL;
 	}
 
-	connstr = PGXCNodeConnStr(NameStr(nodeDef->nodehost),
+	/*
+	 * Connect to the node running on the same host through the Unix-domain
+	 * socket, if allowed. It saves the TCP/IP stack processing on both ends.
+	 */
+	if (PoolUseUnixSocket && node_host_is_local(NameStr(nodeDef->nodehost)))
+		host = local_socket_dir();
+
+	connstr = PGXCNodeConnStr(host ? host : NameStr(nodeDef->nodehost),
 							  nodeDef->nodeport,
 							  dbPool->database,
 							  dbPool->user_name,
@@ -2408,13 +3586,114 @@ build_node_conn_str(Oid node, DatabasePool *dbPool)
 							  IS_PGXC_COORDINATOR ? "coordinator" : "datanode",
 							  PGXCNodeName);
 	pfree(nodeDef);
+	if (host)
+		pfree(host);
 
 	return connstr;
 }
 
+/*
+ * Check if the node host name refers to the host we are running on: it is
+ * a loopback address, our host name, or the host of our own node definition.
+ */
+static bool
+node_host_is_local(const char *host)
+{
+	char		hostname[256];
+	Oid		   *coOids;
+	Oid		   *dnOids;
+	int			numCo;
+	int			numDn;
+	int			i;
+	bool		result = false;
+
+	if (pg_strcasecmp(host, "localhost") == 0 ||
+		strncmp(host, "127.", 4) == 0 ||
+		strcmp(host, "::1") == 0)
+		return true;
+
+	if (gethostname(hostname, sizeof(hostname)) == 0)
+	{
+		hostname[sizeof(hostname) - 1] = '\0';
+		if (pg_strcasecmp(host, hostname) == 0)
+			return true;
+	}
+
+	PgxcNodeGetOids(&coOids, &dnOids, &numCo, &numDn, false);
+	for (i = 0; i < numCo + numDn; i++)
+	{
+		NodeDefinition *nodeDef;
+
+		nodeDef = PgxcNodeGetDefinition(i < numCo ? coOids[i] : dnOids[i - numCo]);
+		if (nodeDef == NULL)
+			continue;
+		if (strcmp(NameStr(nodeDef->nodename), PGXCNodeName) == 0)
+		{
+			result = (pg_strcasecmp(NameStr(nodeDef->nodehost), host) == 0);
+			pfree(nodeDef);
+			break;
+		}
+		pfree(nodeDef);
+	}
+	pfree(coOids);
+	pfree(dnOids);
+
+	return result;
+}
+
+/*
+ * Directory of the Unix-domain socket of the local nodes, we assume they
+ * use the same as the first of ours. Returns NULL if we have none.
+ */
+static char *
+local_socket_dir(void)
+{
+	char	   *rawstring;
+	List	   *elemlist;
+	char	   *result = NULL;
+
+	rawstring = pstrdup(Unix_socket_directories);
+	if (SplitDirectoriesString(rawstring, ',', &elemlist) && elemlist != NIL)
+		result = pstrdup((char *) linitial(elemlist));
+	list_free_deep(elemlist);
+	pfree(rawstring);
+
+	return result;
+}
+
+/*
+ * Update the demand of the node pools with the peak number of connections
+ * used since the last update, and start counting the next peak.
+ */
+static void
+update_pool_demand(void)
+{
+	DatabasePool   *databasePool;
+
+	for (databasePool = databasePools; databasePool;
+			databasePool = databasePool->next)
+	{
+		HASH_SEQ_STATUS hseq_status;
+		PGXCNodePool   *nodePool;
+
+		hash_seq_init(&hseq_status, databasePool->nodePools);
+		while ((nodePool = (PGXCNodePool *) hash_seq_search(&hseq_status)))
+		{
+			nodePool->demand += POOL_DEMAND_WEIGHT *
+				(nodePool->peak_used - nodePool->demand);
+			nodePool->peak_used = nodePool->size - nodePool->freeSize;
+		}
+	}
+}
+
 /*
  * Check all pooled connections, and close which have been released more then
  * PooledConnKeepAlive seconds ago.
+ * Free slots are ordered by release time, so the least recently used ones are
+ * closed first. If the pool is in use it is not shrunk below its demand plus
+ * headroom, or below min_pool_size free connections, and it is shrunk
+ * gradually, so sessions coming back after a spike do not have to reopen all
+ * the connections at once.
  * Return true if shrink operation closed all the connections and pool can be
  * ddestroyed, false if there are still connections or pool is in use.
  */
@@ -2424,42 +3703,58 @@ shrink_pool(DatabasePool *pool)
 	time_t 			now = time(NULL);
 	HASH_SEQ_STATUS hseq_status;
 	PGXCNodePool   *nodePool;
-	int 			i;
 	bool			empty = true;
+	bool			in_use;
 
 	/* Negative PooledConnKeepAlive disables automatic connection cleanup */
 	if (PoolConnKeepAlive < 0)
 		return false;
 
+	in_use = pool_in_use(pool);
+
 	pool->oldest_idle = (time_t) 0;
 	hash_seq_init(&hseq_status, pool->nodePools);
 	while ((nodePool = (PGXCNodePool *) hash_seq_search(&hseq_status)))
 	{
-		/* Go thru the free slots and destroy those that are free too long */
-		for (i = 0; i < nodePool->freeSize; )
+		int			keep = 0;
+		int			evict;
+
+		if (in_use)
 		{
-			PGXCNodePoolSlot *slot = nodePool->slot[i];
+			int			target = (int) ceil(nodePool->demand * (1.0 + POOL_HEADROOM));
 
-			if (difftime(now, slot->released) > PoolConnKeepAlive)
-			{
-				/* connection is idle for long, close it */
-				destroy_slot(slot);
-				/* reduce pool size and total number of connections */
-				(nodePool->freeSize)--;
-				(nodePool->size)--;
-				/* move last connection in place, if not at last already */
-				if (i < nodePool->freeSize)
-					nodePool->slot[i] = nodePool->slot[nodePool->freeSize];
-			}
-			else
-			{
-				if (pool->oldest_idle == (time_t) 0 ||
-						difftime(pool->oldest_idle, slot->released) > 0)
-					pool->oldest_idle = slot->released;
+			/* Pools of the connected sessions keep min_pool_size free */
+			keep = Max(MinPoolSize, target - (nodePool->size - nodePool->freeSize));
+		}
 
-				i++;
-			}
+		/* Count the connections idle for too long, the oldest come first */
+		for (evict = 0; evict < nodePool->freeSize - keep; evict++)
+			if (difftime(now, nodePool->slot[evict]->released) <= PoolConnKeepAlive)
+				break;
+
+		if (in_use && evict > 1)
+			evict = (evict + POOL_SHRINK_DIVISOR - 1) / POOL_SHRINK_DIVISOR;
+
+		if (evict > 0)
+		{
+			int			i;
+
+			/* connections are idle for long, close them */
+			for (i = 0; i < evict; i++)
+				destroy_slot(nodePool->slot[i]);
+			nodePool->evicted += evict;
+			/* reduce pool size and total number of connections */
+			nodePool->freeSize -= evict;
+			nodePool->size -= evict;
+			memmove(&nodePool->slot[0], &nodePool->slot[evict],
+					nodePool->freeSize * sizeof(PGXCNodePoolSlot *));
 		}
+
+		if (nodePool->freeSize > 0 &&
+				(pool->oldest_idle == (time_t) 0 ||
+				 difftime(pool->oldest_idle, nodePool->slot[0]->released) > 0))
+			pool->oldest_idle = nodePool->slot[0]->released;
+
 		if (nodePool->size > 0)
 			empty = false;
 		else
@@ -2476,19 +3771,30 @@ shrink_pool(DatabasePool *pool)
 	 * If all such sessions will eventually disconnect the pool will be
 	 * destroyed during next maintenance procedure.
 	 */
-	if (empty)
-	{
-		for (i = 0; i < agentCount; i++)
-		{
-			if (poolAgents[i]->pool == pool)
-				return false;
-		}
-	}
+	if (empty && in_use)
+		return false;
 
 	return empty;
 }
 
 
+/*
+ * Check if any session is connected to the pool
+ */
+static bool
+pool_in_use(DatabasePool *pool)
+{
+	int			i;
+
+	for (i = 0; i < agentCount; i++)
+	{
+		if (poolAgents[i]->pool == pool)
+			return true;
+	}
+	return false;
+}
+
+
 /*
  * Scan connection pools and release connections which are idle for long.
  * If pool gets empty after releasing connections it is destroyed.
@@ -2514,6 +3820,8 @@ pools_maintenance(void)
 				shrink_pool(curr))
 		{
 			MemoryContext mem = curr->mcxt;
+
+			unindex_database_pool(curr);
 			curr = curr->next;
 			if (prev)
 				prev->next = curr;
@@ -2530,4 +3838,8 @@ pools_maintenance(void)
 	}
 	elog(DEBUG1, "Pool maintenance, done in %f seconds, removed %d pools",
 			difftime(time(NULL), now), count);
+
+	/* Retry the connections failed since last time */
+	if (MinPoolSize > 0)
+		warm_up_pending = true;
 }
@@ -22,6 +22,7 @@
 #include "miscadmin.h"
 #include "libpq/pqsignal.h"
 
+#include "funcapi.h"
 #include "pgxc/pgxc.h"
 #include "nodes/nodes.h"
 #include "nodes/pg_list.h"
@@ -31,6 +32,7 @@
 #include "pgxc/poolutils.h"
 #include "pgxc/pgxcnode.h"
 #include "access/gtm.h"
+#include "access/htup_details.h"
 #include "access/xact.h"
 #include "catalog/pgxc_node.h"
 #include "commands/dbcommands.h"
@@ -42,6 +44,8 @@
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/resowner.h"
+#include "utils/syscache.h"
+#include "utils/tuplestore.h"
 
 /*
  * pgxc_pool_check
@@ -121,6 +125,87 @@ pgxc_pool_reload(PG_FUNCTION_ARGS)
 	PG_RETURN_BOOL(true);
 }
 
+/*
+ * pg_stat_get_pooler
+ *
+ * SQL SRF showing the state and activity counters of the node pools of the
+ * pooler, one row per database pool and node.
+ */
+Datum
+pg_stat_get_pooler(PG_FUNCTION_ARGS)
+{
+#define PG_STAT_GET_POOLER_COLS 11
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+	List	   *pools;
+	ListCell   *lc;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	pools = PoolManagerGetStatistics();
+	foreach(lc, pools)
+	{
+		PoolNodeStatistics *stats = (PoolNodeStatistics *) lfirst(lc);
+		Datum		values[PG_STAT_GET_POOLER_COLS];
+		bool		nulls[PG_STAT_GET_POOLER_COLS];
+		HeapTuple	tuple;
+		Form_pgxc_node nodeForm;
+
+		/* Pools of the dropped nodes are going away, skip them */
+		tuple = SearchSysCache1(PGXCNODEOID, ObjectIdGetDatum(stats->nodeoid));
+		if (!HeapTupleIsValid(tuple))
+			continue;
+		nodeForm = (Form_pgxc_node) GETSTRUCT(tuple);
+
+		MemSet(nulls, 0, sizeof(nulls));
+		values[0] = DirectFunctionCall1(namein, CStringGetDatum(stats->database));
+		values[1] = DirectFunctionCall1(namein, CStringGetDatum(stats->user_name));
+		values[2] = NameGetDatum(&nodeForm->node_name);
+		values[3] = CStringGetTextDatum(nodeForm->node_type == PGXC_NODE_COORDINATOR ?
+										"coordinator" : "datanode");
+		values[4] = Int32GetDatum(stats->size);
+		values[5] = Int32GetDatum(stats->freeSize);
+		values[6] = Int64GetDatum(stats->acquisitions);
+		values[7] = Float8GetDatum(stats->wait_time / 1000.0);
+		values[8] = Int64GetDatum(stats->grow_failures);
+		values[9] = Int64GetDatum(stats->destroyed);
+		values[10] = Int64GetDatum(stats->evicted);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		ReleaseSysCache(tuple);
+	}
+	list_free_deep(pools);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
 /*
  * CleanConnection()
  *
@@ -0,0 +1,839 @@
+/*-------------------------------------------------------------------------
+ *
+ * resultcache.c
+ *	  Result cache of the queries of a Coordinator on read-mostly tables
+ *
+ * Queries on small tables that are rarely written, like the replicated
+ * reference tables, are sent to the Datanodes again and again to return
+ * the same rows. A Coordinator can keep the results of such queries and
+ * answer them from memory, without going to the Datanodes.
+ *
+ * Only the queries reading nothing but tables with the result_cache option
+ * set, and without volatile or stable functions, are considered by the
+ * planner, and only when all of the query is done on the Datanodes, under a
+ * single remote subplan. The key is the query tree, and at execution time
+ * the values of the parameters. The cache of each backend is limited to
+ * result_cache_size, the least recently used results are evicted first.
+ *
+ * The Datanodes commit the writes before the GTM does, so a result may be
+ * read with a snapshot not seeing a write already committed on the nodes,
+ * and the invalidation messages of the write do not help. Instead, each
+ * Coordinator counts the writes of each table in shared memory, the writer
+ * bumping the count of the table on all the Coordinators when it starts
+ * writing the table in a transaction, and remembers the transaction ids of
+ * the latest writers. A result is stored only if no write of its tables
+ * started while it was read, and if all the recent writers were visible to
+ * the snapshot it was read with. It is used as long as the counts of its
+ * tables are the same as when it was read.
+ *
+ * The writes made on the Datanodes without going through a Coordinator, by
+ * EXECUTE DIRECT or by the triggers run there, are not seen; after them
+ * pgxc_result_cache_invalidate has to be called. The transactions using
+ * the same snapshot for all their statements do not use the cache.
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ *
+ * IDENTIFICATION
+ *	  src/backend/pgxc/pool/resultcache.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "access/hash.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/transam.h"
+#include "access/xact.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "executor/tuptable.h"
+#include "lib/ilist.h"
+#include "lib/stringinfo.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "pgxc/execRemote.h"
+#include "pgxc/nodemgr.h"
+#include "pgxc/pgxc.h"
+#include "pgxc/planner.h"
+#include "pgxc/resultcache.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
+
+/* Configuration options */
+int			ResultCacheSize = 0;
+
+/* Counts of writes, by hash of the table, and the latest writers */
+#define RESULT_CACHE_COUNTERS	1024
+#define RESULT_CACHE_WRITERS	64
+
+typedef struct
+{
+	slock_t		mutex;
+	/* the latest writer that is no longer in writers */
+	TransactionId horizon;
+	int			nextwriter;
+	TransactionId writers[RESULT_CACHE_WRITERS];
+	uint32		counters[RESULT_CACHE_COUNTERS];
+} ResultCacheSharedData;
+
+static ResultCacheSharedData *ResultCacheShared = NULL;
+
+typedef struct ResultCacheKey
+{
+	uint32		hashvalue;		/* hash of the key data */
+	int			length;			/* length of the key data */
+} ResultCacheKey;
+
+typedef struct ResultCacheEntry
+{
+	ResultCacheKey key;			/* hash key, must be first */
+	MemoryContext context;		/* holds the rest of the entry */
+	char	   *keydata;		/* query and parameters, to detect collisions */
+	int			nrels;
+	Oid		   *relids;			/* the tables read */
+	uint32	   *counters;		/* their counts of writes when read */
+	int			ntuples;
+	MinimalTuple *tuples;		/* the result */
+	Size		size;
+	dlist_node	lru;			/* most recently used first */
+} ResultCacheEntry;
+
+struct ResultCacheScan
+{
+	MemoryContext context;		/* holds the key and the tuples */
+	ResultCacheKey key;
+	char	   *keydata;
+	int			nrels;
+	Oid		   *relids;
+	uint32	   *counters;		/* counts of writes when the scan began */
+	Snapshot	snapshot;		/* the snapshot the result is read with */
+	uint32		flushcount;
+	bool		hit;			/* result is in tuples */
+	bool		collecting;		/* collect the result to store it */
+	int			ntuples;
+	int			maxtuples;
+	MinimalTuple *tuples;
+	int			pos;			/* next tuple to return on hit */
+	Size		size;
+};
+
+static HTAB *ResultCacheHash = NULL;
+static MemoryContext ResultCacheContext = NULL;
+static dlist_head ResultCacheLRU = DLIST_STATIC_INIT(ResultCacheLRU);
+static Size ResultCacheUsed = 0;
+/* Incremented when entries are removed on invalidation */
+static uint32 ResultCacheFlushCount = 0;
+
+/* The tables written by the current transaction */
+static TransactionId ResultCacheWriterXid = InvalidTransactionId;
+static List *ResultCacheWrittenRels = NIL;
+
+static bool result_cache_query_walker(Node *node, bool *found);
+static int	result_cache_counter(Oid relid);
+static void result_cache_changed(Oid relid, TransactionId xid);
+static bool result_cache_valid(ResultCacheScan *scan);
+static void result_cache_notify(Relation rel, TransactionId xid);
+static void result_cache_init(void);
+static void result_cache_remove(ResultCacheEntry *entry);
+static void InvalidateResultCacheCallBack(Datum arg, int cacheid,
+							  uint32 hashvalue);
+static void InvalidateResultCacheRelCallBack(Datum arg, Oid relid);
+
+
+/* Report shared memory space needed by ResultCacheShmemInit */
+Size
+ResultCacheShmemSize(void)
+{
+	return sizeof(ResultCacheSharedData);
+}
+
+/* Allocate and initialize result cache shared memory */
+void
+ResultCacheShmemInit(void)
+{
+	bool		found;
+
+	ResultCacheShared = (ResultCacheSharedData *)
+		ShmemInitStruct("Result Cache", ResultCacheShmemSize(), &found);
+
+	if (!found)
+	{
+		MemSet(ResultCacheShared, 0, ResultCacheShmemSize());
+		SpinLockInit(&ResultCacheShared->mutex);
+	}
+}
+
+
+/*
+ * The result of a query may be cached if it reads cached tables only, views
+ * on them aside.
+ */
+static bool
+result_cache_query_walker(Node *node, bool *found)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, RangeTblEntry))
+	{
+		RangeTblEntry *rte = (RangeTblEntry *) node;
+		Relation	rel;
+		bool		cached;
+
+		if (rte->rtekind != RTE_RELATION || rte->relkind == RELKIND_VIEW)
+			return false;
+
+		/* The query is locked by the caller */
+		rel = relation_open(rte->relid, NoLock);
+		cached = RelationHasResultCache(rel) &&
+			RelationGetLocInfo(rel) != NULL;
+		relation_close(rel, NoLock);
+		if (!cached)
+			return true;
+		*found = true;
+		return false;
+	}
+	if (IsA(node, Query))
+		return query_tree_walker((Query *) node, result_cache_query_walker,
+								 (void *) found, QTW_EXAMINE_RTES);
+	return expression_tree_walker(node, result_cache_query_walker,
+								  (void *) found);
+}
+
+/*
+ * ResultCacheQueryKey
+ *	Returns the key of the result of the query in the cache, or NULL if the
+ *	result can not be cached. Called by the planner before it modifies the
+ *	query.
+ */
+char *
+ResultCacheQueryKey(Query *query)
+{
+	bool		found = false;
+
+	if (!IS_PGXC_LOCAL_COORDINATOR ||
+		query->commandType != CMD_SELECT ||
+		query->utilityStmt != NULL ||
+		query->rowMarks != NIL ||
+		query->hasModifyingCTE)
+		return NULL;
+
+	if (result_cache_query_walker((Node *) query, &found) || !found)
+		return NULL;
+
+	/* The result must depend on the data and the parameters only */
+	if (contain_mutable_functions((Node *) query))
+		return NULL;
+
+	return nodeToString(query);
+}
+
+
+static int
+result_cache_counter(Oid relid)
+{
+	uint32		hashvalue;
+
+	hashvalue = DatumGetUInt32(hash_uint32((uint32) relid)) ^ MyDatabaseId;
+	return hashvalue % RESULT_CACHE_COUNTERS;
+}
+
+/*
+ * A write of the table started, forget the results read before it, and
+ * remember the writer, so the results read before it commits are not stored.
+ */
+static void
+result_cache_changed(Oid relid, TransactionId xid)
+{
+	volatile ResultCacheSharedData *shared = ResultCacheShared;
+	int			n = result_cache_counter(relid);
+
+	if (shared == NULL)
+		return;
+
+	SpinLockAcquire(&shared->mutex);
+	shared->counters[n]++;
+	if (TransactionIdIsValid(xid))
+	{
+		TransactionId oldest = shared->writers[shared->nextwriter];
+
+		if (TransactionIdIsValid(oldest) &&
+			(!TransactionIdIsValid(shared->horizon) ||
+			 TransactionIdFollows(oldest, shared->horizon)))
+			shared->horizon = oldest;
+		shared->writers[shared->nextwriter] = xid;
+		shared->nextwriter = (shared->nextwriter + 1) % RESULT_CACHE_WRITERS;
+	}
+	SpinLockRelease(&shared->mutex);
+}
+
+/*
+ * The result read by the scan may be stored if its tables were not written
+ * while it was read, and if all the writers it may have missed had
+ * committed as of its snapshot.
+ */
+static bool
+result_cache_valid(ResultCacheScan *scan)
+{
+	volatile ResultCacheSharedData *shared = ResultCacheShared;
+	Snapshot	snapshot = scan->snapshot;
+	bool		valid = true;
+	int			i,
+				j;
+
+	SpinLockAcquire(&shared->mutex);
+	for (i = 0; valid && i < scan->nrels; i++)
+		if (shared->counters[result_cache_counter(scan->relids[i])] !=
+			scan->counters[i])
+			valid = false;
+	if (valid && TransactionIdIsValid(shared->horizon))
+	{
+		if (!TransactionIdPrecedes(shared->horizon, snapshot->xmin))
+			valid = false;
+		else if (TransactionIdIsNormal(RecentGlobalXmin) &&
+				 TransactionIdPrecedes(shared->horizon, RecentGlobalXmin))
+			shared->horizon = InvalidTransactionId;
+	}
+	for (i = 0; valid && i < RESULT_CACHE_WRITERS; i++)
+	{
+		TransactionId xid = shared->writers[i];
+
+		if (!TransactionIdIsValid(xid) ||
+			TransactionIdPrecedes(xid, snapshot->xmin))
+		{
+			/* No snapshot can miss it any more */
+			if (TransactionIdIsValid(xid) &&
+				TransactionIdIsNormal(RecentGlobalXmin) &&
+				TransactionIdPrecedes(xid, RecentGlobalXmin))
+				shared->writers[i] = InvalidTransactionId;
+			continue;
+		}
+		if (!TransactionIdPrecedes(xid, snapshot->xmax))
+			valid = false;
+		for (j = 0; valid && j < snapshot->xcnt; j++)
+			if (TransactionIdEquals(xid, snapshot->xip[j]))
+				valid = false;
+	}
+	SpinLockRelease(&shared->mutex);
+
+	return valid;
+}
+
+/*
+ * Tell the other Coordinators the table is being written by the transaction.
+ */
+static void
+result_cache_notify(Relation rel, TransactionId xid)
+{
+	RemoteQuery *plan;
+	RemoteQueryState *pstate;
+	EState	   *estate;
+	MemoryContext oldcontext;
+	TupleTableSlot *result;
+	StringInfoData buf;
+	char	   *relname;
+
+	relname = quote_qualified_identifier(
+							get_namespace_name(RelationGetNamespace(rel)),
+										 RelationGetRelationName(rel));
+	initStringInfo(&buf);
+	appendStringInfo(&buf,
+					 "SELECT pg_catalog.pgxc_result_cache_invalidate(%s::pg_catalog.regclass, '%u'::pg_catalog.xid)",
+					 quote_literal_cstr(relname), xid);
+
+	plan = makeNode(RemoteQuery);
+	plan->combine_type = COMBINE_TYPE_NONE;
+	plan->exec_nodes = NULL;
+	plan->exec_type = EXEC_ON_COORDS;
+	plan->sql_statement = buf.data;
+	plan->force_autocommit = false;
+	/* Nothing is written, no need to prepare the Coordinators */
+	plan->read_only = true;
+	plan->scan.plan.targetlist =
+		list_make1(makeTargetEntry((Expr *) makeVar(1, 1, VOIDOID, -1,
+													InvalidOid, 0),
+								   1, NULL, false));
+
+	estate = CreateExecutorState();
+	oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+	estate->es_snapshot = GetActiveSnapshot();
+	pstate = ExecInitRemoteQuery(plan, estate, 0);
+	MemoryContextSwitchTo(oldcontext);
+
+	result = ExecRemoteQuery(pstate);
+	while (!TupIsNull(result))
+		result = ExecRemoteQuery(pstate);
+
+	ExecEndRemoteQuery(pstate);
+	FreeExecutorState(estate);
+	pfree(buf.data);
+}
+
+/*
+ * ResultCacheRelationModified
+ *	The table is about to be written by the current transaction. The first
+ *	time in the transaction, forget the results read from it before, on all
+ *	the Coordinators.
+ */
+void
+ResultCacheRelationModified(Relation rel)
+{
+	TransactionId xid;
+	MemoryContext oldcontext;
+
+	if (ResultCacheShared == NULL || !RelationHasResultCache(rel))
+		return;
+
+	xid = GetTopTransactionId();
+	if (!TransactionIdEquals(xid, ResultCacheWriterXid))
+	{
+		/* The list of the previous transaction is gone with its context */
+		ResultCacheWriterXid = xid;
+		ResultCacheWrittenRels = NIL;
+	}
+	else if (list_member_oid(ResultCacheWrittenRels, RelationGetRelid(rel)))
+		return;
+
+	oldcontext = MemoryContextSwitchTo(TopTransactionContext);
+	ResultCacheWrittenRels = lappend_oid(ResultCacheWrittenRels,
+										 RelationGetRelid(rel));
+	MemoryContextSwitchTo(oldcontext);
+
+	result_cache_changed(RelationGetRelid(rel), xid);
+	if (NumCoords > 1)
+		result_cache_notify(rel, xid);
+}
+
+/*
+ * pgxc_result_cache_invalidate
+ *	Forget the results read from the table on all the Coordinators. If the
+ *	transaction writing it is given, the results read before it commits are
+ *	not stored either.
+ */
+Datum
+pgxc_result_cache_invalidate(PG_FUNCTION_ARGS)
+{
+	Oid			relid;
+	TransactionId xid;
+	Relation	rel;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_VOID();
+	relid = PG_GETARG_OID(0);
+	xid = PG_ARGISNULL(1) ? InvalidTransactionId :
+		DatumGetTransactionId(PG_GETARG_DATUM(1));
+
+	rel = relation_open(relid, AccessShareLock);
+	if (pg_class_aclmask(relid, GetUserId(),
+						 ACL_INSERT | ACL_UPDATE | ACL_DELETE | ACL_TRUNCATE,
+						 ACLMASK_ANY) == 0)
+		aclcheck_error(ACLCHECK_NO_PRIV, ACL_KIND_CLASS,
+					   RelationGetRelationName(rel));
+
+	result_cache_changed(relid, xid);
+	if (IS_PGXC_LOCAL_COORDINATOR && NumCoords > 1)
+		result_cache_notify(rel, xid);
+
+	relation_close(rel, AccessShareLock);
+
+	PG_RETURN_VOID();
+}
+
+
+static void
+result_cache_init(void)
+{
+	HASHCTL		ctl;
+	static bool callbacks_registered = false;
+
+	if (!callbacks_registered)
+	{
+		/*
+		 * Results of a table are removed on any change of it, everything on
+		 * changes of the functions.
+		 */
+		CacheRegisterRelcacheCallback(InvalidateResultCacheRelCallBack,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(PROCOID,
+									  InvalidateResultCacheCallBack,
+									  (Datum) 0);
+		callbacks_registered = true;
+	}
+
+	ResultCacheContext = AllocSetContextCreate(CacheMemoryContext,
+											   "Result cache",
+											   ALLOCSET_DEFAULT_MINSIZE,
+											   ALLOCSET_DEFAULT_INITSIZE,
+											   ALLOCSET_DEFAULT_MAXSIZE);
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(ResultCacheKey);
+	ctl.entrysize = sizeof(ResultCacheEntry);
+	ctl.hcxt = ResultCacheContext;
+	ResultCacheHash = hash_create("Result cache", 256,
+								  &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	dlist_init(&ResultCacheLRU);
+	ResultCacheUsed = 0;
+}
+
+static void
+result_cache_remove(ResultCacheEntry *entry)
+{
+	ResultCacheUsed -= entry->size;
+	dlist_delete(&entry->lru);
+	MemoryContextDelete(entry->context);
+	hash_search(ResultCacheHash, (void *) &entry->key, HASH_REMOVE, NULL);
+}
+
+static void
+InvalidateResultCacheCallBack(Datum arg, int cacheid, uint32 hashvalue)
+{
+	ResultCacheFlushCount++;
+	if (ResultCacheContext)
+	{
+		MemoryContextDelete(ResultCacheContext);
+		ResultCacheContext = NULL;
+		ResultCacheHash = NULL;
+		dlist_init(&ResultCacheLRU);
+		ResultCacheUsed = 0;
+	}
+}
+
+static void
+InvalidateResultCacheRelCallBack(Datum arg, Oid relid)
+{
+	dlist_mutable_iter iter;
+
+	if (!OidIsValid(relid))
+	{
+		InvalidateResultCacheCallBack(arg, PROCOID, 0);
+		return;
+	}
+
+	ResultCacheFlushCount++;
+	if (ResultCacheHash == NULL)
+		return;
+
+	dlist_foreach_modify(iter, &ResultCacheLRU)
+	{
+		ResultCacheEntry *entry;
+		int			i;
+
+		entry = dlist_container(ResultCacheEntry, lru, iter.cur);
+		for (i = 0; i < entry->nrels; i++)
+		{
+			if (entry->relids[i] == relid)
+			{
+				result_cache_remove(entry);
+				break;
+			}
+		}
+	}
+}
+
+
+/*
+ * ResultCacheBeginScan
+ *	Look for the result of the query with the parameters of the executor in
+ *	the cache. Returns NULL if the cache can not be used; otherwise check
+ *	ResultCacheHit to know whether the result is returned by the scan, or
+ *	has to be read and given to it.
+ */
+ResultCacheScan *
+ResultCacheBeginScan(const char *querykey, EState *estate)
+{
+	volatile ResultCacheSharedData *shared = ResultCacheShared;
+	ResultCacheScan *scan;
+	ResultCacheEntry *entry;
+	ParamListInfo params = estate->es_param_list_info;
+	TransactionId xid;
+	MemoryContext oldcontext;
+	StringInfoData buf;
+	List	   *relids = NIL;
+	ListCell   *lc;
+	int			i;
+
+	if (ResultCacheSize <= 0 || ResultCacheShared == NULL ||
+		IsolationUsesXactSnapshot())
+		return NULL;
+
+	foreach(lc, estate->es_range_table)
+	{
+		RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+
+		if (rte->rtekind == RTE_RELATION)
+			relids = list_append_unique_oid(relids, rte->relid);
+	}
+
+	/* The transaction sees its own writes, the others do not */
+	xid = GetTopTransactionIdIfAny();
+	if (TransactionIdIsValid(xid) &&
+		TransactionIdEquals(xid, ResultCacheWriterXid))
+	{
+		foreach(lc, relids)
+			if (list_member_oid(ResultCacheWrittenRels, lfirst_oid(lc)))
+				return NULL;
+	}
+
+	scan = (ResultCacheScan *) palloc0(sizeof(ResultCacheScan));
+	scan->context = AllocSetContextCreate(CurrentMemoryContext,
+										  "Result cache scan",
+										  ALLOCSET_DEFAULT_MINSIZE,
+										  ALLOCSET_DEFAULT_INITSIZE,
+										  ALLOCSET_DEFAULT_MAXSIZE);
+	oldcontext = MemoryContextSwitchTo(scan->context);
+
+	/* The key is the query followed by the values of the parameters */
+	initStringInfo(&buf);
+	appendStringInfoString(&buf, querykey);
+	appendStringInfoChar(&buf, '\0');
+	for (i = 0; params && i < params->numParams; i++)
+	{
+		ParamExternData *param = &params->params[i];
+		int16		typlen;
+		bool		typbyval;
+
+		if (!OidIsValid(param->ptype) && params->paramFetch)
+			(*params->paramFetch) (params, i + 1);
+
+		appendBinaryStringInfo(&buf, (char *) &param->ptype, sizeof(Oid));
+		appendBinaryStringInfo(&buf, (char *) &param->isnull, sizeof(bool));
+		if (!OidIsValid(param->ptype) || param->isnull)
+			continue;
+
+		get_typlenbyval(param->ptype, &typlen, &typbyval);
+		if (typbyval)
+			appendBinaryStringInfo(&buf, (char *) &param->value,
+								   sizeof(Datum));
+		else if (typlen == -1)
+		{
+			struct varlena *value;
+
+			value = pg_detoast_datum((struct varlena *) DatumGetPointer(param->value));
+			appendBinaryStringInfo(&buf, (char *) value, VARSIZE(value));
+		}
+		else if (typlen == -2)
+			appendBinaryStringInfo(&buf, DatumGetCString(param->value),
+								   strlen(DatumGetCString(param->value)) + 1);
+		else
+			appendBinaryStringInfo(&buf, DatumGetPointer(param->value),
+								   typlen);
+	}
+	scan->keydata = buf.data;
+	scan->key.length = buf.len;
+	scan->key.hashvalue = DatumGetUInt32(hash_any((unsigned char *) buf.data,
+												  buf.len));
+
+	scan->nrels = list_length(relids);
+	scan->relids = (Oid *) palloc(scan->nrels * sizeof(Oid));
+	scan->counters = (uint32 *) palloc(scan->nrels * sizeof(uint32));
+	i = 0;
+	foreach(lc, relids)
+		scan->relids[i++] = lfirst_oid(lc);
+	list_free(relids);
+
+	SpinLockAcquire(&shared->mutex);
+	for (i = 0; i < scan->nrels; i++)
+		scan->counters[i] =
+			shared->counters[result_cache_counter(scan->relids[i])];
+	SpinLockRelease(&shared->mutex);
+
+	scan->snapshot = estate->es_snapshot;
+	scan->flushcount = ResultCacheFlushCount;
+
+	entry = NULL;
+	if (ResultCacheHash)
+		entry = (ResultCacheEntry *) hash_search(ResultCacheHash,
+												 (void *) &scan->key,
+												 HASH_FIND, NULL);
+	if (entry && memcmp(entry->keydata, scan->keydata, buf.len) == 0)
+	{
+		if (entry->nrels == scan->nrels &&
+			memcmp(entry->relids, scan->relids,
+				   scan->nrels * sizeof(Oid)) == 0 &&
+			memcmp(entry->counters, scan->counters,
+				   scan->nrels * sizeof(uint32)) == 0)
+		{
+			/*
+			 * Copy the result, the entry may be removed while it is
+			 * returned.
+			 */
+			scan->ntuples = entry->ntuples;
+			scan->tuples = (MinimalTuple *)
+				palloc(Max(entry->ntuples, 1) * sizeof(MinimalTuple));
+			for (i = 0; i < entry->ntuples; i++)
+				scan->tuples[i] = heap_copy_minimal_tuple(entry->tuples[i]);
+			scan->hit = true;
+			dlist_move_head(&ResultCacheLRU, &entry->lru);
+		}
+		else
+		{
+			/* A table was written since the result was read */
+			result_cache_remove(entry);
+		}
+	}
+
+	if (!scan->hit)
+	{
+		scan->collecting = true;
+		scan->maxtuples = 64;
+		scan->tuples = (MinimalTuple *)
+			palloc(scan->maxtuples * sizeof(MinimalTuple));
+		scan->size = sizeof(ResultCacheEntry) + scan->key.length +
+			scan->nrels * (sizeof(Oid) + sizeof(uint32));
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return scan;
+}
+
+/* Is the result of the scan taken from the cache? */
+bool
+ResultCacheHit(ResultCacheScan *scan)
+{
+	return scan->hit;
+}
+
+/*
+ * ResultCacheGetTuple
+ *	Return the next tuple of the result taken from the cache, or an empty
+ *	slot at the end of it.
+ */
+TupleTableSlot *
+ResultCacheGetTuple(ResultCacheScan *scan, TupleTableSlot *slot)
+{
+	Assert(scan->hit);
+
+	if (scan->pos >= scan->ntuples)
+		return ExecClearTuple(slot);
+	return ExecStoreMinimalTuple(scan->tuples[scan->pos++], slot, false);
+}
+
+/*
+ * ResultCachePutTuple
+ *	Collect a tuple of the result being read, to store it once complete.
+ *	A result too large for the cache is not collected.
+ */
+void
+ResultCachePutTuple(ResultCacheScan *scan, TupleTableSlot *slot)
+{
+	MemoryContext oldcontext;
+	MinimalTuple tuple;
+
+	if (!scan->collecting)
+		return;
+
+	oldcontext = MemoryContextSwitchTo(scan->context);
+	tuple = ExecCopySlotMinimalTuple(slot);
+	scan->size += tuple->t_len;
+	if (scan->size > (Size) ResultCacheSize * 1024L)
+	{
+		scan->collecting = false;
+		MemoryContextSwitchTo(oldcontext);
+		return;
+	}
+	if (scan->ntuples >= scan->maxtuples)
+	{
+		scan->maxtuples *= 2;
+		scan->tuples = (MinimalTuple *)
+			repalloc(scan->tuples, scan->maxtuples * sizeof(MinimalTuple));
+	}
+	scan->tuples[scan->ntuples++] = tuple;
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * ResultCacheStore
+ *	The result is complete, keep it in the cache if it is still valid.
+ */
+void
+ResultCacheStore(ResultCacheScan *scan)
+{
+	ResultCacheEntry *entry;
+	MemoryContext context;
+	MemoryContext oldcontext;
+	bool		found;
+	int			i;
+
+	if (!scan->collecting)
+		return;
+	scan->collecting = false;
+
+	/* A table or function was changed while the result was read */
+	if (scan->flushcount != ResultCacheFlushCount ||
+		!result_cache_valid(scan))
+		return;
+
+	if (ResultCacheHash == NULL)
+		result_cache_init();
+
+	/* Make room, the least recently used first */
+	while (ResultCacheUsed + scan->size > (Size) ResultCacheSize * 1024L &&
+		   !dlist_is_empty(&ResultCacheLRU))
+		result_cache_remove(dlist_tail_element(ResultCacheEntry, lru,
+											   &ResultCacheLRU));
+
+	entry = (ResultCacheEntry *) hash_search(ResultCacheHash,
+											 (void *) &scan->key,
+											 HASH_ENTER, &found);
+	if (found)
+	{
+		/* Another query with the same hash, replace it */
+		ResultCacheUsed -= entry->size;
+		dlist_delete(&entry->lru);
+		MemoryContextDelete(entry->context);
+	}
+
+	context = AllocSetContextCreate(ResultCacheContext,
+									"Result cache entry",
+									ALLOCSET_SMALL_MINSIZE,
+									ALLOCSET_SMALL_INITSIZE,
+									ALLOCSET_DEFAULT_MAXSIZE);
+	oldcontext = MemoryContextSwitchTo(context);
+	entry->context = context;
+	entry->keydata = (char *) palloc(scan->key.length);
+	memcpy(entry->keydata, scan->keydata, scan->key.length);
+	entry->nrels = scan->nrels;
+	entry->relids = (Oid *) palloc(Max(scan->nrels, 1) * sizeof(Oid));
+	memcpy(entry->relids, scan->relids, scan->nrels * sizeof(Oid));
+	entry->counters = (uint32 *) palloc(Max(scan->nrels, 1) * sizeof(uint32));
+	memcpy(entry->counters, scan->counters, scan->nrels * sizeof(uint32));
+	entry->ntuples = scan->ntuples;
+	entry->tuples = (MinimalTuple *)
+		palloc(Max(scan->ntuples, 1) * sizeof(MinimalTuple));
+	for (i = 0; i < scan->ntuples; i++)
+		entry->tuples[i] = heap_copy_minimal_tuple(scan->tuples[i]);
+	entry->size = scan->size;
+	MemoryContextSwitchTo(oldcontext);
+
+	dlist_push_head(&ResultCacheLRU, &entry->lru);
+	ResultCacheUsed += entry->size;
+}
+
+/*
+ * ResultCacheRescan
+ *	The result is going to be returned again from the start. A result being
+ *	read is not stored then, it may be incomplete.
+ */
+void
+ResultCacheRescan(ResultCacheScan *scan)
+{
+	if (scan->hit)
+		scan->pos = 0;
+	else
+		scan->collecting = false;
+}
@@ -18,7 +18,9 @@
  *-------------------------------------------------------------------------
  */
 
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <unistd.h>
 #include "postgres.h"
 
 #include "miscadmin.h"
@@ -26,22 +28,30 @@
 #include "catalog/pgxc_node.h"
 #include "commands/prepare.h"
 #include "executor/executor.h"
+#include "funcapi.h"
 #include "nodes/pg_list.h"
 #include "pgxc/nodemgr.h"
 #include "pgxc/pgxc.h"
 #include "pgxc/pgxcnode.h"
 #include "pgxc/squeue.h"
+#include "pgstat.h"
+#include "port/atomics.h"
+#include "portability/instr_time.h"
+#include "storage/fd.h"
 #include "storage/latch.h"
 #include "storage/lwlock.h"
 #include "storage/shmem.h"
+#include "utils/builtins.h"
 #include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/lsyscache.h"
 #include "utils/resowner.h"
 
 
 int NSQueues = 64;
 int SQueueSize = 64;
-
-#define LONG_TUPLE -42
+bool SQueueSpillFiles = false;
+bool SQueueNumaLocal = false;
 
 typedef struct ConsumerSync
 {
@@ -80,20 +90,42 @@ typedef struct
 	 * Queue state. The queue is a cyclic queue where stored tuples in the
 	 * DataRow format, first goes the lengths of the tuple in host format,
 	 * because it never sent over network followed by tuple bytes.
+	 * The queue has exactly one writer (the producer) and one reader (the
+	 * consumer), so data are passed without locking: the producer owns
+	 * cs_qwritepos, the consumer owns cs_qreadpos, and cs_ntuples is changed
+	 * atomically by both. The producer increments cs_ntuples only after the
+	 * tuple is in place, the consumer decrements it only after the tuple is
+	 * read out. The cs_lwlock protects cs_status changes.
 	 */
-	int			cs_ntuples; 	/* Number of tuples in the queue */
+	pg_atomic_uint32 cs_ntuples; /* Number of tuples in the queue */
 	int			cs_status;	 	/* See CONSUMER_* defines above */
 	char	   *cs_qstart;		/* Where consumer queue begins */
 	int			cs_qlength;		/* The size of the consumer queue */
 	int			cs_qreadpos;	/* The read position in the consumer queue */
 	int			cs_qwritepos;	/* The write position in the consumer queue */
-#ifdef SQUEUE_STAT
-	long 		stat_writes;
-	long		stat_reads;
-	long 		stat_buff_writes;
-	long		stat_buff_reads;
-	long		stat_buff_returns;
-#endif
+	/*
+	 * Overflow file state, if the queue is in spill mode. Tuples that do not
+	 * fit the consumer queue are appended to the file by the producer, and
+	 * consumer reads them from there after the queue is drained. Producer
+	 * writes to the queue again only after the consumer read everything from
+	 * the file, so the order of tuples is kept. Protected by cs_lwlock.
+	 */
+	int64		cs_spillsize;	/* Bytes in the file available to consumer */
+	int64		cs_spillread;	/* Bytes of the file consumer has taken */
+	/*
+	 * Statistics, reported by pg_stat_shared_queues. The producer and the
+	 * consumer update different counters, so they are not locked.
+	 */
+	long 		stat_writes;	/* Tuples sent to the consumer (producer) */
+	long		stat_write_bytes;	/* Bytes sent through the queue (producer) */
+	long		stat_full;		/* Times the queue was full (producer) */
+	long 		stat_buff_writes;	/* Tuples buffered or spilled (producer) */
+	long		stat_buff_bytes;	/* Bytes spilled to files (producer) */
+	long		stat_buff_reads;	/* Tuples taken from the buffer */
+	long		stat_buff_returns;	/* Tuples returned to the buffer (producer) */
+	long		stat_reads;		/* Tuples read (consumer) */
+	long		stat_waits;		/* Times consumer waited for data */
+	long		stat_wait_time;	/* Microseconds consumer waited for data */
 } ConsState;
 
 /* Shared queue header */
@@ -104,10 +136,20 @@ typedef struct SQueueHeader
 	int			sq_pid; 		/* Process id of the producer session */
 	int			sq_nodeid;		/* Node id of the producer parent */
 	SQueueSync *sq_sync;        /* Associated sinchronization objects */
-#ifdef SQUEUE_STAT
+	bool		sq_spill;		/* Overflow tuples go to files, not tuplestores */
+	bool		sq_broadcast;	/* All consumers read the same queue */
+	/*
+	 * Flow control. Producer which can not proceed until some consumer frees
+	 * space in its queue sets sq_wantcredit and waits on its latch. Consumer
+	 * which sees the flag set after it has drained half of its queue clears
+	 * the flag and wakes the producer up.
+	 */
+	volatile bool sq_wantcredit;
+	int			sq_nextcons;	/* Consumer to serve first next time */
 	bool		stat_finish;
-	long		stat_paused;
-#endif
+	long		stat_paused;	/* Times producer decided to pause */
+	long		stat_stalls;	/* Times producer waited for credit */
+	long		stat_stall_time;	/* Microseconds producer waited */
 	int			sq_nconsumers;	/* Number of consumers */
 	ConsState 	sq_consumers[0];/* variable length array */
 } SQueueHeader;
@@ -125,6 +167,29 @@ static HTAB *SharedQueues = NULL;
  */
 static void *SQueueSyncs;
 
+/*
+ * Backend local state of an overflow file or a long tuple file of a consumer
+ * queue, as a producer or as a consumer. Producer keeps the file open until
+ * all consumers are done, and removes it when unbinding.
+ */
+typedef struct SQueueSpill
+{
+	char		sp_key[SQUEUE_KEYSIZE]; /* Name of the shared queue */
+	SharedQueue sp_squeue;		/* The shared queue */
+	int			sp_consumer;	/* Index of the consumer queue */
+	bool		sp_producer;	/* Are we the producer? */
+	bool		sp_long;		/* Long tuple file rather than overflow file */
+	File		sp_file;		/* The file */
+	int64		sp_filepos;		/* Bytes written (producer) or read (consumer) */
+	StringInfoData sp_buf;		/* Tuples to be written out (producer) or
+								 * read but not yet returned (consumer) */
+} SQueueSpill;
+
+static List *SQueueSpills = NIL;
+
+/* Size of the portion consumer reads from the overflow file at once */
+#define SQUEUE_SPILL_CHUNK (64 * 1024)
+
 #define SQUEUE_SYNC_SIZE \
 	(sizeof(SQueueSync) + (MaxDataNodes-1) * sizeof(ConsumerSync))
 
@@ -134,13 +199,23 @@ static void *SQueueSyncs;
 #define SQUEUE_HDR_SIZE(nconsumers) \
 	(sizeof(SQueueHeader) + (nconsumers) * sizeof(ConsState))
 
-#define QUEUE_FREE_SPACE(cstate) \
-	((cstate)->cs_ntuples > 0 ? \
-		((cstate)->cs_qreadpos >= (cstate)->cs_qwritepos ? \
-			(cstate)->cs_qreadpos - (cstate)->cs_qwritepos : \
-			(cstate)->cs_qlength + (cstate)->cs_qreadpos \
-								 - (cstate)->cs_qwritepos) \
-		: (cstate)->cs_qlength)
+/* Number of tuples in the queue */
+#define QUEUE_NTUPLES(cstate) \
+	((int) pg_atomic_read_u32(&(cstate)->cs_ntuples))
+
+/*
+ * Tuples which do not fit the queue are passed through the long tuple file of
+ * the consumer, only the length and the file offset are put into the queue.
+ */
+#define QUEUE_LONG_TUPLE(cstate, len) \
+	((len) > (int) ((cstate)->cs_qlength - sizeof(int)))
+
+/* Queue space taken by a tuple of the specified length */
+#define QUEUE_TUPLE_SPACE(cstate, len) \
+	(QUEUE_LONG_TUPLE(cstate, len) ? \
+		sizeof(int) + sizeof(int64) : sizeof(int) + (len))
+
+#define QUEUE_FREE_SPACE(cstate) sq_queue_free_space(cstate)
 
 #define QUEUE_WRITE(cstate, len, buf) \
 	do \
@@ -182,9 +257,53 @@ static void *SQueueSyncs;
 	} while(0)
 
 
-static bool sq_push_long_tuple(ConsState *cstate, RemoteDataRow datarow);
-static void sq_pull_long_tuple(ConsState *cstate, RemoteDataRow datarow,
-							   ConsumerSync *sync);
+static void sq_layout_queues(SharedQueue sq, bool all);
+static int	sq_bcast_lead(SharedQueue squeue);
+static int	sq_bcast_finish(SharedQueue squeue, TupleDesc tupDesc,
+				Tuplestorestate **tuplestore);
+static int	sq_free_space(SharedQueue squeue, ConsState *cstate);
+static void sq_publish(SharedQueue squeue, int consumerIdx, int ntuples);
+static bool sq_has_credit(SharedQueue squeue, ConsState *cstate);
+static SQueueSpill *sq_spill_find(SharedQueue squeue, int consumerIdx,
+			  bool islong);
+static SQueueSpill *sq_spill_open(SharedQueue squeue, int consumerIdx,
+			  bool producer, bool islong);
+static void sq_spill_close(SharedQueue squeue, int consumerIdx);
+static void sq_spill_write(SharedQueue squeue, int consumerIdx,
+			   TupleTableSlot **slots, int nslots, MemoryContext tmpcxt);
+static void sq_spill_read(SQueueSpill *spill, ConsState *cstate,
+			  ConsumerSync *sync);
+static bool sq_spill_get_row(SQueueSpill *spill, TupleTableSlot *slot);
+static void sq_put_datarow(SharedQueue squeue, int consumerIdx,
+			   RemoteDataRow datarow);
+static void sq_get_long_tuple(SharedQueue squeue, int consumerIdx,
+				  RemoteDataRow datarow, int64 offset);
+
+
+/*
+ * sq_queue_free_space
+ *    Determine how many bytes producer may write to the consumer queue.
+ *    Must be called by the producer, the consumer may be reading the queue
+ *    concurrently. The consumer updates the read position before decrementing
+ *    the tuple counter, so if we read the counter first the read position
+ *    can not be older than the counter. If the consumer advances in between we
+ *    just underestimate the free space.
+ */
+static inline int
+sq_queue_free_space(ConsState *cstate)
+{
+	int			readpos;
+
+	if (QUEUE_NTUPLES(cstate) <= 0)
+		return cstate->cs_qlength;
+
+	pg_read_barrier();
+	readpos = *((volatile int *) &cstate->cs_qreadpos);
+
+	return readpos >= cstate->cs_qwritepos ?
+			readpos - cstate->cs_qwritepos :
+			cstate->cs_qlength + readpos - cstate->cs_qwritepos;
+}
 
 /*
  * SharedQueuesInit
@@ -280,19 +399,21 @@ tryagain:
 	/* First process acquiring queue should format it */
 	if (!found)
 	{
-		int		qsize;   /* Size of one queue */
 		int		i;
-		char   *heapPtr;
 
 		elog(DEBUG1, "Format squeue %s for %d consumers", sqname, ncons);
 
 		/* Initialize the shared queue */
 		sq->sq_pid = 0;
 		sq->sq_nodeid = -1;
-#ifdef SQUEUE_STAT
+		sq->sq_spill = false;
+		sq->sq_broadcast = false;
+		sq->sq_wantcredit = false;
+		sq->sq_nextcons = 0;
 		sq->stat_finish = false;
 		sq->stat_paused = 0;
-#endif
+		sq->stat_stalls = 0;
+		sq->stat_stall_time = 0;
 		/*
 		 * Assign sync object (latches to wait on)
 		 * XXX We may want to optimize this and do smart search instead of
@@ -312,12 +433,6 @@ tryagain:
 		Assert(sq->sq_sync != NULL);
 
 		sq->sq_nconsumers = ncons;
-		/* Determine queue size for a single consumer */
-		qsize = (SQUEUE_SIZE - SQUEUE_HDR_SIZE(sq->sq_nconsumers)) / sq->sq_nconsumers;
-
-		heapPtr = (char *) sq;
-		/* Skip header */
-		heapPtr += SQUEUE_HDR_SIZE(sq->sq_nconsumers);
 		/* Set up consumer queues */
 		for (i = 0; i < ncons; i++)
 		{
@@ -325,15 +440,26 @@ tryagain:
 
 			cstate->cs_pid = 0;
 			cstate->cs_node = -1;
-			cstate->cs_ntuples = 0;
+			pg_atomic_init_u32(&cstate->cs_ntuples, 0);
 			cstate->cs_status = CONSUMER_ACTIVE;
-			cstate->cs_qstart = heapPtr;
-			cstate->cs_qlength = qsize;
-			cstate->cs_qreadpos = 0;
-			cstate->cs_qwritepos = 0;
-			heapPtr += qsize;
+			cstate->cs_spillsize = 0;
+			cstate->cs_spillread = 0;
+			cstate->stat_writes = 0;
+			cstate->stat_write_bytes = 0;
+			cstate->stat_full = 0;
+			cstate->stat_buff_writes = 0;
+			cstate->stat_buff_bytes = 0;
+			cstate->stat_buff_reads = 0;
+			cstate->stat_buff_returns = 0;
+			cstate->stat_reads = 0;
+			cstate->stat_waits = 0;
+			cstate->stat_wait_time = 0;
 		}
-		Assert(heapPtr <= ((char *) sq) + SQUEUE_SIZE);
+		/*
+		 * Split the space evenly for now, producer will redistribute it
+		 * between consumers actually reading when it binds.
+		 */
+		sq_layout_queues(sq, true);
 	}
 	else
 	{
@@ -403,10 +529,15 @@ tryagain:
  * SQ_CONS_SELF is stored, nodes from distNodes list which are not members of
  * consNodes or if it was reported they won't read results, they are represented
  * as SQ_CONS_NONE.
+ * If the producer is going to send every tuple to all the consumers it sets
+ * broadcast to true. Then the consumers share one queue, each of them reading
+ * it at its own pace, and the producer writes every tuple once. Consumers
+ * ignore the parameter.
  */
 SharedQueue
 SharedQueueBind(const char *sqname, List *consNodes,
-								   List *distNodes, int *myindex, int *consMap)
+								   List *distNodes, int *myindex, int *consMap,
+								   bool broadcast)
 {
 	bool		found;
 	SharedQueue sq;
@@ -432,8 +563,18 @@ SharedQueueBind(const char *sqname, List *consNodes,
 		/* Initialize the shared queue */
 		sq->sq_pid = MyProcPid;
 		sq->sq_nodeid = PGXC_PARENT_NODE_ID;
+		sq->sq_broadcast = broadcast;
+		/* Overflow files are per consumer, not used by broadcast queues */
+		sq->sq_spill = SQueueSpillFiles && !broadcast;
 		OwnLatch(&sq->sq_sync->sqs_producer_latch);
 
+		/*
+		 * Producer writes every tuple through the queue, consumers read each
+		 * one once, so have the queue memory on the producer's NUMA node.
+		 */
+		if (SQueueNumaLocal)
+			(void) ShmemNumaBindLocal(sq, SQUEUE_SIZE);
+
 		i = 0;
 		foreach(lc, distNodes)
 		{
@@ -489,6 +630,12 @@ SharedQueueBind(const char *sqname, List *consNodes,
 			}
 		}
 
+		/*
+		 * No consumer has bound yet, so it is safe to give the space of the
+		 * consumers that are not going to read to those that will.
+		 */
+		sq_layout_queues(sq, false);
+
 		if (myindex)
 			*myindex = -1;
 	}
@@ -542,8 +689,6 @@ SharedQueueBind(const char *sqname, List *consNodes,
 									  LW_EXCLUSIVE);
 						/* Make sure no consumer bound to the queue already */
 						Assert(cstate->cs_pid == 0);
-						/* make sure the queue is ready to read */
-						Assert(cstate->cs_qlength > 0);
 						/* verify status */
 						if (cstate->cs_status == CONSUMER_ERROR ||
 								cstate->cs_status == CONSUMER_DONE)
@@ -568,6 +713,8 @@ SharedQueueBind(const char *sqname, List *consNodes,
 						 * ACTIVE. If producer have had only few rows to emit
 						 * and it is already done the status would be EOF.
 						 */
+						/* make sure the queue is ready to read */
+						Assert(cstate->cs_qlength > 0);
 						/* Set up the consumer */
 						cstate->cs_pid = MyProcPid;
 						/* return found index */
@@ -590,6 +737,160 @@ SharedQueueBind(const char *sqname, List *consNodes,
 }
 
 
+/*
+ * sq_layout_queues
+ *    Distribute the space of the shared queue between consumer queues.
+ *    If all is true every consumer gets a queue, otherwise only consumers that
+ *    are assigned to a node and are expected to read, others get an empty
+ *    queue and the producer never writes to them. The queue contents are
+ *    discarded, so it must be invoked before any consumer is bound.
+ */
+static void
+sq_layout_queues(SharedQueue sq, bool all)
+{
+	int			nqueues = 0;
+	int			qsize = 0;
+	char	   *heapPtr;
+	int			i;
+
+	for (i = 0; i < sq->sq_nconsumers; i++)
+	{
+		ConsState  *cstate = &(sq->sq_consumers[i]);
+
+		if (all || (cstate->cs_node != -1 &&
+					cstate->cs_status == CONSUMER_ACTIVE))
+			nqueues++;
+	}
+
+	/*
+	 * Determine queue size for a single consumer. Consumers of broadcast
+	 * queue share all the space.
+	 */
+	if (sq->sq_broadcast)
+		qsize = SQUEUE_SIZE - SQUEUE_HDR_SIZE(sq->sq_nconsumers);
+	else if (nqueues > 0)
+		qsize = (SQUEUE_SIZE - SQUEUE_HDR_SIZE(sq->sq_nconsumers)) / nqueues;
+
+	heapPtr = (char *) sq;
+	/* Skip header */
+	heapPtr += SQUEUE_HDR_SIZE(sq->sq_nconsumers);
+	for (i = 0; i < sq->sq_nconsumers; i++)
+	{
+		ConsState  *cstate = &(sq->sq_consumers[i]);
+
+		Assert(QUEUE_NTUPLES(cstate) == 0);
+		cstate->cs_qreadpos = 0;
+		cstate->cs_qwritepos = 0;
+		if (all || (cstate->cs_node != -1 &&
+					cstate->cs_status == CONSUMER_ACTIVE))
+		{
+			cstate->cs_qstart = heapPtr;
+			cstate->cs_qlength = qsize;
+			if (!sq->sq_broadcast)
+				heapPtr += qsize;
+		}
+		else
+		{
+			cstate->cs_qstart = NULL;
+			cstate->cs_qlength = 0;
+		}
+	}
+	Assert(heapPtr <= ((char *) sq) + SQUEUE_SIZE);
+	elog(DEBUG1, "Shared queue %s: %d of %d consumer queues of %d bytes%s",
+		 sq->sq_key, nqueues, sq->sq_nconsumers, qsize,
+		 sq->sq_broadcast ? ", broadcast" : "");
+}
+
+
+/*
+ * sq_bcast_lead
+ *    Return index of a consumer reading the broadcast queue, or -1 if no
+ *    consumer is reading. The producer writes to the queue through the state
+ *    of that consumer, and then copies the write position to the others.
+ */
+static int
+sq_bcast_lead(SharedQueue squeue)
+{
+	int			i;
+
+	for (i = 0; i < squeue->sq_nconsumers; i++)
+	{
+		ConsState  *cstate = &(squeue->sq_consumers[i]);
+
+		if (cstate->cs_status == CONSUMER_ACTIVE && cstate->cs_qlength > 0)
+			return i;
+	}
+	return -1;
+}
+
+
+/*
+ * sq_free_space
+ *    Return space available for writing to the consumer queue. Free space of
+ *    a broadcast queue is determined by the consumer which is most behind.
+ */
+static int
+sq_free_space(SharedQueue squeue, ConsState *cstate)
+{
+	int			freespace;
+	int			i;
+
+	if (!squeue->sq_broadcast)
+		return QUEUE_FREE_SPACE(cstate);
+
+	freespace = cstate->cs_qlength;
+	for (i = 0; i < squeue->sq_nconsumers; i++)
+	{
+		ConsState  *other = &(squeue->sq_consumers[i]);
+
+		if (other->cs_status == CONSUMER_ACTIVE && other->cs_qlength > 0)
+			freespace = Min(freespace, QUEUE_FREE_SPACE(other));
+	}
+	return freespace;
+}
+
+
+/*
+ * sq_publish
+ *    Make tuples just written to the consumer queue available for reading and
+ *    wake up the consumer if it may be waiting. Tuples written to a broadcast
+ *    queue are published to all consumers reading the queue.
+ */
+static void
+sq_publish(SharedQueue squeue, int consumerIdx, int ntuples)
+{
+	ConsState  *cstate = &(squeue->sq_consumers[consumerIdx]);
+	int			i;
+
+	/*
+	 * Increment tuple counter. The atomic increment is a barrier, so data are
+	 * visible now. If it was 0 consumer may be waiting for data so try to
+	 * wake it up.
+	 */
+	if (!squeue->sq_broadcast)
+	{
+		if (pg_atomic_fetch_add_u32(&cstate->cs_ntuples, ntuples) == 0)
+			SetLatch(&squeue->sq_sync->sqs_consumer_sync[consumerIdx].cs_latch);
+		return;
+	}
+
+	for (i = 0; i < squeue->sq_nconsumers; i++)
+	{
+		ConsState  *other = &(squeue->sq_consumers[i]);
+
+		if (other->cs_status != CONSUMER_ACTIVE || other->cs_qlength == 0)
+			continue;
+		if (other != cstate)
+		{
+			other->cs_qwritepos = cstate->cs_qwritepos;
+			other->stat_writes += ntuples;
+		}
+		if (pg_atomic_fetch_add_u32(&other->cs_ntuples, ntuples) == 0)
+			SetLatch(&squeue->sq_sync->sqs_consumer_sync[i].cs_latch);
+	}
+}
+
+
 /*
  * Push data from the local tuplestore to the queue for specified consumer.
  * Return true if succeeded and the tuplestore is now empty. Return false
@@ -633,44 +934,18 @@ SharedQueueDump(SharedQueue squeue, int consumerIdx,
 			/* false means the tuplestore in EOF state */
 			break;
 		}
-#ifdef SQUEUE_STAT
 		cstate->stat_buff_reads++;
-#endif
 
 		/* The slot should contain a data row */
 		Assert(tmpslot->tts_datarow);
 
 		/* check if queue has enough room for the data */
-		if (QUEUE_FREE_SPACE(cstate) < sizeof(int) + tmpslot->tts_datarow->msglen)
+		if (sq_free_space(squeue, cstate) <
+				QUEUE_TUPLE_SPACE(cstate, tmpslot->tts_datarow->msglen))
 		{
-			/*
-			 * If stored tuple does not fit empty queue we are entering special
-			 * procedure of pushing it through.
-			 */
-			if (cstate->cs_ntuples <= 0)
-			{
-				/*
-				 * If pushing throw is completed wake up and proceed to next
-				 * tuple, there could be enough space in the consumer queue to
-				 * fit more.
-				 */
-				bool done = sq_push_long_tuple(cstate, tmpslot->tts_datarow);
-
-				/*
-				 * sq_push_long_tuple writes some data anyway, so wake up
-				 * the consumer.
-				 */
-				SetLatch(&squeue->sq_sync->sqs_consumer_sync[consumerIdx].cs_latch);
-
-				if (done)
-					continue;
-			}
-
 			/* Restore read position to get same tuple next time */
 			tuplestore_copy_read_pointer(tuplestore, 0, 1);
-#ifdef SQUEUE_STAT
 			cstate->stat_buff_returns++;
-#endif
 
 			/* We might advance the mark, try to truncate */
 			tuplestore_trim(tuplestore);
@@ -684,13 +959,8 @@ SharedQueueDump(SharedQueue squeue, int consumerIdx,
 		else
 		{
 			/* Enqueue data */
-			QUEUE_WRITE(cstate, sizeof(int), (char *) &tmpslot->tts_datarow->msglen);
-			QUEUE_WRITE(cstate, tmpslot->tts_datarow->msglen, tmpslot->tts_datarow->msg);
-
-			/* Increment tuple counter. If it was 0 consumer may be waiting for
-			 * data so try to wake it up */
-			if ((cstate->cs_ntuples)++ == 0)
-				SetLatch(&squeue->sq_sync->sqs_consumer_sync[consumerIdx].cs_latch);
+			sq_put_datarow(squeue, consumerIdx, tmpslot->tts_datarow);
+			sq_publish(squeue, consumerIdx, 1);
 		}
 	}
 
@@ -705,135 +975,209 @@ SharedQueueDump(SharedQueue squeue, int consumerIdx,
 
 
 /*
- * SharedQueueWrite
- *    Write data from the specified slot to the specified queue. If the
- * tuplestore passed in has tuples try and write them first.
- * If specified queue is full the tuple is put into the tuplestore which is
- * created if necessary
+ * Create the local tuplestore to buffer tuples for the consumer if its
+ * queue is full
  */
-void
-SharedQueueWrite(SharedQueue squeue, int consumerIdx,
-							TupleTableSlot *slot, Tuplestorestate **tuplestore,
-							MemoryContext tmpcxt)
+static Tuplestorestate *
+sq_begin_tuplestore(SharedQueue squeue, ConsState *cstate,
+					MemoryContext tmpcxt)
 {
-	ConsState  *cstate = &(squeue->sq_consumers[consumerIdx]);
-	SQueueSync *sqsync = squeue->sq_sync;
-	LWLockId    clwlock = sqsync->sqs_consumer_sync[consumerIdx].cs_lwlock;
-	RemoteDataRow datarow;
-	bool		free_datarow;
+	Tuplestorestate *tuplestore;
+	int			ptrno;
+	char 		storename[64];
+
+	elog(DEBUG1, "Start buffering %s node %d, %d tuples in queue, %ld writes and %ld reads so far",
+		 squeue->sq_key, cstate->cs_node, QUEUE_NTUPLES(cstate), cstate->stat_writes, cstate->stat_reads);
+	tuplestore = tuplestore_begin_datarow(false, work_mem, tmpcxt);
+	/* We need is to be able to remember/restore the read position */
+	snprintf(storename, 64, "%s node %d", squeue->sq_key, cstate->cs_node);
+	tuplestore_collect_stat(tuplestore, storename);
+	/*
+	 * Allocate a second read pointer to read from the store. We know
+	 * it must have index 1, so needn't store that.
+	 */
+	ptrno = tuplestore_alloc_read_pointer(tuplestore, 0);
+	Assert(ptrno == 1);
 
-	Assert(cstate->cs_qlength > 0);
+	return tuplestore;
+}
 
-	LWLockAcquire(clwlock, LW_EXCLUSIVE);
 
-#ifdef SQUEUE_STAT
-	cstate->stat_writes++;
-#endif
+/*
+ * Write out data rows of as many slots as fit into the consumer queue and
+ * return the number of written slots. The tuple counter is updated and
+ * consumer is woken up once for all written rows.
+ * The producer is the only writer of the queue, it is not necessary to hold
+ * the consumer lock.
+ */
+static int
+sq_write_slots(SharedQueue squeue, int consumerIdx, TupleTableSlot **slots,
+			   int nslots, MemoryContext tmpcxt)
+{
+	ConsState  *cstate = &(squeue->sq_consumers[consumerIdx]);
+	int			freespace = sq_free_space(squeue, cstate);
+	int			i;
 
-	/*
-	 * If we have anything in the local storage try to dump this first,
-	 * but do not try to dump often to avoid overhead of creating temporary
-	 * tuple slot. It should be OK to dump if queue is half empty.
-	 */
-	if (*tuplestore)
+	for (i = 0; i < nslots; i++)
 	{
-		bool dumped = false;
+		TupleTableSlot *slot = slots[i];
+		RemoteDataRow datarow;
+		bool		free_datarow;
 
-		if (QUEUE_FREE_SPACE(cstate) > cstate->cs_qlength / 2)
+		/* Get datarow from the tuple slot */
+		if (slot->tts_datarow)
 		{
-			TupleTableSlot *tmpslot;
-
-			tmpslot = MakeSingleTupleTableSlot(slot->tts_tupleDescriptor);
-			dumped = SharedQueueDump(squeue, consumerIdx, tmpslot, *tuplestore);
-			ExecDropSingleTupleTableSlot(tmpslot);
+			/*
+			 * The function ExecCopySlotDatarow always make a copy, but here we
+			 * can optimize and avoid copying the data, so we just get the
+			 * reference
+			 */
+			datarow = slot->tts_datarow;
+			free_datarow = false;
 		}
-		if (!dumped)
+		else
 		{
-			/* No room to even dump local store, append the tuple to the store
-			 * and exit */
-#ifdef SQUEUE_STAT
-			cstate->stat_buff_writes++;
-#endif
-			LWLockRelease(clwlock);
-			tuplestore_puttupleslot(*tuplestore, slot);
-			return;
+			datarow = ExecCopySlotDatarow(slot, tmpcxt);
+			free_datarow = true;
+		}
+
+		if (freespace < QUEUE_TUPLE_SPACE(cstate, datarow->msglen))
+		{
+			/* Not enough room, caller will store the rest locally */
+			if (free_datarow)
+				pfree(datarow);
+			break;
 		}
+
+		/* write out the data */
+		sq_put_datarow(squeue, consumerIdx, datarow);
+		freespace -= QUEUE_TUPLE_SPACE(cstate, datarow->msglen);
+		cstate->stat_write_bytes += sizeof(int) + datarow->msglen;
+
+		/* clean up */
+		if (free_datarow)
+			pfree(datarow);
+	}
+
+	if (i > 0)
+		sq_publish(squeue, consumerIdx, i);
+
+	return i;
+}
+
+
+/*
+ * SharedQueueWriteBatch
+ *    Write data from the specified slots to the specified queue. If the
+ * tuplestore passed in has tuples try and write them first.
+ * As many slots as fit are written to the queue at once, the consumer is
+ * woken up once per batch. If the queue is full the rest of slots are put
+ * into the tuplestore which is created if necessary.
+ * Tuples written to a broadcast queue go to all consumers, consumerIdx is
+ * ignored, and the caller should use the same tuplestore for all consumers.
+ */
+void
+SharedQueueWriteBatch(SharedQueue squeue, int consumerIdx,
+					  TupleTableSlot **slots, int nslots,
+					  Tuplestorestate **tuplestore, MemoryContext tmpcxt)
+{
+	ConsState  *cstate;
+	SQueueSync *sqsync = squeue->sq_sync;
+	LWLockId    clwlock;
+	int			nwritten = 0;
+
+	if (squeue->sq_broadcast)
+	{
+		consumerIdx = sq_bcast_lead(squeue);
+		/* Nobody is reading */
+		if (consumerIdx < 0)
+			return;
+	}
+	cstate = &(squeue->sq_consumers[consumerIdx]);
+	clwlock = sqsync->sqs_consumer_sync[consumerIdx].cs_lwlock;
+
+	/*
+	 * Do not supply data to closed consumer. Status never goes back to active,
+	 * so it is safe to check it without lock. Consumers which are not going to
+	 * read may have no queue at all.
+	 */
+	if (cstate->cs_status != CONSUMER_ACTIVE || nslots <= 0)
+		return;
+
+	Assert(cstate->cs_qlength > 0);
+
+	cstate->stat_writes += nslots;
+
+	/* In spill mode tuples are never buffered in the tuplestore */
+	if (squeue->sq_spill)
+	{
+		sq_spill_write(squeue, consumerIdx, slots, nslots, tmpcxt);
+		return;
 	}
 
-	/* Get datarow from the tuple slot */
-	if (slot->tts_datarow)
+	if (*tuplestore == NULL)
 	{
 		/*
-		 * The function ExecCopySlotDatarow always make a copy, but here we
-		 * can optimize and avoid copying the data, so we just get the reference
+		 * Nothing is buffered locally, so the tuples may go directly to the
+		 * queue. We are the only writer of the queue, so the lock is not
+		 * needed.
 		 */
-		datarow = slot->tts_datarow;
-		free_datarow = false;
+		nwritten = sq_write_slots(squeue, consumerIdx, slots, nslots, tmpcxt);
 	}
 	else
 	{
-		datarow = ExecCopySlotDatarow(slot, tmpcxt);
-		free_datarow = true;
-	}
-	if (QUEUE_FREE_SPACE(cstate) < sizeof(int) + datarow->msglen)
-	{
-		/* Not enough room, store tuple locally */
-		LWLockRelease(clwlock);
+		bool dumped = false;
 
-		/* clean up */
-		if (free_datarow)
-			pfree(datarow);
+		LWLockAcquire(clwlock, LW_EXCLUSIVE);
 
-		/* Create tuplestore if does not exist */
-		if (*tuplestore == NULL)
+		/*
+		 * If we have anything in the local storage try to dump this first,
+		 * but do not try to dump often to avoid overhead of creating temporary
+		 * tuple slot. It should be OK to dump if queue is half empty.
+		 */
+		if (sq_free_space(squeue, cstate) > cstate->cs_qlength / 2)
 		{
-			int			ptrno;
-			char 		storename[64];
-
-#ifdef SQUEUE_STAT
-			elog(DEBUG1, "Start buffering %s node %d, %d tuples in queue, %ld writes and %ld reads so far",
-				 squeue->sq_key, cstate->cs_node, cstate->cs_ntuples, cstate->stat_writes, cstate->stat_reads);
-#endif
-			*tuplestore = tuplestore_begin_datarow(false, work_mem, tmpcxt);
-			/* We need is to be able to remember/restore the read position */
-			snprintf(storename, 64, "%s node %d", squeue->sq_key, cstate->cs_node);
-			tuplestore_collect_stat(*tuplestore, storename);
-			/*
-			 * Allocate a second read pointer to read from the store. We know
-			 * it must have index 1, so needn't store that.
-			 */
-			ptrno = tuplestore_alloc_read_pointer(*tuplestore, 0);
-			Assert(ptrno == 1);
-		}
-
-#ifdef SQUEUE_STAT
-		cstate->stat_buff_writes++;
-#endif
-		/* Append the slot to the store... */
-		tuplestore_puttupleslot(*tuplestore, slot);
+			TupleTableSlot *tmpslot;
 
-		/* ... and exit */
-		return;
+			tmpslot = MakeSingleTupleTableSlot(slots[0]->tts_tupleDescriptor);
+			dumped = SharedQueueDump(squeue, consumerIdx, tmpslot, *tuplestore);
+			ExecDropSingleTupleTableSlot(tmpslot);
+		}
+		if (dumped)
+			nwritten = sq_write_slots(squeue, consumerIdx, slots, nslots,
+									  tmpcxt);
+		LWLockRelease(clwlock);
 	}
-	else
+
+	if (nwritten < nslots)
 	{
-		/* do not supply data to closed consumer */
-		if (cstate->cs_status == CONSUMER_ACTIVE)
+		/* Not enough room, store the rest of tuples locally */
+		cstate->stat_full++;
+		if (*tuplestore == NULL)
+			*tuplestore = sq_begin_tuplestore(squeue, cstate, tmpcxt);
+
+		for (; nwritten < nslots; nwritten++)
 		{
-			/* write out the data */
-			QUEUE_WRITE(cstate, sizeof(int), (char *) &datarow->msglen);
-			QUEUE_WRITE(cstate, datarow->msglen, datarow->msg);
-			/* Increment tuple counter. If it was 0 consumer may be waiting for
-			 * data so try to wake it up */
-			if ((cstate->cs_ntuples)++ == 0)
-				SetLatch(&sqsync->sqs_consumer_sync[consumerIdx].cs_latch);
+			cstate->stat_buff_writes++;
+			tuplestore_puttupleslot(*tuplestore, slots[nwritten]);
 		}
-
-		/* clean up */
-		if (free_datarow)
-			pfree(datarow);
 	}
-	LWLockRelease(clwlock);
+}
+
+
+/*
+ * SharedQueueWrite
+ *    Write data from the specified slot to the specified queue. If the
+ * tuplestore passed in has tuples try and write them first.
+ * If specified queue is full the tuple is put into the tuplestore which is
+ * created if necessary
+ */
+void
+SharedQueueWrite(SharedQueue squeue, int consumerIdx,
+							TupleTableSlot *slot, Tuplestorestate **tuplestore,
+							MemoryContext tmpcxt)
+{
+	SharedQueueWriteBatch(squeue, consumerIdx, &slot, 1, tuplestore, tmpcxt);
 }
 
 
@@ -851,86 +1195,155 @@ SharedQueueRead(SharedQueue squeue, int consumerIdx,
 {
 	ConsState  *cstate = &(squeue->sq_consumers[consumerIdx]);
 	SQueueSync *sqsync = squeue->sq_sync;
+	ConsumerSync *sync = &sqsync->sqs_consumer_sync[consumerIdx];
+	SQueueSpill *spill = NULL;
 	RemoteDataRow datarow;
 	int 		datalen;
+	instr_time	wait_start;
+	instr_time	wait_time;
 
 	Assert(cstate->cs_qlength > 0);
 
-	LWLockAcquire(sqsync->sqs_consumer_sync[consumerIdx].cs_lwlock, LW_EXCLUSIVE);
-
-	Assert(cstate->cs_status != CONSUMER_DONE);
-	while (cstate->cs_ntuples <= 0)
+	/*
+	 * In spill mode tuples already taken from the overflow file go before
+	 * anything in the queue, producer does not write to the queue until
+	 * consumer has taken everything from the file.
+	 */
+	if (squeue->sq_spill)
 	{
-		if (cstate->cs_status == CONSUMER_EOF)
+		spill = sq_spill_find(squeue, consumerIdx, false);
+		if (spill && cstate->cs_status != CONSUMER_ERROR &&
+				sq_spill_get_row(spill, slot))
 		{
-			/* Inform producer the consumer have done the job */
-			cstate->cs_status = CONSUMER_DONE;
-			/* no need to receive notifications */
-			DisownLatch(&sqsync->sqs_consumer_sync[consumerIdx].cs_latch);
-			/* producer done the job and no more rows expected, clean up */
-			LWLockRelease(sqsync->sqs_consumer_sync[consumerIdx].cs_lwlock);
-			ExecClearTuple(slot);
-			/*
-			 * notify the producer, it may be waiting while consumers
-			 * are finishing
-			 */
-			SetLatch(&sqsync->sqs_producer_latch);
-			elog(DEBUG1, "EOF reached while reading from squeue, exiting");
-			return true;
+			cstate->stat_buff_reads++;
+			return false;
 		}
-		else if (cstate->cs_status == CONSUMER_ERROR)
-		{
-			/*
-			 * There was a producer error while waiting.
-			 * Release all the locks and report problem to the caller.
-			 */
-			LWLockRelease(sqsync->sqs_consumer_sync[consumerIdx].cs_lwlock);
-			/*
-			 * Reporting error will cause transaction rollback and clean up of
-			 * all portals. We can not mark the portal so it does not access
-			 * the queue so we should hold it for now. We should prevent queue
-			 * unbound in between.
-			 */
-			ereport(ERROR,
-					(errcode(ERRCODE_PRODUCER_ERROR),
-					 errmsg("Failed to read from shared queue - producer failed and set status to %d",
-						 cstate->cs_status)));
-		}
-		if (canwait)
+	}
+
+	/*
+	 * If the queue has tuples we can read them out without locking, producer
+	 * does not touch the part of the queue which is not read yet. Otherwise
+	 * take the lock and check the status or wait for more data.
+	 */
+	if (cstate->cs_status == CONSUMER_ERROR || QUEUE_NTUPLES(cstate) <= 0)
+	{
+		LWLockAcquire(sync->cs_lwlock, LW_EXCLUSIVE);
+
+		Assert(cstate->cs_status != CONSUMER_DONE);
+		for (;;)
 		{
+			if (cstate->cs_status == CONSUMER_ERROR)
+			{
+				/*
+				 * There was a producer error while waiting.
+				 * Release all the locks and report problem to the caller.
+				 */
+				LWLockRelease(sync->cs_lwlock);
+				/*
+				 * Reporting error will cause transaction rollback and clean up
+				 * of all portals. We can not mark the portal so it does not
+				 * access the queue so we should hold it for now. We should
+				 * prevent queue unbound in between.
+				 */
+				ereport(ERROR,
+						(errcode(ERRCODE_PRODUCER_ERROR),
+						 errmsg("Failed to read from shared queue - producer failed and set status to %d",
+							 cstate->cs_status)));
+			}
+			if (QUEUE_NTUPLES(cstate) > 0)
+				break;
+			if (cstate->cs_spillsize > (spill ? spill->sp_filepos : 0))
+			{
+				/* The queue is drained, continue with the overflow file */
+				LWLockRelease(sync->cs_lwlock);
+				if (spill == NULL)
+					spill = sq_spill_open(squeue, consumerIdx, false, false);
+				do
+					sq_spill_read(spill, cstate, sync);
+				while (!sq_spill_get_row(spill, slot));
+				cstate->stat_buff_reads++;
+				return false;
+			}
+			if (cstate->cs_status == CONSUMER_EOF)
+			{
+				/* Inform producer the consumer have done the job */
+				cstate->cs_status = CONSUMER_DONE;
+				/* no need to receive notifications */
+				DisownLatch(&sync->cs_latch);
+				/* producer done the job and no more rows expected, clean up */
+				LWLockRelease(sync->cs_lwlock);
+				sq_spill_close(squeue, consumerIdx);
+				ExecClearTuple(slot);
+				/*
+				 * notify the producer, it may be waiting while consumers
+				 * are finishing
+				 */
+				SetLatch(&sqsync->sqs_producer_latch);
+				elog(DEBUG1, "EOF reached while reading from squeue, exiting");
+				return true;
+			}
+			if (!canwait)
+			{
+				LWLockRelease(sync->cs_lwlock);
+				ExecClearTuple(slot);
+				return false;
+			}
 			/* Prepare waiting on empty buffer */
-			ResetLatch(&sqsync->sqs_consumer_sync[consumerIdx].cs_latch);
-			LWLockRelease(sqsync->sqs_consumer_sync[consumerIdx].cs_lwlock);
+			ResetLatch(&sync->cs_latch);
+			/*
+			 * Producer puts tuples without the lock, so check again after
+			 * the latch is reset to not miss the wake up.
+			 */
+			if (QUEUE_NTUPLES(cstate) > 0)
+				break;
+			LWLockRelease(sync->cs_lwlock);
 			/* Wait for notification about available info */
-			WaitLatch(&sqsync->sqs_consumer_sync[consumerIdx].cs_latch, WL_LATCH_SET | WL_POSTMASTER_DEATH, -1);
+			INSTR_TIME_SET_CURRENT(wait_start);
+			pgstat_report_wait_start(WAIT_EVENT_SQUEUE_READ, InvalidOid);
+			WaitLatch(&sync->cs_latch, WL_LATCH_SET | WL_POSTMASTER_DEATH, -1);
+			pgstat_report_wait_end(WAIT_EVENT_SQUEUE_READ);
+			INSTR_TIME_SET_CURRENT(wait_time);
+			INSTR_TIME_SUBTRACT(wait_time, wait_start);
+			cstate->stat_waits++;
+			cstate->stat_wait_time += (long) INSTR_TIME_GET_MICROSEC(wait_time);
 			/* got the notification, restore lock and try again */
-			LWLockAcquire(sqsync->sqs_consumer_sync[consumerIdx].cs_lwlock, LW_EXCLUSIVE);
-		}
-		else
-		{
-			LWLockRelease(sqsync->sqs_consumer_sync[consumerIdx].cs_lwlock);
-			ExecClearTuple(slot);
-			return false;
+			LWLockAcquire(sync->cs_lwlock, LW_EXCLUSIVE);
 		}
+		LWLockRelease(sync->cs_lwlock);
 	}
+
+	/* Make sure we see the data the producer wrote before the counter */
+	pg_read_barrier();
+
 	/* have at least one row, read it in and store to slot */
 	QUEUE_READ(cstate, sizeof(int), (char *) (&datalen));
 	datarow = (RemoteDataRow) palloc(sizeof(RemoteDataRowData) + datalen);
 	datarow->msgnode = InvalidOid;
 	datarow->msglen = datalen;
-	if (datalen > cstate->cs_qlength - sizeof(int))
-		sq_pull_long_tuple(cstate, datarow,
-						   &sqsync->sqs_consumer_sync[consumerIdx]);
+	if (QUEUE_LONG_TUPLE(cstate, datalen))
+	{
+		/* The queue holds location of the tuple in the long tuple file */
+		int64		offset;
+
+		QUEUE_READ(cstate, sizeof(int64), (char *) &offset);
+		sq_get_long_tuple(squeue, consumerIdx, datarow, offset);
+	}
 	else
 		QUEUE_READ(cstate, datalen, datarow->msg);
 	ExecStoreDataRowTuple(datarow, slot, true);
-	(cstate->cs_ntuples)--;
-#ifdef SQUEUE_STAT
+	/*
+	 * Release the space. The atomic decrement is a barrier, so the producer
+	 * will see the updated read position before the counter change.
+	 */
+	pg_atomic_fetch_sub_u32(&cstate->cs_ntuples, 1);
 	cstate->stat_reads++;
-#endif
-	/* sanity check */
-	Assert((cstate->cs_ntuples == 0) == (cstate->cs_qreadpos == cstate->cs_qwritepos));
-	LWLockRelease(sqsync->sqs_consumer_sync[consumerIdx].cs_lwlock);
+
+	/* Let the producer know if it is waiting for the space we have freed */
+	if (squeue->sq_wantcredit && sq_has_credit(squeue, cstate))
+	{
+		squeue->sq_wantcredit = false;
+		SetLatch(&sqsync->sqs_producer_latch);
+	}
 	return false;
 }
 
@@ -976,11 +1389,13 @@ SharedQueueReset(SharedQueue squeue, int consumerIdx)
 					cstate->cs_status != CONSUMER_DONE)
 			{
 				elog(DEBUG1, "Consumer %d of producer %s is cancelled", i, squeue->sq_key);
+				/*
+				 * Consumer may be reading the queue without the lock, so we
+				 * can not discard tuples which are already in the queue. The
+				 * consumer checks the status before reading and will discard
+				 * them itself.
+				 */
 				cstate->cs_status = CONSUMER_ERROR;
-				/* discard tuples which may already be in the queue */
-				cstate->cs_ntuples = 0;
-				/* keep consistent with cs_ntuples*/
-				cstate->cs_qreadpos = cstate->cs_qwritepos = 0;
 
 				/* wake up consumer if it is sleeping */
 				SetLatch(&sqsync->sqs_consumer_sync[i].cs_latch);
@@ -1014,6 +1429,9 @@ SharedQueueReset(SharedQueue squeue, int consumerIdx)
 		}
 
 		LWLockRelease(sqsync->sqs_consumer_sync[consumerIdx].cs_lwlock);
+
+		/* Close files if consumer has opened them */
+		sq_spill_close(squeue, consumerIdx);
 	}
 }
 
@@ -1043,8 +1461,11 @@ SharedQueueResetNotConnected(SharedQueue squeue)
 			result++;
 			elog(DEBUG1, "Consumer %d of producer %s is cancelled", i, squeue->sq_key);
 			cstate->cs_status = CONSUMER_ERROR;
-			/* discard tuples which may already be in the queue */
-			cstate->cs_ntuples = 0;
+			/*
+			 * Discard tuples which may already be in the queue, it is safe
+			 * since consumer is not connected and is not reading.
+			 */
+			pg_atomic_write_u32(&cstate->cs_ntuples, 0);
 			/* keep consistent with cs_ntuples*/
 			cstate->cs_qreadpos = cstate->cs_qwritepos = 0;
 
@@ -1057,6 +1478,73 @@ SharedQueueResetNotConnected(SharedQueue squeue)
 }
 
 
+/*
+ * sq_has_credit
+ *    Is the consumer queue drained enough to be worth writing to? That is if
+ *    the queue is empty or more than half of it is free.
+ */
+static bool
+sq_has_credit(SharedQueue squeue, ConsState *cstate)
+{
+	return QUEUE_NTUPLES(cstate) == 0 ||
+		QUEUE_FREE_SPACE(cstate) > cstate->cs_qlength / 2;
+}
+
+
+/*
+ * SharedQueueWaitCredit
+ *    Wait until some active consumer has drained its queue enough, so the
+ *    producer can write more, or until the timeout expires. Used instead of
+ *    sleeping for a fixed time when all the consumer queues are filled up,
+ *    and the consumers do not make progress. Returns false if timeout has
+ *    expired without any consumer reporting progress.
+ *    The time spent waiting is reported by pg_stat_shared_queues.
+ */
+bool
+SharedQueueWaitCredit(SharedQueue squeue, long timeout)
+{
+	SQueueSync *sqsync = squeue->sq_sync;
+	instr_time	wait_start;
+	instr_time	wait_time;
+	int			wait_result;
+	int			i;
+
+	ResetLatch(&sqsync->sqs_producer_latch);
+	squeue->sq_wantcredit = true;
+	/*
+	 * Consumers check the flag after they update the queue, so recheck the
+	 * queues after the flag is set to not miss the wake up. A consumer which
+	 * has drained the queue completely may be idle and would not notify us.
+	 */
+	pg_memory_barrier();
+	for (i = 0; i < squeue->sq_nconsumers; i++)
+	{
+		ConsState  *cstate = &squeue->sq_consumers[i];
+
+		if (cstate->cs_status == CONSUMER_ACTIVE && cstate->cs_qlength > 0 &&
+				QUEUE_NTUPLES(cstate) == 0)
+		{
+			squeue->sq_wantcredit = false;
+			return true;
+		}
+	}
+
+	INSTR_TIME_SET_CURRENT(wait_start);
+	pgstat_report_wait_start(WAIT_EVENT_SQUEUE_CREDIT, InvalidOid);
+	wait_result = WaitLatch(&sqsync->sqs_producer_latch,
+							WL_LATCH_SET | WL_POSTMASTER_DEATH | WL_TIMEOUT,
+							timeout);
+	pgstat_report_wait_end(WAIT_EVENT_SQUEUE_CREDIT);
+	INSTR_TIME_SET_CURRENT(wait_time);
+	INSTR_TIME_SUBTRACT(wait_time, wait_start);
+	squeue->sq_wantcredit = false;
+	squeue->stat_stalls++;
+	squeue->stat_stall_time += (long) INSTR_TIME_GET_MICROSEC(wait_time);
+
+	return (wait_result & WL_TIMEOUT) == 0;
+}
+
+
 /*
  * Determine if producer can safely pause work.
  * The producer can pause if all consumers have enough data to read while
@@ -1069,10 +1557,12 @@ SharedQueueCanPause(SharedQueue squeue)
 	SQueueSync *sqsync = squeue->sq_sync;
 	bool 		result = true;
 	int 		usedspace;
+	int			totalspace;
 	int			ncons;
 	int 		i;
 
 	usedspace = 0;
+	totalspace = 0;
 	ncons = 0;
 	for (i = 0; result && (i < squeue->sq_nconsumers); i++)
 	{
@@ -1081,16 +1571,15 @@ SharedQueueCanPause(SharedQueue squeue)
 		/*
 		 * Count only consumers that may be blocked.
 		 * If producer has finished scanning and pushing local buffers some
-		 * consumers may be finished already.
+		 * consumers may be finished already. Consumers without a queue
+		 * are not going to read at all.
 		 */
-		if (cstate->cs_status == CONSUMER_ACTIVE)
+		if (cstate->cs_status == CONSUMER_ACTIVE && cstate->cs_qlength > 0)
 		{
 			/* can not pause if some queue is empty */
-			result = (cstate->cs_ntuples > 0);
-			usedspace += (cstate->cs_qwritepos > cstate->cs_qreadpos ?
-							  cstate->cs_qwritepos - cstate->cs_qreadpos :
-							  cstate->cs_qlength + cstate->cs_qwritepos
-												 - cstate->cs_qreadpos);
+			result = (QUEUE_NTUPLES(cstate) > 0);
+			usedspace += cstate->cs_qlength - QUEUE_FREE_SPACE(cstate);
+			totalspace += cstate->cs_qlength;
 			ncons++;
 		}
 		LWLockRelease(sqsync->sqs_consumer_sync[i].cs_lwlock);
@@ -1100,14 +1589,12 @@ SharedQueueCanPause(SharedQueue squeue)
 		return false;
 
 	/*
-	 * Pause only if average consumer queue is full more then on half.
+	 * Pause only if consumer queues are full more then on half in average.
 	 */
 	if (result)
-		result = (usedspace / ncons > squeue->sq_consumers[0].cs_qlength / 2);
-#ifdef SQUEUE_STAT
+		result = (usedspace > totalspace / 2);
 	if (result)
 		squeue->stat_paused++;
-#endif
 	return result;
 }
 
@@ -1118,18 +1605,25 @@ SharedQueueFinish(SharedQueue squeue, TupleDesc tupDesc,
 {
 	SQueueSync *sqsync = squeue->sq_sync;
 	TupleTableSlot *tmpslot = NULL;
-	int 			i;
+	int 			n;
 	int 			nstores = 0;
 
-	for (i = 0; i < squeue->sq_nconsumers; i++)
+	if (squeue->sq_broadcast)
+		return sq_bcast_finish(squeue, tupDesc, tuplestore);
+
+	/*
+	 * Start from the next consumer each time, so if the consumers free space
+	 * at different rates the producer does not keep serving the same ones
+	 * first.
+	 */
+	for (n = 0; n < squeue->sq_nconsumers; n++)
 	{
+		int			i = (squeue->sq_nextcons + n) % squeue->sq_nconsumers;
 		ConsState *cstate = &squeue->sq_consumers[i];
 		LWLockAcquire(sqsync->sqs_consumer_sync[i].cs_lwlock, LW_EXCLUSIVE);
-#ifdef SQUEUE_STAT
 		if (!squeue->stat_finish)
 			elog(DEBUG1, "Finishing %s node %d, %ld writes and %ld reads so far, %ld buffer writes, %ld buffer reads, %ld tuples returned to buffer",
 				 squeue->sq_key, cstate->cs_node, cstate->stat_writes, cstate->stat_reads, cstate->stat_buff_writes, cstate->stat_buff_reads, cstate->stat_buff_returns);
-#endif
 		/*
 		 * if the tuplestore has data and consumer queue has space for some
 		 * try to push rows to the queue. We do not want to do that often
@@ -1181,14 +1675,90 @@ SharedQueueFinish(SharedQueue squeue, TupleDesc tupDesc,
 	if (tmpslot)
 		ExecDropSingleTupleTableSlot(tmpslot);
 
-#ifdef SQUEUE_STAT
+	if (squeue->sq_nconsumers > 0)
+		squeue->sq_nextcons = (squeue->sq_nextcons + 1) % squeue->sq_nconsumers;
 	squeue->stat_finish = true;
-#endif
 
 	return nstores;
 }
 
 
+/*
+ * sq_bcast_finish
+ *    SharedQueueFinish for a broadcast queue. Tuples for all consumers are in
+ *    the first tuplestore, when it is written out all the consumers get EOF.
+ */
+static int
+sq_bcast_finish(SharedQueue squeue, TupleDesc tupDesc,
+				Tuplestorestate **tuplestore)
+{
+	SQueueSync *sqsync = squeue->sq_sync;
+	int			lead = sq_bcast_lead(squeue);
+	int			i;
+
+	if (tuplestore[0])
+	{
+		/* If no consumers are reading just destroy the tuplestore */
+		if (lead < 0)
+		{
+			tuplestore_end(tuplestore[0]);
+			tuplestore[0] = NULL;
+		}
+		else
+		{
+			ConsState  *cstate = &squeue->sq_consumers[lead];
+
+			/* See comments in SharedQueueFinish */
+			if (sq_free_space(squeue, cstate) > cstate->cs_qlength / 2)
+			{
+				TupleTableSlot *tmpslot = MakeSingleTupleTableSlot(tupDesc);
+
+				if (SharedQueueDump(squeue, lead, tmpslot, tuplestore[0]))
+				{
+					tuplestore_end(tuplestore[0]);
+					tuplestore[0] = NULL;
+				}
+				ExecDropSingleTupleTableSlot(tmpslot);
+			}
+		}
+	}
+
+	for (i = 0; i < squeue->sq_nconsumers; i++)
+	{
+		ConsState *cstate = &squeue->sq_consumers[i];
+
+		LWLockAcquire(sqsync->sqs_consumer_sync[i].cs_lwlock, LW_EXCLUSIVE);
+		if (!squeue->stat_finish)
+			elog(DEBUG1, "Finishing %s node %d, %ld writes and %ld reads so far",
+				 squeue->sq_key, cstate->cs_node, cstate->stat_writes,
+				 cstate->stat_reads);
+		if (cstate->cs_status == CONSUMER_ACTIVE)
+		{
+			if (tuplestore[0] == NULL)
+				cstate->cs_status = CONSUMER_EOF;
+			/* Consumer may be sleeping, wake it up */
+			SetLatch(&sqsync->sqs_consumer_sync[i].cs_latch);
+		}
+		LWLockRelease(sqsync->sqs_consumer_sync[i].cs_lwlock);
+	}
+
+	squeue->stat_finish = true;
+
+	return tuplestore[0] ? 1 : 0;
+}
+
+
+/*
+ * SharedQueueIsBroadcast
+ *    Are consumers of the shared queue reading the same data?
+ */
+bool
+SharedQueueIsBroadcast(SharedQueue squeue)
+{
+	return squeue->sq_broadcast;
+}
+
+
 /*
  * SharedQueueUnBind
  *    Cancel binding of current process to the shared queue. If the process
@@ -1240,16 +1810,18 @@ CHECK:
 			break;
 		elog(DEBUG1, "Wait while %d squeue readers finishing", c_count);
 		/* wait for a notification */
+		pgstat_report_wait_start(WAIT_EVENT_SQUEUE_UNBIND, InvalidOid);
 		wait_result = WaitLatch(&sqsync->sqs_producer_latch,
 								WL_LATCH_SET | WL_POSTMASTER_DEATH | WL_TIMEOUT,
 								10000L);
+		pgstat_report_wait_end(WAIT_EVENT_SQUEUE_UNBIND);
 		if (wait_result & WL_TIMEOUT)
 			break;
 		/* got notification, continue loop */
 	}
-#ifdef SQUEUE_STAT
-	elog(DEBUG1, "Producer %s is done, there were %ld pauses", squeue->sq_key, squeue->stat_paused);
-#endif
+	elog(DEBUG1, "Producer %s is done, there were %ld pauses, waited %ld times for %ld us",
+		 squeue->sq_key, squeue->stat_paused, squeue->stat_stalls,
+		 squeue->stat_stall_time);
 	elog(LOG, "Producer %s is done", squeue->sq_key);
 
 	LWLockAcquire(SQueuesLock, LW_EXCLUSIVE);
@@ -1285,6 +1857,9 @@ CHECK:
 	/* All is done, clean up */
 	DisownLatch(&sqsync->sqs_producer_latch);
 
+	/* Consumers are not reading any more, remove the files */
+	sq_spill_close(squeue, -1);
+
 	/* Now it is OK to remove hash table entry */
 	squeue->sq_sync = NULL;
 	sqsync->queue = NULL;
@@ -1372,6 +1947,8 @@ SharedQueueRelease(const char *sqname)
 						elog(DEBUG1, "Release consumer %d of %s", i, sqname);
 					}
 					LWLockRelease(sqsync->sqs_consumer_sync[i].cs_lwlock);
+					/* Close files if consumer has opened them */
+					sq_spill_close(sq, i);
 					/* exit */
 					LWLockRelease(SQueuesLock);
 					return;
@@ -1427,135 +2004,591 @@ SharedQueuesCleanup(int code, Datum arg)
 
 
 /*
- * sq_push_long_tuple
- *    Routine to push through the consumer state tuple longer the the consumer
- *    queue. Long tuple is written by a producer partially, and only when the
- *    consumer queue is empty.
- *    The consumer can determine that the tuple being read is long if the length
- *    of the tuple which is read before data is exceeding queue length.
- * 	  Consumers is switching to the long tuple mode and read in the portion of
- *	  data which is already in the queue. After reading in each portion of data
- *    consumer sets cs_ntuples to LONG_TUPLE to indicate it is in long tuple
- *    mode, and writes out number of already read bytes to the beginning of the
- *    queue.
- *    While Consumer is reading in tuple data Producer may work on other task:
- *    execute query and send tuples to other Customers. If Producer sees the
- *    LONG_TUPLE indicator it may write out next portion. The tuple remains
- *    current in the tuplestore, and Producer just needs to read offset from
- *    the buffer to know what part of data to write next.
- *    After tuple is completely written the Producer is advancing to next tuple
- *    and continue operation in normal mode.
+ * Copy of the statistics of a consumer queue, taken under the lock to be
+ * reported by pg_stat_get_shared_queues.
  */
-static bool
-sq_push_long_tuple(ConsState *cstate, RemoteDataRow datarow)
+typedef struct SQueueStat
+{
+	char		key[SQUEUE_KEYSIZE];
+	int			producer_pid;
+	int			producer_node;
+	long		producer_pauses;
+	long		producer_waits;
+	long		producer_wait_time;
+	int			consumer;
+	ConsState	cstate;
+} SQueueStat;
+
+/*
+ * Return name of the datanode with the specified node id, or NULL if the
+ * node id is unknown.
+ */
+static char *
+sq_node_name(int nodeid)
+{
+	Oid			nodeoid;
+
+	if (nodeid < 0 || nodeid >= NumDataNodes)
+		return NULL;
+	nodeoid = PGXCNodeGetNodeOid(nodeid, PGXC_NODE_DATANODE);
+	if (!OidIsValid(nodeoid))
+		return NULL;
+	return get_pgxc_nodename(nodeoid);
+}
+
+/*
+ * pg_stat_get_shared_queues
+ *    SQL SRF showing the shared queues of the node, one row per consumer
+ *    queue, along with the counters of the data going through the queue.
+ */
+Datum
+pg_stat_get_shared_queues(PG_FUNCTION_ARGS)
+{
+#define PG_STAT_GET_SHARED_QUEUES_COLS 19
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	HASH_SEQ_STATUS hash_seq;
+	SharedQueue sq;
+	SQueueStat *stats = NULL;
+	int			nstats = 0;
+	int			maxstats = 0;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/*
+	 * Take a snapshot of the queues first, node names are looked up in the
+	 * catalog and we should not do that while holding the lock.
+	 */
+	LWLockAcquire(SQueuesLock, LW_SHARED);
+	hash_seq_init(&hash_seq, SharedQueues);
+	while ((sq = (SharedQueue) hash_seq_search(&hash_seq)) != NULL)
+	{
+		for (i = 0; i < sq->sq_nconsumers; i++)
+		{
+			SQueueStat *stat;
+
+			if (nstats == maxstats)
+			{
+				maxstats = maxstats ? maxstats * 2 : 16;
+				if (stats)
+					stats = (SQueueStat *) repalloc(stats,
+											maxstats * sizeof(SQueueStat));
+				else
+					stats = (SQueueStat *) palloc(maxstats * sizeof(SQueueStat));
+			}
+			stat = &stats[nstats++];
+			strncpy(stat->key, sq->sq_key, SQUEUE_KEYSIZE);
+			stat->producer_pid = sq->sq_pid;
+			stat->producer_node = sq->sq_nodeid;
+			stat->producer_pauses = sq->stat_paused;
+			stat->producer_waits = sq->stat_stalls;
+			stat->producer_wait_time = sq->stat_stall_time;
+			stat->consumer = i;
+			memcpy(&stat->cstate, &sq->sq_consumers[i], sizeof(ConsState));
+		}
+	}
+	LWLockRelease(SQueuesLock);
+
+	for (i = 0; i < nstats; i++)
+	{
+		SQueueStat *stat = &stats[i];
+		ConsState  *cstate = &stat->cstate;
+		Datum		values[PG_STAT_GET_SHARED_QUEUES_COLS];
+		bool		nulls[PG_STAT_GET_SHARED_QUEUES_COLS];
+		char	   *nodename;
+		const char *status;
+
+		MemSet(nulls, 0, sizeof(nulls));
+
+		values[0] = CStringGetTextDatum(stat->key);
+		if (stat->producer_pid != 0)
+			values[1] = Int32GetDatum(stat->producer_pid);
+		else
+			nulls[1] = true;
+		nodename = sq_node_name(stat->producer_node);
+		if (nodename)
+			values[2] = CStringGetDatum(nodename);
+		else
+			nulls[2] = true;
+		values[3] = Int64GetDatum(stat->producer_pauses);
+		values[4] = Int64GetDatum(stat->producer_waits);
+		values[5] = Float8GetDatum(stat->producer_wait_time / 1000.0);
+		values[6] = Int32GetDatum(stat->consumer);
+		if (cstate->cs_pid != 0)
+			values[7] = Int32GetDatum(cstate->cs_pid);
+		else
+			nulls[7] = true;
+		nodename = sq_node_name(cstate->cs_node);
+		if (nodename)
+			values[8] = CStringGetDatum(nodename);
+		else
+			nulls[8] = true;
+		switch (cstate->cs_status)
+		{
+			case CONSUMER_ACTIVE:
+				status = "active";
+				break;
+			case CONSUMER_EOF:
+				status = "eof";
+				break;
+			case CONSUMER_ERROR:
+				status = "error";
+				break;
+			case CONSUMER_DONE:
+				status = "done";
+				break;
+			default:
+				status = "unknown";
+				break;
+		}
+		values[9] = CStringGetTextDatum(status);
+		values[10] = Int32GetDatum(cstate->cs_qlength);
+		values[11] = Int64GetDatum(cstate->stat_writes);
+		values[12] = Int64GetDatum(cstate->stat_write_bytes);
+		values[13] = Int64GetDatum(cstate->stat_full);
+		values[14] = Int64GetDatum(cstate->stat_buff_writes);
+		values[15] = Int64GetDatum(cstate->stat_buff_bytes);
+		values[16] = Int64GetDatum(cstate->stat_reads);
+		values[17] = Int64GetDatum(cstate->stat_waits);
+		values[18] = Float8GetDatum(cstate->stat_wait_time / 1000.0);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * sq_put_datarow
+ *    Write the data row to the consumer queue, caller have checked there is
+ *    enough room. The tuple which does not fit the queue is appended to the
+ *    long tuple file of the consumer, and its length and location in the file
+ *    are written to the queue instead of the data. The consumer reads in the
+ *    tuple with one read, no need to push the tuple through the queue piece by
+ *    piece waiting for the consumer to take each of them.
+ */
+static void
+sq_put_datarow(SharedQueue squeue, int consumerIdx, RemoteDataRow datarow)
 {
-	if (cstate->cs_ntuples == 0)
+	ConsState  *cstate = &(squeue->sq_consumers[consumerIdx]);
+
+	QUEUE_WRITE(cstate, sizeof(int), (char *) &datarow->msglen);
+	if (QUEUE_LONG_TUPLE(cstate, datarow->msglen))
 	{
-		/* the tuple is too big to fit the queue, start pushing it through */
-		int len;
+		/* Consumers of broadcast queue share the file, see sq_spill_path */
+		int			fileIdx = squeue->sq_broadcast ? 0 : consumerIdx;
+		SQueueSpill *spill = sq_spill_find(squeue, fileIdx, true);
+		int64		offset;
+
+		if (spill == NULL)
+			spill = sq_spill_open(squeue, fileIdx, true, true);
+
+		offset = spill->sp_filepos;
+		if (FileWrite(spill->sp_file, datarow->msg, datarow->msglen) !=
+				datarow->msglen)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not write to shared queue long tuple file \"%s\": %m",
+							FilePathName(spill->sp_file))));
+		spill->sp_filepos += datarow->msglen;
+
 		/*
-		 * Output actual message size, to prepare consumer:
-		 * allocate memory and set up transmission.
+		 * The data are in the kernel buffers now and consumer can read them
+		 * as soon as it sees the reference.
 		 */
-		QUEUE_WRITE(cstate, sizeof(int), (char *) &datarow->msglen);
-		/* Output as much as possible */
-		len = cstate->cs_qlength - sizeof(int);
-		Assert(datarow->msglen > len);
-		QUEUE_WRITE(cstate, len, datarow->msg);
-		cstate->cs_ntuples = 1;
-		return false;
+		QUEUE_WRITE(cstate, sizeof(int64), (char *) &offset);
 	}
 	else
+		QUEUE_WRITE(cstate, datarow->msglen, datarow->msg);
+}
+
+
+/*
+ * sq_get_long_tuple
+ *    Read in data of the long tuple from the long tuple file of the consumer
+ *    queue. Length of the tuple is already set in the data row.
+ */
+static void
+sq_get_long_tuple(SharedQueue squeue, int consumerIdx, RemoteDataRow datarow,
+				  int64 offset)
+{
+	SQueueSpill *spill = sq_spill_find(squeue, consumerIdx, true);
+
+	if (spill == NULL)
+		spill = sq_spill_open(squeue, consumerIdx, false, true);
+
+	if (spill->sp_filepos != offset)
 	{
-		int offset;
-		int	len;
+		if (FileSeek(spill->sp_file, (off_t) offset, SEEK_SET) != offset)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not seek in shared queue long tuple file \"%s\": %m",
+							FilePathName(spill->sp_file))));
+		spill->sp_filepos = offset;
+	}
+	if (FileRead(spill->sp_file, datarow->msg, datarow->msglen) !=
+			datarow->msglen)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from shared queue long tuple file \"%s\": %m",
+						FilePathName(spill->sp_file))));
+	spill->sp_filepos += datarow->msglen;
+}
 
-		/* Continue pushing through long tuple */
-		Assert(cstate->cs_ntuples == LONG_TUPLE);
-		/*
-		 * Consumer outputs number of bytes already read at the beginning of
-		 * the queue.
-		 */
-		memcpy(&offset, cstate->cs_qstart, sizeof(int));
 
-		Assert(offset > 0 && offset < datarow->msglen);
+/*
+ * sq_spill_find
+ *    Find local state of the overflow file or the long tuple file of the
+ *    specified consumer queue.
+ */
+static SQueueSpill *
+sq_spill_find(SharedQueue squeue, int consumerIdx, bool islong)
+{
+	ListCell   *lc;
 
-		/* remaining data */
-		len = datarow->msglen - offset;
-		/*
-		 * We are sending remaining lengs just for sanity check at the consumer
-		 * side
-		 */
-		QUEUE_WRITE(cstate, sizeof(int), (char *) &len);
-		if (len > cstate->cs_qlength - sizeof(int))
+	foreach(lc, SQueueSpills)
+	{
+		SQueueSpill *spill = (SQueueSpill *) lfirst(lc);
+
+		if (spill->sp_squeue == squeue &&
+				spill->sp_consumer == consumerIdx &&
+				spill->sp_long == islong &&
+				strcmp(spill->sp_key, squeue->sq_key) == 0)
+			return spill;
+	}
+	return NULL;
+}
+
+
+/*
+ * sq_spill_path
+ *    Build the overflow or the long tuple file name of the consumer queue.
+ *    The file is in the temporary file directory so it is removed on restart
+ *    if the producer failed to clean it up.
+ */
+static void
+sq_spill_path(SharedQueue squeue, int consumerIdx, bool islong, char *path)
+{
+	int			syncidx;
+
+	/*
+	 * The producer writes long tuples of broadcast queue once, so all the
+	 * consumers read the same file.
+	 */
+	if (islong && squeue->sq_broadcast)
+		consumerIdx = 0;
+
+	syncidx = ((char *) squeue->sq_sync - (char *) SQueueSyncs) /
+			SQUEUE_SYNC_SIZE;
+	snprintf(path, MAXPGPATH, "base/%s/%s%d.sq%d.%d%s",
+			 PG_TEMP_FILES_DIR, PG_TEMP_FILE_PREFIX,
+			 squeue->sq_pid, syncidx, consumerIdx, islong ? ".long" : "");
+}
+
+
+/*
+ * sq_spill_open
+ *    Open the overflow file or the long tuple file of the consumer queue.
+ *    Producer creates the file, consumer opens it for reading.
+ */
+static SQueueSpill *
+sq_spill_open(SharedQueue squeue, int consumerIdx, bool producer, bool islong)
+{
+	char		path[MAXPGPATH];
+	File		file;
+	SQueueSpill *spill;
+	MemoryContext oldcontext;
+
+	sq_spill_path(squeue, consumerIdx, islong, path);
+	if (producer)
+	{
+		file = PathNameOpenFile(path, O_RDWR | O_CREAT | O_TRUNC | PG_BINARY,
+								0600);
+		if (file <= 0)
 		{
-			/* does not fit yet */
-			len = cstate->cs_qlength - sizeof(int);
-			QUEUE_WRITE(cstate, len, datarow->msg + offset);
-			cstate->cs_ntuples = 1;
-			return false;
+			/*
+			 * We might need to create the temporary file directory, as
+			 * OpenTemporaryFile does.
+			 */
+			mkdir("base/" PG_TEMP_FILES_DIR, S_IRWXU);
+			file = PathNameOpenFile(path,
+									O_RDWR | O_CREAT | O_TRUNC | PG_BINARY,
+									0600);
 		}
-		else
+	}
+	else
+		file = PathNameOpenFile(path, O_RDONLY | PG_BINARY, 0);
+
+	if (file <= 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open shared queue file \"%s\": %m",
+						path)));
+
+	elog(DEBUG1, "Opened file \"%s\" of squeue %s consumer %d",
+		 path, squeue->sq_key, consumerIdx);
+
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	spill = (SQueueSpill *) palloc(sizeof(SQueueSpill));
+	strncpy(spill->sp_key, squeue->sq_key, SQUEUE_KEYSIZE);
+	spill->sp_squeue = squeue;
+	spill->sp_consumer = consumerIdx;
+	spill->sp_producer = producer;
+	spill->sp_long = islong;
+	spill->sp_file = file;
+	spill->sp_filepos = 0;
+	initStringInfo(&spill->sp_buf);
+	SQueueSpills = lappend(SQueueSpills, spill);
+	MemoryContextSwitchTo(oldcontext);
+
+	return spill;
+}
+
+
+/*
+ * sq_spill_close
+ *    Close overflow and long tuple files of the consumer queue, or all files
+ *    of the shared queue if consumerIdx is -1. Producer removes the files.
+ */
+static void
+sq_spill_close(SharedQueue squeue, int consumerIdx)
+{
+	ListCell   *lc;
+	ListCell   *prev = NULL;
+	ListCell   *next;
+
+	for (lc = list_head(SQueueSpills); lc; lc = next)
+	{
+		SQueueSpill *spill = (SQueueSpill *) lfirst(lc);
+
+		next = lnext(lc);
+		if (spill->sp_squeue == squeue &&
+				(consumerIdx == -1 || spill->sp_consumer == consumerIdx) &&
+				strcmp(spill->sp_key, squeue->sq_key) == 0)
 		{
-			/* now we are done */
-			QUEUE_WRITE(cstate, len, datarow->msg + offset);
-			cstate->cs_ntuples = 1;
-			return true;
+			FileClose(spill->sp_file);
+			if (spill->sp_producer)
+			{
+				char		path[MAXPGPATH];
+
+				sq_spill_path(squeue, spill->sp_consumer, spill->sp_long,
+							  path);
+				if (unlink(path) < 0 && errno != ENOENT)
+					ereport(WARNING,
+							(errcode_for_file_access(),
+							 errmsg("could not remove shared queue file \"%s\": %m",
+									path)));
+			}
+			SQueueSpills = list_delete_cell(SQueueSpills, lc, prev);
+			pfree(spill->sp_buf.data);
+			pfree(spill);
 		}
+		else
+			prev = lc;
 	}
 }
 
 
 /*
- * sq_pull_long_tuple
- *    Read in from the queue data of a long tuple which does not the queue.
- *    See sq_push_long_tuple for more details
+ * sq_spill_write
+ *    Write data from the specified slots to the consumer queue of shared queue
+ *    in spill mode. Slots which do not fit the queue are appended to the
+ *    overflow file. If consumer has not yet taken all the data from the file
+ *    everything goes to the file to keep the order of tuples.
  */
 static void
-sq_pull_long_tuple(ConsState *cstate, RemoteDataRow datarow,
-							   ConsumerSync *sync)
+sq_spill_write(SharedQueue squeue, int consumerIdx, TupleTableSlot **slots,
+			   int nslots, MemoryContext tmpcxt)
 {
-	int offset = 0;
-	int len = datarow->msglen;
+	ConsState  *cstate = &(squeue->sq_consumers[consumerIdx]);
+	LWLockId	clwlock = squeue->sq_sync->sqs_consumer_sync[consumerIdx].cs_lwlock;
+	SQueueSpill *spill = sq_spill_find(squeue, consumerIdx, false);
+	int			nwritten = 0;
+	bool		drained = true;
 
-	for (;;)
+	if (spill)
 	{
-		/* determine how many bytes to read */
-		if (len > cstate->cs_qlength - sizeof(int))
-			len = cstate->cs_qlength - sizeof(int);
+		LWLockAcquire(clwlock, LW_SHARED);
+		drained = (cstate->cs_spillread == spill->sp_filepos);
+		LWLockRelease(clwlock);
+	}
 
-		/* read data */
-		QUEUE_READ(cstate, len, datarow->msg + offset);
+	if (drained)
+		nwritten = sq_write_slots(squeue, consumerIdx, slots, nslots, tmpcxt);
 
-		/* remember how many we read already */
-		offset += len;
+	if (nwritten == nslots)
+		return;
 
-		/* check if we are done */
-		if (offset == datarow->msglen)
-			return;
+	cstate->stat_full++;
+	if (spill == NULL)
+		spill = sq_spill_open(squeue, consumerIdx, true, false);
 
-		/* need more, set up queue to accept data from the producer */
-		Assert(cstate->cs_ntuples == 1); /* allow exactly one incomplete tuple */
-		cstate->cs_ntuples = LONG_TUPLE; /* long tuple mode marker */
-		/* Inform producer how many bytes we have already */
-		memcpy(cstate->cs_qstart, &offset, sizeof(int));
-		/* Release locks and wait until producer supply more data */
-		while (cstate->cs_ntuples == LONG_TUPLE)
-		{
-			/* prepare wait */
-			ResetLatch(&sync->cs_latch);
-			LWLockRelease(sync->cs_lwlock);
-			/* Wait for notification about available info */
-			WaitLatch(&sync->cs_latch, WL_LATCH_SET | WL_POSTMASTER_DEATH, -1);
-			/* got the notification, restore lock and try again */
-			LWLockAcquire(sync->cs_lwlock, LW_EXCLUSIVE);
-		}
-		/* Read length of remaining data */
-		QUEUE_READ(cstate, sizeof(int), (char *) &len);
+	/* Format tuples the same way as in the queue, length goes first */
+	resetStringInfo(&spill->sp_buf);
+	for (; nwritten < nslots; nwritten++)
+	{
+		TupleTableSlot *slot = slots[nwritten];
+		RemoteDataRow datarow;
 
-		/* Make sure we are doing the same tuple */
-		Assert(offset + len == datarow->msglen);
+		if (slot->tts_datarow)
+			datarow = slot->tts_datarow;
+		else
+			datarow = ExecCopySlotDatarow(slot, tmpcxt);
 
-		/* next iteration */
+		appendBinaryStringInfo(&spill->sp_buf, (char *) &datarow->msglen,
+							   sizeof(int));
+		appendBinaryStringInfo(&spill->sp_buf, datarow->msg, datarow->msglen);
+
+		if (datarow != slot->tts_datarow)
+			pfree(datarow);
+		cstate->stat_buff_writes++;
 	}
+
+	if (FileWrite(spill->sp_file, spill->sp_buf.data, spill->sp_buf.len) !=
+			spill->sp_buf.len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to shared queue overflow file \"%s\": %m",
+						FilePathName(spill->sp_file))));
+	spill->sp_filepos += spill->sp_buf.len;
+	cstate->stat_buff_bytes += spill->sp_buf.len;
+	resetStringInfo(&spill->sp_buf);
+
+	/* Let consumer know about new data */
+	LWLockAcquire(clwlock, LW_EXCLUSIVE);
+	cstate->cs_spillsize = spill->sp_filepos;
+	LWLockRelease(clwlock);
+	SetLatch(&squeue->sq_sync->sqs_consumer_sync[consumerIdx].cs_latch);
+}
+
+
+/*
+ * sq_spill_read
+ *    Read next portion of the overflow file into the consumer buffer. At
+ *    least the rest of the next tuple is read, producer always writes out
+ *    complete tuples.
+ */
+static void
+sq_spill_read(SQueueSpill *spill, ConsState *cstate, ConsumerSync *sync)
+{
+	StringInfo	buf = &spill->sp_buf;
+	int			avail = buf->len - buf->cursor;
+	int			needed;
+	int64		toread;
+	int			nread;
+
+	/* Determine how many bytes are missing to complete the next tuple */
+	if (avail < sizeof(int))
+		needed = sizeof(int) - avail;
+	else
+	{
+		int			datalen;
+
+		memcpy(&datalen, buf->data + buf->cursor, sizeof(int));
+		needed = sizeof(int) + datalen - avail;
+	}
+	Assert(needed > 0);
+
+	/* Discard data already returned */
+	if (buf->cursor > 0)
+	{
+		memmove(buf->data, buf->data + buf->cursor, avail);
+		buf->len = avail;
+		buf->cursor = 0;
+	}
+
+	/*
+	 * Take next portion of the file. Move the read mark before actually
+	 * reading, producer should not write to the queue until we have the data,
+	 * and anything in the buffer is returned before the queue is looked at.
+	 */
+	LWLockAcquire(sync->cs_lwlock, LW_EXCLUSIVE);
+	toread = cstate->cs_spillsize - spill->sp_filepos;
+	if (toread < needed)
+	{
+		LWLockRelease(sync->cs_lwlock);
+		elog(ERROR, "unexpected end of shared queue overflow file");
+	}
+	if (toread > Max(needed, SQUEUE_SPILL_CHUNK))
+		toread = Max(needed, SQUEUE_SPILL_CHUNK);
+	cstate->cs_spillread = spill->sp_filepos + toread;
+	LWLockRelease(sync->cs_lwlock);
+
+	enlargeStringInfo(buf, (int) toread);
+	if (FileSeek(spill->sp_file, spill->sp_filepos, SEEK_SET) !=
+			spill->sp_filepos)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not seek in shared queue overflow file \"%s\": %m",
+						FilePathName(spill->sp_file))));
+	nread = FileRead(spill->sp_file, buf->data + buf->len, (int) toread);
+	if (nread != toread)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from shared queue overflow file \"%s\": %m",
+						FilePathName(spill->sp_file))));
+	buf->len += nread;
+	spill->sp_filepos += nread;
+}
+
+
+/*
+ * sq_spill_get_row
+ *    Store next tuple from the consumer buffer to the slot. Returns false if
+ *    the buffer does not contain complete tuple.
+ */
+static bool
+sq_spill_get_row(SQueueSpill *spill, TupleTableSlot *slot)
+{
+	StringInfo	buf = &spill->sp_buf;
+	int			avail = buf->len - buf->cursor;
+	int			datalen;
+	RemoteDataRow datarow;
+
+	if (avail < sizeof(int))
+		return false;
+	memcpy(&datalen, buf->data + buf->cursor, sizeof(int));
+	if (avail < sizeof(int) + datalen)
+		return false;
+
+	datarow = (RemoteDataRow) palloc(sizeof(RemoteDataRowData) + datalen);
+	datarow->msgnode = InvalidOid;
+	datarow->msglen = datalen;
+	memcpy(datarow->msg, buf->data + buf->cursor + sizeof(int), datalen);
+	buf->cursor += sizeof(int) + datalen;
+	if (buf->cursor == buf->len)
+		resetStringInfo(buf);
+	ExecStoreDataRowTuple(datarow, slot, true);
+	return true;
 }
@@ -41,6 +41,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "access/hash.h"
 #include "access/xlog.h"
 #include "access/xlog_internal.h"
 #include "libpq/pqsignal.h"
@@ -59,6 +60,9 @@
 #include "utils/guc.h"
 #include "utils/memutils.h"
 #include "utils/resowner.h"
+#ifdef PGXC
+#include "pgxc/pgxc.h"
+#endif
 
 
 /*----------
@@ -144,6 +148,7 @@ static CheckpointerShmemStruct *CheckpointerShmem;
 int			CheckPointTimeout = 300;
 int			CheckPointWarning = 30;
 double		CheckPointCompletionTarget = 0.5;
+bool		CheckPointStagger = false;
 
 /*
  * Flags set by interrupt handlers for later service in the main loop.
@@ -172,6 +177,7 @@ static bool IsCheckpointOnSchedule(double progress);
 static bool ImmediateCheckpointRequested(void);
 static bool CompactCheckpointerRequestQueue(void);
 static void UpdateSharedMemoryConfig(void);
+static pg_time_t CheckpointBaseTime(pg_time_t now);
 
 /* Signal handlers */
 
@@ -230,6 +236,7 @@ CheckpointerMain(void)
 	 * Initialize so that first time-driven event happens at the correct time.
 	 */
 	last_checkpoint_time = last_xlog_switch_time = (pg_time_t) time(NULL);
+	last_checkpoint_time = CheckpointBaseTime(last_checkpoint_time);
 
 	/*
 	 * Create a resource owner to keep track of our resources (currently only
@@ -516,7 +523,7 @@ CheckpointerMain(void)
 				 * last_checkpoint_time.  This is so that time-driven
 				 * checkpoints happen at a predictable spacing.
 				 */
-				last_checkpoint_time = now;
+				last_checkpoint_time = CheckpointBaseTime(now);
 			}
 			else
 			{
@@ -574,6 +581,44 @@ CheckpointerMain(void)
 	}
 }
 
+/*
+ * CheckpointBaseTime -- the time from which to count checkpoint_timeout for
+ * the next time-driven checkpoint, for a checkpoint starting now.
+ *
+ * Normally that's now.  With checkpoint_stagger, time-driven checkpoints are
+ * aligned on the wall clock instead: they start when the time since the
+ * epoch, shifted by a phase derived from the node name, is a multiple of
+ * checkpoint_timeout.  The nodes of a cluster then checkpoint at different
+ * times, instead of all of them at once because they were started or
+ * loaded together.  The next checkpoint is skipped to the following slot if
+ * it would come less than half a checkpoint_timeout after this one.
+ */
+static pg_time_t
+CheckpointBaseTime(pg_time_t now)
+{
+	uint32		phase = 0;
+	pg_time_t	slot;
+
+	if (!CheckPointStagger)
+		return now;
+
+#ifdef PGXC
+	if (PGXCNodeName != NULL)
+		phase = DatumGetUInt32(hash_any((unsigned char *) PGXCNodeName,
+										strlen(PGXCNodeName)));
+#endif
+	phase %= CheckPointTimeout;
+
+	/* start of the current slot */
+	slot = now - ((now - phase) % CheckPointTimeout + CheckPointTimeout) %
+		CheckPointTimeout;
+
+	if (slot + CheckPointTimeout - now < CheckPointTimeout / 2)
+		slot += CheckPointTimeout;
+
+	return slot;
+}
+
 /*
  * CheckArchiveTimeout -- check for archive_timeout and switch xlog files
  *
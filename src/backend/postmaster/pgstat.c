@@ -62,6 +62,7 @@
 #include "storage/pg_shmem.h"
 #include "storage/procsignal.h"
 #include "storage/sinvaladt.h"
+#include "storage/spin.h"
 #include "utils/ascii.h"
 #include "utils/guc.h"
 #include "utils/memutils.h"
@@ -2551,6 +2552,52 @@ static Size BackendActivityBufferSize = 0;
 static PgBackendSSLStatus *BackendSslStatusBuffer = NULL;
 #endif
 
+#ifdef XCP
+/*
+ * Time spent by all the backends in the waits of a wait class.  Every wait
+ * is timed; waits are slow enough for the update under a spinlock to be
+ * negligible.
+ */
+typedef struct WaitHistogram
+{
+	slock_t		mutex;
+	int64		waits;
+	int64		total_time;		/* in microseconds */
+	int64		counts[WAIT_HISTOGRAM_BUCKETS];
+} WaitHistogram;
+
+static WaitHistogram *WaitHistograms = NULL;
+
+/* Upper bounds of the histogram buckets, the last bucket is unbounded */
+static const int64 wait_histogram_bounds[WAIT_HISTOGRAM_BUCKETS - 1] = {
+	1000, 10000, 100000, 1000000, 10000000
+};
+
+static const char *const wait_class_names[NUM_WAIT_CLASSES] = {
+	"Remote", "SharedQueue", "GTM", "Pooler", "Barrier"
+};
+
+/* Name and class of each wait event, indexed by WaitEvent */
+static const struct
+{
+	const char *name;
+	WaitClass	wclass;
+}	wait_events[] = {
+	{NULL, WAIT_CLASS_REMOTE},
+	{"RemoteResponse", WAIT_CLASS_REMOTE},
+	{"SharedQueueRead", WAIT_CLASS_SHARED_QUEUE},
+	{"SharedQueueCredit", WAIT_CLASS_SHARED_QUEUE},
+	{"SharedQueueUnBind", WAIT_CLASS_SHARED_QUEUE},
+	{"GTMResponse", WAIT_CLASS_GTM},
+	{"PoolerConnections", WAIT_CLASS_POOLER},
+	{"Barrier", WAIT_CLASS_BARRIER}
+};
+
+/* Wait in progress in this backend, reported or not */
+static WaitEvent MyWaitEvent = WAIT_EVENT_NONE;
+static instr_time MyWaitStart;
+#endif
+
 
 /*
  * Report shared-memory space needed by CreateSharedBackendStatus.
@@ -2567,6 +2614,10 @@ BackendStatusShmemSize(void)
 					mul_size(pgstat_track_activity_query_size, MaxBackends));
 	size = add_size(size,
 					mul_size(NAMEDATALEN, MaxBackends));
+#ifdef XCP
+	size = add_size(size,
+					mul_size(sizeof(WaitHistogram), NUM_WAIT_CLASSES));
+#endif
 	return size;
 }
 
@@ -2671,6 +2722,20 @@ CreateSharedBackendStatus(void)
 			buffer += pgstat_track_activity_query_size;
 		}
 	}
+
+#ifdef XCP
+	/* Create or attach to the wait histograms */
+	size = mul_size(sizeof(WaitHistogram), NUM_WAIT_CLASSES);
+	WaitHistograms = (WaitHistogram *)
+		ShmemInitStruct("Wait Histograms", size, &found);
+
+	if (!found)
+	{
+		MemSet(WaitHistograms, 0, size);
+		for (i = 0; i < NUM_WAIT_CLASSES; i++)
+			SpinLockInit(&WaitHistograms[i].mutex);
+	}
+#endif
 }
 
 
@@ -2778,6 +2843,10 @@ pgstat_bestart(void)
 	beentry->st_ssl = false;
 #endif
 	beentry->st_waiting = false;
+#ifdef XCP
+	beentry->st_wait_event = WAIT_EVENT_NONE;
+	beentry->st_wait_node = InvalidOid;
+#endif
 	beentry->st_state = STATE_UNDEFINED;
 	beentry->st_appname[0] = '\0';
 	beentry->st_activity[0] = '\0';
@@ -2870,6 +2939,10 @@ pgstat_report_activity(BackendState state, const char *cmd_str)
 			/* st_xact_start_timestamp and st_waiting are also disabled */
 			beentry->st_xact_start_timestamp = 0;
 			beentry->st_waiting = false;
+#ifdef XCP
+			beentry->st_wait_event = WAIT_EVENT_NONE;
+			beentry->st_wait_node = InvalidOid;
+#endif
 			pgstat_increment_changecount_after(beentry);
 		}
 		return;
@@ -2983,6 +3056,140 @@ pgstat_report_waiting(bool waiting)
 	beentry->st_waiting = waiting;
 }
 
+#ifdef XCP
+/* ----------
+ * pgstat_report_wait_start() -
+ *
+ *	Called when starting to wait on another component of the cluster,
+ *	nodeoid being the node waited on or InvalidOid.  When waits nest, as a
+ *	barrier waiting on remote responses does, the outer one is reported.
+ * ----------
+ */
+void
+pgstat_report_wait_start(WaitEvent event, Oid nodeoid)
+{
+	volatile PgBackendStatus *beentry = MyBEEntry;
+
+	if (MyWaitEvent != WAIT_EVENT_NONE)
+		return;
+
+	MyWaitEvent = event;
+	INSTR_TIME_SET_CURRENT(MyWaitStart);
+
+	if (!pgstat_track_activities || !beentry)
+		return;
+
+	pgstat_increment_changecount_before(beentry);
+	beentry->st_wait_event = event;
+	beentry->st_wait_node = nodeoid;
+	pgstat_increment_changecount_after(beentry);
+}
+
+/* ----------
+ * pgstat_report_wait_end() -
+ *
+ *	Called when the wait started by pgstat_report_wait_start() is over, to
+ *	clear it and add its duration to the histogram of its class.
+ * ----------
+ */
+void
+pgstat_report_wait_end(WaitEvent event)
+{
+	instr_time	duration;
+	int64		usecs;
+	int			bucket;
+
+	if (MyWaitEvent == WAIT_EVENT_NONE || MyWaitEvent != event)
+		return;
+
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, MyWaitStart);
+	usecs = INSTR_TIME_GET_MICROSEC(duration);
+
+	for (bucket = 0; bucket < WAIT_HISTOGRAM_BUCKETS - 1; bucket++)
+		if (usecs < wait_histogram_bounds[bucket])
+			break;
+
+	if (WaitHistograms)
+	{
+		volatile WaitHistogram *hist;
+
+		hist = &WaitHistograms[wait_events[event].wclass];
+		SpinLockAcquire(&hist->mutex);
+		hist->waits++;
+		hist->total_time += usecs;
+		hist->counts[bucket]++;
+		SpinLockRelease(&hist->mutex);
+	}
+
+	pgstat_clear_wait();
+}
+
+/* ----------
+ * pgstat_clear_wait() -
+ *
+ *	Forget the wait in progress without accounting it, when it has been
+ *	interrupted by an error.
+ * ----------
+ */
+void
+pgstat_clear_wait(void)
+{
+	volatile PgBackendStatus *beentry = MyBEEntry;
+
+	MyWaitEvent = WAIT_EVENT_NONE;
+
+	if (!beentry || beentry->st_wait_event == WAIT_EVENT_NONE)
+		return;
+
+	pgstat_increment_changecount_before(beentry);
+	beentry->st_wait_event = WAIT_EVENT_NONE;
+	beentry->st_wait_node = InvalidOid;
+	pgstat_increment_changecount_after(beentry);
+}
+
+/* Name of a wait event, NULL for WAIT_EVENT_NONE */
+const char *
+pgstat_get_wait_event(WaitEvent event)
+{
+	return wait_events[event].name;
+}
+
+WaitClass
+pgstat_get_wait_event_class(WaitEvent event)
+{
+	return wait_events[event].wclass;
+}
+
+const char *
+pgstat_get_wait_class(WaitClass wclass)
+{
+	return wait_class_names[wclass];
+}
+
+/* ----------
+ * pgstat_fetch_wait_histogram() -
+ *
+ *	Copy the histogram of a wait class: the number of waits, their total
+ *	duration in microseconds, and the count of waits in each bucket.
+ * ----------
+ */
+void
+pgstat_fetch_wait_histogram(WaitClass wclass, int64 *waits,
+							int64 *total_time, int64 *counts)
+{
+	volatile WaitHistogram *hist = &WaitHistograms[wclass];
+	int			i;
+
+	SpinLockAcquire(&hist->mutex);
+	*waits = hist->waits;
+	*total_time = hist->total_time;
+	for (i = 0; i < WAIT_HISTOGRAM_BUCKETS; i++)
+		counts[i] = hist->counts[i];
+	SpinLockRelease(&hist->mutex);
+}
+#endif
+
 
 /* ----------
  * pgstat_read_current_status() -
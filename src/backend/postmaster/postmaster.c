@@ -1776,8 +1776,12 @@ ServerLoop(void)
 			PgStatPID = pgstat_start();
 
 #ifdef PGXC
-		/* If we have lost the pooler, try to start a new one */
-		if (PgPoolerPID == 0 && pmState == PM_RUN)
+		/*
+		 * If we have lost the pooler, try to start a new one. The sessions
+		 * of a hot standby Coordinator need it as well.
+		 */
+		if (PgPoolerPID == 0 &&
+			(pmState == PM_RUN || pmState == PM_HOT_STANDBY))
 			PgPoolerPID = StartPoolManager();
 #endif /* PGXC */
 
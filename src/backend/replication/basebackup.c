@@ -16,6 +16,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <time.h>
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
 
 #include "access/xlog_internal.h"		/* for pg_start/stop_backup */
 #include "catalog/catalog.h"
@@ -34,6 +37,7 @@
 #include "storage/ipc.h"
 #include "utils/builtins.h"
 #include "utils/elog.h"
+#include "utils/memutils.h"
 #include "utils/ps_status.h"
 #include "utils/timestamp.h"
 
@@ -47,8 +51,40 @@ typedef struct
 	bool		includewal;
 	uint32		maxrate;
 	bool		sendtblspcmapfile;
+	bool		parallel;
 } basebackup_options;
 
+typedef struct
+{
+	Oid			tablespace;		/* InvalidOid for the data directory */
+	uint32		maxrate;
+	int			compresslevel;
+} sendfiles_options;
+
+/* A regular file of a parallel backup, to be fetched with SEND_FILES */
+typedef struct
+{
+	char	   *spcoid;			/* tablespace OID, or NULL for PGDATA */
+	char	   *path;			/* relative to the tablespace or PGDATA */
+	int64		size;
+} backupfileinfo;
+
+/*
+ * The parallel backup in progress in this session, between BASE_BACKUP
+ * PARALLEL and STOP_BACKUP. Its start position is also published in the
+ * WalSnd of the session, which SEND_FILES checks.
+ */
+typedef struct
+{
+	bool		active;
+	basebackup_options opt;
+	XLogRecPtr	startptr;
+	TimeLineID	starttli;
+	char	   *labelfile;
+	char	   *tblspc_map_file;
+	MemoryContext context;		/* holds the above */
+} parallel_backup_state;
+
 
 static int64 sendDir(char *path, int basepathlen, bool sizeonly,
 		List *tablespaces, bool sendtblspclinks);
@@ -61,10 +97,22 @@ static void send_int8_string(StringInfoData *buf, int64 intval);
 static void SendBackupHeader(List *tablespaces);
 static void base_backup_cleanup(int code, Datum arg);
 static void perform_base_backup(basebackup_options *opt, DIR *tblspcdir);
+static void perform_parallel_base_backup(basebackup_options *opt,
+							 DIR *tblspcdir);
+static void parallel_backup_cleanup(int code, Datum arg);
+static void parallel_backup_reset(void);
+static bool parallel_backup_in_progress(XLogRecPtr startptr);
+static void SendBackupFileList(List *files);
+static void send_wal_files(XLogRecPtr startptr, XLogRecPtr endptr);
+static void set_statrelpath(void);
 static void parse_basebackup_options(List *options, basebackup_options *opt);
+static void parse_sendfiles_options(List *options, sendfiles_options *opt);
 static void SendXlogRecPtrResult(XLogRecPtr ptr, TimeLineID tli);
 static int	compareWalFileNames(const void *a, const void *b);
+static void setup_throttle(uint32 maxrate);
 static void throttle(size_t increment);
+static void setup_compression(int level);
+static int	send_data(const char *data, size_t len);
 
 /* Was the backup currently in-progress initiated in recovery mode? */
 static bool backup_started_in_recovery = false;
@@ -72,6 +120,23 @@ static bool backup_started_in_recovery = false;
 /* Relative path of temporary statistics directory */
 static char *statrelpath = NULL;
 
+static parallel_backup_state parallel_backup;
+static bool parallel_backup_exit_registered = false;
+
+/*
+ * While sending the layout of a parallel backup, sendDir collects the
+ * regular files in collected_files instead of sending them.
+ */
+static bool collect_files = false;
+static char *collect_spcoid = NULL;
+static List *collected_files = NIL;
+
+#ifdef HAVE_LIBZ
+/* Compression of the data sent by SEND_FILES, if requested */
+static z_stream *compress_stream = NULL;
+static StringInfoData compress_buf;
+#endif
+
 /*
  * Size of each block sent into the tar stream for larger files.
  */
@@ -104,6 +169,24 @@ base_backup_cleanup(int code, Datum arg)
 	do_pg_abort_backup();
 }
 
+/*
+ * Calculate the relative path of temporary statistics directory in order to
+ * skip the files which are located in that directory later.
+ */
+static void
+set_statrelpath(void)
+{
+	int			datadirpathlen = strlen(DataDir);
+
+	if (is_absolute_path(pgstat_stat_directory) &&
+		strncmp(pgstat_stat_directory, DataDir, datadirpathlen) == 0)
+		statrelpath = psprintf("./%s", pgstat_stat_directory + datadirpathlen + 1);
+	else if (strncmp(pgstat_stat_directory, "./", 2) != 0)
+		statrelpath = psprintf("./%s", pgstat_stat_directory);
+	else
+		statrelpath = pgstat_stat_directory;
+}
+
 /*
  * Actually do a base backup for the specified tablespaces.
  *
@@ -119,10 +202,13 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 	TimeLineID	endtli;
 	char	   *labelfile;
 	char	   *tblspc_map_file = NULL;
-	int			datadirpathlen;
 	List	   *tablespaces = NIL;
 
-	datadirpathlen = strlen(DataDir);
+	if (opt->parallel)
+	{
+		perform_parallel_base_backup(opt, tblspcdir);
+		return;
+	}
 
 	backup_started_in_recovery = RecoveryInProgress();
 
@@ -145,17 +231,7 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 
 		SendXlogRecPtrResult(startptr, starttli);
 
-		/*
-		 * Calculate the relative path of temporary statistics directory in
-		 * order to skip the files which are located in that directory later.
-		 */
-		if (is_absolute_path(pgstat_stat_directory) &&
-			strncmp(pgstat_stat_directory, DataDir, datadirpathlen) == 0)
-			statrelpath = psprintf("./%s", pgstat_stat_directory + datadirpathlen + 1);
-		else if (strncmp(pgstat_stat_directory, "./", 2) != 0)
-			statrelpath = psprintf("./%s", pgstat_stat_directory);
-		else
-			statrelpath = pgstat_stat_directory;
+		set_statrelpath();
 
 		/* Add a node for the base directory at the end */
 		ti = palloc0(sizeof(tablespaceinfo));
@@ -166,28 +242,7 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 		SendBackupHeader(tablespaces);
 
 		/* Setup and activate network throttling, if client requested it */
-		if (opt->maxrate > 0)
-		{
-			throttling_sample =
-				(int64) opt->maxrate * (int64) 1024 / THROTTLING_FREQUENCY;
-
-			/*
-			 * The minimum amount of time for throttling_sample bytes to be
-			 * transferred.
-			 */
-			elapsed_min_unit = USECS_PER_SEC / THROTTLING_FREQUENCY;
-
-			/* Enable throttling. */
-			throttling_counter = 0;
-
-			/* The 'real data' starts now (header was ignored). */
-			throttled_last = GetCurrentIntegerTimestamp();
-		}
-		else
-		{
-			/* Disable throttling. */
-			throttling_counter = -1;
-		}
+		setup_throttle(opt->maxrate);
 
 		/* Send off our tablespaces one by one */
 		foreach(lc, tablespaces)
@@ -255,232 +310,625 @@ perform_base_backup(basebackup_options *opt, DIR *tblspcdir)
 		 * We've left the last tar file "open", so we can now append the
 		 * required WAL files to it.
 		 */
-		char		pathbuf[MAXPGPATH];
-		XLogSegNo	segno;
-		XLogSegNo	startsegno;
-		XLogSegNo	endsegno;
-		struct stat statbuf;
-		List	   *historyFileList = NIL;
-		List	   *walFileList = NIL;
-		char	  **walFiles;
-		int			nWalFiles;
-		char		firstoff[MAXFNAMELEN];
-		char		lastoff[MAXFNAMELEN];
-		DIR		   *dir;
-		struct dirent *de;
-		int			i;
-		ListCell   *lc;
-		TimeLineID	tli;
+		send_wal_files(startptr, endptr);
 
-		/*
-		 * I'd rather not worry about timelines here, so scan pg_xlog and
-		 * include all WAL files in the range between 'startptr' and 'endptr',
-		 * regardless of the timeline the file is stamped with. If there are
-		 * some spurious WAL files belonging to timelines that don't belong in
-		 * this server's history, they will be included too. Normally there
-		 * shouldn't be such files, but if there are, there's little harm in
-		 * including them.
-		 */
-		XLByteToSeg(startptr, startsegno);
-		XLogFileName(firstoff, ThisTimeLineID, startsegno);
-		XLByteToPrevSeg(endptr, endsegno);
-		XLogFileName(lastoff, ThisTimeLineID, endsegno);
+		/* Send CopyDone message for the last tar file */
+		pq_putemptymessage('c');
+	}
+	SendXlogRecPtrResult(endptr, endtli);
+}
 
-		dir = AllocateDir("pg_xlog");
-		if (!dir)
-			ereport(ERROR,
-				 (errmsg("could not open directory \"%s\": %m", "pg_xlog")));
-		while ((de = ReadDir(dir, "pg_xlog")) != NULL)
+/*
+ * Append the WAL files needed to make the backup consistent, from startptr
+ * to endptr, to the current tar stream.
+ */
+static void
+send_wal_files(XLogRecPtr startptr, XLogRecPtr endptr)
+{
+	char		pathbuf[MAXPGPATH];
+	XLogSegNo	segno;
+	XLogSegNo	startsegno;
+	XLogSegNo	endsegno;
+	struct stat statbuf;
+	List	   *historyFileList = NIL;
+	List	   *walFileList = NIL;
+	char	  **walFiles;
+	int			nWalFiles;
+	char		firstoff[MAXFNAMELEN];
+	char		lastoff[MAXFNAMELEN];
+	DIR		   *dir;
+	struct dirent *de;
+	int			i;
+	ListCell   *lc;
+	TimeLineID	tli;
+
+	/*
+	 * I'd rather not worry about timelines here, so scan pg_xlog and
+	 * include all WAL files in the range between 'startptr' and 'endptr',
+	 * regardless of the timeline the file is stamped with. If there are
+	 * some spurious WAL files belonging to timelines that don't belong in
+	 * this server's history, they will be included too. Normally there
+	 * shouldn't be such files, but if there are, there's little harm in
+	 * including them.
+	 */
+	XLByteToSeg(startptr, startsegno);
+	XLogFileName(firstoff, ThisTimeLineID, startsegno);
+	XLByteToPrevSeg(endptr, endsegno);
+	XLogFileName(lastoff, ThisTimeLineID, endsegno);
+
+	dir = AllocateDir("pg_xlog");
+	if (!dir)
+		ereport(ERROR,
+			 (errmsg("could not open directory \"%s\": %m", "pg_xlog")));
+	while ((de = ReadDir(dir, "pg_xlog")) != NULL)
+	{
+		/* Does it look like a WAL segment, and is it in the range? */
+		if (IsXLogFileName(de->d_name) &&
+			strcmp(de->d_name + 8, firstoff + 8) >= 0 &&
+			strcmp(de->d_name + 8, lastoff + 8) <= 0)
 		{
-			/* Does it look like a WAL segment, and is it in the range? */
-			if (IsXLogFileName(de->d_name) &&
-				strcmp(de->d_name + 8, firstoff + 8) >= 0 &&
-				strcmp(de->d_name + 8, lastoff + 8) <= 0)
-			{
-				walFileList = lappend(walFileList, pstrdup(de->d_name));
-			}
-			/* Does it look like a timeline history file? */
-			else if (IsTLHistoryFileName(de->d_name))
-			{
-				historyFileList = lappend(historyFileList, pstrdup(de->d_name));
-			}
+			walFileList = lappend(walFileList, pstrdup(de->d_name));
 		}
-		FreeDir(dir);
+		/* Does it look like a timeline history file? */
+		else if (IsTLHistoryFileName(de->d_name))
+		{
+			historyFileList = lappend(historyFileList, pstrdup(de->d_name));
+		}
+	}
+	FreeDir(dir);
 
-		/*
-		 * Before we go any further, check that none of the WAL segments we
-		 * need were removed.
-		 */
-		CheckXLogRemoved(startsegno, ThisTimeLineID);
+	/*
+	 * Before we go any further, check that none of the WAL segments we
+	 * need were removed.
+	 */
+	CheckXLogRemoved(startsegno, ThisTimeLineID);
 
-		/*
-		 * Put the WAL filenames into an array, and sort. We send the files in
-		 * order from oldest to newest, to reduce the chance that a file is
-		 * recycled before we get a chance to send it over.
-		 */
-		nWalFiles = list_length(walFileList);
-		walFiles = palloc(nWalFiles * sizeof(char *));
-		i = 0;
-		foreach(lc, walFileList)
+	/*
+	 * Put the WAL filenames into an array, and sort. We send the files in
+	 * order from oldest to newest, to reduce the chance that a file is
+	 * recycled before we get a chance to send it over.
+	 */
+	nWalFiles = list_length(walFileList);
+	walFiles = palloc(nWalFiles * sizeof(char *));
+	i = 0;
+	foreach(lc, walFileList)
+	{
+		walFiles[i++] = lfirst(lc);
+	}
+	qsort(walFiles, nWalFiles, sizeof(char *), compareWalFileNames);
+
+	/*
+	 * There must be at least one xlog file in the pg_xlog directory,
+	 * since we are doing backup-including-xlog.
+	 */
+	if (nWalFiles < 1)
+		ereport(ERROR,
+				(errmsg("could not find any WAL files")));
+
+	/*
+	 * Sanity check: the first and last segment should cover startptr and
+	 * endptr, with no gaps in between.
+	 */
+	XLogFromFileName(walFiles[0], &tli, &segno);
+	if (segno != startsegno)
+	{
+		char		startfname[MAXFNAMELEN];
+
+		XLogFileName(startfname, ThisTimeLineID, startsegno);
+		ereport(ERROR,
+				(errmsg("could not find WAL file \"%s\"", startfname)));
+	}
+	for (i = 0; i < nWalFiles; i++)
+	{
+		XLogSegNo	currsegno = segno;
+		XLogSegNo	nextsegno = segno + 1;
+
+		XLogFromFileName(walFiles[i], &tli, &segno);
+		if (!(nextsegno == segno || currsegno == segno))
 		{
-			walFiles[i++] = lfirst(lc);
-		}
-		qsort(walFiles, nWalFiles, sizeof(char *), compareWalFileNames);
+			char		nextfname[MAXFNAMELEN];
 
-		/*
-		 * There must be at least one xlog file in the pg_xlog directory,
-		 * since we are doing backup-including-xlog.
-		 */
-		if (nWalFiles < 1)
+			XLogFileName(nextfname, ThisTimeLineID, nextsegno);
 			ereport(ERROR,
-					(errmsg("could not find any WAL files")));
+				  (errmsg("could not find WAL file \"%s\"", nextfname)));
+		}
+	}
+	if (segno != endsegno)
+	{
+		char		endfname[MAXFNAMELEN];
 
-		/*
-		 * Sanity check: the first and last segment should cover startptr and
-		 * endptr, with no gaps in between.
-		 */
-		XLogFromFileName(walFiles[0], &tli, &segno);
-		if (segno != startsegno)
+		XLogFileName(endfname, ThisTimeLineID, endsegno);
+		ereport(ERROR,
+				(errmsg("could not find WAL file \"%s\"", endfname)));
+	}
+
+	/* Ok, we have everything we need. Send the WAL files. */
+	for (i = 0; i < nWalFiles; i++)
+	{
+		FILE	   *fp;
+		char		buf[TAR_SEND_SIZE];
+		size_t		cnt;
+		pgoff_t		len = 0;
+
+		snprintf(pathbuf, MAXPGPATH, XLOGDIR "/%s", walFiles[i]);
+		XLogFromFileName(walFiles[i], &tli, &segno);
+
+		fp = AllocateFile(pathbuf, "rb");
+		if (fp == NULL)
 		{
-			char		startfname[MAXFNAMELEN];
+			/*
+			 * Most likely reason for this is that the file was already
+			 * removed by a checkpoint, so check for that to get a better
+			 * error message.
+			 */
+			CheckXLogRemoved(segno, tli);
 
-			XLogFileName(startfname, ThisTimeLineID, startsegno);
 			ereport(ERROR,
-					(errmsg("could not find WAL file \"%s\"", startfname)));
+					(errcode_for_file_access(),
+					 errmsg("could not open file \"%s\": %m", pathbuf)));
 		}
-		for (i = 0; i < nWalFiles; i++)
+
+		if (fstat(fileno(fp), &statbuf) != 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not stat file \"%s\": %m",
+							pathbuf)));
+		if (statbuf.st_size != XLogSegSize)
 		{
-			XLogSegNo	currsegno = segno;
-			XLogSegNo	nextsegno = segno + 1;
+			CheckXLogRemoved(segno, tli);
+			ereport(ERROR,
+					(errcode_for_file_access(),
+				errmsg("unexpected WAL file size \"%s\"", walFiles[i])));
+		}
 
-			XLogFromFileName(walFiles[i], &tli, &segno);
-			if (!(nextsegno == segno || currsegno == segno))
-			{
-				char		nextfname[MAXFNAMELEN];
+		/* send the WAL file itself */
+		_tarWriteHeader(pathbuf, NULL, &statbuf);
 
-				XLogFileName(nextfname, ThisTimeLineID, nextsegno);
+		while ((cnt = fread(buf, 1, Min(sizeof(buf), XLogSegSize - len), fp)) > 0)
+		{
+			CheckXLogRemoved(segno, tli);
+			/* Send the chunk as a CopyData message */
+			if (send_data(buf, cnt))
 				ereport(ERROR,
-					  (errmsg("could not find WAL file \"%s\"", nextfname)));
-			}
+						(errmsg("base backup could not send data, aborting backup")));
+
+			len += cnt;
+			throttle(cnt);
+
+			if (len == XLogSegSize)
+				break;
 		}
-		if (segno != endsegno)
-		{
-			char		endfname[MAXFNAMELEN];
 
-			XLogFileName(endfname, ThisTimeLineID, endsegno);
+		if (len != XLogSegSize)
+		{
+			CheckXLogRemoved(segno, tli);
 			ereport(ERROR,
-					(errmsg("could not find WAL file \"%s\"", endfname)));
+					(errcode_for_file_access(),
+				errmsg("unexpected WAL file size \"%s\"", walFiles[i])));
 		}
 
-		/* Ok, we have everything we need. Send the WAL files. */
-		for (i = 0; i < nWalFiles; i++)
-		{
-			FILE	   *fp;
-			char		buf[TAR_SEND_SIZE];
-			size_t		cnt;
-			pgoff_t		len = 0;
+		/* XLogSegSize is a multiple of 512, so no need for padding */
 
-			snprintf(pathbuf, MAXPGPATH, XLOGDIR "/%s", walFiles[i]);
-			XLogFromFileName(walFiles[i], &tli, &segno);
+		FreeFile(fp);
 
-			fp = AllocateFile(pathbuf, "rb");
-			if (fp == NULL)
-			{
-				/*
-				 * Most likely reason for this is that the file was already
-				 * removed by a checkpoint, so check for that to get a better
-				 * error message.
-				 */
-				CheckXLogRemoved(segno, tli);
+		/*
+		 * Mark file as archived, otherwise files can get archived again
+		 * after promotion of a new node. This is in line with
+		 * walreceiver.c always doing an XLogArchiveForceDone() after a
+		 * complete segment.
+		 */
+		StatusFilePath(pathbuf, walFiles[i], ".done");
+		sendFileWithContent(pathbuf, "");
+	}
 
-				ereport(ERROR,
-						(errcode_for_file_access(),
-						 errmsg("could not open file \"%s\": %m", pathbuf)));
-			}
+	/*
+	 * Send timeline history files too. Only the latest timeline history
+	 * file is required for recovery, and even that only if there happens
+	 * to be a timeline switch in the first WAL segment that contains the
+	 * checkpoint record, or if we're taking a base backup from a standby
+	 * server and the target timeline changes while the backup is taken.
+	 * But they are small and highly useful for debugging purposes, so
+	 * better include them all, always.
+	 */
+	foreach(lc, historyFileList)
+	{
+		char	   *fname = lfirst(lc);
 
-			if (fstat(fileno(fp), &statbuf) != 0)
-				ereport(ERROR,
-						(errcode_for_file_access(),
-						 errmsg("could not stat file \"%s\": %m",
-								pathbuf)));
-			if (statbuf.st_size != XLogSegSize)
-			{
-				CheckXLogRemoved(segno, tli);
-				ereport(ERROR,
-						(errcode_for_file_access(),
-					errmsg("unexpected WAL file size \"%s\"", walFiles[i])));
-			}
+		snprintf(pathbuf, MAXPGPATH, XLOGDIR "/%s", fname);
 
-			/* send the WAL file itself */
-			_tarWriteHeader(pathbuf, NULL, &statbuf);
+		if (lstat(pathbuf, &statbuf) != 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not stat file \"%s\": %m", pathbuf)));
 
-			while ((cnt = fread(buf, 1, Min(sizeof(buf), XLogSegSize - len), fp)) > 0)
-			{
-				CheckXLogRemoved(segno, tli);
-				/* Send the chunk as a CopyData message */
-				if (pq_putmessage('d', buf, cnt))
-					ereport(ERROR,
-							(errmsg("base backup could not send data, aborting backup")));
+		sendFile(pathbuf, pathbuf, &statbuf, false);
 
-				len += cnt;
-				throttle(cnt);
+		/* unconditionally mark file as archived */
+		StatusFilePath(pathbuf, fname, ".done");
+		sendFileWithContent(pathbuf, "");
+	}
+}
 
-				if (len == XLogSegSize)
-					break;
-			}
+/*
+ * Start a parallel base backup: send the start position, the tablespaces,
+ * a tar stream for each of them with the directories and symbolic links but
+ * no regular file, and the list of the regular files. The backup is left in
+ * progress until STOP_BACKUP, and the files are fetched in the meantime by
+ * SEND_FILES, possibly on several connections at once.
+ */
+static void
+perform_parallel_base_backup(basebackup_options *opt, DIR *tblspcdir)
+{
+	List	   *tablespaces = NIL;
+	MemoryContext oldcontext;
 
-			if (len != XLogSegSize)
-			{
-				CheckXLogRemoved(segno, tli);
-				ereport(ERROR,
-						(errcode_for_file_access(),
-					errmsg("unexpected WAL file size \"%s\"", walFiles[i])));
-			}
+	if (parallel_backup.active)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("a parallel base backup is already in progress in this session"),
+				 errhint("Run STOP_BACKUP first.")));
 
-			/* XLogSegSize is a multiple of 512, so no need for padding */
+	/* Abort the backup if the session ends before STOP_BACKUP */
+	if (!parallel_backup_exit_registered)
+	{
+		before_shmem_exit(parallel_backup_cleanup, (Datum) 0);
+		parallel_backup_exit_registered = true;
+	}
 
-			FreeFile(fp);
+	backup_started_in_recovery = RecoveryInProgress();
 
-			/*
-			 * Mark file as archived, otherwise files can get archived again
-			 * after promotion of a new node. This is in line with
-			 * walreceiver.c always doing an XLogArchiveForceDone() after a
-			 * complete segment.
-			 */
-			StatusFilePath(pathbuf, walFiles[i], ".done");
-			sendFileWithContent(pathbuf, "");
+	/* What STOP_BACKUP needs must outlive this command */
+	if (parallel_backup.context)
+		MemoryContextDelete(parallel_backup.context);
+	parallel_backup.context = AllocSetContextCreate(TopMemoryContext,
+													"parallel base backup",
+													ALLOCSET_SMALL_MINSIZE,
+													ALLOCSET_SMALL_INITSIZE,
+													ALLOCSET_SMALL_MAXSIZE);
+	oldcontext = MemoryContextSwitchTo(parallel_backup.context);
+	parallel_backup.opt = *opt;
+	parallel_backup.opt.label = pstrdup(opt->label);
+	parallel_backup.tblspc_map_file = NULL;
+	parallel_backup.startptr =
+		do_pg_start_backup(opt->label, opt->fastcheckpoint,
+						   &parallel_backup.starttli,
+						   &parallel_backup.labelfile, tblspcdir,
+						   &tablespaces, &parallel_backup.tblspc_map_file,
+						   opt->progress, opt->sendtblspcmapfile);
+	MemoryContextSwitchTo(oldcontext);
+	parallel_backup.active = true;
+
+	PG_ENSURE_ERROR_CLEANUP(parallel_backup_cleanup, (Datum) 0);
+	{
+		volatile WalSnd *walsnd = MyWalSnd;
+		ListCell   *lc;
+		tablespaceinfo *ti;
+
+		/* Let the other sessions fetch files for this backup */
+		SpinLockAcquire(&walsnd->mutex);
+		walsnd->backupStart = parallel_backup.startptr;
+		SpinLockRelease(&walsnd->mutex);
+
+		SendXlogRecPtrResult(parallel_backup.startptr,
+							 parallel_backup.starttli);
+
+		set_statrelpath();
+
+		/* Add a node for the base directory at the end */
+		ti = palloc0(sizeof(tablespaceinfo));
+		ti->size = opt->progress ? sendDir(".", 1, true, tablespaces, true) : -1;
+		tablespaces = lappend(tablespaces, ti);
+
+		SendBackupHeader(tablespaces);
+
+		setup_throttle(0);
+
+		/* Send the layout of the tablespaces, collecting their files */
+		collected_files = NIL;
+		collect_files = true;
+		foreach(lc, tablespaces)
+		{
+			StringInfoData buf;
+
+			ti = (tablespaceinfo *) lfirst(lc);
+
+			/* Send CopyOutResponse message */
+			pq_beginmessage(&buf, 'H');
+			pq_sendbyte(&buf, 0);		/* overall format */
+			pq_sendint(&buf, 0, 2);		/* natts */
+			pq_endmessage(&buf);
+
+			collect_spcoid = ti->oid;
+			if (ti->path == NULL)
+				sendDir(".", 1, false, tablespaces,
+						!(parallel_backup.tblspc_map_file &&
+						  opt->sendtblspcmapfile));
+			else
+				sendTablespace(ti->path, false);
+
+			pq_putemptymessage('c');	/* CopyDone */
 		}
+		collect_files = false;
 
-		/*
-		 * Send timeline history files too. Only the latest timeline history
-		 * file is required for recovery, and even that only if there happens
-		 * to be a timeline switch in the first WAL segment that contains the
-		 * checkpoint record, or if we're taking a base backup from a standby
-		 * server and the target timeline changes while the backup is taken.
-		 * But they are small and highly useful for debugging purposes, so
-		 * better include them all, always.
-		 */
-		foreach(lc, historyFileList)
+		SendBackupFileList(collected_files);
+		collected_files = NIL;
+	}
+	PG_END_ENSURE_ERROR_CLEANUP(parallel_backup_cleanup, (Datum) 0);
+}
+
+/*
+ * Abort the parallel backup in progress in this session, if any, on error
+ * or at exit.
+ */
+static void
+parallel_backup_cleanup(int code, Datum arg)
+{
+	collect_files = false;
+	if (!parallel_backup.active)
+		return;
+
+	do_pg_abort_backup();
+	parallel_backup_reset();
+}
+
+/*
+ * Forget the parallel backup of this session once it has been stopped or
+ * aborted.
+ */
+static void
+parallel_backup_reset(void)
+{
+	volatile WalSnd *walsnd = MyWalSnd;
+
+	if (walsnd != NULL)
+	{
+		SpinLockAcquire(&walsnd->mutex);
+		walsnd->backupStart = InvalidXLogRecPtr;
+		SpinLockRelease(&walsnd->mutex);
+	}
+
+	parallel_backup.active = false;
+	if (parallel_backup.context)
+		MemoryContextDelete(parallel_backup.context);
+	parallel_backup.context = NULL;
+	parallel_backup.labelfile = NULL;
+	parallel_backup.tblspc_map_file = NULL;
+}
+
+/*
+ * Is a parallel backup started at startptr in progress in any session?
+ */
+static bool
+parallel_backup_in_progress(XLogRecPtr startptr)
+{
+	int			i;
+
+	for (i = 0; i < max_wal_senders; i++)
+	{
+		/* use volatile pointer to prevent code rearrangement */
+		volatile WalSnd *walsnd = &WalSndCtl->walsnds[i];
+		XLogRecPtr	backupStart;
+
+		SpinLockAcquire(&walsnd->mutex);
+		backupStart = walsnd->pid != 0 ? walsnd->backupStart : InvalidXLogRecPtr;
+		SpinLockRelease(&walsnd->mutex);
+
+		if (!XLogRecPtrIsInvalid(backupStart) && backupStart == startptr)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Send the regular files found by a parallel backup, as a result set with
+ * the OID of their tablespace, NULL for the data directory, their path
+ * relative to it, as given to SEND_FILES, and their size.
+ */
+static void
+SendBackupFileList(List *files)
+{
+	StringInfoData buf;
+	ListCell   *lc;
+
+	pq_beginmessage(&buf, 'T'); /* RowDescription */
+	pq_sendint(&buf, 3, 2);		/* 3 fields */
+
+	pq_sendstring(&buf, "spcoid");
+	pq_sendint(&buf, 0, 4);		/* table oid */
+	pq_sendint(&buf, 0, 2);		/* attnum */
+	pq_sendint(&buf, OIDOID, 4);	/* type oid */
+	pq_sendint(&buf, 4, 2);		/* typlen */
+	pq_sendint(&buf, 0, 4);		/* typmod */
+	pq_sendint(&buf, 0, 2);		/* format code */
+
+	pq_sendstring(&buf, "path");
+	pq_sendint(&buf, 0, 4);
+	pq_sendint(&buf, 0, 2);
+	pq_sendint(&buf, TEXTOID, 4);
+	pq_sendint(&buf, -1, 2);
+	pq_sendint(&buf, 0, 4);
+	pq_sendint(&buf, 0, 2);
+
+	pq_sendstring(&buf, "size");
+	pq_sendint(&buf, 0, 4);
+	pq_sendint(&buf, 0, 2);
+	pq_sendint(&buf, INT8OID, 4);
+	pq_sendint(&buf, 8, 2);
+	pq_sendint(&buf, 0, 4);
+	pq_sendint(&buf, 0, 2);
+	pq_endmessage(&buf);
+
+	foreach(lc, files)
+	{
+		backupfileinfo *fi = lfirst(lc);
+
+		pq_beginmessage(&buf, 'D');
+		pq_sendint(&buf, 3, 2); /* number of columns */
+		if (fi->spcoid == NULL)
+			pq_sendint(&buf, -1, 4);	/* Length = -1 ==> NULL */
+		else
 		{
-			char	   *fname = lfirst(lc);
+			pq_sendint(&buf, strlen(fi->spcoid), 4);
+			pq_sendbytes(&buf, fi->spcoid, strlen(fi->spcoid));
+		}
+		pq_sendint(&buf, strlen(fi->path), 4);
+		pq_sendbytes(&buf, fi->path, strlen(fi->path));
+		send_int8_string(&buf, fi->size);
+		pq_endmessage(&buf);
+	}
 
-			snprintf(pathbuf, MAXPGPATH, XLOGDIR "/%s", fname);
+	/* Send a CommandComplete message */
+	pq_puttextmessage('C', "SELECT");
+}
+
+/*
+ * SendBackupFiles() - send files for a parallel base backup.
+ *
+ * The files are sent as one tar stream, with the paths given, which are
+ * relative to the data directory or, with the TABLESPACE option, to the
+ * location of the tablespace. Files removed since they were listed are
+ * skipped.
+ */
+void
+SendBackupFiles(SendFilesCmd *cmd)
+{
+	sendfiles_options opt;
+	char		prefix[MAXPGPATH];
+	StringInfoData buf;
+	ListCell   *lc;
+
+	parse_sendfiles_options(cmd->options, &opt);
+
+	if (list_length(cmd->files) > SEND_FILES_MAX)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("cannot send more than %d files at once",
+						SEND_FILES_MAX)));
+
+	/*
+	 * The files are only consistent if read while the backup is in
+	 * progress, until the backup is stopped.
+	 */
+	if (!parallel_backup_in_progress(cmd->startpoint))
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("no parallel base backup started at %X/%X is in progress",
+						(uint32) (cmd->startpoint >> 32),
+						(uint32) cmd->startpoint)));
+
+	WalSndSetState(WALSNDSTATE_BACKUP);
+
+	if (OidIsValid(opt.tablespace))
+		snprintf(prefix, sizeof(prefix), "pg_tblspc/%u/", opt.tablespace);
+	else
+		prefix[0] = '\0';
+
+	setup_throttle(opt.maxrate);
+	setup_compression(opt.compresslevel);
+
+	/* Send CopyOutResponse message */
+	pq_beginmessage(&buf, 'H');
+	pq_sendbyte(&buf, 0);		/* overall format */
+	pq_sendint(&buf, 0, 2);		/* natts */
+	pq_endmessage(&buf);
+
+	foreach(lc, cmd->files)
+	{
+		char	   *path = strVal(lfirst(lc));
+		char		pathbuf[MAXPGPATH];
+		struct stat statbuf;
+
+		CHECK_FOR_INTERRUPTS();
 
-			if (lstat(pathbuf, &statbuf) != 0)
+		if (!path_is_relative_and_below_cwd(path))
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+					 errmsg("path \"%s\" is not a relative path below the data directory or the tablespace",
+							path)));
+
+		snprintf(pathbuf, sizeof(pathbuf), "%s%s", prefix, path);
+		if (lstat(pathbuf, &statbuf) != 0)
+		{
+			if (errno != ENOENT)
 				ereport(ERROR,
 						(errcode_for_file_access(),
 						 errmsg("could not stat file \"%s\": %m", pathbuf)));
 
-			sendFile(pathbuf, pathbuf, &statbuf, false);
-
-			/* unconditionally mark file as archived */
-			StatusFilePath(pathbuf, fname, ".done");
-			sendFileWithContent(pathbuf, "");
+			/* If the file went away since it was listed, it's no error. */
+			continue;
 		}
+		if (!S_ISREG(statbuf.st_mode))
+			ereport(ERROR,
+					(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+					 errmsg("\"%s\" is not a regular file", pathbuf)));
 
-		/* Send CopyDone message for the last tar file */
-		pq_putemptymessage('c');
+		sendFile(pathbuf, path, &statbuf, true);
+	}
+
+	setup_compression(0);
+	pq_putemptymessage('c');	/* CopyDone */
+}
+
+/*
+ * StopBaseBackup() - stop the parallel base backup of this session.
+ *
+ * Sends a tar stream for the data directory with the backup_label, the
+ * tablespace_map if requested, pg_control and the WAL files if requested,
+ * and then the end position of the backup.
+ */
+void
+StopBaseBackup(StopBackupCmd *cmd)
+{
+	XLogRecPtr	startptr;
+	XLogRecPtr	endptr;
+	TimeLineID	endtli;
+	basebackup_options opt;
+	StringInfoData buf;
+
+	if (!parallel_backup.active)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("no parallel base backup is in progress in this session")));
+
+	WalSndSetState(WALSNDSTATE_BACKUP);
+
+	startptr = parallel_backup.startptr;
+	opt = parallel_backup.opt;
+	setup_throttle(opt.maxrate);
+
+	PG_ENSURE_ERROR_CLEANUP(parallel_backup_cleanup, (Datum) 0);
+	{
+		struct stat statbuf;
+
+		/* Send CopyOutResponse message */
+		pq_beginmessage(&buf, 'H');
+		pq_sendbyte(&buf, 0);		/* overall format */
+		pq_sendint(&buf, 0, 2);		/* natts */
+		pq_endmessage(&buf);
+
+		sendFileWithContent(BACKUP_LABEL_FILE, parallel_backup.labelfile);
+		if (parallel_backup.tblspc_map_file && opt.sendtblspcmapfile)
+			sendFileWithContent(TABLESPACE_MAP,
+								parallel_backup.tblspc_map_file);
+
+		/* pg_control is copied last, as in a complete base backup */
+		if (lstat(XLOG_CONTROL_FILE, &statbuf) != 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not stat control file \"%s\": %m",
+							XLOG_CONTROL_FILE)));
+		sendFile(XLOG_CONTROL_FILE, XLOG_CONTROL_FILE, &statbuf, false);
 	}
+	PG_END_ENSURE_ERROR_CLEANUP(parallel_backup_cleanup, (Datum) 0);
+
+	endptr = do_pg_stop_backup(parallel_backup.labelfile, !opt.nowait,
+							   &endtli);
+	parallel_backup_reset();
+
+	if (opt.includewal)
+		send_wal_files(startptr, endptr);
+	pq_putemptymessage('c');	/* CopyDone */
+
 	SendXlogRecPtrResult(endptr, endtli);
 }
 
@@ -511,6 +959,7 @@ parse_basebackup_options(List *options, basebackup_options *opt)
 	bool		o_wal = false;
 	bool		o_maxrate = false;
 	bool		o_tablespace_map = false;
+	bool		o_parallel = false;
 
 	MemSet(opt, 0, sizeof(*opt));
 	foreach(lopt, options)
@@ -590,6 +1039,15 @@ parse_basebackup_options(List *options, basebackup_options *opt)
 			opt->sendtblspcmapfile = true;
 			o_tablespace_map = true;
 		}
+		else if (strcmp(defel->defname, "parallel") == 0)
+		{
+			if (o_parallel)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("duplicate option \"%s\"", defel->defname)));
+			opt->parallel = true;
+			o_parallel = true;
+		}
 		else
 			elog(ERROR, "option \"%s\" not recognized",
 				 defel->defname);
@@ -598,6 +1056,81 @@ parse_basebackup_options(List *options, basebackup_options *opt)
 		opt->label = "base backup";
 }
 
+/*
+ * Parse the options of SEND_FILES passed down by the parser
+ */
+static void
+parse_sendfiles_options(List *options, sendfiles_options *opt)
+{
+	ListCell   *lopt;
+	bool		o_tablespace = false;
+	bool		o_maxrate = false;
+	bool		o_compress = false;
+
+	MemSet(opt, 0, sizeof(*opt));
+	foreach(lopt, options)
+	{
+		DefElem    *defel = (DefElem *) lfirst(lopt);
+
+		if (strcmp(defel->defname, "tablespace") == 0)
+		{
+			if (o_tablespace)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("duplicate option \"%s\"", defel->defname)));
+			opt->tablespace = (Oid) intVal(defel->arg);
+			o_tablespace = true;
+		}
+		else if (strcmp(defel->defname, "max_rate") == 0)
+		{
+			long		maxrate;
+
+			if (o_maxrate)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("duplicate option \"%s\"", defel->defname)));
+
+			maxrate = intVal(defel->arg);
+			if (maxrate < MAX_RATE_LOWER || maxrate > MAX_RATE_UPPER)
+				ereport(ERROR,
+						(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+						 errmsg("%d is outside the valid range for parameter \"%s\" (%d .. %d)",
+				(int) maxrate, "MAX_RATE", MAX_RATE_LOWER, MAX_RATE_UPPER)));
+
+			opt->maxrate = (uint32) maxrate;
+			o_maxrate = true;
+		}
+		else if (strcmp(defel->defname, "compress") == 0)
+		{
+			long		level;
+
+			if (o_compress)
+				ereport(ERROR,
+						(errcode(ERRCODE_SYNTAX_ERROR),
+						 errmsg("duplicate option \"%s\"", defel->defname)));
+
+			level = intVal(defel->arg);
+			if (level < 0 || level > 9)
+				ereport(ERROR,
+						(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+						 errmsg("%d is outside the valid range for parameter \"%s\" (%d .. %d)",
+								(int) level, "COMPRESS", 0, 9)));
+#ifndef HAVE_LIBZ
+			if (level > 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("compression is not supported by this build")));
+#endif
+
+			opt->compresslevel = (int) level;
+			o_compress = true;
+		}
+		else
+			elog(ERROR, "option \"%s\" not recognized",
+				 defel->defname);
+	}
+}
+
 
 /*
  * SendBaseBackup() - send a complete base backup.
@@ -798,7 +1331,7 @@ sendFileWithContent(const char *filename, const char *content)
 
 	_tarWriteHeader(filename, NULL, &statbuf);
 	/* Send the contents as a CopyData message */
-	pq_putmessage('d', content, len);
+	send_data(content, len);
 
 	/* Pad to 512 byte boundary, per tar format requirements */
 	pad = ((len + 511) & ~511) - len;
@@ -807,7 +1340,7 @@ sendFileWithContent(const char *filename, const char *content)
 		char		buf[512];
 
 		MemSet(buf, 0, pad);
-		pq_putmessage('d', buf, pad);
+		send_data(buf, pad);
 	}
 }
 
@@ -1093,6 +1626,16 @@ sendDir(char *path, int basepathlen, bool sizeonly, List *tablespaces,
 			if (!skip_this_dir)
 				size += sendDir(pathbuf, basepathlen, sizeonly, tablespaces, sendtblspclinks);
 		}
+		else if (S_ISREG(statbuf.st_mode) && collect_files && !sizeonly)
+		{
+			/* Fetched later by SEND_FILES */
+			backupfileinfo *fi = palloc(sizeof(backupfileinfo));
+
+			fi->spcoid = collect_spcoid;
+			fi->path = pstrdup(pathbuf + basepathlen + 1);
+			fi->size = statbuf.st_size;
+			collected_files = lappend(collected_files, fi);
+		}
 		else if (S_ISREG(statbuf.st_mode))
 		{
 			bool		sent = false;
@@ -1172,7 +1715,7 @@ sendFile(char *readfilename, char *tarfilename, struct stat * statbuf,
 	while ((cnt = fread(buf, 1, Min(sizeof(buf), statbuf->st_size - len), fp)) > 0)
 	{
 		/* Send the chunk as a CopyData message */
-		if (pq_putmessage('d', buf, cnt))
+		if (send_data(buf, cnt))
 			ereport(ERROR,
 			   (errmsg("base backup could not send data, aborting backup")));
 
@@ -1197,7 +1740,7 @@ sendFile(char *readfilename, char *tarfilename, struct stat * statbuf,
 		while (len < statbuf->st_size)
 		{
 			cnt = Min(sizeof(buf), statbuf->st_size - len);
-			pq_putmessage('d', buf, cnt);
+			send_data(buf, cnt);
 			len += cnt;
 			throttle(cnt);
 		}
@@ -1211,7 +1754,7 @@ sendFile(char *readfilename, char *tarfilename, struct stat * statbuf,
 	if (pad > 0)
 	{
 		MemSet(buf, 0, pad);
-		pq_putmessage('d', buf, pad);
+		send_data(buf, pad);
 	}
 
 	FreeFile(fp);
@@ -1249,7 +1792,38 @@ _tarWriteHeader(const char *filename, const char *linktarget,
 			elog(ERROR, "unrecognized tar error: %d", rc);
 	}
 
-	pq_putmessage('d', h, 512);
+	send_data(h, 512);
+}
+
+/*
+ * Setup and activate network throttling at maxrate kB/s, or disable it if
+ * maxrate is 0.
+ */
+static void
+setup_throttle(uint32 maxrate)
+{
+	if (maxrate > 0)
+	{
+		throttling_sample =
+			(int64) maxrate * (int64) 1024 / THROTTLING_FREQUENCY;
+
+		/*
+		 * The minimum amount of time for throttling_sample bytes to be
+		 * transferred.
+		 */
+		elapsed_min_unit = USECS_PER_SEC / THROTTLING_FREQUENCY;
+
+		/* Enable throttling. */
+		throttling_counter = 0;
+
+		/* The 'real data' starts now (header was ignored). */
+		throttled_last = GetCurrentIntegerTimestamp();
+	}
+	else
+	{
+		/* Disable throttling. */
+		throttling_counter = -1;
+	}
 }
 
 /*
@@ -1319,3 +1893,74 @@ throttle(size_t increment)
 		/* Sleep was necessary but might have been interrupted. */
 		throttled_last = GetCurrentIntegerTimestamp();
 }
+
+/*
+ * Compress the data sent from now on at the given zlib level, or stop
+ * compressing if level is 0.
+ *
+ * Each CopyData message is compressed on its own with a sync flush, sharing
+ * the dictionary of the previous ones, so that the client can uncompress
+ * the messages one by one and still see the boundaries of the tar blocks.
+ */
+static void
+setup_compression(int level)
+{
+#ifdef HAVE_LIBZ
+	if (compress_stream != NULL)
+	{
+		deflateEnd(compress_stream);
+		pfree(compress_stream);
+		pfree(compress_buf.data);
+		compress_stream = NULL;
+	}
+
+	if (level > 0)
+	{
+		compress_stream = MemoryContextAllocZero(TopMemoryContext,
+												 sizeof(z_stream));
+		if (deflateInit(compress_stream, level) != Z_OK)
+			ereport(ERROR,
+					(errcode(ERRCODE_OUT_OF_MEMORY),
+					 errmsg("could not initialize compression: %s",
+							compress_stream->msg ? compress_stream->msg : "")));
+		compress_buf.data = MemoryContextAlloc(TopMemoryContext,
+											   TAR_SEND_SIZE * 2);
+		compress_buf.maxlen = TAR_SEND_SIZE * 2;
+		resetStringInfo(&compress_buf);
+	}
+#else
+	Assert(level == 0);
+#endif
+}
+
+/*
+ * Send a chunk of the tar stream as a CopyData message, compressed if
+ * requested.
+ */
+static int
+send_data(const char *data, size_t len)
+{
+#ifdef HAVE_LIBZ
+	if (compress_stream != NULL)
+	{
+		resetStringInfo(&compress_buf);
+		compress_stream->next_in = (Bytef *) data;
+		compress_stream->avail_in = len;
+		do
+		{
+			enlargeStringInfo(&compress_buf, TAR_SEND_SIZE);
+			compress_stream->next_out =
+				(Bytef *) compress_buf.data + compress_buf.len;
+			compress_stream->avail_out =
+				compress_buf.maxlen - compress_buf.len - 1;
+			if (deflate(compress_stream, Z_SYNC_FLUSH) == Z_STREAM_ERROR)
+				elog(ERROR, "could not compress data");
+			compress_buf.len = compress_buf.maxlen - 1 -
+				compress_stream->avail_out;
+		} while (compress_stream->avail_out == 0);
+
+		return pq_putmessage('d', compress_buf.data, compress_buf.len);
+	}
+#endif
+	return pq_putmessage('d', data, len);
+}
@@ -649,6 +649,10 @@ begin_cb_wrapper(ReorderBuffer *cache, ReorderBufferTXN *txn)
 	ctx->accept_writes = true;
 	ctx->write_xid = txn->xid;
 	ctx->write_location = txn->first_lsn;
+#ifdef XCP
+	ctx->write_commit_location = txn->end_lsn;
+	ctx->write_commit_time = txn->commit_time;
+#endif
 
 	/* do the actual work: call callback */
 	ctx->callbacks.begin_cb(ctx, txn);
@@ -678,6 +682,10 @@ commit_cb_wrapper(ReorderBuffer *cache, ReorderBufferTXN *txn,
 	ctx->accept_writes = true;
 	ctx->write_xid = txn->xid;
 	ctx->write_location = txn->end_lsn; /* points to the end of the record */
+#ifdef XCP
+	ctx->write_commit_location = txn->end_lsn;
+	ctx->write_commit_time = txn->commit_time;
+#endif
 
 	/* do the actual work: call callback */
 	ctx->callbacks.commit_cb(ctx, txn, commit_lsn);
@@ -714,6 +722,10 @@ change_cb_wrapper(ReorderBuffer *cache, ReorderBufferTXN *txn,
 	 * commit to be confirmed with one message.
 	 */
 	ctx->write_location = change->lsn;
+#ifdef XCP
+	ctx->write_commit_location = txn->end_lsn;
+	ctx->write_commit_time = txn->commit_time;
+#endif
 
 	ctx->callbacks.change_cb(ctx, txn, relation, change);
 
@@ -43,12 +43,26 @@
 
 #include "storage/fd.h"
 
+#ifdef XCP
+#include "catalog/pgxc_node.h"
+#include "executor/executor.h"
+#include "pgxc/execRemote.h"
+#include "pgxc/nodemgr.h"
+#include "pgxc/pgxc.h"
+#include "pgxc/pgxcnode.h"
+#include "utils/fmgroids.h"
+#include "utils/snapmgr.h"
+#endif
+
 /* private date for writing out data */
 typedef struct DecodingOutputState
 {
 	Tuplestorestate *tupstore;
 	TupleDesc	tupdesc;
 	bool		binary_output;
+#ifdef XCP
+	bool		commit_output;	/* with the commit of each transaction */
+#endif
 	int64		returned_rows;
 } DecodingOutputState;
 
@@ -69,8 +83,9 @@ static void
 LogicalOutputWrite(LogicalDecodingContext *ctx, XLogRecPtr lsn, TransactionId xid,
 				   bool last_write)
 {
-	Datum		values[3];
-	bool		nulls[3];
+	Datum		values[5];
+	bool		nulls[5];
+	int			datacol = 2;
 	DecodingOutputState *p;
 
 	/* SQL Datums can only be of a limited length... */
@@ -82,6 +97,14 @@ LogicalOutputWrite(LogicalDecodingContext *ctx, XLogRecPtr lsn, TransactionId xi
 	memset(nulls, 0, sizeof(nulls));
 	values[0] = LSNGetDatum(lsn);
 	values[1] = TransactionIdGetDatum(xid);
+#ifdef XCP
+	if (p->commit_output)
+	{
+		values[2] = LSNGetDatum(ctx->write_commit_location);
+		values[3] = TimestampTzGetDatum(ctx->write_commit_time);
+		datacol = 4;
+	}
+#endif
 
 	/*
 	 * Assert ctx->out is in database encoding when we're writing textual
@@ -93,7 +116,7 @@ LogicalOutputWrite(LogicalDecodingContext *ctx, XLogRecPtr lsn, TransactionId xi
 							   false));
 
 	/* ick, but cstring_to_text_with_len works for bytea perfectly fine */
-	values[2] = PointerGetDatum(
+	values[datacol] = PointerGetDatum(
 					cstring_to_text_with_len(ctx->out->data, ctx->out->len));
 
 	tuplestore_putvalues(p->tupstore, p->tupdesc, values, nulls);
@@ -323,6 +346,10 @@ pg_logical_slot_get_changes_guts(FunctionCallInfo fcinfo, bool confirm, bool bin
 	/* Build a tuple descriptor for our result type */
 	if (get_call_result_type(fcinfo, NULL, &p->tupdesc) != TYPEFUNC_COMPOSITE)
 		elog(ERROR, "return type must be a row type");
+#ifdef XCP
+	/* pgxc_logical_slot_peek_changes has the commit columns too */
+	p->commit_output = (p->tupdesc->natts == 5);
+#endif
 
 	check_permissions();
 
@@ -517,3 +544,324 @@ pg_logical_slot_peek_binary_changes(PG_FUNCTION_ARGS)
 
 	return ret;
 }
+
+#ifdef XCP
+/*
+ * SQL function returning the changestream as text with the commit location
+ * and time of each transaction, only peeking ahead.
+ */
+Datum
+pgxc_logical_slot_peek_changes(PG_FUNCTION_ARGS)
+{
+	Datum		ret = pg_logical_slot_get_changes_guts(fcinfo, false, false);
+
+	return ret;
+}
+
+/*
+ * Change stream of the cluster
+ *
+ * Each Datanode decodes the changes of its own WAL, so a consumer of their
+ * slots has to put the transactions of all the nodes back in order.
+ * pgxc_logical_slot_get_changes decodes a slot of the same name on all the
+ * Datanodes at once, and returns their changes ordered by the commit time of
+ * their transactions, which the nodes take from the clock of GTM.
+ *
+ * The changes are peeked first. A node returning as many changes as asked
+ * may have committed others before the last transaction returned by another
+ * node: only the transactions committed before the last one of every such
+ * node are returned, the others are left for the next call. The slots are
+ * then advanced to the end of the last transaction returned on each node,
+ * so no change is lost or returned twice.
+ */
+typedef struct NodeChange
+{
+	int			node;			/* index of the Datanode */
+	int			seq;			/* order of the change on that node */
+	XLogRecPtr	location;
+	TransactionId xid;
+	XLogRecPtr	commit_location;
+	TimestampTz commit_time;
+	Datum		data;
+} NodeChange;
+
+static int
+node_change_cmp(const void *a, const void *b)
+{
+	const NodeChange *ca = (const NodeChange *) a;
+	const NodeChange *cb = (const NodeChange *) b;
+
+	if (ca->commit_time != cb->commit_time)
+		return (ca->commit_time < cb->commit_time) ? -1 : 1;
+	if (ca->xid != cb->xid)
+		return TransactionIdPrecedes(ca->xid, cb->xid) ? -1 : 1;
+	if (ca->node != cb->node)
+		return (ca->node < cb->node) ? -1 : 1;
+	return (ca->seq < cb->seq) ? -1 : (ca->seq > cb->seq);
+}
+
+/*
+ * Run a query on the given Datanodes at the same time, and return the
+ * executor state reading its result, of the types given.
+ */
+static RemoteQueryState *
+logical_remote_query(const char *sql, List *nodelist, int ntypes,
+					 Oid *types, EState **estate)
+{
+	RemoteQuery *plan;
+	RemoteQueryState *pstate;
+	MemoryContext oldcontext;
+	int			i;
+
+	plan = makeNode(RemoteQuery);
+	plan->combine_type = COMBINE_TYPE_NONE;
+	plan->exec_nodes = makeNode(ExecNodes);
+	plan->exec_type = EXEC_ON_DATANODES;
+	plan->exec_nodes->nodeList = nodelist;
+	plan->sql_statement = (char *) sql;
+	plan->force_autocommit = false;
+	/* The target list only determines the types of the result */
+	for (i = 0; i < ntypes; i++)
+		plan->scan.plan.targetlist = lappend(plan->scan.plan.targetlist,
+				makeTargetEntry((Expr *) makeVar(1, i + 1, types[i], -1,
+												 InvalidOid, 0),
+								i + 1, NULL, false));
+
+	*estate = CreateExecutorState();
+	oldcontext = MemoryContextSwitchTo((*estate)->es_query_cxt);
+	(*estate)->es_snapshot = GetActiveSnapshot();
+	pstate = ExecInitRemoteQuery(plan, *estate, 0);
+	MemoryContextSwitchTo(oldcontext);
+
+	return pstate;
+}
+
+/*
+ * pgxc_logical_slot_get_changes - change stream of all the Datanodes
+ *
+ * Returns the changes of the slot of the given name on each Datanode, at
+ * most upto_nchanges per node, ordered by commit time, and consumes them.
+ */
+Datum
+pgxc_logical_slot_get_changes(PG_FUNCTION_ARGS)
+{
+#define PGXC_LOGICAL_SLOT_GET_CHANGES_COLS 5
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Name		name;
+	int32		upto_nchanges;
+	char	   *options;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+	Oid		   *dnOids;
+	int			numdnodes;
+	char	  **nodenames;
+	int		   *nchanges;
+	TimestampTz *lasttime;
+	XLogRecPtr *confirm;
+	bool	   *held;
+	List	   *nodelist = NIL;
+	NodeChange *changes;
+	int			maxchanges = 64;
+	int			nkept = 0;
+	int			n = 0;
+	TimestampTz watermark;
+	RemoteQueryState *pstate;
+	EState	   *estate;
+	TupleTableSlot *result;
+	StringInfoData buf;
+	Oid			peektypes[6] = {NAMEOID, LSNOID, XIDOID, LSNOID,
+								TIMESTAMPTZOID, TEXTOID};
+	Oid			counttype = INT8OID;
+	int			i;
+
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(2))
+		ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("slot name and options must not be null")));
+	name = PG_GETARG_NAME(0);
+	upto_nchanges = PG_ARGISNULL(1) ? 0 : PG_GETARG_INT32(1);
+
+	if (!IS_PGXC_LOCAL_COORDINATOR)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("the change stream of the cluster can only be read on a Coordinator")));
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	check_permissions();
+
+	options = quote_literal_cstr(OidOutputFunctionCall(F_ARRAY_OUT,
+													   PG_GETARG_DATUM(2)));
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	PgxcNodeGetOids(NULL, &dnOids, NULL, &numdnodes, false);
+	nodenames = (char **) palloc(numdnodes * sizeof(char *));
+	nchanges = (int *) palloc0(numdnodes * sizeof(int));
+	lasttime = (TimestampTz *) palloc0(numdnodes * sizeof(TimestampTz));
+	confirm = (XLogRecPtr *) palloc0(numdnodes * sizeof(XLogRecPtr));
+	held = (bool *) palloc0(numdnodes * sizeof(bool));
+	for (i = 0; i < numdnodes; i++)
+	{
+		char		ntype = PGXC_NODE_DATANODE;
+
+		nodenames[i] = get_pgxc_nodename(dnOids[i]);
+		nodelist = lappend_int(nodelist, PGXCNodeGetNodeId(dnOids[i], &ntype));
+	}
+	changes = (NodeChange *) palloc(maxchanges * sizeof(NodeChange));
+
+	/* Decode on all the Datanodes in parallel */
+	initStringInfo(&buf);
+	appendStringInfo(&buf,
+					 "SELECT pg_catalog.pgxc_node_str(), location, xid, "
+					 "commit_location, commit_time, data "
+					 "FROM pg_catalog.pgxc_logical_slot_peek_changes(%s, NULL, ",
+					 quote_literal_cstr(NameStr(*name)));
+	if (upto_nchanges > 0)
+		appendStringInfo(&buf, "%d", upto_nchanges);
+	else
+		appendStringInfoString(&buf, "NULL");
+	appendStringInfo(&buf, ", VARIADIC %s::pg_catalog.text[])", options);
+
+	pstate = logical_remote_query(buf.data, nodelist, 6, peektypes, &estate);
+	result = ExecRemoteQuery(pstate);
+	while (!TupIsNull(result))
+	{
+		NodeChange *change;
+		char	   *nodename;
+		bool		isnull;
+
+		if (n >= maxchanges)
+		{
+			maxchanges *= 2;
+			changes = (NodeChange *) repalloc(changes,
+											  maxchanges * sizeof(NodeChange));
+		}
+		change = &changes[n];
+
+		nodename = NameStr(*DatumGetName(slot_getattr(result, 1, &isnull)));
+		for (i = 0; i < numdnodes; i++)
+		{
+			if (strcmp(nodenames[i], nodename) == 0)
+				break;
+		}
+		if (i == numdnodes)
+			elog(ERROR, "unexpected changes from node \"%s\"", nodename);
+
+		change->node = i;
+		change->seq = nchanges[i]++;
+		change->location = DatumGetLSN(slot_getattr(result, 2, &isnull));
+		change->xid = DatumGetTransactionId(slot_getattr(result, 3, &isnull));
+		change->commit_location = DatumGetLSN(slot_getattr(result, 4, &isnull));
+		change->commit_time = DatumGetTimestampTz(slot_getattr(result, 5, &isnull));
+		change->data = PointerGetDatum(
+					DatumGetTextPCopy(slot_getattr(result, 6, &isnull)));
+		lasttime[i] = change->commit_time;
+		n++;
+
+		result = ExecRemoteQuery(pstate);
+	}
+	ExecEndRemoteQuery(pstate);
+	FreeExecutorState(estate);
+
+	/*
+	 * The nodes having returned all the changes they have may only commit
+	 * later transactions. The others may have earlier ones to return.
+	 */
+	TIMESTAMP_NOEND(watermark);
+	for (i = 0; i < numdnodes; i++)
+	{
+		if (upto_nchanges > 0 && nchanges[i] >= upto_nchanges &&
+			lasttime[i] < watermark)
+			watermark = lasttime[i];
+	}
+
+	/* Keep the transactions of each node up to the watermark, in order */
+	for (i = 0; i < n; i++)
+	{
+		NodeChange *change = &changes[i];
+
+		if (held[change->node] || change->commit_time > watermark)
+		{
+			held[change->node] = true;
+			continue;
+		}
+		confirm[change->node] = change->commit_location;
+		changes[nkept++] = *change;
+	}
+
+	qsort(changes, nkept, sizeof(NodeChange), node_change_cmp);
+	for (i = 0; i < nkept; i++)
+	{
+		Datum		values[PGXC_LOGICAL_SLOT_GET_CHANGES_COLS];
+		bool		nulls[PGXC_LOGICAL_SLOT_GET_CHANGES_COLS];
+
+		MemSet(nulls, 0, sizeof(nulls));
+		values[0] = DirectFunctionCall1(namein,
+								CStringGetDatum(nodenames[changes[i].node]));
+		values[1] = LSNGetDatum(changes[i].location);
+		values[2] = TransactionIdGetDatum(changes[i].xid);
+		values[3] = TimestampTzGetDatum(changes[i].commit_time);
+		values[4] = changes[i].data;
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	/* Consume what is returned, on the nodes having returned something */
+	list_free(nodelist);
+	nodelist = NIL;
+	resetStringInfo(&buf);
+	appendStringInfo(&buf,
+					 "SELECT count(*) FROM pg_catalog.pg_logical_slot_get_changes(%s, "
+					 "CASE pg_catalog.pgxc_node_str()",
+					 quote_literal_cstr(NameStr(*name)));
+	for (i = 0; i < numdnodes; i++)
+	{
+		char		ntype = PGXC_NODE_DATANODE;
+
+		if (confirm[i] == InvalidXLogRecPtr)
+			continue;
+		nodelist = lappend_int(nodelist, PGXCNodeGetNodeId(dnOids[i], &ntype));
+		appendStringInfo(&buf, " WHEN %s THEN '%X/%X'",
+						 quote_literal_cstr(nodenames[i]),
+						 (uint32) (confirm[i] >> 32), (uint32) confirm[i]);
+	}
+	appendStringInfo(&buf, " END::pg_catalog.pg_lsn, NULL, VARIADIC %s::pg_catalog.text[])",
+					 options);
+
+	if (nodelist != NIL)
+	{
+		pstate = logical_remote_query(buf.data, nodelist, 1, &counttype,
+									  &estate);
+		result = ExecRemoteQuery(pstate);
+		while (!TupIsNull(result))
+			result = ExecRemoteQuery(pstate);
+		ExecEndRemoteQuery(pstate);
+		FreeExecutorState(estate);
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+#endif
@@ -76,13 +76,19 @@ Node *replication_parse_result;
 %token K_PHYSICAL
 %token K_LOGICAL
 %token K_SLOT
+%token K_PARALLEL
+%token K_SEND_FILES
+%token K_STOP_BACKUP
+%token K_START_WAL_LOCATION
+%token K_TABLESPACE
+%token K_COMPRESS
 
 %type <node>	command
 %type <node>	base_backup start_replication start_logical_replication
 				create_replication_slot drop_replication_slot identify_system
-				timeline_history
-%type <list>	base_backup_opt_list
-%type <defelt>	base_backup_opt
+				timeline_history send_files stop_backup
+%type <list>	base_backup_opt_list send_files_list send_files_opt_list
+%type <defelt>	base_backup_opt send_files_opt
 %type <uintval>	opt_timeline
 %type <list>	plugin_options plugin_opt_list
 %type <defelt>	plugin_opt_elem
@@ -109,6 +115,8 @@ command:
 			| create_replication_slot
 			| drop_replication_slot
 			| timeline_history
+			| send_files
+			| stop_backup
 			;
 
 /*
@@ -123,7 +131,7 @@ identify_system:
 
 /*
  * BASE_BACKUP [LABEL '<label>'] [PROGRESS] [FAST] [WAL] [NOWAIT]
- * [MAX_RATE %d] [TABLESPACE_MAP]
+ * [MAX_RATE %d] [TABLESPACE_MAP] [PARALLEL]
  */
 base_backup:
 			K_BASE_BACKUP base_backup_opt_list
@@ -178,6 +186,70 @@ base_backup_opt:
 				  $$ = makeDefElem("tablespace_map",
 								   (Node *)makeInteger(TRUE));
 				}
+			| K_PARALLEL
+				{
+				  $$ = makeDefElem("parallel",
+								   (Node *)makeInteger(TRUE));
+				}
+			;
+
+/*
+ * SEND_FILES ( '<path>' [, ...] ) START_WAL_LOCATION %X/%X [TABLESPACE %u]
+ * [MAX_RATE %d] [COMPRESS %d]
+ */
+send_files:
+			K_SEND_FILES '(' send_files_list ')' K_START_WAL_LOCATION RECPTR
+			send_files_opt_list
+				{
+					SendFilesCmd *cmd = makeNode(SendFilesCmd);
+
+					cmd->files = $3;
+					cmd->startpoint = $6;
+					cmd->options = $7;
+					$$ = (Node *) cmd;
+				}
+			;
+
+send_files_list:
+			SCONST
+				{ $$ = list_make1(makeString($1)); }
+			| send_files_list ',' SCONST
+				{ $$ = lappend($1, makeString($3)); }
+			;
+
+send_files_opt_list:
+			send_files_opt_list send_files_opt
+				{ $$ = lappend($1, $2); }
+			| /* EMPTY */
+				{ $$ = NIL; }
+			;
+
+send_files_opt:
+			K_TABLESPACE UCONST
+				{
+				  $$ = makeDefElem("tablespace",
+								   (Node *)makeInteger($2));
+				}
+			| K_MAX_RATE UCONST
+				{
+				  $$ = makeDefElem("max_rate",
+								   (Node *)makeInteger($2));
+				}
+			| K_COMPRESS UCONST
+				{
+				  $$ = makeDefElem("compress",
+								   (Node *)makeInteger($2));
+				}
+			;
+
+/*
+ * STOP_BACKUP
+ */
+stop_backup:
+			K_STOP_BACKUP
+				{
+					$$ = (Node *) makeNode(StopBackupCmd);
+				}
 			;
 
 create_replication_slot:
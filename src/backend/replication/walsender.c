@@ -1309,6 +1309,14 @@ exec_replication_command(const char *cmd_string)
 			SendBaseBackup((BaseBackupCmd *) cmd_node);
 			break;
 
+		case T_SendFilesCmd:
+			SendBackupFiles((SendFilesCmd *) cmd_node);
+			break;
+
+		case T_StopBackupCmd:
+			StopBaseBackup((StopBackupCmd *) cmd_node);
+			break;
+
 		case T_CreateReplicationSlotCmd:
 			CreateReplicationSlot((CreateReplicationSlotCmd *) cmd_node);
 			break;
@@ -1943,6 +1951,7 @@ InitWalSenderSlot(void)
 			 */
 			walsnd->pid = MyProcPid;
 			walsnd->sentPtr = InvalidXLogRecPtr;
+			walsnd->backupStart = InvalidXLogRecPtr;
 			walsnd->state = WALSNDSTATE_STARTUP;
 			walsnd->latch = &MyProc->procLatch;
 			SpinLockRelease(&walsnd->mutex);
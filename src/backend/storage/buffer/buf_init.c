@@ -20,6 +20,8 @@
 
 BufferDescPadded *BufferDescriptors;
 char	   *BufferBlocks;
+bool		numa_interleave_buffers = false;
+CkptSortItem *CkptBufferIds;
 
 
 /*
@@ -65,7 +67,8 @@ void
 InitBufferPool(void)
 {
 	bool		foundBufs,
-				foundDescs;
+				foundDescs,
+				foundBufCkpt;
 
 	/* Align descriptors to a cacheline boundary. */
 	BufferDescriptors = (BufferDescPadded *) CACHELINEALIGN(
@@ -77,16 +80,38 @@ InitBufferPool(void)
 		ShmemInitStruct("Buffer Blocks",
 						NBuffers * (Size) BLCKSZ, &foundBufs);
 
-	if (foundDescs || foundBufs)
+	/*
+	 * The array used to sort to-be-checkpointed buffer ids is located in
+	 * shared memory, to avoid having to allocate significant amounts of
+	 * memory at runtime. As that'd be in the middle of a checkpoint, or when
+	 * the checkpointer is restarted, memory allocation failures would be
+	 * painful.
+	 */
+	CkptBufferIds = (CkptSortItem *)
+		ShmemInitStruct("Checkpoint BufferIds",
+						NBuffers * sizeof(CkptSortItem), &foundBufCkpt);
+
+	if (foundDescs || foundBufs || foundBufCkpt)
 	{
-		/* both should be present or neither */
-		Assert(foundDescs && foundBufs);
+		/* should find all of these, or none of them */
+		Assert(foundDescs && foundBufs && foundBufCkpt);
 		/* note: this path is only taken in EXEC_BACKEND case */
 	}
 	else
 	{
 		int			i;
 
+		/*
+		 * Every backend reads and writes all of the buffers, so the pages
+		 * would best be spread evenly over the NUMA nodes.  They otherwise
+		 * end up on the node of whichever process first touches them, that
+		 * is, mostly on one node after a sequential scan of a big table.
+		 */
+		if (numa_interleave_buffers &&
+			!ShmemNumaInterleave(BufferBlocks, NBuffers * (Size) BLCKSZ))
+			ereport(LOG,
+					(errmsg("could not interleave shared buffers across NUMA nodes")));
+
 		/*
 		 * Initialize all the buffer headers.
 		 */
@@ -144,5 +169,8 @@ BufferShmemSize(void)
 	/* size of stuff controlled by freelist.c */
 	size = add_size(size, StrategyShmemSize());
 
+	/* size of checkpoint sort array in bufmgr.c */
+	size = add_size(size, mul_size(NBuffers, sizeof(CkptSortItem)));
+
 	return size;
 }
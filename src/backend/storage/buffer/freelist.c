@@ -24,22 +24,40 @@
 
 
 /*
- * The shared freelist control information.
+ * The buffer pool is split into clock_sweep_partitions ranges of consecutive
+ * buffers, each with its own clock hand and list of free buffers, so that
+ * backends looking for a victim do not all hit the same cache lines.  A
+ * backend sweeps the partition picked by its PGPROC number first, and moves
+ * on to the next ones only if it found no usable buffer there.  The
+ * partitions are only made when each gets at least this many buffers.
+ */
+#define MIN_BUFFERS_PER_PARTITION	1024
+
+/* GUC parameter */
+int			clock_sweep_partitions = 1;
+
+/*
+ * The freelist control information of a partition.
  */
 typedef struct
 {
-	/* Spinlock: protects the values below */
+	/* Spinlock: protects the freelist and completePasses */
 	slock_t		buffer_strategy_lock;
 
 	/*
-	 * Clock sweep hand: index of next buffer to consider grabbing. Note that
-	 * this isn't a concrete buffer - we only ever increase the value. So, to
-	 * get an actual buffer, it needs to be used modulo NBuffers.
+	 * Clock sweep hand: index of next buffer to consider grabbing, relative
+	 * to firstBuffer. Note that this isn't a concrete buffer - we only ever
+	 * increase the value. So, to get an actual buffer, it needs to be used
+	 * modulo nbuffers.
 	 */
 	pg_atomic_uint32 nextVictimBuffer;
 
+	int			firstBuffer;	/* first buffer of the partition */
+	int			nbuffers;		/* number of buffers in the partition */
+
 	int			firstFreeBuffer;	/* Head of list of unused buffers */
 	int			lastFreeBuffer; /* Tail of list of unused buffers */
+	int			numFreeBuffers; /* Length of the list */
 
 	/*
 	 * NOTE: lastFreeBuffer is undefined when firstFreeBuffer is -1 (that is,
@@ -52,6 +70,25 @@ typedef struct
 	 */
 	uint32		completePasses; /* Complete cycles of the clock sweep */
 	pg_atomic_uint32 numBufferAllocs;	/* Buffers allocated since last reset */
+} BufferStrategyPartition;
+
+/* Each partition gets its own cache line */
+typedef union
+{
+	BufferStrategyPartition part;
+	char		pad[PG_CACHE_LINE_SIZE];
+} BufferStrategyPartitionPadded;
+
+/*
+ * The shared freelist control information.
+ */
+typedef struct
+{
+	/* Spinlock: protects bgwprocno */
+	slock_t		buffer_strategy_lock;
+
+	/* Number of partitions, see StrategyNumPartitions */
+	int			npartitions;
 
 	/*
 	 * Bgworker process to be notified upon activity or -1 if none. See
@@ -62,6 +99,7 @@ typedef struct
 
 /* Pointers to shared state */
 static BufferStrategyControl *StrategyControl = NULL;
+static BufferStrategyPartitionPadded *StrategyPartitions = NULL;
 
 /*
  * Private (non-shared) state for managing a ring of shared buffers to re-use.
@@ -98,18 +136,47 @@ typedef struct BufferAccessStrategyData
 
 
 /* Prototypes for internal functions */
+static int	StrategyNumPartitions(void);
+static volatile BufferDesc *GetBufferFromFreelist(BufferStrategyPartition *part,
+					  BufferAccessStrategy strategy);
+static volatile BufferDesc *GetBufferFromSweep(BufferStrategyPartition *part,
+				   BufferAccessStrategy strategy);
 static volatile BufferDesc *GetBufferFromRing(BufferAccessStrategy strategy);
 static void AddBufferToRing(BufferAccessStrategy strategy,
 				volatile BufferDesc *buf);
 
+/*
+ * Partition a buffer belongs to.  Partition p starts at buffer
+ * p * NBuffers / npartitions, rounded down.
+ */
+static inline BufferStrategyPartition *
+BufferPartition(int buf_id)
+{
+	uint64		p;
+
+	p = ((uint64) (buf_id + 1) * StrategyControl->npartitions - 1) / NBuffers;
+	return &StrategyPartitions[p].part;
+}
+
+/*
+ * Partition this backend sweeps first.
+ */
+static inline int
+HomePartition(void)
+{
+	if (MyProc == NULL)
+		return 0;
+	return MyProc->pgprocno % StrategyControl->npartitions;
+}
+
 /*
  * ClockSweepTick - Helper routine for StrategyGetBuffer()
  *
- * Move the clock hand one buffer ahead of its current position and return the
- * id of the buffer now under the hand.
+ * Move the clock hand of the partition one buffer ahead of its current
+ * position and return the id of the buffer now under the hand.
  */
 static inline uint32
-ClockSweepTick(void)
+ClockSweepTick(BufferStrategyPartition *part)
 {
 	uint32		victim;
 
@@ -119,14 +186,14 @@ ClockSweepTick(void)
 	 * apparent order.
 	 */
 	victim =
-		pg_atomic_fetch_add_u32(&StrategyControl->nextVictimBuffer, 1);
+		pg_atomic_fetch_add_u32(&part->nextVictimBuffer, 1);
 
-	if (victim >= NBuffers)
+	if (victim >= part->nbuffers)
 	{
 		uint32		originalVictim = victim;
 
 		/* always wrap what we look up in BufferDescriptors */
-		victim = victim % NBuffers;
+		victim = victim % part->nbuffers;
 
 		/*
 		 * If we're the one that just caused a wraparound, force
@@ -152,19 +219,19 @@ ClockSweepTick(void)
 				 * could lead to an overflow of nextVictimBuffers, but that's
 				 * highly unlikely and wouldn't be particularly harmful.
 				 */
-				SpinLockAcquire(&StrategyControl->buffer_strategy_lock);
+				SpinLockAcquire(&part->buffer_strategy_lock);
 
-				wrapped = expected % NBuffers;
+				wrapped = expected % part->nbuffers;
 
-				success = pg_atomic_compare_exchange_u32(&StrategyControl->nextVictimBuffer,
+				success = pg_atomic_compare_exchange_u32(&part->nextVictimBuffer,
 														 &expected, wrapped);
 				if (success)
-					StrategyControl->completePasses++;
-				SpinLockRelease(&StrategyControl->buffer_strategy_lock);
+					part->completePasses++;
+				SpinLockRelease(&part->buffer_strategy_lock);
 			}
 		}
 	}
-	return victim;
+	return part->firstBuffer + victim;
 }
 
 /*
@@ -184,7 +251,8 @@ StrategyGetBuffer(BufferAccessStrategy strategy)
 {
 	volatile BufferDesc *buf;
 	int			bgwprocno;
-	int			trycounter;
+	int			home;
+	int			i;
 
 	/*
 	 * If given a strategy object, see whether it can select a buffer. We
@@ -223,12 +291,55 @@ StrategyGetBuffer(BufferAccessStrategy strategy)
 		SetLatch(&ProcGlobal->allProcs[bgwprocno].procLatch);
 	}
 
+	home = HomePartition();
+
 	/*
 	 * We count buffer allocation requests so that the bgwriter can estimate
 	 * the rate of buffer consumption.  Note that buffers recycled by a
 	 * strategy object are intentionally not counted here.
 	 */
-	pg_atomic_fetch_add_u32(&StrategyControl->numBufferAllocs, 1);
+	pg_atomic_fetch_add_u32(&StrategyPartitions[home].part.numBufferAllocs, 1);
+
+	/*
+	 * Try the freelist and then the clock sweep of our own partition, then
+	 * those of the next partitions if all the buffers of ours are pinned.
+	 */
+	for (i = 0; i < StrategyControl->npartitions; i++)
+	{
+		BufferStrategyPartition *part;
+
+		part = &StrategyPartitions[(home + i) % StrategyControl->npartitions].part;
+
+		buf = GetBufferFromFreelist(part, strategy);
+		if (buf != NULL)
+			return buf;
+
+		buf = GetBufferFromSweep(part, strategy);
+		if (buf != NULL)
+			return buf;
+	}
+
+	/*
+	 * We've scanned all the buffers without making any state changes, so
+	 * all the buffers are pinned (or were when we looked at them). We could
+	 * hope that someone will free one eventually, but it's probably better
+	 * to fail than to risk getting stuck in an infinite loop.
+	 */
+	elog(ERROR, "no unpinned buffers available");
+	return NULL;				/* keep compiler quiet */
+}
+
+/*
+ * GetBufferFromFreelist -- pop a usable buffer off the freelist of a
+ *		partition, or return NULL if there is none
+ *
+ * The buffer is returned with its header spinlock held.
+ */
+static volatile BufferDesc *
+GetBufferFromFreelist(BufferStrategyPartition *part,
+					  BufferAccessStrategy strategy)
+{
+	volatile BufferDesc *buf;
 
 	/*
 	 * First check, without acquiring the lock, whether there's buffers in the
@@ -246,57 +357,68 @@ StrategyGetBuffer(BufferAccessStrategy strategy)
 	 * buffer_strategy_lock not the individual buffer spinlocks, so it's OK to
 	 * manipulate them without holding the spinlock.
 	 */
-	if (StrategyControl->firstFreeBuffer >= 0)
-	{
-		while (true)
-		{
-			/* Acquire the spinlock to remove element from the freelist */
-			SpinLockAcquire(&StrategyControl->buffer_strategy_lock);
+	if (part->firstFreeBuffer < 0)
+		return NULL;
 
-			if (StrategyControl->firstFreeBuffer < 0)
-			{
-				SpinLockRelease(&StrategyControl->buffer_strategy_lock);
-				break;
-			}
+	while (true)
+	{
+		/* Acquire the spinlock to remove element from the freelist */
+		SpinLockAcquire(&part->buffer_strategy_lock);
 
-			buf = GetBufferDescriptor(StrategyControl->firstFreeBuffer);
-			Assert(buf->freeNext != FREENEXT_NOT_IN_LIST);
+		if (part->firstFreeBuffer < 0)
+		{
+			SpinLockRelease(&part->buffer_strategy_lock);
+			return NULL;
+		}
 
-			/* Unconditionally remove buffer from freelist */
-			StrategyControl->firstFreeBuffer = buf->freeNext;
-			buf->freeNext = FREENEXT_NOT_IN_LIST;
+		buf = GetBufferDescriptor(part->firstFreeBuffer);
+		Assert(buf->freeNext != FREENEXT_NOT_IN_LIST);
 
-			/*
-			 * Release the lock so someone else can access the freelist while
-			 * we check out this buffer.
-			 */
-			SpinLockRelease(&StrategyControl->buffer_strategy_lock);
+		/* Unconditionally remove buffer from freelist */
+		part->firstFreeBuffer = buf->freeNext;
+		part->numFreeBuffers--;
+		buf->freeNext = FREENEXT_NOT_IN_LIST;
 
-			/*
-			 * If the buffer is pinned or has a nonzero usage_count, we cannot
-			 * use it; discard it and retry.  (This can only happen if VACUUM
-			 * put a valid buffer in the freelist and then someone else used
-			 * it before we got to it.  It's probably impossible altogether as
-			 * of 8.3, but we'd better check anyway.)
-			 */
-			LockBufHdr(buf);
-			if (buf->refcount == 0 && buf->usage_count == 0)
-			{
-				if (strategy != NULL)
-					AddBufferToRing(strategy, buf);
-				return buf;
-			}
-			UnlockBufHdr(buf);
+		/*
+		 * Release the lock so someone else can access the freelist while we
+		 * check out this buffer.
+		 */
+		SpinLockRelease(&part->buffer_strategy_lock);
 
+		/*
+		 * If the buffer is pinned or has a nonzero usage_count, we cannot use
+		 * it; discard it and retry.  (This can happen if VACUUM or the
+		 * bgwriter put a valid buffer in the freelist and then someone else
+		 * used it before we got to it.)
+		 */
+		LockBufHdr(buf);
+		if (buf->refcount == 0 && buf->usage_count == 0)
+		{
+			if (strategy != NULL)
+				AddBufferToRing(strategy, buf);
+			return buf;
 		}
+		UnlockBufHdr(buf);
 	}
+}
 
-	/* Nothing on the freelist, so run the "clock sweep" algorithm */
-	trycounter = NBuffers;
+/*
+ * GetBufferFromSweep -- run the "clock sweep" algorithm over a partition
+ *
+ * The buffer is returned with its header spinlock held.  Returns NULL if
+ * the hand went around the partition without making any state change.
+ */
+static volatile BufferDesc *
+GetBufferFromSweep(BufferStrategyPartition *part,
+				   BufferAccessStrategy strategy)
+{
+	volatile BufferDesc *buf;
+	int			trycounter;
+
+	trycounter = part->nbuffers;
 	for (;;)
 	{
-
-		buf = GetBufferDescriptor(ClockSweepTick());
+		buf = GetBufferDescriptor(ClockSweepTick(part));
 
 		/*
 		 * If the buffer is pinned or has a nonzero usage_count, we cannot use
@@ -308,7 +430,7 @@ StrategyGetBuffer(BufferAccessStrategy strategy)
 			if (buf->usage_count > 0)
 			{
 				buf->usage_count--;
-				trycounter = NBuffers;
+				trycounter = part->nbuffers;
 			}
 			else
 			{
@@ -320,15 +442,8 @@ StrategyGetBuffer(BufferAccessStrategy strategy)
 		}
 		else if (--trycounter == 0)
 		{
-			/*
-			 * We've scanned all the buffers without making any state changes,
-			 * so all the buffers are pinned (or were when we looked at them).
-			 * We could hope that someone will free one eventually, but it's
-			 * probably better to fail than to risk getting stuck in an
-			 * infinite loop.
-			 */
 			UnlockBufHdr(buf);
-			elog(ERROR, "no unpinned buffers available");
+			return NULL;
 		}
 		UnlockBufHdr(buf);
 	}
@@ -340,7 +455,9 @@ StrategyGetBuffer(BufferAccessStrategy strategy)
 void
 StrategyFreeBuffer(volatile BufferDesc *buf)
 {
-	SpinLockAcquire(&StrategyControl->buffer_strategy_lock);
+	BufferStrategyPartition *part = BufferPartition(buf->buf_id);
+
+	SpinLockAcquire(&part->buffer_strategy_lock);
 
 	/*
 	 * It is possible that we are told to put something in the freelist that
@@ -348,13 +465,67 @@ StrategyFreeBuffer(volatile BufferDesc *buf)
 	 */
 	if (buf->freeNext == FREENEXT_NOT_IN_LIST)
 	{
-		buf->freeNext = StrategyControl->firstFreeBuffer;
+		buf->freeNext = part->firstFreeBuffer;
 		if (buf->freeNext < 0)
-			StrategyControl->lastFreeBuffer = buf->buf_id;
-		StrategyControl->firstFreeBuffer = buf->buf_id;
+			part->lastFreeBuffer = buf->buf_id;
+		part->firstFreeBuffer = buf->buf_id;
+		part->numFreeBuffers++;
 	}
 
-	SpinLockRelease(&StrategyControl->buffer_strategy_lock);
+	SpinLockRelease(&part->buffer_strategy_lock);
+}
+
+/*
+ * StrategyFillFreelists -- put clean victims on the freelists ahead of need
+ *
+ * Called by the bgwriter after its LRU scan, with the number of buffers it
+ * expects to be allocated before its next round.  When the pool is
+ * partitioned, the clock hand of each partition whose freelist holds fewer
+ * than its share of them is moved ahead the way a backend would, and the
+ * clean, unused buffers found are put on the freelist, so that backends get
+ * their victims off the freelist rather than by sweeping.  Dirty buffers are
+ * left to the LRU scan, which writes them out.
+ */
+void
+StrategyFillFreelists(int upcoming_allocs)
+{
+	int			npartitions = StrategyControl->npartitions;
+	int			target;
+	int			p;
+
+	if (npartitions == 1)
+		return;
+
+	target = upcoming_allocs / npartitions + 1;
+
+	for (p = 0; p < npartitions; p++)
+	{
+		BufferStrategyPartition *part = &StrategyPartitions[p].part;
+		int			num_to_scan = part->nbuffers;
+
+		while (num_to_scan-- > 0 &&
+			   INT_ACCESS_ONCE(part->numFreeBuffers) < target)
+		{
+			volatile BufferDesc *buf;
+			bool		reusable = false;
+
+			buf = GetBufferDescriptor(ClockSweepTick(part));
+
+			LockBufHdr(buf);
+			if (buf->refcount == 0)
+			{
+				if (buf->usage_count > 0)
+					buf->usage_count--;
+				else if (!(buf->flags & BM_DIRTY))
+					reusable = true;
+			}
+			UnlockBufHdr(buf);
+
+			/* StrategyGetBuffer checks it again when taking it off */
+			if (reusable)
+				StrategyFreeBuffer(buf);
+		}
+	}
 }
 
 /*
@@ -371,30 +542,42 @@ StrategyFreeBuffer(volatile BufferDesc *buf)
 int
 StrategySyncStart(uint32 *complete_passes, uint32 *num_buf_alloc)
 {
-	uint32		nextVictimBuffer;
-	int			result;
-
-	SpinLockAcquire(&StrategyControl->buffer_strategy_lock);
-	nextVictimBuffer = pg_atomic_read_u32(&StrategyControl->nextVictimBuffer);
-	result = nextVictimBuffer % NBuffers;
+	uint64		ticks = 0;
+	uint32		allocs = 0;
+	int			p;
 
-	if (complete_passes)
+	/*
+	 * The hands of the partitions are summed up as if they were one hand
+	 * going around the whole pool, which is exact when there is a single
+	 * partition and a fair estimate of the progress of the sweep otherwise.
+	 */
+	for (p = 0; p < StrategyControl->npartitions; p++)
 	{
-		*complete_passes = StrategyControl->completePasses;
+		BufferStrategyPartition *part = &StrategyPartitions[p].part;
+		uint32		nextVictimBuffer;
+		uint64		passes;
+
+		SpinLockAcquire(&part->buffer_strategy_lock);
+		nextVictimBuffer = pg_atomic_read_u32(&part->nextVictimBuffer);
 
 		/*
 		 * Additionally add the number of wraparounds that happened before
 		 * completePasses could be incremented. C.f. ClockSweepTick().
 		 */
-		*complete_passes += nextVictimBuffer / NBuffers;
+		passes = part->completePasses + nextVictimBuffer / part->nbuffers;
+		ticks += passes * part->nbuffers + nextVictimBuffer % part->nbuffers;
+
+		if (num_buf_alloc)
+			allocs += pg_atomic_exchange_u32(&part->numBufferAllocs, 0);
+		SpinLockRelease(&part->buffer_strategy_lock);
 	}
 
+	if (complete_passes)
+		*complete_passes = (uint32) (ticks / NBuffers);
 	if (num_buf_alloc)
-	{
-		*num_buf_alloc = pg_atomic_exchange_u32(&StrategyControl->numBufferAllocs, 0);
-	}
-	SpinLockRelease(&StrategyControl->buffer_strategy_lock);
-	return result;
+		*num_buf_alloc = allocs;
+
+	return (int) (ticks % NBuffers);
 }
 
 /*
@@ -438,9 +621,29 @@ StrategyShmemSize(void)
 	/* size of the shared replacement strategy control block */
 	size = add_size(size, MAXALIGN(sizeof(BufferStrategyControl)));
 
+	/* size of the partitions, and room to align them on cache lines */
+	size = add_size(size, mul_size(StrategyNumPartitions(),
+								   sizeof(BufferStrategyPartitionPadded)));
+	size = add_size(size, PG_CACHE_LINE_SIZE);
+
 	return size;
 }
 
+/*
+ * StrategyNumPartitions -- number of clock sweep partitions
+ *
+ * clock_sweep_partitions, reduced so that every partition gets at least
+ * MIN_BUFFERS_PER_PARTITION buffers.
+ */
+static int
+StrategyNumPartitions(void)
+{
+	int			npartitions = clock_sweep_partitions;
+
+	npartitions = Min(npartitions, NBuffers / MIN_BUFFERS_PER_PARTITION);
+	return Max(npartitions, 1);
+}
+
 /*
  * StrategyInitialize -- initialize the buffer cache replacement
  *		strategy.
@@ -452,6 +655,7 @@ void
 StrategyInitialize(bool init)
 {
 	bool		found;
+	int			npartitions = StrategyNumPartitions();
 
 	/*
 	 * Initialize the shared buffer lookup hashtable.
@@ -470,31 +674,52 @@ StrategyInitialize(bool init)
 	 */
 	StrategyControl = (BufferStrategyControl *)
 		ShmemInitStruct("Buffer Strategy Status",
-						sizeof(BufferStrategyControl),
+						MAXALIGN(sizeof(BufferStrategyControl)) +
+						npartitions * sizeof(BufferStrategyPartitionPadded) +
+						PG_CACHE_LINE_SIZE,
 						&found);
+	StrategyPartitions = (BufferStrategyPartitionPadded *)
+		CACHELINEALIGN((char *) StrategyControl +
+					   MAXALIGN(sizeof(BufferStrategyControl)));
 
 	if (!found)
 	{
+		int			p;
+
 		/*
 		 * Only done once, usually in postmaster
 		 */
 		Assert(init);
 
 		SpinLockInit(&StrategyControl->buffer_strategy_lock);
+		StrategyControl->npartitions = npartitions;
 
-		/*
-		 * Grab the whole linked list of free buffers for our strategy. We
-		 * assume it was previously set up by InitBufferPool().
-		 */
-		StrategyControl->firstFreeBuffer = 0;
-		StrategyControl->lastFreeBuffer = NBuffers - 1;
+		for (p = 0; p < npartitions; p++)
+		{
+			BufferStrategyPartition *part = &StrategyPartitions[p].part;
+			int			first = (int) ((uint64) p * NBuffers / npartitions);
+			int			next = (int) ((uint64) (p + 1) * NBuffers / npartitions);
 
-		/* Initialize the clock sweep pointer */
-		pg_atomic_init_u32(&StrategyControl->nextVictimBuffer, 0);
+			SpinLockInit(&part->buffer_strategy_lock);
+			part->firstBuffer = first;
+			part->nbuffers = next - first;
 
-		/* Clear statistics */
-		StrategyControl->completePasses = 0;
-		pg_atomic_init_u32(&StrategyControl->numBufferAllocs, 0);
+			/*
+			 * Grab the part of the linked list of free buffers set up by
+			 * InitBufferPool() which belongs to the partition.
+			 */
+			part->firstFreeBuffer = first;
+			part->lastFreeBuffer = next - 1;
+			part->numFreeBuffers = part->nbuffers;
+			GetBufferDescriptor(next - 1)->freeNext = FREENEXT_END_OF_LIST;
+
+			/* Initialize the clock sweep pointer */
+			pg_atomic_init_u32(&part->nextVictimBuffer, 0);
+
+			/* Clear statistics */
+			part->completePasses = 0;
+			pg_atomic_init_u32(&part->numBufferAllocs, 0);
+		}
 
 		/* No pending notification */
 		StrategyControl->bgwprocno = -1;
@@ -1298,6 +1298,38 @@ FilePrefetch(File file, off_t offset, int amount)
 #endif
 }
 
+/*
+ * Ask the kernel to start writing out the given range of the file, without
+ * waiting for it.  This is only a hint; errors are ignored.  It is a no-op
+ * unless sync_file_range is available: the other ways pg_flush_data has to
+ * do this also drop the data from the OS cache.
+ */
+void
+FileWriteback(File file, off_t offset, off_t nbytes)
+{
+#ifdef HAVE_SYNC_FILE_RANGE
+	int			returnCode;
+
+	Assert(FileIsValid(file));
+
+	DO_DB(elog(LOG, "FileWriteback: %d (%s) " INT64_FORMAT " " INT64_FORMAT,
+			   file, VfdCache[file].fileName,
+			   (int64) offset, (int64) nbytes));
+
+	/* a length of zero would mean the whole rest of the file */
+	if (nbytes <= 0)
+		return;
+
+	returnCode = FileAccess(file);
+	if (returnCode < 0)
+		return;
+
+	(void) pg_flush_data(VfdCache[file].fd, offset, nbytes);
+#else
+	Assert(FileIsValid(file));
+#endif
+}
+
 int
 FileRead(File file, char *buffer, int amount)
 {
@@ -105,6 +105,7 @@ static uint8 fsm_space_needed_to_cat(Size needed);
 static Size fsm_space_cat_to_avail(uint8 cat);
 
 /* workhorse functions for various operations */
+static void fsm_raise_upper(Relation rel, FSMAddress addr, uint8 new_cat);
 static int fsm_set_and_search(Relation rel, FSMAddress addr, uint16 slot,
 				   uint8 newValue, uint8 minValue);
 static BlockNumber fsm_search(Relation rel, uint8 min_cat);
@@ -220,6 +221,36 @@ XLogRecordPageWithFreeSpace(RelFileNode rnode, BlockNumber heapBlk,
 	UnlockReleaseBuffer(buf);
 }
 
+/*
+ * UpdateFreeSpaceMap - propagate the free space of a range of pages to the
+ *		upper levels of the FSM.
+ *
+ * The caller has already recorded each page of the range with
+ * RecordPageWithFreeSpace; this makes the space visible to searchers right
+ * away, instead of after the next FreeSpaceMapVacuum.  Used after bulk
+ * extension of a relation, where all the new pages have the same amount of
+ * free space.
+ */
+void
+UpdateFreeSpaceMap(Relation rel, BlockNumber startBlkNum,
+				   BlockNumber endBlkNum, Size freespace)
+{
+	uint8		new_cat = fsm_space_avail_to_cat(freespace);
+	BlockNumber blkno = startBlkNum;
+
+	while (blkno <= endBlkNum)
+	{
+		FSMAddress	addr;
+		uint16		slot;
+
+		/* One upper-level update covers all the pages of a leaf FSM page */
+		addr = fsm_get_location(blkno, &slot);
+		fsm_raise_upper(rel, addr, new_cat);
+
+		blkno = fsm_get_heap_blk(addr, SlotsPerFSMPage - 1) + 1;
+	}
+}
+
 /*
  * GetRecordedFreePage - return the amount of free space on a particular page,
  *		according to the FSM.
@@ -633,6 +664,33 @@ fsm_set_and_search(Relation rel, FSMAddress addr, uint16 slot,
 	return newslot;
 }
 
+/*
+ * Raise the slots pointing to the given FSM page in all its ancestors to at
+ * least new_cat.  Slots that already advertise more are left alone.
+ */
+static void
+fsm_raise_upper(Relation rel, FSMAddress addr, uint8 new_cat)
+{
+	while (addr.level != FSM_ROOT_LEVEL)
+	{
+		Buffer		buf;
+		Page		page;
+		uint16		parentslot;
+
+		addr = fsm_get_parent(addr, &parentslot);
+
+		buf = fsm_readbuf(rel, addr, true);
+		LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+		page = BufferGetPage(buf);
+
+		if (fsm_get_avail(page, parentslot) < new_cat &&
+			fsm_set_avail(page, parentslot, new_cat))
+			MarkBufferDirtyHint(buf, false);
+
+		UnlockReleaseBuffer(buf);
+	}
+}
+
 /*
  * Search the tree for a heap page with at least min_cat of free space
  */
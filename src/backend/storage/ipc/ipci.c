@@ -21,12 +21,15 @@
 
 #include "access/clog.h"
 #include "access/commit_ts.h"
+#include "access/csnlog.h"
+#include "access/gtm.h"
 #include "access/heapam.h"
 #include "access/multixact.h"
 #include "access/nbtree.h"
 #include "access/subtrans.h"
 #include "access/twophase.h"
 #include "commands/async.h"
+#include "commands/sequence.h"
 #include "miscadmin.h"
 #include "pgstat.h"
 #ifdef PGXC
@@ -52,7 +55,11 @@
 #include "storage/sinvaladt.h"
 #include "storage/spin.h"
 #ifdef XCP
+#include "pgxc/admission.h"
+#include "pgxc/resultcache.h"
+#include "pgxc/locator.h"
 #include "pgxc/pgxc.h"
+#include "pgxc/pgxcnode.h"
 #include "pgxc/squeue.h"
 #include "pgxc/pause.h"
 #endif
@@ -152,7 +159,17 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 		if (IS_PGXC_DATANODE)
 			size = add_size(size, SharedQueueShmemSize());
 		if (IS_PGXC_COORDINATOR)
+		{
 			size = add_size(size, ClusterLockShmemSize());
+			size = add_size(size, LocatorCacheShmemSize());
+			size = add_size(size, AdmissionShmemSize());
+			size = add_size(size, ResultCacheShmemSize());
+		}
+		size = add_size(size, PGXCNodeStatsShmemSize());
+		size = add_size(size, CSNLogShmemSize());
+		size = add_size(size, SequenceCacheShmemSize());
+		size = add_size(size, GTMClockShmemSize());
+		size = add_size(size, GlobalXminShmemSize());
 #endif
 		size = add_size(size, BTreeShmemSize());
 		size = add_size(size, SyncScanShmemSize());
@@ -273,7 +290,17 @@ CreateSharedMemoryAndSemaphores(bool makePrivate, int port)
 	if (IS_PGXC_DATANODE)
 		SharedQueuesInit();
 	if (IS_PGXC_COORDINATOR)
+	{
 		ClusterLockShmemInit();
+		LocatorCacheShmemInit();
+		AdmissionShmemInit();
+		ResultCacheShmemInit();
+	}
+	PGXCNodeStatsShmemInit();
+	CSNLogShmemInit();
+	SequenceCacheShmemInit();
+	GTMClockShmemInit();
+	GlobalXminShmemInit();
 #endif
 
 	/*
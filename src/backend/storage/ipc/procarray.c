@@ -77,7 +77,9 @@
 #ifdef PGXC
 #include "pgxc/pgxc.h"
 #include "access/gtm.h"
+#include "access/csnlog.h"
 #include "storage/ipc.h"
+#include "storage/lmgr.h"
 /* PGXC_DATANODE */
 #include "postmaster/autovacuum.h"
 #endif
@@ -197,6 +199,16 @@ GlobalSnapshotData globalSnapshot = {
 };
 
 static void GetSnapshotFromGlobalSnapshot(Snapshot snapshot);
+
+/* GUC: single-node read-only statements take local snapshots */
+bool		single_node_snapshots = false;
+
+/* The current statement of the Coordinator takes local snapshots */
+static bool statementLocalSnapshots = false;
+
+#define LocalSnapshotsAllowed() \
+	(statementLocalSnapshots || \
+	 globalSnapshot.snapshot_source == SNAPSHOT_LOCAL)
 static void GetSnapshotDataFromGTM(Snapshot snapshot);
 #endif
 
@@ -1450,8 +1462,20 @@ GetSnapshotData(Snapshot snapshot)
 	 * !!TODO We don't seem to fully support Hot Standby. So why should we even
 	 * exempt RecoveryInProgress()?
 	 */
-	if (IsPostmasterEnvironment && !useLocalXid)
+	if (IsPostmasterEnvironment && !useLocalXid && !LocalSnapshotsAllowed())
 		elog(ERROR, "Was unable to obtain a snapshot from GTM.");
+
+	/*
+	 * GTM does not know about a local snapshot, the backends of the node
+	 * taking their horizon from GTM have to keep what it sees.
+	 */
+	if (IsPostmasterEnvironment && !useLocalXid &&
+		!(MyPgXact->vacuumFlags & PROC_IN_LOCAL_SNAPSHOT))
+	{
+		LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
+		MyPgXact->vacuumFlags |= PROC_IN_LOCAL_SNAPSHOT;
+		LWLockRelease(ProcArrayLock);
+	}
 #endif
 
 	/*
@@ -1669,6 +1693,22 @@ GetSnapshotData(Snapshot snapshot)
 		NormalTransactionIdPrecedes(replication_slot_xmin, RecentGlobalXmin))
 		RecentGlobalXmin = replication_slot_xmin;
 
+#ifdef PGXC
+	/*
+	 * The transactions of the cluster which did not reach this node yet are
+	 * not in the procarray, the horizon can not pass the global xmin.
+	 */
+	if (IsPostmasterEnvironment && !useLocalXid)
+	{
+		TransactionId gxmin = GlobalXminGet();
+
+		if (!TransactionIdIsNormal(gxmin))
+			RecentGlobalXmin = FirstNormalTransactionId;
+		else if (TransactionIdPrecedes(gxmin, RecentGlobalXmin))
+			RecentGlobalXmin = gxmin;
+	}
+#endif
+
 	/* Non-catalog tables can be vacuumed if older than this xid */
 	RecentGlobalDataXmin = RecentGlobalXmin;
 
@@ -3051,6 +3091,35 @@ UnsetGlobalSnapshotData(void)
 }
 
 
+/*
+ * Let the current statement take local snapshots, or stop it. The
+ * Coordinator then tells the Datanode to take a local snapshot too instead
+ * of sending its own, see single_node_snapshots.
+ *
+ * A statement planned with a local snapshot may turn out to need GTM. The
+ * local snapshots it took are no longer used then, so it stops holding back
+ * the RecentGlobalXmin of the other backends right away.
+ */
+void
+SetStatementLocalSnapshots(bool value)
+{
+	if (!value && statementLocalSnapshots &&
+		(MyPgXact->vacuumFlags & PROC_IN_LOCAL_SNAPSHOT))
+	{
+		InvalidateCatalogSnapshot();
+		LWLockAcquire(ProcArrayLock, LW_EXCLUSIVE);
+		MyPgXact->vacuumFlags &= ~PROC_IN_LOCAL_SNAPSHOT;
+		LWLockRelease(ProcArrayLock);
+	}
+	statementLocalSnapshots = value;
+}
+
+bool
+StatementLocalSnapshots(void)
+{
+	return statementLocalSnapshots;
+}
+
 /*
  * Entry of snapshot obtention for Postgres-XC node
  */
@@ -3062,7 +3131,20 @@ GetPGXCSnapshotData(Snapshot snapshot)
 	 * snapshot has to be taken directly from WAL information.
 	 */
 	if (RecoveryInProgress())
+	{
+		/*
+		 * The sessions of a hot standby Coordinator read the Datanodes, which
+		 * only know the transactions of GTM, so they take their snapshots
+		 * from GTM as well.
+		 */
+		if (IS_PGXC_LOCAL_COORDINATOR && IsPostmasterEnvironment &&
+			IsNormalProcessingMode() && MyBackendId != InvalidBackendId)
+		{
+			GetSnapshotDataFromGTM(snapshot);
+			return true;
+		}
 		return false;
+	}
 
 	/*
 	 * The typical case is that the local Coordinator passes down the snapshot to the
@@ -3079,6 +3161,8 @@ GetPGXCSnapshotData(Snapshot snapshot)
 	{
 		if (globalSnapshot.snapshot_source == SNAPSHOT_COORDINATOR)
 			GetSnapshotFromGlobalSnapshot(snapshot);
+		else if (globalSnapshot.snapshot_source == SNAPSHOT_LOCAL)
+			return false;
 		else
 		{
 			elog(WARNING, "Expected to see a snapshot sent by the coordinator "
@@ -3087,7 +3171,7 @@ GetPGXCSnapshotData(Snapshot snapshot)
 		}
 		return true;
 	}
-	else if (IsPostmasterEnvironment)
+	else if (IsPostmasterEnvironment && !statementLocalSnapshots)
 	{
 		GetSnapshotDataFromGTM(snapshot);
 		return true;
@@ -3096,10 +3180,58 @@ GetPGXCSnapshotData(Snapshot snapshot)
 	return false;
 }
 
+/*
+ * Wait for the transactions prepared on this Datanode that the snapshot sent
+ * by the Coordinator sees committed. With async_commit_prepared GTM commits
+ * a transaction before COMMIT PREPARED completes on the nodes, a statement
+ * seeing it committed must not miss its changes here. Called once at the
+ * start of the statements of the Coordinator, not by the snapshot code: the
+ * transactions waited for are recorded, sent to the Coordinator and reported
+ * to GTM with the commit like any other, see TransactionRecordXidWait.
+ *
+ * The local snapshots of single_node_snapshots do not wait, they do not see
+ * a prepared transaction committed.
+ */
+void
+WaitForPreparedCommits(void)
+{
+	TransactionId *xids;
+	int			nxids;
+	int			i;
+
+	if (globalSnapshot.snapshot_source != SNAPSHOT_COORDINATOR)
+		return;
+
+	nxids = GetPreparedTransactionXids(&xids);
+	for (i = 0; i < nxids; i++)
+	{
+		TransactionId xid = xids[i];
+		int			j;
+		bool		running = false;
+
+		if (!TransactionIdIsNormal(xid) ||
+			TransactionIdFollowsOrEquals(xid, globalSnapshot.gxmax))
+			continue;
+		for (j = 0; j < globalSnapshot.gxcnt; j++)
+		{
+			if (TransactionIdEquals(xid, globalSnapshot.gxip[j]))
+			{
+				running = true;
+				break;
+			}
+		}
+		if (!running)
+			XactLockTableWait(xid, NULL, NULL, XLTW_None);
+	}
+	if (xids)
+		pfree(xids);
+}
+
 static void
 GetSnapshotDataFromGTM(Snapshot snapshot)
 {
 	GTM_Snapshot gtm_snapshot;
+	GlobalTransactionId gxid;
 	bool canbe_grouped = (!FirstSnapshotSet) || (!IsolationUsesXactSnapshot());
 
 	/*
@@ -3129,10 +3261,47 @@ GetSnapshotDataFromGTM(Snapshot snapshot)
 	 * establishment or auto-analyze scans. Nevertheless, we MUST fix this
 	 * before going to production release
 	 */ 
-	if (IS_PGXC_LOCAL_COORDINATOR)
-		gtm_snapshot = GetSnapshotGTM(GetCurrentTransactionId(), canbe_grouped);
+	if (IS_PGXC_LOCAL_COORDINATOR && RecoveryInProgress())
+		gxid = GetStandbyGlobalTransactionId();
+	else if (IS_PGXC_LOCAL_COORDINATOR)
+	{
+		/*
+		 * A transaction starting on GTM right now can get its GXID and first
+		 * snapshot in a single round trip. Copy the snapshot out before the
+		 * GXID is assigned, BeginTranGTM then hands it out locally.
+		 */
+		if (!TransactionIdIsValid(GetTopTransactionIdIfAny()) &&
+			!gtm_csn_snapshots && !useLocalXid && !IsInParallelMode() &&
+			!(gtm_standby_snapshots && XactReadOnly) &&
+			!(MyPgXact->vacuumFlags & PROC_IN_VACUUM) &&
+			(gtm_snapshot = BeginTranSnapshotGTM()) != NULL)
+		{
+			RecentGlobalXmin = gtm_snapshot->sn_recent_global_xmin;
+			RecentGlobalDataXmin = RecentGlobalXmin;
+			SetGlobalSnapshotData(gtm_snapshot->sn_xmin, gtm_snapshot->sn_xmax,
+					gtm_snapshot->sn_xcnt, gtm_snapshot->sn_xip, SNAPSHOT_DIRECT);
+			(void) GetCurrentTransactionId();
+			GetSnapshotFromGlobalSnapshot(snapshot);
+			return;
+		}
+		gxid = GetCurrentTransactionId();
+	}
 	else
-		gtm_snapshot = GetSnapshotGTM(GetCurrentTransactionIdIfAny(), canbe_grouped);
+		gxid = GetCurrentTransactionIdIfAny();
+
+	/*
+	 * Try a commit sequence number snapshot first, GTM hands them out without
+	 * scanning its open transactions. It can not always be resolved locally
+	 * though, then request a regular one.
+	 */
+	gtm_snapshot = NULL;
+	if (gtm_csn_snapshots)
+		gtm_snapshot = GetCSNSnapshotData(gxid, !FirstSnapshotSet);
+	if (!gtm_snapshot && gtm_standby_snapshots && XactReadOnly &&
+		TransactionIdIsValid(gxid))
+		gtm_snapshot = GetSnapshotGTMReadOnly(gxid);
+	if (!gtm_snapshot)
+		gtm_snapshot = GetSnapshotGTM(gxid, canbe_grouped);
 
 	
 	if (!gtm_snapshot)
@@ -3217,6 +3386,10 @@ GetSnapshotFromGlobalSnapshot(Snapshot snapshot)
 
 		RecentXmin = globalSnapshot.gxmin;
 
+		/* Catch up with the newest global xmin the node heard of */
+		RecentGlobalXmin = GlobalXminAdvance(RecentGlobalXmin,
+											 globalSnapshot.gxmin);
+
 		/* PGXCTODO - set this until we handle subtransactions. */
 		snapshot->subxcnt = 0;
 
@@ -3244,6 +3417,16 @@ GetSnapshotFromGlobalSnapshot(Snapshot snapshot)
 			volatile PGPROC *proc = &allProcs[pgprocno];
 			volatile PGXACT *pgxact = &allPgXact[pgprocno];
 
+			/* GTM does not know the xmin of a local snapshot */
+			if (pgxact->vacuumFlags & PROC_IN_LOCAL_SNAPSHOT)
+			{
+				TransactionId xid = pgxact->xmin;	/* fetch just once */
+
+				if (TransactionIdIsNormal(xid) &&
+					TransactionIdPrecedes(xid, RecentGlobalXmin))
+					RecentGlobalXmin = xid;
+			}
+
 			/* Do that only for an autovacuum process */
 			if (pgxact->vacuumFlags & PROC_IS_AUTOVACUUM)
 			{
@@ -65,6 +65,12 @@
 
 #include "postgres.h"
 
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
 #include "access/transam.h"
 #include "miscadmin.h"
 #include "storage/lwlock.h"
@@ -73,6 +79,16 @@
 #include "storage/spin.h"
 
 
+/*
+ * NUMA memory policies are set with the system calls directly, there being
+ * nothing to gain from a dependency on libnuma for the two we need.
+ */
+#if defined(SYS_mbind) && defined(SYS_get_mempolicy) && defined(SYS_getcpu)
+#define USE_NUMA_POLICY
+#define NUMA_MAX_NODES	1024
+#define NUMA_MASK_WORDS (NUMA_MAX_NODES / (8 * sizeof(unsigned long)))
+#endif
+
 /* shared memory global variables */
 
 static PGShmemHeader *ShmemSegHdr;		/* shared mem segment header */
@@ -218,6 +234,84 @@ ShmemAddrIsValid(const void *addr)
 	return (addr >= ShmemBase) && (addr < ShmemEnd);
 }
 
+#ifdef USE_NUMA_POLICY
+/*
+ * Apply a NUMA memory policy to the whole pages of a shared memory area.
+ * mbind() wants a page-aligned start, and we must not change the policy of
+ * pages partly belonging to something else.
+ */
+static bool
+shmem_numa_mbind(void *ptr, Size size, int mode, unsigned long *nodes,
+				 unsigned flags)
+{
+	Size		pagesize = (Size) sysconf(_SC_PAGESIZE);
+	char	   *start = (char *) TYPEALIGN(pagesize, ptr);
+	char	   *end = (char *) TYPEALIGN_DOWN(pagesize, (char *) ptr + size);
+
+	if (end <= start)
+		return true;
+
+	/* the kernel reads one bit less of the node mask than maxnode says */
+	return syscall(SYS_mbind, start, (unsigned long) (end - start), mode,
+				   nodes, (unsigned long) NUMA_MAX_NODES + 1, flags) == 0;
+}
+#endif
+
+/*
+ * ShmemNumaInterleave -- spread the pages of a shared memory area
+ *		round-robin over the NUMA nodes this process may allocate memory on.
+ *
+ * To have an effect, this must be called before the pages are first touched.
+ * Returns false if the platform can't do it or the kernel refused.
+ */
+bool
+ShmemNumaInterleave(void *ptr, Size size)
+{
+#ifdef USE_NUMA_POLICY
+	unsigned long nodes[NUMA_MASK_WORDS];
+	int			mode;
+
+	memset(nodes, 0, sizeof(nodes));
+	if (syscall(SYS_get_mempolicy, &mode, nodes,
+				(unsigned long) NUMA_MAX_NODES, NULL,
+				(unsigned long) MPOL_F_MEMS_ALLOWED) != 0)
+		return false;
+
+	return shmem_numa_mbind(ptr, size, MPOL_INTERLEAVE, nodes, 0);
+#else
+	return false;
+#endif
+}
+
+/*
+ * ShmemNumaBindLocal -- prefer the NUMA node this process runs on for the
+ *		pages of a shared memory area.
+ *
+ * Pages not yet touched will be allocated there, and the kernel moves those
+ * already allocated elsewhere if no other process has them mapped.  Returns
+ * false if the platform can't do it or the kernel refused.
+ */
+bool
+ShmemNumaBindLocal(void *ptr, Size size)
+{
+#ifdef USE_NUMA_POLICY
+	unsigned long nodes[NUMA_MASK_WORDS];
+	unsigned	cpu,
+				node;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0 || node >= NUMA_MAX_NODES)
+		return false;
+
+	memset(nodes, 0, sizeof(nodes));
+	nodes[node / (8 * sizeof(unsigned long))] |=
+		1UL << (node % (8 * sizeof(unsigned long)));
+
+	return shmem_numa_mbind(ptr, size, MPOL_PREFERRED, nodes, MPOL_MF_MOVE);
+#else
+	return false;
+#endif
+}
+
 /*
  *	InitShmemIndex() --- set up or attach to shmem index table.
  */
@@ -68,6 +68,7 @@
 #include "postmaster/autovacuum.h"
 #include "postmaster/postmaster.h"
 #include "replication/slot.h"
+#include "replication/walreceiver.h"
 #include "replication/walsender.h"
 #include "rewrite/rewriteHandler.h"
 #include "storage/bufmgr.h"
@@ -104,8 +105,11 @@
 #include "pgxc/squeue.h"
 #endif
 #include "commands/copy.h"
+#include "optimizer/clauses.h"
+#include "pgxc/locator.h"
 /* PGXC_DATANODE */
 #include "access/transam.h"
+#include "utils/builtins.h"
 #endif
 extern int	optind;
 
@@ -179,6 +183,23 @@ static bool DoingCommandRead = false;
 static bool doing_extended_query_message = false;
 static bool ignore_till_sync = false;
 
+#ifdef PGXC
+/*
+ * Xids of the last snapshot received from the parent node, sorted. The next
+ * snapshot may come as a difference to it, see exec_snapshot_message.
+ * received_xcnt is -1 if there is no snapshot to apply a difference to.
+ */
+static TransactionId *received_xip = NULL;
+static int	received_xcnt = -1;
+static int	received_xip_size = 0;
+
+/*
+ * A standby asked for a local snapshot by the Coordinator reports how far
+ * it is behind its Datanode when the command is done, see send_standby_lag.
+ */
+static bool report_standby_lag = false;
+#endif
+
 /*
  * If an unnamed prepared statement exists, it's stored here.
  * We keep it separate from the hashtable kept by commands/prepare.c
@@ -423,6 +444,7 @@ SocketBackend(StringInfo inBuf)
 				 *    producers immediately
 				 */
 				int activePortals = -1;
+				SharedQueue pausedQueue = NULL;
 				ListCell   *lc = list_head(getProducingPortals());
 				while (lc)
 				{
@@ -441,6 +463,7 @@ SocketBackend(StringInfo inBuf)
 						/* Portal is paused */
 						if (activePortals < 0)
 							activePortals = 0;
+						pausedQueue = PortalGetQueryDesc(p)->squeue;
 					}
 					else if (result > 0)
 					{
@@ -459,8 +482,12 @@ SocketBackend(StringInfo inBuf)
 				else if (activePortals == 0)
 				{
 					/* all producers are paused, sleep a little to allow other
-					 * processes to go */
-					pg_usleep(10000L);
+					 * processes to go. Wake up earlier if consumers of a
+					 * paused producer have drained their queues */
+					if (pausedQueue)
+						(void) SharedQueueWaitCredit(pausedQueue, 10L);
+					else
+						pg_usleep(10000L);
 				}
 			}
 			else if (qtype == 1)
@@ -484,6 +511,22 @@ SocketBackend(StringInfo inBuf)
 		 */
 		qtype = pq_getbyte();
 	}
+
+	/*
+	 * Other nodes may send a batch of messages compressed, see
+	 * remote_compression_threshold. Unpack them and handle the first one.
+	 */
+	while (qtype == PQ_PACKED_MSG_TYPE &&
+		   (IsConnFromCoord() || IsConnFromDatanode()))
+	{
+		if (pq_getmessage(inBuf, 0) || pq_inflatemessage(inBuf))
+		{
+			qtype = EOF;
+			break;
+		}
+		pq_startmsgread();
+		qtype = pq_getbyte();
+	}
 #else
 	qtype = pq_getbyte();
 #endif
@@ -582,6 +625,8 @@ SocketBackend(StringInfo inBuf)
 		case 'B':				/* bind */
 #ifdef XCP /* PGXC_DATANODE */
 		case 'p':				/* plan */
+		case 'r':				/* rescan */
+		case 'J':				/* join filter */
 #endif
 		case 'C':				/* close */
 		case 'D':				/* describe */
@@ -622,6 +667,7 @@ SocketBackend(StringInfo inBuf)
 		case 'M':				/* Command ID */
 		case 'g':				/* GXID */
 		case 's':				/* Snapshot */
+		case 'z':				/* Snapshot difference */
 		case 't':				/* Timestamp */
 		case 'b':				/* Barrier */
 			break;
@@ -1044,6 +1090,91 @@ pg_plan_queries(List *querytrees, int cursorOptions, ParamListInfo boundParams)
 }
 
 
+#ifdef XCP
+/*
+ * single_node_snapshot_candidate
+ *
+ * Whether a raw statement received by the Coordinator may run with local
+ * snapshots, before it is planned. It has to be a plain SELECT starting its
+ * own transaction, its first snapshot being then used for planning only.
+ */
+static bool
+single_node_snapshot_candidate(Node *parsetree)
+{
+	SelectStmt *stmt;
+
+	if (!single_node_snapshots || !IS_PGXC_LOCAL_COORDINATOR)
+		return false;
+
+	if (IsTransactionBlock() || IsolationUsesXactSnapshot() ||
+		TransactionIdIsValid(GetTopTransactionIdIfAny()))
+		return false;
+
+	if (!IsA(parsetree, SelectStmt))
+		return false;
+
+	stmt = (SelectStmt *) parsetree;
+	return stmt->intoClause == NULL && stmt->lockingClause == NIL;
+}
+
+/*
+ * single_node_snapshot_query
+ *
+ * Whether a planned statement may run with local snapshots: a read-only
+ * query shipped as a whole to a single Datanode. That Datanode sees
+ * everything it has to see, the snapshot it takes itself is enough.
+ */
+static bool
+single_node_snapshot_query(List *querytree_list, List *plantree_list)
+{
+	Query	   *query;
+	PlannedStmt *stmt;
+	RemoteSubplan *rs;
+	RemoteQuery *rq;
+	ExecNodes  *en;
+
+	if (list_length(querytree_list) != 1 || list_length(plantree_list) != 1)
+		return false;
+
+	query = (Query *) linitial(querytree_list);
+	stmt = (PlannedStmt *) linitial(plantree_list);
+	if (!IsA(stmt, PlannedStmt) || stmt->commandType != CMD_SELECT ||
+		stmt->hasModifyingCTE || stmt->rowMarks != NIL ||
+		stmt->subplans != NIL)
+		return false;
+
+	/* a volatile function may write */
+	if (contain_volatile_functions((Node *) query))
+		return false;
+
+	/* the plan of a SELECT is usually a RemoteSubplan fetching the rows */
+	if (IsA(stmt->planTree, RemoteSubplan))
+	{
+		rs = (RemoteSubplan *) stmt->planTree;
+		if (rs->scan.plan.initPlan != NIL ||
+			plan_has_remote_nodes(outerPlan(rs)))
+			return false;
+		/* replicated tables are read on any node */
+		return !rs->execOnAll || list_length(rs->nodeList) == 1;
+	}
+
+	if (!IsA(stmt->planTree, RemoteQuery))
+		return false;
+	rq = (RemoteQuery *) stmt->planTree;
+	if (rq->scan.plan.initPlan != NIL || !rq->read_only || rq->cursor ||
+		rq->exec_type != EXEC_ON_DATANODES)
+		return false;
+
+	/* the nodes are known in advance, and only one of them is used */
+	en = rq->exec_nodes;
+	if (en == NULL || en->en_expr != NULL)
+		return false;
+	return list_length(en->nodeList) == 1 ||
+		(IsLocatorReplicated(en->baselocatortype) &&
+		 en->accesstype == RELATION_ACCESS_READ);
+}
+#endif
+
 /*
  * exec_simple_query
  *
@@ -1086,6 +1217,17 @@ exec_simple_query(const char *query_string)
 	 */
 	start_xact_command();
 
+#ifdef XCP
+	/*
+	 * Wait for the transactions the snapshot of the Coordinator sees
+	 * committed while COMMIT PREPARED is still running here, see
+	 * async_commit_prepared.
+	 */
+	if (IS_PGXC_DATANODE && IsConnFromCoord() &&
+		!IsAbortedTransactionBlockState())
+		WaitForPreparedCommits();
+#endif
+
 	/*
 	 * Zap any pre-existing unnamed statement.  (While not strictly necessary,
 	 * it seems best to define simple-Query mode as if it used the unnamed
@@ -1217,6 +1359,12 @@ exec_simple_query(const char *query_string)
 		/* If we got a cancel signal in parsing or prior command, quit */
 		CHECK_FOR_INTERRUPTS();
 
+#ifdef XCP
+		/* A plain query may not need GTM, see single_node_snapshots */
+		SetStatementLocalSnapshots(isTopLevel &&
+								   single_node_snapshot_candidate(parsetree));
+#endif
+
 		/*
 		 * Set up a snapshot if parse analysis/planning will need one.
 		 */
@@ -1243,6 +1391,12 @@ exec_simple_query(const char *query_string)
 		if (snapshot_set)
 			PopActiveSnapshot();
 
+#ifdef XCP
+		if (StatementLocalSnapshots() &&
+			!single_node_snapshot_query(querytree_list, plantree_list))
+			SetStatementLocalSnapshots(false);
+#endif
+
 		/* If we got a cancel signal in analysis or planning, quit */
 		CHECK_FOR_INTERRUPTS();
 
@@ -1719,7 +1873,8 @@ exec_plan_message(const char *query_string,	/* source of the query */
 				  const char *stmt_name,		/* name for prepared stmt */
 				  const char *plan_string,		/* encoded plan to execute */
 				  char **paramTypeNames,	/* parameter type names */
-				  int numParams)		/* number of parameters */
+				  int numParams,		/* number of parameters */
+				  bool persistent)		/* keep after end of transaction */
 {
 	MemoryContext oldcontext;
 	bool		save_log_statement_stats = log_statement_stats;
@@ -1791,6 +1946,13 @@ exec_plan_message(const char *query_string,	/* source of the query */
 	/* If we got a cancel signal, quit */
 	CHECK_FOR_INTERRUPTS();
 
+	/*
+	 * Persistent statement is re-sent if the coordinator lost track of it,
+	 * replace the old copy then.
+	 */
+	if (persistent)
+		DropPreparedStatement(stmt_name, false);
+
 	psrc = CreateCachedPlan(NULL, query_string, stmt_name, "REMOTE SUBPLAN");
 
 	CompleteCachedPlan(psrc, NIL, NULL, paramTypes, numParams, NULL, NULL,
@@ -1798,8 +1960,10 @@ exec_plan_message(const char *query_string,	/* source of the query */
 
 	/*
 	 * Store the query as a prepared statement.  See above comments.
+	 * Persistent statement is not released at the end of transaction, the
+	 * coordinator is binding it again on subsequent executions.
 	 */
-	StorePreparedStatement(stmt_name, psrc, false, true);
+	StorePreparedStatement(stmt_name, psrc, false, !persistent);
 
 	SetRemoteSubplan(psrc, plan_string);
 
@@ -1843,6 +2007,418 @@ exec_plan_message(const char *query_string,	/* source of the query */
 
 	debug_query_string = NULL;
 }
+
+/*
+ * exec_rescan_message
+ *
+ * Process a "Rescan" message: restart a distributed portal with new values
+ * of the parameters evaluated by the parent node. The message has the name
+ * of the portal followed by parameter format codes and values like in Bind.
+ * Only values of PARAM_EXEC parameters are taken, PARAM_EXTERN parameters
+ * can not change while the query is running.
+ * A portal can be restarted that way if it executes a SELECT, not
+ * distributing results through a shared queue, and started with PARAM_EXEC
+ * parameters, which is the case of a parameterized remote subplan.
+ */
+static void
+exec_rescan_message(StringInfo input_message)
+{
+	const char *portal_name;
+	Portal		portal;
+	QueryDesc  *queryDesc;
+	PlannedStmt *stmt;
+	int			numPFormats;
+	int16	   *pformats = NULL;
+	int			numParams;
+	int			paramno;
+	Bitmapset  *chgParam = NULL;
+	MemoryContext oldContext;
+
+	portal_name = pq_getmsgstring(input_message);
+
+	ereport(DEBUG2,
+			(errmsg("rescan %s",
+					*portal_name ? portal_name : "<unnamed>")));
+
+	set_ps_display("RESCAN", false);
+
+	/* Portal can only exist in a transaction */
+	start_xact_command();
+
+	if (IsAbortedTransactionBlockState())
+		ereport(ERROR,
+				(errcode(ERRCODE_IN_FAILED_SQL_TRANSACTION),
+				 errmsg("current transaction is aborted, "
+						"commands ignored until end of transaction block")));
+
+	portal = GetPortalByName(portal_name);
+	if (!PortalIsValid(portal))
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_CURSOR),
+				 errmsg("portal \"%s\" does not exist", portal_name)));
+
+	queryDesc = PortalGetQueryDesc(portal);
+	stmt = queryDesc ? queryDesc->plannedstmt : NULL;
+	if (portal->strategy != PORTAL_DISTRIBUTED ||
+			portal->status != PORTAL_READY ||
+			queryDesc->operation != CMD_SELECT ||
+			queryDesc->squeue != NULL ||
+			stmt->nParamRemote == 0 ||
+			stmt->remoteparams[stmt->nParamRemote - 1].paramkind != PARAM_EXEC)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("portal \"%s\" can not be rescanned", portal_name)));
+
+	/* Get the parameter format codes */
+	numPFormats = pq_getmsgint(input_message, 2);
+	if (numPFormats > 0)
+	{
+		int			i;
+
+		pformats = (int16 *) palloc(numPFormats * sizeof(int16));
+		for (i = 0; i < numPFormats; i++)
+			pformats[i] = pq_getmsgint(input_message, 2);
+	}
+
+	/* Get the parameter value count */
+	numParams = pq_getmsgint(input_message, 2);
+
+	if (numPFormats > 1 && numPFormats != numParams)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+			errmsg("rescan message has %d parameter formats but %d parameters",
+				   numPFormats, numParams)));
+
+	if (numParams != stmt->nParamRemote)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("rescan message supplies %d parameters, but portal \"%s\" requires %d",
+						numParams, portal_name, stmt->nParamRemote)));
+
+	/*
+	 * Values of the previous scan are not needed any more, reuse the memory.
+	 * Input functions might need a snapshot.
+	 */
+	if (portal->paramContext)
+		MemoryContextReset(portal->paramContext);
+	else
+		portal->paramContext = AllocSetContextCreate(PortalGetHeapMemory(portal),
+													 "PortalParams",
+													 ALLOCSET_SMALL_MINSIZE,
+													 ALLOCSET_SMALL_INITSIZE,
+													 ALLOCSET_DEFAULT_MAXSIZE);
+	oldContext = MemoryContextSwitchTo(portal->paramContext);
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	for (paramno = 0; paramno < numParams; paramno++)
+	{
+		RemoteParam *rparam = &stmt->remoteparams[paramno];
+		ParamExecData *prmdata;
+		int32		plength;
+		Datum		pval;
+		bool		isNull;
+		StringInfoData pbuf;
+		char		csave;
+		int16		pformat;
+
+		plength = pq_getmsgint(input_message, 4);
+		isNull = (plength == -1);
+
+		/* External parameters are the same as they were bound */
+		if (rparam->paramkind != PARAM_EXEC)
+		{
+			if (!isNull)
+				(void) pq_getmsgbytes(input_message, plength);
+			continue;
+		}
+
+		if (numPFormats > 1)
+			pformat = pformats[paramno];
+		else if (numPFormats > 0)
+			pformat = pformats[0];
+		else
+			pformat = 0;	/* default = text */
+
+		if (isNull)
+			pval = (Datum) 0;
+		else
+		{
+			/* See exec_bind_message about scribbling on the message buffer */
+			pbuf.data = (char *) pq_getmsgbytes(input_message, plength);
+			pbuf.maxlen = plength + 1;
+			pbuf.len = plength;
+			pbuf.cursor = 0;
+
+			csave = pbuf.data[plength];
+			pbuf.data[plength] = '\0';
+
+			if (pformat == 0)	/* text mode */
+			{
+				Oid			typinput;
+				Oid			typioparam;
+				char	   *pstring;
+
+				getTypeInputInfo(rparam->paramtype, &typinput, &typioparam);
+
+				pstring = pg_client_to_server(pbuf.data, plength);
+				pval = OidInputFunctionCall(typinput, pstring, typioparam, -1);
+
+				/* Free result of encoding conversion, if any */
+				if (pstring != pbuf.data)
+					pfree(pstring);
+			}
+			else if (pformat == 1)		/* binary mode */
+			{
+				Oid			typreceive;
+				Oid			typioparam;
+
+				getTypeBinaryInputInfo(rparam->paramtype, &typreceive,
+									   &typioparam);
+
+				pval = OidReceiveFunctionCall(typreceive, &pbuf, typioparam,
+											  -1);
+
+				/* Trouble if it didn't eat the whole buffer */
+				if (pbuf.cursor != pbuf.len)
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							 errmsg("incorrect binary data format in rescan parameter %d",
+									paramno + 1)));
+			}
+			else
+			{
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("unsupported format code: %d",
+								pformat)));
+				pval = 0;		/* keep compiler quiet */
+			}
+
+			/* Restore message buffer contents */
+			pbuf.data[plength] = csave;
+		}
+
+		prmdata = &(queryDesc->estate->es_param_exec_vals[rparam->paramid]);
+		prmdata->value = pval;
+		prmdata->isnull = isNull;
+		prmdata->ptype = rparam->paramtype;
+		chgParam = bms_add_member(chgParam, rparam->paramid);
+	}
+
+	PopActiveSnapshot();
+	MemoryContextSwitchTo(oldContext);
+
+	pq_getmsgend(input_message);
+
+	PortalRescanDistributed(portal, chgParam);
+	bms_free(chgParam);
+
+	/*
+	 * Send BindComplete, the portal is ready to execute as if it was bound
+	 * again.
+	 */
+	if (whereToSendOutput == DestRemote)
+		pq_putemptymessage('2');
+}
+#endif
+
+#ifdef PGXC
+/*
+ * send_standby_lag
+ *
+ * Tell the Coordinator how old the data of this standby is ('L' message):
+ * milliseconds since the commit time of the last replayed transaction, zero
+ * if all the WAL received from the Datanode is replayed, -1 if the standby is
+ * not streaming from the Datanode.
+ */
+static void
+send_standby_lag(void)
+{
+	StringInfoData buf;
+	int			lag;
+
+	report_standby_lag = false;
+
+	if (!RecoveryInProgress() || !WalRcvStreaming())
+		lag = -1;
+	else if (GetXLogReplayRecPtr(NULL) >= GetWalRcvWriteRecPtr(NULL, NULL))
+		lag = 0;
+	else
+	{
+		TimestampTz latest = GetLatestXTime();
+		long		secs;
+		int			usecs;
+
+		if (latest == 0)
+			lag = -1;
+		else
+		{
+			TimestampDifference(latest, GetCurrentTimestamp(), &secs, &usecs);
+			lag = (int) Min(secs * 1000 + usecs / 1000, INT_MAX);
+		}
+	}
+
+	pq_beginmessage(&buf, 'L');
+	pq_sendint(&buf, lag, 4);
+	pq_endmessage(&buf);
+}
+
+/*
+ * exec_snapshot_message
+ *
+ * Process a "Snapshot" message ('s'), or a "Snapshot difference" message
+ * ('z'). Both have xmin, xmax and RecentGlobalXmin. The first is followed by
+ * the full list of running xids, the second by the list of xids not running
+ * anymore and the list of newly started xids, as compared to the previous
+ * snapshot received. If apply is false the snapshot is only remembered, that
+ * is used while skipping messages after an error, the parent does not know
+ * the messages were skipped and may send following snapshot as a difference.
+ */
+static void
+exec_snapshot_message(StringInfo input_message, bool delta, bool apply)
+{
+	TransactionId xmin;
+	TransactionId xmax;
+	TransactionId globalxmin;
+	int			xcnt;
+	int			i;
+
+	memcpy(&xmin, pq_getmsgbytes(input_message, sizeof (TransactionId)),
+		   sizeof (TransactionId));
+	memcpy(&xmax, pq_getmsgbytes(input_message, sizeof (TransactionId)),
+		   sizeof (TransactionId));
+	memcpy(&globalxmin, pq_getmsgbytes(input_message, sizeof (TransactionId)),
+		   sizeof (TransactionId));
+
+	if (delta)
+	{
+		int			nremoved;
+		int			nadded;
+		TransactionId *removed;
+		TransactionId *xip;
+		int			basecnt = received_xcnt;
+		int			j = 0,
+					k = 0;
+
+		if (basecnt < 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_PROTOCOL_VIOLATION),
+					 errmsg("snapshot difference received without a snapshot")));
+		/* not valid until completely received */
+		received_xcnt = -1;
+
+		/* xids not running anymore, they are removed from the list */
+		nremoved = pq_getmsgint(input_message, 4);
+		if (nremoved < 0 || nremoved > basecnt)
+			ereport(ERROR,
+					(errcode(ERRCODE_PROTOCOL_VIOLATION),
+					 errmsg("invalid snapshot difference")));
+		removed = (TransactionId *) palloc((nremoved + 1) * sizeof (TransactionId));
+		for (i = 0; i < nremoved; i++)
+			memcpy(&removed[i],
+				   pq_getmsgbytes(input_message, sizeof (TransactionId)),
+				   sizeof (TransactionId));
+		nadded = pq_getmsgint(input_message, 4);
+		if (nadded < 0 || nadded > (input_message->len - input_message->cursor) /
+				sizeof (TransactionId))
+			ereport(ERROR,
+					(errcode(ERRCODE_PROTOCOL_VIOLATION),
+					 errmsg("invalid snapshot difference")));
+
+		/*
+		 * Merge the sorted lists: copy the remaining xids and put the newly
+		 * started ones in order
+		 */
+		xcnt = basecnt - nremoved + nadded;
+		xip = (TransactionId *) palloc((xcnt + 1) * sizeof (TransactionId));
+		for (i = 0; i < basecnt; i++)
+		{
+			if (j < nremoved && removed[j] == received_xip[i])
+			{
+				j++;
+				continue;
+			}
+			xip[k++] = received_xip[i];
+		}
+		if (j < nremoved)
+			ereport(ERROR,
+					(errcode(ERRCODE_PROTOCOL_VIOLATION),
+					 errmsg("invalid snapshot difference")));
+		for (i = 0; i < nadded; i++)
+		{
+			TransactionId xid;
+			int			pos;
+
+			memcpy(&xid, pq_getmsgbytes(input_message, sizeof (TransactionId)),
+				   sizeof (TransactionId));
+			xip[k] = xid;
+			/* the added xids come sorted, so it is usually just appended */
+			for (pos = k; pos > 0 && xip[pos - 1] > xid; pos--)
+				xip[pos] = xip[pos - 1];
+			xip[pos] = xid;
+			k++;
+		}
+		Assert(k == xcnt);
+
+		if (received_xip_size < xcnt)
+		{
+			if (received_xip)
+				pfree(received_xip);
+			received_xip_size = Max(xcnt, 64);
+			received_xip = (TransactionId *)
+				MemoryContextAlloc(TopMemoryContext,
+								   received_xip_size * sizeof (TransactionId));
+		}
+		memcpy(received_xip, xip, xcnt * sizeof (TransactionId));
+		pfree(xip);
+		pfree(removed);
+	}
+	else
+	{
+		xcnt = pq_getmsgint(input_message, 4);
+		if (xcnt < 0 || xcnt > (input_message->len - input_message->cursor) /
+				sizeof (TransactionId))
+			ereport(ERROR,
+					(errcode(ERRCODE_PROTOCOL_VIOLATION),
+					 errmsg("invalid snapshot")));
+		if (received_xip_size < xcnt)
+		{
+			if (received_xip)
+				pfree(received_xip);
+			received_xip_size = Max(xcnt, 64);
+			received_xip = (TransactionId *)
+				MemoryContextAlloc(TopMemoryContext,
+								   received_xip_size * sizeof (TransactionId));
+		}
+		/* not valid until completely received */
+		received_xcnt = -1;
+		for (i = 0; i < xcnt; i++)
+			memcpy(&received_xip[i],
+				   pq_getmsgbytes(input_message, sizeof (TransactionId)),
+				   sizeof (TransactionId));
+		qsort(received_xip, xcnt, sizeof (TransactionId), xidComparator);
+	}
+	pq_getmsgend(input_message);
+	received_xcnt = xcnt;
+
+	if (apply)
+	{
+		/* An invalid xmin asks for a snapshot of the local procarray */
+		if (!delta && !TransactionIdIsValid(xmin))
+		{
+			SetGlobalSnapshotData(InvalidTransactionId, InvalidTransactionId,
+								  0, received_xip, SNAPSHOT_LOCAL);
+			if (RecoveryInProgress())
+				report_standby_lag = true;
+		}
+		else
+		{
+			RecentGlobalXmin = globalxmin;
+			SetGlobalSnapshotData(xmin, xmax, xcnt, received_xip,
+								  SNAPSHOT_COORDINATOR);
+		}
+	}
+}
 #endif
 
 /*
@@ -1917,6 +2493,17 @@ exec_bind_message(StringInfo input_message)
 	 */
 	start_xact_command();
 
+#ifdef XCP
+	/*
+	 * Wait for the transactions the snapshot of the Coordinator sees
+	 * committed while COMMIT PREPARED is still running here, see
+	 * async_commit_prepared.
+	 */
+	if (IS_PGXC_DATANODE && IsConnFromCoord() &&
+		!IsAbortedTransactionBlockState())
+		WaitForPreparedCommits();
+#endif
+
 	/* Switch back to message context */
 	MemoryContextSwitchTo(MessageContext);
 
@@ -4008,11 +4595,6 @@ PostgresMain(int argc, char *argv[],
 	volatile bool send_ready_for_query = true;
 
 #ifdef PGXC /* PGXC_DATANODE */
-	/* Snapshot info */
-	TransactionId 			xmin;
-	TransactionId 			xmax;
-	int						xcnt;
-	TransactionId 			*xip;
 	/* Timestamp info */
 	TimestampTz		timestamp;
 
@@ -4499,8 +5081,22 @@ PostgresMain(int argc, char *argv[],
 				pgstat_report_activity(STATE_IDLE, NULL);
 			}
 
+#ifdef PGXC
+			if (report_standby_lag)
+				send_standby_lag();
+#endif
 			ReadyForQuery(whereToSendOutput);
 #ifdef XCP
+			/*
+			 * The pooler reads the connection startup messages up to the
+			 * first ReadyForQuery, after that the connection is used by the
+			 * parent node, so we can start compressing the output.
+			 */
+			if (RemoteCompressionThreshold >= 0 &&
+				whereToSendOutput == DestRemote &&
+				(IsConnFromCoord() || IsConnFromDatanode()))
+				pq_setcompression(RemoteCompressionThreshold);
+
 			/*
 			 * Before we read any new command we now should wait while all
 			 * already closed portals which are still producing finish their
@@ -4508,6 +5104,13 @@ PostgresMain(int argc, char *argv[],
 			 */
 			if (IS_PGXC_DATANODE && IsConnFromDatanode())
 				cleanupClosedProducers();
+
+			/*
+			 * The client has got the commit, complete it on the remote nodes
+			 * while it processes the result, see async_commit_prepared.
+			 */
+			if (IsAsyncCommitPending())
+				FinishAsyncCommit();
 #endif
 #ifdef PGXC
 			/*
@@ -4517,6 +5120,7 @@ PostgresMain(int argc, char *argv[],
 			 */
 			if ((IS_PGXC_DATANODE || IsConnFromCoord()) && !IsAnyAfterTriggerDeferred())
 				UnsetGlobalSnapshotData();
+			SetStatementLocalSnapshots(false);
 #endif
 
 			send_ready_for_query = false;
@@ -4562,7 +5166,17 @@ PostgresMain(int argc, char *argv[],
 		 * Sync.
 		 */
 		if (ignore_till_sync && firstchar != EOF)
+		{
+#ifdef PGXC
+			/*
+			 * Keep track of skipped snapshots, the parent may send the next
+			 * one as a difference to them
+			 */
+			if (firstchar == 's' || firstchar == 'z')
+				exec_snapshot_message(&input_message, firstchar == 'z', false);
+#endif
 			continue;
+		}
 
 #ifdef XCP
 		/*
@@ -4652,6 +5266,7 @@ PostgresMain(int argc, char *argv[],
 					const char *plan_string;
 					int			numParams;
 					char 	  **paramTypes = NULL;
+					bool		persistent;
 
 					/* Set statement_timestamp() */
 					SetCurrentStatementStartTimestamp();
@@ -4668,10 +5283,31 @@ PostgresMain(int argc, char *argv[],
 							paramTypes[i] = (char *)
 									pq_getmsgstring(&input_message);
 					}
+					persistent = (pq_getmsgbyte(&input_message) != 0);
 					pq_getmsgend(&input_message);
 
 					exec_plan_message(query_string, stmt_name, plan_string,
-									  paramTypes, numParams);
+									  paramTypes, numParams, persistent);
+				}
+				break;
+
+			case 'r':			/* rescan */
+				/* Set statement_timestamp() */
+				SetCurrentStatementStartTimestamp();
+
+				exec_rescan_message(&input_message);
+				break;
+
+			case 'J':			/* join filter */
+				{
+					const char *portal_name;
+					JoinFilter *filter;
+
+					portal_name = pq_getmsgstring(&input_message);
+					filter = JoinFilterDeserialize(&input_message);
+					pq_getmsgend(&input_message);
+
+					SetPortalJoinFilter(portal_name, filter);
 				}
 				break;
 #endif
@@ -4897,38 +5533,11 @@ PostgresMain(int argc, char *argv[],
 
 			case 's':			/* snapshot */
 				/* Set the snapshot we were passed down */
-				memcpy(&xmin,
-						pq_getmsgbytes(&input_message, sizeof (TransactionId)),
-						sizeof (TransactionId));
-				memcpy(&xmax,
-						pq_getmsgbytes(&input_message, sizeof (TransactionId)),
-						sizeof (TransactionId));
-				memcpy(&RecentGlobalXmin,
-						pq_getmsgbytes(&input_message, sizeof (TransactionId)),
-						sizeof (TransactionId));
-				xcnt = pq_getmsgint(&input_message, 4);
-				if (xcnt > 0)
-				{
-					int i;
-					xip = palloc(xcnt * sizeof(TransactionId));
-					if (xip == NULL)
-					{
-						ereport(ERROR,
-								(errcode(ERRCODE_OUT_OF_MEMORY),
-								 errmsg("out of memory")));
-					}
-					for (i = 0; i < xcnt; i++)
-					       memcpy(&xip[i],
-								   pq_getmsgbytes(&input_message, sizeof (TransactionId)),
-								   sizeof (TransactionId));
-				}
-				else
-					xip = NULL;
-				pq_getmsgend(&input_message);
-				SetGlobalSnapshotData(xmin, xmax, xcnt, xip,
-						SNAPSHOT_COORDINATOR);
-				if (xip)
-					pfree(xip);
+				exec_snapshot_message(&input_message, false, true);
+				break;
+
+			case 'z':			/* snapshot difference */
+				exec_snapshot_message(&input_message, true, true);
 				break;
 
 			case 't':			/* timestamp */
@@ -4962,7 +5571,15 @@ PostgresMain(int argc, char *argv[],
 							break;
 
 						case CREATE_BARRIER_EXECUTE:
-							ProcessCreateBarrierExecute(id);
+							ProcessCreateBarrierExecute(id, true);
+							break;
+
+						case CREATE_BARRIER_INSERT:
+							ProcessCreateBarrierExecute(id, false);
+							break;
+
+						case CREATE_BARRIER_FLUSH:
+							ProcessCreateBarrierFlush(id);
 							break;
 
 						default:
@@ -70,6 +70,15 @@ static long DoPortalRunFetch(Portal portal,
 				 long count,
 				 DestReceiver *dest);
 static void DoPortalRewind(Portal portal);
+#ifdef XCP
+static void AttachJoinFilter(Portal portal, JoinFilter *filter);
+static void SetProducerAdaptiveLocator(QueryDesc *queryDesc,
+						   DestReceiver *dest, int len, int *consMap);
+
+/* Join filter received for a portal which is not bound yet */
+static char *PendingJoinFilterPortal = NULL;
+static JoinFilter *PendingJoinFilter = NULL;
+#endif
 
 /*
  * CreateQueryDesc
@@ -106,6 +115,7 @@ CreateQueryDesc(PlannedStmt *plannedstmt,
 #ifdef XCP
 	qd->squeue = NULL;
 	qd->myindex = -1;
+	qd->joinfilter = NULL;
 #endif
 
 	return qd;
@@ -679,10 +689,16 @@ PortalStart(Portal portal, ParamListInfo params,
 							consMap,
 							NULL,
 							false);
+					setLocatorBuckets(locator,
+							queryDesc->plannedstmt->distributionBuckets,
+							queryDesc->plannedstmt->distributionNodes);
+					setLocatorRanges(locator,
+							queryDesc->plannedstmt->distributionRanges);
 					dest = CreateDestReceiver(DestProducer);
 					SetProducerDestReceiverParams(dest,
 							queryDesc->plannedstmt->distributionKey,
 							locator, queryDesc->squeue);
+					SetProducerAdaptiveLocator(queryDesc, dest, len, consMap);
 					queryDesc->dest = dest;
 				}
 				else
@@ -690,13 +706,21 @@ PortalStart(Portal portal, ParamListInfo params,
 					int 	   *consMap;
 					int 		len;
 
-					/* Distributed data requested, bind shared queue for data exchange */
+					/*
+					 * Distributed data requested, bind shared queue for data
+					 * exchange. Consumers of a broadcast may read the same
+					 * data, unless producer may switch to distribution by key.
+					 */
 					len = list_length(queryDesc->plannedstmt->distributionNodes);
 					consMap = (int *) palloc(len * sizeof(int));
 					queryDesc->squeue = SharedQueueBind(portal->name,
 								queryDesc->plannedstmt->distributionRestrict,
 								queryDesc->plannedstmt->distributionNodes,
-								&queryDesc->myindex, consMap);
+								&queryDesc->myindex, consMap,
+								queryDesc->plannedstmt->distributionType ==
+									LOCATOR_TYPE_REPLICATED &&
+								queryDesc->plannedstmt->adaptiveKey ==
+									InvalidAttrNumber);
 					if (queryDesc->myindex == -1)
 					{
 						/* producer */
@@ -740,10 +764,17 @@ PortalStart(Portal portal, ParamListInfo params,
 								consMap,
 								NULL,
 								false);
+						setLocatorBuckets(locator,
+								queryDesc->plannedstmt->distributionBuckets,
+								queryDesc->plannedstmt->distributionNodes);
+						setLocatorRanges(locator,
+								queryDesc->plannedstmt->distributionRanges);
 						dest = CreateDestReceiver(DestProducer);
 						SetProducerDestReceiverParams(dest,
 								queryDesc->plannedstmt->distributionKey,
 								locator, queryDesc->squeue);
+						SetProducerAdaptiveLocator(queryDesc, dest, len,
+												   consMap);
 						queryDesc->dest = dest;
 
 						addProducingPortal(portal);
@@ -776,6 +807,16 @@ PortalStart(Portal portal, ParamListInfo params,
 				portal->portalPos = 0;
 				portal->posOverflow = false;
 
+				/* Apply the join filter sent for the portal, if any */
+				if (PendingJoinFilterPortal &&
+						strcmp(PendingJoinFilterPortal, portal->name) == 0)
+				{
+					AttachJoinFilter(portal, PendingJoinFilter);
+					pfree(PendingJoinFilterPortal);
+					PendingJoinFilterPortal = NULL;
+					PendingJoinFilter = NULL;
+				}
+
 				PopActiveSnapshot();
 				break;
 #endif
@@ -1251,6 +1292,11 @@ PortalRun(Portal portal, long count, bool isTopLevel,
 								break;
 							}
 						}
+						/* Do not send the rows the parent does not need */
+						if (queryDesc->joinfilter &&
+								!JoinFilterTestSlot(queryDesc->joinfilter, slot))
+							continue;
+
 						/*
 						 * Send the tuple
 						 */
@@ -2187,6 +2233,117 @@ DoPortalRewind(Portal portal)
 }
 
 #ifdef XCP
+/*
+ * PortalRescanDistributed
+ *		Restart execution of a distributed portal from the beginning.
+ *
+ * New values of the parameters listed in chgParam are already stored in the
+ * executor state. Plan nodes depending on them are re-executed by the rescan,
+ * other nodes may just rewind. That is cheaper than closing the portal and
+ * binding it again, the plan does not need to be initialized.
+ */
+void
+PortalRescanDistributed(Portal portal, Bitmapset *chgParam)
+{
+	QueryDesc  *queryDesc = PortalGetQueryDesc(portal);
+	MemoryContext oldcontext;
+
+	Assert(portal->strategy == PORTAL_DISTRIBUTED);
+	Assert(queryDesc);
+
+	/* ExecReScan frees the set, so it should be in the executor memory */
+	oldcontext = MemoryContextSwitchTo(queryDesc->estate->es_query_cxt);
+	queryDesc->planstate->chgParam = bms_union(queryDesc->planstate->chgParam,
+											   chgParam);
+	MemoryContextSwitchTo(oldcontext);
+
+	DoPortalRewind(portal);
+}
+
+/*
+ * Make the rows of the portal sent to the parent node pass the join filter,
+ * replacing the filter applied so far. NULL removes the filter.
+ */
+static void
+AttachJoinFilter(Portal portal, JoinFilter *filter)
+{
+	QueryDesc  *queryDesc = PortalGetQueryDesc(portal);
+
+	if (queryDesc->joinfilter)
+		JoinFilterFree(queryDesc->joinfilter);
+	if (filter)
+		MemoryContextSetParent(filter->jf_context,
+							   PortalGetHeapMemory(portal));
+	queryDesc->joinfilter = filter;
+
+	/* Rows produced for the parent do not go through the shared queue */
+	if (queryDesc->myindex == -1 && queryDesc->dest &&
+			queryDesc->dest->mydest == DestProducer)
+		SetProducerJoinFilter(queryDesc->dest, filter);
+}
+
+/*
+ * If the planner allowed producer to stop broadcasting after some number of
+ * rows set up the locator to distribute the rest by the key.
+ */
+static void
+SetProducerAdaptiveLocator(QueryDesc *queryDesc, DestReceiver *dest,
+						   int len, int *consMap)
+{
+	PlannedStmt *pstmt = queryDesc->plannedstmt;
+	Locator	   *locator;
+
+	if (pstmt->adaptiveKey == InvalidAttrNumber || pstmt->adaptiveRows <= 0)
+		return;
+
+	locator = createLocator(pstmt->adaptiveType,
+							RELATION_ACCESS_INSERT,
+							queryDesc->tupDesc->attrs[pstmt->adaptiveKey - 1]->atttypid,
+							LOCATOR_LIST_INT,
+							len,
+							consMap,
+							NULL,
+							false);
+	SetProducerAdaptiveParams(dest, pstmt->adaptiveKey, locator,
+							  pstmt->adaptiveRows);
+}
+
+/*
+ * Process the join filter the parent node sent for the portal, see
+ * joinFilter.c. If the portal is not bound yet the filter is applied once
+ * it is, only the latest filter is kept until then.
+ */
+void
+SetPortalJoinFilter(const char *portal_name, JoinFilter *filter)
+{
+	Portal		portal = GetPortalByName(portal_name);
+
+	if (PortalIsValid(portal) && portal->strategy == PORTAL_DISTRIBUTED &&
+			PortalGetQueryDesc(portal))
+	{
+		AttachJoinFilter(portal, filter);
+		return;
+	}
+
+	if (PendingJoinFilterPortal)
+	{
+		pfree(PendingJoinFilterPortal);
+		PendingJoinFilterPortal = NULL;
+	}
+	if (PendingJoinFilter)
+	{
+		JoinFilterFree(PendingJoinFilter);
+		PendingJoinFilter = NULL;
+	}
+	if (filter)
+	{
+		MemoryContextSetParent(filter->jf_context, TopMemoryContext);
+		PendingJoinFilterPortal = MemoryContextStrdup(TopMemoryContext,
+													  portal_name);
+		PendingJoinFilter = filter;
+	}
+}
+
 /*
  * Execute the specified portal's query and distribute tuples to consumers.
  * Returs 1 if portal should keep producing, 0 if all consumers have enough
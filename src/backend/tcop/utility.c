@@ -2257,8 +2257,14 @@ ProcessUtilitySlow(Node *parsetree,
 					{
 						RefreshMatViewStmt *stmt = (RefreshMatViewStmt *) parsetree;
 						if (stmt->relation->relpersistence != RELPERSISTENCE_TEMP)
+						{
 							ExecUtilityStmtOnNodes(queryString, NULL,
 									sentToRemote, false, EXEC_ON_COORDS, false);
+#ifdef XCP
+							/* All the Coordinators have applied the changes logged */
+							PurgeMatViewLog(address.objectId);
+#endif
+						}
 					}
 #endif
 				}
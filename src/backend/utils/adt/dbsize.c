@@ -28,6 +28,7 @@
 #include "commands/dbcommands.h"
 #include "commands/tablespace.h"
 #include "executor/spi.h"
+#include "funcapi.h"
 #include "miscadmin.h"
 #ifdef PGXC
 #include "pgxc/nodemgr.h"
@@ -1190,4 +1191,204 @@ pgxc_exec_sizefunc(Oid relOid, char *funcname, char *extra_arg)
 	return DatumGetInt64(pgxc_execute_on_nodes(numnodes, nodelist, buf.data));
 }
 
+
+/*
+ * pgxc_get_distribution
+ *	SQL SRF showing how the rows of a distributed table are spread over its
+ *	Datanodes, one row per node: the number of rows and the size of the
+ *	table on the node, and the ratio of the rows to the average of the
+ *	nodes. The nodes are queried in parallel with a single remote query.
+ *
+ *	For a table distributed by buckets it also shows the number of buckets
+ *	of the node and how many of them should move away from the node (or to
+ *	it, if negative) to even out the rows, assuming the rows of a node are
+ *	evenly spread over its buckets.
+ */
+Datum
+pgxc_get_distribution(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+	Relation	rel;
+	char	   *relname;
+	char		locatorType;
+	int			numnodes;
+	Oid		   *nodeoids;
+	int16	   *bucketmap;
+	int			nbuckets;
+	int		   *nodebuckets;
+	char	  **nodenames;
+	int64	   *rows;
+	int64	   *sizes;
+	bool	   *found;
+	int64		totalrows = 0;
+	double		avgrows;
+	StringInfoData buf;
+	RemoteQuery *plan;
+	RemoteQueryState *pstate;
+	EState	   *estate;
+	TupleTableSlot *result;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Only the coordinator knows the distribution */
+	if (!IS_PGXC_COORDINATOR)
+		return (Datum) 0;
+
+	rel = relation_open(relid, AccessShareLock);
+	if (rel->rd_locator_info == NULL)
+	{
+		relation_close(rel, AccessShareLock);
+		return (Datum) 0;
+	}
+	locatorType = rel->rd_locator_info->locatorType;
+	relname = quote_qualified_identifier(get_namespace_name(rel->rd_rel->relnamespace),
+										 RelationGetRelationName(rel));
+	relation_close(rel, AccessShareLock);
+
+	numnodes = get_pgxc_classnodes(relid, &nodeoids);
+	nbuckets = get_pgxc_classbuckets(relid, &bucketmap);
+
+	nodenames = (char **) palloc(numnodes * sizeof(char *));
+	nodebuckets = (int *) palloc0(numnodes * sizeof(int));
+	rows = (int64 *) palloc0(numnodes * sizeof(int64));
+	sizes = (int64 *) palloc0(numnodes * sizeof(int64));
+	found = (bool *) palloc0(numnodes * sizeof(bool));
+	for (i = 0; i < numnodes; i++)
+		nodenames[i] = get_pgxc_nodename(nodeoids[i]);
+	for (i = 0; i < nbuckets; i++)
+		if (bucketmap[i] >= 0 && bucketmap[i] < numnodes)
+			nodebuckets[bucketmap[i]]++;
+
+	/*
+	 * Every node reports its name along with the figures, the rows come
+	 * back in the order the nodes answer.
+	 */
+	initStringInfo(&buf);
+	appendStringInfo(&buf,
+					 "SELECT pg_catalog.pgxc_node_str(), pg_catalog.count(*), "
+					 "pg_catalog.pg_table_size(%s) FROM ONLY %s",
+					 quote_literal_cstr(relname), relname);
+
+	plan = makeNode(RemoteQuery);
+	plan->combine_type = COMBINE_TYPE_NONE;
+	plan->exec_nodes = makeNode(ExecNodes);
+	plan->exec_type = EXEC_ON_DATANODES;
+	for (i = 0; i < numnodes; i++)
+	{
+		char		ntype = PGXC_NODE_DATANODE;
+
+		plan->exec_nodes->nodeList = lappend_int(plan->exec_nodes->nodeList,
+								PGXCNodeGetNodeId(nodeoids[i], &ntype));
+	}
+	plan->sql_statement = buf.data;
+	plan->force_autocommit = false;
+	/* The target list only determines the types of the result */
+	plan->scan.plan.targetlist = list_make3(
+			makeTargetEntry((Expr *) makeVar(1, 1, NAMEOID, -1, InvalidOid, 0),
+							1, NULL, false),
+			makeTargetEntry((Expr *) makeVar(1, 2, INT8OID, -1, InvalidOid, 0),
+							2, NULL, false),
+			makeTargetEntry((Expr *) makeVar(1, 3, INT8OID, -1, InvalidOid, 0),
+							3, NULL, false));
+
+	estate = CreateExecutorState();
+	oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+	estate->es_snapshot = GetActiveSnapshot();
+	pstate = ExecInitRemoteQuery(plan, estate, 0);
+	MemoryContextSwitchTo(oldcontext);
+
+	result = ExecRemoteQuery(pstate);
+	while (!TupIsNull(result))
+	{
+		bool		isnull;
+		char	   *nodename;
+
+		nodename = NameStr(*DatumGetName(slot_getattr(result, 1, &isnull)));
+		for (i = 0; i < numnodes; i++)
+		{
+			if (!found[i] && strcmp(nodenames[i], nodename) == 0)
+			{
+				found[i] = true;
+				rows[i] = DatumGetInt64(slot_getattr(result, 2, &isnull));
+				sizes[i] = DatumGetInt64(slot_getattr(result, 3, &isnull));
+				totalrows += rows[i];
+				break;
+			}
+		}
+		result = ExecRemoteQuery(pstate);
+	}
+	ExecEndRemoteQuery(pstate);
+	FreeExecutorState(estate);
+
+	avgrows = numnodes > 0 ? (double) totalrows / numnodes : 0;
+
+	for (i = 0; i < numnodes; i++)
+	{
+		Datum		values[6];
+		bool		nulls[6];
+		NameData	nodename;
+
+		MemSet(nulls, 0, sizeof(nulls));
+		namestrcpy(&nodename, nodenames[i]);
+		values[0] = NameGetDatum(&nodename);
+		values[1] = Int64GetDatum(rows[i]);
+		values[2] = Int64GetDatum(sizes[i]);
+		if (avgrows > 0 && !IsLocatorReplicated(locatorType))
+			values[3] = Float8GetDatum(rows[i] / avgrows);
+		else
+			nulls[3] = true;
+		if (locatorType == LOCATOR_TYPE_BUCKET && nbuckets > 0)
+		{
+			double		bucketrows;
+			double		moves;
+
+			/* Rows of a bucket of the node, or of any bucket if it has none */
+			if (nodebuckets[i] > 0)
+				bucketrows = (double) rows[i] / nodebuckets[i];
+			else
+				bucketrows = (double) totalrows / nbuckets;
+
+			moves = bucketrows > 0 ? rint((rows[i] - avgrows) / bucketrows) : 0;
+			if (moves > nodebuckets[i])
+				moves = nodebuckets[i];
+			values[4] = Int32GetDatum(nodebuckets[i]);
+			values[5] = Int32GetDatum((int32) moves);
+		}
+		else
+		{
+			nulls[4] = true;
+			nulls[5] = true;
+		}
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
 #endif /* PGXC */
@@ -18,14 +18,24 @@
 #include "funcapi.h"
 #include "miscadmin.h"
 #ifdef PGXC
+#include "catalog/pgxc_node.h"
 #include "pgxc/pgxc.h"
 #include "pgxc/pgxcnode.h"
 #include "pgxc/nodemgr.h"
+#include "pgxc/execRemote.h"
+#include "executor/executor.h"
 #include "executor/spi.h"
+#include "nodes/makefuncs.h"
 #include "tcop/utility.h"
 #endif
 #include "storage/predicate_internals.h"
+#include "storage/proc.h"
+#include "storage/procarray.h"
 #include "utils/builtins.h"
+#ifdef PGXC
+#include "utils/lsyscache.h"
+#include "utils/snapmgr.h"
+#endif
 
 
 /* This must match enum LockTagType! */
@@ -422,6 +432,109 @@ pg_lock_status(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * Top-level transaction id of the process with the given pid, if any.
+ */
+static TransactionId
+BackendPidGetXid(int pid)
+{
+	PGPROC	   *proc = BackendPidGetProc(pid);
+
+	if (proc == NULL)
+		return InvalidTransactionId;
+	return ProcGlobal->allPgXact[proc->pgprocno].xid;
+}
+
+/*
+ * pg_lock_waits - produce the wait-for edges of the local lock manager
+ *
+ * One row per pair of a process waiting for a lock and a process holding
+ * a mode of the same lock that conflicts with the awaited one, with the
+ * transaction ids of both.  Processes queued ahead of the waiter are not
+ * reported, only holders.  Transaction ids being global in a cluster, the
+ * rows of all the Datanodes make up the wait-for graph of the cluster.
+ */
+Datum
+pg_lock_waits(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+	LockData   *lockData;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	lockData = GetLockStatusData();
+
+	for (i = 0; i < lockData->nelements; i++)
+	{
+		LockInstanceData *waiter = &lockData->locks[i];
+		LOCKMASK	conflicts;
+		TransactionId waiterXid;
+		int			j;
+
+		if (waiter->waitLockMode == NoLock)
+			continue;
+
+		conflicts = GetLockTagsMethodTable(&waiter->locktag)->conflictTab[waiter->waitLockMode];
+		waiterXid = BackendPidGetXid(waiter->pid);
+
+		for (j = 0; j < lockData->nelements; j++)
+		{
+			LockInstanceData *holder = &lockData->locks[j];
+			TransactionId holderXid;
+			Datum		values[4];
+			bool		nulls[4];
+
+			if (holder->pid == waiter->pid ||
+				(holder->holdMask & conflicts) == 0 ||
+				memcmp(&holder->locktag, &waiter->locktag, sizeof(LOCKTAG)) != 0)
+				continue;
+
+			holderXid = BackendPidGetXid(holder->pid);
+
+			MemSet(nulls, 0, sizeof(nulls));
+			values[0] = Int32GetDatum(waiter->pid);
+			if (TransactionIdIsValid(waiterXid))
+				values[1] = TransactionIdGetDatum(waiterXid);
+			else
+				nulls[1] = true;
+			values[2] = Int32GetDatum(holder->pid);
+			if (TransactionIdIsValid(holderXid))
+				values[3] = TransactionIdGetDatum(holderXid);
+			else
+				nulls[3] = true;
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+	}
+
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+
 /*
  * Functions for manipulating advisory locks
  *
@@ -1223,4 +1336,341 @@ pgxc_lock_for_utility_stmt(Node *parsetree)
 
 	return lockAcquired;
 }
+
+/*
+ * Global deadlock detection
+ *
+ * The lock manager of each node only sees the waits on that node, so a
+ * cycle of waits through several Datanodes is never detected: each wait is
+ * legitimate locally and lasts until lock_timeout or statement_timeout.
+ * pgxc_global_deadlock_check collects the wait-for edges of all Datanodes,
+ * which are labeled with global transaction ids, and looks for cycles in the
+ * resulting graph.  The edges are collected twice, deadlock_timeout apart,
+ * and only those seen both times are considered: the snapshots of the nodes
+ * are not taken at the same instant, and a real deadlock does not go away.
+ * Cycles within a single node are left to the deadlock detector of that
+ * node.  From each other cycle, the youngest transaction is chosen as the
+ * victim, and its wait is canceled on a node where it takes part in the
+ * cycle; the error then aborts the transaction on all nodes.
+ */
+typedef struct LockWaitEdge
+{
+	int			node;			/* index of the Datanode */
+	int			pid;			/* waiting process on that Datanode */
+	TransactionId waiter;		/* transaction of the waiting process */
+	TransactionId blocker;		/* transaction holding the lock */
+	bool		removed;		/* no longer part of the graph */
+} LockWaitEdge;
+
+/*
+ * Fetch the wait-for edges of all the Datanodes. Returns their number.
+ */
+static int
+pgxc_collect_lock_waits(int numnodes, Oid *nodeoids, char **nodenames,
+						LockWaitEdge **edges)
+{
+	RemoteQuery *plan;
+	RemoteQueryState *pstate;
+	EState	   *estate;
+	MemoryContext oldcontext;
+	TupleTableSlot *result;
+	int			nedges = 0;
+	int			maxedges = 64;
+	int			i;
+
+	*edges = (LockWaitEdge *) palloc(maxedges * sizeof(LockWaitEdge));
+
+	plan = makeNode(RemoteQuery);
+	plan->combine_type = COMBINE_TYPE_NONE;
+	plan->exec_nodes = makeNode(ExecNodes);
+	plan->exec_type = EXEC_ON_DATANODES;
+	for (i = 0; i < numnodes; i++)
+	{
+		char		ntype = PGXC_NODE_DATANODE;
+
+		plan->exec_nodes->nodeList = lappend_int(plan->exec_nodes->nodeList,
+								PGXCNodeGetNodeId(nodeoids[i], &ntype));
+	}
+	plan->sql_statement = "SELECT pg_catalog.pgxc_node_str(), waiter_pid, "
+		"waiter_xid, blocker_xid FROM pg_catalog.pg_lock_waits() "
+		"WHERE waiter_xid IS NOT NULL AND blocker_xid IS NOT NULL";
+	plan->force_autocommit = false;
+	/* The target list only determines the types of the result */
+	plan->scan.plan.targetlist = list_make4(
+			makeTargetEntry((Expr *) makeVar(1, 1, NAMEOID, -1, InvalidOid, 0),
+							1, NULL, false),
+			makeTargetEntry((Expr *) makeVar(1, 2, INT4OID, -1, InvalidOid, 0),
+							2, NULL, false),
+			makeTargetEntry((Expr *) makeVar(1, 3, XIDOID, -1, InvalidOid, 0),
+							3, NULL, false),
+			makeTargetEntry((Expr *) makeVar(1, 4, XIDOID, -1, InvalidOid, 0),
+							4, NULL, false));
+
+	estate = CreateExecutorState();
+	oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+	estate->es_snapshot = GetActiveSnapshot();
+	pstate = ExecInitRemoteQuery(plan, estate, 0);
+	MemoryContextSwitchTo(oldcontext);
+
+	result = ExecRemoteQuery(pstate);
+	while (!TupIsNull(result))
+	{
+		bool		isnull;
+		char	   *nodename;
+		LockWaitEdge *edge;
+
+		if (nedges >= maxedges)
+		{
+			maxedges *= 2;
+			*edges = (LockWaitEdge *) repalloc(*edges,
+											   maxedges * sizeof(LockWaitEdge));
+		}
+		edge = &(*edges)[nedges];
+
+		nodename = NameStr(*DatumGetName(slot_getattr(result, 1, &isnull)));
+		edge->node = -1;
+		for (i = 0; i < numnodes; i++)
+		{
+			if (strcmp(nodenames[i], nodename) == 0)
+			{
+				edge->node = i;
+				break;
+			}
+		}
+		edge->pid = DatumGetInt32(slot_getattr(result, 2, &isnull));
+		edge->waiter = DatumGetTransactionId(slot_getattr(result, 3, &isnull));
+		edge->blocker = DatumGetTransactionId(slot_getattr(result, 4, &isnull));
+		edge->removed = false;
+		if (edge->node >= 0 && edge->waiter != edge->blocker)
+			nedges++;
+
+		result = ExecRemoteQuery(pstate);
+	}
+	ExecEndRemoteQuery(pstate);
+	FreeExecutorState(estate);
+
+	return nedges;
+}
+
+/*
+ * Depth-first search for a path of edges from the transaction cur back to
+ * start.  The edges of the path are put in path[depth...]; returns the
+ * length of the whole path, or zero.  visited[] remembers the transactions
+ * already searched from, which can't lead to start if we are still looking.
+ */
+static int
+pgxc_find_wait_path(LockWaitEdge *edges, int nedges, TransactionId start,
+					TransactionId cur, int *path, int depth,
+					TransactionId *visited, int *nvisited)
+{
+	int			i;
+
+	check_stack_depth();
+
+	for (i = 0; i < *nvisited; i++)
+		if (visited[i] == cur)
+			return 0;
+	visited[(*nvisited)++] = cur;
+
+	for (i = 0; i < nedges; i++)
+	{
+		int			len;
+
+		if (edges[i].removed || edges[i].waiter != cur)
+			continue;
+
+		path[depth] = i;
+		if (edges[i].blocker == start)
+			return depth + 1;
+
+		len = pgxc_find_wait_path(edges, nedges, start, edges[i].blocker,
+								  path, depth + 1, visited, nvisited);
+		if (len > 0)
+			return len;
+	}
+
+	return 0;
+}
+
+/*
+ * pgxc_global_deadlock_check - find and break deadlocks across Datanodes
+ *
+ * Returns one row per transaction chosen as the victim of a deadlock: the
+ * Datanode and the process whose wait was canceled, and the transaction.
+ */
+Datum
+pgxc_global_deadlock_check(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+	Oid		   *coOids,
+			   *dnOids;
+	int			numcoords,
+				numdnodes;
+	char	  **nodenames;
+	LockWaitEdge *first,
+			   *edges;
+	int			nfirst,
+				nedges,
+				nkept;
+	int		   *path;
+	TransactionId *visited;
+	int			i,
+				j;
+
+	if (!superuser())
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 (errmsg("must be superuser to check for global deadlocks"))));
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Only a coordinator sees all the Datanodes */
+	if (!IS_PGXC_COORDINATOR)
+		return (Datum) 0;
+
+	PgxcNodeGetOids(&coOids, &dnOids, &numcoords, &numdnodes, false);
+	if (numdnodes < 2)
+		return (Datum) 0;
+	nodenames = (char **) palloc(numdnodes * sizeof(char *));
+	for (i = 0; i < numdnodes; i++)
+		nodenames[i] = get_pgxc_nodename(dnOids[i]);
+
+	nfirst = pgxc_collect_lock_waits(numdnodes, dnOids, nodenames, &first);
+	if (nfirst == 0)
+		return (Datum) 0;
+
+	pg_usleep(DeadlockTimeout * 1000L);
+	CHECK_FOR_INTERRUPTS();
+
+	nedges = pgxc_collect_lock_waits(numdnodes, dnOids, nodenames, &edges);
+
+	/* Keep the waits seen both times */
+	nkept = 0;
+	for (i = 0; i < nedges; i++)
+	{
+		for (j = 0; j < nfirst; j++)
+		{
+			if (first[j].node == edges[i].node &&
+				first[j].pid == edges[i].pid &&
+				first[j].waiter == edges[i].waiter &&
+				first[j].blocker == edges[i].blocker)
+			{
+				edges[nkept++] = edges[i];
+				break;
+			}
+		}
+	}
+	nedges = nkept;
+
+	path = (int *) palloc(Max(nedges, 1) * sizeof(int));
+	visited = (TransactionId *) palloc((2 * nedges + 1) * sizeof(TransactionId));
+
+	for (i = 0; i < nedges; i++)
+	{
+		TransactionId victim;
+		LockWaitEdge *victimEdge;
+		bool		local;
+		StringInfoData detail;
+		StringInfoData cmd;
+		Datum		values[3];
+		bool		nulls[3];
+		NameData	nodename;
+		int			nvisited = 0;
+		int			len;
+
+		if (edges[i].removed)
+			continue;
+
+		len = pgxc_find_wait_path(edges, nedges, edges[i].waiter,
+								  edges[i].waiter, path, 0,
+								  visited, &nvisited);
+		if (len == 0)
+			continue;
+
+		local = true;
+		victimEdge = &edges[path[0]];
+		for (j = 0; j < len; j++)
+		{
+			LockWaitEdge *edge = &edges[path[j]];
+
+			if (edge->node != edges[path[0]].node)
+				local = false;
+			if (TransactionIdFollows(edge->waiter, victimEdge->waiter))
+				victimEdge = edge;
+		}
+
+		if (local)
+		{
+			/* The node breaks it by itself */
+			for (j = 0; j < len; j++)
+				edges[path[j]].removed = true;
+			i--;
+			continue;
+		}
+
+		victim = victimEdge->waiter;
+
+		initStringInfo(&detail);
+		for (j = 0; j < len; j++)
+		{
+			LockWaitEdge *edge = &edges[path[j]];
+
+			if (j > 0)
+				appendStringInfoChar(&detail, '\n');
+			appendStringInfo(&detail,
+							 _("Transaction %u waits for transaction %u on node \"%s\"."),
+							 edge->waiter, edge->blocker, nodenames[edge->node]);
+		}
+		ereport(LOG,
+				(errmsg("global deadlock detected, canceling transaction %u on node \"%s\"",
+						victim, nodenames[victimEdge->node]),
+				 errdetail_internal("%s", detail.data)));
+
+		initStringInfo(&cmd);
+		appendStringInfo(&cmd, "SELECT pg_catalog.pg_cancel_backend(%d)",
+						 victimEdge->pid);
+		(void) pgxc_execute_on_nodes(1, &dnOids[victimEdge->node], cmd.data);
+
+		MemSet(nulls, 0, sizeof(nulls));
+		namestrcpy(&nodename, nodenames[victimEdge->node]);
+		values[0] = NameGetDatum(&nodename);
+		values[1] = Int32GetDatum(victimEdge->pid);
+		values[2] = TransactionIdGetDatum(victim);
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+
+		/* The victim's waits and the waits for it are going away */
+		for (j = 0; j < nedges; j++)
+			if (edges[j].waiter == victim || edges[j].blocker == victim)
+				edges[j].removed = true;
+
+		/* Edge i may still be part of another cycle */
+		i--;
+	}
+
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
 #endif
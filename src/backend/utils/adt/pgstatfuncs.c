@@ -16,6 +16,9 @@
 
 #include "access/htup_details.h"
 #include "catalog/pg_type.h"
+#ifdef XCP
+#include "catalog/pgxc_node.h"
+#endif
 #include "funcapi.h"
 #include "libpq/ip.h"
 #include "miscadmin.h"
@@ -24,6 +27,9 @@
 #include "utils/builtins.h"
 #include "utils/inet.h"
 #include "utils/timestamp.h"
+#ifdef XCP
+#include "utils/syscache.h"
+#endif
 
 /* bogus ... these externs should be in a header file */
 extern Datum pg_stat_get_numscans(PG_FUNCTION_ARGS);
@@ -64,6 +70,9 @@ extern Datum pg_stat_get_backend_xact_start(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_backend_start(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_backend_client_addr(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_backend_client_port(PG_FUNCTION_ARGS);
+#ifdef XCP
+extern Datum pg_stat_get_wait_histogram(PG_FUNCTION_ARGS);
+#endif
 
 extern Datum pg_stat_get_db_numbackends(PG_FUNCTION_ARGS);
 extern Datum pg_stat_get_db_xact_commit(PG_FUNCTION_ARGS);
@@ -126,6 +135,10 @@ extern Datum pg_stat_reset_single_function_counters(PG_FUNCTION_ARGS);
 /* Global bgwriter statistics, from bgwriter.c */
 extern PgStat_MsgBgWriter bgwriterStats;
 
+#ifdef XCP
+static char *wait_node_name(Oid nodeoid);
+#endif
+
 Datum
 pg_stat_get_numscans(PG_FUNCTION_ARGS)
 {
@@ -530,7 +543,7 @@ pg_stat_get_backend_idset(PG_FUNCTION_ARGS)
 Datum
 pg_stat_get_activity(PG_FUNCTION_ARGS)
 {
-#define PG_STAT_GET_ACTIVITY_COLS	22
+#define PG_STAT_GET_ACTIVITY_COLS	25
 	int			num_backends = pgstat_fetch_stat_numbackends();
 	int			curr_backend;
 	int			pid = PG_ARGISNULL(0) ? -1 : PG_GETARG_INT32(0);
@@ -674,6 +687,25 @@ pg_stat_get_activity(PG_FUNCTION_ARGS)
 			values[5] = CStringGetTextDatum(beentry->st_activity);
 			values[6] = BoolGetDatum(beentry->st_waiting);
 
+#ifdef XCP
+			if (beentry->st_wait_event != WAIT_EVENT_NONE)
+			{
+				WaitEvent	event = beentry->st_wait_event;
+				char	   *nodename = wait_node_name(beentry->st_wait_node);
+
+				values[22] = CStringGetTextDatum(
+						pgstat_get_wait_class(pgstat_get_wait_event_class(event)));
+				values[23] = CStringGetTextDatum(pgstat_get_wait_event(event));
+				if (nodename)
+					values[24] = DirectFunctionCall1(namein,
+													 CStringGetDatum(nodename));
+				else
+					nulls[24] = true;
+			}
+			else
+#endif
+				nulls[22] = nulls[23] = nulls[24] = true;
+
 			if (beentry->st_xact_start_timestamp != 0)
 				values[7] = TimestampTzGetDatum(beentry->st_xact_start_timestamp);
 			else
@@ -775,6 +807,9 @@ pg_stat_get_activity(PG_FUNCTION_ARGS)
 			nulls[11] = true;
 			nulls[12] = true;
 			nulls[13] = true;
+			nulls[22] = true;
+			nulls[23] = true;
+			nulls[24] = true;
 		}
 
 		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
@@ -791,6 +826,102 @@ pg_stat_get_activity(PG_FUNCTION_ARGS)
 }
 
 
+#ifdef XCP
+/*
+ * Name of the node a backend waits on, NULL if none or if the node has been
+ * dropped meanwhile.
+ */
+static char *
+wait_node_name(Oid nodeoid)
+{
+	HeapTuple	tuple;
+	char	   *result;
+
+	if (!OidIsValid(nodeoid))
+		return NULL;
+
+	tuple = SearchSysCache1(PGXCNODEOID, ObjectIdGetDatum(nodeoid));
+	if (!HeapTupleIsValid(tuple))
+		return NULL;
+
+	result = pstrdup(NameStr(((Form_pgxc_node) GETSTRUCT(tuple))->node_name));
+	ReleaseSysCache(tuple);
+
+	return result;
+}
+
+/*
+ * Returns the histogram of the time spent in each class of distributed
+ * waits since the server started.
+ */
+Datum
+pg_stat_get_wait_histogram(PG_FUNCTION_ARGS)
+{
+#define PG_STAT_GET_WAIT_HISTOGRAM_COLS	(3 + WAIT_HISTOGRAM_BUCKETS)
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	int			wclass;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	for (wclass = 0; wclass < NUM_WAIT_CLASSES; wclass++)
+	{
+		Datum		values[PG_STAT_GET_WAIT_HISTOGRAM_COLS];
+		bool		nulls[PG_STAT_GET_WAIT_HISTOGRAM_COLS];
+		int64		waits;
+		int64		total_time;
+		int64		counts[WAIT_HISTOGRAM_BUCKETS];
+		int			i;
+
+		MemSet(nulls, 0, sizeof(nulls));
+
+		pgstat_fetch_wait_histogram((WaitClass) wclass, &waits, &total_time,
+									counts);
+
+		values[0] = CStringGetTextDatum(pgstat_get_wait_class((WaitClass) wclass));
+		values[1] = Int64GetDatum(waits);
+		/* convert to msec */
+		values[2] = Float8GetDatum(((double) total_time) / 1000.0);
+		for (i = 0; i < WAIT_HISTOGRAM_BUCKETS; i++)
+			values[3 + i] = Int64GetDatum(counts[i]);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+#endif
+
+
 Datum
 pg_backend_pid(PG_FUNCTION_ARGS)
 {
@@ -6274,7 +6274,21 @@ get_utility_query_def(Query *query, deparse_context *context)
 					break;
 
 				case DISTTYPE_HASH:
-					appendStringInfo(buf, " DISTRIBUTE BY HASH(%s)", stmt->distributeby->colname);
+					if (stmt->distributeby->colnames)
+					{
+						ListCell   *lc;
+
+						appendStringInfoString(buf, " DISTRIBUTE BY HASH(");
+						foreach(lc, stmt->distributeby->colnames)
+						{
+							if (lc != list_head(stmt->distributeby->colnames))
+								appendStringInfoString(buf, ", ");
+							appendStringInfoString(buf, strVal(lfirst(lc)));
+						}
+						appendStringInfoChar(buf, ')');
+					}
+					else
+						appendStringInfo(buf, " DISTRIBUTE BY HASH(%s)", stmt->distributeby->colname);
 					break;
 
 				case DISTTYPE_ROUNDROBIN:
@@ -6285,6 +6299,26 @@ get_utility_query_def(Query *query, deparse_context *context)
 					appendStringInfo(buf, " DISTRIBUTE BY MODULO(%s)", stmt->distributeby->colname);
 					break;
 
+				case DISTTYPE_BUCKET:
+					appendStringInfo(buf, " DISTRIBUTE BY BUCKET(%s)", stmt->distributeby->colname);
+					break;
+
+				case DISTTYPE_RANGE:
+					{
+						ListCell   *lc;
+
+						appendStringInfo(buf, " DISTRIBUTE BY RANGE(%s) VALUES (",
+										 stmt->distributeby->colname);
+						foreach(lc, stmt->distributeby->rangevalues)
+						{
+							if (lc != list_head(stmt->distributeby->rangevalues))
+								appendStringInfoString(buf, ", ");
+							simple_quote_literal(buf, strVal(lfirst(lc)));
+						}
+						appendStringInfoChar(buf, ')');
+					}
+					break;
+
 				default:
 					ereport(ERROR, (errcode(ERRCODE_SYNTAX_ERROR),
 								errmsg("Invalid distribution type")));
@@ -2569,6 +2569,47 @@ get_pgxc_classnodes(Oid tableid, Oid **nodes)
 	ReleaseSysCache(tuple);
 	return numnodes;
 }
+
+/*
+ * get_pgxc_classbuckets
+ *		Obtain PGXC class bucket map for given relation Oid
+ *		Return number of buckets and the position in the node list of the
+ *		node of each bucket, zero if the relation is not distributed by
+ *		bucket
+ *
+ * Bucket map is returned as a palloc'd array
+ */
+int
+get_pgxc_classbuckets(Oid tableid, int16 **buckets)
+{
+	HeapTuple		tuple;
+	Datum			datum;
+	bool			isnull;
+	int2vector	   *bucketmap;
+	int				numbuckets = 0;
+
+	tuple = SearchSysCache1(PGXCCLASSRELID, ObjectIdGetDatum(tableid));
+
+	if (!HeapTupleIsValid(tuple))
+			elog(ERROR, "cache lookup failed for relation %u", tableid);
+
+	*buckets = NULL;
+	datum = SysCacheGetAttr(PGXCCLASSRELID, tuple,
+							Anum_pgxc_class_pcbucketmap, &isnull);
+	if (!isnull)
+	{
+		bucketmap = (int2vector *) DatumGetPointer(datum);
+		numbuckets = bucketmap->dim1;
+		if (numbuckets > 0)
+		{
+			*buckets = (int16 *) palloc(numbuckets * sizeof(int16));
+			memcpy(*buckets, bucketmap->values, numbuckets * sizeof(int16));
+		}
+	}
+
+	ReleaseSysCache(tuple);
+	return numbuckets;
+}
 #endif
 
 /*
@@ -54,6 +54,7 @@
 
 #include <limits.h>
 
+#include "access/hash.h"
 #include "access/transam.h"
 #include "catalog/namespace.h"
 #include "executor/executor.h"
@@ -78,6 +79,7 @@
 #include "commands/prepare.h"
 #include "pgxc/execRemote.h"
 #ifdef XCP
+#include "lib/ilist.h"
 #include "pgxc/squeue.h"
 #endif
 #include "pgxc/pgxc.h"
@@ -100,6 +102,36 @@
  */
 static CachedPlanSource *first_saved_plan = NULL;
 
+#ifdef XCP
+/*
+ * Remote subplans decoded by this backend. A pooled Datanode connection
+ * serves many Coordinator sessions, which send the plans they prepared once
+ * more whenever they get a connection the statement is not stored on. The
+ * entry keeps the decoded plan so it is copied instead of decoded again from
+ * the string, which looks up every object referenced by name. The cache
+ * outlives the prepared statements, DISCARD ALL does not reset it.
+ */
+typedef struct RemoteSubplanEntry
+{
+	dlist_node	node;			/* list link, most recently used first */
+	uint32		hash;			/* hash of the plan string */
+	char	   *plan_string;	/* encoded plan, as received */
+	int			num_params;		/* number of parameters */
+	Oid		   *param_types;	/* types of the parameters */
+	Oid			userid;			/* user the plan was decoded for */
+	char	   *search_path;	/* search_path the plan was decoded with */
+	List	   *relationOids;	/* relations referenced by the plan */
+	PlannedStmt *stmt;			/* the decoded plan */
+	MemoryContext context;		/* context holding all of the above */
+} RemoteSubplanEntry;
+
+static dlist_head remote_subplan_cache = DLIST_STATIC_INIT(remote_subplan_cache);
+static int	remote_subplan_count = 0;
+
+/* GUC parameter */
+int			RemoteSubplanCacheSize = 100;
+#endif
+
 static void ReleaseGenericPlan(CachedPlanSource *plansource);
 static List *RevalidateCachedQuery(CachedPlanSource *plansource);
 static bool CheckCachedPlan(CachedPlanSource *plansource);
@@ -117,6 +149,15 @@ static TupleDesc PlanCacheComputeResultDesc(List *stmt_list);
 static void PlanCacheRelCallback(Datum arg, Oid relid);
 static void PlanCacheFuncCallback(Datum arg, int cacheid, uint32 hashvalue);
 static void PlanCacheSysCallback(Datum arg, int cacheid, uint32 hashvalue);
+#ifdef XCP
+static PlannedStmt *LookupRemoteSubplan(const char *plan_string, uint32 hash,
+					CachedPlanSource *plansource);
+static void RememberRemoteSubplan(const char *plan_string, uint32 hash,
+					  CachedPlanSource *plansource, PlannedStmt *stmt);
+static void DropRemoteSubplanEntry(RemoteSubplanEntry *entry);
+static void RemoteSubplanRelCallback(Datum arg, Oid relid);
+static void RemoteSubplanSysCallback(Datum arg, int cacheid, uint32 hashvalue);
+#endif
 
 
 /*
@@ -132,6 +173,17 @@ InitPlanCache(void)
 	CacheRegisterSyscacheCallback(NAMESPACEOID, PlanCacheSysCallback, (Datum) 0);
 	CacheRegisterSyscacheCallback(OPEROID, PlanCacheSysCallback, (Datum) 0);
 	CacheRegisterSyscacheCallback(AMOPOPID, PlanCacheSysCallback, (Datum) 0);
+#ifdef XCP
+	if (IS_PGXC_DATANODE)
+	{
+		CacheRegisterRelcacheCallback(RemoteSubplanRelCallback, (Datum) 0);
+		CacheRegisterSyscacheCallback(PROCOID, RemoteSubplanSysCallback, (Datum) 0);
+		CacheRegisterSyscacheCallback(TYPEOID, RemoteSubplanSysCallback, (Datum) 0);
+		CacheRegisterSyscacheCallback(NAMESPACEOID, RemoteSubplanSysCallback, (Datum) 0);
+		CacheRegisterSyscacheCallback(OPEROID, RemoteSubplanSysCallback, (Datum) 0);
+		CacheRegisterSyscacheCallback(AMOPOPID, RemoteSubplanSysCallback, (Datum) 0);
+	}
+#endif
 }
 
 /*
@@ -1060,6 +1112,17 @@ BuildCachedPlan(CachedPlanSource *plansource, List *qlist,
 				n = SetRemoteStatementName(ps->planTree, plansource->stmt_name,
 							plansource->num_params,
 							plansource->param_types, n);
+#ifdef XCP
+				/*
+				 * Generic plan is going to be executed multiple times, keep
+				 * its remote subplans stored on the Datanodes.
+				 */
+				if (CacheRemoteSubplans && boundParams == NULL)
+				{
+					RemoteSubplanSetPersistent((Node *) ps->planTree, true);
+					RemoteSubplanSetPersistent((Node *) ps->subplans, true);
+				}
+#endif
 			}
 		}
 	}
@@ -1348,6 +1411,25 @@ ReleaseCachedPlan(CachedPlan *plan, bool useResOwner)
 		/* Mark it no longer valid */
 		plan->magic = 0;
 
+#ifdef XCP
+		/* Remote subplans stored on Datanodes are not valid any more */
+		if (IS_PGXC_LOCAL_COORDINATOR)
+		{
+			ListCell   *lc;
+
+			foreach(lc, plan->stmt_list)
+			{
+				PlannedStmt *ps = (PlannedStmt *) lfirst(lc);
+
+				if (IsA(ps, PlannedStmt))
+				{
+					RemoteSubplanSetPersistent((Node *) ps->planTree, false);
+					RemoteSubplanSetPersistent((Node *) ps->subplans, false);
+				}
+			}
+		}
+#endif
+
 		/* One-shot plans do not own their context, so we can't free them */
 		if (!plan->is_oneshot)
 			MemoryContextDelete(plan->context);
@@ -2004,6 +2086,7 @@ SetRemoteSubplan(CachedPlanSource *plansource, const char *plan_string)
 	MemoryContext 		oldcxt;
 	RemoteStmt 		   *rstmt;
 	PlannedStmt 	   *stmt;
+	uint32				hash;
 
 	Assert(IS_PGXC_DATANODE);
 	Assert(plansource->raw_parse_tree == NULL);
@@ -2014,44 +2097,63 @@ SetRemoteSubplan(CachedPlanSource *plansource, const char *plan_string)
 	 * memory context for now, later it will be reparented to
 	 * CachedMemoryContext. If it is in CachedMemoryContext initially we would
 	 * have to destroy it in case of error.
+	 * The plan is never modified once decoded and the context is dropped as a
+	 * whole, so a bump context is enough.
 	 */
-	plan_context = AllocSetContextCreate(CurrentMemoryContext,
-										 "CachedPlan",
-										 ALLOCSET_SMALL_MINSIZE,
-										 ALLOCSET_SMALL_INITSIZE,
-										 ALLOCSET_DEFAULT_MAXSIZE);
+	plan_context = BumpContextCreate(CurrentMemoryContext,
+									 "CachedPlan",
+									 ALLOCSET_SMALL_INITSIZE,
+									 ALLOCSET_DEFAULT_MAXSIZE);
 	oldcxt = MemoryContextSwitchTo(plan_context);
 
 	/*
-	 * Restore query plan.
+	 * Take the plan decoded earlier if the same one is received again,
+	 * otherwise restore query plan.
 	 */
-	set_portable_input(true);
-	rstmt = (RemoteStmt *) stringToNode((char *) plan_string);
-	set_portable_input(false);
-
-	stmt = makeNode(PlannedStmt);
-
-	stmt->commandType = rstmt->commandType;
-	stmt->hasReturning = rstmt->hasReturning;
-	stmt->canSetTag = true;
-	stmt->transientPlan = false; // ???
-	stmt->planTree = rstmt->planTree;
-	stmt->rtable = rstmt->rtable;
-	stmt->resultRelations = rstmt->resultRelations;
-	stmt->utilityStmt = NULL;
-	stmt->subplans = rstmt->subplans;
-	stmt->rewindPlanIDs = NULL;
-	stmt->rowMarks = rstmt->rowMarks;
-	stmt->relationOids = NIL;
-	stmt->invalItems = NIL;
-	stmt->nParamExec = rstmt->nParamExec;
-	stmt->nParamRemote = rstmt->nParamRemote;
-	stmt->remoteparams = rstmt->remoteparams;
+	hash = DatumGetUInt32(hash_any((const unsigned char *) plan_string,
+								   strlen(plan_string)));
+	stmt = LookupRemoteSubplan(plan_string, hash, plansource);
+	if (stmt == NULL)
+	{
+		set_portable_input(true);
+		rstmt = (RemoteStmt *) stringToNode((char *) plan_string);
+		set_portable_input(false);
+
+		stmt = makeNode(PlannedStmt);
+
+		stmt->commandType = rstmt->commandType;
+		stmt->hasReturning = rstmt->hasReturning;
+		stmt->canSetTag = true;
+		stmt->transientPlan = false; // ???
+		stmt->planTree = rstmt->planTree;
+		stmt->rtable = rstmt->rtable;
+		stmt->resultRelations = rstmt->resultRelations;
+		stmt->utilityStmt = NULL;
+		stmt->subplans = rstmt->subplans;
+		stmt->rewindPlanIDs = NULL;
+		stmt->rowMarks = rstmt->rowMarks;
+		stmt->relationOids = NIL;
+		stmt->invalItems = NIL;
+		stmt->nParamExec = rstmt->nParamExec;
+		stmt->nParamRemote = rstmt->nParamRemote;
+		stmt->remoteparams = rstmt->remoteparams;
+		stmt->distributionType = rstmt->distributionType;
+		stmt->distributionKey = rstmt->distributionKey;
+		stmt->distributionNodes = rstmt->distributionNodes;
+		stmt->distributionRestrict = rstmt->distributionRestrict;
+		stmt->distributionBuckets = rstmt->distributionBuckets;
+		stmt->distributionRanges = rstmt->distributionRanges;
+		stmt->adaptiveType = rstmt->adaptiveType;
+		stmt->adaptiveKey = rstmt->adaptiveKey;
+		stmt->adaptiveRows = rstmt->adaptiveRows;
+		stmt->workMem = rstmt->workMem;
+		stmt->instrumentOptions = rstmt->instrumentOptions;
+		/* Account the fragment to the statement of the Coordinator */
+		stmt->queryId = rstmt->queryId;
+
+		RememberRemoteSubplan(plan_string, hash, plansource, stmt);
+	}
 	stmt->pname = plansource->stmt_name;
-	stmt->distributionType = rstmt->distributionType;
-	stmt->distributionKey = rstmt->distributionKey;
-	stmt->distributionNodes = rstmt->distributionNodes;
-	stmt->distributionRestrict = rstmt->distributionRestrict;
 
 	/*
 	 * Set up SharedQueue if intermediate results need to be distributed
@@ -2089,4 +2191,149 @@ SetRemoteSubplan(CachedPlanSource *plansource, const char *plan_string)
 
 	MemoryContextSwitchTo(oldcxt);
 }
+
+
+/*
+ * LookupRemoteSubplan: find the plan decoded earlier from the same string,
+ * with the same parameter types, user and search_path. A copy of the plan is
+ * returned in the current memory context, or NULL if there is no such plan.
+ */
+static PlannedStmt *
+LookupRemoteSubplan(const char *plan_string, uint32 hash,
+					CachedPlanSource *plansource)
+{
+	dlist_iter	iter;
+
+	dlist_foreach(iter, &remote_subplan_cache)
+	{
+		RemoteSubplanEntry *entry = dlist_container(RemoteSubplanEntry, node,
+													iter.cur);
+
+		if (entry->hash != hash ||
+				entry->num_params != plansource->num_params ||
+				entry->userid != GetUserId() ||
+				strcmp(entry->search_path, namespace_search_path) != 0 ||
+				strcmp(entry->plan_string, plan_string) != 0)
+			continue;
+		if (entry->num_params > 0 &&
+				memcmp(entry->param_types, plansource->param_types,
+					   entry->num_params * sizeof(Oid)) != 0)
+			continue;
+
+		dlist_move_head(&remote_subplan_cache, &entry->node);
+		return (PlannedStmt *) copyObject(entry->stmt);
+	}
+	return NULL;
+}
+
+
+/*
+ * RememberRemoteSubplan: add a copy of the decoded plan to the cache,
+ * removing the least recently used plans if it is full.
+ */
+static void
+RememberRemoteSubplan(const char *plan_string, uint32 hash,
+					  CachedPlanSource *plansource, PlannedStmt *stmt)
+{
+	MemoryContext context;
+	MemoryContext oldcxt;
+	RemoteSubplanEntry *entry;
+	ListCell   *lc;
+
+	if (RemoteSubplanCacheSize <= 0)
+		return;
+
+	while (remote_subplan_count >= RemoteSubplanCacheSize)
+		DropRemoteSubplanEntry(dlist_container(RemoteSubplanEntry, node,
+								dlist_tail_node(&remote_subplan_cache)));
+
+	/*
+	 * Build the entry in a context which becomes the child of
+	 * CacheMemoryContext when it is complete, so nothing leaks on error.
+	 */
+	context = BumpContextCreate(CurrentMemoryContext,
+								"RemoteSubplanEntry",
+								ALLOCSET_SMALL_INITSIZE,
+								ALLOCSET_DEFAULT_MAXSIZE);
+	oldcxt = MemoryContextSwitchTo(context);
+
+	entry = (RemoteSubplanEntry *) palloc(sizeof(RemoteSubplanEntry));
+	entry->hash = hash;
+	entry->plan_string = pstrdup(plan_string);
+	entry->num_params = plansource->num_params;
+	if (entry->num_params > 0)
+	{
+		entry->param_types = (Oid *) palloc(entry->num_params * sizeof(Oid));
+		memcpy(entry->param_types, plansource->param_types,
+			   entry->num_params * sizeof(Oid));
+	}
+	else
+		entry->param_types = NULL;
+	entry->userid = GetUserId();
+	entry->search_path = pstrdup(namespace_search_path);
+	entry->relationOids = NIL;
+	foreach(lc, stmt->rtable)
+	{
+		RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+
+		if (rte->rtekind == RTE_RELATION)
+			entry->relationOids = list_append_unique_oid(entry->relationOids,
+														 rte->relid);
+	}
+	entry->stmt = (PlannedStmt *) copyObject(stmt);
+	entry->context = context;
+
+	MemoryContextSwitchTo(oldcxt);
+
+	MemoryContextSetParent(context, CacheMemoryContext);
+	dlist_push_head(&remote_subplan_cache, &entry->node);
+	remote_subplan_count++;
+}
+
+
+static void
+DropRemoteSubplanEntry(RemoteSubplanEntry *entry)
+{
+	dlist_delete(&entry->node);
+	remote_subplan_count--;
+	MemoryContextDelete(entry->context);
+}
+
+
+/*
+ * RemoteSubplanRelCallback
+ *		Relcache inval callback function
+ *
+ * Drop the decoded plans referencing the relation, or all of them if relid is
+ * InvalidOid.
+ */
+static void
+RemoteSubplanRelCallback(Datum arg, Oid relid)
+{
+	dlist_mutable_iter iter;
+
+	dlist_foreach_modify(iter, &remote_subplan_cache)
+	{
+		RemoteSubplanEntry *entry = dlist_container(RemoteSubplanEntry, node,
+													iter.cur);
+
+		if (relid == InvalidOid ||
+				list_member_oid(entry->relationOids, relid))
+			DropRemoteSubplanEntry(entry);
+	}
+}
+
+
+/*
+ * RemoteSubplanSysCallback
+ *		Syscache inval callback function
+ *
+ * Drop all the decoded plans, changes of the catalogs they may depend on are
+ * infrequent.
+ */
+static void
+RemoteSubplanSysCallback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	RemoteSubplanRelCallback(arg, InvalidOid);
+}
 #endif
@@ -2042,6 +2042,10 @@ RelationDestroyRelation(Relation relation, bool remember_tupdesc)
 		MemoryContextDelete(relation->rd_rsdesc->rscxt);
 	if (relation->rd_fdwroutine)
 		pfree(relation->rd_fdwroutine);
+#ifdef PGXC
+	if (relation->rd_locator_info)
+		FreeRelationInsertLocator(relation->rd_locator_info);
+#endif
 	pfree(relation);
 }
 
@@ -32,11 +32,14 @@
 #include <syslog.h>
 #endif
 
+#include "access/clog.h"
 #include "access/commit_ts.h"
 #include "access/gin.h"
 #ifdef PGXC
 #include "access/gtm.h"
 #include "pgxc/pgxc.h"
+#include "pgxc/admission.h"
+#include "pgxc/resultcache.h"
 #endif
 #include "access/transam.h"
 #include "access/twophase.h"
@@ -48,6 +51,7 @@
 #include "commands/variable.h"
 #include "commands/trigger.h"
 #include "funcapi.h"
+#include "jit/jit.h"
 #include "libpq/auth.h"
 #include "libpq/be-fsstubs.h"
 #include "libpq/libpq.h"
@@ -65,15 +69,20 @@
 #ifdef PGXC
 #include "commands/tablecmds.h"
 #include "nodes/nodes.h"
+#include "pgxc/barrier.h"
 #include "pgxc/execRemote.h"
 #include "pgxc/locator.h"
 #include "pgxc/planner.h"
 #include "pgxc/poolmgr.h"
+#include "pgxc/redistrib.h"
 #include "pgxc/nodemgr.h"
 #include "pgxc/xc_maintenance_mode.h"
 #endif
 #ifdef XCP
 #include "commands/sequence.h"
+#include "executor/joinFilter.h"
+#include "executor/nodeGather.h"
+#include "executor/tuptable.h"
 #include "pgxc/nodemgr.h"
 #include "pgxc/squeue.h"
 #include "utils/snapmgr.h"
@@ -96,6 +105,7 @@
 #include "storage/pg_shmem.h"
 #include "storage/proc.h"
 #include "storage/predicate.h"
+#include "storage/procarray.h"
 #include "tcop/tcopprot.h"
 #include "tsearch/ts_cache.h"
 #include "utils/builtins.h"
@@ -134,6 +144,7 @@
 extern bool Log_disconnections;
 extern int	CommitDelay;
 extern int	CommitSiblings;
+extern bool AdaptiveCommitDelay;
 extern char *default_tablespace;
 extern char *temp_tablespaces;
 extern bool ignore_checksum_failure;
@@ -187,6 +198,8 @@ static bool check_stage_log_stats(bool *newval, void **extra, GucSource source);
 static bool check_log_stats(bool *newval, void **extra, GucSource source);
 #ifdef PGXC
 static bool check_pgxc_maintenance_mode(bool *newval, void **extra, GucSource source);
+static void assign_tenant_column(const char *newval, void *extra);
+static void assign_tenant_id(const char *newval, void *extra);
 #endif
 static bool check_canonical_path(char **newval, void **extra, GucSource source);
 static bool check_timezone_abbreviations(char **newval, void **extra, GucSource source);
@@ -391,6 +404,20 @@ static const struct config_enum_entry pgxc_conn_types[] = {
 	{"gtmproxy", REMOTE_CONN_GTM_PROXY, false},
 	{NULL, 0, false}
 };
+
+static const struct config_enum_entry replicated_read_policy_options[] = {
+	{"random", REPLICATED_READ_RANDOM, false},
+	{"connected", REPLICATED_READ_CONNECTED, false},
+	{"latency", REPLICATED_READ_LATENCY, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry statement_class_options[] = {
+	{"auto", STATEMENT_CLASS_AUTO, false},
+	{"small", STATEMENT_CLASS_SMALL, false},
+	{"large", STATEMENT_CLASS_LARGE, false},
+	{NULL, 0, false}
+};
 #endif
 
 /*
@@ -896,6 +923,15 @@ static struct config_bool ConfigureNamesBool[] =
 		true,
 		NULL, NULL, NULL
 	},
+	{
+		{"enable_incremental_sort", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables the planner's use of incremental sort steps."),
+			NULL
+		},
+		&enable_incremental_sort,
+		true,
+		NULL, NULL, NULL
+	},
 	{
 		{"enable_hashagg", PGC_USERSET, QUERY_TUNING_METHOD,
 			gettext_noop("Enables the planner's use of hashed aggregation plans."),
@@ -914,6 +950,17 @@ static struct config_bool ConfigureNamesBool[] =
 		true,
 		NULL, NULL, NULL
 	},
+	{
+		{"enable_resultcache", PGC_USERSET, QUERY_TUNING_METHOD,
+			gettext_noop("Enables the planner's use of result caching."),
+			gettext_noop("A result cache keeps the rows of the parameterized "
+						 "inner side of a nested loop for repeated values "
+						 "of the parameters.")
+		},
+		&enable_resultcache,
+		true,
+		NULL, NULL, NULL
+	},
 	{
 		{"enable_nestloop", PGC_USERSET, QUERY_TUNING_METHOD,
 			gettext_noop("Enables the planner's use of nested-loop join plans."),
@@ -963,6 +1010,43 @@ static struct config_bool ConfigureNamesBool[] =
 		false,
 		NULL, NULL, NULL
 	},
+	{
+		{"barrier_deferred_flush", PGC_SUSET, WAL_SETTINGS,
+			gettext_noop("Flushes the BARRIER records once the commits resumed."),
+			NULL
+		},
+		&barrier_deferred_flush,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"gtm_csn_snapshots", PGC_SIGHUP, GTM,
+			gettext_noop("Requests commit sequence number snapshots from GTM."),
+			NULL
+		},
+		&gtm_csn_snapshots,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"single_node_snapshots", PGC_USERSET, GTM,
+			gettext_noop("Lets read-only statements running on a single Datanode "
+						 "use the snapshots of that Datanode."),
+			NULL
+		},
+		&single_node_snapshots,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"gtm_standby_snapshots", PGC_SIGHUP, GTM,
+			gettext_noop("Lets the GTM standby serve the snapshots of read-only transactions."),
+			NULL
+		},
+		&gtm_standby_snapshots,
+		false,
+		NULL, NULL, NULL
+	},
 #endif
 	{
 		{"geqo", PGC_USERSET, QUERY_TUNING_GEQO,
@@ -1096,6 +1180,28 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"adaptive_commit_delay", PGC_SUSET, WAL_SETTINGS,
+			gettext_noop("Derives the commit delay from the recent rate of WAL flushes."),
+			gettext_noop("The delay is at most half of the recent WAL flush time, "
+						 "and at most commit_delay if that is set.")
+		},
+		&AdaptiveCommitDelay,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"checkpoint_stagger", PGC_SIGHUP, WAL_CHECKPOINTS,
+			gettext_noop("Aligns time-driven checkpoints on the wall clock, "
+						 "at a phase depending on the node name."),
+			gettext_noop("Nodes of a cluster then checkpoint at different times.")
+		},
+		&CheckPointStagger,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"log_checkpoints", PGC_SIGHUP, LOGGING_WHAT,
 			gettext_noop("Logs each checkpoint."),
@@ -1266,6 +1372,105 @@ static struct config_bool ConfigureNamesBool[] =
 		false,
 		NULL, NULL, NULL
 	},
+	{
+		{"shared_queue_spill_files", PGC_USERSET, RESOURCES_DISK,
+			gettext_noop("Passes tuples that do not fit a shared queue to consumers through temporary files."),
+			gettext_noop("Consumers read such tuples from the file directly and "
+						 "do not wait until the producer puts them into the queue.")
+		},
+		&SQueueSpillFiles,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"shared_queue_numa_local", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Places the memory of shared queues on the NUMA node of their producer."),
+			NULL
+		},
+		&SQueueNumaLocal,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"datarow_binary_format", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Passes rows between cluster nodes in binary format."),
+			gettext_noop("Values are converted with the send and receive "
+						 "functions of their types rather than with the text "
+						 "output and input functions.")
+		},
+		&DatarowBinaryFormat,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"datarow_compression", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Compresses rows passed between cluster nodes."),
+			NULL
+		},
+		&DatarowCompression,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"runtime_join_filters", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Filters the outer rows of hash joins by the inner keys."),
+			gettext_noop("The outer rows which can not match any inner row "
+						 "are dropped by the nodes executing the outer remote "
+						 "subplan, by the outer scan or before probing the "
+						 "hash table.")
+		},
+		&RuntimeJoinFilters,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"cache_remote_subplans", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Keeps remote subplans of prepared statements stored on remote nodes."),
+			gettext_noop("Subsequent executions of the generic plan only bind "
+						 "the stored statements instead of sending them again.")
+		},
+		&CacheRemoteSubplans,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"remote_pipeline_begin", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Sends BEGIN to remote nodes along with the first command of the transaction."),
+			gettext_noop("The coordinator does not wait for the BEGIN responses "
+						 "before sending the command.")
+		},
+		&RemotePipelineBegin,
+		true,
+		NULL, NULL, NULL
+	},
+	{
+		{"async_commit_prepared", PGC_SUSET, QUERY_TUNING_OTHER,
+			gettext_noop("Reports implicit two-phase commits to the client before COMMIT PREPARED completes on remote nodes."),
+			gettext_noop("The transaction is committed on GTM first, the statements "
+						 "of the datanodes wait for COMMIT PREPARED to complete.")
+		},
+		&AsyncCommitPrepared,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"replicated_one_phase_commit", PGC_SUSET, QUERY_TUNING_OTHER,
+			gettext_noop("Commits transactions which wrote to replicated tables only without two-phase commit."),
+			gettext_noop("The primary node commits first, then the other nodes.")
+		},
+		&ReplicatedOnePhaseCommit,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"prefetch_remote_connections", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Gets connections to the recently used Datanodes along with the requested ones."),
+			gettext_noop("The pooler adds the connections it has readily available.")
+		},
+		&PrefetchRemoteConnections,
+		true,
+		NULL, NULL, NULL
+	},
 #endif
 #ifdef BTREE_BUILD_STATS
 	{
@@ -1300,6 +1505,15 @@ static struct config_bool ConfigureNamesBool[] =
 		true,
 		NULL, NULL, NULL
 	},
+	{
+		{"numa_interleave_buffers", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Spreads shared buffers evenly over the NUMA nodes."),
+			NULL
+		},
+		&numa_interleave_buffers,
+		false,
+		NULL, NULL, NULL
+	},
 	{
 		{"track_io_timing", PGC_SUSET, STATS_COLLECTOR,
 			gettext_noop("Collects timing statistics for database I/O activity."),
@@ -1702,6 +1916,38 @@ static struct config_bool ConfigureNamesBool[] =
 		false,
 		NULL, NULL, NULL
 	},
+#ifdef XCP
+	{
+		{"pool_use_unix_socket", PGC_SIGHUP, DATA_NODES,
+			gettext_noop("Connect to the nodes on the same host through the Unix-domain socket."),
+			NULL
+		},
+		&PoolUseUnixSocket,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"transaction_pooling", PGC_USERSET, DATA_NODES,
+			gettext_noop("Returns node connections to the pool at the end of every transaction."),
+			gettext_noop("Remote subplans of prepared statements stored on "
+						 "the nodes are dropped, rather than keeping the "
+						 "connections of the session.")
+		},
+		&TransactionPooling,
+		false,
+		NULL, NULL, NULL
+	},
+	{
+		{"keep_peer_connections", PGC_SIGHUP, DATA_NODES,
+			gettext_noop("Datanode sessions keep their connections to the other Datanodes between transactions."),
+			gettext_noop("The next transactions of the same session reuse "
+						 "them without going through the pooler.")
+		},
+		&KeepPeerConnections,
+		false,
+		NULL, NULL, NULL
+	},
+#endif
 	{
 		{"strict_statement_checking", PGC_USERSET, DEVELOPER_OPTIONS,
 			gettext_noop("Forbid statements that are not safe for the cluster"),
@@ -1966,6 +2212,29 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"clock_sweep_partitions", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the number of partitions of the buffer replacement clock sweep."),
+			gettext_noop("Each partition of shared buffers has its own clock "
+						 "hand and free list, which the background writer "
+						 "keeps filled with clean buffers.")
+		},
+		&clock_sweep_partitions,
+		1, 1, 256,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"xact_status_cache_size", PGC_POSTMASTER, RESOURCES_MEM,
+			gettext_noop("Sets the size of the shared cache of transaction commit statuses."),
+			gettext_noop("Zero disables the cache."),
+			GUC_UNIT_KB
+		},
+		&xact_status_cache_size,
+		1024, 0, 1024 * 1024,
+		NULL, NULL, NULL
+	},
+
 	{
 #ifdef XCP
 		{"temp_buffers", PGC_SUSET, RESOURCES_MEM,
@@ -2037,6 +2306,22 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+#ifdef XCP
+	{
+		{"query_work_mem", PGC_SUSET, RESOURCES_MEM,
+			gettext_noop("Sets the maximum memory to be used by the parts of a "
+						 "distributed query running on remote nodes."),
+			gettext_noop("The memory is shared evenly by the parts of the query, "
+						 "each of them using at most work_mem. Zero lets each "
+						 "part use work_mem."),
+			GUC_UNIT_KB
+		},
+		&QueryWorkMem,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+#endif
 	{
 #ifdef XCP
 		{"maintenance_work_mem", PGC_SUSET, RESOURCES_MEM,
@@ -2381,6 +2666,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"checkpoint_flush_after", PGC_SIGHUP, WAL_CHECKPOINTS,
+			gettext_noop("Number of pages after which previously performed writes are flushed to disk."),
+			NULL,
+			GUC_UNIT_BLOCKS
+		},
+		&checkpoint_flush_after,
+		DEFAULT_CHECKPOINT_FLUSH_AFTER, 0, WRITEBACK_MAX_PENDING_FLUSHES,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"wal_buffers", PGC_POSTMASTER, WAL_SETTINGS,
 			gettext_noop("Sets the number of disk-page buffers in shared memory for WAL."),
@@ -2548,6 +2844,16 @@ static struct config_int ConfigureNamesInt[] =
 		check_max_worker_processes, NULL, NULL
 	},
 
+	{
+		{"max_parallel_degree", PGC_USERSET, RESOURCES_ASYNCHRONOUS,
+			gettext_noop("Sets the maximum number of parallel workers used to run a Datanode plan fragment or to build an index."),
+			gettext_noop("Zero disables parallel execution.")
+		},
+		&max_parallel_degree,
+		0, 0, 1024,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"log_rotation_age", PGC_SIGHUP, LOGGING_WHERE,
 			gettext_noop("Automatic log file rotation will occur after N minutes."),
@@ -2801,6 +3107,18 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"min_parallel_relation_size", PGC_USERSET, QUERY_TUNING_COST,
+			gettext_noop("Sets the minimum size of a relation scanned by a parallel worker."),
+			gettext_noop("A Datanode plan fragment gets one more parallel worker "
+						 "each time the size of the relation it scans triples."),
+			GUC_UNIT_BLOCKS,
+		},
+		&min_parallel_relation_size,
+		1024, 0, INT_MAX / 3,
+		NULL, NULL, NULL
+	},
+
 	{
 		/* Can't be set in postgresql.conf */
 		{"server_version_num", PGC_INTERNAL, PRESET_OPTIONS,
@@ -2841,12 +3159,23 @@ static struct config_int ConfigureNamesInt[] =
 #ifdef PGXC
 	{
 		{"sequence_range", PGC_USERSET, COORDINATORS,
-			gettext_noop("The range of values to ask from GTM for sequences. "
+			gettext_noop("The maximum range of values to ask from GTM for sequences. "
 			             "If CACHE parameter is set then that overrides this."),
 			NULL,
 		},
 		&SequenceRangeVal,
-		1, 1, INT_MAX,
+		1000, 1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"redistribution_max_buckets", PGC_USERSET, COORDINATORS,
+			gettext_noop("Sets the maximum number of buckets moved between the "
+						 "remaining nodes of a table by one redistribution."),
+			gettext_noop("Zero moves all the buckets at once.")
+		},
+		&RedistribMaxBuckets,
+		0, 0, INT_MAX,
 		NULL, NULL, NULL
 	},
 
@@ -2883,6 +3212,38 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"min_pool_size", PGC_SIGHUP, DATA_NODES,
+			gettext_noop("Sets the number of free connections to keep ready in each pool."),
+			gettext_noop("Zero disables opening connections in advance.")
+		},
+		&MinPoolSize,
+		0, 0, 65535,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"pool_wait_timeout", PGC_SIGHUP, DATA_NODES,
+			gettext_noop("Sets the maximum time a session waits for pooled connections."),
+			gettext_noop("Sessions wait when the pools they need are at max_pool_size. "
+						 "Zero makes their requests fail immediately."),
+			GUC_UNIT_MS
+		},
+		&PoolWaitTimeout,
+		0, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"pool_max_waiters", PGC_SIGHUP, DATA_NODES,
+			gettext_noop("Sets the maximum number of sessions of a database or a user waiting for pooled connections."),
+			gettext_noop("Zero means no limit.")
+		},
+		&PoolMaxWaiters,
+		0, 0, MAX_BACKENDS,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"pooler_port", PGC_POSTMASTER, DATA_NODES,
 			gettext_noop("Port of the Pool Manager."),
@@ -2903,6 +3264,30 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"gtm_clock_sync_interval", PGC_SIGHUP, GTM,
+			gettext_noop("Derives transaction timestamps from the local clock, "
+						 "synchronized with GTM at this interval."),
+			gettext_noop("0 takes the timestamps from GTM along with the GXIDs."),
+			GUC_UNIT_MS
+		},
+		&gtm_clock_sync_interval,
+		0, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"gtm_global_xmin_interval", PGC_SIGHUP, GTM,
+			gettext_noop("Asks GTM for the global xmin when it did not advance "
+						 "within this interval."),
+			gettext_noop("0 only takes it from the snapshots."),
+			GUC_UNIT_MS
+		},
+		&gtm_global_xmin_interval,
+		1000, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"max_datanodes", PGC_POSTMASTER, DATA_NODES,
 			gettext_noop("Maximum number of Datanodes in the cluster."),
@@ -2951,6 +3336,146 @@ static struct config_int ConfigureNamesInt[] =
 		64, 1, MAX_KILOBYTES,
 		NULL, NULL, NULL
 	},
+
+	{
+		{"remote_prefetch_size", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Sets the amount of data read in advance from each "
+						 "remote node connection."),
+			gettext_noop("Zero disables reading in advance."),
+			GUC_UNIT_KB
+		},
+		&RemotePrefetchSize,
+		256, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"remote_fetch_size", PGC_USERSET, RESOURCES_MEM,
+			gettext_noop("Sets the number of rows requested at once from a "
+						 "remote subplan read as a cursor."),
+			gettext_noop("Requests of a subplan that keeps being read grow up to "
+						 "64 times this number.")
+		},
+		&RemoteFetchSize,
+		1000, 1, INT_MAX / 64,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"insert_batch_size", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Sets the number of INSERTs in a transaction block sent to a "
+						 "remote node without waiting for the results."),
+			gettext_noop("Zero waits for the results of every INSERT.")
+		},
+		&InsertBatchSize,
+		0, 0, 1000,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"remote_subplan_cache_size", PGC_SIGHUP, QUERY_TUNING_OTHER,
+			gettext_noop("Sets the number of decoded remote subplans a Datanode "
+						 "connection keeps for reuse by later sessions."),
+			gettext_noop("Zero decodes every remote subplan received.")
+		},
+		&RemoteSubplanCacheSize,
+		100, 0, 10000,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"ddl_batch_size", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Sets the number of utility statements in a transaction "
+						 "block sent to the remote nodes without waiting for the results."),
+			gettext_noop("Zero waits for the results of every statement.")
+		},
+		&DDLBatchSize,
+		0, 0, 1000,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"standby_read_max_lag", PGC_USERSET, COORDINATORS,
+			gettext_noop("Sets the maximum lag of the Datanode standbys running "
+						 "read-only statements."),
+			gettext_noop("-1 runs all statements on the Datanodes."),
+			GUC_UNIT_MS
+		},
+		&StandbyReadMaxLag,
+		-1, -1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_active_statements", PGC_SIGHUP, COORDINATORS,
+			gettext_noop("Sets the maximum number of distributed statements "
+						 "running at once on the Datanodes."),
+			gettext_noop("The others wait for a running one to finish. "
+						 "0 does not limit them.")
+		},
+		&MaxActiveStatements,
+		0, 0, MAX_BACKENDS,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_active_large_statements", PGC_SIGHUP, COORDINATORS,
+			gettext_noop("Sets the maximum number of distributed statements "
+						 "of the large class running at once on the Datanodes."),
+			gettext_noop("0 does not limit them.")
+		},
+		&MaxActiveLargeStatements,
+		0, 0, MAX_BACKENDS,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"admission_timeout", PGC_USERSET, COORDINATORS,
+			gettext_noop("Sets the maximum time a statement waits to run on "
+						 "the Datanodes."),
+			gettext_noop("0 waits forever."),
+			GUC_UNIT_MS
+		},
+		&AdmissionTimeout,
+		0, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"result_cache_size", PGC_USERSET, COORDINATORS,
+			gettext_noop("Sets the maximum memory used by each session to "
+						 "cache the results of the queries on tables with "
+						 "the result_cache option."),
+			gettext_noop("0 disables the result cache."),
+			GUC_UNIT_KB
+		},
+		&ResultCacheSize,
+		0, 0, MAX_KILOBYTES,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"remote_compression_threshold", PGC_BACKEND, CONN_AUTH,
+			gettext_noop("Sets the minimum amount of data sent to a remote "
+						 "node at once to be compressed."),
+			gettext_noop("-1 disables compression.")
+		},
+		&RemoteCompressionThreshold,
+		-1, -1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"adaptive_broadcast_rows", PGC_USERSET, QUERY_TUNING_OTHER,
+			gettext_noop("Sets the number of rows a node broadcasts to the "
+						 "nodes joining them before it sends the rest "
+						 "by the join key."),
+			gettext_noop("Zero disables switching from broadcast.")
+		},
+		&adaptive_broadcast_rows,
+		100000, 0, INT_MAX,
+		NULL, NULL, NULL
+	},
 #endif
 #endif /* PGXC */
 
@@ -3025,6 +3550,16 @@ static struct config_real ConfigureNamesReal[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"jit_above_cost", PGC_USERSET, QUERY_TUNING_COST,
+			gettext_noop("Compiles plans costing more than that, if a JIT provider is set."),
+			NULL
+		},
+		&jit_above_cost,
+		100000, 0, DBL_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"cursor_tuple_fraction", PGC_USERSET, QUERY_TUNING_OTHER,
 			gettext_noop("Sets the planner's estimate of the fraction of "
@@ -3056,6 +3591,17 @@ static struct config_real ConfigureNamesReal[] =
 		&remote_query_cost,
 		DEFAULT_REMOTE_QUERY_COST, 0, DBL_MAX, NULL, NULL
 	},
+
+	{
+		{"large_statement_cost", PGC_SIGHUP, COORDINATORS,
+			gettext_noop("Sets the plan cost from which a distributed "
+						 "statement is of the large class."),
+			NULL
+		},
+		&LargeStatementCost,
+		100000.0, 0, DBL_MAX,
+		NULL, NULL, NULL
+	},
 #endif
 
 	{
@@ -3211,6 +3757,19 @@ static struct config_string ConfigureNamesString[] =
 		check_temp_tablespaces, assign_temp_tablespaces, NULL
 	},
 
+#ifdef XCP
+	{
+		{"network_link_costs", PGC_USERSET, QUERY_TUNING_COST,
+			gettext_noop("Sets the planner's estimate of the cost of sending "
+						 "data over each link between the nodes."),
+			gettext_noop("A list of from:to=factor entries, relative to network_byte_cost.")
+		},
+		&network_link_costs,
+		"",
+		check_network_link_costs, assign_network_link_costs, NULL
+	},
+#endif
+
 	{
 		{"dynamic_library_path", PGC_SUSET, CLIENT_CONN_OTHER,
 			gettext_noop("Sets the path for dynamically loadable modules."),
@@ -3225,6 +3784,17 @@ static struct config_string ConfigureNamesString[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"jit_provider", PGC_SUSET, CLIENT_CONN_OTHER,
+			gettext_noop("Sets the shared library compiling expensive plans at execution time."),
+			gettext_noop("An empty string disables compilation."),
+			GUC_SUPERUSER_ONLY
+		},
+		&jit_provider,
+		"",
+		NULL, NULL, NULL
+	},
+
 	{
 		{"krb_server_keyfile", PGC_SIGHUP, CONN_AUTH_SECURITY,
 			gettext_noop("Sets the location of the Kerberos server key file."),
@@ -3707,6 +4277,28 @@ static struct config_string ConfigureNamesString[] =
 		"",
 		NULL, NULL, NULL
 	},
+
+	{
+		{"tenant_column", PGC_USERSET, COORDINATORS,
+			gettext_noop("Sets the name of the distribution column holding the tenant key."),
+			NULL,
+			GUC_IS_NAME
+		},
+		&TenantColumn,
+		"",
+		NULL, assign_tenant_column, NULL
+	},
+
+	{
+		{"tenant_id", PGC_USERSET, COORDINATORS,
+			gettext_noop("Sets the tenant key of the rows the session works with."),
+			gettext_noop("Queries on tables distributed by the tenant column "
+						 "only go to the Datanodes storing the rows of the tenant.")
+		},
+		&TenantId,
+		"",
+		NULL, assign_tenant_id, NULL
+	},
 #endif
 #ifdef XCP
 	{
@@ -4017,6 +4609,29 @@ static struct config_enum ConfigureNamesEnum[] =
 		REMOTE_CONN_APP, pgxc_conn_types,
 		NULL, NULL, NULL
 	},
+
+	{
+		{"replicated_read_policy", PGC_USERSET, COORDINATORS,
+			gettext_noop("Sets how the Datanode reading a replicated table is chosen."),
+			gettext_noop("Nodes the session is connected to are preferred unless "
+						 "set to random, then the ones answering faster if set to latency.")
+		},
+		&replicated_read_policy,
+		REPLICATED_READ_LATENCY, replicated_read_policy_options,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"statement_class", PGC_SUSET, COORDINATORS,
+			gettext_noop("Sets the class of the distributed statements, "
+						 "limiting how many run at once."),
+			gettext_noop("auto chooses it by the cost of the plan. It is "
+						 "usually set for a role with ALTER ROLE.")
+		},
+		&StatementClassSetting,
+		STATEMENT_CLASS_AUTO, statement_class_options,
+		NULL, NULL, NULL
+	},
 #endif
 	{
 		{"huge_pages", PGC_POSTMASTER, RESOURCES_MEM,
@@ -10203,6 +10818,26 @@ assign_session_replication_role(int newval, void *extra)
 		ResetPlanCache();
 }
 
+#ifdef PGXC
+/*
+ * Plans of the queries on multi-tenant tables are restricted to the nodes
+ * of the tenant, flush the plan cache when it changes.
+ */
+static void
+assign_tenant_column(const char *newval, void *extra)
+{
+	if (TenantColumn == NULL || strcmp(TenantColumn, newval) != 0)
+		ResetPlanCache();
+}
+
+static void
+assign_tenant_id(const char *newval, void *extra)
+{
+	if (TenantId == NULL || strcmp(TenantId, newval) != 0)
+		ResetPlanCache();
+}
+#endif
+
 static bool
 check_temp_buffers(int *newval, void **extra, GucSource source)
 {
@@ -0,0 +1,644 @@
+/*-------------------------------------------------------------------------
+ *
+ * bump.c
+ *	  Bump allocator definitions.
+ *
+ * BumpContext is a MemoryContext implementation for memory which is filled
+ * once and released all together, by resetting or deleting the context.
+ * Each request is served from the end of the current block, without rounding
+ * to a power of 2 and without any freelist.  pfree() of a chunk does nothing
+ * and repalloc() of a chunk other than the most recent one copies it; the
+ * space is only reclaimed when the context is reset.  That suits contexts
+ * like the one a decoded plan is stored in, which is never modified, or a
+ * per-message context, and must not be used for memory which is freed and
+ * allocated again repeatedly over the lifetime of the context.
+ *
+ * Requests larger than a quarter of the maximum block size get a dedicated
+ * block, so the space remaining in the current block is not wasted.
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/mmgr/bump.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "utils/memdebug.h"
+#include "utils/memutils.h"
+
+
+#define BUMP_BLOCKHDRSZ		MAXALIGN(sizeof(BumpBlockData))
+#define BUMP_CHUNKHDRSZ		MAXALIGN(sizeof(BumpChunkData))
+
+/* Portion of BUMP_CHUNKHDRSZ examined outside bump.c. */
+#define BUMP_CHUNK_PUBLIC	\
+	(offsetof(BumpChunkData, size) + sizeof(Size))
+
+/* We allow chunks to be at most 1/4 of maxBlockSize (less overhead) */
+#define BUMP_CHUNK_FRACTION	4
+
+typedef struct BumpBlockData *BumpBlock;	/* forward reference */
+typedef struct BumpChunkData *BumpChunk;
+
+/*
+ * BumpContext
+ *
+ * The current block is at the head of the blocks list.
+ */
+typedef struct BumpContext
+{
+	MemoryContextData header;	/* Standard memory-context fields */
+	/* Info about storage allocated in this context: */
+	BumpBlock	blocks;			/* head of list of blocks in this context */
+	/* Allocation parameters for this context: */
+	Size		initBlockSize;	/* initial block size */
+	Size		maxBlockSize;	/* maximum block size */
+	Size		nextBlockSize;	/* next block size to allocate */
+	Size		chunkLimit;		/* larger chunks get a dedicated block */
+	BumpBlock	keeper;			/* if not NULL, keep this block over resets */
+} BumpContext;
+
+typedef BumpContext *Bump;
+
+/*
+ * BumpBlock
+ *		The unit of memory obtained from malloc(), holding the chunks one
+ *		after another.
+ */
+typedef struct BumpBlockData
+{
+	BumpBlock	next;			/* next block in the list */
+	char	   *freeptr;		/* start of free space in this block */
+	char	   *endptr;			/* end of space in this block */
+} BumpBlockData;
+
+/*
+ * BumpChunk
+ *		The prefix of each piece of memory in a BumpBlock
+ *
+ * NB: this MUST match StandardChunkHeader as defined by utils/memutils.h.
+ */
+typedef struct BumpChunkData
+{
+	/* the owning context */
+	void	   *bump;
+	/* size is always the size of the usable space in the chunk */
+	Size		size;
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* when debugging memory usage, also store actual requested size */
+	Size		requested_size;
+#endif
+} BumpChunkData;
+
+#define BumpPointerGetChunk(ptr)	\
+					((BumpChunk)(((char *)(ptr)) - BUMP_CHUNKHDRSZ))
+#define BumpChunkGetPointer(chk)	\
+					((void *)(((char *)(chk)) + BUMP_CHUNKHDRSZ))
+
+/*
+ * These functions implement the MemoryContext API for Bump contexts.
+ */
+static void *BumpAlloc(MemoryContext context, Size size);
+static void BumpFree(MemoryContext context, void *pointer);
+static void *BumpRealloc(MemoryContext context, void *pointer, Size size);
+static void BumpInit(MemoryContext context);
+static void BumpReset(MemoryContext context);
+static void BumpDelete(MemoryContext context);
+static Size BumpGetChunkSpace(MemoryContext context, void *pointer);
+static bool BumpIsEmpty(MemoryContext context);
+static void BumpStats(MemoryContext context, int level);
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void BumpCheck(MemoryContext context);
+#endif
+
+/*
+ * This is the virtual function table for Bump contexts.
+ */
+static MemoryContextMethods BumpMethods = {
+	BumpAlloc,
+	BumpFree,
+	BumpRealloc,
+	BumpInit,
+	BumpReset,
+	BumpDelete,
+	BumpGetChunkSpace,
+	BumpIsEmpty,
+	BumpStats
+#ifdef MEMORY_CONTEXT_CHECKING
+	,BumpCheck
+#endif
+};
+
+#ifdef CLOBBER_FREED_MEMORY
+
+/* Wipe freed memory for debugging purposes */
+static void
+wipe_mem(void *ptr, size_t size)
+{
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, size);
+	memset(ptr, 0x7F, size);
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, size);
+}
+#endif
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void
+set_sentinel(void *base, Size offset)
+{
+	char	   *ptr = (char *) base + offset;
+
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, 1);
+	*ptr = 0x7E;
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, 1);
+}
+
+static bool
+sentinel_ok(const void *base, Size offset)
+{
+	const char *ptr = (const char *) base + offset;
+	bool		ret;
+
+	VALGRIND_MAKE_MEM_DEFINED(ptr, 1);
+	ret = *ptr == 0x7E;
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, 1);
+
+	return ret;
+}
+#endif
+
+
+/*
+ * Public routines
+ */
+
+
+/*
+ * BumpContextCreate
+ *		Create a new Bump context.
+ *
+ * parent: parent context, or NULL if top-level context
+ * name: name of context (for debugging --- string will be copied)
+ * initBlockSize: initial allocation block size
+ * maxBlockSize: maximum allocation block size
+ */
+MemoryContext
+BumpContextCreate(MemoryContext parent,
+				  const char *name,
+				  Size initBlockSize,
+				  Size maxBlockSize)
+{
+	Bump		bump;
+
+	/* Do the type-independent part of context creation */
+	bump = (Bump) MemoryContextCreate(T_BumpContext,
+									  sizeof(BumpContext),
+									  &BumpMethods,
+									  parent,
+									  name);
+
+	/*
+	 * Make sure alloc parameters are reasonable, and save them.
+	 *
+	 * We somewhat arbitrarily enforce a minimum 1K block size.
+	 */
+	initBlockSize = MAXALIGN(initBlockSize);
+	if (initBlockSize < 1024)
+		initBlockSize = 1024;
+	maxBlockSize = MAXALIGN(maxBlockSize);
+	if (maxBlockSize < initBlockSize)
+		maxBlockSize = initBlockSize;
+	Assert(AllocHugeSizeIsValid(maxBlockSize)); /* must be safe to double */
+	bump->initBlockSize = initBlockSize;
+	bump->maxBlockSize = maxBlockSize;
+	bump->nextBlockSize = initBlockSize;
+	bump->chunkLimit = (maxBlockSize - BUMP_BLOCKHDRSZ) / BUMP_CHUNK_FRACTION;
+
+	return (MemoryContext) bump;
+}
+
+/*
+ * BumpInit
+ *		Context-type-specific initialization routine.
+ */
+static void
+BumpInit(MemoryContext context)
+{
+	/*
+	 * Since MemoryContextCreate already zeroed the context node, we don't
+	 * have to do anything here: it's already OK.
+	 */
+}
+
+/*
+ * BumpReset
+ *		Frees all memory which is allocated in the given context.
+ *
+ * Like AllocSetReset, we hang onto the first regular block, so a context
+ * which is repeatedly reset after small allocations does not thrash malloc().
+ */
+static void
+BumpReset(MemoryContext context)
+{
+	Bump		bump = (Bump) context;
+	BumpBlock	block = bump->blocks;
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Check for corruption before freeing */
+	BumpCheck(context);
+#endif
+
+	/* New blocks list is either empty or just the keeper block */
+	bump->blocks = bump->keeper;
+
+	while (block != NULL)
+	{
+		BumpBlock	next = block->next;
+
+		if (block == bump->keeper)
+		{
+			/* Reset the block, but don't return it to malloc */
+			char	   *datastart = ((char *) block) + BUMP_BLOCKHDRSZ;
+
+#ifdef CLOBBER_FREED_MEMORY
+			wipe_mem(datastart, block->freeptr - datastart);
+#else
+			/* wipe_mem() would have done this */
+			VALGRIND_MAKE_MEM_NOACCESS(datastart, block->freeptr - datastart);
+#endif
+			block->freeptr = datastart;
+			block->next = NULL;
+		}
+		else
+		{
+			/* Normal case, release the block */
+			bump->header.mem_allocated -= block->endptr - ((char *) block);
+#ifdef CLOBBER_FREED_MEMORY
+			wipe_mem(block, block->freeptr - ((char *) block));
+#endif
+			free(block);
+		}
+		block = next;
+	}
+
+	/* Reset block size allocation sequence, too */
+	bump->nextBlockSize = bump->initBlockSize;
+}
+
+/*
+ * BumpDelete
+ *		Frees all memory which is allocated in the given context, in
+ *		preparation for deletion of the context.
+ */
+static void
+BumpDelete(MemoryContext context)
+{
+	Bump		bump = (Bump) context;
+	BumpBlock	block = bump->blocks;
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Check for corruption before freeing */
+	BumpCheck(context);
+#endif
+
+	/* Make it look empty, just in case... */
+	bump->blocks = NULL;
+	bump->keeper = NULL;
+	bump->header.mem_allocated = 0;
+
+	while (block != NULL)
+	{
+		BumpBlock	next = block->next;
+
+#ifdef CLOBBER_FREED_MEMORY
+		wipe_mem(block, block->freeptr - ((char *) block));
+#endif
+		free(block);
+		block = next;
+	}
+}
+
+/*
+ * BumpAlloc
+ *		Returns pointer to allocated memory of given size or NULL if
+ *		request could not be completed; memory is added to the context.
+ */
+static void *
+BumpAlloc(MemoryContext context, Size size)
+{
+	Bump		bump = (Bump) context;
+	BumpBlock	block;
+	BumpChunk	chunk;
+	Size		chunk_size;
+	Size		required_size;
+
+	chunk_size = MAXALIGN(size);
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* make sure there is room for the sentinel byte */
+	if (chunk_size == size)
+		chunk_size += MAXIMUM_ALIGNOF;
+#endif
+	required_size = chunk_size + BUMP_CHUNKHDRSZ;
+
+	if (chunk_size > bump->chunkLimit)
+	{
+		/*
+		 * Allocate an entire block for this request, and stick it underneath
+		 * the current block, so that we don't lose the use of the space
+		 * remaining therein.
+		 */
+		Size		blksize = required_size + BUMP_BLOCKHDRSZ;
+
+		block = (BumpBlock) malloc(blksize);
+		if (block == NULL)
+			return NULL;
+		bump->header.mem_allocated += blksize;
+		block->freeptr = block->endptr = ((char *) block) + blksize;
+		if (bump->blocks != NULL)
+		{
+			block->next = bump->blocks->next;
+			bump->blocks->next = block;
+		}
+		else
+		{
+			block->next = NULL;
+			bump->blocks = block;
+		}
+		chunk = (BumpChunk) (((char *) block) + BUMP_BLOCKHDRSZ);
+	}
+	else
+	{
+		block = bump->blocks;
+		if (block == NULL || block->endptr - block->freeptr < required_size)
+		{
+			/*
+			 * Time to create a new block.  The first one has size
+			 * initBlockSize, and we double the space in each succeeding
+			 * block, but not more than maxBlockSize.
+			 */
+			Size		blksize = bump->nextBlockSize;
+
+			bump->nextBlockSize <<= 1;
+			if (bump->nextBlockSize > bump->maxBlockSize)
+				bump->nextBlockSize = bump->maxBlockSize;
+			while (blksize < required_size + BUMP_BLOCKHDRSZ)
+				blksize <<= 1;
+
+			block = (BumpBlock) malloc(blksize);
+			if (block == NULL)
+				return NULL;
+			bump->header.mem_allocated += blksize;
+			block->freeptr = ((char *) block) + BUMP_BLOCKHDRSZ;
+			block->endptr = ((char *) block) + blksize;
+
+			/* The first regular block is kept over resets */
+			if (bump->keeper == NULL && blksize == bump->initBlockSize)
+				bump->keeper = block;
+
+			/* Mark unallocated space NOACCESS. */
+			VALGRIND_MAKE_MEM_NOACCESS(block->freeptr,
+									   blksize - BUMP_BLOCKHDRSZ);
+
+			block->next = bump->blocks;
+			bump->blocks = block;
+		}
+
+		chunk = (BumpChunk) block->freeptr;
+		VALGRIND_MAKE_MEM_UNDEFINED(chunk, BUMP_CHUNKHDRSZ);
+		block->freeptr += required_size;
+		Assert(block->freeptr <= block->endptr);
+	}
+
+	chunk->bump = (void *) bump;
+	chunk->size = chunk_size;
+#ifdef MEMORY_CONTEXT_CHECKING
+	chunk->requested_size = size;
+	/* set mark to catch clobber of "unused" space */
+	set_sentinel(BumpChunkGetPointer(chunk), size);
+#endif
+
+	/*
+	 * Chunk header public fields remain DEFINED; the rest is NOACCESS until
+	 * our caller makes the requested space UNDEFINED.
+	 */
+	VALGRIND_MAKE_MEM_NOACCESS((char *) chunk + BUMP_CHUNK_PUBLIC,
+							   chunk_size + BUMP_CHUNKHDRSZ - BUMP_CHUNK_PUBLIC);
+
+	return BumpChunkGetPointer(chunk);
+}
+
+/*
+ * BumpFree
+ *		Nothing to do, the space is reclaimed when the context is reset.
+ */
+static void
+BumpFree(MemoryContext context, void *pointer)
+{
+#if defined(MEMORY_CONTEXT_CHECKING) || defined(CLOBBER_FREED_MEMORY)
+	BumpChunk	chunk = BumpPointerGetChunk(pointer);
+#endif
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	VALGRIND_MAKE_MEM_DEFINED(&chunk->requested_size,
+							  sizeof(chunk->requested_size));
+	/* Test for someone scribbling on unused space in chunk */
+	if (!sentinel_ok(pointer, chunk->requested_size))
+		elog(WARNING, "detected write past chunk end in %s %p",
+			 context->name, chunk);
+	VALGRIND_MAKE_MEM_NOACCESS(&chunk->requested_size,
+							   sizeof(chunk->requested_size));
+#endif
+
+#ifdef CLOBBER_FREED_MEMORY
+	/* Keep the sentinel byte, BumpCheck still looks at the chunk */
+#ifdef MEMORY_CONTEXT_CHECKING
+	wipe_mem(pointer, chunk->requested_size);
+#else
+	wipe_mem(pointer, chunk->size);
+#endif
+#endif
+}
+
+/*
+ * BumpRealloc
+ *		Returns new pointer to allocated memory of given size or NULL if
+ *		request could not be completed.
+ *
+ * The most recent chunk of the current block is resized in place if the
+ * block has room for it, as is any chunk shrinking.  Otherwise a new chunk
+ * is allocated and the data copied; the old chunk is not reused.
+ */
+static void *
+BumpRealloc(MemoryContext context, void *pointer, Size size)
+{
+	Bump		bump = (Bump) context;
+	BumpChunk	chunk = BumpPointerGetChunk(pointer);
+	BumpBlock	block = bump->blocks;
+	Size		oldsize = chunk->size;
+	Size		chunk_size;
+	void	   *newPointer;
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	VALGRIND_MAKE_MEM_DEFINED(&chunk->requested_size,
+							  sizeof(chunk->requested_size));
+	/* Test for someone scribbling on unused space in chunk */
+	if (!sentinel_ok(pointer, chunk->requested_size))
+		elog(WARNING, "detected write past chunk end in %s %p",
+			 bump->header.name, chunk);
+	oldsize = chunk->requested_size;
+#endif
+
+	chunk_size = MAXALIGN(size);
+#ifdef MEMORY_CONTEXT_CHECKING
+	if (chunk_size == size)
+		chunk_size += MAXIMUM_ALIGNOF;
+#endif
+
+	if (chunk_size > chunk->size && block != NULL &&
+			block->freeptr == (char *) pointer + chunk->size &&
+			chunk_size <= bump->chunkLimit &&
+			block->endptr - (char *) pointer >= chunk_size)
+	{
+		/* The last chunk of the current block, extend it */
+		VALGRIND_MAKE_MEM_UNDEFINED(block->freeptr,
+									chunk_size - chunk->size);
+		block->freeptr = (char *) pointer + chunk_size;
+		chunk->size = chunk_size;
+	}
+
+	if (chunk_size <= chunk->size)
+	{
+#ifdef MEMORY_CONTEXT_CHECKING
+		chunk->requested_size = size;
+		VALGRIND_MAKE_MEM_NOACCESS(&chunk->requested_size,
+								   sizeof(chunk->requested_size));
+		set_sentinel(pointer, size);
+#endif
+		return pointer;
+	}
+
+	newPointer = BumpAlloc(context, size);
+	if (newPointer == NULL)
+		return NULL;
+
+	/* transfer existing data (certain to fit) */
+	VALGRIND_MAKE_MEM_DEFINED(pointer, oldsize);
+	memcpy(newPointer, pointer, oldsize);
+
+	return newPointer;
+}
+
+/*
+ * BumpGetChunkSpace
+ *		Given a currently-allocated chunk, determine the total space
+ *		it occupies (including all memory-allocation overhead).
+ */
+static Size
+BumpGetChunkSpace(MemoryContext context, void *pointer)
+{
+	BumpChunk	chunk = BumpPointerGetChunk(pointer);
+
+	return chunk->size + BUMP_CHUNKHDRSZ;
+}
+
+/*
+ * BumpIsEmpty
+ *		Is the context empty of any allocated space?
+ */
+static bool
+BumpIsEmpty(MemoryContext context)
+{
+	/* Only if the context is new or just reset, like AllocSetIsEmpty */
+	if (context->isReset)
+		return true;
+	return false;
+}
+
+/*
+ * BumpStats
+ *		Displays stats about memory consumption of a bump context.
+ */
+static void
+BumpStats(MemoryContext context, int level)
+{
+	Bump		bump = (Bump) context;
+	Size		nblocks = 0;
+	Size		totalspace = 0;
+	Size		freespace = 0;
+	BumpBlock	block;
+	int			i;
+
+	for (block = bump->blocks; block != NULL; block = block->next)
+	{
+		nblocks++;
+		totalspace += block->endptr - ((char *) block);
+		freespace += block->endptr - block->freeptr;
+	}
+
+	for (i = 0; i < level; i++)
+		fprintf(stderr, "  ");
+
+	fprintf(stderr,
+			"%s: %zu total in %zd blocks; %zu free; %zu used\n",
+			bump->header.name, totalspace, nblocks, freespace,
+			totalspace - freespace);
+}
+
+
+#ifdef MEMORY_CONTEXT_CHECKING
+
+/*
+ * BumpCheck
+ *		Walk through chunks and check consistency of memory.
+ *
+ * NOTE: report errors as WARNING, *not* ERROR or FATAL.  Otherwise you'll
+ * find yourself in an infinite loop when trouble occurs, because this
+ * routine will be entered again when elog cleanup tries to release memory!
+ */
+static void
+BumpCheck(MemoryContext context)
+{
+	Bump		bump = (Bump) context;
+	char	   *name = bump->header.name;
+	BumpBlock	block;
+
+	for (block = bump->blocks; block != NULL; block = block->next)
+	{
+		char	   *bpoz = ((char *) block) + BUMP_BLOCKHDRSZ;
+
+		while (bpoz < block->freeptr)
+		{
+			BumpChunk	chunk = (BumpChunk) bpoz;
+			Size		dsize;
+
+			VALGRIND_MAKE_MEM_DEFINED(&chunk->requested_size,
+									  sizeof(chunk->requested_size));
+			dsize = chunk->requested_size;
+			VALGRIND_MAKE_MEM_NOACCESS(&chunk->requested_size,
+									   sizeof(chunk->requested_size));
+
+			if (chunk->bump != (void *) bump)
+				elog(WARNING, "problem in bump %s: bogus context link in block %p, chunk %p",
+					 name, block, chunk);
+			if (dsize >= chunk->size)
+				elog(WARNING, "problem in bump %s: req size >= alloc size for chunk %p in block %p",
+					 name, chunk, block);
+			else if (!sentinel_ok(chunk, BUMP_CHUNKHDRSZ + dsize))
+				elog(WARNING, "problem in bump %s: detected write past chunk end in block %p, chunk %p",
+					 name, block, chunk);
+
+			bpoz += BUMP_CHUNKHDRSZ + chunk->size;
+		}
+
+		if (bpoz != block->freeptr)
+			elog(WARNING, "problem in bump %s: found inconsistent memory block %p",
+				 name, block);
+	}
+}
+
+#endif   /* MEMORY_CONTEXT_CHECKING */
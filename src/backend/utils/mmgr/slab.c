@@ -0,0 +1,527 @@
+/*-------------------------------------------------------------------------
+ *
+ * slab.c
+ *	  Slab allocator definitions.
+ *
+ * SlabContext is a MemoryContext implementation for objects of one fixed
+ * size, allocated and freed one at a time in large numbers.  The chunks are
+ * carved out of equally sized blocks and a freed chunk is put on a single
+ * freelist, to be handed out again by the next allocation.  Compared to
+ * AllocSet there is no rounding of the request to a power of 2 and no search
+ * for the freelist to use, and the blocks are filled completely.
+ *
+ * Requests larger than the chunk size of the context are rejected.  Smaller
+ * ones are served with a full chunk.  The blocks are only returned to
+ * malloc() when the context is reset or deleted.
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ * Portions Copyright (c) 1996-2015, PostgreSQL Global Development Group
+ *
+ * IDENTIFICATION
+ *	  src/backend/utils/mmgr/slab.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "utils/memdebug.h"
+#include "utils/memutils.h"
+
+
+#define SLAB_BLOCKHDRSZ		MAXALIGN(sizeof(SlabBlockData))
+#define SLAB_CHUNKHDRSZ		MAXALIGN(sizeof(SlabChunkData))
+
+/* Portion of SLAB_CHUNKHDRSZ examined outside slab.c. */
+#define SLAB_CHUNK_PUBLIC	\
+	(offsetof(SlabChunkData, size) + sizeof(Size))
+
+typedef struct SlabBlockData *SlabBlock;	/* forward reference */
+typedef struct SlabChunkData *SlabChunk;
+
+/*
+ * SlabContext
+ *
+ * The newest block is at the head of the blocks list; the chunks between its
+ * freeptr and endptr have not been handed out yet.
+ */
+typedef struct SlabContext
+{
+	MemoryContextData header;	/* Standard memory-context fields */
+	/* Info about storage allocated in this context: */
+	SlabBlock	blocks;			/* head of list of blocks in this context */
+	SlabChunk	freelist;		/* chunks freed and not reused yet */
+	Size		nchunks;		/* number of allocated chunks */
+	/* Allocation parameters for this context: */
+	Size		chunkSize;		/* usable size of each chunk */
+	Size		fullChunkSize;	/* space of each chunk, header included */
+	Size		blockSize;		/* size of each block */
+} SlabContext;
+
+typedef SlabContext *Slab;
+
+/*
+ * SlabBlock
+ *		The unit of memory obtained from malloc(), holding as many chunks as
+ *		fit in it.
+ */
+typedef struct SlabBlockData
+{
+	SlabBlock	next;			/* next block in the list */
+	char	   *freeptr;		/* start of space not carved into chunks */
+	char	   *endptr;			/* end of space in this block */
+} SlabBlockData;
+
+/*
+ * SlabChunk
+ *		The prefix of each piece of memory in a SlabBlock
+ *
+ * NB: this MUST match StandardChunkHeader as defined by utils/memutils.h.
+ */
+typedef struct SlabChunkData
+{
+	/* slab is the owning context if allocated, or the freelist link if free */
+	void	   *slab;
+	/* size is always the chunk size of the context */
+	Size		size;
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* when debugging memory usage, also store actual requested size */
+	/* this is zero in a free chunk */
+	Size		requested_size;
+#endif
+} SlabChunkData;
+
+#define SlabPointerGetChunk(ptr)	\
+					((SlabChunk)(((char *)(ptr)) - SLAB_CHUNKHDRSZ))
+#define SlabChunkGetPointer(chk)	\
+					((void *)(((char *)(chk)) + SLAB_CHUNKHDRSZ))
+
+/*
+ * These functions implement the MemoryContext API for Slab contexts.
+ */
+static void *SlabAlloc(MemoryContext context, Size size);
+static void SlabFree(MemoryContext context, void *pointer);
+static void *SlabRealloc(MemoryContext context, void *pointer, Size size);
+static void SlabInit(MemoryContext context);
+static void SlabReset(MemoryContext context);
+static void SlabDelete(MemoryContext context);
+static Size SlabGetChunkSpace(MemoryContext context, void *pointer);
+static bool SlabIsEmpty(MemoryContext context);
+static void SlabStats(MemoryContext context, int level);
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void SlabCheck(MemoryContext context);
+#endif
+
+/*
+ * This is the virtual function table for Slab contexts.
+ */
+static MemoryContextMethods SlabMethods = {
+	SlabAlloc,
+	SlabFree,
+	SlabRealloc,
+	SlabInit,
+	SlabReset,
+	SlabDelete,
+	SlabGetChunkSpace,
+	SlabIsEmpty,
+	SlabStats
+#ifdef MEMORY_CONTEXT_CHECKING
+	,SlabCheck
+#endif
+};
+
+#ifdef CLOBBER_FREED_MEMORY
+
+/* Wipe freed memory for debugging purposes */
+static void
+wipe_mem(void *ptr, size_t size)
+{
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, size);
+	memset(ptr, 0x7F, size);
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, size);
+}
+#endif
+
+#ifdef MEMORY_CONTEXT_CHECKING
+static void
+set_sentinel(void *base, Size offset)
+{
+	char	   *ptr = (char *) base + offset;
+
+	VALGRIND_MAKE_MEM_UNDEFINED(ptr, 1);
+	*ptr = 0x7E;
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, 1);
+}
+
+static bool
+sentinel_ok(const void *base, Size offset)
+{
+	const char *ptr = (const char *) base + offset;
+	bool		ret;
+
+	VALGRIND_MAKE_MEM_DEFINED(ptr, 1);
+	ret = *ptr == 0x7E;
+	VALGRIND_MAKE_MEM_NOACCESS(ptr, 1);
+
+	return ret;
+}
+#endif
+
+
+/*
+ * Public routines
+ */
+
+
+/*
+ * SlabContextCreate
+ *		Create a new Slab context.
+ *
+ * parent: parent context, or NULL if top-level context
+ * name: name of context (for debugging --- string will be copied)
+ * blockSize: allocation block size
+ * chunkSize: size of the objects allocated in the context
+ */
+MemoryContext
+SlabContextCreate(MemoryContext parent,
+				  const char *name,
+				  Size blockSize,
+				  Size chunkSize)
+{
+	Slab		slab;
+
+	/* Do the type-independent part of context creation */
+	slab = (Slab) MemoryContextCreate(T_SlabContext,
+									  sizeof(SlabContext),
+									  &SlabMethods,
+									  parent,
+									  name);
+
+	/*
+	 * Make sure the parameters are reasonable, and save them.  The block
+	 * must hold at least a few chunks, otherwise AllocSet does better.
+	 */
+	slab->chunkSize = MAXALIGN(chunkSize);
+	slab->fullChunkSize = slab->chunkSize + SLAB_CHUNKHDRSZ;
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* leave room for the sentinel byte */
+	slab->fullChunkSize += MAXIMUM_ALIGNOF;
+#endif
+	blockSize = MAXALIGN(blockSize);
+	if (blockSize < SLAB_BLOCKHDRSZ + 8 * slab->fullChunkSize)
+		blockSize = SLAB_BLOCKHDRSZ + 8 * slab->fullChunkSize;
+	Assert(AllocSizeIsValid(blockSize));
+	slab->blockSize = blockSize;
+
+	return (MemoryContext) slab;
+}
+
+/*
+ * SlabInit
+ *		Context-type-specific initialization routine.
+ */
+static void
+SlabInit(MemoryContext context)
+{
+	/*
+	 * Since MemoryContextCreate already zeroed the context node, we don't
+	 * have to do anything here: it's already OK.
+	 */
+}
+
+/*
+ * SlabReset
+ *		Frees all memory which is allocated in the given context.
+ */
+static void
+SlabReset(MemoryContext context)
+{
+	Slab		slab = (Slab) context;
+	SlabBlock	block = slab->blocks;
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	/* Check for corruption before freeing */
+	SlabCheck(context);
+#endif
+
+	slab->blocks = NULL;
+	slab->freelist = NULL;
+	slab->nchunks = 0;
+	slab->header.mem_allocated = 0;
+
+	while (block != NULL)
+	{
+		SlabBlock	next = block->next;
+
+#ifdef CLOBBER_FREED_MEMORY
+		wipe_mem(block, block->freeptr - ((char *) block));
+#endif
+		free(block);
+		block = next;
+	}
+}
+
+/*
+ * SlabDelete
+ *		Frees all memory which is allocated in the given context, in
+ *		preparation for deletion of the context.
+ */
+static void
+SlabDelete(MemoryContext context)
+{
+	SlabReset(context);
+}
+
+/*
+ * SlabAlloc
+ *		Returns pointer to a chunk of the context, or NULL if request could
+ *		not be completed.
+ */
+static void *
+SlabAlloc(MemoryContext context, Size size)
+{
+	Slab		slab = (Slab) context;
+	SlabBlock	block;
+	SlabChunk	chunk;
+
+	if (size > slab->chunkSize)
+		elog(ERROR, "requested size %zu exceeds chunk size %zu of memory context \"%s\"",
+			 size, slab->chunkSize, slab->header.name);
+
+	chunk = slab->freelist;
+	if (chunk != NULL)
+	{
+		/* Reuse a freed chunk */
+		VALGRIND_MAKE_MEM_DEFINED(chunk, SLAB_CHUNK_PUBLIC);
+		slab->freelist = (SlabChunk) chunk->slab;
+	}
+	else
+	{
+		/* Carve a new chunk out of the newest block, or start a new one */
+		block = slab->blocks;
+		if (block == NULL ||
+				block->endptr - block->freeptr < slab->fullChunkSize)
+		{
+			block = (SlabBlock) malloc(slab->blockSize);
+			if (block == NULL)
+				return NULL;
+			slab->header.mem_allocated += slab->blockSize;
+			block->freeptr = ((char *) block) + SLAB_BLOCKHDRSZ;
+			block->endptr = ((char *) block) + slab->blockSize;
+
+			/* Mark unallocated space NOACCESS. */
+			VALGRIND_MAKE_MEM_NOACCESS(block->freeptr,
+									   slab->blockSize - SLAB_BLOCKHDRSZ);
+
+			block->next = slab->blocks;
+			slab->blocks = block;
+		}
+
+		chunk = (SlabChunk) block->freeptr;
+		VALGRIND_MAKE_MEM_UNDEFINED(chunk, SLAB_CHUNKHDRSZ);
+		block->freeptr += slab->fullChunkSize;
+		chunk->size = slab->chunkSize;
+	}
+
+	chunk->slab = (void *) slab;
+	slab->nchunks++;
+#ifdef MEMORY_CONTEXT_CHECKING
+	chunk->requested_size = size;
+	/* set mark to catch clobber of "unused" space */
+	set_sentinel(SlabChunkGetPointer(chunk), size);
+#endif
+
+	/*
+	 * Chunk header public fields remain DEFINED; the rest is NOACCESS until
+	 * our caller makes the requested space UNDEFINED.
+	 */
+	VALGRIND_MAKE_MEM_NOACCESS((char *) chunk + SLAB_CHUNK_PUBLIC,
+							   SLAB_CHUNKHDRSZ - SLAB_CHUNK_PUBLIC);
+
+	return SlabChunkGetPointer(chunk);
+}
+
+/*
+ * SlabFree
+ *		Puts the chunk on the freelist of the context.
+ */
+static void
+SlabFree(MemoryContext context, void *pointer)
+{
+	Slab		slab = (Slab) context;
+	SlabChunk	chunk = SlabPointerGetChunk(pointer);
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	VALGRIND_MAKE_MEM_DEFINED(&chunk->requested_size,
+							  sizeof(chunk->requested_size));
+	/* Test for someone scribbling on unused space in chunk */
+	if (!sentinel_ok(pointer, chunk->requested_size))
+		elog(WARNING, "detected write past chunk end in %s %p",
+			 slab->header.name, chunk);
+	/* Reset requested_size to 0 in chunks that are on freelist */
+	chunk->requested_size = 0;
+#endif
+
+#ifdef CLOBBER_FREED_MEMORY
+	wipe_mem(pointer, chunk->size);
+#endif
+
+	chunk->slab = (void *) slab->freelist;
+	slab->freelist = chunk;
+	slab->nchunks--;
+}
+
+/*
+ * SlabRealloc
+ *		The chunks can not grow, so the same chunk is returned as long as the
+ *		new size fits in it.
+ */
+static void *
+SlabRealloc(MemoryContext context, void *pointer, Size size)
+{
+	Slab		slab = (Slab) context;
+	SlabChunk	chunk = SlabPointerGetChunk(pointer);
+
+	if (size > slab->chunkSize)
+		elog(ERROR, "requested size %zu exceeds chunk size %zu of memory context \"%s\"",
+			 size, slab->chunkSize, slab->header.name);
+
+#ifdef MEMORY_CONTEXT_CHECKING
+	VALGRIND_MAKE_MEM_DEFINED(&chunk->requested_size,
+							  sizeof(chunk->requested_size));
+	if (!sentinel_ok(pointer, chunk->requested_size))
+		elog(WARNING, "detected write past chunk end in %s %p",
+			 slab->header.name, chunk);
+	chunk->requested_size = size;
+	set_sentinel(pointer, size);
+#endif
+
+	return pointer;
+}
+
+/*
+ * SlabGetChunkSpace
+ *		Given a currently-allocated chunk, determine the total space
+ *		it occupies (including all memory-allocation overhead).
+ */
+static Size
+SlabGetChunkSpace(MemoryContext context, void *pointer)
+{
+	Slab		slab = (Slab) context;
+
+	return slab->fullChunkSize;
+}
+
+/*
+ * SlabIsEmpty
+ *		Is the context empty of any allocated chunks?
+ */
+static bool
+SlabIsEmpty(MemoryContext context)
+{
+	Slab		slab = (Slab) context;
+
+	return slab->nchunks == 0;
+}
+
+/*
+ * SlabStats
+ *		Displays stats about memory consumption of a slab context.
+ */
+static void
+SlabStats(MemoryContext context, int level)
+{
+	Slab		slab = (Slab) context;
+	Size		nblocks = 0;
+	Size		nfree = 0;
+	Size		totalspace = 0;
+	Size		freespace = 0;
+	SlabBlock	block;
+	SlabChunk	chunk;
+	int			i;
+
+	for (block = slab->blocks; block != NULL; block = block->next)
+	{
+		nblocks++;
+		totalspace += block->endptr - ((char *) block);
+		freespace += block->endptr - block->freeptr;
+	}
+	for (chunk = slab->freelist; chunk != NULL; chunk = (SlabChunk) chunk->slab)
+	{
+		nfree++;
+		freespace += slab->fullChunkSize;
+	}
+
+	for (i = 0; i < level; i++)
+		fprintf(stderr, "  ");
+
+	fprintf(stderr,
+			"%s: %zu total in %zd blocks; %zu free (%zd chunks); %zu used (%zu chunks of %zu)\n",
+			slab->header.name, totalspace, nblocks, freespace, nfree,
+			totalspace - freespace, slab->nchunks, slab->chunkSize);
+}
+
+
+#ifdef MEMORY_CONTEXT_CHECKING
+
+/*
+ * SlabCheck
+ *		Walk through chunks and check consistency of memory.
+ *
+ * NOTE: report errors as WARNING, *not* ERROR or FATAL.  Otherwise you'll
+ * find yourself in an infinite loop when trouble occurs, because this
+ * routine will be entered again when elog cleanup tries to release memory!
+ */
+static void
+SlabCheck(MemoryContext context)
+{
+	Slab		slab = (Slab) context;
+	char	   *name = slab->header.name;
+	SlabBlock	block;
+	Size		nchunks = 0;
+
+	for (block = slab->blocks; block != NULL; block = block->next)
+	{
+		char	   *bpoz = ((char *) block) + SLAB_BLOCKHDRSZ;
+
+		if ((block->freeptr - bpoz) % slab->fullChunkSize != 0)
+			elog(WARNING, "problem in slab %s: found inconsistent memory block %p",
+				 name, block);
+
+		while (bpoz < block->freeptr)
+		{
+			SlabChunk	chunk = (SlabChunk) bpoz;
+			Size		dsize;
+
+			VALGRIND_MAKE_MEM_DEFINED(&chunk->requested_size,
+									  sizeof(chunk->requested_size));
+			dsize = chunk->requested_size;
+
+			if (chunk->size != slab->chunkSize)
+				elog(WARNING, "problem in slab %s: bad size %zu for chunk %p in block %p",
+					 name, chunk->size, chunk, block);
+
+			/* Allocated chunks point to the context, free ones do not */
+			if (chunk->slab == (void *) slab)
+			{
+				nchunks++;
+				if (dsize > chunk->size)
+					elog(WARNING, "problem in slab %s: req size > alloc size for chunk %p in block %p",
+						 name, chunk, block);
+				else if (!sentinel_ok(chunk, SLAB_CHUNKHDRSZ + dsize))
+					elog(WARNING, "problem in slab %s: detected write past chunk end in block %p, chunk %p",
+						 name, block, chunk);
+			}
+
+			bpoz += slab->fullChunkSize;
+		}
+	}
+
+	if (nchunks != slab->nchunks)
+		elog(WARNING, "problem in slab %s: found %zu allocated chunks, expected %zu",
+			 name, nchunks, slab->nchunks);
+}
+
+#endif   /* MEMORY_CONTEXT_CHECKING */
@@ -2706,6 +2706,16 @@ mergeprereadone(Tuplesortstate *state, int srcTape)
 	while ((state->mergeavailslots[srcTape] > 0 && !LACKMEM(state)) ||
 		   state->mergenext[srcTape] == 0)
 	{
+#ifdef PGXC
+		/*
+		 * When merging streams from remote nodes read ahead only the rows
+		 * which are already received. Waiting for more data from one node
+		 * would stall the merge while the other nodes may have rows to merge.
+		 */
+		if (state->combiner && state->mergenext[srcTape] != 0 &&
+				!FetchTupleReady(state->combiner, srcTape))
+			break;
+#endif
 		/* read next tuple, if any */
 #ifdef PGXC
 		if ((tuplen = GETLEN(state, srcTape, true)) == 0)
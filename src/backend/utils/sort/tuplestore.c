@@ -1696,6 +1696,53 @@ tuplestore_begin_datarow(bool interXact, int maxKBytes,
 }
 
 
+/*
+ * Append the data row to the Datarow tuplestore. The tuplestore takes
+ * ownership of the row, it should be allocated in the tuplestore's memory
+ * context.
+ */
+void
+tuplestore_putdatarow(Tuplestorestate *state, RemoteDataRow datarow)
+{
+	MemoryContext oldcxt = MemoryContextSwitchTo(state->context);
+
+	Assert(state->format == TSF_DATAROW);
+
+	USEMEM(state, GetMemoryChunkSpace(datarow));
+	tuplestore_puttuple_common(state, (void *) datarow);
+
+	MemoryContextSwitchTo(oldcxt);
+}
+
+
+/*
+ * Fetch next data row from the Datarow tuplestore, NULL if no more. The row
+ * is palloc'd in the current memory context, the caller should free it.
+ */
+RemoteDataRow
+tuplestore_getdatarow(Tuplestorestate *state)
+{
+	bool		should_free;
+	RemoteDataRow datarow;
+
+	Assert(state->format == TSF_DATAROW);
+
+	datarow = (RemoteDataRow) tuplestore_gettuple(state, true, &should_free);
+	if (datarow && !should_free)
+	{
+		RemoteDataRow dup;
+
+		dup = (RemoteDataRow) palloc(sizeof(RemoteDataRowData) +
+									 datarow->msglen);
+		dup->msgnode = datarow->msgnode;
+		dup->msglen = datarow->msglen;
+		memcpy(dup->msg, datarow->msg, datarow->msglen);
+		datarow = dup;
+	}
+	return datarow;
+}
+
+
 /*
  * Do we need this at all?
  */
@@ -20,6 +20,9 @@
 #include <sys/wait.h>
 #include <signal.h>
 #include <time.h>
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
 
 #ifdef HAVE_LIBZ
 #include <zlib.h>
@@ -51,6 +54,56 @@ typedef struct TablespaceList
 	TablespaceListCell *tail;
 } TablespaceList;
 
+/* State of the unpacking of a tar stream into a directory */
+typedef struct UnpackState
+{
+	char		current_path[MAXPGPATH];
+	char		filename[MAXPGPATH];
+	int			current_len_left;
+	int			current_padding;
+	FILE	   *file;
+	int			tablespacenum;	/* row in the backup header */
+} UnpackState;
+
+/* A regular file of a parallel backup, as listed by the server */
+typedef struct BackupFile
+{
+	int			tablespacenum;	/* row in the backup header */
+	char	   *path;			/* relative to the tablespace */
+	uint64		size;
+} BackupFile;
+
+/* Files of one tablespace fetched by one SEND_FILES command */
+typedef struct FileBatch
+{
+	int			tablespacenum;	/* row in the backup header */
+	int			first;			/* first file in the sorted file list */
+	int			nfiles;
+	uint64		size;
+} FileBatch;
+
+/* A connection fetching the batches of a parallel backup */
+typedef struct BackupJob
+{
+	PGconn	   *conn;
+	bool		busy;			/* is a SEND_FILES command running? */
+	bool		copying;		/* is its COPY data being received? */
+	FileBatch  *batch;
+	UnpackState unpack;
+#ifdef HAVE_LIBZ
+	z_stream	zstream;		/* to uncompress the COPY data */
+	char	   *zbuf;
+	int			zbuflen;
+#endif
+} BackupJob;
+
+/*
+ * A SEND_FILES command is ended once it holds this many files or this many
+ * bytes, so that the batches can be spread over the connections.
+ */
+#define FILES_PER_BATCH		64
+#define BYTES_PER_BATCH		(64 * 1024 * 1024)
+
 /* Global options */
 static char *basedir = NULL;
 static TablespaceList tablespace_dirs = {NULL, NULL};
@@ -67,6 +120,7 @@ static bool writerecoveryconf = false;
 static int	standby_message_timeout = 10 * 1000;		/* 10 sec = default */
 static pg_time_t last_progress_report = 0;
 static int32 maxrate = 0;		/* no limit by default */
+static int	numjobs = 1;		/* connections fetching the files */
 
 
 /* Progress counters */
@@ -102,6 +156,14 @@ static void progress_report(int tablespacenum, const char *filename, bool force)
 
 static void ReceiveTarFile(PGconn *conn, PGresult *res, int rownum);
 static void ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum);
+static void UnpackTarStart(UnpackState *state, PGresult *res, int rownum);
+static void UnpackTarBlock(UnpackState *state, char *copybuf, int len);
+static void UnpackTarEnd(UnpackState *state);
+static void ReceiveTarStream(PGconn *conn, UnpackState *state);
+static void ReceiveFilesParallel(PGresult *header, const char *xlogstart);
+static void SendFileBatch(BackupJob *job, PGresult *header, BackupFile *files,
+			  FileBatch *batch, const char *xlogstart);
+static void ProcessBackupJob(BackupJob *job);
 static void GenerateRecoveryConf(PGconn *conn);
 static void WriteRecoveryConf(void);
 static void BaseBackup(void);
@@ -246,10 +308,12 @@ usage(void)
 			 "                         include required WAL files with specified method\n"));
 	printf(_("      --xlogdir=XLOGDIR  location for the transaction log directory\n"));
 	printf(_("  -z, --gzip             compress tar output\n"));
-	printf(_("  -Z, --compress=0-9     compress tar output with given compression level\n"));
+	printf(_("  -Z, --compress=0-9     compress tar output with given compression level,\n"
+			 "                         or the transfer of the files with --jobs\n"));
 	printf(_("\nGeneral options:\n"));
 	printf(_("  -c, --checkpoint=fast|spread\n"
 			 "                         set fast or spread checkpointing\n"));
+	printf(_("  -j, --jobs=NUM         fetch the files on NUM connections (plain format)\n"));
 	printf(_("  -l, --label=LABEL      set backup label\n"));
 	printf(_("  -P, --progress         show progress information\n"));
 	printf(_("  -v, --verbose          output verbose messages\n"));
@@ -1124,33 +1188,249 @@ get_tablespace_mapping(const char *dir)
 
 
 /*
- * Receive a tar format stream from the connection to the server, and unpack
- * the contents of it into a directory. Only files, directories and
- * symlinks are supported, no other kinds of special files.
+ * Prepare the unpacking of the tar stream for the tablespace in the given
+ * row of the backup header.
  *
  * If the data is for the main data directory, it will be restored in the
  * specified directory. If it's for another tablespace, it will be restored
  * in the original or mapped directory.
  */
 static void
-ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
+UnpackTarStart(UnpackState *state, PGresult *res, int rownum)
+{
+	if (PQgetisnull(res, rownum, 0))
+		strlcpy(state->current_path, basedir, sizeof(state->current_path));
+	else
+		strlcpy(state->current_path,
+				get_tablespace_mapping(PQgetvalue(res, rownum, 1)),
+				sizeof(state->current_path));
+	state->filename[0] = '\0';
+	state->current_len_left = 0;
+	state->current_padding = 0;
+	state->file = NULL;
+	state->tablespacenum = rownum;
+}
+
+/*
+ * Unpack one CopyData message of a tar stream. Only files, directories and
+ * symlinks are supported, no other kinds of special files.
+ */
+static void
+UnpackTarBlock(UnpackState *state, char *copybuf, int len)
 {
-	char		current_path[MAXPGPATH];
-	char		filename[MAXPGPATH];
 	const char *mapped_tblspc_path;
-	int			current_len_left;
-	int			current_padding = 0;
-	bool		basetablespace;
-	char	   *copybuf = NULL;
-	FILE	   *file = NULL;
 
-	basetablespace = PQgetisnull(res, rownum, 0);
-	if (basetablespace)
-		strlcpy(current_path, basedir, sizeof(current_path));
+	if (state->file == NULL)
+	{
+		int			filemode;
+
+		/*
+		 * No current file, so this must be the header for a new file
+		 */
+		if (len != 512)
+		{
+			fprintf(stderr, _("%s: invalid tar block header size: %d\n"),
+					progname, len);
+			disconnect_and_exit(1);
+		}
+		totaldone += 512;
+
+		if (sscanf(copybuf + 124, "%11o", &state->current_len_left) != 1)
+		{
+			fprintf(stderr, _("%s: could not parse file size\n"),
+					progname);
+			disconnect_and_exit(1);
+		}
+
+		/* Set permissions on the file */
+		if (sscanf(&copybuf[100], "%07o ", &filemode) != 1)
+		{
+			fprintf(stderr, _("%s: could not parse file mode\n"),
+					progname);
+			disconnect_and_exit(1);
+		}
+
+		/*
+		 * All files are padded up to 512 bytes
+		 */
+		state->current_padding =
+			((state->current_len_left + 511) & ~511) - state->current_len_left;
+
+		/*
+		 * First part of header is zero terminated filename
+		 */
+		snprintf(state->filename, sizeof(state->filename), "%s/%s",
+				 state->current_path, copybuf);
+		if (state->filename[strlen(state->filename) - 1] == '/')
+		{
+			/*
+			 * Ends in a slash means directory or symlink to directory
+			 */
+			if (copybuf[156] == '5')
+			{
+				/*
+				 * Directory
+				 */
+				state->filename[strlen(state->filename) - 1] = '\0';		/* Remove trailing slash */
+				if (mkdir(state->filename, S_IRWXU) != 0)
+				{
+					/*
+					 * When streaming WAL, pg_xlog will have been created
+					 * by the wal receiver process. Also, when transaction
+					 * log directory location was specified, pg_xlog has
+					 * already been created as a symbolic link before
+					 * starting the actual backup. So just ignore creation
+					 * failures on related directories.
+					 */
+					if (!((pg_str_endswith(state->filename, "/pg_xlog") ||
+						 pg_str_endswith(state->filename, "/archive_status")) &&
+						  errno == EEXIST))
+					{
+						fprintf(stderr,
+						_("%s: could not create directory \"%s\": %s\n"),
+								progname, state->filename, strerror(errno));
+						disconnect_and_exit(1);
+					}
+				}
+#ifndef WIN32
+				if (chmod(state->filename, (mode_t) filemode))
+					fprintf(stderr,
+							_("%s: could not set permissions on directory \"%s\": %s\n"),
+							progname, state->filename, strerror(errno));
+#endif
+			}
+			else if (copybuf[156] == '2')
+			{
+				/*
+				 * Symbolic link
+				 *
+				 * It's most likely a link in pg_tblspc directory, to the
+				 * location of a tablespace. Apply any tablespace mapping
+				 * given on the command line (--tablespace-mapping). (We
+				 * blindly apply the mapping without checking that the
+				 * link really is inside pg_tblspc. We don't expect there
+				 * to be other symlinks in a data directory, but if there
+				 * are, you can call it an undocumented feature that you
+				 * can map them too.)
+				 */
+				state->filename[strlen(state->filename) - 1] = '\0';		/* Remove trailing slash */
+
+				mapped_tblspc_path = get_tablespace_mapping(&copybuf[157]);
+				if (symlink(mapped_tblspc_path, state->filename) != 0)
+				{
+					fprintf(stderr,
+							_("%s: could not create symbolic link from \"%s\" to \"%s\": %s\n"),
+							progname, state->filename, mapped_tblspc_path,
+							strerror(errno));
+					disconnect_and_exit(1);
+				}
+			}
+			else
+			{
+				fprintf(stderr,
+						_("%s: unrecognized link indicator \"%c\"\n"),
+						progname, copybuf[156]);
+				disconnect_and_exit(1);
+			}
+			return;		/* directory or link handled */
+		}
+
+		/*
+		 * regular file
+		 */
+		state->file = fopen(state->filename, "wb");
+		if (!state->file)
+		{
+			fprintf(stderr, _("%s: could not create file \"%s\": %s\n"),
+					progname, state->filename, strerror(errno));
+			disconnect_and_exit(1);
+		}
+
+#ifndef WIN32
+		if (chmod(state->filename, (mode_t) filemode))
+			fprintf(stderr, _("%s: could not set permissions on file \"%s\": %s\n"),
+					progname, state->filename, strerror(errno));
+#endif
+
+		if (state->current_len_left == 0)
+		{
+			/*
+			 * Done with this file, next one will be a new tar header
+			 */
+			fclose(state->file);
+			state->file = NULL;
+			return;
+		}
+	}						/* new file */
 	else
-		strlcpy(current_path,
-				get_tablespace_mapping(PQgetvalue(res, rownum, 1)),
-				sizeof(current_path));
+	{
+		/*
+		 * Continuing blocks in existing file
+		 */
+		if (state->current_len_left == 0 && len == state->current_padding)
+		{
+			/*
+			 * Received the padding block for this file, ignore it and
+			 * close the file, then move on to the next tar header.
+			 */
+			fclose(state->file);
+			state->file = NULL;
+			totaldone += len;
+			return;
+		}
+
+		if (fwrite(copybuf, len, 1, state->file) != 1)
+		{
+			fprintf(stderr, _("%s: could not write to file \"%s\": %s\n"),
+					progname, state->filename, strerror(errno));
+			disconnect_and_exit(1);
+		}
+		totaldone += len;
+		progress_report(state->tablespacenum, state->filename, false);
+
+		state->current_len_left -= len;
+		if (state->current_len_left == 0 && state->current_padding == 0)
+		{
+			/*
+			 * Received the last block, and there is no padding to be
+			 * expected. Close the file and move on to the next tar
+			 * header.
+			 */
+			fclose(state->file);
+			state->file = NULL;
+			return;
+		}
+	}						/* continuing data in existing file */
+
+}
+
+/*
+ * Finish the unpacking of a tar stream once the COPY is over.
+ */
+static void
+UnpackTarEnd(UnpackState *state)
+{
+	progress_report(state->tablespacenum, state->filename, true);
+
+	if (state->file != NULL)
+	{
+		fclose(state->file);
+		fprintf(stderr,
+				_("%s: COPY stream ended before last file was finished\n"),
+				progname);
+		disconnect_and_exit(1);
+	}
+}
+
+/*
+ * Receive a tar format stream from the connection to the server, and unpack
+ * the contents of it with the given state.
+ */
+static void
+ReceiveTarStream(PGconn *conn, UnpackState *state)
+{
+	PGresult   *res;
+	char	   *copybuf = NULL;
 
 	/*
 	 * Get the COPY data
@@ -1162,6 +1442,7 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 				progname, PQerrorMessage(conn));
 		disconnect_and_exit(1);
 	}
+	PQclear(res);
 
 	while (1)
 	{
@@ -1180,9 +1461,6 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 			/*
 			 * End of chunk
 			 */
-			if (file)
-				fclose(file);
-
 			break;
 		}
 		else if (r == -2)
@@ -1192,203 +1470,457 @@ ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
 			disconnect_and_exit(1);
 		}
 
-		if (file == NULL)
-		{
-			int			filemode;
+		UnpackTarBlock(state, copybuf, r);
+	}							/* loop over all data blocks */
 
-			/*
-			 * No current file, so this must be the header for a new file
-			 */
-			if (r != 512)
-			{
-				fprintf(stderr, _("%s: invalid tar block header size: %d\n"),
-						progname, r);
-				disconnect_and_exit(1);
-			}
-			totaldone += 512;
+	UnpackTarEnd(state);
+}
 
-			if (sscanf(copybuf + 124, "%11o", &current_len_left) != 1)
+/*
+ * Receive a tar format stream from the connection to the server, and unpack
+ * the contents of it into a directory.
+ */
+static void
+ReceiveAndUnpackTarFile(PGconn *conn, PGresult *res, int rownum)
+{
+	UnpackState state;
+
+	UnpackTarStart(&state, res, rownum);
+	ReceiveTarStream(conn, &state);
+
+	if (PQgetisnull(res, rownum, 0) && writerecoveryconf)
+		WriteRecoveryConf();
+}
+
+/*
+ * qsort comparators for the files and the batches of a parallel backup.
+ * Files are grouped by tablespace, largest first, and batches are fetched
+ * largest first, so that the connections finish at about the same time.
+ */
+static int
+cmp_backup_files(const void *a, const void *b)
+{
+	const BackupFile *fa = (const BackupFile *) a;
+	const BackupFile *fb = (const BackupFile *) b;
+
+	if (fa->tablespacenum != fb->tablespacenum)
+		return fa->tablespacenum - fb->tablespacenum;
+	if (fa->size != fb->size)
+		return fa->size > fb->size ? -1 : 1;
+	return 0;
+}
+
+static int
+cmp_file_batches(const void *a, const void *b)
+{
+	const FileBatch *ba = (const FileBatch *) a;
+	const FileBatch *bb = (const FileBatch *) b;
+
+	if (ba->size != bb->size)
+		return ba->size > bb->size ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Fetch the regular files of a parallel backup, whose directories and links
+ * have already been created, then stop the backup.
+ *
+ * The server lists the files after the tar streams of the tablespaces. They
+ * are split in batches fetched with SEND_FILES on numjobs connections, the
+ * main one included, which are multiplexed here. STOP_BACKUP is then sent on
+ * the main connection, which gets the backup label, the control file and the
+ * WAL files if requested.
+ */
+static void
+ReceiveFilesParallel(PGresult *header, const char *xlogstart)
+{
+	PGresult   *res;
+	BackupFile *files;
+	FileBatch  *batches;
+	BackupJob  *jobs;
+	UnpackState state;
+	int			nfiles;
+	int			nbatches = 0;
+	int			nextbatch = 0;
+	int			running = 0;
+	int			basetablespace = -1;
+	int			i,
+				j;
+
+	/*
+	 * Get the list of the files
+	 */
+	res = PQgetResult(conn);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK)
+	{
+		fprintf(stderr, _("%s: could not get list of files: %s"),
+				progname, PQerrorMessage(conn));
+		disconnect_and_exit(1);
+	}
+	if (PQnfields(res) != 3)
+	{
+		fprintf(stderr,
+				_("%s: server returned unexpected response to BASE_BACKUP command; got %d fields, expected %d fields\n"),
+				progname, PQnfields(res), 3);
+		disconnect_and_exit(1);
+	}
+
+	nfiles = PQntuples(res);
+	files = pg_malloc0(sizeof(BackupFile) * (nfiles + 1));
+	for (i = 0; i < nfiles; i++)
+	{
+		files[i].tablespacenum = -1;
+		for (j = 0; j < PQntuples(header); j++)
+		{
+			if (PQgetisnull(res, i, 0) ?
+				PQgetisnull(header, j, 0) :
+				(!PQgetisnull(header, j, 0) &&
+				 strcmp(PQgetvalue(res, i, 0), PQgetvalue(header, j, 0)) == 0))
 			{
-				fprintf(stderr, _("%s: could not parse file size\n"),
-						progname);
-				disconnect_and_exit(1);
+				files[i].tablespacenum = j;
+				break;
 			}
+		}
+		if (files[i].tablespacenum < 0)
+		{
+			fprintf(stderr, _("%s: file \"%s\" is in an unknown tablespace\n"),
+					progname, PQgetvalue(res, i, 1));
+			disconnect_and_exit(1);
+		}
+		files[i].path = pg_strdup(PQgetvalue(res, i, 1));
+		files[i].size = atol(PQgetvalue(res, i, 2));
+	}
+	PQclear(res);
+
+	/* Wait for the end of BASE_BACKUP */
+	while ((res = PQgetResult(conn)) != NULL)
+	{
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		{
+			fprintf(stderr, _("%s: could not start base backup: %s"),
+					progname, PQerrorMessage(conn));
+			disconnect_and_exit(1);
+		}
+		PQclear(res);
+	}
+
+	/*
+	 * Split the files in batches
+	 */
+	qsort(files, nfiles, sizeof(BackupFile), cmp_backup_files);
+	batches = pg_malloc0(sizeof(FileBatch) * (nfiles + 1));
+	for (i = 0; i < nfiles; i++)
+	{
+		FileBatch  *batch = nbatches > 0 ? &batches[nbatches - 1] : NULL;
+
+		if (batch == NULL ||
+			batch->tablespacenum != files[i].tablespacenum ||
+			batch->nfiles >= FILES_PER_BATCH ||
+			batch->size >= BYTES_PER_BATCH)
+		{
+			batch = &batches[nbatches++];
+			batch->tablespacenum = files[i].tablespacenum;
+			batch->first = i;
+		}
+		batch->nfiles++;
+		batch->size += files[i].size;
+	}
+	qsort(batches, nbatches, sizeof(FileBatch), cmp_file_batches);
+
+	if (verbose)
+		fprintf(stderr, _("%s: fetching %d files in %d batches on %d connections\n"),
+				progname, nfiles, nbatches, numjobs);
+
+	/*
+	 * Open the other connections, and start fetching
+	 */
+	jobs = pg_malloc0(sizeof(BackupJob) * numjobs);
+	for (i = 0; i < numjobs; i++)
+	{
+		jobs[i].conn = (i == 0) ? conn : GetConnection();
+		if (!jobs[i].conn)
+			/* Error message already written in GetConnection() */
+			disconnect_and_exit(1);
+
+		if (nextbatch < nbatches)
+		{
+			SendFileBatch(&jobs[i], header, files, &batches[nextbatch++],
+						  xlogstart);
+			running++;
+		}
+	}
 
-			/* Set permissions on the file */
-			if (sscanf(&copybuf[100], "%07o ", &filemode) != 1)
+	while (running > 0)
+	{
+		fd_set		input_mask;
+		int			maxfd = -1;
+
+		FD_ZERO(&input_mask);
+		for (i = 0; i < numjobs; i++)
+		{
+			if (!jobs[i].busy)
+				continue;
+			FD_SET(PQsocket(jobs[i].conn), &input_mask);
+			maxfd = Max(maxfd, PQsocket(jobs[i].conn));
+		}
+
+		if (select(maxfd + 1, &input_mask, NULL, NULL, NULL) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, _("%s: select() failed: %s\n"),
+					progname, strerror(errno));
+			disconnect_and_exit(1);
+		}
+
+		for (i = 0; i < numjobs; i++)
+		{
+			BackupJob  *job = &jobs[i];
+
+			if (!job->busy || !FD_ISSET(PQsocket(job->conn), &input_mask))
+				continue;
+
+			if (PQconsumeInput(job->conn) == 0)
 			{
-				fprintf(stderr, _("%s: could not parse file mode\n"),
-						progname);
+				fprintf(stderr, _("%s: could not receive data from server: %s"),
+						progname, PQerrorMessage(job->conn));
 				disconnect_and_exit(1);
 			}
 
-			/*
-			 * All files are padded up to 512 bytes
-			 */
-			current_padding =
-				((current_len_left + 511) & ~511) - current_len_left;
+			ProcessBackupJob(job);
+			if (job->busy)
+				continue;
 
-			/*
-			 * First part of header is zero terminated filename
-			 */
-			snprintf(filename, sizeof(filename), "%s/%s", current_path,
-					 copybuf);
-			if (filename[strlen(filename) - 1] == '/')
-			{
-				/*
-				 * Ends in a slash means directory or symlink to directory
-				 */
-				if (copybuf[156] == '5')
-				{
-					/*
-					 * Directory
-					 */
-					filename[strlen(filename) - 1] = '\0';		/* Remove trailing slash */
-					if (mkdir(filename, S_IRWXU) != 0)
-					{
-						/*
-						 * When streaming WAL, pg_xlog will have been created
-						 * by the wal receiver process. Also, when transaction
-						 * log directory location was specified, pg_xlog has
-						 * already been created as a symbolic link before
-						 * starting the actual backup. So just ignore creation
-						 * failures on related directories.
-						 */
-						if (!((pg_str_endswith(filename, "/pg_xlog") ||
-							 pg_str_endswith(filename, "/archive_status")) &&
-							  errno == EEXIST))
-						{
-							fprintf(stderr,
-							_("%s: could not create directory \"%s\": %s\n"),
-									progname, filename, strerror(errno));
-							disconnect_and_exit(1);
-						}
-					}
-#ifndef WIN32
-					if (chmod(filename, (mode_t) filemode))
-						fprintf(stderr,
-								_("%s: could not set permissions on directory \"%s\": %s\n"),
-								progname, filename, strerror(errno));
+			/* This connection is free, give it the next batch */
+			if (nextbatch < nbatches)
+				SendFileBatch(job, header, files, &batches[nextbatch++],
+							  xlogstart);
+			else
+				running--;
+		}
+	}
+
+	for (i = 0; i < numjobs; i++)
+	{
+		if (jobs[i].conn != conn)
+			PQfinish(jobs[i].conn);
+#ifdef HAVE_LIBZ
+		if (jobs[i].zbuf != NULL)
+		{
+			inflateEnd(&jobs[i].zstream);
+			free(jobs[i].zbuf);
+		}
 #endif
-				}
-				else if (copybuf[156] == '2')
-				{
-					/*
-					 * Symbolic link
-					 *
-					 * It's most likely a link in pg_tblspc directory, to the
-					 * location of a tablespace. Apply any tablespace mapping
-					 * given on the command line (--tablespace-mapping). (We
-					 * blindly apply the mapping without checking that the
-					 * link really is inside pg_tblspc. We don't expect there
-					 * to be other symlinks in a data directory, but if there
-					 * are, you can call it an undocumented feature that you
-					 * can map them too.)
-					 */
-					filename[strlen(filename) - 1] = '\0';		/* Remove trailing slash */
+	}
+	for (i = 0; i < nfiles; i++)
+		free(files[i].path);
+	free(files);
+	free(batches);
+	free(jobs);
 
-					mapped_tblspc_path = get_tablespace_mapping(&copybuf[157]);
-					if (symlink(mapped_tblspc_path, filename) != 0)
-					{
-						fprintf(stderr,
-								_("%s: could not create symbolic link from \"%s\" to \"%s\": %s\n"),
-								progname, filename, mapped_tblspc_path,
-								strerror(errno));
-						disconnect_and_exit(1);
-					}
-				}
-				else
-				{
-					fprintf(stderr,
-							_("%s: unrecognized link indicator \"%c\"\n"),
-							progname, copybuf[156]);
-					disconnect_and_exit(1);
-				}
-				continue;		/* directory or link handled */
-			}
+	/*
+	 * Stop the backup. The backup label and the control file go in the main
+	 * data directory, which comes last in the header.
+	 */
+	if (PQsendQuery(conn, "STOP_BACKUP") == 0)
+	{
+		fprintf(stderr, _("%s: could not send replication command \"%s\": %s"),
+				progname, "STOP_BACKUP", PQerrorMessage(conn));
+		disconnect_and_exit(1);
+	}
 
-			/*
-			 * regular file
-			 */
-			file = fopen(filename, "wb");
-			if (!file)
-			{
-				fprintf(stderr, _("%s: could not create file \"%s\": %s\n"),
-						progname, filename, strerror(errno));
-				disconnect_and_exit(1);
-			}
+	for (i = 0; i < PQntuples(header); i++)
+	{
+		if (PQgetisnull(header, i, 0))
+			basetablespace = i;
+	}
+	UnpackTarStart(&state, header, basetablespace);
+	ReceiveTarStream(conn, &state);
+}
 
-#ifndef WIN32
-			if (chmod(filename, (mode_t) filemode))
-				fprintf(stderr, _("%s: could not set permissions on file \"%s\": %s\n"),
-						progname, filename, strerror(errno));
+/*
+ * Send a SEND_FILES command for the given batch of files on the connection
+ * of the job, without waiting for its result.
+ */
+static void
+SendFileBatch(BackupJob *job, PGresult *header, BackupFile *files,
+			  FileBatch *batch, const char *xlogstart)
+{
+	PQExpBuffer cmd = createPQExpBuffer();
+	int			i;
+
+	appendPQExpBufferStr(cmd, "SEND_FILES (");
+	for (i = batch->first; i < batch->first + batch->nfiles; i++)
+	{
+		const char *p;
+
+		if (i > batch->first)
+			appendPQExpBufferStr(cmd, ", ");
+		appendPQExpBufferChar(cmd, '\'');
+		for (p = files[i].path; *p; p++)
+		{
+			if (*p == '\'')
+				appendPQExpBufferChar(cmd, '\'');
+			appendPQExpBufferChar(cmd, *p);
+		}
+		appendPQExpBufferChar(cmd, '\'');
+	}
+	appendPQExpBuffer(cmd, ") START_WAL_LOCATION %s", xlogstart);
+
+	if (!PQgetisnull(header, batch->tablespacenum, 0))
+		appendPQExpBuffer(cmd, " TABLESPACE %s",
+						  PQgetvalue(header, batch->tablespacenum, 0));
+
+	/* The connections share the rate limit */
+	if (maxrate > 0)
+		appendPQExpBuffer(cmd, " MAX_RATE %u",
+						  (uint32) Max(maxrate / numjobs, MAX_RATE_LOWER));
+
+#ifdef HAVE_LIBZ
+	if (compresslevel != 0)
+	{
+		appendPQExpBuffer(cmd, " COMPRESS %d",
+						  compresslevel == Z_DEFAULT_COMPRESSION ?
+						  6 : compresslevel);
+
+		/* Each command is compressed as a new stream */
+		if (job->zbuf != NULL)
+			inflateEnd(&job->zstream);
+		else
+		{
+			job->zbuflen = 64 * 1024;
+			job->zbuf = pg_malloc(job->zbuflen);
+		}
+		MemSet(&job->zstream, 0, sizeof(z_stream));
+		if (inflateInit(&job->zstream) != Z_OK)
+		{
+			fprintf(stderr, _("%s: could not initialize decompression: %s\n"),
+					progname, job->zstream.msg);
+			disconnect_and_exit(1);
+		}
+	}
 #endif
 
-			if (current_len_left == 0)
+	if (PQsendQuery(job->conn, cmd->data) == 0)
+	{
+		fprintf(stderr, _("%s: could not send replication command \"%s\": %s"),
+				progname, "SEND_FILES", PQerrorMessage(job->conn));
+		disconnect_and_exit(1);
+	}
+	destroyPQExpBuffer(cmd);
+
+	UnpackTarStart(&job->unpack, header, batch->tablespacenum);
+	job->busy = true;
+	job->copying = false;
+	job->batch = batch;
+}
+
+/*
+ * Process the data received on the connection of a job, as far as possible
+ * without blocking. The job is no longer busy once its command is complete.
+ */
+static void
+ProcessBackupJob(BackupJob *job)
+{
+	for (;;)
+	{
+		PGresult   *res;
+		char	   *copybuf;
+		int			r;
+
+		if (!job->copying)
+		{
+			/* Waiting for the COPY to start, or for the command to end */
+			if (PQisBusy(job->conn))
+				return;
+
+			res = PQgetResult(job->conn);
+			if (res == NULL)
 			{
-				/*
-				 * Done with this file, next one will be a new tar header
-				 */
-				fclose(file);
-				file = NULL;
-				continue;
+				job->busy = false;
+				return;
 			}
-		}						/* new file */
-		else
+
+			switch (PQresultStatus(res))
+			{
+				case PGRES_COPY_OUT:
+					job->copying = true;
+					break;
+				case PGRES_COMMAND_OK:
+					break;
+				default:
+					fprintf(stderr, _("%s: could not fetch files: %s"),
+							progname, PQerrorMessage(job->conn));
+					disconnect_and_exit(1);
+			}
+			PQclear(res);
+			continue;
+		}
+
+		r = PQgetCopyData(job->conn, &copybuf, 1);
+		if (r == 0)
+			return;				/* need more data */
+		if (r == -1)
+		{
+			UnpackTarEnd(&job->unpack);
+			job->copying = false;
+			continue;
+		}
+		if (r == -2)
+		{
+			fprintf(stderr, _("%s: could not read COPY data: %s"),
+					progname, PQerrorMessage(job->conn));
+			disconnect_and_exit(1);
+		}
+
+#ifdef HAVE_LIBZ
+		if (job->zbuf != NULL && compresslevel != 0)
 		{
+			z_stream   *zs = &job->zstream;
+			int			len = 0;
+
 			/*
-			 * Continuing blocks in existing file
+			 * Every message is flushed on its own by the server, so it
+			 * uncompresses to exactly one message of the tar stream.
 			 */
-			if (current_len_left == 0 && r == current_padding)
+			zs->next_in = (Bytef *) copybuf;
+			zs->avail_in = r;
+			do
 			{
-				/*
-				 * Received the padding block for this file, ignore it and
-				 * close the file, then move on to the next tar header.
-				 */
-				fclose(file);
-				file = NULL;
-				totaldone += r;
-				continue;
-			}
+				int			rc;
 
-			if (fwrite(copybuf, r, 1, file) != 1)
-			{
-				fprintf(stderr, _("%s: could not write to file \"%s\": %s\n"),
-						progname, filename, strerror(errno));
-				disconnect_and_exit(1);
-			}
-			totaldone += r;
-			progress_report(rownum, filename, false);
+				if (len == job->zbuflen)
+				{
+					job->zbuflen *= 2;
+					job->zbuf = pg_realloc(job->zbuf, job->zbuflen);
+				}
+				zs->next_out = (Bytef *) job->zbuf + len;
+				zs->avail_out = job->zbuflen - len;
+				rc = inflate(zs, Z_SYNC_FLUSH);
+				if (rc != Z_OK && rc != Z_BUF_ERROR)
+				{
+					fprintf(stderr, _("%s: could not decompress data: %s\n"),
+							progname, zs->msg ? zs->msg : "");
+					disconnect_and_exit(1);
+				}
+				len = job->zbuflen - zs->avail_out;
+			} while (zs->avail_out == 0);
 
-			current_len_left -= r;
-			if (current_len_left == 0 && current_padding == 0)
+			if (zs->avail_in > 0)
 			{
-				/*
-				 * Received the last block, and there is no padding to be
-				 * expected. Close the file and move on to the next tar
-				 * header.
-				 */
-				fclose(file);
-				file = NULL;
-				continue;
+				fprintf(stderr, _("%s: invalid compressed data\n"),
+						progname);
+				disconnect_and_exit(1);
 			}
-		}						/* continuing data in existing file */
-	}							/* loop over all data blocks */
-	progress_report(rownum, filename, true);
 
-	if (file != NULL)
-	{
-		fprintf(stderr,
-				_("%s: COPY stream ended before last file was finished\n"),
-				progname);
-		disconnect_and_exit(1);
-	}
+			UnpackTarBlock(&job->unpack, job->zbuf, len);
+		}
+		else
+#endif
+			UnpackTarBlock(&job->unpack, copybuf, r);
 
-	if (copybuf != NULL)
 		PQfreemem(copybuf);
-
-	if (basetablespace && writerecoveryconf)
-		WriteRecoveryConf();
+	}
 }
 
 /*
@@ -1652,14 +2184,15 @@ BaseBackup(void)
 		maxrate_clause = psprintf("MAX_RATE %u", maxrate);
 
 	basebkp =
-		psprintf("BASE_BACKUP LABEL '%s' %s %s %s %s %s %s",
+		psprintf("BASE_BACKUP LABEL '%s' %s %s %s %s %s %s %s",
 				 escaped_label,
 				 showprogress ? "PROGRESS" : "",
 				 includewal && !streamwal ? "WAL" : "",
 				 fastcheckpoint ? "FAST" : "",
 				 includewal ? "NOWAIT" : "",
 				 maxrate_clause ? maxrate_clause : "",
-				 format == 't' ? "TABLESPACE_MAP" : "");
+				 format == 't' ? "TABLESPACE_MAP" : "",
+				 numjobs > 1 ? "PARALLEL" : "");
 
 	if (PQsendQuery(conn, basebkp) == 0)
 	{
@@ -1776,6 +2309,13 @@ BaseBackup(void)
 			ReceiveAndUnpackTarFile(conn, res, i);
 	}							/* Loop over all tablespaces */
 
+	/*
+	 * In a parallel backup, the above only created the directories and
+	 * links. Fetch the files, and stop the backup.
+	 */
+	if (numjobs > 1)
+		ReceiveFilesParallel(res, xlogstart);
+
 	if (showprogress)
 	{
 		progress_report(PQntuples(res), NULL, true);
@@ -1950,6 +2490,7 @@ main(int argc, char **argv)
 		{"verbose", no_argument, NULL, 'v'},
 		{"progress", no_argument, NULL, 'P'},
 		{"xlogdir", required_argument, NULL, 1},
+		{"jobs", required_argument, NULL, 'j'},
 		{NULL, 0, NULL, 0}
 	};
 	int			c;
@@ -1974,7 +2515,7 @@ main(int argc, char **argv)
 		}
 	}
 
-	while ((c = getopt_long(argc, argv, "D:F:r:RT:xX:l:zZ:d:c:h:p:U:s:wWvP",
+	while ((c = getopt_long(argc, argv, "D:F:r:RT:xX:l:zZ:d:c:h:j:p:U:s:wWvP",
 							long_options, &option_index)) != -1)
 	{
 		switch (c)
@@ -2077,6 +2618,15 @@ main(int argc, char **argv)
 			case 'd':
 				connection_string = pg_strdup(optarg);
 				break;
+			case 'j':
+				numjobs = atoi(optarg);
+				if (numjobs <= 0)
+				{
+					fprintf(stderr, _("%s: invalid number of parallel jobs \"%s\"\n"),
+							progname, optarg);
+					exit(1);
+				}
+				break;
 			case 'h':
 				dbhost = pg_strdup(optarg);
 				break;
@@ -2145,7 +2695,7 @@ main(int argc, char **argv)
 	/*
 	 * Mutually exclusive arguments
 	 */
-	if (format == 'p' && compresslevel != 0)
+	if (format == 'p' && compresslevel != 0 && numjobs == 1)
 	{
 		fprintf(stderr,
 				_("%s: only tar mode backups can be compressed\n"),
@@ -2155,6 +2705,16 @@ main(int argc, char **argv)
 		exit(1);
 	}
 
+	if (format != 'p' && numjobs > 1)
+	{
+		fprintf(stderr,
+				_("%s: parallel jobs can only be used in plain mode\n"),
+				progname);
+		fprintf(stderr, _("Try \"%s --help\" for more information.\n"),
+				progname);
+		exit(1);
+	}
+
 	if (format != 'p' && streamwal)
 	{
 		fprintf(stderr,
@@ -4559,6 +4559,8 @@ getTables(Archive *fout, DumpOptions *dopt, int *numTables)
 #ifdef PGXC
 	int			i_pgxclocatortype;
 	int			i_pgxcattnum;
+	int			i_pgxcranges;
+	int			i_pgxcattnums;
 	int			i_pgxc_node_names;
 #endif
 	int			i_reltablespace;
@@ -4616,6 +4618,8 @@ getTables(Archive *fout, DumpOptions *dopt, int *numTables)
 #ifdef PGXC
 						  "(SELECT pclocatortype from pgxc_class v where v.pcrelid = c.oid) AS pgxclocatortype,"
 						  "(SELECT pcattnum from pgxc_class v where v.pcrelid = c.oid) AS pgxcattnum,"
+						  "(SELECT array_to_string(array(SELECT quote_literal(r) FROM unnest(pcranges) r), ', ') from pgxc_class v where v.pcrelid = c.oid) AS pgxcranges,"
+						  "(SELECT pcattnums from pgxc_class v where v.pcrelid = c.oid) AS pgxcattnums,"
 						  "(SELECT string_agg(node_name,',') AS pgxc_node_names from pgxc_node n where n.oid in (select unnest(nodeoids) from pgxc_class v where v.pcrelid=c.oid) ) , "
 #endif
 						  "array_to_string(array_remove(array_remove(c.reloptions,'check_option=local'),'check_option=cascaded'), ', ') AS reloptions, "
@@ -5099,6 +5103,8 @@ getTables(Archive *fout, DumpOptions *dopt, int *numTables)
 #ifdef PGXC
 	i_pgxclocatortype = PQfnumber(res, "pgxclocatortype");
 	i_pgxcattnum = PQfnumber(res, "pgxcattnum");
+	i_pgxcranges = PQfnumber(res, "pgxcranges");
+	i_pgxcattnums = PQfnumber(res, "pgxcattnums");
 	i_pgxc_node_names = PQfnumber(res, "pgxc_node_names");
 #endif
 	i_reltablespace = PQfnumber(res, "reltablespace");
@@ -5177,6 +5183,14 @@ getTables(Archive *fout, DumpOptions *dopt, int *numTables)
 			tblinfo[i].pgxclocatortype = *(PQgetvalue(res, i, i_pgxclocatortype));
 			tblinfo[i].pgxcattnum = atoi(PQgetvalue(res, i, i_pgxcattnum));
 		}
+		if (i_pgxcranges == -1 || PQgetisnull(res, i, i_pgxcranges))
+			tblinfo[i].pgxcranges = NULL;
+		else
+			tblinfo[i].pgxcranges = pg_strdup(PQgetvalue(res, i, i_pgxcranges));
+		if (i_pgxcattnums == -1 || PQgetisnull(res, i, i_pgxcattnums))
+			tblinfo[i].pgxcattnums = NULL;
+		else
+			tblinfo[i].pgxcattnums = pg_strdup(PQgetvalue(res, i, i_pgxcattnums));
 		tblinfo[i].pgxc_node_names = pg_strdup(PQgetvalue(res, i, i_pgxc_node_names));
 #endif
 		tblinfo[i].reltablespace = pg_strdup(PQgetvalue(res, i, i_reltablespace));
@@ -14064,6 +14078,28 @@ dumpTableSchema(Archive *fout, DumpOptions *dopt, TableInfo *tbinfo)
 				appendPQExpBuffer(q, "\nDISTRIBUTE BY REPLICATION");
 			}
 			/* H: DISTRIBUTE BY HASH  */
+			else if (tbinfo->pgxclocatortype == 'H' && tbinfo->pgxcattnums)
+			{
+				/* The columns are listed as "1 2 ..." */
+				char	   *hashkeys = tbinfo->pgxcattnums;
+				char	   *end;
+				bool		first = true;
+
+				appendPQExpBufferStr(q, "\nDISTRIBUTE BY HASH (");
+				while (*hashkeys)
+				{
+					int hashkey = (int) strtol(hashkeys, &end, 10);
+
+					if (end == hashkeys)
+						break;
+					if (!first)
+						appendPQExpBufferStr(q, ", ");
+					appendPQExpBufferStr(q, fmtId(tbinfo->attnames[hashkey - 1]));
+					first = false;
+					hashkeys = end;
+				}
+				appendPQExpBufferChar(q, ')');
+			}
 			else if (tbinfo->pgxclocatortype == 'H')
 			{
 				int hashkey = tbinfo->pgxcattnum;
@@ -14076,6 +14112,21 @@ dumpTableSchema(Archive *fout, DumpOptions *dopt, TableInfo *tbinfo)
 				appendPQExpBuffer(q, "\nDISTRIBUTE BY MODULO (%s)",
 								  fmtId(tbinfo->attnames[hashkey - 1]));
 			}
+			/* B: DISTRIBUTE BY BUCKET */
+			else if (tbinfo->pgxclocatortype == 'B')
+			{
+				int hashkey = tbinfo->pgxcattnum;
+				appendPQExpBuffer(q, "\nDISTRIBUTE BY BUCKET (%s)",
+								  fmtId(tbinfo->attnames[hashkey - 1]));
+			}
+			/* G: DISTRIBUTE BY RANGE */
+			else if (tbinfo->pgxclocatortype == 'G' && tbinfo->pgxcranges)
+			{
+				int hashkey = tbinfo->pgxcattnum;
+				appendPQExpBuffer(q, "\nDISTRIBUTE BY RANGE (%s) VALUES (%s)",
+								  fmtId(tbinfo->attnames[hashkey - 1]),
+								  tbinfo->pgxcranges);
+			}
 		}
 		if (include_nodes &&
 			tbinfo->pgxc_node_names != NULL &&
@@ -231,6 +231,8 @@ typedef struct _tableInfo
 	/* PGXC table locator Data */
 	char		pgxclocatortype;	/* Type of PGXC table locator */
 	int			pgxcattnum;		/* Number of the attribute the table is partitioned with */
+	char		*pgxcranges;	/* Split points of range distribution, as literals */
+	char		*pgxcattnums;	/* Columns of a distribution by several columns */
 	char		*pgxc_node_names;	/* List of node names where this table is distributed */
 #endif
 	/*
@@ -35,6 +35,7 @@
 
 #include "getopt_long.h"
 #include "libpq-fe.h"
+#include "pqexpbuffer.h"
 #include "portability/instr_time.h"
 
 #include <ctype.h>
@@ -101,6 +102,9 @@ static int	pthread_join(pthread_t th, void **thread_return);
 #define DEFAULT_NXACTS	10		/* default nxacts */
 
 #define MIN_GAUSSIAN_THRESHOLD		2.0 /* minimum threshold for gauss */
+#ifdef PGXC
+#define MIN_ZIPFIAN_PARAM			1.01	/* minimum parameter for zipfian */
+#endif
 
 int			nxacts = 0;			/* number of transactions per client */
 int			duration = 0;		/* duration in seconds */
@@ -163,6 +167,25 @@ char	   *index_tablespace = NULL;
 
 #ifdef PGXC
 bool		use_branch = false;	/* use branch id in DDL and DML */
+
+/*
+ * Coordinators given by --coordinators, client N connecting to coordinator
+ * N modulo their number.  Without the option the clients connect to pghost
+ * and pgport.
+ */
+#define MAX_COORDINATORS	64
+char	   *coord_hosts[MAX_COORDINATORS];
+char	   *coord_ports[MAX_COORDINATORS];
+int			ncoordinators = 0;
+
+/*
+ * Parameter of the zipfian distribution of the branches drawn by the builtin
+ * scripts, 0 for a uniform distribution.
+ */
+double		skew = 0.0;
+
+/* report the top plan node of each prepared statement? */
+bool		check_fqs = false;
 #endif
 /*
  * The scale factor at/beyond which 32bit integers are incapable of storing
@@ -204,6 +227,19 @@ typedef struct
 #define MAX_FILES		128		/* max number of SQL script files allowed */
 #define SHELL_COMMAND_SIZE	256 /* maximum size allowed for shell command */
 
+#ifdef PGXC
+/* Nodes the transactions of a script run on, as marked by \nodes */
+typedef enum TxnKind
+{
+	TXN_UNMARKED,
+	TXN_SINGLE_NODE,
+	TXN_MULTI_NODE,
+	NUM_TXN_KINDS
+} TxnKind;
+
+static const char *TXNKIND[] = {"unmarked", "single-node", "multi-node"};
+#endif
+
 /*
  * structures used in custom query mode
  */
@@ -229,6 +265,10 @@ typedef struct
 	bool		is_throttled;	/* whether transaction throttling is done */
 	int			use_file;		/* index in sql_files for this client */
 	bool		prepared[MAX_FILES];
+#ifdef PGXC
+	int64		kind_xacts[NUM_TXN_KINDS];	/* xacts of each kind */
+	int64		kind_latencies[NUM_TXN_KINDS];	/* and their latencies */
+#endif
 } CState;
 
 /*
@@ -264,6 +304,12 @@ typedef struct
 	int64		throttle_lag_max;
 	int64		throttle_latency_skipped;
 	int64		latency_late;
+#ifdef PGXC
+	int64		coord_xacts[MAX_COORDINATORS];
+	int64		coord_latencies[MAX_COORDINATORS];
+	int64		kind_xacts[NUM_TXN_KINDS];
+	int64		kind_latencies[NUM_TXN_KINDS];
+#endif
 } TResult;
 
 /*
@@ -319,6 +365,11 @@ static Command **sql_files[MAX_FILES];	/* SQL script files */
 static int	num_files;			/* number of script files */
 static int	num_commands = 0;	/* total number of Command structs */
 static int	debug = 0;			/* debug flag */
+#ifdef PGXC
+static TxnKind sql_file_kind[MAX_FILES];	/* kind of each script file */
+static bool txn_kinds_marked = false;	/* some script has a \nodes? */
+static char **fqs_plans;		/* top plan node, per Command */
+#endif
 
 /* default scenario */
 static char *tpc_b = {
@@ -452,6 +503,12 @@ usage(void)
 		   "  -v, --vacuum-all         vacuum all four standard tables before tests\n"
 		   "  --aggregate-interval=NUM aggregate data over NUM seconds\n"
 		   "  --sampling-rate=NUM      fraction of transactions to log (e.g. 0.01 for 1%%)\n"
+#ifdef PGXC
+		   "  --check-fqs              report the top plan node of the prepared statements\n"
+		   "  --coordinators=HOST[:PORT][,...]\n"
+		   "                           spread the clients across these Coordinators\n"
+		   "  --skew=NUM               draw branches from a zipfian distribution of parameter NUM\n"
+#endif
 		   "\nCommon options:\n"
 		   "  -d, --debug              print debugging output\n"
 	  "  -h, --host=HOSTNAME      database server host or socket directory\n"
@@ -624,6 +681,42 @@ getGaussianRand(TState *thread, int64 min, int64 max, double threshold)
 	return min + (int64) ((max - min + 1) * rand);
 }
 
+#ifdef PGXC
+/*
+ * random number generator: zipfian distribution from min to max inclusive.
+ * The k-th value from min is drawn with a probability proportional to
+ * 1/k^s, so that a few values are drawn most of the time, as the few large
+ * tenants of a multi-tenant database own most of its data.
+ *
+ * The values are drawn by rejection, see L. Devroye, "Non-Uniform Random
+ * Variate Generation", p. 550.  The closer s is to 1, the more draws above
+ * max are rejected, hence the minimum MIN_ZIPFIAN_PARAM.
+ */
+static int64
+getZipfianRand(TState *thread, int64 min, int64 max, double s)
+{
+	double		n = (double) (max - min + 1);
+	double		b = pow(2.0, s - 1.0);
+	double		u,
+				v,
+				x,
+				t;
+
+	Assert(s >= MIN_ZIPFIAN_PARAM);
+	do
+	{
+		/* erand in [0, 1), u in (0, 1] */
+		u = 1.0 - pg_erand48(thread->random_state);
+		v = pg_erand48(thread->random_state);
+		x = floor(pow(u, -1.0 / (s - 1.0)));
+		t = pow(1.0 + 1.0 / x, s - 1.0);
+	}
+	while (x > n || v * x * (t - 1.0) / (b - 1.0) > t / b);
+
+	return min + (int64) x - 1;
+}
+#endif
+
 /*
  * random number generator: generate a value, such that the series of values
  * will approximate a Poisson distribution centered on the given value.
@@ -673,9 +766,12 @@ tryExecuteStatement(PGconn *con, const char *sql)
 	PQclear(res);
 }
 
-/* set up a connection to the backend */
+/*
+ * set up a connection to the backend, the Coordinator of the client of the
+ * given number if several are used
+ */
 static PGconn *
-doConnect(void)
+doConnect(int client)
 {
 	PGconn	   *conn;
 	static char *password = NULL;
@@ -696,6 +792,13 @@ doConnect(void)
 		values[0] = pghost;
 		keywords[1] = "port";
 		values[1] = pgport;
+#ifdef PGXC
+		if (ncoordinators > 0)
+		{
+			values[0] = coord_hosts[client % ncoordinators];
+			values[1] = coord_ports[client % ncoordinators];
+		}
+#endif
 		keywords[2] = "user";
 		values[2] = login;
 		keywords[3] = "password";
@@ -1146,6 +1249,61 @@ preparedStatementName(char *buffer, int file, int state)
 	sprintf(buffer, "P%d_%d", file, state);
 }
 
+#ifdef PGXC
+/*
+ * Return the top plan node of a prepared statement run with the given
+ * parameters, telling whether the statement is shipped as a whole to the
+ * Datanodes.
+ */
+static char *
+explainPrepared(PGconn *con, const char *name, int nparams,
+				const char **params)
+{
+	PQExpBufferData sql;
+	PGresult   *res;
+	char	   *result;
+	int			i;
+
+	initPQExpBuffer(&sql);
+	appendPQExpBuffer(&sql, "EXPLAIN (COSTS OFF) EXECUTE %s", name);
+	for (i = 0; i < nparams; i++)
+	{
+		appendPQExpBufferStr(&sql, i == 0 ? "(" : ", ");
+		if (params[i] == NULL)
+			appendPQExpBufferStr(&sql, "NULL");
+		else
+		{
+			char	   *literal = PQescapeLiteral(con, params[i],
+												  strlen(params[i]));
+
+			if (literal == NULL)
+			{
+				fprintf(stderr, "%s", PQerrorMessage(con));
+				exit(1);
+			}
+			appendPQExpBufferStr(&sql, literal);
+			PQfreemem(literal);
+		}
+	}
+	if (nparams > 0)
+		appendPQExpBufferChar(&sql, ')');
+
+	res = PQexec(con, sql.data);
+	if (PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) > 0)
+		result = pg_strdup(PQgetvalue(res, 0, 0));
+	else
+	{
+		fprintf(stderr, "could not explain %s: %s", name,
+				PQerrorMessage(con));
+		result = pg_strdup("?");
+	}
+	PQclear(res);
+	termPQExpBuffer(&sql);
+
+	return result;
+}
+#endif
+
 static bool
 clientDone(CState *st, bool ok)
 {
@@ -1316,7 +1474,11 @@ top:
 		if (commands[st->state + 1] == NULL)
 		{
 			/* only calculate latency if an option is used that needs it */
-			if (progress || throttle_delay || latency_limit)
+			if (progress || throttle_delay || latency_limit
+#ifdef PGXC
+				|| ncoordinators > 1 || txn_kinds_marked
+#endif
+				)
 			{
 				int64		latency;
 
@@ -1339,6 +1501,11 @@ top:
 				/* record over the limit transactions if needed. */
 				if (latency_limit && latency > latency_limit)
 					thread->latency_late++;
+
+#ifdef PGXC
+				st->kind_xacts[sql_file_kind[st->use_file]]++;
+				st->kind_latencies[sql_file_kind[st->use_file]] += latency;
+#endif
 			}
 
 			/* record the time it took in the log */
@@ -1408,7 +1575,7 @@ top:
 					end;
 
 		INSTR_TIME_SET_CURRENT(start);
-		if ((st->con = doConnect()) == NULL)
+		if ((st->con = doConnect(st->id)) == NULL)
 		{
 			fprintf(stderr, "Client %d aborted in establishing connection.\n", st->id);
 			return clientDone(st, false);
@@ -1429,7 +1596,11 @@ top:
 	}
 
 	/* Record transaction start time under logging, progress or throttling */
-	if ((logfile || progress || throttle_delay || latency_limit) && st->state == 0)
+	if ((logfile || progress || throttle_delay || latency_limit
+#ifdef PGXC
+		 || ncoordinators > 1 || txn_kinds_marked
+#endif
+		 ) && st->state == 0)
 	{
 		INSTR_TIME_SET_CURRENT(st->txn_begin);
 
@@ -1503,6 +1674,14 @@ top:
 			getQueryParams(st, command, params);
 			preparedStatementName(name, st->use_file, st->state);
 
+#ifdef PGXC
+			/* the first client explains each statement the first time */
+			if (check_fqs && st->id == 0 &&
+				fqs_plans[command->command_num] == NULL)
+				fqs_plans[command->command_num] =
+					explainPrepared(st->con, name, command->argc - 1, params);
+#endif
+
 			if (debug)
 				fprintf(stderr, "client %d sending %s\n", st->id, name);
 			r = PQsendQueryPrepared(st->con, name, command->argc - 1,
@@ -1609,6 +1788,9 @@ top:
 			}
 			else if (argc == 6 &&
 					 ((pg_strcasecmp(argv[4], "gaussian") == 0) ||
+#ifdef PGXC
+					  (pg_strcasecmp(argv[4], "zipfian") == 0) ||
+#endif
 					  (pg_strcasecmp(argv[4], "exponential") == 0)))
 			{
 				if (*argv[5] == ':')
@@ -1650,6 +1832,18 @@ top:
 #endif
 					snprintf(res, sizeof(res), INT64_FORMAT, getExponentialRand(thread, min, max, threshold));
 				}
+#ifdef PGXC
+				else if (pg_strcasecmp(argv[4], "zipfian") == 0)
+				{
+					if (threshold < MIN_ZIPFIAN_PARAM)
+					{
+						fprintf(stderr, "%s: zipfian parameter must be at least %f\n", argv[5], MIN_ZIPFIAN_PARAM);
+						st->ecnt++;
+						return true;
+					}
+					snprintf(res, sizeof(res), INT64_FORMAT, getZipfianRand(thread, min, max, threshold));
+				}
+#endif
 			}
 			else	/* this means an error somewhere in the parsing phase... */
 			{
@@ -1750,6 +1944,13 @@ top:
 			else	/* succeeded */
 				st->listen = 1;
 		}
+#ifdef PGXC
+		else if (pg_strcasecmp(argv[0], "nodes") == 0)
+		{
+			/* only marks the script, see sql_file_kind */
+			st->listen = 1;
+		}
+#endif
 		goto top;
 	}
 
@@ -2039,7 +2240,7 @@ init(bool is_no_vacuum)
 				remaining_sec;
 	int			log_interval = 1;
 
-	if ((con = doConnect()) == NULL)
+	if ((con = doConnect(0)) == NULL)
 		exit(1);
 
 	for (i = 0; i < lengthof(DDLs); i++)
@@ -2421,6 +2622,9 @@ process_commands(char *buf, const char *source, const int lineno)
 			}
 			else if (			/* argc >= 5 */
 					 (pg_strcasecmp(my_commands->argv[4], "gaussian") == 0) ||
+#ifdef PGXC
+					 (pg_strcasecmp(my_commands->argv[4], "zipfian") == 0) ||
+#endif
 				   (pg_strcasecmp(my_commands->argv[4], "exponential") == 0))
 			{
 				if (my_commands->argc < 6)
@@ -2525,6 +2729,23 @@ process_commands(char *buf, const char *source, const int lineno)
 							 "missing command", NULL, -1);
 			}
 		}
+#ifdef PGXC
+		else if (pg_strcasecmp(my_commands->argv[0], "nodes") == 0)
+		{
+			if (my_commands->argc < 2)
+			{
+				syntax_error(source, lineno, my_commands->line, my_commands->argv[0],
+							 "missing argument", NULL, -1);
+			}
+			else if (pg_strcasecmp(my_commands->argv[1], "single") != 0 &&
+					 pg_strcasecmp(my_commands->argv[1], "multi") != 0)
+			{
+				syntax_error(source, lineno, my_commands->line, my_commands->argv[0],
+							 "argument must be single or multi",
+							 my_commands->argv[1], my_commands->cols[1]);
+			}
+		}
+#endif
 		else
 		{
 			syntax_error(source, lineno, my_commands->line, my_commands->argv[0],
@@ -2661,6 +2882,31 @@ process_file(char *filename)
 	return true;
 }
 
+#ifdef PGXC
+/*
+ * Make a builtin script draw the branch, the tenant the data belongs to,
+ * from a zipfian distribution of parameter skew.
+ */
+static char *
+skewScript(char *script)
+{
+	static const char *uniform = "\\setrandom bid 1 :nbranches\n";
+	char	   *p = strstr(script, uniform);
+	char	   *result;
+	size_t		len;
+
+	if (skew <= 0.0 || p == NULL)
+		return script;
+
+	len = strlen(script) + 64;
+	result = pg_malloc(len);
+	snprintf(result, len, "%.*s\\setrandom bid 1 :nbranches zipfian %g\n%s",
+			 (int) (p - script), script, skew, p + strlen(uniform));
+
+	return result;
+}
+#endif
+
 static Command **
 process_builtin(char *tb, const char *source)
 {
@@ -2854,6 +3100,69 @@ printResults(int ttype, int64 normal_xacts, int nclients,
 	}
 }
 
+#ifdef PGXC
+/*
+ * Print the results specific to a cluster: latencies per Coordinator and
+ * per kind of transaction, and the plan of the prepared statements.
+ */
+static void
+printClusterResults(int64 normal_xacts, int64 *coord_xacts,
+					int64 *coord_latencies, int64 *kind_xacts,
+					int64 *kind_latencies)
+{
+	int			i;
+
+	if (normal_xacts <= 0)
+		return;
+
+	if (ncoordinators > 1)
+	{
+		printf("latency average per coordinator:\n");
+		for (i = 0; i < ncoordinators; i++)
+			printf("\t%s:%s\t" INT64_FORMAT " xacts\t%.3f ms\n",
+				   coord_hosts[i], coord_ports[i], coord_xacts[i],
+				   coord_xacts[i] > 0 ?
+				   0.001 * coord_latencies[i] / coord_xacts[i] : 0.0);
+	}
+
+	if (txn_kinds_marked)
+	{
+		TxnKind		kind;
+
+		for (kind = 0; kind < NUM_TXN_KINDS; kind++)
+		{
+			if (kind_xacts[kind] == 0)
+				continue;
+			printf("%s transactions: " INT64_FORMAT " (%.3f %%), latency average: %.3f ms\n",
+				   TXNKIND[kind], kind_xacts[kind],
+				   100.0 * kind_xacts[kind] / normal_xacts,
+				   0.001 * kind_latencies[kind] / kind_xacts[kind]);
+		}
+	}
+
+	if (check_fqs)
+	{
+		printf("top plan node of the prepared statements:\n");
+		for (i = 0; i < num_files; i++)
+		{
+			Command   **commands;
+
+			for (commands = sql_files[i]; *commands != NULL; commands++)
+			{
+				Command    *command = *commands;
+
+				if (command->type != SQL_COMMAND)
+					continue;
+				printf("\t%s\t%s\n",
+					   fqs_plans[command->command_num] ?
+					   fqs_plans[command->command_num] : "(not run)",
+					   command->line);
+			}
+		}
+	}
+}
+#endif
+
 
 int
 main(int argc, char **argv)
@@ -2892,6 +3201,11 @@ main(int argc, char **argv)
 		{"aggregate-interval", required_argument, NULL, 5},
 		{"rate", required_argument, NULL, 'R'},
 		{"latency-limit", required_argument, NULL, 'L'},
+#ifdef PGXC
+		{"coordinators", required_argument, NULL, 6},
+		{"skew", required_argument, NULL, 7},
+		{"check-fqs", no_argument, NULL, 8},
+#endif
 		{NULL, 0, NULL, 0}
 	};
 
@@ -2923,6 +3237,13 @@ main(int argc, char **argv)
 	int64		throttle_lag_max = 0;
 	int64		throttle_latency_skipped = 0;
 	int64		latency_late = 0;
+#ifdef PGXC
+	int64		coord_xacts[MAX_COORDINATORS];
+	int64		coord_latencies[MAX_COORDINATORS];
+	int64		kind_xacts[NUM_TXN_KINDS];
+	int64		kind_latencies[NUM_TXN_KINDS];
+	char	   *coordinators = NULL;
+#endif
 
 	int			i;
 
@@ -3222,6 +3543,26 @@ main(int argc, char **argv)
 				}
 #endif
 				break;
+#ifdef PGXC
+			case 6:
+				benchmarking_option_set = true;
+				coordinators = pg_strdup(optarg);
+				break;
+			case 7:
+				benchmarking_option_set = true;
+				skew = atof(optarg);
+				if (skew < MIN_ZIPFIAN_PARAM)
+				{
+					fprintf(stderr, "invalid skew: %s, must be at least %.2f\n",
+							optarg, MIN_ZIPFIAN_PARAM);
+					exit(1);
+				}
+				break;
+			case 8:
+				benchmarking_option_set = true;
+				check_fqs = true;
+				break;
+#endif
 			default:
 				fprintf(stderr, _("Try \"%s --help\" for more information.\n"), progname);
 				exit(1);
@@ -3274,6 +3615,43 @@ main(int argc, char **argv)
 		exit(1);
 	}
 
+#ifdef PGXC
+	if (check_fqs && querymode != QUERY_PREPARED)
+	{
+		fprintf(stderr, "checking fast query shipping (--check-fqs) requires the prepared protocol (-M prepared)\n");
+		exit(1);
+	}
+
+	/* split the Coordinator list into hosts and ports */
+	if (coordinators != NULL)
+	{
+		char	   *coord;
+
+		for (coord = strtok(coordinators, ","); coord != NULL;
+			 coord = strtok(NULL, ","))
+		{
+			char	   *port = strrchr(coord, ':');
+
+			if (ncoordinators >= MAX_COORDINATORS)
+			{
+				fprintf(stderr, "too many coordinators, at most %d are allowed\n",
+						MAX_COORDINATORS);
+				exit(1);
+			}
+			if (port != NULL)
+				*port++ = '\0';
+			coord_hosts[ncoordinators] = coord;
+			coord_ports[ncoordinators] = port ? port : pgport;
+			ncoordinators++;
+		}
+		if (ncoordinators == 0)
+		{
+			fprintf(stderr, "empty coordinator list (--coordinators)\n");
+			exit(1);
+		}
+	}
+#endif
+
 	/* --sampling-rate may be used only with -l */
 	if (sample_rate > 0.0 && !use_log)
 	{
@@ -3360,7 +3738,7 @@ main(int argc, char **argv)
 	}
 
 	/* opening connection... */
-	con = doConnect();
+	con = doConnect(0);
 	if (con == NULL)
 		exit(1);
 
@@ -3453,11 +3831,11 @@ main(int argc, char **argv)
 		case 0:
 #ifdef PGXC
 			if (use_branch)
-				sql_files[0] = process_builtin(tpc_b_bid,
+				sql_files[0] = process_builtin(skewScript(tpc_b_bid),
 						"<builtin: TPC-B (sort of)>" );
 			else
 #endif
-			sql_files[0] = process_builtin(tpc_b,
+			sql_files[0] = process_builtin(skewScript(tpc_b),
 										   "<builtin: TPC-B (sort of)>");
 			num_files = 1;
 			break;
@@ -3471,11 +3849,11 @@ main(int argc, char **argv)
 		case 2:
 #ifdef PGXC
 			if (use_branch)
-				sql_files[0] = process_builtin(simple_update_bid,
+				sql_files[0] = process_builtin(skewScript(simple_update_bid),
 										   "<builtin: simple update>");
 			else
 #endif
-			sql_files[0] = process_builtin(simple_update,
+			sql_files[0] = process_builtin(skewScript(simple_update),
 										   "<builtin: simple update>");
 			num_files = 1;
 			break;
@@ -3484,6 +3862,36 @@ main(int argc, char **argv)
 			break;
 	}
 
+#ifdef PGXC
+	/* find the kind of the transactions of each script */
+	for (i = 0; i < num_files; i++)
+	{
+		Command   **commands;
+
+		sql_file_kind[i] = TXN_UNMARKED;
+		for (commands = sql_files[i]; *commands != NULL; commands++)
+		{
+			Command    *command = *commands;
+
+			if (command->type == META_COMMAND &&
+				pg_strcasecmp(command->argv[0], "nodes") == 0)
+			{
+				if (pg_strcasecmp(command->argv[1], "single") == 0)
+					sql_file_kind[i] = TXN_SINGLE_NODE;
+				else
+					sql_file_kind[i] = TXN_MULTI_NODE;
+				txn_kinds_marked = true;
+			}
+		}
+	}
+
+	if (check_fqs)
+	{
+		fqs_plans = (char **) pg_malloc(sizeof(char *) * num_commands);
+		memset(fqs_plans, 0, sizeof(char *) * num_commands);
+	}
+#endif
+
 	/* set up thread data structures */
 	threads = (TState *) pg_malloc(sizeof(TState) * nthreads);
 	for (i = 0; i < nthreads; i++)
@@ -3555,6 +3963,12 @@ main(int argc, char **argv)
 
 	/* wait for threads and accumulate results */
 	INSTR_TIME_SET_ZERO(conn_total_time);
+#ifdef PGXC
+	memset(coord_xacts, 0, sizeof(coord_xacts));
+	memset(coord_latencies, 0, sizeof(coord_latencies));
+	memset(kind_xacts, 0, sizeof(kind_xacts));
+	memset(kind_latencies, 0, sizeof(kind_latencies));
+#endif
 	for (i = 0; i < nthreads; i++)
 	{
 		void	   *ret = NULL;
@@ -3577,6 +3991,22 @@ main(int argc, char **argv)
 			if (r->throttle_lag_max > throttle_lag_max)
 				throttle_lag_max = r->throttle_lag_max;
 			INSTR_TIME_ADD(conn_total_time, r->conn_time);
+#ifdef PGXC
+			{
+				int			j;
+
+				for (j = 0; j < ncoordinators; j++)
+				{
+					coord_xacts[j] += r->coord_xacts[j];
+					coord_latencies[j] += r->coord_latencies[j];
+				}
+				for (j = 0; j < NUM_TXN_KINDS; j++)
+				{
+					kind_xacts[j] += r->kind_xacts[j];
+					kind_latencies[j] += r->kind_latencies[j];
+				}
+			}
+#endif
 			free(ret);
 		}
 	}
@@ -3598,6 +4028,10 @@ main(int argc, char **argv)
 				 total_time, conn_total_time, total_latencies, total_sqlats,
 				 throttle_lag, throttle_lag_max, throttle_latency_skipped,
 				 latency_late);
+#ifdef PGXC
+	printClusterResults(total_xacts, coord_xacts, coord_latencies,
+						kind_xacts, kind_latencies);
+#endif
 
 	return 0;
 }
@@ -3614,6 +4048,9 @@ threadRun(void *arg)
 	int			nstate = thread->nstate;
 	int			remains = nstate;		/* number of remaining clients */
 	int			i;
+#ifdef PGXC
+	int			j;
+#endif
 
 	/* for reporting progress: */
 	int64		thread_start = INSTR_TIME_GET_MICROSEC(thread->start_time);
@@ -3665,7 +4102,7 @@ threadRun(void *arg)
 		/* make connections to the database */
 		for (i = 0; i < nstate; i++)
 		{
-			if ((state[i].con = doConnect()) == NULL)
+			if ((state[i].con = doConnect(state[i].id)) == NULL)
 				goto done;
 		}
 	}
@@ -3946,11 +4383,31 @@ done:
 	result->xacts = 0;
 	result->latencies = 0;
 	result->sqlats = 0;
+#ifdef PGXC
+	memset(result->coord_xacts, 0, sizeof(result->coord_xacts));
+	memset(result->coord_latencies, 0, sizeof(result->coord_latencies));
+	memset(result->kind_xacts, 0, sizeof(result->kind_xacts));
+	memset(result->kind_latencies, 0, sizeof(result->kind_latencies));
+#endif
 	for (i = 0; i < nstate; i++)
 	{
 		result->xacts += state[i].cnt;
 		result->latencies += state[i].txn_latencies;
 		result->sqlats += state[i].txn_sqlats;
+#ifdef PGXC
+		if (ncoordinators > 0)
+		{
+			int			coord = state[i].id % ncoordinators;
+
+			result->coord_xacts[coord] += state[i].cnt;
+			result->coord_latencies[coord] += state[i].txn_latencies;
+		}
+		for (j = 0; j < NUM_TXN_KINDS; j++)
+		{
+			result->kind_xacts[j] += state[i].kind_xacts[j];
+			result->kind_latencies[j] += state[i].kind_latencies[j];
+		}
+#endif
 	}
 	result->throttle_lag = thread->throttle_lag;
 	result->throttle_lag_max = thread->throttle_lag_max;
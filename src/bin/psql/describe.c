@@ -29,6 +29,8 @@
 #define LOCATOR_TYPE_HASH 'H'
 #define LOCATOR_TYPE_RROBIN 'N'
 #define LOCATOR_TYPE_MODULO 'M'
+#define LOCATOR_TYPE_BUCKET 'B'
+#define LOCATOR_TYPE_RANGE 'G'
 #endif /* PGXC */
 
 static bool describeOneTableDetails(const char *schemaname,
@@ -2541,7 +2543,12 @@ describeOneTableDetails(const char *schemaname,
 							"WHEN '%c' THEN 'ROUND ROBIN' \n"
 							"WHEN '%c' THEN 'REPLICATION' \n"
 							"WHEN '%c' THEN 'HASH' \n"
-							"WHEN '%c' THEN 'MODULO' END || CASE pcattnum WHEN 0 THEN '' ELSE '('|| a.attname ||')' END as distype \n"
+							"WHEN '%c' THEN 'MODULO' \n"
+							"WHEN '%c' THEN 'BUCKET' \n"
+							"WHEN '%c' THEN 'RANGE' END || CASE WHEN pcattnums IS NOT NULL THEN '(' || array_to_string(ARRAY( \n"
+								"SELECT k.attname FROM unnest(c.pcattnums::pg_catalog.int2[]) WITH ORDINALITY u(n, o) \n"
+								"JOIN pg_catalog.pg_attribute k ON k.attrelid = c.pcrelid AND k.attnum = u.n ORDER BY u.o \n"
+							"), ', ') || ')' WHEN pcattnum = 0 THEN '' ELSE '('|| a.attname ||')' END as distype \n"
 							", CASE array_length(nodeoids, 1) \n"
 								"WHEN nc.dn_cn THEN 'ALL DATANODES' \n"
 								"ELSE array_to_string(ARRAY( \n"
@@ -2555,6 +2562,8 @@ describeOneTableDetails(const char *schemaname,
 					, LOCATOR_TYPE_REPLICATED
 					, LOCATOR_TYPE_HASH
 					, LOCATOR_TYPE_MODULO
+					, LOCATOR_TYPE_BUCKET
+					, LOCATOR_TYPE_RANGE
 					, oid
 					, oid);
 			result = PSQLexec(buf.data);
@@ -34,6 +34,8 @@ typedef struct vacuumingOptions
 	bool		and_analyze;
 	bool		full;
 	bool		freeze;
+	bool		order_by_need;
+	int			cost_limit;
 } vacuumingOptions;
 
 
@@ -53,6 +55,10 @@ static void vacuum_all_databases(vacuumingOptions *vacopts,
 					 int concurrentCons,
 					 const char *progname, bool echo, bool quiet);
 
+static void get_tables_by_need(PGconn *conn, vacuumingOptions *vacopts,
+				   SimpleStringList *tables,
+				   const char *progname, bool echo);
+
 static void prepare_vacuum_command(PQExpBuffer sql, PGconn *conn,
 					   vacuumingOptions *vacopts, const char *table);
 
@@ -101,6 +107,8 @@ main(int argc, char *argv[])
 		{"jobs", required_argument, NULL, 'j'},
 		{"maintenance-db", required_argument, NULL, 2},
 		{"analyze-in-stages", no_argument, NULL, 3},
+		{"order-by-need", no_argument, NULL, 4},
+		{"cost-limit", required_argument, NULL, 5},
 		{NULL, 0, NULL, 0}
 	};
 
@@ -204,6 +212,18 @@ main(int argc, char *argv[])
 			case 3:
 				analyze_in_stages = vacopts.analyze_only = true;
 				break;
+			case 4:
+				vacopts.order_by_need = true;
+				break;
+			case 5:
+				vacopts.cost_limit = atoi(optarg);
+				if (vacopts.cost_limit <= 0)
+				{
+					fprintf(stderr, _("%s: cost limit must be at least 1\n"),
+							progname);
+					exit(1);
+				}
+				break;
 			default:
 				fprintf(stderr, _("Try \"%s --help\" for more information.\n"), progname);
 				exit(1);
@@ -372,36 +392,45 @@ vacuum_one_database(const char *dbname, vacuumingOptions *vacopts,
 
 	/*
 	 * If a table list is not provided and we're using multiple connections,
-	 * prepare the list of tables by querying the catalogs.
+	 * or the tables are to be ordered by need, prepare the list of tables by
+	 * querying the catalogs.
 	 */
-	if (parallel && (!tables || !tables->head))
+	if ((parallel || vacopts->order_by_need) && (!tables || !tables->head))
 	{
-		PQExpBufferData buf;
-		PGresult   *res;
-		int			ntups;
-		int			i;
+		int			ntups = 0;
 
-		initPQExpBuffer(&buf);
+		if (vacopts->order_by_need)
+			get_tables_by_need(conn, vacopts, &dbtables, progname, echo);
+		else
+		{
+			PQExpBufferData buf;
+			PGresult   *res;
+			int			i;
 
-		res = executeQuery(conn,
-			"SELECT c.relname, ns.nspname FROM pg_class c, pg_namespace ns\n"
-			 " WHERE relkind IN (\'r\', \'m\') AND c.relnamespace = ns.oid\n"
-						   " ORDER BY c.relpages DESC;",
-						   progname, echo);
+			initPQExpBuffer(&buf);
 
-		ntups = PQntuples(res);
-		for (i = 0; i < ntups; i++)
-		{
-			appendPQExpBuffer(&buf, "%s",
-							  fmtQualifiedId(PQserverVersion(conn),
-											 PQgetvalue(res, i, 1),
-											 PQgetvalue(res, i, 0)));
+			res = executeQuery(conn,
+				"SELECT c.relname, ns.nspname FROM pg_class c, pg_namespace ns\n"
+				 " WHERE relkind IN (\'r\', \'m\') AND c.relnamespace = ns.oid\n"
+							   " ORDER BY c.relpages DESC;",
+							   progname, echo);
 
-			simple_string_list_append(&dbtables, buf.data);
-			resetPQExpBuffer(&buf);
-		}
+			for (i = 0; i < PQntuples(res); i++)
+			{
+				appendPQExpBuffer(&buf, "%s",
+								  fmtQualifiedId(PQserverVersion(conn),
+												 PQgetvalue(res, i, 1),
+												 PQgetvalue(res, i, 0)));
 
-		termPQExpBuffer(&buf);
+				simple_string_list_append(&dbtables, buf.data);
+				resetPQExpBuffer(&buf);
+			}
+
+			termPQExpBuffer(&buf);
+			PQclear(res);
+		}
+		for (cell = dbtables.head; cell; cell = cell->next)
+			ntups++;
 		tables = &dbtables;
 
 		/*
@@ -431,6 +460,27 @@ vacuum_one_database(const char *dbname, vacuumingOptions *vacopts,
 		}
 	}
 
+	/*
+	 * Split the cost limit between the connections.  Each command runs on
+	 * all the Datanodes at once, so this caps the vacuum I/O of every node
+	 * however many tables are processed concurrently.  Manual vacuums are not
+	 * throttled by default, so use the autovacuum delay.
+	 */
+	if (vacopts->cost_limit > 0)
+	{
+		PQExpBufferData buf;
+		int			j;
+
+		initPQExpBuffer(&buf);
+		appendPQExpBuffer(&buf,
+						  "SET vacuum_cost_limit = %d; "
+						  "SET vacuum_cost_delay = 20;",
+						  Max(vacopts->cost_limit / concurrentCons, 1));
+		for (j = 0; j < concurrentCons; j++)
+			executeCommand((slots + j)->connection, buf.data, progname, echo);
+		termPQExpBuffer(&buf);
+	}
+
 	/*
 	 * Prepare all the connections to run the appropriate analyze stage, if
 	 * caller requested that mode.
@@ -594,6 +644,152 @@ vacuum_all_databases(vacuumingOptions *vacopts,
 	PQclear(result);
 }
 
+/*
+ * Per-table statistics summed up over the Datanodes
+ */
+typedef struct TableNeed
+{
+	char	   *name;			/* qualified and quoted table name */
+	int			maxage;			/* oldest relfrozenxid age on any node */
+	double		live;			/* live tuples on all nodes */
+	double		dead;			/* dead tuples on all nodes */
+	double		changed;		/* tuples changed since last analyze */
+	double		need;			/* priority, higher first */
+} TableNeed;
+
+static int
+compare_table_need(const void *a, const void *b)
+{
+	const TableNeed *ta = (const TableNeed *) a;
+	const TableNeed *tb = (const TableNeed *) b;
+
+	if (ta->need > tb->need)
+		return -1;
+	if (ta->need < tb->need)
+		return 1;
+	return strcmp(ta->name, tb->name);
+}
+
+static int
+compare_table_name(const void *a, const void *b)
+{
+	return strcmp(((const TableNeed *) a)->name, ((const TableNeed *) b)->name);
+}
+
+/*
+ * Make the list of tables of the database ordered by how much they need to
+ * be processed, according to the statistics of all the Datanodes.
+ *
+ * A table on which some node is close to autovacuum_freeze_max_age comes
+ * first, then the ones with the largest fraction of dead tuples, or of
+ * tuples changed since the last analyze when only analyzing.  The Datanodes
+ * are queried through EXECUTE DIRECT, so the connection has to be to a
+ * Postgres-XL Coordinator.
+ */
+static void
+get_tables_by_need(PGconn *conn, vacuumingOptions *vacopts,
+				   SimpleStringList *tables,
+				   const char *progname, bool echo)
+{
+	PGresult   *nodes;
+	PGresult   *res;
+	TableNeed  *needs = NULL;
+	int			nneeds = 0;
+	int			maxneeds = 0;
+	int			freeze_max_age;
+	PQExpBufferData buf;
+	int			i,
+				j,
+				k;
+
+	res = executeQuery(conn, "SHOW autovacuum_freeze_max_age;",
+					   progname, echo);
+	freeze_max_age = Max(atoi(PQgetvalue(res, 0, 0)), 1);
+	PQclear(res);
+
+	nodes = executeQuery(conn,
+			"SELECT node_name FROM pg_catalog.pgxc_node\n"
+			" WHERE node_type = 'D' ORDER BY 1;",
+						 progname, echo);
+
+	initPQExpBuffer(&buf);
+	for (i = 0; i < PQntuples(nodes); i++)
+	{
+		int			nsorted = nneeds;
+
+		resetPQExpBuffer(&buf);
+		appendPQExpBuffer(&buf, "EXECUTE DIRECT ON (%s) "
+			"'SELECT ns.nspname, c.relname, age(c.relfrozenxid),\n"
+			"        s.n_live_tup, s.n_dead_tup, s.n_mod_since_analyze\n"
+			"   FROM pg_class c JOIN pg_namespace ns ON c.relnamespace = ns.oid\n"
+			"   LEFT JOIN pg_stat_all_tables s ON s.relid = c.oid\n"
+			"  WHERE c.relkind IN (''r'', ''m'')';",
+						  fmtId(PQgetvalue(nodes, i, 0)));
+		res = executeQuery(conn, buf.data, progname, echo);
+
+		for (j = 0; j < PQntuples(res); j++)
+		{
+			TableNeed	key;
+			TableNeed  *need;
+
+			key.name = (char *) fmtQualifiedId(PQserverVersion(conn),
+											   PQgetvalue(res, j, 0),
+											   PQgetvalue(res, j, 1));
+
+			/* Tables seen on previous nodes are sorted by name */
+			need = (TableNeed *) bsearch(&key, needs, nsorted,
+										 sizeof(TableNeed),
+										 compare_table_name);
+			if (need == NULL)
+			{
+				if (nneeds >= maxneeds)
+				{
+					maxneeds = Max(maxneeds * 2, PQntuples(res));
+					needs = (TableNeed *) pg_realloc(needs,
+											 sizeof(TableNeed) * maxneeds);
+				}
+				need = &needs[nneeds++];
+				memset(need, 0, sizeof(TableNeed));
+				need->name = pg_strdup(key.name);
+			}
+
+			need->maxage = Max(need->maxage, atoi(PQgetvalue(res, j, 2)));
+			need->live += atof(PQgetvalue(res, j, 3));
+			need->dead += atof(PQgetvalue(res, j, 4));
+			need->changed += atof(PQgetvalue(res, j, 5));
+		}
+		PQclear(res);
+
+		if (nneeds > 1)
+			qsort(needs, nneeds, sizeof(TableNeed), compare_table_name);
+	}
+	termPQExpBuffer(&buf);
+	PQclear(nodes);
+
+	for (k = 0; k < nneeds; k++)
+	{
+		TableNeed  *need = &needs[k];
+		double		modified = vacopts->analyze_only ? need->changed : need->dead;
+		double		fraction;
+
+		fraction = modified / Max(need->live + need->dead, 1.0);
+		need->need = Min(fraction, 1.0);
+		if (!vacopts->analyze_only &&
+			need->maxage >= freeze_max_age / 2)
+			need->need += 1.0 + (double) need->maxage / freeze_max_age;
+	}
+
+	if (nneeds > 1)
+		qsort(needs, nneeds, sizeof(TableNeed), compare_table_need);
+
+	for (k = 0; k < nneeds; k++)
+	{
+		simple_string_list_append(tables, needs[k].name);
+		pg_free(needs[k].name);
+	}
+	pg_free(needs);
+}
+
 /*
  * Construct a vacuum/analyze command to run based on the given options, in the
  * given string buffer, which may contain previous garbage.
@@ -944,6 +1140,9 @@ help(const char *progname)
 	printf(_("  -j, --jobs=NUM                  use this many concurrent connections to vacuum\n"));
 	printf(_("      --analyze-in-stages         only update optimizer statistics, in multiple\n"
 			 "                                  stages for faster results;  no vacuum\n"));
+	printf(_("      --cost-limit=NUM            vacuum cost limit per node, shared by all jobs\n"));
+	printf(_("      --order-by-need             process first the tables that need it most,\n"
+			 "                                  judging by the statistics of all Datanodes\n"));
 	printf(_("  -?, --help                      show this help, then exit\n"));
 	printf(_("\nConnection options:\n"));
 	printf(_("  -h, --host=HOSTNAME       database server host or socket directory\n"));
@@ -734,17 +734,37 @@ pglz_decompress(const char *source, int32 slen, char *dest,
 					break;
 				}
 
+				/*
+				 * A zero offset, or one reaching back before the start of
+				 * the output, can only come from corrupt input; the copy
+				 * below would loop forever or read outside the buffer.
+				 */
+				if (off == 0 || off > dp - (unsigned char *) dest)
+				{
+					dp = destend + 1;
+					break;
+				}
+
 				/*
 				 * Now we copy the bytes specified by the tag from OUTPUT to
-				 * OUTPUT. It is dangerous and platform dependent to use
-				 * memcpy() here, because the copied areas could overlap
-				 * extremely!
+				 * OUTPUT.  The areas overlap if the offset is smaller than
+				 * the length, and memmove() would not repeat the pattern the
+				 * way the format wants.  But once one period of off bytes
+				 * is copied, the same match can be seen as starting twice
+				 * as far back, so we copy non-overlapping chunks of growing
+				 * size.  For example, a match of length 16 at offset 4
+				 * copies 4 bytes, then 8 at offset 8, then the last 4 at
+				 * offset 16.
 				 */
-				while (len--)
+				while (off < len)
 				{
-					*dp = dp[-off];
-					dp++;
+					memcpy(dp, dp - off, off);
+					len -= off;
+					dp += off;
+					off += off;
 				}
+				memcpy(dp, dp - off, len);
+				dp += len;
 			}
 			else
 			{
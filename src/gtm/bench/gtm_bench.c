@@ -0,0 +1,500 @@
+/*-------------------------------------------------------------------------
+ *
+ * gtm_bench --- GTM load generator
+ *
+ * Runs a number of client threads, each with its own connection, issuing
+ * GTM requests as fast as it can for a fixed time. Every thread runs the
+ * same transaction in a loop: begin, a number of snapshots, a number of
+ * sequence fetches and commit. The throughput and the latency percentiles
+ * of each request type are reported at the end.
+ *
+ * The target is given by host and port, so the same run can be made
+ * against GTM directly, against a GTM proxy, or against a GTM with a
+ * standby attached, to compare the three setups.
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * src/gtm/bench/gtm_bench.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "gtm/gtm_c.h"
+#include "gtm/libpq-fe.h"
+#include "gtm/gtm_client.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Needed by the GTM libraries, which are shared with the servers */
+pthread_key_t	threadinfo_key;
+GTM_ThreadID	TopMostThreadID;
+int			tcp_keepalives_idle;
+int			tcp_keepalives_interval;
+int			tcp_keepalives_count;
+
+typedef enum BenchOp
+{
+	BENCH_BEGIN,
+	BENCH_BEGIN_SNAPSHOT,
+	BENCH_SNAPSHOT,
+	BENCH_NEXTVAL,
+	BENCH_COMMIT,
+	BENCH_OP_COUNT
+} BenchOp;
+
+static const char *op_names[BENCH_OP_COUNT] =
+{
+	"begin", "begin+snapshot", "snapshot", "nextval", "commit"
+};
+
+/*
+ * Latencies are counted in buckets of 1 us below 1 ms, 10 us below 10 ms,
+ * 100 us below 100 ms and 1 ms below 1 s, the last bucket counts the rest.
+ */
+#define LATENCY_RANGES		4
+#define LATENCY_STEPS		900
+#define LATENCY_BUCKETS		(1000 + (LATENCY_RANGES - 1) * LATENCY_STEPS + 1)
+
+typedef struct BenchCounters
+{
+	uint64		count;
+	uint64		errors;
+	uint64		usecs;
+	uint64		max_usecs;
+	uint64		latency[LATENCY_BUCKETS];
+} BenchCounters;
+
+typedef struct BenchThread
+{
+	pthread_t	thread;
+	int			id;
+	uint64		transactions;
+	bool		failed;
+	BenchCounters counters[BENCH_OP_COUNT];
+} BenchThread;
+
+static const char *progname;
+static char *host = "localhost";
+static int	port = 6666;
+static int	clients = 8;
+static int	duration = 10;
+static int	snapshots = 1;
+static int	nextvals = 0;
+static int	seq_range = 1;
+static bool	no_transaction = false;
+static bool	combined_begin = false;
+
+static volatile bool done = false;
+static pthread_barrier_t start_barrier;
+
+static void usage(void);
+static void *bench_thread_main(void *arg);
+static bool bench_open_sequence(void);
+static void bench_report(BenchThread *threads, double elapsed);
+
+
+static uint64
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int
+latency_bucket(uint64 usecs)
+{
+	uint64		step = 1;
+	int			base = 1000;
+	int			range;
+
+	if (usecs < 1000)
+		return usecs;
+	for (range = 1; range < LATENCY_RANGES; range++)
+	{
+		step *= 10;
+		if (usecs < 1000 * step)
+			return base + (usecs - 100 * step) / step;
+		base += LATENCY_STEPS;
+	}
+	return LATENCY_BUCKETS - 1;
+}
+
+/* Upper bound of the latencies counted in a bucket */
+static uint64
+latency_bucket_bound(int bucket)
+{
+	uint64		step = 1;
+	int			range;
+
+	if (bucket < 1000)
+		return bucket + 1;
+	bucket -= 1000;
+	for (range = 1; range < LATENCY_RANGES; range++)
+	{
+		step *= 10;
+		if (bucket < LATENCY_STEPS)
+			return 100 * step + (bucket + 1) * step;
+		bucket -= LATENCY_STEPS;
+	}
+	return 0;		/* overflow bucket, the maximum is reported instead */
+}
+
+static void
+bench_count(BenchCounters *counters, uint64 started, bool ok)
+{
+	uint64		usecs = bench_now() - started;
+
+	if (!ok)
+	{
+		counters->errors++;
+		return;
+	}
+	counters->count++;
+	counters->usecs += usecs;
+	if (usecs > counters->max_usecs)
+		counters->max_usecs = usecs;
+	counters->latency[latency_bucket(usecs)]++;
+}
+
+static void
+bench_sequence_key(GTM_SequenceKeyData *key)
+{
+	static char name[] = "gtm_bench_seq";
+
+	key->gsk_key = name;
+	key->gsk_keylen = sizeof(name);
+	key->gsk_type = GTM_SEQ_FULL_NAME;
+}
+
+static GTM_Conn *
+bench_connect(int id)
+{
+	char		conn_str[256];
+	GTM_Conn   *conn;
+
+	snprintf(conn_str, sizeof(conn_str),
+			 "host=%s port=%d node_name=gtm_bench_%d", host, port, id);
+	conn = PQconnectGTM(conn_str);
+	if (conn == NULL || GTMPQstatus(conn) != CONNECTION_OK)
+	{
+		fprintf(stderr, "%s: could not connect to GTM at %s:%d: %s",
+				progname, host, port,
+				conn ? GTMPQerrorMessage(conn) : "connection failed\n");
+		if (conn)
+			GTMPQfinish(conn);
+		return NULL;
+	}
+	return conn;
+}
+
+/*
+ * Create the sequence used by the nextval requests, if it does not exist
+ * yet from an earlier run.
+ */
+static bool
+bench_open_sequence(void)
+{
+	GTM_SequenceKeyData key;
+	GTM_Sequence result;
+	GTM_Sequence rangemax;
+	GTM_Conn   *conn;
+	bool		ok = true;
+
+	if ((conn = bench_connect(0)) == NULL)
+		return false;
+
+	bench_sequence_key(&key);
+	if (get_next(conn, &key, "gtm_bench", 0, 1, &result, &rangemax) != 0 &&
+		open_sequence(conn, &key, 1, 1, InvalidSequenceValue - 1, 1,
+					  true) != 0)
+	{
+		fprintf(stderr, "%s: could not create sequence: %s",
+				progname, GTMPQerrorMessage(conn));
+		ok = false;
+	}
+	GTMPQfinish(conn);
+	return ok;
+}
+
+static void *
+bench_thread_main(void *arg)
+{
+	BenchThread *me = (BenchThread *) arg;
+	GTM_SequenceKeyData key;
+	GTM_Conn   *conn;
+
+	conn = bench_connect(me->id);
+	pthread_barrier_wait(&start_barrier);
+	if (conn == NULL)
+	{
+		me->failed = true;
+		return NULL;
+	}
+	bench_sequence_key(&key);
+
+	while (!done)
+	{
+		GlobalTransactionId gxid = InvalidGlobalTransactionId;
+		GTM_Timestamp timestamp;
+		uint64		started;
+		int			i;
+
+		if (!no_transaction)
+		{
+			started = bench_now();
+			if (combined_begin)
+			{
+				bench_count(&me->counters[BENCH_BEGIN_SNAPSHOT], started,
+							begin_transaction_snapshot(conn,
+								GTM_ISOLATION_RC, &gxid, &timestamp) != NULL);
+			}
+			else
+			{
+				gxid = begin_transaction(conn, GTM_ISOLATION_RC, &timestamp);
+				bench_count(&me->counters[BENCH_BEGIN], started,
+							GlobalTransactionIdIsValid(gxid));
+			}
+			if (!GlobalTransactionIdIsValid(gxid))
+				goto failed;
+		}
+
+		/* The combined begin already took the first snapshot */
+		for (i = (combined_begin ? 1 : 0); !no_transaction && i < snapshots; i++)
+		{
+			started = bench_now();
+			bench_count(&me->counters[BENCH_SNAPSHOT], started,
+						get_snapshot(conn, gxid, true) != NULL);
+		}
+
+		for (i = 0; i < nextvals; i++)
+		{
+			GTM_Sequence result;
+			GTM_Sequence rangemax;
+
+			started = bench_now();
+			bench_count(&me->counters[BENCH_NEXTVAL], started,
+						get_next(conn, &key, "gtm_bench", me->id, seq_range,
+								 &result, &rangemax) == 0);
+		}
+
+		if (!no_transaction)
+		{
+			started = bench_now();
+			bench_count(&me->counters[BENCH_COMMIT], started,
+						commit_transaction(conn, gxid, 0, NULL) == 0);
+		}
+		me->transactions++;
+
+failed:
+		if (GTMPQstatus(conn) != CONNECTION_OK)
+		{
+			fprintf(stderr, "%s: client %d lost its connection: %s",
+					progname, me->id, GTMPQerrorMessage(conn));
+			me->failed = true;
+			break;
+		}
+	}
+
+	GTMPQfinish(conn);
+	return NULL;
+}
+
+static uint64
+latency_percentile(BenchCounters *counters, double fraction)
+{
+	uint64		target = (uint64) (counters->count * fraction);
+	uint64		seen = 0;
+	int			i;
+
+	for (i = 0; i < LATENCY_BUCKETS - 1; i++)
+	{
+		seen += counters->latency[i];
+		if (seen > target)
+			return Min(latency_bucket_bound(i), counters->max_usecs);
+	}
+	return counters->max_usecs;
+}
+
+static void
+bench_report(BenchThread *threads, double elapsed)
+{
+	BenchCounters *total;
+	uint64		transactions = 0;
+	int			op;
+	int			t;
+	int			i;
+
+	total = (BenchCounters *) calloc(BENCH_OP_COUNT, sizeof(BenchCounters));
+	if (total == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", progname);
+		exit(1);
+	}
+
+	for (t = 0; t < clients; t++)
+	{
+		transactions += threads[t].transactions;
+		for (op = 0; op < BENCH_OP_COUNT; op++)
+		{
+			BenchCounters *c = &threads[t].counters[op];
+
+			total[op].count += c->count;
+			total[op].errors += c->errors;
+			total[op].usecs += c->usecs;
+			total[op].max_usecs = Max(total[op].max_usecs, c->max_usecs);
+			for (i = 0; i < LATENCY_BUCKETS; i++)
+				total[op].latency[i] += c->latency[i];
+		}
+	}
+
+	printf("target: %s:%d\n", host, port);
+	printf("clients: %d\n", clients);
+	printf("duration: %.3f s\n", elapsed);
+	printf("transactions: " UINT64_FORMAT " (%.1f per second)\n",
+		   transactions, transactions / elapsed);
+	printf("\n%-15s %10s %10s %8s %8s %8s %8s %8s %8s %8s\n",
+		   "request", "count", "per sec", "errors", "avg us",
+		   "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+	for (op = 0; op < BENCH_OP_COUNT; op++)
+	{
+		BenchCounters *c = &total[op];
+
+		if (c->count == 0 && c->errors == 0)
+			continue;
+		printf("%-15s %10" INT64_MODIFIER "u %10.1f %8" INT64_MODIFIER "u "
+			   "%8.1f %8" INT64_MODIFIER "u %8" INT64_MODIFIER "u "
+			   "%8" INT64_MODIFIER "u %8" INT64_MODIFIER "u "
+			   "%8" INT64_MODIFIER "u\n",
+			   op_names[op], c->count, c->count / elapsed, c->errors,
+			   c->count ? (double) c->usecs / c->count : 0.0,
+			   latency_percentile(c, 0.5),
+			   latency_percentile(c, 0.9),
+			   latency_percentile(c, 0.99),
+			   latency_percentile(c, 0.999),
+			   c->max_usecs);
+	}
+	free(total);
+}
+
+static void
+usage(void)
+{
+	printf("%s drives a load of GTM requests and reports their throughput and latency.\n\n", progname);
+	printf("Usage:\n  %s [OPTION]...\n\n", progname);
+	printf("Options:\n");
+	printf("  -h HOST     GTM or GTM proxy host (default: localhost)\n");
+	printf("  -p PORT     GTM or GTM proxy port (default: 6666)\n");
+	printf("  -c CLIENTS  number of client threads (default: 8)\n");
+	printf("  -T SECONDS  duration of the run (default: 10)\n");
+	printf("  -s COUNT    snapshots per transaction (default: 1)\n");
+	printf("  -n COUNT    sequence values fetched per transaction (default: 0)\n");
+	printf("  -r RANGE    range of sequence values fetched at once (default: 1)\n");
+	printf("  -b          begin the transactions with their first snapshot\n");
+	printf("  -N          no transactions, only fetch sequence values\n");
+	printf("  -?          show this help, then exit\n");
+	printf("\nTo measure a proxy or a standby, point -h and -p to the proxy, or to\n"
+		   "a GTM started with a standby connected.\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	BenchThread *threads;
+	uint64		started;
+	int			c;
+	int			t;
+	bool		failed = false;
+
+	progname = argv[0];
+
+	while ((c = getopt(argc, argv, "h:p:c:T:s:n:r:bN?")) != -1)
+	{
+		switch (c)
+		{
+			case 'h':
+				host = optarg;
+				break;
+			case 'p':
+				port = atoi(optarg);
+				break;
+			case 'c':
+				clients = atoi(optarg);
+				break;
+			case 'T':
+				duration = atoi(optarg);
+				break;
+			case 's':
+				snapshots = atoi(optarg);
+				break;
+			case 'n':
+				nextvals = atoi(optarg);
+				break;
+			case 'r':
+				seq_range = atoi(optarg);
+				break;
+			case 'b':
+				combined_begin = true;
+				break;
+			case 'N':
+				no_transaction = true;
+				break;
+			default:
+				usage();
+				exit(c == '?' ? 0 : 1);
+		}
+	}
+
+	if (clients <= 0 || duration <= 0 || snapshots < 0 || nextvals < 0 ||
+		seq_range <= 0)
+	{
+		fprintf(stderr, "%s: invalid option value\n", progname);
+		exit(1);
+	}
+	if (no_transaction && nextvals == 0)
+	{
+		fprintf(stderr, "%s: -N requires -n\n", progname);
+		exit(1);
+	}
+	if (nextvals > 0 && !bench_open_sequence())
+		exit(1);
+
+	threads = (BenchThread *) calloc(clients, sizeof(BenchThread));
+	if (threads == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", progname);
+		exit(1);
+	}
+	pthread_barrier_init(&start_barrier, NULL, clients + 1);
+
+	for (t = 0; t < clients; t++)
+	{
+		threads[t].id = t + 1;
+		if (pthread_create(&threads[t].thread, NULL, bench_thread_main,
+						   &threads[t]) != 0)
+		{
+			fprintf(stderr, "%s: could not create thread\n", progname);
+			exit(1);
+		}
+	}
+
+	/* All the clients are connected, start the clock */
+	pthread_barrier_wait(&start_barrier);
+	started = bench_now();
+	sleep(duration);
+	done = true;
+
+	for (t = 0; t < clients; t++)
+	{
+		pthread_join(threads[t].thread, NULL);
+		failed |= threads[t].failed;
+	}
+
+	bench_report(threads, (bench_now() - started) / 1000000.0);
+	free(threads);
+
+	return failed ? 1 : 0;
+}
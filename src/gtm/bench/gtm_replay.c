@@ -0,0 +1,519 @@
+/*-------------------------------------------------------------------------
+ *
+ * gtm_replay --- replay a trace of GTM requests
+ *
+ * Reads a trace written by GTM or GTM proxy with trace_file set, and sends
+ * the requests it holds again to a GTM or a GTM proxy, at the times they
+ * were received or at a multiple of that speed. Each traced client gets a
+ * connection of its own, the clients being spread over a number of threads.
+ * The latency of each request type is reported next to the one recorded,
+ * so that a captured load can be used to compare GTM or proxy changes.
+ *
+ * The requests are sent as recorded, so those naming a transaction or a
+ * sequence of the traced run fail unless the target starts from the same
+ * state, and are counted as errors. Replication traffic from a standby
+ * connection is not replayed.
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * src/gtm/bench/gtm_replay.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "gtm/gtm_c.h"
+#include "gtm/libpq-fe.h"
+#include "gtm/libpq-int.h"
+#include "gtm/gtm_client.h"
+#include "gtm/gtm_msg.h"
+#include "gtm/gtm_trace.h"
+#include "gtm/gtm_utils.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Needed by the GTM libraries, which are shared with the servers */
+pthread_key_t	threadinfo_key;
+GTM_ThreadID	TopMostThreadID;
+int			tcp_keepalives_idle;
+int			tcp_keepalives_interval;
+int			tcp_keepalives_count;
+
+typedef struct ReplayRequest
+{
+	GTM_TraceRecord record;
+	char	   *data;			/* request, without any proxy header */
+	uint32		len;
+	int			session;		/* index of the traced client */
+} ReplayRequest;
+
+typedef struct ReplayCounters
+{
+	uint64		count;
+	uint64		errors;
+	uint64		usecs;
+	uint64		max_usecs;
+	uint64		recorded_usecs;
+} ReplayCounters;
+
+typedef struct ReplayThread
+{
+	pthread_t	thread;
+	int			id;
+	uint64		max_lag;		/* furthest behind the schedule, usecs */
+	bool		failed;
+	ReplayCounters counters[MSG_TYPE_COUNT];
+} ReplayThread;
+
+static const char *progname;
+static char *host = "localhost";
+static int	port = 6666;
+static int	nthreads = 8;
+static double speed = 1.0;
+static bool	trace_proxy;
+
+static ReplayRequest *requests;
+static int	nrequests;
+static int	nsessions;
+static uint64 replay_start;
+
+static pthread_barrier_t start_barrier;
+
+static void usage(void);
+static void *replay_thread_main(void *arg);
+static void replay_report(ReplayThread *threads, double elapsed);
+
+
+static uint64
+replay_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Whether the client of the record was a standby or another GTM, whose
+ * replication traffic means nothing to the target.
+ */
+static bool
+replay_skip(GTM_TraceRecord *record)
+{
+	return record->tr_remote_type == GTM_NODE_GTM;
+}
+
+/*
+ * Read the trace and number its clients. A client is a connection of the
+ * traced server, or a backend behind a proxy connection.
+ */
+static bool
+replay_load(const char *filename)
+{
+	GTM_TraceFileHeader header;
+	struct
+	{
+		uint32		client;
+		uint32		conid;
+	}		   *keys = NULL;
+	int			nkeys = 0;
+	int			maxrequests = 1024;
+	FILE	   *file;
+
+	if ((file = fopen(filename, "r")) == NULL)
+	{
+		fprintf(stderr, "%s: could not open \"%s\": %s\n",
+				progname, filename, strerror(errno));
+		return false;
+	}
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+		header.th_magic != GTM_TRACE_MAGIC)
+	{
+		fprintf(stderr, "%s: \"%s\" is not a GTM trace\n", progname, filename);
+		fclose(file);
+		return false;
+	}
+	if (header.th_version != GTM_TRACE_VERSION)
+	{
+		fprintf(stderr, "%s: \"%s\" has unsupported trace version %u\n",
+				progname, filename, header.th_version);
+		fclose(file);
+		return false;
+	}
+	trace_proxy = header.th_proxy != 0;
+
+	requests = (ReplayRequest *) malloc(sizeof(ReplayRequest) * maxrequests);
+	keys = malloc(sizeof(*keys) * maxrequests);
+	if (requests == NULL || keys == NULL)
+		goto oom;
+
+	for (;;)
+	{
+		GTM_TraceRecord record;
+		ReplayRequest *req;
+		char	   *data;
+		uint32		skip = 0;
+		int			k;
+
+		/* A trace cut short by a crash ends with a partial record */
+		if (fread(&record, sizeof(GTM_TraceRecord), 1, file) != 1)
+			break;
+		if ((data = malloc(Max(record.tr_len, 1))) == NULL)
+			goto oom;
+		if (fread(data, 1, record.tr_len, file) != record.tr_len)
+		{
+			free(data);
+			break;
+		}
+
+		if (replay_skip(&record))
+		{
+			free(data);
+			continue;
+		}
+		if (record.tr_flags & GTM_TRACE_PROXY_HEADER)
+			skip = sizeof(GTM_ProxyMsgHeader);
+		if (record.tr_len < skip + sizeof(GTM_MessageType) ||
+			record.tr_mtype < 0 || record.tr_mtype >= MSG_TYPE_COUNT)
+		{
+			fprintf(stderr, "%s: \"%s\" is corrupted\n", progname, filename);
+			fclose(file);
+			return false;
+		}
+
+		if (nrequests == maxrequests)
+		{
+			maxrequests *= 2;
+			requests = (ReplayRequest *)
+				realloc(requests, sizeof(ReplayRequest) * maxrequests);
+			keys = realloc(keys, sizeof(*keys) * maxrequests);
+			if (requests == NULL || keys == NULL)
+				goto oom;
+		}
+
+		/* Few clients and many requests, a linear search does */
+		for (k = nkeys - 1; k >= 0; k--)
+		{
+			if (keys[k].client == record.tr_client &&
+				keys[k].conid == record.tr_conid)
+				break;
+		}
+		if (k < 0)
+		{
+			k = nkeys++;
+			keys[k].client = record.tr_client;
+			keys[k].conid = record.tr_conid;
+		}
+
+		req = &requests[nrequests++];
+		req->record = record;
+		req->data = data + skip;
+		req->len = record.tr_len - skip;
+		req->session = k;
+	}
+
+	fclose(file);
+	free(keys);
+	nsessions = nkeys;
+	return true;
+
+oom:
+	fprintf(stderr, "%s: out of memory\n", progname);
+	exit(1);
+}
+
+static GTM_Conn *
+replay_connect(int session)
+{
+	char		conn_str[256];
+	GTM_Conn   *conn;
+
+	snprintf(conn_str, sizeof(conn_str),
+			 "host=%s port=%d node_name=gtm_replay_%d", host, port, session);
+	conn = PQconnectGTM(conn_str);
+	if (conn == NULL || GTMPQstatus(conn) != CONNECTION_OK)
+	{
+		fprintf(stderr, "%s: could not connect to GTM at %s:%d: %s",
+				progname, host, port,
+				conn ? GTMPQerrorMessage(conn) : "connection failed\n");
+		if (conn)
+			GTMPQfinish(conn);
+		return NULL;
+	}
+	return conn;
+}
+
+/*
+ * Send a request as recorded and wait for its reply, if it has one.
+ * Returns false if it failed.
+ */
+static bool
+replay_request(GTM_Conn *conn, ReplayRequest *req)
+{
+	GTM_TraceRecord *record = &req->record;
+	GTM_Result *res;
+
+	if (gtmpqPutMsgStart('C', true, conn) ||
+		gtmpqPutnchar(req->data, req->len, conn) ||
+		gtmpqPutMsgEnd(conn) ||
+		gtmpqFlush(conn))
+		return false;
+
+	/* The server recorded that it sent nothing back */
+	if ((record->tr_flags & GTM_TRACE_REPLY_KNOWN) && record->tr_reply_len == 0)
+		return true;
+
+	res = GTMPQgetResult(conn);
+	return res != NULL && res->gr_status == GTM_RESULT_OK;
+}
+
+static void *
+replay_thread_main(void *arg)
+{
+	ReplayThread *me = (ReplayThread *) arg;
+	GTM_Conn  **conns;
+	int			i;
+
+	conns = (GTM_Conn **) calloc(nsessions, sizeof(GTM_Conn *));
+	if (conns == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", progname);
+		exit(1);
+	}
+
+	/* Connect the clients of this thread before the clock starts */
+	for (i = me->id; i < nsessions; i += nthreads)
+	{
+		if ((conns[i] = replay_connect(i)) == NULL)
+			me->failed = true;
+	}
+	pthread_barrier_wait(&start_barrier);
+	/* The main thread sets the start time in between */
+	pthread_barrier_wait(&start_barrier);
+
+	for (i = 0; i < nrequests && !me->failed; i++)
+	{
+		ReplayRequest *req = &requests[i];
+		ReplayCounters *counters;
+		GTM_Conn   *conn;
+		uint64		started;
+		uint64		usecs;
+
+		if (req->session % nthreads != me->id)
+			continue;
+		conn = conns[req->session];
+
+		/* Keep to the schedule, or report how far behind it we are */
+		if (speed > 0)
+		{
+			uint64		due = replay_start +
+				(uint64) ((req->record.tr_time - requests[0].record.tr_time) /
+						  speed);
+			uint64		now = replay_now();
+
+			if (due > now)
+				usleep(due - now);
+			else if (now - due > me->max_lag)
+				me->max_lag = now - due;
+		}
+
+		counters = &me->counters[req->record.tr_mtype];
+		started = replay_now();
+		if (!replay_request(conn, req))
+		{
+			counters->errors++;
+			if (GTMPQstatus(conn) != CONNECTION_OK)
+			{
+				fprintf(stderr, "%s: client %d lost its connection: %s",
+						progname, req->session, GTMPQerrorMessage(conn));
+				me->failed = true;
+			}
+			continue;
+		}
+		usecs = replay_now() - started;
+		counters->count++;
+		counters->usecs += usecs;
+		counters->recorded_usecs += req->record.tr_elapsed;
+		if (usecs > counters->max_usecs)
+			counters->max_usecs = usecs;
+	}
+
+	for (i = me->id; i < nsessions; i += nthreads)
+	{
+		if (conns[i] != NULL)
+			GTMPQfinish(conns[i]);
+	}
+	free(conns);
+	return NULL;
+}
+
+static void
+replay_report(ReplayThread *threads, double elapsed)
+{
+	ReplayCounters *total;
+	uint64		count = 0;
+	uint64		errors = 0;
+	uint64		max_lag = 0;
+	double		recorded;
+	int			mtype;
+	int			t;
+
+	total = (ReplayCounters *) calloc(MSG_TYPE_COUNT, sizeof(ReplayCounters));
+	if (total == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", progname);
+		exit(1);
+	}
+
+	for (t = 0; t < nthreads; t++)
+	{
+		max_lag = Max(max_lag, threads[t].max_lag);
+		for (mtype = 0; mtype < MSG_TYPE_COUNT; mtype++)
+		{
+			ReplayCounters *c = &threads[t].counters[mtype];
+
+			total[mtype].count += c->count;
+			total[mtype].errors += c->errors;
+			total[mtype].usecs += c->usecs;
+			total[mtype].recorded_usecs += c->recorded_usecs;
+			total[mtype].max_usecs = Max(total[mtype].max_usecs, c->max_usecs);
+			count += c->count;
+			errors += c->errors;
+		}
+	}
+	recorded = nrequests > 0 ?
+		(requests[nrequests - 1].record.tr_time -
+		 requests[0].record.tr_time) / 1000000.0 : 0.0;
+
+	printf("target: %s:%d\n", host, port);
+	printf("trace: %d requests of %d clients, recorded at the %s over %.3f s\n",
+		   nrequests, nsessions, trace_proxy ? "proxy" : "GTM", recorded);
+	if (speed > 0)
+		printf("speed: %.2f, most behind schedule: %.3f ms\n",
+			   speed, max_lag / 1000.0);
+	else
+		printf("speed: as fast as possible\n");
+	printf("duration: %.3f s\n", elapsed);
+	printf("requests: " UINT64_FORMAT " (%.1f per second), " UINT64_FORMAT
+		   " errors\n", count, count / elapsed, errors);
+	printf("\n%-40s %10s %8s %10s %10s %12s\n",
+		   "request", "count", "errors", "avg us", "max us", "recorded us");
+	for (mtype = 0; mtype < MSG_TYPE_COUNT; mtype++)
+	{
+		ReplayCounters *c = &total[mtype];
+
+		if (c->count == 0 && c->errors == 0)
+			continue;
+		printf("%-40s %10" INT64_MODIFIER "u %8" INT64_MODIFIER "u "
+			   "%10.1f %10" INT64_MODIFIER "u %12.1f\n",
+			   gtm_util_message_name(mtype), c->count, c->errors,
+			   c->count ? (double) c->usecs / c->count : 0.0,
+			   c->max_usecs,
+			   c->count ? (double) c->recorded_usecs / c->count : 0.0);
+	}
+	if (trace_proxy)
+		printf("\nThe recorded times of a proxy trace do not include the wait for GTM.\n");
+	free(total);
+}
+
+static void
+usage(void)
+{
+	printf("%s replays a trace of GTM requests and reports their latency.\n\n", progname);
+	printf("Usage:\n  %s [OPTION]... TRACEFILE\n\n", progname);
+	printf("Options:\n");
+	printf("  -h HOST     GTM or GTM proxy host (default: localhost)\n");
+	printf("  -p PORT     GTM or GTM proxy port (default: 6666)\n");
+	printf("  -c THREADS  number of threads sending the requests (default: 8)\n");
+	printf("  -s SPEED    replay at SPEED times the recorded rate, 0 for as fast\n"
+		   "              as possible (default: 1)\n");
+	printf("  -?          show this help, then exit\n");
+	printf("\nThe trace is written by GTM or GTM proxy when trace_file is set.\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	ReplayThread *threads;
+	uint64		started;
+	int			c;
+	int			t;
+	bool		failed = false;
+
+	progname = argv[0];
+
+	while ((c = getopt(argc, argv, "h:p:c:s:?")) != -1)
+	{
+		switch (c)
+		{
+			case 'h':
+				host = optarg;
+				break;
+			case 'p':
+				port = atoi(optarg);
+				break;
+			case 'c':
+				nthreads = atoi(optarg);
+				break;
+			case 's':
+				speed = atof(optarg);
+				break;
+			default:
+				usage();
+				exit(c == '?' ? 0 : 1);
+		}
+	}
+
+	if (optind != argc - 1)
+	{
+		fprintf(stderr, "%s: a trace file must be given\n", progname);
+		fprintf(stderr, "Try \"%s -?\" for more information.\n", progname);
+		exit(1);
+	}
+	if (nthreads <= 0 || speed < 0)
+	{
+		fprintf(stderr, "%s: invalid option value\n", progname);
+		exit(1);
+	}
+	if (!replay_load(argv[optind]))
+		exit(1);
+	if (nthreads > nsessions)
+		nthreads = Max(nsessions, 1);
+
+	threads = (ReplayThread *) calloc(nthreads, sizeof(ReplayThread));
+	if (threads == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", progname);
+		exit(1);
+	}
+	pthread_barrier_init(&start_barrier, NULL, nthreads + 1);
+
+	for (t = 0; t < nthreads; t++)
+	{
+		threads[t].id = t;
+		if (pthread_create(&threads[t].thread, NULL, replay_thread_main,
+						   &threads[t]) != 0)
+		{
+			fprintf(stderr, "%s: could not create thread\n", progname);
+			exit(1);
+		}
+	}
+
+	/* All the clients are connected, start the clock */
+	pthread_barrier_wait(&start_barrier);
+	started = replay_now();
+	replay_start = started;
+	pthread_barrier_wait(&start_barrier);
+
+	for (t = 0; t < nthreads; t++)
+	{
+		pthread_join(threads[t].thread, NULL);
+		failed |= threads[t].failed;
+	}
+
+	replay_report(threads, (replay_now() - started) / 1000000.0);
+	free(threads);
+
+	return failed ? 1 : 0;
+}
@@ -920,6 +920,10 @@ freeGTM_Conn(GTM_Conn *conn)
 		/* Free last snapshot if defined */
 		if (conn->result->gr_snapshot.sn_xip)
 			free(conn->result->gr_snapshot.sn_xip);
+		if (conn->result->gr_csnlog_gxids)
+			free(conn->result->gr_csnlog_gxids);
+		if (conn->result->gr_stats)
+			free(conn->result->gr_stats);
 
 		/* Depending on result type there could be allocated data */
 		switch (conn->result->gr_type)
@@ -977,7 +981,7 @@ closeGTM_Conn(GTM_Conn *conn)
 		 */
 		gtmpqPutMsgStart('X', true, conn);
 		gtmpqPutMsgEnd(conn);
-		gtmpqFlush(conn);
+		gtmpqFlushDeferred(conn);
 	}
 
 	/*
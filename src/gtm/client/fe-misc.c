@@ -47,6 +47,8 @@
 #include "gtm/libpq-fe.h"
 #include "gtm/libpq-int.h"
 
+GTMPQwaitHook GTMPQwait_hook = NULL;
+
 static int	gtmpqPutMsgBytes(const void *buf, size_t len, GTM_Conn *conn);
 static int	gtmpqSendSome(GTM_Conn *conn, int len);
 static int gtmpqSocketCheck(GTM_Conn *conn, int forRead, int forWrite,
@@ -844,6 +846,23 @@ gtmpqFlush(GTM_Conn *conn)
 	if (conn->Pfdebug)
 		fflush(conn->Pfdebug);
 
+	if (conn->outCount > 0 && !conn->deferFlush)
+		return gtmpqSendSome(conn, conn->outCount);
+
+	return 0;
+}
+
+/*
+ * gtmpqFlushDeferred: send the data waiting in the output buffer even if
+ * the connection defers flushes.
+ *
+ * A connection with deferFlush set only sends its output when the buffer
+ * fills up, when a reply is awaited or when this is called, so messages
+ * which don't need a reply go out in batches.
+ */
+int
+gtmpqFlushDeferred(GTM_Conn *conn)
+{
 	if (conn->outCount > 0)
 		return gtmpqSendSome(conn, conn->outCount);
 
@@ -881,7 +900,16 @@ gtmpqWaitTimed(int forRead, int forWrite, GTM_Conn *conn, time_t finish_time)
 {
 	int			result;
 
+	/* The request we are waiting a reply for may not have been sent yet */
+	if (forRead && conn->deferFlush && conn->outCount > 0 &&
+		gtmpqFlushDeferred(conn) < 0)
+		return EOF;
+
+	if (GTMPQwait_hook)
+		GTMPQwait_hook(1);
 	result = gtmpqSocketCheck(conn, forRead, forWrite, finish_time);
+	if (GTMPQwait_hook)
+		GTMPQwait_hook(0);
 
 	if (result < 0)
 		return EOF;				/* errorMessage is already set */
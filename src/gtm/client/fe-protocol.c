@@ -294,6 +294,64 @@ GTMPQgetResult(GTM_Conn *conn)
 	return res;
 }
 
+/*
+ * gtmpqResultBuffered
+ *	  Is a complete message waiting in the input buffer? Several replies
+ *	  may arrive in a single read when requests are pipelined, so waiting
+ *	  on the socket is only needed when this returns false.
+ */
+bool
+gtmpqResultBuffered(GTM_Conn *conn)
+{
+	uint32		msgLength;
+
+	if (conn->inEnd - conn->inStart < 5)
+		return false;
+
+	memcpy(&msgLength, conn->inBuffer + conn->inStart + 1, 4);
+	msgLength = ntohl(msgLength);
+
+	/* Let pqParseInput deal with a broken length */
+	if (msgLength < 4)
+		return true;
+
+	return conn->inEnd - conn->inStart >= 1 + (int) msgLength;
+}
+
+/*
+ * GTMPQisBusy
+ *	  Check without blocking whether the reply to the oldest request sent
+ *	  on the connection can be received. Data waiting to be sent is sent
+ *	  and the data available on the socket is read.
+ *
+ *	  Returns 1 if the reply has not arrived yet, 0 if GTMPQgetResult can
+ *	  parse it without waiting and -1 if the connection failed.
+ */
+int
+GTMPQisBusy(GTM_Conn *conn)
+{
+	if (!conn)
+		return -1;
+
+	if (gtmpqFlushDeferred(conn) < 0)
+		return -1;
+
+	if (gtmpqResultBuffered(conn))
+		return 0;
+
+	switch (gtmpqReadReady(conn))
+	{
+		case 0:
+			return 1;
+		case 1:
+			if (gtmpqReadData(conn) < 0)
+				return -1;
+			return gtmpqResultBuffered(conn) ? 0 : 1;
+		default:
+			return -1;
+	}
+}
+
 /*
  * return 0 if parsing command is totally completed.
  * return 1 if it needs to be read continuously.
@@ -301,9 +359,8 @@ GTMPQgetResult(GTM_Conn *conn)
 static int
 gtmpqParseSuccess(GTM_Conn *conn, GTM_Result *result)
 {
-	int xcnt, xsize;
+	size_t consumed;
 	int i;
-	GlobalTransactionId *xip = NULL;
 
 	result->gr_status = GTM_RESULT_OK;
 
@@ -469,22 +526,23 @@ gtmpqParseSuccess(GTM_Conn *conn, GTM_Result *result)
 			break;
 
 		case SNAPSHOT_GXID_GET_RESULT:
-			if (gtmpqGetnchar((char *)&result->gr_resdata.grd_txn_snap_multi.txnhandle,
-						   sizeof (GTM_TransactionHandle), conn))
+		case SNAPSHOT_GET_RESULT:
+			if (gtmpqGetnchar((char *)&result->gr_resdata.grd_txn_snap_multi.gxid,
+						   sizeof (GlobalTransactionId), conn))
 			{
 				result->gr_status = GTM_RESULT_ERROR;
 				break;
 			}
-			/* Fall through */
-		case SNAPSHOT_GET_RESULT:
-			if (gtmpqGetnchar((char *)&result->gr_resdata.grd_txn_snap_multi.gxid,
-						   sizeof (GlobalTransactionId), conn))
+			if (result->gr_type == SNAPSHOT_GXID_GET_RESULT &&
+				gtmpqGetnchar((char *)&result->gr_resdata.grd_txn_snap_multi.timestamp,
+						   sizeof (GTM_Timestamp), conn))
 			{
 				result->gr_status = GTM_RESULT_ERROR;
 				break;
 			}
 			/* Fall through */
 		case SNAPSHOT_GET_MULTI_RESULT:
+		case SNAPSHOT_GET_STANDBY_RESULT:
 			if (gtmpqGetnchar((char *)&result->gr_resdata.grd_txn_snap_multi.txn_count,
 						   sizeof (int), conn))
 			{
@@ -498,58 +556,107 @@ gtmpqParseSuccess(GTM_Conn *conn, GTM_Result *result)
 				break;
 			}
 
-			if (gtmpqGetnchar((char *)&result->gr_snapshot.sn_xmin,
-						   sizeof (GlobalTransactionId), conn))
+			/* Allocated once, for as many GXIDs as GTM can have open */
+			if (result->gr_snapshot.sn_xip == NULL)
 			{
-				result->gr_status = GTM_RESULT_ERROR;
-				break;
+				result->gr_snapshot.sn_xip = (GlobalTransactionId *)
+					malloc(sizeof(GlobalTransactionId) * GTM_MAX_GLOBAL_TRANSACTIONS);
+				if (result->gr_snapshot.sn_xip == NULL)
+				{
+					result->gr_status = GTM_RESULT_ERROR;
+					break;
+				}
+				result->gr_xip_size = GTM_MAX_GLOBAL_TRANSACTIONS;
 			}
 
-			if (gtmpqGetnchar((char *)&result->gr_snapshot.sn_xmax,
-						   sizeof (GlobalTransactionId), conn))
+			/* The snapshot ends the message, decode it in place */
+			consumed = gtm_deserialize_snapshot_wire(&result->gr_snapshot,
+							result->gr_xip_size,
+							conn->inBuffer + conn->inCursor,
+							conn->inEnd - conn->inCursor);
+			if (consumed == 0)
 			{
 				result->gr_status = GTM_RESULT_ERROR;
 				break;
 			}
+			conn->inCursor += consumed;
+			break;
 
-			if (gtmpqGetnchar((char *)&result->gr_snapshot.sn_recent_global_xmin,
-						   sizeof (GlobalTransactionId), conn))
+		case SNAPSHOT_CSN_GET_RESULT:
+			if (gtmpqGetnchar((char *)&result->gr_resdata.grd_csn_snapshot,
+						   sizeof (GTM_CSNSnapshotData), conn))
+				result->gr_status = GTM_RESULT_ERROR;
+			break;
+
+		case CSNLOG_GET_RESULT:
+			if (gtmpqGetnchar((char *)&result->gr_resdata.grd_csnlog.epoch,
+						   sizeof (uint32), conn) ||
+				gtmpqGetnchar((char *)&result->gr_resdata.grd_csnlog.first,
+						   sizeof (GTM_CSN), conn) ||
+				gtmpqGetInt(&result->gr_resdata.grd_csnlog.count,
+						   sizeof (int32), conn) ||
+				result->gr_resdata.grd_csnlog.count < 0 ||
+				result->gr_resdata.grd_csnlog.count > GTM_CSNLOG_MAX_FETCH)
 			{
 				result->gr_status = GTM_RESULT_ERROR;
 				break;
 			}
 
-
-			if (gtmpqGetInt((int *)&result->gr_snapshot.sn_xcnt,
-						   sizeof (int32), conn))
+			/* Allocated once, like the xip array of the snapshots */
+			if (result->gr_csnlog_gxids == NULL)
 			{
-				result->gr_status = GTM_RESULT_ERROR;
-				break;
+				result->gr_csnlog_gxids = (GlobalTransactionId *)
+					malloc(sizeof(GlobalTransactionId) * GTM_CSNLOG_MAX_FETCH);
+				if (result->gr_csnlog_gxids == NULL)
+				{
+					result->gr_status = GTM_RESULT_ERROR;
+					break;
+				}
 			}
 
-			xsize = result->gr_xip_size;
-			xcnt = result->gr_snapshot.sn_xcnt;
-			xip = result->gr_snapshot.sn_xip;
+			if (gtmpqGetnchar((char *)result->gr_csnlog_gxids,
+						   sizeof (GlobalTransactionId) * result->gr_resdata.grd_csnlog.count,
+						   conn))
+				result->gr_status = GTM_RESULT_ERROR;
+			break;
 
-			if (!xip || xcnt > xsize)
-			{
-				if (!xip)
-					xip = (GlobalTransactionId *) malloc(sizeof(GlobalTransactionId) *
-														 GTM_MAX_GLOBAL_TRANSACTIONS);
-				else
-					xip = (GlobalTransactionId *) realloc(xip,
-									  sizeof(GlobalTransactionId) * xcnt);
+		case GET_TIMESTAMP_RESULT:
+			if (gtmpqGetnchar((char *)&result->gr_resdata.grd_timestamp,
+						   sizeof (GTM_Timestamp), conn))
+				result->gr_status = GTM_RESULT_ERROR;
+			break;
 
-				result->gr_snapshot.sn_xip = xip;
-				result->gr_xip_size = xcnt;
-			}
+		case GET_GLOBAL_XMIN_RESULT:
+			if (gtmpqGetnchar((char *)&result->gr_resdata.grd_gxid,
+						   sizeof (GlobalTransactionId), conn))
+				result->gr_status = GTM_RESULT_ERROR;
+			break;
 
-			if (gtmpqGetnchar((char *)xip, sizeof(GlobalTransactionId) * xcnt, conn))
+		case GET_STATS_RESULT:
+			if (gtmpqGetInt(&result->gr_resdata.grd_stats_count,
+						   sizeof (int32), conn) ||
+				result->gr_resdata.grd_stats_count < 0 ||
+				result->gr_resdata.grd_stats_count > GTM_STATS_MAX_ENTRIES)
 			{
 				result->gr_status = GTM_RESULT_ERROR;
 				break;
 			}
 
+			if (result->gr_stats == NULL)
+			{
+				result->gr_stats = (GTM_MessageStats *)
+					malloc(sizeof (GTM_MessageStats) * GTM_STATS_MAX_ENTRIES);
+				if (result->gr_stats == NULL)
+				{
+					result->gr_status = GTM_RESULT_ERROR;
+					break;
+				}
+			}
+
+			if (gtmpqGetnchar((char *)result->gr_stats,
+						   sizeof (GTM_MessageStats) * result->gr_resdata.grd_stats_count,
+						   conn))
+				result->gr_status = GTM_RESULT_ERROR;
 			break;
 
 		case SEQUENCE_INIT_RESULT:
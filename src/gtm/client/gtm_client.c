@@ -80,6 +80,10 @@ static int node_register_worker(GTM_Conn *conn, GTM_PGXCNodeType type, const cha
 								char *node_name, char *datafolder, GTM_PGXCNodeStatus status, bool is_backup);
 static int node_unregister_worker(GTM_Conn *conn, GTM_PGXCNodeType type, const char * node_name, bool is_backup);
 static int report_barrier_internal(GTM_Conn *conn, char *barrier_id, bool is_backup);
+static int send_get_next_internal(GTM_Conn *conn, GTM_SequenceKey key,
+				  char *coord_name, int coord_procid, GTM_Sequence range,
+				  bool is_backup);
+static GTM_Result *receive_result(GTM_Conn *conn);
 /*
  * Make an empty result if old one is null.
  */
@@ -99,6 +103,28 @@ makeEmptyResultIfIsNull(GTM_Result *oldres)
 	return res;
 }
 
+/*
+ * Wait for the reply to the oldest request sent on the connection and parse
+ * it. The replies to pipelined requests may already be in the input buffer,
+ * so the socket is only waited on when no complete message is.
+ *
+ * Returns NULL on timeout or connection failure.
+ */
+static GTM_Result *
+receive_result(GTM_Conn *conn)
+{
+	time_t finish_time = time(NULL) + CLIENT_GTM_TIMEOUT;
+
+	while (!gtmpqResultBuffered(conn))
+	{
+		if (gtmpqWaitTimed(true, false, conn, finish_time) ||
+			gtmpqReadData(conn) < 0)
+			return NULL;
+	}
+
+	return GTMPQgetResult(conn);
+}
+
 /*
  * Connection Management API
  */
@@ -476,10 +502,31 @@ send_failed:
 
 GlobalTransactionId
 begin_transaction(GTM_Conn *conn, GTM_IsolationLevel isolevel, GTM_Timestamp *timestamp)
+{
+	if (send_begin_transaction(conn, isolevel))
+		return InvalidGlobalTransactionId;
+
+	return receive_begin_transaction(conn, timestamp);
+}
+
+/*
+ * Asynchronous Transaction Management API
+ *
+ * The send_* functions send a request without waiting for its reply, the
+ * matching receive_* functions wait for the reply and parse it. Replies
+ * come back in the order the requests were sent, so several requests may
+ * be in flight on a connection to GTM and GTMPQisBusy() tells whether the
+ * oldest reply can be received without blocking. A GTM proxy reads the
+ * next request of a connection only once it replied to the previous one,
+ * so only one request may be in flight through a proxy.
+ *
+ * The send_* functions return 0 on success. On failure the connection
+ * result is marked as GTM_RESULT_COMM_ERROR and no reply must be received.
+ */
+int
+send_begin_transaction(GTM_Conn *conn, GTM_IsolationLevel isolevel)
 {
 	bool txn_read_only = false;
-	GTM_Result *res = NULL;
-	time_t finish_time;
 
 	 /* Start the message. */
 	if (gtmpqPutMsgStart('C', true, conn) ||
@@ -496,13 +543,25 @@ begin_transaction(GTM_Conn *conn, GTM_IsolationLevel isolevel, GTM_Timestamp *ti
 	if (gtmpqFlush(conn))
 		goto send_failed;
 
-	finish_time = time(NULL) + CLIENT_GTM_TIMEOUT;
-	if (gtmpqWaitTimed(true, false, conn, finish_time) ||
-		gtmpqReadData(conn) < 0)
-		goto receive_failed;
+	return 0;
 
-	if ((res = GTMPQgetResult(conn)) == NULL)
-		goto receive_failed;
+send_failed:
+	conn->result = makeEmptyResultIfIsNull(conn->result);
+	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+	return -1;
+}
+
+GlobalTransactionId
+receive_begin_transaction(GTM_Conn *conn, GTM_Timestamp *timestamp)
+{
+	GTM_Result *res;
+
+	if ((res = receive_result(conn)) == NULL)
+	{
+		conn->result = makeEmptyResultIfIsNull(conn->result);
+		conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+		return InvalidGlobalTransactionId;
+	}
 
 	if (res->gr_status == GTM_RESULT_OK)
 	{
@@ -513,12 +572,6 @@ begin_transaction(GTM_Conn *conn, GTM_IsolationLevel isolevel, GTM_Timestamp *ti
 	}
 	else
 		return InvalidGlobalTransactionId;
-
-receive_failed:
-send_failed:
-	conn->result = makeEmptyResultIfIsNull(conn->result);
-	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
-	return InvalidGlobalTransactionId;
 }
 
 
@@ -606,19 +659,65 @@ commit_transaction(GTM_Conn *conn, GlobalTransactionId gxid,
 {
 	if (waited_xid_count == 0)
 	{
-		int txn_count_out;
-		int status_out;
-		int status;
-		status = commit_transaction_multi(conn, 1, &gxid, &txn_count_out,
-				&status_out);
-		Assert(txn_count_out == 1);
-		return status;
+		if (send_commit_transaction(conn, gxid))
+			return -1;
+		return receive_commit_transaction(conn);
 	}
 	else
 		return commit_transaction_internal(conn, gxid, waited_xid_count,
 				waited_xids, false);
 }
 
+/*
+ * Send the commit of a transaction which did not wait for other ones, GTM
+ * can not delay it.
+ */
+int
+send_commit_transaction(GTM_Conn *conn, GlobalTransactionId gxid)
+{
+	int txn_count = 1;
+
+	/* Start the message. */
+	if (gtmpqPutMsgStart('C', true, conn) ||
+		gtmpqPutInt(MSG_TXN_COMMIT_MULTI, sizeof (GTM_MessageType), conn) ||
+		gtmpqPutInt(txn_count, sizeof(int), conn) ||
+		gtmpqPutnchar((char *)&gxid, sizeof (GlobalTransactionId), conn))
+		goto send_failed;
+
+	/* Finish the message. */
+	if (gtmpqPutMsgEnd(conn))
+		goto send_failed;
+
+	/* Flush to ensure backend gets it. */
+	if (gtmpqFlush(conn))
+		goto send_failed;
+
+	return 0;
+
+send_failed:
+	conn->result = makeEmptyResultIfIsNull(conn->result);
+	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+	return -1;
+}
+
+int
+receive_commit_transaction(GTM_Conn *conn)
+{
+	GTM_Result *res;
+
+	if ((res = receive_result(conn)) == NULL)
+	{
+		conn->result = makeEmptyResultIfIsNull(conn->result);
+		conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+		return -1;
+	}
+
+	if (res->gr_status == GTM_RESULT_OK)
+		Assert(res->gr_resdata.grd_txn_get_multi.txn_count == 1);
+
+	return res->gr_status;
+}
+
 
 static int
 commit_transaction_internal(GTM_Conn *conn, GlobalTransactionId gxid,
@@ -824,68 +923,505 @@ abort_transaction_internal(GTM_Conn *conn, GlobalTransactionId gxid, bool is_bac
 	if (gtmpqFlush(conn))
 		goto send_failed;
 
-	if (!is_backup)
-	{
-		finish_time = time(NULL) + CLIENT_GTM_TIMEOUT;
-		if (gtmpqWaitTimed(true, false, conn, finish_time) ||
-			gtmpqReadData(conn) < 0)
-			goto receive_failed;
-
-		if ((res = GTMPQgetResult(conn)) == NULL)
-			goto receive_failed;
+	if (!is_backup)
+	{
+		finish_time = time(NULL) + CLIENT_GTM_TIMEOUT;
+		if (gtmpqWaitTimed(true, false, conn, finish_time) ||
+			gtmpqReadData(conn) < 0)
+			goto receive_failed;
+
+		if ((res = GTMPQgetResult(conn)) == NULL)
+			goto receive_failed;
+
+		if (res->gr_status == GTM_RESULT_OK)
+		{
+			Assert(res->gr_type == TXN_ROLLBACK_RESULT);
+			Assert(res->gr_resdata.grd_gxid == gxid);
+		}
+
+		return res->gr_status;
+	}
+	return GTM_RESULT_OK;
+
+receive_failed:
+send_failed:
+	conn->result = makeEmptyResultIfIsNull(conn->result);
+	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+	return -1;
+
+}
+
+int
+backup_start_prepared_transaction(GTM_Conn *conn, GlobalTransactionId gxid, char *gid,
+								  char *nodestring)
+{
+	Assert(nodestring && gid && conn);
+
+	return start_prepared_transaction_internal(conn, gxid, gid, nodestring, true);
+}
+
+int
+start_prepared_transaction(GTM_Conn *conn, GlobalTransactionId gxid, char *gid,
+						   char *nodestring)
+{
+	return start_prepared_transaction_internal(conn, gxid, gid, nodestring, false);
+}
+
+static int
+start_prepared_transaction_internal(GTM_Conn *conn, GlobalTransactionId gxid, char *gid,
+						   char *nodestring, bool is_backup)
+{
+	GTM_Result *res = NULL;
+	time_t finish_time;
+
+	Assert(nodestring);
+
+	 /* Start the message. */
+	if (gtmpqPutMsgStart('C', true, conn) ||
+		gtmpqPutInt(is_backup ? MSG_BKUP_TXN_START_PREPARED : MSG_TXN_START_PREPARED, sizeof (GTM_MessageType), conn) ||
+		gtmpqPutnchar((char *)&gxid, sizeof (GlobalTransactionId), conn) ||
+		/* Send also GID for an explicit prepared transaction */
+		gtmpqPutInt(strlen(gid), sizeof (GTM_StrLen), conn) ||
+		gtmpqPutnchar((char *) gid, strlen(gid), conn) ||
+		gtmpqPutInt(strlen(nodestring), sizeof (GTM_StrLen), conn) ||
+		gtmpqPutnchar((char *) nodestring, strlen(nodestring), conn))
+		goto send_failed;
+
+	/* Finish the message. */
+	if (gtmpqPutMsgEnd(conn))
+		goto send_failed;
+
+	/* Flush to ensure backend gets it. */
+	if (gtmpqFlush(conn))
+		goto send_failed;
+
+	if (is_backup)
+		return GTM_RESULT_OK;
+
+	finish_time = time(NULL) + CLIENT_GTM_TIMEOUT;
+	if (gtmpqWaitTimed(true, false, conn, finish_time) ||
+		gtmpqReadData(conn) < 0)
+		goto receive_failed;
+
+	if ((res = GTMPQgetResult(conn)) == NULL)
+		goto receive_failed;
+
+	if (res->gr_status == GTM_RESULT_OK)
+	{
+		Assert(res->gr_type == TXN_START_PREPARED_RESULT);
+		Assert(res->gr_resdata.grd_gxid == gxid);
+	}
+
+	return res->gr_status;
+
+receive_failed:
+send_failed:
+	conn->result = makeEmptyResultIfIsNull(conn->result);
+	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+	return -1;
+}
+
+int
+prepare_transaction(GTM_Conn *conn, GlobalTransactionId gxid)
+{
+	return prepare_transaction_internal(conn, gxid, false);
+}
+
+int
+bkup_prepare_transaction(GTM_Conn *conn, GlobalTransactionId gxid)
+{
+	return prepare_transaction_internal(conn, gxid, true);
+}
+
+static int
+prepare_transaction_internal(GTM_Conn *conn, GlobalTransactionId gxid, bool is_backup)
+{
+	GTM_Result *res = NULL;
+	time_t finish_time;
+
+	 /* Start the message. */
+	if (gtmpqPutMsgStart('C', true, conn) ||
+		gtmpqPutInt(is_backup ? MSG_BKUP_TXN_PREPARE : MSG_TXN_PREPARE, sizeof (GTM_MessageType), conn) ||
+		gtmpqPutnchar((char *)&gxid, sizeof (GlobalTransactionId), conn))
+		goto send_failed;
+
+	/* Finish the message. */
+	if (gtmpqPutMsgEnd(conn))
+		goto send_failed;
+
+	/* Flush to ensure backend gets it. */
+	if (gtmpqFlush(conn))
+		goto send_failed;
+
+	if (!is_backup)
+	{
+		finish_time = time(NULL) + CLIENT_GTM_TIMEOUT;
+		if (gtmpqWaitTimed(true, false, conn, finish_time) ||
+			gtmpqReadData(conn) < 0)
+			goto receive_failed;
+
+		if ((res = GTMPQgetResult(conn)) == NULL)
+			goto receive_failed;
+
+		if (res->gr_status == GTM_RESULT_OK)
+		{
+			Assert(res->gr_type == TXN_PREPARE_RESULT);
+			Assert(res->gr_resdata.grd_gxid == gxid);
+		}
+
+		return res->gr_status;
+	}
+	return GTM_RESULT_OK;
+
+receive_failed:
+send_failed:
+	conn->result = makeEmptyResultIfIsNull(conn->result);
+	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+	return -1;
+}
+
+int
+get_gid_data(GTM_Conn *conn,
+			 GTM_IsolationLevel isolevel,
+			 char *gid,
+			 GlobalTransactionId *gxid,
+			 GlobalTransactionId *prepared_gxid,
+			 char **nodestring)
+{
+	bool txn_read_only = false;
+	GTM_Result *res = NULL;
+	time_t finish_time;
+
+	/* Start the message */
+	if (gtmpqPutMsgStart('C', true, conn) ||
+		gtmpqPutInt(MSG_TXN_GET_GID_DATA, sizeof (GTM_MessageType), conn) ||
+		gtmpqPutInt(isolevel, sizeof (GTM_IsolationLevel), conn) ||
+		gtmpqPutc(txn_read_only, conn) ||
+		/* Send also GID for an explicit prepared transaction */
+		gtmpqPutInt(strlen(gid), sizeof (GTM_StrLen), conn) ||
+		gtmpqPutnchar((char *) gid, strlen(gid), conn))
+		goto send_failed;
+
+	/* Finish the message */
+	if (gtmpqPutMsgEnd(conn))
+		goto send_failed;
+
+	/* Flush to ensure backend gets it. */
+	if (gtmpqFlush(conn))
+		goto send_failed;
+
+	finish_time = time(NULL) + CLIENT_GTM_TIMEOUT;
+	if (gtmpqWaitTimed(true, false, conn, finish_time) ||
+		gtmpqReadData(conn) < 0)
+		goto receive_failed;
+
+	if ((res = GTMPQgetResult(conn)) == NULL)
+		goto receive_failed;
+
+	if (res->gr_status == GTM_RESULT_OK)
+	{
+		*gxid = res->gr_resdata.grd_txn_get_gid_data.gxid;
+		*prepared_gxid = res->gr_resdata.grd_txn_get_gid_data.prepared_gxid;
+		*nodestring = res->gr_resdata.grd_txn_get_gid_data.nodestring;
+	}
+
+	return res->gr_status;
+
+receive_failed:
+send_failed:
+	conn->result = makeEmptyResultIfIsNull(conn->result);
+	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+	return -1;
+}
+
+/*
+ * Snapshot Management API
+ */
+GTM_SnapshotData *
+get_snapshot(GTM_Conn *conn, GlobalTransactionId gxid, bool canbe_grouped)
+{
+	if (send_get_snapshot(conn, gxid, canbe_grouped))
+		return NULL;
+
+	return receive_get_snapshot(conn, canbe_grouped);
+}
+
+int
+send_get_snapshot(GTM_Conn *conn, GlobalTransactionId gxid, bool canbe_grouped)
+{
+	 /* Start the message. */
+	if (gtmpqPutMsgStart('C', true, conn) ||
+		gtmpqPutInt(canbe_grouped ? MSG_SNAPSHOT_GET_MULTI : MSG_SNAPSHOT_GET, sizeof (GTM_MessageType), conn) ||
+		gtmpqPutInt(1, sizeof (int), conn) ||
+		gtmpqPutnchar((char *)&gxid, sizeof (GlobalTransactionId), conn))
+		goto send_failed;
+
+	/* Finish the message. */
+	if (gtmpqPutMsgEnd(conn))
+		goto send_failed;
+
+	/* Flush to ensure backend gets it. */
+	if (gtmpqFlush(conn))
+		goto send_failed;
+
+	return 0;
+
+send_failed:
+	conn->result = makeEmptyResultIfIsNull(conn->result);
+	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+	return -1;
+}
+
+/*
+ * The snapshot returned lives in the connection result, it is only valid
+ * until the next reply is received.
+ */
+GTM_SnapshotData *
+receive_get_snapshot(GTM_Conn *conn, bool canbe_grouped)
+{
+	GTM_Result *res;
+	GTM_ResultType res_type;
+
+	res_type = canbe_grouped ? SNAPSHOT_GET_MULTI_RESULT : SNAPSHOT_GET_RESULT;
+
+	if ((res = receive_result(conn)) == NULL)
+	{
+		conn->result = makeEmptyResultIfIsNull(conn->result);
+		conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+		return NULL;
+	}
+
+	if (res->gr_status == GTM_RESULT_OK)
+	{
+		Assert(res->gr_type == res_type);
+		/*
+		 * !!FIXME - The following assertion fails when snapshots are requested
+		 * in non-grouping mode. We did some investigations and it appears that
+		 * GTMProxy_ProxyCommand() fails to record the incoming GXID and later
+		 * sends down a wrong GXID to the client. We should probably look at
+		 * populating cmd_data member before proxying message to the GTM
+		 *
+		 * Commenting out the assertion till then
+		 *
+		 *	Assert(res->gr_resdata.grd_txn_snap_multi.gxid == gxid);
+		 */
+		return &(res->gr_snapshot);
+	}
+	else
+		return NULL;
+}
+
+/*
+ * Start a transaction and get its first snapshot with a single message.
+ * The GXID and timestamp of the new transaction are set in *gxid and
+ * *timestamp. Returns NULL on failure; the snapshot lives in the connection
+ * result as for get_snapshot.
+ */
+GTM_SnapshotData *
+begin_transaction_snapshot(GTM_Conn *conn, GTM_IsolationLevel isolevel,
+						   GlobalTransactionId *gxid, GTM_Timestamp *timestamp)
+{
+	bool txn_read_only = false;
+	GTM_Result *res = NULL;
+
+	 /* Start the message. */
+	if (gtmpqPutMsgStart('C', true, conn) ||
+		gtmpqPutInt(MSG_SNAPSHOT_GXID_GET, sizeof (GTM_MessageType), conn) ||
+		gtmpqPutInt(isolevel, sizeof (GTM_IsolationLevel), conn) ||
+		gtmpqPutc(txn_read_only, conn))
+		goto send_failed;
+
+	/* Finish the message. */
+	if (gtmpqPutMsgEnd(conn))
+		goto send_failed;
+
+	/* Flush to ensure backend gets it. */
+	if (gtmpqFlush(conn))
+		goto send_failed;
+
+	if ((res = receive_result(conn)) == NULL)
+		goto receive_failed;
+
+	if (res->gr_status == GTM_RESULT_OK)
+	{
+		Assert(res->gr_type == SNAPSHOT_GXID_GET_RESULT);
+		*gxid = res->gr_resdata.grd_txn_snap_multi.gxid;
+		if (timestamp)
+			*timestamp = res->gr_resdata.grd_txn_snap_multi.timestamp;
+		return &(res->gr_snapshot);
+	}
+	else
+		return NULL;
+
+receive_failed:
+send_failed:
+	conn->result = makeEmptyResultIfIsNull(conn->result);
+	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+	return NULL;
+}
+
+/*
+ * Get a snapshot for the read-only transactions in gxid[]. The request may
+ * be served by a GTM standby, *from_standby tells whether it was. The
+ * snapshot lives in the connection result as for get_snapshot.
+ */
+GTM_SnapshotData *
+get_snapshot_readonly(GTM_Conn *conn, int txn_count, GlobalTransactionId *gxid,
+					  bool *from_standby)
+{
+	GTM_Result *res = NULL;
+	int ii;
+
+	 /* Start the message. */
+	if (gtmpqPutMsgStart('C', true, conn) ||
+		gtmpqPutInt(MSG_SNAPSHOT_GET_READONLY, sizeof (GTM_MessageType), conn) ||
+		gtmpqPutInt(txn_count, sizeof (int), conn))
+		goto send_failed;
+
+	for (ii = 0; ii < txn_count; ii++)
+	{
+		if (gtmpqPutnchar((char *)&gxid[ii], sizeof (GlobalTransactionId), conn))
+			goto send_failed;
+	}
+
+	/* Finish the message. */
+	if (gtmpqPutMsgEnd(conn))
+		goto send_failed;
+
+	/* Flush to ensure backend gets it. */
+	if (gtmpqFlush(conn))
+		goto send_failed;
+
+	if ((res = receive_result(conn)) == NULL)
+		goto receive_failed;
+
+	if (res->gr_status == GTM_RESULT_OK)
+	{
+		Assert(res->gr_type == SNAPSHOT_GET_MULTI_RESULT ||
+			   res->gr_type == SNAPSHOT_GET_STANDBY_RESULT);
+		if (from_standby)
+			*from_standby = (res->gr_type == SNAPSHOT_GET_STANDBY_RESULT);
+		return &(res->gr_snapshot);
+	}
+	else
+		return NULL;
+
+receive_failed:
+send_failed:
+	conn->result = makeEmptyResultIfIsNull(conn->result);
+	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+	return NULL;
+}
+
+/*
+ * Send a snapshot of the GTM primary to the standby, which serves it to
+ * read-only transactions. next_gxid is the next GXID of the primary when the
+ * snapshot was taken. No response is expected.
+ */
+int
+bkup_publish_snapshot(GTM_Conn *conn, GlobalTransactionId next_gxid,
+					  GTM_SnapshotData *snapshot)
+{
+	size_t		size = gtm_get_snapshot_wire_size(snapshot);
+	size_t		len;
+	char	   *buf;
+
+	if ((buf = (char *) malloc(size)) == NULL)
+		goto send_failed;
+	len = gtm_serialize_snapshot_wire(snapshot, buf, size);
+
+	/* Start the message. */
+	if (gtmpqPutMsgStart('C', true, conn) || /* FIXME: no proxy header */
+		gtmpqPutInt(MSG_BKUP_SNAPSHOT, sizeof (GTM_MessageType), conn) ||
+		gtmpqPutnchar((char *)&next_gxid, sizeof (GlobalTransactionId), conn) ||
+		gtmpqPutnchar(buf, len, conn))
+		goto send_failed;
+
+	/* Finish the message. */
+	if (gtmpqPutMsgEnd(conn))
+		goto send_failed;
+
+	/* Flush to ensure backend gets it. */
+	if (gtmpqFlush(conn))
+		goto send_failed;
+
+	free(buf);
+	return 0;
+
+send_failed:
+	if (buf)
+		free(buf);
+	conn->result = makeEmptyResultIfIsNull(conn->result);
+	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+	return -1;
+}
+
+/*
+ * Get a CSN snapshot. The first snapshot of a transaction makes GTM hold the
+ * global xmin back for it.
+ */
+int
+get_snapshot_csn(GTM_Conn *conn, GlobalTransactionId gxid, bool first,
+				 GTM_CSNSnapshot snapshot)
+{
+	GTM_Result *res = NULL;
+	time_t finish_time;
+
+	 /* Start the message. */
+	if (gtmpqPutMsgStart('C', true, conn) ||
+		gtmpqPutInt(MSG_SNAPSHOT_CSN_GET, sizeof (GTM_MessageType), conn) ||
+		gtmpqPutnchar((char *)&gxid, sizeof (GlobalTransactionId), conn) ||
+		gtmpqPutInt(first ? 1 : 0, sizeof (int), conn))
+		goto send_failed;
+
+	/* Finish the message. */
+	if (gtmpqPutMsgEnd(conn))
+		goto send_failed;
+
+	/* Flush to ensure backend gets it. */
+	if (gtmpqFlush(conn))
+		goto send_failed;
+
+	finish_time = time(NULL) + CLIENT_GTM_TIMEOUT;
+	if (gtmpqWaitTimed(true, false, conn, finish_time) ||
+		gtmpqReadData(conn) < 0)
+		goto receive_failed;
 
-		if (res->gr_status == GTM_RESULT_OK)
-		{
-			Assert(res->gr_type == TXN_ROLLBACK_RESULT);
-			Assert(res->gr_resdata.grd_gxid == gxid);
-		}
+	if ((res = GTMPQgetResult(conn)) == NULL)
+		goto receive_failed;
 
-		return res->gr_status;
+	if (res->gr_status == GTM_RESULT_OK)
+	{
+		Assert(res->gr_type == SNAPSHOT_CSN_GET_RESULT);
+		memcpy(snapshot, &res->gr_resdata.grd_csn_snapshot,
+			   sizeof (GTM_CSNSnapshotData));
 	}
-	return GTM_RESULT_OK;
+
+	return res->gr_status;
 
 receive_failed:
 send_failed:
 	conn->result = makeEmptyResultIfIsNull(conn->result);
 	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
 	return -1;
-
-}
-
-int
-backup_start_prepared_transaction(GTM_Conn *conn, GlobalTransactionId gxid, char *gid,
-								  char *nodestring)
-{
-	Assert(nodestring && gid && conn);
-
-	return start_prepared_transaction_internal(conn, gxid, gid, nodestring, true);
 }
 
+/*
+ * Get the GXIDs of the transactions completed since the given CSN, at most
+ * GTM_CSNLOG_MAX_FETCH of them. The array returned belongs to the connection
+ * and is valid until the next request.
+ */
 int
-start_prepared_transaction(GTM_Conn *conn, GlobalTransactionId gxid, char *gid,
-						   char *nodestring)
-{
-	return start_prepared_transaction_internal(conn, gxid, gid, nodestring, false);
-}
-
-static int
-start_prepared_transaction_internal(GTM_Conn *conn, GlobalTransactionId gxid, char *gid,
-						   char *nodestring, bool is_backup)
+get_csnlog(GTM_Conn *conn, GTM_CSN from, uint32 *epoch, GTM_CSN *first,
+		   int *count, GlobalTransactionId **gxids)
 {
 	GTM_Result *res = NULL;
 	time_t finish_time;
 
-	Assert(nodestring);
-
 	 /* Start the message. */
 	if (gtmpqPutMsgStart('C', true, conn) ||
-		gtmpqPutInt(is_backup ? MSG_BKUP_TXN_START_PREPARED : MSG_TXN_START_PREPARED, sizeof (GTM_MessageType), conn) ||
-		gtmpqPutnchar((char *)&gxid, sizeof (GlobalTransactionId), conn) ||
-		/* Send also GID for an explicit prepared transaction */
-		gtmpqPutInt(strlen(gid), sizeof (GTM_StrLen), conn) ||
-		gtmpqPutnchar((char *) gid, strlen(gid), conn) ||
-		gtmpqPutInt(strlen(nodestring), sizeof (GTM_StrLen), conn) ||
-		gtmpqPutnchar((char *) nodestring, strlen(nodestring), conn))
+		gtmpqPutInt(MSG_CSNLOG_GET, sizeof (GTM_MessageType), conn) ||
+		gtmpqPutnchar((char *)&from, sizeof (GTM_CSN), conn))
 		goto send_failed;
 
 	/* Finish the message. */
@@ -896,9 +1432,6 @@ start_prepared_transaction_internal(GTM_Conn *conn, GlobalTransactionId gxid, ch
 	if (gtmpqFlush(conn))
 		goto send_failed;
 
-	if (is_backup)
-		return GTM_RESULT_OK;
-
 	finish_time = time(NULL) + CLIENT_GTM_TIMEOUT;
 	if (gtmpqWaitTimed(true, false, conn, finish_time) ||
 		gtmpqReadData(conn) < 0)
@@ -909,8 +1442,11 @@ start_prepared_transaction_internal(GTM_Conn *conn, GlobalTransactionId gxid, ch
 
 	if (res->gr_status == GTM_RESULT_OK)
 	{
-		Assert(res->gr_type == TXN_START_PREPARED_RESULT);
-		Assert(res->gr_resdata.grd_gxid == gxid);
+		Assert(res->gr_type == CSNLOG_GET_RESULT);
+		*epoch = res->gr_resdata.grd_csnlog.epoch;
+		*first = res->gr_resdata.grd_csnlog.first;
+		*count = res->gr_resdata.grd_csnlog.count;
+		*gxids = res->gr_csnlog_gxids;
 	}
 
 	return res->gr_status;
@@ -922,28 +1458,19 @@ send_failed:
 	return -1;
 }
 
+/*
+ * Get the latency statistics of the messages served by GTM. The array
+ * returned belongs to the connection and is valid until the next request.
+ */
 int
-prepare_transaction(GTM_Conn *conn, GlobalTransactionId gxid)
-{
-	return prepare_transaction_internal(conn, gxid, false);
-}
-
-int
-bkup_prepare_transaction(GTM_Conn *conn, GlobalTransactionId gxid)
-{
-	return prepare_transaction_internal(conn, gxid, true);
-}
-
-static int
-prepare_transaction_internal(GTM_Conn *conn, GlobalTransactionId gxid, bool is_backup)
+get_gtm_stats(GTM_Conn *conn, GTM_MessageStats **stats, int *count)
 {
 	GTM_Result *res = NULL;
 	time_t finish_time;
 
 	 /* Start the message. */
 	if (gtmpqPutMsgStart('C', true, conn) ||
-		gtmpqPutInt(is_backup ? MSG_BKUP_TXN_PREPARE : MSG_TXN_PREPARE, sizeof (GTM_MessageType), conn) ||
-		gtmpqPutnchar((char *)&gxid, sizeof (GlobalTransactionId), conn))
+		gtmpqPutInt(MSG_GET_STATS, sizeof (GTM_MessageType), conn))
 		goto send_failed;
 
 	/* Finish the message. */
@@ -954,25 +1481,22 @@ prepare_transaction_internal(GTM_Conn *conn, GlobalTransactionId gxid, bool is_b
 	if (gtmpqFlush(conn))
 		goto send_failed;
 
-	if (!is_backup)
-	{
-		finish_time = time(NULL) + CLIENT_GTM_TIMEOUT;
-		if (gtmpqWaitTimed(true, false, conn, finish_time) ||
-			gtmpqReadData(conn) < 0)
-			goto receive_failed;
-
-		if ((res = GTMPQgetResult(conn)) == NULL)
-			goto receive_failed;
+	finish_time = time(NULL) + CLIENT_GTM_TIMEOUT;
+	if (gtmpqWaitTimed(true, false, conn, finish_time) ||
+		gtmpqReadData(conn) < 0)
+		goto receive_failed;
 
-		if (res->gr_status == GTM_RESULT_OK)
-		{
-			Assert(res->gr_type == TXN_PREPARE_RESULT);
-			Assert(res->gr_resdata.grd_gxid == gxid);
-		}
+	if ((res = GTMPQgetResult(conn)) == NULL)
+		goto receive_failed;
 
-		return res->gr_status;
+	if (res->gr_status == GTM_RESULT_OK)
+	{
+		Assert(res->gr_type == GET_STATS_RESULT);
+		*count = res->gr_resdata.grd_stats_count;
+		*stats = res->gr_stats;
 	}
-	return GTM_RESULT_OK;
+
+	return res->gr_status;
 
 receive_failed:
 send_failed:
@@ -981,29 +1505,21 @@ send_failed:
 	return -1;
 }
 
+/*
+ * Get the current GTM timestamp
+ */
 int
-get_gid_data(GTM_Conn *conn,
-			 GTM_IsolationLevel isolevel,
-			 char *gid,
-			 GlobalTransactionId *gxid,
-			 GlobalTransactionId *prepared_gxid,
-			 char **nodestring)
+get_timestamp(GTM_Conn *conn, GTM_Timestamp *timestamp)
 {
-	bool txn_read_only = false;
 	GTM_Result *res = NULL;
 	time_t finish_time;
 
-	/* Start the message */
+	 /* Start the message. */
 	if (gtmpqPutMsgStart('C', true, conn) ||
-		gtmpqPutInt(MSG_TXN_GET_GID_DATA, sizeof (GTM_MessageType), conn) ||
-		gtmpqPutInt(isolevel, sizeof (GTM_IsolationLevel), conn) ||
-		gtmpqPutc(txn_read_only, conn) ||
-		/* Send also GID for an explicit prepared transaction */
-		gtmpqPutInt(strlen(gid), sizeof (GTM_StrLen), conn) ||
-		gtmpqPutnchar((char *) gid, strlen(gid), conn))
+		gtmpqPutInt(MSG_GET_TIMESTAMP, sizeof (GTM_MessageType), conn))
 		goto send_failed;
 
-	/* Finish the message */
+	/* Finish the message. */
 	if (gtmpqPutMsgEnd(conn))
 		goto send_failed;
 
@@ -1021,9 +1537,8 @@ get_gid_data(GTM_Conn *conn,
 
 	if (res->gr_status == GTM_RESULT_OK)
 	{
-		*gxid = res->gr_resdata.grd_txn_get_gid_data.gxid;
-		*prepared_gxid = res->gr_resdata.grd_txn_get_gid_data.prepared_gxid;
-		*nodestring = res->gr_resdata.grd_txn_get_gid_data.nodestring;
+		Assert(res->gr_type == GET_TIMESTAMP_RESULT);
+		*timestamp = res->gr_resdata.grd_timestamp;
 	}
 
 	return res->gr_status;
@@ -1036,22 +1551,17 @@ send_failed:
 }
 
 /*
- * Snapshot Management API
+ * Get the current global xmin
  */
-GTM_SnapshotData *
-get_snapshot(GTM_Conn *conn, GlobalTransactionId gxid, bool canbe_grouped)
+int
+get_global_xmin(GTM_Conn *conn, GlobalTransactionId *globalxmin)
 {
 	GTM_Result *res = NULL;
 	time_t finish_time;
-	GTM_ResultType res_type;
-
-	res_type = canbe_grouped ? SNAPSHOT_GET_MULTI_RESULT : SNAPSHOT_GET_RESULT;
 
 	 /* Start the message. */
 	if (gtmpqPutMsgStart('C', true, conn) ||
-		gtmpqPutInt(canbe_grouped ? MSG_SNAPSHOT_GET_MULTI : MSG_SNAPSHOT_GET, sizeof (GTM_MessageType), conn) ||
-		gtmpqPutInt(1, sizeof (int), conn) ||
-		gtmpqPutnchar((char *)&gxid, sizeof (GlobalTransactionId), conn))
+		gtmpqPutInt(MSG_GET_GLOBAL_XMIN, sizeof (GTM_MessageType), conn))
 		goto send_failed;
 
 	/* Finish the message. */
@@ -1072,29 +1582,17 @@ get_snapshot(GTM_Conn *conn, GlobalTransactionId gxid, bool canbe_grouped)
 
 	if (res->gr_status == GTM_RESULT_OK)
 	{
-		Assert(res->gr_type == res_type);
-		/*
-		 * !!FIXME - The following assertion fails when snapshots are requested
-		 * in non-grouping mode. We did some investigations and it appears that
-		 * GTMProxy_ProxyCommand() fails to record the incoming GXID and later
-		 * sends down a wrong GXID to the client. We should probably look at
-		 * populating cmd_data member before proxying message to the GTM
-		 *
-		 * Commenting out the assertion till then
-		 *
-		 *	Assert(res->gr_resdata.grd_txn_snap_multi.gxid == gxid);
-		 */
-		return &(res->gr_snapshot);
+		Assert(res->gr_type == GET_GLOBAL_XMIN_RESULT);
+		*globalxmin = res->gr_resdata.grd_gxid;
 	}
-	else
-		return NULL;
 
+	return res->gr_status;
 
 receive_failed:
 send_failed:
 	conn->result = makeEmptyResultIfIsNull(conn->result);
 	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
-	return NULL;
+	return -1;
 }
 
 /*
@@ -1502,8 +2000,28 @@ get_next_internal(GTM_Conn *conn, GTM_SequenceKey key,
 				  char *coord_name, int coord_procid, GTM_Sequence range,
 				  GTM_Sequence *result, GTM_Sequence *rangemax, bool is_backup)
 {
-	GTM_Result *res = NULL;
-	time_t finish_time;
+	if (send_get_next_internal(conn, key, coord_name, coord_procid, range,
+							   is_backup))
+		return GTM_RESULT_COMM_ERROR;
+
+	if (!is_backup)
+		return receive_get_next(conn, result, rangemax);
+	return GTM_RESULT_OK;
+}
+
+int
+send_get_next(GTM_Conn *conn, GTM_SequenceKey key,
+			  char *coord_name, int coord_procid, GTM_Sequence range)
+{
+	return send_get_next_internal(conn, key, coord_name, coord_procid, range,
+								  false);
+}
+
+static int
+send_get_next_internal(GTM_Conn *conn, GTM_SequenceKey key,
+				  char *coord_name, int coord_procid, GTM_Sequence range,
+				  bool is_backup)
+{
 	int	coord_namelen = coord_name ? strlen(coord_name) : 0;
 
 	/* Start the message. */
@@ -1525,32 +2043,34 @@ get_next_internal(GTM_Conn *conn, GTM_SequenceKey key,
 	if (gtmpqFlush(conn))
 		goto send_failed;
 
-	if (!is_backup)
-	{
-		finish_time = time(NULL) + CLIENT_GTM_TIMEOUT;
-		if (gtmpqWaitTimed(true, false, conn, finish_time) ||
-			gtmpqReadData(conn) < 0)
-			goto receive_failed;
-
-		if ((res = GTMPQgetResult(conn)) == NULL)
-			goto receive_failed;
-
-		if (res->gr_status == GTM_RESULT_OK)
-		{
-			*result = res->gr_resdata.grd_seq.seqval;
-			*rangemax = res->gr_resdata.grd_seq.rangemax;
-		}
-		return res->gr_status;
-	}
-	return GTM_RESULT_OK;
+	return 0;
 
-receive_failed:
 send_failed:
 	conn->result = makeEmptyResultIfIsNull(conn->result);
 	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
 	return GTM_RESULT_COMM_ERROR;
 }
 
+int
+receive_get_next(GTM_Conn *conn, GTM_Sequence *result, GTM_Sequence *rangemax)
+{
+	GTM_Result *res;
+
+	if ((res = receive_result(conn)) == NULL)
+	{
+		conn->result = makeEmptyResultIfIsNull(conn->result);
+		conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+		return GTM_RESULT_COMM_ERROR;
+	}
+
+	if (res->gr_status == GTM_RESULT_OK)
+	{
+		*result = res->gr_resdata.grd_seq.seqval;
+		*rangemax = res->gr_resdata.grd_seq.rangemax;
+	}
+	return res->gr_status;
+}
+
 int
 reset_sequence(GTM_Conn *conn, GTM_SequenceKey key)
 {
@@ -2008,6 +2528,57 @@ send_failed:
 	return -1;
 }
 
+/*
+ * Replicate a MSG_TXN_LEASE_REPORT to the standby
+ */
+int
+bkup_report_leased_gxids(GTM_Conn *conn,
+						 int assign_count, GTM_LeaseAssignment *assigned,
+						 int release_count, GlobalTransactionId *released)
+{
+	int ii;
+
+	/* Start the message. */
+	if (gtmpqPutMsgStart('C', true, conn)) /* FIXME: no proxy header */
+		goto send_failed;
+
+	if (gtmpqPutInt(MSG_BKUP_TXN_LEASE_REPORT, sizeof (GTM_MessageType), conn) ||
+		gtmpqPutInt(assign_count, sizeof (int), conn))
+		goto send_failed;
+
+	for (ii = 0; ii < assign_count; ii++)
+	{
+		if (gtmpqPutnchar((char *)&assigned[ii].la_gxid,
+						  sizeof (GlobalTransactionId), conn) ||
+			gtmpqPutInt(assigned[ii].la_isolevel, sizeof (GTM_IsolationLevel), conn) ||
+			gtmpqPutc(assigned[ii].la_readonly, conn) ||
+			gtmpqPutInt(assigned[ii].la_connid, sizeof (GTMProxy_ConnID), conn))
+			goto send_failed;
+	}
+
+	if (gtmpqPutInt(release_count, sizeof (int), conn))
+		goto send_failed;
+	for (ii = 0; ii < release_count; ii++)
+	{
+		if (gtmpqPutnchar((char *)&released[ii],
+						  sizeof (GlobalTransactionId), conn))
+			goto send_failed;
+	}
+
+	/* Finish the message. */
+	if (gtmpqPutMsgEnd(conn))
+		goto send_failed;
+
+	/* Flush to ensure backend gets it. */
+	if (gtmpqFlush(conn))
+		goto send_failed;
+
+	return 0;
+
+send_failed:
+	return -1;
+}
+
 int
 bkup_commit_transaction_multi(GTM_Conn *conn, int txn_count,
 		GlobalTransactionId *gxid)
@@ -2370,6 +2941,33 @@ send_failed:
 	return -1;
 }
 
+/*
+ * Replicate GTM state log records to the standby. There is no response,
+ * follow with gtm_sync_standby() to know they are applied.
+ */
+int
+bkup_state_log(GTM_Conn *conn, const char *data, int len)
+{
+	if (gtmpqPutMsgStart('C', true, conn) ||
+		gtmpqPutInt(MSG_BKUP_STATE_LOG, sizeof (GTM_MessageType), conn) ||
+		gtmpqPutInt(len, sizeof (int), conn) ||
+		gtmpqPutnchar(data, len, conn))
+		goto send_failed;
+
+	if (gtmpqPutMsgEnd(conn))
+		goto send_failed;
+
+	if (gtmpqFlush(conn))
+		goto send_failed;
+
+	return GTM_RESULT_OK;
+
+send_failed:
+	conn->result = makeEmptyResultIfIsNull(conn->result);
+	conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+	return -1;
+}
+
 /*
  * Submit to GTM information about started distributed session.
  * The information is the session identifier consisting of coordinator name and
@@ -14,9 +14,84 @@
  *-------------------------------------------------------------------------
  */
 #include "gtm/gtm_c.h"
+
+#include <limits.h>
+#include <sys/time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "gtm/gtm.h"
 #include "gtm/gtm_lock.h"
 #include "gtm/elog.h"
 
+#define RW_WRITER			((uint32) 1 << 31)
+
+/* Number of attempts to get a busy lock before going to sleep */
+#define GTM_LOCK_SPINS		100
+
+/* Named locks, reported by GTM_RWLockReportStats */
+#define GTM_MAX_NAMED_LOCKS	32
+
+static pthread_mutex_t	NamedLocksLock = PTHREAD_MUTEX_INITIALIZER;
+static GTM_RWLock	   *NamedLocks[GTM_MAX_NAMED_LOCKS];
+static int				NamedLockCount = 0;
+
+static bool GTM_RWLockTryAcquire(GTM_RWLock *lock, GTM_LockMode mode);
+static void GTM_RWLockSleep(GTM_RWLock *lock, uint32 state);
+static void GTM_RWLockWakeup(GTM_RWLock *lock);
+
+/*
+ * Try to acquire the lock once, without waiting
+ */
+static bool
+GTM_RWLockTryAcquire(GTM_RWLock *lock, GTM_LockMode mode)
+{
+	uint32 old = pg_atomic_read_u32(&lock->lk_state);
+
+	if (mode == GTM_LOCKMODE_WRITE)
+		return old == 0 &&
+			pg_atomic_compare_exchange_u32(&lock->lk_state, &old, RW_WRITER);
+
+	while ((old & RW_WRITER) == 0)
+	{
+		if (pg_atomic_compare_exchange_u32(&lock->lk_state, &old, old + 1))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Sleep until the lock state changes from the given value. Returns at once if
+ * it has changed already, and may return spuriously.
+ */
+static void
+GTM_RWLockSleep(GTM_RWLock *lock, uint32 state)
+{
+#ifdef __linux__
+	syscall(SYS_futex, &lock->lk_state.value, FUTEX_WAIT_PRIVATE, state,
+			NULL, NULL, 0);
+#else
+	if (pg_atomic_read_u32(&lock->lk_state) == state)
+		pg_usleep(1000L);
+#endif
+}
+
+/*
+ * Wake up the threads sleeping on the lock after its state changed
+ */
+static void
+GTM_RWLockWakeup(GTM_RWLock *lock)
+{
+#ifdef __linux__
+	if (pg_atomic_read_u32(&lock->lk_sleepers) > 0)
+		syscall(SYS_futex, &lock->lk_state.value, FUTEX_WAKE_PRIVATE, INT_MAX,
+				NULL, NULL, 0);
+#endif
+}
+
 /*
  * Acquire the request lock. Block if the lock is not available
  *
@@ -28,24 +103,70 @@
 bool
 GTM_RWLockAcquire(GTM_RWLock *lock, GTM_LockMode mode)
 {
-	int status = EINVAL;
+	struct timeval start, end;
+	GTM_ThreadInfo *thrinfo;
+	uint64 usecs;
+	int spins = 0;
 
-	switch (mode)
+	if (mode != GTM_LOCKMODE_WRITE && mode != GTM_LOCKMODE_READ)
+		elog(ERROR, "Invalid lockmode");
+
+	pg_atomic_fetch_add_u64(&lock->lk_acquires, 1);
+
+	/* Readers let waiting writers go first */
+	if ((mode == GTM_LOCKMODE_WRITE ||
+		 pg_atomic_read_u32(&lock->lk_writers_waiting) == 0) &&
+		GTM_RWLockTryAcquire(lock, mode))
+		return true;
+
+	gettimeofday(&start, NULL);
+	if (mode == GTM_LOCKMODE_WRITE)
+		pg_atomic_fetch_add_u32(&lock->lk_writers_waiting, 1);
+
+	for (;;)
 	{
-		case GTM_LOCKMODE_WRITE:
-			status = pthread_rwlock_wrlock(&lock->lk_lock);
-			break;
+		uint32 state;
 
-		case GTM_LOCKMODE_READ:
-			status = pthread_rwlock_rdlock(&lock->lk_lock);
+		if ((mode == GTM_LOCKMODE_WRITE ||
+			 pg_atomic_read_u32(&lock->lk_writers_waiting) == 0) &&
+			GTM_RWLockTryAcquire(lock, mode))
 			break;
 
-		default:
-			elog(ERROR, "Invalid lockmode");
-			break;
+		if (++spins < GTM_LOCK_SPINS)
+		{
+			pg_spin_delay();
+			continue;
+		}
+
+		/*
+		 * Go to sleep. The lock holders wake us up when they change the
+		 * state if they see us sleeping, so check the state again after
+		 * announcing ourselves.
+		 */
+		pg_atomic_fetch_add_u32(&lock->lk_sleepers, 1);
+		state = pg_atomic_read_u32(&lock->lk_state);
+		if (mode == GTM_LOCKMODE_WRITE ? state != 0 :
+			((state & RW_WRITER) != 0 ||
+			 pg_atomic_read_u32(&lock->lk_writers_waiting) > 0))
+			GTM_RWLockSleep(lock, state);
+		pg_atomic_fetch_sub_u32(&lock->lk_sleepers, 1);
+		spins = 0;
 	}
 
-	return status ? false : true;
+	if (mode == GTM_LOCKMODE_WRITE)
+		pg_atomic_fetch_sub_u32(&lock->lk_writers_waiting, 1);
+
+	gettimeofday(&end, NULL);
+	usecs = (end.tv_sec - start.tv_sec) * 1000000L +
+		(end.tv_usec - start.tv_usec);
+	pg_atomic_fetch_add_u64(&lock->lk_waits, 1);
+	pg_atomic_fetch_add_u64(&lock->lk_wait_usecs, usecs);
+
+	/* Also charged to the message the thread is processing */
+	if ((thrinfo = GetMyThreadInfo) != NULL)
+		thrinfo->thr_lock_wait_usecs += usecs;
+
+	return true;
 }
 
 /*
@@ -54,9 +175,23 @@ GTM_RWLockAcquire(GTM_RWLock *lock, GTM_LockMode mode)
 bool
 GTM_RWLockRelease(GTM_RWLock *lock)
 {
-	int status;
-	status = pthread_rwlock_unlock(&lock->lk_lock);
-	return status ? false : true;
+	uint32 old = pg_atomic_read_u32(&lock->lk_state);
+
+	if (old & RW_WRITER)
+		pg_atomic_exchange_u32(&lock->lk_state, 0);
+	else
+	{
+		if (old == 0)
+			return false;
+		old = pg_atomic_fetch_sub_u32(&lock->lk_state, 1);
+		/* Other readers still hold it, nobody can be waiting for them only */
+		if (old != 1)
+			return true;
+	}
+
+	GTM_RWLockWakeup(lock);
+
+	return true;
 }
 
 /*
@@ -65,7 +200,14 @@ GTM_RWLockRelease(GTM_RWLock *lock)
 int
 GTM_RWLockInit(GTM_RWLock *lock)
 {
-	return pthread_rwlock_init(&lock->lk_lock, NULL);
+	pg_atomic_init_u32(&lock->lk_state, 0);
+	pg_atomic_init_u32(&lock->lk_writers_waiting, 0);
+	pg_atomic_init_u32(&lock->lk_sleepers, 0);
+	pg_atomic_init_u64(&lock->lk_acquires, 0);
+	pg_atomic_init_u64(&lock->lk_waits, 0);
+	pg_atomic_init_u64(&lock->lk_wait_usecs, 0);
+	lock->lk_name = NULL;
+	return 0;
 }
 
 /*
@@ -74,7 +216,23 @@ GTM_RWLockInit(GTM_RWLock *lock)
 int
 GTM_RWLockDestroy(GTM_RWLock *lock)
 {
-	return pthread_rwlock_destroy(&lock->lk_lock);
+	int ii;
+
+	if (lock->lk_name == NULL)
+		return 0;
+
+	pthread_mutex_lock(&NamedLocksLock);
+	for (ii = 0; ii < NamedLockCount; ii++)
+	{
+		if (NamedLocks[ii] == lock)
+		{
+			NamedLocks[ii] = NamedLocks[--NamedLockCount];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&NamedLocksLock);
+
+	return 0;
 }
 
 /*
@@ -86,24 +244,50 @@ GTM_RWLockDestroy(GTM_RWLock *lock)
 bool
 GTM_RWLockConditionalAcquire(GTM_RWLock *lock, GTM_LockMode mode)
 {
-	int status = EINVAL;
+	if (mode != GTM_LOCKMODE_WRITE && mode != GTM_LOCKMODE_READ)
+		elog(ERROR, "Invalid lockmode");
 
-	switch (mode)
-	{
-		case GTM_LOCKMODE_WRITE:
-			status = pthread_rwlock_trywrlock(&lock->lk_lock);
-			break;
+	if (!GTM_RWLockTryAcquire(lock, mode))
+		return false;
 
-		case GTM_LOCKMODE_READ:
-			status = pthread_rwlock_tryrdlock(&lock->lk_lock);
-			break;
+	pg_atomic_fetch_add_u64(&lock->lk_acquires, 1);
+	return true;
+}
 
-		default:
-			elog(ERROR, "Invalid lockmode");
-			break;
-	}
+/*
+ * Give a name to a lock so that its contention is reported
+ */
+void
+GTM_RWLockSetName(GTM_RWLock *lock, const char *name)
+{
+	pthread_mutex_lock(&NamedLocksLock);
+	if (lock->lk_name == NULL && NamedLockCount < GTM_MAX_NAMED_LOCKS)
+		NamedLocks[NamedLockCount++] = lock;
+	lock->lk_name = name;
+	pthread_mutex_unlock(&NamedLocksLock);
+}
 
-	return status ? false : true;
+/*
+ * Report the acquisitions and waits of the named locks to the log
+ */
+void
+GTM_RWLockReportStats(void)
+{
+	int ii;
+
+	pthread_mutex_lock(&NamedLocksLock);
+	for (ii = 0; ii < NamedLockCount; ii++)
+	{
+		GTM_RWLock *lock = NamedLocks[ii];
+
+		elog(LOG, "lock %s: " UINT64_FORMAT " acquisitions, " UINT64_FORMAT
+			 " waits, " UINT64_FORMAT " us waited",
+			 lock->lk_name,
+			 pg_atomic_read_u64(&lock->lk_acquires),
+			 pg_atomic_read_u64(&lock->lk_waits),
+			 pg_atomic_read_u64(&lock->lk_wait_usecs));
+	}
+	pthread_mutex_unlock(&NamedLocksLock);
 }
 
 /*
@@ -157,6 +157,129 @@ gtm_deserialize_snapshotdata(GTM_SnapshotData *data, const char *buf, size_t buf
 	return len;
 }
 
+/*
+ * Wire format of the snapshots sent in the replies to the snapshot messages
+ *
+ * version ---> sn_xmin ---> sn_xmax ---> sn_recent_global_xmin ---> sn_xcnt
+ * ---> sn_xcnt encoded GXIDs
+ *
+ * The fixed part is copied in one go. Each GXID is encoded as its distance
+ * from the previous one, sn_xmin for the first, 7 bits per byte with the
+ * high bit set on all but the last byte. GTM sends the GXIDs in ascending
+ * order and open transactions are close to each other, so most of them take
+ * a single byte. The distances wrap around like the GXIDs do, any order
+ * decodes back to the same array.
+ */
+typedef struct GTM_SnapshotWireHeader
+{
+	uint32				sw_version;
+	GlobalTransactionId	sw_xmin;
+	GlobalTransactionId	sw_xmax;
+	GlobalTransactionId	sw_recent_global_xmin;
+	uint32				sw_xcnt;
+} GTM_SnapshotWireHeader;
+
+/* Longest encoding of a 32-bit distance */
+#define GTM_SNAPSHOT_WIRE_MAX_DELTA	5
+
+/*
+ * gtm_get_snapshot_wire_size
+ * Upper bound of the size of a snapshot in the wire format
+ */
+size_t
+gtm_get_snapshot_wire_size(GTM_SnapshotData *data)
+{
+	return sizeof(GTM_SnapshotWireHeader) +
+		GTM_SNAPSHOT_WIRE_MAX_DELTA * (size_t) data->sn_xcnt;
+}
+
+/*
+ * gtm_serialize_snapshot_wire
+ * Encode a snapshot in the wire format, returns the length used or 0 if
+ * the buffer is too small.
+ */
+size_t
+gtm_serialize_snapshot_wire(GTM_SnapshotData *data, char *buf, size_t buflen)
+{
+	GTM_SnapshotWireHeader hdr;
+	unsigned char *p = (unsigned char *) buf + sizeof(hdr);
+	GlobalTransactionId prev = data->sn_xmin;
+	uint32		i;
+
+	if (gtm_get_snapshot_wire_size(data) > buflen)
+		return 0;
+
+	hdr.sw_version = GTM_SNAPSHOT_WIRE_VERSION;
+	hdr.sw_xmin = data->sn_xmin;
+	hdr.sw_xmax = data->sn_xmax;
+	hdr.sw_recent_global_xmin = data->sn_recent_global_xmin;
+	hdr.sw_xcnt = data->sn_xcnt;
+	memcpy(buf, &hdr, sizeof(hdr));
+
+	for (i = 0; i < data->sn_xcnt; i++)
+	{
+		uint32		delta = data->sn_xip[i] - prev;
+
+		while (delta >= 0x80)
+		{
+			*p++ = (delta & 0x7F) | 0x80;
+			delta >>= 7;
+		}
+		*p++ = delta;
+		prev = data->sn_xip[i];
+	}
+
+	return (char *) p - buf;
+}
+
+/*
+ * gtm_deserialize_snapshot_wire
+ * Decode a snapshot in the wire format into data, whose sn_xip has room
+ * for xip_size GXIDs. Returns the length consumed or 0 if the data is not
+ * a valid snapshot.
+ */
+size_t
+gtm_deserialize_snapshot_wire(GTM_SnapshotData *data, uint32 xip_size,
+							  const char *buf, size_t buflen)
+{
+	GTM_SnapshotWireHeader hdr;
+	const unsigned char *p = (const unsigned char *) buf + sizeof(hdr);
+	const unsigned char *end = (const unsigned char *) buf + buflen;
+	GlobalTransactionId prev;
+	uint32		i;
+
+	if (buflen < sizeof(hdr))
+		return 0;
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (hdr.sw_version != GTM_SNAPSHOT_WIRE_VERSION ||
+		hdr.sw_xcnt > xip_size)
+		return 0;
+
+	prev = hdr.sw_xmin;
+	for (i = 0; i < hdr.sw_xcnt; i++)
+	{
+		uint32		delta = 0;
+		int			shift = 0;
+
+		do
+		{
+			if (p >= end || shift > 28)
+				return 0;
+			delta |= (uint32) (*p & 0x7F) << shift;
+			shift += 7;
+		} while (*p++ & 0x80);
+
+		prev += delta;
+		data->sn_xip[i] = prev;
+	}
+
+	data->sn_xmin = hdr.sw_xmin;
+	data->sn_xmax = hdr.sw_xmax;
+	data->sn_recent_global_xmin = hdr.sw_recent_global_xmin;
+	data->sn_xcnt = hdr.sw_xcnt;
+
+	return (const char *) p - buf;
+}
 
 /*
  * gtm_get_transactioninfo_size
@@ -310,6 +433,8 @@ gtm_serialize_transactioninfo(GTM_TransactionInfo *data, char *buf, size_t bufle
 	memcpy(buf + len, &(data->gti_vacuum), sizeof(bool));
 	len += sizeof(bool);
 
+	/* GTM_TransactionInfo.gti_open_index would not be serialized. */
+
 	return len;
 }
 
@@ -404,6 +529,8 @@ gtm_deserialize_transactioninfo(GTM_TransactionInfo *data, const char *buf, size
 	memcpy(&(data->gti_vacuum), buf + len, sizeof(bool));
 	len += sizeof(bool);
 
+	/* GTM_TransactionInfo.gti_open_index would not be serialized. */
+
 	return len;
 }
 
@@ -439,7 +566,7 @@ gtm_get_transactions_size(GTM_Transactions *data)
 		len += gtm_get_transactioninfo_size(&data->gt_transactions_array[i]);
 	}
 
-	/* NOTE: nothing to be done for gt_open_transactions */
+	/* NOTE: nothing to be done for gt_open_count and gt_open_handles */
 	/* NOTE: nothing to be done for gt_TransArrayLock */
 
 	return len;
@@ -0,0 +1,120 @@
+/*-------------------------------------------------------------------------
+ *
+ * gtm_trace.c
+ *	  Binary trace of the requests served by GTM or GTM proxy
+ *
+ * When trace_file is set, every request received from a client is appended
+ * to the file with its timing and sizes, so that the load can be replayed
+ * later with gtm_replay. The records go through a large stdio buffer under
+ * a single mutex, which keeps the cost per request to a copy.
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ *
+ * IDENTIFICATION
+ *	  src/gtm/common/gtm_trace.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include <sys/time.h>
+
+#include "gtm/gtm_c.h"
+#include "gtm/elog.h"
+#include "gtm/gtm_lock.h"
+#include "gtm/gtm_trace.h"
+
+#define TRACE_BUFFER_SIZE	(1024 * 1024)
+
+bool		GTM_TraceEnabled = false;
+
+static FILE *TraceFile = NULL;
+static uint64 TraceStart;
+static GTM_MutexLock TraceLock;
+
+uint64
+GTM_TraceNow(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Start writing the trace to the given file, replacing its contents. Must
+ * be called before the threads serving the clients are started.
+ */
+bool
+GTM_TraceOpen(const char *filename, bool proxy)
+{
+	GTM_TraceFileHeader header;
+
+	if ((TraceFile = fopen(filename, "w")) == NULL)
+	{
+		elog(LOG, "could not open trace file \"%s\": %m", filename);
+		return false;
+	}
+	setvbuf(TraceFile, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+	GTM_MutexLockInit(&TraceLock);
+
+	TraceStart = GTM_TraceNow();
+	memset(&header, 0, sizeof(header));
+	header.th_magic = GTM_TRACE_MAGIC;
+	header.th_version = GTM_TRACE_VERSION;
+	header.th_start = TraceStart;
+	header.th_proxy = proxy ? 1 : 0;
+	if (fwrite(&header, sizeof(header), 1, TraceFile) != 1)
+	{
+		elog(LOG, "could not write trace file \"%s\": %m", filename);
+		fclose(TraceFile);
+		TraceFile = NULL;
+		return false;
+	}
+
+	elog(LOG, "Tracing the requests to \"%s\".", filename);
+	GTM_TraceEnabled = true;
+	return true;
+}
+
+/*
+ * Flush and close the trace, at shutdown.
+ */
+void
+GTM_TraceClose(void)
+{
+	if (!GTM_TraceEnabled)
+		return;
+
+	GTM_MutexLockAcquire(&TraceLock);
+	GTM_TraceEnabled = false;
+	fclose(TraceFile);
+	TraceFile = NULL;
+	GTM_MutexLockRelease(&TraceLock);
+}
+
+/*
+ * Append a request to the trace. The caller fills in the record except for
+ * its times, given by received, the time the request was read from the
+ * client. data holds the record->tr_len bytes of the request.
+ */
+void
+GTM_TraceRequest(GTM_TraceRecord *record, uint64 received, const char *data)
+{
+	uint64		now = GTM_TraceNow();
+
+	record->tr_time = received > TraceStart ? received - TraceStart : 0;
+	record->tr_elapsed = now > received ? (uint32) (now - received) : 0;
+
+	GTM_MutexLockAcquire(&TraceLock);
+	if (TraceFile != NULL &&
+		(fwrite(record, sizeof(GTM_TraceRecord), 1, TraceFile) != 1 ||
+		 fwrite(data, 1, record->tr_len, TraceFile) != record->tr_len))
+	{
+		/* Stop tracing rather than leave a torn record behind more of them */
+		elog(LOG, "could not write trace file, tracing stopped: %m");
+		GTM_TraceEnabled = false;
+		fclose(TraceFile);
+		TraceFile = NULL;
+	}
+	GTM_MutexLockRelease(&TraceLock);
+}
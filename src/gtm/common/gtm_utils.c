@@ -17,6 +17,7 @@
 #include "gtm/elog.h"
 #include "gtm/gtm.h"
 #include "gtm/gtm_msg.h"
+#include "gtm/gtm_serialize.h"
 
 struct enum_name
 {
@@ -70,6 +71,8 @@ static struct enum_name message_name_tab[] =
 	{MSG_SNAPSHOT_GET, "MSG_SNAPSHOT_GET"},
 	{MSG_SNAPSHOT_GET_MULTI, "MSG_SNAPSHOT_GET_MULTI"},
 	{MSG_SNAPSHOT_GXID_GET, "MSG_SNAPSHOT_GXID_GET"},
+	{MSG_SNAPSHOT_CSN_GET, "MSG_SNAPSHOT_CSN_GET"},
+	{MSG_CSNLOG_GET, "MSG_CSNLOG_GET"},
 	{MSG_SEQUENCE_INIT, "MSG_SEQUENCE_INIT"},
 	{MSG_BKUP_SEQUENCE_INIT, "MSG_BKUP_SEQUENCE_INIT"},
 	{MSG_SEQUENCE_GET_CURRENT, "MSG_SEQUENCE_GET_CURRENT"},
@@ -94,6 +97,14 @@ static struct enum_name message_name_tab[] =
 	{MSG_BKUP_TXN_BEGIN_GETGXID_AUTOVACUUM, "MSG_BKUP_TXN_BEGIN_GETGXID_AUTOVACUUM"},
 	{MSG_DATA_FLUSH, "MSG_DATA_FLUSH"},
 	{MSG_BACKEND_DISCONNECT, "MSG_BACKEND_DISCONNECT"},
+	{MSG_BKUP_STATE_LOG, "MSG_BKUP_STATE_LOG"},
+	{MSG_GET_STATS, "MSG_GET_STATS"},
+	{MSG_TXN_LEASE_REPORT, "MSG_TXN_LEASE_REPORT"},
+	{MSG_BKUP_TXN_LEASE_REPORT, "MSG_BKUP_TXN_LEASE_REPORT"},
+	{MSG_SNAPSHOT_GET_READONLY, "MSG_SNAPSHOT_GET_READONLY"},
+	{MSG_BKUP_SNAPSHOT, "MSG_BKUP_SNAPSHOT"},
+	{MSG_GET_TIMESTAMP, "MSG_GET_TIMESTAMP"},
+	{MSG_GET_GLOBAL_XMIN, "MSG_GET_GLOBAL_XMIN"},
 	{MSG_TYPE_COUNT, "MSG_TYPE_COUNT"},
 	{-1, NULL}
 };
@@ -125,6 +136,8 @@ static struct enum_name result_name_tab[] =
 	{SNAPSHOT_GET_RESULT, "SNAPSHOT_GET_RESULT"},
 	{SNAPSHOT_GET_MULTI_RESULT, "SNAPSHOT_GET_MULTI_RESULT"},
 	{SNAPSHOT_GXID_GET_RESULT, "SNAPSHOT_GXID_GET_RESULT"},
+	{SNAPSHOT_CSN_GET_RESULT, "SNAPSHOT_CSN_GET_RESULT"},
+	{CSNLOG_GET_RESULT, "CSNLOG_GET_RESULT"},
 	{SEQUENCE_INIT_RESULT, "SEQUENCE_INIT_RESULT"},
 	{SEQUENCE_GET_CURRENT_RESULT, "SEQUENCE_GET_CURRENT_RESULT"},
 	{SEQUENCE_GET_NEXT_RESULT, "SEQUENCE_GET_NEXT_RESULT"},
@@ -138,6 +151,10 @@ static struct enum_name result_name_tab[] =
 	{TXN_GET_STATUS_RESULT, "TXN_GET_STATUS_RESULT"},
 	{TXN_GET_ALL_PREPARED_RESULT, "TXN_GET_ALL_PREPARED_RESULT"},
 	{TXN_BEGIN_GETGXID_AUTOVACUUM_RESULT, "TXN_BEGIN_GETGXID_AUTOVACUUM_RESULT"},
+	{GET_STATS_RESULT, "GET_STATS_RESULT"},
+	{SNAPSHOT_GET_STANDBY_RESULT, "SNAPSHOT_GET_STANDBY_RESULT"},
+	{GET_TIMESTAMP_RESULT, "GET_TIMESTAMP_RESULT"},
+	{GET_GLOBAL_XMIN_RESULT, "GET_GLOBAL_XMIN_RESULT"},
 	{RESULT_TYPE_COUNT, "RESULT_TYPE_COUNT"},
 	{-1, NULL}
 };
@@ -197,3 +214,21 @@ char *gtm_util_result_name(GTM_ResultType type)
 		return "UNKNOWN_RESULT";
 	return result_name[type];
 }
+
+/*
+ * gtm_send_snapshot_wire
+ * Append a snapshot in the wire format to a message
+ *
+ * This is here rather than with the rest of the wire format in
+ * gtm_serialize.c because it needs StringInfo, which the client programs
+ * linking gtm_serialize.o do not have.
+ */
+void
+gtm_send_snapshot_wire(StringInfo buf, GTM_SnapshotData *data)
+{
+	size_t		size = gtm_get_snapshot_wire_size(data);
+
+	enlargeStringInfo(buf, size);
+	buf->len += gtm_serialize_snapshot_wire(data, buf->data + buf->len, size);
+	buf->data[buf->len] = '\0';
+}
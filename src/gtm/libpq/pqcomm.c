@@ -858,6 +858,7 @@ internal_flush(Port *myport)
 
 		last_reported_send_errno = 0;	/* reset after any successful send */
 		bufptr += r;
+		myport->PqSentBytes += r;
 	}
 
 	myport->PqSendPointer = 0;
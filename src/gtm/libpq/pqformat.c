@@ -99,6 +99,25 @@ pq_beginmessage(StringInfo buf, char msgtype)
 	buf->cursor = msgtype;
 }
 
+/* --------------------------------
+ *		pq_beginmessage_reuse - initialize for sending a message, reuse buffer
+ *
+ * This requires the buffer to be allocated in a sufficiently long-lived
+ * memory context, such as the per-thread GTM_ReplyBuffer.
+ * --------------------------------
+ */
+void
+pq_beginmessage_reuse(StringInfo buf, char msgtype)
+{
+	resetStringInfo(buf);
+
+	/*
+	 * We stash the message type into the buffer's cursor field, expecting
+	 * that the pq_sendXXX routines won't touch it.
+	 */
+	buf->cursor = msgtype;
+}
+
 /* --------------------------------
  *		pq_sendbyte		- append a raw byte to a StringInfo buffer
  * --------------------------------
@@ -347,6 +366,20 @@ pq_endmessage(Port *myport, StringInfo buf)
 	buf->data = NULL;
 }
 
+/* --------------------------------
+ *		pq_endmessage_reuse - send the completed message to the frontend
+ *
+ * The data buffer is *not* freed, allowing the buffer to be reused with
+ * pq_beginmessage_reuse.
+ * --------------------------------
+ */
+void
+pq_endmessage_reuse(Port *myport, StringInfo buf)
+{
+	/* msgtype was saved in cursor field */
+	(void) pq_putmessage(myport, buf->cursor, buf->data, buf->len);
+}
+
 
 /* --------------------------------
  *		pq_puttextmessage - generate a character set-converted message in one step
@@ -1,40 +1,290 @@
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "gtm/gtm_c.h"
 #include "gtm/gtm_lock.h"
 #include "gtm/gtm_txn.h"
 #include "gtm/gtm_seq.h"
 #include "gtm/gtm_backup.h"
+#include "gtm/gtm_standby.h"
 #include "gtm/elog.h"
 
 GTM_RWLock gtm_bkup_lock;
-bool gtm_need_bkup;
 
 extern char GTMControlFile[];
+extern char GTMControlFileTmp[];
+extern char *GTMDataDir;
 
+/*
+ * GTM state log
+ *
+ * The control file holds a snapshot of the GXID and sequence restore points
+ * followed by the restore points changed since the snapshot was taken, so
+ * the cost of keeping them durable follows the rate of changes rather than
+ * the number of sequences. Records are added to an in-memory buffer first.
+ * A thread that needs them durable writes out everything buffered so far
+ * with a single fsync, on behalf of the other threads waiting for the same.
+ * Once the log grows past GTM_STATE_LOG_MAX_RECORDS the control file is
+ * rewritten from the current state, which starts an empty log.
+ *
+ * Writes to the file are serialized by gtm_bkup_lock. The buffer being
+ * filled is protected by StateLogInsertLock, the other one is only touched
+ * by the holder of gtm_bkup_lock while it is written out.
+ */
+typedef struct GTM_StateLogBuffer
+{
+	char	   *sb_data;
+	int			sb_len;
+	int			sb_size;
+	int			sb_records;
+} GTM_StateLogBuffer;
 
+static GTM_MutexLock StateLogInsertLock;
+static GTM_StateLogBuffer StateLogBuffers[2];
+static GTM_StateLogBuffer *StateLogInsert = &StateLogBuffers[0];
+static pg_atomic_uint64 StateLogInserted;	/* bytes added to the buffers */
+static pg_atomic_uint64 StateLogWritten;	/* bytes durable in the file */
+static int	StateLogFd = -1;
+static int	StateLogRecords;				/* records in the file */
+static bool StateLogStarted = false;
 
-void GTM_WriteRestorePoint(void)
+static bool GTM_RewriteControlFile(bool exact);
+
+
+/*
+ * Replace the control file with a snapshot of the current state, followed
+ * by an empty state log. The snapshot holds the restore points unless exact
+ * is true, which is only right once GTM stopped handing out GXIDs. The
+ * caller holds gtm_bkup_lock.
+ */
+static bool GTM_RewriteControlFile(bool exact)
 {
-	FILE *f = fopen(GTMControlFile, "w");
+	FILE *f = fopen(GTMControlFileTmp, "w");
+	int dirfd;
 
 	if (f == NULL)
 	{
 		ereport(LOG, (errno,
 					  errmsg("Cannot open control file"),
 					  errhint("%s", strerror(errno))));
+		return false;
+	}
+	if (exact)
+	{
+		GTM_SaveTxnInfo(f);
+		GTM_SaveSeqInfo(f);
+	}
+	else
+	{
+		GTM_WriteRestorePointXid(f);
+		GTM_WriteRestorePointSeq(f);
+	}
+	if (fflush(f) != 0 || fsync(fileno(f)) != 0)
+	{
+		ereport(LOG, (errno,
+					  errmsg("Cannot write control file"),
+					  errhint("%s", strerror(errno))));
+		fclose(f);
+		return false;
+	}
+	fclose(f);
+
+	if (rename(GTMControlFileTmp, GTMControlFile) != 0)
+	{
+		ereport(LOG, (errno,
+					  errmsg("Cannot rename control file"),
+					  errhint("%s", strerror(errno))));
+		return false;
+	}
+	/* Make the rename durable too */
+	if ((dirfd = open(GTMDataDir, O_RDONLY, 0)) >= 0)
+	{
+		fsync(dirfd);
+		close(dirfd);
+	}
+
+	/* The log goes on in the new file */
+	if (StateLogFd >= 0)
+		close(StateLogFd);
+	StateLogFd = open(GTMControlFile, O_WRONLY | O_APPEND, 0);
+	if (StateLogFd < 0)
+		ereport(LOG, (errno,
+					  errmsg("Cannot open control file"),
+					  errhint("%s", strerror(errno))));
+	StateLogRecords = 0;
+	return true;
+}
+
+/*
+ * Called once at startup, before any other thread is running.
+ */
+void GTM_InitStateLog(void)
+{
+	GTM_RWLockInit(&gtm_bkup_lock);
+	GTM_RWLockSetName(&gtm_bkup_lock, "BackupLock");
+	GTM_MutexLockInit(&StateLogInsertLock);
+	pg_atomic_init_u64(&StateLogInserted, 0);
+	pg_atomic_init_u64(&StateLogWritten, 0);
+}
+
+/*
+ * Start logging changes once the state is restored from the control file.
+ * The control file is rewritten first, so the log replayed at the next
+ * start only holds the changes made from now on.
+ */
+void GTM_StartStateLog(void)
+{
+	GTM_RWLockAcquire(&gtm_bkup_lock, GTM_LOCKMODE_WRITE);
+	GTM_RewriteControlFile(false);
+	StateLogStarted = true;
+	GTM_RWLockRelease(&gtm_bkup_lock);
+}
+
+/*
+ * Add a record to the state log. It is not durable until the next
+ * GTM_WriteRestorePoint() returns. Records are replayed in the order they
+ * are added, so callers add them while holding the lock protecting the
+ * state they describe.
+ */
+void GTM_AppendStateRecord(const char *record)
+{
+	int len = strlen(record);
+
+	/* Changes made while restoring are part of the snapshot taken at start */
+	if (!StateLogStarted)
 		return;
+
+	GTM_MutexLockAcquire(&StateLogInsertLock);
+	if (StateLogInsert->sb_len + len > StateLogInsert->sb_size)
+	{
+		int newsize = Max(StateLogInsert->sb_size * 2,
+						  StateLogInsert->sb_len + len + 1024);
+		char *data = realloc(StateLogInsert->sb_data, newsize);
+
+		if (data == NULL)
+		{
+			GTM_MutexLockRelease(&StateLogInsertLock);
+			ereport(FATAL, (ENOMEM, errmsg("Out of memory")));
+		}
+		StateLogInsert->sb_data = data;
+		StateLogInsert->sb_size = newsize;
 	}
+	memcpy(StateLogInsert->sb_data + StateLogInsert->sb_len, record, len);
+	StateLogInsert->sb_len += len;
+	StateLogInsert->sb_records++;
+	pg_atomic_add_fetch_u64(&StateLogInserted, len);
+	GTM_MutexLockRelease(&StateLogInsertLock);
+}
+
+/*
+ * Make all the state log records added so far durable. Threads arriving
+ * while the log is being written find their records written by the time
+ * they get the lock, so a single fsync serves all of them.
+ */
+void GTM_WriteRestorePoint(void)
+{
+	GTM_StateLogBuffer *buf;
+	uint64 upto;
+	char *data;
+	int len;
+
+	upto = pg_atomic_read_u64(&StateLogInserted);
+	if (pg_atomic_read_u64(&StateLogWritten) >= upto)
+		return;
+
 	GTM_RWLockAcquire(&gtm_bkup_lock, GTM_LOCKMODE_WRITE);
-	if (!gtm_need_bkup)
+	if (pg_atomic_read_u64(&StateLogWritten) >= upto)
 	{
 		GTM_RWLockRelease(&gtm_bkup_lock);
-		fclose(f);
 		return;
 	}
-	gtm_need_bkup = FALSE;
+
+	GTM_MutexLockAcquire(&StateLogInsertLock);
+	buf = StateLogInsert;
+	StateLogInsert = (buf == &StateLogBuffers[0]) ?
+		&StateLogBuffers[1] : &StateLogBuffers[0];
+	upto = pg_atomic_read_u64(&StateLogInserted);
+	GTM_MutexLockRelease(&StateLogInsertLock);
+
+	data = buf->sb_data;
+	len = buf->sb_len;
+	while (StateLogFd >= 0 && len > 0)
+	{
+		int written = write(StateLogFd, data, len);
+
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		data += written;
+		len -= written;
+	}
+	if (StateLogFd < 0 || len > 0 || fsync(StateLogFd) != 0)
+	{
+		/* The snapshot covers the records we failed to write */
+		ereport(LOG, (errno,
+					  errmsg("Cannot write GTM state log, rewriting control file"),
+					  errhint("%s", strerror(errno))));
+		GTM_RewriteControlFile(false);
+	}
+	else
+	{
+		StateLogRecords += buf->sb_records;
+		if (StateLogRecords > GTM_STATE_LOG_MAX_RECORDS)
+			GTM_RewriteControlFile(false);
+	}
+
+	/* The standby must know the restore points before we go past them */
+	gtm_standby_replicate_state_log(buf->sb_data, buf->sb_len);
+
+	buf->sb_len = 0;
+	buf->sb_records = 0;
+
+	pg_atomic_write_u64(&StateLogWritten, upto);
 	GTM_RWLockRelease(&gtm_bkup_lock);
+}
+
+/*
+ * Write the exact GXID and sequence values to the control file at shutdown.
+ * Buffered records are dropped, the values they hold are restore points
+ * ahead of the values written here.
+ */
+void GTM_WriteControlFile(void)
+{
+	GTM_RWLockAcquire(&gtm_bkup_lock, GTM_LOCKMODE_WRITE);
+	GTM_MutexLockAcquire(&StateLogInsertLock);
+	StateLogBuffers[0].sb_len = StateLogBuffers[0].sb_records = 0;
+	StateLogBuffers[1].sb_len = StateLogBuffers[1].sb_records = 0;
+	pg_atomic_write_u64(&StateLogWritten,
+						pg_atomic_read_u64(&StateLogInserted));
+	GTM_MutexLockRelease(&StateLogInsertLock);
+
+	GTM_RewriteControlFile(true);
+	GTM_RWLockRelease(&gtm_bkup_lock);
+}
+
+/*
+ * Build a snapshot of the restore points in the format of the state log
+ * records, to start the replication to a standby. The result is malloc'd.
+ */
+bool GTM_StateLogSnapshot(char **data, size_t *len)
+{
+	FILE *f = open_memstream(data, len);
+
+	if (f == NULL)
+	{
+		ereport(LOG, (errno,
+					  errmsg("Cannot build GTM state snapshot"),
+					  errhint("%s", strerror(errno))));
+		return false;
+	}
+	fprintf(f, "%s\t", GTM_STATE_XID_TAG);
 	GTM_WriteRestorePointXid(f);
 	GTM_WriteRestorePointSeq(f);
 	fclose(f);
+	return true;
 }
 
 void GTM_WriteBarrierBackup(char *barrier_id)
@@ -43,7 +293,6 @@ void GTM_WriteBarrierBackup(char *barrier_id)
 
 	FILE  *f;
 	char BarrierFilePath[MyMAXPATH+1];
-	extern char *GTMDataDir;
 
 	snprintf(BarrierFilePath, MyMAXPATH, "%s/GTM_%s.control", GTMDataDir, barrier_id);
 	if ((f = fopen(BarrierFilePath, "w")) == NULL)
@@ -53,14 +302,11 @@ void GTM_WriteBarrierBackup(char *barrier_id)
 					  errhint("%s", strerror(errno))));
 		return;
 	}
-	GTM_RWLockAcquire(&gtm_bkup_lock, GTM_LOCKMODE_WRITE);
-	gtm_need_bkup = FALSE;
-	GTM_RWLockRelease(&gtm_bkup_lock);
 	GTM_WriteRestorePointXid(f);
 	GTM_WriteRestorePointSeq(f);
 	fclose(f);
 }
-	
+
 
 void GTM_MakeBackup(char *path)
 {
@@ -78,14 +324,11 @@ void GTM_MakeBackup(char *path)
 	fclose(f);
 }
 
-void GTM_SetNeedBackup(void)
-{
-	GTM_RWLockAcquire(&gtm_bkup_lock, GTM_LOCKMODE_READ);
-	gtm_need_bkup = TRUE;
-	GTM_RWLockRelease(&gtm_bkup_lock);
-}
-
+/*
+ * Are there state log records which are not durable yet?
+ */
 bool GTM_NeedBackup(void)
 {
-	return gtm_need_bkup;
+	return pg_atomic_read_u64(&StateLogWritten) <
+		pg_atomic_read_u64(&StateLogInserted);
 }
@@ -48,10 +48,13 @@ extern int active_port;
 extern int GTM_StandbyMode;
 extern char *error_reporter;
 extern char *status_reader;
+extern char *GTMTraceFile;
 extern int log_min_messages;
 extern int tcp_keepalives_idle;
 extern int tcp_keepalives_count;
 extern int tcp_keepalives_interval;
+extern int GTMWorkerThreads;
+extern int GTMStandbySnapshotInterval;
 extern char *GTMDataDir;
 
 
@@ -191,6 +194,26 @@ struct config_int ConfigureNamesInt[] =
 		0, 0, INT_MAX,
 		0, NULL
 	},
+	{
+		{GTM_OPTNAME_WORKER_THREADS, GTMC_STARTUP,
+			gettext_noop("Number of worker threads serving the connections."),
+			gettext_noop("Zero starts a thread for each connection."),
+			0
+		},
+		&GTMWorkerThreads,
+		0, 0, INT_MAX,
+		0, NULL
+	},
+	{
+		{GTM_OPTNAME_STANDBY_SNAPSHOT_INTERVAL, GTMC_SIGHUP,
+			gettext_noop("Minimum time between snapshots sent to GTM-Standby for read-only transactions."),
+			gettext_noop("Zero does not send snapshots to GTM-Standby."),
+			GTMOPT_UNIT_MS
+		},
+		&GTMStandbySnapshotInterval,
+		0, 0, INT_MAX,
+		0, NULL
+	},
 	/* End-of-list marker */
 	{
 		{NULL, 0, NULL, NULL, 0}, NULL, 0, 0, 0, 0, NULL
@@ -299,6 +322,17 @@ struct config_string ConfigureNamesString[] =
 		NULL, NULL
 	},
 
+	{
+		{GTM_OPTNAME_TRACE_FILE, GTMC_STARTUP,
+			gettext_noop("File the requests are traced to."),
+			gettext_noop("The trace can be replayed with gtm_replay. Empty disables it."),
+			0
+		},
+		&GTMTraceFile,
+		"",
+		NULL, NULL
+	},
+
 	/* End-of-list marker */
 	{
 		{NULL, 0, NULL, NULL}, NULL, NULL, NULL, NULL
@@ -41,7 +41,8 @@ typedef struct GTM_SeqInfoHashBucket
 	GTM_RWLock	shb_lock;
 } GTM_SeqInfoHashBucket;
 
-#define SEQ_HASH_TABLE_SIZE		1024
+/* Must be a power of 2 */
+#define SEQ_HASH_TABLE_SIZE		4096
 static GTM_SeqInfoHashBucket GTMSequences[SEQ_HASH_TABLE_SIZE];
 
 static uint32 seq_gethash(GTM_SequenceKey key);
@@ -54,23 +55,43 @@ static int seq_remove_seqinfo(GTM_SeqInfo *seqinfo);
 static GTM_SequenceKey seq_copy_key(GTM_SequenceKey key);
 static int seq_drop_with_dbkey(GTM_SequenceKey nsp);
 static bool GTM_NeedSeqRestoreUpdateInternal(GTM_SeqInfo *seqinfo);
+static void advance_gs_value(GTM_SeqInfo *seqinfo);
+static void seq_log_seqinfo(GTM_SeqInfo *seqinfo);
+static void seq_read_state(FILE *ctlf, bool replicated);
+static bool seq_value_precedes(GTM_SeqInfo *seqinfo, GTM_Sequence a,
+							   GTM_Sequence b);
+static void seq_apply_restore_point(GTM_SequenceKey seqkey, GTM_Sequence value,
+									int32 state);
+static void encode_seq_key(GTM_SequenceKey seqkey, char *buffer);
 
 static GTM_Sequence get_rangemax(GTM_SeqInfo *seqinfo, GTM_Sequence range);
 
 /*
  * Get the hash value given the sequence key
  *
- * XXX This should probably be replaced by a better hash function.
+ * This is FNV-1a followed by the MurmurHash3 finalizer, so that names which
+ * differ by a character or two, like those of per-tenant sequences, spread
+ * over the whole table.
  */
 static uint32
 seq_gethash(GTM_SequenceKey key)
 {
-	uint32 total = 0;
+	uint32 hash = 2166136261U;
 	int ii;
 
 	for (ii = 0; ii < key->gsk_keylen; ii++)
-		total += key->gsk_key[ii];
-	return (total % SEQ_HASH_TABLE_SIZE);
+	{
+		hash ^= (unsigned char) key->gsk_key[ii];
+		hash *= 16777619U;
+	}
+
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+
+	return (hash & (SEQ_HASH_TABLE_SIZE - 1));
 }
 
 /*
@@ -92,6 +113,10 @@ seq_keys_equal(GTM_SequenceKey key1, GTM_SequenceKey key2)
  * Find the seqinfo structure for the given key. The reference count is
  * incremented before structure is returned. The caller must release the
  * reference to the structure when done with it
+ *
+ * The state of a sequence only changes under the write lock of its bucket,
+ * so the reference can be taken under the read lock without locking the
+ * sequence itself.
  */
 static GTM_SeqInfo *
 seq_find_seqinfo(GTM_SequenceKey seqkey)
@@ -115,16 +140,14 @@ seq_find_seqinfo(GTM_SequenceKey seqkey)
 
 	if (curr_seqinfo != NULL)
 	{
-		GTM_RWLockAcquire(&curr_seqinfo->gs_lock, GTM_LOCKMODE_WRITE);
 		if (curr_seqinfo->gs_state != SEQ_STATE_ACTIVE)
 		{
 			elog(LOG, "Sequence not active");
-			GTM_RWLockRelease(&curr_seqinfo->gs_lock);
+			GTM_RWLockRelease(&bucket->shb_lock);
 			return NULL;
 		}
-		Assert(curr_seqinfo->gs_ref_count != SEQ_MAX_REFCOUNT);
-		curr_seqinfo->gs_ref_count++;
-		GTM_RWLockRelease(&curr_seqinfo->gs_lock);
+		Assert(pg_atomic_read_u32(&curr_seqinfo->gs_ref_count) != SEQ_MAX_REFCOUNT);
+		pg_atomic_fetch_add_u32(&curr_seqinfo->gs_ref_count, 1);
 	}
 	GTM_RWLockRelease(&bucket->shb_lock);
 
@@ -140,15 +163,11 @@ seq_release_seqinfo(GTM_SeqInfo *seqinfo)
 {
 	bool remove = false;
 
-	GTM_RWLockAcquire(&seqinfo->gs_lock, GTM_LOCKMODE_WRITE);
-	Assert(seqinfo->gs_ref_count > 0);
-	seqinfo->gs_ref_count--;
-
-	if ((seqinfo->gs_state == SEQ_STATE_DELETED) &&
-		(seqinfo->gs_ref_count == 0))
+	Assert(pg_atomic_read_u32(&seqinfo->gs_ref_count) > 0);
+	if ((pg_atomic_sub_fetch_u32(&seqinfo->gs_ref_count, 1) == 0) &&
+		(seqinfo->gs_state == SEQ_STATE_DELETED))
 		remove = true;
 
-	GTM_RWLockRelease(&seqinfo->gs_lock);
 	/*
 	 * Remove the structure from the global hash table
 	 */
@@ -210,9 +229,15 @@ seq_remove_seqinfo(GTM_SeqInfo *seqinfo)
 	GTM_RWLockAcquire(&bucket->shb_lock, GTM_LOCKMODE_WRITE);
 	GTM_RWLockAcquire(&seqinfo->gs_lock, GTM_LOCKMODE_WRITE);
 
-	if (seqinfo->gs_ref_count > 1)
+	/* Log the removal once, a sequence marked for deletion is logged already */
+	if (seqinfo->gs_state != SEQ_STATE_DELETED)
 	{
 		seqinfo->gs_state = SEQ_STATE_DELETED;
+		seq_log_seqinfo(seqinfo);
+	}
+
+	if (pg_atomic_read_u32(&seqinfo->gs_ref_count) > 1)
+	{
 		GTM_RWLockRelease(&seqinfo->gs_lock);
 		GTM_RWLockRelease(&bucket->shb_lock);
 		return EBUSY;
@@ -269,7 +294,7 @@ GTM_SeqOpen(GTM_SequenceKey seqkey,
 
 	GTM_RWLockInit(&seqinfo->gs_lock);
 
-	seqinfo->gs_ref_count = 0;
+	pg_atomic_init_u32(&seqinfo->gs_ref_count, 0);
 	seqinfo->gs_key = seq_copy_key(seqkey);
 	seqinfo->gs_state = SEQ_STATE_ACTIVE;
 	seqinfo->gs_called = false;
@@ -351,8 +376,13 @@ GTM_SeqOpen(GTM_SequenceKey seqkey,
 		GTM_RWLockDestroy(&seqinfo->gs_lock);
 		pfree(seqinfo->gs_key);
 		pfree(seqinfo);
+		return errcode;
 	}
-	GTM_SetNeedBackup();
+
+	GTM_RWLockAcquire(&seqinfo->gs_lock, GTM_LOCKMODE_WRITE);
+	advance_gs_value(seqinfo);
+	seq_log_seqinfo(seqinfo);
+	GTM_RWLockRelease(&seqinfo->gs_lock);
 
 	return errcode;
 }
@@ -405,6 +435,9 @@ int GTM_SeqAlter(GTM_SequenceKey seqkey,
 	if (seqinfo->gs_init_value != startval)
 		seqinfo->gs_init_value = startval;
 
+	advance_gs_value(seqinfo);
+	seq_log_seqinfo(seqinfo);
+
 	/* Remove the old key with the old name */
 	GTM_RWLockRelease(&seqinfo->gs_lock);
 	seq_release_seqinfo(seqinfo);
@@ -434,7 +467,7 @@ GTM_SeqRestore(GTM_SequenceKey seqkey,
 
 	GTM_RWLockInit(&seqinfo->gs_lock);
 
-	seqinfo->gs_ref_count = 0;
+	pg_atomic_init_u32(&seqinfo->gs_ref_count, 0);
 	seqinfo->gs_key = seq_copy_key(seqkey);
 	seqinfo->gs_state = state;
 	seqinfo->gs_called = called;
@@ -543,7 +576,7 @@ seq_drop_with_dbkey(GTM_SequenceKey nsp)
 	{
 		bucket = &GTMSequences[ii];
 
-		GTM_RWLockAcquire(&bucket->shb_lock, GTM_LOCKMODE_READ);
+		GTM_RWLockAcquire(&bucket->shb_lock, GTM_LOCKMODE_WRITE);
 
 		prev = NULL;
 		cell = gtm_list_head(bucket->shb_list);
@@ -556,10 +589,14 @@ seq_drop_with_dbkey(GTM_SequenceKey nsp)
 			{
 				GTM_RWLockAcquire(&curr_seqinfo->gs_lock, GTM_LOCKMODE_WRITE);
 
-				if (curr_seqinfo->gs_ref_count > 1)
+				if (curr_seqinfo->gs_state != SEQ_STATE_DELETED)
 				{
 					curr_seqinfo->gs_state = SEQ_STATE_DELETED;
+					seq_log_seqinfo(curr_seqinfo);
+				}
 
+				if (pg_atomic_read_u32(&curr_seqinfo->gs_ref_count) > 1)
+				{
 					/* can not happen, be checked before called */
 					elog(LOG,"Sequence %s is in use, mark for deletion only",
 							 curr_seqinfo->gs_key->gsk_key);
@@ -625,7 +662,7 @@ GTM_SeqRename(GTM_SequenceKey seqkey, GTM_SequenceKey newseqkey)
 	GTM_RWLockAcquire(&seqinfo->gs_lock, GTM_LOCKMODE_WRITE);
 	GTM_RWLockInit(&newseqinfo->gs_lock);
 
-	newseqinfo->gs_ref_count = 0;
+	pg_atomic_init_u32(&newseqinfo->gs_ref_count, 0);
 	newseqinfo->gs_key = seq_copy_key(newseqkey);
 	newseqinfo->gs_state = seqinfo->gs_state;
 	newseqinfo->gs_called = seqinfo->gs_called;
@@ -657,6 +694,10 @@ GTM_SeqRename(GTM_SequenceKey seqkey, GTM_SequenceKey newseqkey)
 		return errcode;
 	}
 
+	GTM_RWLockAcquire(&newseqinfo->gs_lock, GTM_LOCKMODE_WRITE);
+	seq_log_seqinfo(newseqinfo);
+	GTM_RWLockRelease(&newseqinfo->gs_lock);
+
 	/* Remove the old key with the old name */
 	GTM_RWLockRelease(&seqinfo->gs_lock);
 	/* Release first the structure as it has been taken previously */
@@ -807,6 +848,9 @@ GTM_SeqSetVal(GTM_SequenceKey seqkey, char *coord_name,
 	if (!iscalled)
 		seq_set_lastval(seqinfo, coord_name, coord_procid, nextval);
 
+	advance_gs_value(seqinfo);
+	seq_log_seqinfo(seqinfo);
+
 	/* Remove the old key with the old name */
 	GTM_RWLockRelease(&seqinfo->gs_lock);
 	seq_release_seqinfo(seqinfo);
@@ -915,6 +959,13 @@ GTM_SeqGetNext(GTM_SequenceKey seqkey, char *coord_name,
 	 */
 	seq_set_lastval(seqinfo, coord_name, coord_procid, *rangemax);
 	seqinfo->gs_value = *rangemax;
+
+	/* Move the restore point ahead once we reach it */
+	if (GTM_NeedSeqRestoreUpdateInternal(seqinfo))
+	{
+		advance_gs_value(seqinfo);
+		seq_log_seqinfo(seqinfo);
+	}
 	GTM_RWLockRelease(&seqinfo->gs_lock);
 	seq_release_seqinfo(seqinfo);
 	return 0;
@@ -988,10 +1039,10 @@ GTM_SeqReset(GTM_SequenceKey seqkey)
 
 	GTM_RWLockAcquire(&seqinfo->gs_lock, GTM_LOCKMODE_WRITE);
 	seqinfo->gs_value = seqinfo->gs_backedUpValue = seqinfo->gs_init_value;
+	advance_gs_value(seqinfo);
+	seq_log_seqinfo(seqinfo);
+	GTM_RWLockRelease(&seqinfo->gs_lock);
 
-	GTM_RWLockRelease(&gtm_bkup_lock);
-
-	GTM_SetNeedBackup();
 	seq_release_seqinfo(seqinfo);
 	return 0;
 }
@@ -1091,8 +1142,8 @@ ProcessSequenceInitCommand(Port *myport, StringInfo message, bool is_backup)
 
 			elog(DEBUG1, "open_sequence() returns rc %d.", rc);
 		}
-		/* Save control file with new seq info */
-        SaveControlInfo();
+		/* Make the new sequence durable */
+		GTM_WriteRestorePoint();
 		/*
 		 * Send a SUCCESS message back to the client
 		 */
@@ -1207,8 +1258,8 @@ ProcessSequenceAlterCommand(Port *myport, StringInfo message, bool is_backup)
 
 			elog(DEBUG1, "alter_sequence() returns rc %d.", rc);
 		}
-		/* Save control file info */
-        SaveControlInfo();
+		/* Make the restore point of the sequence durable */
+		GTM_WriteRestorePoint();
 
 		pq_beginmessage(&buf, 'S');
 		pq_sendint(&buf, SEQUENCE_ALTER_RESULT, 4);
@@ -1364,7 +1415,7 @@ void
 ProcessSequenceGetCurrentCommand(Port *myport, StringInfo message)
 {
 	GTM_SequenceKeyData seqkey;
-	StringInfoData buf;
+	StringInfo	buf = GTM_ReplyBuffer;
 	GTM_Sequence seqval;
 	uint32 coord_namelen;
 	char  *coord_name;
@@ -1384,18 +1435,18 @@ ProcessSequenceGetCurrentCommand(Port *myport, StringInfo message)
 
 	elog(DEBUG1, "Getting current value %ld for sequence %s", seqval, seqkey.gsk_key);
 
-	pq_beginmessage(&buf, 'S');
-	pq_sendint(&buf, SEQUENCE_GET_CURRENT_RESULT, 4);
+	pq_beginmessage_reuse(buf, 'S');
+	pq_sendint(buf, SEQUENCE_GET_CURRENT_RESULT, 4);
 	if (myport->remote_type == GTM_NODE_GTM_PROXY)
 	{
 		GTM_ProxyMsgHeader proxyhdr;
 		proxyhdr.ph_conid = myport->conn_id;
-		pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+		pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 	}
-	pq_sendint(&buf, seqkey.gsk_keylen, 4);
-	pq_sendbytes(&buf, seqkey.gsk_key, seqkey.gsk_keylen);
-	pq_sendbytes(&buf, (char *)&seqval, sizeof (GTM_Sequence));
-	pq_endmessage(myport, &buf);
+	pq_sendint(buf, seqkey.gsk_keylen, 4);
+	pq_sendbytes(buf, seqkey.gsk_key, seqkey.gsk_keylen);
+	pq_sendbytes(buf, (char *)&seqval, sizeof (GTM_Sequence));
+	pq_endmessage_reuse(myport, buf);
 
 	if (myport->remote_type != GTM_NODE_GTM_PROXY)
 		/* Don't flush to the standby because this does not change the status */
@@ -1436,7 +1487,7 @@ void
 ProcessSequenceGetNextCommand(Port *myport, StringInfo message, bool is_backup)
 {
 	GTM_SequenceKeyData seqkey;
-	StringInfoData buf;
+	StringInfo	buf = GTM_ReplyBuffer;
 	GTM_Sequence seqval;
 	GTM_Sequence range;
 	GTM_Sequence rangemax;
@@ -1489,23 +1540,23 @@ ProcessSequenceGetNextCommand(Port *myport, StringInfo message, bool is_backup)
 
 			elog(DEBUG1, "get_next() returns GTM_Sequence %ld.", loc_seq);
 		}
-		/* Save control file info */
-        SaveControlInfo();
+		/* Make the restore point of the sequence durable */
+		GTM_WriteRestorePoint();
 
 		/* Respond to the client */
-		pq_beginmessage(&buf, 'S');
-		pq_sendint(&buf, SEQUENCE_GET_NEXT_RESULT, 4);
+		pq_beginmessage_reuse(buf, 'S');
+		pq_sendint(buf, SEQUENCE_GET_NEXT_RESULT, 4);
 		if (myport->remote_type == GTM_NODE_GTM_PROXY)
 		{
 			GTM_ProxyMsgHeader proxyhdr;
 			proxyhdr.ph_conid = myport->conn_id;
-			pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+			pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 		}
-		pq_sendint(&buf, seqkey.gsk_keylen, 4);
-		pq_sendbytes(&buf, seqkey.gsk_key, seqkey.gsk_keylen);
-		pq_sendbytes(&buf, (char *)&seqval, sizeof (GTM_Sequence));
-		pq_sendbytes(&buf, (char *)&rangemax, sizeof (GTM_Sequence));
-		pq_endmessage(myport, &buf);
+		pq_sendint(buf, seqkey.gsk_keylen, 4);
+		pq_sendbytes(buf, seqkey.gsk_key, seqkey.gsk_keylen);
+		pq_sendbytes(buf, (char *)&seqval, sizeof (GTM_Sequence));
+		pq_sendbytes(buf, (char *)&rangemax, sizeof (GTM_Sequence));
+		pq_endmessage_reuse(myport, buf);
 
 		if (myport->remote_type != GTM_NODE_GTM_PROXY)
 		{
@@ -1602,8 +1653,8 @@ ProcessSequenceSetValCommand(Port *myport, StringInfo message, bool is_backup)
 
 			elog(DEBUG1, "set_val() returns rc %d.", rc);
 		}
-		/* Save control file info */
-        SaveControlInfo();
+		/* Make the restore point of the sequence durable */
+		GTM_WriteRestorePoint();
 
 		/* Respond to the client */
 		pq_beginmessage(&buf, 'S');
@@ -1675,8 +1726,8 @@ ProcessSequenceResetCommand(Port *myport, StringInfo message, bool is_backup)
 
 			elog(DEBUG1, "reset_sequence() returns rc %d.", rc);
 		}
-		/* Save control file info */
-        SaveControlInfo();
+		/* Make the restore point of the sequence durable */
+		GTM_WriteRestorePoint();
 
 		/* Respond to the client */
 		pq_beginmessage(&buf, 'S');
@@ -1750,8 +1801,8 @@ ProcessSequenceCloseCommand(Port *myport, StringInfo message, bool is_backup)
 
 			elog(DEBUG1, "close_sequence() returns rc %d.", rc);
 		}
-		/* Save control file info */
-        SaveControlInfo();
+		/* Make the removal durable */
+		GTM_WriteRestorePoint();
 
 		/* Respond to the client */
 		pq_beginmessage(&buf, 'S');
@@ -1840,8 +1891,8 @@ ProcessSequenceRenameCommand(Port *myport, StringInfo message, bool is_backup)
 
 			elog(DEBUG1, "rename_sequence() returns rc %d.", rc);
 		}
-		/* Save control file info */
-        SaveControlInfo();
+		/* Make the renamed sequence durable */
+		GTM_WriteRestorePoint();
 
 		/* Send a SUCCESS message back to the client */
 		pq_beginmessage(&buf, 'S');
@@ -2023,11 +2074,12 @@ static bool GTM_NeedSeqRestoreUpdateInternal(GTM_SeqInfo *seqinfo)
 	if (!SEQ_IS_CALLED(seqinfo))
 		/* The first call.  Must backup */
 		return TRUE;
+	/* The next value would go past the restore point */
 	distance = distanceToBackedUpSeqValue(seqinfo);
 	if (SEQ_IS_ASCENDING(seqinfo))
-		return(distance >= seqinfo->gs_increment_by);
+		return(distance < seqinfo->gs_increment_by);
 	else
-		return(distance <= seqinfo->gs_increment_by);
+		return(distance > seqinfo->gs_increment_by);
 }
 
 
@@ -2112,48 +2164,103 @@ static void advance_gs_value(GTM_SeqInfo *seqinfo)
 }
 
 
+/*
+ * Append the restore point of the sequence to the GTM state log, or its
+ * removal once it is marked deleted. The caller holds gs_lock in write mode,
+ * so the records of a sequence are logged in the order of its changes.
+ */
 static void
-GTM_UpdateRestorePointSeq(void)
+seq_log_seqinfo(GTM_SeqInfo *seqinfo)
 {
-	GTM_SeqInfoHashBucket *bucket;
-	gtm_ListCell *elem;
-	GTM_SeqInfo *seqinfo = NULL;
-	int hash;
-
-	for (hash = 0; hash < SEQ_HASH_TABLE_SIZE; hash++)
-	{
-		bucket = &GTMSequences[hash];
-
-		GTM_RWLockAcquire(&bucket->shb_lock, GTM_LOCKMODE_READ);
-
-		gtm_foreach(elem, bucket->shb_list)
-		{
-			seqinfo = (GTM_SeqInfo *) gtm_lfirst(elem);
-			if (seqinfo == NULL)
-				break;
-
-			if (seqinfo->gs_state == SEQ_STATE_DELETED)
-				continue;
-
-			GTM_RWLockAcquire(&seqinfo->gs_lock, GTM_LOCKMODE_READ);
-			advance_gs_value(seqinfo);
-			GTM_RWLockRelease(&seqinfo->gs_lock);
-		}
-
-		GTM_RWLockRelease(&bucket->shb_lock);
-	}
-
+	char buffer[1024];
+	char record[1280];
+
+	encode_seq_key(seqinfo->gs_key, buffer);
+	snprintf(record, sizeof(record), "%s\t%ld\t%ld\t%ld\t%ld\t%ld\t%c\t%c\t%x\n",
+			 buffer, seqinfo->gs_backedUpValue,
+			 seqinfo->gs_init_value, seqinfo->gs_increment_by,
+			 seqinfo->gs_min_value, seqinfo->gs_max_value,
+			 (seqinfo->gs_cycle ? 't' : 'f'),
+			 (seqinfo->gs_called ? 't' : 'f'),
+			 seqinfo->gs_state);
+	GTM_AppendStateRecord(record);
 }
 
-
+/*
+ * Write the restore points of all the sequences. They are kept ahead of the
+ * values handed out, any sequence reaching its restore point logs a new one.
+ */
 void GTM_WriteRestorePointSeq(FILE *ctlf)
 {
-	GTM_UpdateRestorePointSeq();
 	GTM_SaveSeqInfo2(ctlf, TRUE);
 }
 
+/*
+ * Restore the sequences from the control file, then replay the state log
+ * following them. A record of a sequence restored already replaces it.
+ */
 void
 GTM_RestoreSeqInfo(FILE *ctlf)
+{
+	seq_read_state(ctlf, false);
+}
+
+/*
+ * Apply the state log records replicated from the active GTM. They only
+ * move the restore points ahead, the sequences themselves are kept up to
+ * date by the backup messages.
+ */
+void
+GTM_ApplyStateLog(FILE *f)
+{
+	seq_read_state(f, true);
+}
+
+/*
+ * Is the sequence value a reached before b? Cycling sequences may wrap
+ * around between the two, the latest value replicated wins for them.
+ */
+static bool
+seq_value_precedes(GTM_SeqInfo *seqinfo, GTM_Sequence a, GTM_Sequence b)
+{
+	if (SEQ_IS_CYCLE(seqinfo))
+		return a != b;
+	if (SEQ_IS_ASCENDING(seqinfo))
+		return a < b;
+	return a > b;
+}
+
+/*
+ * Raise the restore point of a sequence to the one replicated from the
+ * active GTM. Sequences we don't know about yet are skipped, the backup of
+ * their creation sets the same restore point the active GTM did.
+ */
+static void
+seq_apply_restore_point(GTM_SequenceKey seqkey, GTM_Sequence value, int32 state)
+{
+	GTM_SeqInfo *seqinfo;
+
+	if (state == SEQ_STATE_DELETED)
+		return;
+	if ((seqinfo = seq_find_seqinfo(seqkey)) == NULL)
+		return;
+
+	GTM_RWLockAcquire(&seqinfo->gs_lock, GTM_LOCKMODE_WRITE);
+	if (seq_value_precedes(seqinfo, seqinfo->gs_backedUpValue, value))
+	{
+		seqinfo->gs_backedUpValue = value;
+		seq_log_seqinfo(seqinfo);
+	}
+	GTM_RWLockRelease(&seqinfo->gs_lock);
+	seq_release_seqinfo(seqinfo);
+}
+
+/*
+ * Read sequence records and GXID restore points from the control file or
+ * from the state log replicated from the active GTM.
+ */
+static void
+seq_read_state(FILE *ctlf, bool replicated)
 {
 	char seqname[1024];
 
@@ -2173,7 +2280,24 @@ GTM_RestoreSeqInfo(FILE *ctlf)
 		bool called;
 		char boolval[16];
 
+		if (strcmp(seqname, GTM_STATE_XID_TAG) == 0)
+		{
+			GlobalTransactionId gxid;
+
+			if (fscanf(ctlf, "%u", &gxid) != 1)
+			{
+				elog(WARNING, "Corrupted control file");
+				return;
+			}
+			if (replicated)
+				GTM_ApplyRestorePointXid(gxid);
+			else
+				GTM_RestoreTxnRestorePoint(gxid);
+			continue;
+		}
+
 		decode_seq_key(seqname, &seqkey);
+		seqkey.gsk_type = GTM_SEQ_FULL_NAME;
 
 		if (fscanf(ctlf, "%ld", &curval) != 1)
 		{
@@ -2223,8 +2347,56 @@ GTM_RestoreSeqInfo(FILE *ctlf)
 			elog(WARNING, "Corrupted control file");
 			return;
 		}
-		GTM_SeqRestore(&seqkey, increment_by, minval, maxval, startval, curval,
-					   state, cycle, called);
+		if (replicated)
+			seq_apply_restore_point(&seqkey, curval, state);
+		else
+		{
+			GTM_SeqClose(&seqkey);
+			if (state != SEQ_STATE_DELETED)
+				GTM_SeqRestore(&seqkey, increment_by, minval, maxval, startval,
+							   curval, state, cycle, called);
+		}
+		pfree(seqkey.gsk_key);
+	}
+}
+
+/*
+ * Move every sequence to its restore point when this standby is promoted.
+ * The active GTM never hands out values past a restore point before it is
+ * replicated here, nor past the restore point it set from a value we got
+ * in our initial backup or in a backup message since then.
+ */
+void
+GTM_SeqPromoteRestorePoints(void)
+{
+	int i;
+
+	for (i = 0; i < SEQ_HASH_TABLE_SIZE; i++)
+	{
+		GTM_SeqInfoHashBucket *bucket = &GTMSequences[i];
+		gtm_ListCell *elem;
+
+		GTM_RWLockAcquire(&bucket->shb_lock, GTM_LOCKMODE_READ);
+		gtm_foreach(elem, bucket->shb_list)
+		{
+			GTM_SeqInfo *seqinfo = (GTM_SeqInfo *) gtm_lfirst(elem);
+			GTM_Sequence replicated;
+
+			GTM_RWLockAcquire(&seqinfo->gs_lock, GTM_LOCKMODE_WRITE);
+			if (seqinfo->gs_state == SEQ_STATE_ACTIVE)
+			{
+				replicated = seqinfo->gs_backedUpValue;
+				advance_gs_value(seqinfo);
+				if (!SEQ_IS_CYCLE(seqinfo) &&
+					seq_value_precedes(seqinfo, seqinfo->gs_backedUpValue,
+									   replicated))
+					seqinfo->gs_backedUpValue = replicated;
+				seqinfo->gs_value = seqinfo->gs_backedUpValue;
+				seq_log_seqinfo(seqinfo);
+			}
+			GTM_RWLockRelease(&seqinfo->gs_lock);
+		}
+		GTM_RWLockRelease(&bucket->shb_lock);
 	}
 }
 
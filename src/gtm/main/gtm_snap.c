@@ -17,13 +17,85 @@
 #include "gtm/elog.h"
 #include "gtm/gtm.h"
 #include "gtm/gtm_client.h"
+#include "gtm/gtm_serialize.h"
 #include "gtm/gtm_standby.h"
+#include "gtm/gtm_utils.h"
+#include "gtm/standby_utils.h"
 #include "gtm/stringinfo.h"
 #include "gtm/libpq.h"
 #include "gtm/libpq-int.h"
 #include "gtm/pqformat.h"
+#include "port/atomics.h"
 
-static GTM_SnapshotData localSnapshot;
+/*
+ * The last snapshot built by GTM_GetTransactionSnapshot(). Snapshots only
+ * change when transactions complete: new transactions get GXIDs beyond xmax
+ * and xmins not below the one of the snapshot. So while gt_snapshot_generation
+ * does not change, snapshot requests copy the cached one instead of scanning
+ * the open transactions again.
+ *
+ * The cache is filled by readers of gt_TransArrayLock, hence its own lock.
+ */
+typedef struct GTM_SnapshotCache
+{
+	GTM_RWLock			sc_lock;
+	bool				sc_valid;
+	uint64				sc_generation;
+	GTM_SnapshotData	sc_snapshot;
+} GTM_SnapshotCache;
+
+static GTM_SnapshotCache snapshotCache;
+
+/*
+ * Snapshots for read-only transactions on the standby
+ *
+ * With standby_snapshot_interval set, the GTM sends the snapshot it just
+ * built to the standby at most once per interval, along with its next GXID
+ * at that moment. The standby keeps the latest one and serves it to
+ * MSG_SNAPSHOT_GET_READONLY requests of transactions whose GXID precedes
+ * that next GXID: they started before the snapshot was taken, so it shows
+ * them all the transactions completed before they started.
+ *
+ * The standby never asks the GTM for a snapshot, so new transactions get
+ * the global xmin of the GTM as their xmin right away (see
+ * init_GTM_TransactionInfo), which keeps the GTM from letting VACUUM remove
+ * rows the snapshot of the standby may still see.
+ */
+typedef struct GTM_StandbySnapshot
+{
+	GTM_RWLock			ss_lock;
+	bool				ss_valid;
+	GlobalTransactionId	ss_next_gxid;
+	GTM_SnapshotData	ss_snapshot;
+} GTM_StandbySnapshot;
+
+extern int GTMStandbySnapshotInterval;
+
+static GTM_StandbySnapshot standbySnapshot;
+static pg_atomic_uint64 standbySnapshotSent;	/* time of the last one sent */
+
+static bool GTM_ClaimStandbySnapshot(void);
+
+/*
+ * Commit sequence number snapshots
+ *
+ * Every completion of a transaction holding a GXID takes the next CSN and
+ * its GXID is stored in csnLog, a ring of the latest completions indexed by
+ * CSN. Whoever completes transactions, with gt_TransArrayLock held in write
+ * mode, then publishes csnSnapshot: the next CSN together with the xmin,
+ * xmax and global xmin a regular snapshot would get at that moment. The
+ * publication is guarded by csnSnapshotSeq, which is odd while it is in
+ * progress, so snapshot requests copy csnSnapshot without taking any lock
+ * and retry if it changed under them.
+ *
+ * Nodes fetch the ring to learn which transactions completed before a given
+ * CSN and build the list of running transactions themselves.
+ */
+static uint32 csnEpoch;
+static volatile GTM_CSN csnNext = FirstCSN;
+static GlobalTransactionId csnLog[GTM_CSNLOG_SIZE];
+static volatile uint32 csnSnapshotSeq = 0;
+static GTM_CSNSnapshotData csnSnapshot;
 /*
  * Get snapshot for the given transactions. If this is the first call in the
  * transaction, a fresh snapshot is taken and returned back. For a serializable
@@ -57,7 +129,6 @@ GTM_GetTransactionSnapshot(GTM_TransactionHandle handle[], int txn_count, int *s
 	GlobalTransactionId xmax;
 	GlobalTransactionId globalxmin;
 	int			count = 0;
-	gtm_ListCell *elem = NULL;
 	int ii;
 
 	/*
@@ -67,6 +138,7 @@ GTM_GetTransactionSnapshot(GTM_TransactionHandle handle[], int txn_count, int *s
 	 */
 	GTM_TransactionInfo *mygtm_txninfo = NULL;
 	GTM_Snapshot snapshot = NULL;
+	GlobalTransactionId standby_next_gxid = InvalidGlobalTransactionId;
 
 	memset(status, 0, sizeof (int) * txn_count);
 
@@ -91,10 +163,11 @@ GTM_GetTransactionSnapshot(GTM_TransactionHandle handle[], int txn_count, int *s
 
 	/*
 	 * If no valid transaction exists in the array, we record the snapshot in a
-	 * local strucure and still send it out to the caller
+	 * per-thread structure and still send it out to the caller. It must not
+	 * be shared, other threads may be building their own at the same time.
 	 */
 	if (snapshot == NULL)
-		snapshot = &localSnapshot;
+		snapshot = GTM_ThreadSnapshot;
 
 	Assert(snapshot != NULL);
 
@@ -117,6 +190,25 @@ GTM_GetTransactionSnapshot(GTM_TransactionHandle handle[], int txn_count, int *s
 	 */
 	GTM_RWLockAcquire(&GTMTransactions.gt_TransArrayLock, GTM_LOCKMODE_READ);
 
+	/*
+	 * Nothing completed since the cached snapshot was built, it is the one we
+	 * would build.
+	 */
+	GTM_RWLockAcquire(&snapshotCache.sc_lock, GTM_LOCKMODE_READ);
+	if (snapshotCache.sc_valid &&
+		snapshotCache.sc_generation == GTMTransactions.gt_snapshot_generation)
+	{
+		xmin = snapshotCache.sc_snapshot.sn_xmin;
+		xmax = snapshotCache.sc_snapshot.sn_xmax;
+		globalxmin = snapshotCache.sc_snapshot.sn_recent_global_xmin;
+		count = snapshotCache.sc_snapshot.sn_xcnt;
+		memcpy(snapshot->sn_xip, snapshotCache.sc_snapshot.sn_xip,
+			   sizeof (GlobalTransactionId) * count);
+		GTM_RWLockRelease(&snapshotCache.sc_lock);
+		goto snapshot_done;
+	}
+	GTM_RWLockRelease(&snapshotCache.sc_lock);
+
 	/* xmax is always latestCompletedXid + 1 */
 	xmax = GTMTransactions.gt_latestCompletedXid;
 	Assert(GlobalTransactionIdIsNormal(xmax));
@@ -129,9 +221,9 @@ GTM_GetTransactionSnapshot(GTM_TransactionHandle handle[], int txn_count, int *s
 	 * Spin over transaction list checking xid, xmin, and subxids.  The goal is to
 	 * gather all active xids and find the lowest xmin
 	 */
-	gtm_foreach(elem, GTMTransactions.gt_open_transactions)
+	for (ii = 0; ii < GTMTransactions.gt_open_count; ii++)
 	{
-		volatile GTM_TransactionInfo *gtm_txninfo = (GTM_TransactionInfo *)gtm_lfirst(elem);
+		volatile GTM_TransactionInfo *gtm_txninfo = GTM_OpenTransaction(ii);
 		GlobalTransactionId xid;
 
 		/* Don't take into account LAZY VACUUMs */
@@ -186,11 +278,51 @@ GTM_GetTransactionSnapshot(GTM_TransactionHandle handle[], int txn_count, int *s
 
 	GTMTransactions.gt_recent_global_xmin = globalxmin;
 
+	/*
+	 * Sort the GXIDs, so that they are sent as small distances from each
+	 * other. The open transactions are mostly in GXID order already, an
+	 * insertion sort costs little more than a pass over them.
+	 */
+	for (ii = 1; ii < count; ii++)
+	{
+		GlobalTransactionId xid = snapshot->sn_xip[ii];
+		int			jj = ii;
+
+		while (jj > 0 && snapshot->sn_xip[jj - 1] - xmin > xid - xmin)
+		{
+			snapshot->sn_xip[jj] = snapshot->sn_xip[jj - 1];
+			jj--;
+		}
+		snapshot->sn_xip[jj] = xid;
+	}
+
+	GTM_RWLockAcquire(&snapshotCache.sc_lock, GTM_LOCKMODE_WRITE);
+	snapshotCache.sc_snapshot.sn_xmin = xmin;
+	snapshotCache.sc_snapshot.sn_xmax = xmax;
+	snapshotCache.sc_snapshot.sn_xcnt = count;
+	snapshotCache.sc_snapshot.sn_recent_global_xmin = globalxmin;
+	memcpy(snapshotCache.sc_snapshot.sn_xip, snapshot->sn_xip,
+		   sizeof (GlobalTransactionId) * count);
+	snapshotCache.sc_generation = GTMTransactions.gt_snapshot_generation;
+	snapshotCache.sc_valid = true;
+	GTM_RWLockRelease(&snapshotCache.sc_lock);
+
+snapshot_done:
 	snapshot->sn_xmin = xmin;
 	snapshot->sn_xmax = xmax;
 	snapshot->sn_xcnt = count;
 	snapshot->sn_recent_global_xmin = globalxmin;
 
+	/*
+	 * No transaction can complete while we hold gt_TransArrayLock, so the
+	 * snapshot shows all the transactions completed before any GXID below
+	 * the next one was assigned.
+	 */
+	if (GTMStandbySnapshotInterval > 0 &&
+		GetMyThreadInfo->thr_conn->standby &&
+		GTM_ClaimStandbySnapshot())
+		standby_next_gxid = ReadNewGlobalTransactionId();
+
 	/*
 	 * Now, before the proc array lock is released, set the xmin in the txninfo
 	 * structures of all the transactions.
@@ -272,45 +404,85 @@ GTM_GetTransactionSnapshot(GTM_TransactionHandle handle[], int txn_count, int *s
 	elog(DEBUG1, "GTM_GetTransactionSnapshot: (%u:%u:%u:%u)",
 			snapshot->sn_xmin, snapshot->sn_xmax,
 			snapshot->sn_xcnt, snapshot->sn_recent_global_xmin);
+
+	/* A lost snapshot only delays the next one, do not retry */
+	if (GlobalTransactionIdIsValid(standby_next_gxid))
+	{
+		GTM_Conn *oldconn = GetMyThreadInfo->thr_conn->standby;
+		int count = 0;
+
+		if (bkup_publish_snapshot(oldconn, standby_next_gxid, snapshot) != 0)
+			gtm_standby_check_communication_error(&count, oldconn);
+	}
+
 	return snapshot;
 }
 
+/*
+ * Is it time to send a snapshot to the standby? Only one of the threads
+ * getting there at the same time is told so.
+ */
+static bool
+GTM_ClaimStandbySnapshot(void)
+{
+	uint64		now = gtm_stat_now();
+	uint64		last = pg_atomic_read_u64(&standbySnapshotSent);
+
+	if (now >= last &&
+		now - last < (uint64) GTMStandbySnapshotInterval * 1000)
+		return false;
+
+	return pg_atomic_compare_exchange_u64(&standbySnapshotSent, &last, now);
+}
+
 /*
  * Process MSG_SNAPSHOT_GET command
+ *
+ * With get_gxid, process MSG_SNAPSHOT_GXID_GET instead: start a new
+ * transaction and reply with its GXID and timestamp along with its first
+ * snapshot, saving the client a round trip.
  */
 void
 ProcessGetSnapshotCommand(Port *myport, StringInfo message, bool get_gxid)
 {
-	StringInfoData buf;
+	StringInfo	buf = GTM_ReplyBuffer;
 	GTM_TransactionHandle txn;
 	GlobalTransactionId gxid;
+	GTM_Timestamp timestamp = 0;
 	GTM_Snapshot snapshot;
 	MemoryContext oldContext;
 	int status;
 	int txn_count;
 	const char *data = NULL;
 
-	txn_count = pq_getmsgint(message, sizeof (int));
-	Assert(txn_count == 1);
-
-	data = pq_getmsgbytes(message, sizeof (gxid));
-	if (data == NULL)
-		ereport(ERROR,
-				(EPROTO,
-				 errmsg("Message does not contain valid GXID")));
-	memcpy(&gxid, data, sizeof(gxid));
-	elog(INFO, "Received transaction ID %d for snapshot obtention", gxid);
-	txn = GTM_GXIDToHandle(gxid);
+	if (get_gxid)
+	{
+		GTM_IsolationLevel txn_isolation_level;
+		bool txn_read_only;
 
-	pq_getmsgend(message);
+		txn_isolation_level = pq_getmsgint(message, sizeof (GTM_IsolationLevel));
+		txn_read_only = pq_getmsgbyte(message);
+		pq_getmsgend(message);
 
-	if (get_gxid)
+		gxid = GTM_BeginTransactionGetGXID(myport, txn_isolation_level,
+										   txn_read_only, &txn, &timestamp);
+		txn_count = 1;
+	}
+	else
 	{
-		gxid = GTM_GetGlobalTransactionId(txn);
-		if (gxid == InvalidGlobalTransactionId)
+		txn_count = pq_getmsgint(message, sizeof (int));
+		Assert(txn_count == 1);
+
+		data = pq_getmsgbytes(message, sizeof (gxid));
+		if (data == NULL)
 			ereport(ERROR,
-					(EINVAL,
-					 errmsg("Failed to get a new transaction id")));
+					(EPROTO,
+					 errmsg("Message does not contain valid GXID")));
+		memcpy(&gxid, data, sizeof(gxid));
+		elog(INFO, "Received transaction ID %d for snapshot obtention", gxid);
+		txn = GTM_GXIDToHandle(gxid);
+
+		pq_getmsgend(message);
 	}
 
 	oldContext = MemoryContextSwitchTo(TopMostMemoryContext);
@@ -325,27 +497,29 @@ ProcessGetSnapshotCommand(Port *myport, StringInfo message, bool get_gxid)
 
 	MemoryContextSwitchTo(oldContext);
 
-	pq_beginmessage(&buf, 'S');
-	pq_sendint(&buf, get_gxid ? SNAPSHOT_GXID_GET_RESULT : SNAPSHOT_GET_RESULT, 4);
+	pq_beginmessage_reuse(buf, 'S');
+	pq_sendint(buf, get_gxid ? SNAPSHOT_GXID_GET_RESULT : SNAPSHOT_GET_RESULT, 4);
 	if (myport->remote_type == GTM_NODE_GTM_PROXY)
 	{
 		GTM_ProxyMsgHeader proxyhdr;
 		proxyhdr.ph_conid = myport->conn_id;
-		pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+		pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 	}
-	pq_sendbytes(&buf, (char *)&gxid, sizeof (GlobalTransactionId));
-	pq_sendbytes(&buf, (char *)&txn_count, sizeof(txn_count));
-	pq_sendbytes(&buf, (char *)&status, sizeof(int) * txn_count);
-	pq_sendbytes(&buf, (char *)&snapshot->sn_xmin, sizeof (GlobalTransactionId));
-	pq_sendbytes(&buf, (char *)&snapshot->sn_xmax, sizeof (GlobalTransactionId));
-	pq_sendbytes(&buf, (char *)&snapshot->sn_recent_global_xmin, sizeof (GlobalTransactionId));
-	pq_sendint(&buf, snapshot->sn_xcnt, sizeof (int));
-	pq_sendbytes(&buf, (char *)snapshot->sn_xip,
-				 sizeof(GlobalTransactionId) * snapshot->sn_xcnt);
-	pq_endmessage(myport, &buf);
+	pq_sendbytes(buf, (char *)&gxid, sizeof (GlobalTransactionId));
+	if (get_gxid)
+		pq_sendbytes(buf, (char *)&timestamp, sizeof (GTM_Timestamp));
+	pq_sendbytes(buf, (char *)&txn_count, sizeof(txn_count));
+	pq_sendbytes(buf, (char *)&status, sizeof(int) * txn_count);
+	gtm_send_snapshot_wire(buf, snapshot);
+	pq_endmessage_reuse(myport, buf);
 
 	if (myport->remote_type != GTM_NODE_GTM_PROXY)
+	{
+		/* Flush standby */
+		if (get_gxid && GetMyThreadInfo->thr_conn->standby)
+			gtmpqFlush(GetMyThreadInfo->thr_conn->standby);
 		pq_flush(myport);
+	}
 
 	return;
 }
@@ -356,7 +530,7 @@ ProcessGetSnapshotCommand(Port *myport, StringInfo message, bool get_gxid)
 void
 ProcessGetSnapshotCommandMulti(Port *myport, StringInfo message)
 {
-	StringInfoData buf;
+	StringInfo	buf = GTM_ReplyBuffer;
 	GTM_TransactionHandle txn[GTM_MAX_GLOBAL_TRANSACTIONS];
 	GlobalTransactionId gxid[GTM_MAX_GLOBAL_TRANSACTIONS];
 	GTM_Snapshot snapshot;
@@ -392,23 +566,18 @@ ProcessGetSnapshotCommandMulti(Port *myport, StringInfo message)
 
 	MemoryContextSwitchTo(oldContext);
 
-	pq_beginmessage(&buf, 'S');
-	pq_sendint(&buf, SNAPSHOT_GET_MULTI_RESULT, 4);
+	pq_beginmessage_reuse(buf, 'S');
+	pq_sendint(buf, SNAPSHOT_GET_MULTI_RESULT, 4);
 	if (myport->remote_type == GTM_NODE_GTM_PROXY)
 	{
 		GTM_ProxyMsgHeader proxyhdr;
 		proxyhdr.ph_conid = myport->conn_id;
-		pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+		pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 	}
-	pq_sendbytes(&buf, (char *)&txn_count, sizeof(txn_count));
-	pq_sendbytes(&buf, (char *)status, sizeof(int) * txn_count);
-	pq_sendbytes(&buf, (char *)&snapshot->sn_xmin, sizeof (GlobalTransactionId));
-	pq_sendbytes(&buf, (char *)&snapshot->sn_xmax, sizeof (GlobalTransactionId));
-	pq_sendbytes(&buf, (char *)&snapshot->sn_recent_global_xmin, sizeof (GlobalTransactionId));
-	pq_sendint(&buf, snapshot->sn_xcnt, sizeof (int));
-	pq_sendbytes(&buf, (char *)snapshot->sn_xip,
-				 sizeof(GlobalTransactionId) * snapshot->sn_xcnt);
-	pq_endmessage(myport, &buf);
+	pq_sendbytes(buf, (char *)&txn_count, sizeof(txn_count));
+	pq_sendbytes(buf, (char *)status, sizeof(int) * txn_count);
+	gtm_send_snapshot_wire(buf, snapshot);
+	pq_endmessage_reuse(myport, buf);
 
 	if (myport->remote_type != GTM_NODE_GTM_PROXY)
 		pq_flush(myport);
@@ -447,6 +616,479 @@ retry:
 	return;
 }
 
+/*
+ * Process MSG_SNAPSHOT_GET_READONLY command
+ *
+ * The GTM serves it as MSG_SNAPSHOT_GET_MULTI. The standby replies with the
+ * last snapshot the GTM sent if all the given transactions started before
+ * it was taken, and fails otherwise, the client then asks the GTM.
+ */
+void
+ProcessGetSnapshotCommandReadOnly(Port *myport, StringInfo message)
+{
+	StringInfo	buf = GTM_ReplyBuffer;
+	GlobalTransactionId gxid[GTM_MAX_GLOBAL_TRANSACTIONS];
+	int txn_count;
+	int ii;
+	int status[GTM_MAX_GLOBAL_TRANSACTIONS];
+
+	if (!Recovery_IsStandby())
+	{
+		ProcessGetSnapshotCommandMulti(myport, message);
+		return;
+	}
+
+	txn_count = pq_getmsgint(message, sizeof (int));
+	if (txn_count <= 0 || txn_count > GTM_MAX_GLOBAL_TRANSACTIONS)
+		ereport(ERROR,
+				(EPROTO,
+				 errmsg("Invalid number of transactions: %d", txn_count)));
+
+	for (ii = 0; ii < txn_count; ii++)
+	{
+		const char *data = pq_getmsgbytes(message, sizeof (gxid[ii]));
+		if (data == NULL)
+			ereport(ERROR,
+					(EPROTO,
+					 errmsg("Message does not contain valid GXID")));
+		memcpy(&gxid[ii], data, sizeof (gxid[ii]));
+		status[ii] = STATUS_OK;
+	}
+
+	pq_getmsgend(message);
+
+	GTM_RWLockAcquire(&standbySnapshot.ss_lock, GTM_LOCKMODE_READ);
+	for (ii = 0; ii < txn_count; ii++)
+	{
+		if (!standbySnapshot.ss_valid ||
+			!GlobalTransactionIdPrecedes(gxid[ii], standbySnapshot.ss_next_gxid))
+		{
+			GTM_RWLockRelease(&standbySnapshot.ss_lock);
+			ereport(ERROR,
+					(EAGAIN,
+					 errmsg("No snapshot for transaction %u on the standby",
+							gxid[ii])));
+		}
+	}
+
+	pq_beginmessage_reuse(buf, 'S');
+	pq_sendint(buf, SNAPSHOT_GET_STANDBY_RESULT, 4);
+	if (myport->remote_type == GTM_NODE_GTM_PROXY)
+	{
+		GTM_ProxyMsgHeader proxyhdr;
+		proxyhdr.ph_conid = myport->conn_id;
+		pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+	}
+	pq_sendbytes(buf, (char *)&txn_count, sizeof(txn_count));
+	pq_sendbytes(buf, (char *)status, sizeof(int) * txn_count);
+	gtm_send_snapshot_wire(buf, &standbySnapshot.ss_snapshot);
+	GTM_RWLockRelease(&standbySnapshot.ss_lock);
+
+	pq_endmessage_reuse(myport, buf);
+
+	if (myport->remote_type != GTM_NODE_GTM_PROXY)
+		pq_flush(myport);
+}
+
+/*
+ * Process MSG_BKUP_SNAPSHOT command, a snapshot sent by the GTM for the
+ * read-only transactions. Snapshots arrive through the connections of all
+ * the threads of the GTM, a snapshot older than the one kept is ignored.
+ */
+void
+ProcessBkupSnapshotCommand(Port *myport, StringInfo message)
+{
+	GlobalTransactionId next_gxid;
+	const char *data;
+	int len;
+
+	data = pq_getmsgbytes(message, sizeof (next_gxid));
+	if (data == NULL)
+		ereport(ERROR,
+				(EPROTO,
+				 errmsg("Message does not contain valid GXID")));
+	memcpy(&next_gxid, data, sizeof (next_gxid));
+
+	len = message->len - message->cursor;
+	data = pq_getmsgbytes(message, len);
+	pq_getmsgend(message);
+
+	GTM_RWLockAcquire(&standbySnapshot.ss_lock, GTM_LOCKMODE_WRITE);
+	if (!standbySnapshot.ss_valid ||
+		GlobalTransactionIdFollows(next_gxid, standbySnapshot.ss_next_gxid))
+	{
+		standbySnapshot.ss_valid =
+			gtm_deserialize_snapshot_wire(&standbySnapshot.ss_snapshot,
+										  GTM_MAX_GLOBAL_TRANSACTIONS,
+										  data, len) != 0;
+		standbySnapshot.ss_next_gxid = next_gxid;
+	}
+	GTM_RWLockRelease(&standbySnapshot.ss_lock);
+
+	if (!standbySnapshot.ss_valid)
+		elog(LOG, "Invalid snapshot received from GTM");
+}
+
+/*
+ * Compute the global xmin as a snapshot would, without building one. The
+ * cached snapshot has it already unless a transaction completed since.
+ */
+static GlobalTransactionId
+GTM_GetGlobalXmin(void)
+{
+	GlobalTransactionId globalxmin;
+	int			ii;
+
+	GTM_RWLockAcquire(&GTMTransactions.gt_TransArrayLock, GTM_LOCKMODE_READ);
+
+	GTM_RWLockAcquire(&snapshotCache.sc_lock, GTM_LOCKMODE_READ);
+	if (snapshotCache.sc_valid &&
+		snapshotCache.sc_generation == GTMTransactions.gt_snapshot_generation)
+	{
+		globalxmin = snapshotCache.sc_snapshot.sn_recent_global_xmin;
+		GTM_RWLockRelease(&snapshotCache.sc_lock);
+		GTM_RWLockRelease(&GTMTransactions.gt_TransArrayLock);
+		return globalxmin;
+	}
+	GTM_RWLockRelease(&snapshotCache.sc_lock);
+
+	globalxmin = GTMTransactions.gt_latestCompletedXid;
+	Assert(GlobalTransactionIdIsNormal(globalxmin));
+	GlobalTransactionIdAdvance(globalxmin);
+
+	for (ii = 0; ii < GTMTransactions.gt_open_count; ii++)
+	{
+		volatile GTM_TransactionInfo *gtm_txninfo = GTM_OpenTransaction(ii);
+		GlobalTransactionId xid;
+
+		/* Don't take into account LAZY VACUUMs */
+		if (gtm_txninfo->gti_vacuum)
+			continue;
+
+		xid = gtm_txninfo->gti_xmin;
+		if (GlobalTransactionIdIsNormal(xid) &&
+			GlobalTransactionIdPrecedes(xid, globalxmin))
+			globalxmin = xid;
+
+		xid = gtm_txninfo->gti_gxid;
+		if (GlobalTransactionIdIsNormal(xid) &&
+			GlobalTransactionIdPrecedes(xid, globalxmin))
+			globalxmin = xid;
+	}
+
+	GTMTransactions.gt_recent_global_xmin = globalxmin;
+
+	GTM_RWLockRelease(&GTMTransactions.gt_TransArrayLock);
+
+	return globalxmin;
+}
+
+/*
+ * Process MSG_GET_GLOBAL_XMIN message
+ *
+ * The nodes otherwise learn the global xmin only with the snapshots, a node
+ * seeing few of them refreshes its horizon this way. A proxy asks once per
+ * round on behalf of all of its waiting backends.
+ */
+void
+ProcessGetGlobalXminCommand(Port *myport, StringInfo message)
+{
+	StringInfoData buf;
+	GlobalTransactionId globalxmin;
+
+	pq_getmsgend(message);
+
+	globalxmin = GTM_GetGlobalXmin();
+
+	pq_beginmessage(&buf, 'S');
+	pq_sendint(&buf, GET_GLOBAL_XMIN_RESULT, 4);
+	if (myport->remote_type == GTM_NODE_GTM_PROXY)
+	{
+		GTM_ProxyMsgHeader proxyhdr;
+		proxyhdr.ph_conid = myport->conn_id;
+		pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+	}
+	pq_sendbytes(&buf, (char *)&globalxmin, sizeof (GlobalTransactionId));
+	pq_endmessage(myport, &buf);
+
+	if (myport->remote_type != GTM_NODE_GTM_PROXY)
+		pq_flush(myport);
+}
+
+/*
+ * Set up the snapshot cache when GTM starts.
+ */
+void
+GTM_InitSnapshotCache(void)
+{
+	MemoryContext oldContext;
+
+	GTM_RWLockInit(&snapshotCache.sc_lock);
+	GTM_RWLockSetName(&snapshotCache.sc_lock, "SnapshotCacheLock");
+	snapshotCache.sc_valid = false;
+
+	GTM_RWLockInit(&standbySnapshot.ss_lock);
+	GTM_RWLockSetName(&standbySnapshot.ss_lock, "StandbySnapshotLock");
+	standbySnapshot.ss_valid = false;
+	pg_atomic_init_u64(&standbySnapshotSent, 0);
+
+	oldContext = MemoryContextSwitchTo(TopMostMemoryContext);
+	snapshotCache.sc_snapshot.sn_xip = (GlobalTransactionId *)
+		palloc(GTM_MAX_GLOBAL_TRANSACTIONS * sizeof(GlobalTransactionId));
+	standbySnapshot.ss_snapshot.sn_xip = (GlobalTransactionId *)
+		palloc(GTM_MAX_GLOBAL_TRANSACTIONS * sizeof(GlobalTransactionId));
+	MemoryContextSwitchTo(oldContext);
+}
+
+/*
+ * Set up the CSN snapshots when GTM starts. The epoch lets the nodes notice
+ * a restart or a failover, after which the CSNs start over.
+ */
+void
+GTM_InitCSNSnapshots(void)
+{
+	csnEpoch = (uint32) time(NULL);
+	csnNext = FirstCSN;
+	GTM_PublishCSNSnapshot();
+}
+
+/*
+ * Record the completion of the given transaction in the CSN log. The caller
+ * holds gt_TransArrayLock in write mode and publishes a new CSN snapshot
+ * once it is done with the transactions it completes.
+ */
+void
+GTM_CSNLogCompleted(GlobalTransactionId gxid)
+{
+	GTM_CSN		csn = csnNext;
+
+	if (!GlobalTransactionIdIsNormal(gxid))
+		return;
+
+	/*
+	 * Advance csnNext before overwriting the slot, so GTM_GetCSNLog() can
+	 * tell whether the entries it copied were still current.
+	 */
+	csnNext = csn + 1;
+	pg_write_barrier();
+	csnLog[csn % GTM_CSNLOG_SIZE] = gxid;
+}
+
+/*
+ * Publish the CSN snapshot reflecting the current set of open transactions.
+ * The caller holds gt_TransArrayLock in write mode, or is the only thread.
+ *
+ * The horizons are computed the same way as in GTM_GetTransactionSnapshot(),
+ * this is done on transaction completion only, as that is the only time they
+ * may advance.
+ */
+void
+GTM_PublishCSNSnapshot(void)
+{
+	GlobalTransactionId xmin;
+	GlobalTransactionId xmax;
+	GlobalTransactionId globalxmin;
+	int			ii;
+
+	csnSnapshotSeq++;
+
+	/*
+	 * Readers set the xmin of their transaction before checking the sequence
+	 * again, so either we see their xmin below or they see the sequence
+	 * change and retry.
+	 */
+	pg_memory_barrier();
+
+	xmax = GTMTransactions.gt_latestCompletedXid;
+	GlobalTransactionIdAdvance(xmax);
+	globalxmin = xmin = xmax;
+
+	for (ii = 0; ii < GTMTransactions.gt_open_count; ii++)
+	{
+		volatile GTM_TransactionInfo *gtm_txninfo = GTM_OpenTransaction(ii);
+		GlobalTransactionId xid;
+
+		/* Don't take into account LAZY VACUUMs */
+		if (gtm_txninfo->gti_vacuum)
+			continue;
+
+		xid = gtm_txninfo->gti_xmin;
+		if (GlobalTransactionIdIsNormal(xid) &&
+			GlobalTransactionIdPrecedes(xid, globalxmin))
+			globalxmin = xid;
+
+		xid = gtm_txninfo->gti_gxid;
+		if (GlobalTransactionIdIsNormal(xid) &&
+			GlobalTransactionIdPrecedes(xid, xmin))
+			xmin = xid;
+	}
+
+	if (GlobalTransactionIdPrecedes(xmin, globalxmin))
+		globalxmin = xmin;
+
+	csnSnapshot.cs_epoch = csnEpoch;
+	csnSnapshot.cs_csn = csnNext;
+	csnSnapshot.cs_xmin = xmin;
+	csnSnapshot.cs_xmax = xmax;
+	csnSnapshot.cs_recent_global_xmin = globalxmin;
+
+	pg_write_barrier();
+	csnSnapshotSeq++;
+}
+
+/*
+ * Get the current CSN snapshot without taking any lock. If the transaction
+ * is given and this is its first snapshot, its xmin is set so the global
+ * xmin does not advance past the snapshot.
+ */
+void
+GTM_GetCSNSnapshot(GTM_TransactionInfo *txninfo, GTM_CSNSnapshot snapshot)
+{
+	for (;;)
+	{
+		uint32		seq = csnSnapshotSeq;
+
+		pg_read_barrier();
+		memcpy(snapshot, (char *) &csnSnapshot, sizeof(GTM_CSNSnapshotData));
+
+		if (txninfo != NULL &&
+			!GlobalTransactionIdIsValid(txninfo->gti_xmin))
+			txninfo->gti_xmin = snapshot->cs_xmin;
+
+		pg_memory_barrier();
+		if ((seq & 1) == 0 && seq == csnSnapshotSeq)
+			break;
+	}
+}
+
+/*
+ * Copy at most maxcount GXIDs completed since the given CSN, the first of
+ * them completed with *first. If the ring has already been overwritten past
+ * the given CSN the copy starts from the oldest CSN still available, the
+ * caller detects that comparing *first with what it asked for.
+ */
+static int
+GTM_GetCSNLog(GTM_CSN from, int maxcount, GTM_CSN *first,
+			  GlobalTransactionId *gxids)
+{
+	GTM_CSNSnapshotData snapshot;
+	GTM_CSN		oldest;
+	GTM_CSN		next;
+	int			count;
+	int			ii;
+
+	GTM_GetCSNSnapshot(NULL, &snapshot);
+
+	oldest = snapshot.cs_csn > GTM_CSNLOG_SIZE ?
+		snapshot.cs_csn - GTM_CSNLOG_SIZE : FirstCSN;
+	if (from < oldest)
+		from = oldest;
+	if (from > snapshot.cs_csn)
+		from = snapshot.cs_csn;
+	*first = from;
+
+	count = (int) Min(snapshot.cs_csn - from, (GTM_CSN) maxcount);
+	for (ii = 0; ii < count; ii++)
+		gxids[ii] = csnLog[(from + ii) % GTM_CSNLOG_SIZE];
+
+	/* The slots may have been reused while they were being copied */
+	pg_read_barrier();
+	next = csnNext;
+	if (next > GTM_CSNLOG_SIZE && from < next - GTM_CSNLOG_SIZE)
+	{
+		*first = next - GTM_CSNLOG_SIZE;
+		return 0;
+	}
+	return count;
+}
+
+/*
+ * Process MSG_SNAPSHOT_CSN_GET command
+ */
+void
+ProcessGetCSNSnapshotCommand(Port *myport, StringInfo message)
+{
+	StringInfoData buf;
+	GlobalTransactionId gxid;
+	GTM_TransactionInfo *txninfo = NULL;
+	GTM_CSNSnapshotData snapshot;
+	const char *data;
+	bool		first;
+
+	data = pq_getmsgbytes(message, sizeof (gxid));
+	if (data == NULL)
+		ereport(ERROR,
+				(EPROTO,
+				 errmsg("Message does not contain valid GXID")));
+	memcpy(&gxid, data, sizeof(gxid));
+	first = (bool) pq_getmsgint(message, sizeof (int));
+	pq_getmsgend(message);
+
+	/*
+	 * Only the first snapshot of a transaction has to find it, later ones
+	 * are covered by the xmin already set.
+	 */
+	if (first && GlobalTransactionIdIsValid(gxid))
+		txninfo = GTM_HandleToTransactionInfo(GTM_GXIDToHandle(gxid));
+
+	GTM_GetCSNSnapshot(txninfo, &snapshot);
+
+	pq_beginmessage(&buf, 'S');
+	pq_sendint(&buf, SNAPSHOT_CSN_GET_RESULT, 4);
+	if (myport->remote_type == GTM_NODE_GTM_PROXY)
+	{
+		GTM_ProxyMsgHeader proxyhdr;
+		proxyhdr.ph_conid = myport->conn_id;
+		pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+	}
+	pq_sendbytes(&buf, (char *)&snapshot, sizeof (GTM_CSNSnapshotData));
+	pq_endmessage(myport, &buf);
+
+	if (myport->remote_type != GTM_NODE_GTM_PROXY)
+		pq_flush(myport);
+}
+
+/*
+ * Process MSG_CSNLOG_GET command
+ */
+void
+ProcessGetCSNLogCommand(Port *myport, StringInfo message)
+{
+	StringInfoData buf;
+	GlobalTransactionId gxids[GTM_CSNLOG_MAX_FETCH];
+	GTM_CSN		from;
+	GTM_CSN		first;
+	const char *data;
+	int			count;
+
+	data = pq_getmsgbytes(message, sizeof (from));
+	if (data == NULL)
+		ereport(ERROR,
+				(EPROTO,
+				 errmsg("Message does not contain valid CSN")));
+	memcpy(&from, data, sizeof(from));
+	pq_getmsgend(message);
+
+	count = GTM_GetCSNLog(from, GTM_CSNLOG_MAX_FETCH, &first, gxids);
+
+	pq_beginmessage(&buf, 'S');
+	pq_sendint(&buf, CSNLOG_GET_RESULT, 4);
+	if (myport->remote_type == GTM_NODE_GTM_PROXY)
+	{
+		GTM_ProxyMsgHeader proxyhdr;
+		proxyhdr.ph_conid = myport->conn_id;
+		pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+	}
+	pq_sendbytes(&buf, (char *)&csnEpoch, sizeof (uint32));
+	pq_sendbytes(&buf, (char *)&first, sizeof (GTM_CSN));
+	pq_sendint(&buf, count, sizeof (int));
+	pq_sendbytes(&buf, (char *)gxids, sizeof (GlobalTransactionId) * count);
+	pq_endmessage(myport, &buf);
+
+	if (myport->remote_type != GTM_NODE_GTM_PROXY)
+		pq_flush(myport);
+}
+
 /*
  * Free the snapshot data. The snapshot itself is not freed though
  */
@@ -18,6 +18,7 @@
 #include "gtm/elog.h"
 #include "gtm/gtm.h"
 #include "gtm/gtm_c.h"
+#include "gtm/gtm_backup.h"
 #include "gtm/standby_utils.h"
 #include "gtm/gtm_client.h"
 #include "gtm/gtm_seq.h"
@@ -182,14 +183,15 @@ gtm_standby_restore_gxid(void)
 		 */
 		if (GTMTransactions.gt_transactions_array[handle].gti_state != GTM_TXN_ABORTED)
 		{
-			GTMTransactions.gt_open_transactions =
-					gtm_lappend(GTMTransactions.gt_open_transactions,
-							&GTMTransactions.gt_transactions_array[handle]);
+			GTM_AddOpenTransaction(&GTMTransactions.gt_transactions_array[handle]);
 		}
 	}
 
 	dump_transactions_elog(&GTMTransactions, num_txn);
 
+	GTMTransactions.gt_snapshot_generation++;
+	GTM_PublishCSNSnapshot();
+
 	GTM_RWLockRelease(&GTMTransactions.gt_TransArrayLock);
 	GTM_RWLockRelease(&GTMTransactions.gt_XidGenLock);
 
@@ -406,6 +408,9 @@ gtm_standby_connect_to_standby_int(int *report_needed)
 
 	elog(DEBUG1, "Connection established with GTM standby. - %p", n);
 
+	/* Backup messages are sent in batches, see gtm_standby_flush() */
+	standby->deferFlush = true;
+
 	return standby;
 }
 
@@ -449,6 +454,31 @@ gtm_standby_reconnect_to_standby(GTM_Conn *old_conn, int retry_max)
 
 #define GTM_STANDBY_RETRY_MAX 3
 
+/*
+ * Send the backup messages accumulated on a connection to the standby.
+ *
+ * Connections to the standby defer their flushes, so the backup messages of
+ * the requests served in a round go out together, and only the requests
+ * waiting for a response from the standby make a round trip. Threads call
+ * this before they wait for more requests, which bounds the lag of the
+ * standby to a round. A failure is noticed by the next
+ * gtm_standby_check_communication_error() on the connection.
+ */
+void
+gtm_standby_flush(GTM_Conn *conn)
+{
+	if (conn == NULL || conn->outCount == 0)
+		return;
+
+	if (gtmpqFlushDeferred(conn) < 0)
+	{
+		if (conn->result == NULL)
+			conn->result = (GTM_Result *) calloc(1, sizeof (GTM_Result));
+		if (conn->result != NULL)
+			conn->result->gr_status = GTM_RESULT_COMM_ERROR;
+	}
+}
+
 bool
 gtm_standby_check_communication_error(int *retry_count, GTM_Conn *oldconn)
 {
@@ -477,6 +507,82 @@ gtm_standby_check_communication_error(int *retry_count, GTM_Conn *oldconn)
 	return false;
 }
 
+/*
+ * Connection replicating the GTM state log, used under gtm_bkup_lock.
+ */
+static GTM_Conn *StateLogStandby = NULL;
+
+/*
+ * Replicate state log records to the standby and wait until it applied
+ * them. The records hold the restore points of the GXIDs and sequences,
+ * which the active GTM does not go past before they are durable. Once the
+ * standby has them it can be promoted safely even though the backup
+ * messages of the connections are not acknowledged. A new connection
+ * starts with a snapshot of the restore points, it may have missed records.
+ *
+ * The caller holds gtm_bkup_lock.
+ */
+void
+gtm_standby_replicate_state_log(const char *data, int len)
+{
+	bool		snapshot = false;
+	int			count = 0;
+
+	if (Recovery_IsStandby())
+		return;
+
+	if (!GTMThreads->gt_standby_ready)
+	{
+		if (StateLogStandby)
+		{
+			gtm_standby_disconnect_from_standby(StateLogStandby);
+			StateLogStandby = NULL;
+		}
+		return;
+	}
+
+retry:
+	if (StateLogStandby == NULL)
+	{
+		StateLogStandby = gtm_standby_connect_to_standby();
+		if (StateLogStandby == NULL)
+			return;
+		snapshot = true;
+	}
+
+	if (snapshot)
+	{
+		char	   *snapdata;
+		size_t		snaplen;
+
+		if (!GTM_StateLogSnapshot(&snapdata, &snaplen))
+			return;
+		bkup_state_log(StateLogStandby, snapdata, (int) snaplen);
+		free(snapdata);
+	}
+	if (len > 0)
+		bkup_state_log(StateLogStandby, data, len);
+
+	if (gtm_sync_standby(StateLogStandby) != GTM_RESULT_OK)
+	{
+		StateLogStandby = gtm_standby_reconnect_to_standby(StateLogStandby,
+														   GTM_STANDBY_RETRY_MAX);
+		if (StateLogStandby != NULL && count++ == 0)
+		{
+			snapshot = true;
+			goto retry;
+		}
+		elog(LOG, "Failed to replicate the GTM state log to the standby");
+
+		/* Start over with a snapshot next time */
+		if (StateLogStandby != NULL)
+		{
+			gtm_standby_disconnect_from_standby(StateLogStandby);
+			StateLogStandby = NULL;
+		}
+	}
+}
+
 int
 gtm_standby_begin_backup(void)
 {
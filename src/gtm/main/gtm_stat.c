@@ -12,11 +12,50 @@
  *
  *-------------------------------------------------------------------------
  */
+#include <sys/time.h>
+
 #include "gtm/gtm_c.h"
 #include "gtm/gtm.h"
+#include "gtm/gtm_lock.h"
+#include "gtm/gtm_msg.h"
+#include "gtm/gtm_utils.h"
+#include "gtm/libpq.h"
+#include "gtm/libpq-be.h"
+#include "gtm/pqformat.h"
+
+uint32	GTM_Message_Stats[MSG_TYPE_COUNT];
+uint32	GTM_Result_Stats[RESULT_TYPE_COUNT];
+
+/*
+ * Latency counters of the messages, by message type and client type. They
+ * are updated by all the threads without locking.
+ */
+typedef struct GTM_MessageCounters
+{
+	pg_atomic_uint64	mc_count;
+	pg_atomic_uint64	mc_usecs[GTM_STAT_PHASE_COUNT];
+	pg_atomic_uint64	mc_latency[GTM_STAT_PHASE_COUNT][GTM_STAT_LATENCY_BUCKETS];
+} GTM_MessageCounters;
+
+static GTM_MessageCounters MessageCounters[MSG_TYPE_COUNT][GTM_STAT_CLIENT_TYPES];
 
-uint32	GTM_Message_Stats[MSG_MAX_MESSAGE_TYPE];
-uint32	GTM_Result_Stats[GTM_MAX_RESULT_TYPE];
+/* Upper bounds of the latency buckets, in microseconds */
+static const uint64 latency_bounds[GTM_STAT_LATENCY_BUCKETS - 1] =
+{
+	10, 30, 100, 300, 1000, 3000, 10000, 30000, 100000
+};
+
+static const char *phase_names[GTM_STAT_PHASE_COUNT] =
+{
+	"queue wait", "lock wait", "processing"
+};
+
+/* Indexed by GTM_PGXCNodeType */
+static const char *client_type_names[GTM_STAT_CLIENT_TYPES] =
+{
+	"unknown", "proxy", "proxy postmaster", "coordinator", "datanode",
+	"gtm", "other"
+};
 
 void
 gtm_msgstat_increment(int type)
@@ -30,8 +69,157 @@ gtm_resultstat_increment(int type)
 	GTM_Result_Stats[type]++;
 }
 
+/*
+ * Current time in microseconds, to time the messages
+ */
+uint64
+gtm_stat_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Count a message served by the thread. received is the time its data was
+ * read from the client, started the time its processing started and
+ * lock_wait the time the processing waited for locks since then.
+ */
+void
+gtm_msgstat_record(GTM_MessageType mtype, GTM_PGXCNodeType client_type,
+				   uint64 received, uint64 started, uint64 lock_wait)
+{
+	GTM_MessageCounters *counters;
+	uint64		usecs[GTM_STAT_PHASE_COUNT];
+	uint64		now = gtm_stat_now();
+	int			phase;
+
+	if (mtype <= MSG_TYPE_INVALID || mtype >= MSG_TYPE_COUNT)
+		return;
+	if (client_type <= 0 || client_type >= GTM_STAT_CLIENT_TYPES)
+		client_type = GTM_NODE_DEFAULT;
+
+	usecs[GTM_STAT_QUEUE_WAIT] = started > received ? started - received : 0;
+	usecs[GTM_STAT_PROCESSING] = now > started ? now - started : 0;
+	usecs[GTM_STAT_LOCK_WAIT] = Min(lock_wait, usecs[GTM_STAT_PROCESSING]);
+	usecs[GTM_STAT_PROCESSING] -= usecs[GTM_STAT_LOCK_WAIT];
+
+	counters = &MessageCounters[mtype][client_type];
+	pg_atomic_fetch_add_u64(&counters->mc_count, 1);
+	for (phase = 0; phase < GTM_STAT_PHASE_COUNT; phase++)
+	{
+		int			i;
+
+		for (i = 0; i < GTM_STAT_LATENCY_BUCKETS - 1; i++)
+			if (usecs[phase] < latency_bounds[i])
+				break;
+		pg_atomic_fetch_add_u64(&counters->mc_usecs[phase], usecs[phase]);
+		pg_atomic_fetch_add_u64(&counters->mc_latency[phase][i], 1);
+	}
+}
+
+/*
+ * Copy the counters of the message and client types seen so far. Returns
+ * the number of entries, at most GTM_STATS_MAX_ENTRIES.
+ */
+static int
+gtm_msgstat_collect(GTM_MessageStats *stats)
+{
+	int			count = 0;
+	int			mtype;
+	int			client_type;
+
+	for (mtype = 0; mtype < MSG_TYPE_COUNT; mtype++)
+	{
+		for (client_type = 0; client_type < GTM_STAT_CLIENT_TYPES; client_type++)
+		{
+			GTM_MessageCounters *counters = &MessageCounters[mtype][client_type];
+			GTM_MessageStats *entry = &stats[count];
+			int			phase;
+			int			i;
+
+			entry->ms_count = pg_atomic_read_u64(&counters->mc_count);
+			if (entry->ms_count == 0)
+				continue;
+
+			entry->ms_mtype = mtype;
+			entry->ms_client_type = client_type;
+			for (phase = 0; phase < GTM_STAT_PHASE_COUNT; phase++)
+			{
+				entry->ms_usecs[phase] =
+					pg_atomic_read_u64(&counters->mc_usecs[phase]);
+				for (i = 0; i < GTM_STAT_LATENCY_BUCKETS; i++)
+					entry->ms_latency[phase][i] =
+						pg_atomic_read_u64(&counters->mc_latency[phase][i]);
+			}
+			count++;
+		}
+	}
+	return count;
+}
+
+/*
+ * Process MSG_GET_STATS message
+ */
+void
+ProcessGetStatsCommand(Port *myport, StringInfo message)
+{
+	StringInfoData buf;
+	GTM_MessageStats *stats;
+	int			count;
+
+	pq_getmsgend(message);
+
+	stats = (GTM_MessageStats *)
+		palloc(sizeof (GTM_MessageStats) * GTM_STATS_MAX_ENTRIES);
+	count = gtm_msgstat_collect(stats);
+
+	pq_beginmessage(&buf, 'S');
+	pq_sendint(&buf, GET_STATS_RESULT, 4);
+	if (myport->remote_type == GTM_NODE_GTM_PROXY)
+	{
+		GTM_ProxyMsgHeader proxyhdr;
+		proxyhdr.ph_conid = myport->conn_id;
+		pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+	}
+	pq_sendint(&buf, count, sizeof (int));
+	pq_sendbytes(&buf, (char *)stats, sizeof (GTM_MessageStats) * count);
+	pq_endmessage(myport, &buf);
+
+	if (myport->remote_type != GTM_NODE_GTM_PROXY)
+		pq_flush(myport);
+
+	pfree(stats);
+}
+
+/*
+ * Report the statistics to the log
+ */
 void
 gtm_print_stats(void)
 {
+	GTM_MessageStats *stats;
+	int			count;
+	int			i;
+
+	GTM_RWLockReportStats();
 
+	stats = (GTM_MessageStats *)
+		palloc(sizeof (GTM_MessageStats) * GTM_STATS_MAX_ENTRIES);
+	count = gtm_msgstat_collect(stats);
+	for (i = 0; i < count; i++)
+		elog(LOG, "message %s from %s: " UINT64_FORMAT " messages, "
+			 "%s " UINT64_FORMAT " us, %s " UINT64_FORMAT " us, "
+			 "%s " UINT64_FORMAT " us",
+			 gtm_util_message_name(stats[i].ms_mtype),
+			 client_type_names[stats[i].ms_client_type],
+			 stats[i].ms_count,
+			 phase_names[GTM_STAT_QUEUE_WAIT],
+			 stats[i].ms_usecs[GTM_STAT_QUEUE_WAIT],
+			 phase_names[GTM_STAT_LOCK_WAIT],
+			 stats[i].ms_usecs[GTM_STAT_LOCK_WAIT],
+			 phase_names[GTM_STAT_PROCESSING],
+			 stats[i].ms_usecs[GTM_STAT_PROCESSING]);
+	pfree(stats);
 }
@@ -14,6 +14,8 @@
  *-------------------------------------------------------------------------
  */
 #include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "gtm/gtm.h"
 #include "gtm/memutils.h"
 #include "gtm/gtm_txn.h"
@@ -150,6 +152,23 @@ GTM_ThreadAdd(GTM_ThreadInfo *thrinfo)
 	return ii;
 }
 
+/*
+ * Assign a new client identifier, for connections served by worker threads.
+ * See GTM_ThreadAdd.
+ */
+uint32
+GTM_NextClientIdentifier(void)
+{
+	uint32 client_id;
+
+	GTM_RWLockAcquire(&GTMThreads->gt_lock, GTM_LOCKMODE_WRITE);
+	client_id = GTMThreads->gt_next_client_id;
+	GTMThreads->gt_next_client_id = GTM_CLIENT_ID_NEXT(GTMThreads->gt_next_client_id);
+	GTM_RWLockRelease(&GTMThreads->gt_lock);
+
+	return client_id;
+}
+
 int
 GTM_ThreadRemove(GTM_ThreadInfo *thrinfo)
 {
@@ -203,6 +222,34 @@ GTM_ThreadCreate(GTM_ConnectionInfo *conninfo,
 
 	thrinfo->thr_conn = conninfo;
 	GTM_RWLockInit(&thrinfo->thr_lock);
+	GTM_MutexLockInit(&thrinfo->thr_conn_lock);
+	thrinfo->thr_wakeup_fd[0] = thrinfo->thr_wakeup_fd[1] = -1;
+
+	/*
+	 * A thread started without a connection is a worker thread, connections
+	 * are handed over to it later. Set up the pipe used to wake it up.
+	 */
+	if (conninfo == NULL)
+	{
+		thrinfo->thr_worker = true;
+		if (pipe(thrinfo->thr_wakeup_fd) < 0 ||
+			fcntl(thrinfo->thr_wakeup_fd[0], F_SETFL, O_NONBLOCK) < 0 ||
+			fcntl(thrinfo->thr_wakeup_fd[1], F_SETFL, O_NONBLOCK) < 0)
+		{
+			ereport(LOG,
+					(errno,
+					 errmsg("Failed to create the wakeup pipe of a worker thread: %m")));
+			if (thrinfo->thr_wakeup_fd[0] >= 0)
+			{
+				close(thrinfo->thr_wakeup_fd[0]);
+				close(thrinfo->thr_wakeup_fd[1]);
+			}
+			GTM_MutexLockDestroy(&thrinfo->thr_conn_lock);
+			GTM_RWLockDestroy(&thrinfo->thr_lock);
+			pfree(thrinfo);
+			return NULL;
+		}
+	}
 
 	/*
 	 * The thread status is set to GTM_THREAD_STARTING and will be changed by
@@ -324,6 +371,45 @@ GTM_GetThreadInfo(GTM_ThreadID thrid)
 	return NULL;
 }
 
+/*
+ * Close the given client connection along with its connection to the GTM
+ * standby, and free it.
+ */
+void
+GTM_ConnectionClose(GTM_ConnectionInfo *conninfo)
+{
+	/*
+	 * Close a connection to GTM standby.
+	 */
+	if (conninfo->standby)
+	{
+		elog(DEBUG1, "Closing a connection to the GTM standby.");
+
+		GTMPQfinish(conninfo->standby);
+		conninfo->standby = NULL;
+	}
+
+	/*
+	 * TODO Close the open connection.
+	 */
+	StreamClose(conninfo->con_port->sock);
+
+	/* Free the node_name in the port */
+	if (conninfo->con_port->node_name != NULL)
+		/* 
+		 * We don't have to reset pointer to NULL her because ConnFree() 
+		 * frees this structure next.
+		 */
+		pfree(conninfo->con_port->node_name);
+
+	/* Free the port */
+	ConnFree(conninfo->con_port);
+	conninfo->con_port = NULL;
+
+	/* Free the connection info structure */
+	pfree(conninfo);
+}
+
 /*
  * Cleanup routine for the thread
  */
@@ -346,35 +432,31 @@ GTM_ThreadCleanup(void *argp)
 	}
 
 	/*
-	 * Close a connection to GTM standby.
+	 * Close the connections served by the thread
 	 */
-	if (thrinfo->thr_conn->standby)
+	if (thrinfo->thr_worker)
 	{
-		elog(DEBUG1, "Closing a connection to the GTM standby.");
-
-		GTMPQfinish(thrinfo->thr_conn->standby);
-		thrinfo->thr_conn->standby = NULL;
-	}
-
-	/*
-	 * TODO Close the open connection.
-	 */
-	StreamClose(thrinfo->thr_conn->con_port->sock);
+		int ii;
+		gtm_ListCell *elem;
 
-	/* Free the node_name in the port */
-	if (thrinfo->thr_conn->con_port->node_name != NULL)
-		/* 
-		 * We don't have to reset pointer to NULL her because ConnFree() 
-		 * frees this structure next.
-		 */
-		pfree(thrinfo->thr_conn->con_port->node_name);
+		for (ii = 0; ii < thrinfo->thr_conn_count; ii++)
+			GTM_ConnectionClose(thrinfo->thr_all_conns[ii]);
+		thrinfo->thr_conn_count = 0;
 
-	/* Free the port */
-	ConnFree(thrinfo->thr_conn->con_port);
-	thrinfo->thr_conn->con_port = NULL;
+		GTM_MutexLockAcquire(&thrinfo->thr_conn_lock);
+		gtm_foreach(elem, thrinfo->thr_new_conns)
+			GTM_ConnectionClose((GTM_ConnectionInfo *) gtm_lfirst(elem));
+		thrinfo->thr_new_conns = gtm_NIL;
+		GTM_MutexLockRelease(&thrinfo->thr_conn_lock);
 
-	/* Free the connection info structure */
-	pfree(thrinfo->thr_conn);
+		if (thrinfo->thr_wakeup_fd[0] >= 0)
+		{
+			close(thrinfo->thr_wakeup_fd[0]);
+			close(thrinfo->thr_wakeup_fd[1]);
+		}
+	}
+	else
+		GTM_ConnectionClose(thrinfo->thr_conn);
 	thrinfo->thr_conn = NULL;
 
 	/*
@@ -396,6 +478,7 @@ GTM_ThreadCleanup(void *argp)
 	thrinfo->thr_thread_context = NULL;
 
 	GTM_RWLockDestroy(&thrinfo->thr_lock);
+	GTM_MutexLockDestroy(&thrinfo->thr_conn_lock);
 
 	/*
 	 * TODO Now cleanup the thrinfo structure itself and remove it from the global
@@ -428,6 +511,15 @@ GTM_ThreadMainWrapper(void *argp)
 	SetMyThreadInfo(thrinfo);
 	MemoryContextSwitchTo(TopMemoryContext);
 
+	/*
+	 * Allocate the per-thread message buffers up front. The snapshot array is
+	 * sized for the largest snapshot we can build, so that snapshot requests
+	 * never need to allocate.
+	 */
+	thrinfo->thr_snapshot.sn_xip = (GlobalTransactionId *)
+		palloc(GTM_MAX_GLOBAL_TRANSACTIONS * sizeof(GlobalTransactionId));
+	initStringInfo(&thrinfo->thr_reply_buf);
+
 	pthread_cleanup_push(GTM_ThreadCleanup, thrinfo);
 	thrinfo->thr_startroutine(thrinfo);
 	pthread_cleanup_pop(1);
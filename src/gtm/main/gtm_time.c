@@ -17,6 +17,9 @@
 #include "gtm/gtm.h"
 #include "gtm/gtm_c.h"
 #include "gtm/gtm_time.h"
+#include "gtm/gtm_msg.h"
+#include "gtm/libpq.h"
+#include "gtm/pqformat.h"
 #include <time.h>
 #include <sys/time.h>
 
@@ -39,3 +42,35 @@ GTM_TimestampGetCurrent(void)
 
 	return result;
 }
+
+/*
+ * Process MSG_GET_TIMESTAMP message
+ *
+ * Coordinators use it to keep their clocks in step with GTM when they had
+ * no transaction begin to carry a timestamp lately. A proxy asks once per
+ * round on behalf of all of its waiting backends.
+ */
+void
+ProcessGetTimestampCommand(Port *myport, StringInfo message)
+{
+	StringInfoData buf;
+	GTM_Timestamp timestamp;
+
+	pq_getmsgend(message);
+
+	timestamp = GTM_TimestampGetCurrent();
+
+	pq_beginmessage(&buf, 'S');
+	pq_sendint(&buf, GET_TIMESTAMP_RESULT, 4);
+	if (myport->remote_type == GTM_NODE_GTM_PROXY)
+	{
+		GTM_ProxyMsgHeader proxyhdr;
+		proxyhdr.ph_conid = myport->conn_id;
+		pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+	}
+	pq_sendbytes(&buf, (char *)&timestamp, sizeof (GTM_Timestamp));
+	pq_endmessage(myport, &buf);
+
+	if (myport->remote_type != GTM_NODE_GTM_PROXY)
+		pq_flush(myport);
+}
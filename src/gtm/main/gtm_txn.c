@@ -35,6 +35,7 @@
 #include "gtm/gtm_backup.h"
 
 extern bool Backup_synchronously;
+extern int GTMStandbySnapshotInterval;
 
 /* Local functions */
 static XidStatus GlobalTransactionIdGetStatus(GlobalTransactionId transactionId);
@@ -46,8 +47,59 @@ static void init_GTM_TransactionInfo(GTM_TransactionInfo *gtm_txninfo,
 									 GTMProxy_ConnID connid,
 									 bool readonly);
 static void clean_GTM_TransactionInfo(GTM_TransactionInfo *gtm_txninfo);
+static int GTM_BeginTransactionMultiInternal(GTM_IsolationLevel isolevel[],
+											 bool readonly[],
+											 uint32 client_id[],
+											 GTMProxy_ConnID connid[],
+											 int txn_count,
+											 GTM_TransactionHandle txns[]);
+
+/*
+ * Single requests of the same kind coming from different connection threads
+ * at the same time are coalesced into one multi-operation, so that they take
+ * the transaction locks once rather than once each.
+ *
+ * A thread with a request to process queues it up. If no other thread is
+ * processing requests, it becomes the combiner: it takes the queued requests,
+ * processes them together and wakes up their threads. Otherwise it waits
+ * until the combiner has processed its request, or has left and it can take
+ * over. Each thread then backs up its own request to the standby and replies
+ * to its own client as usual.
+ */
+#define GTM_MAX_COMBINED_REQUESTS	128
+
+typedef struct GTM_CombinedRequest
+{
+	GTM_IsolationLevel	cr_isolevel;	/* begin: the transaction to start */
+	bool				cr_readonly;
+	uint32				cr_client_id;
+	GTM_TransactionHandle cr_txn;		/* begin: output, commit: input */
+	GlobalTransactionId	cr_gxid;		/* begin: output */
+	int					cr_status;
+	bool				cr_done;
+	struct GTM_CombinedRequest *cr_next;
+} GTM_CombinedRequest;
+
+typedef struct GTM_Combiner
+{
+	GTM_MutexLock		cb_lock;
+	GTM_CV				cb_cv;
+	bool				cb_active;		/* a thread is processing requests */
+	GTM_CombinedRequest *cb_head;		/* requests waiting to be processed */
+	GTM_CombinedRequest *cb_tail;
+	void				(*cb_process)(GTM_CombinedRequest *reqs[], int count);
+} GTM_Combiner;
+
+static void GTM_CombineRequest(GTM_Combiner *combiner, GTM_CombinedRequest *req);
+static void GTM_ProcessCombinedBegin(GTM_CombinedRequest *reqs[], int count);
+static void GTM_ProcessCombinedCommit(GTM_CombinedRequest *reqs[], int count);
+
+static GTM_Combiner GTMBeginCombiner;
+static GTM_Combiner GTMCommitCombiner;
+
+/* Was the next GXID given at startup rather than restored? */
+static bool next_gxid_given = false;
 
-GlobalTransactionId ControlXid;  /* last one written to control file */
 GTM_Transactions GTMTransactions;
 
 void
@@ -61,6 +113,7 @@ GTM_InitTxnManager(void)
 	{
 		GTM_TransactionInfo *gtm_txninfo = &GTMTransactions.gt_transactions_array[ii];
 		gtm_txninfo->gti_in_use = false;
+		gtm_txninfo->gti_open_index = -1;
 		GTM_RWLockInit(&gtm_txninfo->gti_lock);
 	}
 
@@ -99,17 +152,24 @@ GTM_InitTxnManager(void)
 	 * list of transactions
 	 */
 	GTM_RWLockInit(&GTMTransactions.gt_XidGenLock);
+	GTM_RWLockSetName(&GTMTransactions.gt_XidGenLock, "XidGenLock");
 	GTM_RWLockInit(&GTMTransactions.gt_TransArrayLock);
+	GTM_RWLockSetName(&GTMTransactions.gt_TransArrayLock, "TransArrayLock");
 
-	/*
-	 * Initialize the list
-	 */
-	GTMTransactions.gt_open_transactions = gtm_NIL;
+	GTMTransactions.gt_open_count = 0;
 	GTMTransactions.gt_lastslot = -1;
 
 	GTMTransactions.gt_gtm_state = GTM_STARTING;
 
-	ControlXid = FirstNormalGlobalTransactionId;
+	GTM_InitSnapshotCache();
+	GTM_InitCSNSnapshots();
+
+	GTM_MutexLockInit(&GTMBeginCombiner.cb_lock);
+	GTM_CVInit(&GTMBeginCombiner.cb_cv);
+	GTMBeginCombiner.cb_process = GTM_ProcessCombinedBegin;
+	GTM_MutexLockInit(&GTMCommitCombiner.cb_lock);
+	GTM_CVInit(&GTMCommitCombiner.cb_cv);
+	GTMCommitCombiner.cb_process = GTM_ProcessCombinedCommit;
 
 	return;
 }
@@ -148,7 +208,7 @@ GlobalTransactionIdGetStatus(GlobalTransactionId transactionId)
 static GTM_TransactionHandle
 GTM_GXIDToHandle_Internal(GlobalTransactionId gxid, bool warn)
 {
-	gtm_ListCell *elem = NULL;
+	int ii;
    	GTM_TransactionInfo *gtm_txninfo = NULL;
 
 	if (!GlobalTransactionIdIsValid(gxid))
@@ -156,9 +216,9 @@ GTM_GXIDToHandle_Internal(GlobalTransactionId gxid, bool warn)
 
 	GTM_RWLockAcquire(&GTMTransactions.gt_TransArrayLock, GTM_LOCKMODE_READ);
 
-	gtm_foreach(elem, GTMTransactions.gt_open_transactions)
+	for (ii = 0; ii < GTMTransactions.gt_open_count; ii++)
 	{
-		gtm_txninfo = (GTM_TransactionInfo *)gtm_lfirst(elem);
+		gtm_txninfo = GTM_OpenTransaction(ii);
 		if (GlobalTransactionIdEquals(gtm_txninfo->gti_gxid, gxid))
 			break;
 		gtm_txninfo = NULL;
@@ -197,14 +257,14 @@ GTM_IsGXIDInProgress(GlobalTransactionId gxid)
 GTM_TransactionHandle
 GTM_GIDToHandle(char *gid)
 {
-	gtm_ListCell *elem = NULL;
+	int ii;
 	GTM_TransactionInfo *gtm_txninfo = NULL;
 
 	GTM_RWLockAcquire(&GTMTransactions.gt_TransArrayLock, GTM_LOCKMODE_READ);
 
-	gtm_foreach(elem, GTMTransactions.gt_open_transactions)
+	for (ii = 0; ii < GTMTransactions.gt_open_count; ii++)
 	{
-		gtm_txninfo = (GTM_TransactionInfo *)gtm_lfirst(elem);
+		gtm_txninfo = GTM_OpenTransaction(ii);
 		if (gtm_txninfo->gti_gid && strcmp(gid,gtm_txninfo->gti_gid) == 0)
 			break;
 		gtm_txninfo = NULL;
@@ -253,6 +313,45 @@ GTM_HandleToTransactionInfo(GTM_TransactionHandle handle)
 }
 
 
+/*
+ * Add the transaction to the open transactions. The caller holds
+ * gt_TransArrayLock in write mode.
+ */
+void
+GTM_AddOpenTransaction(GTM_TransactionInfo *gtm_txninfo)
+{
+	if (gtm_txninfo->gti_open_index >= 0)
+		return;
+
+	gtm_txninfo->gti_open_index = GTMTransactions.gt_open_count;
+	GTMTransactions.gt_open_handles[GTMTransactions.gt_open_count++] =
+		gtm_txninfo->gti_handle;
+}
+
+/*
+ * Remove the transaction from the open transactions, moving the last one in
+ * its place. The caller holds gt_TransArrayLock in write mode.
+ */
+static void
+GTM_RemoveOpenTransaction(GTM_TransactionInfo *gtm_txninfo)
+{
+	int32 index = gtm_txninfo->gti_open_index;
+	int32 last;
+
+	if (index < 0)
+		return;
+
+	last = --GTMTransactions.gt_open_count;
+	if (index != last)
+	{
+		GTM_TransactionHandle moved = GTMTransactions.gt_open_handles[last];
+
+		GTMTransactions.gt_open_handles[index] = moved;
+		GTMTransactions.gt_transactions_array[moved].gti_open_index = index;
+	}
+	gtm_txninfo->gti_open_index = -1;
+}
+
 /*
  * Remove the given transaction info structures from the global array. If the
  * calling thread does not have enough cached structures, we in fact keep the
@@ -279,7 +378,7 @@ GTM_RemoveTransInfoMulti(GTM_TransactionInfo *gtm_txninfo[], int txn_count)
 		if (gtm_txninfo[ii] == NULL)
 			continue;
 
-		GTMTransactions.gt_open_transactions = gtm_list_delete(GTMTransactions.gt_open_transactions, gtm_txninfo[ii]);
+		GTM_RemoveOpenTransaction(gtm_txninfo[ii]);
 
 		if (GlobalTransactionIdIsNormal(gtm_txninfo[ii]->gti_gxid) &&
 			GlobalTransactionIdFollowsOrEquals(gtm_txninfo[ii]->gti_gxid,
@@ -290,12 +389,17 @@ GTM_RemoveTransInfoMulti(GTM_TransactionInfo *gtm_txninfo[], int txn_count)
 				gtm_txninfo[ii]->gti_gxid, gtm_txninfo[ii]->gti_client_id,
 				gtm_txninfo[ii]->gti_handle);
 
+		GTM_CSNLogCompleted(gtm_txninfo[ii]->gti_gxid);
+
 		/*
 		 * Now mark the transaction as aborted and mark the structure as not-in-use
 		 */
 		clean_GTM_TransactionInfo(gtm_txninfo[ii]);
 	}
 
+	GTMTransactions.gt_snapshot_generation++;
+	GTM_PublishCSNSnapshot();
+
 	GTM_RWLockRelease(&GTMTransactions.gt_TransArrayLock);
 	return;
 }
@@ -309,17 +413,16 @@ GTM_RemoveTransInfoMulti(GTM_TransactionInfo *gtm_txninfo[], int txn_count)
 void
 GTM_RemoveAllTransInfos(uint32 client_id, int backend_id)
 {
-	gtm_ListCell *cell, *prev;
+	int ii;
 
 	/*
-	 * Scan the global list of open transactions
+	 * Scan the open transactions
 	 */
 	GTM_RWLockAcquire(&GTMTransactions.gt_TransArrayLock, GTM_LOCKMODE_WRITE);
-	prev = NULL;
-	cell = gtm_list_head(GTMTransactions.gt_open_transactions);
-	while (cell != NULL)
+	ii = 0;
+	while (ii < GTMTransactions.gt_open_count)
 	{
-		GTM_TransactionInfo *gtm_txninfo = gtm_lfirst(cell);
+		GTM_TransactionInfo *gtm_txninfo = GTM_OpenTransaction(ii);
 		/*
 		 * Check if current entry is associated with the thread
 		 * A transaction in prepared state has to be kept alive in the structure.
@@ -331,8 +434,8 @@ GTM_RemoveAllTransInfos(uint32 client_id, int backend_id)
 			(GTM_CLIENT_ID_EQ(gtm_txninfo->gti_client_id, client_id)) &&
 			((gtm_txninfo->gti_proxy_client_id == backend_id) || (backend_id == -1)))
 		{
-			/* remove the entry */
-			GTMTransactions.gt_open_transactions = gtm_list_delete_cell(GTMTransactions.gt_open_transactions, cell, prev);
+			/* remove the entry, the last one moves to its position */
+			GTM_RemoveOpenTransaction(gtm_txninfo);
 
 			/* update the latestCompletedXid */
 			if (GlobalTransactionIdIsNormal(gtm_txninfo->gti_gxid) &&
@@ -343,24 +446,20 @@ GTM_RemoveAllTransInfos(uint32 client_id, int backend_id)
 			elog(DEBUG1, "GTM_RemoveAllTransInfos: removing transaction id %u, %u:%u %d:%d",
 					gtm_txninfo->gti_gxid, gtm_txninfo->gti_client_id,
 					client_id, gtm_txninfo->gti_proxy_client_id, backend_id);
+
+			GTM_CSNLogCompleted(gtm_txninfo->gti_gxid);
 			/*
 			 * Now mark the transaction as aborted and mark the structure as not-in-use
 			 */
 			clean_GTM_TransactionInfo(gtm_txninfo);
-
-			/* move to next cell in the list */
-			if (prev)
-				cell = gtm_lnext(prev);
-			else
-				cell = gtm_list_head(GTMTransactions.gt_open_transactions);
 		}
 		else
-		{
-			prev = cell;
-			cell = gtm_lnext(cell);
-		}
+			ii++;
 	}
 
+	GTMTransactions.gt_snapshot_generation++;
+	GTM_PublishCSNSnapshot();
+
 	GTM_RWLockRelease(&GTMTransactions.gt_TransArrayLock);
 	return;
 }
@@ -375,22 +474,20 @@ GTM_RemoveAllTransInfos(uint32 client_id, int backend_id)
 uint32
 GTMGetLastClientIdentifier(void)
 {
-	gtm_ListCell *cell;
+	int ii;
 	uint32 last_client_id = 0;
 
 	/*
-	 * Scan the global list of open transactions
+	 * Scan the open transactions
 	 */
 	GTM_RWLockAcquire(&GTMTransactions.gt_TransArrayLock, GTM_LOCKMODE_WRITE);
 
-	cell = gtm_list_head(GTMTransactions.gt_open_transactions);
-	while (cell != NULL)
+	for (ii = 0; ii < GTMTransactions.gt_open_count; ii++)
 	{
-		GTM_TransactionInfo *gtm_txninfo = gtm_lfirst(cell);
+		GTM_TransactionInfo *gtm_txninfo = GTM_OpenTransaction(ii);
 
 		if (GTM_CLIENT_ID_GT(gtm_txninfo->gti_client_id, last_client_id))
 			last_client_id = gtm_txninfo->gti_client_id;
-		cell = gtm_lnext(cell);
 	}
 
 	GTM_RWLockRelease(&GTMTransactions.gt_TransArrayLock);
@@ -403,22 +500,20 @@ GTMGetLastClientIdentifier(void)
 uint32
 GTMGetFirstClientIdentifier(void)
 {
-	gtm_ListCell *cell;
+	int ii;
 	uint32 first_client_id = UINT32_MAX;
 
 	/*
-	 * Scan the global list of open transactions
+	 * Scan the open transactions
 	 */
 	GTM_RWLockAcquire(&GTMTransactions.gt_TransArrayLock, GTM_LOCKMODE_WRITE);
 
-	cell = gtm_list_head(GTMTransactions.gt_open_transactions);
-	while (cell != NULL)
+	for (ii = 0; ii < GTMTransactions.gt_open_count; ii++)
 	{
-		GTM_TransactionInfo *gtm_txninfo = gtm_lfirst(cell);
+		GTM_TransactionInfo *gtm_txninfo = GTM_OpenTransaction(ii);
 
 		if (GTM_CLIENT_ID_LT(gtm_txninfo->gti_client_id, first_client_id))
 			first_client_id = gtm_txninfo->gti_client_id;
-		cell = gtm_lnext(cell);
 	}
 
 	GTM_RWLockRelease(&GTMTransactions.gt_TransArrayLock);
@@ -571,7 +666,6 @@ GTM_GetGlobalTransactionIdMulti(GTM_TransactionHandle handle[], int txn_count)
 	GlobalTransactionId start_xid = InvalidGlobalTransactionId;
 	GTM_TransactionInfo *gtm_txninfo = NULL;
 	int ii;
-	bool save_control = false;
 
 	if (Recovery_IsStandby())
 	{
@@ -650,23 +744,17 @@ GTM_GetGlobalTransactionIdMulti(GTM_TransactionHandle handle[], int txn_count)
 		gtm_txninfo->gti_gxid = xid;
 	}
 
-	/* Periodically write the xid and sequence info out to the control file.
-	 * Try and handle wrapping, too.
-	 */
-	if (GlobalTransactionIdIsValid(xid) &&
-			(xid - ControlXid > CONTROL_INTERVAL || xid < ControlXid))
-	{
-		save_control = true;
-		ControlXid = xid;
-	}
-
+	/* Move the restore point ahead once we reach it */
 	if (GTM_NeedXidRestoreUpdate())
-		GTM_SetNeedBackup();
+		GTM_LogRestorePointXid();
 	GTM_RWLockRelease(&GTMTransactions.gt_XidGenLock);
 
-	/* save control info when not holding the XidGenLock */
-	if (save_control)
-		SaveControlInfo();
+	/*
+	 * Make the restore point durable before the XIDs are handed out, also
+	 * when another thread logged it and did not write it out yet. Do it when
+	 * not holding the XidGenLock.
+	 */
+	GTM_WriteRestorePoint();
 
 	return start_xid;
 }
@@ -729,6 +817,28 @@ GTM_BeginTransactionMulti(GTM_IsolationLevel isolevel[],
 					 GTMProxy_ConnID connid[],
 					 int txn_count,
 					 GTM_TransactionHandle txns[])
+{
+	uint32 client_id[txn_count];
+	int kk;
+
+	for (kk = 0; kk < txn_count; kk++)
+		client_id[kk] = GetMyThreadInfo->thr_client_id;
+
+	return GTM_BeginTransactionMultiInternal(isolevel, readonly, client_id,
+											 connid, txn_count, txns);
+}
+
+/*
+ * Same as GTM_BeginTransactionMulti, but the transactions may belong to
+ * different clients
+ */
+static int
+GTM_BeginTransactionMultiInternal(GTM_IsolationLevel isolevel[],
+								  bool readonly[],
+								  uint32 client_id[],
+								  GTMProxy_ConnID connid[],
+								  int txn_count,
+								  GTM_TransactionHandle txns[])
 {
 	GTM_TransactionInfo *gtm_txninfo[txn_count];
 	MemoryContext oldContext;
@@ -779,19 +889,16 @@ GTM_BeginTransactionMulti(GTM_IsolationLevel isolevel[],
 		}
 
 		init_GTM_TransactionInfo(gtm_txninfo[kk], ii, isolevel[kk],
-				GetMyThreadInfo->thr_client_id, connid[kk], readonly[kk]);
+				client_id[kk], connid[kk], readonly[kk]);
 
 		GTMTransactions.gt_lastslot = ii;
 
 		txns[kk] = ii;
 
 		/*
-		 * Add the structure to the global list of open transactions. We should
-		 * call add the element to the list in the context of TopMostMemoryContext
-		 * because the list is global and any memory allocation must outlive the
-		 * thread context
+		 * Add the structure to the open transactions
 		 */
-		GTMTransactions.gt_open_transactions = gtm_lappend(GTMTransactions.gt_open_transactions, gtm_txninfo[kk]);
+		GTM_AddOpenTransaction(gtm_txninfo[kk]);
 	}
 
 	GTM_RWLockRelease(&GTMTransactions.gt_TransArrayLock);
@@ -822,9 +929,17 @@ init_GTM_TransactionInfo(GTM_TransactionInfo *gtm_txninfo,
 						 bool readonly)
 {
 	gtm_txninfo->gti_gxid = InvalidGlobalTransactionId;
-	gtm_txninfo->gti_xmin = InvalidGlobalTransactionId;
 	gtm_txninfo->gti_state = GTM_TXN_STARTING;
 
+	/*
+	 * The snapshots the standby serves are not taken for this transaction,
+	 * keep the global xmin where it is until the transaction completes.
+	 */
+	if (GTMStandbySnapshotInterval > 0)
+		gtm_txninfo->gti_xmin = GTMTransactions.gt_recent_global_xmin;
+	else
+		gtm_txninfo->gti_xmin = InvalidGlobalTransactionId;
+
 	gtm_txninfo->gti_isolevel = isolevel;
 	gtm_txninfo->gti_readonly = readonly;
 	gtm_txninfo->gti_in_use = true;
@@ -1048,6 +1163,194 @@ GTM_CommitTransactionMulti(GTM_TransactionHandle txn[], int txn_count,
 	return remove_count;
 }
 
+/*
+ * Queue up a request to the combiner and return once it has been processed,
+ * by us or by another thread.
+ */
+static void
+GTM_CombineRequest(GTM_Combiner *combiner, GTM_CombinedRequest *req)
+{
+	GTM_CombinedRequest *reqs[GTM_MAX_COMBINED_REQUESTS];
+	int count;
+
+	req->cr_status = STATUS_OK;
+	req->cr_done = false;
+	req->cr_next = NULL;
+
+	GTM_MutexLockAcquire(&combiner->cb_lock);
+
+	if (combiner->cb_tail)
+		combiner->cb_tail->cr_next = req;
+	else
+		combiner->cb_head = req;
+	combiner->cb_tail = req;
+
+	while (combiner->cb_active && !req->cr_done)
+		GTM_CVWait(&combiner->cb_cv, &combiner->cb_lock);
+
+	if (req->cr_done)
+	{
+		GTM_MutexLockRelease(&combiner->cb_lock);
+		return;
+	}
+
+	/*
+	 * Our request is still pending and no one is processing requests, take
+	 * over. Go on until our own request has been processed.
+	 */
+	combiner->cb_active = true;
+	while (!req->cr_done)
+	{
+		count = 0;
+		while (combiner->cb_head && count < GTM_MAX_COMBINED_REQUESTS)
+		{
+			reqs[count++] = combiner->cb_head;
+			combiner->cb_head = combiner->cb_head->cr_next;
+		}
+		if (combiner->cb_head == NULL)
+			combiner->cb_tail = NULL;
+
+		GTM_MutexLockRelease(&combiner->cb_lock);
+
+		PG_TRY();
+		{
+			(combiner->cb_process)(reqs, count);
+		}
+		PG_CATCH();
+		{
+			int ii;
+
+			/*
+			 * Fail all the requests, the other threads report their own
+			 * error, and let another thread take over
+			 */
+			GTM_MutexLockAcquire(&combiner->cb_lock);
+			for (ii = 0; ii < count; ii++)
+			{
+				reqs[ii]->cr_status = STATUS_ERROR;
+				reqs[ii]->cr_done = true;
+			}
+			combiner->cb_active = false;
+			GTM_CVBcast(&combiner->cb_cv);
+			GTM_MutexLockRelease(&combiner->cb_lock);
+
+			PG_RE_THROW();
+		}
+		PG_END_TRY();
+
+		GTM_MutexLockAcquire(&combiner->cb_lock);
+		for (; count > 0; count--)
+			reqs[count - 1]->cr_done = true;
+		GTM_CVBcast(&combiner->cb_cv);
+	}
+	combiner->cb_active = false;
+	GTM_CVBcast(&combiner->cb_cv);
+
+	GTM_MutexLockRelease(&combiner->cb_lock);
+}
+
+/*
+ * Start the transactions of the combined requests and assign their GXIDs
+ */
+static void
+GTM_ProcessCombinedBegin(GTM_CombinedRequest *reqs[], int count)
+{
+	GTM_IsolationLevel isolevel[count];
+	bool readonly[count];
+	uint32 client_id[count];
+	GTMProxy_ConnID connid[count];
+	GTM_TransactionHandle txn[count];
+	GlobalTransactionId gxid;
+	int ii;
+
+	for (ii = 0; ii < count; ii++)
+	{
+		isolevel[ii] = reqs[ii]->cr_isolevel;
+		readonly[ii] = reqs[ii]->cr_readonly;
+		client_id[ii] = reqs[ii]->cr_client_id;
+		connid[ii] = -1;
+	}
+
+	if (GTM_BeginTransactionMultiInternal(isolevel, readonly, client_id, connid,
+										  count, txn) != count)
+		ereport(ERROR,
+				(EINVAL,
+				 errmsg("Failed to start %d new transactions", count)));
+
+	gxid = GTM_GetGlobalTransactionIdMulti(txn, count);
+	if (gxid == InvalidGlobalTransactionId)
+		ereport(ERROR,
+				(EINVAL,
+				 errmsg("Failed to get a new transaction id")));
+
+	for (ii = 0; ii < count; ii++)
+	{
+		reqs[ii]->cr_txn = txn[ii];
+		reqs[ii]->cr_gxid = GTM_HandleToTransactionInfo(txn[ii])->gti_gxid;
+	}
+}
+
+/*
+ * Commit the transactions of the combined requests
+ */
+static void
+GTM_ProcessCombinedCommit(GTM_CombinedRequest *reqs[], int count)
+{
+	GTM_TransactionHandle txn[count];
+	int status[count];
+	int ii;
+
+	for (ii = 0; ii < count; ii++)
+		txn[ii] = reqs[ii]->cr_txn;
+
+	GTM_CommitTransactionMulti(txn, count, 0, NULL, status);
+
+	for (ii = 0; ii < count; ii++)
+		reqs[ii]->cr_status = status[ii];
+}
+
+/*
+ * Start a transaction and assign its GXID, together with the other threads
+ * doing the same
+ */
+static GlobalTransactionId
+GTM_BeginTransactionGXIDCombined(GTM_IsolationLevel isolevel, bool readonly,
+								 GTM_TransactionHandle *txn)
+{
+	GTM_CombinedRequest req;
+
+	req.cr_isolevel = isolevel;
+	req.cr_readonly = readonly;
+	req.cr_client_id = GetMyThreadInfo->thr_client_id;
+	req.cr_txn = InvalidTransactionHandle;
+	req.cr_gxid = InvalidGlobalTransactionId;
+
+	GTM_CombineRequest(&GTMBeginCombiner, &req);
+
+	if (req.cr_status != STATUS_OK)
+		ereport(ERROR,
+				(EINVAL,
+				 errmsg("Failed to start a new transaction")));
+
+	*txn = req.cr_txn;
+	return req.cr_gxid;
+}
+
+/*
+ * Commit a transaction, together with the other threads doing the same
+ */
+static int
+GTM_CommitTransactionCombined(GTM_TransactionHandle txn)
+{
+	GTM_CombinedRequest req;
+
+	req.cr_txn = txn;
+
+	GTM_CombineRequest(&GTMCommitCombiner, &req);
+
+	return req.cr_status;
+}
+
 /*
  * Prepare a transaction
  */
@@ -1199,7 +1502,7 @@ ProcessBeginTransactionCommand(Port *myport, StringInfo message)
 {
 	GTM_IsolationLevel txn_isolation_level;
 	bool txn_read_only;
-	StringInfoData buf;
+	StringInfo	buf = GTM_ReplyBuffer;
 	GTM_TransactionHandle txn;
 	GTM_Timestamp timestamp;
 	MemoryContext oldContext;
@@ -1234,17 +1537,17 @@ ProcessBeginTransactionCommand(Port *myport, StringInfo message)
 			gtm_sync_standby(GetMyThreadInfo->thr_conn->standby);
 	}
 
-	pq_beginmessage(&buf, 'S');
-	pq_sendint(&buf, TXN_BEGIN_RESULT, 4);
+	pq_beginmessage_reuse(buf, 'S');
+	pq_sendint(buf, TXN_BEGIN_RESULT, 4);
 	if (myport->remote_type == GTM_NODE_GTM_PROXY)
 	{
 		GTM_ProxyMsgHeader proxyhdr;
 		proxyhdr.ph_conid = myport->conn_id;
-		pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+		pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 	}
-	pq_sendbytes(&buf, (char *)&txn, sizeof(txn));
-	pq_sendbytes(&buf, (char *)&timestamp, sizeof (GTM_Timestamp));
-	pq_endmessage(myport, &buf);
+	pq_sendbytes(buf, (char *)&txn, sizeof(txn));
+	pq_sendbytes(buf, (char *)&timestamp, sizeof (GTM_Timestamp));
+	pq_endmessage_reuse(myport, buf);
 
 	if (myport->remote_type != GTM_NODE_GTM_PROXY)
 	{
@@ -1283,37 +1586,29 @@ ProcessBkupBeginTransactionCommand(Port *myport, StringInfo message)
 }
 
 /*
- * Process MSG_TXN_BEGIN_GETGXID message
+ * Start a new transaction for the client of myport and back it up on the
+ * standby. Returns its GXID, its handle in *txn and its start time in
+ * *timestamp.
  */
-void
-ProcessBeginTransactionGetGXIDCommand(Port *myport, StringInfo message)
+GlobalTransactionId
+GTM_BeginTransactionGetGXID(Port *myport, GTM_IsolationLevel txn_isolation_level,
+							bool txn_read_only, GTM_TransactionHandle *txn,
+							GTM_Timestamp *timestamp)
 {
-	GTM_IsolationLevel txn_isolation_level;
-	bool txn_read_only;
-	StringInfoData buf;
-	GTM_TransactionHandle txn;
 	GlobalTransactionId gxid;
-	GTM_Timestamp timestamp;
 	MemoryContext oldContext;
 
-	txn_isolation_level = pq_getmsgint(message, sizeof (GTM_IsolationLevel));
-	txn_read_only = pq_getmsgbyte(message);
-
 	oldContext = MemoryContextSwitchTo(TopMemoryContext);
 
 	/* GXID has been received, now it's time to get a GTM timestamp */
-	timestamp = GTM_TimestampGetCurrent();
+	*timestamp = GTM_TimestampGetCurrent();
 
 	/*
-	 * Start a new transaction
+	 * Start a new transaction, coalesced with the ones other threads are
+	 * starting
 	 */
-	txn = GTM_BeginTransaction(txn_isolation_level, txn_read_only);
-	if (txn == InvalidTransactionHandle)
-		ereport(ERROR,
-				(EINVAL,
-				 errmsg("Failed to start a new transaction")));
-
-	gxid = GTM_GetGlobalTransactionId(txn);
+	gxid = GTM_BeginTransactionGXIDCombined(txn_isolation_level, txn_read_only,
+											txn);
 	if (gxid == InvalidGlobalTransactionId)
 		ereport(ERROR,
 				(EINVAL,
@@ -1321,8 +1616,6 @@ ProcessBeginTransactionGetGXIDCommand(Port *myport, StringInfo message)
 
 	MemoryContextSwitchTo(oldContext);
 
-	elog(DEBUG1, "Sending transaction id %u", gxid);
-
 	/* Backup first */
 	if (GetMyThreadInfo->thr_conn->standby)
 	{
@@ -1336,7 +1629,7 @@ retry:
 									gxid, txn_isolation_level,
 									txn_read_only,
 									GetMyThreadInfo->thr_client_id,
-									timestamp);
+									*timestamp);
 
 		if (gtm_standby_check_communication_error(&count, oldconn))
 			goto retry;
@@ -1346,18 +1639,43 @@ retry:
 			gtm_sync_standby(GetMyThreadInfo->thr_conn->standby);
 
 	}
+
+	return gxid;
+}
+
+/*
+ * Process MSG_TXN_BEGIN_GETGXID message
+ */
+void
+ProcessBeginTransactionGetGXIDCommand(Port *myport, StringInfo message)
+{
+	GTM_IsolationLevel txn_isolation_level;
+	bool txn_read_only;
+	StringInfo	buf = GTM_ReplyBuffer;
+	GTM_TransactionHandle txn;
+	GlobalTransactionId gxid;
+	GTM_Timestamp timestamp;
+
+	txn_isolation_level = pq_getmsgint(message, sizeof (GTM_IsolationLevel));
+	txn_read_only = pq_getmsgbyte(message);
+
+	gxid = GTM_BeginTransactionGetGXID(myport, txn_isolation_level,
+									   txn_read_only, &txn, &timestamp);
+
+	elog(DEBUG1, "Sending transaction id %u", gxid);
+
 	/* Respond to the client */
-	pq_beginmessage(&buf, 'S');
-	pq_sendint(&buf, TXN_BEGIN_GETGXID_RESULT, 4);
+	pq_beginmessage_reuse(buf, 'S');
+	pq_sendint(buf, TXN_BEGIN_GETGXID_RESULT, 4);
 	if (myport->remote_type == GTM_NODE_GTM_PROXY)
 	{
 		GTM_ProxyMsgHeader proxyhdr;
 		proxyhdr.ph_conid = myport->conn_id;
-		pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+		pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 	}
-	pq_sendbytes(&buf, (char *)&gxid, sizeof(gxid));
-	pq_sendbytes(&buf, (char *)&timestamp, sizeof (GTM_Timestamp));
-	pq_endmessage(myport, &buf);
+	pq_sendbytes(buf, (char *)&gxid, sizeof(gxid));
+	pq_sendbytes(buf, (char *)&timestamp, sizeof (GTM_Timestamp));
+	pq_endmessage_reuse(myport, buf);
 
 	if (myport->remote_type != GTM_NODE_GTM_PROXY)
 	{
@@ -1385,9 +1703,6 @@ GTM_BkupBeginTransactionGetGXIDMulti(GlobalTransactionId *gxid,
 	int count;
 	MemoryContext oldContext;
 
-	bool save_control = false;
-	GlobalTransactionId xid = InvalidGlobalTransactionId;
-
 	oldContext = MemoryContextSwitchTo(TopMostMemoryContext);
 
 	count = GTM_BeginTransactionMulti(isolevel, readonly, connid,
@@ -1416,24 +1731,15 @@ GTM_BkupBeginTransactionGetGXIDMulti(GlobalTransactionId *gxid,
 			GTMTransactions.gt_nextXid = gxid[ii] + 1;
 		if (!GlobalTransactionIdIsValid(GTMTransactions.gt_nextXid))	/* Handle wrap around too */
 			GTMTransactions.gt_nextXid = FirstNormalGlobalTransactionId;
-		xid = GTMTransactions.gt_nextXid;
 	}
 
-	/* Periodically write the xid and sequence info out to the control file.
-	 * Try and handle wrapping, too.
-	 */
-	if (GlobalTransactionIdIsValid(xid) &&
-			(xid - ControlXid > CONTROL_INTERVAL || xid < ControlXid))
-	{
-		save_control = true;
-		ControlXid = xid;
-	}
+	/* Keep a restore point too, in case we get promoted */
+	if (GTM_NeedXidRestoreUpdate())
+		GTM_LogRestorePointXid();
 
 	GTM_RWLockRelease(&GTMTransactions.gt_TransArrayLock);
 
-	/* save control info when not holding the XidGenLock */
-	if (save_control)
-		SaveControlInfo();
+	GTM_WriteRestorePoint();
 
 	MemoryContextSwitchTo(oldContext);
 }
@@ -1588,7 +1894,7 @@ ProcessBeginTransactionGetGXIDCommandMulti(Port *myport, StringInfo message)
 	GTM_IsolationLevel txn_isolation_level[GTM_MAX_GLOBAL_TRANSACTIONS];
 	bool txn_read_only[GTM_MAX_GLOBAL_TRANSACTIONS];
 	int txn_count;
-	StringInfoData buf;
+	StringInfo	buf = GTM_ReplyBuffer;
 	GTM_TransactionHandle txn[GTM_MAX_GLOBAL_TRANSACTIONS];
 	GlobalTransactionId start_gxid, end_gxid;
 	GTM_Timestamp timestamp;
@@ -1671,18 +1977,18 @@ retry:
 		elog(DEBUG1, "begin_transaction_multi() rc=%d done.", _rc);
 	}
 	/* Respond to the client */
-	pq_beginmessage(&buf, 'S');
-	pq_sendint(&buf, TXN_BEGIN_GETGXID_MULTI_RESULT, 4);
+	pq_beginmessage_reuse(buf, 'S');
+	pq_sendint(buf, TXN_BEGIN_GETGXID_MULTI_RESULT, 4);
 	if (myport->remote_type == GTM_NODE_GTM_PROXY)
 	{
 		GTM_ProxyMsgHeader proxyhdr;
 		proxyhdr.ph_conid = myport->conn_id;
-		pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+		pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 	}
-	pq_sendbytes(&buf, (char *)&txn_count, sizeof(txn_count));
-	pq_sendbytes(&buf, (char *)&start_gxid, sizeof(start_gxid));
-	pq_sendbytes(&buf, (char *)&(timestamp), sizeof (GTM_Timestamp));
-	pq_endmessage(myport, &buf);
+	pq_sendbytes(buf, (char *)&txn_count, sizeof(txn_count));
+	pq_sendbytes(buf, (char *)&start_gxid, sizeof(start_gxid));
+	pq_sendbytes(buf, (char *)&(timestamp), sizeof (GTM_Timestamp));
+	pq_endmessage_reuse(myport, buf);
 
 	if (myport->remote_type != GTM_NODE_GTM_PROXY)
 	{
@@ -1734,7 +2040,7 @@ ProcessBkupBeginTransactionGetGXIDCommandMulti(Port *myport, StringInfo message)
 void
 ProcessCommitTransactionCommand(Port *myport, StringInfo message, bool is_backup)
 {
-	StringInfoData buf;
+	StringInfo	buf = GTM_ReplyBuffer;
 	GTM_TransactionHandle txn;
 	GlobalTransactionId gxid;
 	MemoryContext oldContext;
@@ -1763,9 +2069,13 @@ ProcessCommitTransactionCommand(Port *myport, StringInfo message, bool is_backup
 	oldContext = MemoryContextSwitchTo(TopMemoryContext);
 
 	/*
-	 * Commit the transaction
+	 * Commit the transaction. Unless it has to wait for other transactions,
+	 * coalesce it with the ones other threads are committing
 	 */
-	status = GTM_CommitTransaction(txn, waited_xid_count, waited_xids);
+	if (waited_xid_count == 0)
+		status = GTM_CommitTransactionCombined(txn);
+	else
+		status = GTM_CommitTransaction(txn, waited_xid_count, waited_xids);
 
 	MemoryContextSwitchTo(oldContext);
 
@@ -1799,17 +2109,17 @@ ProcessCommitTransactionCommand(Port *myport, StringInfo message, bool is_backup
 			elog(DEBUG1, "commit_transaction() rc=%d done.", _rc);
 		}
 
-		pq_beginmessage(&buf, 'S');
-		pq_sendint(&buf, TXN_COMMIT_RESULT, 4);
+		pq_beginmessage_reuse(buf, 'S');
+		pq_sendint(buf, TXN_COMMIT_RESULT, 4);
 		if (myport->remote_type == GTM_NODE_GTM_PROXY)
 		{
 			GTM_ProxyMsgHeader proxyhdr;
 			proxyhdr.ph_conid = myport->conn_id;
-			pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+			pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 		}
-		pq_sendbytes(&buf, (char *)&gxid, sizeof(gxid));
-		pq_sendbytes(&buf, (char *)&status, sizeof(status));
-		pq_endmessage(myport, &buf);
+		pq_sendbytes(buf, (char *)&gxid, sizeof(gxid));
+		pq_sendbytes(buf, (char *)&status, sizeof(status));
+		pq_endmessage_reuse(myport, buf);
 
 		if (myport->remote_type != GTM_NODE_GTM_PROXY)
 		{
@@ -1833,7 +2143,7 @@ ProcessCommitTransactionCommand(Port *myport, StringInfo message, bool is_backup
 void
 ProcessCommitPreparedTransactionCommand(Port *myport, StringInfo message, bool is_backup)
 {
-	StringInfoData buf;
+	StringInfo	buf = GTM_ReplyBuffer;
 	int	txn_count = 2; /* PREPARE and COMMIT PREPARED gxid's */
 	GTM_TransactionHandle txn[txn_count];
 	GlobalTransactionId gxid[txn_count];
@@ -1914,17 +2224,17 @@ ProcessCommitPreparedTransactionCommand(Port *myport, StringInfo message, bool i
 			elog(DEBUG1, "commit_prepared_transaction() rc=%d done.", _rc);
 		}
 		/* Respond to the client */
-		pq_beginmessage(&buf, 'S');
-		pq_sendint(&buf, TXN_COMMIT_PREPARED_RESULT, 4);
+		pq_beginmessage_reuse(buf, 'S');
+		pq_sendint(buf, TXN_COMMIT_PREPARED_RESULT, 4);
 		if (myport->remote_type == GTM_NODE_GTM_PROXY)
 		{
 			GTM_ProxyMsgHeader proxyhdr;
 			proxyhdr.ph_conid = myport->conn_id;
-			pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+			pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 		}
-		pq_sendbytes(&buf, (char *)&gxid[0], sizeof(GlobalTransactionId));
-		pq_sendbytes(&buf, (char *)&status[0], 4);
-		pq_endmessage(myport, &buf);
+		pq_sendbytes(buf, (char *)&gxid[0], sizeof(GlobalTransactionId));
+		pq_sendbytes(buf, (char *)&status[0], 4);
+		pq_endmessage_reuse(myport, buf);
 
 		if (myport->remote_type != GTM_NODE_GTM_PROXY)
 		{
@@ -2142,7 +2452,7 @@ ProcessGXIDListCommand(Port *myport, StringInfo message)
 void
 ProcessRollbackTransactionCommand(Port *myport, StringInfo message, bool is_backup)
 {
-	StringInfoData buf;
+	StringInfo	buf = GTM_ReplyBuffer;
 	GTM_TransactionHandle txn;
 	GlobalTransactionId gxid;
 	MemoryContext oldContext;
@@ -2192,17 +2502,17 @@ ProcessRollbackTransactionCommand(Port *myport, StringInfo message, bool is_back
 			elog(DEBUG1, "abort_transaction() GXID=%d done.", gxid);
 		}
 		/* Respond to the client */
-		pq_beginmessage(&buf, 'S');
-		pq_sendint(&buf, TXN_ROLLBACK_RESULT, 4);
+		pq_beginmessage_reuse(buf, 'S');
+		pq_sendint(buf, TXN_ROLLBACK_RESULT, 4);
 		if (myport->remote_type == GTM_NODE_GTM_PROXY)
 		{
 			GTM_ProxyMsgHeader proxyhdr;
 			proxyhdr.ph_conid = myport->conn_id;
-			pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+			pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 		}
-		pq_sendbytes(&buf, (char *)&gxid, sizeof(gxid));
-		pq_sendint(&buf, status, sizeof(status));
-		pq_endmessage(myport, &buf);
+		pq_sendbytes(buf, (char *)&gxid, sizeof(gxid));
+		pq_sendint(buf, status, sizeof(status));
+		pq_endmessage_reuse(myport, buf);
 
 		if (myport->remote_type != GTM_NODE_GTM_PROXY)
 		{
@@ -2225,7 +2535,7 @@ ProcessRollbackTransactionCommand(Port *myport, StringInfo message, bool is_back
 void
 ProcessCommitTransactionCommandMulti(Port *myport, StringInfo message, bool is_backup)
 {
-	StringInfoData buf;
+	StringInfo	buf = GTM_ReplyBuffer;
 	GTM_TransactionHandle txn[GTM_MAX_GLOBAL_TRANSACTIONS];
 	GlobalTransactionId gxid[GTM_MAX_GLOBAL_TRANSACTIONS];
 	MemoryContext oldContext;
@@ -2284,17 +2594,17 @@ ProcessCommitTransactionCommandMulti(Port *myport, StringInfo message, bool is_b
 			elog(DEBUG1, "commit_transaction_multi() rc=%d done.", _rc);
 		}
 		/* Respond to the client */
-		pq_beginmessage(&buf, 'S');
-		pq_sendint(&buf, TXN_COMMIT_MULTI_RESULT, 4);
+		pq_beginmessage_reuse(buf, 'S');
+		pq_sendint(buf, TXN_COMMIT_MULTI_RESULT, 4);
 		if (myport->remote_type == GTM_NODE_GTM_PROXY)
 		{
 			GTM_ProxyMsgHeader proxyhdr;
 			proxyhdr.ph_conid = myport->conn_id;
-			pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+			pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 		}
-		pq_sendbytes(&buf, (char *)&txn_count, sizeof(txn_count));
-		pq_sendbytes(&buf, (char *)status, sizeof(int) * txn_count);
-		pq_endmessage(myport, &buf);
+		pq_sendbytes(buf, (char *)&txn_count, sizeof(txn_count));
+		pq_sendbytes(buf, (char *)status, sizeof(int) * txn_count);
+		pq_endmessage_reuse(myport, buf);
 
 		if (myport->remote_type != GTM_NODE_GTM_PROXY)
 		{
@@ -2315,7 +2625,7 @@ ProcessCommitTransactionCommandMulti(Port *myport, StringInfo message, bool is_b
 void
 ProcessRollbackTransactionCommandMulti(Port *myport, StringInfo message, bool is_backup)
 {
-	StringInfoData buf;
+	StringInfo	buf = GTM_ReplyBuffer;
 	GTM_TransactionHandle txn[GTM_MAX_GLOBAL_TRANSACTIONS];
 	GlobalTransactionId gxid[GTM_MAX_GLOBAL_TRANSACTIONS];
 	MemoryContext oldContext;
@@ -2373,17 +2683,17 @@ ProcessRollbackTransactionCommandMulti(Port *myport, StringInfo message, bool is
 			elog(DEBUG1, "abort_transaction_multi() rc=%d done.", _rc);
 		}
 		/* Respond to the client */
-		pq_beginmessage(&buf, 'S');
-		pq_sendint(&buf, TXN_ROLLBACK_MULTI_RESULT, 4);
+		pq_beginmessage_reuse(buf, 'S');
+		pq_sendint(buf, TXN_ROLLBACK_MULTI_RESULT, 4);
 		if (myport->remote_type == GTM_NODE_GTM_PROXY)
 		{
 			GTM_ProxyMsgHeader proxyhdr;
 			proxyhdr.ph_conid = myport->conn_id;
-			pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+			pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 		}
-		pq_sendbytes(&buf, (char *)&txn_count, sizeof(txn_count));
-		pq_sendbytes(&buf, (char *)status, sizeof(int) * txn_count);
-		pq_endmessage(myport, &buf);
+		pq_sendbytes(buf, (char *)&txn_count, sizeof(txn_count));
+		pq_sendbytes(buf, (char *)status, sizeof(int) * txn_count);
+		pq_endmessage_reuse(myport, buf);
 
 		if (myport->remote_type != GTM_NODE_GTM_PROXY)
 		{
@@ -2397,6 +2707,158 @@ ProcessRollbackTransactionCommandMulti(Port *myport, StringInfo message, bool is
 	return;
 }
 
+/*
+ * Sort the reported assignments by GXID, to match them against the open
+ * transactions
+ */
+static int
+lease_assignment_cmp(const void *a, const void *b)
+{
+	GlobalTransactionId gxid_a = ((const GTM_LeaseAssignment *) a)->la_gxid;
+	GlobalTransactionId gxid_b = ((const GTM_LeaseAssignment *) b)->la_gxid;
+
+	if (gxid_a < gxid_b)
+		return -1;
+	if (gxid_a > gxid_b)
+		return 1;
+	return 0;
+}
+
+/*
+ * Process MSG_TXN_LEASE_REPORT/MSG_BKUP_TXN_LEASE_REPORT message
+ *
+ * A GTM proxy asks for more transactions than it has begin requests for and
+ * keeps the extra GXIDs as a lease, which it hands out to the next begin
+ * requests by itself. The leased transactions are open from the start, so
+ * the snapshots include them, but they do not belong to a backend yet. The
+ * proxy reports the attributes of the ones it handed out, and gives back the
+ * ones it did not use. It does not wait for a response.
+ *
+ * is_backup indicates the message is MSG_BKUP_TXN_LEASE_REPORT
+ */
+void
+ProcessLeaseReportCommand(Port *myport, StringInfo message, bool is_backup)
+{
+	GTM_LeaseAssignment *assigned = NULL;
+	GlobalTransactionId *released = NULL;
+	GTM_TransactionHandle *txn;
+	int *status;
+	int assign_count;
+	int release_count;
+	int ii;
+
+	assign_count = pq_getmsgint(message, sizeof (int));
+	if (assign_count < 0 || assign_count > GTM_MAX_GLOBAL_TRANSACTIONS)
+		ereport(ERROR,
+				(EPROTO,
+				 errmsg("Invalid number of leased transactions: %d", assign_count)));
+	if (assign_count > 0)
+		assigned = (GTM_LeaseAssignment *)
+			palloc(sizeof (GTM_LeaseAssignment) * assign_count);
+	for (ii = 0; ii < assign_count; ii++)
+	{
+		const char *data = pq_getmsgbytes(message, sizeof (GlobalTransactionId));
+		if (data == NULL)
+			ereport(ERROR,
+					(EPROTO,
+					 errmsg("Message does not contain valid GXID")));
+		memcpy(&assigned[ii].la_gxid, data, sizeof (GlobalTransactionId));
+		assigned[ii].la_isolevel = pq_getmsgint(message, sizeof (GTM_IsolationLevel));
+		assigned[ii].la_readonly = pq_getmsgbyte(message);
+		assigned[ii].la_connid = pq_getmsgint(message, sizeof (GTMProxy_ConnID));
+	}
+
+	release_count = pq_getmsgint(message, sizeof (int));
+	if (release_count < 0 || release_count > GTM_MAX_GLOBAL_TRANSACTIONS)
+		ereport(ERROR,
+				(EPROTO,
+				 errmsg("Invalid number of leased transactions: %d", release_count)));
+	if (release_count > 0)
+		released = (GlobalTransactionId *)
+			palloc(sizeof (GlobalTransactionId) * release_count);
+	for (ii = 0; ii < release_count; ii++)
+	{
+		const char *data = pq_getmsgbytes(message, sizeof (GlobalTransactionId));
+		if (data == NULL)
+			ereport(ERROR,
+					(EPROTO,
+					 errmsg("Message does not contain valid GXID")));
+		memcpy(&released[ii], data, sizeof (GlobalTransactionId));
+	}
+	pq_getmsgend(message);
+
+	/* Hand the transactions over to the backends */
+	if (assign_count > 0)
+	{
+		qsort(assigned, assign_count, sizeof (GTM_LeaseAssignment),
+			  lease_assignment_cmp);
+
+		GTM_RWLockAcquire(&GTMTransactions.gt_TransArrayLock, GTM_LOCKMODE_WRITE);
+		for (ii = 0; ii < GTMTransactions.gt_open_count; ii++)
+		{
+			GTM_TransactionInfo *gtm_txninfo = GTM_OpenTransaction(ii);
+			GTM_LeaseAssignment key;
+			GTM_LeaseAssignment *entry;
+
+			key.la_gxid = gtm_txninfo->gti_gxid;
+			entry = bsearch(&key, assigned, assign_count,
+							sizeof (GTM_LeaseAssignment), lease_assignment_cmp);
+			/* On the standby the transactions belong to another client */
+			if (entry == NULL ||
+				(!is_backup &&
+				 !GTM_CLIENT_ID_EQ(gtm_txninfo->gti_client_id,
+								   GetMyThreadInfo->thr_client_id)))
+				continue;
+
+			gtm_txninfo->gti_isolevel = entry->la_isolevel;
+			gtm_txninfo->gti_readonly = entry->la_readonly;
+			gtm_txninfo->gti_proxy_client_id = entry->la_connid;
+		}
+		GTM_RWLockRelease(&GTMTransactions.gt_TransArrayLock);
+	}
+
+	/* And end the ones the proxy did not need */
+	if (release_count > 0)
+	{
+		txn = (GTM_TransactionHandle *)
+			palloc(sizeof (GTM_TransactionHandle) * release_count);
+		status = (int *) palloc(sizeof (int) * release_count);
+		for (ii = 0; ii < release_count; ii++)
+			txn[ii] = GTM_GXIDToHandle(released[ii]);
+		GTM_RollbackTransactionMulti(txn, release_count, status);
+		pfree(txn);
+		pfree(status);
+	}
+
+	elog(DEBUG1, "Leased transactions: %d handed out, %d released",
+		 assign_count, release_count);
+
+	if (!is_backup && GetMyThreadInfo->thr_conn->standby)
+	{
+		int _rc;
+		GTM_Conn *oldconn = GetMyThreadInfo->thr_conn->standby;
+		int count = 0;
+
+		elog(DEBUG1, "calling bkup_report_leased_gxids() for standby GTM %p.",
+			 GetMyThreadInfo->thr_conn->standby);
+
+retry:
+		_rc = bkup_report_leased_gxids(GetMyThreadInfo->thr_conn->standby,
+									   assign_count, assigned,
+									   release_count, released);
+
+		if (gtm_standby_check_communication_error(&count, oldconn))
+			goto retry;
+
+		elog(DEBUG1, "bkup_report_leased_gxids() rc=%d done.", _rc);
+	}
+
+	if (assigned)
+		pfree(assigned);
+	if (released)
+		pfree(released);
+}
+
 /*
  * Process MSG_TXN_START_PREPARED/MSG_BKUP_TXN_START_PREPARED message
  *
@@ -2405,7 +2867,7 @@ ProcessRollbackTransactionCommandMulti(Port *myport, StringInfo message, bool is
 void
 ProcessStartPreparedTransactionCommand(Port *myport, StringInfo message, bool is_backup)
 {
-	StringInfoData buf;
+	StringInfo	buf = GTM_ReplyBuffer;
 	GTM_TransactionHandle txn;
 	GlobalTransactionId gxid;
 	GTM_StrLen gidlen, nodelen;
@@ -2473,16 +2935,16 @@ ProcessStartPreparedTransactionCommand(Port *myport, StringInfo message, bool is
 
 			elog(DEBUG1, "start_prepared_transaction() rc=%d done.", _rc);
 		}
-		pq_beginmessage(&buf, 'S');
-		pq_sendint(&buf, TXN_START_PREPARED_RESULT, 4);
+		pq_beginmessage_reuse(buf, 'S');
+		pq_sendint(buf, TXN_START_PREPARED_RESULT, 4);
 		if (myport->remote_type == GTM_NODE_GTM_PROXY)
 		{
 			GTM_ProxyMsgHeader proxyhdr;
 			proxyhdr.ph_conid = myport->conn_id;
-			pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+			pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 		}
-		pq_sendbytes(&buf, (char *)&gxid, sizeof(GlobalTransactionId));
-		pq_endmessage(myport, &buf);
+		pq_sendbytes(buf, (char *)&gxid, sizeof(GlobalTransactionId));
+		pq_endmessage_reuse(myport, buf);
 
 		if (myport->remote_type != GTM_NODE_GTM_PROXY)
 		{
@@ -2504,7 +2966,7 @@ ProcessStartPreparedTransactionCommand(Port *myport, StringInfo message, bool is
 void
 ProcessPrepareTransactionCommand(Port *myport, StringInfo message, bool is_backup)
 {
-	StringInfoData buf;
+	StringInfo	buf = GTM_ReplyBuffer;
 	GTM_TransactionHandle txn;
 	GlobalTransactionId gxid;
 	MemoryContext oldContext;
@@ -2553,16 +3015,16 @@ ProcessPrepareTransactionCommand(Port *myport, StringInfo message, bool is_backu
 			elog(DEBUG1, "prepare_transaction() GXID=%d done.", gxid);
 		}
 		/* Respond to the client */
-		pq_beginmessage(&buf, 'S');
-		pq_sendint(&buf, TXN_PREPARE_RESULT, 4);
+		pq_beginmessage_reuse(buf, 'S');
+		pq_sendint(buf, TXN_PREPARE_RESULT, 4);
 		if (myport->remote_type == GTM_NODE_GTM_PROXY)
 		{
 			GTM_ProxyMsgHeader proxyhdr;
 			proxyhdr.ph_conid = myport->conn_id;
-			pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+			pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 		}
-		pq_sendbytes(&buf, (char *)&gxid, sizeof(gxid));
-		pq_endmessage(myport, &buf);
+		pq_sendbytes(buf, (char *)&gxid, sizeof(gxid));
+		pq_endmessage_reuse(myport, buf);
 
 		if (myport->remote_type != GTM_NODE_GTM_PROXY)
 		{
@@ -2588,7 +3050,7 @@ ProcessPrepareTransactionCommand(Port *myport, StringInfo message, bool is_backu
 void
 ProcessGetGXIDTransactionCommand(Port *myport, StringInfo message)
 {
-	StringInfoData buf;
+	StringInfo	buf = GTM_ReplyBuffer;
 	GTM_TransactionHandle txn;
 	GlobalTransactionId gxid;
 	const char *data;
@@ -2620,17 +3082,17 @@ ProcessGetGXIDTransactionCommand(Port *myport, StringInfo message)
 
 	elog(DEBUG3, "Sending transaction id %d", gxid);
 
-	pq_beginmessage(&buf, 'S');
-	pq_sendint(&buf, TXN_GET_GXID_RESULT, 4);
+	pq_beginmessage_reuse(buf, 'S');
+	pq_sendint(buf, TXN_GET_GXID_RESULT, 4);
 	if (myport->remote_type == GTM_NODE_GTM_PROXY)
 	{
 		GTM_ProxyMsgHeader proxyhdr;
 		proxyhdr.ph_conid = myport->conn_id;
-		pq_sendbytes(&buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
+		pq_sendbytes(buf, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
 	}
-	pq_sendbytes(&buf, (char *)&txn, sizeof(txn));
-	pq_sendbytes(&buf, (char *)&gxid, sizeof(gxid));
-	pq_endmessage(myport, &buf);
+	pq_sendbytes(buf, (char *)&txn, sizeof(txn));
+	pq_sendbytes(buf, (char *)&gxid, sizeof(gxid));
+	pq_endmessage_reuse(myport, buf);
 
 	if (myport->remote_type != GTM_NODE_GTM_PROXY)
 		pq_flush(myport);
@@ -2702,6 +3164,9 @@ GTM_RestoreTxnInfo(FILE *ctlf, GlobalTransactionId next_gxid)
 {
 	GlobalTransactionId saved_gxid;
 
+	/* The state log is not replayed over an explicitly given GXID */
+	next_gxid_given = GlobalTransactionIdIsValid(next_gxid);
+
 	if (ctlf)
 	{
 		if ((fscanf(ctlf, "%u", &saved_gxid) != 1) &&
@@ -2711,7 +3176,6 @@ GTM_RestoreTxnInfo(FILE *ctlf, GlobalTransactionId next_gxid)
 		{
 			/* Add in extra amount in case we had not gracefully stopped */
 			next_gxid = saved_gxid + CONTROL_INTERVAL;
-			ControlXid = next_gxid;
 		}
 	}
 	else if (!GlobalTransactionIdIsValid(next_gxid))
@@ -2723,9 +3187,30 @@ GTM_RestoreTxnInfo(FILE *ctlf, GlobalTransactionId next_gxid)
 		SetNextGlobalTransactionId(next_gxid);
 	/* Set this otherwise a strange snapshot might be returned for the first one */
 	GTMTransactions.gt_latestCompletedXid = next_gxid - 1;
+	GTMTransactions.gt_snapshot_generation++;
+	GTM_PublishCSNSnapshot();
 	return;
 }
 
+/*
+ * Replay a GXID restore point of the state log: no GXID beyond it had been
+ * handed out when it was logged.
+ */
+void
+GTM_RestoreTxnRestorePoint(GlobalTransactionId gxid)
+{
+	if (next_gxid_given || !GlobalTransactionIdIsValid(gxid) ||
+		!GlobalTransactionIdPrecedes(ReadNewGlobalTransactionId(), gxid))
+		return;
+
+	elog(DEBUG1, "Restoring last GXID to %u from the state log", gxid);
+
+	SetNextGlobalTransactionId(gxid);
+	GTMTransactions.gt_latestCompletedXid = gxid - 1;
+	GTMTransactions.gt_snapshot_generation++;
+	GTM_PublishCSNSnapshot();
+}
+
 void
 GTM_SaveTxnInfo(FILE *ctlf)
 {
@@ -2743,15 +3228,85 @@ bool GTM_NeedXidRestoreUpdate(void)
 	return(GlobalTransactionIdPrecedesOrEquals(GTMTransactions.gt_backedUpXid, GTMTransactions.gt_nextXid));
 }
 
+/*
+ * Move the GXID restore point ahead of the next GXID and add it to the state
+ * log. The caller holds the lock protecting gt_nextXid, and makes the record
+ * durable with GTM_WriteRestorePoint() once it released the lock.
+ */
+void GTM_LogRestorePointXid(void)
+{
+	GlobalTransactionId gxid;
+	char record[64];
+
+	gxid = GTMTransactions.gt_nextXid + RestoreDuration;
+	/* Handle wrap around, skipping the special GXIDs */
+	if (gxid < FirstNormalGlobalTransactionId)
+		gxid += FirstNormalGlobalTransactionId;
+	GTMTransactions.gt_backedUpXid = gxid;
+
+	elog(DEBUG1, "Saving transaction restoration info, backed-up gxid: %u", gxid);
+	snprintf(record, sizeof(record), "%s\t%u\n", GTM_STATE_XID_TAG, gxid);
+	GTM_AppendStateRecord(record);
+}
+
+/*
+ * Raise the GXID restore point to the one replicated from the active GTM,
+ * and log it so it survives a restart of the standby.
+ */
+void GTM_ApplyRestorePointXid(GlobalTransactionId gxid)
+{
+	char record[64];
+
+	GTM_RWLockAcquire(&GTMTransactions.gt_XidGenLock, GTM_LOCKMODE_WRITE);
+	if (GlobalTransactionIdPrecedes(GTMTransactions.gt_backedUpXid, gxid))
+	{
+		GTMTransactions.gt_backedUpXid = gxid;
+		snprintf(record, sizeof(record), "%s\t%u\n", GTM_STATE_XID_TAG, gxid);
+		GTM_AppendStateRecord(record);
+	}
+	GTM_RWLockRelease(&GTMTransactions.gt_XidGenLock);
+}
+
+/*
+ * Skip the GXIDs the active GTM may have handed out when this standby is
+ * promoted. The backup messages may lag behind, but the active GTM never
+ * goes past a restore point before it is replicated here, nor past the
+ * restore point it set from a GXID we have seen already.
+ */
+void GTM_PromoteRestorePointXid(void)
+{
+	GlobalTransactionId gxid;
+
+	GTM_RWLockAcquire(&GTMTransactions.gt_XidGenLock, GTM_LOCKMODE_WRITE);
+	gxid = GTMTransactions.gt_nextXid + RestoreDuration;
+	if (gxid < FirstNormalGlobalTransactionId)
+		gxid += FirstNormalGlobalTransactionId;
+	if (GlobalTransactionIdPrecedes(gxid, GTMTransactions.gt_backedUpXid))
+		gxid = GTMTransactions.gt_backedUpXid;
+	GTMTransactions.gt_nextXid = gxid;
+	GTM_RWLockRelease(&GTMTransactions.gt_XidGenLock);
+
+	elog(LOG, "Next GXID moved to the restore point %u", gxid);
+}
+
+/*
+ * Write the GXID restore point to a snapshot of the state. Once the next
+ * GXID reaches the restore point it is logged again, until then the next
+ * GXID itself is safe to restore from.
+ */
 void GTM_WriteRestorePointXid(FILE *f)
 {
-	if ((MaxGlobalTransactionId - GTMTransactions.gt_nextXid) <= RestoreDuration)
-		GTMTransactions.gt_backedUpXid = GTMTransactions.gt_nextXid + RestoreDuration;
+	GlobalTransactionId gxid;
+
+	GTM_RWLockAcquire(&GTMTransactions.gt_XidGenLock, GTM_LOCKMODE_READ);
+	if (GTM_NeedXidRestoreUpdate())
+		gxid = GTMTransactions.gt_nextXid;
 	else
-		GTMTransactions.gt_backedUpXid = FirstNormalGlobalTransactionId + (RestoreDuration - (MaxGlobalTransactionId - GTMTransactions.gt_nextXid));
-	
-	elog(DEBUG1, "Saving transaction restoration info, backed-up gxid: %u", GTMTransactions.gt_backedUpXid);
-	fprintf(f, "%u\n", GTMTransactions.gt_backedUpXid);
+		gxid = GTMTransactions.gt_backedUpXid;
+	GTM_RWLockRelease(&GTMTransactions.gt_XidGenLock);
+
+	elog(DEBUG1, "Saving transaction restoration info, backed-up gxid: %u", gxid);
+	fprintf(f, "%u\n", gxid);
 }
 
 /*
@@ -21,6 +21,7 @@
 #include <unistd.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/select.h>
 #include <sys/stat.h>
@@ -52,6 +53,7 @@
 #include "gtm/gtm_opt.h"
 #include "gtm/gtm_utils.h"
 #include "gtm/gtm_backup.h"
+#include "gtm/gtm_trace.h"
 
 extern int	optind;
 extern char *optarg;
@@ -75,8 +77,11 @@ int 		active_port;
 int			tcp_keepalives_idle;
 int			tcp_keepalives_interval;
 int			tcp_keepalives_count;
+int			GTMWorkerThreads = 0;
+int			GTMStandbySnapshotInterval = 0;
 char		*error_reporter;
 char		*status_reader;
+char		*GTMTraceFile;
 bool		isStartUp;
 GTM_MutexLock   control_lock;
 char		GTMControlFileTmp[GTM_MAX_PATH];
@@ -98,12 +103,22 @@ static int	ListenSocket[MAXLISTEN];
 
 pthread_key_t	threadinfo_key;
 static bool		GTMAbortPending = false;
+static volatile bool GTMPrintStatsPending = false;
+
+/* Worker threads serving the connections, if worker_threads is set */
+static GTM_ThreadInfo **GTMWorkers = NULL;
 
 static Port *ConnCreate(int serverFd);
 static int ServerLoop(void);
 static int initMasks(fd_set *rmask);
 void *GTM_ThreadMain(void *argp);
+void *GTM_WorkerMain(void *argp);
 static int GTMAddConnection(Port *port, GTM_Conn *standby);
+static void GTM_HandshakeConnection(GTM_ConnectionInfo *conninfo);
+static void GTM_CheckStandbyConnection(GTM_ThreadInfo *thrinfo);
+static bool GTM_ProcessMessage(GTM_ThreadInfo *thrinfo, int qtype, StringInfo input_message);
+static void GTM_WorkerCollectConnections(GTM_ThreadInfo *thrinfo);
+static void GTM_WorkerProcessConnection(GTM_ThreadInfo *thrinfo, StringInfo input_message);
 static int ReadCommand(Port *myport, StringInfo inBuf);
 
 static void ProcessCommand(Port *myport, StringInfo input_message);
@@ -124,6 +139,7 @@ static void checkDataDir(void);
 static void DeleteLockFile(const char *filename);
 static void PromoteToActive(void);
 static void ProcessSyncStandbyCommand(Port *myport, GTM_MessageType mtype, StringInfo message);
+static void ProcessBkupStateLogCommand(Port *myport, StringInfo message);
 static void ProcessBarrierCommand(Port *myport, GTM_MessageType mtype, StringInfo message);
 
 /*
@@ -141,7 +157,8 @@ MainThreadInit()
 	 * Initialize the lock protecting the global threads info and backup lock info.
 	 */
 	GTM_RWLockInit(&GTMThreads->gt_lock);
-	GTM_RWLockInit(&gtm_bkup_lock);
+	GTM_RWLockSetName(&GTMThreads->gt_lock, "ThreadsLock");
+	GTM_InitStateLog();
 
 	/*
 	 * Set the next client identifier to be issued after connection
@@ -194,9 +211,6 @@ InitGTMProcess()
 	MyThreadID = pthread_self();
 	MemoryContextInit();
 
-	/* Backup the restore point */
-	GTM_WriteRestorePoint();
-
 	/*
 	 * The memory context is now set up.
 	 * Add the thrinfo structure in the global array
@@ -231,6 +245,9 @@ BaseInit()
 
 	DebugFileOpen();
 
+	if (GTMTraceFile != NULL && GTMTraceFile[0] != '\0')
+		GTM_TraceOpen(GTMTraceFile, false);
+
 	GTM_InitTxnManager();
 	GTM_InitSeqManager();
 
@@ -255,6 +272,11 @@ GTM_SigleHandler(int signal)
 				PromoteToActive();
 			return;
 
+		case SIGUSR2:
+			/* Reported by the main loop */
+			GTMPrintStatsPending = true;
+			return;
+
 		default:
 			fprintf(stderr, "Unknown signal %d\n", signal);
 			return;
@@ -314,27 +336,8 @@ gtm_status()
 void
 SaveControlInfo(void)
 {
-	FILE	   *ctlf;
-
 	GTM_MutexLockAcquire(&control_lock);
-
-	ctlf = fopen(GTMControlFileTmp, "w");
-
-	if (ctlf == NULL)
-	{
-		fprintf(stderr, "Failed to create/open the control file\n");
-		fclose(ctlf);
-		GTM_MutexLockRelease(&control_lock);
-		return;
-	}
-
-	GTM_SaveTxnInfo(ctlf);
-	GTM_SaveSeqInfo(ctlf);
-	fclose(ctlf);
-
-	remove(GTMControlFile);
-	rename(GTMControlFileTmp, GTMControlFile);
-
+	GTM_WriteControlFile();
 	GTM_MutexLockRelease(&control_lock);
 }
 
@@ -661,6 +664,9 @@ main(int argc, char *argv[])
 		GTM_MutexLockRelease(&control_lock);
 	}
 
+	/* Log the changes from now on, after a snapshot of the restored state */
+	GTM_StartStateLog();
+
 	if (Recovery_IsStandby())
 	{
 		if (!gtm_standby_register_self(NodeName, GTMPortNumber, GTMDataDir))
@@ -731,6 +737,7 @@ main(int argc, char *argv[])
 	pqsignal(SIGTERM, GTM_SigleHandler);
 	pqsignal(SIGINT, GTM_SigleHandler);
 	pqsignal(SIGUSR1, GTM_SigleHandler);
+	pqsignal(SIGUSR2, GTM_SigleHandler);
 	pqsignal(SIGPIPE, SIG_IGN);
 
 	pqinitmask();
@@ -774,9 +781,30 @@ main(int argc, char *argv[])
 		elog(DEBUG1, "Startup connection with the active-GTM closed.");
 	}
 
+	/*
+	 * Start the worker threads, if connections are to be served by a fixed
+	 * pool of threads rather than by a thread each
+	 */
+	if (GTMWorkerThreads > 0)
+	{
+		int			ii;
+
+		GTMWorkers = (GTM_ThreadInfo **)
+			palloc(sizeof (GTM_ThreadInfo *) * GTMWorkerThreads);
+		for (ii = 0; ii < GTMWorkerThreads; ii++)
+		{
+			GTMWorkers[ii] = GTM_ThreadCreate(NULL, GTM_WorkerMain);
+			if (GTMWorkers[ii] == NULL)
+				ereport(FATAL,
+						(EAGAIN,
+						 errmsg("Failed to start worker thread %d", ii)));
+		}
+		elog(LOG, "Started %d worker threads.", GTMWorkerThreads);
+	}
+
 	/*
 	 * Accept any new connections. Fork a new thread for each incoming
-	 * connection
+	 * connection, or hand it over to a worker thread
 	 */
 	status = ServerLoop();
 
@@ -862,6 +890,7 @@ ServerLoop(void)
 			 */
 
 			elog(LOG, "GTM shutting down.");
+			gtm_print_stats();
 			/*
 			 * Tell GTM that we are shutting down so that no new GXIDs are
 			 * issued this point onwards
@@ -869,6 +898,7 @@ ServerLoop(void)
 			GTM_SetShuttingDown();
 
 			SaveControlInfo();
+			GTM_TraceClose();
 
 #if 0
 			/*
@@ -914,6 +944,12 @@ ServerLoop(void)
 		 */
 		PG_SETMASK(&BlockSig);
 
+		if (GTMPrintStatsPending)
+		{
+			GTMPrintStatsPending = false;
+			gtm_print_stats();
+		}
+
 		/* Now check the select() result */
 		if (selres < 0)
 		{
@@ -1008,13 +1044,15 @@ GTM_ThreadMain(void *argp)
 	 * Create the memory context we will use in the main loop.
 	 *
 	 * MessageContext is reset once per iteration of the main loop, ie, upon
-	 * completion of processing of each command message from the client.
+	 * completion of processing of each command message from the client. It
+	 * keeps its first block over resets, so that small requests do not go
+	 * to malloc.
 	 *
 	 * This context is thread-specific
 	 */
 	MessageContext = AllocSetContextCreate(TopMemoryContext,
 										   "MessageContext",
-										   ALLOCSET_DEFAULT_MINSIZE,
+										   ALLOCSET_DEFAULT_INITSIZE,
 										   ALLOCSET_DEFAULT_INITSIZE,
 										   ALLOCSET_DEFAULT_MAXSIZE,
 										   false);
@@ -1025,6 +1063,120 @@ GTM_ThreadMain(void *argp)
 	 */
 	GTM_RWLockAcquire(&thrinfo->thr_lock, GTM_LOCKMODE_WRITE);
 
+	thrinfo->thr_conn->con_client_id = thrinfo->thr_client_id;
+	GTM_HandshakeConnection(thrinfo->thr_conn);
+	thrinfo->thr_client_id = thrinfo->thr_conn->con_client_id;
+
+	/*
+	 * Get the input_message in the TopMemoryContext so that we don't need to
+	 * free/palloc it for every incoming message. Unlike Postgres, we don't
+	 * expect the incoming messages to be of arbitrary sizes
+	 */
+
+	initStringInfo(&input_message);
+
+	/*
+	 * POSTGRES main processing loop begins here
+	 *
+	 * If an exception is encountered, processing resumes here so we abort the
+	 * current transaction and start a new one.
+	 *
+	 * You might wonder why this isn't coded as an infinite loop around a
+	 * PG_TRY construct.  The reason is that this is the bottom of the
+	 * exception stack, and so with PG_TRY there would be no exception handler
+	 * in force at all during the CATCH part.  By leaving the outermost setjmp
+	 * always active, we have at least some chance of recovering from an error
+	 * during error recovery.  (If we get into an infinite loop thereby, it
+	 * will soon be stopped by overflow of elog.c's internal state stack.)
+	 */
+
+	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
+	{
+		/*
+		 * NOTE: if you are tempted to add more code in this if-block,
+		 * consider the high probability that it should be in
+		 * AbortTransaction() instead.	The only stuff done directly here
+		 * should be stuff that is guaranteed to apply *only* for outer-level
+		 * error recovery, such as adjusting the FE/BE protocol status.
+		 */
+
+		/* Report the error to the client and/or server log */
+		if (thrinfo->thr_conn)
+			EmitErrorReport(thrinfo->thr_conn->con_port);
+		else
+			EmitErrorReport(NULL);
+
+		/*
+		 * Now return to normal top-level context and clear ErrorContext for
+		 * next time.
+		 */
+		MemoryContextSwitchTo(TopMemoryContext);
+		FlushErrorState();
+	}
+
+	/* We can now handle ereport(ERROR) */
+	PG_exception_stack = &local_sigjmp_buf;
+
+
+	for (;;)
+	{
+		/*
+		 * Release storage left over from prior query cycle, and create a new
+		 * query input buffer in the cleared MessageContext.
+		 */
+		MemoryContextSwitchTo(MessageContext);
+		MemoryContextResetAndDeleteChildren(MessageContext);
+
+		/*
+		 * Just reset the input buffer to avoid repeated palloc/pfrees
+		 *
+		 * XXX We should consider resetting the MessageContext periodically to
+		 * handle any memory leaks
+		 */
+		resetStringInfo(&input_message);
+
+		/*
+		 * GTM-Standby registration information can be updated during ReadCommand
+		 * operation.
+		 */
+		GTM_RWLockRelease(&thrinfo->thr_lock);
+
+		/* Send the backups of the requests served before we block */
+		if (thrinfo->thr_conn->con_port->PqRecvPointer >=
+			thrinfo->thr_conn->con_port->PqRecvLength)
+			gtm_standby_flush(thrinfo->thr_conn->standby);
+
+		/*
+		 * (3) read a command (loop blocks here)
+		 */
+		qtype = ReadCommand(thrinfo->thr_conn->con_port, &input_message);
+		thrinfo->thr_recv_time = gtm_stat_now();
+
+		GTM_RWLockAcquire(&thrinfo->thr_lock, GTM_LOCKMODE_WRITE);
+
+		GTM_CheckStandbyConnection(thrinfo);
+
+		if (!GTM_ProcessMessage(thrinfo, qtype, &input_message))
+		{
+			GTM_RWLockRelease(&thrinfo->thr_lock);
+			pthread_exit(thrinfo);
+		}
+	}
+
+	/* can't get here because the above loop never exits */
+	Assert(false);
+
+	return thrinfo;
+}
+
+/*
+ * Process the startup message of a new connection and reply with the client
+ * identifier. The connection's con_client_id is the identifier assigned by
+ * us, it is replaced by the one sent by the client if we accept it.
+ */
+static void
+GTM_HandshakeConnection(GTM_ConnectionInfo *conninfo)
+{
 	{
 		/*
 		 * We expect a startup message at the very start. The message type is
@@ -1034,7 +1186,7 @@ GTM_ThreadMain(void *argp)
 		GTM_StartupPacket sp;
 		StringInfoData inBuf;
 
-		startup_type = pq_getbyte(thrinfo->thr_conn->con_port);
+		startup_type = pq_getbyte(conninfo->con_port);
 
 		if (startup_type != 'A')
 			ereport(ERROR,
@@ -1049,7 +1201,7 @@ GTM_ThreadMain(void *argp)
 		 * after the type code; we can read the message contents independently of
 		 * the type.
 		 */
-		if (pq_getmessage(thrinfo->thr_conn->con_port, &inBuf, 0))
+		if (pq_getmessage(conninfo->con_port, &inBuf, 0))
 			ereport(ERROR,
 					(EPROTO,
 					 errmsg("Expecting coordinator ID, but received EOF")));
@@ -1058,11 +1210,12 @@ GTM_ThreadMain(void *argp)
 			   pq_getmsgbytes(&inBuf, sizeof (GTM_StartupPacket)),
 			   sizeof (GTM_StartupPacket));
 		pq_getmsgend(&inBuf);
+		pfree(inBuf.data);
 
-		GTM_RegisterPGXCNode(thrinfo->thr_conn->con_port, sp.sp_node_name);
+		GTM_RegisterPGXCNode(conninfo->con_port, sp.sp_node_name);
 
-		thrinfo->thr_conn->con_port->remote_type = sp.sp_remotetype;
-		thrinfo->thr_conn->con_port->is_postmaster = sp.sp_ispostmaster;
+		conninfo->con_port->remote_type = sp.sp_remotetype;
+		conninfo->con_port->is_postmaster = sp.sp_ispostmaster;
 
 		/*
 		 * If the client has resent the identifier assigned to it previously
@@ -1075,7 +1228,7 @@ GTM_ThreadMain(void *argp)
 		if ((sp.sp_client_id != 0) &&
 			(sp.sp_client_id <= GTMThreads->gt_starting_client_id))
 		{
-			thrinfo->thr_client_id = sp.sp_client_id;
+			conninfo->con_client_id = sp.sp_client_id;
 		}
 	}
 
@@ -1088,49 +1241,165 @@ GTM_ThreadMain(void *argp)
 		 */
 		StringInfoData buf;
 		pq_beginmessage(&buf, 'R');
-		pq_sendint(&buf, thrinfo->thr_client_id, 4);
-		pq_endmessage(thrinfo->thr_conn->con_port, &buf);
-		pq_flush(thrinfo->thr_conn->con_port);
+		pq_sendint(&buf, conninfo->con_client_id, 4);
+		pq_endmessage(conninfo->con_port, &buf);
+		pq_flush(conninfo->con_port);
 
 		elog(DEBUG3, "Sent connection authentication message to the client");
 	}
 
-	/*
-	 * Get the input_message in the TopMemoryContext so that we don't need to
-	 * free/palloc it for every incoming message. Unlike Postgres, we don't
-	 * expect the incoming messages to be of arbitrary sizes
-	 */
+	conninfo->con_authenticated = true;
+}
 
-	initStringInfo(&input_message);
+/*
+ * Check if GTM Standby info is upadted and connect to or disconnect from the
+ * standby on behalf of the connection being served.
+ *
+ * Please note that we don't check if it is not in the standby mode to allow
+ * cascased standby.
+ *
+ * Also ensure that we don't try to connect just yet if we are responsible for
+ * serving the BACKUP request from the standby. Otherwise, this will lead to a
+ * deadlock
+ */
+static void
+GTM_CheckStandbyConnection(GTM_ThreadInfo *thrinfo)
+{
+	if (GTMThreads->gt_standby_ready &&
+			thrinfo->thr_conn->standby == NULL &&
+			thrinfo->thr_status != GTM_THREAD_BACKUP)
+	{
+		/* Connect to GTM-Standby */
+		thrinfo->thr_conn->standby = gtm_standby_connect_to_standby();
+		if (thrinfo->thr_conn->standby == NULL)
+			GTMThreads->gt_standby_ready = false;	/* This will make other threads to disconnect from
+													 * the standby, if needed.*/
+	}
+	else if (GTMThreads->gt_standby_ready == false && thrinfo->thr_conn->standby)
+	{
+		/* Disconnect from GTM-Standby */
+		gtm_standby_disconnect_from_standby(thrinfo->thr_conn->standby);
+		thrinfo->thr_conn->standby = NULL;
+	}
+}
+
+/*
+ * Process a message read from the connection being served by the thread.
+ * Returns false if the client terminated the connection.
+ */
+static bool
+GTM_ProcessMessage(GTM_ThreadInfo *thrinfo, int qtype, StringInfo input_message)
+{
+	switch(qtype)
+	{
+		case 'C':
+			ProcessCommand(thrinfo->thr_conn->con_port, input_message);
+			break;
+
+		case 'X':
+			elog(DEBUG1, "Removing all transaction infos - qtype:X");
+		case EOF:
+			/*
+			 * Connection termination request
+			 * Remove all transactions opened within the thread. Note that
+			 * we don't remove transaction infos if we are a standby and
+			 * the transaction infos actually correspond to in-progress
+			 * transactions on the master
+			 */
+			elog(DEBUG1, "Removing all transaction infos - qtype:EOF");
+			if (!Recovery_IsStandby())
+				GTM_RemoveAllTransInfos(thrinfo->thr_client_id, -1);
+
+			/* Disconnect node if necessary */
+			Recovery_PGXCNodeDisconnect(thrinfo->thr_conn->con_port);
+			return false;
+
+		case 'F':
+			/*
+			 * Flush all the outgoing data on the wire. Consume the message
+			 * type field for sanity
+			 */
+			/* Sync with standby first */
+			if (thrinfo->thr_conn->standby)
+			{
+				if (Backup_synchronously)
+					gtm_sync_standby(thrinfo->thr_conn->standby);
+				else
+					gtm_standby_flush(thrinfo->thr_conn->standby);
+			}
+			pq_getmsgint(input_message, sizeof (GTM_MessageType));
+			pq_getmsgend(input_message);
+			pq_flush(thrinfo->thr_conn->con_port);
+			break;
+
+		default:
+			/*
+			 * Remove all transactions opened by the client
+			 */
+			GTM_RemoveAllTransInfos(thrinfo->thr_client_id, -1);
+
+			/* Disconnect node if necessary */
+			Recovery_PGXCNodeDisconnect(thrinfo->thr_conn->con_port);
+
+			/*
+			 * A worker thread serves other connections too, just drop this
+			 * one
+			 */
+			thrinfo->thr_conn->con_disconnected = true;
+			ereport(thrinfo->thr_worker ? ERROR : FATAL,
+					(EPROTO,
+					 errmsg("invalid frontend message type %d",
+							qtype)));
+			break;
+	}
+	return true;
+}
+
+/*
+ * Main loop of a worker thread.
+ *
+ * A worker thread serves all the connections handed over to it by the main
+ * thread. It waits for any of them to become readable and processes the
+ * messages available, so that the number of threads does not grow with the
+ * number of clients.
+ *
+ * The thread lock is held while a connection is being served, and thr_conn
+ * and thr_client_id point to that connection so that the command processing
+ * routines need not know about workers.
+ */
+void *
+GTM_WorkerMain(void *argp)
+{
+	GTM_ThreadInfo *thrinfo = (GTM_ThreadInfo *)argp;
+	StringInfoData input_message;
+	sigjmp_buf  local_sigjmp_buf;
+
+	elog(DEBUG3, "Starting the worker thread");
 
 	/*
-	 * POSTGRES main processing loop begins here
-	 *
-	 * If an exception is encountered, processing resumes here so we abort the
-	 * current transaction and start a new one.
-	 *
-	 * You might wonder why this isn't coded as an infinite loop around a
-	 * PG_TRY construct.  The reason is that this is the bottom of the
-	 * exception stack, and so with PG_TRY there would be no exception handler
-	 * in force at all during the CATCH part.  By leaving the outermost setjmp
-	 * always active, we have at least some chance of recovering from an error
-	 * during error recovery.  (If we get into an infinite loop thereby, it
-	 * will soon be stopped by overflow of elog.c's internal state stack.)
+	 * Create the memory context we will use in the main loop, as for the
+	 * connection helper threads
 	 */
+	MessageContext = AllocSetContextCreate(TopMemoryContext,
+										   "MessageContext",
+										   ALLOCSET_DEFAULT_INITSIZE,
+										   ALLOCSET_DEFAULT_INITSIZE,
+										   ALLOCSET_DEFAULT_MAXSIZE,
+										   false);
+
+	initStringInfo(&input_message);
 
 	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
 	{
-		/*
-		 * NOTE: if you are tempted to add more code in this if-block,
-		 * consider the high probability that it should be in
-		 * AbortTransaction() instead.	The only stuff done directly here
-		 * should be stuff that is guaranteed to apply *only* for outer-level
-		 * error recovery, such as adjusting the FE/BE protocol status.
-		 */
-
 		/* Report the error to the client and/or server log */
 		if (thrinfo->thr_conn)
+		{
 			EmitErrorReport(thrinfo->thr_conn->con_port);
+
+			/* The client failed to start up, it can't go on */
+			if (!thrinfo->thr_conn->con_authenticated)
+				thrinfo->thr_conn->con_disconnected = true;
+		}
 		else
 			EmitErrorReport(NULL);
 
@@ -1145,122 +1414,78 @@ GTM_ThreadMain(void *argp)
 	/* We can now handle ereport(ERROR) */
 	PG_exception_stack = &local_sigjmp_buf;
 
-
 	for (;;)
 	{
-		/*
-		 * Release storage left over from prior query cycle, and create a new
-		 * query input buffer in the cleared MessageContext.
-		 */
-		MemoryContextSwitchTo(MessageContext);
-		MemoryContextResetAndDeleteChildren(MessageContext);
+		int			nfds;
+		int			ii;
 
-		/*
-		 * Just reset the input buffer to avoid repeated palloc/pfrees
-		 *
-		 * XXX We should consider resetting the MessageContext periodically to
-		 * handle any memory leaks
-		 */
-		resetStringInfo(&input_message);
+		/* Let GTM-Standby backup our status while we wait */
+		if (thrinfo->thr_conn)
+		{
+			thrinfo->thr_conn = NULL;
+			GTM_RWLockRelease(&thrinfo->thr_lock);
+		}
 
-		/*
-		 * GTM-Standby registration information can be updated during ReadCommand
-		 * operation.
-		 */
+		/* Send the backups of the requests served in the last round at once */
+		GTM_RWLockAcquire(&thrinfo->thr_lock, GTM_LOCKMODE_WRITE);
+		for (ii = 0; ii < thrinfo->thr_conn_count; ii++)
+			gtm_standby_flush(thrinfo->thr_all_conns[ii]->standby);
 		GTM_RWLockRelease(&thrinfo->thr_lock);
-		/*
-		 * (3) read a command (loop blocks here)
-		 */
-		qtype = ReadCommand(thrinfo->thr_conn->con_port, &input_message);
 
-		GTM_RWLockAcquire(&thrinfo->thr_lock, GTM_LOCKMODE_WRITE);
+		GTM_WorkerCollectConnections(thrinfo);
+
 		/*
-		 * Check if GTM Standby info is upadted
-		 * Maybe the following lines can be a separate function.   At present, this is done only here so
-		 * I'll leave them here.   K.Suzuki, Nov.29, 2011
-		 * Please note that we don't check if it is not in the standby mode to allow cascased standby.
-		 *
-		 * Also ensure that we don't try to connect just yet if we are
-		 * responsible for serving the BACKUP request from the standby.
-		 * Otherwise, this will lead to a deadlock
+		 * The first slot is the wakeup pipe. While we serve a backup to the
+		 * standby, the other connections must wait until it completes.
 		 */
-		if (GTMThreads->gt_standby_ready &&
-				thrinfo->thr_conn->standby == NULL &&
-				thrinfo->thr_status != GTM_THREAD_BACKUP)
+		thrinfo->thr_poll_fds[0].fd = thrinfo->thr_wakeup_fd[0];
+		thrinfo->thr_poll_fds[0].events = POLLIN;
+		for (ii = 0; ii < thrinfo->thr_conn_count; ii++)
 		{
-			/* Connect to GTM-Standby */
-			thrinfo->thr_conn->standby = gtm_standby_connect_to_standby();
-			if (thrinfo->thr_conn->standby == NULL)
-				GTMThreads->gt_standby_ready = false;	/* This will make other threads to disconnect from
-														 * the standby, if needed.*/
+			GTM_ConnectionInfo *conninfo = thrinfo->thr_all_conns[ii];
+
+			if (thrinfo->thr_status == GTM_THREAD_BACKUP &&
+				conninfo != thrinfo->thr_backup_conn)
+				thrinfo->thr_poll_fds[ii + 1].fd = -1;
+			else
+				thrinfo->thr_poll_fds[ii + 1].fd = conninfo->con_port->sock;
+			thrinfo->thr_poll_fds[ii + 1].events = POLLIN;
+			thrinfo->thr_poll_fds[ii + 1].revents = 0;
 		}
-		else if (GTMThreads->gt_standby_ready == false && thrinfo->thr_conn->standby)
+
+		nfds = poll(thrinfo->thr_poll_fds, thrinfo->thr_conn_count + 1, -1);
+		if (nfds < 0)
 		{
-			/* Disconnect from GTM-Standby */
-			gtm_standby_disconnect_from_standby(thrinfo->thr_conn->standby);
-			thrinfo->thr_conn->standby = NULL;
+			if (errno == EINTR)
+				continue;
+			ereport(ERROR,
+					(errno,
+					 errmsg("poll() failed in worker thread: %m")));
 		}
 
-		switch(qtype)
+		/* Messages wait from now on while other connections are served */
+		thrinfo->thr_recv_time = gtm_stat_now();
+
+		for (ii = 0; ii < thrinfo->thr_conn_count; ii++)
 		{
-			case 'C':
-				ProcessCommand(thrinfo->thr_conn->con_port, &input_message);
-				break;
+			GTM_ConnectionInfo *conninfo = thrinfo->thr_all_conns[ii];
 
-			case 'X':
-				elog(DEBUG1, "Removing all transaction infos - qtype:X");
-			case EOF:
-				/*
-				 * Connection termination request
-				 * Remove all transactions opened within the thread. Note that
-				 * we don't remove transaction infos if we are a standby and
-				 * the transaction infos actually correspond to in-progress
-				 * transactions on the master
-				 */
-				elog(DEBUG1, "Removing all transaction infos - qtype:EOF");
-				if (!Recovery_IsStandby())
-					GTM_RemoveAllTransInfos(thrinfo->thr_client_id, -1);
-
-				/* Disconnect node if necessary */
-				Recovery_PGXCNodeDisconnect(thrinfo->thr_conn->con_port);
-				GTM_RWLockRelease(&thrinfo->thr_lock);
-				pthread_exit(thrinfo);
-				break;
+			if (conninfo->con_disconnected ||
+				!(thrinfo->thr_poll_fds[ii + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
 
-			case 'F':
-				/*
-				 * Flush all the outgoing data on the wire. Consume the message
-				 * type field for sanity
-				 */
-				/* Sync with standby first */
-				if (thrinfo->thr_conn->standby)
-				{
-					if (Backup_synchronously)
-						gtm_sync_standby(thrinfo->thr_conn->standby);
-					else
-						gtmpqFlush(thrinfo->thr_conn->standby);
-				}
-				pq_getmsgint(&input_message, sizeof (GTM_MessageType));
-				pq_getmsgend(&input_message);
-				pq_flush(thrinfo->thr_conn->con_port);
-				break;
-
-			default:
-				/*
-				 * Remove all transactions opened by the client
-				 */
-				GTM_RemoveAllTransInfos(thrinfo->thr_client_id, -1);
+			GTM_RWLockAcquire(&thrinfo->thr_lock, GTM_LOCKMODE_WRITE);
+			thrinfo->thr_conn = conninfo;
+			thrinfo->thr_client_id = conninfo->con_client_id;
 
-				/* Disconnect node if necessary */
-				Recovery_PGXCNodeDisconnect(thrinfo->thr_conn->con_port);
+			if (!conninfo->con_authenticated)
+				GTM_HandshakeConnection(conninfo);
+			else
+				GTM_WorkerProcessConnection(thrinfo, &input_message);
 
-				ereport(FATAL,
-						(EPROTO,
-						 errmsg("invalid frontend message type %d",
-								qtype)));
-				break;
+			thrinfo->thr_conn = NULL;
+			GTM_RWLockRelease(&thrinfo->thr_lock);
 		}
-
 	}
 
 	/* can't get here because the above loop never exits */
@@ -1269,11 +1494,129 @@ GTM_ThreadMain(void *argp)
 	return thrinfo;
 }
 
+/*
+ * Drop the connections closed since the last round and take over the new
+ * ones handed over by the main thread.
+ */
+static void
+GTM_WorkerCollectConnections(GTM_ThreadInfo *thrinfo)
+{
+	gtm_List   *new_conns;
+	gtm_ListCell *elem;
+	char		dummy[64];
+	int			ii;
+
+	for (ii = 0; ii < thrinfo->thr_conn_count;)
+	{
+		GTM_ConnectionInfo *conninfo = thrinfo->thr_all_conns[ii];
+
+		if (!conninfo->con_disconnected)
+		{
+			ii++;
+			continue;
+		}
+
+		/* The standby went away in the middle of a backup */
+		if (conninfo == thrinfo->thr_backup_conn)
+		{
+			if (thrinfo->thr_status == GTM_THREAD_BACKUP)
+			{
+				GTM_UnlockAllOtherThreads();
+				thrinfo->thr_status = GTM_THREAD_RUNNING;
+			}
+			thrinfo->thr_backup_conn = NULL;
+		}
+
+		GTM_ConnectionClose(conninfo);
+		thrinfo->thr_all_conns[ii] = thrinfo->thr_all_conns[--thrinfo->thr_conn_count];
+	}
+
+	GTM_MutexLockAcquire(&thrinfo->thr_conn_lock);
+	new_conns = thrinfo->thr_new_conns;
+	thrinfo->thr_new_conns = gtm_NIL;
+	while (read(thrinfo->thr_wakeup_fd[0], dummy, sizeof (dummy)) > 0)
+		;
+	GTM_MutexLockRelease(&thrinfo->thr_conn_lock);
+
+	gtm_foreach(elem, new_conns)
+	{
+		if (thrinfo->thr_conn_count >= thrinfo->thr_conn_size)
+		{
+			int			newsize = thrinfo->thr_conn_size ? thrinfo->thr_conn_size * 2 : 32;
+
+			if (thrinfo->thr_all_conns == NULL)
+			{
+				thrinfo->thr_all_conns = (GTM_ConnectionInfo **)
+					palloc(sizeof (GTM_ConnectionInfo *) * newsize);
+				thrinfo->thr_poll_fds = (struct pollfd *)
+					palloc(sizeof (struct pollfd) * (newsize + 1));
+			}
+			else
+			{
+				thrinfo->thr_all_conns = (GTM_ConnectionInfo **)
+					repalloc(thrinfo->thr_all_conns,
+							 sizeof (GTM_ConnectionInfo *) * newsize);
+				thrinfo->thr_poll_fds = (struct pollfd *)
+					repalloc(thrinfo->thr_poll_fds,
+							 sizeof (struct pollfd) * (newsize + 1));
+			}
+			thrinfo->thr_conn_size = newsize;
+		}
+		thrinfo->thr_all_conns[thrinfo->thr_conn_count++] =
+			(GTM_ConnectionInfo *) gtm_lfirst(elem);
+	}
+	gtm_list_free(new_conns);
+
+	/* Make sure the pipe slot is there even before the first connection */
+	if (thrinfo->thr_poll_fds == NULL)
+		thrinfo->thr_poll_fds = (struct pollfd *) palloc(sizeof (struct pollfd));
+}
+
+/*
+ * Serve a readable connection: process its messages until its receive buffer
+ * is drained, so that a client pipelining requests is served in one round.
+ */
+static void
+GTM_WorkerProcessConnection(GTM_ThreadInfo *thrinfo, StringInfo input_message)
+{
+	GTM_ConnectionInfo *conninfo = thrinfo->thr_conn;
+	int			qtype;
+
+	do
+	{
+		MemoryContextSwitchTo(MessageContext);
+		MemoryContextResetAndDeleteChildren(MessageContext);
+		resetStringInfo(input_message);
+
+		qtype = ReadCommand(conninfo->con_port, input_message);
+
+		GTM_CheckStandbyConnection(thrinfo);
+
+		if (!GTM_ProcessMessage(thrinfo, qtype, input_message))
+		{
+			conninfo->con_disconnected = true;
+			break;
+		}
+
+		/* Remember the connection serving the backup to the standby */
+		if (thrinfo->thr_status == GTM_THREAD_BACKUP)
+			thrinfo->thr_backup_conn = conninfo;
+		else if (thrinfo->thr_backup_conn == conninfo)
+			thrinfo->thr_backup_conn = NULL;
+	} while (conninfo->con_port->PqRecvPointer < conninfo->con_port->PqRecvLength);
+
+	MemoryContextSwitchTo(TopMemoryContext);
+}
+
 void
 ProcessCommand(Port *myport, StringInfo input_message)
 {
+	GTM_ThreadInfo *thrinfo = GetMyThreadInfo;
 	GTM_MessageType mtype;
 	GTM_ProxyMsgHeader proxyhdr;
+	uint64		started = gtm_stat_now();
+	uint64		lock_wait = thrinfo->thr_lock_wait_usecs;
+	uint64		sent = myport->PqSentBytes + myport->PqSendPointer;
 
 	if (myport->remote_type == GTM_NODE_GTM_PROXY)
 		pq_copymsgbytes(input_message, (char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader));
@@ -1294,6 +1637,18 @@ ProcessCommand(Port *myport, StringInfo input_message)
 		case MSG_SYNC_STANDBY:
 			ProcessSyncStandbyCommand(myport, mtype, input_message);
 			break;
+		case MSG_BKUP_STATE_LOG:
+			ProcessBkupStateLogCommand(myport, input_message);
+			break;
+		case MSG_GET_STATS:
+			ProcessGetStatsCommand(myport, input_message);
+			break;
+		case MSG_GET_TIMESTAMP:
+			ProcessGetTimestampCommand(myport, input_message);
+			break;
+		case MSG_GET_GLOBAL_XMIN:
+			ProcessGetGlobalXminCommand(myport, input_message);
+			break;
 		case MSG_NODE_REGISTER:
 		case MSG_BKUP_NODE_REGISTER:
 		case MSG_NODE_UNREGISTER:
@@ -1337,12 +1692,18 @@ ProcessCommand(Port *myport, StringInfo input_message)
 		case MSG_TXN_GET_GID_DATA:
 		case MSG_TXN_GET_NEXT_GXID:
 		case MSG_TXN_GXID_LIST:
+		case MSG_TXN_LEASE_REPORT:
+		case MSG_BKUP_TXN_LEASE_REPORT:
 			ProcessTransactionCommand(myport, mtype, input_message);
 			break;
 
 		case MSG_SNAPSHOT_GET:
 		case MSG_SNAPSHOT_GXID_GET:
 		case MSG_SNAPSHOT_GET_MULTI:
+		case MSG_SNAPSHOT_GET_READONLY:
+		case MSG_BKUP_SNAPSHOT:
+		case MSG_SNAPSHOT_CSN_GET:
+		case MSG_CSNLOG_GET:
 			ProcessSnapshotCommand(myport, mtype, input_message);
 			break;
 
@@ -1384,13 +1745,35 @@ ProcessCommand(Port *myport, StringInfo input_message)
 			break;
 
 		default:
-			ereport(FATAL,
+			/* A worker thread serves other connections too */
+			GetMyThreadInfo->thr_conn->con_disconnected = true;
+			ereport(GetMyThreadInfo->thr_worker ? ERROR : FATAL,
 					(EPROTO,
 					 errmsg("invalid frontend message type %d",
 							mtype)));
 	}
 	if (GTM_NeedBackup())
 		GTM_WriteRestorePoint();
+
+	gtm_msgstat_record(mtype, myport->remote_type, thrinfo->thr_recv_time,
+					   started, thrinfo->thr_lock_wait_usecs - lock_wait);
+
+	if (GTM_TraceEnabled)
+	{
+		GTM_TraceRecord record;
+
+		record.tr_client = thrinfo->thr_client_id;
+		record.tr_conid = proxyhdr.ph_conid;
+		record.tr_mtype = mtype;
+		record.tr_remote_type = myport->remote_type;
+		record.tr_flags = GTM_TRACE_REPLY_KNOWN;
+		if (myport->remote_type == GTM_NODE_GTM_PROXY)
+			record.tr_flags |= GTM_TRACE_PROXY_HEADER;
+		record.tr_len = input_message->len;
+		record.tr_reply_len = (uint32)
+			(myport->PqSentBytes + myport->PqSendPointer - sent);
+		GTM_TraceRequest(&record, thrinfo->thr_recv_time, input_message->data);
+	}
 }
 
 static int
@@ -1409,6 +1792,36 @@ GTMAddConnection(Port *port, GTM_Conn *standby)
 	if (standby != NULL)
 		conninfo->standby = standby;
 
+	/*
+	 * Hand the connection over to the least loaded worker thread and wake it
+	 * up. The worker takes it up with the startup message.
+	 */
+	if (GTMWorkers != NULL)
+	{
+		GTM_ThreadInfo *worker = NULL;
+		MemoryContext oldContext;
+		int			ii;
+
+		conninfo->con_client_id = GTM_NextClientIdentifier();
+
+		for (ii = 0; ii < GTMWorkerThreads; ii++)
+		{
+			if (worker == NULL ||
+				GTMWorkers[ii]->thr_conn_count < worker->thr_conn_count)
+				worker = GTMWorkers[ii];
+		}
+
+		GTM_MutexLockAcquire(&worker->thr_conn_lock);
+		oldContext = MemoryContextSwitchTo(TopMostMemoryContext);
+		worker->thr_new_conns = gtm_lappend(worker->thr_new_conns, conninfo);
+		MemoryContextSwitchTo(oldContext);
+		if (write(worker->thr_wakeup_fd[1], "", 1) < 0 && errno != EAGAIN)
+			elog(LOG, "Failed to wake up the worker thread: %m");
+		GTM_MutexLockRelease(&worker->thr_conn_lock);
+
+		return STATUS_OK;
+	}
+
 	/*
 	 * XXX Start the thread
 	 */
@@ -1506,6 +1919,32 @@ ProcessSyncStandbyCommand(Port *myport, GTM_MessageType mtype, StringInfo messag
 	pq_flush(myport);
 }
 
+/*
+ * Process MSG_BKUP_STATE_LOG message
+ *
+ * Apply the restore points replicated from the active GTM and make them
+ * durable. The active GTM follows with MSG_SYNC_STANDBY to wait for them.
+ */
+static void
+ProcessBkupStateLogCommand(Port *myport, StringInfo message)
+{
+	int			len;
+	const char *data;
+	FILE	   *f;
+
+	len = pq_getmsgint(message, sizeof (int));
+	data = pq_getmsgbytes(message, len);
+	pq_getmsgend(message);
+
+	if ((f = fmemopen((void *) data, len, "r")) == NULL)
+		ereport(ERROR,
+				(errno,
+				 errmsg("Cannot read the GTM state log records: %m")));
+	GTM_ApplyStateLog(f);
+	fclose(f);
+
+	GTM_WriteRestorePoint();
+}
 
 
 static void
@@ -1645,6 +2084,14 @@ ProcessTransactionCommand(Port *myport, GTM_MessageType mtype, StringInfo messag
 			ProcessRollbackTransactionCommandMulti(myport, message, true);
 			break;
 
+		case MSG_TXN_LEASE_REPORT:
+			ProcessLeaseReportCommand(myport, message, false);
+			break;
+
+		case MSG_BKUP_TXN_LEASE_REPORT:
+			ProcessLeaseReportCommand(myport, message, true);
+			break;
+
 		case MSG_TXN_GET_GXID:
 			/*
 			 * Notice: we don't have corresponding functions in gtm_client.c
@@ -1689,6 +2136,22 @@ ProcessSnapshotCommand(Port *myport, GTM_MessageType mtype, StringInfo message)
 			ProcessGetSnapshotCommand(myport, message, true);
 			break;
 
+		case MSG_SNAPSHOT_GET_READONLY:
+			ProcessGetSnapshotCommandReadOnly(myport, message);
+			break;
+
+		case MSG_BKUP_SNAPSHOT:
+			ProcessBkupSnapshotCommand(myport, message);
+			break;
+
+		case MSG_SNAPSHOT_CSN_GET:
+			ProcessGetCSNSnapshotCommand(myport, message);
+			break;
+
+		case MSG_CSNLOG_GET:
+			ProcessGetCSNLogCommand(myport, message);
+			break;
+
 		default:
 			Assert(0);			/* Shouldn't come here.. keep compiler quite */
 	}
@@ -2140,6 +2603,14 @@ PromoteToActive(void)
 	Recovery_StandbySetStandby(false);
 	CreateDataDirLockFile();
 
+	/*
+	 * Skip what the active GTM may have handed out without our knowing, the
+	 * backup messages are not acknowledged one by one
+	 */
+	GTM_PromoteRestorePointXid();
+	GTM_SeqPromoteRestorePoints();
+	GTM_WriteRestorePoint();
+
 	/*
 	 * Update the GTM config file for the next restart..
 	 */
@@ -2221,8 +2692,7 @@ static void ProcessBarrierCommand(Port *myport, GTM_MessageType mtype, StringInf
 		if (myport->remote_type != GTM_NODE_GTM_PROXY)
 		{
 			/* Flush standby first */
-			if (GetMyThreadInfo->thr_conn->standby)
-				gtmpqFlush(GetMyThreadInfo->thr_conn->standby);
+			gtm_standby_flush(GetMyThreadInfo->thr_conn->standby);
 			pq_flush(myport);
 		}
 	}
@@ -30,6 +30,7 @@
 #include "gtm/gtm_opt_tables.h"
 #include "gtm/gtm_opt.h"
 #include "gtm/gtm_standby.h"
+#include "gtm/gtm_msg.h"
 
 #define CONFIG_FILENAME "gtm_proxy.conf"
 const char *config_filename = CONFIG_FILENAME;
@@ -43,6 +44,7 @@ extern char *ListenAddresses;
 extern int GTMPortNumber;
 extern char *error_reporter;
 extern char *status_reader;
+extern char *GTMTraceFile;
 extern int log_min_messages;
 extern int tcp_keepalives_idle;
 extern int tcp_keepalives_count;
@@ -51,7 +53,11 @@ extern char *GTMServerHost;
 extern int GTMProxyPortNumber;
 extern int GTMConnectRetryInterval;
 extern int GTMServerPortNumber;
+extern char *GTMStandbyHost;
+extern int GTMStandbyPortNumber;
 extern int GTMProxyWorkerThreads;
+extern int GTMProxySnapshotCacheMaxAge;
+extern int GTMProxyGXIDLeaseSize;
 extern char *GTMProxyDataDir;
 extern char *GTMProxyConfigFileName;
 extern char *GTMConfigFileName;
@@ -172,6 +178,17 @@ struct config_int ConfigureNamesInt[] =
 		0, 0, INT_MAX,
 	    0, NULL
 	},
+	{
+		{
+			GTM_OPTNAME_GTM_STANDBY_PORT, GTMC_STARTUP,
+			gettext_noop("GTM standby port number, for the snapshots of read-only transactions."),
+			gettext_noop("Zero sends all the snapshot requests to GTM."),
+			0
+		},
+		&GTMStandbyPortNumber,
+		0, 0, INT_MAX,
+		0, NULL
+	},
 	{
 		{
 			GTM_OPTNAME_CONNECT_RETRY_INTERVAL, GTMC_SIGHUP,
@@ -227,6 +244,28 @@ struct config_int ConfigureNamesInt[] =
 		GTM_PROXY_DEFAULT_WORKERS, 1, INT_MAX,
 		0, NULL
 	},
+	{
+		{
+			GTM_OPTNAME_SNAPSHOT_CACHE_MAX_AGE, GTMC_STARTUP,
+			gettext_noop("Maximum age in microseconds of the snapshots served from the snapshot cache."),
+			gettext_noop("Zero disables the cache."),
+			0
+		},
+		&GTMProxySnapshotCacheMaxAge,
+		0, 0, INT_MAX,
+		0, NULL
+	},
+	{
+		{
+			GTM_OPTNAME_GXID_LEASE_SIZE, GTMC_STARTUP,
+			gettext_noop("Number of GXIDs each worker thread obtains from GTM in advance."),
+			gettext_noop("Zero disables the lease."),
+			0
+		},
+		&GTMProxyGXIDLeaseSize,
+		0, 0, GTM_PROXY_MAX_GXID_LEASE,
+		0, NULL
+	},
 	/* End-of-list marker */
 	{
 		{NULL, 0, NULL, NULL, 0}, NULL, 0, 0, 0, 0, NULL
@@ -306,6 +345,18 @@ struct config_string ConfigureNamesString[] =
 		NULL, NULL
 	},
 
+	{
+		{
+			GTM_OPTNAME_GTM_STANDBY_HOST, GTMC_STARTUP,
+			gettext_noop("Address of GTM standby, for the snapshots of read-only transactions."),
+			NULL,
+			0
+		},
+		&GTMStandbyHost,
+		NULL,
+		NULL, NULL
+	},
+
 	{
 		{
 			GTM_OPTNAME_LOG_FILE, GTMC_SIGHUP,
@@ -342,6 +393,18 @@ struct config_string ConfigureNamesString[] =
 		NULL, NULL
 	},
 
+	{
+		{
+			GTM_OPTNAME_TRACE_FILE, GTMC_STARTUP,
+			gettext_noop("File the requests are traced to."),
+			gettext_noop("The trace can be replayed with gtm_replay. Empty disables it."),
+			0
+		},
+		&GTMTraceFile,
+		"",
+		NULL, NULL
+	},
+
 	/* End-of-list marker */
 	{
 		{NULL, 0, NULL, NULL}, NULL, NULL, NULL, NULL
@@ -22,7 +22,6 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <sys/socket.h>
-#include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/resource.h>
@@ -43,13 +42,16 @@
 #include "gtm/assert.h"
 #include "gtm/gtm_txn.h"
 #include "gtm/gtm_seq.h"
+#include "gtm/gtm_serialize.h"
 #include "gtm/gtm_msg.h"
 #include "gtm/libpq-int.h"
 #include "gtm/gtm_ip.h"
 #include "gtm/gtm_standby.h"
+#include "gtm/gtm_utils.h"
 /* For reconnect control lock */
 #include "gtm/gtm_lock.h"
 #include "gtm/gtm_opt.h"
+#include "gtm/gtm_trace.h"
 
 extern int	optind;
 extern char *optarg;
@@ -73,12 +75,16 @@ static char *progname = "gtm_proxy";
 char	   *ListenAddresses;
 int			GTMProxyPortNumber;
 int			GTMProxyWorkerThreads;
+int			GTMProxySnapshotCacheMaxAge = 0;
+int			GTMProxyGXIDLeaseSize = 0;
 char		*GTMProxyDataDir;
 char		*GTMProxyConfigFileName;
 char		*GTMConfigFileName;
 
 char		*GTMServerHost;
 int			GTMServerPortNumber;
+char		*GTMStandbyHost;
+int			GTMStandbyPortNumber = 0;
 
 int			GTMConnectRetryInterval = 60;
 
@@ -101,6 +107,7 @@ int		NewGTMServerPortNumber;
 /* Status reader/reporter */
 char	*error_reporter;
 char	*status_reader;
+char	*GTMTraceFile;
 
 /* Mode */
 bool	isStartUp = false;
@@ -126,6 +133,41 @@ pthread_key_t	threadinfo_key;
 static bool		GTMProxyAbortPending = false;
 static GTM_Conn *master_conn;
 
+/*
+ * Snapshot cache
+ *
+ * With snapshot_cache_max_age set, the last snapshot received from GTM is
+ * shared by the worker threads, and the statement snapshots of the read
+ * committed transactions are served from it as long as it is younger than
+ * that, so the backends of a host share the GTM snapshot fetches.
+ *
+ * A cached snapshot is only given to a transaction which got its first
+ * snapshot from GTM before the cached one was requested. GTM recorded the
+ * xmin of the transaction with its first snapshot, which protects the rows
+ * the cached snapshot may still see, and the cached snapshot is not older
+ * than the transaction. A commit answered by the proxy invalidates the cache
+ * and the snapshots requested before it, so a client always sees the
+ * commits it was told about. Commits made through other proxies are seen
+ * once the cache expires.
+ *
+ * Snapshot requests are numbered as they are sent to GTM. The numbers order
+ * the snapshots with the commits and with the first snapshots of the
+ * transactions.
+ */
+typedef struct GTMProxy_SnapshotCache
+{
+	GTM_RWLock			sc_lock;
+	bool				sc_valid;
+	uint64				sc_seqno;		/* request number of the snapshot */
+	uint64				sc_requested;	/* time it was requested, in us */
+	uint64				sc_min_seqno;	/* requests up to this one are stale */
+	int					sc_xip_size;
+	GTM_SnapshotData	sc_snapshot;
+} GTMProxy_SnapshotCache;
+
+static GTMProxy_SnapshotCache SnapshotCache;
+static pg_atomic_uint64 SnapshotRequestSeqno;
+
 
 /*
  * External Routines
@@ -137,9 +179,8 @@ extern void InitializeGTMOptions(void);
  * Internal Routines
  */
 static Port *ConnCreate(int serverFd);
-static void ConnFree(Port *conn);
 static int ServerLoop(void);
-static int initMasks(fd_set *rmask);
+static int initListenFds(struct pollfd *fds);
 void *GTMProxy_ThreadMain(void *argp);
 static int GTMProxyAddConnection(Port *port);
 static int ReadCommand(GTMProxy_ConnectionInfo *conninfo, StringInfo inBuf);
@@ -157,10 +198,24 @@ static GTM_Conn *HandleGTMError(GTM_Conn *gtm_conn);
 static GTM_Conn *HandlePostCommand(GTMProxy_ConnectionInfo *conninfo, GTM_Conn *gtm_conn);
 static void ProcessPGXCNodeCommand(GTMProxy_ConnectionInfo *conninfo,
 		GTM_Conn *gtm_conn, GTM_MessageType mtype, StringInfo message);
-static void ProcessTransactionCommand(GTMProxy_ConnectionInfo *conninfo,
+static bool ProcessTransactionCommand(GTMProxy_ConnectionInfo *conninfo,
 		GTM_Conn *gtm_conn, GTM_MessageType mtype, StringInfo message);
-static void ProcessSnapshotCommand(GTMProxy_ConnectionInfo *conninfo,
+static bool ProcessSnapshotCommand(GTMProxy_ConnectionInfo *conninfo,
 		GTM_Conn *gtm_conn, GTM_MessageType mtype, StringInfo message);
+static void GTMProxy_BuildSnapshotMessage(StringInfo buf, GTM_Snapshot snapshot,
+		GTM_ResultType res_type);
+static bool GTMProxy_SendCachedSnapshot(GTMProxy_ConnectionInfo *conninfo,
+		GlobalTransactionId gxid);
+static void GTMProxy_CacheSnapshot(GTMProxy_CommandInfo *cmdinfo,
+		GTM_Snapshot snapshot);
+static void GTMProxy_InvalidateSnapshotCache(void);
+static uint64 proxy_now_usecs(void);
+static bool GTMProxy_BeginFromLease(GTMProxy_ConnectionInfo *conninfo,
+		GTMProxy_CommandData *cmd_data);
+static bool GTMProxy_LeaseExpired(GTMProxy_ThreadInfo *thrinfo);
+static void GTMProxy_SendLeaseReport(GTMProxy_ThreadInfo *thrinfo);
+static GTM_Conn *GTMProxy_StandbyConn(GTMProxy_ThreadInfo *thrinfo);
+static void GTMProxy_GetReadOnlySnapshots(GTMProxy_ThreadInfo *thrinfo);
 
 static void GTMProxy_RegisterPGXCNode(GTMProxy_ConnectionInfo *conninfo,
 									  char *node_name,
@@ -270,10 +325,16 @@ BaseInit()
 		sprintf(GTMLogFile, "%s/%s", GTMProxyDataDir, GTM_LOG_FILE);
 	}
 
+	if (GTMTraceFile != NULL && GTMTraceFile[0] != '\0')
+		GTM_TraceOpen(GTMTraceFile, true);
+
 	/* Initialize reconnect control lock */
 
 	GTM_RWLockInit(&ReconnectControlLock);
 
+	GTM_RWLockInit(&SnapshotCache.sc_lock);
+	pg_atomic_init_u64(&SnapshotRequestSeqno, 0);
+
 	/* Save Node Register File in register.c */
 	Recovery_SaveRegisterFileName(GTMProxyDataDir);
 
@@ -931,7 +992,7 @@ ConnCreate(int serverFd)
 /*
  * ConnFree -- free a local connection data structure
  */
-static void
+void
 ConnFree(Port *conn)
 {
 	free(conn);
@@ -943,14 +1004,13 @@ ConnFree(Port *conn)
 static int
 ServerLoop(void)
 {
-	fd_set		readmask;
+	struct pollfd listen_fds[MAXLISTEN];
 	int			nSockets;
 
-	nSockets = initMasks(&readmask);
+	nSockets = initListenFds(listen_fds);
 
 	for (;;)
 	{
-		fd_set		rmask;
 		int			selres;
 
 		if (sigsetjmp(mainThreadSIGUSR1_buf, 1) != 0)
@@ -986,8 +1046,6 @@ ServerLoop(void)
 		 * Wait at most one minute, to ensure that the other background
 		 * tasks handled below get done even when no requests are arriving.
 		 */
-		memcpy((char *) &rmask, (char *) &readmask, sizeof(fd_set));
-
 		PG_SETMASK(&UnBlockSig);
 
 		if (GTMProxyAbortPending)
@@ -997,18 +1055,11 @@ ServerLoop(void)
 			 *
 			 * !! TODO
 			 */
+			GTM_TraceClose();
 			exit(1);
 		}
 
-		{
-			/* must set timeout each time; some OSes change it! */
-			struct timeval timeout;
-
-			timeout.tv_sec = 60;
-			timeout.tv_usec = 0;
-
-			selres = select(nSockets, &rmask, NULL, NULL, &timeout);
-		}
+		selres = poll(listen_fds, nSockets, 60 * 1000);
 
 		/*
 		 * Block all signals until we wait again.  (This makes it safe for our
@@ -1016,14 +1067,14 @@ ServerLoop(void)
 		 */
 		PG_SETMASK(&BlockSig);
 
-		/* Now check the select() result */
+		/* Now check the poll() result */
 		if (selres < 0)
 		{
 			if (errno != EINTR && errno != EWOULDBLOCK)
 			{
 				ereport(DEBUG1,
 						(EACCES,
-						 errmsg("select() failed in main thread: %m")));
+						 errmsg("poll() failed in main thread: %m")));
 				return STATUS_ERROR;
 			}
 		}
@@ -1036,15 +1087,13 @@ ServerLoop(void)
 		{
 			int			i;
 
-			for (i = 0; i < MAXLISTEN; i++)
+			for (i = 0; i < nSockets; i++)
 			{
-				if (ListenSocket[i] == -1)
-					break;
-				if (FD_ISSET(ListenSocket[i], &rmask))
+				if (listen_fds[i].revents & POLLIN)
 				{
 					Port	   *port;
 
-					port = ConnCreate(ListenSocket[i]);
+					port = ConnCreate(listen_fds[i].fd);
 					if (port)
 					{
 						if (GTMProxyAddConnection(port) != STATUS_OK)
@@ -1060,29 +1109,26 @@ ServerLoop(void)
 }
 
 /*
- * Initialise the masks for select() for the ports we are listening on.
+ * Initialise the poll() array for the ports we are listening on.
  * Return the number of sockets to listen on.
  */
 static int
-initMasks(fd_set *rmask)
+initListenFds(struct pollfd *fds)
 {
-	int			maxsock = -1;
 	int			i;
 
-	FD_ZERO(rmask);
-
 	for (i = 0; i < MAXLISTEN; i++)
 	{
 		int			fd = ListenSocket[i];
 
 		if (fd == -1)
 			break;
-		FD_SET(fd, rmask);
-		if (fd > maxsock)
-			maxsock = fd;
+		fds[i].fd = fd;
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
 	}
 
-	return maxsock + 1;
+	return i;
 }
 
 /*
@@ -1095,8 +1141,8 @@ GTMProxy_ThreadMain(void *argp)
 	int qtype;
 	StringInfoData input_message;
 	sigjmp_buf  local_sigjmp_buf;
-	int32 saved_seqno = -1;
 	int ii, nrfds;
+	int timeout;
 	char gtm_connect_string[1024];
 	int	first_turn = TRUE;	/* Used only to set longjmp target at the first turn of thread loop */
 	GTMProxy_CommandData cmd_data = {};
@@ -1149,6 +1195,9 @@ GTMProxy_ThreadMain(void *argp)
 		initStringInfo(&(thrinfo->thr_inBufData[ii]));
 	}
 
+	thrinfo->thr_lease_count = 0;
+	thrinfo->thr_lease_assign_count = 0;
+
 	/*
 	 * If an exception is encountered, processing resumes here so we abort the
 	 * current transaction and start a new one.
@@ -1172,6 +1221,9 @@ GTMProxy_ThreadMain(void *argp)
 		 * error recovery, such as adjusting the FE/BE protocol status.
 		 */
 
+		/* The command which failed may have to be replayed */
+		thrinfo->thr_replay_backups = true;
+
 		/* Report the error to the client and/or server log */
 		if (thrinfo->thr_conn_count > 0)
 		{
@@ -1248,72 +1300,23 @@ GTMProxy_ThreadMain(void *argp)
 		if (!first_turn)
 		{
 			/*
-			 * Check if there are any changes to the connection array assigned to
-			 * this thread. If so, we need to rebuild the fd array.
+			 * Pick up the connections the main thread handed over to us. They
+			 * complete the handshake when their startup message arrives.
 			 */
-			GTM_MutexLockAcquire(&thrinfo->thr_lock);
-			if (saved_seqno != thrinfo->thr_seqno)
-			{
-				saved_seqno = thrinfo->thr_seqno;
+			GTMProxy_ThreadTakeConnections(thrinfo);
 
-				while (thrinfo->thr_conn_count <= 0)
-				{
-					/*
-					 * No connections assigned to the thread. Wait for at least one
-					 * connection to be assigned to us
-					 */
-					if (sigsetjmp(GetMyThreadInfo->longjmp_env, 1) == 0)
-					{
-						Enable_Longjmp();
-						GTM_CVWait(&thrinfo->thr_cv, &thrinfo->thr_lock);
-						Disable_Longjmp();
-					}
-					else
-					{
-						/* SIGUSR2 here */
-						workerThreadReconnectToGTM();
-					}
-				}
-
-				memset(thrinfo->thr_poll_fds, 0, sizeof (thrinfo->thr_poll_fds));
-
-				/*
-				 * Now grab all the open connections. A lock is being hold so no
-				 * new connections can be added.
-				 */
-				for (ii = 0; ii < thrinfo->thr_conn_count; ii++)
-				{
-					int connIndx = thrinfo->thr_conn_map[ii];
-					GTMProxy_ConnectionInfo *conninfo = thrinfo->thr_all_conns[connIndx];
-
-					/*
-					 * Detect if the connection has been dropped to avoid
-					 * a segmentation fault.
-					 */
-					if (conninfo->con_port == NULL)
-					{
-						conninfo->con_disconnected = true;
-						continue;
-					}
-
-					/*
-					 * If this is a newly added connection, complete the handshake
-					 */
-					if (!conninfo->con_authenticated)
-						GTMProxy_HandshakeConnection(conninfo);
-
-					thrinfo->thr_poll_fds[ii].fd = conninfo->con_port->sock;
-					thrinfo->thr_poll_fds[ii].events = POLLIN;
-					thrinfo->thr_poll_fds[ii].revents = 0;
-				}
-			}
-			GTM_MutexLockRelease(&thrinfo->thr_lock);
+			/*
+			 * Wait for messages. With no connections, there is nothing to do
+			 * until one is added, unless a lease has to be given back.
+			 */
+			timeout = poll_timeout_ms;
+			if (thrinfo->thr_conn_count == 0 && thrinfo->thr_lease_count == 0)
+				timeout = -1;
 
 			while (true)
 			{
 				Enable_Longjmp();
-				nrfds = poll(thrinfo->thr_poll_fds, thrinfo->thr_conn_count,
-							poll_timeout_ms);
+				nrfds = GTMProxy_ThreadWait(thrinfo, timeout);
 				Disable_Longjmp();
 
 				if (nrfds < 0)
@@ -1326,9 +1329,36 @@ GTMProxy_ThreadMain(void *argp)
 					break;
 			}
 
-			if (nrfds == 0)
+			if (nrfds == 0 && !thrinfo->thr_replay_backups &&
+				!GTMProxy_LeaseExpired(thrinfo))
 				continue;
 
+			/*
+			 * Commands interrupted by a reconnect or an error are read again
+			 * from their backup, whether the client sent more or not.
+			 */
+			if (thrinfo->thr_replay_backups)
+			{
+				short events[GTM_PROXY_MAX_CONNECTIONS];
+
+				memset(events, 0, sizeof (events));
+				for (ii = 0; ii < thrinfo->thr_ready_count; ii++)
+					events[thrinfo->thr_ready_conns[ii]] = thrinfo->thr_ready_events[ii];
+
+				thrinfo->thr_ready_count = 0;
+				for (ii = 0; ii < thrinfo->thr_conn_count; ii++)
+				{
+					int connIndx = thrinfo->thr_conn_map[ii];
+
+					if (events[connIndx] == 0 && !thrinfo->thr_any_backup[connIndx])
+						continue;
+					thrinfo->thr_ready_conns[thrinfo->thr_ready_count] = connIndx;
+					thrinfo->thr_ready_events[thrinfo->thr_ready_count] = events[connIndx];
+					thrinfo->thr_ready_count++;
+				}
+				thrinfo->thr_replay_backups = false;
+			}
+
 			/*
 			 * Initialize the lists
 			 */
@@ -1354,6 +1384,7 @@ setjmp_again:
 			 * Reconnection phase
 			 */
 			workerThreadReconnectToGTM();
+			thrinfo->thr_replay_backups = true;
 
 			/*
 			 * Correction of pending works.
@@ -1384,13 +1415,14 @@ setjmp_again:
 		 * Now, read command from each of the connections that has some data to
 		 * be read.
 		 */
-		for (ii = 0; ii < thrinfo->thr_conn_count; ii++)
+		for (ii = 0; ii < thrinfo->thr_ready_count; ii++)
 		{
-			int connIndx = thrinfo->thr_conn_map[ii];
+			int connIndx = thrinfo->thr_ready_conns[ii];
+			short revents = thrinfo->thr_ready_events[ii];
 			GTMProxy_ConnectionInfo *conninfo = thrinfo->thr_all_conns[connIndx];
 			thrinfo->thr_conn = conninfo;
 
-			if (thrinfo->thr_poll_fds[ii].revents & POLLHUP)
+			if (revents & POLLHUP)
 			{
 				/*
 				 * The fd has become invalid. The connection is broken. Add it
@@ -1402,16 +1434,24 @@ setjmp_again:
 				continue;
 			}
 
+			/*
+			 * The first message of a new connection is the startup message
+			 */
+			if (!conninfo->con_authenticated)
+			{
+				if (revents & POLLIN)
+					GTMProxy_HandshakeConnection(conninfo);
+				continue;
+			}
+
 			if ((thrinfo->thr_any_backup[connIndx]) ||
-				(thrinfo->thr_poll_fds[ii].revents & POLLIN))
+				(revents & POLLIN))
 			{
 				/*
 				 * (3) read a command (loop blocks here)
 				 */
 				qtype = ReadCommand(thrinfo->thr_conn, &input_message);
 
-				thrinfo->thr_poll_fds[ii].revents = 0;
-
 				switch(qtype)
 				{
 					case 'C':
@@ -1516,17 +1556,17 @@ setjmp_again:
 		thrinfo->thr_processed_commands = gtm_NIL;
 
 		/*
-		 * Now clean up disconnected connections
+		 * Now clean up disconnected connections. Only the connections read
+		 * in this round can have been disconnected.
 		 */
-		for (ii = 0; ii < thrinfo->thr_conn_count; ii++)
+		for (ii = 0; ii < thrinfo->thr_ready_count; ii++)
 		{
-			int connIndx = thrinfo->thr_conn_map[ii];
+			int connIndx = thrinfo->thr_ready_conns[ii];
 			GTMProxy_ConnectionInfo *conninfo = thrinfo->thr_all_conns[connIndx];
-			if (conninfo->con_disconnected)
+			if (conninfo != NULL && conninfo->con_disconnected)
 			{
 				GTMProxy_ThreadRemoveConnection(thrinfo, conninfo);
 				pfree(conninfo);
-				ii--;
 			}
 		}
 	}
@@ -1575,14 +1615,29 @@ ProcessCommand(GTMProxy_ConnectionInfo *conninfo, GTM_Conn *gtm_conn,
 
 	mtype = pq_getmsgint(input_message, sizeof (GTM_MessageType));
 
+	/* Requests are traced as they come, before they are grouped */
+	if (GTM_TraceEnabled)
+	{
+		GTM_TraceRecord record;
+
+		record.tr_client = GetMyThreadInfo->thr_localid;
+		record.tr_conid = conninfo->con_id;
+		record.tr_mtype = mtype;
+		record.tr_remote_type = conninfo->con_port->remote_type;
+		record.tr_flags = 0;
+		record.tr_len = input_message->len;
+		record.tr_reply_len = 0;
+		GTM_TraceRequest(&record, GTM_TraceNow(), input_message->data);
+	}
+
 	switch (mtype)
 	{
 		case MSG_TXN_BEGIN_GETGXID_AUTOVACUUM:
 		case MSG_TXN_PREPARE:
 		case MSG_TXN_START_PREPARED:
 		case MSG_TXN_GET_GID_DATA:
-		case MSG_TXN_COMMIT_PREPARED:
 		case MSG_SNAPSHOT_GET:
+		case MSG_SNAPSHOT_GXID_GET:
 		case MSG_SEQUENCE_INIT:
 		case MSG_SEQUENCE_GET_CURRENT:
 		case MSG_SEQUENCE_GET_NEXT:
@@ -1595,6 +1650,9 @@ ProcessCommand(GTMProxy_ConnectionInfo *conninfo, GTM_Conn *gtm_conn,
 		case MSG_BARRIER:
 		case MSG_TXN_COMMIT:
 		case MSG_REGISTER_SESSION:
+		case MSG_SNAPSHOT_CSN_GET:
+		case MSG_CSNLOG_GET:
+		case MSG_GET_STATS:
 			GTMProxy_ProxyCommand(conninfo, gtm_conn, mtype, input_message);
 			break;
 
@@ -1607,14 +1665,29 @@ ProcessCommand(GTMProxy_ConnectionInfo *conninfo, GTM_Conn *gtm_conn,
 		case MSG_TXN_BEGIN:
 		case MSG_TXN_BEGIN_GETGXID:
 		case MSG_TXN_COMMIT_MULTI:
+		case MSG_TXN_COMMIT_PREPARED:
 		case MSG_TXN_ROLLBACK:
 		case MSG_TXN_GET_GXID:
-			ProcessTransactionCommand(conninfo, gtm_conn, mtype, input_message);
+			if (ProcessTransactionCommand(conninfo, gtm_conn, mtype, input_message))
+				return;		/* GXID given out from the lease */
 			break;
 
 		case MSG_SNAPSHOT_GET_MULTI:
-		case MSG_SNAPSHOT_GXID_GET:
-			ProcessSnapshotCommand(conninfo, gtm_conn, mtype, input_message);
+		case MSG_SNAPSHOT_GET_READONLY:
+			if (ProcessSnapshotCommand(conninfo, gtm_conn, mtype, input_message))
+				return;		/* answered from the snapshot cache */
+			break;
+
+		case MSG_GET_TIMESTAMP:
+		case MSG_GET_GLOBAL_XMIN:
+			{
+				GTMProxy_CommandData cmd_data;
+
+				/* One request per round serves all the waiting backends */
+				pq_getmsgend(input_message);
+				memset(&cmd_data, 0, sizeof (cmd_data));
+				GTMProxy_CommandPending(conninfo, mtype, cmd_data);
+			}
 			break;
 
 		default:
@@ -1733,7 +1806,7 @@ IsProxiedMessage(GTM_MessageType mtype)
 		case MSG_TXN_BEGIN_GETGXID_AUTOVACUUM:
 		case MSG_TXN_PREPARE:
 		case MSG_TXN_START_PREPARED:
-		/* There are not so many 2PC from application messages, so just proxy it. */
+		/* Proxied if the transaction had to wait for other transactions */
 		case MSG_TXN_COMMIT_PREPARED:
 		case MSG_TXN_GET_GXID:
 		case MSG_TXN_GET_GID_DATA:
@@ -1752,6 +1825,9 @@ IsProxiedMessage(GTM_MessageType mtype)
 		case MSG_SEQUENCE_ALTER:
 		case MSG_SNAPSHOT_GET:
 		case MSG_TXN_COMMIT:
+		case MSG_SNAPSHOT_CSN_GET:
+		case MSG_CSNLOG_GET:
+		case MSG_GET_STATS:
 			return true;
 
 		default:
@@ -1768,6 +1844,19 @@ ProcessResponse(GTMProxy_ThreadInfo *thrinfo, GTMProxy_CommandInfo *cmdinfo,
 	GTM_Timestamp timestamp;
 	int	status;
 
+	/* The client is about to see its commit, cached snapshots do not */
+	switch (cmdinfo->ci_mtype)
+	{
+		case MSG_TXN_COMMIT:
+		case MSG_TXN_COMMIT_MULTI:
+		case MSG_TXN_COMMIT_PREPARED:
+			GTMProxy_InvalidateSnapshotCache();
+			break;
+
+		default:
+			break;
+	}
+
 	switch (cmdinfo->ci_mtype)
 	{
 		case MSG_TXN_BEGIN_GETGXID:
@@ -1805,6 +1894,28 @@ ProcessResponse(GTMProxy_ThreadInfo *thrinfo, GTMProxy_CommandInfo *cmdinfo,
 				pq_sendbytes(&buf, (char *)&timestamp, sizeof (GTM_Timestamp));
 				pq_endmessage(cmdinfo->ci_conn->con_port, &buf);
 				pq_flush(cmdinfo->ci_conn->con_port);
+
+				/* The GXIDs past the last command are the new lease */
+				if (cmdinfo->ci_data.cd_beg.lease_count > 0)
+				{
+					int txn_count = res->gr_resdata.grd_txn_get_multi.txn_count;
+					int lease_count = cmdinfo->ci_data.cd_beg.lease_count;
+
+					if (lease_count >= txn_count)
+					{
+						ReleaseCmdBackup(cmdinfo);
+						elog(ERROR, "Too few GXIDs");
+					}
+					gxid = res->gr_resdata.grd_txn_get_multi.start_gxid +
+						(txn_count - lease_count);
+					if (gxid < res->gr_resdata.grd_txn_get_multi.start_gxid)
+						gxid += FirstNormalGlobalTransactionId;
+
+					thrinfo->thr_lease_next = gxid;
+					thrinfo->thr_lease_count = lease_count;
+					thrinfo->thr_lease_timestamp = timestamp;
+					thrinfo->thr_lease_received = proxy_now_usecs();
+				}
 			}
 			else
 			{
@@ -1907,19 +2018,10 @@ ProcessResponse(GTMProxy_ThreadInfo *thrinfo, GTMProxy_CommandInfo *cmdinfo,
 			status = res->gr_resdata.grd_txn_snap_multi.status[cmdinfo->ci_res_index];
 		   	if ((status == STATUS_OK) || (status == STATUS_NOT_FOUND))
 			{
-				int txn_count = 1;
-				int status = STATUS_OK;
-
-				pq_beginmessage(&buf, 'S');
-				pq_sendint(&buf, SNAPSHOT_GET_MULTI_RESULT, 4);
-				pq_sendbytes(&buf, (char *)&txn_count, sizeof (txn_count));
-				pq_sendbytes(&buf, (char *)&status, sizeof (status));
-				pq_sendbytes(&buf, (char *)&res->gr_snapshot.sn_xmin, sizeof (GlobalTransactionId));
-				pq_sendbytes(&buf, (char *)&res->gr_snapshot.sn_xmax, sizeof (GlobalTransactionId));
-				pq_sendbytes(&buf, (char *)&res->gr_snapshot.sn_recent_global_xmin, sizeof (GlobalTransactionId));
-				pq_sendint(&buf, res->gr_snapshot.sn_xcnt, sizeof (int));
-				pq_sendbytes(&buf, (char *)res->gr_snapshot.sn_xip,
-							 sizeof(GlobalTransactionId) * res->gr_snapshot.sn_xcnt);
+				if (status == STATUS_OK)
+					GTMProxy_CacheSnapshot(cmdinfo, &res->gr_snapshot);
+				GTMProxy_BuildSnapshotMessage(&buf, &res->gr_snapshot,
+											  SNAPSHOT_GET_MULTI_RESULT);
 				pq_endmessage(cmdinfo->ci_conn->con_port, &buf);
 				pq_flush(cmdinfo->ci_conn->con_port);
 			}
@@ -1932,12 +2034,84 @@ ProcessResponse(GTMProxy_ThreadInfo *thrinfo, GTMProxy_CommandInfo *cmdinfo,
 			ReleaseCmdBackup(cmdinfo);
 			break;
 
+		case MSG_GET_TIMESTAMP:
+			if (res->gr_type != GET_TIMESTAMP_RESULT)
+			{
+				ReleaseCmdBackup(cmdinfo);
+				elog(ERROR, "Wrong result");
+			}
+
+			/* The whole group gets the same timestamp */
+			timestamp = res->gr_resdata.grd_timestamp;
+			pq_beginmessage(&buf, 'S');
+			pq_sendint(&buf, GET_TIMESTAMP_RESULT, 4);
+			pq_sendbytes(&buf, (char *)&timestamp, sizeof (GTM_Timestamp));
+			pq_endmessage(cmdinfo->ci_conn->con_port, &buf);
+			pq_flush(cmdinfo->ci_conn->con_port);
+			cmdinfo->ci_conn->con_pending_msg = MSG_TYPE_INVALID;
+			ReleaseCmdBackup(cmdinfo);
+			break;
+
+		case MSG_GET_GLOBAL_XMIN:
+			if (res->gr_type != GET_GLOBAL_XMIN_RESULT)
+			{
+				ReleaseCmdBackup(cmdinfo);
+				elog(ERROR, "Wrong result");
+			}
+
+			gxid = res->gr_resdata.grd_gxid;
+			pq_beginmessage(&buf, 'S');
+			pq_sendint(&buf, GET_GLOBAL_XMIN_RESULT, 4);
+			pq_sendbytes(&buf, (char *)&gxid, sizeof (GlobalTransactionId));
+			pq_endmessage(cmdinfo->ci_conn->con_port, &buf);
+			pq_flush(cmdinfo->ci_conn->con_port);
+			cmdinfo->ci_conn->con_pending_msg = MSG_TYPE_INVALID;
+			ReleaseCmdBackup(cmdinfo);
+			break;
+
+		case MSG_TXN_COMMIT_PREPARED:
+			/*
+			 * Grouped command has the GXIDs saved, proxied one is handled
+			 * below along with other proxied messages.
+			 */
+			if (GlobalTransactionIdIsValid(cmdinfo->ci_data.cd_cp.prepared_gxid))
+			{
+				if (res->gr_type != TXN_COMMIT_MULTI_RESULT)
+				{
+					ReleaseCmdBackup(cmdinfo);
+					elog(ERROR, "Wrong result");
+				}
+				if (cmdinfo->ci_res_index + 1 >= res->gr_resdata.grd_txn_rc_multi.txn_count)
+				{
+					ReleaseCmdBackup(cmdinfo);
+					elog(ERROR, "Too few GXIDs");
+				}
+
+				status = res->gr_resdata.grd_txn_rc_multi.status[cmdinfo->ci_res_index];
+				if (status == STATUS_OK &&
+					res->gr_resdata.grd_txn_rc_multi.status[cmdinfo->ci_res_index + 1] == STATUS_OK)
+				{
+					pq_beginmessage(&buf, 'S');
+					pq_sendint(&buf, TXN_COMMIT_PREPARED_RESULT, 4);
+					pq_sendbytes(&buf, (char *)&cmdinfo->ci_data.cd_cp.gxid, sizeof (GlobalTransactionId));
+					pq_sendbytes(&buf, (char *)&status, sizeof (int));
+					pq_endmessage(cmdinfo->ci_conn->con_port, &buf);
+					pq_flush(cmdinfo->ci_conn->con_port);
+				}
+				else
+				{
+					ReleaseCmdBackup(cmdinfo);
+					ereport(ERROR2, (EINVAL, errmsg("Transaction commit failed")));
+				}
+				cmdinfo->ci_conn->con_pending_msg = MSG_TYPE_INVALID;
+				ReleaseCmdBackup(cmdinfo);
+				break;
+			}
+			/* fall through */
 		case MSG_TXN_BEGIN:
 		case MSG_TXN_BEGIN_GETGXID_AUTOVACUUM:
 		case MSG_TXN_PREPARE:
 		case MSG_TXN_START_PREPARED:
-		/* There are not so many 2PC from application messages, so just proxy it. */
-		case MSG_TXN_COMMIT_PREPARED:
 		case MSG_TXN_GET_GXID:
 		case MSG_TXN_GET_GID_DATA:
 		case MSG_NODE_REGISTER:
@@ -1955,6 +2129,9 @@ ProcessResponse(GTMProxy_ThreadInfo *thrinfo, GTMProxy_CommandInfo *cmdinfo,
 		case MSG_SEQUENCE_ALTER:
 		case MSG_SNAPSHOT_GET:
 		case MSG_TXN_COMMIT:
+		case MSG_SNAPSHOT_CSN_GET:
+		case MSG_CSNLOG_GET:
+		case MSG_GET_STATS:
 			Assert(IsProxiedMessage(cmdinfo->ci_mtype));
 			if ((res->gr_proxyhdr.ph_conid == InvalidGTMProxyConnID) ||
 				(res->gr_proxyhdr.ph_conid >= GTM_PROXY_MAX_CONNECTIONS) ||
@@ -2266,7 +2443,10 @@ ProcessPGXCNodeCommand(GTMProxy_ConnectionInfo *conninfo, GTM_Conn *gtm_conn,
 	return;
 }
 
-static void
+/*
+ * Returns true if the command was answered without asking GTM
+ */
+static bool
 ProcessTransactionCommand(GTMProxy_ConnectionInfo *conninfo, GTM_Conn *gtm_conn,
 		GTM_MessageType mtype, StringInfo message)
 {
@@ -2277,6 +2457,9 @@ ProcessTransactionCommand(GTMProxy_ConnectionInfo *conninfo, GTM_Conn *gtm_conn,
 		case MSG_TXN_BEGIN_GETGXID:
 			cmd_data.cd_beg.iso_level = pq_getmsgint(message, sizeof (GTM_IsolationLevel));
 			cmd_data.cd_beg.rdonly = pq_getmsgbyte(message);
+			cmd_data.cd_beg.lease_count = 0;
+			if (GTMProxy_BeginFromLease(conninfo, &cmd_data))
+				return true;
 			GTMProxy_CommandPending(conninfo, mtype, cmd_data);
 			break;
 
@@ -2300,6 +2483,43 @@ ProcessTransactionCommand(GTMProxy_ConnectionInfo *conninfo, GTM_Conn *gtm_conn,
 			GTMProxy_CommandPending(conninfo, mtype, cmd_data);
 			break;
 
+		case MSG_TXN_COMMIT_PREPARED:
+			{
+				int			cursor = message->cursor;
+				int			waited_xid_count;
+				const char *data;
+
+				data = pq_getmsgbytes(message, sizeof (GlobalTransactionId));
+				if (data == NULL)
+					ereport(ERROR,
+							(EPROTO,
+							 errmsg("Message does not contain valid GXID")));
+				memcpy(&cmd_data.cd_cp.gxid, data, sizeof (GlobalTransactionId));
+				data = pq_getmsgbytes(message, sizeof (GlobalTransactionId));
+				if (data == NULL)
+					ereport(ERROR,
+							(EPROTO,
+							 errmsg("Message does not contain valid GXID")));
+				memcpy(&cmd_data.cd_cp.prepared_gxid, data,
+					   sizeof (GlobalTransactionId));
+				waited_xid_count = pq_getmsgint(message, sizeof (int));
+
+				/*
+				 * Transaction which had to wait for other transactions may be
+				 * delayed by GTM, and such a commit can not be grouped.
+				 * Just proxy the message.
+				 */
+				if (waited_xid_count > 0)
+				{
+					message->cursor = cursor;
+					GTMProxy_ProxyCommand(conninfo, gtm_conn, mtype, message);
+					break;
+				}
+			}
+			pq_getmsgend(message);
+			GTMProxy_CommandPending(conninfo, mtype, cmd_data);
+			break;
+
 		case MSG_TXN_BEGIN:
 		case MSG_TXN_GET_GXID:
 			elog(FATAL, "Support not yet added for these message types");
@@ -2308,9 +2528,15 @@ ProcessTransactionCommand(GTMProxy_ConnectionInfo *conninfo, GTM_Conn *gtm_conn,
 		default:
 			Assert(0);			/* Shouldn't come here.. keep compiler quiet */
 	}
+
+	return false;
 }
 
-static void
+/*
+ * Returns true if the snapshot was sent from the snapshot cache, there is
+ * no response to wait for then.
+ */
+static bool
 ProcessSnapshotCommand(GTMProxy_ConnectionInfo *conninfo, GTM_Conn *gtm_conn,
 		GTM_MessageType mtype, StringInfo message)
 {
@@ -2319,6 +2545,7 @@ ProcessSnapshotCommand(GTMProxy_ConnectionInfo *conninfo, GTM_Conn *gtm_conn,
 	switch (mtype)
 	{
 		case MSG_SNAPSHOT_GET_MULTI:
+		case MSG_SNAPSHOT_GET_READONLY:
 			{
 				{
 					int txn_count = pq_getmsgint(message, sizeof (int));
@@ -2331,18 +2558,383 @@ ProcessSnapshotCommand(GTMProxy_ConnectionInfo *conninfo, GTM_Conn *gtm_conn,
 					memcpy(&cmd_data.cd_snap.gxid, data, sizeof (GlobalTransactionId));
 				}
 				pq_getmsgend(message);
+				if (GTMProxy_SendCachedSnapshot(conninfo, cmd_data.cd_snap.gxid))
+					return true;
+				/* Without a standby, GTM serves read-only transactions too */
+				if (mtype == MSG_SNAPSHOT_GET_READONLY && GTMStandbyPortNumber == 0)
+					mtype = MSG_SNAPSHOT_GET_MULTI;
 				GTMProxy_CommandPending(conninfo, mtype, cmd_data);
 			}
 			break;
 
-		case MSG_SNAPSHOT_GXID_GET:
-			elog(ERROR, "Message not yet support");
-			break;
-
 		default:
 			Assert(0);			/* Shouldn't come here.. keep compiler quiet */
 	}
 
+	return false;
+}
+
+/*
+ * Current time in microseconds, to age the cached snapshot and the lease
+ */
+static uint64
+proxy_now_usecs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Build the response to MSG_SNAPSHOT_GET_MULTI or MSG_SNAPSHOT_GET_READONLY
+ * for a single transaction
+ */
+static void
+GTMProxy_BuildSnapshotMessage(StringInfo buf, GTM_Snapshot snapshot,
+		GTM_ResultType res_type)
+{
+	int txn_count = 1;
+	int status = STATUS_OK;
+
+	pq_beginmessage(buf, 'S');
+	pq_sendint(buf, res_type, 4);
+	pq_sendbytes(buf, (char *)&txn_count, sizeof (txn_count));
+	pq_sendbytes(buf, (char *)&status, sizeof (status));
+	gtm_send_snapshot_wire(buf, snapshot);
+}
+
+/*
+ * Send the cached snapshot to the client if the transaction gxid can use
+ * it. Returns false if the snapshot must be requested from GTM.
+ */
+static bool
+GTMProxy_SendCachedSnapshot(GTMProxy_ConnectionInfo *conninfo,
+		GlobalTransactionId gxid)
+{
+	StringInfoData buf;
+	GTM_Snapshot snapshot = &SnapshotCache.sc_snapshot;
+
+	if (GTMProxySnapshotCacheMaxAge <= 0 ||
+		!GlobalTransactionIdIsValid(gxid) ||
+		conninfo->con_snapshot_gxid != gxid)
+		return false;
+
+	GTM_RWLockAcquire(&SnapshotCache.sc_lock, GTM_LOCKMODE_READ);
+	if (!SnapshotCache.sc_valid ||
+		SnapshotCache.sc_seqno <= conninfo->con_snapshot_seqno ||
+		!GlobalTransactionIdPrecedes(gxid, snapshot->sn_xmax) ||
+		proxy_now_usecs() - SnapshotCache.sc_requested >
+			(uint64) GTMProxySnapshotCacheMaxAge)
+	{
+		GTM_RWLockRelease(&SnapshotCache.sc_lock);
+		return false;
+	}
+	GTMProxy_BuildSnapshotMessage(&buf, snapshot, SNAPSHOT_GET_MULTI_RESULT);
+	GTM_RWLockRelease(&SnapshotCache.sc_lock);
+
+	pq_endmessage(conninfo->con_port, &buf);
+	pq_flush(conninfo->con_port);
+	return true;
+}
+
+/*
+ * Remember the snapshot received for the transaction of cmdinfo as its
+ * first one, and keep it in the cache unless a later one is there or a
+ * commit was answered since it was requested.
+ */
+static void
+GTMProxy_CacheSnapshot(GTMProxy_CommandInfo *cmdinfo, GTM_Snapshot snapshot)
+{
+	GTMProxy_ConnectionInfo *conninfo = cmdinfo->ci_conn;
+	uint64 seqno = cmdinfo->ci_data.cd_snap.seqno;
+
+	if (GTMProxySnapshotCacheMaxAge <= 0)
+		return;
+
+	if (conninfo->con_snapshot_gxid != cmdinfo->ci_data.cd_snap.gxid)
+	{
+		conninfo->con_snapshot_gxid = cmdinfo->ci_data.cd_snap.gxid;
+		conninfo->con_snapshot_seqno = pg_atomic_read_u64(&SnapshotRequestSeqno);
+	}
+
+	GTM_RWLockAcquire(&SnapshotCache.sc_lock, GTM_LOCKMODE_WRITE);
+	if (seqno > SnapshotCache.sc_min_seqno &&
+		(!SnapshotCache.sc_valid || seqno > SnapshotCache.sc_seqno))
+	{
+		if (snapshot->sn_xcnt > SnapshotCache.sc_xip_size)
+		{
+			GlobalTransactionId *xip = (GlobalTransactionId *)
+				realloc(SnapshotCache.sc_snapshot.sn_xip,
+						sizeof (GlobalTransactionId) * snapshot->sn_xcnt);
+
+			if (xip == NULL)
+			{
+				SnapshotCache.sc_valid = false;
+				GTM_RWLockRelease(&SnapshotCache.sc_lock);
+				return;
+			}
+			SnapshotCache.sc_snapshot.sn_xip = xip;
+			SnapshotCache.sc_xip_size = snapshot->sn_xcnt;
+		}
+		SnapshotCache.sc_snapshot.sn_xmin = snapshot->sn_xmin;
+		SnapshotCache.sc_snapshot.sn_xmax = snapshot->sn_xmax;
+		SnapshotCache.sc_snapshot.sn_recent_global_xmin =
+			snapshot->sn_recent_global_xmin;
+		SnapshotCache.sc_snapshot.sn_xcnt = snapshot->sn_xcnt;
+		memcpy(SnapshotCache.sc_snapshot.sn_xip, snapshot->sn_xip,
+			   sizeof (GlobalTransactionId) * snapshot->sn_xcnt);
+		SnapshotCache.sc_seqno = seqno;
+		SnapshotCache.sc_requested = cmdinfo->ci_data.cd_snap.requested;
+		SnapshotCache.sc_valid = true;
+	}
+	GTM_RWLockRelease(&SnapshotCache.sc_lock);
+}
+
+/*
+ * Drop the cached snapshot, and the ones requested so far as they arrive
+ */
+static void
+GTMProxy_InvalidateSnapshotCache(void)
+{
+	if (GTMProxySnapshotCacheMaxAge <= 0)
+		return;
+
+	GTM_RWLockAcquire(&SnapshotCache.sc_lock, GTM_LOCKMODE_WRITE);
+	SnapshotCache.sc_valid = false;
+	SnapshotCache.sc_min_seqno = pg_atomic_read_u64(&SnapshotRequestSeqno);
+	GTM_RWLockRelease(&SnapshotCache.sc_lock);
+}
+
+/*
+ * Give out the next leased GXID, if any, for a MSG_TXN_BEGIN_GETGXID.
+ * Returns true if the response was sent.
+ *
+ * The transaction is open on GTM since the lease was obtained. Its begin
+ * timestamp is extrapolated from the timestamp of the lease.
+ */
+static bool
+GTMProxy_BeginFromLease(GTMProxy_ConnectionInfo *conninfo,
+		GTMProxy_CommandData *cmd_data)
+{
+	GTMProxy_ThreadInfo *thrinfo = GetMyThreadInfo;
+	GTM_LeaseAssignment *entry;
+	GlobalTransactionId gxid;
+	GTM_Timestamp timestamp;
+	uint64 elapsed;
+	StringInfoData buf;
+
+	if (thrinfo->thr_lease_count == 0 ||
+		thrinfo->thr_lease_assign_count >= GTM_PROXY_MAX_GXID_LEASE)
+		return false;
+
+	/* Expired, it is given back with the next report */
+	elapsed = proxy_now_usecs() - thrinfo->thr_lease_received;
+	if (elapsed > (uint64) GTM_PROXY_GXID_LEASE_TIMEOUT * 1000)
+		return false;
+
+	gxid = thrinfo->thr_lease_next++;
+	if (!GlobalTransactionIdIsNormal(thrinfo->thr_lease_next))
+		thrinfo->thr_lease_next = FirstNormalGlobalTransactionId;
+	thrinfo->thr_lease_count--;
+
+	entry = &thrinfo->thr_lease_assigned[thrinfo->thr_lease_assign_count++];
+	entry->la_gxid = gxid;
+	entry->la_isolevel = cmd_data->cd_beg.iso_level;
+	entry->la_readonly = cmd_data->cd_beg.rdonly;
+	entry->la_connid = conninfo->con_id;
+
+	timestamp = thrinfo->thr_lease_timestamp;
+#ifdef HAVE_INT64_TIMESTAMP
+	timestamp += elapsed;
+#else
+	timestamp += elapsed / 1000000;
+#endif
+
+	pq_beginmessage(&buf, 'S');
+	pq_sendint(&buf, TXN_BEGIN_GETGXID_RESULT, 4);
+	pq_sendbytes(&buf, (char *)&gxid, sizeof (GlobalTransactionId));
+	pq_sendbytes(&buf, (char *)&timestamp, sizeof (GTM_Timestamp));
+	pq_endmessage(conninfo->con_port, &buf);
+	pq_flush(conninfo->con_port);
+
+	return true;
+}
+
+/*
+ * Is there a lease to give back?
+ */
+static bool
+GTMProxy_LeaseExpired(GTMProxy_ThreadInfo *thrinfo)
+{
+	return thrinfo->thr_lease_count > 0 &&
+		proxy_now_usecs() - thrinfo->thr_lease_received >
+			(uint64) GTM_PROXY_GXID_LEASE_TIMEOUT * 1000;
+}
+
+/*
+ * Report the leased GXIDs given out since the last report, and give back
+ * the lease if it expired. Sent ahead of the grouped commands, so GTM knows
+ * about the transactions before any other message of their backends.
+ */
+static void
+GTMProxy_SendLeaseReport(GTMProxy_ThreadInfo *thrinfo)
+{
+	GTM_Conn *gtm_conn = thrinfo->thr_gtm_conn;
+	GTM_ProxyMsgHeader proxyhdr;
+	GlobalTransactionId gxid;
+	int release_count = 0;
+	int ii;
+
+	if (GTMProxy_LeaseExpired(thrinfo))
+		release_count = thrinfo->thr_lease_count;
+
+	if (thrinfo->thr_lease_assign_count == 0 && release_count == 0)
+		return;
+
+	proxyhdr.ph_conid = InvalidGTMProxyConnID;
+
+	if (gtmpqPutMsgStart('C', true, gtm_conn) ||
+		gtmpqPutnchar((char *)&proxyhdr, sizeof (GTM_ProxyMsgHeader), gtm_conn) ||
+		gtmpqPutInt(MSG_TXN_LEASE_REPORT, sizeof (GTM_MessageType), gtm_conn) ||
+		gtmpqPutInt(thrinfo->thr_lease_assign_count, sizeof (int), gtm_conn))
+		elog(ERROR, "Error sending data");
+
+	for (ii = 0; ii < thrinfo->thr_lease_assign_count; ii++)
+	{
+		GTM_LeaseAssignment *entry = &thrinfo->thr_lease_assigned[ii];
+
+		if (gtmpqPutnchar((char *)&entry->la_gxid,
+						  sizeof (GlobalTransactionId), gtm_conn) ||
+			gtmpqPutInt(entry->la_isolevel, sizeof (GTM_IsolationLevel), gtm_conn) ||
+			gtmpqPutc(entry->la_readonly, gtm_conn) ||
+			gtmpqPutInt(entry->la_connid, sizeof (GTMProxy_ConnID), gtm_conn))
+			elog(ERROR, "Error sending data");
+	}
+
+	if (gtmpqPutInt(release_count, sizeof (int), gtm_conn))
+		elog(ERROR, "Error sending data");
+	gxid = thrinfo->thr_lease_next;
+	for (ii = 0; ii < release_count; ii++)
+	{
+		if (gtmpqPutnchar((char *)&gxid, sizeof (GlobalTransactionId), gtm_conn))
+			elog(ERROR, "Error sending data");
+		if (!GlobalTransactionIdIsNormal(++gxid))
+			gxid = FirstNormalGlobalTransactionId;
+	}
+
+	/* Finish the message. */
+	Enable_Longjmp();
+	if (gtmpqPutMsgEnd(gtm_conn))
+		elog(ERROR, "Error finishing the message");
+	Disable_Longjmp();
+
+	thrinfo->thr_lease_assign_count = 0;
+	thrinfo->thr_lease_count -= release_count;
+}
+
+/*
+ * Connection to the GTM standby, or NULL if it can not be used now
+ */
+static GTM_Conn *
+GTMProxy_StandbyConn(GTMProxy_ThreadInfo *thrinfo)
+{
+	char conn_str[256];
+
+	if (thrinfo->thr_standby_conn != NULL)
+		return thrinfo->thr_standby_conn;
+	if (GTMStandbyHost == NULL || proxy_now_usecs() < thrinfo->thr_standby_retry)
+		return NULL;
+
+	sprintf(conn_str, "host=%s port=%d node_name=%s remote_type=%d",
+			GTMStandbyHost, GTMStandbyPortNumber, GTMProxyNodeName,
+			GTM_NODE_DEFAULT);
+	thrinfo->thr_standby_conn = PQconnectGTM(conn_str);
+	if (GTMPQstatus(thrinfo->thr_standby_conn) != CONNECTION_OK)
+	{
+		elog(LOG, "can not connect to GTM standby");
+		GTMPQfinish(thrinfo->thr_standby_conn);
+		thrinfo->thr_standby_conn = NULL;
+		thrinfo->thr_standby_retry = proxy_now_usecs() +
+			(uint64) GTM_PROXY_STANDBY_RETRY_INTERVAL * 1000;
+	}
+	return thrinfo->thr_standby_conn;
+}
+
+/*
+ * Get the snapshots of the read-only transactions of this round from the
+ * GTM standby, with a single request. The transactions it can not serve are
+ * grouped with the MSG_SNAPSHOT_GET_MULTI requests sent to GTM.
+ *
+ * The standby is asked synchronously, so it only delays the rounds which
+ * have read-only transactions.
+ */
+static void
+GTMProxy_GetReadOnlySnapshots(GTMProxy_ThreadInfo *thrinfo)
+{
+	gtm_List *pending = thrinfo->thr_pending_commands[MSG_SNAPSHOT_GET_READONLY];
+	GTM_Conn *standby_conn;
+	GTM_Snapshot snapshot = NULL;
+	GlobalTransactionId *gxids;
+	gtm_ListCell *elem;
+	bool from_standby = false;
+	int count = 0;
+
+	if (gtm_list_length(pending) == 0)
+		return;
+	thrinfo->thr_pending_commands[MSG_SNAPSHOT_GET_READONLY] = gtm_NIL;
+
+	if ((standby_conn = GTMProxy_StandbyConn(thrinfo)) != NULL)
+	{
+		gxids = (GlobalTransactionId *)
+			palloc(sizeof (GlobalTransactionId) * gtm_list_length(pending));
+		gtm_foreach (elem, pending)
+		{
+			GTMProxy_CommandInfo *cmdinfo = (GTMProxy_CommandInfo *)gtm_lfirst(elem);
+			gxids[count++] = cmdinfo->ci_data.cd_snap.gxid;
+		}
+		snapshot = get_snapshot_readonly(standby_conn, count, gxids,
+										 &from_standby);
+		pfree(gxids);
+
+		if (snapshot == NULL && standby_conn->result &&
+			standby_conn->result->gr_status == GTM_RESULT_COMM_ERROR)
+		{
+			elog(LOG, "lost connection to GTM standby");
+			GTMPQfinish(standby_conn);
+			thrinfo->thr_standby_conn = NULL;
+			thrinfo->thr_standby_retry = proxy_now_usecs() +
+				(uint64) GTM_PROXY_STANDBY_RETRY_INTERVAL * 1000;
+		}
+	}
+
+	gtm_foreach (elem, pending)
+	{
+		GTMProxy_CommandInfo *cmdinfo = (GTMProxy_CommandInfo *)gtm_lfirst(elem);
+		StringInfoData buf;
+
+		if (snapshot == NULL)
+		{
+			cmdinfo->ci_mtype = MSG_SNAPSHOT_GET_MULTI;
+			thrinfo->thr_pending_commands[MSG_SNAPSHOT_GET_MULTI] =
+				gtm_lappend(thrinfo->thr_pending_commands[MSG_SNAPSHOT_GET_MULTI],
+							cmdinfo);
+			continue;
+		}
+
+		GTMProxy_BuildSnapshotMessage(&buf, snapshot,
+				from_standby ? SNAPSHOT_GET_STANDBY_RESULT :
+							   SNAPSHOT_GET_MULTI_RESULT);
+		pq_endmessage(cmdinfo->ci_conn->con_port, &buf);
+		pq_flush(cmdinfo->ci_conn->con_port);
+		cmdinfo->ci_conn->con_pending_msg = MSG_TYPE_INVALID;
+		ReleaseCmdBackup(cmdinfo);
+	}
+
+	if (snapshot != NULL)
+		gtm_list_free_deep(pending);
+	else
+		gtm_list_free(pending);
 }
 
 /*
@@ -2624,6 +3216,12 @@ GTMProxy_ProcessPendingCommands(GTMProxy_ThreadInfo *thrinfo)
 	GTM_ProxyMsgHeader proxyhdr;
 	GTM_Conn *gtm_conn = thrinfo->thr_gtm_conn;
 	gtm_ListCell *elem = NULL;
+	uint64 snapshot_seqno;
+	uint64 snapshot_requested;
+	int lease_count;
+
+	GTMProxy_SendLeaseReport(thrinfo);
+	GTMProxy_GetReadOnlySnapshots(thrinfo);
 
 	for (ii = 0; ii < MSG_TYPE_COUNT; ii++)
 	{
@@ -2649,8 +3247,18 @@ GTMProxy_ProcessPendingCommands(GTMProxy_ThreadInfo *thrinfo)
 				if (gtm_list_length(thrinfo->thr_pending_commands[ii]) <=0 )
 					elog(PANIC, "No pending commands of type %d", ii);
 
+				/*
+				 * Ask for the next lease along. The leased transactions
+				 * begin now with the default attributes and no backend,
+				 * the lease report fills them in later.
+				 */
+				lease_count = 0;
+				if (GTMProxyGXIDLeaseSize > 0 && thrinfo->thr_lease_count == 0)
+					lease_count = GTMProxyGXIDLeaseSize;
+
 				if (gtmpqPutInt(MSG_TXN_BEGIN_GETGXID_MULTI, sizeof (GTM_MessageType), gtm_conn) ||
-					gtmpqPutInt(gtm_list_length(thrinfo->thr_pending_commands[ii]), sizeof(int), gtm_conn))
+					gtmpqPutInt(gtm_list_length(thrinfo->thr_pending_commands[ii]) + lease_count,
+								sizeof(int), gtm_conn))
 					elog(ERROR, "Error sending data");
 				gtm_foreach (elem, thrinfo->thr_pending_commands[ii])
 				{
@@ -2664,6 +3272,16 @@ GTMProxy_ProcessPendingCommands(GTMProxy_ThreadInfo *thrinfo)
 						elog(ERROR, "Error sending data");
 
 				}
+				for (res_index = 0; res_index < lease_count; res_index++)
+				{
+					if (gtmpqPutInt(GTM_ISOLATION_RC, sizeof (GTM_IsolationLevel), gtm_conn) ||
+						gtmpqPutc(false, gtm_conn) ||
+						gtmpqPutInt(InvalidGTMProxyConnID, sizeof (GTMProxy_ConnID), gtm_conn))
+						elog(ERROR, "Error sending data");
+				}
+				cmdinfo = (GTMProxy_CommandInfo *)
+					gtm_linitial(thrinfo->thr_pending_commands[ii]);
+				cmdinfo->ci_data.cd_beg.lease_count = lease_count;
 
 				/* Finish the message. */
 				Enable_Longjmp();
@@ -2712,6 +3330,43 @@ GTMProxy_ProcessPendingCommands(GTMProxy_ThreadInfo *thrinfo)
 
 				break;
 
+			case MSG_TXN_COMMIT_PREPARED:
+				/*
+				 * Both GXIDs of every prepared transaction are committed in
+				 * a single MSG_TXN_COMMIT_MULTI message, that is what GTM
+				 * does for MSG_TXN_COMMIT_PREPARED too.
+				 */
+				if (gtmpqPutInt(MSG_TXN_COMMIT_MULTI, sizeof (GTM_MessageType), gtm_conn) ||
+					gtmpqPutInt(2 * gtm_list_length(thrinfo->thr_pending_commands[ii]), sizeof(int), gtm_conn))
+					elog(ERROR, "Error sending data");
+
+				gtm_foreach (elem, thrinfo->thr_pending_commands[ii])
+				{
+					cmdinfo = (GTMProxy_CommandInfo *)gtm_lfirst(elem);
+					Assert(cmdinfo->ci_mtype == ii);
+					cmdinfo->ci_res_index = res_index;
+					res_index += 2;
+					if (gtmpqPutnchar((char *)&cmdinfo->ci_data.cd_cp.gxid,
+								sizeof (GlobalTransactionId), gtm_conn) ||
+						gtmpqPutnchar((char *)&cmdinfo->ci_data.cd_cp.prepared_gxid,
+								sizeof (GlobalTransactionId), gtm_conn))
+						elog(ERROR, "Error sending data");
+				}
+
+				/* Finish the message. */
+				Enable_Longjmp();
+				if (gtmpqPutMsgEnd(gtm_conn))
+					elog(ERROR, "Error finishing the message");
+				Disable_Longjmp();
+
+				/*
+				 * Move the entire list to the processed command
+				 */
+				thrinfo->thr_processed_commands = gtm_list_concat(thrinfo->thr_processed_commands,
+						thrinfo->thr_pending_commands[ii]);
+				thrinfo->thr_pending_commands[ii] = gtm_NIL;
+				break;
+
 			case MSG_TXN_ROLLBACK:
 				if (gtmpqPutInt(MSG_TXN_ROLLBACK_MULTI, sizeof (GTM_MessageType), gtm_conn) ||
 					gtmpqPutInt(gtm_list_length(thrinfo->thr_pending_commands[ii]), sizeof(int), gtm_conn))
@@ -2749,11 +3404,17 @@ GTMProxy_ProcessPendingCommands(GTMProxy_ThreadInfo *thrinfo)
 					gtmpqPutInt(gtm_list_length(thrinfo->thr_pending_commands[ii]), sizeof(int), gtm_conn))
 					elog(ERROR, "Error sending data");
 
+				/* The group shares the snapshot, and its place in the cache */
+				snapshot_seqno = pg_atomic_add_fetch_u64(&SnapshotRequestSeqno, 1);
+				snapshot_requested = proxy_now_usecs();
+
 				gtm_foreach (elem, thrinfo->thr_pending_commands[ii])
 				{
 					cmdinfo = (GTMProxy_CommandInfo *)gtm_lfirst(elem);
 					Assert(cmdinfo->ci_mtype == ii);
 					cmdinfo->ci_res_index = res_index++;
+					cmdinfo->ci_data.cd_snap.seqno = snapshot_seqno;
+					cmdinfo->ci_data.cd_snap.requested = snapshot_requested;
 					{
 						if (gtmpqPutnchar((char *)&cmdinfo->ci_data.cd_rc.gxid,
 								sizeof (GlobalTransactionId), gtm_conn))
@@ -2776,6 +3437,30 @@ GTMProxy_ProcessPendingCommands(GTMProxy_ThreadInfo *thrinfo)
 				break;
 
 
+			case MSG_GET_TIMESTAMP:
+			case MSG_GET_GLOBAL_XMIN:
+				if (gtmpqPutInt(ii, sizeof (GTM_MessageType), gtm_conn))
+					elog(ERROR, "Error sending data");
+
+				/* All of them read the response of the first one */
+				gtm_foreach (elem, thrinfo->thr_pending_commands[ii])
+				{
+					cmdinfo = (GTMProxy_CommandInfo *)gtm_lfirst(elem);
+					Assert(cmdinfo->ci_mtype == ii);
+					cmdinfo->ci_res_index = res_index++;
+				}
+
+				/* Finish the message. */
+				Enable_Longjmp();
+				if (gtmpqPutMsgEnd(gtm_conn))
+					elog(ERROR, "Error finishing the message");
+				Disable_Longjmp();
+
+				thrinfo->thr_processed_commands = gtm_list_concat(thrinfo->thr_processed_commands,
+						thrinfo->thr_pending_commands[ii]);
+				thrinfo->thr_pending_commands[ii] = gtm_NIL;
+				break;
+
 			default:
 				elog(ERROR, "This message type (%d) can not be grouped together", ii);
 		}
@@ -13,6 +13,8 @@
  *-------------------------------------------------------------------------
  */
 #include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "gtm/gtm_proxy.h"
 #include "gtm/memutils.h"
 #include "gtm/libpq.h"
@@ -27,6 +29,9 @@ GTMProxy_Threads *GTMProxyThreads = &GTMProxyThreadsData;
 #define GTM_PROXY_MAX_THREADS 1024		/* Max threads allowed in the GTMProxy */
 #define GTMProxyThreadsFull	(GTMProxyThreads->gt_thread_count == GTMProxyThreads->gt_array_size)
 
+/* Event data of the wakeup pipe in the epoll set, beyond any connection slot */
+#define GTM_PROXY_WAKEUP_EVENT	GTM_PROXY_MAX_CONNECTIONS
+
 extern int GTMProxyWorkerThreads;
 extern GTMProxy_ThreadInfo **Proxy_ThreadInfo;
 
@@ -141,8 +146,41 @@ GTMProxy_ThreadCreate(void *(* startroutine)(void *), int idx)
 	 */
 	thrinfo = (GTMProxy_ThreadInfo *)palloc0(sizeof (GTMProxy_ThreadInfo));
 
-	GTM_MutexLockInit(&thrinfo->thr_lock);
-	GTM_CVInit(&thrinfo->thr_cv);
+	/*
+	 * Set up the queue of new connections, and the wakeup pipe the thread
+	 * waits on along with its connections
+	 */
+	pg_atomic_init_u32(&thrinfo->thr_newconn_head, 0);
+	pg_atomic_init_u32(&thrinfo->thr_newconn_tail, 0);
+	if (pipe(thrinfo->thr_wakeup_pipe) < 0 ||
+		fcntl(thrinfo->thr_wakeup_pipe[0], F_SETFL, O_NONBLOCK) < 0 ||
+		fcntl(thrinfo->thr_wakeup_pipe[1], F_SETFL, O_NONBLOCK) < 0)
+		ereport(ERROR,
+				(errno,
+				 errmsg("Failed to create the wakeup pipe of a thread: %m")));
+
+#ifdef HAVE_SYS_EPOLL_H
+	{
+		struct epoll_event ev;
+
+		thrinfo->thr_epoll_fd = epoll_create(GTM_PROXY_MAX_CONNECTIONS);
+		if (thrinfo->thr_epoll_fd < 0)
+			ereport(ERROR,
+					(errno,
+					 errmsg("Failed to create the epoll set of a thread: %m")));
+
+		ev.events = EPOLLIN;
+		ev.data.u32 = GTM_PROXY_WAKEUP_EVENT;
+		if (epoll_ctl(thrinfo->thr_epoll_fd, EPOLL_CTL_ADD,
+					  thrinfo->thr_wakeup_pipe[0], &ev) < 0)
+			ereport(ERROR,
+					(errno,
+					 errmsg("Failed to add the wakeup pipe of a thread: %m")));
+	}
+#else
+	thrinfo->thr_poll_fds[0].fd = thrinfo->thr_wakeup_pipe[0];
+	thrinfo->thr_poll_fds[0].events = POLLIN;
+#endif
 
 	/*
 	 * Initialize communication area with SIGUSR2 signal handler (reconnect)
@@ -331,7 +369,10 @@ GTMProxy_ThreadMainWrapper(void *argp)
  * Add the given connection info structure to a thread which is selected by a
  * round-robin manner. The caller is responsible for only accepting the
  * connection. Other things including the authentication is done by the worker
- * thread when it finds a new entry in the connection list.
+ * thread when it takes the connection from its queue.
+ *
+ * Only the main thread adds connections, so the queue of each thread has a
+ * single producer and a single consumer and needs no lock.
  *
  * Return the reference to the GTMProxy_ThreadInfo structure of the thread
  * which will be serving this connection
@@ -340,7 +381,7 @@ GTMProxy_ThreadInfo *
 GTMProxy_ThreadAddConnection(GTMProxy_ConnectionInfo *conninfo)
 {
 	GTMProxy_ThreadInfo *thrinfo = NULL;
-	GTMProxy_ConnID connIndx, ii;
+	uint32 head;
 
 	/*
 	 * Get the next thread in the queue
@@ -364,120 +405,239 @@ GTMProxy_ThreadAddConnection(GTMProxy_ConnectionInfo *conninfo)
 
 	GTM_RWLockRelease(&GTMProxyThreads->gt_lock);
 
-	/*
-	 * Lock the threadninfo structure to safely add the new connection to the
-	 * thread structure. The thread will see the connection when it queries the
-	 * socket descriptor in the next cycle
-	 */
-	GTM_MutexLockAcquire(&thrinfo->thr_lock);
-
-	if (thrinfo->thr_conn_count >= GTM_PROXY_MAX_CONNECTIONS)
+	head = pg_atomic_read_u32(&thrinfo->thr_newconn_head);
+	if (head - pg_atomic_read_u32(&thrinfo->thr_newconn_tail) >=
+		GTM_PROXY_MAX_CONNECTIONS)
 	{
-		GTM_MutexLockRelease(&thrinfo->thr_lock);
 		elog(LOG, "Too many connections");
 		return NULL;
 	}
 
-	connIndx = -1;
-	for (ii = 0; ii < GTM_PROXY_MAX_CONNECTIONS; ii++)
+	thrinfo->thr_newconns[head % GTM_PROXY_MAX_CONNECTIONS] = conninfo;
+
+	/* The thread must see the entry once it sees the new head */
+	pg_write_barrier();
+	pg_atomic_write_u32(&thrinfo->thr_newconn_head, head + 1);
+
+	/*
+	 * Wake up the thread if it is waiting. If the pipe is full, there are
+	 * wakeups pending already.
+	 */
+	if (write(thrinfo->thr_wakeup_pipe[1], "", 1) < 0 && errno != EAGAIN)
+		elog(LOG, "Failed to wake up a worker thread: %m");
+
+	return thrinfo;
+}
+
+/*
+ * Take the connections added to the queue of the thread and start waiting
+ * for their messages. Returns the number of new connections, they are at the
+ * end of thr_conn_map.
+ */
+int
+GTMProxy_ThreadTakeConnections(GTMProxy_ThreadInfo *thrinfo)
+{
+	uint32 tail = pg_atomic_read_u32(&thrinfo->thr_newconn_tail);
+	uint32 head = pg_atomic_read_u32(&thrinfo->thr_newconn_head);
+	int count = 0;
+
+	if (tail == head)
+		return 0;
+
+	/* Read the entries only after the head which covers them */
+	pg_read_barrier();
+
+	for (; tail != head; tail++)
 	{
-		if (thrinfo->thr_all_conns[ii] == NULL)
+		GTMProxy_ConnectionInfo *conninfo =
+			thrinfo->thr_newconns[tail % GTM_PROXY_MAX_CONNECTIONS];
+		GTMProxy_ConnID connIndx, ii;
+
+		connIndx = -1;
+		for (ii = 0; ii < GTM_PROXY_MAX_CONNECTIONS; ii++)
 		{
-			/*
-			 * Great, found a free slot to track the connection
-			 */
-			connIndx = ii;
-			break;
+			if (thrinfo->thr_all_conns[ii] == NULL)
+			{
+				/*
+				 * Great, found a free slot to track the connection
+				 */
+				connIndx = ii;
+				break;
+			}
 		}
-	}
 
-	if (connIndx == -1)
-	{
-		GTM_MutexLockRelease(&thrinfo->thr_lock);
-		elog(LOG, "Too many connections - could not find a free slot");
-		return NULL;
-	}
+		if (connIndx == -1)
+		{
+			elog(LOG, "Too many connections - could not find a free slot");
+			StreamClose(conninfo->con_port->sock);
+			ConnFree(conninfo->con_port);
+			pfree(conninfo);
+			continue;
+		}
 
-	/*
-	 * Save the array slotid in the conninfo structure. We send this to the GTM
-	 * server as an identifier which the GTM server sends us back in the
-	 * response. We use that information to route the response back to the
-	 * approrpiate connection.
-	 *
-	 * Note that the reason to use the array slotid in the messages to/from GTM
-	 * is to ensure that the corresponding connection can be quickly found
-	 * while proxying responses back to the client.
-	 */
-	conninfo->con_id = connIndx;
-	thrinfo->thr_all_conns[connIndx] = conninfo;
+#ifdef HAVE_SYS_EPOLL_H
+		{
+			struct epoll_event ev;
+
+			ev.events = EPOLLIN;
+			ev.data.u32 = connIndx;
+			if (epoll_ctl(thrinfo->thr_epoll_fd, EPOLL_CTL_ADD,
+						  conninfo->con_port->sock, &ev) < 0)
+			{
+				elog(LOG, "Failed to add a connection to the epoll set: %m");
+				StreamClose(conninfo->con_port->sock);
+				ConnFree(conninfo->con_port);
+				pfree(conninfo);
+				continue;
+			}
+		}
+#else
+		thrinfo->thr_poll_fds[thrinfo->thr_conn_count + 1].fd =
+			conninfo->con_port->sock;
+		thrinfo->thr_poll_fds[thrinfo->thr_conn_count + 1].events = POLLIN;
+		thrinfo->thr_poll_fds[thrinfo->thr_conn_count + 1].revents = 0;
+#endif
 
-	/*
-	 * We also maintain a map of currently used array slots in a separate data
-	 * structure. This allows us to quickly iterate through all open
-	 * connections servred by a thread. So while iterating through all open
-	 * connections, the correct mechanism would be something as follow:
-	 *
-	 * for (ii = 0; ii < thrinfo->thr_conn_count; ii++)
-	 * {
-	 * 		int connIndx = thrinfo->thr_conn_map[ii];
-	 * 	 	GTMProxy_ConnectionInfo *conninfo = * 	 	thrinfo->thr_all_conns[connIndx];	
-	 * 	 	.....
-	 * }
-	 */  
-	thrinfo->thr_conn_map[thrinfo->thr_conn_count] = connIndx;
-	thrinfo->thr_conn_count++;
+		/*
+		 * Save the array slotid in the conninfo structure. We send this to
+		 * the GTM server as an identifier which the GTM server sends us back
+		 * in the response. We use that information to route the response
+		 * back to the approrpiate connection.
+		 *
+		 * Note that the reason to use the array slotid in the messages
+		 * to/from GTM is to ensure that the corresponding connection can be
+		 * quickly found while proxying responses back to the client.
+		 */
+		conninfo->con_id = connIndx;
+		thrinfo->thr_all_conns[connIndx] = conninfo;
 
-	/*
-	 * Now increment the seqno since a new connection is added to the array.
-	 * Before we do the next poll(), the fd array will be forced to be
-	 * reconstructed.
-	 */
-   	thrinfo->thr_seqno++;
+		/*
+		 * We also maintain a map of currently used array slots in a separate
+		 * data structure. This allows us to quickly iterate through all open
+		 * connections servred by a thread. So while iterating through all
+		 * open connections, the correct mechanism would be something as
+		 * follow:
+		 *
+		 * for (ii = 0; ii < thrinfo->thr_conn_count; ii++)
+		 * {
+		 * 		int connIndx = thrinfo->thr_conn_map[ii];
+		 * 	 	GTMProxy_ConnectionInfo *conninfo = thrinfo->thr_all_conns[connIndx];
+		 * 	 	.....
+		 * }
+		 */
+		thrinfo->thr_conn_map[thrinfo->thr_conn_count] = connIndx;
+		thrinfo->thr_conn_count++;
+		count++;
+	}
 
-	/*
-	 * Signal the worker thread if its waiting for connections to be added to
-	 * its Q
-	 *
-	 * XXX May be we can first check the condition that this is the first
-	 * connection in the array and also use signal instead of a bcast since
-	 * only one thread is waiting on the cv.
-	 */
-	GTM_CVBcast(&thrinfo->thr_cv);
-	GTM_MutexLockRelease(&thrinfo->thr_lock);
+	/* The main thread may reuse the entries once we are done with them */
+	pg_memory_barrier();
+	pg_atomic_write_u32(&thrinfo->thr_newconn_tail, tail);
 
-	return thrinfo;
+	return count;
 }
 
 /*
- * Remove the connection from the array and compact the array
+ * Wait at most timeout_ms (-1 for no limit) for messages or new connections.
+ * The connections with events are put in thr_ready_conns, with POLLIN and/or
+ * POLLHUP in thr_ready_events. Returns their number, or -1 with errno set if
+ * the wait failed.
  */
 int
-GTMProxy_ThreadRemoveConnection(GTMProxy_ThreadInfo *thrinfo, GTMProxy_ConnectionInfo *conninfo)
+GTMProxy_ThreadWait(GTMProxy_ThreadInfo *thrinfo, int timeout_ms)
 {
+	char buf[64];
+	int nevents;
 	int ii;
-	int connIndx;
 
-	/*
-	 * Lock the threadninfo structure to safely remove the connection from the
-	 * thread structure.
-	 */
-	GTM_MutexLockAcquire(&thrinfo->thr_lock);
+	thrinfo->thr_ready_count = 0;
+
+#ifdef HAVE_SYS_EPOLL_H
+	nevents = epoll_wait(thrinfo->thr_epoll_fd, thrinfo->thr_epoll_events,
+						 GTM_PROXY_MAX_CONNECTIONS + 1, timeout_ms);
+	if (nevents < 0)
+		return -1;
 
-	connIndx = -1;
-	for (ii = 0; ii < GTM_PROXY_MAX_CONNECTIONS; ii++)
+	for (ii = 0; ii < nevents; ii++)
 	{
-		if (thrinfo->thr_all_conns[ii] == conninfo)
+		struct epoll_event *ev = &thrinfo->thr_epoll_events[ii];
+		short events = 0;
+
+		if (ev->data.u32 == GTM_PROXY_WAKEUP_EVENT)
 		{
-			connIndx = ii;
-			break;
+			while (read(thrinfo->thr_wakeup_pipe[0], buf, sizeof (buf)) > 0)
+				;
+			continue;
 		}
+
+		if (ev->events & (EPOLLHUP | EPOLLERR))
+			events |= POLLHUP;
+		if (ev->events & EPOLLIN)
+			events |= POLLIN;
+		thrinfo->thr_ready_conns[thrinfo->thr_ready_count] = ev->data.u32;
+		thrinfo->thr_ready_events[thrinfo->thr_ready_count] = events;
+		thrinfo->thr_ready_count++;
 	}
+#else
+	nevents = poll(thrinfo->thr_poll_fds, thrinfo->thr_conn_count + 1,
+				   timeout_ms);
+	if (nevents < 0)
+		return -1;
 
-	if (connIndx == -1)
+	for (ii = 0; nevents > 0 && ii <= thrinfo->thr_conn_count; ii++)
 	{
-		GTM_MutexLockRelease(&thrinfo->thr_lock);
-		elog(ERROR, "No such connection");
+		short revents = thrinfo->thr_poll_fds[ii].revents;
+		short events = 0;
+
+		if (revents == 0)
+			continue;
+		nevents--;
+		thrinfo->thr_poll_fds[ii].revents = 0;
+
+		if (ii == 0)
+		{
+			while (read(thrinfo->thr_wakeup_pipe[0], buf, sizeof (buf)) > 0)
+				;
+			continue;
+		}
+
+		if (revents & (POLLHUP | POLLERR | POLLNVAL))
+			events |= POLLHUP;
+		if (revents & POLLIN)
+			events |= POLLIN;
+		thrinfo->thr_ready_conns[thrinfo->thr_ready_count] =
+			thrinfo->thr_conn_map[ii - 1];
+		thrinfo->thr_ready_events[thrinfo->thr_ready_count] = events;
+		thrinfo->thr_ready_count++;
 	}
+#endif
+
+	return thrinfo->thr_ready_count;
+}
+
+/*
+ * Remove the connection from the array and compact the array
+ */
+int
+GTMProxy_ThreadRemoveConnection(GTMProxy_ThreadInfo *thrinfo, GTMProxy_ConnectionInfo *conninfo)
+{
+	int ii;
+	int connIndx;
+
+	connIndx = conninfo->con_id;
+	if (connIndx < 0 || connIndx >= GTM_PROXY_MAX_CONNECTIONS ||
+		thrinfo->thr_all_conns[connIndx] != conninfo)
+		elog(ERROR, "No such connection");
+
+	/*
+	 * Closing the socket removed it from the epoll set already, unless the
+	 * connection is still open
+	 */
+#ifdef HAVE_SYS_EPOLL_H
+	if (conninfo->con_port != NULL)
+		(void) epoll_ctl(thrinfo->thr_epoll_fd, EPOLL_CTL_DEL,
+						 conninfo->con_port->sock, NULL);
+#endif
 
 	/*
 	 * Reset command backup info
@@ -497,10 +657,7 @@ GTMProxy_ThreadRemoveConnection(GTMProxy_ThreadInfo *thrinfo, GTMProxy_Connectio
 	}
 
 	if (ii >= thrinfo->thr_conn_count)
-	{
-		GTM_MutexLockRelease(&thrinfo->thr_lock);
 		elog(FATAL, "Failed to find connection mapping to %d", connIndx);
-	}
 
 	/*
 	 * If this is the last entry in the array ? If not, then copy the last
@@ -510,6 +667,9 @@ GTMProxy_ThreadRemoveConnection(GTMProxy_ThreadInfo *thrinfo, GTMProxy_Connectio
 	{
 		/* Copy the last entry in this slot */
 		thrinfo->thr_conn_map[ii] = thrinfo->thr_conn_map[thrinfo->thr_conn_count - 1];
+#ifndef HAVE_SYS_EPOLL_H
+		thrinfo->thr_poll_fds[ii + 1] = thrinfo->thr_poll_fds[thrinfo->thr_conn_count];
+#endif
 
 		/* Mark the last slot free */
 		thrinfo->thr_conn_map[thrinfo->thr_conn_count - 1] = -1;
@@ -522,12 +682,5 @@ GTMProxy_ThreadRemoveConnection(GTMProxy_ThreadInfo *thrinfo, GTMProxy_Connectio
 
 	thrinfo->thr_conn_count--;
 
-	/*
-	 * Increment the seqno to ensure that the next time before we poll, the fd
-	 * array is reconstructed.
-	 */
-	thrinfo->thr_seqno++;
-	GTM_MutexLockRelease(&thrinfo->thr_lock);
-
 	return 0;
 }
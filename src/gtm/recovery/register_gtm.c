@@ -484,7 +484,22 @@ ProcessGTMEndBackup(Port *myport, StringInfo message)
 static void
 finishStandbyConn(GTM_ThreadInfo *thrinfo)
 {
-	if ((thrinfo->thr_conn != NULL) && (thrinfo->thr_conn->standby != NULL))
+	if (thrinfo->thr_worker)
+	{
+		int ii;
+
+		for (ii = 0; ii < thrinfo->thr_conn_count; ii++)
+		{
+			GTM_ConnectionInfo *conninfo = thrinfo->thr_all_conns[ii];
+
+			if (conninfo->standby != NULL)
+			{
+				GTMPQfinish(conninfo->standby);
+				conninfo->standby = NULL;
+			}
+		}
+	}
+	else if ((thrinfo->thr_conn != NULL) && (thrinfo->thr_conn->standby != NULL))
 	{
 		GTMPQfinish(thrinfo->thr_conn->standby);
 		thrinfo->thr_conn->standby = NULL;
@@ -83,4 +83,5 @@ void
 Recovery_InitStandbyLock(void)
 {
 	GTM_RWLockInit(&StandbyLock);
+	GTM_RWLockSetName(&StandbyLock, "StandbyLock");
 }
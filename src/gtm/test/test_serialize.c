@@ -306,7 +306,7 @@ test_seqinfo_1(void)
   d1->gs_max_value = 17;
   d1->gs_cycle = true;
   d1->gs_called = true;
-  d1->gs_ref_count = 19;
+  pg_atomic_init_u32(&d1->gs_ref_count, 19);
   d1->gs_state = 23;
 
   /* serialize */
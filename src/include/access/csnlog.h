@@ -0,0 +1,23 @@
+/*-------------------------------------------------------------------------
+ *
+ * csnlog.h
+ *
+ *	  Commit sequence number snapshots obtained from GTM
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * src/include/access/csnlog.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef CSNLOG_H
+#define CSNLOG_H
+
+#include "gtm/gtm_c.h"
+
+extern Size CSNLogShmemSize(void);
+extern void CSNLogShmemInit(void);
+extern GTM_Snapshot GetCSNSnapshotData(GlobalTransactionId gxid, bool first);
+
+#endif   /* CSNLOG_H */
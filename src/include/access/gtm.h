@@ -11,11 +11,16 @@
 #define ACCESS_GTM_H
 
 #include "gtm/gtm_c.h"
+#include "gtm/gtm_msg.h"
 
 /* Configuration variables */
 extern char *GtmHost;
 extern int GtmPort;
 extern bool gtm_backup_barrier;
+extern bool gtm_csn_snapshots;
+extern bool gtm_standby_snapshots;
+extern int gtm_clock_sync_interval;
+extern int gtm_global_xmin_interval;
 
 extern bool IsXidFromGTM;
 extern GlobalTransactionId currentGxid;
@@ -27,6 +32,9 @@ extern GlobalTransactionId BeginTranGTM(GTM_Timestamp *timestamp);
 extern GlobalTransactionId BeginTranAutovacuumGTM(void);
 extern int CommitTranGTM(GlobalTransactionId gxid, int waited_xid_count,
 		GlobalTransactionId *waited_xids);
+extern void StartCommitTranGTM(GlobalTransactionId gxid, int waited_xid_count,
+		GlobalTransactionId *waited_xids);
+extern int FinishCommitTranGTM(void);
 extern int RollbackTranGTM(GlobalTransactionId gxid);
 extern int StartPreparedTranGTM(GlobalTransactionId gxid,
 								char *gid,
@@ -42,6 +50,28 @@ extern int CommitPreparedTranGTM(GlobalTransactionId gxid,
 								 GlobalTransactionId *waited_xids);
 
 extern GTM_Snapshot GetSnapshotGTM(GlobalTransactionId gxid, bool canbe_grouped);
+extern GTM_Snapshot GetSnapshotGTMReadOnly(GlobalTransactionId gxid);
+extern GTM_Snapshot BeginTranSnapshotGTM(void);
+extern int GetCSNSnapshotGTM(GlobalTransactionId gxid, bool first,
+				  GTM_CSNSnapshot csn_snapshot);
+extern int GetCSNLogGTM(GTM_CSN from, uint32 *epoch, GTM_CSN *first,
+			 int *count, GlobalTransactionId **gxids);
+extern int GetStatsGTM(GTM_MessageStats **stats, int *count);
+extern int GetTimestampGTM(GTM_Timestamp *timestamp);
+extern int GetGlobalXminGTM(GlobalTransactionId *globalxmin);
+
+/* Hybrid logical clock of the node */
+extern Size GTMClockShmemSize(void);
+extern void GTMClockShmemInit(void);
+extern void GTMClockSync(GTM_Timestamp timestamp);
+extern GTM_Timestamp GTMClockTimestamp(GTM_Timestamp local);
+
+/* Newest global xmin of the node */
+extern Size GlobalXminShmemSize(void);
+extern void GlobalXminShmemInit(void);
+extern TransactionId GlobalXminAdvance(TransactionId globalxmin,
+				  TransactionId limit);
+extern TransactionId GlobalXminGet(void);
 
 /* Node registration APIs with GTM */
 extern int RegisterGTM(GTM_PGXCNodeType type, GTM_PGXCNodePort port, char *datafolder);
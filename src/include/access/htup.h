@@ -93,6 +93,22 @@ typedef struct RemoteDataRowData
 	char		msg[0];					/* last data row message */
 } 	RemoteDataRowData;
 typedef RemoteDataRowData *RemoteDataRow;
+
+/*
+ * DataRow messages passed between cluster nodes may carry attribute values in
+ * binary (send/receive) format, and the attribute data may be compressed.
+ * That is indicated by the high bits of the attribute count, which go first
+ * in the message. A compressed message continues with the raw length of the
+ * attribute data (int32), followed by pglz-compressed data. Messages with any
+ * of these flags are never sent to clients.
+ */
+#define DATAROW_BINARY			0x8000
+#define DATAROW_COMPRESSED		0x4000
+#define DATAROW_FLAGS			(DATAROW_BINARY | DATAROW_COMPRESSED)
+
+/* Is the data row in the format clients expect? */
+#define DataRowIsPlain(datarow) \
+	((((unsigned char) (datarow)->msg[0]) & (DATAROW_FLAGS >> 8)) == 0)
 #endif
 
 /*
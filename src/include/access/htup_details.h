@@ -782,6 +782,8 @@ extern HeapTuple heap_modify_tuple(HeapTuple tuple,
 				  bool *doReplace);
 extern void heap_deform_tuple(HeapTuple tuple, TupleDesc tupleDesc,
 				  Datum *values, bool *isnull);
+extern void heap_getattr_batch(HeapTuple tuples, int ntuples, int attnum,
+				   TupleDesc tupleDesc, Datum *values, bool *isnull);
 
 /* these three are deprecated versions of the three above: */
 extern HeapTuple heap_formtuple(TupleDesc tupleDescriptor,
@@ -613,6 +613,11 @@ typedef struct BTScanOpaqueData
 	int		   *killedItems;	/* currPos.items indexes of killed items */
 	int			numKilled;		/* number of currently stored items */
 
+	/* heap prefetching of plain index scans, see _bt_prefetch_heap */
+	int			prefetchDistance;	/* current read-ahead distance */
+	int			prefetchItem;	/* last currPos item prefetched, or -1 */
+	BlockNumber prefetchBlock;	/* heap block last prefetched */
+
 	/*
 	 * If we are doing an index-only scan, these are the tuple storage
 	 * workspaces for the currPos and markPos respectively.  Each is of size
@@ -741,6 +746,7 @@ extern void BTreeShmemInit(void);
  * prototypes for functions in nbtsort.c
  */
 typedef struct BTSpool BTSpool; /* opaque type known only within nbtsort.c */
+struct IndexInfo;				/* avoid including execnodes.h here */
 
 extern BTSpool *_bt_spoolinit(Relation heap, Relation index,
 			  bool isunique, bool isdead);
@@ -748,6 +754,9 @@ extern void _bt_spooldestroy(BTSpool *btspool);
 extern void _bt_spool(BTSpool *btspool, ItemPointer self,
 		  Datum *values, bool *isnull);
 extern void _bt_leafbuild(BTSpool *btspool, BTSpool *spool2);
+extern bool _bt_parallel_build(Relation heap, Relation index,
+				   struct IndexInfo *indexInfo,
+				   double *reltuples, double *indtuples);
 
 /*
  * prototypes for functions in nbtxlog.c
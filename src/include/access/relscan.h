@@ -19,7 +19,19 @@
 #include "access/htup_details.h"
 #include "access/itup.h"
 #include "access/tupdesc.h"
+#include "storage/spin.h"
 
+/*
+ * Shared state of a heap scan run by several processes, each of them taking
+ * the next page to scan from here.
+ */
+typedef struct ParallelHeapScanDescData
+{
+	Oid			phs_relid;		/* OID of relation to scan */
+	BlockNumber phs_nblocks;	/* number of blocks to scan */
+	slock_t		phs_mutex;		/* mutual exclusion for phs_cblock */
+	BlockNumber phs_cblock;		/* next block to hand out */
+}	ParallelHeapScanDescData;
 
 typedef struct HeapScanDescData
 {
@@ -42,6 +54,10 @@ typedef struct HeapScanDescData
 	BlockNumber rs_numblocks;	/* number of blocks to scan */
 	BufferAccessStrategy rs_strategy;	/* access strategy for reads */
 	bool		rs_syncscan;	/* report location to syncscan logic? */
+	ParallelHeapScanDesc rs_parallel;	/* shared state of a parallel scan,
+										 * or NULL */
+	BlockNumber rs_prefetch_pos;	/* blocks of the scan prefetched so far */
+	int			rs_prefetch_distance;	/* current read-ahead distance */
 
 	/* scan current state */
 	bool		rs_inited;		/* false = scan not init'd yet */
@@ -78,6 +78,8 @@ typedef struct tupleDesc
 	int32		tdtypmod;		/* typmod for tuple type */
 	bool		tdhasoid;		/* tuple has oid attribute in its header */
 	int			tdrefcount;		/* reference count, or -1 if not counting */
+	int			tdnfixed;		/* leading fixed-width attributes, or -1 if
+								 * not computed yet */
 }	*TupleDesc;
 
 
@@ -43,6 +43,9 @@ extern GlobalTransaction MarkAsPreparing(TransactionId xid, const char *gid,
 extern void EndPrepare(GlobalTransaction gxact);
 extern void StartPrepare(GlobalTransaction gxact);
 extern bool StandbyTransactionIdIsPrepared(TransactionId xid);
+#ifdef XCP
+extern int	GetPreparedTransactionXids(TransactionId **xids);
+#endif
 
 extern TransactionId PrescanPreparedTransactions(TransactionId **xids_p,
 							int *nxids_p);
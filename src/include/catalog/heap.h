@@ -152,6 +152,11 @@ extern void GetRelationDistributionItems(Oid relid,
 extern Oid *GetRelationDistributionNodes(PGXCSubCluster *subcluster,
 										 int *numnodes);
 extern Oid *BuildRelationDistributionNodes(List *nodes, int *numnodes);
+extern List *BuildRelationDistributionKeys(Oid relid,
+										   DistributeBy *distributeby,
+										   TupleDesc descriptor);
+extern List *BuildRelationDistributionRanges(Oid typid, List *rangevalues);
+extern void CheckRelationDistributionRanges(List *ranges, int numnodes);
 extern Oid *SortRelationDistributionNodes(Oid *nodeoids, int numnodes);
 #endif
 
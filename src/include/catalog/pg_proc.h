@@ -2798,7 +2798,7 @@ DATA(insert OID = 3057 ( pg_stat_get_autoanalyze_count PGNSP PGUID 12 1 0 0 0 f
 DESCR("statistics: number of auto analyzes for a table");
 DATA(insert OID = 1936 (  pg_stat_get_backend_idset		PGNSP PGUID 12 1 100 0 0 f f f f t t s 0 0 23 "" _null_ _null_ _null_ _null_ _null_ pg_stat_get_backend_idset _null_ _null_ _null_ ));
 DESCR("statistics: currently active backend IDs");
-DATA(insert OID = 2022 (  pg_stat_get_activity			PGNSP PGUID 12 1 100 0 0 f f f f f t s 1 0 2249 "23" "{23,26,23,26,25,25,25,16,1184,1184,1184,1184,869,25,23,28,28,16,25,25,23,16,25}" "{i,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o}" "{pid,datid,pid,usesysid,application_name,state,query,waiting,xact_start,query_start,backend_start,state_change,client_addr,client_hostname,client_port,backend_xid,backend_xmin,ssl,sslversion,sslcipher,sslbits,sslcompression,sslclientdn}" _null_ _null_ pg_stat_get_activity _null_ _null_ _null_ ));
+DATA(insert OID = 2022 (  pg_stat_get_activity			PGNSP PGUID 12 1 100 0 0 f f f f f t s 1 0 2249 "23" "{23,26,23,26,25,25,25,16,1184,1184,1184,1184,869,25,23,28,28,16,25,25,23,16,25,25,25,19}" "{i,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o}" "{pid,datid,pid,usesysid,application_name,state,query,waiting,xact_start,query_start,backend_start,state_change,client_addr,client_hostname,client_port,backend_xid,backend_xmin,ssl,sslversion,sslcipher,sslbits,sslcompression,sslclientdn,wait_event_type,wait_event,wait_node}" _null_ _null_ pg_stat_get_activity _null_ _null_ _null_ ));
 DESCR("statistics: information about currently active backends");
 DATA(insert OID = 3099 (  pg_stat_get_wal_senders	PGNSP PGUID 12 1 10 0 0 f f f f f t s 0 0 2249 "" "{23,25,3220,3220,3220,3220,23,25}" "{o,o,o,o,o,o,o,o}" "{pid,state,sent_location,write_location,flush_location,replay_location,sync_priority,sync_state}" _null_ _null_ pg_stat_get_wal_senders _null_ _null_ _null_ ));
 DESCR("statistics: information about currently active replication");
@@ -5310,6 +5310,42 @@ DATA(insert OID = 7022 (  numeric_poly_agg_state_recv		   PGNSP PGUID 12 1 0 0 0
 DESCR("I/O");
 DATA(insert OID = 7023 (  numeric_poly_agg_state_send		   PGNSP PGUID 12 1 0 0 0 f f f f t f i 1 0 17 "7019" _null_ _null_ _null_ _null_ _null_ numeric_poly_agg_state_send _null_ _null_ _null_ ));
 DESCR("I/O");
+DATA(insert OID = 7024 (  pg_stat_get_shared_queues	PGNSP PGUID 12 1 100 0 0 f f f f t t v 0 0 2249 "" "{25,23,19,20,20,701,23,23,19,25,23,20,20,20,20,20,20,20,701}" "{o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o,o}" "{queue_name,producer_pid,producer_node,producer_pauses,producer_waits,producer_wait_time,consumer,consumer_pid,consumer_node,status,queue_size,tuples,bytes,queue_full,spill_tuples,spill_bytes,read_tuples,read_waits,read_wait_time}" _null_ _null_ pg_stat_get_shared_queues _null_ _null_ _null_ ));
+DESCR("statistics: shared queues of the node");
+DATA(insert OID = 7025 (  pg_stat_get_remote_nodes	PGNSP PGUID 12 1 100 0 0 f f f f t t v 0 0 2249 "" "{19,25,20,20,20,20,701,701,1016}" "{o,o,o,o,o,o,o,o,o}" "{node_name,node_type,bytes_sent,bytes_received,messages_sent,messages_received,send_time,wait_time,latency_histogram}" _null_ _null_ pg_stat_get_remote_nodes _null_ _null_ _null_ ));
+DESCR("statistics: network activity with remote nodes");
+DATA(insert OID = 7026 (  pg_stat_get_session_remote_nodes	PGNSP PGUID 12 1 100 0 0 f f f f t t v 0 0 2249 "" "{19,25,20,20,20,20,701,701,1016}" "{o,o,o,o,o,o,o,o,o}" "{node_name,node_type,bytes_sent,bytes_received,messages_sent,messages_received,send_time,wait_time,latency_histogram}" _null_ _null_ pg_stat_get_session_remote_nodes _null_ _null_ _null_ ));
+DESCR("statistics: network activity of current session with remote nodes");
+DATA(insert OID = 7027 (  pg_stat_get_pooler	PGNSP PGUID 12 1 100 0 0 f f f f t t v 0 0 2249 "" "{19,19,19,25,23,23,20,701,20,20,20}" "{o,o,o,o,o,o,o,o,o,o,o}" "{database,user_name,node_name,node_type,size,free,acquisitions,wait_time,grow_failures,destroyed,evicted}" _null_ _null_ pg_stat_get_pooler _null_ _null_ _null_ ));
+DESCR("statistics: connection pools of the pooler");
+DATA(insert OID = 7028 (  pg_stat_get_gtm	PGNSP PGUID 12 1 100 0 0 f f f f t t v 0 0 2249 "" "{25,25,25,20,701,1016}" "{o,o,o,o,o,o}" "{message,client_type,phase,calls,total_time,latency_histogram}" _null_ _null_ pg_stat_get_gtm _null_ _null_ _null_ ));
+DESCR("statistics: latency of the messages served by GTM");
+DATA(insert OID = 7029 (  pgxc_get_distribution	PGNSP PGUID 12 1 100 0 0 f f f f t t v 1 0 2249 "2205" "{2205,19,20,20,701,23,23}" "{i,o,o,o,o,o,o}" "{relation,node_name,rows,size,skew,buckets,bucket_moves}" _null_ _null_ pgxc_get_distribution _null_ _null_ _null_ ));
+DESCR("rows and size of a distributed table on each of its nodes");
+DATA(insert OID = 7030 (  pgxc_get_distribution_map	PGNSP PGUID 12 1 100 0 0 f f f f t t s 1 0 2249 "2205" "{2205,23,19,19,23,1007}" "{i,o,o,o,o,o}" "{relation,position,node_name,node_host,node_port,buckets}" _null_ _null_ pgxc_get_distribution_map _null_ _null_ _null_ ));
+DESCR("nodes storing a table distributed by value, in the order of the distribution map");
+DATA(insert OID = 7031 (  pgxc_node_for_value	PGNSP PGUID 12 1 0 25 0 f f f f t f s 2 0 19 "2205 1009" "{2205,1009}" "{i,v}" _null_ _null_ _null_ pgxc_node_for_value _null_ _null_ _null_ ));
+DESCR("node storing the rows with the given values of the distribution columns");
+DATA(insert OID = 7032 (  pg_lock_waits	PGNSP PGUID 12 1 100 0 0 f f f f t t v 0 0 2249 "" "{23,28,23,28}" "{o,o,o,o}" "{waiter_pid,waiter_xid,blocker_pid,blocker_xid}" _null_ _null_ pg_lock_waits _null_ _null_ _null_ ));
+DESCR("processes waiting for locks and the processes holding them");
+DATA(insert OID = 7033 (  pgxc_global_deadlock_check	PGNSP PGUID 12 1 10 0 0 f f f f t t v 0 0 2249 "" "{19,23,28}" "{o,o,o}" "{node_name,pid,xid}" _null_ _null_ pgxc_global_deadlock_check _null_ _null_ _null_ ));
+DESCR("find and break deadlocks across Datanodes");
+DATA(insert OID = 7034 (  pg_stat_get_global_xmin	PGNSP PGUID 12 1 10 0 0 f f f f t t v 0 0 2249 "" "{19,28,23,1184}" "{o,o,o,o}" "{node_name,global_xmin,xid_lag,last_update}" _null_ _null_ pg_stat_get_global_xmin _null_ _null_ _null_ ));
+DESCR("statistics: global xmin known to the nodes");
+DATA(insert OID = 7035 (  pgxc_resolve_prepared	PGNSP PGUID 12 1 10 0 0 f f f f t t v 1 0 2249 "23" "{23,28,25,25}" "{i,o,o,o}" "{min_age,transaction,gid,action}" _null_ _null_ pgxc_resolve_prepared _null_ _null_ _null_ ));
+DESCR("finish the prepared transactions left behind by failed Coordinators");
+DATA(insert OID = 7036 (  pg_stat_get_wait_histogram	PGNSP PGUID 12 1 10 0 0 f f f f t t v 0 0 2249 "" "{25,20,701,20,20,20,20,20,20}" "{o,o,o,o,o,o,o,o,o}" "{wait_event_type,waits,total_time,under_1ms,under_10ms,under_100ms,under_1s,under_10s,over_10s}" _null_ _null_ pg_stat_get_wait_histogram _null_ _null_ _null_ ));
+DESCR("statistics: time spent in each class of distributed waits");
+DATA(insert OID = 7037 (  pgxc_create_global_index	PGNSP PGUID 12 1 0 0 0 f f f f t f v 2 0 2205 "2205 19" _null_ _null_ _null_ _null_ _null_ pgxc_create_global_index _null_ _null_ _null_ ));
+DESCR("create a global index of a column of a table distributed by value");
+DATA(insert OID = 7038 (  pgxc_create_matview_log	PGNSP PGUID 12 1 0 0 0 f f f f t f v 2 0 2278 "2205 2205" _null_ _null_ _null_ _null_ _null_ pgxc_create_matview_log _null_ _null_ _null_ ));
+DESCR("log the changes of a table for the incremental refresh of a materialized view");
+DATA(insert OID = 7039 (  pgxc_logical_slot_peek_changes PGNSP PGUID 12 1000 1000 25 0 f f f f f t v 4 0 2249 "19 3220 23 1009" "{19,3220,23,1009,3220,28,3220,1184,25}" "{i,i,i,v,o,o,o,o,o}" "{slot_name,upto_lsn,upto_nchanges,options,location,xid,commit_location,commit_time,data}" _null_ _null_ pgxc_logical_slot_peek_changes _null_ _null_ _null_ ));
+DESCR("peek at changes from replication slot, with the commit of their transactions");
+DATA(insert OID = 7040 (  pgxc_logical_slot_get_changes PGNSP PGUID 12 1000 1000 25 0 f f f f f t v 3 0 2249 "19 23 1009" "{19,23,1009,19,3220,28,1184,25}" "{i,i,v,o,o,o,o,o}" "{slot_name,upto_nchanges,options,node_name,location,xid,commit_time,data}" _null_ _null_ pgxc_logical_slot_get_changes _null_ _null_ _null_ ));
+DESCR("get changes from replication slots of all Datanodes, in commit order");
+DATA(insert OID = 7041 (  pgxc_result_cache_invalidate PGNSP PGUID 12 1 0 0 0 f f f f f f v 2 0 2278 "2205 28" _null_ _null_ _null_ _null_ _null_ pgxc_result_cache_invalidate _null_ _null_ _null_ ));
+DESCR("remove the cached results of a table on all the Coordinators");
 #endif
 /* pg_upgrade support */
 DATA(insert OID = 3582 ( binary_upgrade_set_next_pg_type_oid PGNSP PGUID  12 1 0 0 0 f f f f t f v 1 0 2278 "26" _null_ _null_ _null_ _null_ _null_ binary_upgrade_set_next_pg_type_oid _null_ _null_ _null_ ));
@@ -290,4 +290,16 @@ typedef FormData_pg_statistic *Form_pg_statistic;
  */
 #define STATISTIC_KIND_BOUNDS_HISTOGRAM  7
 
+#ifdef XCP
+/*
+ * A "datanode rows" slot is stored by coordinators for the distribution
+ * column of a table distributed by value. stanumbers contains the fraction
+ * of the table rows held by each datanode, in decreasing order. staop and
+ * stavalues are not used. The planner estimates from it how unevenly the
+ * work on the table is spread over the datanodes. The code is taken from
+ * the private use range.
+ */
+#define STATISTIC_KIND_DATANODE_ROWS  12001
+#endif
+
 #endif   /* PG_STATISTIC_H */
@@ -18,11 +18,16 @@ CATALOG(pgxc_class,9001) BKI_WITHOUT_OIDS
 
 	/* VARIABLE LENGTH FIELDS: */
 	oidvector	nodeoids;		/* List of nodes used by table */
+	int2vector	pcbucketmap;	/* Position in nodeoids of each bucket */
+#ifdef CATALOG_VARLEN
+	text		pcranges[1];	/* Split points of range distribution */
+	int2vector	pcattnums;		/* Columns of a multi-column distribution */
+#endif
 } FormData_pgxc_class;
 
 typedef FormData_pgxc_class *Form_pgxc_class;
 
-#define Natts_pgxc_class					6
+#define Natts_pgxc_class					9
 
 #define Anum_pgxc_class_pcrelid				1
 #define Anum_pgxc_class_pclocatortype		2
@@ -30,6 +35,9 @@ typedef FormData_pgxc_class *Form_pgxc_class;
 #define Anum_pgxc_class_pchashalgorithm		4
 #define Anum_pgxc_class_pchashbuckets		5
 #define Anum_pgxc_class_nodes				6
+#define Anum_pgxc_class_pcbucketmap			7
+#define Anum_pgxc_class_pcranges			8
+#define Anum_pgxc_class_pcattnums			9
 
 typedef enum PgxcClassAlterType
 {
@@ -44,7 +52,9 @@ extern void PgxcClassCreate(Oid pcrelid,
 							int pchashalgorithm,
 							int pchashbuckets,
 							int numnodes,
-							Oid *nodes);
+							Oid *nodes,
+							List *ranges,
+							List *attnums);
 extern void PgxcClassAlter(Oid pcrelid,
 						   char pclocatortype,
 						   int pcattnum,
@@ -52,6 +62,8 @@ extern void PgxcClassAlter(Oid pcrelid,
 						   int pchashbuckets,
 						   int numnodes,
 						   Oid *nodes,
+						   List *ranges,
+						   List *attnums,
 						   PgxcClassAlterType type);
 extern void RemovePgxcClass(Oid pcrelid);
 
@@ -15,6 +15,7 @@
 #define MATVIEW_H
 
 #include "catalog/objectaddress.h"
+#include "fmgr.h"
 #include "nodes/params.h"
 #include "nodes/parsenodes.h"
 #include "tcop/dest.h"
@@ -30,4 +31,10 @@ extern DestReceiver *CreateTransientRelDestReceiver(Oid oid);
 
 extern bool MatViewIncrementalMaintenanceIsEnabled(void);
 
+#ifdef XCP
+extern void PurgeMatViewLog(Oid matviewOid);
+extern bool RelationHasMatViewLog(Relation rel);
+extern Datum pgxc_create_matview_log(PG_FUNCTION_ARGS);
+#endif
+
 #endif   /* MATVIEW_H */
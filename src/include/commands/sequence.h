@@ -95,6 +95,9 @@ extern const char *seq_identify(uint8 info);
 #ifdef XCP
 #define DEFAULT_CACHEVAL	1
 extern int SequenceRangeVal;
+
+extern Size SequenceCacheShmemSize(void);
+extern void SequenceCacheShmemInit(void);
 #endif
 #ifdef PGXC
 /*
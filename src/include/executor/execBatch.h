@@ -0,0 +1,27 @@
+/*-------------------------------------------------------------------------
+ *
+ * execBatch.h
+ *	  Evaluation of simple scan quals over a batch of tuples at a time
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * src/include/executor/execBatch.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef EXECBATCH_H
+#define EXECBATCH_H
+
+#include "access/htup.h"
+#include "access/tupdesc.h"
+#include "nodes/pg_list.h"
+
+typedef struct BatchQual BatchQual;
+
+extern BatchQual *ExecInitBatchQual(List *qual, Index varno,
+				  TupleDesc tupdesc, int maxtuples, List **residual);
+extern int ExecBatchQual(BatchQual *bqual, HeapTuple tuples, int ntuples,
+			  uint16 *selection);
+
+#endif   /* EXECBATCH_H */
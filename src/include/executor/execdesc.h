@@ -61,6 +61,8 @@ typedef struct QueryDesc
 	int 		myindex;		/* -1 if locally executed subplan is producing
 								 * data and distribute via squeue. Otherwise
 								 * get local data from squeue */
+	struct JoinFilter *joinfilter;	/* rows sent to the parent node must pass
+									 * it, see joinFilter.c */
 #endif
 
 	/* This is always set NULL by the core system, but plugins can change it */
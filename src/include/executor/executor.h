@@ -275,6 +275,9 @@ extern TupleTableSlot *ExecScan(ScanState *node, ExecScanAccessMtd accessMtd,
 extern void ExecAssignScanProjectionInfo(ScanState *node);
 extern void ExecAssignScanProjectionInfoWithVarno(ScanState *node, Index varno);
 extern void ExecScanReScan(ScanState *node);
+#ifdef XCP
+extern bool ExecScanJoinFilter(ScanState *node, TupleTableSlot *slot);
+#endif
 
 /*
  * prototypes from functions in execTuples.c
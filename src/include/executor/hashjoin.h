@@ -72,6 +72,23 @@ typedef struct HashJoinTupleData
 #define HJTUPLE_MINTUPLE(hjtup)  \
 	((MinimalTuple) ((char *) (hjtup) + HJTUPLE_OVERHEAD))
 
+/*
+ * A bucket of the in-memory hash table.  Besides the head of its list of
+ * tuples, it keeps one bit set for the tag of each tuple in the list, the
+ * tag being the top bits of the hash value (the bucket number comes from
+ * the bottom ones).  An outer tuple whose tag bit is not set cannot match
+ * anything in the bucket, which is found out without following the list:
+ * with a table larger than the CPU caches, each tuple visited is a cache
+ * miss, and most probes of a selective join would otherwise pay one.
+ */
+typedef struct HashJoinBucketData
+{
+	struct HashJoinTupleData *tuples;	/* list of tuples in the bucket */
+	uint32		tags;			/* tag bits of the tuples in the list */
+}	HashJoinBucketData;
+
+#define HJ_TAG_BIT(hashvalue)	((uint32) 1 << ((hashvalue) >> 27))
+
 /*
  * If the outer relation's distribution is sufficiently nonuniform, we attempt
  * to optimize the join by treating the hash values corresponding to the outer
@@ -133,8 +150,8 @@ typedef struct HashJoinTableData
 	int			nbuckets_optimal;		/* optimal # buckets (per batch) */
 	int			log2_nbuckets_optimal;	/* same as log2_nbuckets optimal */
 
-	/* buckets[i] is head of list of tuples in i'th in-memory bucket */
-	struct HashJoinTupleData **buckets;
+	/* buckets[i] heads the list of tuples in i'th in-memory bucket */
+	HashJoinBucketData *buckets;
 	/* buckets array is per-batch storage, as are all the tuples */
 
 	bool		keepNulls;		/* true to store unmatchable NULL tuples */
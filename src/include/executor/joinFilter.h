@@ -0,0 +1,55 @@
+/*-------------------------------------------------------------------------
+ *
+ * joinFilter.h
+ *	  Bloom filters of hash join keys, applied by the nodes producing the
+ *	  outer rows of the join
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * src/include/executor/joinFilter.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef JOINFILTER_H
+#define JOINFILTER_H
+
+#include "executor/tuptable.h"
+#include "fmgr.h"
+#include "lib/stringinfo.h"
+
+/* Bounds of the filter size, in bits */
+#define JOIN_FILTER_MIN_BITS	1024
+#define JOIN_FILTER_MAX_BITS	(8 * 1024 * 1024)
+
+/* Bits set per hash value */
+#define JOIN_FILTER_HASHES		3
+
+typedef struct JoinFilter
+{
+	MemoryContext jf_context;	/* holds the filter and everything below */
+	int			jf_nkeys;		/* number of join keys */
+	AttrNumber *jf_attnos;		/* key columns of the outer rows */
+	Oid		   *jf_hashfuncs;	/* hash functions of the outer keys */
+	FmgrInfo   *jf_hashinfo;	/* set up when the filter is first applied */
+	uint32		jf_nbits;		/* size of the filter, a power of 2 */
+	uint64	   *jf_bits;
+	double		jf_nadded;		/* hash values added */
+	long		jf_tested;		/* rows tested */
+	long		jf_rejected;	/* rows rejected */
+} JoinFilter;
+
+extern bool RuntimeJoinFilters;
+
+extern JoinFilter *JoinFilterCreate(int nkeys, AttrNumber *attnos,
+				 Oid *hashfuncs, double rows);
+extern void JoinFilterFree(JoinFilter *filter);
+extern void JoinFilterAdd(JoinFilter *filter, uint32 hashvalue);
+extern bool JoinFilterUseful(JoinFilter *filter);
+extern bool JoinFilterTestSlot(JoinFilter *filter, TupleTableSlot *slot);
+extern bool JoinFilterTestHash(JoinFilter *filter, uint32 hashvalue);
+extern bool JoinFilterWorthwhile(JoinFilter *filter);
+extern void JoinFilterSerialize(JoinFilter *filter, StringInfo buf);
+extern JoinFilter *JoinFilterDeserialize(StringInfo msg);
+
+#endif   /* JOINFILTER_H */
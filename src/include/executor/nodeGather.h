@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * nodeGather.h
+ *	  prototypes for nodeGather.c
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * src/include/executor/nodeGather.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef NODEGATHER_H
+#define NODEGATHER_H
+
+#include "nodes/execnodes.h"
+
+/* GUC parameters */
+extern int	max_parallel_degree;
+extern int	min_parallel_relation_size;
+
+extern Plan *ExecParallelFragment(Plan *plan, EState *estate, int eflags);
+extern GatherState *ExecInitGather(Gather *node, EState *estate, int eflags);
+extern TupleTableSlot *ExecGather(GatherState *node);
+extern void ExecEndGather(GatherState *node);
+extern void ExecReScanGather(GatherState *node);
+
+#endif   /* NODEGATHER_H */
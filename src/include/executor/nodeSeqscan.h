@@ -20,5 +20,7 @@ extern SeqScanState *ExecInitSeqScan(SeqScan *node, EState *estate, int eflags);
 extern TupleTableSlot *ExecSeqScan(SeqScanState *node);
 extern void ExecEndSeqScan(SeqScanState *node);
 extern void ExecReScanSeqScan(SeqScanState *node);
+extern void ExecSeqScanInitializeParallel(SeqScanState *node,
+							  ParallelHeapScanDesc parallel_scan);
 
 #endif   /* NODESEQSCAN_H */
@@ -16,6 +16,13 @@
 
 #include "nodes/execnodes.h"
 
+/*
+ * An incremental sort sorts at least that many tuples at a time, so that
+ * small groups of tuples with equal presorted keys do not each pay for
+ * setting up a sort.
+ */
+#define SORT_MIN_BATCH_TUPLES	32
+
 extern SortState *ExecInitSort(Sort *node, EState *estate, int eflags);
 extern TupleTableSlot *ExecSort(SortState *node);
 extern void ExecEndSort(SortState *node);
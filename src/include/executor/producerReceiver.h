@@ -14,6 +14,7 @@
 #ifndef PRODUCER_RECEIVER_H
 #define PRODUCER_RECEIVER_H
 
+#include "executor/joinFilter.h"
 #include "tcop/dest.h"
 #include "pgxc/locator.h"
 #include "pgxc/squeue.h"
@@ -28,6 +29,11 @@ extern void SetProducerDestReceiverParams(DestReceiver *self,
 extern DestReceiver *SetSelfConsumerDestReceiver(DestReceiver *self,
 							DestReceiver *consumer);
 extern void SetProducerTempMemory(DestReceiver *self, MemoryContext tmpcxt);
+extern void SetProducerJoinFilter(DestReceiver *self, JoinFilter *filter);
+extern void SetProducerAdaptiveParams(DestReceiver *self,
+						  AttrNumber distKey,
+						  Locator *locator,
+						  long rows);
 extern bool ProducerReceiverPushBuffers(DestReceiver *self);
 
 #endif   /* PRODUCER_RECEIVER_H */
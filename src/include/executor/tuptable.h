@@ -113,6 +113,9 @@
  *
  * tts_slow/tts_off are saved state for slot_deform_tuple, and should not
  * be touched by any other code.
+ *
+ * tts_deform, if set, replaces slot_deform_tuple for the slot's descriptor.
+ * It is set by a JIT provider to code compiled for that descriptor.
  *----------
  */
 typedef struct TupleTableSlot
@@ -128,6 +131,7 @@ typedef struct TupleTableSlot
 	MemoryContext tts_drowcxt; 	/* Context to store deformed */
 	bool		tts_shouldFreeRow;	/* should pfree tts_dataRow? */
 	struct AttInMetadata *tts_attinmeta;	/* store here info to extract values from the DataRow */
+	struct AttInMetadata *tts_attrecvmeta;	/* the same for binary DataRows */
 #endif
 	TupleDesc	tts_tupleDescriptor;	/* slot's tuple descriptor */
 	MemoryContext tts_mcxt;		/* slot itself is in this context */
@@ -138,6 +142,7 @@ typedef struct TupleTableSlot
 	MinimalTuple tts_mintuple;	/* minimal tuple, or NULL if none */
 	HeapTupleData tts_minhdr;	/* workspace for minimal-tuple-only case */
 	long		tts_off;		/* saved state for slot_deform_tuple */
+	void		(*tts_deform) (struct TupleTableSlot *slot, int natts);
 } TupleTableSlot;
 
 #define TTS_HAS_PHYSICAL_TUPLE(slot)  \
@@ -174,6 +179,11 @@ extern TupleTableSlot *ExecStoreAllNullTuple(TupleTableSlot *slot);
 extern HeapTuple ExecCopySlotTuple(TupleTableSlot *slot);
 extern MinimalTuple ExecCopySlotMinimalTuple(TupleTableSlot *slot);
 #ifdef PGXC
+extern bool DatarowBinaryFormat;
+extern bool DatarowCompression;
+extern bool ExecDatarowBinaryPossible(TupleDesc tdesc);
+extern bool ExecDatarowBinaryOutput(Oid typid, Oid *typSend,
+						bool *typIsVarlena);
 extern RemoteDataRow ExecCopySlotDatarow(TupleTableSlot *slot,
 					MemoryContext tmpcxt);
 #endif
@@ -18,5 +18,13 @@
 
 extern bool assert_enabled;
 
+/*
+ * Same as in postgres.h, the GTM headers using Assert() are also included by
+ * the backend.
+ */
+extern void ExceptionalCondition(const char *conditionName,
+					 const char *errorType,
+			   const char *fileName, int lineNumber) pg_attribute_noreturn();
+
 #endif
 
@@ -28,6 +28,7 @@
 #include "gtm/gtm_conn.h"
 #include "gtm/elog.h"
 #include "gtm/gtm_list.h"
+#include "gtm/stringinfo.h"
 
 extern char *GTMLogFile;
 
@@ -42,6 +43,7 @@ typedef enum GTM_ThreadStatus
 } GTM_ThreadStatus;
 
 struct GTM_ConnectionInfo;
+struct pollfd;
 
 #define ERRORDATA_STACK_SIZE  20
 
@@ -62,6 +64,34 @@ typedef struct GTM_ThreadInfo
 
 	GTM_RWLock			thr_lock;
 	gtm_List				*thr_cached_txninfo;
+
+	/*
+	 * A worker thread serves many connections, thr_conn and thr_client_id
+	 * are those of the connection whose message is being processed. The main
+	 * thread hands new connections over through thr_new_conns and wakes the
+	 * worker up writing to thr_wakeup_fd.
+	 */
+	bool				thr_worker;
+	GTM_MutexLock		thr_conn_lock;		/* protects thr_new_conns */
+	gtm_List			*thr_new_conns;
+	int					thr_wakeup_fd[2];
+	GTM_ConnectionInfo	**thr_all_conns;
+	struct pollfd		*thr_poll_fds;
+	int					thr_conn_count;
+	int					thr_conn_size;
+	GTM_ConnectionInfo	*thr_backup_conn;	/* connection taking a backup */
+	uint64				thr_recv_time;		/* when the messages being
+											 * processed were read */
+
+	/*
+	 * Buffers reused by every message the thread processes, so that the hot
+	 * request paths do not go to malloc. Both live in the thread's
+	 * TopMemoryContext. thr_snapshot is built for snapshot requests which do
+	 * not carry a valid transaction, thr_reply_buf holds the reply being
+	 * sent.
+	 */
+	GTM_SnapshotData	thr_snapshot;
+	StringInfoData		thr_reply_buf;
 } GTM_ThreadInfo;
 
 typedef struct GTM_Threads
@@ -89,7 +119,17 @@ void GTM_SetInitialAndNextClientIdentifierAtPromote(void);
 
 GTM_ThreadInfo *GTM_ThreadCreate(GTM_ConnectionInfo *conninfo,
 				  void *(* startroutine)(void *));
+uint32 GTM_NextClientIdentifier(void);
+void GTM_ConnectionClose(GTM_ConnectionInfo *conninfo);
 GTM_ThreadInfo * GTM_GetThreadInfo(GTM_ThreadID thrid);
+void gtm_msgstat_increment(int type);
+void gtm_resultstat_increment(int type);
+uint64 gtm_stat_now(void);
+void gtm_msgstat_record(GTM_MessageType mtype, GTM_PGXCNodeType client_type,
+						uint64 received, uint64 started, uint64 lock_wait);
+void ProcessGetStatsCommand(Port *myport, StringInfo message);
+void ProcessGetTimestampCommand(Port *myport, StringInfo message);
+void gtm_print_stats(void);
 #ifdef XCP
 extern void SaveControlInfo(void);
 #define CONTROL_INTERVAL		1000
@@ -123,6 +163,9 @@ extern GTM_ThreadID						TopMostThreadID;
 #define MyThreadID				(GetMyThreadInfo->thr_id)
 #define IsMainThread()			(GetMyThreadInfo->thr_id == TopMostThreadID)
 
+#define GTM_ThreadSnapshot		(&GetMyThreadInfo->thr_snapshot)
+#define GTM_ReplyBuffer			(&GetMyThreadInfo->thr_reply_buf)
+
 #define GTM_CachedTransInfo				(GetMyThreadInfo->thr_cached_txninfo)
 #define GTM_HaveFreeCachedTransInfo()	(gtm_list_length(GTM_CachedTransInfo))
 
@@ -22,9 +22,22 @@ extern GTM_RWLock	gtm_bkup_lock;
 
 #define RestoreDuration	2000
 
+/* Rewrite the control file once its state log has that many records */
+#define GTM_STATE_LOG_MAX_RECORDS	10000
+
+/*
+ * Tag of the GXID restore point records of the state log. Sequence records
+ * start with the sequence key, encoded so that it never looks like this.
+ */
+#define GTM_STATE_XID_TAG	"\\gxid"
+
+extern void GTM_InitStateLog(void);
+extern void GTM_StartStateLog(void);
+extern void GTM_AppendStateRecord(const char *record);
 extern void GTM_WriteRestorePoint(void);
+extern void GTM_WriteControlFile(void);
+extern bool GTM_StateLogSnapshot(char **data, size_t *len);
 extern void GTM_MakeBackup(char *path);
-extern void GTM_SetNeedBackup(void);
 extern bool GTM_NeedBackup(void);
 extern void GTM_WriteBarrierBackup(char *barrier_id);
 
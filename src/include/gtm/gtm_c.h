@@ -117,6 +117,35 @@ typedef struct GTM_SnapshotData
 
 typedef GTM_SnapshotData *GTM_Snapshot;
 
+/*
+ * Commit sequence number. Every completion of a transaction holding a GXID
+ * takes the next one, so a CSN identifies the set of completed transactions.
+ */
+typedef uint64	GTM_CSN;
+
+#define InvalidCSN					((GTM_CSN) 0)
+#define FirstCSN					((GTM_CSN) 1)
+
+/*
+ * A CSN snapshot sees the transactions completed with a CSN lower than
+ * cs_csn. The other fields are those of the regular snapshot taken at the
+ * same moment, cs_epoch identifies the GTM instance the CSNs come from.
+ */
+typedef struct GTM_CSNSnapshotData
+{
+	uint32					cs_epoch;
+	GTM_CSN					cs_csn;
+	GlobalTransactionId		cs_xmin;
+	GlobalTransactionId		cs_xmax;
+	GlobalTransactionId		cs_recent_global_xmin;
+} GTM_CSNSnapshotData;
+
+typedef GTM_CSNSnapshotData *GTM_CSNSnapshot;
+
+/* Number of the latest completions GTM keeps, and sends at once */
+#define GTM_CSNLOG_SIZE				65536
+#define GTM_CSNLOG_MAX_FETCH		8192
+
 /* Define max size of node name in start up packet */
 #define SP_NODE_NAME		64
 
@@ -39,6 +39,7 @@ typedef union GTM_ResultData
 	GlobalTransactionId			grd_gxid;			/* TXN_PREPARE		
 													 * TXN_START_PREPARED
 													 * TXN_ROLLBACK
+													 * GET_GLOBAL_XMIN
 													 */
 	struct {
 		GlobalTransactionId			gxid;
@@ -87,12 +88,27 @@ typedef union GTM_ResultData
 
 	struct
 	{
-		GTM_TransactionHandle	txnhandle;		/* SNAPSHOT_GXID_GET */
 		GlobalTransactionId		gxid;			/* SNAPSHOT_GET */
+		GTM_Timestamp			timestamp;		/* SNAPSHOT_GXID_GET */
 		int						txn_count;		/* SNAPSHOT_GET_MULTI */
 		int						status[GTM_MAX_GLOBAL_TRANSACTIONS];
 	} grd_txn_snap_multi;
 
+	GTM_CSNSnapshotData			grd_csn_snapshot;	/* SNAPSHOT_CSN_GET */
+
+	struct
+	{
+		uint32				epoch;
+		GTM_CSN				first;
+		int					count;
+	} grd_csnlog;								/* CSNLOG_GET, GXIDs are in
+												 * gr_csnlog_gxids */
+
+	int							grd_stats_count;	/* GET_STATS, entries are
+													 * in gr_stats */
+
+	GTM_Timestamp				grd_timestamp;		/* GET_TIMESTAMP */
+
 	struct
 	{
 		GlobalTransactionId		gxid;
@@ -151,6 +167,8 @@ typedef struct GTM_Result
 	 */
 	int					gr_xip_size;
 	GTM_SnapshotData	gr_snapshot;
+	GlobalTransactionId *gr_csnlog_gxids;
+	GTM_MessageStats	*gr_stats;
 
 	/*
 	 * Similarly, keep the buffer for proxying data outside the union
@@ -209,6 +227,23 @@ int get_gid_data(GTM_Conn *conn, GTM_IsolationLevel isolevel, char *gid,
 				 GlobalTransactionId *gxid,
 				 GlobalTransactionId *prepared_gxid,
 				 char **nodestring);
+
+/*
+ * Asynchronous Transaction Management API, see gtm_client.c
+ */
+int send_begin_transaction(GTM_Conn *conn, GTM_IsolationLevel isolevel);
+GlobalTransactionId receive_begin_transaction(GTM_Conn *conn,
+											  GTM_Timestamp *timestamp);
+int send_commit_transaction(GTM_Conn *conn, GlobalTransactionId gxid);
+int receive_commit_transaction(GTM_Conn *conn);
+int send_get_snapshot(GTM_Conn *conn, GlobalTransactionId gxid,
+		bool canbe_grouped);
+GTM_SnapshotData *receive_get_snapshot(GTM_Conn *conn, bool canbe_grouped);
+int send_get_next(GTM_Conn *conn, GTM_SequenceKey key,
+		 char *coord_name, int coord_procid, GTM_Sequence range);
+int receive_get_next(GTM_Conn *conn, GTM_Sequence *result,
+		 GTM_Sequence *rangemax);
+
 /*
  * Multiple Transaction Management API
  */
@@ -223,6 +258,10 @@ bkup_begin_transaction_multi(GTM_Conn *conn, int txn_count,
 							 uint32 *client_id,
 							 GTMProxy_ConnID *txn_connid);
 int
+bkup_report_leased_gxids(GTM_Conn *conn,
+						 int assign_count, GTM_LeaseAssignment *assigned,
+						 int release_count, GlobalTransactionId *released);
+int
 commit_transaction_multi(GTM_Conn *conn, int txn_count, GlobalTransactionId *gxid,
 						 int *txn_count_out, int *status_out);
 int
@@ -244,6 +283,17 @@ snapshot_get_multi(GTM_Conn *conn, int txn_count, GlobalTransactionId *gxid,
  */
 GTM_SnapshotData *get_snapshot(GTM_Conn *conn, GlobalTransactionId gxid,
 		bool canbe_grouped);
+GTM_SnapshotData *begin_transaction_snapshot(GTM_Conn *conn,
+		GTM_IsolationLevel isolevel, GlobalTransactionId *gxid,
+		GTM_Timestamp *timestamp);
+GTM_SnapshotData *get_snapshot_readonly(GTM_Conn *conn, int txn_count,
+		GlobalTransactionId *gxid, bool *from_standby);
+int bkup_publish_snapshot(GTM_Conn *conn, GlobalTransactionId next_gxid,
+		GTM_SnapshotData *snapshot);
+int get_snapshot_csn(GTM_Conn *conn, GlobalTransactionId gxid, bool first,
+		GTM_CSNSnapshot snapshot);
+int get_csnlog(GTM_Conn *conn, GTM_CSN from, uint32 *epoch, GTM_CSN *first,
+		int *count, GlobalTransactionId **gxids);
 
 /*
  * Node Registering management API
@@ -317,6 +367,10 @@ int bkup_report_barrier(GTM_Conn *conn, char *barrier_id);
  */
 int set_begin_end_backup(GTM_Conn *conn, bool begin);
 int gtm_sync_standby(GTM_Conn *conn);
+int bkup_state_log(GTM_Conn *conn, const char *data, int len);
+int get_gtm_stats(GTM_Conn *conn, GTM_MessageStats **stats, int *count);
+int get_timestamp(GTM_Conn *conn, GTM_Timestamp *timestamp);
+int get_global_xmin(GTM_Conn *conn, GlobalTransactionId *globalxmin);
 
 
 #endif
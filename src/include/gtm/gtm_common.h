@@ -29,7 +29,8 @@
 	ErrorData		thr_error_data[ERRORDATA_STACK_SIZE]; \
 	int				thr_error_stack_depth; \
 	int				thr_error_recursion_depth; \
-	int				thr_criticalsec_count;
+	int				thr_criticalsec_count; \
+	uint64			thr_lock_wait_usecs;	/* time waited for GTM_RWLocks */
 
 
 #endif
@@ -26,6 +26,8 @@ typedef struct GTM_ConnectionInfo
 	Port					*con_port;
 	struct GTM_ThreadInfo	*con_thrinfo;
 	bool					con_authenticated;
+	bool					con_disconnected;
+	uint32					con_client_id;	/* unique client identifier */
 
 	/* a connection object to the standby */
 	GTM_Conn				*standby;
@@ -16,10 +16,26 @@
 #define GTM_LOCK_H
 
 #include <pthread.h>
+#include "gtm/assert.h"
+#include "port/atomics.h"
 
+/*
+ * Reader-writer lock built on atomics. lk_state holds the writer bit and the
+ * number of readers, new readers wait while a writer is waiting so that they
+ * can't starve writers. Threads spin for a while before they sleep.
+ *
+ * The counters report how often the lock was acquired and how long threads
+ * had to wait for it. Locks given a name are reported by gtm_print_stats.
+ */
 typedef struct GTM_RWLock
 {
-	pthread_rwlock_t lk_lock;
+	pg_atomic_uint32	lk_state;
+	pg_atomic_uint32	lk_writers_waiting;
+	pg_atomic_uint32	lk_sleepers;
+	pg_atomic_uint64	lk_acquires;
+	pg_atomic_uint64	lk_waits;
+	pg_atomic_uint64	lk_wait_usecs;
+	const char		   *lk_name;
 } GTM_RWLock;
 
 typedef struct GTM_MutexLock
@@ -43,6 +59,8 @@ extern bool GTM_RWLockRelease(GTM_RWLock *lock);
 extern int GTM_RWLockInit(GTM_RWLock *lock);
 extern int GTM_RWLockDestroy(GTM_RWLock *lock);
 extern bool GTM_RWLockConditionalAcquire(GTM_RWLock *lock, GTM_LockMode mode);
+extern void GTM_RWLockSetName(GTM_RWLock *lock, const char *name);
+extern void GTM_RWLockReportStats(void);
 
 extern bool GTM_MutexLockAcquire(GTM_MutexLock *lock);
 extern bool GTM_MutexLockRelease(GTM_MutexLock *lock);
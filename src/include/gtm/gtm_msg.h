@@ -66,6 +66,8 @@ typedef enum GTM_MessageType
 	MSG_SNAPSHOT_GET,		/* Get a global snapshot */
 	MSG_SNAPSHOT_GET_MULTI,	/* Get multiple global snapshots */
 	MSG_SNAPSHOT_GXID_GET,	/* Get GXID and snapshot together */
+	MSG_SNAPSHOT_CSN_GET,	/* Get a commit sequence number snapshot */
+	MSG_CSNLOG_GET,			/* Get the GXIDs completed since a CSN */
 	MSG_SEQUENCE_INIT,		/* Initialize a new global sequence */
 	MSG_BKUP_SEQUENCE_INIT,	/* Backup of MSG_SEQUENCE_INIT */
 	MSG_SEQUENCE_GET_CURRENT,/* Get the current value of sequence */
@@ -92,6 +94,14 @@ typedef enum GTM_MessageType
 	MSG_BACKEND_DISCONNECT,			/* tell GTM that the backend diconnected from the proxy */
 	MSG_BARRIER,				/* Tell the barrier was issued */
 	MSG_BKUP_BARRIER,			/* Backup barrier to standby */
+	MSG_BKUP_STATE_LOG,			/* Replicate state log records to standby */
+	MSG_GET_STATS,				/* Get the latency statistics of messages */
+	MSG_TXN_LEASE_REPORT,		/* Report the GXIDs handed out by a proxy */
+	MSG_BKUP_TXN_LEASE_REPORT,	/* Backup of MSG_TXN_LEASE_REPORT */
+	MSG_SNAPSHOT_GET_READONLY,	/* Get a snapshot, from the standby if possible */
+	MSG_BKUP_SNAPSHOT,			/* Publish a snapshot to the standby */
+	MSG_GET_TIMESTAMP,			/* Get the current GTM timestamp */
+	MSG_GET_GLOBAL_XMIN,		/* Get the current global xmin */
 
 	/*
 	 * Must be at the end
@@ -131,6 +141,8 @@ typedef enum GTM_ResultType
 	SNAPSHOT_GET_RESULT,
 	SNAPSHOT_GET_MULTI_RESULT,
 	SNAPSHOT_GXID_GET_RESULT,
+	SNAPSHOT_CSN_GET_RESULT,
+	CSNLOG_GET_RESULT,
 	SEQUENCE_INIT_RESULT,
 	SEQUENCE_GET_CURRENT_RESULT,
 	SEQUENCE_GET_NEXT_RESULT,
@@ -145,9 +157,45 @@ typedef enum GTM_ResultType
 	TXN_GET_ALL_PREPARED_RESULT,
 	TXN_BEGIN_GETGXID_AUTOVACUUM_RESULT,
 	BARRIER_RESULT,
+	GET_STATS_RESULT,
+	SNAPSHOT_GET_STANDBY_RESULT,
+	GET_TIMESTAMP_RESULT,
+	GET_GLOBAL_XMIN_RESULT,
 	RESULT_TYPE_COUNT
 } GTM_ResultType;
 
+/*
+ * Latency statistics of a message type sent by a type of client, as returned
+ * by MSG_GET_STATS. The time to serve a message is split into the time it
+ * waited to be read, the time its processing waited for locks and the rest
+ * of the processing. The total time spent in each of them is counted, as
+ * well as the number of messages in buckets by time. The upper bounds of the
+ * buckets are 10, 30, 100, 300, 1000, 3000, 10000, 30000 and 100000 us, the
+ * last bucket counts the longer ones.
+ */
+typedef enum GTM_StatPhase
+{
+	GTM_STAT_QUEUE_WAIT,
+	GTM_STAT_LOCK_WAIT,
+	GTM_STAT_PROCESSING,
+	GTM_STAT_PHASE_COUNT
+} GTM_StatPhase;
+
+#define GTM_STAT_LATENCY_BUCKETS	10
+
+typedef struct GTM_MessageStats
+{
+	int32		ms_mtype;			/* GTM_MessageType */
+	int32		ms_client_type;		/* GTM_PGXCNodeType */
+	uint64		ms_count;
+	uint64		ms_usecs[GTM_STAT_PHASE_COUNT];
+	uint64		ms_latency[GTM_STAT_PHASE_COUNT][GTM_STAT_LATENCY_BUCKETS];
+} GTM_MessageStats;
+
+/* Client types are GTM_PGXCNodeType values, from 1 to GTM_NODE_DEFAULT */
+#define GTM_STAT_CLIENT_TYPES		7
+#define GTM_STATS_MAX_ENTRIES		(MSG_TYPE_COUNT * GTM_STAT_CLIENT_TYPES)
+
 /*
  * Special message header for the messgaes exchanged between the GTM server and
  * the proxy.
@@ -160,4 +208,18 @@ typedef struct GTM_ProxyMsgHeader
 	GTMProxy_ConnID	ph_conid;
 } GTM_ProxyMsgHeader;
 
+/* Limit of gxid_lease_size of a GTM proxy */
+#define GTM_PROXY_MAX_GXID_LEASE	1000
+
+/*
+ * Leased GXID handed out by a GTM proxy, as reported in MSG_TXN_LEASE_REPORT
+ */
+typedef struct GTM_LeaseAssignment
+{
+	GlobalTransactionId	la_gxid;
+	GTM_IsolationLevel	la_isolevel;
+	bool				la_readonly;
+	GTMProxy_ConnID		la_connid;
+} GTM_LeaseAssignment;
+
 #endif
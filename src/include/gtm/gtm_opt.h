@@ -336,6 +336,9 @@ const char *const config_type_names[] =\
 #define GTM_OPTNAME_CONNECT_RETRY_INTERVAL "gtm_connect_retry_interval"
 #define GTM_OPTNAME_GTM_HOST			"gtm_host"
 #define GTM_OPTNAME_GTM_PORT			"gtm_port"
+#define GTM_OPTNAME_GTM_STANDBY_HOST	"gtm_standby_host"
+#define GTM_OPTNAME_GTM_STANDBY_PORT	"gtm_standby_port"
+#define GTM_OPTNAME_GXID_LEASE_SIZE		"gxid_lease_size"
 #define GTM_OPTNAME_KEEPALIVES_IDLE		"keepalives_idle"
 #define GTM_OPTNAME_KEEPALIVES_INTERVAL	"keepalives_interval"
 #define GTM_OPTNAME_KEEPALIVES_COUNT	"keepalives_count"
@@ -344,9 +347,12 @@ const char *const config_type_names[] =\
 #define GTM_OPTNAME_LOG_MIN_MESSAGES	"log_min_messages"
 #define GTM_OPTNAME_NODENAME			"nodename"
 #define GTM_OPTNAME_PORT				"port"
+#define GTM_OPTNAME_SNAPSHOT_CACHE_MAX_AGE "snapshot_cache_max_age"
+#define GTM_OPTNAME_STANDBY_SNAPSHOT_INTERVAL "standby_snapshot_interval"
 #define GTM_OPTNAME_STARTUP				"startup"
 #define GTM_OPTNAME_STATUS_READER		"status_reader"
 #define GTM_OPTNAME_SYNCHRONOUS_BACKUP	"synchronous_backup"
+#define GTM_OPTNAME_TRACE_FILE			"trace_file"
 #define GTM_OPTNAME_WORKER_THREADS		"worker_threads"
 
 
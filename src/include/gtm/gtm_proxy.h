@@ -18,6 +18,9 @@
 #include <poll.h>
 
 #include "gtm/gtm_c.h"
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 #include "gtm/gtm_common.h"
 #include "gtm/palloc.h"
 #include "gtm/gtm_lock.h"
@@ -50,6 +53,10 @@ typedef struct GTMProxy_ConnectionInfo
 	GTM_MessageType			con_pending_msg;
 	GlobalTransactionId 		con_txid;
 	GTM_TransactionHandle		con_handle;
+
+	/* First snapshot received from GTM by the transaction of the client */
+	GlobalTransactionId		con_snapshot_gxid;
+	uint64					con_snapshot_seqno;
 } GTMProxy_ConnectionInfo;
 
 typedef struct GTMProxy_Connections
@@ -63,6 +70,12 @@ typedef struct GTMProxy_Connections
 #define ERRORDATA_STACK_SIZE  20
 #define GTM_PROXY_MAX_CONNECTIONS	1024
 
+/* How long the leased GXIDs are kept (ms) */
+#define GTM_PROXY_GXID_LEASE_TIMEOUT	100
+
+/* How long to wait before connecting again to a failed GTM standby (ms) */
+#define GTM_PROXY_STANDBY_RETRY_INTERVAL	1000
+
 typedef struct GTMProxy_ThreadInfo
 {
 	/*
@@ -78,32 +91,65 @@ typedef struct GTMProxy_ThreadInfo
 	GTMProxy_ConnectionInfo	*thr_conn;		/* Current set of connections from clients */
 	uint32					thr_conn_count;	/* number of connections served by this thread */
 
-	GTM_MutexLock			thr_lock;
-	GTM_CV					thr_cv;
-
 	/*
-	 * We use a sequence number to track the state of connection/fd array.
-	 * Whenever a new connection is added or an existing connection is deleted
-	 * from the connection array, the sequence number is incremented. The
-	 * thread main routine can then reconstruct the fd array again.
+	 * New connections handed over by the main thread. This is a ring the
+	 * main thread adds to at thr_newconn_head and the worker thread takes
+	 * from at thr_newconn_tail, without locking. A byte is written to the
+	 * wakeup pipe after each addition, in case the thread is waiting.
 	 */
-	int32					thr_seqno;
+	pg_atomic_uint32		thr_newconn_head;
+	pg_atomic_uint32		thr_newconn_tail;
+	GTMProxy_ConnectionInfo	*thr_newconns[GTM_PROXY_MAX_CONNECTIONS];
+	int						thr_wakeup_pipe[2];
 
-	/* connection array */
+	/* connection array, only accessed by the thread itself */
 	GTMProxy_ConnectionInfo	*thr_all_conns[GTM_PROXY_MAX_CONNECTIONS];
 	int						thr_conn_map[GTM_PROXY_MAX_CONNECTIONS];
-	struct pollfd			thr_poll_fds[GTM_PROXY_MAX_CONNECTIONS];
+
+	/* Connections with events in this round, and the events (POLLIN/POLLHUP) */
+	int						thr_ready_count;
+	int						thr_ready_conns[GTM_PROXY_MAX_CONNECTIONS];
+	short					thr_ready_events[GTM_PROXY_MAX_CONNECTIONS];
+
+#ifdef HAVE_SYS_EPOLL_H
+	int						thr_epoll_fd;
+	struct epoll_event		thr_epoll_events[GTM_PROXY_MAX_CONNECTIONS + 1];
+#else
+	/* The wakeup pipe first, then the connections in thr_conn_map order */
+	struct pollfd			thr_poll_fds[GTM_PROXY_MAX_CONNECTIONS + 1];
+#endif
 
 	/* Command backup */
 	short					thr_any_backup[GTM_PROXY_MAX_CONNECTIONS];
 	int						thr_qtype[GTM_PROXY_MAX_CONNECTIONS];
 	StringInfoData			thr_inBufData[GTM_PROXY_MAX_CONNECTIONS];
+	bool					thr_replay_backups;	/* look for backups to replay */
 
 	gtm_List 					*thr_processed_commands;
 	gtm_List 					*thr_pending_commands[MSG_TYPE_COUNT];
 
 	GTM_Conn				*thr_gtm_conn;		/* Connection to GTM */
 
+	/*
+	 * GXIDs obtained from GTM in advance, given out to the next
+	 * MSG_TXN_BEGIN_GETGXID requests without asking GTM. The ones given out
+	 * are reported to GTM with the next MSG_TXN_LEASE_REPORT.
+	 */
+	GlobalTransactionId		thr_lease_next;
+	int						thr_lease_count;
+	GTM_Timestamp			thr_lease_timestamp;	/* GTM time of the lease */
+	uint64					thr_lease_received;		/* local time, in us */
+	int						thr_lease_assign_count;
+	GTM_LeaseAssignment		thr_lease_assigned[GTM_PROXY_MAX_GXID_LEASE];
+
+	/*
+	 * Connection to the GTM standby serving the snapshots of read-only
+	 * transactions, made when first needed. After a failure it is not tried
+	 * again before thr_standby_retry, local time in us.
+	 */
+	GTM_Conn				*thr_standby_conn;
+	uint64					thr_standby_retry;
+
 	/* Reconnect Info */
 	int						can_accept_SIGUSR2;
 	int						reconnect_issued;
@@ -131,6 +177,9 @@ void GTMProxy_ThreadExit(void);
 extern GTMProxy_ThreadInfo *GTMProxy_ThreadCreate(void *(* startroutine)(void *), int idx);
 extern GTMProxy_ThreadInfo * GTMProxy_GetThreadInfo(GTM_ThreadID thrid);
 extern GTMProxy_ThreadInfo *GTMProxy_ThreadAddConnection(GTMProxy_ConnectionInfo *conninfo);
+extern int GTMProxy_ThreadTakeConnections(GTMProxy_ThreadInfo *thrinfo);
+extern int GTMProxy_ThreadWait(GTMProxy_ThreadInfo *thrinfo, int timeout_ms);
+extern void ConnFree(Port *conn);
 extern int GTMProxy_ThreadRemoveConnection(GTMProxy_ThreadInfo *thrinfo,
 		GTMProxy_ConnectionInfo *conninfo);
 
@@ -144,6 +193,7 @@ typedef union GTMProxy_CommandData
 	{
 		bool			rdonly;
 		GTM_IsolationLevel	iso_level;
+		int				lease_count;	/* GXIDs requested for the lease */
 	} cd_beg;
 
 	struct
@@ -154,6 +204,14 @@ typedef union GTMProxy_CommandData
 	struct
 	{
 		GlobalTransactionId	gxid;
+		GlobalTransactionId	prepared_gxid;
+	} cd_cp;
+
+	struct
+	{
+		GlobalTransactionId	gxid;
+		uint64				seqno;		/* set when sent to GTM */
+		uint64				requested;
 	} cd_snap;
 
 	struct
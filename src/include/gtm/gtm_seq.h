@@ -47,7 +47,7 @@ typedef struct GTM_SeqInfo
 	bool			gs_cycle;
 	bool			gs_called;
 
-	int32			gs_ref_count;
+	pg_atomic_uint32 gs_ref_count;	/* changed under the bucket lock */
 	int32			gs_state;
 	GTM_RWLock		gs_lock;
 } GTM_SeqInfo;
@@ -107,6 +107,8 @@ void ProcessSequenceListCommand(Port *myport, StringInfo message);
 
 void GTM_SaveSeqInfo(FILE *ctlf);
 void GTM_RestoreSeqInfo(FILE *ctlf);
+void GTM_ApplyStateLog(FILE *f);
+void GTM_SeqPromoteRestorePoints(void);
 int GTM_SeqRestore(GTM_SequenceKey seqkey,
 			   GTM_Sequence increment_by,
 			   GTM_Sequence minval,
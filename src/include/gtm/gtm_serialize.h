@@ -21,11 +21,19 @@
 #include "gtm/gtm_txn.h"
 #include "gtm/register.h"
 #include "gtm/gtm_seq.h"
+#include "gtm/stringinfo.h"
 
 size_t gtm_get_snapshotdata_size(GTM_SnapshotData *);
 size_t gtm_serialize_snapshotdata(GTM_SnapshotData *, char *, size_t);
 size_t gtm_deserialize_snapshotdata(GTM_SnapshotData *, const char *, size_t);
 
+/* Version of the wire format of the snapshots sent to the clients */
+#define GTM_SNAPSHOT_WIRE_VERSION	1
+
+size_t gtm_get_snapshot_wire_size(GTM_SnapshotData *);
+size_t gtm_serialize_snapshot_wire(GTM_SnapshotData *, char *, size_t);
+size_t gtm_deserialize_snapshot_wire(GTM_SnapshotData *, uint32, const char *, size_t);
+
 size_t gtm_get_transactioninfo_size(GTM_TransactionInfo *);
 size_t gtm_serialize_transactioninfo(GTM_TransactionInfo *, char *, size_t);
 size_t gtm_deserialize_transactioninfo(GTM_TransactionInfo *, const char *, size_t);
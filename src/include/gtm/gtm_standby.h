@@ -42,6 +42,8 @@ GTM_Conn *gtm_standby_connect_to_standby(void);
 void gtm_standby_disconnect_from_standby(GTM_Conn *conn);
 GTM_Conn *gtm_standby_reconnect_to_standby(GTM_Conn *old_conn, int retry_max);
 bool gtm_standby_check_communication_error(int *retry_count, GTM_Conn *oldconn);
+void gtm_standby_flush(GTM_Conn *conn);
+void gtm_standby_replicate_state_log(const char *data, int len);
 
 GTM_PGXCNodeInfo *find_standby_node_info(void);
 
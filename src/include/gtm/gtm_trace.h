@@ -0,0 +1,61 @@
+/*-------------------------------------------------------------------------
+ *
+ * gtm_trace.h
+ *	  Binary trace of the requests served by GTM or GTM proxy
+ *
+ * A trace file starts with a GTM_TraceFileHeader, followed by one
+ * GTM_TraceRecord for each request, each followed by the tr_len bytes of
+ * the request as received, message type included. Everything is written in
+ * the byte order of the server; gtm_replay reads the file back on the same
+ * platform.
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * src/include/gtm/gtm_trace.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef GTM_TRACE_H
+#define GTM_TRACE_H
+
+#include "gtm/gtm_c.h"
+
+#define GTM_TRACE_MAGIC		0x47544d54	/* "GTMT" */
+#define GTM_TRACE_VERSION	1
+
+typedef struct GTM_TraceFileHeader
+{
+	uint32		th_magic;
+	uint32		th_version;
+	uint64		th_start;		/* start of the trace, usecs since epoch */
+	uint32		th_proxy;		/* 1 if written by a GTM proxy */
+	uint32		th_pad;
+} GTM_TraceFileHeader;
+
+/* tr_flags */
+#define GTM_TRACE_PROXY_HEADER	0x01	/* request starts with a proxy header */
+#define GTM_TRACE_REPLY_KNOWN	0x02	/* tr_reply_len was measured */
+
+typedef struct GTM_TraceRecord
+{
+	uint64		tr_time;		/* receipt, usecs since the trace started */
+	uint32		tr_elapsed;		/* usecs from receipt to reply */
+	uint32		tr_client;		/* client connection identifier */
+	uint32		tr_conid;		/* proxy connection ID, if any */
+	int32		tr_mtype;		/* GTM_MessageType of the request */
+	int32		tr_remote_type;	/* GTM_PGXCNodeType of the client */
+	uint32		tr_flags;
+	uint32		tr_len;			/* bytes of the request that follow */
+	uint32		tr_reply_len;	/* bytes of the reply */
+} GTM_TraceRecord;
+
+extern bool GTM_TraceOpen(const char *filename, bool proxy);
+extern void GTM_TraceClose(void);
+extern uint64 GTM_TraceNow(void);
+extern void GTM_TraceRequest(GTM_TraceRecord *record, uint64 received,
+				 const char *data);
+
+/* Cheap test done for every request before building its record */
+extern bool GTM_TraceEnabled;
+
+#endif   /* GTM_TRACE_H */
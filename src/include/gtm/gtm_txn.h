@@ -86,7 +86,10 @@ extern void GTM_SetShuttingDown(void);
 
 /* For restoration point backup */
 extern bool GTM_NeedXidRestoreUpdate(void);
+extern void GTM_LogRestorePointXid(void);
 extern void GTM_WriteRestorePointXid(FILE *f);
+extern void GTM_ApplyRestorePointXid(GlobalTransactionId gxid);
+extern void GTM_PromoteRestorePointXid(void);
 
 typedef enum GTM_States
 {
@@ -128,6 +131,9 @@ typedef struct GTM_TransactionInfo
 
 	GTM_RWLock				gti_lock;
 	bool					gti_vacuum;
+
+	int32					gti_open_index;	/* position in gt_open_handles,
+											 * -1 if not open */
 } GTM_TransactionInfo;
 
 #define GTM_MAX_2PC_NODES				16
@@ -164,9 +170,22 @@ typedef struct GTM_Transactions
 
 	GlobalTransactionId	gt_recent_global_xmin;
 
+	/*
+	 * Bumped whenever transactions complete, so snapshots taken with the same
+	 * generation are identical and can be reused.
+	 */
+	uint64				gt_snapshot_generation;
+
 	int32				gt_lastslot;
 	GTM_TransactionInfo	gt_transactions_array[GTM_MAX_GLOBAL_TRANSACTIONS];
-	gtm_List			*gt_open_transactions;
+
+	/*
+	 * Handles of the open transactions, densely packed so they are scanned
+	 * without chasing list cells. A transaction is removed by moving the last
+	 * handle into its position.
+	 */
+	int32				gt_open_count;
+	GTM_TransactionHandle gt_open_handles[GTM_MAX_GLOBAL_TRANSACTIONS];
 
 	GTM_RWLock			gt_TransArrayLock;
 } GTM_Transactions;
@@ -174,7 +193,11 @@ typedef struct GTM_Transactions
 extern GTM_Transactions	GTMTransactions;
 
 /* NOTE: This macro should be used with READ lock held on gt_TransArrayLock! */
-#define GTM_CountOpenTransactions()	(gtm_list_length(GTMTransactions.gt_open_transactions))
+#define GTM_CountOpenTransactions()	(GTMTransactions.gt_open_count)
+
+/* NOTE: This macro should be used with lock held on gt_TransArrayLock! */
+#define GTM_OpenTransaction(n) \
+	(&GTMTransactions.gt_transactions_array[GTMTransactions.gt_open_handles[(n)]])
 
 /*
  * Two hash tables will be maintained to quickly find the
@@ -219,6 +242,7 @@ GTM_TransactionStates GTM_GetStatus(GTM_TransactionHandle txn);
 GTM_TransactionStates GTM_GetStatusGXID(GlobalTransactionId gxid);
 int GTM_GetAllTransactions(GTM_TransactionInfo txninfo[], uint32 txncnt);
 void GTM_RemoveAllTransInfos(uint32 client_id, int backend_id);
+void GTM_AddOpenTransaction(GTM_TransactionInfo *gtm_txninfo);
 uint32 GTMGetLastClientIdentifier(void);
 
 GTM_Snapshot GTM_GetSnapshotData(GTM_TransactionInfo *my_txninfo,
@@ -253,12 +277,19 @@ void ProcessBkupBeginTransactionGetGXIDAutovacuumCommand(Port *myport, StringInf
 void ProcessBeginTransactionGetGXIDCommandMulti(Port *myport, StringInfo message);
 void ProcessCommitTransactionCommandMulti(Port *myport, StringInfo message, bool is_backup);
 void ProcessRollbackTransactionCommandMulti(Port *myport, StringInfo message, bool is_backup) ;
+void ProcessLeaseReportCommand(Port *myport, StringInfo message, bool is_backup);
 
 void GTM_SaveTxnInfo(FILE *ctlf);
 void GTM_RestoreTxnInfo(FILE *ctlf, GlobalTransactionId next_gxid);
+void GTM_RestoreTxnRestorePoint(GlobalTransactionId gxid);
 void GTM_BkupBeginTransaction(GTM_IsolationLevel isolevel,
 							  bool readonly,
 							  uint32 client_id);
+GlobalTransactionId GTM_BeginTransactionGetGXID(Port *myport,
+							  GTM_IsolationLevel txn_isolation_level,
+							  bool txn_read_only,
+							  GTM_TransactionHandle *txn,
+							  GTM_Timestamp *timestamp);
 void ProcessBkupBeginTransactionGetGXIDCommand(Port *myport, StringInfo message);
 void ProcessBkupBeginTransactionGetGXIDCommandMulti(Port *myport, StringInfo message);
 
@@ -268,5 +299,15 @@ void ProcessBkupBeginTransactionGetGXIDCommandMulti(Port *myport, StringInfo mes
  */
 void ProcessGetSnapshotCommand(Port *myport, StringInfo message, bool get_gxid);
 void ProcessGetSnapshotCommandMulti(Port *myport, StringInfo message);
+void ProcessGetSnapshotCommandReadOnly(Port *myport, StringInfo message);
+void ProcessBkupSnapshotCommand(Port *myport, StringInfo message);
+void ProcessGetCSNSnapshotCommand(Port *myport, StringInfo message);
+void ProcessGetCSNLogCommand(Port *myport, StringInfo message);
+void ProcessGetGlobalXminCommand(Port *myport, StringInfo message);
 void GTM_FreeSnapshotData(GTM_Snapshot snapshot);
+void GTM_InitSnapshotCache(void);
+void GTM_InitCSNSnapshots(void);
+void GTM_CSNLogCompleted(GlobalTransactionId gxid);
+void GTM_PublishCSNSnapshot(void);
+void GTM_GetCSNSnapshot(GTM_TransactionInfo *txninfo, GTM_CSNSnapshot snapshot);
 #endif
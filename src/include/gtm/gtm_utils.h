@@ -16,9 +16,11 @@
 
 #include "gtm/libpq-int.h"
 #include "gtm/gtm_msg.h"
+#include "gtm/stringinfo.h"
 
 void gtm_util_init_nametabs(void);
 char *gtm_util_message_name(GTM_MessageType type);
 char *gtm_util_result_name(GTM_ResultType type);
+void gtm_send_snapshot_wire(StringInfo buf, GTM_SnapshotData *data);
 
 #endif /* GTM_UTILS_H */
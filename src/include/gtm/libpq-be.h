@@ -57,6 +57,7 @@ typedef struct Port
 
 	char		PqSendBuffer[PQ_BUFFER_SIZE];
 	int			PqSendPointer;		/* Next index to store a byte in PqSendBuffer */
+	uint64		PqSentBytes;		/* Bytes sent so far, for the trace */
 
 	char 		PqRecvBuffer[PQ_BUFFER_SIZE];
 	int			PqRecvPointer;		/* Next index to read a byte from PqRecvBuffer */
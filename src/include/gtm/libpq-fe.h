@@ -130,6 +130,13 @@ extern void GTMPQuntrace(GTM_Conn *conn);
 /* Force the write buffer to be written (or at least try) */
 extern int	PQflush(GTM_Conn *conn);
 
+/* Can the reply to the oldest request be received without blocking? */
+extern int	GTMPQisBusy(GTM_Conn *conn);
+
+/* Called with 1 before and 0 after blocking on the socket, if set */
+typedef void (*GTMPQwaitHook) (int waiting);
+extern GTMPQwaitHook GTMPQwait_hook;
+
 #define libpq_gettext(x)	x
 
 #ifdef __cplusplus
@@ -79,6 +79,8 @@ struct gtm_conn
 	char	*outBuffer;		/* currently allocated buffer */
 	int		outBufSize;		/* allocated size of buffer */
 	int		outCount;		/* number of chars waiting in buffer */
+	bool	deferFlush;		/* gtmpqFlush leaves the buffer alone, see
+							 * gtmpqFlushDeferred */
 
 	/* State for constructing messages in outBuffer */
 	int		outMsgStart;	/* offset to msg start (length word); if -1,
@@ -117,6 +119,7 @@ extern int	gtmpqPutMsgStart(char msg_type, bool force_len, GTM_Conn *conn);
 extern int	gtmpqPutMsgEnd(GTM_Conn *conn);
 extern int	gtmpqReadData(GTM_Conn *conn);
 extern int	gtmpqFlush(GTM_Conn *conn);
+extern int	gtmpqFlushDeferred(GTM_Conn *conn);
 extern int	gtmpqWait(int forRead, int forWrite, GTM_Conn *conn);
 extern int	gtmpqWaitTimed(int forRead, int forWrite, GTM_Conn *conn,
 			time_t finish_time);
@@ -127,6 +130,7 @@ extern int	gtmpqWriteReady(GTM_Conn *conn);
  * In fe-protocol.c
  */
 GTM_Result * GTMPQgetResult(GTM_Conn *conn);
+extern bool gtmpqResultBuffered(GTM_Conn *conn);
 extern int gtmpqGetError(GTM_Conn *conn, GTM_Result *result);
 void gtmpqFreeResultData(GTM_Result *result, GTM_PGXCNodeType remote_type);
 
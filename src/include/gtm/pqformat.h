@@ -17,6 +17,7 @@
 #include "gtm/stringinfo.h"
 
 extern void pq_beginmessage(StringInfo buf, char msgtype);
+extern void pq_beginmessage_reuse(StringInfo buf, char msgtype);
 extern void pq_sendbyte(StringInfo buf, int byt);
 extern void pq_sendbytes(StringInfo buf, const char *data, int datalen);
 extern void pq_sendcountedtext(StringInfo buf, const char *str, int slen,
@@ -29,6 +30,7 @@ extern void pq_sendint64(StringInfo buf, int64 i);
 extern void pq_sendfloat4(StringInfo buf, float4 f);
 extern void pq_sendfloat8(StringInfo buf, float8 f);
 extern void pq_endmessage(Port *myport, StringInfo buf);
+extern void pq_endmessage_reuse(Port *myport, StringInfo buf);
 
 extern void pq_puttextmessage(Port *myport, char msgtype, const char *str);
 extern void pq_putemptymessage(Port *myport, char msgtype);
@@ -0,0 +1,52 @@
+/*-------------------------------------------------------------------------
+ *
+ * jit.h
+ *	  Interface to the loadable provider compiling expressions and tuple
+ *	  deforming code at execution time
+ *
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ * src/include/jit/jit.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef JIT_H
+#define JIT_H
+
+#include "nodes/execnodes.h"
+
+/*
+ * State of the provider for one execution of a plan. Providers extend it
+ * with the code compiled for that execution, and free it all when the
+ * context is released.
+ */
+typedef struct JitContext
+{
+	EState	   *estate;			/* execution being compiled for */
+	int			ncompiled;		/* number of functions compiled */
+} JitContext;
+
+typedef struct JitProviderCallbacks
+{
+	/* Make a context, in the current memory context */
+	JitContext *(*create_context) (EState *estate);
+	/* Compile whatever is worth it in a newly initialized plan node */
+	void		(*compile_planstate) (JitContext *context, PlanState *planstate);
+	/* Free the compiled code, at the end of the execution */
+	void		(*release_context) (JitContext *context);
+} JitProviderCallbacks;
+
+/* The provider library exports a function of that name and type */
+#define JIT_PROVIDER_INIT_FUNCTION "_PG_jit_provider_init"
+typedef void (*JitProviderInit) (JitProviderCallbacks *callbacks);
+
+/* GUC parameters */
+extern char *jit_provider;
+extern double jit_above_cost;
+
+extern void jit_start_execution(EState *estate, PlannedStmt *plannedstmt,
+					int eflags);
+extern void jit_compile_planstate(EState *estate, PlanState *planstate);
+
+#endif   /* JIT_H */
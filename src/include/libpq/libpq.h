@@ -70,6 +70,18 @@ extern int	pq_getbyte(void);
 extern int	pq_peekbyte(void);
 extern int	pq_getbyte_if_available(unsigned char *c);
 extern int	pq_putbytes(const char *s, size_t len);
+#ifdef XCP
+/*
+ * Batch of protocol messages compressed with pglz, which Postgres-XL nodes
+ * may send to each other: message type, length word, length of the raw
+ * messages, compressed data
+ */
+#define PQ_PACKED_MSG_TYPE		'Y'
+#define PQ_PACKED_HDR_SIZE		9
+
+extern void pq_setcompression(int threshold);
+extern int	pq_inflatemessage(StringInfo s);
+#endif
 
 /*
  * prototypes for functions in be-secure.c
@@ -22,6 +22,7 @@
 #include "access/genam.h"
 #include "access/heapam.h"
 #include "executor/instrument.h"
+#include "lib/ilist.h"
 #include "lib/pairingheap.h"
 #include "nodes/params.h"
 #include "nodes/plannodes.h"
@@ -430,6 +431,8 @@ typedef struct EState
 	HeapTuple  *es_epqTuple;	/* array of EPQ substitute tuples */
 	bool	   *es_epqTupleSet; /* true if EPQ tuple is provided */
 	bool	   *es_epqScanDone; /* true if EPQ tuple has been fetched */
+
+	struct JitContext *es_jit;	/* compiled code, or NULL if interpreted */
 } EState;
 
 
@@ -1157,6 +1160,10 @@ typedef struct ModifyTableState
  *
  *		nplans			how many plans are in the array
  *		whichplan		which plan is being executed (0 .. n-1)
+ *		async			inputs are remote subplans read as rows arrive
+ *		started			async inputs were sent to the nodes
+ *		finished		async inputs which returned all their rows
+ *		waitconns		connections the async inputs are waiting on
  * ----------------
  */
 typedef struct AppendState
@@ -1165,6 +1172,12 @@ typedef struct AppendState
 	PlanState **appendplans;	/* array of PlanStates for my inputs */
 	int			as_nplans;
 	int			as_whichplan;
+#ifdef XCP
+	bool		as_async;
+	bool		as_started;
+	bool	   *as_finished;
+	struct pgxc_node_handle **as_waitconns;
+#endif
 } AppendState;
 
 /* ----------------
@@ -1255,6 +1268,8 @@ typedef struct BitmapOrState
  *		currentRelation    relation being scanned (NULL if none)
  *		currentScanDesc    current scan descriptor for scan (NULL if none)
  *		ScanTupleSlot	   pointer to slot in tuple table holding scan tuple
+ *		JoinFilter		   filter of the keys of the hash join above, the
+ *						   scan tuples must pass it (NULL if none)
  * ----------------
  */
 typedef struct ScanState
@@ -1263,13 +1278,32 @@ typedef struct ScanState
 	Relation	ss_currentRelation;
 	HeapScanDesc ss_currentScanDesc;
 	TupleTableSlot *ss_ScanTupleSlot;
+#ifdef XCP
+	struct JoinFilter *ss_JoinFilter;
+#endif
 } ScanState;
 
-/*
- * SeqScan uses a bare ScanState as its state node, since it needs
- * no additional fields.
+/* ----------------
+ *	 SeqScanState information
+ *
+ *		batchqual		quals evaluated a page of tuples at a time, or NULL
+ *		residualqual	the other quals, evaluated per tuple, if batchqual
+ *		batch			tuples of the current page
+ *		batchsel		positions of the batch tuples passing batchqual
+ *		batchnsel		number of them
+ *		batchnext		next one to return
+ * ----------------
  */
-typedef ScanState SeqScanState;
+typedef struct SeqScanState
+{
+	ScanState	ss;				/* its first field is NodeTag */
+	struct BatchQual *batchqual;
+	List	   *residualqual;
+	HeapTupleData *batch;
+	uint16	   *batchsel;
+	int			batchnsel;
+	int			batchnext;
+} SeqScanState;
 
 /*
  * SampleScan
@@ -1737,6 +1771,12 @@ typedef struct MergeJoinState
  *		hj_JoinState			current state of ExecHashJoin state machine
  *		hj_MatchedOuter			true if found a join match for current outer
  *		hj_OuterNotEmpty		true if outer relation known not empty
+ *		hj_JoinFilter			filter of the inner keys, or NULL
+ *		hj_FilterRemote			true if the filter is sent to the remote
+ *								outer subplan
+ *		hj_FilterScan			outer scan node applying the filter, or NULL
+ *		hj_FilterProbe			true if the outer tuples are tested against
+ *								the filter before probing the hash table
  * ----------------
  */
 
@@ -1764,6 +1804,12 @@ typedef struct HashJoinState
 	int			hj_JoinState;
 	bool		hj_MatchedOuter;
 	bool		hj_OuterNotEmpty;
+#ifdef XCP
+	struct JoinFilter *hj_JoinFilter;
+	bool		hj_FilterRemote;
+	struct ScanState *hj_FilterScan;
+	bool		hj_FilterProbe;
+#endif
 } HashJoinState;
 
 
@@ -1791,6 +1837,10 @@ typedef struct MaterialState
 
 /* ----------------
  *	 SortState information
+ *
+ *		An incremental sort keeps the state of the batch being returned
+ *		in tuplesortstate, and the first tuple of the next batch in
+ *		pivotSlot.
  * ----------------
  */
 typedef struct SortState
@@ -1803,6 +1853,16 @@ typedef struct SortState
 	bool		bounded_Done;	/* value of bounded we did the sort with */
 	int64		bound_Done;		/* value of bound we did the sort with */
 	void	   *tuplesortstate; /* private state of tuplesort.c */
+	int			presorted;		/* presorted columns, 0 if not incremental */
+	FmgrInfo   *presortedEq;	/* equality fns of the presorted columns */
+	TupleTableSlot *pivotSlot;	/* tuple ending or following the batch */
+	bool		pivotPending;	/* pivotSlot starts the next batch? */
+	bool		outerDone;		/* outer plan exhausted? */
+	int64		returned;		/* tuples returned since the last rescan */
+	long		incr_batches;	/* number of batches sorted */
+	const char *incr_method;	/* stats of the biggest batch, for EXPLAIN */
+	const char *incr_spaceType;
+	long		incr_spaceUsed;
 } SortState;
 
 /* ---------------------
@@ -1832,6 +1892,8 @@ typedef struct GroupState
 typedef struct AggStatePerAggData *AggStatePerAgg;
 typedef struct AggStatePerGroupData *AggStatePerGroup;
 typedef struct AggStatePerPhaseData *AggStatePerPhase;
+typedef struct AggHashSpillData *AggHashSpill;
+typedef struct AggHashBatchData *AggHashBatch;
 
 typedef struct AggState
 {
@@ -1868,6 +1930,15 @@ typedef struct AggState
 	List	   *hash_needed;	/* list of columns needed in hash table */
 	bool		table_filled;	/* hash table filled yet? */
 	TupleHashIterator hashiter; /* for iterating through hash table */
+	/* these fields are used when AGG_HASHED runs out of memory: */
+	Size		hash_mem_limit; /* memory the hash table may use */
+	Size		hash_mem_peak;	/* most memory it used, for EXPLAIN */
+	bool		hash_spill_mode;	/* new groups go to the spill files? */
+	AggHashSpill hash_spill;	/* spill files of the current batch */
+	AggHashBatch hash_batch;	/* spilled batch being aggregated */
+	List	   *hash_batches;	/* spilled batches still to aggregate */
+	int			hash_nbatches;	/* batches aggregated so far */
+	TupleTableSlot *hash_spill_slot;	/* slot for spilled tuples */
 } AggState;
 
 /* ----------------
@@ -1963,6 +2034,9 @@ typedef struct HashState
 	HashJoinTable hashtable;	/* hash table for the hashjoin */
 	List	   *hashkeys;		/* list of ExprState nodes */
 	/* hashkeys is same as parent's hj_InnerHashKeys */
+#ifdef XCP
+	struct JoinFilter *joinfilter;	/* filter to add the inner keys to */
+#endif
 } HashState;
 
 /* ----------------
@@ -2046,4 +2120,74 @@ typedef struct LimitState
 	TupleTableSlot *subSlot;	/* tuple last obtained from subplan */
 } LimitState;
 
+/* ----------------
+ *	 GatherState information
+ *
+ *		The workers are launched on the first call, their rows are read
+ *		from a queue per worker. The current process runs the subplan as
+ *		well when no worker has a row ready.
+ * ----------------
+ */
+typedef struct GatherState
+{
+	PlanState	ps;				/* its first field is NodeTag */
+	bool		initialized;	/* are the workers launched? */
+	struct ParallelContext *pcxt;
+	int			nreaders;		/* number of queues still attached */
+	int			nextreader;		/* queue to read next */
+	struct shm_mq_handle **reader;	/* queues of the workers */
+	bool		need_to_scan_locally;	/* subplan of this process not done */
+} GatherState;
+
+/* ----------------
+ *	 ResultCacheState information
+ *
+ *		The cache is a hash table of entries, one per key, each holding the
+ *		rows the subplan returned for it. The entries are also kept in a
+ *		list from the least to the most recently used, which is where
+ *		entries are evicted from when the cache outgrows work_mem.
+ * ----------------
+ */
+typedef enum
+{
+	RC_LOOKUP,					/* look up the key of the next rescan */
+	RC_FETCH,					/* return the rows of a cached entry */
+	RC_FILLING,					/* run the subplan, saving its rows */
+	RC_BYPASS,					/* run the subplan, not saving its rows */
+	RC_END						/* all rows returned */
+} ResultCacheStatus;
+
+struct ResultCacheEntry;
+
+typedef struct ResultCacheState
+{
+	PlanState	ps;				/* its first field is NodeTag */
+	ResultCacheStatus status;	/* state machine status, as above */
+	int			nkeys;			/* number of Params in the key */
+	List	   *param_exprs;	/* ExprStates computing the key */
+	Bitmapset  *keyparams;		/* paramids of the key */
+	FmgrInfo   *hashfunctions;	/* hash function of each key column */
+	FmgrInfo   *eqfunctions;	/* equality function of each key column */
+	Oid		   *keycollations;	/* collation of each key column */
+	bool	   *keybyval;		/* typbyval of each key column */
+	int16	   *keylen;			/* typlen of each key column */
+	Datum	   *keyvalues;		/* key of the current rescan */
+	bool	   *keynulls;
+	struct ResultCacheEntry **buckets;	/* the hash table */
+	int			nbuckets;
+	int			nentries;
+	dlist_head	lru;			/* entries, least recently used first */
+	struct ResultCacheEntry *entry;		/* entry being read or filled */
+	struct ResultCacheTuple *next;		/* next row of it to return */
+	Size		mem_used;		/* memory taken by the entries */
+	Size		mem_limit;		/* memory they may take */
+	MemoryContext cachecontext; /* holds the entries */
+	bool		subplan_used;	/* subplan run since its last rescan? */
+	long		hits;			/* instrumentation */
+	long		misses;
+	long		evictions;
+	long		overflows;
+	Size		mem_peak;
+} ResultCacheState;
+
 #endif   /* EXECNODES_H */
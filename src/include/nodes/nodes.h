@@ -84,6 +84,8 @@ typedef enum NodeTag
 	T_SetOp,
 	T_LockRows,
 	T_Limit,
+	T_Gather,
+	T_ResultCache,
 #ifdef PGXC
 	/*
 	 * TAGS FOR PGXC NODES
@@ -152,6 +154,8 @@ typedef enum NodeTag
 	T_SetOpState,
 	T_LockRowsState,
 	T_LimitState,
+	T_GatherState,
+	T_ResultCacheState,
 #ifdef PGXC
 	T_RemoteQueryState,
 #ifdef XCP
@@ -275,6 +279,7 @@ typedef enum NodeTag
 	T_ResultPath,
 	T_MaterialPath,
 	T_UniquePath,
+	T_ResultCachePath,
 	T_EquivalenceClass,
 	T_EquivalenceMember,
 	T_PathKey,
@@ -294,6 +299,8 @@ typedef enum NodeTag
 	 */
 	T_MemoryContext = 600,
 	T_AllocSetContext,
+	T_SlabContext,
+	T_BumpContext,
 
 	/*
 	 * TAGS FOR VALUE NODES (value.h)
@@ -484,6 +491,8 @@ typedef enum NodeTag
 	T_DropReplicationSlotCmd,
 	T_StartReplicationCmd,
 	T_TimeLineHistoryCmd,
+	T_SendFilesCmd,
+	T_StopBackupCmd,
 
 	/*
 	 * TAGS FOR RANDOM OTHER STUFF
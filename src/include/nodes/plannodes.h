@@ -86,6 +86,16 @@ typedef struct PlannedStmt
 	AttrNumber  distributionKey;
 	List	   *distributionNodes;
 	List	   *distributionRestrict;
+	List	   *distributionBuckets;
+	List	   *distributionRanges;
+	/* Switch from replicated distribution after adaptiveRows rows */
+	char		adaptiveType;
+	AttrNumber	adaptiveKey;
+	int			adaptiveRows;
+	/* work_mem of the fragment, 0 for the default */
+	int			workMem;
+	/* instrumentation requested by the Coordinator running EXPLAIN ANALYZE */
+	int			instrumentOptions;
 #endif	
 
 	bool		hasRowSecurity; /* row security applied? */
@@ -673,6 +683,10 @@ typedef struct Material
 
 /* ----------------
  *		sort node
+ *
+ * If numPresorted is not zero, the input is already sorted by that many
+ * leading sort columns, and the sort is incremental: it only sorts the
+ * groups of tuples equal on those columns.
  * ----------------
  */
 typedef struct Sort
@@ -683,6 +697,7 @@ typedef struct Sort
 	Oid		   *sortOperators;	/* OIDs of operators to sort them by */
 	Oid		   *collations;		/* OIDs of collations */
 	bool	   *nullsFirst;		/* NULLS FIRST/LAST directions */
+	int			numPresorted;	/* number of presorted leading columns */
 } Sort;
 
 /* ---------------
@@ -858,6 +873,38 @@ typedef struct Limit
 	Node	   *limitCount;		/* COUNT parameter, or NULL if none */
 } Limit;
 
+/* ----------------
+ *		gather node
+ *
+ * Runs its subplan in num_workers parallel workers besides the current
+ * process and returns the rows of all of them, in no particular order.  The
+ * first sequential scan down the outer side of the subplan is shared, each
+ * page being scanned by one of the processes.  The node is not made by the
+ * planner, see ExecParallelFragment.
+ * ----------------
+ */
+typedef struct Gather
+{
+	Plan		plan;
+	int			num_workers;
+} Gather;
+
+/* ----------------
+ *		result cache node
+ *
+ * Sits between a nested loop and its parameterized inner side, and keeps
+ * the rows the inner side returned for recent values of the parameters, so
+ * that a repeated outer key is answered without running the subplan again.
+ * param_exprs are the PARAM_EXEC Params set by the nested loop which make
+ * up the key of the cache.
+ * ----------------
+ */
+typedef struct ResultCache
+{
+	Plan		plan;
+	List	   *param_exprs;	/* Params making up the cache key */
+} ResultCache;
+
 
 /*
  * RowMarkType -
@@ -1386,7 +1386,10 @@ typedef enum DistributionType
 	DISTTYPE_REPLICATION,			/* Replicated */
 	DISTTYPE_HASH,				/* Hash partitioned */
 	DISTTYPE_ROUNDROBIN,			/* Round Robin */
-	DISTTYPE_MODULO				/* Modulo partitioned */
+	DISTTYPE_MODULO,			/* Modulo partitioned */
+	DISTTYPE_BUCKET,			/* Hash partitioned into buckets mapped
+								 * to nodes */
+	DISTTYPE_RANGE				/* Partitioned into ranges of values */
 } DistributionType;
 
 /*----------
@@ -1399,6 +1402,10 @@ typedef struct DistributeBy
 	NodeTag		type;
 	DistributionType disttype;		/* Distribution type */
 	char	   	*colname;		/* Distribution column name */
+	List		*colnames;		/* All the column names of a multi-column
+								 * hash distribution, as String values */
+	List		*rangevalues;	/* Split points of a range distribution, as
+								 * String values */
 } DistributeBy;
 
 /*----------
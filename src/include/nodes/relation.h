@@ -41,6 +41,9 @@ typedef struct Distribution
 	Node	   *distributionExpr;
 	Bitmapset  *nodes;
 	Bitmapset  *restrictNodes;
+	List	   *buckets;		/* node number of each bucket, BUCKET only,
+								 * of each range, RANGE only */
+	List	   *ranges;			/* split points as strings, RANGE only */
 } Distribution;
 #endif
 
@@ -295,6 +298,8 @@ typedef struct PlannerInfo
 	 */
 	Distribution *distribution; /* Query result distribution */
 	bool		recursiveOk;
+	/* nodes restricted by distribution key values, see pathnode.c */
+	List	   *distribution_value_nodes;
 #endif
 
 	/* for GroupingFunc fixup in setrefs */
@@ -518,6 +523,12 @@ typedef struct RelOptInfo
 	List	   *joininfo;		/* RestrictInfo structures for join clauses
 								 * involving this rel */
 	bool		has_eclass_joins;		/* T means joininfo is incomplete */
+#ifdef XCP
+	/* distribution of scan paths, set when the first one is created */
+	bool		scan_distribution_set;
+	Distribution *scan_distribution;
+	Distribution *restricted_distribution;	/* restricted by baserestrictinfo */
+#endif
 } RelOptInfo;
 
 /*
@@ -1072,11 +1083,34 @@ typedef struct UniquePath
 	List	   *uniq_exprs;		/* expressions to be made unique */
 } UniquePath;
 
+/*
+ * ResultCachePath represents a ResultCache plan node, caching the rows of
+ * a parameterized subpath for each value of the outer expressions it is
+ * parameterized by.  calls is the expected number of rescans, ndistinct the
+ * expected number of distinct keys among them; est_entries is the number of
+ * keys thought to fit in work_mem, and hit_ratio the fraction of rescans
+ * expected to be answered from the cache.
+ */
+typedef struct ResultCachePath
+{
+	Path		path;
+	Path	   *subpath;
+	List	   *param_exprs;	/* outer expressions making up the key */
+	double		calls;
+	double		ndistinct;
+	double		est_entries;
+	double		hit_ratio;
+} ResultCachePath;
+
 #ifdef XCP
 typedef struct RemoteSubPath
 {
 	Path		path;
 	Path	   *subpath;
+	/* replicated distribution may switch to this one if too many rows */
+	char		adaptiveType;
+	Node	   *adaptiveExpr;
+	bool		distinct;		/* remove duplicate rows before sending */
 } RemoteSubPath;
 #endif
 
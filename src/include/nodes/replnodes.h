@@ -45,6 +45,29 @@ typedef struct BaseBackupCmd
 } BaseBackupCmd;
 
 
+/* ----------------------
+ *		SEND_FILES command
+ * ----------------------
+ */
+typedef struct SendFilesCmd
+{
+	NodeTag		type;
+	List	   *files;			/* list of String, paths of the files */
+	XLogRecPtr	startpoint;		/* start of the parallel backup */
+	List	   *options;
+} SendFilesCmd;
+
+
+/* ----------------------
+ *		STOP_BACKUP command
+ * ----------------------
+ */
+typedef struct StopBackupCmd
+{
+	NodeTag		type;
+} StopBackupCmd;
+
+
 /* ----------------------
  *		CREATE_REPLICATION_SLOT command
  * ----------------------
@@ -60,6 +60,9 @@ extern RecursiveUnion *make_recursive_union(PlannerInfo *root, List *tlist,
 					 List *distinctList, long numGroups);
 extern Sort *make_sort_from_pathkeys(PlannerInfo *root, Plan *lefttree,
 						List *pathkeys, double limit_tuples);
+extern Plan *make_incremental_sort_from_pathkeys(PlannerInfo *root,
+									Plan *lefttree, List *pathkeys,
+									int presortedKeys, double limit_tuples);
 extern Sort *make_sort_from_sortclauses(PlannerInfo *root, List *sortcls,
 						   Plan *lefttree);
 extern Sort *make_sort_from_groupcols(PlannerInfo *root, List *groupcls,
@@ -700,6 +700,41 @@ typedef enum BackendState
 	STATE_DISABLED
 } BackendState;
 
+#ifdef XCP
+/* ----------
+ * Waits of a backend on another component of the cluster
+ *
+ * A wait event belongs to a wait class, and the time spent in the waits of
+ * each class is accumulated in a shared histogram.
+ * ----------
+ */
+typedef enum WaitClass
+{
+	WAIT_CLASS_REMOTE,			/* response of a remote node */
+	WAIT_CLASS_SHARED_QUEUE,	/* producer or consumer of a shared queue */
+	WAIT_CLASS_GTM,				/* response of the GTM */
+	WAIT_CLASS_POOLER,			/* connections from the pooler */
+	WAIT_CLASS_BARRIER			/* nodes to complete a barrier */
+} WaitClass;
+
+#define NUM_WAIT_CLASSES	(WAIT_CLASS_BARRIER + 1)
+
+typedef enum WaitEvent
+{
+	WAIT_EVENT_NONE = 0,
+	WAIT_EVENT_REMOTE_RESPONSE,
+	WAIT_EVENT_SQUEUE_READ,
+	WAIT_EVENT_SQUEUE_CREDIT,
+	WAIT_EVENT_SQUEUE_UNBIND,
+	WAIT_EVENT_GTM_RESPONSE,
+	WAIT_EVENT_POOLER_CONNECTIONS,
+	WAIT_EVENT_BARRIER
+} WaitEvent;
+
+/* Waits shorter than 1ms, 10ms, 100ms, 1s, 10s, and longer ones */
+#define WAIT_HISTOGRAM_BUCKETS	6
+#endif
+
 /* ----------
  * Shared-memory data structures
  * ----------
@@ -773,6 +808,12 @@ typedef struct PgBackendStatus
 	/* Is backend currently waiting on an lmgr lock? */
 	bool		st_waiting;
 
+#ifdef XCP
+	/* Distributed wait in progress, and the node waited on if any */
+	WaitEvent	st_wait_event;
+	Oid			st_wait_node;
+#endif
+
 	/* current state */
 	BackendState st_state;
 
@@ -937,6 +978,16 @@ extern void pgstat_report_tempfile(size_t filesize);
 extern void pgstat_report_appname(const char *appname);
 extern void pgstat_report_xact_timestamp(TimestampTz tstamp);
 extern void pgstat_report_waiting(bool waiting);
+#ifdef XCP
+extern void pgstat_report_wait_start(WaitEvent event, Oid nodeoid);
+extern void pgstat_report_wait_end(WaitEvent event);
+extern void pgstat_clear_wait(void);
+extern const char *pgstat_get_wait_event(WaitEvent event);
+extern const char *pgstat_get_wait_class(WaitClass wclass);
+extern WaitClass pgstat_get_wait_event_class(WaitEvent event);
+extern void pgstat_fetch_wait_histogram(WaitClass wclass, int64 *waits,
+							int64 *total_time, int64 *counts);
+#endif
 extern const char *pgstat_get_backend_current_activity(int pid, bool checkUser);
 extern const char *pgstat_get_crashed_backend_activity(int pid, char *buffer,
 									int buflen);
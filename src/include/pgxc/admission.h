@@ -0,0 +1,41 @@
+/*-------------------------------------------------------------------------
+ *
+ * admission.h
+ *	  Admission control of the distributed statements of a Coordinator
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ *
+ * IDENTIFICATION
+ *	  src/include/pgxc/admission.h
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include "nodes/execnodes.h"
+
+/* Classes of statements, see statement_class */
+typedef enum
+{
+	STATEMENT_CLASS_AUTO,		/* chosen by the cost of the plan */
+	STATEMENT_CLASS_SMALL,
+	STATEMENT_CLASS_LARGE
+} StatementClass;
+
+extern int	MaxActiveStatements;
+extern int	MaxActiveLargeStatements;
+extern double LargeStatementCost;
+extern int	StatementClassSetting;
+extern int	AdmissionTimeout;
+
+extern Size AdmissionShmemSize(void);
+extern void AdmissionShmemInit(void);
+
+extern void AdmitStatement(EState *estate);
+extern void ReleaseStatement(EState *estate);
+extern void AtEOXact_Admission(void);
+
+#endif   /* ADMISSION_H */
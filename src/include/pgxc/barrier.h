@@ -22,6 +22,8 @@
 #define CREATE_BARRIER_PREPARE	'P'
 #define CREATE_BARRIER_EXECUTE	'X'
 #define CREATE_BARRIER_END		'E'
+#define CREATE_BARRIER_INSERT	'I'		/* EXECUTE, flushed later on */
+#define CREATE_BARRIER_FLUSH	'F'
 
 #define CREATE_BARRIER_PREPARE_DONE	'p'
 #define CREATE_BARRIER_EXECUTE_DONE	'x'
@@ -35,7 +37,10 @@ typedef struct xl_barrier
 
 extern void ProcessCreateBarrierPrepare(const char *id);
 extern void ProcessCreateBarrierEnd(const char *id);
-extern void ProcessCreateBarrierExecute(const char *id);
+extern void ProcessCreateBarrierExecute(const char *id, bool flush);
+extern void ProcessCreateBarrierFlush(const char *id);
+
+extern bool barrier_deferred_flush;
 
 extern void RequestBarrier(const char *id, char *completionTag);
 extern void barrier_redo(XLogReaderState *record);
@@ -29,6 +29,9 @@
 #include "remotecopy.h"
 #endif
 #include "access/tupdesc.h"
+#ifdef XCP
+#include "executor/joinFilter.h"
+#endif
 #include "executor/tuptable.h"
 #include "nodes/execnodes.h"
 #include "nodes/pg_list.h"
@@ -38,6 +41,18 @@
 
 /* GUC parameters */
 extern bool EnforceTwoPhaseCommit;
+extern int	RemotePrefetchSize;
+extern int	RemoteFetchSize;
+extern bool CacheRemoteSubplans;
+extern bool RemotePipelineBegin;
+extern int	InsertBatchSize;
+extern int	DDLBatchSize;
+extern bool TransactionPooling;
+extern bool KeepPeerConnections;
+extern int	StandbyReadMaxLag;
+extern bool AsyncCommitPrepared;
+extern int	QueryWorkMem;
+extern bool ReplicatedOnePhaseCommit;
 
 /* Outputs of handle_response() */
 #define RESPONSE_EOF EOF
@@ -86,6 +101,20 @@ typedef struct CombineTag
  * ResponseCombiner must be the first field of the plan state node so we can
  * typecast
  */
+/*
+ * How a fragment of the query went on a remote node, as reported to
+ * EXPLAIN ANALYZE
+ */
+typedef struct RemoteInstrumentation
+{
+	Oid			nodeoid;		/* the remote node */
+	double		ntuples;		/* rows produced */
+	double		total;			/* execution time in seconds */
+	long		shared_blks_hit;
+	long		shared_blks_read;
+	long		temp_blks_written;
+} RemoteInstrumentation;
+
 typedef struct ResponseCombiner
 {
 	ScanState	ss;						/* its first field is NodeTag */
@@ -108,9 +137,21 @@ typedef struct ResponseCombiner
 	char	   *errorHint;				/* error hint to send back to client */
 	Oid			returning_node;			/* returning replicated node */
 	RemoteDataRow currentRow;			/* next data ro to be wrapped into a tuple */
-	/* TODO use a tuplestore as a rowbuffer */
-	List 	   *rowBuffer;				/* buffer where rows are stored when connection
-										 * should be cleaned for reuse by other RemoteQuery */
+	int			prefetch_counter;		/* rows fetched since last prefetch */
+	/*
+	 * Buffers where rows are stored when connection should be cleaned for
+	 * reuse by other RemoteQuery. There is a tuplestore per node, so rows of
+	 * a tape are read back in order without scanning rows of other nodes,
+	 * and the buffered rows are spilled to disk if they do not fit work_mem.
+	 */
+	int			rowBufferCount;			/* number of nodes having a buffer */
+	Oid		   *rowBufferNodes;			/* node of each buffer */
+	Tuplestorestate **rowBuffers;		/* the buffers */
+	long	   *rowBufferRows;			/* rows not yet read from the buffers */
+	/* Rows to request when the portal of a node is resumed, by node */
+	int			fetchSizeCount;
+	Oid		   *fetchSizeNodes;
+	int		   *fetchSizes;
 	/*
 	 * To handle special case - if there is a simple sort and sort connection
 	 * is buffered. If EOF is reached on a connection it should be removed from
@@ -119,12 +160,6 @@ typedef struct ResponseCombiner
 	 * when buffering
 	 */
 	Oid 	   *tapenodes;
-	/*
-	 * If some tape (connection) is buffered, contains a reference on the cell
-	 * right before first row buffered from this tape, needed to speed up
-	 * access to the data
-	 */
-	ListCell  **tapemarks;
 	bool		merge_sort;             /* perform mergesort of node tuples */
 	bool		extended_query;         /* running extended query protocol */
 	bool		probing_primary;		/* trying replicated on primary node */
@@ -137,6 +172,9 @@ typedef struct ResponseCombiner
 	char	   *update_cursor;			/* throw this cursor current tuple can be updated */
 	int			cursor_count;			/* total count of participating nodes */
 	PGXCNodeHandle **cursor_connections;/* data node connections being combined */
+	/* EXPLAIN ANALYZE support */
+	bool		collect_instr;			/* keep the reports of the nodes */
+	List	   *remote_instr;			/* RemoteInstrumentation of each node */
 }	ResponseCombiner;
 
 typedef struct RemoteQueryState
@@ -152,7 +190,8 @@ typedef struct RemoteQueryState
 	FmgrInfo   *eqfunctions; 			/* functions to compare tuples */
 	MemoryContext tmp_ctx;				/* separate context is needed to compare tuples */
 	/* Support for parameters */
-	char	   *paramval_data;		/* parameter data, format is like in BIND */
+	char	   *paramval_data;		/* parameter format codes and values,
+									 * format is like in BIND */
 	int			paramval_len;		/* length of parameter values data */
 
 	int			eflags;			/* capability flags to pass to tuplestore */
@@ -185,6 +224,18 @@ typedef struct RemoteSubplanState
 	bool 		execOnAll;
 	int			nParamRemote;	/* number of params sent from the master node */
 	RemoteParam *remoteparams;  /* parameter descriptors */
+	bool		persistent;		/* subplan is kept stored on the nodes */
+	bool		rescan;			/* portals can be restarted with new values
+								 * of exec params, see pgxc_node_send_rescan */
+	JoinFilter *joinfilter;		/* filter the nodes apply to the rows, set
+								 * by the hash join consuming them */
+	bool		joinfilter_sent;	/* a filter was sent to the nodes */
+	int			insert_rows;	/* rows inserted by the subplan if it may be
+								 * sent without waiting, otherwise 0 */
+	bool		insert_deferred;	/* results of the INSERT are not received,
+									 * see ExecEndRemoteSubplan */
+	struct ResultCacheScan *resultcache;	/* result is from or to the
+											 * result cache */
 } RemoteSubplanState;
 
 
@@ -224,12 +275,29 @@ typedef struct RemoteStmt
 	List	   *distributionNodes;
 
 	List	   *distributionRestrict;
+
+	List	   *distributionBuckets;
+	List	   *distributionRanges;
+
+	char		adaptiveType;
+
+	AttrNumber	adaptiveKey;
+
+	int			adaptiveRows;
+
+	int			workMem;
+
+	int			instrumentOptions;
+
+	uint32		queryId;
 } RemoteStmt;
 
 typedef void (*xact_callback) (bool isCommit, void *args);
 
 /* Copy command just involves Datanodes */
 extern void DataNodeCopyBegin(RemoteCopyData *rcstate);
+extern uint64 DataNodeCopyToFiles(RemoteCopyData *rcstate, const char *filename,
+								  bool header);
 extern int DataNodeCopyIn(char *data_row, int len, int conn_count,
 						  PGXCNodeHandle** copy_connections);
 extern uint64 DataNodeCopyOut(PGXCNodeHandle** copy_connections,
@@ -245,12 +313,19 @@ extern RemoteQueryState *ExecInitRemoteQuery(RemoteQuery *node, EState *estate,
 extern TupleTableSlot* ExecRemoteQuery(RemoteQueryState *step);
 extern void ExecEndRemoteQuery(RemoteQueryState *step);
 extern void RemoteSubplanMakeUnique(Node *plan, int unique);
+extern void RemoteSubplanSetPersistent(Node *plan, bool persistent);
 extern RemoteSubplanState *ExecInitRemoteSubplan(RemoteSubplan *node, EState *estate, int eflags);
 extern void ExecFinishInitRemoteSubplan(RemoteSubplanState *node);
 extern TupleTableSlot* ExecRemoteSubplan(RemoteSubplanState *node);
+extern bool ExecStartRemoteSubplan(RemoteSubplanState *node);
+extern bool ExecRemoteSubplanReady(RemoteSubplanState *node,
+					   PGXCNodeHandle **waitconn);
 extern void ExecEndRemoteSubplan(RemoteSubplanState *node);
 extern void ExecReScanRemoteSubplan(RemoteSubplanState *node);
+extern void ExecRemoteSubplanSetJoinFilter(RemoteSubplanState *node,
+							   JoinFilter *filter);
 extern void ExecRemoteUtility(RemoteQuery *node);
+extern bool plan_has_remote_nodes(Plan *plan);
 
 extern bool	is_data_node_ready(PGXCNodeHandle * conn);
 
@@ -268,6 +343,7 @@ extern void HandleCmdComplete(CmdType commandType, CombineTag *combine, const ch
 	} while(0)
 
 extern TupleTableSlot *FetchTuple(ResponseCombiner *combiner);
+extern bool FetchTupleReady(ResponseCombiner *combiner, int tapenum);
 extern void InitResponseCombiner(ResponseCombiner *combiner, int node_count,
 					   CombineType combine_type);
 extern void CloseCombiner(ResponseCombiner *combiner);
@@ -284,6 +360,8 @@ extern void PreCommit_Remote(char *prepareGID, char *nodestring, bool preparedLo
 extern bool	PreAbort_Remote(void);
 extern void AtEOXact_Remote(void);
 extern bool IsTwoPhaseCommitRequired(bool localWrite);
+extern bool IsAsyncCommitPending(void);
+extern void FinishAsyncCommit(void);
 extern bool FinishRemotePreparedTransaction(char *prepareGID, bool commit);
 
 extern void pgxc_all_success_nodes(ExecNodes **d_nodes, ExecNodes **c_nodes, char **failednodes_msg);
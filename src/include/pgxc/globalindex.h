@@ -0,0 +1,25 @@
+/*-------------------------------------------------------------------------
+ *
+ * globalindex.h
+ *	  Global secondary indexes of tables distributed by value
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ *
+ * IDENTIFICATION
+ *	  src/include/pgxc/globalindex.h
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef GLOBALINDEX_H
+#define GLOBALINDEX_H
+
+#include "utils/relcache.h"
+
+extern Oid	RelationGetGlobalIndex(Relation rel, AttrNumber attnum);
+extern bool RelationHasGlobalIndex(Relation rel);
+extern List *GlobalIndexLookup(Oid relid, Oid gindexid, Datum value,
+				  Oid valuetype);
+
+#endif   /* GLOBALINDEX_H */
@@ -21,6 +21,7 @@
 #define LOCATOR_TYPE_RROBIN 'N'
 #define LOCATOR_TYPE_CUSTOM 'C'
 #define LOCATOR_TYPE_MODULO 'M'
+#define LOCATOR_TYPE_BUCKET 'B'
 #define LOCATOR_TYPE_NONE 'O'
 #define LOCATOR_TYPE_DISTRIBUTED 'D'	/* for distributed table without specific
 										 * scheme, e.g. result of JOIN of
@@ -32,14 +33,24 @@
 #define HASH_SIZE 4096
 #define HASH_MASK 0x00000FFF;
 
+/*
+ * Number of virtual buckets of a bucket distributed table, a power of 2.
+ * The bucket map is stored in pgxc_class, which has no TOAST table, so it
+ * must fit into a catalog tuple.
+ */
+#define BUCKET_MAP_SIZE 1024
+
 #define IsLocatorNone(x) (x == LOCATOR_TYPE_NONE)
 #define IsLocatorReplicated(x) (x == LOCATOR_TYPE_REPLICATED)
 #define IsLocatorColumnDistributed(x) (x == LOCATOR_TYPE_HASH || \
 									   x == LOCATOR_TYPE_RROBIN || \
 									   x == LOCATOR_TYPE_MODULO || \
+									   x == LOCATOR_TYPE_BUCKET || \
+									   x == LOCATOR_TYPE_RANGE || \
 									   x == LOCATOR_TYPE_DISTRIBUTED)
 #define IsLocatorDistributedByValue(x) (x == LOCATOR_TYPE_HASH || \
 										x == LOCATOR_TYPE_MODULO || \
+										x == LOCATOR_TYPE_BUCKET || \
 										x == LOCATOR_TYPE_RANGE)
 
 #include "nodes/primnodes.h"
@@ -64,8 +75,18 @@ typedef struct
 	char		locatorType;
 	PartAttrNumber	partAttrNum;	/* if partitioned */
 	char		*partAttrName;		/* if partitioned */
+	List		*partAttrNums;		/* All the columns, if hash partitioned
+									 * by more than one column */
 	List		*nodeList;			/* Node Indices */
 	ListCell	*roundRobinNode;	/* index of the next one to use */
+	List		*buckets;			/* Node Index of each bucket, if bucket
+									 * distributed, of each range if range
+									 * distributed */
+	List		*ranges;			/* Split points, as strings, if range
+									 * distributed */
+	struct _Locator *insertLocator;	/* Locator routing inserted rows, built
+									 * on first use, relcache entry only */
+	MemoryContext locatorcxt;		/* Memory of insertLocator */
 } RelationLocInfo;
 
 /*
@@ -133,13 +154,33 @@ extern Locator *createLocator(char locatorType, RelationAccessType accessType,
 			  Oid dataType, LocatorListType listType, int nodeCount,
 			  void *nodeList, void **result, bool primary);
 extern void freeLocator(Locator *locator);
+extern Locator *GetRelationInsertLocator(Relation rel, Oid dataType);
+extern void FreeRelationInsertLocator(RelationLocInfo *rel_loc_info);
+extern void setLocatorBuckets(Locator *locator, List *buckets, List *nodeList);
+extern void setLocatorRanges(Locator *locator, List *ranges);
 
 extern int GET_NODES(Locator *self, Datum value, bool isnull, bool *hasprimary);
+extern bool GET_NODES_BATCH(Locator *self, int nvalues, Datum *values,
+				bool *nulls, int *indexes);
 extern void *getLocatorResults(Locator *self);
 extern void *getLocatorNodeMap(Locator *self);
 extern int getLocatorNodeCount(Locator *self);
 
+/*
+ * Policies to choose the Datanode reading a replicated table, see
+ * GetAnyDataNode
+ */
+typedef enum
+{
+	REPLICATED_READ_RANDOM,		/* any of the nodes */
+	REPLICATED_READ_CONNECTED,	/* prefer the nodes already connected */
+	REPLICATED_READ_LATENCY		/* then prefer the nodes answering faster */
+} ReplicatedReadPolicy;
+
 /* Extern variables related to locations */
+extern int	replicated_read_policy;
+extern char *TenantColumn;
+extern char *TenantId;
 extern Oid primary_data_node;
 extern Oid preferred_data_node[MAX_PREFERRED_NODES];
 extern int num_preferred_data_nodes;
@@ -163,14 +204,24 @@ extern List *GetAllDataNodes(void);
 extern List *GetAllCoordNodes(void);
 extern int GetAnyDataNode(Bitmapset *nodes);
 extern void RelationBuildLocator(Relation rel);
+extern Size LocatorCacheShmemSize(void);
+extern void LocatorCacheShmemInit(void);
 extern void FreeRelationLocInfo(RelationLocInfo *relationLocInfo);
 
 extern bool IsTypeModuloDistributable(Oid col_type);
+extern bool IsTypeRangeDistributable(Oid col_type);
+extern int GetRangeIndex(Oid dataType, List *ranges, Datum value);
 extern char *GetRelationModuloColumn(RelationLocInfo *rel_loc_info);
 extern bool IsModuloColumn(RelationLocInfo *rel_loc_info, char *part_col_name);
 extern bool IsModuloColumnForRelId(Oid relid, char *part_col_name);
 extern char *GetRelationDistColumn(RelationLocInfo *rel_loc_info);
 extern bool IsDistColumnForRelId(Oid relid, char *part_col_name);
 extern void FreeExecNodes(ExecNodes **exec_nodes);
+extern Node *MakeDistributionKeyExpr(List *keyexprs);
+extern List *GetDistributionKeyColumns(Node *expr);
+extern Datum ComputeDistributionKey(RelationLocInfo *rel_loc_info,
+					   TupleDesc tupdesc, Datum *values, bool *nulls);
+extern int16 *BuildBucketMap(int nbuckets, Oid *oldnodes, int oldcount,
+			   int16 *oldmap, Oid *newnodes, int newcount, int maxmoves);
 
 #endif   /* LOCATOR_H */
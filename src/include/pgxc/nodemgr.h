@@ -24,6 +24,7 @@ extern int 	MaxCoords;
 /* Global number of nodes */
 extern int 	NumDataNodes;
 extern int 	NumCoords;
+extern int	NumStandbyNodes;
 
 /* Node definition */
 typedef struct
@@ -34,6 +35,7 @@ typedef struct
 	int			nodeport;
 	bool		nodeisprimary;
 	bool 		nodeispreferred;
+	Oid			nodestandbyof;	/* Datanode replicated by a standby node */
 } NodeDefinition;
 
 extern void NodeTablesShmemInit(void);
@@ -43,6 +45,8 @@ extern void PgxcNodeListAndCount(void);
 extern void PgxcNodeGetOids(Oid **coOids, Oid **dnOids,
 							int *num_coords, int *num_dns,
 							bool update_preferred);
+extern void PgxcNodeGetStandbyOids(Oid **sbOids, Oid **primaryOids,
+					   int *num_standbys);
 extern NodeDefinition *PgxcNodeGetDefinition(Oid node);
 extern void PgxcNodeAlter(AlterNodeStmt *stmt);
 extern void PgxcNodeCreate(CreateNodeStmt *stmt);
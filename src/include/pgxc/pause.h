@@ -18,9 +18,11 @@
 /* Shared memory area for management of cluster pause/unpause */
 typedef struct {
 	int		cl_holder_pid; /* pid of the process issuing CLUSTER PAUSE */
-	int		cl_process_count; /* Number of processes undergoing txns */
 
-	slock_t	cl_mutex; /* locks shared variables mentioned above */
+	slock_t	cl_mutex; /* serializes the PAUSE CLUSTER requests */
+
+	/* Backends undergoing txns, by backend ID */
+	bool	cl_holding[FLEXIBLE_ARRAY_MEMBER];
 } ClusterLockInfo;
 
 extern ClusterLockInfo *ClustLinfo;
@@ -22,13 +22,19 @@
 #define PGXCNODE_H
 #include "postgres.h"
 #include "gtm/gtm_c.h"
+#include "lib/stringinfo.h"
 #include "utils/timestamp.h"
 #include "nodes/pg_list.h"
+#include "portability/instr_time.h"
 #include "utils/snapshot.h"
 #include <unistd.h>
 
 #define NO_SOCKET -1
 
+/* Command to reset the remote session before it is used by another session */
+#define PGXC_NODE_RESET_SESSION_CMD \
+	"RESET ALL;RESET SESSION AUTHORIZATION;RESET transaction_isolation;"
+
 /* Connection to Datanode maintained by Pool Manager */
 typedef struct PGconn NODE_CONNECTION;
 typedef struct PGcancel NODE_CANCEL;
@@ -59,12 +65,39 @@ typedef enum
 		((conn)->inCursor + 4 < (conn)->inEnd \
 			&& (conn)->inCursor + ntohl(*((uint32_t *) ((conn)->inBuffer + (conn)->inCursor + 1))) < (conn)->inEnd)
 
+/*
+ * Round trips to a remote node are counted in buckets by latency, the upper
+ * bounds of the buckets are 0.1, 0.3, 1, 3, 10, 30, 100, 300 and 1000 ms,
+ * and the last bucket counts the longer ones.
+ */
+#define PGXC_NODE_LATENCY_BUCKETS	10
+
+/* Network activity counters of the connection to a remote node */
+typedef struct
+{
+	int64		bytes_sent;
+	int64		bytes_received;
+	int64		messages_sent;
+	int64		messages_received;
+	int64		send_time;		/* microseconds spent sending */
+	int64		wait_time;		/* microseconds waited for data */
+	int64		latency[PGXC_NODE_LATENCY_BUCKETS];
+} PGXCNodeStats;
+
 struct pgxc_node_handle
 {
 	Oid			nodeoid;
+	/* Standby of a Datanode, it is only sent local snapshot requests */
+	bool		standby;
 
 	/* fd of the connection */
 	int		sock;
+	/*
+	 * Socket registered in the epoll set of pgxc_node_receive, NO_SOCKET if
+	 * none, and whether there may be unread data on it
+	 */
+	int			epoll_sock;
+	bool		readable;
 	/* Connection state */
 	char		transaction_status;
 	DNConnectionState state;
@@ -78,6 +111,7 @@ struct pgxc_node_handle
 	char		*outBuffer;
 	size_t		outSize;
 	size_t		outEnd;
+	size_t		outPacked;		/* end of data already compressed, if needed */
 	/* Input buffer */
 	char		*inBuffer;
 	size_t		inSize;
@@ -91,6 +125,48 @@ struct pgxc_node_handle
 	 * For details see comments of RESP_ROLLBACK
 	 */
 	bool		ck_resp_rollback;
+	/*
+	 * Names of remote subplans stored on the node as persistent statements,
+	 * they are kept across transactions while the handle is held.
+	 * The flag is set if persistent statements were ever prepared on the
+	 * connection, so they should be deallocated before it is released.
+	 */
+	List	   *prepared_subplans;
+	bool		deallocate_subplans;
+	/*
+	 * Snapshot xids last sent to the node, sorted. Subsequent snapshots are
+	 * sent as a difference to it, see pgxc_node_send_snapshot.
+	 * last_xcnt is -1 if the node does not have a snapshot yet.
+	 */
+	TransactionId *last_xip;
+	int			last_xcnt;
+	int			last_xip_size;
+	/*
+	 * Hash of the session parameters set on the remote session, see
+	 * PGXCNodeGetSessionParamHash. Zero if the remote session was not
+	 * initialized with the session parameters, then it is reset before it
+	 * is returned to the pool.
+	 */
+	uint32		param_hash;
+	/* BEGIN is sent without waiting, its responses are not received yet */
+	bool		begin_pending;
+	/*
+	 * Number of INSERTs and utility statements sent without waiting for the
+	 * results, and the first ErrorResponse received for them, see
+	 * pgxc_node_finish_deferred
+	 */
+	int			deferred_pending;
+	char	   *deferred_error;
+	int			deferred_error_len;
+	/*
+	 * Network activity of the session with the node, and the part of it
+	 * already added to the counters of the server, see PGXCNodeReportStats.
+	 * request_sent is the time the last request was sent, if no response
+	 * came yet, or zero.
+	 */
+	PGXCNodeStats stats;
+	PGXCNodeStats stats_reported;
+	instr_time	request_sent;
 };
 typedef struct pgxc_node_handle PGXCNodeHandle;
 
@@ -104,23 +180,38 @@ typedef struct
 	PGXCNodeHandle	  **coord_handles;	/* an array of Coordinator handles */
 } PGXCNodeAllHandles;
 
+extern int	RemoteCompressionThreshold;
+extern bool PrefetchRemoteConnections;
+
 extern void InitMultinodeExecutor(bool is_force);
 
+extern Size PGXCNodeStatsShmemSize(void);
+extern void PGXCNodeStatsShmemInit(void);
+extern void PGXCNodeReportStats(void);
+
 /* Open/close connection routines (invoked from Pool Manager) */
 extern char *PGXCNodeConnStr(char *host, int port, char *dbname, char *user,
 							 char *pgoptions,
 							 char *remote_type, char *parent_node);
 extern NODE_CONNECTION *PGXCNodeConnect(char *connstr);
+extern void PGXCNodeConnectAll(int count, char **connstrs,
+				   NODE_CONNECTION **conns);
 extern void PGXCNodeClose(NODE_CONNECTION * conn);
 extern int PGXCNodeConnected(NODE_CONNECTION * conn);
 extern int PGXCNodeConnClean(NODE_CONNECTION * conn);
 extern void PGXCNodeCleanAndRelease(int code, Datum arg);
 
 extern PGXCNodeHandle *get_any_handle(List *datanodelist);
+extern PGXCNodeHandle *get_standby_handle(int node);
 /* Look at information cached in node handles */
 extern int PGXCNodeGetNodeId(Oid nodeoid, char *node_type);
 extern int PGXCNodeGetNodeIdFromName(char *node_name, char *node_type);
 extern Oid PGXCNodeGetNodeOid(int nodeid, char node_type);
+extern bool PGXCNodeIsConnected(int nodeid);
+extern int64 PGXCNodeGetLatency(int nodeid);
+extern int PGXCNodeStandbyOf(int nodeid);
+extern void PGXCNodeStandbyReport(Oid nodeoid, int lag);
+extern bool PGXCNodeGetStandbyLag(int nodeid, int *lag);
 
 extern PGXCNodeAllHandles *get_handles(List *datanodelist, List *coordlist, bool is_query_coord_only, bool is_global_session);
 
@@ -140,17 +231,26 @@ extern int	ensure_in_buffer_capacity(size_t bytes_needed, PGXCNodeHandle * handl
 extern int	ensure_out_buffer_capacity(size_t bytes_needed, PGXCNodeHandle * handle);
 
 extern int	pgxc_node_send_query(PGXCNodeHandle * handle, const char *query);
+extern int	pgxc_node_queue_query(PGXCNodeHandle *handle, const char *query);
+extern int	pgxc_node_send_begin(PGXCNodeHandle *handle, const char *query);
 extern int	pgxc_node_send_describe(PGXCNodeHandle * handle, bool is_statement,
 						const char *name);
 extern int	pgxc_node_send_execute(PGXCNodeHandle * handle, const char *portal, int fetch);
 extern int	pgxc_node_send_close(PGXCNodeHandle * handle, bool is_statement,
 					 const char *name);
 extern int	pgxc_node_send_sync(PGXCNodeHandle * handle);
+extern int	pgxc_node_queue_sync(PGXCNodeHandle *handle);
 extern int	pgxc_node_send_bind(PGXCNodeHandle * handle, const char *portal,
-								const char *statement, int paramlen, char *params);
+								const char *statement, int paramlen, char *params,
+								bool binary);
+extern int	pgxc_node_send_rescan(PGXCNodeHandle * handle, const char *portal,
+								  int paramlen, char *params);
+extern int	pgxc_node_send_join_filter(PGXCNodeHandle * handle,
+						   const char *portal, const char *data, int len);
 extern int	pgxc_node_send_parse(PGXCNodeHandle * handle, const char* statement,
 								 const char *query, short num_params, Oid *param_types);
 extern int	pgxc_node_send_flush(PGXCNodeHandle * handle);
+extern int	pgxc_node_queue_flush(PGXCNodeHandle *handle);
 extern int	pgxc_node_send_query_extended(PGXCNodeHandle *handle, const char *query,
 							  const char *statement, const char *portal,
 							  int num_params, Oid *param_types,
@@ -158,19 +258,34 @@ extern int	pgxc_node_send_query_extended(PGXCNodeHandle *handle, const char *que
 							  bool send_describe, int fetch_size);
 extern int  pgxc_node_send_plan(PGXCNodeHandle * handle, const char *statement,
 					const char *query, const char *planstr,
-					short num_params, Oid *param_types);
+					short num_params, Oid *param_types, bool persistent);
 extern int	pgxc_node_send_gxid(PGXCNodeHandle * handle, GlobalTransactionId gxid);
 extern int	pgxc_node_send_cmd_id(PGXCNodeHandle *handle, CommandId cid);
 extern int	pgxc_node_send_snapshot(PGXCNodeHandle * handle, Snapshot snapshot);
 extern int	pgxc_node_send_timestamp(PGXCNodeHandle * handle, TimestampTz timestamp);
+extern void pgxc_node_prefix_gxid(StringInfo prefix, GlobalTransactionId gxid);
+extern void pgxc_node_prefix_cmd_id(StringInfo prefix, CommandId cid);
+extern void pgxc_node_prefix_timestamp(StringInfo prefix, TimestampTz timestamp);
+extern int	pgxc_node_send_prefix(PGXCNodeHandle *handle, StringInfo prefix);
 
 extern bool	pgxc_node_receive(const int conn_count,
 				  PGXCNodeHandle ** connections, struct timeval * timeout);
 extern int	pgxc_node_read_data(PGXCNodeHandle * conn, bool close_if_error);
 extern int	pgxc_node_is_data_enqueued(PGXCNodeHandle *conn);
+extern int	pgxc_node_prefetch(int conn_count, PGXCNodeHandle **connections,
+				   size_t maxbuffered);
+
+extern bool pgxc_node_has_subplan(PGXCNodeHandle *handle, const char *name);
+extern bool pgxc_node_subplan_prepared(List *nodelist, const char *name);
+extern void pgxc_node_add_subplan(PGXCNodeHandle *handle, const char *name);
+extern void pgxc_node_forget_subplan(const char *name);
+extern void pgxc_node_forget_all_subplans(void);
+extern bool HavePreparedSubplans(void);
 
 extern int	send_some(PGXCNodeHandle * handle, int len);
 extern int	pgxc_node_flush(PGXCNodeHandle *handle);
+extern int	pgxc_node_flush_nowait(PGXCNodeHandle *handle);
+extern int	pgxc_node_flush_all(int count, PGXCNodeHandle **handles);
 extern void	pgxc_node_flush_read(PGXCNodeHandle *handle);
 
 extern char get_message(PGXCNodeHandle *conn, int *len, char **msg);
@@ -182,6 +297,7 @@ extern Datum pgxc_execute_on_nodes(int numnodes, Oid *nodelist, char *query);
 extern void PGXCNodeSetParam(bool local, const char *name, const char *value);
 extern void PGXCNodeResetParams(bool only_local);
 extern char *PGXCNodeGetSessionParamStr(void);
+extern uint32 PGXCNodeGetSessionParamHash(void);
 extern char *PGXCNodeGetTransactionParamStr(void);
 extern void pgxc_node_set_query(PGXCNodeHandle *handle, const char *set_query);
 extern void RequestInvalidateRemoteHandles(void);
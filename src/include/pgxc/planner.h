@@ -129,11 +129,30 @@ typedef struct
 	AttrNumber	distributionKey;
 	List 	   *distributionNodes;
 	List 	   *distributionRestrict;
+	List	   *distributionBuckets;
+	List	   *distributionRanges;
 	List 	   *nodeList;
 	bool 		execOnAll;
 	SimpleSort *sort;
 	char	   *cursor;
 	int			unique;
+	bool		persistent;		/* keep the statement on the remote nodes */
+	/*
+	 * If adaptiveKey is set, replicated distribution switches to
+	 * adaptiveType by value of that attribute once adaptiveRows rows are sent
+	 */
+	char		adaptiveType;
+	AttrNumber	adaptiveKey;
+	int			adaptiveRows;
+	char	   *resultCacheKey;	/* the query, if its result may be cached */
+	/*
+	 * If globalIndex is set, the Coordinator probes that global index of
+	 * globalIndexRel for globalIndexValue and runs the subplan only on the
+	 * nodes of the rows found, see pgxc_create_global_index()
+	 */
+	Oid			globalIndex;
+	Oid			globalIndexRel;
+	Expr	   *globalIndexValue;
 } RemoteSubplan;
 
 /*
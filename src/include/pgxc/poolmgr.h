@@ -35,6 +35,8 @@ typedef struct
 	time_t		released;
 	NODE_CONNECTION *conn;
 	NODE_CANCEL	*xc_cancelConn;
+	uint32		paramhash;	/* session parameters set on the connection,
+							 * zero if it has defaults */
 } PGXCNodePoolSlot;
 
 /* Pool of connections to specified pgxc node */
@@ -45,8 +47,32 @@ typedef struct
 	int			freeSize;	/* available connections */
 	int			size;  		/* total pool size */
 	PGXCNodePoolSlot **slot;
+	/* Statistics reported by pg_stat_pooler */
+	int64		acquisitions;	/* connections handed out to sessions */
+	int64		wait_time;		/* time sessions waited for them, in us */
+	int64		grow_failures;	/* failed attempts to open a connection */
+	int64		destroyed;		/* broken or discarded connections closed */
+	int64		evicted;		/* idle connections closed by keepalive */
+	/* Sizing, see shrink_pool() */
+	int			peak_used;		/* max connections used since last update */
+	double		demand;			/* moving average of peak_used */
 } PGXCNodePool;
 
+/* Statistics of a node pool as sent by the pooler to the session */
+typedef struct
+{
+	char	   *database;
+	char	   *user_name;
+	Oid			nodeoid;
+	int			size;
+	int			freeSize;
+	int64		acquisitions;
+	int64		wait_time;
+	int64		grow_failures;
+	int64		destroyed;
+	int64		evicted;
+} PoolNodeStatistics;
+
 /* All pools for specified database */
 typedef struct databasepool
 {
@@ -89,9 +115,13 @@ typedef struct pollfd Pollfd;
 extern int	PoolConnKeepAlive;
 extern int	PoolMaintenanceTimeout;
 extern int	MaxPoolSize;
+extern int	MinPoolSize;
+extern int	PoolWaitTimeout;
+extern int	PoolMaxWaiters;
 extern int	PoolerPort;
 
 extern bool PersistentConnections;
+extern bool PoolUseUnixSocket;
 
 /* Status inquiry functions */
 extern void PGXCPoolerProcessIam(void);
@@ -116,7 +146,9 @@ extern char *session_options(void);
 extern void PoolManagerReconnect(void);
 
 /* Get pooled connections */
-extern int *PoolManagerGetConnections(List *datanodelist, List *coordlist);
+extern int *PoolManagerGetConnections(List *datanodelist, List *coordlist,
+						  List *prefetchlist, uint32 paramhash,
+						  uint32 **paramhashes, int *prefetched);
 
 /* Clean pool connections */
 extern void PoolManagerCleanConnection(List *datanodelist, List *coordlist, char *dbname, char *username);
@@ -127,11 +159,16 @@ extern bool PoolManagerCheckConnectionInfo(void);
 /* Reload connection data in pooler and drop all the existing connections of pooler */
 extern void PoolManagerReloadConnectionInfo(void);
 
+/* Get statistics of the pooler, a list of PoolNodeStatistics */
+extern List *PoolManagerGetStatistics(void);
+
 /* Send Abort signal to transactions being run */
 extern int	PoolManagerAbortTransactions(char *dbname, char *username, int **proc_pids);
 
 /* Return connections back to the pool, for both Coordinator and Datanode connections */
-extern void PoolManagerReleaseConnections(bool destroy);
+extern void PoolManagerReleaseConnections(bool destroy,
+							  int dn_count, uint32 *dn_paramhashes,
+							  int co_count, uint32 *co_paramhashes);
 
 /* Cancel a running query on Datanodes as well as on other Coordinators */
 extern void PoolManagerCancelQuery(int dn_count, int* dn_list, int co_count, int* co_list);
@@ -26,10 +26,13 @@ typedef enum RedistribOperation {
 	DISTRIB_NONE,		/* Default operation */
 	DISTRIB_DELETE_HASH,	/* Perform a DELETE with hash value check */
 	DISTRIB_DELETE_MODULO,	/* Perform a DELETE with modulo value check */
+	DISTRIB_DELETE_BUCKETS,	/* Perform a DELETE of the given buckets */
 	DISTRIB_COPY_TO,	/* Perform a COPY TO */
 	DISTRIB_COPY_FROM,	/* Perform a COPY FROM */
 	DISTRIB_TRUNCATE,	/* Truncate relation */
-	DISTRIB_REINDEX		/* Reindex relation */
+	DISTRIB_REINDEX,	/* Reindex relation */
+	DISTRIB_STAGE_TO,	/* Move data to a staging table with new distribution */
+	DISTRIB_STAGE_FROM	/* Move data back from staging table */
 } RedistribOperation;
 
 /*
@@ -52,6 +55,7 @@ typedef struct RedistribCommand {
 	ExecNodes	   *execNodes;			/* List of nodes where to perform operation */
 	RedistribCatalog	updateState;		/* Flag to determine if operation can be done
 										 * before or after catalog update */
+	List	   *buckets;			/* Buckets concerned by operation, if any */
 } RedistribCommand;
 
 /*
@@ -65,8 +69,13 @@ typedef struct RedistribState {
 	Oid			relid;			/* Oid of relation redistributed */
 	List	   *commands;		/* List of commands */
 	Tuplestorestate *store;		/* Tuple store used for temporary data storage */
+	char	   *stageName;		/* Qualified name of staging table, if any */
+	char	   *stageDistribution;	/* Distribution clause of staging table */
 } RedistribState;
 
+/* GUC parameter */
+extern int RedistribMaxBuckets;
+
 extern void PGXCRedistribTable(RedistribState *distribState, RedistribCatalog type);
 extern void PGXCRedistribCreateCommandList(RedistribState *distribState,
 										 RelationLocInfo *newLocInfo);
@@ -76,5 +85,6 @@ extern RedistribCommand *makeRedistribCommand(RedistribOperation type,
 extern RedistribState *makeRedistribState(Oid relOid);
 extern void FreeRedistribState(RedistribState *state);
 extern void FreeRedistribCommand(RedistribCommand *command);
+extern char *RelationLocInfoDistribution(Oid relid, RelationLocInfo *locInfo);
 
 #endif  /* REDISTRIB_H */
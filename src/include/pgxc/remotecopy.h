@@ -33,6 +33,7 @@ typedef struct RemoteCopyData {
 	 * as copy source or destination
 	 */
 	StringInfoData query_buf;
+	int				target_pos;		/* offset of STDIN/STDOUT clause */
 	Locator			*locator;		/* the locator object */
 	Oid				dist_type;		/* data type of the distribution column */
 
@@ -57,6 +58,7 @@ typedef struct RemoteCopyOptions {
 	char	   *rco_escape;			/* CSV escape char (must be 1 byte) */
 	List	   *rco_force_quote;	/* list of column names */
 	List	   *rco_force_notnull;	/* list of column names */
+	bool		rco_freeze;			/* freeze rows on loading? */
 } RemoteCopyOptions;
 
 extern void RemoteCopy_BuildStatement(RemoteCopyData *state,
@@ -64,6 +66,9 @@ extern void RemoteCopy_BuildStatement(RemoteCopyData *state,
 									  RemoteCopyOptions *options,
 									  List *attnamelist,
 									  List *attnums);
+extern char *RemoteCopy_FileStatement(RemoteCopyData *state,
+									  const char *filename,
+									  bool header);
 extern void RemoteCopy_GetRelationLoc(RemoteCopyData *state,
 									  Relation rel,
 									  List *attnums);
@@ -0,0 +1,46 @@
+/*-------------------------------------------------------------------------
+ *
+ * resultcache.h
+ *	  Result cache of the queries of a Coordinator on read-mostly tables
+ *
+ * Portions Copyright (c) 2015, Postgres-XL Development Group
+ *
+ *
+ * IDENTIFICATION
+ *	  src/include/pgxc/resultcache.h
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include "fmgr.h"
+#include "nodes/execnodes.h"
+#include "nodes/parsenodes.h"
+#include "utils/relcache.h"
+
+/* Scan of the result of a query, from the cache or to be stored in it */
+typedef struct ResultCacheScan ResultCacheScan;
+
+extern int	ResultCacheSize;
+
+extern Size ResultCacheShmemSize(void);
+extern void ResultCacheShmemInit(void);
+
+extern char *ResultCacheQueryKey(Query *query);
+
+extern ResultCacheScan *ResultCacheBeginScan(const char *querykey,
+					 EState *estate);
+extern bool ResultCacheHit(ResultCacheScan *scan);
+extern TupleTableSlot *ResultCacheGetTuple(ResultCacheScan *scan,
+					TupleTableSlot *slot);
+extern void ResultCachePutTuple(ResultCacheScan *scan, TupleTableSlot *slot);
+extern void ResultCacheStore(ResultCacheScan *scan);
+extern void ResultCacheRescan(ResultCacheScan *scan);
+
+extern void ResultCacheRelationModified(Relation rel);
+
+extern Datum pgxc_result_cache_invalidate(PG_FUNCTION_ARGS);
+
+#endif   /* RESULTCACHE_H */
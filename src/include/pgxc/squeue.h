@@ -23,6 +23,8 @@
 
 extern PGDLLIMPORT int NSQueues;
 extern PGDLLIMPORT int SQueueSize;
+extern PGDLLIMPORT bool SQueueSpillFiles;
+extern PGDLLIMPORT bool SQueueNumaLocal;
 
 /* Fixed size of shared queue, maybe need to be GUC configurable */
 #define SQUEUE_SIZE ((long) SQueueSize * 1024L)
@@ -31,6 +33,9 @@ extern PGDLLIMPORT int SQueueSize;
 
 #define SQUEUE_KEYSIZE (64)
 
+/* Number of tuples producer accumulates for a consumer before writing */
+#define SQUEUE_BATCH_SIZE (32)
+
 #define SQ_CONS_SELF -1
 #define SQ_CONS_NONE -2
 
@@ -40,7 +45,9 @@ extern Size SharedQueueShmemSize(void);
 extern void SharedQueuesInit(void);
 extern void SharedQueueAcquire(const char *sqname, int ncons);
 extern SharedQueue SharedQueueBind(const char *sqname, List *consNodes,
-				List *distNodes, int *myindex, int *consMap);
+				List *distNodes, int *myindex, int *consMap, bool broadcast);
+extern bool SharedQueueIsBroadcast(SharedQueue squeue);
+extern bool SharedQueueWaitCredit(SharedQueue squeue, long timeout);
 extern void SharedQueueUnBind(SharedQueue squeue);
 extern void SharedQueueRelease(const char *sqname);
 extern void SharedQueuesCleanup(int code, Datum arg);
@@ -51,6 +58,9 @@ extern int	SharedQueueFinish(SharedQueue squeue, TupleDesc tupDesc,
 extern void SharedQueueWrite(SharedQueue squeue, int consumerIdx,
 				 TupleTableSlot *slot, Tuplestorestate **tuplestore,
 				 MemoryContext tmpcxt);
+extern void SharedQueueWriteBatch(SharedQueue squeue, int consumerIdx,
+				 TupleTableSlot **slots, int nslots,
+				 Tuplestorestate **tuplestore, MemoryContext tmpcxt);
 extern bool SharedQueueRead(SharedQueue squeue, int consumerIdx,
 				TupleTableSlot *slot, bool canwait);
 extern void SharedQueueReset(SharedQueue squeue, int consumerIdx);
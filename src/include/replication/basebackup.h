@@ -20,6 +20,12 @@
 #define MAX_RATE_LOWER	32
 #define MAX_RATE_UPPER	1048576
 
+/*
+ * Maximum number of files in a SEND_FILES command, to bound the size of the
+ * command.
+ */
+#define SEND_FILES_MAX	1024
+
 
 typedef struct
 {
@@ -30,6 +36,8 @@ typedef struct
 } tablespaceinfo;
 
 extern void SendBaseBackup(BaseBackupCmd *cmd);
+extern void SendBackupFiles(SendFilesCmd *cmd);
+extern void StopBaseBackup(StopBackupCmd *cmd);
 
 extern int64 sendTablespace(char *path, bool sizeonly);
 
@@ -73,6 +73,11 @@ typedef struct LogicalDecodingContext
 	bool		prepared_write;
 	XLogRecPtr	write_location;
 	TransactionId write_xid;
+#ifdef XCP
+	/* Commit of the transaction written, to order the output of the nodes */
+	XLogRecPtr	write_commit_location;
+	TimestampTz write_commit_time;
+#endif
 } LogicalDecodingContext;
 
 extern void CheckLogicalDecodingRequirements(void);
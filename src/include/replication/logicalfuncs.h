@@ -21,4 +21,9 @@ extern Datum pg_logical_slot_get_binary_changes(PG_FUNCTION_ARGS);
 extern Datum pg_logical_slot_peek_changes(PG_FUNCTION_ARGS);
 extern Datum pg_logical_slot_peek_binary_changes(PG_FUNCTION_ARGS);
 
+#ifdef XCP
+extern Datum pgxc_logical_slot_peek_changes(PG_FUNCTION_ARGS);
+extern Datum pgxc_logical_slot_get_changes(PG_FUNCTION_ARGS);
+#endif
+
 #endif
@@ -35,6 +35,8 @@ typedef struct WalSnd
 	pid_t		pid;			/* this walsender's process id, or 0 */
 	WalSndState state;			/* this walsender's state */
 	XLogRecPtr	sentPtr;		/* WAL has been sent up to this point */
+	XLogRecPtr	backupStart;	/* start of the parallel base backup in
+								 * progress, or InvalidXLogRecPtr */
 	bool		needreload;		/* does currently-open file need to be
 								 * reloaded? */
 
@@ -204,8 +204,23 @@ typedef union BufferDescPadded
 #define UnlockBufHdr(bufHdr)	SpinLockRelease(&(bufHdr)->buf_hdr_lock)
 
 
+/*
+ * Entry of the array the checkpointer sorts the buffers to write by, so that
+ * it writes each file in block order.  The fields are copied from the buffer
+ * tag, with the tablespace first as writes are balanced between tablespaces.
+ */
+typedef struct CkptSortItem
+{
+	Oid			tsId;
+	Oid			relNode;
+	ForkNumber	forkNum;
+	BlockNumber blockNum;
+	int			buf_id;
+} CkptSortItem;
+
 /* in buf_init.c */
 extern PGDLLIMPORT BufferDescPadded *BufferDescriptors;
+extern CkptSortItem *CkptBufferIds;
 
 /* in localbuf.c */
 extern BufferDesc *LocalBufferDescriptors;
@@ -223,6 +238,7 @@ extern bool StrategyRejectBuffer(BufferAccessStrategy strategy,
 
 extern int	StrategySyncStart(uint32 *complete_passes, uint32 *num_buf_alloc);
 extern void StrategyNotifyBgWriter(int bgwprocno);
+extern void StrategyFillFreelists(int upcoming_allocs);
 
 extern Size StrategyShmemSize(void);
 extern void StrategyInitialize(bool init);
@@ -54,9 +54,25 @@ extern int	bgwriter_lru_maxpages;
 extern double bgwriter_lru_multiplier;
 extern bool track_io_timing;
 extern int	target_prefetch_pages;
+extern int	checkpoint_flush_after;
+
+/*
+ * Kernel writeback of checkpoint writes is only worth asking for where it
+ * doesn't also drop the data from the OS cache.
+ */
+#ifdef HAVE_SYNC_FILE_RANGE
+#define DEFAULT_CHECKPOINT_FLUSH_AFTER 32
+#else
+#define DEFAULT_CHECKPOINT_FLUSH_AFTER 0
+#endif
+#define WRITEBACK_MAX_PENDING_FLUSHES 256
+
+/* in freelist.c */
+extern int	clock_sweep_partitions;
 
 /* in buf_init.c */
 extern PGDLLIMPORT char *BufferBlocks;
+extern bool numa_interleave_buffers;
 
 /* in localbuf.c */
 extern PGDLLIMPORT int NLocBuffer;
@@ -146,6 +162,7 @@ extern PGDLLIMPORT int32 *LocalRefCount;
  */
 extern void PrefetchBuffer(Relation reln, ForkNumber forkNum,
 			   BlockNumber blockNum);
+extern int	PrefetchDistance(int distance);
 extern Buffer ReadBuffer(Relation reln, BlockNumber blockNum);
 extern Buffer ReadBufferExtended(Relation reln, ForkNumber forkNum,
 				   BlockNumber blockNum, ReadBufferMode mode,
@@ -145,9 +145,14 @@ extern PGDLLIMPORT LWLockPadded *MainLWLockArray;
 #define CommitTsControlLock			(&MainLWLockArray[41].lock)
 #define CommitTsLock				(&MainLWLockArray[42].lock)
 #define ReplicationOriginLock		(&MainLWLockArray[43].lock)
+#ifdef PGXC
+#define CSNLogControlLock			(&MainLWLockArray[44].lock)
+#define SequenceCacheLock			(&MainLWLockArray[45].lock)
+#define LocatorCacheLock			(&MainLWLockArray[46].lock)
+#endif
 
 #ifdef PGXC
-#define NUM_INDIVIDUAL_LWLOCKS		44
+#define NUM_INDIVIDUAL_LWLOCKS		47
 #else
 #define NUM_INDIVIDUAL_LWLOCKS		41
 #endif
@@ -50,10 +50,19 @@ struct XidCache
 #define		PROC_VACUUM_FOR_WRAPAROUND	0x08	/* set by autovac only */
 #define		PROC_IN_LOGICAL_DECODING	0x10	/* currently doing logical
 												 * decoding outside xact */
+#ifdef PGXC
+#define		PROC_IN_LOCAL_SNAPSHOT	0x20	/* xmin from a local snapshot,
+											 * unknown to GTM */
 
+/* flags reset at EOXact */
+#define		PROC_VACUUM_STATE_MASK \
+	(PROC_IN_VACUUM | PROC_IN_ANALYZE | PROC_VACUUM_FOR_WRAPAROUND | \
+	 PROC_IN_LOCAL_SNAPSHOT)
+#else
 /* flags reset at EOXact */
 #define		PROC_VACUUM_STATE_MASK \
 	(PROC_IN_VACUUM | PROC_IN_ANALYZE | PROC_VACUUM_FOR_WRAPAROUND)
+#endif
 
 /*
  * We allow a small number of "weak" relation locks (AccesShareLock,
@@ -46,6 +46,11 @@ extern void SetGlobalSnapshotData(TransactionId xmin, TransactionId xmax, int xc
 		TransactionId *xip,
 		SnapshotSource source);
 extern void UnsetGlobalSnapshotData(void);
+extern void WaitForPreparedCommits(void);
+extern void SetStatementLocalSnapshots(bool value);
+extern bool StatementLocalSnapshots(void);
+
+extern bool single_node_snapshots;
 extern void ReloadConnInfoOnBackends(void);
 #endif /* PGXC */
 extern void ProcArrayInitRecovery(TransactionId initializedUptoXID);
@@ -36,6 +36,8 @@ extern void InitShmemAccess(void *seghdr);
 extern void InitShmemAllocation(void);
 extern void *ShmemAlloc(Size size);
 extern bool ShmemAddrIsValid(const void *addr);
+extern bool ShmemNumaInterleave(void *ptr, Size size);
+extern bool ShmemNumaBindLocal(void *ptr, Size size);
 extern void InitShmemIndex(void);
 extern HTAB *ShmemInitHash(const char *name, long init_size, long max_size,
 			  HASHCTL *infoP, int hash_flags);
@@ -50,6 +50,9 @@ extern long PortalRunFetch(Portal portal,
 #ifdef XCP
 extern int	AdvanceProducingPortal(Portal portal, bool can_wait);
 extern void cleanupClosedProducers(void);
+extern void PortalRescanDistributed(Portal portal, Bitmapset *chgParam);
+extern void SetPortalJoinFilter(const char *portal_name,
+					struct JoinFilter *filter);
 #endif
 
 #endif   /* PQUERY_H */
@@ -575,6 +575,7 @@ extern Datum void_send(PG_FUNCTION_ARGS);
 #ifdef PGXC
 extern Datum pgxc_node_str (PG_FUNCTION_ARGS);
 extern Datum pgxc_lock_for_backup (PG_FUNCTION_ARGS);
+extern Datum pgxc_global_deadlock_check(PG_FUNCTION_ARGS);
 #endif
 extern Datum trigger_in(PG_FUNCTION_ARGS);
 extern Datum trigger_out(PG_FUNCTION_ARGS);
@@ -1171,6 +1172,7 @@ extern Datum show_all_file_settings(PG_FUNCTION_ARGS);
 
 /* lockfuncs.c */
 extern Datum pg_lock_status(PG_FUNCTION_ARGS);
+extern Datum pg_lock_waits(PG_FUNCTION_ARGS);
 extern Datum pg_advisory_lock_int8(PG_FUNCTION_ARGS);
 extern Datum pg_advisory_xact_lock_int8(PG_FUNCTION_ARGS);
 extern Datum pg_advisory_lock_shared_int8(PG_FUNCTION_ARGS);
@@ -1306,12 +1308,37 @@ extern Datum pg_cursor(PG_FUNCTION_ARGS);
 /* backend/pgxc/pool/poolutils.c */
 extern Datum pgxc_pool_check(PG_FUNCTION_ARGS);
 extern Datum pgxc_pool_reload(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_pooler(PG_FUNCTION_ARGS);
+
+/* backend/pgxc/pool/execRemote.c */
+extern Datum pgxc_resolve_prepared(PG_FUNCTION_ARGS);
 
 /* backend/pgxc/cluster/stormutils.c */
 extern Datum stormdb_promote_standby(PG_FUNCTION_ARGS);
 
 /* backend/access/transam/transam.c */
 extern Datum pgxc_is_committed(PG_FUNCTION_ARGS);
+
+/* backend/access/transam/gtm.c */
+extern Datum pg_stat_get_gtm(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_global_xmin(PG_FUNCTION_ARGS);
+
+/* backend/pgxc/squeue/squeue.c */
+extern Datum pg_stat_get_shared_queues(PG_FUNCTION_ARGS);
+
+/* backend/pgxc/pool/pgxcnode.c */
+extern Datum pg_stat_get_remote_nodes(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_session_remote_nodes(PG_FUNCTION_ARGS);
+
+/* backend/utils/adt/dbsize.c */
+extern Datum pgxc_get_distribution(PG_FUNCTION_ARGS);
+
+/* backend/pgxc/locator/locator.c */
+extern Datum pgxc_get_distribution_map(PG_FUNCTION_ARGS);
+extern Datum pgxc_node_for_value(PG_FUNCTION_ARGS);
+
+/* backend/pgxc/locator/globalindex.c */
+extern Datum pgxc_create_global_index(PG_FUNCTION_ARGS);
 #endif
 
 #endif   /* BUILTINS_H */
@@ -445,6 +445,12 @@ extern void assign_temp_tablespaces(const char *newval, void *extra);
 extern bool check_search_path(char **newval, void **extra, GucSource source);
 extern void assign_search_path(const char *newval, void *extra);
 
+#ifdef XCP
+/* in optimizer/path/costsize.c */
+extern bool check_network_link_costs(char **newval, void **extra, GucSource source);
+extern void assign_network_link_costs(const char *newval, void *extra);
+#endif
+
 /* in access/transam/xlog.c */
 extern bool check_wal_buffers(int *newval, void **extra, GucSource source);
 extern void assign_xlog_sync_method(int new_sync_method, void *extra);
@@ -168,6 +168,7 @@ extern bool	is_pgxc_nodeprimary(Oid nodeid);
 extern Oid	get_pgxc_groupoid(const char *groupname);
 extern int	get_pgxc_groupmembers(Oid groupid, Oid **members);
 extern int	get_pgxc_classnodes(Oid tableid, Oid **nodes);
+extern int	get_pgxc_classbuckets(Oid tableid, int16 **buckets);
 #endif
 extern int32 get_typavgwidth(Oid typid, int32 typmod);
 extern int32 get_attavgwidth(Oid relid, AttrNumber attnum);
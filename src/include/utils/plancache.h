@@ -187,6 +187,8 @@ extern CachedPlan *GetCachedPlan(CachedPlanSource *plansource,
 			  bool useResOwner);
 extern void ReleaseCachedPlan(CachedPlan *plan, bool useResOwner);
 #ifdef XCP
+extern int	RemoteSubplanCacheSize;
+
 extern void SetRemoteSubplan(CachedPlanSource *plansource,
 				 const char *plan_string);
 #endif
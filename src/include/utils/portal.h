@@ -168,6 +168,8 @@ typedef struct PortalData
 	MemoryContext holdContext;	/* memory containing holdStore */
 #ifdef XCP
 	MemoryContext tmpContext;	/* temporary memory */
+	MemoryContext paramContext;	/* memory for parameter values received
+								 * with Rescan messages */
 #endif
 
 	/*
@@ -235,6 +235,9 @@ typedef struct StdRdOptions
 	AutoVacOpts autovacuum;		/* autovacuum-related options */
 	bool		user_catalog_table;		/* use as an additional catalog
 										 * relation */
+#ifdef XCP
+	bool		result_cache;	/* results of its queries may be cached */
+#endif
 } StdRdOptions;
 
 #define HEAP_MIN_FILLFACTOR			10
@@ -271,6 +274,19 @@ typedef struct StdRdOptions
 	((relation)->rd_options ?				\
 	 ((StdRdOptions *) (relation)->rd_options)->user_catalog_table : false)
 
+#ifdef XCP
+/*
+ * RelationHasResultCache
+ *		Returns whether the results of the queries reading the relation may be
+ *		kept in the result cache of the Coordinators.  Note multiple eval of
+ *		argument!
+ */
+#define RelationHasResultCache(relation)	\
+	((relation)->rd_rel->relkind == RELKIND_RELATION && \
+	 (relation)->rd_options ?				\
+	 ((StdRdOptions *) (relation)->rd_options)->result_cache : false)
+#endif
+
 
 /*
  * ViewOptions
@@ -0,0 +1,49 @@
+--
+-- Hashed aggregation spilling to disk
+--
+-- Number of batches of the hashed aggregation of a query
+create function hashagg_batches(query text) returns int as $$
+declare
+	ln text;
+	b int;
+BEGIN
+	for ln in execute 'explain (analyze, costs off, timing off) ' || query loop
+		b := substring(ln from 'Batches: (\d+)');
+		if b is not null then
+			return b;
+		end if;
+	end loop;
+	return 0;
+END;$$ language plpgsql;
+
+SET work_mem = '64kB';
+SET enable_sort = off;
+-- Few groups fit in memory
+SELECT hashagg_batches('SELECT g % 10, count(*) FROM generate_series(1, 1000) g GROUP BY 1');
+-- Too many groups are spilled
+SELECT hashagg_batches('SELECT g % 20000, count(*) FROM generate_series(1, 100000) g GROUP BY 1') > 1 AS spilled;
+SELECT count(*) AS groups, sum(c) AS rows, sum(s) AS total, min(c), max(c)
+	FROM (SELECT g % 20000 AS k, count(*) AS c, sum(g) AS s
+		  FROM generate_series(1, 100000) g GROUP BY 1) a;
+SELECT k, count(*), min(g), max(g)
+	FROM (SELECT (g % 5000)::text AS k, g FROM generate_series(1, 50000) g) s
+	GROUP BY k HAVING k IN ('0', '1', '4999') ORDER BY k;
+SELECT count(*) FROM (SELECT DISTINCT g % 30000 FROM generate_series(1, 90000) g) s;
+
+-- Aggregation on the Datanodes
+CREATE TABLE hashagg_spill (a int, b int) DISTRIBUTE BY HASH (a);
+INSERT INTO hashagg_spill SELECT g, g % 25000 FROM generate_series(1, 50000) g;
+SELECT count(*), sum(c), min(c), max(c)
+	FROM (SELECT b, count(*) AS c FROM hashagg_spill GROUP BY b) s;
+SELECT count(*) FROM (SELECT DISTINCT b FROM hashagg_spill) s;
+
+-- The spill files are temporary files
+SET temp_file_limit = '64kB';
+SELECT count(*) FROM (SELECT g % 20000 AS k, count(*)
+	FROM generate_series(1, 100000) g GROUP BY 1) a;
+
+RESET temp_file_limit;
+RESET enable_sort;
+RESET work_mem;
+DROP TABLE hashagg_spill;
+DROP FUNCTION hashagg_batches(text);
@@ -0,0 +1,74 @@
+--
+-- Incremental sort
+--
+create function incremental_sort_used(query text) returns bool as $$
+declare
+	ln text;
+BEGIN
+	for ln in execute 'explain (costs off) ' || query loop
+		if ln like '%Incremental Sort%' then
+			return true;
+		end if;
+	end loop;
+	return false;
+END;$$ language plpgsql;
+-- Whether the incremental sort of a query had to use disk
+create function incremental_sort_spilled(query text) returns bool as $$
+declare
+	ln text;
+BEGIN
+	for ln in execute 'explain (analyze, costs off, timing off) ' || query loop
+		if ln like '%Sort Method: %Batches: %' then
+			return ln like '%Sort Method: external%';
+		end if;
+	end loop;
+	return null;
+END;$$ language plpgsql;
+-- Number of rows of a query out of the order of its columns a and b
+create function sort_disorder(query text) returns int as $$
+declare
+	r record;
+	pa int;
+	pb int;
+	n int := 0;
+BEGIN
+	for r in execute query loop
+		if pa > r.a or (pa = r.a and pb > r.b) then
+			n := n + 1;
+		end if;
+		pa := r.a;
+		pb := r.b;
+	end loop;
+	return n;
+END;$$ language plpgsql;
+
+-- Rows sorted by a already, only the groups of equal a are sorted by b
+SELECT incremental_sort_used('SELECT a, b FROM (SELECT i / 10 AS a, -i AS b FROM generate_series(1, 1000) i ORDER BY 1) s ORDER BY a, b');
+SET enable_incremental_sort = off;
+SELECT incremental_sort_used('SELECT a, b FROM (SELECT i / 10 AS a, -i AS b FROM generate_series(1, 1000) i ORDER BY 1) s ORDER BY a, b');
+RESET enable_incremental_sort;
+SELECT a, b FROM (SELECT i / 10 AS a, -i AS b FROM generate_series(1, 1000) i ORDER BY 1) s
+	ORDER BY a, b LIMIT 12;
+SELECT sort_disorder('SELECT a, b FROM (SELECT i / 10 AS a, -i AS b FROM generate_series(1, 1000) i ORDER BY 1) s ORDER BY a, b');
+SELECT sort_disorder('SELECT a, b FROM (SELECT i / 100 AS a, (i * 7919) % 5000 AS b FROM generate_series(1, 5000) i ORDER BY 1) s ORDER BY a, b');
+
+-- Groups too big for work_mem are sorted on disk
+SET work_mem = '64kB';
+SELECT incremental_sort_spilled('SELECT a, b, c FROM (SELECT i / 5000 AS a, (i * 7919) % 20000 AS b, repeat(''x'', 100) AS c FROM generate_series(1, 20000) i ORDER BY 1) s ORDER BY a, b');
+SELECT sort_disorder('SELECT a, b, c FROM (SELECT i / 5000 AS a, (i * 7919) % 20000 AS b, repeat(''x'', 100) AS c FROM generate_series(1, 20000) i ORDER BY 1) s ORDER BY a, b');
+RESET work_mem;
+
+-- Backward scans sort all the rows at once
+BEGIN;
+DECLARE c SCROLL CURSOR FOR
+	SELECT a, b FROM (SELECT i / 10 AS a, -i AS b FROM generate_series(1, 1000) i ORDER BY 1) s
+	ORDER BY a, b;
+FETCH 3 FROM c;
+FETCH BACKWARD 2 FROM c;
+FETCH LAST FROM c;
+FETCH BACKWARD 1 FROM c;
+COMMIT;
+
+DROP FUNCTION sort_disorder(text);
+DROP FUNCTION incremental_sort_spilled(text);
+DROP FUNCTION incremental_sort_used(text);
@@ -0,0 +1,64 @@
+--
+-- Result Cache of the inner side of nested loops
+--
+create function resultcache_used(query text) returns bool as $$
+declare
+	ln text;
+BEGIN
+	for ln in execute 'explain (costs off) ' || query loop
+		if ln like '%Result Cache%' then
+			return true;
+		end if;
+	end loop;
+	return false;
+END;$$ language plpgsql;
+-- Hits, misses, evictions and overflows of the result cache of a query
+create function resultcache_stats(query text) returns text as $$
+declare
+	ln text;
+BEGIN
+	for ln in execute 'explain (analyze, costs off, timing off) ' || query loop
+		if ln like '%Hits: %' then
+			return substring(ln from 'Hits: \d+  Misses: \d+  Evictions: \d+  Overflows: \d+');
+		end if;
+	end loop;
+	return null;
+END;$$ language plpgsql;
+
+SET enable_hashjoin = off;
+SET enable_mergejoin = off;
+-- Ten distinct keys, each looked up once
+SELECT resultcache_used('SELECT count(*), sum(t.typlen) FROM (SELECT (16 + i % 10)::oid AS k FROM generate_series(1, 1000) i OFFSET 0) s JOIN pg_type t ON t.oid = s.k');
+SELECT resultcache_stats('SELECT count(*), sum(t.typlen) FROM (SELECT (16 + i % 10)::oid AS k FROM generate_series(1, 1000) i OFFSET 0) s JOIN pg_type t ON t.oid = s.k');
+SELECT count(*), sum(t.typlen) FROM (SELECT (16 + i % 10)::oid AS k FROM generate_series(1, 1000) i OFFSET 0) s JOIN pg_type t ON t.oid = s.k;
+SET enable_resultcache = off;
+SELECT resultcache_used('SELECT count(*), sum(t.typlen) FROM (SELECT (16 + i % 10)::oid AS k FROM generate_series(1, 1000) i OFFSET 0) s JOIN pg_type t ON t.oid = s.k');
+SELECT count(*), sum(t.typlen) FROM (SELECT (16 + i % 10)::oid AS k FROM generate_series(1, 1000) i OFFSET 0) s JOIN pg_type t ON t.oid = s.k;
+RESET enable_resultcache;
+
+-- More keys than fit in work_mem, the least recently used are evicted
+SET work_mem = '64kB';
+SELECT resultcache_stats('SELECT count(*) FROM (SELECT oid AS k FROM pg_proc UNION ALL SELECT oid FROM pg_proc OFFSET 0) s JOIN pg_proc p ON p.oid = s.k') ~ 'Evictions: [1-9]' AS evicted;
+SELECT count(*) = 2 * (SELECT count(*) FROM pg_proc) AS ok FROM (SELECT oid AS k FROM pg_proc UNION ALL SELECT oid FROM pg_proc OFFSET 0) s JOIN pg_proc p ON p.oid = s.k;
+
+-- Keys with more rows than fit in the cache, with and without it
+CREATE TABLE resultcache_inner (k int, v text) DISTRIBUTE BY REPLICATION;
+CREATE INDEX ON resultcache_inner (k);
+INSERT INTO resultcache_inner SELECT i, 'v' || i FROM generate_series(1, 100) i;
+INSERT INTO resultcache_inner SELECT 0, repeat('x', 100) FROM generate_series(1, 2000);
+ANALYZE resultcache_inner;
+SELECT count(*), count(r.v), sum(length(r.v))
+	FROM (SELECT i % 110 AS k FROM generate_series(1, 1000) i OFFSET 0) s
+	LEFT JOIN resultcache_inner r ON r.k = s.k;
+SET enable_resultcache = off;
+SELECT count(*), count(r.v), sum(length(r.v))
+	FROM (SELECT i % 110 AS k FROM generate_series(1, 1000) i OFFSET 0) s
+	LEFT JOIN resultcache_inner r ON r.k = s.k;
+
+RESET enable_resultcache;
+RESET work_mem;
+RESET enable_mergejoin;
+RESET enable_hashjoin;
+DROP TABLE resultcache_inner;
+DROP FUNCTION resultcache_stats(text);
+DROP FUNCTION resultcache_used(text);
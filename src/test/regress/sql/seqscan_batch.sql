@@ -0,0 +1,42 @@
+--
+-- Quals of sequential scans checked a page at a time
+--
+CREATE TABLE seqscan_batch (i2 int2, i4 int4, i8 int8, d date, f4 float4, f8 float8, j int4);
+INSERT INTO seqscan_batch
+	SELECT CASE WHEN i % 7 = 0 THEN NULL ELSE i % 100 END, i, i * 10000000000::int8,
+		'2000-01-01'::date + i, CASE WHEN i % 11 = 0 THEN NULL ELSE i / 4.0 END,
+		CASE WHEN i % 50 = 0 THEN 'NaN' ELSE i / 8.0 END, i % 10
+	FROM generate_series(1, 2000) i;
+
+-- Comparisons of a column with a constant
+SELECT count(*) FROM seqscan_batch WHERE i4 > 1500;
+SELECT count(*) FROM seqscan_batch WHERE i2 < 10;
+SELECT count(*) FROM seqscan_batch WHERE i2 = 5::int8;
+SELECT count(*) FROM seqscan_batch WHERE 15000000000000 <= i8;
+SELECT count(*) FROM seqscan_batch WHERE d >= '2000-02-01' AND d <= '2000-03-01';
+SELECT count(*) FROM seqscan_batch WHERE f4 <= 100.5;
+SELECT count(*) FROM seqscan_batch WHERE f4 < 3::float8;
+
+-- NaN is above all the other values
+SELECT count(*) FROM seqscan_batch WHERE f8 > 200;
+SELECT count(*) FROM seqscan_batch WHERE f8 < 'NaN';
+SELECT count(*) FROM seqscan_batch WHERE f8 = 'NaN';
+
+-- Comparisons of two columns
+SELECT count(*) FROM seqscan_batch WHERE i4 > i2;
+SELECT count(*) FROM seqscan_batch WHERE f4 < f8;
+
+-- Several quals, some of them checked a tuple at a time
+SELECT count(*) FROM seqscan_batch WHERE j = 3 AND i4 < 100;
+SELECT count(*) FROM seqscan_batch WHERE i4 > 1000 AND i4 % 3 = 0;
+SELECT sum(i4), min(d) - '2000-01-01' AS days, max(f4) FROM seqscan_batch WHERE i2 IS NOT NULL AND i2 >= 98;
+
+-- The other quals see only the rows passing the checked ones
+SELECT count(*) FROM seqscan_batch WHERE j >= 0 AND 100 / (j - 3) > 0;
+SELECT count(*) FROM seqscan_batch WHERE j <> 3 AND 100 / (j - 3) > 0;
+
+-- Deleted rows are not seen
+DELETE FROM seqscan_batch WHERE i4 > 1000;
+SELECT count(*) FROM seqscan_batch WHERE i4 > 500;
+
+DROP TABLE seqscan_batch;
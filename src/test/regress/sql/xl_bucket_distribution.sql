@@ -0,0 +1,62 @@
+--
+-- Distribution by bucket
+--
+create function xl_bucket_nodename(integer) returns name as $$
+declare
+	n name;
+BEGIN
+	select node_name into n from pgxc_node where node_id = $1;
+	RETURN n;
+END;$$ language plpgsql;
+-- Number of buckets of the table on each node
+create function xl_bucket_shares(regclass) returns table (node name, buckets bigint) as $$
+	select n.node_name, count(*)
+	from pgxc_class c, generate_series(0, c.pchashbuckets - 1) b, pgxc_node n
+	where c.pcrelid = $1 and n.oid = c.nodeoids[c.pcbucketmap[b]]
+	group by n.node_name order by n.node_name;
+$$ language sql;
+
+CREATE TABLE xl_bucket (a int, b text) DISTRIBUTE BY BUCKET (a);
+SELECT pclocatortype, pchashbuckets FROM pgxc_class WHERE pcrelid = 'xl_bucket'::regclass;
+SELECT * FROM xl_bucket_shares('xl_bucket');
+INSERT INTO xl_bucket SELECT i, 'row ' || i FROM generate_series(1, 1000) i;
+-- Every row is on the node of its bucket
+SELECT count(*) FROM xl_bucket
+	WHERE xl_bucket_nodename(xc_node_id) <> pgxc_node_for_value('xl_bucket', a::text);
+SELECT * FROM xl_bucket WHERE a = 42;
+UPDATE xl_bucket SET b = 'updated' WHERE a % 100 = 0;
+DELETE FROM xl_bucket WHERE a > 990;
+SELECT count(*), sum(a), count(*) FILTER (WHERE b = 'updated') AS updated FROM xl_bucket;
+
+-- Removing a node moves only its buckets
+SELECT array_agg(c.nodeoids[c.pcbucketmap[b]] ORDER BY b) AS xl_bucket_map
+	FROM pgxc_class c, generate_series(0, c.pchashbuckets - 1) b
+	WHERE c.pcrelid = 'xl_bucket'::regclass \gset
+ALTER TABLE xl_bucket DELETE NODE (datanode_2);
+SELECT * FROM xl_bucket_shares('xl_bucket');
+SELECT count(*) AS moved
+	FROM pgxc_class c, generate_series(0, c.pchashbuckets - 1) b
+	WHERE c.pcrelid = 'xl_bucket'::regclass
+	AND c.nodeoids[c.pcbucketmap[b]] <> (:'xl_bucket_map'::oid[])[b + 1];
+
+-- Adding it back moves the surplus of the other node only
+SELECT array_agg(c.nodeoids[c.pcbucketmap[b]] ORDER BY b) AS xl_bucket_map
+	FROM pgxc_class c, generate_series(0, c.pchashbuckets - 1) b
+	WHERE c.pcrelid = 'xl_bucket'::regclass \gset
+ALTER TABLE xl_bucket ADD NODE (datanode_2);
+SELECT * FROM xl_bucket_shares('xl_bucket');
+SELECT count(*) AS moved
+	FROM pgxc_class c, generate_series(0, c.pchashbuckets - 1) b
+	WHERE c.pcrelid = 'xl_bucket'::regclass
+	AND c.nodeoids[c.pcbucketmap[b]] <> (:'xl_bucket_map'::oid[])[b + 1];
+SELECT count(*), sum(a), count(*) FILTER (WHERE b = 'updated') AS updated FROM xl_bucket;
+SELECT count(*) FROM xl_bucket
+	WHERE xl_bucket_nodename(xc_node_id) <> pgxc_node_for_value('xl_bucket', a::text);
+
+-- Not allowed
+CREATE TABLE xl_bucket_ref (a int REFERENCES xl_bucket (a)) DISTRIBUTE BY HASH (a);
+CREATE TABLE xl_bucket_bad (p point) DISTRIBUTE BY BUCKET (p);
+
+DROP TABLE xl_bucket;
+DROP FUNCTION xl_bucket_shares(regclass);
+DROP FUNCTION xl_bucket_nodename(integer);
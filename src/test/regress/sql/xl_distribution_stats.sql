@@ -0,0 +1,41 @@
+--
+-- Distribution of the rows of tables over the Datanodes
+--
+CREATE TABLE xl_dist_even (a int, b text) DISTRIBUTE BY MODULO (a);
+INSERT INTO xl_dist_even SELECT i, 'row ' || i FROM generate_series(1, 100) i;
+SELECT node_name, rows, size > 0 AS size, skew, buckets, bucket_moves
+	FROM pgxc_get_distribution('xl_dist_even') ORDER BY node_name;
+
+-- All the rows on a single node
+CREATE TABLE xl_dist_skewed (a int) DISTRIBUTE BY MODULO (a);
+INSERT INTO xl_dist_skewed SELECT 2 * i FROM generate_series(1, 100) i;
+SELECT rows, skew FROM pgxc_get_distribution('xl_dist_skewed') ORDER BY rows;
+
+-- Replicated tables have no skew and are not in the view
+CREATE TABLE xl_dist_rep (a int) DISTRIBUTE BY REPLICATION;
+INSERT INTO xl_dist_rep SELECT generate_series(1, 10);
+SELECT node_name, rows, skew FROM pgxc_get_distribution('xl_dist_rep') ORDER BY node_name;
+SELECT tablename, rows, skew FROM pgxc_distribution
+	WHERE tablename LIKE 'xl_dist%' ORDER BY tablename, rows;
+
+-- Tables distributed by buckets
+CREATE TABLE xl_dist_bucket (a int) DISTRIBUTE BY BUCKET (a);
+INSERT INTO xl_dist_bucket SELECT generate_series(1, 1000);
+SELECT node_name, buckets, bucket_moves IS NOT NULL AS bucket_moves
+	FROM pgxc_get_distribution('xl_dist_bucket') ORDER BY node_name;
+SELECT sum(rows) FROM pgxc_get_distribution('xl_dist_bucket');
+
+-- Most common values of the distribution column
+CREATE TABLE xl_dist_hot (a int, b int) DISTRIBUTE BY MODULO (a);
+INSERT INTO xl_dist_hot SELECT 2, i FROM generate_series(1, 300) i;
+INSERT INTO xl_dist_hot SELECT 1, i FROM generate_series(1, 100) i;
+ANALYZE xl_dist_hot;
+SELECT attname, null_frac, n_distinct, most_common_vals, most_common_freqs
+	FROM pgxc_distribution_hot_values WHERE tablename = 'xl_dist_hot';
+SELECT rows, skew FROM pgxc_get_distribution('xl_dist_hot') ORDER BY rows;
+
+DROP TABLE xl_dist_even;
+DROP TABLE xl_dist_skewed;
+DROP TABLE xl_dist_rep;
+DROP TABLE xl_dist_bucket;
+DROP TABLE xl_dist_hot;
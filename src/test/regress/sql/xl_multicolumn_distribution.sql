@@ -0,0 +1,61 @@
+--
+-- Distribution by hash of several columns
+--
+create function xl_mcol_nodename(integer) returns name as $$
+declare
+	n name;
+BEGIN
+	select node_name into n from pgxc_node where node_id = $1;
+	RETURN n;
+END;$$ language plpgsql;
+-- Number of nodes the remote part of the plan of a query runs on
+create function xl_mcol_plan_nodes(query text) returns int as $$
+declare
+	ln text;
+BEGIN
+	for ln in execute 'explain (costs off) ' || query loop
+		if ln like '%Remote Subquery Scan%' then
+			return array_length(regexp_split_to_array(ln, ','), 1);
+		end if;
+	end loop;
+	return 0;
+END;$$ language plpgsql;
+
+CREATE TABLE xl_mcol (a int, b text, c int, PRIMARY KEY (a, b)) DISTRIBUTE BY HASH (a, b);
+SELECT pclocatortype, pcattnums FROM pgxc_class WHERE pcrelid = 'xl_mcol'::regclass;
+INSERT INTO xl_mcol SELECT i % 10, 'b' || i / 10, i FROM generate_series(1, 1000) i;
+-- Every row is on the node of the combination of its keys
+SELECT count(*) FROM xl_mcol
+	WHERE xl_mcol_nodename(xc_node_id) <> pgxc_node_for_value('xl_mcol', a::text, b);
+-- Both nodes are used
+SELECT count(DISTINCT xc_node_id) FROM xl_mcol;
+
+-- Only equality on all the keys restricts the nodes
+SELECT xl_mcol_plan_nodes($$SELECT * FROM xl_mcol WHERE a = 1 AND b = 'b5'$$);
+SELECT xl_mcol_plan_nodes($$SELECT * FROM xl_mcol WHERE a = 1$$);
+SELECT * FROM xl_mcol WHERE a = 1 AND b = 'b5';
+UPDATE xl_mcol SET c = -c WHERE a = 1 AND b = 'b5';
+SELECT * FROM xl_mcol WHERE b = 'b5' AND a = 1;
+INSERT INTO xl_mcol VALUES (1, 'b5', 0);
+SELECT count(*) FROM xl_mcol t1 JOIN xl_mcol t2 ON t1.a = t2.a AND t1.b = t2.b;
+
+-- Redistribution on the keys in the other order
+ALTER TABLE xl_mcol DISTRIBUTE BY HASH (b, a);
+SELECT pclocatortype, pcattnums FROM pgxc_class WHERE pcrelid = 'xl_mcol'::regclass;
+SELECT count(*) FROM xl_mcol
+	WHERE xl_mcol_nodename(xc_node_id) <> pgxc_node_for_value('xl_mcol', b, a::text);
+SELECT count(*), sum(c) FROM xl_mcol;
+
+-- Not allowed
+CREATE TABLE xl_mcol_bad (a int, b int)
+  DISTRIBUTE BY MODULO (a, b);
+CREATE TABLE xl_mcol_bad (a int, b int) DISTRIBUTE BY HASH (a, a);
+CREATE TABLE xl_mcol_bad (a int, p point) DISTRIBUTE BY HASH (a, p);
+CREATE TABLE xl_mcol_bad (a int, b int, UNIQUE (a)) DISTRIBUTE BY HASH (a, b);
+CREATE UNIQUE INDEX ON xl_mcol (a);
+CREATE TABLE xl_mcol_ref (a int, b text, FOREIGN KEY (a, b) REFERENCES xl_mcol (a, b))
+	DISTRIBUTE BY HASH (a);
+
+DROP TABLE xl_mcol;
+DROP FUNCTION xl_mcol_plan_nodes(text);
+DROP FUNCTION xl_mcol_nodename(integer);
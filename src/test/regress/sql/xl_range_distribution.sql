@@ -0,0 +1,51 @@
+--
+-- Distribution by range
+--
+create function xl_range_nodename(integer) returns name as $$
+declare
+	n name;
+BEGIN
+	select node_name into n from pgxc_node where node_id = $1;
+	RETURN n;
+END;$$ language plpgsql;
+
+CREATE TABLE xl_range (a int, b text) DISTRIBUTE BY RANGE (a) VALUES (500);
+SELECT pclocatortype, pcranges FROM pgxc_class WHERE pcrelid = 'xl_range'::regclass;
+INSERT INTO xl_range SELECT i, 'row ' || i FROM generate_series(1, 1000) i;
+INSERT INTO xl_range VALUES (NULL, 'null row');
+-- Values below the split point and NULLs are on the first node
+SELECT xl_range_nodename(xc_node_id) AS node, count(*), min(a), max(a)
+	FROM xl_range GROUP BY 1 ORDER BY 1;
+SELECT count(*) FROM xl_range
+	WHERE a IS NOT NULL
+	AND xl_range_nodename(xc_node_id) <> pgxc_node_for_value('xl_range', a::text);
+SELECT * FROM xl_range WHERE a = 500;
+SELECT * FROM xl_range WHERE a IS NULL;
+
+-- Inequalities on the distribution column restrict the nodes
+EXPLAIN (costs off) SELECT * FROM xl_range WHERE a < 100;
+EXPLAIN (costs off) SELECT * FROM xl_range WHERE a >= 500;
+EXPLAIN (costs off) SELECT * FROM xl_range WHERE 600 > a;
+SELECT count(*) FROM xl_range WHERE a < 100;
+SELECT count(*) FROM xl_range WHERE a >= 500;
+SELECT count(*) FROM xl_range WHERE 600 > a;
+
+-- New split points move the rows
+ALTER TABLE xl_range DISTRIBUTE BY RANGE (a) VALUES (100);
+SELECT pcranges FROM pgxc_class WHERE pcrelid = 'xl_range'::regclass;
+SELECT xl_range_nodename(xc_node_id) AS node, count(*), min(a), max(a)
+	FROM xl_range GROUP BY 1 ORDER BY 1;
+
+-- The split points have to match the nodes
+ALTER TABLE xl_range DELETE NODE (datanode_2);
+CREATE TABLE xl_range_bad (a int) DISTRIBUTE BY RANGE (a) VALUES (10, 20);
+CREATE TABLE xl_range_bad (a int) DISTRIBUTE BY RANGE (a) VALUES (20, 10);
+CREATE TABLE xl_range_bad (a int)
+  DISTRIBUTE BY RANGE (a);
+CREATE TABLE xl_range_bad (a int)
+  DISTRIBUTE BY HASH (a) VALUES (10);
+CREATE TABLE xl_range_bad (p point) DISTRIBUTE BY RANGE (p) VALUES ('(1,1)');
+CREATE TABLE xl_range_ref (a int REFERENCES xl_range (a)) DISTRIBUTE BY HASH (a);
+
+DROP TABLE xl_range;
+DROP FUNCTION xl_range_nodename(integer);
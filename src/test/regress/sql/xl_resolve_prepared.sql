@@ -0,0 +1,36 @@
+--
+-- Resolution of in-doubt prepared transactions
+--
+CREATE TABLE xl_resolve (a int) DISTRIBUTE BY REPLICATION;
+
+-- A transaction prepared on all its nodes by PREPARE TRANSACTION is left alone
+BEGIN;
+INSERT INTO xl_resolve SELECT generate_series(1, 10);
+PREPARE TRANSACTION 'xl_resolve_1';
+SELECT gid, action FROM pgxc_resolve_prepared(0) WHERE gid LIKE 'xl_resolve%';
+SELECT gid FROM pg_prepared_xacts WHERE gid LIKE 'xl_resolve%';
+
+-- Once committed on a node, it is committed on the others
+EXECUTE DIRECT ON (datanode_1) 'COMMIT PREPARED ''xl_resolve_1''';
+SELECT gid, action FROM pgxc_resolve_prepared(3600) WHERE gid LIKE 'xl_resolve%';
+SELECT gid, action FROM pgxc_resolve_prepared(0) WHERE gid LIKE 'xl_resolve%';
+SELECT gid FROM pg_prepared_xacts WHERE gid LIKE 'xl_resolve%';
+SELECT count(*) FROM xl_resolve;
+
+-- Once rolled back on a node, it is rolled back on the others
+BEGIN;
+DELETE FROM xl_resolve;
+PREPARE TRANSACTION 'xl_resolve_2';
+EXECUTE DIRECT ON (datanode_2) 'ROLLBACK PREPARED ''xl_resolve_2''';
+SELECT gid, action FROM pgxc_resolve_prepared(0) WHERE gid LIKE 'xl_resolve%';
+SELECT gid FROM pg_prepared_xacts WHERE gid LIKE 'xl_resolve%';
+SELECT count(*) FROM xl_resolve;
+
+-- Only superusers may resolve transactions
+CREATE ROLE regress_xl_resolve;
+SET ROLE regress_xl_resolve;
+SELECT * FROM pgxc_resolve_prepared(0);
+RESET ROLE;
+
+DROP ROLE regress_xl_resolve;
+DROP TABLE xl_resolve;
@@ -0,0 +1,16 @@
+--
+-- Latency of the messages served by GTM
+--
+SELECT DISTINCT phase FROM pg_stat_gtm ORDER BY phase;
+SELECT count(*) FROM pg_stat_gtm
+	WHERE array_length(latency_histogram, 1) <> 10 OR calls < 0 OR total_time < 0;
+
+-- A transaction writing a table gets its transaction ID and snapshots from GTM
+SELECT sum(calls) AS xl_gtm_calls FROM pg_stat_gtm WHERE phase = 'processing' \gset
+CREATE TABLE xl_stat_gtm (a int) DISTRIBUTE BY HASH (a);
+INSERT INTO xl_stat_gtm SELECT generate_series(1, 10);
+SELECT sum(calls) > :xl_gtm_calls AS served FROM pg_stat_gtm WHERE phase = 'processing';
+SELECT count(*) > 0 AS begin FROM pg_stat_gtm
+	WHERE message LIKE 'MSG_TXN_BEGIN_GETGXID%' AND calls > 0;
+
+DROP TABLE xl_stat_gtm;
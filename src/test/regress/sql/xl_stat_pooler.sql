@@ -0,0 +1,19 @@
+--
+-- Statistics of the connection pools
+--
+CREATE TABLE xl_stat_pooler (a int) DISTRIBUTE BY HASH (a);
+INSERT INTO xl_stat_pooler SELECT generate_series(1, 10);
+SELECT count(*) FROM xl_stat_pooler;
+
+-- The pools of the session give connections to all the Datanodes
+SELECT node_name, node_type, size >= free AS size, acquisitions > 0 AS acquisitions,
+		wait_time >= 0 AS wait_time
+	FROM pg_stat_pooler
+	WHERE database = current_database() AND user_name = current_user
+		AND node_type = 'datanode'
+	ORDER BY node_name;
+SELECT count(*) FROM pg_stat_pooler
+	WHERE node_type NOT IN ('coordinator', 'datanode') OR free < 0
+		OR grow_failures < 0 OR destroyed < 0 OR evicted < 0;
+
+DROP TABLE xl_stat_pooler;
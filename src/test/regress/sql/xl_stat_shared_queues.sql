@@ -0,0 +1,22 @@
+--
+-- Statistics of the shared queues
+--
+SELECT * FROM pg_stat_shared_queues WHERE false;
+
+-- Run a query redistributing rows between the Datanodes
+CREATE TABLE xl_squeue_1 (a int, b int) DISTRIBUTE BY HASH (a);
+CREATE TABLE xl_squeue_2 (a int, b int) DISTRIBUTE BY HASH (a);
+INSERT INTO xl_squeue_1 SELECT i, i % 10 FROM generate_series(1, 1000) i;
+INSERT INTO xl_squeue_2 SELECT i, i FROM generate_series(1, 10) i;
+SELECT count(*) FROM xl_squeue_1 t1 JOIN xl_squeue_2 t2 ON t1.b = t2.b;
+
+-- The Datanodes report their queues
+EXECUTE DIRECT ON (datanode_1) 'SELECT count(*) FROM pg_stat_shared_queues
+	WHERE producer_pauses < 0 OR queue_size < 0 OR tuples < 0 OR bytes < 0
+		OR queue_full < 0 OR spill_tuples < 0 OR spill_bytes < 0
+		OR read_tuples < 0 OR read_waits < 0 OR read_wait_time < 0';
+EXECUTE DIRECT ON (datanode_2) 'SELECT count(*) FROM pg_stat_shared_queues
+	WHERE status NOT IN (''active'', ''eof'', ''error'', ''done'')';
+
+DROP TABLE xl_squeue_1;
+DROP TABLE xl_squeue_2;
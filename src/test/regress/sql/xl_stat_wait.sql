@@ -0,0 +1,21 @@
+--
+-- Distributed waits
+--
+-- This backend is not waiting while it reports itself
+SELECT wait_event_type, wait_event, wait_node FROM pg_stat_activity
+	WHERE pid = pg_backend_pid();
+SELECT wait_event_type FROM pg_stat_wait_histogram ORDER BY wait_event_type;
+SELECT count(*) FROM pg_stat_wait_histogram
+	WHERE waits <> under_1ms + under_10ms + under_100ms + under_1s + under_10s + over_10s
+		OR total_time < 0;
+
+-- Queries on the Datanodes wait for their responses
+SELECT waits AS xl_remote_waits FROM pg_stat_wait_histogram
+	WHERE wait_event_type = 'Remote' \gset
+CREATE TABLE xl_stat_wait (a int) DISTRIBUTE BY HASH (a);
+INSERT INTO xl_stat_wait SELECT generate_series(1, 10);
+SELECT count(*) FROM xl_stat_wait;
+SELECT waits > :xl_remote_waits AS waited FROM pg_stat_wait_histogram
+	WHERE wait_event_type = 'Remote';
+
+DROP TABLE xl_stat_wait;